@@ -0,0 +1,295 @@
+#!/bin/sh
+#
+# Monit startup, reload and steady-state benchmark.
+#
+# Generates a synthetic control file with N services of each type (file,
+# directory, fifo, process, filesystem, program and, if python3 is
+# available, host checks against a local mock HTTP server), runs the
+# monit daemon in the foreground and measures:
+#
+#   parse_ms                  control file syntax check (monit -t), best of 3
+#   first_cycle_ms            daemon start until the end of the first poll cycle
+#   restart_first_cycle_ms    the same with the state file restored
+#   reload_ms                 SIGHUP until the end of the next poll cycle
+#   cycle_cpu_ms              daemon CPU time per poll cycle in the steady state
+#   rss_start_kb, rss_growth_kb  daemon resident size after the first cycle
+#                             and its growth during the steady state run
+#   cli_status_ms             'monit status <service>' including the client start
+#   shell_status_ms           one status query over the 'monit shell' connection
+#
+# The results are printed as one JSON object to stdout, the progress to
+# stderr, so the output of two runs can be compared by a script.
+#
+# Usage: bench.sh [-n services] [-t seconds] [-p port] [-k] <monit binary>
+#   -n  number of services per type (default 100)
+#   -t  steady state duration in seconds (default 30)
+#   -p  port of the mock HTTP server (default 28480)
+#   -k  keep the work directory
+#
+# The synthetic services are owned by the benchmark (its files, fifos and
+# sleeping processes), the /proc tree is the real one of the host.
+#
+
+COUNT=100
+DURATION=30
+PORT=28480
+KEEP=no
+while getopts n:t:p:k option; do
+        case $option in
+        n) COUNT=$OPTARG ;;
+        t) DURATION=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        k) KEEP=yes ;;
+        *) echo "Usage: $0 [-n services] [-t seconds] [-p port] [-k] <monit binary>" >&2; exit 1 ;;
+        esac
+done
+shift $((OPTIND - 1))
+MONIT=${1:?"Usage: $0 [-n services] [-t seconds] [-p port] [-k] <monit binary>"}
+case $MONIT in
+/*) ;;
+*) MONIT=$(pwd)/$MONIT ;;
+esac
+[ -x "$MONIT" ] || { echo "$MONIT: not executable" >&2; exit 1; }
+
+WORK=$(mktemp -d ${TMPDIR:-/tmp}/monit-bench.XXXXXX) || exit 1
+RC=$WORK/monitrc
+STATE=$WORK/monit.state
+DAEMON=
+MOCK=
+SLEEPERS=
+
+
+log() {
+        echo "bench: $*" >&2
+}
+
+
+# Milliseconds since the epoch, falls back to seconds if date doesn't support %N
+now() {
+        t=$(date +%s%N)
+        case $t in
+        *N) echo $(($(date +%s) * 1000)) ;;
+        *) echo $((t / 1000000)) ;;
+        esac
+}
+
+
+cleanup() {
+        [ -n "$DAEMON" ] && kill $DAEMON 2>/dev/null && wait $DAEMON 2>/dev/null
+        [ -n "$MOCK" ] && kill $MOCK 2>/dev/null
+        [ -n "$SLEEPERS" ] && kill $SLEEPERS 2>/dev/null
+        if [ $KEEP = yes ]; then
+                log "work directory $WORK kept"
+        else
+                rm -rf "$WORK"
+        fi
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+
+fail() {
+        KEEP=yes
+        exit 1
+}
+
+
+# The profiler report, via curl if available to not charge the client start to the measurement
+metrics() {
+        if [ $CURL = yes ]; then
+                curl -s --max-time 10 --unix-socket $WORK/monit.sock -u bench:bench http://localhost/_metrics
+        else
+                "$MONIT" -c "$RC" report metrics
+        fi 2>/dev/null
+}
+
+
+# The number of finished poll cycles: each ends with the state save phase
+cycles() {
+        metrics | awk '$1 == "state" && $2 == "save" {n = $3} END {print n + 0}'
+}
+
+
+# Wait until the daemon finished more than the given number of cycles, print the elapsed milliseconds
+wait_for() {
+        limit=$(($(now) + 300000))
+        while [ $(cycles) -le $1 ]; do
+                kill -0 $DAEMON 2>/dev/null || { log "the daemon exited, see $WORK/monit.log"; return 1; }
+                [ $(now) -gt $limit ] && { log "timeout waiting for the poll cycle"; return 1; }
+                sleep 0.01 2>/dev/null || sleep 1
+        done
+        echo $(($(now) - $2))
+}
+
+
+# Resident set size [kB] and CPU time [clock ticks] of the daemon
+rss() {
+        awk '/^VmRSS:/ {print $2}' /proc/$DAEMON/status 2>/dev/null || echo 0
+}
+
+
+cputicks() {
+        # The command name in the second field is enclosed in parentheses and may contain spaces
+        sed 's/^.*) //' /proc/$DAEMON/stat 2>/dev/null | awk '{print $12 + $13}'
+}
+
+
+start_daemon() {
+        "$MONIT" -c "$RC" -I >>$WORK/monit.log 2>&1 &
+        DAEMON=$!
+}
+
+
+stop_daemon() {
+        kill $DAEMON 2>/dev/null
+        wait $DAEMON 2>/dev/null
+        DAEMON=
+}
+
+
+# --------------------------------------------------------- Synthetic setup
+
+
+log "generating $COUNT services of each type in $WORK"
+mkdir -p $WORK/files $WORK/dirs $WORK/fifos $WORK/pids $WORK/www
+echo ok > $WORK/www/index.html
+
+CURL=no
+command -v curl >/dev/null 2>&1 && CURL=yes
+
+HOSTS=no
+if command -v python3 >/dev/null 2>&1; then
+        (cd $WORK/www && exec python3 -m http.server --bind 127.0.0.1 $PORT) >/dev/null 2>&1 &
+        MOCK=$!
+        HOSTS=yes
+else
+        log "python3 not found, no host checks"
+fi
+
+cat > $RC <<EOF
+set daemon 1
+set logfile $WORK/monit.log
+set pidfile $WORK/monit.pid
+set idfile $WORK/monit.id
+set statefile $STATE
+set httpd unixsocket $WORK/monit.sock
+    allow bench:bench
+
+check system bench
+    if loadavg (5min) > 1000 then alert
+EOF
+
+i=0
+while [ $i -lt $COUNT ]; do
+        echo "file $i" > $WORK/files/f$i
+        mkdir -p $WORK/dirs/d$i
+        [ -p $WORK/fifos/p$i ] || mkfifo $WORK/fifos/p$i
+        sleep 86400 &
+        echo $! > $WORK/pids/s$i.pid
+        SLEEPERS="$SLEEPERS $!"
+        cat >> $RC <<EOF
+
+check file file$i with path $WORK/files/f$i
+    if changed checksum then alert
+    if size > 100 MB then alert
+    if timestamp > 1 hour then alert
+
+check directory dir$i with path $WORK/dirs/d$i
+    if changed timestamp then alert
+
+check fifo fifo$i with path $WORK/fifos/p$i
+    if failed permission 644 then alert
+
+check process process$i with pidfile $WORK/pids/s$i.pid
+    if cpu > 90% then alert
+    if totalmem > 1 GB then alert
+
+check filesystem fs$i with path /
+    if space usage > 99% then alert
+
+check program program$i with path /bin/true
+    if status != 0 then alert
+EOF
+        if [ $HOSTS = yes ]; then
+                cat >> $RC <<EOF
+
+check host host$i with address 127.0.0.1
+    if failed port $PORT protocol http then alert
+EOF
+        fi
+        i=$((i + 1))
+done
+chmod 600 $RC
+SERVICES=$(grep -c '^check ' $RC)
+
+
+# ------------------------------------------------------------ Measurements
+
+
+log "parsing the control file"
+PARSE=
+for run in 1 2 3; do
+        start=$(now)
+        "$MONIT" -c "$RC" -t >/dev/null 2>&1 || { log "syntax error in $RC"; fail; }
+        elapsed=$(($(now) - start))
+        if [ -z "$PARSE" ] || [ $elapsed -lt $PARSE ]; then
+                PARSE=$elapsed
+        fi
+done
+
+log "starting the daemon"
+rm -f $STATE
+start=$(now)
+start_daemon
+FIRST=$(wait_for 0 $start) || fail
+RSS_START=$(rss)
+
+log "restarting the daemon with the state file"
+stop_daemon
+start=$(now)
+start_daemon
+RESTART=$(wait_for 0 $start) || fail
+
+log "reloading the daemon"
+count=$(cycles)
+start=$(now)
+kill -HUP $DAEMON
+RELOAD=$(wait_for $count $start) || fail
+
+log "steady state for $DURATION seconds"
+CYCLES_START=$(cycles)
+TICKS_START=$(cputicks)
+RSS_STEADY=$(rss)
+sleep $DURATION
+TICKS_END=$(cputicks)
+CYCLES_END=$(cycles)
+RSS_END=$(rss)
+HZ=$(getconf CLK_TCK 2>/dev/null || echo 100)
+CYCLES=$((CYCLES_END - CYCLES_START))
+if [ $CYCLES -gt 0 ]; then
+        CYCLE_CPU=$(((TICKS_END - TICKS_START) * 1000 / HZ / CYCLES))
+else
+        CYCLE_CPU=null
+fi
+
+log "querying the status"
+QUERIES=20
+start=$(now)
+i=0
+while [ $i -lt $QUERIES ]; do
+        "$MONIT" -c "$RC" status file$i >/dev/null 2>&1
+        i=$((i + 1))
+done
+CLI=$((($(now) - start) / QUERIES))
+i=0
+while [ $i -lt $QUERIES ]; do
+        echo "status file$i"
+        i=$((i + 1))
+done > $WORK/queries
+start=$(now)
+"$MONIT" -c "$RC" shell < $WORK/queries >/dev/null 2>&1
+SHELL_STATUS=$((($(now) - start) / QUERIES))
+
+stop_daemon
+
+echo "{\"services\": $SERVICES, \"count\": $COUNT, \"parse_ms\": $PARSE, \"first_cycle_ms\": $FIRST, \"restart_first_cycle_ms\": $RESTART, \"reload_ms\": $RELOAD, \"cycles\": $CYCLES, \"cycle_cpu_ms\": $CYCLE_CPU, \"rss_start_kb\": ${RSS_START:-0}, \"rss_growth_kb\": $((RSS_END - RSS_STEADY)), \"cli_status_ms\": $CLI, \"shell_status_ms\": $SHELL_STATUS}"
@@ -0,0 +1,216 @@
+#!/bin/sh
+#
+# Monit HTTP interface throughput benchmark.
+#
+# Generates a synthetic control file with N file and N process services,
+# runs the monit daemon in the foreground with the HTTP interface on a local
+# TCP port and drives concurrent clients (httpload.py) against the status
+# pages: the plain text status, the XML status, the summary, the HTML home
+# page and the HTML page of one service. Each page is loaded over plain
+# HTTP and, if openssl is available and monit was built with SSL, over TLS,
+# each with and without keep-alive. For each run it measures:
+#
+#   rps                       completed requests per second
+#   p50_ms, p99_ms, max_ms    request latency percentiles
+#   cpu_us_per_request        daemon CPU time per request
+#   errors                    failed requests
+#
+# The results are printed as one JSON object to stdout, the progress to
+# stderr, so the output of two runs can be compared by a script.
+#
+# Usage: httpbench.sh [-n services] [-c clients] [-t seconds] [-p port] [-k] <monit binary>
+#   -n  number of services per type (default 100)
+#   -c  number of concurrent clients (default 8)
+#   -t  load duration of each run in seconds (default 5)
+#   -p  port of the HTTP interface (default 28481)
+#   -k  keep the work directory
+#
+# Requires python3 for the load generator. The clients run on the same
+# host as the daemon, so use fewer clients than CPUs for server bound
+# numbers.
+#
+
+COUNT=100
+CLIENTS=8
+DURATION=5
+PORT=28481
+KEEP=no
+USAGE="Usage: $0 [-n services] [-c clients] [-t seconds] [-p port] [-k] <monit binary>"
+while getopts n:c:t:p:k option; do
+        case $option in
+        n) COUNT=$OPTARG ;;
+        c) CLIENTS=$OPTARG ;;
+        t) DURATION=$OPTARG ;;
+        p) PORT=$OPTARG ;;
+        k) KEEP=yes ;;
+        *) echo "$USAGE" >&2; exit 1 ;;
+        esac
+done
+shift $((OPTIND - 1))
+MONIT=${1:?"$USAGE"}
+case $MONIT in
+/*) ;;
+*) MONIT=$(pwd)/$MONIT ;;
+esac
+[ -x "$MONIT" ] || { echo "$MONIT: not executable" >&2; exit 1; }
+command -v python3 >/dev/null 2>&1 || { echo "python3 is required for the load generator" >&2; exit 1; }
+LOAD=$(cd "$(dirname "$0")" && pwd)/httpload.py
+
+WORK=$(mktemp -d ${TMPDIR:-/tmp}/monit-httpbench.XXXXXX) || exit 1
+RC=$WORK/monitrc
+DAEMON=
+SLEEPERS=
+
+
+log() {
+        echo "httpbench: $*" >&2
+}
+
+
+cleanup() {
+        [ -n "$DAEMON" ] && kill $DAEMON 2>/dev/null && wait $DAEMON 2>/dev/null
+        [ -n "$SLEEPERS" ] && kill $SLEEPERS 2>/dev/null
+        if [ $KEEP = yes ]; then
+                log "work directory $WORK kept"
+        else
+                rm -rf "$WORK"
+        fi
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+
+fail() {
+        KEEP=yes
+        exit 1
+}
+
+
+# Write the control file, the argument is the httpd SSL setup or empty
+config() {
+        cat > $RC <<EOF
+set daemon 1
+set logfile $WORK/monit.log
+set pidfile $WORK/monit.pid
+set idfile $WORK/monit.id
+set statefile $WORK/monit.state
+set httpd port $PORT
+    use address 127.0.0.1
+    $1
+    allow bench:bench
+
+check system bench
+    if loadavg (5min) > 1000 then alert
+EOF
+        cat $WORK/services >> $RC
+        chmod 600 $RC
+}
+
+
+start_daemon() {
+        "$MONIT" -c "$RC" -I >>$WORK/monit.log 2>&1 &
+        DAEMON=$!
+        # Wait until the first cycle collected the status
+        i=0
+        while [ $i -lt 300 ]; do
+                kill -0 $DAEMON 2>/dev/null || { log "the daemon exited, see $WORK/monit.log"; return 1; }
+                if python3 - $PORT "$1" <<'EOF' 2>/dev/null
+import base64, http.client, ssl, sys
+port, tls = int(sys.argv[1]), sys.argv[2] == "tls"
+c = http.client.HTTPSConnection("127.0.0.1", port, context=ssl._create_unverified_context()) if tls else http.client.HTTPConnection("127.0.0.1", port)
+c.request("GET", "/_status?format=xml", headers={"Authorization": "Basic " + base64.b64encode(b"bench:bench").decode()})
+r = c.getresponse()
+sys.exit(0 if r.status == 200 and b"<collected_sec>" in r.read() else 1)
+EOF
+                then
+                        return 0
+                fi
+                sleep 0.1 2>/dev/null || sleep 1
+                i=$((i + 1))
+        done
+        log "timeout waiting for the HTTP interface"
+        return 1
+}
+
+
+stop_daemon() {
+        kill $DAEMON 2>/dev/null
+        wait $DAEMON 2>/dev/null
+        DAEMON=
+}
+
+
+# Load all pages with and without keep-alive, the argument is "tls" or "plain"
+load() {
+        for path in "/_status" "/_status?format=xml" "/_summary" "/" "/process0"; do
+                for keepalive in "" "--keepalive"; do
+                        tls=
+                        [ $1 = tls ] && tls=--tls
+                        log "$1 $path ${keepalive:---no-keepalive}"
+                        result=$(python3 "$LOAD" --port $PORT --path "$path" --user bench:bench --clients $CLIENTS --duration $DURATION --pid $DAEMON $tls $keepalive) || { log "no request completed, see $WORK/monit.log"; fail; }
+                        RESULTS="$RESULTS${RESULTS:+, }$result"
+                done
+        done
+}
+
+
+# --------------------------------------------------------- Synthetic setup
+
+
+log "generating $COUNT services of each type in $WORK"
+mkdir -p $WORK/files $WORK/pids
+: > $WORK/services
+i=0
+while [ $i -lt $COUNT ]; do
+        echo "file $i" > $WORK/files/f$i
+        sleep 86400 &
+        echo $! > $WORK/pids/s$i.pid
+        SLEEPERS="$SLEEPERS $!"
+        cat >> $WORK/services <<EOF
+
+check file file$i with path $WORK/files/f$i
+    if size > 100 MB then alert
+    if timestamp > 1 hour then alert
+
+check process process$i with pidfile $WORK/pids/s$i.pid
+    if cpu > 90% then alert
+    if totalmem > 1 GB then alert
+EOF
+        i=$((i + 1))
+done
+SERVICES=$(($(grep -c '^check ' $WORK/services) + 1))
+
+
+# ------------------------------------------------------------ Measurements
+
+
+RESULTS=
+
+log "starting the daemon with plain HTTP"
+config ""
+"$MONIT" -c "$RC" -t >/dev/null 2>&1 || { log "syntax error in $RC"; fail; }
+start_daemon plain || fail
+load plain
+stop_daemon
+
+TLS=no
+if command -v openssl >/dev/null 2>&1; then
+        openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=localhost -keyout $WORK/key.pem -out $WORK/cert.pem >/dev/null 2>&1 && cat $WORK/key.pem $WORK/cert.pem > $WORK/monit.pem
+        chmod 600 $WORK/monit.pem 2>/dev/null
+        config "ssl enable pemfile $WORK/monit.pem"
+        if [ -s $WORK/monit.pem ] && "$MONIT" -c "$RC" -t >/dev/null 2>&1; then
+                TLS=yes
+        else
+                log "monit built without SSL, no TLS runs"
+        fi
+else
+        log "openssl not found, no TLS runs"
+fi
+if [ $TLS = yes ]; then
+        log "starting the daemon with TLS"
+        start_daemon tls || fail
+        load tls
+        stop_daemon
+fi
+
+echo "{\"services\": $SERVICES, \"clients\": $CLIENTS, \"duration_s\": $DURATION, \"runs\": [$RESULTS]}"
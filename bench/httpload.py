@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+#
+# HTTP load generator for the Monit HTTP interface benchmark, see httpbench.sh.
+#
+# Runs the given number of concurrent clients against one URL path for the
+# given duration. Each client is a separate process, so the client side isn't
+# serialized by the interpreter lock. With keep-alive the client sends all
+# its requests over one HTTP/1.1 connection (reconnecting if the server
+# closes it), otherwise it opens a new connection (and a new TLS session)
+# for each request.
+#
+# Prints one JSON object to stdout:
+#
+#   requests, errors          completed and failed requests
+#   rps                       completed requests per second
+#   p50_ms, p99_ms, max_ms    request latency percentiles
+#   cpu_us_per_request        daemon CPU time per completed request, if the
+#                             daemon PID is given (Linux /proc)
+#
+
+import argparse
+import base64
+import http.client
+import json
+import multiprocessing
+import os
+import ssl
+import sys
+import time
+
+
+def cputime(pid):
+        """User and system CPU time of the process [s] or None if n/a"""
+        if not pid:
+                return None
+        try:
+                with open("/proc/%d/stat" % pid) as f:
+                        # The command name in the second field is enclosed in parentheses and may contain spaces
+                        fields = f.read().rsplit(")", 1)[1].split()
+                return (int(fields[11]) + int(fields[12])) / os.sysconf("SC_CLK_TCK")
+        except (OSError, IndexError, ValueError):
+                return None
+
+
+def connect(args):
+        if args.tls:
+                context = ssl.create_default_context()
+                context.check_hostname = False
+                context.verify_mode = ssl.CERT_NONE
+                return http.client.HTTPSConnection(args.host, args.port, timeout=30, context=context)
+        return http.client.HTTPConnection(args.host, args.port, timeout=30)
+
+
+def client(args, start, deadline, results):
+        headers = {}
+        if args.user:
+                headers["Authorization"] = "Basic " + base64.b64encode(args.user.encode()).decode()
+        if not args.keepalive:
+                headers["Connection"] = "close"
+        latencies = []
+        errors = 0
+        connection = None
+        while time.time() < start:
+                time.sleep(0.001)
+        while time.time() < deadline:
+                t = time.perf_counter()
+                try:
+                        if connection is None:
+                                connection = connect(args)
+                        connection.request("GET", args.path, headers=headers)
+                        response = connection.getresponse()
+                        response.read()
+                        if response.status != 200:
+                                errors += 1
+                        else:
+                                latencies.append((time.perf_counter() - t) * 1000.)
+                        if not args.keepalive or response.will_close:
+                                connection.close()
+                                connection = None
+                except (OSError, http.client.HTTPException):
+                        errors += 1
+                        if connection:
+                                connection.close()
+                        connection = None
+        if connection:
+                connection.close()
+        results.put((latencies, errors))
+
+
+def percentile(values, p):
+        if not values:
+                return None
+        return round(values[min(len(values) - 1, int(len(values) * p / 100.))], 3)
+
+
+def main():
+        parser = argparse.ArgumentParser(description="Monit HTTP interface load generator")
+        parser.add_argument("--host", default="127.0.0.1")
+        parser.add_argument("--port", type=int, required=True)
+        parser.add_argument("--path", default="/_status")
+        parser.add_argument("--user", help="user:password for the basic authentication")
+        parser.add_argument("--tls", action="store_true")
+        parser.add_argument("--keepalive", action="store_true")
+        parser.add_argument("--clients", type=int, default=4)
+        parser.add_argument("--duration", type=float, default=10.)
+        parser.add_argument("--pid", type=int, help="daemon PID for the CPU time per request")
+        args = parser.parse_args()
+
+        results = multiprocessing.Queue()
+        # Start all clients at the same time, after the processes were forked
+        start = time.time() + 0.5
+        deadline = start + args.duration
+        clients = [multiprocessing.Process(target=client, args=(args, start, deadline, results)) for _ in range(args.clients)]
+        for c in clients:
+                c.start()
+        while time.time() < start:
+                time.sleep(0.001)
+        cpu_start = cputime(args.pid)
+        latencies = []
+        errors = 0
+        for _ in clients:
+                l, e = results.get()
+                latencies.extend(l)
+                errors += e
+        cpu_end = cputime(args.pid)
+        for c in clients:
+                c.join()
+        latencies.sort()
+        requests = len(latencies)
+        cpu = None
+        if cpu_start is not None and cpu_end is not None and requests:
+                cpu = round((cpu_end - cpu_start) * 1000000. / requests, 1)
+        json.dump({
+                "path": args.path,
+                "tls": args.tls,
+                "keepalive": args.keepalive,
+                "clients": args.clients,
+                "requests": requests,
+                "errors": errors,
+                "rps": round(requests / args.duration, 1),
+                "p50_ms": percentile(latencies, 50),
+                "p99_ms": percentile(latencies, 99),
+                "max_ms": round(latencies[-1], 3) if latencies else None,
+                "cpu_us_per_request": cpu
+        }, sys.stdout)
+        sys.stdout.write("\n")
+        return 0 if requests else 1
+
+
+if __name__ == "__main__":
+        sys.exit(main())
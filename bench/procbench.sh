@@ -0,0 +1,128 @@
+#!/bin/sh
+#
+# Monit process engine benchmark.
+#
+# Replays a recorded process table snapshot through the process collector
+# (the /proc parsing on Linux, the kinfo_proc conversion on FreeBSD and
+# macOS) and the process tree builder in a loop, so changes of this code
+# can be measured with the same input on any machine. Without a snapshot,
+# the process table of the host is recorded first, optionally grown with
+# sleeping processes. For each run (without and with the command line and
+# container collection) it measures:
+#
+#   first_cycle_ns_per_process   the first cycle, with empty caches
+#   ns_per_process               the following cycles
+#   first_cycle_allocations      heap allocations of the first cycle
+#   allocations_per_cycle        heap allocations of the following cycles
+#
+# With -g the tree builder is measured with generated process tables of
+# 1k, 10k and 100k processes instead, so its scaling can be seen without
+# starting that many processes. The runs report the same times and the
+# allocations per cycle plus lookup_ns, the cost of a PID lookup.
+#
+# The allocations are the ones made through the libmonit allocator. The
+# results are printed as one JSON object to stdout, the progress to
+# stderr, so the output of two runs can be compared by a script.
+#
+# Usage: procbench.sh [-g] [-s snapshot] [-r snapshot] [-p processes] [-n cycles] [-k] <monit binary>
+#   -g  benchmark the tree builder with generated process tables
+#   -s  replay this snapshot instead of recording one
+#   -r  record the snapshot to this new directory and keep it
+#   -p  number of sleeping processes started before recording (default 0)
+#   -n  number of measured cycles (default 100)
+#   -k  keep the work directory
+#
+# A snapshot can be replayed on the same platform only, the kinfo_proc
+# snapshots on the same OS release and architecture only.
+#
+
+SNAPSHOT=
+RECORD=
+PROCESSES=0
+CYCLES=100
+KEEP=no
+SYNTHETIC=no
+USAGE="Usage: $0 [-g] [-s snapshot] [-r snapshot] [-p processes] [-n cycles] [-k] <monit binary>"
+while getopts gs:r:p:n:k option; do
+        case $option in
+        g) SYNTHETIC=yes ;;
+        s) SNAPSHOT=$OPTARG ;;
+        r) RECORD=$OPTARG ;;
+        p) PROCESSES=$OPTARG ;;
+        n) CYCLES=$OPTARG ;;
+        k) KEEP=yes ;;
+        *) echo "$USAGE" >&2; exit 1 ;;
+        esac
+done
+shift $((OPTIND - 1))
+MONIT=${1:?"$USAGE"}
+case $MONIT in
+/*) ;;
+*) MONIT=$(pwd)/$MONIT ;;
+esac
+[ -x "$MONIT" ] || { echo "$MONIT: not executable" >&2; exit 1; }
+
+WORK=$(mktemp -d ${TMPDIR:-/tmp}/monit-procbench.XXXXXX) || exit 1
+RC=$WORK/monitrc
+SLEEPERS=
+
+
+log() {
+        echo "procbench: $*" >&2
+}
+
+
+cleanup() {
+        [ -n "$SLEEPERS" ] && kill $SLEEPERS 2>/dev/null
+        if [ $KEEP = yes ]; then
+                log "work directory $WORK kept"
+        else
+                rm -rf "$WORK"
+        fi
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+
+fail() {
+        KEEP=yes
+        exit 1
+}
+
+
+cat > $RC <<EOF
+set logfile $WORK/monit.log
+set pidfile $WORK/monit.pid
+set idfile $WORK/monit.id
+set statefile $WORK/monit.state
+
+check system bench
+    if loadavg (5min) > 1000 then alert
+EOF
+chmod 600 $RC
+
+if [ $SYNTHETIC = yes ]; then
+        log "building generated process trees for $CYCLES cycles"
+        "$MONIT" -c "$RC" procbench $CYCLES || fail
+        exit 0
+fi
+
+if [ -z "$SNAPSHOT" ]; then
+        SNAPSHOT=${RECORD:-$WORK/snapshot}
+        if [ $PROCESSES -gt 0 ]; then
+                log "starting $PROCESSES sleeping processes"
+                i=0
+                while [ $i -lt $PROCESSES ]; do
+                        sleep 86400 &
+                        SLEEPERS="$SLEEPERS $!"
+                        i=$((i + 1))
+                done
+        fi
+        log "recording the process table to $SNAPSHOT"
+        "$MONIT" -c "$RC" procsnapshot record "$SNAPSHOT" >&2 || fail
+        [ -n "$SLEEPERS" ] && kill $SLEEPERS 2>/dev/null
+        SLEEPERS=
+fi
+
+log "replaying $SNAPSHOT for $CYCLES cycles"
+"$MONIT" -c "$RC" procsnapshot replay "$SNAPSHOT" $CYCLES || fail
@@ -0,0 +1,108 @@
+#!/bin/sh
+#
+# Monit service list benchmark.
+#
+# Generates a synthetic control file with N services of all types and runs
+# the service list walks of each poll cycle over it in a loop, so the cost
+# of the service iteration can be compared between builds. The services
+# are not monitored during the benchmark, no test is run. It measures per
+# service:
+#
+#   validate_ns_per_service     the validation loop and the scheduler rebuild
+#   state_save_ns_per_service   the state file update
+#   status_ns_per_service       the delta status poll of the HTTP interface
+#
+# service_size is the size of the service structure. The results are
+# printed as one JSON object to stdout, the progress to stderr, so the
+# output of two runs can be compared by a script.
+#
+# Usage: servicebench.sh [-n services] [-c cycles] [-k] <monit binary>
+#   -n  number of services (default 10000)
+#   -c  number of measured cycles (default 100)
+#   -k  keep the work directory
+#
+
+COUNT=10000
+CYCLES=100
+KEEP=no
+USAGE="Usage: $0 [-n services] [-c cycles] [-k] <monit binary>"
+while getopts n:c:k option; do
+        case $option in
+        n) COUNT=$OPTARG ;;
+        c) CYCLES=$OPTARG ;;
+        k) KEEP=yes ;;
+        *) echo "$USAGE" >&2; exit 1 ;;
+        esac
+done
+shift $((OPTIND - 1))
+MONIT=${1:?"$USAGE"}
+case $MONIT in
+/*) ;;
+*) MONIT=$(pwd)/$MONIT ;;
+esac
+[ -x "$MONIT" ] || { echo "$MONIT: not executable" >&2; exit 1; }
+
+WORK=$(mktemp -d ${TMPDIR:-/tmp}/monit-servicebench.XXXXXX) || exit 1
+RC=$WORK/monitrc
+
+
+log() {
+        echo "servicebench: $*" >&2
+}
+
+
+cleanup() {
+        if [ $KEEP = yes ]; then
+                log "work directory $WORK kept"
+        else
+                rm -rf "$WORK"
+        fi
+}
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+
+
+fail() {
+        KEEP=yes
+        exit 1
+}
+
+
+log "generating $COUNT services in $RC"
+cat > $RC <<EOF
+set logfile $WORK/monit.log
+set pidfile $WORK/monit.pid
+set idfile $WORK/monit.id
+set statefile $WORK/monit.state
+
+check system bench
+    if loadavg (5min) > 1000 then alert
+EOF
+
+# The services are not checked, so their files and processes need not exist
+i=1
+while [ $i -lt $COUNT ]; do
+        case $((i % 7)) in
+        0) echo "check file file$i with path $WORK/f$i
+    if changed checksum then alert
+    if size > 100 MB then alert" ;;
+        1) echo "check directory dir$i with path $WORK/d$i
+    if changed timestamp then alert" ;;
+        2) echo "check fifo fifo$i with path $WORK/p$i
+    if failed permission 644 then alert" ;;
+        3) echo "check process process$i with pidfile $WORK/s$i.pid
+    if cpu > 90% then alert
+    if totalmem > 1 GB then alert" ;;
+        4) echo "check filesystem fs$i with path /
+    if space usage > 99% then alert" ;;
+        5) echo "check program program$i with path /bin/true
+    if status != 0 then alert" ;;
+        6) echo "check host host$i with address 127.0.0.1
+    if failed port 80 protocol http then alert" ;;
+        esac
+        i=$((i + 1))
+done >> $RC
+chmod 600 $RC
+
+log "walking the service list for $CYCLES cycles"
+"$MONIT" -c "$RC" servicebench $CYCLES || fail
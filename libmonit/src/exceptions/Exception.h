@@ -185,7 +185,7 @@ typedef struct T {
 typedef struct Exception_Frame Exception_Frame;
 struct Exception_Frame {
 	int line;
-	jmp_buf env;
+	sigjmp_buf env;
         const char *func;
 	const char *file;
 	const T *exception;
@@ -243,7 +243,7 @@ void Exception_throw(const T *e, const char *func, const char *file, int line, c
         Exception_frame.message[0] = 0; \
         Exception_frame.prev = TD_get(Exception_stack); \
         TD_set(Exception_stack, &Exception_frame); \
-        Exception_flag = setjmp(Exception_frame.env); \
+        Exception_flag = sigsetjmp(Exception_frame.env, 0); \
         if (Exception_flag == Exception_entered) {
 
 
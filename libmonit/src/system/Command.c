@@ -33,9 +33,13 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/resource.h>
 #include <stdlib.h>
 #include <pwd.h>
 #include <grp.h>
+#ifdef HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
 
 #include "Str.h"
 #include "Dir.h"
@@ -66,7 +70,7 @@
 struct T {
         uid_t uid;
         gid_t gid;
-        List_T env;
+        List_T env; // The variables set by the caller, the rest is inherited from environ on exec
         List_T args;
         char **_env;
         char **_args;
@@ -79,6 +83,9 @@ struct Process_T {
         uid_t uid;
         gid_t gid;
         int status;
+        long long started; // Monotonic start time [ms]
+        long long finished; // Monotonic time when the exit status was collected [ms]
+        struct rusage usage; // Resources used by the sub-process and its waited-for children
         int stdin_pipe[2];
         int stdout_pipe[2];
         int stderr_pipe[2];
@@ -92,18 +99,37 @@ struct Process_T {
 /* --------------------------------------------------------------- Private */
 
 
+/* Returns true if the "name=value" string e is the variable name of the given length */
+static inline boolean_t _isEnv(const char *e, const char *name, size_t length) {
+        return strncmp(e, name, length) == 0 && e[length] == '='; // Ensure that e is not just a sub-string
+}
+
+
 /* Search the env list and return the pointer to the name (in the list)
  if found, otherwise NULL */
 static inline char *_findEnv(T C, const char *name) {
+        size_t length = strlen(name);
         for (list_t p = C->env->head; p; p = p->next) {
-                if ((strncmp(p->e, name, strlen(name)) == 0))
-                        if (((char*)p->e)[strlen(name)] == '=') // Ensure that p->e is not just a sub-string
-                                return p->e;
+                if (_isEnv(p->e, name, length))
+                        return p->e;
         }
         return NULL;
 }
 
 
+/* Returns true if the "name=value" string e is overridden by the env list */
+static inline boolean_t _isOverridden(T C, const char *e) {
+        const char *value = strchr(e, '=');
+        if (value) {
+                for (list_t p = C->env->head; p; p = p->next) {
+                        if (_isEnv(p->e, e, value - e))
+                                return true;
+                }
+        }
+        return false;
+}
+
+
 /* Remove env variable and value identified by name */
 static inline void _removeEnv(T C, const char *name) {
         char *e = _findEnv(C, name);
@@ -145,10 +171,23 @@ static inline char **_args(T C) {
 }
 
 
-/* Returns an array of program environment */
+/* Returns an array of program environment: the variables set by the caller
+ followed by the inherited environment of this process. The inherited strings
+ are referenced, not copied */
 static inline char **_env(T C) {
-        if (! C->_env)
-                C->_env = (char**)List_toArray(C->env);
+        if (! C->_env) {
+                extern char **environ;
+                int count = List_length(C->env);
+                for (char **e = environ; *e; e++)
+                        count++;
+                C->_env = CALLOC(count + 1, sizeof(char *));
+                int i = 0;
+                for (list_t p = C->env->head; p; p = p->next)
+                        C->_env[i++] = p->e;
+                for (char **e = environ; *e; e++)
+                        if (! _isOverridden(C, *e))
+                                C->_env[i++] = *e;
+        }
         return C->_env;
 }
 
@@ -203,6 +242,57 @@ static void _closeParentPipes(Process_T P) {
 }
 
 
+#if defined HAVE_POSIX_SPAWN && defined HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP && defined POSIX_SPAWN_SETSID
+#define HAVE_SPAWN 1
+/* Is posix_spawn(3) able to start the sub-process? It cannot change the uid
+ or the gid and the working directory only with the non portable extension */
+static inline boolean_t _canSpawn(T C) {
+#ifndef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+        if (C->working_directory)
+                return false;
+#endif
+        return ! C->uid && ! C->gid;
+}
+
+
+/* Start the sub-process with posix_spawn(3). It sets up the child the same
+ way as the vfork(2) path in Command_execute, except SIGHUP is reset to the
+ default rather than ignored. The descriptors are closed in the child before
+ exec, without a loop over the descriptor table. Returns 0 or the error */
+static int _spawn(T C, Process_T P) {
+        int status;
+        posix_spawn_file_actions_t actions;
+        posix_spawnattr_t attributes;
+        if ((status = posix_spawn_file_actions_init(&actions)) != 0)
+                return status;
+        if ((status = posix_spawnattr_init(&attributes)) != 0) {
+                posix_spawn_file_actions_destroy(&actions);
+                return status;
+        }
+        sigset_t mask, defaults;
+        sigemptyset(&mask);
+        sigemptyset(&defaults);
+        int signals[] = {SIGINT, SIGQUIT, SIGABRT, SIGTERM, SIGPIPE, SIGCHLD, SIGUSR1, SIGHUP};
+        for (int i = 0; i < (int)(sizeof(signals) / sizeof(signals[0])); i++)
+                sigaddset(&defaults, signals[i]);
+        if ((status = posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF)) == 0
+            && (status = posix_spawnattr_setsigmask(&attributes, &mask)) == 0
+            && (status = posix_spawnattr_setsigdefault(&attributes, &defaults)) == 0
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCHDIR_NP
+            && (! C->working_directory || (status = posix_spawn_file_actions_addchdir_np(&actions, C->working_directory)) == 0)
+#endif
+            && (status = posix_spawn_file_actions_adddup2(&actions, P->stdin_pipe[0], STDIN_FILENO)) == 0
+            && (status = posix_spawn_file_actions_adddup2(&actions, P->stdout_pipe[1], STDOUT_FILENO)) == 0
+            && (status = posix_spawn_file_actions_adddup2(&actions, P->stderr_pipe[1], STDERR_FILENO)) == 0
+            && (status = posix_spawn_file_actions_addclosefrom_np(&actions, 3)) == 0)
+                status = posix_spawn(&P->pid, _args(C)[0], &actions, &attributes, _args(C), _env(C));
+        posix_spawnattr_destroy(&attributes);
+        posix_spawn_file_actions_destroy(&actions);
+        return status;
+}
+#endif
+
+
 /* Close and destroy opened stdio streams */
 static void _closeStreams(Process_T P) {
         if (P->in) InputStream_free(&P->in);
@@ -215,6 +305,7 @@ static void _closeStreams(Process_T P) {
 
 
 static inline void _setstatus(Process_T P) {
+        P->finished = Time_monotonic();
         if (WIFEXITED(P->status))
                 P->status = WEXITSTATUS(P->status);
         else if (WIFSIGNALED(P->status))
@@ -228,6 +319,7 @@ static Process_T _Process_new(void) {
         Process_T P;
         NEW(P);
         P->status = -1;
+        P->started = Time_monotonic();
         return P;
 }
 
@@ -278,7 +370,7 @@ int Process_waitFor(Process_T P) {
         if (P->status < 0) {
                 int r;
                 do
-                        r = waitpid(P->pid, &P->status, 0); // Wait blocking
+                        r = wait4(P->pid, &P->status, 0, &P->usage); // Wait blocking
                 while (r == -1 && errno == EINTR);
                 if (r != P->pid) 
                         P->status = -1;
@@ -294,7 +386,7 @@ int Process_exitStatus(Process_T P) {
         if (P->status < 0) {
                 int r;
                 do
-                        r = waitpid(P->pid, &P->status, WNOHANG); // Wait non-blocking
+                        r = wait4(P->pid, &P->status, WNOHANG, &P->usage); // Wait non-blocking
                 while (r == -1 && errno == EINTR); 
                 if (r == 0) // Process is still running
                         P->status = -1;
@@ -305,6 +397,32 @@ int Process_exitStatus(Process_T P) {
 }
 
 
+long long Process_getCpuTime(Process_T P) {
+        assert(P);
+        if (Process_exitStatus(P) < 0)
+                return -1;
+        return (long long)(P->usage.ru_utime.tv_sec + P->usage.ru_stime.tv_sec) * 1000000LL + P->usage.ru_utime.tv_usec + P->usage.ru_stime.tv_usec;
+}
+
+
+long long Process_getMaxMemory(Process_T P) {
+        assert(P);
+        if (Process_exitStatus(P) < 0)
+                return -1;
+#ifdef DARWIN
+        return P->usage.ru_maxrss; // Bytes on macOS
+#else
+        return (long long)P->usage.ru_maxrss * 1024LL; // Kilobytes elsewhere
+#endif
+}
+
+
+long long Process_getRunTime(Process_T P) {
+        assert(P);
+        return (Process_exitStatus(P) < 0 ? Time_monotonic() : P->finished) - P->started;
+}
+
+
 int Process_isRunning(Process_T P) {
         assert(P);
         return Process_exitStatus(P) < 0;
@@ -362,11 +480,7 @@ T Command_new(const char *path, const char *arg0, ...) {
         va_start(ap, arg0);
         _buildArgs(C, path, arg0, ap);
         va_end(ap);
-        // Copy this process's environment for transit to sub-processes
-        extern char **environ;
-        for (char **e = environ; *e; e++) {
-                List_append(C->env, Str_dup(*e));
-        }
+        // The environment of this process is passed to the sub-process on exec, see _env()
         return C;
 }
 
@@ -468,6 +582,13 @@ const char *Command_getEnv(T C, const char *name) {
         assert(C);
         assert(name);
         char *e = _findEnv(C, name);
+        if (! e) {
+                extern char **environ;
+                size_t length = strlen(name);
+                for (char **i = environ; *i && ! e; i++)
+                        if (_isEnv(*i, name, length))
+                                e = *i;
+        }
         if (e) {
                 char *v = strchr(e, '=');
                 if (v)
@@ -483,7 +604,8 @@ List_T Command_getCommand(T C) {
 }
 
 
-/* The Execute function. Note that we use vfork() rather than fork. Vfork has
+/* The Execute function. The program is started with posix_spawn() if the
+ uid and gid don't change, otherwise we use vfork() rather than fork. Vfork has
  a special semantic in that the child process runs in the parent address space
  until exec is called in the child. The child also run first and suspend the
  parent process until exec or exit is called */
@@ -494,8 +616,27 @@ Process_T Command_execute(T C) {
         volatile int exec_error = 0;
         Process_T P = _Process_new();
         _createPipes(P);
+#ifdef HAVE_SPAWN
+        if (_canSpawn(C)) {
+                int status = _spawn(C, P);
+                if (status != 0) {
+                        ERROR("Command: '%s' failed to execute -- %s\n", _args(C)[0], System_getError(status));
+                        _setupParentPipes(P);
+                        P->status = status; // Not started, Process_free() must not wait for or kill it
+                        Process_free(&P);
+                        errno = status;
+                        return NULL;
+                }
+                P->uid = getuid();
+                P->gid = getgid();
+                _setupParentPipes(P);
+                return P;
+        }
+#endif
         if ((P->pid = vfork()) < 0) {
+                P->status = errno; // Not started, Process_free() must not wait for or kill pid -1
                 ERROR("Command: fork failed -- %s\n", System_getLastError());
+                _setupParentPipes(P);
                 Process_free(&P);
                 return NULL;
         } else if (P->pid == 0) { 
@@ -535,8 +676,7 @@ Process_T Command_execute(T C) {
                 setsid(); // Loose controlling terminal
                 _setupChildPipes(P);
                 // Close all descriptors except stdio
-                for (int i = 3, descriptors = getdtablesize(); i < descriptors; i++)
-                        close(i);
+                System_closeDescriptors(3);
                 // Unblock any signals and reset signal handlers
                 sigset_t mask;
                 sigemptyset(&mask);
@@ -0,0 +1,189 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "Str.h"
+#include "system/Cron.h"
+
+
+/**
+ * Implementation of the precompiled crontab specification
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define T Cron_T
+struct T {
+        uint64_t field[5]; // Bitsets of the minutes, hours, days, months and weekdays
+};
+
+
+static const struct {
+        int min;
+        int max;
+} _range[5] = {{0, 59}, {0, 23}, {1, 31}, {1, 12}, {0, 6}};
+
+
+enum {Cron_Minute = 0, Cron_Hour, Cron_Day, Cron_Month, Cron_Weekday};
+
+
+#define YEARS 5
+
+
+/* --------------------------------------------------------------- Private */
+
+
+static inline boolean_t _isSet(T C, int field, int value) {
+        return (C->field[field] >> value) & 1;
+}
+
+
+static const char *_number(const char *s, int *value) {
+        if (! isdigit((unsigned char)*s))
+                return NULL;
+        for (*value = 0; isdigit((unsigned char)*s); s++)
+                if ((*value = *value * 10 + (*s - '0')) > 99)
+                        return NULL;
+        return s;
+}
+
+
+/**
+ * Parse one field: an asterisk or a comma separated sequence of numbers and ranges
+ * @return Pointer behind the field or NULL if the field is not valid
+ */
+static const char *_field(T C, int field, const char *s) {
+        if (*s == '*') {
+                for (int i = _range[field].min; i <= _range[field].max; i++)
+                        C->field[field] |= 1ULL << i;
+                return s + 1;
+        }
+        do {
+                int from, to;
+                if (*s == ',')
+                        s++;
+                if (! (s = _number(s, &from)))
+                        return NULL;
+                to = from;
+                if (*s == '-' && ! (s = _number(s + 1, &to)))
+                        return NULL;
+                if (from < _range[field].min || to > _range[field].max || from > to)
+                        return NULL;
+                for (int i = from; i <= to; i++)
+                        C->field[field] |= 1ULL << i;
+        } while (*s == ',');
+        return s;
+}
+
+
+static boolean_t _matchDay(T C, struct tm *tm) {
+        return _isSet(C, Cron_Day, tm->tm_mday) && _isSet(C, Cron_Month, tm->tm_mon + 1) && _isSet(C, Cron_Weekday, tm->tm_wday);
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T Cron_new(const char *spec) {
+        assert(spec);
+        T C;
+        NEW(C);
+        const char *s = spec;
+        for (int field = 0; field < 5; field++) {
+                while (isspace((unsigned char)*s))
+                        s++;
+                if (! (s = _field(C, field, s)) || (*s && ! isspace((unsigned char)*s))) {
+                        FREE(C);
+                        return NULL;
+                }
+        }
+        while (isspace((unsigned char)*s))
+                s++;
+        if (*s) {
+                // Too many fields
+                FREE(C);
+                return NULL;
+        }
+        return C;
+}
+
+
+void Cron_free(T *C) {
+        assert(C && *C);
+        FREE(*C);
+}
+
+
+boolean_t Cron_match(T C, time_t time) {
+        assert(C);
+        struct tm tm;
+        localtime_r(&time, &tm);
+        return _matchDay(C, &tm) && _isSet(C, Cron_Hour, tm.tm_hour) && _isSet(C, Cron_Minute, tm.tm_min);
+}
+
+
+time_t Cron_nextFire(T C, time_t time) {
+        assert(C);
+        struct tm tm;
+        time_t t = time - time % 60 + 60;
+        localtime_r(&t, &tm);
+        int year = tm.tm_year + YEARS;
+        // Skip the not matching days, then hours and minutes; mktime() normalizes the overflows (and handles the DST changes)
+        while (tm.tm_year <= year) {
+                if (! _matchDay(C, &tm)) {
+                        tm.tm_mday++;
+                        tm.tm_hour = tm.tm_min = 0;
+                } else if (! _isSet(C, Cron_Hour, tm.tm_hour)) {
+                        tm.tm_hour++;
+                        tm.tm_min = 0;
+                } else if (! _isSet(C, Cron_Minute, tm.tm_min)) {
+                        tm.tm_min++;
+                } else {
+                        return t;
+                }
+                tm.tm_sec = 0;
+                tm.tm_isdst = -1;
+                t = mktime(&tm);
+        }
+        return 0;
+}
+
+
+#undef T
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef CRON_INCLUDED
+#define CRON_INCLUDED
+
+
+/**
+ * A precompiled crontab specification. The specification string with the
+ * syntax described in Time_incron() is parsed once into bitsets of the
+ * minutes, hours, days, months and weekdays, so testing a time is a couple
+ * of bit operations and the next matching time can be computed directly.
+ * As in Time_incron(), the time matches if all 5 fields match (i.e. both
+ * the day of month and the day of week must match).
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T Cron_T
+typedef struct T *T;
+
+
+/**
+ * Compile the crontab specification
+ * @param spec A crontab format string. e.g. "* 8-9 * * 1-5"
+ * @return A Cron object or NULL if the specification is not valid
+ */
+T Cron_new(const char *spec);
+
+
+/**
+ * Destroy a Cron object and release allocated resources.
+ * @param C A Cron object reference
+ */
+void Cron_free(T *C);
+
+
+/**
+ * Test if the given time is in the range of the crontab specification
+ * @param C A Cron object
+ * @param time The time to test
+ * @return true if the time matches, otherwise false
+ */
+boolean_t Cron_match(T C, time_t time);
+
+
+/**
+ * Get the start of the first matching minute after the minute of the given
+ * time. For example if the specification is "0 3 * * *" and the time is
+ * 03:00:20, the returned time is 03:00:00 of the next day.
+ * @param C A Cron object
+ * @param time The time to start from
+ * @return The next time when the specification matches or 0 if it doesn't
+ * match in the next 5 years (e.g. "* * 31 2 *")
+ */
+time_t Cron_nextFire(T C, time_t time);
+
+
+#undef T
+#endif
@@ -59,11 +59,22 @@
 #include <sys/protosw.h>
 #include <libperfstat.h>
 #endif
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+#ifdef HAVE_LINUX_ETHTOOL_H
+#include <linux/ethtool.h>
+#endif
+#ifdef HAVE_LINUX_SOCKIOS_H
+#include <linux/sockios.h>
+#endif
 
 #include "system/Link.h"
 #include "system/Time.h"
 #include "system/System.h"
 #include "Str.h"
+#include "HashMap.h"
 
 
 /**
@@ -79,6 +90,7 @@
 
 
 #define T Link_T
+#define LINK_HISTORY_MAX 3600 // Maximum history length [s]
 
 
 static struct {
@@ -98,6 +110,23 @@ typedef struct LinkData_T {
 } LinkData_T;
 
 
+typedef enum {
+        Sample_IBytes = 0,
+        Sample_IPackets,
+        Sample_IErrors,
+        Sample_OBytes,
+        Sample_OPackets,
+        Sample_OErrors,
+        Sample_Count
+} Sample_Type;
+
+
+typedef struct LinkSample_T {
+        unsigned long long timestamp; // Monotonic time of the sample [ms]
+        unsigned long long value[Sample_Count];
+} LinkSample_T;
+
+
 struct T {
         char *object;
         const char *(*resolve)(const char *object); // Resolve Object -> Interface, set during Link_T instantiation by constructor (currently we implement only IPAddress -> Interface lookup)
@@ -114,6 +143,12 @@ struct T {
         LinkData_T opackets;  // Packets sent on interface
         LinkData_T oerrors;   // Output errors on interface
         LinkData_T obytes;    // Total number of octets sent
+        struct {
+                int size;     // Number of samples in the ring (0 = no history)
+                int count;    // Number of valid samples
+                int head;     // Index of the newest sample
+                LinkSample_T *samples;
+        } history;            // Sample of each update, allocated by Link_setHistory() so updates don't allocate
 };
 
 
@@ -178,6 +213,7 @@ static void _resetData(LinkData_T *data, unsigned long long value) {
 
 static void _reset(T L) {
         L->timestamp.last = L->timestamp.now = 0ULL;
+        L->history.count = L->history.head = 0;
         L->speed = -1LL;
         L->state = L->duplex = -1;
         _resetData(&(L->ibytes), 0ULL);
@@ -197,8 +233,30 @@ static unsigned long long _deltaSecond(T L, LinkData_T *data) {
 }
 
 
+/**
+ * Average rate per second since the oldest sample within the last 'count' seconds. If no sample
+ * lies within the range (the update interval is longer), the previous sample is used
+ */
+static unsigned long long _deltaSeconds(T L, Sample_Type type, int count) {
+        if (L->history.count < 2)
+                return 0ULL;
+        LinkSample_T *newest = &(L->history.samples[L->history.head]);
+        LinkSample_T *oldest = NULL;
+        unsigned long long range = count * 1000ULL + 500ULL; // Tolerate the scheduling jitter of the update
+        for (int i = 1; i < L->history.count; i++) {
+                LinkSample_T *sample = &(L->history.samples[(L->history.head - i + L->history.size) % L->history.size]);
+                if (oldest && newest->timestamp - sample->timestamp > range)
+                        break;
+                oldest = sample;
+        }
+        if (newest->timestamp > oldest->timestamp && newest->value[type] > oldest->value[type])
+                return (unsigned long long)((newest->value[type] - oldest->value[type]) * 1000. / (newest->timestamp - oldest->timestamp));
+        return 0ULL;
+}
+
+
 static unsigned long long _deltaMinute(T L, LinkData_T *data, int count) {
-        int stop = Time_minutes(L->timestamp.now / 1000.);
+        int stop = (L->timestamp.now / 60000ULL) % 60;
         int delta = stop - count;
         int start = delta < 0 ? 60 + delta : delta;
         if (start == stop) // count == 60 (wrap)
@@ -210,7 +268,7 @@ static unsigned long long _deltaMinute(T L, LinkData_T *data, int count) {
 
 
 static unsigned long long _deltaHour(T L, LinkData_T *data, int count) {
-        int stop = Time_hour(L->timestamp.now / 1000.);
+        int stop = (L->timestamp.now / 3600000ULL) % 24;
         int delta = stop - count;
         int start = delta < 0 ? 24 + delta : delta;
         if (start == stop) // count == 24 (wrap)
@@ -252,6 +310,41 @@ static const char *_returnInterface(const char *interface) {
 }
 
 
+/**
+ * Store the value in the current slot. The slots skipped since the last update get the last value, so
+ * the traffic is accounted to the current slot and no stale slot from the previous round is left
+ */
+static void _updateSlots(unsigned long long *slots, int size, unsigned long long last, unsigned long long now, LinkData_T *data) {
+        unsigned long long skipped = now - last;
+        for (unsigned long long i = skipped > (unsigned long long)size ? now - size + 1 : last + 1; i < now; i++)
+                slots[i % size] = data->last;
+        slots[now % size] = data->now;
+}
+
+
+static void _updateData(T L, LinkData_T *data) {
+        _updateSlots(data->minute, 60, L->timestamp.last / 60000ULL, L->timestamp.now / 60000ULL, data);
+        _updateSlots(data->hour, 24, L->timestamp.last / 3600000ULL, L->timestamp.now / 3600000ULL, data);
+}
+
+
+static void _updateSample(T L) {
+        if (L->history.size > 0) {
+                L->history.head = (L->history.head + 1) % L->history.size;
+                if (L->history.count < L->history.size)
+                        L->history.count++;
+                LinkSample_T *sample = &(L->history.samples[L->history.head]);
+                sample->timestamp = L->timestamp.now;
+                sample->value[Sample_IBytes] = L->ibytes.now;
+                sample->value[Sample_IPackets] = L->ipackets.now;
+                sample->value[Sample_IErrors] = L->ierrors.now;
+                sample->value[Sample_OBytes] = L->obytes.now;
+                sample->value[Sample_OPackets] = L->opackets.now;
+                sample->value[Sample_OErrors] = L->oerrors.now;
+        }
+}
+
+
 static void _updateHistory(T L) {
         if (L->timestamp.last == 0ULL) {
                 // Initialize the history on first update, so we can start accounting for total data immediately. Any delta will show difference between the very first value and then given point in time, until regular update cycle
@@ -261,18 +354,17 @@ static void _updateHistory(T L) {
                 _resetData(&(L->obytes), L->obytes.now);
                 _resetData(&(L->opackets), L->opackets.now);
                 _resetData(&(L->oerrors), L->oerrors.now);
+                L->history.count = L->history.head = 0;
         } else {
-                // Update relative values only
-                time_t now = L->timestamp.now / 1000.;
-                int minute = Time_minutes(now);
-                int hour =  Time_hour(now);
-                L->ibytes.minute[minute] = L->ibytes.hour[hour] = L->ibytes.now;
-                L->ipackets.minute[minute] = L->ipackets.hour[hour] = L->ipackets.now;
-                L->ierrors.minute[minute] = L->ierrors.hour[hour] = L->ierrors.now;
-                L->obytes.minute[minute] = L->obytes.hour[hour] = L->obytes.now;
-                L->opackets.minute[minute] = L->opackets.hour[hour] = L->opackets.now;
-                L->oerrors.minute[minute] = L->oerrors.hour[hour] = L->oerrors.now;
+                // Update relative values only. The slots are based on the monotonic clock, so changes of the system time don't corrupt the deltas
+                _updateData(L, &(L->ibytes));
+                _updateData(L, &(L->ipackets));
+                _updateData(L, &(L->ierrors));
+                _updateData(L, &(L->obytes));
+                _updateData(L, &(L->opackets));
+                _updateData(L, &(L->oerrors));
         }
+        _updateSample(L);
 }
 
 
@@ -320,6 +412,7 @@ T Link_createForInterface(const char *interface) {
 
 
 void Link_free(T *L) {
+        FREE((*L)->history.samples);
         FREE((*L)->object);
         FREE(*L);
 }
@@ -330,6 +423,27 @@ void Link_reset(T L) {
 }
 
 
+void Link_setHistory(T L, int seconds) {
+        assert(L);
+        if (seconds < 0 || seconds > LINK_HISTORY_MAX)
+                THROW(AssertException, "History length must be between 0 and %d seconds", LINK_HISTORY_MAX);
+        int size = seconds > 0 ? seconds + 1 : 0; // The range of n seconds is spanned by n + 1 samples
+        if (size != L->history.size) {
+                FREE(L->history.samples);
+                if (size > 0)
+                        L->history.samples = CALLOC(size, sizeof(LinkSample_T));
+                L->history.size = size;
+                L->history.count = L->history.head = 0;
+        }
+}
+
+
+int Link_getHistory(T L) {
+        assert(L);
+        return L->history.size > 0 ? L->history.size - 1 : 0;
+}
+
+
 int Link_isGetByAddressSupported() {
 #ifdef HAVE_IFADDRS_H
         return true;
@@ -340,12 +454,29 @@ int Link_isGetByAddressSupported() {
 
 
 void Link_update(T L) {
+        char error[STRLEN];
+        if (! Link_tryUpdate(L, error, sizeof(error)))
+                THROW(AssertException, "%s", error);
+}
+
+
+int Link_tryUpdate(T L, char *error, int errorlen) {
+        assert(L);
+#ifdef LINUX
+        // The statistics are read from the netlink link table, the addresses are needed only to find the interface of an address
+        if (L->resolve == _findInterfaceForAddress)
+                _updateCache();
+#else
         _updateCache();
+#endif
         const char *interface = L->resolve(L->object);
-        if (_update(L, interface))
-                _updateHistory(L);
-        else
-                THROW(AssertException, "Cannot udate network statistics -- interface %s not found", interface);
+        if (! _update(L, interface)) {
+                if (error)
+                        snprintf(error, errorlen, "Cannot udate network statistics -- interface %s not found", interface);
+                return false;
+        }
+        _updateHistory(L);
+        return true;
 }
 
 
@@ -355,6 +486,14 @@ unsigned long long Link_getBytesInPerSecond(T L) {
 }
 
 
+unsigned long long Link_getBytesInPerSecondAverage(T L, int count) {
+        assert(L);
+        if (count < 1 || count > Link_getHistory(L))
+                THROW(AssertException, "Range of %d seconds is outside of the history", count);
+        return _deltaSeconds(L, Sample_IBytes, count);
+}
+
+
 unsigned long long Link_getBytesInPerMinute(T L, int count) {
         assert(L);
         return _deltaMinute(L, &(L->ibytes), count);
@@ -385,6 +524,14 @@ unsigned long long Link_getPacketsInPerSecond(T L) {
 }
 
 
+unsigned long long Link_getPacketsInPerSecondAverage(T L, int count) {
+        assert(L);
+        if (count < 1 || count > Link_getHistory(L))
+                THROW(AssertException, "Range of %d seconds is outside of the history", count);
+        return _deltaSeconds(L, Sample_IPackets, count);
+}
+
+
 unsigned long long Link_getPacketsInPerMinute(T L, int count) {
         assert(L);
         return _deltaMinute(L, &(L->ipackets), count);
@@ -433,6 +580,14 @@ unsigned long long Link_getBytesOutPerSecond(T L) {
 }
 
 
+unsigned long long Link_getBytesOutPerSecondAverage(T L, int count) {
+        assert(L);
+        if (count < 1 || count > Link_getHistory(L))
+                THROW(AssertException, "Range of %d seconds is outside of the history", count);
+        return _deltaSeconds(L, Sample_OBytes, count);
+}
+
+
 unsigned long long Link_getBytesOutPerMinute(T L, int count) {
         assert(L);
         return _deltaMinute(L, &(L->obytes), count);
@@ -463,6 +618,14 @@ unsigned long long Link_getPacketsOutPerSecond(T L) {
 }
 
 
+unsigned long long Link_getPacketsOutPerSecondAverage(T L, int count) {
+        assert(L);
+        if (count < 1 || count > Link_getHistory(L))
+                THROW(AssertException, "Range of %d seconds is outside of the history", count);
+        return _deltaSeconds(L, Sample_OPackets, count);
+}
+
+
 unsigned long long Link_getPacketsOutPerMinute(T L, int count) {
         assert(L);
         return _deltaMinute(L, &(L->opackets), count);
@@ -77,6 +77,28 @@ void Link_free(T *L);
 void Link_reset(T L);
 
 
+/**
+ * Set the length of the per second history. The history keeps a sample
+ * of the statistics from each Link_update() with the monotonic time of
+ * the update, so rates over a range of seconds can be computed with the
+ * Link_get*PerSecondAverage() methods. The samples are allocated by this
+ * method, Link_update() doesn't allocate memory. The history is disabled
+ * by default.
+ * @param L A Link object
+ * @param seconds History length in seconds (0 = disable, max = 3600s)
+ * @exception AssertException If the history length is out of range
+ */
+void Link_setHistory(T L, int seconds);
+
+
+/**
+ * Get the length of the per second history.
+ * @param L A Link object
+ * @return History length in seconds (0 if disabled)
+ */
+int Link_getHistory(T L);
+
+
 /**
  * Update network statistics for object.
  * @param L A Link object
@@ -86,6 +108,19 @@ void Link_reset(T L);
 void Link_update(T L);
 
 
+/**
+ * Update network statistics for object. The same as Link_update() but
+ * the failure is reported by the return value instead of an exception,
+ * for the callers which update the statistics at every cycle.
+ * @param L A Link object
+ * @param error A buffer for the error description (optional)
+ * @param errorlen The size of the error buffer
+ * @return true if the statistics were updated, false if the interface
+ * was not found
+ */
+int Link_tryUpdate(T L, char *error, int errorlen);
+
+
 /**
  * Get incoming bytes per second.
  * @param L A Link object
@@ -94,6 +129,17 @@ void Link_update(T L);
 unsigned long long Link_getBytesInPerSecond(T L);
 
 
+/**
+ * Get incoming bytes per second on the average over the last seconds.
+ * @param L A Link object
+ * @param count Number of seconds, the rate will be for the range given
+ * by 'now - count' (count max = the history length)
+ * @return Incoming bytes per second over the range.
+ * @exception AssertException If count exceeds the history length
+ */
+unsigned long long Link_getBytesInPerSecondAverage(T L, int count);
+
+
 /**
  * Get incoming bytes per minute.
  * @param L A Link object
@@ -138,6 +184,17 @@ unsigned long long Link_getBytesInPerHour(T L, int count);
 unsigned long long Link_getPacketsInPerSecond(T L);
 
 
+/**
+ * Get incoming packets per second on the average over the last seconds.
+ * @param L A Link object
+ * @param count Number of seconds, the rate will be for the range given
+ * by 'now - count' (count max = the history length)
+ * @return Incoming packets per second over the range.
+ * @exception AssertException If count exceeds the history length
+ */
+unsigned long long Link_getPacketsInPerSecondAverage(T L, int count);
+
+
 /**
  * Get incoming packets per minute.
  * @param L A  object
@@ -210,6 +267,17 @@ unsigned long long Link_getErrorsInTotal(T L);
 unsigned long long Link_getBytesOutPerSecond(T L);
 
 
+/**
+ * Get outgoing bytes per second on the average over the last seconds.
+ * @param L A Link object
+ * @param count Number of seconds, the rate will be for the range given
+ * by 'now - count' (count max = the history length)
+ * @return Outgoing bytes per second over the range.
+ * @exception AssertException If count exceeds the history length
+ */
+unsigned long long Link_getBytesOutPerSecondAverage(T L, int count);
+
+
 /**
  * Get outgoing bytes per minute.
  * @param L A Link object
@@ -254,6 +322,17 @@ double Link_getSaturationOutPerSecond(T L);
 unsigned long long Link_getPacketsOutPerSecond(T L);
 
 
+/**
+ * Get outgoing packets per second on the average over the last seconds.
+ * @param L A Link object
+ * @param count Number of seconds, the rate will be for the range given
+ * by 'now - count' (count max = the history length)
+ * @return Outgoing packets per second over the range.
+ * @exception AssertException If count exceeds the history length
+ */
+unsigned long long Link_getPacketsOutPerSecondAverage(T L, int count);
+
+
 /**
  * Get outgoing packets per minute.
  * @param L A Link object
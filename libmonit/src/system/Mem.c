@@ -43,12 +43,20 @@
  */
 
 
+/* ----------------------------------------------------------- Definitions */
+
+
+static void(*_AllocationHandler)(void) = NULL;
+
+
 /* ---------------------------------------------------------------- Public */
 
 
 void *Mem_alloc(long nbytes, const char *func, const char *file, int line){
 	void *ptr;
 	assert(nbytes > 0);
+	if (_AllocationHandler)
+		_AllocationHandler();
 	ptr = malloc(nbytes);
 	if (ptr == NULL)
                 Exception_throw(&(MemoryException), func, file, line, System_getLastError());
@@ -60,6 +68,8 @@ void *Mem_calloc(long count, long nbytes, const char *func, const char *file, in
 	void *ptr;
 	assert(count > 0);
 	assert(nbytes > 0);
+	if (_AllocationHandler)
+		_AllocationHandler();
 	ptr = calloc(count, nbytes);
 	if (ptr == NULL)
                 Exception_throw(&(MemoryException), func, file, line, System_getLastError());
@@ -77,8 +87,15 @@ void *Mem_resize(void *ptr, long nbytes, const char *func, const char *file, int
 	assert(nbytes > 0);
         if (! ptr)
                 return Mem_alloc(nbytes, func, file, line); 
+	if (_AllocationHandler)
+		_AllocationHandler();
 	ptr = realloc(ptr, nbytes);
 	if (ptr == NULL)
                 Exception_throw(&(MemoryException), func, file, line, System_getLastError());
 	return ptr;
 }
+
+
+void Mem_setAllocationHandler(void(*allocationHandler)(void)) {
+	_AllocationHandler = allocationHandler;
+}
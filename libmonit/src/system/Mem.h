@@ -153,4 +153,16 @@ void Mem_free(void *p, const char *func, const char *file, int line);
 void *Mem_resize(void *p, long size, const char *func, const char *file, int line);
 
 
+/**
+ * Set the function to call on each allocation made through this
+ * interface, including the resizes, for example to count them. The
+ * handler is called by the allocating thread, so it can count per
+ * thread without a shared write. Allocations made directly with
+ * malloc(3) are not seen. No handler is set by default.
+ * @param allocationHandler The handler function or NULL to remove it
+ */
+void Mem_setAllocationHandler(void(*allocationHandler)(void));
+
+
+
 #endif
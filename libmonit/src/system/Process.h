@@ -130,6 +130,36 @@ int Process_waitFor(T P);
 int Process_exitStatus(T P);
 
 
+/**
+ * Returns the CPU time used by the sub-process, user and system time
+ * combined. The value includes the descendants of the sub-process which
+ * it waited for and is available when the sub-process has terminated.
+ * @param P A Process object
+ * @return The CPU time in microseconds or -1 if the sub-process is still
+ * running
+ */
+long long Process_getCpuTime(T P);
+
+
+/**
+ * Returns the maximum resident memory size of the sub-process, as reported
+ * by the system when the sub-process terminated.
+ * @param P A Process object
+ * @return The peak resident memory in bytes or -1 if the sub-process is
+ * still running
+ */
+long long Process_getMaxMemory(T P);
+
+
+/**
+ * Returns the wall-clock time the sub-process ran. If the sub-process is
+ * still running, the time elapsed since it was started is returned.
+ * @param P A Process object
+ * @return The run time in milliseconds
+ */
+long long Process_getRunTime(T P);
+
+
 /**
  * Returns true if the sub-process is running otherwise false
  * @param P A Process object
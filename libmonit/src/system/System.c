@@ -29,6 +29,7 @@
 #include <errno.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 
 #include "Str.h"
 #include "system/System.h"
@@ -85,3 +86,19 @@ void System_error(const char *e, ...) {
                 vfprintf(stderr, e, ap);
         va_end(ap);
 }
+
+
+void System_closeDescriptors(int lowfd) {
+#ifdef HAVE_CLOSE_RANGE
+        if (close_range(lowfd, ~0U, 0) == 0)
+                return;
+        // The kernel doesn't support close_range(2), fall back
+#endif
+#ifdef HAVE_CLOSEFROM
+        closefrom(lowfd);
+#else
+        for (int i = lowfd, descriptors = getdtablesize(); i < descriptors; i++)
+                close(i);
+#endif
+}
+
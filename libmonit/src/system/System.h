@@ -68,4 +68,14 @@ void System_abort(const char *e, ...) __attribute__((format (printf, 1, 2)));
 void System_error(const char *e, ...) __attribute__((format (printf, 1, 2)));
 
 
+/**
+ * Close all open descriptors from <code>lowfd</code> and up. Uses
+ * close_range(2) or closefrom(3) where available and falls back to
+ * closing each descriptor up to the descriptor table size. Safe to call
+ * in a child process between fork and exec
+ * @param lowfd The lowest descriptor to close
+ */
+void System_closeDescriptors(int lowfd);
+
+
 #endif
@@ -501,6 +501,26 @@ long long int Time_micro(void) {
 }
 
 
+long long int Time_monotonic(void) {
+#ifdef CLOCK_MONOTONIC
+        struct timespec t;
+        if (clock_gettime(CLOCK_MONOTONIC, &t) == 0)
+                return (long long int)t.tv_sec * 1000 + (long long int)t.tv_nsec / 1000000;
+#endif
+        return Time_milli();
+}
+
+
+long long int Time_monotonicMicro(void) {
+#ifdef CLOCK_MONOTONIC
+        struct timespec t;
+        if (clock_gettime(CLOCK_MONOTONIC, &t) == 0)
+                return (long long int)t.tv_sec * 1000000 + (long long int)t.tv_nsec / 1000;
+#endif
+        return Time_micro();
+}
+
+
 int Time_seconds(time_t time) {
         struct tm tm;
         localtime_r(&time, &tm);
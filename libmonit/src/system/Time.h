@@ -132,6 +132,27 @@ long long int Time_milli(void);
 long long int Time_micro(void);
 
 
+/**
+ * Returns the time of a monotonic clock measured in milliseconds. The clock
+ * doesn't follow changes of the system time, use it to measure intervals.
+ * The starting point is unspecified. If the system has no monotonic clock,
+ * the time since the epoch is returned.
+ * @return A 64 bits long representing milliseconds of the monotonic clock
+ * @exception AssertException If time could not be obtained
+ */
+long long int Time_monotonic(void);
+
+
+/**
+ * Returns the time of the monotonic clock measured in microseconds, see
+ * Time_monotonic(). If the system has no monotonic clock, the time since
+ * the epoch is returned.
+ * @return A 64 bits long representing microseconds of the monotonic clock
+ * @exception AssertException If time could not be obtained
+ */
+long long int Time_monotonicMicro(void);
+
+
 /**
  * Returns the second of the minute for time.
  * @param time Number of seconds since the EPOCH
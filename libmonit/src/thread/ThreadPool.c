@@ -0,0 +1,382 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "Thread.h"
+#include "ThreadPool.h"
+
+
+/**
+ * Implementation of the ThreadPool interface. Each worker has a ring buffer
+ * of tasks guarded by its own mutex, the pool mutex guards only the count of
+ * queued tasks and the sleeping workers. A queue has room for all tasks of
+ * the pool, so pushing to a queue never fails when the pool count allows it.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ------------------------------------------------------------ Definitions */
+
+
+#define T ThreadPool_T
+
+
+typedef struct Task_T {
+        void *(*run)(void *args);
+        void *args;
+        Future_T future;
+} Task_T;
+
+
+typedef struct Worker_T {
+        T pool;
+        int index;
+        Thread_T thread;
+        Mutex_T mutex;
+        int head;        // Next task to take
+        int count;       // Number of tasks in the ring
+        Task_T *tasks;
+} Worker_T;
+
+
+struct Future_T {
+        int references;  // The caller and the task
+        boolean_t done;
+        void *result;
+        const Exception_T *exception;
+        T pool;
+        char message[EXCEPTION_MESSAGE_LENGTH + 1];
+};
+
+
+struct T {
+        int workers;
+        int started;     // Number of running worker threads
+        int capacity;
+        int queued;      // Tasks in the queues
+        int idle;        // Workers waiting for a task
+        int next;        // Queue for the next submission from outside of the pool
+        boolean_t stopped;
+        Mutex_T mutex;
+        Sem_T work;      // Signalled when a task was queued
+        Sem_T room;      // Signalled when a task was taken
+        Sem_T done;      // Broadcasted when a task finished
+        Worker_T *worker;
+};
+
+
+static ThreadData_T current;
+static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+static void init_once(void) {
+        ThreadData_create(current);
+}
+
+
+/* Returns the worker of the pool P running in this thread or NULL */
+static Worker_T *self(T P) {
+        Worker_T *w = ThreadData_get(current);
+        return w && w->pool == P ? w : NULL;
+}
+
+
+static void release(Future_T F) {
+        if (__atomic_sub_fetch(&F->references, 1, __ATOMIC_ACQ_REL) == 0)
+                FREE(F);
+}
+
+
+static void run(T P, Task_T *task) {
+        Future_T F = task->future;
+        TRY
+        {
+                F->result = task->run(task->args);
+        }
+        ELSE
+        {
+                F->exception = Exception_frame.exception;
+                snprintf(F->message, sizeof(F->message), "%s", Exception_frame.message);
+        }
+        END_TRY;
+        LOCK(P->mutex)
+        {
+                __atomic_store_n(&F->done, true, __ATOMIC_RELEASE);
+                Sem_broadcast(P->done);
+        }
+        END_LOCK;
+        release(F);
+}
+
+
+/* Take a task from the queue of worker w, the thief takes the oldest task too, so the tasks are run in about submission order */
+static boolean_t take(Worker_T *w, Task_T *task) {
+        boolean_t found = false;
+        LOCK(w->mutex)
+        {
+                if (w->count > 0) {
+                        *task = w->tasks[w->head];
+                        w->head = (w->head + 1) % w->pool->capacity;
+                        w->count--;
+                        found = true;
+                }
+        }
+        END_LOCK;
+        return found;
+}
+
+
+/* Take a task from the worker's own queue or steal one from the other workers */
+static boolean_t next(T P, int index, Task_T *task) {
+        for (int i = 0; i < P->workers; i++) {
+                if (take(&P->worker[(index + i) % P->workers], task)) {
+                        LOCK(P->mutex)
+                        {
+                                P->queued--;
+                                Sem_signal(P->room);
+                        }
+                        END_LOCK;
+                        return true;
+                }
+        }
+        return false;
+}
+
+
+static void *worker(void *args) {
+        Worker_T *w = args;
+        T P = w->pool;
+        ThreadData_set(current, w);
+        while (true) {
+                Task_T task;
+                if (next(P, w->index, &task)) {
+                        run(P, &task);
+                        continue;
+                }
+                boolean_t exit = false;
+                LOCK(P->mutex)
+                {
+                        while (P->queued == 0 && ! P->stopped) {
+                                P->idle++;
+                                Sem_wait(P->work, P->mutex);
+                                P->idle--;
+                        }
+                        exit = P->queued == 0 && P->stopped;
+                }
+                END_LOCK;
+                if (exit)
+                        break;
+        }
+        return NULL;
+}
+
+
+static Future_T submit(T P, void *(*task)(void *args), void *args, boolean_t wait) {
+        assert(P);
+        assert(task);
+        Worker_T *w = self(P);
+        Future_T F;
+        NEW(F);
+        F->references = 2;
+        F->pool = P;
+        boolean_t stopped = false, queued = false;
+        LOCK(P->mutex)
+        {
+                // A worker doesn't wait for room, it would wait for itself if all workers submit
+                while (wait && ! w && P->queued >= P->capacity && ! P->stopped)
+                        Sem_wait(P->room, P->mutex);
+                // The workers may still submit subtasks while the queued tasks are run on shutdown
+                stopped = P->stopped && ! w;
+                if (! stopped && P->queued < P->capacity) {
+                        Worker_T *target = w ? w : &P->worker[P->next++ % P->workers];
+                        LOCK(target->mutex)
+                        {
+                                target->tasks[(target->head + target->count) % P->capacity] = (Task_T){.run = task, .args = args, .future = F};
+                                target->count++;
+                        }
+                        END_LOCK;
+                        P->queued++;
+                        if (P->idle)
+                                Sem_signal(P->work);
+                        queued = true;
+                }
+        }
+        END_LOCK;
+        if (stopped) {
+                FREE(F);
+                THROW(AssertException, "ThreadPool was shut down");
+        }
+        if (! queued) {
+                if (w) {
+                        // The pool is full, run the subtask in the worker
+                        run(P, &(Task_T){.run = task, .args = args, .future = F});
+                } else {
+                        FREE(F);
+                }
+        }
+        return F;
+}
+
+
+/* ----------------------------------------------------------------- Public */
+
+
+T ThreadPool_new(int workers, int capacity) {
+        if (workers < 1 || capacity < 1)
+                THROW(AssertException, "Illegal ThreadPool size");
+        pthread_once(&once_control, init_once);
+        T P;
+        NEW(P);
+        P->workers = workers;
+        P->capacity = capacity;
+        Mutex_init(P->mutex);
+        Sem_init(P->work);
+        Sem_init(P->room);
+        Sem_init(P->done);
+        P->worker = CALLOC(workers, sizeof(Worker_T));
+        for (int i = 0; i < workers; i++) {
+                Worker_T *w = &P->worker[i];
+                w->pool = P;
+                w->index = i;
+                w->tasks = CALLOC(capacity, sizeof(Task_T));
+                Mutex_init(w->mutex);
+        }
+        TRY
+        {
+                for (; P->started < workers; P->started++)
+                        Thread_create(P->worker[P->started].thread, worker, &P->worker[P->started]);
+        }
+        ELSE
+        {
+                ThreadPool_free(&P);
+                RETHROW;
+        }
+        END_TRY;
+        return P;
+}
+
+
+void ThreadPool_free(T *P) {
+        assert(P && *P);
+        T p = *P;
+        LOCK(p->mutex)
+        {
+                p->stopped = true;
+                Sem_broadcast(p->work);
+                Sem_broadcast(p->room);
+        }
+        END_LOCK;
+        for (int i = 0; i < p->started; i++)
+                Thread_join(p->worker[i].thread);
+        for (int i = 0; i < p->workers; i++) {
+                Mutex_destroy(p->worker[i].mutex);
+                FREE(p->worker[i].tasks);
+        }
+        FREE(p->worker);
+        Sem_destroy(p->done);
+        Sem_destroy(p->room);
+        Sem_destroy(p->work);
+        Mutex_destroy(p->mutex);
+        FREE(*P);
+}
+
+
+Future_T ThreadPool_submit(T P, void *(*task)(void *args), void *args) {
+        return submit(P, task, args, true);
+}
+
+
+Future_T ThreadPool_trySubmit(T P, void *(*task)(void *args), void *args) {
+        return submit(P, task, args, false);
+}
+
+
+int ThreadPool_workers(T P) {
+        assert(P);
+        return P->workers;
+}
+
+
+int ThreadPool_queued(T P) {
+        assert(P);
+        int queued = 0;
+        LOCK(P->mutex)
+        {
+                queued = P->queued;
+        }
+        END_LOCK;
+        return queued;
+}
+
+
+void *Future_get(Future_T F) {
+        assert(F);
+        if (! __atomic_load_n(&F->done, __ATOMIC_ACQUIRE)) {
+                T P = F->pool;
+                Worker_T *w = self(P);
+                while (! __atomic_load_n(&F->done, __ATOMIC_ACQUIRE)) {
+                        Task_T task;
+                        if (w && next(P, w->index, &task)) {
+                                // Help the pool while waiting, the awaited task may be queued behind this worker
+                                run(P, &task);
+                                continue;
+                        }
+                        LOCK(P->mutex)
+                        {
+                                // A worker waits only when the queues are empty, so the awaited task runs in another thread
+                                if (! F->done && (! w || P->queued == 0))
+                                        Sem_wait(P->done, P->mutex);
+                        }
+                        END_LOCK;
+                }
+        }
+        if (F->exception)
+                Exception_throw(F->exception, __func__, __FILE__, __LINE__, "%s", F->message, 0);
+        return F->result;
+}
+
+
+boolean_t Future_isDone(Future_T F) {
+        assert(F);
+        return __atomic_load_n(&F->done, __ATOMIC_ACQUIRE);
+}
+
+
+void Future_free(Future_T *F) {
+        assert(F && *F);
+        release(*F);
+        *F = NULL;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef THREADPOOL_INCLUDED
+#define THREADPOOL_INCLUDED
+
+
+/**
+ * A <b>ThreadPool</b> runs tasks on a fixed set of worker threads. Each
+ * worker has its own task queue, a worker which ran out of tasks steals
+ * from the queues of the other workers, so one lock is not contended by
+ * all workers and a long task doesn't hold back the tasks queued behind it.
+ * The tasks are taken from the queues in submission order.
+ *
+ * The number of queued tasks is bounded by the capacity of the pool:
+ * ThreadPool_submit() waits for room, ThreadPool_trySubmit() returns NULL
+ * when the pool is full. A task submitted from a worker of the same pool
+ * is run in the submitting thread when the pool is full, so a task which
+ * submits subtasks never blocks the pool.
+ *
+ * Each submitted task has a Future, which is used to wait for the task and
+ * to get its result:
+ * <pre>
+ * ThreadPool_T P = ThreadPool_new(4, 64);
+ * Future_T F = ThreadPool_submit(P, checksum, path);
+ * ...
+ * char *sum = Future_get(F);
+ * Future_free(&F);
+ * ThreadPool_free(&P);
+ * </pre>
+ * An exception thrown by the task is caught by the worker and re-thrown by
+ * Future_get(). A worker which waits for a Future runs other queued tasks
+ * meanwhile. The worker threads inherit the signal mask of the thread which
+ * created the pool.
+ *
+ * This class is thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T ThreadPool_T
+typedef struct T *T;
+typedef struct Future_T *Future_T;
+
+
+/**
+ * Create a new ThreadPool and start its worker threads
+ * @param workers The number of worker threads (workers > 0)
+ * @param capacity The maximum number of queued tasks (capacity > 0)
+ * @return A ThreadPool object
+ * @exception AssertException if a parameter is out of range or a thread
+ * could not be created
+ * @exception MemoryException if allocation failed
+ */
+T ThreadPool_new(int workers, int capacity);
+
+
+/**
+ * Shut down the ThreadPool and release allocated resources. The tasks
+ * which were queued already are run before the workers exit, the method
+ * waits for the workers. The Futures are not freed, they stay valid and
+ * Future_get() returns the result immediately.
+ * @param P A ThreadPool object reference
+ */
+void ThreadPool_free(T *P);
+
+
+/**
+ * Submit a task to the ThreadPool. If the pool is full, wait until a queued
+ * task is taken by a worker.
+ * @param P A ThreadPool object
+ * @param task The task to run, it's called with <code>args</code> and its
+ * return value is the result of the Future
+ * @param args Arguments to <code>task</code>
+ * @return A Future of the task, the caller must free it with Future_free()
+ * @exception AssertException if the pool was shut down
+ * @exception MemoryException if allocation failed
+ */
+Future_T ThreadPool_submit(T P, void *(*task)(void *args), void *args);
+
+
+/**
+ * Submit a task to the ThreadPool if it has room for the task
+ * @param P A ThreadPool object
+ * @param task The task to run, see ThreadPool_submit()
+ * @param args Arguments to <code>task</code>
+ * @return A Future of the task or NULL if the pool is full
+ * @exception AssertException if the pool was shut down
+ * @exception MemoryException if allocation failed
+ */
+Future_T ThreadPool_trySubmit(T P, void *(*task)(void *args), void *args);
+
+
+/**
+ * Returns the number of worker threads
+ * @param P A ThreadPool object
+ * @return The number of worker threads
+ */
+int ThreadPool_workers(T P);
+
+
+/**
+ * Returns the number of tasks queued and not yet taken by a worker
+ * @param P A ThreadPool object
+ * @return The number of queued tasks
+ */
+int ThreadPool_queued(T P);
+
+
+/**
+ * Wait for the task and return its result. If the task threw an exception,
+ * the exception is re-thrown with the same message. A worker thread of the
+ * pool runs other queued tasks while it waits.
+ * @param F A Future object
+ * @return The value returned by the task
+ * @exception The exception thrown by the task
+ */
+void *Future_get(Future_T F);
+
+
+/**
+ * Check if the task has finished
+ * @param F A Future object
+ * @return true if the task has finished, otherwise false
+ */
+boolean_t Future_isDone(Future_T F);
+
+
+/**
+ * Release the Future. The task isn't cancelled, if it didn't finish yet,
+ * it runs and its result is dropped.
+ * @param F A Future object reference
+ */
+void Future_free(Future_T *F);
+
+
+#undef T
+#endif
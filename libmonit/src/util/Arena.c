@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arena.h"
+
+
+/**
+ * Implementation of the Arena interface. The blocks are kept in a singly
+ * linked list with the current block first.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ------------------------------------------------------------ Definitions */
+
+
+/* The strictest alignment of the basic types */
+union align {
+        long l;
+        long long ll;
+        double d;
+        long double ld;
+        void *p;
+        void (*f)(void);
+};
+
+
+#define ALIGN(n) (((n) + sizeof(union align) - 1) & ~(sizeof(union align) - 1))
+
+
+typedef struct block_t {
+        struct block_t *next;
+        char *avail;
+        char *limit;
+} *block_t;
+
+
+/* The block header is padded so the block data is aligned */
+#define HEADER ALIGN(sizeof(struct block_t))
+
+
+#define T Arena_T
+struct T {
+        long hint;
+        long used;           // Bytes allocated since the last reset
+        block_t blocks;
+};
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+static inline block_t newBlock(long size) {
+        block_t b = ALLOC(HEADER + size);
+        b->next = NULL;
+        b->avail = (char *)b + HEADER;
+        b->limit = b->avail + size;
+        return b;
+}
+
+
+static inline void freeBlocks(block_t b) {
+        while (b) {
+                block_t next = b->next;
+                FREE(b);
+                b = next;
+        }
+}
+
+
+/* ----------------------------------------------------------------- Public */
+
+
+T Arena_new(int hint) {
+        if (hint <= 0)
+                THROW(AssertException, "Illegal hint value");
+        T A;
+        NEW(A);
+        A->hint = ALIGN(hint);
+        A->blocks = newBlock(A->hint);
+        return A;
+}
+
+
+void Arena_free(T *A) {
+        assert(A && *A);
+        freeBlocks((*A)->blocks);
+        FREE(*A);
+}
+
+
+void *Arena_alloc(T A, long size) {
+        assert(A);
+        if (size <= 0)
+                THROW(AssertException, "Illegal size value");
+        size = ALIGN(size);
+        block_t b = A->blocks;
+        if (size > b->limit - b->avail) {
+                if (size > A->hint / 2) {
+                        // A large allocation gets its own block behind the current block, so the rest of the current block is still used
+                        block_t large = newBlock(size);
+                        large->next = b->next;
+                        b->next = large;
+                        A->used += size;
+                        large->avail = large->limit;
+                        return large->limit - size;
+                }
+                b = newBlock(A->hint);
+                b->next = A->blocks;
+                A->blocks = b;
+        }
+        void *p = b->avail;
+        b->avail += size;
+        A->used += size;
+        return p;
+}
+
+
+void *Arena_calloc(T A, long count, long size) {
+        assert(A);
+        if (count <= 0 || size <= 0)
+                THROW(AssertException, "Illegal count or size value");
+        void *p = Arena_alloc(A, count * size);
+        memset(p, 0, count * size);
+        return p;
+}
+
+
+char *Arena_dup(T A, const char *s) {
+        return s ? Arena_ndup(A, s, strlen(s)) : NULL;
+}
+
+
+char *Arena_ndup(T A, const char *s, long n) {
+        assert(A);
+        if (n < 0)
+                THROW(AssertException, "Illegal length value");
+        if (! s)
+                return NULL;
+        long length;
+        for (length = 0; length < n && s[length]; length++)
+                ;
+        char *t = Arena_alloc(A, length + 1);
+        memcpy(t, s, length);
+        t[length] = 0;
+        return t;
+}
+
+
+T Arena_reset(T A) {
+        assert(A);
+        block_t b = A->blocks;
+        if (b->next) {
+                // Replace the blocks with one block which holds the whole load
+                long size = A->used > A->hint ? ALIGN(A->used) : A->hint;
+                freeBlocks(b);
+                A->blocks = b = newBlock(size);
+        }
+        b->avail = (char *)b + HEADER;
+        A->used = 0;
+        return A;
+}
+
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+
+/**
+ * An <b>Arena</b> is a region allocator for scratch memory with a common
+ * lifetime, such as the data of one HTTP request or of one validation
+ * cycle. Allocation bumps a pointer in the current memory block, the
+ * allocations are not freed one by one, but all at once with Arena_reset()
+ * or Arena_free(). An allocation larger than the block size gets its own
+ * block. Arena_reset() keeps one block, sized to hold everything allocated
+ * since the last reset, so a steady workload allocates from the heap only
+ * once the arena has warmed up.
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T Arena_T
+typedef struct T *T;
+
+
+/**
+ * Create a new Arena object
+ * @param hint The size of the memory blocks in bytes (hint > 0)
+ * @return A new Arena object
+ * @exception AssertException if hint is less than or equal to 0
+ * @exception MemoryException if allocation failed
+ */
+T Arena_new(int hint);
+
+
+/**
+ * Destroy an Arena object and free all memory allocated from it
+ * @param A An Arena object reference
+ */
+void Arena_free(T *A);
+
+
+/**
+ * Allocate <code>size</code> bytes from the arena. The memory is aligned
+ * for any type and is valid until the next Arena_reset() or Arena_free()
+ * @param A An Arena object
+ * @param size The number of bytes to allocate
+ * @return A pointer to the allocated memory
+ * @exception AssertException if size is less than or equal to 0
+ * @exception MemoryException if allocation failed
+ */
+void *Arena_alloc(T A, long size);
+
+
+/**
+ * Allocate <code>count</code> objects of <code>size</code> bytes each
+ * from the arena. Same as Arena_alloc(A, count * size) except the memory
+ * is cleared.
+ * @param A An Arena object
+ * @param count The number of objects to allocate
+ * @param size The size of each object in bytes
+ * @return A pointer to the allocated memory
+ * @exception AssertException if count or size is less than or equal to 0
+ * @exception MemoryException if allocation failed
+ */
+void *Arena_calloc(T A, long count, long size);
+
+
+/**
+ * Copy the string <code>s</code> into the arena
+ * @param A An Arena object
+ * @param s The string to copy
+ * @return A copy of <code>s</code> or NULL if <code>s</code> is NULL
+ * @exception MemoryException if allocation failed
+ */
+char *Arena_dup(T A, const char *s);
+
+
+/**
+ * Copy at most <code>n</code> characters of the string <code>s</code>
+ * into the arena. The copy is always NUL terminated
+ * @param A An Arena object
+ * @param s The string to copy
+ * @param n The maximum number of characters to copy
+ * @return A copy of <code>s</code> or NULL if <code>s</code> is NULL
+ * @exception AssertException if n is negative
+ * @exception MemoryException if allocation failed
+ */
+char *Arena_ndup(T A, const char *s, long n);
+
+
+/**
+ * Release everything allocated from the arena at once. The memory
+ * returned by the arena before the reset must not be used afterwards
+ * @param A An Arena object
+ * @return a reference to this Arena
+ */
+T Arena_reset(T A);
+
+
+#undef T
+#endif
@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "HashMap.h"
+
+
+/**
+ * Implementation of the HashMap interface. The index is an array of
+ * entry numbers with a power of two size, probed linearly from the slot
+ * of the key's hash. The entries array is never compacted, removed
+ * entries are put on a freelist and reused, so an entry number is a
+ * stable handle. The index is rebuilt from the cached hash values when
+ * it is three quarters full, counting the slots of removed entries.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ------------------------------------------------------------ Definitions */
+
+
+#define EMPTY   -1
+#define DELETED -2
+
+
+typedef struct entry_t {
+        const void *key;                                 // NULL if the entry is free
+        void *value;
+        unsigned int hash;
+        int next;                                         // Next free entry
+} *entry_t;
+
+
+#define T HashMap_T
+struct T {
+        int length;
+        int count;                          // Number of used and free entries
+        int capacity;                                   // Allocated entries
+        int freelist;
+        int size;                                     // Number of index slots
+        int filled;                  // Index slots which are not EMPTY
+        int *index;
+        entry_t entries;
+        int (*cmp)(const void *x, const void *y);
+        unsigned int (*hash)(const void *key);
+};
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+static inline unsigned int hashKey(T M, const void *key) {
+        unsigned int h;
+        if (M->hash) {
+                h = M->hash(key);
+        } else {
+                uint64_t p = (uintptr_t)key;
+                h = (unsigned int)(p ^ (p >> 32));
+        }
+        // Spread the bits so the low bits used for the slot depend on all bits
+        h ^= h >> 16;
+        h *= 0x45d9f3b;
+        h ^= h >> 16;
+        return h;
+}
+
+
+static inline boolean_t isEqual(T M, const void *x, const void *y) {
+        return x == y || (M->cmp && M->cmp(x, y) == 0);
+}
+
+
+/* Returns the index slot of the key or -1 if the key is not in the map */
+static inline int lookup(T M, const void *key, unsigned int hash) {
+        int mask = M->size - 1;
+        for (int slot = hash & mask; ; slot = (slot + 1) & mask) {
+                int e = M->index[slot];
+                if (e == EMPTY)
+                        return -1;
+                if (e >= 0 && M->entries[e].hash == hash && isEqual(M, M->entries[e].key, key))
+                        return slot;
+        }
+}
+
+
+static void rehash(T M, int n) {
+        int size = 8;
+        while (size < n * 2)
+                size *= 2;
+        if (size != M->size) {
+                FREE(M->index);
+                M->index = ALLOC(size * sizeof *(M->index));
+                M->size = size;
+        }
+        memset(M->index, 0xff, size * sizeof *(M->index)); // EMPTY
+        int mask = size - 1;
+        for (int e = 0; e < M->count; e++) {
+                if (M->entries[e].key) {
+                        int slot;
+                        for (slot = M->entries[e].hash & mask; M->index[slot] != EMPTY; slot = (slot + 1) & mask)
+                                ;
+                        M->index[slot] = e;
+                }
+        }
+        M->filled = M->length;
+}
+
+
+static inline void checkHandle(T M, int handle) {
+        if (handle < 0 || handle >= M->count || ! M->entries[handle].key)
+                THROW(AssertException, "Invalid handle %d", handle);
+}
+
+
+/* ----------------------------------------------------------------- Public */
+
+
+T HashMap_new(int hint, int (*cmp)(const void *x, const void *y), unsigned int (*hash)(const void *key)) {
+        if (hint < 0)
+                THROW(AssertException, "Illegal hint value");
+        if ((cmp == NULL) != (hash == NULL))
+                THROW(AssertException, "Both or none of the compare and hash functions must be set");
+        T M;
+        NEW(M);
+        M->cmp = cmp;
+        M->hash = hash;
+        M->freelist = -1;
+        if (hint > 0) {
+                M->entries = ALLOC(hint * sizeof *(M->entries));
+                M->capacity = hint;
+        }
+        rehash(M, hint);
+        return M;
+}
+
+
+void HashMap_free(T *M) {
+        assert(M && *M);
+        FREE((*M)->index);
+        FREE((*M)->entries);
+        FREE(*M);
+}
+
+
+void *HashMap_put(T M, const void *key, void *value) {
+        assert(M);
+        if (! key)
+                THROW(AssertException, "The key must not be NULL");
+        unsigned int hash = hashKey(M, key);
+        int slot = lookup(M, key, hash);
+        if (slot >= 0) {
+                entry_t entry = &M->entries[M->index[slot]];
+                void *previous = entry->value;
+                entry->value = value;
+                return previous;
+        }
+        if ((M->filled + 1) * 4 > M->size * 3)
+                rehash(M, M->length + 1);
+        int e;
+        if (M->freelist >= 0) {
+                e = M->freelist;
+                M->freelist = M->entries[e].next;
+        } else {
+                if (M->count == M->capacity) {
+                        M->capacity = M->capacity > 0 ? M->capacity * 2 : 8;
+                        RESIZE(M->entries, M->capacity * sizeof *(M->entries));
+                }
+                e = M->count++;
+        }
+        M->entries[e] = (struct entry_t){.key = key, .value = value, .hash = hash, .next = -1};
+        int mask = M->size - 1;
+        for (slot = hash & mask; M->index[slot] >= 0; slot = (slot + 1) & mask)
+                ;
+        if (M->index[slot] == EMPTY)
+                M->filled++;
+        M->index[slot] = e;
+        M->length++;
+        return NULL;
+}
+
+
+void *HashMap_get(T M, const void *key) {
+        int handle = HashMap_find(M, key);
+        return handle >= 0 ? M->entries[handle].value : NULL;
+}
+
+
+void *HashMap_remove(T M, const void *key) {
+        assert(M);
+        if (! key)
+                return NULL;
+        int slot = lookup(M, key, hashKey(M, key));
+        if (slot < 0)
+                return NULL;
+        int e = M->index[slot];
+        void *value = M->entries[e].value;
+        M->entries[e].key = NULL;
+        M->entries[e].next = M->freelist;
+        M->freelist = e;
+        M->length--;
+        // A slot before an empty slot doesn't need a tombstone, no probe continues past it
+        if (M->index[(slot + 1) & (M->size - 1)] == EMPTY) {
+                M->index[slot] = EMPTY;
+                M->filled--;
+        } else {
+                M->index[slot] = DELETED;
+        }
+        return value;
+}
+
+
+int HashMap_find(T M, const void *key) {
+        assert(M);
+        if (! key || M->length == 0)
+                return -1;
+        int slot = lookup(M, key, hashKey(M, key));
+        return slot >= 0 ? M->index[slot] : -1;
+}
+
+
+const void *HashMap_key(T M, int handle) {
+        assert(M);
+        checkHandle(M, handle);
+        return M->entries[handle].key;
+}
+
+
+void *HashMap_value(T M, int handle) {
+        assert(M);
+        checkHandle(M, handle);
+        return M->entries[handle].value;
+}
+
+
+void *HashMap_setValue(T M, int handle, void *value) {
+        assert(M);
+        checkHandle(M, handle);
+        void *previous = M->entries[handle].value;
+        M->entries[handle].value = value;
+        return previous;
+}
+
+
+int HashMap_next(T M, int handle) {
+        assert(M);
+        for (int e = handle < 0 ? 0 : handle + 1; e < M->count; e++)
+                if (M->entries[e].key)
+                        return e;
+        return -1;
+}
+
+
+int HashMap_length(T M) {
+        assert(M);
+        return M->length;
+}
+
+
+void HashMap_clear(T M) {
+        assert(M);
+        M->length = M->count = 0;
+        M->freelist = -1;
+        M->filled = 0;
+        memset(M->index, 0xff, M->size * sizeof *(M->index)); // EMPTY
+}
+
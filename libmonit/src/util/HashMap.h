@@ -0,0 +1,191 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef HASHMAP_INCLUDED
+#define HASHMAP_INCLUDED
+
+
+/**
+ * A <b>HashMap</b> is an associative table of key-value pairs, with
+ * expected constant time lookup, insertion and removal. The map uses
+ * open addressing with linear probing over a compact index array, and
+ * keeps the entries in a separate array, so a lookup touches few cache
+ * lines and the entries don't move when the index grows.
+ *
+ * Each entry has a <i>handle</i>, an integer which stays valid until the
+ * entry is removed. Iterate the entries with HashMap_next():
+ * <pre>
+ * for (int h = HashMap_next(M, -1); h >= 0; h = HashMap_next(M, h)) {
+ *         const char *name = HashMap_key(M, h);
+ *         Service_T s = HashMap_value(M, h);
+ *         ...
+ * }
+ * </pre>
+ * Removing the current entry while iterating is safe, entries inserted
+ * while iterating may or may not be visited.
+ *
+ * Keys are compared with the <code>cmp</code> function and hashed with
+ * the <code>hash</code> function given to HashMap_new(). If both are
+ * NULL the keys are compared by their address. Use Str_cmp() and
+ * Str_hash() for string keys. The map does not copy or free the keys
+ * or the values.
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T HashMap_T
+typedef struct T *T;
+
+
+/**
+ * Create a new HashMap object
+ * @param hint The expected number of entries (hint >= 0)
+ * @param cmp A function which returns 0 if the two keys are equal or NULL
+ * to compare the key addresses
+ * @param hash A hash function for the keys or NULL to hash the key addresses
+ * @return A HashMap object
+ * @exception AssertException if hint is negative or if only one of
+ * <code>cmp</code> and <code>hash</code> is NULL
+ * @exception MemoryException if allocation failed
+ */
+T HashMap_new(int hint, int (*cmp)(const void *x, const void *y), unsigned int (*hash)(const void *key));
+
+
+/**
+ * Destroy a HashMap object and release allocated resources. The keys
+ * and values are not freed.
+ * @param M A HashMap object reference
+ */
+void HashMap_free(T *M);
+
+
+/**
+ * Add the <code>key</code> with the <code>value</code> to the map. If
+ * the key is already in the map, its value is replaced and the handle
+ * of the entry doesn't change
+ * @param M A HashMap object
+ * @param key The key, must not be NULL
+ * @param value The value
+ * @return The previous value of the key or NULL if the key was not
+ * in the map
+ * @exception AssertException if key is NULL
+ * @exception MemoryException if allocation failed
+ */
+void *HashMap_put(T M, const void *key, void *value);
+
+
+/**
+ * Get the value of the <code>key</code>
+ * @param M A HashMap object
+ * @param key The key to look up
+ * @return The value of the key or NULL if the key is not in the map
+ */
+void *HashMap_get(T M, const void *key);
+
+
+/**
+ * Remove the <code>key</code> from the map
+ * @param M A HashMap object
+ * @param key The key to remove
+ * @return The value of the removed key or NULL if the key was not in
+ * the map
+ */
+void *HashMap_remove(T M, const void *key);
+
+
+/**
+ * Find the handle of the <code>key</code>
+ * @param M A HashMap object
+ * @param key The key to look up
+ * @return The handle of the entry or -1 if the key is not in the map
+ */
+int HashMap_find(T M, const void *key);
+
+
+/**
+ * Get the key of the entry with the given handle
+ * @param M A HashMap object
+ * @param handle A handle returned by HashMap_find() or HashMap_next()
+ * @return The key of the entry
+ * @exception AssertException if the handle is not valid
+ */
+const void *HashMap_key(T M, int handle);
+
+
+/**
+ * Get the value of the entry with the given handle
+ * @param M A HashMap object
+ * @param handle A handle returned by HashMap_find() or HashMap_next()
+ * @return The value of the entry
+ * @exception AssertException if the handle is not valid
+ */
+void *HashMap_value(T M, int handle);
+
+
+/**
+ * Replace the value of the entry with the given handle
+ * @param M A HashMap object
+ * @param handle A handle returned by HashMap_find() or HashMap_next()
+ * @param value The new value
+ * @return The previous value of the entry
+ * @exception AssertException if the handle is not valid
+ */
+void *HashMap_setValue(T M, int handle, void *value);
+
+
+/**
+ * Get the handle of the entry after the given handle. The entries are
+ * visited in the order of their handles, which is not the insertion
+ * order after entries were removed
+ * @param M A HashMap object
+ * @param handle The current handle or -1 to get the first entry
+ * @return The handle of the next entry or -1 if there are no more entries
+ */
+int HashMap_next(T M, int handle);
+
+
+/**
+ * Returns the number of entries in the map
+ * @param M A HashMap object
+ * @return Number of entries in the map
+ */
+int HashMap_length(T M);
+
+
+/**
+ * Remove all entries from the map. The allocated memory is kept
+ * @param M A HashMap object
+ */
+void HashMap_clear(T M);
+
+
+#undef T
+#endif
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#include "Config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <regex.h>
+
+#include "Str.h"
+#include "PatternSet.h"
+
+
+/**
+ * Implementation of the regular expressions set with the Aho-Corasick
+ * literals prefilter
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ----------------------------------------------------------- Definitions */
+
+
+#define T PatternSet_T
+
+
+typedef struct Pattern_T {
+        char *literal;                        // NULL if the pattern has no literal
+        const regex_t *regex;
+        boolean_t candidate;             // The literal was found by the last scan
+        int next;         // Next pattern with the same literal end state or -1
+} Pattern_T;
+
+
+struct T {
+        int count;
+        int size;
+        Pattern_T *patterns;
+        boolean_t compiled;
+        int states;
+        int alphabet;                            // Number of the byte classes
+        unsigned char classes[256];   // Byte to class, 0 is a byte not in any literal
+        int *delta;                     // Transitions: states x alphabet
+        int *output;       // First pattern whose literal ends in the state or -1
+        int *dictionary;         // Nearest state with output on the failure chain or -1
+        unsigned long long executions;      // Regular expressions executed
+};
+
+
+/* --------------------------------------------------------------- Private */
+
+
+static const char *_skipBracket(const char *p) {
+        p++;
+        if (*p == '^')
+                p++;
+        if (*p == ']')
+                p++;
+        while (*p && *p != ']') {
+                if (*p == '[' && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+                        char delimiter = p[1];
+                        for (p += 2; *p && ! (*p == delimiter && p[1] == ']'); p++)
+                                ;
+                        if (*p)
+                                p += 2;
+                } else {
+                        p++;
+                }
+        }
+        return *p ? p + 1 : p;
+}
+
+
+static const char *_skipGroup(const char *p) {
+        int depth = 0;
+        while (*p) {
+                if (*p == '\\') {
+                        p += p[1] ? 2 : 1;
+                } else if (*p == '[') {
+                        p = _skipBracket(p);
+                } else {
+                        if (*p == '(')
+                                depth++;
+                        else if (*p == ')' && --depth == 0)
+                                return p + 1;
+                        p++;
+                }
+        }
+        return p;
+}
+
+
+/**
+ * Extract the longest sequence of literal characters which every match of
+ * the pattern must contain. The groups, bracket expressions and escapes
+ * other than the escaped special characters end a sequence, the character
+ * before an optional quantifier is removed from it and an alternation at the
+ * top level means there is no such literal.
+ * @return The literal or NULL
+ */
+static char *_literal(const char *pattern) {
+        size_t length = strlen(pattern), bestLength = 0, currentLength = 0;
+        char *best = CALLOC(1, length + 1);
+        char *current = CALLOC(1, length + 1);
+        boolean_t literal = false; // The last atom was a literal character of the current sequence
+        for (const char *p = pattern; *p;) {
+                boolean_t end = true;
+                switch (*p) {
+                        case '|':
+                                FREE(best);
+                                FREE(current);
+                                return NULL;
+                        case '\\':
+                                if (p[1] && strchr(".[]()*+?{}|^$\\", p[1])) {
+                                        current[currentLength++] = p[1];
+                                        end = false;
+                                }
+                                p += p[1] ? 2 : 1;
+                                break;
+                        case '[':
+                                p = _skipBracket(p);
+                                break;
+                        case '(':
+                                p = _skipGroup(p);
+                                break;
+                        case '*':
+                        case '?':
+                        case '{':
+                                // The previous character is optional: remove it from the sequence
+                                if (literal)
+                                        currentLength--;
+                                p = *p == '{' && strchr(p, '}') ? strchr(p, '}') + 1 : p + 1;
+                                break;
+                        case '+':
+                        case '.':
+                        case '^':
+                        case '$':
+                        case ')':
+                                p++;
+                                break;
+                        default:
+                                current[currentLength++] = *p++;
+                                end = false;
+                                break;
+                }
+                literal = ! end;
+                // A quantifier may follow a literal character, so the sequence is closed only when some other atom ends it
+                if (end || ! *p) {
+                        if (currentLength > bestLength) {
+                                memcpy(best, current, currentLength);
+                                best[currentLength] = 0;
+                                bestLength = currentLength;
+                        }
+                        if (end)
+                                currentLength = 0;
+                }
+        }
+        FREE(current);
+        if (! bestLength)
+                FREE(best);
+        return best;
+}
+
+
+static void _release(T P) {
+        FREE(P->delta);
+        FREE(P->output);
+        FREE(P->dictionary);
+        P->compiled = false;
+}
+
+
+static void _compile(T P) {
+        // The byte classes: one per distinct character used in the literals
+        memset(P->classes, 0, sizeof(P->classes));
+        P->alphabet = 1;
+        int states = 1;
+        for (int i = 0; i < P->count; i++) {
+                if (P->patterns[i].literal) {
+                        for (unsigned char *c = (unsigned char *)P->patterns[i].literal; *c; c++, states++)
+                                if (! P->classes[*c])
+                                        P->classes[*c] = P->alphabet++;
+                }
+        }
+        P->delta = ALLOC(states * P->alphabet * sizeof(int));
+        for (int i = 0; i < states * P->alphabet; i++)
+                P->delta[i] = -1;
+        P->output = ALLOC(states * sizeof(int));
+        P->dictionary = ALLOC(states * sizeof(int));
+        for (int i = 0; i < states; i++)
+                P->output[i] = P->dictionary[i] = -1;
+        // The trie of the literals
+        P->states = 1;
+        for (int i = 0; i < P->count; i++) {
+                P->patterns[i].next = -1;
+                if (P->patterns[i].literal) {
+                        int state = 0;
+                        for (unsigned char *c = (unsigned char *)P->patterns[i].literal; *c; c++) {
+                                int *next = &P->delta[state * P->alphabet + P->classes[*c]];
+                                if (*next < 0)
+                                        *next = P->states++;
+                                state = *next;
+                        }
+                        P->patterns[i].next = P->output[state];
+                        P->output[state] = i;
+                }
+        }
+        // The failure links, resolved into the transitions in the breadth-first order
+        int *failure = CALLOC(P->states, sizeof(int));
+        int *queue = CALLOC(P->states, sizeof(int));
+        int head = 0, tail = 0;
+        for (int c = 0; c < P->alphabet; c++) {
+                int *next = &P->delta[c];
+                if (*next < 0)
+                        *next = 0;
+                else
+                        queue[tail++] = *next;
+        }
+        while (head < tail) {
+                int state = queue[head++];
+                for (int c = 0; c < P->alphabet; c++) {
+                        int *next = &P->delta[state * P->alphabet + c];
+                        int fallback = P->delta[failure[state] * P->alphabet + c];
+                        if (*next < 0) {
+                                *next = fallback;
+                        } else {
+                                failure[*next] = fallback;
+                                P->dictionary[*next] = P->output[fallback] >= 0 ? fallback : P->dictionary[fallback];
+                                queue[tail++] = *next;
+                        }
+                }
+        }
+        FREE(queue);
+        FREE(failure);
+        P->compiled = true;
+}
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T PatternSet_new(void) {
+        T P;
+        NEW(P);
+        return P;
+}
+
+
+void PatternSet_free(T *P) {
+        assert(P && *P);
+        for (int i = 0; i < (*P)->count; i++)
+                FREE((*P)->patterns[i].literal);
+        FREE((*P)->patterns);
+        _release(*P);
+        FREE(*P);
+}
+
+
+int PatternSet_add(T P, const char *pattern, const regex_t *regex) {
+        assert(P);
+        assert(pattern);
+        assert(regex);
+        if (P->count == P->size) {
+                P->size = P->size ? P->size * 2 : 8;
+                RESIZE(P->patterns, P->size * sizeof(Pattern_T));
+        }
+        Pattern_T *p = &P->patterns[P->count];
+        p->literal = _literal(pattern);
+        p->regex = regex;
+        p->candidate = true;
+        p->next = -1;
+        _release(P);
+        return P->count++;
+}
+
+
+int PatternSet_size(T P) {
+        assert(P);
+        return P->count;
+}
+
+
+void PatternSet_scan(T P, const char *s) {
+        assert(P);
+        assert(s);
+        if (! P->compiled)
+                _compile(P);
+        for (int i = 0; i < P->count; i++)
+                P->patterns[i].candidate = P->patterns[i].literal ? false : true;
+        if (P->states < 2)
+                return;
+        int state = 0;
+        for (const unsigned char *c = (const unsigned char *)s; *c; c++) {
+                state = P->delta[state * P->alphabet + P->classes[*c]];
+                for (int found = P->output[state] >= 0 ? state : P->dictionary[state]; found >= 0; found = P->dictionary[found])
+                        for (int i = P->output[found]; i >= 0; i = P->patterns[i].next)
+                                P->patterns[i].candidate = true;
+        }
+}
+
+
+boolean_t PatternSet_match(T P, int index, const char *s) {
+        assert(P);
+        assert(index >= 0 && index < P->count);
+        assert(s);
+        if (! P->patterns[index].candidate)
+                return false;
+        P->executions++;
+        return regexec(P->patterns[index].regex, s, 0, NULL, 0) == 0;
+}
+
+
+unsigned long long PatternSet_executions(T P) {
+        assert(P);
+        return P->executions;
+}
+
+
+const char *PatternSet_literal(T P, int index) {
+        assert(P);
+        assert(index >= 0 && index < P->count);
+        return P->patterns[index].literal;
+}
@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+#ifndef PATTERNSET_INCLUDED
+#define PATTERNSET_INCLUDED
+#include <regex.h>
+
+
+/**
+ * A set of POSIX extended regular expressions which are tested against the
+ * same input. For each pattern a literal which any match must contain is
+ * extracted (for example "timed out" from "connection [0-9]+ timed out") and
+ * the literals of all patterns are compiled into one Aho-Corasick automaton.
+ * PatternSet_scan() finds all literals present in the input in a single pass,
+ * so the regular expression is executed only for the patterns whose literal
+ * is present (or which have no usable literal, e.g. "a|b").
+ *
+ * The regular expressions are owned by the caller and must outlive the set.
+ * The set is not thread-safe: the result of the last scan is stored in it.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T PatternSet_T
+typedef struct T *T;
+
+
+/**
+ * Create a new empty pattern set
+ * @return A PatternSet object
+ */
+T PatternSet_new(void);
+
+
+/**
+ * Destroy a PatternSet object and release allocated resources. The regular
+ * expressions added to the set are not freed.
+ * @param P A PatternSet object reference
+ */
+void PatternSet_free(T *P);
+
+
+/**
+ * Add the pattern to the set. If the set was scanned already, the automaton
+ * is rebuilt on the next scan.
+ * @param P A PatternSet object
+ * @param pattern The regular expression source (POSIX extended syntax)
+ * @param regex The compiled regular expression
+ * @return The index of the pattern in the set
+ */
+int PatternSet_add(T P, const char *pattern, const regex_t *regex);
+
+
+/**
+ * Get the number of patterns in the set
+ * @param P A PatternSet object
+ * @return The number of patterns
+ */
+int PatternSet_size(T P);
+
+
+/**
+ * Find the patterns which can match the string: scan the string for the
+ * literals of all patterns in one pass. The automaton is built on the
+ * first call.
+ * @param P A PatternSet object
+ * @param s The string to scan
+ */
+void PatternSet_scan(T P, const char *s);
+
+
+/**
+ * Test if the pattern matches the string which was scanned last. The regular
+ * expression is executed only if the pattern literal was found by the scan.
+ * @param P A PatternSet object
+ * @param index The index of the pattern returned by PatternSet_add()
+ * @param s The string passed to the last PatternSet_scan() call
+ * @return true if the pattern matches, otherwise false
+ */
+boolean_t PatternSet_match(T P, int index, const char *s);
+
+
+/**
+ * Get the number of regular expressions executed by PatternSet_match()
+ * since the set was created. The patterns skipped by the scan are not
+ * counted.
+ * @param P A PatternSet object
+ * @return The execution count
+ */
+unsigned long long PatternSet_executions(T P);
+
+
+/**
+ * Get the literal extracted from the pattern (e.g. for diagnostics)
+ * @param P A PatternSet object
+ * @param index The index of the pattern returned by PatternSet_add()
+ * @return The literal which any match must contain or NULL if the pattern
+ * has none and is always tested with the regular expression
+ */
+const char *PatternSet_literal(T P, int index);
+
+
+#undef T
+#endif
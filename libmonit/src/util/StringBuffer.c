@@ -57,6 +57,19 @@ struct T {
 /* ---------------------------------------------------------------- Private */
 
 
+/* Grow the buffer geometrically so at least n more bytes and the NUL fit,
+ building a large document costs a linear number of copies */
+static inline void reserve(T S, int n) {
+        if (S->used + n >= S->length) {
+                int length = S->length * 2;
+                if (length <= S->used + n)
+                        length = S->used + n + 1;
+                S->length = length;
+                RESIZE(S->buffer, S->length);
+        }
+}
+
+
 static inline void append(T S, const char *s, va_list ap) {
         va_list ap_copy;
         while (true) {
@@ -67,8 +80,7 @@ static inline void append(T S, const char *s, va_list ap) {
                         S->used += n;
                         break;
                 }
-                S->length += STRLEN + n;
-                RESIZE(S->buffer, S->length);
+                reserve(S, n);
         }
 }
 
@@ -130,6 +142,49 @@ T StringBuffer_vappend(T S, const char *s, va_list ap) {
 }
 
 
+T StringBuffer_appendBytes(T S, const void *b, int length) {
+        assert(S);
+        if (b && length > 0) {
+                reserve(S, length);
+                memcpy(S->buffer + S->used, b, length);
+                S->used += length;
+                S->buffer[S->used] = 0;
+        }
+        return S;
+}
+
+
+T StringBuffer_appendChar(T S, char c) {
+        assert(S);
+        reserve(S, 1);
+        S->buffer[S->used++] = c;
+        S->buffer[S->used] = 0;
+        return S;
+}
+
+
+T StringBuffer_appendInt(T S, long long n) {
+        assert(S);
+        char buf[24], *p = buf + sizeof(buf);
+        unsigned long long u = n < 0 ? -(unsigned long long)n : (unsigned long long)n;
+        do
+                *--p = '0' + u % 10;
+        while (u /= 10);
+        if (n < 0)
+                *--p = '-';
+        return StringBuffer_appendBytes(S, p, (int)(buf + sizeof(buf) - p));
+}
+
+
+T StringBuffer_reserve(T S, int n) {
+        assert(S);
+        if (n < 0)
+                THROW(AssertException, "Illegal reserve value");
+        reserve(S, n);
+        return S;
+}
+
+
 int StringBuffer_replace(T S, const char *a, const char *b) {
         int n = 0;
         assert(S);
@@ -97,6 +97,54 @@ T StringBuffer_append(T S, const char *s, ...) __attribute__((format (printf, 2,
 T StringBuffer_vappend(T S, const char *s, va_list ap);
 
 
+/**
+ * Append <code>length</code> bytes from <code>b</code> to this string
+ * buffer. Unlike StringBuffer_append() the data is copied as is, without
+ * format string processing, use this method to append large or
+ * pre-formatted strings.
+ * @param S StringBuffer object
+ * @param b The bytes to append
+ * @param length The number of bytes to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendBytes(T S, const void *b, int length);
+
+
+/**
+ * Append the character <code>c</code> to this string buffer
+ * @param S StringBuffer object
+ * @param c The character to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendChar(T S, char c);
+
+
+/**
+ * Append the decimal representation of the number <code>n</code> to
+ * this string buffer, the same as appending with "%lld" but faster
+ * @param S StringBuffer object
+ * @param n The number to append
+ * @return a reference to this StringBuffer
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_appendInt(T S, long long n);
+
+
+/**
+ * Ensure the capacity for at least <code>n</code> more bytes, so the
+ * following appends up to this size don't resize the buffer. The buffer
+ * otherwise grows geometrically as needed.
+ * @param S StringBuffer object
+ * @param n The number of bytes to reserve (n >= 0)
+ * @return a reference to this StringBuffer
+ * @exception AssertException if n is negative
+ * @exception MemoryException if allocation was used and failed
+ */
+T StringBuffer_reserve(T S, int n);
+
+
 /**
  * Replace all occurences of <code>a</code> with <code>b</code>. Example: 
  * <pre>
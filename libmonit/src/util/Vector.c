@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#include "Config.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "Vector.h"
+
+
+/**
+ * Implementation of the Vector interface. The elements are kept in one
+ * array of pointers, which doubles its capacity when it is full.
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+/* ------------------------------------------------------------ Definitions */
+
+
+#define T Vector_T
+struct T {
+        int length;
+        int capacity;
+        void **array;
+};
+
+
+/* ---------------------------------------------------------------- Private */
+
+
+static inline void grow(T V, int n) {
+        if (n > V->capacity) {
+                int capacity = V->capacity > 0 ? V->capacity : 8;
+                while (capacity < n)
+                        capacity *= 2;
+                RESIZE(V->array, capacity * sizeof *(V->array));
+                V->capacity = capacity;
+        }
+}
+
+
+static inline void checkIndex(T V, int i, int length) {
+        if (i < 0 || i >= length)
+                THROW(AssertException, "Index %d out of range", i);
+}
+
+
+/* ----------------------------------------------------------------- Public */
+
+
+T Vector_new(int hint) {
+        if (hint < 0)
+                THROW(AssertException, "Illegal hint value");
+        T V;
+        NEW(V);
+        grow(V, hint);
+        return V;
+}
+
+
+void Vector_free(T *V) {
+        assert(V && *V);
+        FREE((*V)->array);
+        FREE(*V);
+}
+
+
+int Vector_append(T V, void *e) {
+        assert(V);
+        grow(V, V->length + 1);
+        V->array[V->length] = e;
+        return V->length++;
+}
+
+
+void Vector_insert(T V, int i, void *e) {
+        assert(V);
+        checkIndex(V, i, V->length + 1);
+        grow(V, V->length + 1);
+        memmove(V->array + i + 1, V->array + i, (V->length - i) * sizeof *(V->array));
+        V->array[i] = e;
+        V->length++;
+}
+
+
+void *Vector_get(T V, int i) {
+        assert(V);
+        checkIndex(V, i, V->length);
+        return V->array[i];
+}
+
+
+void *Vector_set(T V, int i, void *e) {
+        assert(V);
+        checkIndex(V, i, V->length);
+        void *previous = V->array[i];
+        V->array[i] = e;
+        return previous;
+}
+
+
+void *Vector_remove(T V, int i) {
+        assert(V);
+        checkIndex(V, i, V->length);
+        void *e = V->array[i];
+        V->length--;
+        memmove(V->array + i, V->array + i + 1, (V->length - i) * sizeof *(V->array));
+        return e;
+}
+
+
+void *Vector_pop(T V) {
+        assert(V);
+        return V->length > 0 ? V->array[--V->length] : NULL;
+}
+
+
+int Vector_length(T V) {
+        assert(V);
+        return V->length;
+}
+
+
+void Vector_clear(T V) {
+        assert(V);
+        V->length = 0;
+}
+
+
+void Vector_reserve(T V, int n) {
+        assert(V);
+        grow(V, n);
+}
+
+
+void Vector_sort(T V, int (*compare)(const void *x, const void *y)) {
+        assert(V);
+        assert(compare);
+        if (V->length > 1)
+                qsort(V->array, V->length, sizeof *(V->array), compare);
+}
+
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.  
+ */
+
+
+
+#ifndef VECTOR_INCLUDED
+#define VECTOR_INCLUDED
+
+
+/**
+ * A <b>Vector</b> is a sequence of zero or more elements stored in one
+ * contiguous array, which grows geometrically as elements are added.
+ * Vector_get() and Vector_set() take constant time and appending is
+ * amortized constant time. The elements are addressed by their index, an
+ * index is a stable handle for the element as long as no element before
+ * it is inserted or removed.
+ *
+ * Iterate the elements in order with:
+ * <pre>
+ * for (int i = 0; i < Vector_length(V); i++) {
+ *         Service_T s = Vector_get(V, i);
+ *         ...
+ * }
+ * </pre>
+ *
+ * This class is reentrant but not thread-safe
+ *
+ * @author http://www.tildeslash.com/
+ * @see http://www.mmonit.com/
+ * @file
+ */
+
+
+#define T Vector_T
+typedef struct T *T;
+
+
+/**
+ * Create a new Vector object
+ * @param hint The initial capacity of the Vector (hint >= 0)
+ * @return A Vector object
+ * @exception AssertException if hint is negative
+ * @exception MemoryException if allocation failed
+ */
+T Vector_new(int hint);
+
+
+/**
+ * Destroy a Vector object and release allocated resources. The elements
+ * are not freed.
+ * @param V A Vector object reference
+ */
+void Vector_free(T *V);
+
+
+/**
+ * Append <code>e</code> to the end of the Vector
+ * @param V A Vector object
+ * @param e An element to append to the Vector
+ * @return The index of the element
+ * @exception MemoryException if allocation failed
+ */
+int Vector_append(T V, void *e);
+
+
+/**
+ * Insert <code>e</code> at position <code>i</code> in the Vector. The
+ * elements from <code>i</code> to the end are moved up one position
+ * @param V A Vector object
+ * @param i The index to insert at (0 <= i <= Vector_length(V))
+ * @param e An element to insert
+ * @exception AssertException if i is out of range
+ * @exception MemoryException if allocation failed
+ */
+void Vector_insert(T V, int i, void *e);
+
+
+/**
+ * Get the element at position <code>i</code>
+ * @param V A Vector object
+ * @param i The index of the element (0 <= i < Vector_length(V))
+ * @return The element at position <code>i</code>
+ * @exception AssertException if i is out of range
+ */
+void *Vector_get(T V, int i);
+
+
+/**
+ * Replace the element at position <code>i</code> with <code>e</code>
+ * @param V A Vector object
+ * @param i The index of the element (0 <= i < Vector_length(V))
+ * @param e The new element
+ * @return The previous element at position <code>i</code>
+ * @exception AssertException if i is out of range
+ */
+void *Vector_set(T V, int i, void *e);
+
+
+/**
+ * Remove the element at position <code>i</code>. The elements after
+ * <code>i</code> are moved down one position
+ * @param V A Vector object
+ * @param i The index of the element (0 <= i < Vector_length(V))
+ * @return The removed element
+ * @exception AssertException if i is out of range
+ */
+void *Vector_remove(T V, int i);
+
+
+/**
+ * Remove the last element of the Vector
+ * @param V A Vector object
+ * @return The removed element or NULL if the Vector is empty
+ */
+void *Vector_pop(T V);
+
+
+/**
+ * Returns the number of elements in the Vector
+ * @param V A Vector object
+ * @return Number of elements in the Vector
+ */
+int Vector_length(T V);
+
+
+/**
+ * Clear this Vector so it contains no elements. The capacity is kept
+ * @param V A Vector object
+ */
+void Vector_clear(T V);
+
+
+/**
+ * Make room for at least <code>n</code> elements, so appending up to
+ * <code>n</code> elements in total doesn't reallocate the array
+ * @param V A Vector object
+ * @param n The number of elements to reserve space for
+ * @exception MemoryException if allocation failed
+ */
+void Vector_reserve(T V, int n);
+
+
+/**
+ * Sort the elements of the Vector with qsort(3)
+ * @param V A Vector object
+ * @param compare A comparison function, which is called with pointers
+ * to two elements, as qsort(3) does
+ */
+void Vector_sort(T V, int (*compare)(const void *x, const void *y));
+
+
+#undef T
+#endif
@@ -0,0 +1,138 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "Arena.h"
+
+/**
+ * Arena.c unity tests.
+ */
+
+
+int main(void) {
+        Arena_T A = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start Arena Tests\n\n");
+
+        printf("=> Test0: create/destroy\n");
+        {
+                A = Arena_new(1024);
+                assert(A);
+                Arena_free(&A);
+                assert(A == NULL);
+                TRY
+                {
+                        A = Arena_new(0);
+                        printf("\tResult: Arena_new(0) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: alloc and alignment\n");
+        {
+                A = Arena_new(128);
+                char *a = Arena_alloc(A, 1);
+                double *b = Arena_alloc(A, sizeof(double));
+                long long *c = Arena_alloc(A, 3 * sizeof(long long));
+                assert(a && b && c);
+                assert((uintptr_t)b % sizeof(double) == 0);
+                assert((uintptr_t)c % sizeof(long long) == 0);
+                assert((char *)b >= a + 1);
+                *a = 'x';
+                *b = 1.5;
+                c[0] = c[1] = c[2] = 42;
+                assert(*a == 'x' && *b == 1.5 && c[2] == 42);
+                int *z = Arena_calloc(A, 10, sizeof(int));
+                for (int i = 0; i < 10; i++)
+                        assert(z[i] == 0);
+                TRY
+                {
+                        Arena_alloc(A, 0);
+                        printf("\tResult: Arena_alloc(0) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                Arena_free(&A);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: dup and ndup\n");
+        {
+                A = Arena_new(64);
+                assert(Arena_dup(A, NULL) == NULL);
+                assert(Str_isEqual(Arena_dup(A, "abc"), "abc"));
+                assert(Str_isEqual(Arena_dup(A, ""), ""));
+                assert(Str_isEqual(Arena_ndup(A, "abcdef", 3), "abc"));
+                assert(Str_isEqual(Arena_ndup(A, "ab", 10), "ab"));
+                Arena_free(&A);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: grow with small and large allocations\n");
+        {
+                A = Arena_new(256);
+                char *s[1000];
+                for (int i = 0; i < 1000; i++) {
+                        char buf[32];
+                        snprintf(buf, sizeof(buf), "string %d", i);
+                        s[i] = Arena_dup(A, buf);
+                }
+                char *large = Arena_alloc(A, 100000);
+                memset(large, 'a', 100000);
+                char *after = Arena_dup(A, "after");
+                for (int i = 0; i < 1000; i++) {
+                        char buf[32];
+                        snprintf(buf, sizeof(buf), "string %d", i);
+                        assert(Str_isEqual(s[i], buf));
+                }
+                assert(large[0] == 'a' && large[99999] == 'a');
+                assert(Str_isEqual(after, "after"));
+                Arena_free(&A);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("=> Test4: reset\n");
+        {
+                A = Arena_new(256);
+                char *first = Arena_alloc(A, 16);
+                Arena_reset(A);
+                assert(Arena_alloc(A, 16) == first);
+                // The load which overflowed the block fits into one block after the reset
+                for (int i = 0; i < 100; i++)
+                        Arena_alloc(A, 100);
+                Arena_reset(A);
+                char *p = Arena_alloc(A, 100);
+                for (int i = 1; i < 100; i++) {
+                        char *q = Arena_alloc(A, 100);
+                        assert(q > p);
+                        p = q;
+                }
+                Arena_reset(A);
+                assert(Str_isEqual(Arena_dup(A, "reused"), "reused"));
+                Arena_free(&A);
+        }
+        printf("=> Test4: OK\n\n");
+
+        printf("============> Arena Tests: OK\n\n");
+
+        return 0;
+}
+
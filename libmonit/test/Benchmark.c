@@ -0,0 +1,379 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "StringBuffer.h"
+#include "system/Time.h"
+#include "system/Cron.h"
+#include "system/Link.h"
+#include "system/Net.h"
+#include "system/Command.h"
+#include "system/Process.h"
+#include "system/System.h"
+#include "Thread.h"
+#include "ThreadPool.h"
+#include "Exception.h"
+#include "AssertException.h"
+
+/**
+ * Microbenchmarks of the libmonit primitives. Each benchmark runs with
+ * a doubled number of iterations until it takes at least the minimum
+ * time, the result is the time and the number of heap allocations per
+ * operation. The optional arguments select the benchmarks whose name
+ * starts with one of them, e.g.: ./Benchmark Str Time
+ */
+
+
+#define MINIMUM_TIME 250000000LL // ns
+
+
+/* ------------------------------------------------------ Allocation counter */
+
+
+static long long allocations = 0;
+
+#ifdef __GLIBC__
+// Interpose the allocator, the library is linked statically so its allocations are counted too
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+
+void *malloc(size_t size) {
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+        __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+        return __libc_realloc(ptr, size);
+}
+#define ALLOCATIONS_COUNTED 1
+#else
+#define ALLOCATIONS_COUNTED 0
+#endif
+
+
+/* -------------------------------------------------------------- Benchmarks */
+
+
+static volatile long long sink; // Keeps the results alive so the compiler doesn't drop the work
+
+
+static void benchStringBufferAppend(long n) {
+        StringBuffer_T S = StringBuffer_create(64);
+        for (long i = 0; i < n; i++) {
+                StringBuffer_append(S, "%ld: %s\n", i, "monit");
+                if (StringBuffer_length(S) > 1048576)
+                        StringBuffer_clear(S);
+        }
+        sink += StringBuffer_length(S);
+        StringBuffer_free(&S);
+}
+
+
+static void benchStringBufferAppendBytes(long n) {
+        StringBuffer_T S = StringBuffer_create(64);
+        for (long i = 0; i < n; i++) {
+                StringBuffer_appendBytes(S, "0123456789abcdef", 16);
+                if (StringBuffer_length(S) > 1048576)
+                        StringBuffer_clear(S);
+        }
+        sink += StringBuffer_length(S);
+        StringBuffer_free(&S);
+}
+
+
+static void benchStringBufferGrowth(long n) {
+        // A fresh buffer grown from the default size to 64kB per operation
+        for (long i = 0; i < n; i++) {
+                StringBuffer_T S = StringBuffer_create(64);
+                for (int j = 0; j < 4096; j++)
+                        StringBuffer_appendBytes(S, "0123456789abcdef", 16);
+                sink += StringBuffer_length(S);
+                StringBuffer_free(&S);
+        }
+}
+
+
+static void benchStrDup(long n) {
+        for (long i = 0; i < n; i++) {
+                char *s = Str_dup("The quick brown fox jumps over the lazy dog");
+                sink += *s;
+                FREE(s);
+        }
+}
+
+
+static void benchStrCat(long n) {
+        for (long i = 0; i < n; i++) {
+                char *s = Str_cat("%s %ld %s", "service", i, "status");
+                sink += *s;
+                FREE(s);
+        }
+}
+
+
+static void benchStrTrim(long n) {
+        char buf[64];
+        for (long i = 0; i < n; i++) {
+                strcpy(buf, " \t  The quick brown fox \r\n ");
+                sink += *Str_trim(buf);
+        }
+}
+
+
+static void benchStrSub(long n) {
+        for (long i = 0; i < n; i++)
+                sink += Str_sub("Content-Type: application/x-www-form-urlencoded", "urlencoded") ? 1 : 0;
+}
+
+
+static void benchStrStartsWith(long n) {
+        for (long i = 0; i < n; i++)
+                sink += Str_startsWith("Content-Length: 1024", "content-length");
+}
+
+
+static void benchStrParseInt(long n) {
+        for (long i = 0; i < n; i++)
+                sink += Str_parseInt("1234567");
+}
+
+
+static void benchTimeIncron(long n) {
+        time_t t = Time_build(2016, 5, 1, 12, 0, 0);
+        for (long i = 0; i < n; i++)
+                sink += Time_incron("0-5,30 8-18 * * 1-5", t + i * 60);
+}
+
+
+static void benchCronMatch(long n) {
+        time_t t = Time_build(2016, 5, 1, 12, 0, 0);
+        Cron_T C = Cron_new("0-5,30 8-18 * * 1-5");
+        for (long i = 0; i < n; i++)
+                sink += Cron_match(C, t + i * 60);
+        Cron_free(&C);
+}
+
+
+static void benchTimeFmt(long n) {
+        char buf[STRLEN];
+        time_t t = Time_build(2016, 5, 1, 12, 0, 0);
+        for (long i = 0; i < n; i++)
+                sink += *Time_fmt(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S", t + i);
+}
+
+
+static void benchLinkUpdate(long n) {
+        Link_T L = Link_createForInterface("lo");
+        for (long i = 0; i < n; i++)
+                Link_update(L);
+        sink += Link_getBytesInTotal(L);
+        Link_free(&L);
+}
+
+
+static void benchLinkTryUpdate(long n) {
+        Link_T L = Link_createForInterface("lo");
+        for (long i = 0; i < n; i++)
+                sink += Link_tryUpdate(L, NULL, 0);
+        Link_free(&L);
+}
+
+
+static void benchCommandExecute(long n) {
+        for (long i = 0; i < n; i++) {
+                Command_T C = Command_new("/bin/sh", "-c", "exit 0", NULL);
+                Process_T P = Command_execute(C);
+                assert(P);
+                sink += Process_waitFor(P);
+                Process_free(&P);
+                Command_free(&C);
+        }
+}
+
+
+static void benchNetReadWrite(long n) {
+        // One 4kB message per operation through a local socket pair
+        char out[4096], in[4096];
+        int s[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, s) != 0)
+                THROW(AssertException, "socketpair: %s", System_getLastError());
+        memset(out, 'x', sizeof(out));
+        for (long i = 0; i < n; i++) {
+                ssize_t sent = Net_write(s[0], out, sizeof(out), 1000);
+                assert(sent == sizeof(out));
+                for (ssize_t received = 0, r; received < sent; received += r) {
+                        r = Net_read(s[1], in + received, sizeof(in) - received, 1000);
+                        assert(r > 0);
+                }
+                sink += in[0];
+        }
+        close(s[0]);
+        close(s[1]);
+}
+
+
+static void benchTry(long n) {
+        for (long i = 0; i < n; i++) {
+                TRY
+                {
+                        sink++;
+                }
+                END_TRY;
+        }
+}
+
+
+static void benchTryThrowCatch(long n) {
+        for (long i = 0; i < n; i++) {
+                TRY
+                {
+                        THROW(AssertException, "benchmark");
+                }
+                CATCH (AssertException)
+                {
+                        sink++;
+                }
+                END_TRY;
+        }
+}
+
+
+static void *task(void *args) {
+        return args;
+}
+
+
+static void benchThreadCreateJoin(long n) {
+        // The baseline for the thread pool: one thread per task
+        for (long i = 0; i < n; i++) {
+                Thread_T thread;
+                Thread_create(thread, task, NULL);
+                Thread_join(thread);
+                sink++;
+        }
+}
+
+
+static void benchThreadPoolSubmit(long n) {
+        // Batches of tasks submitted to 4 workers, the time per task includes waiting for its Future
+        Future_T F[64];
+        ThreadPool_T P = ThreadPool_new(4, 64);
+        for (long i = 0; i < n; i += 64) {
+                int batch = n - i < 64 ? (int)(n - i) : 64;
+                for (int j = 0; j < batch; j++)
+                        F[j] = ThreadPool_submit(P, task, (void *)1);
+                for (int j = 0; j < batch; j++) {
+                        sink += (intptr_t)Future_get(F[j]);
+                        Future_free(&F[j]);
+                }
+        }
+        ThreadPool_free(&P);
+}
+
+
+static struct {
+        const char *name;
+        void (*run)(long n);
+        int bytes; // Bytes transferred per operation for the throughput or 0
+} benchmarks[] = {
+        {"StringBuffer_append", benchStringBufferAppend, 0},
+        {"StringBuffer_appendBytes", benchStringBufferAppendBytes, 0},
+        {"StringBuffer_growth64k", benchStringBufferGrowth, 0},
+        {"Str_dup", benchStrDup, 0},
+        {"Str_cat", benchStrCat, 0},
+        {"Str_trim", benchStrTrim, 0},
+        {"Str_sub", benchStrSub, 0},
+        {"Str_startsWith", benchStrStartsWith, 0},
+        {"Str_parseInt", benchStrParseInt, 0},
+        {"Time_incron", benchTimeIncron, 0},
+        {"Cron_match", benchCronMatch, 0},
+        {"Time_fmt", benchTimeFmt, 0},
+        {"Link_update", benchLinkUpdate, 0},
+        {"Link_tryUpdate", benchLinkTryUpdate, 0},
+        {"Command_execute", benchCommandExecute, 0},
+        {"Net_write/Net_read", benchNetReadWrite, 4096},
+        {"TRY", benchTry, 0},
+        {"TRY/THROW/CATCH", benchTryThrowCatch, 0},
+        {"Thread_create/Thread_join", benchThreadCreateJoin, 0},
+        {"ThreadPool_submit/Future_get", benchThreadPoolSubmit, 0},
+        {}
+};
+
+
+/* ------------------------------------------------------------------ Runner */
+
+
+static long long nanoseconds(void) {
+        struct timespec t;
+        clock_gettime(CLOCK_MONOTONIC, &t);
+        return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+
+static boolean_t selected(int argc, char **argv, const char *name) {
+        if (argc < 2)
+                return true;
+        for (int i = 1; i < argc; i++)
+                if (Str_startsWith(name, argv[i]))
+                        return true;
+        return false;
+}
+
+
+int main(int argc, char **argv) {
+
+        Bootstrap(); // Need to initialize library
+
+        printf("%-28s %12s %14s %12s %12s\n", "Benchmark", "iterations", "ns/op", "allocs/op", "MB/s");
+        for (int i = 0; benchmarks[i].name; i++) {
+                if (! selected(argc, argv, benchmarks[i].name))
+                        continue;
+                TRY
+                {
+                        long n = 1;
+                        long long elapsed, allocated;
+                        while (true) {
+                                allocated = __atomic_load_n(&allocations, __ATOMIC_RELAXED);
+                                long long start = nanoseconds();
+                                benchmarks[i].run(n);
+                                elapsed = nanoseconds() - start;
+                                allocated = __atomic_load_n(&allocations, __ATOMIC_RELAXED) - allocated;
+                                if (elapsed >= MINIMUM_TIME || n >= 1L << 30)
+                                        break;
+                                n *= 2;
+                        }
+                        char allocs[32] = "n/a", throughput[32] = "";
+                        if (ALLOCATIONS_COUNTED)
+                                snprintf(allocs, sizeof(allocs), "%.2f", (double)allocated / n);
+                        if (benchmarks[i].bytes)
+                                snprintf(throughput, sizeof(throughput), "%.1f", (double)benchmarks[i].bytes * n * 1000. / elapsed);
+                        printf("%-28s %12ld %14.1f %12s %12s\n", benchmarks[i].name, n, (double)elapsed / n, allocs, throughput);
+                }
+                ELSE
+                {
+                        printf("%-28s skipped -- %s\n", benchmarks[i].name, Exception_frame.message);
+                }
+                END_TRY;
+                fflush(stdout);
+        }
+
+        return 0;
+}
+
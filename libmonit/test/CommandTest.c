@@ -172,6 +172,12 @@ int main(void) {
                 assert(Str_parseLLong(Command_getEnv(c, "PID")) > 1);
                 Command_vSetEnv(c, "ZERO", NULL);
                 assert(Str_isEqual(Command_getEnv(c, "ZERO"), ""));
+                // The environment of this process is inherited unless overridden
+                setenv("COMMANDTEST", "inherited", 1);
+                assert(Str_isEqual(Command_getEnv(c, "COMMANDTEST"), "inherited"));
+                Command_setEnv(c, "COMMANDTEST", "overridden");
+                assert(Str_isEqual(Command_getEnv(c, "COMMANDTEST"), "overridden"));
+                unsetenv("COMMANDTEST");
                 Command_free(&c);
                 assert(!c);
         }
@@ -279,6 +285,23 @@ int main(void) {
         printf("=> Test12: OK\n\n");
 #endif
 
+        printf("=> Test13: resource usage of sub-process\n");
+        {
+                Command_T c = Command_new("/bin/sh", "-c", "i=0; while [ $i -lt 20000 ]; do i=$((i+1)); done", NULL);
+                assert(c);
+                Process_T p = Command_execute(c);
+                assert(p);
+                Process_waitFor(p);
+                assert(Process_getCpuTime(p) > 0);
+                assert(Process_getMaxMemory(p) > 0);
+                assert(Process_getRunTime(p) >= 0);
+                printf("\tcpu time: %lldus, memory: %lldB, run time: %lldms\n", Process_getCpuTime(p), Process_getMaxMemory(p), Process_getRunTime(p));
+                Process_free(&p);
+                Command_free(&c);
+                assert(!c);
+        }
+        printf("=> Test13: OK\n\n");
+
         printf("============> Command Tests: OK\n\n");
 
         return 0;
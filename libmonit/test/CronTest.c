@@ -0,0 +1,94 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "system/Time.h"
+#include "system/Cron.h"
+
+/**
+ * Cron.c unity tests.
+ */
+
+
+int main(void) {
+
+        setenv("TZ", "CET", 1);
+        tzset();
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start Cron Tests\n\n");
+
+        printf("=> Test1: invalid specifications\n");
+        {
+                assert(! Cron_new("a bc d"));
+                assert(! Cron_new("* * * *  ")); // Too few fields
+                assert(! Cron_new("* * * * * * ")); // Too many fields
+                assert(! Cron_new("60 * * * *")); // Out of range
+                assert(! Cron_new("* * 0 * *"));
+                assert(! Cron_new("* * * * 7"));
+                assert(! Cron_new("* 10-9 * * *")); // Reversed range
+                assert(! Cron_new("* 1,,2 * * *"));
+                assert(! Cron_new("* 1- * * *"));
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: Cron_match\n");
+        {
+                // Same specifications as the Time_incron test
+                const char *match[] = {"27 11 5 7 2", "* * * * *", "* 10-11 1-5 * 1-5", "* 10,11 1-3,5,6 * *", NULL};
+                const char *nomatch[] = {"1-10 9-10 1-5 * 1-5", "* 10,11,12 4,5,6 * 0,6", NULL};
+                time_t time = Time_build(2011, 7, 5, 11, 27, 5);
+                for (int i = 0; match[i]; i++) {
+                        Cron_T C = Cron_new(match[i]);
+                        assert(C);
+                        assert(Cron_match(C, time));
+                        assert(Cron_match(C, time) == Time_incron(match[i], time));
+                        Cron_free(&C);
+                        assert(! C);
+                }
+                for (int i = 0; nomatch[i]; i++) {
+                        Cron_T C = Cron_new(nomatch[i]);
+                        assert(C);
+                        assert(! Cron_match(C, time));
+                        assert(Cron_match(C, time) == Time_incron(nomatch[i], time));
+                        Cron_free(&C);
+                }
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: Cron_nextFire\n");
+        {
+                time_t time = Time_build(2011, 7, 5, 11, 27, 5); // Tuesday
+                Cron_T C = Cron_new("* * * * *");
+                assert(Cron_nextFire(C, time) == Time_build(2011, 7, 5, 11, 28, 0));
+                Cron_free(&C);
+                C = Cron_new("0 3 * * *");
+                assert(Cron_nextFire(C, time) == Time_build(2011, 7, 6, 3, 0, 0));
+                // Within the matching minute the next fire is on the next day
+                assert(Cron_nextFire(C, Time_build(2011, 7, 6, 3, 0, 20)) == Time_build(2011, 7, 7, 3, 0, 0));
+                Cron_free(&C);
+                C = Cron_new("30 8-9 * * 1-5");
+                assert(Cron_nextFire(C, Time_build(2011, 7, 8, 9, 31, 0)) == Time_build(2011, 7, 11, 8, 30, 0)); // Friday => Monday
+                Cron_free(&C);
+                C = Cron_new("0 0 1 1 *");
+                assert(Cron_nextFire(C, time) == Time_build(2012, 1, 1, 0, 0, 0));
+                Cron_free(&C);
+                C = Cron_new("* * 31 2 *"); // Never
+                assert(Cron_nextFire(C, time) == 0);
+                Cron_free(&C);
+                // Daylight saving time change: 27 Mar 2011 02:00 CET => 03:00 CEST
+                C = Cron_new("30 * 27 3 *");
+                assert(Cron_nextFire(C, Time_build(2011, 3, 27, 1, 40, 0)) == Time_build(2011, 3, 27, 3, 30, 0));
+                Cron_free(&C);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("============> Cron Tests: OK\n\n");
+
+        return 0;
+}
@@ -0,0 +1,236 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "List.h"
+#include "HashMap.h"
+#include "system/Time.h"
+
+/**
+ * HashMap.c unity tests.
+ */
+
+
+int main(void) {
+        HashMap_T M = NULL;
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start HashMap Tests\n\n");
+
+        printf("=> Test0: create/destroy\n");
+        {
+                M = HashMap_new(0, NULL, NULL);
+                assert(M);
+                assert(HashMap_length(M) == 0);
+                assert(HashMap_next(M, -1) == -1);
+                HashMap_free(&M);
+                assert(M == NULL);
+                M = HashMap_new(100, Str_cmp, Str_hash);
+                HashMap_free(&M);
+                TRY
+                {
+                        M = HashMap_new(-1, NULL, NULL);
+                        printf("\tResult: HashMap_new(-1) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                TRY
+                {
+                        M = HashMap_new(0, Str_cmp, NULL);
+                        printf("\tResult: HashMap_new without hash function succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: put, get and remove string keys\n");
+        {
+                M = HashMap_new(4, Str_cmp, Str_hash);
+                assert(HashMap_put(M, "apple", "red") == NULL);
+                assert(HashMap_put(M, "banana", "yellow") == NULL);
+                assert(HashMap_put(M, "pear", "green") == NULL);
+                assert(HashMap_length(M) == 3);
+                char key[] = "apple"; // Equal key at another address
+                assert(Str_isEqual(HashMap_get(M, key), "red"));
+                assert(Str_isEqual(HashMap_get(M, "banana"), "yellow"));
+                assert(HashMap_get(M, "cherry") == NULL);
+                assert(Str_isEqual(HashMap_put(M, key, "green"), "red"));
+                assert(Str_isEqual(HashMap_get(M, "apple"), "green"));
+                assert(HashMap_length(M) == 3);
+                assert(Str_isEqual(HashMap_remove(M, "pear"), "green"));
+                assert(HashMap_remove(M, "pear") == NULL);
+                assert(HashMap_get(M, "pear") == NULL);
+                assert(HashMap_length(M) == 2);
+                TRY
+                {
+                        HashMap_put(M, NULL, "x");
+                        printf("\tResult: HashMap_put with NULL key succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                assert(HashMap_get(M, NULL) == NULL);
+                HashMap_free(&M);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: pointer keys\n");
+        {
+                int a, b;
+                M = HashMap_new(0, NULL, NULL);
+                HashMap_put(M, &a, "a");
+                HashMap_put(M, &b, "b");
+                assert(Str_isEqual(HashMap_get(M, &a), "a"));
+                assert(Str_isEqual(HashMap_get(M, &b), "b"));
+                char *s = Str_dup("key");
+                HashMap_put(M, s, "s");
+                assert(HashMap_get(M, "key") == NULL); // Compared by address
+                assert(Str_isEqual(HashMap_get(M, s), "s"));
+                FREE(s);
+                HashMap_free(&M);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: handles and iteration\n");
+        {
+                M = HashMap_new(0, Str_cmp, Str_hash);
+                char *keys[] = {"one", "two", "three", "four", "five"};
+                int handles[5];
+                for (int i = 0; i < 5; i++)
+                        HashMap_put(M, keys[i], keys[i]);
+                for (int i = 0; i < 5; i++) {
+                        handles[i] = HashMap_find(M, keys[i]);
+                        assert(handles[i] >= 0);
+                        assert(HashMap_key(M, handles[i]) == keys[i]);
+                }
+                assert(HashMap_find(M, "six") == -1);
+                int count = 0;
+                for (int h = HashMap_next(M, -1); h >= 0; h = HashMap_next(M, h)) {
+                        assert(Str_isEqual(HashMap_key(M, h), HashMap_value(M, h)));
+                        count++;
+                }
+                assert(count == 5);
+                // Handles are stable while the map grows
+                for (intptr_t i = 0; i < 1000; i++) {
+                        char *k = Str_cat("key%ld", (long)i);
+                        HashMap_put(M, k, (void *)i);
+                }
+                for (int i = 0; i < 5; i++)
+                        assert(HashMap_find(M, keys[i]) == handles[i]);
+                // Remove the current entry while iterating
+                count = 0;
+                for (int h = HashMap_next(M, -1); h >= 0; h = HashMap_next(M, h)) {
+                        char *k = (char *)HashMap_key(M, h);
+                        if (Str_startsWith(k, "key")) {
+                                HashMap_remove(M, k);
+                                FREE(k);
+                        }
+                        count++;
+                }
+                assert(count == 1005);
+                assert(HashMap_length(M) == 5);
+                assert(Str_isEqual(HashMap_setValue(M, handles[1], "TWO"), "two"));
+                assert(Str_isEqual(HashMap_get(M, "two"), "TWO"));
+                HashMap_remove(M, "two");
+                TRY
+                {
+                        HashMap_value(M, handles[1]);
+                        printf("\tResult: HashMap_value with a removed handle succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                // A removed entry is reused
+                HashMap_put(M, "six", "six");
+                assert(HashMap_find(M, "six") == handles[1]);
+                HashMap_clear(M);
+                assert(HashMap_length(M) == 0);
+                assert(HashMap_next(M, -1) == -1);
+                assert(HashMap_get(M, "one") == NULL);
+                HashMap_put(M, "one", "1");
+                assert(Str_isEqual(HashMap_get(M, "one"), "1"));
+                HashMap_free(&M);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("=> Test4: churn\n");
+        {
+                // Insert and remove keys so the index fills with removed slots and is rebuilt
+                M = HashMap_new(0, NULL, NULL);
+                for (intptr_t i = 1; i <= 100000; i++) {
+                        HashMap_put(M, (void *)i, (void *)i);
+                        if (i > 10)
+                                assert(HashMap_remove(M, (void *)(i - 10)) == (void *)(i - 10));
+                }
+                assert(HashMap_length(M) == 10);
+                for (intptr_t i = 1; i <= 100000; i++)
+                        assert(HashMap_get(M, (void *)i) == (i > 99990 ? (void *)i : NULL));
+                HashMap_free(&M);
+        }
+        printf("=> Test4: OK\n\n");
+
+        printf("=> Test5: benchmark lookup in List and HashMap\n");
+        {
+                int n = 1000, lookups = 10000;
+                char **keys = CALLOC(n, sizeof(char *));
+                List_T L = List_new();
+                M = HashMap_new(n, Str_cmp, Str_hash);
+                for (int i = 0; i < n; i++) {
+                        keys[i] = Str_cat("service-%d", i);
+                        List_append(L, keys[i]);
+                        HashMap_put(M, keys[i], keys[i]);
+                }
+                int found = 0;
+                long long start = Time_micro();
+                for (int i = 0; i < lookups; i++) {
+                        const char *k = keys[(i * 7919) % n];
+                        for (list_t p = L->head; p; p = p->next) {
+                                if (Str_isEqual(p->e, k)) {
+                                        found++;
+                                        break;
+                                }
+                        }
+                }
+                long long list = Time_micro() - start;
+                start = Time_micro();
+                for (int i = 0; i < lookups; i++)
+                        if (HashMap_get(M, keys[(i * 7919) % n]))
+                                found--;
+                long long map = Time_micro() - start;
+                assert(found == 0);
+                printf("\t%d lookups of %d string keys: List %.3f ms, HashMap %.3f ms\n", lookups, n, list / 1000., map / 1000.);
+                for (int i = 0; i < n; i++)
+                        FREE(keys[i]);
+                FREE(keys);
+                List_free(&L);
+                HashMap_free(&M);
+        }
+        printf("=> Test5: OK\n\n");
+
+        printf("============> HashMap Tests: OK\n\n");
+
+        return 0;
+}
+
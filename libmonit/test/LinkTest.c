@@ -25,6 +25,55 @@ int main(int argc, char **argv) {
 
         printf("============> Start Link Tests\n\n");
 
+        printf("=> Test1: per second history\n");
+        {
+                Link_T L = Link_createForInterface("lo");
+                assert(Link_getHistory(L) == 0);
+                Link_setHistory(L, 2);
+                assert(Link_getHistory(L) == 2);
+                TRY
+                {
+                        Link_getBytesInPerSecondAverage(L, 3);
+                        printf("\tResult: range outside of the history accepted\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                TRY
+                {
+                        for (int i = 0; i < 5; i++) {
+                                Link_update(L);
+                                Time_usleep(100000);
+                        }
+                        unsigned long long total = Link_getBytesInTotal(L);
+                        assert(Link_getBytesInPerSecondAverage(L, 1) <= total * 10);
+                        assert(Link_getPacketsOutPerSecondAverage(L, 2) <= Link_getPacketsOutTotal(L) * 10);
+                        Link_setHistory(L, 0);
+                        assert(Link_getHistory(L) == 0);
+                }
+                CATCH (AssertException)
+                {
+                        printf("\tLoopback interface not available, skipping: %s\n", Exception_frame.message);
+                }
+                END_TRY;
+                Link_free(&L);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: update without exception\n");
+        {
+                char error[STRLEN] = {};
+                Link_T L = Link_createForInterface("nonexistent0");
+                assert(! Link_tryUpdate(L, error, sizeof(error)));
+                assert(Str_sub(error, "nonexistent0"));
+                assert(! Link_tryUpdate(L, NULL, 0));
+                Link_free(&L);
+        }
+        printf("=> Test2: OK\n\n");
+
 
         printf("============> Link Tests: OK\n\n");
 
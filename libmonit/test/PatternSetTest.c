@@ -0,0 +1,92 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <regex.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "PatternSet.h"
+
+/**
+ * PatternSet.c unity tests.
+ */
+
+
+int main(void) {
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start PatternSet Tests\n\n");
+
+        printf("=> Test1: literal extraction\n");
+        {
+                const char *patterns[][2] = {
+                        {"connection [0-9]+ timed out", "connection "},
+                        {"error", "error"},
+                        {"^ERROR: disk", "ERROR: disk"},
+                        {"ab*cdef", "cdef"},
+                        {"fail(ed|ure) to start", " to start"},
+                        {"a\\.b\\*c", "a.b*c"},
+                        {"x{2}yz", "yz"},
+                        {"[[:digit:]]+ bytes", " bytes"},
+                        {"error|warning", NULL},
+                        {".*", NULL},
+                        {"", NULL},
+                        {NULL, NULL}
+                };
+                PatternSet_T P = PatternSet_new();
+                regex_t regex[12];
+                for (int i = 0; patterns[i][0]; i++) {
+                        assert(regcomp(&regex[i], patterns[i][0], REG_NOSUB | REG_EXTENDED) == 0);
+                        assert(PatternSet_add(P, patterns[i][0], &regex[i]) == i);
+                        const char *literal = PatternSet_literal(P, i);
+                        printf("\t'%s' -> '%s'\n", patterns[i][0], literal ? literal : "(none)");
+                        assert(patterns[i][1] ? Str_isEqual(literal, patterns[i][1]) : literal == NULL);
+                }
+                assert(PatternSet_size(P) == 11);
+                PatternSet_free(&P);
+                assert(! P);
+                for (int i = 0; i < 11; i++)
+                        regfree(&regex[i]);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: the set matches the same lines as the regular expressions\n");
+        {
+                const char *patterns[] = {"error", "timed out", "she", "hers", "his", "he", "^usr", "[0-9]+ ms$", "a|b", "rror [A-Z]", NULL};
+                const char *lines[] = {"", "ushers", "connection timed out", "ERROR error E", "his hers", "usr/bin", "took 12 ms", "took 12 ms!", "no match here", "error X", "error x", "aaa", "xyz", NULL};
+                PatternSet_T P = PatternSet_new();
+                regex_t regex[10];
+                int count = 0;
+                for (; patterns[count]; count++) {
+                        assert(regcomp(&regex[count], patterns[count], REG_NOSUB | REG_EXTENDED) == 0);
+                        PatternSet_add(P, patterns[count], &regex[count]);
+                }
+                for (int j = 0; lines[j]; j++) {
+                        PatternSet_scan(P, lines[j]);
+                        for (int i = 0; i < count; i++)
+                                assert(PatternSet_match(P, i, lines[j]) == (regexec(&regex[i], lines[j], 0, NULL, 0) == 0));
+                }
+                // Add a pattern after the scan: the automaton is rebuilt
+                regex_t more;
+                assert(regcomp(&more, "xyz", REG_NOSUB | REG_EXTENDED) == 0);
+                int index = PatternSet_add(P, "xyz", &more);
+                unsigned long long executions = PatternSet_executions(P);
+                PatternSet_scan(P, "xyz");
+                assert(PatternSet_match(P, index, "xyz"));
+                assert(! PatternSet_match(P, 0, "xyz"));
+                // Only the candidate pattern was executed
+                assert(PatternSet_executions(P) == executions + 1);
+                PatternSet_free(&P);
+                for (int i = 0; i < count; i++)
+                        regfree(&regex[i]);
+                regfree(&more);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("============> PatternSet Tests: OK\n\n");
+
+        return 0;
+}
@@ -248,6 +248,40 @@ int main(void) {
         }
         printf("=> Test12: OK\n\n");
 
+        printf("=> Test13: appendBytes, appendChar, appendInt and reserve\n");
+        {
+                sb = StringBuffer_create(1);
+                StringBuffer_appendBytes(sb, "abcdef", 3);
+                StringBuffer_appendBytes(sb, NULL, 3);
+                StringBuffer_appendBytes(sb, "xyz", 0);
+                StringBuffer_appendChar(sb, '-');
+                StringBuffer_appendInt(sb, 0);
+                StringBuffer_appendChar(sb, ' ');
+                StringBuffer_appendInt(sb, -42);
+                StringBuffer_appendChar(sb, ' ');
+                StringBuffer_appendInt(sb, 9223372036854775807LL);
+                StringBuffer_appendChar(sb, ' ');
+                StringBuffer_appendInt(sb, -9223372036854775807LL - 1);
+                assert(Str_isEqual(StringBuffer_toString(sb), "abc-0 -42 9223372036854775807 -9223372036854775808"));
+                StringBuffer_clear(sb);
+                StringBuffer_reserve(sb, 100000);
+                for (int i = 0; i < 10000; i++)
+                        StringBuffer_append(sb, "%d;", i % 10);
+                assert(StringBuffer_length(sb) == 20000);
+                assert(Str_isEqual(StringBuffer_substring(sb, 19994), "7;8;9;"));
+                StringBuffer_free(&sb);
+                assert(sb==NULL);
+                printf("\tGrow from one byte\n");
+                sb = StringBuffer_create(1);
+                for (int i = 0; i < 100000; i++)
+                        StringBuffer_appendChar(sb, 'a' + i % 26);
+                assert(StringBuffer_length(sb) == 100000);
+                assert(StringBuffer_toString(sb)[99999] == 'a' + 99999 % 26);
+                StringBuffer_free(&sb);
+                assert(sb==NULL);
+        }
+        printf("=> Test13: OK\n\n");
+
         printf("============> StringBuffer Tests: OK\n\n");
 
         return 0;
@@ -0,0 +1,226 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "Thread.h"
+#include "ThreadPool.h"
+#include "system/Time.h"
+
+/**
+ * ThreadPool.c unity tests.
+ */
+
+
+static ThreadPool_T pool;
+static Mutex_T gateMutex;
+static Sem_T gateSem;
+static boolean_t gateOpen;
+static int finished;
+
+
+static void *square(void *args) {
+        intptr_t n = (intptr_t)args;
+        return (void *)(n * n);
+}
+
+
+static void *fail(void *args) {
+        THROW(AssertException, "task %s failed", (char *)args);
+        return NULL;
+}
+
+
+static void *gate(void *args) {
+        LOCK(gateMutex)
+        {
+                while (! gateOpen)
+                        Sem_wait(gateSem, gateMutex);
+        }
+        END_LOCK;
+        return args;
+}
+
+
+static void *slow(void *args) {
+        Time_usleep(1000);
+        __atomic_add_fetch(&finished, 1, __ATOMIC_RELAXED);
+        return args;
+}
+
+
+// Fork-join: the subtasks are submitted to the pool the task runs in
+static void *fibonacci(void *args) {
+        intptr_t n = (intptr_t)args;
+        if (n < 2)
+                return (void *)n;
+        Future_T F = ThreadPool_submit(pool, fibonacci, (void *)(n - 1));
+        intptr_t result = (intptr_t)fibonacci((void *)(n - 2));
+        result += (intptr_t)Future_get(F);
+        Future_free(&F);
+        return (void *)result;
+}
+
+
+static void openGate(void) {
+        LOCK(gateMutex)
+        {
+                gateOpen = true;
+                Sem_broadcast(gateSem);
+        }
+        END_LOCK;
+}
+
+
+int main(void) {
+        Bootstrap(); // Need to initialize library
+
+        Mutex_init(gateMutex);
+        Sem_init(gateSem);
+
+        printf("============> Start ThreadPool Tests\n\n");
+
+        printf("=> Test0: create/destroy\n");
+        {
+                pool = ThreadPool_new(4, 16);
+                assert(pool);
+                assert(ThreadPool_workers(pool) == 4);
+                assert(ThreadPool_queued(pool) == 0);
+                ThreadPool_free(&pool);
+                assert(pool == NULL);
+                TRY
+                {
+                        pool = ThreadPool_new(0, 16);
+                        printf("\tResult: ThreadPool_new(0, 16) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                TRY
+                {
+                        pool = ThreadPool_new(4, 0);
+                        printf("\tResult: ThreadPool_new(4, 0) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: submit and get\n");
+        {
+                int n = 1000;
+                Future_T *F = CALLOC(n, sizeof(Future_T));
+                pool = ThreadPool_new(4, 8);
+                // More tasks than the capacity, ThreadPool_submit() waits for room
+                for (int i = 0; i < n; i++)
+                        F[i] = ThreadPool_submit(pool, square, (void *)(intptr_t)i);
+                for (int i = 0; i < n; i++) {
+                        assert((intptr_t)Future_get(F[i]) == i * i);
+                        assert(Future_isDone(F[i]));
+                        Future_free(&F[i]);
+                        assert(F[i] == NULL);
+                }
+                ThreadPool_free(&pool);
+                FREE(F);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: exception in the task\n");
+        {
+                pool = ThreadPool_new(2, 4);
+                Future_T F = ThreadPool_submit(pool, fail, "foo");
+                TRY
+                {
+                        Future_get(F);
+                        printf("\tResult: Future_get() didn't re-throw the exception\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        assert(Str_isEqual(Exception_frame.message, "task foo failed"));
+                }
+                END_TRY;
+                Future_free(&F);
+                // The worker survived the exception
+                F = ThreadPool_submit(pool, square, (void *)3);
+                assert((intptr_t)Future_get(F) == 9);
+                Future_free(&F);
+                ThreadPool_free(&pool);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: bounded queue\n");
+        {
+                gateOpen = false;
+                pool = ThreadPool_new(1, 2);
+                Future_T running = ThreadPool_submit(pool, gate, "running");
+                while (ThreadPool_queued(pool) > 0)
+                        Time_usleep(1000);
+                // The worker is blocked in the gate, two tasks fill the queue
+                Future_T first = ThreadPool_trySubmit(pool, gate, "first");
+                Future_T second = ThreadPool_trySubmit(pool, gate, "second");
+                assert(first && second);
+                assert(ThreadPool_queued(pool) == 2);
+                assert(ThreadPool_trySubmit(pool, gate, "third") == NULL);
+                assert(! Future_isDone(running));
+                openGate();
+                assert(Str_isEqual(Future_get(running), "running"));
+                assert(Str_isEqual(Future_get(first), "first"));
+                assert(Str_isEqual(Future_get(second), "second"));
+                Future_free(&running);
+                Future_free(&first);
+                Future_free(&second);
+                ThreadPool_free(&pool);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("=> Test4: subtasks\n");
+        {
+                // Few workers and a small queue: the workers run queued tasks while waiting and run the subtasks themselves when the pool is full
+                pool = ThreadPool_new(2, 4);
+                Future_T F = ThreadPool_submit(pool, fibonacci, (void *)20);
+                assert((intptr_t)Future_get(F) == 6765);
+                Future_free(&F);
+                ThreadPool_free(&pool);
+        }
+        printf("=> Test4: OK\n\n");
+
+        printf("=> Test5: shutdown runs the queued tasks\n");
+        {
+                int n = 32;
+                Future_T F[n];
+                finished = 0;
+                pool = ThreadPool_new(2, n);
+                for (int i = 0; i < n; i++)
+                        F[i] = ThreadPool_submit(pool, slow, (void *)(intptr_t)i);
+                // Free a Future before its task finished
+                Future_free(&F[n - 1]);
+                ThreadPool_free(&pool);
+                assert(finished == n);
+                for (int i = 0; i < n - 1; i++) {
+                        assert(Future_isDone(F[i]));
+                        assert((intptr_t)Future_get(F[i]) == i);
+                        Future_free(&F[i]);
+                }
+        }
+        printf("=> Test5: OK\n\n");
+
+        printf("============> ThreadPool Tests: OK\n\n");
+
+        Sem_destroy(gateSem);
+        Mutex_destroy(gateMutex);
+
+        return 0;
+}
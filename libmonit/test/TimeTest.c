@@ -61,8 +61,11 @@ int main(void) {
         {
                 time_t now;
                 now = Time_now();
+                long long int monotonic = Time_monotonic();
                 Time_usleep(1000000);
                 assert((now + 1) == Time_now());
+                long long int elapsed = Time_monotonic() - monotonic;
+                assert(elapsed >= 1000 && elapsed < 2000);
         }
         printf("=> Test3: OK\n\n");
 
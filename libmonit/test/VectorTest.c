@@ -0,0 +1,193 @@
+#include "Config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "Bootstrap.h"
+#include "Str.h"
+#include "List.h"
+#include "Vector.h"
+#include "system/Time.h"
+
+/**
+ * Vector.c unity tests.
+ */
+
+
+static int compare(const void *x, const void *y) {
+        return Str_cmp(*(const char **)x, *(const char **)y);
+}
+
+
+int main(void) {
+        Vector_T V = NULL;
+        char *s[] = {"zero", "one", "two", "three", "four", "five", "six", "seven", "eight", "nine"};
+
+        Bootstrap(); // Need to initialize library
+
+        printf("============> Start Vector Tests\n\n");
+
+        printf("=> Test0: create/destroy\n");
+        {
+                V = Vector_new(0);
+                assert(V);
+                assert(Vector_length(V) == 0);
+                Vector_free(&V);
+                assert(V == NULL);
+                V = Vector_new(100);
+                assert(Vector_length(V) == 0);
+                Vector_free(&V);
+                TRY
+                {
+                        V = Vector_new(-1);
+                        printf("\tResult: Vector_new(-1) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+        }
+        printf("=> Test0: OK\n\n");
+
+        printf("=> Test1: append, get and set\n");
+        {
+                V = Vector_new(2);
+                for (int i = 0; i < 10; i++)
+                        assert(Vector_append(V, s[i]) == i);
+                assert(Vector_length(V) == 10);
+                for (int i = 0; i < 10; i++)
+                        assert(Vector_get(V, i) == s[i]);
+                assert(Vector_set(V, 5, "FIVE") == s[5]);
+                assert(Str_isEqual(Vector_get(V, 5), "FIVE"));
+                TRY
+                {
+                        Vector_get(V, 10);
+                        printf("\tResult: Vector_get(V, 10) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                TRY
+                {
+                        Vector_set(V, -1, NULL);
+                        printf("\tResult: Vector_set(V, -1) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                Vector_free(&V);
+        }
+        printf("=> Test1: OK\n\n");
+
+        printf("=> Test2: insert, remove and pop\n");
+        {
+                V = Vector_new(0);
+                Vector_insert(V, 0, s[2]);
+                Vector_insert(V, 0, s[0]);
+                Vector_insert(V, 1, s[1]);
+                Vector_insert(V, 3, s[3]);
+                assert(Vector_length(V) == 4);
+                for (int i = 0; i < 4; i++)
+                        assert(Vector_get(V, i) == s[i]);
+                TRY
+                {
+                        Vector_insert(V, 5, s[5]);
+                        printf("\tResult: Vector_insert(V, 5) succeeded\n");
+                        exit(1);
+                }
+                CATCH (AssertException)
+                {
+                        // Passed
+                }
+                END_TRY;
+                assert(Vector_remove(V, 1) == s[1]);
+                assert(Vector_length(V) == 3);
+                assert(Vector_get(V, 0) == s[0]);
+                assert(Vector_get(V, 1) == s[2]);
+                assert(Vector_get(V, 2) == s[3]);
+                assert(Vector_pop(V) == s[3]);
+                assert(Vector_pop(V) == s[2]);
+                assert(Vector_pop(V) == s[0]);
+                assert(Vector_pop(V) == NULL);
+                assert(Vector_length(V) == 0);
+                Vector_free(&V);
+        }
+        printf("=> Test2: OK\n\n");
+
+        printf("=> Test3: reserve, clear and sort\n");
+        {
+                V = Vector_new(0);
+                Vector_reserve(V, 1000);
+                for (int i = 0; i < 10; i++)
+                        Vector_append(V, s[i]);
+                Vector_sort(V, compare);
+                for (int i = 1; i < Vector_length(V); i++)
+                        assert(Str_cmp(Vector_get(V, i - 1), Vector_get(V, i)) <= 0);
+                assert(Str_isEqual(Vector_get(V, 0), "eight"));
+                assert(Str_isEqual(Vector_get(V, 9), "zero"));
+                Vector_clear(V);
+                assert(Vector_length(V) == 0);
+                assert(Vector_pop(V) == NULL);
+                Vector_append(V, s[0]);
+                assert(Vector_length(V) == 1);
+                Vector_free(&V);
+        }
+        printf("=> Test3: OK\n\n");
+
+        printf("=> Test4: many elements\n");
+        {
+                V = Vector_new(0);
+                for (intptr_t i = 0; i < 100000; i++)
+                        Vector_append(V, (void *)i);
+                for (intptr_t i = 0; i < 100000; i++)
+                        assert(Vector_get(V, (int)i) == (void *)i);
+                while (Vector_length(V) > 50000)
+                        Vector_pop(V);
+                assert(Vector_get(V, 49999) == (void *)49999);
+                Vector_free(&V);
+        }
+        printf("=> Test4: OK\n\n");
+
+        printf("=> Test5: benchmark iteration of List and Vector\n");
+        {
+                int n = 100000, rounds = 100;
+                long long sum = 0;
+                List_T L = List_new();
+                V = Vector_new(0);
+                for (intptr_t i = 0; i < n; i++) {
+                        List_append(L, (void *)i);
+                        Vector_append(V, (void *)i);
+                }
+                long long start = Time_micro();
+                for (int r = 0; r < rounds; r++)
+                        for (list_t p = L->head; p; p = p->next)
+                                sum += (intptr_t)p->e;
+                long long list = Time_micro() - start;
+                start = Time_micro();
+                for (int r = 0; r < rounds; r++)
+                        for (int i = 0; i < Vector_length(V); i++)
+                                sum -= (intptr_t)Vector_get(V, i);
+                long long vector = Time_micro() - start;
+                assert(sum == 0);
+                printf("\tIterating %d elements %d times: List %.3f ms, Vector %.3f ms\n", n, rounds, list / 1000., vector / 1000.);
+                List_free(&L);
+                Vector_free(&V);
+        }
+        printf("=> Test5: OK\n\n");
+
+        printf("============> Vector Tests: OK\n\n");
+
+        return 0;
+}
+
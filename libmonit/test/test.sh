@@ -4,8 +4,13 @@ export PATH=$PATH:.
 
 StrTest && \
 TimeTest && \
+CronTest && \
+PatternSetTest && \
 SystemTest && \
 ListTest && \
+ArenaTest && \
+VectorTest && \
+HashMapTest && \
 LinkTest && \
 StringBufferTest && \
 DirTest && \
@@ -14,4 +19,5 @@ OutputStreamTest && \
 FileTest && \
 ExceptionTest && \
 NetTest && \
-CommandTest
+CommandTest && \
+ThreadPoolTest
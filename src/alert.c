@@ -55,8 +55,12 @@
 #include "SMTP.h"
 
 // libmonit
+#include "system/Net.h"
 #include "system/Time.h"
 #include "util/Str.h"
+#include "util/StringBuffer.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 #include "exceptions/IOException.h"
 
 
@@ -67,6 +71,78 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+#define DIGEST_SERVICES 10      /**< Maximum number of service names listed per digest entry */
+#define SMTP_IDLE 60             /**< Seconds an idle mail server session is kept open */
+#define ALERT_VARIABLES 6                 /**< Number of the mail template variables */
+
+
+/* Mail template variable, the value is resolved once per event */
+typedef struct AlertVariable_T {
+        const char *name;
+        size_t length;
+        const char *value;
+} AlertVariable_T;
+
+
+/* State of the mail template rendering */
+typedef struct AlertRender_T {
+        StringBuffer_T b;                                     /**< Output buffer */
+        boolean_t body;               /**< true if the output is the message body */
+        boolean_t cr;                      /**< The last written character was CR */
+        boolean_t bol;                         /**< At the beginning of a line */
+} AlertRender_T;
+
+
+/* Coalesced events of the same type and state in the same service group */
+typedef struct DigestEntry_T {
+        char *group;                              /**< Service group name or NULL */
+        long id;                                                   /**< Event type */
+        State_Type state;                                         /**< Event state */
+        char *description;                                  /**< Event description */
+        int count;                                         /**< Number of events */
+        int services;                             /**< Number of listed services */
+        boolean_t truncated;                /**< true if some services were not listed */
+        char *names[DIGEST_SERVICES];                   /**< Listed service names */
+        struct DigestEntry_T *next;
+} *DigestEntry_T;
+
+
+/* Alert digest of one recipient. The first alert opens the digest window and is sent right away, the alerts which follow within the window are coalesced */
+typedef struct Digest_T {
+        char *to;                                                   /**< Recipient */
+        Address_T from;                                                /**< Sender */
+        Address_T replyto;                              /**< Optional reply-to address */
+        char host[256];                                             /**< FQDN hostname */
+        time_t opened;                                /**< The digest window start */
+        int count;                                /**< Number of coalesced events */
+        DigestEntry_T entries;
+        struct Digest_T *next;
+} *Digest_T;
+
+
+/* Mail server session kept open between the alerts */
+static struct {
+        MailServer_T mta;                 /**< Mail server of the session or NULL */
+        SMTP_T smtp;                                     /**< SMTP protocol object */
+        time_t used;                               /**< Last use of the session */
+} session;
+
+
+/* The last mail server which accepted a connection, preferred by the next session. A copy, as the mail server list is rebuilt on reload */
+static struct {
+        char host[256];
+        int port;
+} relay;
+
+
+static Digest_T digests = NULL;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t sessionMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -95,63 +171,103 @@ static char *_getFQDNhostname(char host[256]) {
 }
 
 
-static void _substitute(Mail_T m, Event_T e) {
-        ASSERT(m);
-        ASSERT(e);
-
-        Util_replaceString(&m->from->address, "$HOST", m->host);
-        Util_replaceString(&m->subject, "$HOST", m->host);
-        Util_replaceString(&m->message, "$HOST", m->host);
-
-        char timestamp[26];
-        Time_string(e->collected.tv_sec, timestamp);
-        Util_replaceString(&m->subject, "$DATE", timestamp);
-        Util_replaceString(&m->message, "$DATE", timestamp);
+static void _setVariables(AlertVariable_T variables[ALERT_VARIABLES], Event_T e, const char *host, char timestamp[26]) {
+        variables[0] = (AlertVariable_T){"$HOST", 5, host};
+        variables[1] = (AlertVariable_T){"$DATE", 5, Time_string(e->collected.tv_sec, timestamp)};
+        variables[2] = (AlertVariable_T){"$SERVICE", 8, e->source->name};
+        variables[3] = (AlertVariable_T){"$EVENT", 6, Event_get_description(e)};
+        variables[4] = (AlertVariable_T){"$DESCRIPTION", 12, NVLSTR(e->message)};
+        variables[5] = (AlertVariable_T){"$ACTION", 7, Event_get_action_description(e)};
+}
 
-        Util_replaceString(&m->subject, "$SERVICE", e->source->name);
-        Util_replaceString(&m->message, "$SERVICE", e->source->name);
 
-        const char *description = Event_get_description(e);
-        Util_replaceString(&m->subject, "$EVENT", description);
-        Util_replaceString(&m->message, "$EVENT", description);
+/**
+ * Append the text to the rendered mail body: a bare LF is replaced with CRLF
+ * and a dot at the beginning of a line is doubled (RFC 5321 4.5.2)
+ */
+static void _putBody(AlertRender_T *r, const char *s, size_t length) {
+        size_t start = 0;
+        for (size_t i = 0; i < length; i++) {
+                if ((s[i] == '\n' && ! r->cr) || (s[i] == '.' && r->bol)) {
+                        // Insert the CR or the second dot, the character itself is written with the text which follows
+                        StringBuffer_appendBytes(r->b, s + start, (int)(i - start));
+                        StringBuffer_appendChar(r->b, s[i] == '\n' ? '\r' : '.');
+                        start = i;
+                }
+                r->cr = s[i] == '\r';
+                r->bol = s[i] == '\n';
+        }
+        StringBuffer_appendBytes(r->b, s + start, (int)(length - start));
+}
 
-        const char *message = NVLSTR(e->message);
-        Util_replaceString(&m->subject, "$DESCRIPTION", message);
-        Util_replaceString(&m->message, "$DESCRIPTION", message);
 
-        const char *action = Event_get_action_description(e);
-        Util_replaceString(&m->subject, "$ACTION", action);
-        Util_replaceString(&m->message, "$ACTION", action);
+static void _put(AlertRender_T *r, const char *s, size_t length) {
+        if (r->body)
+                _putBody(r, s, length);
+        else
+                StringBuffer_appendBytes(r->b, s, (int)length);
 }
 
 
-static void _escape(Mail_T m) {
-        // replace bare linefeed
-        Util_replaceString(&m->message, "\r\n", "\n");
-        Util_replaceString(&m->message, "\n", "\r\n");
-        // escape ^.
-        Util_replaceString(&m->message, "\n.", "\n..");
-        // drop any CR|LF from the subject
-        Str_chomp(m->subject);
+/**
+ * Render the template in one pass: the $VARIABLES are substituted (the
+ * substituted values are not scanned again) and the body is escaped as it
+ * is written to the buffer
+ * @param b The reusable output buffer
+ * @param template The mail template
+ * @param variables The variables to substitute
+ * @param count The number of variables
+ * @param body true if the template is the message body
+ * @return A copy of the rendered text, the caller must free it
+ */
+static char *_render(StringBuffer_T b, const char *template, AlertVariable_T variables[], int count, boolean_t body) {
+        AlertRender_T r = {.b = b, .body = body, .bol = true};
+        StringBuffer_clear(b);
+        const char *text = template;
+        for (const char *p = strchr(template, '$'); p; p = strchr(p, '$')) {
+                int i;
+                for (i = 0; i < count; i++)
+                        if (! strncmp(p, variables[i].name, variables[i].length))
+                                break;
+                if (i < count) {
+                        _put(&r, text, p - text);
+                        _put(&r, variables[i].value, strlen(variables[i].value));
+                        text = p += variables[i].length;
+                } else {
+                        p++;
+                }
+        }
+        _put(&r, text, strlen(text));
+        return Str_dup(StringBuffer_toString(b));
 }
 
 
-static void _copyMail(Mail_T n, Mail_T o) {
+/**
+ * Render the mail of the recipient from the templates of the recipient, the
+ * global mail format or the defaults
+ */
+static void _renderMail(Mail_T n, Mail_T o, AlertVariable_T variables[ALERT_VARIABLES], StringBuffer_T b) {
         ASSERT(n);
         ASSERT(o);
 
         n->to = Str_dup(o->to);
-        if (o->from) {
-                n->from = Address_copy(o->from);
-        } else if (Run.MailFormat.from) {
-                n->from = Address_copy(Run.MailFormat.from);
+        Address_T from = o->from ? o->from : Run.MailFormat.from;
+        if (from) {
+                n->from = Address_copy(from);
+                // Only the $HOST variable is substituted in the sender address
+                if (strchr(from->address, '$')) {
+                        FREE(n->from->address);
+                        n->from->address = _render(b, from->address, variables, 1, false);
+                }
         } else {
                 n->from = Address_new();
-                n->from->address = Str_dup(ALERT_FROM);
+                n->from->address = _render(b, ALERT_FROM, variables, 1, false);
         }
         n->replyto = o->replyto ? Address_copy(o->replyto) : Run.MailFormat.replyto ? Address_copy(Run.MailFormat.replyto) : NULL;
-        n->subject = o->subject ? Str_dup(o->subject) : Run.MailFormat.subject ? Str_dup(Run.MailFormat.subject) : Str_dup(ALERT_SUBJECT);
-        n->message = o->message ? Str_dup(o->message) : Run.MailFormat.message ? Str_dup(Run.MailFormat.message) : Str_dup(ALERT_MESSAGE);
+        n->subject = _render(b, o->subject ? o->subject : Run.MailFormat.subject ? Run.MailFormat.subject : ALERT_SUBJECT, variables, ALERT_VARIABLES, false);
+        // drop any CR|LF from the subject
+        Str_chomp(n->subject);
+        n->message = _render(b, o->message ? o->message : Run.MailFormat.message ? Run.MailFormat.message : ALERT_MESSAGE, variables, ALERT_VARIABLES, true);
 }
 
 
@@ -159,69 +275,151 @@ static void _copyMail(Mail_T n, Mail_T o) {
 // 1) is the given event type allowed for this recipient?
 // 2a) state change notifications is always delivered
 // 2b) failure notification is sent only of it matches reminder settings
-static void _appendMail(List_T list, Mail_T m, Event_T e, char *host) {
+static void _appendMail(List_T list, Mail_T m, Event_T e, char *host, AlertVariable_T variables[ALERT_VARIABLES], StringBuffer_T b) {
         if (IS_EVENT_SET(m->events, e->id) && (e->state_changed || (e->state && m->reminder && e->count % m->reminder == 0))) {
                 Mail_T tmp = NULL;
                 NEW(tmp);
                 tmp->host = host;
-                _copyMail(tmp, m);
-                _substitute(tmp, e);
-                _escape(tmp);
+                _renderMail(tmp, m, variables, b);
                 List_append(list, tmp);
                 DEBUG("Sending %s notification to %s\n", Event_get_description(e), m->to);
         }
 }
 
 
+static boolean_t _isRelay(MailServer_T mta) {
+        return mta->port == relay.port && IS(mta->host, relay.host);
+}
+
+
+// Connect to the mail servers in parallel, the last healthy relay first and the others staggered behind it in the configured order, the first connected server wins
 static MailServer_T _connectMTA() {
         if (! Run.mailservers)
                 THROW(IOException, "No mail servers are defined -- see manual for 'set mailserver' statement");
-        MailServer_T mta = NULL;
-        for (mta = Run.mailservers; mta; mta = mta->next) {
-                DEBUG("Trying to send mail via %s:%i\n", mta->host, mta->port);
-                if (mta->ssl.flags == SSL_Enabled)
-                        mta->socket = Socket_create(mta->host, mta->port, Socket_Tcp, Socket_Ip, mta->ssl, Run.mailserver_timeout);
-                else
-                        mta->socket = Socket_new(mta->host, mta->port, Socket_Tcp, Socket_Ip, false, Run.mailserver_timeout);
-                if (mta->socket)
-                        break;
-                else
-                        LogError("Cannot open a connection to the mailserver %s:%i -- %s\n", mta->host, mta->port, STRERROR);
+        int count = 0;
+        for (MailServer_T mta = Run.mailservers; mta; mta = mta->next)
+                count++;
+        MailServer_T order[count];
+        const char *hosts[count];
+        int ports[count];
+        SslOptions_T ssl[count];
+        int n = 0;
+        for (MailServer_T mta = Run.mailservers; mta; mta = mta->next)
+                if (_isRelay(mta))
+                        order[n++] = mta;
+        for (MailServer_T mta = Run.mailservers; mta; mta = mta->next)
+                if (! _isRelay(mta))
+                        order[n++] = mta;
+        for (int i = 0; i < count; i++) {
+                DEBUG("Trying to send mail via %s:%i\n", order[i]->host, order[i]->port);
+                hosts[i] = order[i]->host;
+                ports[i] = order[i]->port;
+                ssl[i] = order[i]->ssl;
+                // STARTTLS is negotiated by the SMTP session
+                if (ssl[i].flags != SSL_Enabled)
+                        ssl[i].flags = SSL_Disabled;
         }
-        if (! mta || ! mta->socket)
+        int winner = -1;
+        Socket_T socket = Socket_createAny(hosts, ports, ssl, count, Run.mailserver_timeout, &winner);
+        if (! socket) {
+                *relay.host = 0;
                 THROW(IOException, "Delivery failed -- no mail server is available");
+        }
+        MailServer_T mta = order[winner];
+        mta->socket = socket;
+        if (! _isRelay(mta)) {
+                if (*relay.host)
+                        LogInfo("Mail server %s:%i did not answer in time, using %s:%i\n", relay.host, relay.port, mta->host, mta->port);
+                snprintf(relay.host, sizeof(relay.host), "%s", mta->host);
+                relay.port = mta->port;
+        }
         return mta;
 }
 
 
+// Close the mail server session, say QUIT to the server unless the connection was lost
+static void _closeSession(boolean_t quit) {
+        if (session.smtp) {
+                if (quit)
+                        SMTP_free(&session.smtp);
+                else
+                        SMTP_discard(&session.smtp);
+        }
+        if (session.mta) {
+                if (session.mta->socket)
+                        Socket_free(&(session.mta->socket));
+                session.mta = NULL;
+        }
+}
+
+
+static void _openSession() {
+        session.mta = _connectMTA();
+        session.smtp = SMTP_new(session.mta->socket);
+        SMTP_greeting(session.smtp);
+        SMTP_helo(session.smtp, Run.mail_hostname ? Run.mail_hostname : Run.system->name);
+        if (session.mta->ssl.flags == SSL_StartTLS)
+                SMTP_starttls(session.smtp, session.mta->ssl);
+        if (session.mta->username && session.mta->password)
+                SMTP_auth(session.smtp, session.mta->username, session.mta->password);
+}
+
+
+// Reuse the session of the previous alerts if the server didn't close it meanwhile, otherwise open a new session
+static void _getSession() {
+        if (session.smtp) {
+                if (Time_now() - session.used > SMTP_IDLE) {
+                        _closeSession(true);
+                } else if (Net_canRead(Socket_getSocket(session.mta->socket), 0)) {
+                        // The server closed the connection or sent the 421 timeout response
+                        _closeSession(false);
+                } else {
+                        TRY
+                        {
+                                SMTP_reset(session.smtp);
+                                DEBUG("Reusing the mail server session with %s:%i\n", session.mta->host, session.mta->port);
+                        }
+                        ELSE
+                        {
+                                _closeSession(false);
+                        }
+                        END_TRY;
+                }
+        }
+        if (! session.smtp)
+                _openSession();
+}
+
+
 static boolean_t _send(List_T list) {
         boolean_t failed = false;
         if (List_length(list)) {
-                volatile Mail_T m = NULL;
-                volatile SMTP_T smtp = NULL;
-                volatile MailServer_T mta = NULL;
-                TRY
+                StringBuffer_T content = StringBuffer_create(1024);
+                LOCK(sessionMutex)
                 {
-                        mta = _connectMTA();
-                        smtp = SMTP_new(mta->socket);
-                        SMTP_greeting(smtp);
-                        SMTP_helo(smtp, Run.mail_hostname ? Run.mail_hostname : Run.system->name);
-                        if (mta->ssl.flags == SSL_StartTLS)
-                                SMTP_starttls(smtp, mta->ssl);
-                        if (mta->username && mta->password)
-                                SMTP_auth(smtp, mta->username, mta->password);
-                        char now[STRLEN];
-                        Time_gmtstring(Time_now(), now);
-                        while ((m = List_pop(list))) {
-                                SMTP_from(smtp, m->from->address);
-                                SMTP_to(smtp, m->to);
-                                SMTP_dataBegin(smtp);
-                                if (
-                                        (m->replyto && ((m->replyto->name ? Socket_print(mta->socket, "Reply-To: \"%s\" <%s>\r\n", m->replyto->name, m->replyto->address) : Socket_print(mta->socket, "Reply-To: %s\r\n", m->replyto->address)) <= 0))
-                                        ||
-                                        ((m->from->name ? Socket_print(mta->socket, "From: \"%s\" <%s>\r\n", m->from->name, m->from->address) : Socket_print(mta->socket, "From: %s\r\n", m->from->address)) <= 0)
-                                        ||
-                                        Socket_print(mta->socket,
+                        volatile Mail_T m = NULL;
+                        TRY
+                        {
+                                _getSession();
+                                SMTP_T smtp = session.smtp;
+                                char now[STRLEN];
+                                Time_gmtstring(Time_now(), now);
+                                while ((m = List_pop(list))) {
+                                        SMTP_from(smtp, m->from->address);
+                                        SMTP_to(smtp, m->to);
+                                        SMTP_dataBegin(smtp);
+                                        StringBuffer_clear(content);
+                                        if (m->replyto) {
+                                                if (m->replyto->name)
+                                                        StringBuffer_append(content, "Reply-To: \"%s\" <%s>\r\n", m->replyto->name, m->replyto->address);
+                                                else
+                                                        StringBuffer_append(content, "Reply-To: %s\r\n", m->replyto->address);
+                                        }
+                                        if (m->from->name)
+                                                StringBuffer_append(content, "From: \"%s\" <%s>\r\n", m->from->name, m->from->address);
+                                        else
+                                                StringBuffer_append(content, "From: %s\r\n", m->from->address);
+                                        StringBuffer_append(content,
                                                 "To: %s\r\n"
                                                 "Subject: %s\r\n"
                                                 "Date: %s\r\n"
@@ -237,36 +435,155 @@ static boolean_t _send(List_T list) {
                                                 now,
                                                 VERSION,
                                                 (long long)Time_now(), random(), Run.mail_hostname ? Run.mail_hostname : m->host,
-                                                m->message) <= 0
-                                   )
-                                {
-                                        THROW(IOException, "Error sending data to mail server %s -- %s", mta->host, STRERROR);
+                                                m->message);
+                                        SMTP_data(smtp, StringBuffer_toString(content));
+                                        gc_mail_list((Mail_T *)&m);
                                 }
-                                SMTP_dataCommit(smtp);
-                                gc_mail_list((Mail_T *)&m);
+                                // Keep the session open for the next alerts
+                                session.used = Time_now();
                         }
-                        SMTP_quit(smtp);
-                }
-                ELSE
-                {
-                        failed = true;
-                        LogError("Mail: %s\n", Exception_frame.message);
-                }
-                FINALLY
-                {
-                        if (m)
-                                gc_mail_list((Mail_T *)&m);
-                        if (smtp)
-                                SMTP_free((SMTP_T *)&smtp);
-                        if (mta && mta->socket)
-                                Socket_free(&(mta->socket));
+                        ELSE
+                        {
+                                failed = true;
+                                LogError("Mail: %s\n", Exception_frame.message);
+                                _closeSession(true);
+                        }
+                        FINALLY
+                        {
+                                if (m)
+                                        gc_mail_list((Mail_T *)&m);
+                        }
+                        END_TRY;
                 }
-                END_TRY;
+                END_LOCK;
+                StringBuffer_free(&content);
         }
         return failed;
 }
 
 
+static const char *_getGroup(Service_T S) {
+        for (ServiceGroup_T g = servicegrouplist; g; g = g->next)
+                if (Util_isGroupMember(S, g))
+                        return g->name;
+        return NULL;
+}
+
+
+static void _freeEntries(Digest_T d) {
+        while (d->entries) {
+                DigestEntry_T entry = d->entries;
+                d->entries = entry->next;
+                for (int i = 0; i < entry->services; i++)
+                        FREE(entry->names[i]);
+                FREE(entry->group);
+                FREE(entry->description);
+                FREE(entry);
+        }
+        d->count = 0;
+}
+
+
+static void _freeDigest(Digest_T *d) {
+        _freeEntries(*d);
+        if ((*d)->from)
+                Address_free(&((*d)->from));
+        if ((*d)->replyto)
+                Address_free(&((*d)->replyto));
+        FREE((*d)->to);
+        FREE(*d);
+}
+
+
+static void _addDigest(Digest_T d, Event_T E) {
+        const char *group = _getGroup(E->source);
+        DigestEntry_T entry, *last = &d->entries;
+        for (entry = d->entries; entry; last = &entry->next, entry = entry->next)
+                if (entry->id == E->id && entry->state == E->state && (group ? IS(entry->group, group) : ! entry->group))
+                        break;
+        if (! entry) {
+                NEW(entry);
+                entry->group = group ? Str_dup(group) : NULL;
+                entry->id = E->id;
+                entry->state = E->state;
+                entry->description = Str_dup(Event_get_description(E));
+                *last = entry;
+        }
+        entry->count++;
+        d->count++;
+        for (int i = 0; i < entry->services; i++)
+                if (IS(entry->names[i], E->source->name))
+                        return;
+        if (entry->services < DIGEST_SERVICES)
+                entry->names[entry->services++] = Str_dup(E->source->name);
+        else
+                entry->truncated = true;
+}
+
+
+static Mail_T _digestMail(Digest_T d) {
+        Mail_T m;
+        NEW(m);
+        m->to = Str_dup(d->to);
+        m->from = Address_copy(d->from);
+        m->replyto = d->replyto ? Address_copy(d->replyto) : NULL;
+        m->host = d->host;
+        m->subject = Str_cat("monit alert digest -- %d events on %s", d->count, d->host);
+        char timestamp[26];
+        StringBuffer_T b = StringBuffer_create(256);
+        StringBuffer_append(b, "%d events on %s since %s:\r\n\r\n", d->count, d->host, Time_string(d->opened, timestamp));
+        for (DigestEntry_T entry = d->entries; entry; entry = entry->next) {
+                StringBuffer_append(b, "\t%d x %s", entry->count, entry->description);
+                if (entry->group)
+                        StringBuffer_append(b, " in group %s", entry->group);
+                for (int i = 0; i < entry->services; i++)
+                        StringBuffer_append(b, "%s%s", i ? ", " : ": ", entry->names[i]);
+                StringBuffer_append(b, "%s\r\n", entry->truncated ? ", ..." : "");
+        }
+        StringBuffer_append(b, "\r\nYour faithful employee,\r\nMonit\r\n");
+        // The digest is composed with CRLF line endings and no line starts with a dot, so it doesn't need the escaping
+        m->message = Str_dup(StringBuffer_toString(b));
+        StringBuffer_free(&b);
+        return m;
+}
+
+
+/**
+ * Coalesce the alerts of recipients which have the digest window open. The
+ * alert of a recipient without the window stays in the list to be sent right
+ * away and opens the window.
+ */
+static void _coalesce(List_T list, Event_T E, char *host) {
+        time_t now = Time_now();
+        LOCK(mutex)
+        {
+                for (int n = List_length(list); n > 0; n--) {
+                        Mail_T m = List_pop(list);
+                        Digest_T d;
+                        for (d = digests; d; d = d->next)
+                                if (IS(d->to, m->to))
+                                        break;
+                        if (d) {
+                                _addDigest(d, E);
+                                DEBUG("Adding %s notification for %s to the alert digest\n", Event_get_description(E), m->to);
+                                gc_mail_list(&m);
+                        } else {
+                                NEW(d);
+                                d->to = Str_dup(m->to);
+                                d->from = Address_copy(m->from);
+                                d->replyto = m->replyto ? Address_copy(m->replyto) : NULL;
+                                snprintf(d->host, sizeof(d->host), "%s", host);
+                                d->opened = now;
+                                d->next = digests;
+                                digests = d;
+                                List_append(list, m);
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -280,19 +597,26 @@ Handler_Type handle_alert(Event_T E) {
 
         Handler_Type rv = Handler_Succeeded;
         if (E->source->maillist || Run.maillist) {
-                char host[256];
+                char host[256], timestamp[26];
                 _getFQDNhostname(host);
+                // The variables are resolved once per event, the mails are rendered into one reusable buffer
+                AlertVariable_T variables[ALERT_VARIABLES];
+                _setVariables(variables, E, host, timestamp);
+                StringBuffer_T b = StringBuffer_create(1024);
                 List_T list = List_new();
                 // Build a mail-list with local recipients that has registered interest for this event
                 for (Mail_T m = E->source->maillist; m; m = m->next)
-                        _appendMail(list, m, E, host);
+                        _appendMail(list, m, E, host, variables, b);
                 // Build a mail-list with global recipients that has registered interest for this event. Recipients which are defined in the service localy overrides the same recipient events which are registered globaly.
                 for (Mail_T m = Run.maillist; m; m = m->next) {
                         for (Mail_T n = E->source->maillist; n; n = n->next)
                                 if (IS(m->to, n->to))
                                         continue; // Handled by local alert definition already
-                        _appendMail(list, m, E, host);
+                        _appendMail(list, m, E, host, variables, b);
                 }
+                StringBuffer_free(&b);
+                if (List_length(list) && Run.alertDigest.window > 0)
+                        _coalesce(list, E, host);
                 if (List_length(list))
                         if (_send(list))
                                 rv = Handler_Alert;
@@ -301,3 +625,44 @@ Handler_Type handle_alert(Event_T E) {
         return rv;
 }
 
+
+void Alert_flush(boolean_t force) {
+        List_T list = List_new();
+        time_t now = Time_now();
+        LOCK(mutex)
+        {
+                for (Digest_T *d = &digests; *d;) {
+                        if (force || Run.alertDigest.window <= 0 || now - (*d)->opened >= Run.alertDigest.window) {
+                                if ((*d)->count)
+                                        List_append(list, _digestMail(*d));
+                                if ((*d)->count && ! force && Run.alertDigest.window > 0) {
+                                        // The alerts keep coming, keep the window open
+                                        _freeEntries(*d);
+                                        (*d)->opened = now;
+                                        d = &(*d)->next;
+                                } else {
+                                        Digest_T t = *d;
+                                        *d = t->next;
+                                        _freeDigest(&t);
+                                }
+                        } else {
+                                d = &(*d)->next;
+                        }
+                }
+        }
+        END_LOCK;
+        if (List_length(list)) {
+                if (_send(list))
+                        LogError("Alert digest delivery failed\n");
+                for (Mail_T m; (m = List_pop(list));)
+                        gc_mail_list(&m);
+        }
+        List_free(&list);
+        // Close the mail server session if it is idle too long, or before the mail servers are freed on stop and reload
+        LOCK(sessionMutex)
+        {
+                if (session.smtp && (force || now - session.used > SMTP_IDLE))
+                        _closeSession(true);
+        }
+        END_LOCK;
+}
@@ -66,4 +66,13 @@
 Handler_Type handle_alert(Event_T E);
 
 
+/**
+ * Send the alert digests whose window expired (see "set alert digest").
+ * Called once per cycle.
+ * @param force true to send all pending digests and close the windows,
+ * used when Monit stops or reloads
+ */
+void Alert_flush(boolean_t force);
+
+
 #endif
@@ -0,0 +1,293 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "monit.h"
+#include "capture.h"
+
+// libmonit
+#include "system/Net.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The capture thread polls the pipes of all running programs and appends
+ * the output to the capture's ring buffer. A byte written to the wakeup
+ * pipe makes the thread rebuild the list of the polled descriptors after a
+ * capture was added or removed. The ring buffer is accessed with the lock
+ * held, the pipes are read without blocking.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T Capture_T
+struct T {
+        int descriptors[2];          /**< Read end of stdout and stderr or -1 */
+        int limit;                               /**< Size of the ring buffer */
+        unsigned long long total;           /**< Number of bytes captured */
+        char *ring;
+        struct T *next;
+};
+
+
+static struct {
+        boolean_t running;
+        boolean_t stopped;
+        Thread_T thread;
+        int wakeup[2];
+        T captures;
+} capture = {.wakeup = {-1, -1}};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _append(T C, const char *data, int length) {
+        if (C->limit > 0) {
+                int position = C->total % C->limit;
+                C->total += length;
+                if (length > C->limit) {
+                        // Only the last limit bytes will stay
+                        position = (position + length - C->limit) % C->limit;
+                        data += length - C->limit;
+                        length = C->limit;
+                }
+                int n = C->limit - position < length ? C->limit - position : length;
+                memcpy(C->ring + position, data, n);
+                memcpy(C->ring, data + n, length - n);
+        } else {
+                C->total += length;
+        }
+}
+
+
+/**
+ * Read the pending output of the descriptor. The descriptor is not polled
+ * anymore after end of file or an error
+ */
+static void _drain(T C, int i) {
+        char buf[4096];
+        while (C->descriptors[i] >= 0) {
+                ssize_t n = read(C->descriptors[i], buf, sizeof(buf));
+                if (n > 0) {
+                        _append(C, buf, (int)n);
+                } else if (n < 0 && errno == EINTR) {
+                        continue;
+                } else {
+                        if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                                C->descriptors[i] = -1;
+                        break;
+                }
+        }
+}
+
+
+static void _wakeup() {
+        if (capture.running)
+                if (write(capture.wakeup[1], "", 1) < 0 && errno != EAGAIN)
+                        DEBUG("Cannot wake up the capture thread -- %s\n", STRERROR);
+}
+
+
+static void *_worker(void *args) {
+        set_signal_block();
+        int capacity = 0;
+        struct pollfd *fds = NULL;
+        LOCK(mutex)
+        {
+                while (! capture.stopped) {
+                        int count = 1;
+                        for (T C = capture.captures; C; C = C->next)
+                                count += 2;
+                        if (count > capacity) {
+                                capacity = count * 2;
+                                RESIZE(fds, capacity * sizeof(struct pollfd));
+                        }
+                        fds[0] = (struct pollfd){.fd = capture.wakeup[0], .events = POLLIN};
+                        int n = 1;
+                        for (T C = capture.captures; C; C = C->next)
+                                for (int i = 0; i < 2; i++)
+                                        if (C->descriptors[i] >= 0)
+                                                fds[n++] = (struct pollfd){.fd = C->descriptors[i], .events = POLLIN};
+                        Mutex_unlock(mutex);
+                        int ready = poll(fds, n, -1);
+                        Mutex_lock(mutex);
+                        if (ready <= 0)
+                                continue;
+                        if (fds[0].revents) {
+                                char buf[64];
+                                while (read(capture.wakeup[0], buf, sizeof(buf)) > 0)
+                                        ;
+                        }
+                        // The descriptor is drained only if it still belongs to a capture, the capture may be gone meanwhile
+                        for (int j = 1; j < n; j++)
+                                if (fds[j].revents)
+                                        for (T C = capture.captures; C; C = C->next)
+                                                for (int i = 0; i < 2; i++)
+                                                        if (C->descriptors[i] == fds[j].fd)
+                                                                _drain(C, i);
+                }
+        }
+        END_LOCK;
+        FREE(fds);
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Capture_start() {
+        LOCK(mutex)
+        {
+                if (! capture.running) {
+                        if (pipe(capture.wakeup) == 0) {
+                                for (int i = 0; i < 2; i++) {
+                                        Net_setNonBlocking(capture.wakeup[i]);
+                                        fcntl(capture.wakeup[i], F_SETFD, FD_CLOEXEC);
+                                }
+                                capture.stopped = false;
+                                Thread_create(capture.thread, _worker, NULL);
+                                capture.running = true;
+                        } else {
+                                LogError("Cannot create the program output capture thread -- %s\n", STRERROR);
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+void Capture_stop() {
+        if (capture.running) {
+                LOCK(mutex)
+                {
+                        capture.stopped = true;
+                        _wakeup();
+                }
+                END_LOCK;
+                Thread_join(capture.thread);
+                LOCK(mutex)
+                {
+                        close(capture.wakeup[0]);
+                        close(capture.wakeup[1]);
+                        capture.wakeup[0] = capture.wakeup[1] = -1;
+                        capture.running = false;
+                }
+                END_LOCK;
+        }
+}
+
+
+T Capture_new(Process_T P, int limit) {
+        ASSERT(P);
+        ASSERT(limit >= 0);
+        T C;
+        NEW(C);
+        C->limit = limit;
+        if (limit > 0)
+                C->ring = ALLOC(limit);
+        C->descriptors[0] = InputStream_getDescriptor(Process_getInputStream(P));
+        C->descriptors[1] = InputStream_getDescriptor(Process_getErrorStream(P));
+        LOCK(mutex)
+        {
+                C->next = capture.captures;
+                capture.captures = C;
+                _wakeup();
+        }
+        END_LOCK;
+        return C;
+}
+
+
+void Capture_free(T *C) {
+        ASSERT(C && *C);
+        LOCK(mutex)
+        {
+                for (T *p = &capture.captures; *p; p = &(*p)->next) {
+                        if (*p == *C) {
+                                *p = (*C)->next;
+                                break;
+                        }
+                }
+                _wakeup();
+        }
+        END_LOCK;
+        FREE((*C)->ring);
+        FREE(*C);
+}
+
+
+boolean_t Capture_collect(T C, StringBuffer_T output) {
+        ASSERT(C);
+        ASSERT(output);
+        boolean_t dropped = false;
+        LOCK(mutex)
+        {
+                for (int i = 0; i < 2; i++)
+                        _drain(C, i);
+                StringBuffer_clear(output);
+                dropped = C->total > (unsigned long long)C->limit;
+                if (dropped && C->limit > 0) {
+                        int position = C->total % C->limit;
+                        StringBuffer_appendBytes(output, C->ring + position, C->limit - position);
+                        StringBuffer_appendBytes(output, C->ring, position);
+                } else if (! dropped && C->total > 0) {
+                        StringBuffer_appendBytes(output, C->ring, (int)C->total);
+                }
+        }
+        END_LOCK;
+        return dropped;
+}
+
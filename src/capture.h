@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_CAPTURE_H
+#define MONIT_CAPTURE_H
+
+
+/**
+ * Capture the output of a running program. The program's stdout and
+ * stderr pipes are drained by the capture thread while the program runs,
+ * so a program which writes more than the pipe buffer doesn't block until
+ * it times out. The capture keeps only the last <i>limit</i> bytes of the
+ * output in a ring buffer, the older output is dropped. Without the capture
+ * thread, for example when Monit doesn't run as a daemon, the pipes are
+ * drained only when the output is collected with Capture_collect().
+ *
+ * @file
+ */
+
+
+#define T Capture_T
+typedef struct T *T;
+
+
+/**
+ * Start the capture thread
+ */
+void Capture_start(void);
+
+
+/**
+ * Stop the capture thread. The captures stay valid and can be collected.
+ */
+void Capture_stop(void);
+
+
+/**
+ * Start capturing the stdout and stderr output of the process
+ * @param P A Process object
+ * @param limit The ring buffer size in bytes, 0 drops all output
+ * @return A new Capture object
+ */
+T Capture_new(Process_T P, int limit);
+
+
+/**
+ * Stop capturing and release the Capture object. Must be called before
+ * the Process object is freed.
+ * @param C A Capture object reference
+ */
+void Capture_free(T *C);
+
+
+/**
+ * Read the output which is still pending in the pipes and copy the
+ * captured output to the string buffer. The buffer is cleared first.
+ * @param C A Capture object
+ * @param output The buffer for the output
+ * @return true if older output was dropped, otherwise false
+ */
+boolean_t Capture_collect(T C, StringBuffer_T output);
+
+
+#undef T
+#endif
+
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "checksumpool.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The checksum jobs are queued in FIFO order and processed by the worker
+ * threads without holding the pool mutex. The job is owned by the checksum
+ * test (Checksum_T.job) until the test is freed, then the job is marked as
+ * cancelled and freed by the worker which processes it, or immediately if
+ * no worker holds it.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef enum {
+        Job_Queued = 0,
+        Job_Running,
+        Job_Done,
+        Job_Failed,
+        Job_Abandoned                    // The pool was stopped before the job ran
+} Job_State;
+
+
+typedef struct ChecksumJob_T {
+        char *path;
+        Hash_Type type;
+        Job_State state;
+        boolean_t cancelled;
+        MD_T sum;
+        struct {
+                unsigned long long inode;
+                unsigned long long size;
+                unsigned long long mtime;
+                unsigned long long ctime;
+        } stat;                          // The file's stat data when the job was queued
+        struct ChecksumJob_T *next;
+} *ChecksumJob_T;
+
+
+static struct {
+        boolean_t running;
+        boolean_t stopped;
+        int workers;
+        Thread_T *threads;
+        Sem_T queued;
+        ChecksumJob_T head;
+        ChecksumJob_T tail;
+} pool = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _freeJob(ChecksumJob_T *job) {
+        FREE((*job)->path);
+        FREE(*job);
+}
+
+
+static void _queue(Checksum_T cs, const char *path, struct stat *st) {
+        ChecksumJob_T job;
+        NEW(job);
+        job->path = Str_dup(path);
+        job->type = cs->type;
+        job->stat.inode = st->st_ino;
+        job->stat.size = st->st_size;
+        file_getStatTimes(st, &job->stat.mtime, &job->stat.ctime);
+        if (pool.tail)
+                pool.tail->next = job;
+        else
+                pool.head = job;
+        pool.tail = job;
+        cs->job = job;
+        Sem_signal(pool.queued);
+}
+
+
+static boolean_t _isChanged(ChecksumJob_T job, struct stat *st) {
+        unsigned long long mtime, ctime;
+        file_getStatTimes(st, &mtime, &ctime);
+        return job->stat.inode != (unsigned long long)st->st_ino || job->stat.size != (unsigned long long)st->st_size || job->stat.mtime != mtime || job->stat.ctime != ctime;
+}
+
+
+static void *_worker(void *args) {
+        set_signal_block();
+        LOCK(mutex)
+        {
+                while (! pool.stopped) {
+                        ChecksumJob_T job = pool.head;
+                        if (! job) {
+                                Sem_wait(pool.queued, mutex);
+                                continue;
+                        }
+                        if (! (pool.head = job->next))
+                                pool.tail = NULL;
+                        job->next = NULL;
+                        if (job->cancelled) {
+                                _freeJob(&job);
+                                continue;
+                        }
+                        job->state = Job_Running;
+                        MD_T sum;
+                        Mutex_unlock(mutex);
+                        boolean_t computed = Util_getChecksum(job->path, job->type, sum, sizeof(sum));
+                        Mutex_lock(mutex);
+                        if (job->cancelled) {
+                                _freeJob(&job);
+                        } else if (computed) {
+                                snprintf(job->sum, sizeof(job->sum), "%s", sum);
+                                job->state = Job_Done;
+                        } else {
+                                job->state = Job_Failed;
+                        }
+                }
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t ChecksumPool_start() {
+        if (Run.checksumEngine.workers < 1)
+                return false;
+        LOCK(mutex)
+        {
+                if (! pool.running) {
+                        Sem_init(pool.queued);
+                        pool.stopped = false;
+                        pool.workers = Run.checksumEngine.workers;
+                        pool.threads = CALLOC(pool.workers, sizeof(Thread_T));
+                        for (int i = 0; i < pool.workers; i++)
+                                Thread_create(pool.threads[i], _worker, NULL);
+                        pool.running = true;
+                        DEBUG("Checksum worker pool started with %d workers\n", pool.workers);
+                }
+        }
+        END_LOCK;
+        return true;
+}
+
+
+void ChecksumPool_stop() {
+        if (! pool.running)
+                return;
+        LOCK(mutex)
+        {
+                pool.stopped = true;
+                Sem_broadcast(pool.queued);
+        }
+        END_LOCK;
+        for (int i = 0; i < pool.workers; i++)
+                Thread_join(pool.threads[i]);
+        LOCK(mutex)
+        {
+                while (pool.head) {
+                        ChecksumJob_T job = pool.head;
+                        pool.head = job->next;
+                        job->next = NULL;
+                        if (job->cancelled)
+                                _freeJob(&job);
+                        else
+                                job->state = Job_Abandoned;
+                }
+                pool.tail = NULL;
+                FREE(pool.threads);
+                Sem_destroy(pool.queued);
+                pool.running = false;
+        }
+        END_LOCK;
+}
+
+
+boolean_t ChecksumPool_isRunning() {
+        return pool.running;
+}
+
+
+State_Type ChecksumPool_get(Service_T s, struct stat *st) {
+        ASSERT(s);
+        ASSERT(s->checksum);
+        ASSERT(st);
+        State_Type rv = State_Init;
+        Checksum_T cs = s->checksum;
+        LOCK(mutex)
+        {
+                ChecksumJob_T job = cs->job;
+                if (job && (job->state == Job_Done || job->state == Job_Failed)) {
+                        if (job->state == Job_Done) {
+                                snprintf(s->inf->priv.file.cs_sum, sizeof(s->inf->priv.file.cs_sum), "%s", job->sum);
+                                s->inf->priv.file.cs_cache.inode = job->stat.inode;
+                                s->inf->priv.file.cs_cache.size = job->stat.size;
+                                s->inf->priv.file.cs_cache.mtime = job->stat.mtime;
+                                s->inf->priv.file.cs_cache.ctime = job->stat.ctime;
+                                s->inf->priv.file.cs_cache.cycles = 0;
+                                rv = State_Succeeded;
+                        } else {
+                                memset(&s->inf->priv.file.cs_cache, 0, sizeof(s->inf->priv.file.cs_cache));
+                                rv = State_Failed;
+                        }
+                        boolean_t again = ! (Run.flags & Run_ChecksumCache) || _isChanged(job, st);
+                        _freeJob(&cs->job);
+                        if (again && pool.running)
+                                _queue(cs, s->path, st);
+                } else if (job && job->state == Job_Abandoned) {
+                        _freeJob(&cs->job);
+                }
+                if (! cs->job && rv == State_Init && pool.running) {
+                        DEBUG("'%s' checksum computation queued\n", s->name);
+                        _queue(cs, s->path, st);
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+void ChecksumPool_cancel(Checksum_T cs) {
+        ASSERT(cs);
+        LOCK(mutex)
+        {
+                ChecksumJob_T job = cs->job;
+                if (job) {
+                        cs->job = NULL;
+                        // Queued and running jobs are freed by the worker, completed jobs now
+                        if (job->state == Job_Queued || job->state == Job_Running)
+                                job->cancelled = true;
+                        else
+                                _freeJob(&job);
+                }
+        }
+        END_LOCK;
+}
+
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_CHECKSUMPOOL_H
+#define MONIT_CHECKSUMPOOL_H
+
+
+/**
+ * Background file checksum computation. If enabled with "set checksum
+ * workers N", the file checksums are computed by a bounded pool of worker
+ * threads, so hashing large files doesn't block the validation loop. The
+ * checksum test consumes the most recently completed checksum, until the
+ * first one is ready the test is deferred.
+ *
+ * @file
+ */
+
+
+/**
+ * Start the checksum worker threads
+ * @return true if the workers were started, otherwise false
+ */
+boolean_t ChecksumPool_start(void);
+
+
+/**
+ * Stop the checksum worker threads. The running computations are waited
+ * for, the queued computations are abandoned.
+ */
+void ChecksumPool_stop(void);
+
+
+/**
+ * Test if the checksum worker pool is running
+ * @return true if the checksums are computed in background, otherwise false
+ */
+boolean_t ChecksumPool_isRunning(void);
+
+
+/**
+ * Get the checksum of the file service computed in background. If a checksum
+ * computation completed, its result is stored in the service's cs_sum along
+ * with the file's stat data at the time the computation was queued (cs_cache).
+ * A new computation is queued if none was pending. After a completed one is
+ * consumed, the next is queued right away unless the checksum cache is enabled
+ * and the file didn't change, so the checksum is at most one cycle old.
+ * @param s A file service with the checksum test
+ * @param st The file's current stat data
+ * @return State_Succeeded if the checksum was updated, State_Init if no
+ * checksum was computed yet or State_Failed if the computation failed
+ */
+State_Type ChecksumPool_get(Service_T s, struct stat *st);
+
+
+/**
+ * Abandon the pending computation of the checksum (when the checksum test
+ * is freed)
+ * @param cs A checksum test
+ */
+void ChecksumPool_cancel(Checksum_T cs);
+
+
+#endif
+
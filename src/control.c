@@ -40,6 +40,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -52,8 +56,21 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_SYS_EVENT_H
+#include <sys/event.h>
+#endif
+
 #include "monit.h"
 #include "ProcessTree.h"
+#include "ProcessEvents.h"
 #include "net.h"
 #include "socket.h"
 #include "event.h"
@@ -62,6 +79,7 @@
 
 // libmonit
 #include "exceptions/AssertException.h"
+#include "thread/Thread.h"
 
 
 /**
@@ -83,9 +101,161 @@ typedef enum {
 #define RETRY_INTERVAL 100000 // 100ms
 
 
+/**
+ * The start/stop orchestrator: a batch of services is started, stopped or
+ * restarted by a pool of worker threads in the dependency order. A service is
+ * started only after all services which it depends on were started and it is
+ * stopped only after all services which depend on it were stopped, independent
+ * services run concurrently. The workers hold the orchestrator mutex all the
+ * time except when they wait for a start/stop program or process, so the
+ * events and the service state updates are serialized.
+ */
+typedef enum {
+        Job_Requested = 0,                  // The action was requested for the service
+        Job_Dependency,                  // Some requested service depends on the service
+        Job_Dependant                   // The service depends on some requested service
+} __attribute__((__packed__)) Job_Role;
+
+
+typedef struct ControlJob_T {
+        Service_T service;
+        Job_Role role;
+        boolean_t selected;     // The service takes part in the current phase
+        boolean_t failed;
+        int pending;            // Number of jobs which have to finish before this one in the current phase
+        int parents;            // Services which this service depends on in the orchestrator.edges array
+        int parentsCount;
+        int children;           // Services which depend on this service in the orchestrator.edges array
+        int childrenCount;
+} ControlJob_T;
+
+
+typedef struct ServiceIndex_T {
+        Service_T service;
+        int index;
+} ServiceIndex_T;
+
+
+static struct {
+        boolean_t active;
+        boolean_t reverse;       // The stop phase: the dependants are processed first
+        Action_Type action;
+        Mutex_T mutex;
+        Sem_T ready;             // Signalled when some job was finished
+        int count;
+        int selected;
+        int done;
+        int head;
+        int tail;
+        int *queue;              // Jobs ready to be dispatched
+        int *edges;
+        ControlJob_T *jobs;
+        ServiceIndex_T *lookup;  // The jobs sorted by the service address
+} orchestrator = {};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
+/**
+ * The user action request of the service is being executed, see handle_do_action()
+ */
+static void _requestTake(Service_T s) {
+        s->request.executing = __atomic_load_n(&s->request.requested, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * Publish the result of the executed request to the clients which wait for it
+ */
+static void _requestDone(Service_T s, boolean_t failed) {
+        s->request.failed = failed;
+        __atomic_store_n(&s->request.finished, s->request.executing, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Let other start/stop workers run while this one waits for a program or process
+ */
+static inline void _orchestratorRelease() {
+        if (orchestrator.active)
+                Mutex_unlock(orchestrator.mutex);
+}
+
+
+static inline void _orchestratorAcquire() {
+        if (orchestrator.active)
+                Mutex_lock(orchestrator.mutex);
+}
+
+
+/**
+ * Open a descriptor which reports the exit of the process: a pidfd on Linux
+ * 5.3+ or a kqueue with the EVFILT_PROC filter on BSD and macOS
+ * @return The descriptor or -1 if the notification is not available, the
+ * caller has to poll the process state then
+ */
+static int _exitNotificationOpen(pid_t pid) {
+        if (pid <= 0)
+                return -1;
+#if defined SYS_pidfd_open
+        return syscall(SYS_pidfd_open, pid, 0);
+#elif defined HAVE_SYS_EVENT_H && defined EVFILT_PROC
+        int kq = kqueue();
+        if (kq >= 0) {
+                struct kevent event;
+                EV_SET(&event, pid, EVFILT_PROC, EV_ADD | EV_ONESHOT, NOTE_EXIT, 0, NULL);
+                if (kevent(kq, &event, 1, NULL, 0, NULL) == -1) {
+                        close(kq);
+                        return -1;
+                }
+        }
+        return kq;
+#else
+        return -1;
+#endif
+}
+
+
+/**
+ * Wait up to the given time [ms] for the exit notification
+ * @return true if the process exited, otherwise false
+ */
+static boolean_t _exitNotificationWait(int fd, int timeout) {
+#if defined SYS_pidfd_open
+        struct pollfd p = {.fd = fd, .events = POLLIN};
+        return poll(&p, 1, timeout) > 0;
+#elif defined HAVE_SYS_EVENT_H && defined EVFILT_PROC
+        struct kevent event;
+        return kevent(fd, NULL, 0, &event, 1, &(struct timespec){.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000L}) > 0;
+#else
+        return false;
+#endif
+}
+
+
+/**
+ * Wait until the process exits, but at most the timeout [us] or one second.
+ * Without the exit notification descriptor fall back to the RETRY_INTERVAL sleep.
+ * @param fd The exit notification descriptor, it is closed and set to -1 when
+ * the exit was reported (a zombie which is not reaped yet would report it again)
+ * @param timeout The remaining timeout [us]
+ * @return The time spent waiting [us]
+ */
+static int64_t _waitExit(int *fd, int64_t timeout) {
+        if (*fd >= 0) {
+                long long start = Time_micro();
+                if (_exitNotificationWait(*fd, (int)MAX(1, MIN(timeout, USEC_PER_SEC) / 1000))) {
+                        close(*fd);
+                        *fd = -1;
+                }
+                return Time_micro() - start;
+        }
+        Time_usleep(RETRY_INTERVAL);
+        return RETRY_INTERVAL;
+}
+
+
 static int _getOutput(InputStream_T in, char *buf, int buflen) {
         InputStream_setTimeout(in, 0);
         return InputStream_readBytes(in, buf, buflen - 1);
@@ -137,10 +307,13 @@ static int _commandExecute(Service_T S, command_t c, char *msg, int msglen, int6
                 Process_T P = Command_execute(C);
                 Command_free(&C);
                 if (P) {
-                        do {
-                                Time_usleep(RETRY_INTERVAL);
-                                *timeout -= RETRY_INTERVAL;
-                        } while ((status = Process_exitStatus(P)) < 0 && *timeout > 0 && ! (Run.flags & Run_Stopped));
+                        _orchestratorRelease();
+                        int fd = _exitNotificationOpen(Process_getPid(P));
+                        while ((status = Process_exitStatus(P)) < 0 && *timeout > 0 && ! (Run.flags & Run_Stopped))
+                                *timeout -= _waitExit(&fd, *timeout);
+                        if (fd >= 0)
+                                close(fd);
+                        _orchestratorAcquire();
                         if (*timeout <= 0)
                                 snprintf(msg, msglen, "Program %s timed out", c->arg[0]);
                         int n, total = 0;
@@ -166,29 +339,54 @@ static int _commandExecute(Service_T S, command_t c, char *msg, int msglen, int6
 
 static Process_Status _waitProcessStart(Service_T s, int64_t *timeout) {
         long wait = RETRY_INTERVAL;
+        boolean_t scanned = false;
+        unsigned long generation = 0;
         do {
+                _orchestratorRelease();
                 Time_usleep(wait);
+                _orchestratorAcquire();
+                *timeout -= wait;
+                if (s->matchlist && ProcessEvents_isRunning()) {
+                        // The process events report every fork and exec, so the process table has to be rescanned only if some process appeared since the last scan
+                        unsigned long current = ProcessEvents_getGeneration();
+                        if (scanned && current == generation)
+                                continue;
+                        generation = current;
+                        scanned = true;
+                        wait = RETRY_INTERVAL / 2;
+                } else {
+                        wait = wait < 1000000 ? wait * 2 : 1000000; // double the wait during each cycle until 1s is reached (ProcessTree_findProcess can be heavy and we don't want to drain power every 100ms on mobile devices)
+                }
+                // Start a new process tree generation, so the process spawned after the current tree was collected can be matched
+                if (s->matchlist)
+                        ProcessTree_init(ProcessEngine_CollectCommandLine);
                 pid_t pid = ProcessTree_findProcess(s);
                 if (pid) {
-                        ProcessTree_init(ProcessEngine_None);
+                        if (! s->matchlist)
+                                ProcessTree_init(ProcessEngine_None);
                         ProcessTree_updateProcess(s, pid);
                         return Process_Started;
                 }
-                *timeout -= wait;
-                wait = wait < 1000000 ? wait * 2 : 1000000; // double the wait during each cycle until 1s is reached (ProcessTree_findProcess can be heavy and we don't want to drain power every 100ms on mobile devices)
         } while (*timeout > 0 && ! (Run.flags & Run_Stopped));
         return Process_Stopped;
 }
 
 
 static Process_Status _waitProcessStop(int pid, int64_t *timeout) {
+        Process_Status status = Process_Started;
+        _orchestratorRelease();
+        int fd = _exitNotificationOpen(pid);
         do {
-                Time_usleep(RETRY_INTERVAL);
-                if (! pid || (getpgid(pid) == -1 && errno != EPERM))
-                        return Process_Stopped;
-                *timeout -= RETRY_INTERVAL;
+                *timeout -= _waitExit(&fd, *timeout);
+                if (! pid || (getpgid(pid) == -1 && errno != EPERM)) {
+                        status = Process_Stopped;
+                        break;
+                }
         } while (*timeout > 0 && ! (Run.flags & Run_Stopped));
-        return Process_Started;
+        if (fd >= 0)
+                close(fd);
+        _orchestratorAcquire();
+        return status;
 }
 
 
@@ -199,13 +397,19 @@ static State_Type _check(Service_T s) {
         Monitor_Mode original = s->mode;
         s->mode = Monitor_Passive;
         rv = s->check(s);
-        if (s->type == Service_Program) {
+        if (s->type == Service_Program && ! s->program->plugin) {
                 // check program executes the program and needs to be called again to collect the exit value and evaluate the status
                 int64_t timeout = s->program->timeout * 1000000;
-                do {
-                        Time_usleep(RETRY_INTERVAL);
-                        timeout -= RETRY_INTERVAL;
-                } while (Process_exitStatus(s->program->P) < 0 && timeout > 0LL && ! (Run.flags & Run_Stopped));
+                _orchestratorRelease();
+                Process_T P = s->program->P;
+                if (P) {
+                        int fd = _exitNotificationOpen(Process_getPid(P));
+                        while (Process_exitStatus(P) < 0 && timeout > 0LL && ! (Run.flags & Run_Stopped))
+                                timeout -= _waitExit(&fd, timeout);
+                        if (fd >= 0)
+                                close(fd);
+                }
+                _orchestratorAcquire();
                 rv = s->check(s);
         }
         s->mode = original;
@@ -214,29 +418,15 @@ static State_Type _check(Service_T s) {
 
 
 /*
- * This is a post-fix recursive function for starting every service
- * that s depends on before starting s.
+ * Start the service s, the services which it depends on must be started already.
  * @param s A Service_T object
+ * @param failed The names of the required services which could not be started or NULL
  * @return true if the service was started otherwise false
  */
-static boolean_t _doStart(Service_T s) {
+static boolean_t _doStartService(Service_T s, const char *failed) {
         ASSERT(s);
         boolean_t rv = true;
-        StringBuffer_T sb = StringBuffer_create(64);
-        for (Dependant_T d = s->dependantlist; d; d = d->next ) {
-                Service_T parent = Util_getService(d->dependant);
-                ASSERT(parent);
-                if (parent->monitor != Monitor_Yes || parent->error) {
-                        if (_doStart(parent)) {
-                                State_Type state = _check(parent);
-                                if (state != State_Failed && state != State_Init)
-                                        continue;
-                        }
-                        rv = false;
-                        StringBuffer_append(sb, "%s%s", StringBuffer_length(sb) ? ", " : "", parent->name);
-                }
-        }
-        if (rv) {
+        if (! failed) {
                 if (s->start) {
                         if (s->type != Service_Process || ! ProcessTree_findProcess(s)) {
                                 LogInfo("'%s' start: %s\n", s->name, s->start->arg[0]);
@@ -255,10 +445,37 @@ static boolean_t _doStart(Service_T s) {
                         Event_post(s, Event_Exec, State_Succeeded, s->action_EXEC, "monitoring enabled");
                 }
         } else {
-                Event_post(s, Event_Exec, State_Failed, s->action_EXEC, "failed to start -- could not start required services: '%s'", StringBuffer_toString(sb));
+                Event_post(s, Event_Exec, State_Failed, s->action_EXEC, "failed to start -- could not start required services: '%s'", failed);
                 s->doaction = Action_Start; // Retry the start next cycle
+                rv = false;
         }
         Util_monitorSet(s);
+        return rv;
+}
+
+
+/*
+ * This is a post-fix recursive function for starting every service
+ * that s depends on before starting s.
+ * @param s A Service_T object
+ * @return true if the service was started otherwise false
+ */
+static boolean_t _doStart(Service_T s) {
+        ASSERT(s);
+        StringBuffer_T sb = StringBuffer_create(64);
+        for (Dependant_T d = s->dependantlist; d; d = d->next ) {
+                Service_T parent = d->service;
+                ASSERT(parent);
+                if (parent->monitor != Monitor_Yes || parent->error) {
+                        if (_doStart(parent)) {
+                                State_Type state = _check(parent);
+                                if (state != State_Failed && state != State_Init)
+                                        continue;
+                        }
+                        StringBuffer_append(sb, "%s%s", StringBuffer_length(sb) ? ", " : "", parent->name);
+                }
+        }
+        boolean_t rv = _doStartService(s, StringBuffer_length(sb) ? StringBuffer_toString(sb) : NULL);
         StringBuffer_free(&sb);
         return rv;
 }
@@ -353,7 +570,7 @@ static boolean_t _doRestart(Service_T s) {
 static void _doMonitor(Service_T s) {
         ASSERT(s);
         for (Dependant_T d = s->dependantlist; d; d = d->next ) {
-                Service_T parent = Util_getService(d->dependant);
+                Service_T parent = d->service;
                 ASSERT(parent);
                 _doMonitor(parent);
         }
@@ -383,7 +600,7 @@ static boolean_t _doDepend(Service_T s, Action_Type action, boolean_t unmonitor)
         boolean_t rv = true;
         for (Service_T child = servicelist; child; child = child->next) {
                 for (Dependant_T d = child->dependantlist; d; d = d->next) {
-                        if (IS(d->dependant, s->name)) {
+                        if (d->service == s) {
                                 child->doaction = Action_Ignored;
                                 if (action == Action_Start) {
                                         // (re)start children only if it's monitoring is enabled (we keep monitoring flag during restart, allowing to restore original pre-restart configuration)
@@ -414,11 +631,339 @@ static boolean_t _doDepend(Service_T s, Action_Type action, boolean_t unmonitor)
 }
 
 
+static int _compareIndex(const void *a, const void *b) {
+        uintptr_t x = (uintptr_t)((const ServiceIndex_T *)a)->service;
+        uintptr_t y = (uintptr_t)((const ServiceIndex_T *)b)->service;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+static int _orchestratorFind(Service_T s) {
+        ServiceIndex_T key = {.service = s};
+        ServiceIndex_T *found = s ? bsearch(&key, orchestrator.lookup, orchestrator.count, sizeof(ServiceIndex_T), _compareIndex) : NULL;
+        return found ? found->index : -1;
+}
+
+
+/**
+ * Build the dependency graph of all services and mark the requested ones
+ */
+static void _orchestratorPrepare(Service_T *services, int count, Action_Type action) {
+        orchestrator.action = action;
+        orchestrator.count = Util_getNumberOfServices();
+        orchestrator.jobs = CALLOC(orchestrator.count, sizeof(ControlJob_T));
+        orchestrator.queue = CALLOC(orchestrator.count, sizeof(int));
+        orchestrator.lookup = CALLOC(orchestrator.count, sizeof(ServiceIndex_T));
+        int i = 0;
+        for (Service_T s = servicelist; s && i < orchestrator.count; s = s->next, i++) {
+                orchestrator.jobs[i].service = orchestrator.lookup[i].service = s;
+                orchestrator.lookup[i].index = i;
+        }
+        orchestrator.count = i;
+        qsort(orchestrator.lookup, orchestrator.count, sizeof(ServiceIndex_T), _compareIndex);
+        // Count the edges first, then store the parents of each service in the first half of the edges array and its children in the second half
+        int edges = 0;
+        for (int pass = 0; pass < 2; pass++) {
+                if (pass) {
+                        int parents = 0, children = edges;
+                        for (i = 0; i < orchestrator.count; i++) {
+                                ControlJob_T *job = &orchestrator.jobs[i];
+                                job->parents = parents;
+                                job->children = children;
+                                parents += job->parentsCount;
+                                children += job->childrenCount;
+                                job->parentsCount = job->childrenCount = 0;
+                        }
+                        orchestrator.edges = CALLOC(edges ? 2 * edges : 1, sizeof(int));
+                }
+                for (i = 0; i < orchestrator.count; i++) {
+                        ControlJob_T *job = &orchestrator.jobs[i];
+                        for (Dependant_T d = job->service->dependantlist; d; d = d->next) {
+                                int p = _orchestratorFind(d->service);
+                                if (p >= 0) {
+                                        ControlJob_T *parent = &orchestrator.jobs[p];
+                                        if (pass) {
+                                                orchestrator.edges[job->parents + job->parentsCount] = p;
+                                                orchestrator.edges[parent->children + parent->childrenCount] = i;
+                                        } else {
+                                                edges++;
+                                        }
+                                        job->parentsCount++;
+                                        parent->childrenCount++;
+                                }
+                        }
+                }
+        }
+        for (i = 0; i < count; i++) {
+                int j = _orchestratorFind(services[i]);
+                if (j >= 0) {
+                        orchestrator.jobs[j].selected = true;
+                        orchestrator.jobs[j].role = Job_Requested;
+                        services[i]->doaction = Action_Ignored;
+                        _requestTake(services[i]);
+                }
+        }
+}
+
+
+/**
+ * Extend the selection with the required services which have to be started
+ * (dependencies) or with the services which depend on the selected ones (dependants)
+ */
+static void _orchestratorSelect(boolean_t dependencies, boolean_t dependants) {
+        for (boolean_t changed = true; changed;) {
+                changed = false;
+                for (int i = 0; i < orchestrator.count; i++) {
+                        ControlJob_T *job = &orchestrator.jobs[i];
+                        if (! job->selected)
+                                continue;
+                        if (dependencies) {
+                                for (int e = job->parents; e < job->parents + job->parentsCount; e++) {
+                                        ControlJob_T *parent = &orchestrator.jobs[orchestrator.edges[e]];
+                                        // Same as in _doStart(): a required service which is running is not touched
+                                        if (! parent->selected && (parent->service->monitor != Monitor_Yes || parent->service->error)) {
+                                                parent->selected = changed = true;
+                                                parent->role = Job_Dependency;
+                                        }
+                                }
+                        }
+                        if (dependants) {
+                                for (int e = job->children; e < job->children + job->childrenCount; e++) {
+                                        ControlJob_T *child = &orchestrator.jobs[orchestrator.edges[e]];
+                                        if (! child->selected) {
+                                                child->selected = changed = true;
+                                                child->role = Job_Dependant;
+                                        }
+                                }
+                        }
+                }
+        }
+}
+
+
+/**
+ * @return true if the service was stopped (or the stop failed), false if the stop was not needed
+ */
+static boolean_t _orchestratorStop(ControlJob_T *job) {
+        Service_T s = job->service;
+        if (job->role == Job_Requested) {
+                if (orchestrator.action == Action_Restart) {
+                        LogInfo("'%s' trying to restart\n", s->name);
+                        // The service with restart method is restarted in the start phase
+                        if (s->restart)
+                                return false;
+                        if (! _doStop(s, false)) {
+                                /* enable monitoring of this service again to allow the restart retry in the next cycle up to timeout limit */
+                                Util_monitorSet(s);
+                                job->failed = true;
+                        }
+                } else {
+                        job->failed = ! _doStop(s, true);
+                }
+        } else if (s->monitor != Monitor_Not) {
+                s->doaction = Action_Ignored;
+                job->failed = ! _doStop(s, orchestrator.action == Action_Stop);
+        } else {
+                return false;
+        }
+        return true;
+}
+
+
+/**
+ * @return true if the service was started (or the start failed), false if the start was not needed
+ */
+static boolean_t _orchestratorStart(ControlJob_T *job, const char *failed) {
+        Service_T s = job->service;
+        if (job->role == Job_Requested) {
+                if (orchestrator.action == Action_Restart && s->restart && ! failed)
+                        job->failed = ! _doRestart(s);
+                else
+                        job->failed = ! _doStartService(s, failed);
+        } else if (job->role == Job_Dependency) {
+                job->failed = true;
+                if (_doStartService(s, failed)) {
+                        State_Type state = _check(s);
+                        if (state != State_Failed && state != State_Init)
+                                job->failed = false;
+                }
+        } else if (s->monitor != Monitor_Not) {
+                // (re)start the dependants only if their monitoring is enabled, see _doDepend()
+                s->doaction = Action_Ignored;
+                job->failed = ! _doStartService(s, failed);
+        } else {
+                return false;
+        }
+        return true;
+}
+
+
+static void _orchestratorExecute(ControlJob_T *job) {
+        Service_T s = job->service;
+        long long started = Time_milli();
+        // The services which this one waited for in the current phase and which failed
+        int offset = orchestrator.reverse ? job->children : job->parents;
+        int count = orchestrator.reverse ? job->childrenCount : job->parentsCount;
+        StringBuffer_T sb = StringBuffer_create(64);
+        for (int e = offset; e < offset + count; e++) {
+                ControlJob_T *other = &orchestrator.jobs[orchestrator.edges[e]];
+                if (other->selected && other->failed)
+                        StringBuffer_append(sb, "%s%s", StringBuffer_length(sb) ? ", " : "", other->service->name);
+        }
+        boolean_t executed = false;
+        if (job->failed) {
+                // The service failed in the stop phase of the restart
+                DEBUG("'%s' start skipped -- the service was not stopped\n", s->name);
+        } else if (orchestrator.reverse) {
+                if (StringBuffer_length(sb)) {
+                        LogError("'%s' stop skipped -- could not stop dependant services: '%s'\n", s->name, StringBuffer_toString(sb));
+                        job->failed = true;
+                } else {
+                        executed = _orchestratorStop(job);
+                }
+        } else {
+                executed = _orchestratorStart(job, StringBuffer_length(sb) ? StringBuffer_toString(sb) : NULL);
+        }
+        StringBuffer_free(&sb);
+        if (executed)
+                LogInfo("'%s' %s %s in %s\n", s->name, orchestrator.reverse ? "stop" : "start", job->failed ? "failed" : "finished", Str_milliToTime(Time_milli() - started, (char[23]){}));
+}
+
+
+static void *_orchestratorWorker(void *args) {
+        set_signal_block();
+        LOCK(orchestrator.mutex)
+        {
+                while (orchestrator.done < orchestrator.selected) {
+                        if (orchestrator.head == orchestrator.tail) {
+                                Sem_wait(orchestrator.ready, orchestrator.mutex);
+                                continue;
+                        }
+                        ControlJob_T *job = &orchestrator.jobs[orchestrator.queue[orchestrator.head++]];
+                        if (! (Run.flags & Run_Stopped))
+                                _orchestratorExecute(job);
+                        else
+                                job->failed = true;
+                        // The requested service is done after the last phase of its action
+                        if (job->role == Job_Requested && orchestrator.reverse == (orchestrator.action == Action_Stop))
+                                _requestDone(job->service, job->failed);
+                        // Release the jobs which waited for this one: the children in the start phase, the parents in the stop phase
+                        int offset = orchestrator.reverse ? job->parents : job->children;
+                        int count = orchestrator.reverse ? job->parentsCount : job->childrenCount;
+                        for (int e = offset; e < offset + count; e++) {
+                                ControlJob_T *next = &orchestrator.jobs[orchestrator.edges[e]];
+                                if (next->selected && --next->pending == 0)
+                                        orchestrator.queue[orchestrator.tail++] = orchestrator.edges[e];
+                        }
+                        orchestrator.done++;
+                        Sem_broadcast(orchestrator.ready);
+                }
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+/**
+ * Run one phase over the selected services using the pool of start/stop workers
+ * @param reverse true for the stop phase (the dependants first), false for the start phase
+ */
+static void _orchestratorRun(boolean_t reverse) {
+        orchestrator.reverse = reverse;
+        orchestrator.selected = orchestrator.done = orchestrator.head = orchestrator.tail = 0;
+        for (int i = 0; i < orchestrator.count; i++) {
+                ControlJob_T *job = &orchestrator.jobs[i];
+                if (job->selected) {
+                        int offset = reverse ? job->children : job->parents;
+                        int count = reverse ? job->childrenCount : job->parentsCount;
+                        job->pending = 0;
+                        for (int e = offset; e < offset + count; e++)
+                                if (orchestrator.jobs[orchestrator.edges[e]].selected)
+                                        job->pending++;
+                        if (job->pending == 0)
+                                orchestrator.queue[orchestrator.tail++] = i;
+                        orchestrator.selected++;
+                }
+        }
+        if (! orchestrator.selected)
+                return;
+        int workers = MAX(1, MIN(Run.controlEngine.workers, orchestrator.selected));
+        Thread_T threads[workers];
+        Mutex_init(orchestrator.mutex);
+        Sem_init(orchestrator.ready);
+        orchestrator.active = true;
+        for (int i = 0; i < workers; i++)
+                Thread_create(threads[i], _orchestratorWorker, NULL);
+        for (int i = 0; i < workers; i++)
+                Thread_join(threads[i]);
+        orchestrator.active = false;
+        Sem_destroy(orchestrator.ready);
+        Mutex_destroy(orchestrator.mutex);
+}
 
 
 /* ------------------------------------------------------------------ Public */
 
 
+/**
+ * Apply the action to the services. The start, stop and restart actions are
+ * executed in the dependency order by the pool of Run.controlEngine.workers
+ * threads, so the services which don't depend on each other are processed
+ * concurrently. Other actions are applied one service after another.
+ * @param services An array of services
+ * @param count The number of services in the array
+ * @param action An action id describing the action to execute
+ * @param result Optional array of count results: true if the action succeeded for the service
+ * @return number of errors
+ */
+int control_services(Service_T *services, int count, Action_Type action, boolean_t *result) {
+        ASSERT(services);
+        int errors = 0;
+        if (action != Action_Start && action != Action_Stop && action != Action_Restart) {
+                for (int i = 0; i < count; i++) {
+                        boolean_t rv = control_service(services[i]->name, action);
+                        if (result)
+                                result[i] = rv;
+                        if (! rv)
+                                errors++;
+                }
+                return errors;
+        }
+        long long started = Time_milli();
+        _orchestratorPrepare(services, count, action);
+        if (action == Action_Start) {
+                _orchestratorSelect(true, false);
+                _orchestratorRun(false);
+        } else {
+                // Stop the services which depend on the requested ones first, then restart the requested services and start the dependants again
+                _orchestratorSelect(false, true);
+                _orchestratorRun(true);
+                if (action == Action_Restart) {
+                        _orchestratorSelect(true, false);
+                        _orchestratorRun(false);
+                }
+        }
+        for (int i = 0; i < count; i++) {
+                int j = _orchestratorFind(services[i]);
+                boolean_t rv = j >= 0 && ! orchestrator.jobs[j].failed;
+                if (j < 0) {
+                        _requestTake(services[i]);
+                        _requestDone(services[i], true);
+                }
+                if (result)
+                        result[i] = rv;
+                if (! rv)
+                        errors++;
+        }
+        FREE(orchestrator.jobs);
+        FREE(orchestrator.queue);
+        FREE(orchestrator.edges);
+        FREE(orchestrator.lookup);
+        DEBUG("%s of %d services finished in %s\n", actionnames[action], count, Str_milliToTime(Time_milli() - started, (char[23]){}));
+        return errors;
+}
+
+
 /**
  * Apply given action to the services list.
  * @param services A services list
@@ -433,10 +978,18 @@ boolean_t control_service_string(List_T services, const char *action) {
                 LogError("invalid action %s\n", action);
                 return 1;
         }
-        int errors = 0;
-        for (list_t s = services->head; s; s = s->next)
-                if (control_service(s->e, a) == false)
+        int errors = 0, count = 0;
+        Service_T *list = CALLOC(services->length ? services->length : 1, sizeof(Service_T));
+        for (list_t s = services->head; s; s = s->next) {
+                if (! (list[count] = Util_getService(s->e))) {
+                        LogError("Service '%s' -- doesn't exist\n", (char *)s->e);
                         errors++;
+                } else {
+                        count++;
+                }
+        }
+        errors += control_services(list, count, a, NULL);
+        FREE(list);
         return errors;
 }
 
@@ -456,6 +1009,7 @@ boolean_t control_service(const char *S, Action_Type A) {
                 return false;
         }
         s->doaction = Action_Ignored;
+        _requestTake(s);
         switch (A) {
                 case Action_Start:
                         rv = _doStart(s);
@@ -499,8 +1053,10 @@ boolean_t control_service(const char *S, Action_Type A) {
 
                 default:
                         LogError("Service '%s' -- invalid action %d\n", S, A);
-                        return false;
+                        rv = false;
+                        break;
         }
+        _requestDone(s, ! rv);
         return rv;
 }
 
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "counter.h"
+
+// libmonit
+#include "system/Mem.h"
+#include "thread/Thread.h"
+
+
+/**
+ *  Internal work counters. Each thread has its own block of counters which
+ *  fills whole cache lines, so the threads don't contend for a line. The
+ *  owner updates its block with relaxed stores only, the reader sums the
+ *  blocks under the mutex which protects the list. When a thread exits, its
+ *  block is added to the retired totals and freed.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define CACHELINE 64
+
+
+typedef struct __attribute__((aligned(CACHELINE))) Block_T {
+        unsigned long long value[Counter_Last + 1];
+        struct Block_T *next;
+} *Block_T;
+
+
+static const char *counternames[] = {"proc_files", "proc_bytes", "sockets", "events", "queue_writes", "regex_executions", "allocations"};
+
+
+static Mutex_T mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t key;
+static pthread_once_t once_control = PTHREAD_ONCE_INIT;
+static Block_T blocks = NULL;
+static unsigned long long shared[Counter_Last + 1];   // Threads without own block, updated atomically
+static unsigned long long retired[Counter_Last + 1];  // Exited threads
+static unsigned long long previous[Counter_Last + 1]; // Totals at the end of the last cycle
+static unsigned long long last[Counter_Last + 1];     // Increments in the last cycle
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _retire(void *data) {
+        Block_T block = data;
+        LOCK(mutex)
+        {
+                for (Block_T *b = &blocks; *b; b = &(*b)->next) {
+                        if (*b == block) {
+                                *b = block->next;
+                                break;
+                        }
+                }
+                for (int i = 0; i <= Counter_Last; i++)
+                        retired[i] += block->value[i];
+        }
+        END_LOCK;
+        free(block);
+}
+
+
+static void _init(void) {
+        pthread_key_create(&key, _retire);
+}
+
+
+/**
+ * @return The block of the calling thread or NULL if it cannot be created
+ */
+static Block_T _block(void) {
+        pthread_once(&once_control, _init);
+        Block_T block = pthread_getspecific(key);
+        if (! block) {
+                void *p;
+                if (posix_memalign(&p, CACHELINE, sizeof(struct Block_T)))
+                        return NULL;
+                block = memset(p, 0, sizeof(struct Block_T));
+                if (pthread_setspecific(key, block)) {
+                        free(block);
+                        return NULL;
+                }
+                LOCK(mutex)
+                {
+                        block->next = blocks;
+                        blocks = block;
+                }
+                END_LOCK;
+        }
+        return block;
+}
+
+
+/* Must be called with the mutex locked */
+static void _sum(unsigned long long total[]) {
+        for (int i = 0; i <= Counter_Last; i++)
+                total[i] = retired[i] + __atomic_load_n(&shared[i], __ATOMIC_RELAXED);
+        for (Block_T b = blocks; b; b = b->next)
+                for (int i = 0; i <= Counter_Last; i++)
+                        total[i] += __atomic_load_n(&b->value[i], __ATOMIC_RELAXED);
+}
+
+
+/* The libmonit allocation handler */
+static void _allocated(void) {
+        Counter_add(Counter_Allocations, 1);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Counter_init(void) {
+        Mem_setAllocationHandler(_allocated);
+}
+
+
+void Counter_add(Counter_Type counter, unsigned long long value) {
+        ASSERT(counter <= Counter_Last);
+        Block_T block = _block();
+        if (block)
+                __atomic_store_n(&block->value[counter], block->value[counter] + value, __ATOMIC_RELAXED);
+        else
+                __atomic_add_fetch(&shared[counter], value, __ATOMIC_RELAXED);
+}
+
+
+void Counter_cycle(void) {
+        LOCK(mutex)
+        {
+                unsigned long long total[Counter_Last + 1];
+                _sum(total);
+                for (int i = 0; i <= Counter_Last; i++) {
+                        last[i] = total[i] - previous[i];
+                        previous[i] = total[i];
+                }
+        }
+        END_LOCK;
+}
+
+
+const char *Counter_name(Counter_Type counter) {
+        ASSERT(counter <= Counter_Last);
+        return counternames[counter];
+}
+
+
+void Counter_read(unsigned long long total[], unsigned long long cycle[]) {
+        ASSERT(total);
+        LOCK(mutex)
+        {
+                _sum(total);
+                if (cycle)
+                        memcpy(cycle, last, sizeof(last));
+        }
+        END_LOCK;
+}
+
+
+void Counter_print(StringBuffer_T sb) {
+        ASSERT(sb);
+        unsigned long long total[Counter_Last + 1], cycle[Counter_Last + 1];
+        Counter_read(total, cycle);
+        StringBuffer_append(sb, "%-32s %20s %20s\n", "Counter", "total", "last cycle");
+        for (int i = 0; i <= Counter_Last; i++)
+                StringBuffer_append(sb, "%-32s %20llu %20llu\n", counternames[i], total[i], cycle[i]);
+}
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_COUNTER_H
+#define MONIT_COUNTER_H
+
+
+/**
+ * Internal work counters. They count how much work Monit does on the hot
+ * paths (the /proc files read, the sockets opened, the events posted, ...),
+ * so a capacity regression is visible in production, not only the latency
+ * reported by the profiler. Each thread increments its own cache line
+ * aligned block of counters without locking, the blocks are summed only
+ * when the counters are read. The totals and the increments of the last
+ * poll cycle are available via the HTTP interface ('monit report metrics'),
+ * the Prometheus metrics and the status XML and JSON.
+ *
+ * @file
+ */
+
+
+typedef enum {
+        Counter_ProcFiles = 0,          /**< /proc files read */
+        Counter_ProcBytes,              /**< /proc bytes read */
+        Counter_Sockets,                /**< Client sockets opened */
+        Counter_Events,                 /**< Event_post() calls */
+        Counter_QueueWrites,            /**< Event queue records written */
+        Counter_RegexExecutions,        /**< Content match regex executions */
+        Counter_Allocations,            /**< Allocations made through libmonit */
+        Counter_Last = Counter_Allocations
+} __attribute__((__packed__)) Counter_Type;
+
+
+/**
+ * Start counting the libmonit allocations, called once at startup
+ */
+void Counter_init(void);
+
+
+/**
+ * Add the value to the counter of the calling thread
+ * @param counter The counter
+ * @param value The value to add
+ */
+void Counter_add(Counter_Type counter, unsigned long long value);
+
+
+/**
+ * Remember the totals at the end of the poll cycle, the difference to the
+ * totals of the previous cycle is reported as the last cycle increment
+ */
+void Counter_cycle(void);
+
+
+/**
+ * Get the counter name
+ * @param counter The counter
+ * @return The name, for example "proc_files"
+ */
+const char *Counter_name(Counter_Type counter);
+
+
+/**
+ * Sum the counters of all threads
+ * @param total The totals since Monit started, Counter_Last + 1 elements
+ * @param cycle The increments in the last poll cycle, Counter_Last + 1
+ * elements or NULL
+ */
+void Counter_read(unsigned long long total[], unsigned long long cycle[]);
+
+
+/**
+ * Print the report: the total and the last cycle increment of each counter
+ * @param sb The output buffer
+ */
+void Counter_print(StringBuffer_T sb);
+
+
+#endif
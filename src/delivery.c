@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include "monit.h"
+#include "alert.h"
+#include "event.h"
+#include "delivery.h"
+#include "MMonit.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The posted events are copied once and put on a bounded ring per
+ * handler: one for the alerts and one for each M/Monit server. Each ring
+ * has its own thread, so a slow or unreachable M/Monit server delays only
+ * its own queue, not the other servers or the alerts. The copy is shared by
+ * the rings and released by the last one. The copy references the event
+ * source service, so the delivery threads are stopped (and the rings
+ * drained) before the service list is freed on reload and exit.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define DELIVERY_ATTEMPTS 3           /**< Delivery attempts before queueing */
+#define DELIVERY_BACKOFF  1                 /**< First retry delay [s], doubled */
+
+
+/* Copy of the event and its actions owned by the delivery queues */
+typedef struct DeliveryEvent_T {
+        struct myevent event;
+        struct myeventaction action;
+        struct myaction failed;
+        struct myaction succeeded;
+        int references;               /**< Number of rings holding the event */
+        int mmonits;        /**< Number of M/Monit servers the event is sent to */
+        int mmonitsFailed;     /**< Number of M/Monit servers which failed */
+        boolean_t alertFailed;                /**< true if the alert failed */
+} *DeliveryEvent_T;
+
+
+/* The ring and thread of one handler */
+typedef struct DeliveryQueue_T {
+        Mmonit_T mmonit;            /**< The M/Monit server or NULL for alerts */
+        int count;
+        int head;                                  /**< Index of the oldest event */
+        Thread_T thread;
+        Sem_T queued;                       /**< Signalled when an event was posted */
+        DeliveryEvent_T *ring;
+} *DeliveryQueue_T;
+
+
+static struct {
+        boolean_t running;
+        boolean_t stopped;
+        int slots;
+        int count;                    /**< Number of events not delivered yet */
+        int queues;
+        Sem_T stop;                  /**< Signalled when the threads should stop */
+        DeliveryQueue_T queue;          /**< The alert queue, then the M/Monit queues */
+} delivery = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static DeliveryEvent_T _copy(Event_T E) {
+        DeliveryEvent_T d;
+        NEW(d);
+        d->event = *E;
+        d->event.message = E->message ? Str_dup(E->message) : NULL;
+        d->event.next = NULL;
+        if (E->action->failed) {
+                d->failed = *E->action->failed;
+                d->action.failed = &d->failed;
+        }
+        if (E->action->succeeded) {
+                d->succeeded = *E->action->succeeded;
+                d->action.succeeded = &d->succeeded;
+        }
+        d->event.action = &d->action;
+        return d;
+}
+
+
+/**
+ * Release the reference of one ring. The last one adds the event to the
+ * event queue if the alert failed or none of the M/Monit servers received
+ * it, and frees the copy
+ */
+static void _release(DeliveryEvent_T *d) {
+        if (__atomic_sub_fetch(&(*d)->references, 1, __ATOMIC_ACQ_REL) > 0) {
+                *d = NULL;
+                return;
+        }
+        Handler_Type pending = Handler_Succeeded;
+        if ((*d)->alertFailed)
+                pending |= Handler_Alert;
+        if ((*d)->mmonits && (*d)->mmonitsFailed == (*d)->mmonits)
+                pending |= Handler_Mmonit;
+        if (pending != Handler_Succeeded) {
+                (*d)->event.flag = pending;
+                Event_queue_add(&(*d)->event);
+        }
+        LOCK(mutex)
+        {
+                delivery.count--;
+        }
+        END_LOCK;
+        FREE((*d)->event.message);
+        FREE(*d);
+}
+
+
+/**
+ * Return the handlers which should deliver the event
+ */
+static Handler_Type _handlers(Event_T E) {
+        Handler_Type handlers = Handler_Succeeded;
+        if (E->source->maillist || Run.maillist)
+                handlers |= Handler_Alert;
+        if (Run.mmonits && E->state_changed)
+                handlers |= Handler_Mmonit;
+        return handlers;
+}
+
+
+/**
+ * Deliver the events by the handler of the queue, the failed ones are
+ * retried with increasing delay until the attempts are exhausted or the
+ * threads are stopped. The M/Monit notifications of several events are sent
+ * in one message
+ */
+static void _deliver(DeliveryQueue_T q, DeliveryEvent_T *batch, int count) {
+        boolean_t *pending = CALLOC(count, sizeof(boolean_t));
+        Event_T *events = CALLOC(count, sizeof(Event_T));
+        for (int i = 0; i < count; i++)
+                pending[i] = true;
+        for (int attempt = 1; ; attempt++) {
+                boolean_t failed = false;
+                if (q->mmonit) {
+                        int n = 0;
+                        for (int i = 0; i < count; i++)
+                                events[n++] = &batch[i]->event;
+                        failed = MMonit_sendTo(q->mmonit, events, n) != Handler_Succeeded;
+                        if (! failed)
+                                for (int i = 0; i < count; i++)
+                                        pending[i] = false;
+                } else {
+                        for (int i = 0; i < count; i++) {
+                                if (pending[i] && handle_alert(&batch[i]->event) == Handler_Succeeded)
+                                        pending[i] = false;
+                                if (pending[i])
+                                        failed = true;
+                        }
+                }
+                if (! failed || attempt >= DELIVERY_ATTEMPTS)
+                        break;
+                boolean_t stopped = false;
+                LOCK(mutex)
+                {
+                        if (! (stopped = delivery.stopped)) {
+                                int backoff = DELIVERY_BACKOFF << (attempt - 1);
+                                DEBUG("Event delivery to %s failed, retry in %d seconds\n", q->mmonit ? q->mmonit->url->url : "the mail servers", backoff);
+                                struct timespec wait = {.tv_sec = Time_now() + backoff, .tv_nsec = 0};
+                                Sem_timeWait(delivery.stop, mutex, wait);
+                        }
+                }
+                END_LOCK;
+                if (stopped)
+                        break;
+        }
+        for (int i = 0; i < count; i++) {
+                if (pending[i]) {
+                        if (q->mmonit)
+                                __atomic_add_fetch(&batch[i]->mmonitsFailed, 1, __ATOMIC_ACQ_REL);
+                        else
+                                batch[i]->alertFailed = true;
+                }
+        }
+        FREE(events);
+        FREE(pending);
+}
+
+
+/**
+ * Take the oldest event from the ring, must be called with the mutex locked
+ */
+static DeliveryEvent_T _take(DeliveryQueue_T q) {
+        DeliveryEvent_T d = q->ring[q->head];
+        q->ring[q->head] = NULL;
+        q->head = (q->head + 1) % delivery.slots;
+        q->count--;
+        return d;
+}
+
+
+static void *_worker(void *args) {
+        DeliveryQueue_T q = args;
+        set_signal_block();
+        // With the M/Monit batching, the events posted within the batch delay are delivered together
+        int size = q->mmonit && Run.mmonitBatch.size > 1 ? Run.mmonitBatch.size : 1;
+        DeliveryEvent_T *batch = CALLOC(size, sizeof(DeliveryEvent_T));
+        LOCK(mutex)
+        {
+                while (q->count || ! delivery.stopped) {
+                        if (! q->count) {
+                                Sem_wait(q->queued, mutex);
+                                continue;
+                        }
+                        int count = 0;
+                        batch[count++] = _take(q);
+                        struct timespec deadline = {.tv_sec = Time_now() + Run.mmonitBatch.delay, .tv_nsec = 0};
+                        while (count < size) {
+                                if (q->count)
+                                        batch[count++] = _take(q);
+                                else if (! delivery.stopped && Time_now() < deadline.tv_sec)
+                                        Sem_timeWait(q->queued, mutex, deadline);
+                                else
+                                        break;
+                        }
+                        Mutex_unlock(mutex);
+                        _deliver(q, batch, count);
+                        for (int i = 0; i < count; i++)
+                                _release(&batch[i]);
+                        Mutex_lock(mutex);
+                }
+        }
+        END_LOCK;
+        FREE(batch);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Delivery_start() {
+        if (Run.deliveryEngine.slots < 1)
+                return false;
+        LOCK(mutex)
+        {
+                if (! delivery.running) {
+                        Sem_init(delivery.stop);
+                        delivery.stopped = false;
+                        delivery.slots = Run.deliveryEngine.slots;
+                        delivery.count = 0;
+                        delivery.queues = 1;
+                        for (Mmonit_T C = Run.mmonits; C; C = C->next)
+                                delivery.queues++;
+                        delivery.queue = CALLOC(delivery.queues, sizeof(struct DeliveryQueue_T));
+                        Mmonit_T C = Run.mmonits;
+                        for (int i = 0; i < delivery.queues; i++) {
+                                DeliveryQueue_T q = &delivery.queue[i];
+                                if (i > 0) {
+                                        q->mmonit = C;
+                                        C = C->next;
+                                }
+                                Sem_init(q->queued);
+                                q->ring = CALLOC(delivery.slots, sizeof(DeliveryEvent_T));
+                                Thread_create(q->thread, _worker, q);
+                        }
+                        delivery.running = true;
+                        DEBUG("Event delivery started with %d slots, %d queues\n", delivery.slots, delivery.queues);
+                }
+        }
+        END_LOCK;
+        return true;
+}
+
+
+void Delivery_stop() {
+        if (! delivery.running)
+                return;
+        LOCK(mutex)
+        {
+                delivery.stopped = true;
+                for (int i = 0; i < delivery.queues; i++)
+                        Sem_signal(delivery.queue[i].queued);
+                Sem_broadcast(delivery.stop);
+        }
+        END_LOCK;
+        for (int i = 0; i < delivery.queues; i++)
+                Thread_join(delivery.queue[i].thread);
+        LOCK(mutex)
+        {
+                for (int i = 0; i < delivery.queues; i++) {
+                        FREE(delivery.queue[i].ring);
+                        Sem_destroy(delivery.queue[i].queued);
+                }
+                FREE(delivery.queue);
+                Sem_destroy(delivery.stop);
+                delivery.running = false;
+        }
+        END_LOCK;
+}
+
+
+boolean_t Delivery_post(Event_T E) {
+        ASSERT(E);
+        boolean_t rv = false, full = false;
+        Handler_Type handlers = _handlers(E);
+        LOCK(mutex)
+        {
+                if (delivery.running && ! delivery.stopped) {
+                        // The event is queued for all its handlers or for none
+                        int first = handlers & Handler_Alert ? 0 : 1;
+                        int last = handlers & Handler_Mmonit ? delivery.queues : 1;
+                        for (int i = first; i < last; i++)
+                                if (delivery.queue[i].count >= delivery.slots)
+                                        full = true;
+                        if (! full) {
+                                if (first < last) {
+                                        DeliveryEvent_T d = _copy(E);
+                                        d->references = last - first;
+                                        d->mmonits = last - 1;
+                                        for (int i = first; i < last; i++) {
+                                                DeliveryQueue_T q = &delivery.queue[i];
+                                                q->ring[(q->head + q->count) % delivery.slots] = d;
+                                                q->count++;
+                                                Sem_signal(q->queued);
+                                        }
+                                        delivery.count++;
+                                }
+                                rv = true;
+                        }
+                }
+        }
+        END_LOCK;
+        if (full && Run.eventlist_dir) {
+                LogError("Event delivery queue is full, adding '%s' event to the event queue\n", E->source->name);
+                if ((E->flag = handlers) != Handler_Succeeded)
+                        Event_queue_add(E);
+                rv = true;
+        }
+        return rv;
+}
+
+
+int Delivery_count(void) {
+        int count = 0;
+        LOCK(mutex)
+        {
+                count = delivery.count;
+        }
+        END_LOCK;
+        return count;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_DELIVERY_H
+#define MONIT_DELIVERY_H
+
+
+/**
+ * Background event notification delivery. If enabled with "set event
+ * delivery slots N", the alert and M/Monit notifications of an event are
+ * sent by a delivery thread, so a slow mail server or M/Monit doesn't delay
+ * the service checks. The thread works on a copy of the event, failed
+ * notifications are retried with increasing delay and then added to the
+ * event queue. If the delivery queue is full, the event is added to the
+ * event queue right away.
+ * @file
+ */
+
+
+/**
+ * Start the delivery thread
+ * @return true if the thread was started, otherwise false
+ */
+boolean_t Delivery_start(void);
+
+
+/**
+ * Stop the delivery thread. The queued events are delivered first without
+ * retry, the events which failed are added to the event queue.
+ */
+void Delivery_stop(void);
+
+
+/**
+ * Post the event for the background delivery of the alert and M/Monit
+ * notifications
+ * @param E An event object
+ * @return true if the event was queued for the delivery thread or added
+ * to the event queue because the delivery queue is full. false if the
+ * delivery thread isn't running or the delivery queue is full and the event
+ * queue is disabled, the caller should deliver the event itself
+ */
+boolean_t Delivery_post(Event_T E);
+
+
+/**
+ * Get the number of events waiting in the delivery queue
+ * @return The number of queued events
+ */
+int Delivery_count(void);
+
+
+#endif
@@ -25,7 +25,9 @@
 #ifndef MONIT_DEVICE_H
 #define MONIT_DEVICE_H
 
+void filesystem_invalidate(void);
 boolean_t filesystem_usage(Service_T);
+boolean_t filesystem_isVirtual(const char *path, dev_t device);
 
 #endif
 
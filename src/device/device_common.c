@@ -35,6 +35,10 @@
 #include <stdio.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
@@ -62,14 +66,235 @@
 #include "monit.h"
 #include "device.h"
 #include "device_sysdep.h"
+#include "ioprobe.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/AssertException.h"
+#include "thread/Thread.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define USAGE_BUCKETS 64
+
+
+/* Usage statistics of the filesystem on the given device, valid in the cycle they were read */
+typedef struct FilesystemUsage_T {
+        dev_t device;
+        unsigned long long cycle;
+        struct myinfo usage;
+        struct FilesystemUsage_T *next;
+} *FilesystemUsage_T;
+
+
+static struct {
+        unsigned long long cycle;
+        FilesystemUsage_T buckets[USAGE_BUCKETS];
+} usagecache = {.cycle = 1};
+
+
+/* Block device I/O counters from the current and the previous cycle, sorted by device id */
+static struct {
+        unsigned long long cycle;
+        int count;
+        int previousCount;
+        long long time;                                                 /**< [ms] */
+        long long previousTime;
+        DiskStatistics_T *current;
+        DiskStatistics_T *previous;
+} disktable;
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static FilesystemUsage_T _findUsage(dev_t device) {
+        for (FilesystemUsage_T u = usagecache.buckets[(unsigned long long)device % USAGE_BUCKETS]; u; u = u->next)
+                if (u->device == device)
+                        return u;
+        return NULL;
+}
+
+
+/**
+ * Get the usage statistics of the filesystem mounted at the mountpoint with
+ * the given device id. The statistics are read once per cycle and shared by
+ * all services on the same filesystem.
+ */
+static boolean_t _getUsage(char *mountpoint, dev_t device, Info_T inf) {
+        struct myinfo usage = {.priv.filesystem.flags = -1}; // Not all platforms report the flags
+        boolean_t cached = false;
+        LOCK(mutex)
+        {
+                FilesystemUsage_T u = _findUsage(device);
+                if (u && u->cycle == usagecache.cycle) {
+                        usage = u->usage;
+                        cached = true;
+                }
+        }
+        END_LOCK;
+        if (! cached) {
+                if (! filesystem_usage_sysdep(mountpoint, &usage))
+                        return false;
+                LOCK(mutex)
+                {
+                        FilesystemUsage_T u = _findUsage(device);
+                        if (! u) {
+                                NEW(u);
+                                u->device = device;
+                                u->next = usagecache.buckets[(unsigned long long)device % USAGE_BUCKETS];
+                                usagecache.buckets[(unsigned long long)device % USAGE_BUCKETS] = u;
+                        }
+                        u->cycle = usagecache.cycle;
+                        u->usage = usage;
+                }
+                END_LOCK;
+        }
+        inf->priv.filesystem.f_bsize =           usage.priv.filesystem.f_bsize;
+        inf->priv.filesystem.f_blocks =          usage.priv.filesystem.f_blocks;
+        inf->priv.filesystem.f_blocksfree =      usage.priv.filesystem.f_blocksfree;
+        inf->priv.filesystem.f_blocksfreetotal = usage.priv.filesystem.f_blocksfreetotal;
+        inf->priv.filesystem.f_files =           usage.priv.filesystem.f_files;
+        inf->priv.filesystem.f_filesfree =       usage.priv.filesystem.f_filesfree;
+        inf->priv.filesystem._flags =            inf->priv.filesystem.flags;
+        inf->priv.filesystem.flags =             usage.priv.filesystem.flags;
+        return true;
+}
+
+
+static int _compareDisk(const void *a, const void *b) {
+        dev_t x = ((const DiskStatistics_T *)a)->device, y = ((const DiskStatistics_T *)b)->device;
+        return x < y ? -1 : x > y;
+}
+
+
+static DiskStatistics_T *_findDisk(DiskStatistics_T *table, int count, dev_t device) {
+        DiskStatistics_T key = {.device = device};
+        return count > 0 ? bsearch(&key, table, count, sizeof(DiskStatistics_T), _compareDisk) : NULL;
+}
+
+
+/* Read the I/O counters of all block devices once per cycle, the caller must hold the lock */
+static void _updateDisks() {
+        if (disktable.cycle == usagecache.cycle)
+                return;
+        FREE(disktable.previous);
+        disktable.previous = disktable.current;
+        disktable.previousCount = disktable.count;
+        disktable.previousTime = disktable.time;
+        disktable.current = NULL;
+        disktable.count = device_diskstatistics_sysdep(&disktable.current);
+        disktable.time = Time_milli();
+        disktable.cycle = usagecache.cycle;
+        if (disktable.count > 0)
+                qsort(disktable.current, disktable.count, sizeof(DiskStatistics_T), _compareDisk);
+}
+
+
+/**
+ * Compute the I/O rates of the block device holding the filesystem from
+ * the counters of the current and the previous cycle. The rates are -1 if
+ * the device has no statistics or until two samples are available.
+ */
+static void _getIO(dev_t disk, Info_T inf) {
+        inf->priv.filesystem.io.read_bytes = inf->priv.filesystem.io.write_bytes = -1.;
+        inf->priv.filesystem.io.read_operations = inf->priv.filesystem.io.write_operations = -1.;
+        inf->priv.filesystem.io.service_time = inf->priv.filesystem.io.utilization = -1.;
+        LOCK(mutex)
+        {
+                _updateDisks();
+                DiskStatistics_T *current = _findDisk(disktable.current, disktable.count, disk);
+                DiskStatistics_T *previous = _findDisk(disktable.previous, disktable.previousCount, disk);
+                double seconds = (disktable.time - disktable.previousTime) / 1000.;
+                // The counters are reset if the device was removed and added again
+                if (current && previous && seconds > 0. && current->reads >= previous->reads && current->writes >= previous->writes && current->busyTime >= previous->busyTime) {
+                        unsigned long long operations = (current->reads - previous->reads) + (current->writes - previous->writes);
+                        inf->priv.filesystem.io.read_bytes = (current->readBytes - previous->readBytes) / seconds;
+                        inf->priv.filesystem.io.write_bytes = (current->writeBytes - previous->writeBytes) / seconds;
+                        inf->priv.filesystem.io.read_operations = (current->reads - previous->reads) / seconds;
+                        inf->priv.filesystem.io.write_operations = (current->writes - previous->writes) / seconds;
+                        inf->priv.filesystem.io.service_time = operations ? (double)((current->readTime - previous->readTime) + (current->writeTime - previous->writeTime)) / operations : 0.;
+                        inf->priv.filesystem.io.utilization = MIN(100., (current->busyTime - previous->busyTime) / (seconds * 10.));
+                }
+        }
+        END_LOCK;
+}
+
+
+/*
+ * Read the usage of all quotas tested for the filesystem with one lookup.
+ * Rules for the same user, group or project share one quota entry. The
+ * limit is the hard limit, or the soft limit if no hard limit is set.
+ */
+static void _getQuota(char *mountpoint, dev_t device, Service_T s) {
+        int count = 0;
+        for (Quota_T q = s->quotalist; q; q = q->next)
+                count++;
+        QuotaUsage_T *quota = CALLOC(count, sizeof(QuotaUsage_T));
+        count = 0;
+        for (Quota_T q = s->quotalist; q; q = q->next) {
+                int i;
+                for (i = 0; i < count && (quota[i].type != q->type || quota[i].id != q->id); i++)
+                        ;
+                if (i == count) {
+                        quota[count].type = q->type;
+                        quota[count].id = q->id;
+                        count++;
+                }
+        }
+        boolean_t available = filesystem_quota_sysdep(mountpoint, device, quota, count);
+        for (Quota_T q = s->quotalist; q; q = q->next) {
+                q->usage.found = false;
+                for (int i = 0; available && i < count; i++) {
+                        if (quota[i].type == q->type && quota[i].id == q->id) {
+                                if ((q->usage.found = quota[i].found)) {
+                                        q->usage.used = q->inode ? quota[i].inodes : quota[i].space;
+                                        q->usage.limit = q->inode ? (quota[i].inodeHard ? quota[i].inodeHard : quota[i].inodeSoft) : (quota[i].spaceHard ? quota[i].spaceHard : quota[i].spaceSoft);
+                                }
+                                break;
+                        }
+                }
+        }
+        FREE(quota);
+}
+
+
+/* Get the device id of the filesystem mounted at the mountpoint */
+static boolean_t _getDevice(char *mountpoint, dev_t *device) {
+        struct stat sb;
+        if (IoProbe_stat(mountpoint, &sb) != 0) {
+                LogError("filesystem %s doesn't exist\n", mountpoint);
+                return false;
+        }
+        *device = sb.st_dev;
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void filesystem_invalidate() {
+        LOCK(mutex)
+        {
+                usagecache.cycle++;
+        }
+        END_LOCK;
+}
 
 
 boolean_t filesystem_usage(Service_T s) {
         ASSERT(s);
 
         struct stat sb;
+        dev_t device = 0;
         char buf[PATH_MAX+1];
-        if (lstat(s->path, &sb) == 0) {
+        if (IoProbe_lstat(s->path, &sb) == 0) {
                 if (S_ISLNK(sb.st_mode)) {
                         // Symbolic link: dereference so we'll be able to find it in mnttab + get permissions of the target
                         if (! realpath(s->path, buf)) {
@@ -77,7 +302,7 @@ boolean_t filesystem_usage(Service_T s) {
                                 return false;
                         }
                         // Get link target mode + permissions
-                        if (stat(buf, &sb) != 0) {
+                        if (IoProbe_stat(buf, &sb) != 0) {
                                 LogError("filesystem %s doesn't exist\n", buf);
                                 return false;
                         }
@@ -85,29 +310,38 @@ boolean_t filesystem_usage(Service_T s) {
                         if (S_ISBLK(sb.st_mode) || S_ISCHR(sb.st_mode)) {
                                 char dev[PATH_MAX+1];
                                 snprintf(dev, sizeof(dev), "%s", buf);
-                                if (! device_mountpoint_sysdep(dev, buf, sizeof(buf)))
+                                if (! device_mountpoint_sysdep(dev, buf, sizeof(buf)) || ! _getDevice(buf, &device))
                                         return false;
+                        } else {
+                                device = sb.st_dev;
                         }
                 } else if (S_ISREG(sb.st_mode) || S_ISDIR(sb.st_mode)) {
                         // File or directory: we have mountpoint or filesystem subdirectory already (no need to map)
                         snprintf(buf, sizeof(buf), "%s", s->path);
+                        device = sb.st_dev;
                 } else if (S_ISBLK(sb.st_mode) || S_ISCHR(sb.st_mode)) {
                         // Block or character device: look for mountpoint
-                        if (! device_mountpoint_sysdep(s->path, buf, sizeof(buf)))
+                        if (! device_mountpoint_sysdep(s->path, buf, sizeof(buf)) || ! _getDevice(buf, &device))
                                 return false;
                 } else {
                         LogError("Cannot get filesystem for '%s' -- not file, directory nor device\n", s->path);
+                        return false;
                 }
         } else {
                 // Generic device string (such as sshfs connection info): look for mountpoint
                 if (! device_mountpoint_sysdep(s->path, buf, sizeof(buf)))
                         return false;
-                if (stat(buf, &sb) != 0) {
+                if (IoProbe_stat(buf, &sb) != 0) {
                         LogError("filesystem %s doesn't exist\n", buf);
                         return false;
                 }
+                device = sb.st_dev;
         }
-        if (filesystem_usage_sysdep(buf, s->inf)) {
+        if (_getUsage(buf, device, s->inf)) {
+                // The I/O counters belong to the block device, which is the mounted device node or the device of the filesystem for a path
+                _getIO(S_ISBLK(sb.st_mode) ? sb.st_rdev : device, s->inf);
+                if (s->quotalist)
+                        _getQuota(buf, device, s);
                 s->inf->priv.filesystem.mode = sb.st_mode;
                 s->inf->priv.filesystem.uid = sb.st_uid;
                 s->inf->priv.filesystem.gid = sb.st_gid;
@@ -120,3 +354,17 @@ boolean_t filesystem_usage(Service_T s) {
         return false;
 }
 
+
+/**
+ * Test if the file is on a virtual filesystem such as procfs, where the
+ * files report no meaningful size. The filesystem type is looked up by
+ * the file's device id where the mount table is available, otherwise
+ * the path prefix is tested.
+ */
+boolean_t filesystem_isVirtual(const char *path, dev_t device) {
+        char type[STRLEN];
+        if (device_filesystemtype_sysdep(device, type, sizeof(type)))
+                return IS(type, "proc") || IS(type, "sysfs") || IS(type, "debugfs") || IS(type, "tracefs");
+        return Str_startsWith(path, "/proc");
+}
+
@@ -25,8 +25,36 @@
 #ifndef MONIT_DEVICE_SYSDEP_H
 #define MONIT_DEVICE_SYSDEP_H
 
+/** Cumulative I/O counters of a block device */
+typedef struct DiskStatistics_T {
+        dev_t device;
+        unsigned long long reads;                /**< Completed read operations */
+        unsigned long long readBytes;
+        unsigned long long readTime;                  /**< Time spent reading [ms] */
+        unsigned long long writes;              /**< Completed write operations */
+        unsigned long long writeBytes;
+        unsigned long long writeTime;                 /**< Time spent writing [ms] */
+        unsigned long long busyTime;        /**< Time with I/O in progress [ms] */
+} DiskStatistics_T;
+
+/** Quota usage and limits of one user, group or project on a filesystem */
+typedef struct QuotaUsage_T {
+        int type;                                                /**< Quota_Type */
+        int id;
+        boolean_t found;                  /**< The quota was read from the system */
+        unsigned long long space;                               /**< Used space [B] */
+        unsigned long long spaceSoft;           /**< Space soft limit [B], 0 if none */
+        unsigned long long spaceHard;           /**< Space hard limit [B], 0 if none */
+        unsigned long long inodes;
+        unsigned long long inodeSoft;
+        unsigned long long inodeHard;
+} QuotaUsage_T;
+
 char *device_mountpoint_sysdep(char *dev, char *buf, int buflen);
+int device_diskstatistics_sysdep(DiskStatistics_T **statistics);
 boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf);
+char *device_filesystemtype_sysdep(dev_t device, char *buf, int buflen);
+boolean_t filesystem_quota_sysdep(char *mntpoint, dev_t device, QuotaUsage_T *quota, int count);
 
 #endif
 
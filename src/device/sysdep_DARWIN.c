@@ -101,3 +101,18 @@ boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf) {
         return true;
 }
 
+
+char *device_filesystemtype_sysdep(dev_t device, char *buf, int buflen) {
+        return NULL; // Not implemented, the caller falls back to the path
+}
+
+
+int device_diskstatistics_sysdep(DiskStatistics_T **statistics) {
+        return -1; // Not implemented, the disk I/O tests are skipped
+}
+
+
+boolean_t filesystem_quota_sysdep(char *mntpoint, dev_t device, QuotaUsage_T *quota, int count) {
+        return false; // Not implemented, the quota tests are skipped
+}
+
@@ -54,6 +54,10 @@
 #include <sys/mount.h>
 #endif
 
+#ifdef HAVE_UFS_UFS_QUOTA_H
+#include <ufs/ufs/quota.h>
+#endif
+
 #include "monit.h"
 #include "device_sysdep.h"
 
@@ -102,3 +106,39 @@ boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf) {
 
 }
 
+
+char *device_filesystemtype_sysdep(dev_t device, char *buf, int buflen) {
+        return NULL; // Not implemented, the caller falls back to the path
+}
+
+
+int device_diskstatistics_sysdep(DiskStatistics_T **statistics) {
+        return -1; // Not implemented, the disk I/O tests are skipped
+}
+
+
+/* UFS user and group quotas, the limits are in disk blocks */
+boolean_t filesystem_quota_sysdep(char *mntpoint, dev_t device, QuotaUsage_T *quota, int count) {
+        ASSERT(quota);
+#ifdef HAVE_UFS_UFS_QUOTA_H
+        for (int i = 0; i < count; i++) {
+                struct dqblk dqblk = {};
+                if (quota[i].type == Quota_Project || quotactl(mntpoint, QCMD(Q_GETQUOTA, quota[i].type == Quota_Group ? GRPQUOTA : USRQUOTA), quota[i].id, &dqblk) != 0) {
+                        DEBUG("Cannot read the %s quota of id %d on filesystem '%s' -- %s\n", quotatypenames[quota[i].type], quota[i].id, mntpoint, quota[i].type == Quota_Project ? "not supported" : STRERROR);
+                        quota[i].found = false;
+                        continue;
+                }
+                quota[i].found = true;
+                quota[i].space = dbtob((unsigned long long)dqblk.dqb_curblocks);
+                quota[i].spaceSoft = dbtob((unsigned long long)dqblk.dqb_bsoftlimit);
+                quota[i].spaceHard = dbtob((unsigned long long)dqblk.dqb_bhardlimit);
+                quota[i].inodes = dqblk.dqb_curinodes;
+                quota[i].inodeSoft = dqblk.dqb_isoftlimit;
+                quota[i].inodeHard = dqblk.dqb_ihardlimit;
+        }
+        return true;
+#else
+        return false;
+#endif
+}
+
@@ -46,6 +46,26 @@
 #include <strings.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h>
+#endif
+
 #ifdef HAVE_SYS_STATVFS_H
 # include <sys/statvfs.h>
 #endif
@@ -54,16 +74,258 @@
 #include <mntent.h>
 #endif
 
+#ifdef HAVE_SYS_QUOTA_H
+#include <sys/quota.h>
+#endif
+
 #include "monit.h"
 #include "device_sysdep.h"
+#include "ioprobe.h"
 
+// libmonit
+#include "exceptions/AssertException.h"
+#include "thread/Thread.h"
 
-char *device_mountpoint_sysdep(char *dev, char *buf, int buflen) {
-        FILE *mntfd;
-        struct mntent *mnt;
 
-        ASSERT(dev);
+/* ------------------------------------------------------------- Definitions */
+
+
+#define MOUNTINFO "/proc/self/mountinfo"
+#define DISKSTATS "/proc/diskstats"
+
+/* The quota block limits are in units of 1kB (QIF_DQBLKSIZE in the kernel headers) */
+#define QUOTABLOCKSIZE 1024ULL
+
+#ifndef PRJQUOTA
+#define PRJQUOTA 2
+#endif
+
+
+/* Mount table entry. The strings point to the mount table data, except of realsource */
+typedef struct Mount_T {
+        char *source;                                        /**< Mounted device */
+        char *realsource;   /**< Device with symbolic links resolved or NULL if same */
+        char *mountpoint;
+        char *type;                                           /**< Filesystem type */
+        dev_t device;                       /**< st_dev of files on the filesystem */
+        int nextSource;             /**< Next entry in the hash chain or -1 (ditto) */
+        int nextRealSource;
+        int nextDevice;
+} Mount_T;
+
+
+/*
+ * The mount table is parsed once and indexed by the device name and by the
+ * device id. The kernel signals POLLPRI on the open mountinfo file when the
+ * mount table changes, the table is parsed again on the next lookup then.
+ */
+static struct {
+        int fd;
+        boolean_t valid;
+        int count;
+        unsigned buckets;                                           /**< Power of 2 */
+        Mount_T *mounts;
+        int *bySource;
+        int *byRealSource;
+        int *byDevice;
+        char *data;                                          /**< mountinfo content */
+} mounttable = {.fd = -1};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static unsigned _hashString(const char *s) {
+        unsigned h = 5381;
+        while (*s)
+                h = h * 33 + *s++;
+        return h & (mounttable.buckets - 1);
+}
+
+
+static unsigned _hashDevice(dev_t device) {
+        return (unsigned)(major(device) * 31 + minor(device)) & (mounttable.buckets - 1);
+}
+
+
+/* Decode the octal escapes of space, tab, newline and backslash in place */
+static char *_unescape(char *s) {
+        char *src = s, *dst = s;
+        while (*src) {
+                if (src[0] == '\\' && src[1] >= '0' && src[1] <= '3' && src[2] >= '0' && src[2] <= '7' && src[3] >= '0' && src[3] <= '7') {
+                        *dst++ = (src[1] - '0') * 64 + (src[2] - '0') * 8 + (src[3] - '0');
+                        src += 4;
+                } else {
+                        *dst++ = *src++;
+                }
+        }
+        *dst = 0;
+        return s;
+}
+
+
+static void _clear() {
+        for (int i = 0; i < mounttable.count; i++)
+                FREE(mounttable.mounts[i].realsource);
+        FREE(mounttable.mounts);
+        FREE(mounttable.bySource);
+        FREE(mounttable.byRealSource);
+        FREE(mounttable.byDevice);
+        FREE(mounttable.data);
+        mounttable.count = 0;
+        mounttable.valid = false;
+}
+
+
+static boolean_t _readData() {
+        if (lseek(mounttable.fd, 0, SEEK_SET) != 0)
+                return false;
+        int size = 8192, length = 0;
+        mounttable.data = ALLOC(size);
+        for (;;) {
+                if (length == size - 1) {
+                        size *= 2;
+                        RESIZE(mounttable.data, size);
+                }
+                ssize_t n = read(mounttable.fd, mounttable.data + length, size - length - 1);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        return false;
+                } else if (n == 0) {
+                        break;
+                }
+                length += n;
+        }
+        mounttable.data[length] = 0;
+        return true;
+}
+
+
+/*
+ * Parse the mountinfo line, the format is (see proc(5)):
+ * 36 35 98:0 /mnt1 /mnt/parent rw,noatime master:1 - ext3 /dev/root rw,errors=continue
+ */
+static boolean_t _parseLine(char *line, Mount_T *m) {
+        char *save = NULL, *field;
+        unsigned maj, min;
+        if (! strtok_r(line, " ", &save) || ! strtok_r(NULL, " ", &save) || ! (field = strtok_r(NULL, " ", &save)) || sscanf(field, "%u:%u", &maj, &min) != 2)
+                return false;
+        if (! strtok_r(NULL, " ", &save) || ! (m->mountpoint = strtok_r(NULL, " ", &save)))
+                return false;
+        // Skip the mount options and the optional fields up to the separator
+        while ((field = strtok_r(NULL, " ", &save)) && ! IS(field, "-"))
+                ;
+        if (! field || ! (m->type = strtok_r(NULL, " ", &save)) || ! (m->source = strtok_r(NULL, " ", &save)))
+                return false;
+        _unescape(m->mountpoint);
+        _unescape(m->source);
+        m->device = makedev(maj, min);
+        m->realsource = NULL;
+        if (Str_startsWith(m->source, "/dev/")) {
+                char path[PATH_MAX];
+                if (realpath(m->source, path) && ! IS(path, m->source))
+                        m->realsource = Str_dup(path);
+        }
+        return true;
+}
 
+
+static void _index() {
+        mounttable.buckets = 16;
+        while (mounttable.buckets < (unsigned)mounttable.count * 2)
+                mounttable.buckets *= 2;
+        mounttable.bySource = ALLOC(mounttable.buckets * sizeof(int));
+        mounttable.byRealSource = ALLOC(mounttable.buckets * sizeof(int));
+        mounttable.byDevice = ALLOC(mounttable.buckets * sizeof(int));
+        memset(mounttable.bySource, 0xff, mounttable.buckets * sizeof(int));
+        memset(mounttable.byRealSource, 0xff, mounttable.buckets * sizeof(int));
+        memset(mounttable.byDevice, 0xff, mounttable.buckets * sizeof(int));
+        // Insert in reverse order so the first mount of the device is found first, as with a sequential scan
+        for (int i = mounttable.count - 1; i >= 0; i--) {
+                Mount_T *m = &mounttable.mounts[i];
+                unsigned h = _hashString(m->source);
+                m->nextSource = mounttable.bySource[h];
+                mounttable.bySource[h] = i;
+                m->nextRealSource = -1;
+                if (m->realsource) {
+                        h = _hashString(m->realsource);
+                        m->nextRealSource = mounttable.byRealSource[h];
+                        mounttable.byRealSource[h] = i;
+                }
+                h = _hashDevice(m->device);
+                m->nextDevice = mounttable.byDevice[h];
+                mounttable.byDevice[h] = i;
+        }
+}
+
+
+static boolean_t _parse() {
+        _clear();
+        if (! _readData()) {
+                LogError("Cannot read %s -- %s\n", MOUNTINFO, STRERROR);
+                _clear();
+                return false;
+        }
+        int size = 64;
+        mounttable.mounts = ALLOC(size * sizeof(Mount_T));
+        char *save = NULL;
+        for (char *line = strtok_r(mounttable.data, "\n", &save); line; line = strtok_r(NULL, "\n", &save)) {
+                if (mounttable.count == size) {
+                        size *= 2;
+                        RESIZE(mounttable.mounts, size * sizeof(Mount_T));
+                }
+                if (_parseLine(line, &mounttable.mounts[mounttable.count]))
+                        mounttable.count++;
+        }
+        _index();
+        mounttable.valid = true;
+        DEBUG("Mount table loaded: %d filesystems\n", mounttable.count);
+        return true;
+}
+
+
+/* Get the current mount table, it is parsed again only if the kernel reported a change. Returns false if mountinfo is not available */
+static boolean_t _update() {
+        if (mounttable.fd == -1) {
+                if ((mounttable.fd = open(MOUNTINFO, O_RDONLY | O_CLOEXEC)) == -1)
+                        return false;
+        } else if (mounttable.valid) {
+                struct pollfd fds = {.fd = mounttable.fd, .events = POLLPRI};
+                if (poll(&fds, 1, 0) == 0)
+                        return true;
+                DEBUG("Mount table changed\n");
+        }
+        return _parse();
+}
+
+
+static Mount_T *_findBySource(const char *dev) {
+        for (int i = mounttable.bySource[_hashString(dev)]; i != -1; i = mounttable.mounts[i].nextSource)
+                if (IS(mounttable.mounts[i].source, dev))
+                        return &mounttable.mounts[i];
+        for (int i = mounttable.byRealSource[_hashString(dev)]; i != -1; i = mounttable.mounts[i].nextRealSource)
+                if (IS(mounttable.mounts[i].realsource, dev))
+                        return &mounttable.mounts[i];
+        return NULL;
+}
+
+
+static Mount_T *_findByDevice(dev_t device) {
+        for (int i = mounttable.byDevice[_hashDevice(device)]; i != -1; i = mounttable.mounts[i].nextDevice)
+                if (mounttable.mounts[i].device == device)
+                        return &mounttable.mounts[i];
+        return NULL;
+}
+
+
+/* Fallback for systems without mountinfo: scan /etc/mtab */
+static char *_mountpointFromMtab(char *dev, char *buf, int buflen) {
+        FILE *mntfd;
+        struct mntent *mnt;
         if ((mntfd = setmntent("/etc/mtab", "r")) == NULL) {
                 LogError("Cannot open /etc/mtab file\n");
                 return NULL;
@@ -82,12 +344,100 @@ char *device_mountpoint_sysdep(char *dev, char *buf, int buflen) {
 }
 
 
+/* statvfs(2) adapter for IoProbe_run() */
+static int _statvfs(const char *path, void *result) {
+        return statvfs(path, result);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+char *device_mountpoint_sysdep(char *dev, char *buf, int buflen) {
+        ASSERT(dev);
+        char *rv = NULL;
+        boolean_t cached = false;
+        LOCK(mutex)
+        {
+                if ((cached = _update())) {
+                        Mount_T *m = _findBySource(dev);
+                        if (! m) {
+                                // The block device may be mounted under another name, match its device id
+                                struct stat sb;
+                                if (stat(dev, &sb) == 0 && S_ISBLK(sb.st_mode))
+                                        m = _findByDevice(sb.st_rdev);
+                        }
+                        if (m) {
+                                snprintf(buf, buflen, "%s", m->mountpoint);
+                                rv = buf;
+                        } else {
+                                LogError("Device %s not found in %s\n", dev, MOUNTINFO);
+                        }
+                }
+        }
+        END_LOCK;
+        return cached ? rv : _mountpointFromMtab(dev, buf, buflen);
+}
+
+
+char *device_filesystemtype_sysdep(dev_t device, char *buf, int buflen) {
+        char *rv = NULL;
+        LOCK(mutex)
+        {
+                if (_update()) {
+                        Mount_T *m = _findByDevice(device);
+                        if (m) {
+                                snprintf(buf, buflen, "%s", m->type);
+                                rv = buf;
+                        }
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+/* The sector size in /proc/diskstats is always 512 bytes, independently of the device */
+int device_diskstatistics_sysdep(DiskStatistics_T **statistics) {
+        ASSERT(statistics);
+        FILE *f = fopen(DISKSTATS, "r");
+        if (! f) {
+                DEBUG("Cannot open %s -- %s\n", DISKSTATS, STRERROR);
+                return -1;
+        }
+        int count = 0, size = 32;
+        *statistics = ALLOC(size * sizeof(DiskStatistics_T));
+        char line[STRLEN];
+        while (fgets(line, sizeof(line), f)) {
+                unsigned maj, min;
+                unsigned long long reads, readSectors, readTime, writes, writeSectors, writeTime, busyTime;
+                if (sscanf(line, "%u %u %*s %llu %*u %llu %llu %llu %*u %llu %llu %*u %llu", &maj, &min, &reads, &readSectors, &readTime, &writes, &writeSectors, &writeTime, &busyTime) != 9)
+                        continue;
+                if (count == size) {
+                        size *= 2;
+                        RESIZE(*statistics, size * sizeof(DiskStatistics_T));
+                }
+                DiskStatistics_T *d = &(*statistics)[count++];
+                d->device = makedev(maj, min);
+                d->reads = reads;
+                d->readBytes = readSectors * 512ULL;
+                d->readTime = readTime;
+                d->writes = writes;
+                d->writeBytes = writeSectors * 512ULL;
+                d->writeTime = writeTime;
+                d->busyTime = busyTime;
+        }
+        fclose(f);
+        return count;
+}
+
+
 boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf) {
         struct statvfs usage;
 
         ASSERT(inf);
 
-        if (statvfs(mntpoint, &usage) != 0) {
+        if (IoProbe_run(_statvfs, mntpoint, &usage, sizeof(usage)) != 0) {
                 LogError("Error getting usage statistics for filesystem '%s' -- %s\n", mntpoint, STRERROR);
                 return false;
         }
@@ -102,3 +452,44 @@ boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf) {
         return true;
 }
 
+
+/* The generic quota interface covers ext4 and XFS, including the project quotas. The quotactl() device is the mounted source */
+boolean_t filesystem_quota_sysdep(char *mntpoint, dev_t device, QuotaUsage_T *quota, int count) {
+        ASSERT(quota);
+#ifdef HAVE_SYS_QUOTA_H
+        char source[PATH_MAX] = {};
+        LOCK(mutex)
+        {
+                if (_update()) {
+                        Mount_T *m = _findByDevice(device);
+                        if (m)
+                                snprintf(source, sizeof(source), "%s", m->source);
+                }
+        }
+        END_LOCK;
+        if (! *source) {
+                DEBUG("Cannot find the device of filesystem '%s' for the quota lookup\n", mntpoint);
+                return false;
+        }
+        for (int i = 0; i < count; i++) {
+                struct dqblk dqblk = {};
+                int type = quota[i].type == Quota_Project ? PRJQUOTA : quota[i].type == Quota_Group ? GRPQUOTA : USRQUOTA;
+                if (quotactl(QCMD(Q_GETQUOTA, type), source, quota[i].id, (caddr_t)&dqblk) != 0) {
+                        DEBUG("Cannot read the %s quota of id %d on filesystem '%s' -- %s\n", quotatypenames[quota[i].type], quota[i].id, mntpoint, STRERROR);
+                        quota[i].found = false;
+                        continue;
+                }
+                quota[i].found = true;
+                quota[i].space = dqblk.dqb_curspace;
+                quota[i].spaceSoft = dqblk.dqb_bsoftlimit * QUOTABLOCKSIZE;
+                quota[i].spaceHard = dqblk.dqb_bhardlimit * QUOTABLOCKSIZE;
+                quota[i].inodes = dqblk.dqb_curinodes;
+                quota[i].inodeSoft = dqblk.dqb_isoftlimit;
+                quota[i].inodeHard = dqblk.dqb_ihardlimit;
+        }
+        return true;
+#else
+        return false;
+#endif
+}
+
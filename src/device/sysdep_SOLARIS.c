@@ -56,6 +56,13 @@
 
 #include "monit.h"
 #include "device_sysdep.h"
+#include "ioprobe.h"
+
+
+/* statvfs(2) adapter for IoProbe_run() */
+static int _statvfs(const char *path, void *result) {
+        return statvfs(path, result);
+}
 
 
 char *device_mountpoint_sysdep(char *dev, char *buf, int buflen) {
@@ -86,7 +93,7 @@ boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf) {
 
         ASSERT(inf);
 
-        if (statvfs(mntpoint, &usage) != 0) {
+        if (IoProbe_run(_statvfs, mntpoint, &usage, sizeof(usage)) != 0) {
                 LogError("Error getting usage statistics for filesystem '%s' -- %s\n", mntpoint, STRERROR);
                 return false;
         }
@@ -102,3 +109,18 @@ boolean_t filesystem_usage_sysdep(char *mntpoint, Info_T inf) {
         return true;
 }
 
+
+char *device_filesystemtype_sysdep(dev_t device, char *buf, int buflen) {
+        return NULL; // Not implemented, the caller falls back to the path
+}
+
+
+int device_diskstatistics_sysdep(DiskStatistics_T **statistics) {
+        return -1; // Not implemented, the disk I/O tests are skipped
+}
+
+
+boolean_t filesystem_quota_sysdep(char *mntpoint, dev_t device, QuotaUsage_T *quota, int count) {
+        return false; // Not implemented, the quota tests are skipped
+}
+
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include "monit.h"
+#include "dirscan.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+/* A full rescan is done every DIRSCAN_RESCAN scans in the incremental mode */
+#define DIRSCAN_RESCAN 10
+
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+
+/* The cached directory: identity, the totals of its own files and the subdirectories sorted by name */
+typedef struct DirScanNode_T {
+        char *name;
+        dev_t device;
+        ino_t inode;
+        unsigned long long mtime;
+        unsigned long long ctime;
+        long long size;
+        long long files;
+        time_t oldest;
+        time_t newest;
+        int count;
+        struct DirScanNode_T *children;
+} *DirScanNode_T;
+
+
+typedef struct Totals_T {
+        long long size;
+        long long files;
+        long long directories;
+        time_t oldest;
+        time_t newest;
+} Totals_T;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _freeNode(DirScanNode_T node) {
+        for (int i = 0; i < node->count; i++)
+                _freeNode(&node->children[i]);
+        FREE(node->children);
+        FREE(node->name);
+}
+
+
+static int _compareNode(const void *a, const void *b) {
+        return strcmp(((const struct DirScanNode_T *)a)->name, ((const struct DirScanNode_T *)b)->name);
+}
+
+
+static void _addTime(time_t *oldest, time_t *newest, time_t t) {
+        if (! *oldest || t < *oldest)
+                *oldest = t;
+        if (! *newest || t > *newest)
+                *newest = t;
+}
+
+
+/* Find the cached subdirectory with the given name and inode to reuse its subtree */
+static DirScanNode_T _findChild(DirScanNode_T node, const char *name, ino_t inode) {
+        if (node->count) {
+                struct DirScanNode_T key = {.name = (char *)name};
+                DirScanNode_T child = bsearch(&key, node->children, node->count, sizeof(struct DirScanNode_T), _compareNode);
+                if (child && child->inode == inode)
+                        return child;
+        }
+        return NULL;
+}
+
+
+/**
+ * Scan the directory open as fd (the descriptor is consumed) at the given
+ * level. The node holds the cached state of the directory from the previous
+ * scan (zeroed if unknown) and is updated. If reuse is true, the cached
+ * totals of an unchanged directory are used.
+ */
+static void _scan(DirScan_T scan, int fd, const char *path, DirScanNode_T node, int level, boolean_t reuse, Totals_T *totals) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                DEBUG("Directory scan: cannot stat %s -- %s\n", path, STRERROR);
+                close(fd);
+                return;
+        }
+        unsigned long long mtime, ctime;
+        file_getStatTimes(&st, &mtime, &ctime);
+        boolean_t descend = scan->depth == 0 || level < scan->depth;
+        if (reuse && (descend || ! node->count) && node->inode == st.st_ino && node->device == st.st_dev && node->mtime == mtime && node->ctime == ctime) {
+                // The directory entries didn't change, visit only the subdirectories
+                totals->size += node->size;
+                totals->files += node->files;
+                if (node->files)
+                        _addTime(&totals->oldest, &totals->newest, node->oldest), _addTime(&totals->oldest, &totals->newest, node->newest);
+                for (int i = 0; i < node->count; i++) {
+                        totals->directories++;
+                        int child = openat(fd, node->children[i].name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                        if (child != -1)
+                                _scan(scan, child, node->children[i].name, &node->children[i], level + 1, true, totals);
+                }
+                close(fd);
+                return;
+        }
+        DIR *dir = fdopendir(fd);
+        if (! dir) {
+                DEBUG("Directory scan: cannot read %s -- %s\n", path, STRERROR);
+                close(fd);
+                return;
+        }
+        struct DirScanNode_T previous = *node;
+        node->device = st.st_dev;
+        node->inode = st.st_ino;
+        node->mtime = mtime;
+        node->ctime = ctime;
+        node->size = node->files = 0LL;
+        node->oldest = node->newest = 0;
+        node->count = 0;
+        node->children = NULL;
+        int size = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+                if (entry->d_name[0] == '.' && (entry->d_name[1] == 0 || (entry->d_name[1] == '.' && entry->d_name[2] == 0)))
+                        continue;
+                struct stat est;
+                if (fstatat(dirfd(dir), entry->d_name, &est, AT_SYMLINK_NOFOLLOW) != 0)
+                        continue; // The entry was removed meanwhile
+                if (S_ISDIR(est.st_mode)) {
+                        if (! descend || est.st_dev != st.st_dev)
+                                continue;
+                        if (node->count == size) {
+                                size = size ? size * 2 : 8;
+                                RESIZE(node->children, size * sizeof(struct DirScanNode_T));
+                        }
+                        DirScanNode_T child = &node->children[node->count++];
+                        DirScanNode_T cached = _findChild(&previous, entry->d_name, est.st_ino);
+                        if (cached) {
+                                *child = *cached;
+                                cached->name = NULL; // Ownership of the subtree moved to the new node
+                                cached->children = NULL;
+                                cached->count = 0;
+                        } else {
+                                memset(child, 0, sizeof(*child));
+                                child->name = Str_dup(entry->d_name);
+                        }
+                } else {
+                        node->files++;
+                        if (S_ISREG(est.st_mode))
+                                node->size += est.st_size;
+                        _addTime(&node->oldest, &node->newest, est.st_mtime);
+                }
+        }
+        if (node->count)
+                qsort(node->children, node->count, sizeof(struct DirScanNode_T), _compareNode);
+        // Free the subtrees of the subdirectories which were removed
+        for (int i = 0; i < previous.count; i++)
+                if (previous.children[i].name)
+                        _freeNode(&previous.children[i]);
+        FREE(previous.children);
+        totals->size += node->size;
+        totals->files += node->files;
+        if (node->files)
+                _addTime(&totals->oldest, &totals->newest, node->oldest), _addTime(&totals->oldest, &totals->newest, node->newest);
+        for (int i = 0; i < node->count; i++) {
+                totals->directories++;
+                int child = openat(dirfd(dir), node->children[i].name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (child != -1)
+                        _scan(scan, child, node->children[i].name, &node->children[i], level + 1, reuse, totals);
+        }
+        closedir(dir);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t DirScan_scan(Service_T s) {
+        ASSERT(s);
+        ASSERT(s->dirscan);
+        DirScan_T scan = s->dirscan;
+        int fd = open(s->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) {
+                LogError("'%s' cannot open directory %s -- %s\n", s->name, s->path, STRERROR);
+                return false;
+        }
+        if (! scan->root) {
+                NEW(scan->root);
+                scan->root->name = Str_dup(s->path);
+        }
+        boolean_t reuse = scan->incremental && scan->scans++ % DIRSCAN_RESCAN != 0;
+        char buf[10];
+        Totals_T totals = {};
+        _scan(scan, fd, s->path, scan->root, 1, reuse, &totals);
+        s->inf->priv.directory.tree.size = totals.size;
+        s->inf->priv.directory.tree.files = totals.files;
+        s->inf->priv.directory.tree.directories = totals.directories;
+        s->inf->priv.directory.tree.oldest = totals.oldest;
+        s->inf->priv.directory.tree.newest = totals.newest;
+        DEBUG("'%s' directory scan%s: %lld files, %lld directories, %s total\n", s->name, reuse ? " (incremental)" : "", totals.files, totals.directories, Str_bytesToSize(totals.size, buf));
+        return true;
+}
+
+
+void DirScan_free(DirScan_T *scan) {
+        ASSERT(scan);
+        if ((*scan)->root) {
+                _freeNode((*scan)->root);
+                FREE((*scan)->root);
+        }
+        FREE(*scan);
+}
+
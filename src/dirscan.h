@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_DIRSCAN_H
+#define MONIT_DIRSCAN_H
+
+
+/**
+ * Recursive directory scanner. The directory tree of a directory service
+ * is walked with openat(2) and fstatat(2) and the total size, number of
+ * files and the modification time of the oldest and newest file are
+ * stored in the service's directory info. Symbolic links are not followed
+ * and directories on other filesystems are not descended into.
+ *
+ * In the incremental mode, the scanner keeps the tree of directories and
+ * the totals of the files in each directory. A directory whose modification
+ * and change time didn't change since the last scan has the same entries,
+ * so its files are not read again, only its subdirectories are visited.
+ * Changes of existing files without a rename (such as append) are picked up
+ * by the full rescan which runs every DIRSCAN_RESCAN scans.
+ *
+ * @file
+ */
+
+
+/**
+ * Scan the directory tree of the service and update its directory info
+ * @param s A directory service with the scan settings
+ * @return true if the directory was scanned, otherwise false
+ */
+boolean_t DirScan_scan(Service_T s);
+
+
+/**
+ * Free the scan settings and the cached directory tree
+ * @param scan The scan object
+ */
+void DirScan_free(DirScan_T *scan);
+
+
+#endif
+
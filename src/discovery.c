@@ -0,0 +1,342 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include "monit.h"
+#include "discovery.h"
+#include "snapshot.h"
+#include "statussegment.h"
+
+// libmonit
+#include "util/HashMap.h"
+
+
+/**
+ *  Service discovery from a directory of service files.
+ *
+ *  The directory is scanned before each cycle, a file is changed if its
+ *  inode, size or modification time differs. The files should be replaced
+ *  atomically (written under a hidden name and renamed), the hidden files
+ *  and the backup copies ending with '~' are skipped.
+ *
+ *  The removed services are unlinked from the service list, the index and
+ *  the groups, but they are freed by the next update only: the heartbeat
+ *  and statsd listeners look up the services without a lock and may still
+ *  hold a removed one for a moment.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct DiscoveryFile_T {
+        char *path;
+        unsigned long long inode;
+        unsigned long long size;
+        unsigned long long mtime;                          /**< Modification time [ns] */
+        int scan;                                  /**< The last scan which found the file */
+        boolean_t changed;         /**< The file changed since its services were added */
+        boolean_t removed;                        /**< The services are being removed */
+        int count;
+        char **services;                             /**< Names of the file's services */
+} *DiscoveryFile_T;
+
+
+static struct {
+        HashMap_T files;                                      /**< DiscoveryFile_T by path */
+        HashMap_T services;                           /**< DiscoveryFile_T by service name */
+        int scan;                                                    /**< The scan number */
+        boolean_t pending;                             /**< Some file changed or was removed */
+        char *anchor;         /**< The last control file service in the check order list */
+        char *anchorConf;           /**< The last control file service in the config order */
+        Service_T retired;             /**< The removed services, chained by the next link */
+} _discovery = {};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _freeFile(DiscoveryFile_T *f) {
+        for (int i = 0; i < (*f)->count; i++)
+                FREE((*f)->services[i]);
+        FREE((*f)->services);
+        FREE((*f)->path);
+        FREE(*f);
+}
+
+
+static void _freeRetired(void) {
+        while (_discovery.retired) {
+                Service_T s = _discovery.retired;
+                _discovery.retired = s->next;
+                gc_service(&s);
+        }
+}
+
+
+/**
+ * Unlink the services of the removed files from the discovered part of the
+ * service lists (after the anchor), the index and the groups
+ * @return The number of removed services
+ */
+static int _unlink(boolean_t live) {
+        int count = 0;
+        for (Service_T *s = &Util_getService(_discovery.anchor)->next; *s;) {
+                DiscoveryFile_T f = HashMap_get(_discovery.services, (*s)->name);
+                if (f && f->removed) {
+                        Service_T r = *s;
+                        *s = r->next;
+                        Util_unindexService(r);
+                        Util_ungroupService(r);
+                        if (live)
+                                Snapshot_remove(r);
+                        r->next = _discovery.retired;
+                        _discovery.retired = r;
+                        count++;
+                } else {
+                        s = &(*s)->next;
+                }
+        }
+        for (Service_T *s = &Util_getService(_discovery.anchorConf)->next_conf; *s;) {
+                DiscoveryFile_T f = HashMap_get(_discovery.services, (*s)->name);
+                if (f && f->removed)
+                        *s = (*s)->next_conf;
+                else
+                        s = &(*s)->next_conf;
+        }
+        return count;
+}
+
+
+/**
+ * Parse the file and append its services to the service lists
+ * @return The number of added services
+ */
+static int _add(DiscoveryFile_T f, boolean_t live) {
+        Service_T services;
+        if (! parse_discovered(f->path, &services)) {
+                LogError("Discovery file '%s' skipped -- parsing error\n", f->path);
+                return 0;
+        }
+        if (! services)
+                return 0;
+        Service_T last = Util_getService(_discovery.anchor);
+        while (last->next)
+                last = last->next;
+        last->next = services;
+        // The services of the file are chained by the next_conf link in the same order
+        Service_T lastConf = Util_getService(_discovery.anchorConf);
+        while (lastConf->next_conf)
+                lastConf = lastConf->next_conf;
+        lastConf->next_conf = services;
+        for (Service_T s = services; s; s = s->next) {
+                RESIZE(f->services, (f->count + 1) * sizeof(char *));
+                f->services[f->count] = Str_dup(s->name);
+                HashMap_put(_discovery.services, f->services[f->count++], f);
+                Util_indexService(s);
+                if (live)
+                        Snapshot_publish(s);
+        }
+        return f->count;
+}
+
+
+/**
+ * Remove the services of the changed and removed files, then add the
+ * services of the changed files
+ */
+static void _update(boolean_t live) {
+        // The services removed by the previous update are not held by the listeners anymore
+        _freeRetired();
+        // Remove first, a service may move to another file
+        int removed = 0, added = 0;
+        for (int h = HashMap_next(_discovery.files, -1); h >= 0; h = HashMap_next(_discovery.files, h)) {
+                DiscoveryFile_T f = HashMap_value(_discovery.files, h);
+                f->removed = f->count && (f->changed || f->scan != _discovery.scan);
+                if (f->removed)
+                        removed++;
+        }
+        if (removed) {
+                removed = _unlink(live);
+                for (int h = HashMap_next(_discovery.files, -1); h >= 0; h = HashMap_next(_discovery.files, h)) {
+                        DiscoveryFile_T f = HashMap_value(_discovery.files, h);
+                        if (f->removed) {
+                                for (int i = 0; i < f->count; i++) {
+                                        HashMap_remove(_discovery.services, f->services[i]);
+                                        FREE(f->services[i]);
+                                }
+                                f->count = 0;
+                                f->removed = false;
+                        }
+                }
+        }
+        List_T gone = List_new();
+        for (int h = HashMap_next(_discovery.files, -1); h >= 0; h = HashMap_next(_discovery.files, h)) {
+                DiscoveryFile_T f = HashMap_value(_discovery.files, h);
+                if (f->scan != _discovery.scan) {
+                        List_append(gone, f);
+                } else if (f->changed) {
+                        f->changed = false;
+                        added += _add(f, live);
+                }
+        }
+        while (List_length(gone) > 0) {
+                DiscoveryFile_T f = List_pop(gone);
+                HashMap_remove(_discovery.files, f->path);
+                _freeFile(&f);
+        }
+        List_free(&gone);
+        _discovery.pending = false;
+        if (added || removed)
+                LogInfo("Service discovery: %d services added, %d services removed\n", added, removed);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Discovery_load(void) {
+        Discovery_stop();
+        if (! Run.discovery.directory || ! servicelist)
+                return;
+        _discovery.files = HashMap_new(64, Str_cmp, Str_hash);
+        _discovery.services = HashMap_new(64, Str_cmp, Str_hash);
+        Service_T last = servicelist;
+        while (last->next)
+                last = last->next;
+        _discovery.anchor = Str_dup(last->name);
+        last = servicelist_conf;
+        while (last->next_conf)
+                last = last->next_conf;
+        _discovery.anchorConf = Str_dup(last->name);
+        if (Discovery_scan())
+                _update(false);
+}
+
+
+boolean_t Discovery_scan(void) {
+        if (! _discovery.files)
+                return false;
+        DIR *dir = opendir(Run.discovery.directory);
+        if (! dir) {
+                // Keep the services, the directory may be replaced
+                DEBUG("Cannot read the discovery directory '%s' -- %s\n", Run.discovery.directory, STRERROR);
+                return _discovery.pending;
+        }
+        _discovery.scan++;
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+                size_t length = strlen(entry->d_name);
+                if (*entry->d_name == '.' || entry->d_name[length - 1] == '~')
+                        continue;
+                char path[PATH_MAX];
+                if (snprintf(path, sizeof(path), "%s/%s", Run.discovery.directory, entry->d_name) >= (int)sizeof(path))
+                        continue;
+                struct stat st;
+                if (stat(path, &st) != 0 || ! S_ISREG(st.st_mode))
+                        continue;
+                unsigned long long mtime, ctime;
+                file_getStatTimes(&st, &mtime, &ctime);
+                DiscoveryFile_T f = HashMap_get(_discovery.files, path);
+                if (! f) {
+                        NEW(f);
+                        f->path = Str_dup(path);
+                        f->changed = true;
+                        HashMap_put(_discovery.files, f->path, f);
+                } else if (f->inode != (unsigned long long)st.st_ino || f->size != (unsigned long long)st.st_size || f->mtime != mtime) {
+                        f->changed = true;
+                }
+                f->inode = st.st_ino;
+                f->size = st.st_size;
+                f->mtime = mtime;
+                f->scan = _discovery.scan;
+                if (f->changed)
+                        _discovery.pending = true;
+        }
+        closedir(dir);
+        if (! _discovery.pending)
+                for (int h = HashMap_next(_discovery.files, -1); h >= 0 && ! _discovery.pending; h = HashMap_next(_discovery.files, h))
+                        _discovery.pending = ((DiscoveryFile_T)HashMap_value(_discovery.files, h))->scan != _discovery.scan;
+        return _discovery.pending;
+}
+
+
+void Discovery_apply(void) {
+        if (! _discovery.pending)
+                return;
+        _update(true);
+        StatusSegment_open();
+}
+
+
+boolean_t Discovery_isDiscovered(const char *name) {
+        ASSERT(name);
+        return _discovery.services && HashMap_get(_discovery.services, name);
+}
+
+
+void Discovery_stop(void) {
+        _freeRetired();
+        if (_discovery.files) {
+                for (int h = HashMap_next(_discovery.files, -1); h >= 0; h = HashMap_next(_discovery.files, h)) {
+                        DiscoveryFile_T f = HashMap_value(_discovery.files, h);
+                        _freeFile(&f);
+                }
+                HashMap_free(&_discovery.files);
+                HashMap_free(&_discovery.services);
+        }
+        FREE(_discovery.anchor);
+        FREE(_discovery.anchorConf);
+        _discovery.pending = false;
+}
+
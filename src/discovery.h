@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_DISCOVERY_H
+#define MONIT_DISCOVERY_H
+
+
+/**
+ * Service discovery. With 'set discovery directory' the daemon adds and
+ * removes services at runtime from the files in the directory, without a
+ * reload. Each file holds check statements, which can use the templates
+ * of the control file; the services of a file are added when the file
+ * appears, replaced when it changes and removed when it is deleted. The
+ * files are written by the container or unit manager hooks, for example
+ * the ExecStartPost and ExecStopPost commands of a systemd unit or a
+ * "docker events" handler.
+ *
+ * Only the services of the changed files are parsed and linked into the
+ * service list and the service index, the services of the control file are
+ * not touched. The discovered services follow the control file services in
+ * the service list, they may depend on the control file services and on the
+ * services of the same file. A reload reads all discovery files again, the
+ * unchanged services keep their runtime data like the control file ones.
+ *
+ * @file
+ */
+
+
+/**
+ * Forget the known files and add the services of all discovery files to
+ * the service list. Called after the control file was parsed, before the
+ * state is restored and the service list is shared with other threads.
+ */
+void Discovery_load(void);
+
+
+/**
+ * Look for added, changed and removed discovery files
+ * @return true if some file changed and Discovery_apply() is due
+ */
+boolean_t Discovery_scan(void);
+
+
+/**
+ * Add and remove the services of the files which changed since the last
+ * update. Called between the cycles while the http requests are suspended.
+ */
+void Discovery_apply(void);
+
+
+/**
+ * Test if the service was added from a discovery file
+ * @param name A service name
+ * @return true if the service was discovered, otherwise false
+ */
+boolean_t Discovery_isDiscovered(const char *name);
+
+
+/**
+ * Forget the known files and free the removed services. The discovered
+ * services which are in the service list are freed with the list.
+ */
+void Discovery_stop(void);
+
+
+#endif
+
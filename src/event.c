@@ -24,6 +24,18 @@
 
 #include "config.h"
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -53,6 +65,10 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_DIRENT_H
 #include <dirent.h>
 #endif
@@ -62,10 +78,16 @@
 #include "event.h"
 #include "ProcessTree.h"
 #include "MMonit.h"
+#include "delivery.h"
+#include "history.h"
+#include "probes.h"
+#include "counter.h"
 
 // libmonit
 #include "io/File.h"
 #include "system/Time.h"
+#include "exceptions/AssertException.h"
+#include "thread/Thread.h"
 
 /**
  * Implementation of the event interface.
@@ -112,6 +134,135 @@ EventTable_T Event_Table[] = {
 };
 
 
+#define QUEUE_SEGMENT_SIZE 1048576       /**< Start a new segment when the last one is larger */
+#define QUEUE_RECORD_MAX   1048576                   /**< Maximum record payload size */
+#define QUEUE_MAGIC        0x4d514931                  /**< Index file format identifier */
+#define QUEUE_INDEX        "index"                             /**< Index file name */
+#define QUEUE_SUFFIX       ".queue"                       /**< Segment file name suffix */
+#define QUEUE_FORMAT       1                        /**< Record payload encoding version */
+#define QUEUE_OVERHEAD     512     /**< Maximum payload size without the service name and message */
+
+
+/* Position of a record in the queue: the segment number and the offset of the record in the segment */
+typedef struct QueuePosition_T {
+        uint32_t segment;
+        uint32_t offset;
+} QueuePosition_T;
+
+
+/* Record header, followed by the payload */
+typedef struct QueueRecord_T {
+        uint32_t size;                                          /**< Payload size */
+        uint32_t crc;                                          /**< Payload CRC-32 */
+} QueueRecord_T;
+
+
+/*
+ * Record payload fields. The payload starts with the QUEUE_FORMAT varint,
+ * followed by fields. Each field starts with a varint tag, which is the field
+ * number shifted left by one bit, with the lowest bit set to the QueueWire_Type.
+ * A number field follows with a zigzag encoded varint, a string field with a
+ * varint length and the bytes. Numbers which are zero are not written. Fields
+ * unknown to the reader are skipped, so new fields may be added without the
+ * format version change. Do not renumber the fields.
+ */
+typedef enum {
+        QueueField_Id = 1,
+        QueueField_Collected,
+        QueueField_CollectedUsec,
+        QueueField_Mode,
+        QueueField_ServiceType,
+        QueueField_State,
+        QueueField_StateChanged,
+        QueueField_Flag,
+        QueueField_StateMap,
+        QueueField_Count,
+        QueueField_Action,
+        QueueField_ServiceId,
+        QueueField_ServiceName,
+        QueueField_Message
+} QueueField_Type;
+
+
+typedef enum {
+        QueueWire_Number = 0,
+        QueueWire_String
+} QueueWire_Type;
+
+
+/* Service names interned in a segment: the name is stored only in the first record of the segment which refers to the service, the following records refer to the name by its index */
+typedef struct QueueNames_T {
+        int count;                                     /**< Number of names */
+        int size;                         /**< Allocated names and hash slots */
+        char **names;                                    /**< Names by index */
+        int *slots;   /**< Name hash table, index + 1 or 0 if empty (writer only) */
+} QueueNames_T;
+
+
+/* Decoded record payload */
+typedef struct QueueEvent_T {
+        Action_Type action;
+        struct myevent event;           /**< Event fields, without the source */
+        const char *source;    /**< The service name or NULL if not resolved */
+        char *message;                  /**< The event message, must be freed */
+} QueueEvent_T;
+
+
+/* Index file, each cursor points to the first record which the handler didn't deliver yet */
+typedef struct QueueIndex_T {
+        uint32_t magic;
+        QueuePosition_T cursor[Handler_Max + 1];
+        uint32_t crc;
+} QueueIndex_T;
+
+
+typedef enum {
+        Queue_Record = 0,
+        Queue_End,
+        Queue_Truncated,
+        Queue_Corrupted
+} Queue_Status;
+
+
+static Handler_Type handlers[] = {Handler_Alert, Handler_Mmonit};
+
+
+/* Copy of a queued event in the M/Monit batch */
+typedef struct QueueBatchEvent_T {
+        struct myevent event;
+        struct myaction action;
+        struct myeventaction eventaction;
+        QueuePosition_T position;                        /**< Position of the record */
+} QueueBatchEvent_T;
+
+
+/* Queued events collected for one M/Monit message, see "set mmonit batch". The M/Monit cursor stays at the first batched record until the batch was sent */
+typedef struct QueueBatch_T {
+        int size;                                      /**< Maximum events per message */
+        int count;
+        QueuePosition_T next;                   /**< Position behind the last batched record */
+        QueueBatchEvent_T *events;
+} QueueBatch_T;
+
+
+/* The event queue is a log of records appended to numbered segment files. Delivered records are not rewritten, the handler's cursor is moved forward instead and the segments behind all cursors are removed */
+static struct {
+        char *dir;                                  /**< Directory the queue was opened in */
+        uint32_t first;                                            /**< Oldest segment */
+        uint32_t last;                                   /**< Segment which is appended to */
+        uint32_t size;                                     /**< Size of the last segment */
+        int count;                             /**< Number of records with pending handlers */
+        long long bytes;                                 /**< Total size of the segments */
+        uint32_t crc[256];                                            /**< CRC-32 table */
+        QueuePosition_T cursor[Handler_Max + 1];                        /**< Handler cursors */
+        QueueNames_T names;                     /**< Service names in the last segment */
+        uint32_t interned;           /**< The segment the names belong to, UINT32_MAX if none */
+} queue;
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -152,128 +303,905 @@ static boolean_t _checkState(Event_T E, State_Type S) {
 }
 
 
+static uint32_t _crc32(const void *data, size_t size) {
+        uint32_t crc = 0xffffffff;
+        for (const unsigned char *p = data; size--; p++)
+                crc = queue.crc[(crc ^ *p) & 0xff] ^ (crc >> 8);
+        return crc ^ 0xffffffff;
+}
+
+
+static int _queueCompare(QueuePosition_T a, QueuePosition_T b) {
+        if (a.segment != b.segment)
+                return a.segment < b.segment ? -1 : 1;
+        return a.offset < b.offset ? -1 : a.offset > b.offset;
+}
+
+
 /**
- * Add the partialy handled event to the global queue
- * @param E An event object
+ * Return the position of the oldest record which wasn't delivered by all handlers
  */
-static void _queueAdd(Event_T E) {
-        ASSERT(E);
-        ASSERT(E->flag != Handler_Succeeded);
+static QueuePosition_T _queueMinimum() {
+        QueuePosition_T position = queue.cursor[handlers[0]];
+        for (int i = 1; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++)
+                if (_queueCompare(queue.cursor[handlers[i]], position) < 0)
+                        position = queue.cursor[handlers[i]];
+        return position;
+}
 
-        if (! file_checkQueueDirectory(Run.eventlist_dir)) {
-                LogError("Aborting event - cannot access the directory %s\n", Run.eventlist_dir);
-                return;
+
+/**
+ * Return the handlers which didn't deliver the record at the given position yet
+ */
+static Handler_Type _queuePending(QueueEvent_T *record, QueuePosition_T position) {
+        Handler_Type pending = Handler_Succeeded;
+        for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++)
+                if ((record->event.flag & handlers[i]) && _queueCompare(queue.cursor[handlers[i]], position) <= 0)
+                        pending |= handlers[i];
+        return pending;
+}
+
+
+static void _queuePath(char *path, int size, uint32_t segment) {
+        snprintf(path, size, "%s/%010u%s", queue.dir, segment, QUEUE_SUFFIX);
+}
+
+
+static boolean_t _queueSegment(const char *name, uint32_t *segment) {
+        int length = 0;
+        return sscanf(name, "%10u%n", segment, &length) == 1 && IS(name + length, QUEUE_SUFFIX);
+}
+
+
+static unsigned char *_queuePutVarint(unsigned char *p, uint64_t value) {
+        while (value >= 0x80) {
+                *p++ = (unsigned char)(value | 0x80);
+                value >>= 7;
+        }
+        *p++ = (unsigned char)value;
+        return p;
+}
+
+
+static boolean_t _queueGetVarint(const unsigned char **p, const unsigned char *end, uint64_t *value) {
+        *value = 0;
+        for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+                unsigned char c = *(*p)++;
+                *value |= (uint64_t)(c & 0x7f) << shift;
+                if (! (c & 0x80))
+                        return true;
+        }
+        return false;
+}
+
+
+static unsigned char *_queuePutNumber(unsigned char *p, QueueField_Type field, long long value) {
+        uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        if (! zigzag)
+                return p;
+        p = _queuePutVarint(p, (uint64_t)field << 1 | QueueWire_Number);
+        return _queuePutVarint(p, zigzag);
+}
+
+
+static unsigned char *_queuePutString(unsigned char *p, QueueField_Type field, const char *value, size_t length) {
+        p = _queuePutVarint(p, (uint64_t)field << 1 | QueueWire_String);
+        p = _queuePutVarint(p, length);
+        memcpy(p, value, length);
+        return p + length;
+}
+
+
+static char *_queueString(const unsigned char *value, size_t length) {
+        char *s = ALLOC(length + 1);
+        memcpy(s, value, length);
+        s[length] = 0;
+        return s;
+}
+
+
+static void _queueNamesReset(QueueNames_T *names) {
+        for (int i = 0; i < names->count; i++)
+                FREE(names->names[i]);
+        FREE(names->names);
+        FREE(names->slots);
+        names->count = names->size = 0;
+}
+
+
+/**
+ * Set the name with the given index, used by the reader
+ */
+static void _queueNamesSet(QueueNames_T *names, int id, const unsigned char *name, size_t length) {
+        if (id >= names->size) {
+                int size = names->size ? names->size : 64;
+                while (size <= id)
+                        size *= 2;
+                RESIZE(names->names, size * sizeof(char *));
+                memset(names->names + names->size, 0, (size - names->size) * sizeof(char *));
+                names->size = size;
+        }
+        FREE(names->names[id]);
+        names->names[id] = _queueString(name, length);
+        if (id >= names->count)
+                names->count = id + 1;
+}
+
+
+/**
+ * Get the index of the name, add the name if it wasn't interned yet, used by the writer
+ * @return true if the name was added
+ */
+static boolean_t _queueNamesIntern(QueueNames_T *names, const char *name, int *id) {
+        if (names->size) {
+                for (unsigned int i = Str_hash(name) & (names->size - 1); names->slots[i]; i = (i + 1) & (names->size - 1)) {
+                        if (IS(names->names[names->slots[i] - 1], name)) {
+                                *id = names->slots[i] - 1;
+                                return false;
+                        }
+                }
+        }
+        // Keep the load factor below 1/2
+        if (2 * (names->count + 1) > names->size) {
+                names->size = names->size ? names->size * 2 : 64;
+                RESIZE(names->names, names->size * sizeof(char *));
+                FREE(names->slots);
+                names->slots = CALLOC(names->size, sizeof(int));
+                for (int k = 0; k < names->count; k++) {
+                        unsigned int i = Str_hash(names->names[k]) & (names->size - 1);
+                        while (names->slots[i])
+                                i = (i + 1) & (names->size - 1);
+                        names->slots[i] = k + 1;
+                }
+        }
+        unsigned int i = Str_hash(name) & (names->size - 1);
+        while (names->slots[i])
+                i = (i + 1) & (names->size - 1);
+        names->names[names->count] = Str_dup(name);
+        names->slots[i] = names->count + 1;
+        *id = names->count++;
+        return true;
+}
+
+
+/**
+ * Decode the record payload
+ * @param payload The record payload
+ * @param size The payload size
+ * @param names The service names of the segment to resolve the source and
+ * the message, or NULL to decode the event fields only (the source and the
+ * message are not set then)
+ * @param record The decoded record, zeroed if the payload is invalid
+ * @return true if the payload is valid, otherwise false
+ */
+static boolean_t _queueDecode(const unsigned char *payload, uint32_t size, QueueNames_T *names, QueueEvent_T *record) {
+        const unsigned char *p = payload, *end = payload + size, *name = NULL;
+        uint64_t format, nameLength = 0;
+        long long id = 0;
+        memset(record, 0, sizeof(*record));
+        if (! _queueGetVarint(&p, end, &format) || format != QUEUE_FORMAT)
+                return false;
+        while (p < end) {
+                uint64_t tag, value;
+                if (! _queueGetVarint(&p, end, &tag) || ! _queueGetVarint(&p, end, &value))
+                        goto invalid;
+                if ((tag & 1) == QueueWire_String) {
+                        if (value > (uint64_t)(end - p))
+                                goto invalid;
+                        if ((tag >> 1) == QueueField_ServiceName) {
+                                name = p;
+                                nameLength = value;
+                        } else if ((tag >> 1) == QueueField_Message && names) {
+                                FREE(record->message);
+                                record->message = _queueString(p, value);
+                        }
+                        p += value;
+                } else {
+                        long long number = (long long)(value >> 1) ^ -(long long)(value & 1);
+                        switch (tag >> 1) {
+                                case QueueField_Id:
+                                        record->event.id = (long)number;
+                                        break;
+                                case QueueField_Collected:
+                                        record->event.collected.tv_sec = (time_t)number;
+                                        break;
+                                case QueueField_CollectedUsec:
+                                        record->event.collected.tv_usec = (suseconds_t)number;
+                                        break;
+                                case QueueField_Mode:
+                                        record->event.mode = (Monitor_Mode)number;
+                                        break;
+                                case QueueField_ServiceType:
+                                        record->event.type = (Service_Type)number;
+                                        break;
+                                case QueueField_State:
+                                        record->event.state = (State_Type)number;
+                                        break;
+                                case QueueField_StateChanged:
+                                        record->event.state_changed = number ? true : false;
+                                        break;
+                                case QueueField_Flag:
+                                        record->event.flag = (Handler_Type)number;
+                                        break;
+                                case QueueField_StateMap:
+                                        record->event.state_map = number;
+                                        break;
+                                case QueueField_Count:
+                                        record->event.count = (unsigned int)number;
+                                        break;
+                                case QueueField_Action:
+                                        record->action = (Action_Type)number;
+                                        break;
+                                case QueueField_ServiceId:
+                                        id = number;
+                                        break;
+                                default:
+                                        // Field added by a newer Monit version
+                                        break;
+                        }
+                }
+        }
+        if (id < 0 || id > QUEUE_RECORD_MAX)
+                goto invalid;
+        if (names) {
+                if (name)
+                        _queueNamesSet(names, (int)id, name, nameLength);
+                if (id < names->count)
+                        record->source = names->names[id];
+                if (! record->message)
+                        record->message = Str_dup("");
         }
+        return true;
+invalid:
+        FREE(record->message);
+        memset(record, 0, sizeof(*record));
+        return false;
+}
+
 
-        if (! file_checkQueueLimit(Run.eventlist_dir, Run.eventlist_slots)) {
-                LogError("Aborting event - queue over quota\n");
+/**
+ * Read the next record from the segment file
+ * @param file A segment file
+ * @param payload Set to the allocated record payload
+ * @param size Set to the payload size
+ * @return Queue_Record if the record was read, otherwise the reason why not
+ */
+static Queue_Status _queueRead(FILE *file, char **payload, uint32_t *size) {
+        QueueRecord_T record;
+        size_t n = fread(&record, 1, sizeof(record), file);
+        if (n != sizeof(record))
+                return n || ferror(file) ? Queue_Truncated : Queue_End;
+        if (! record.size || record.size > QUEUE_RECORD_MAX)
+                return Queue_Corrupted;
+        *payload = ALLOC(record.size);
+        if (fread(*payload, 1, record.size, file) != record.size) {
+                FREE(*payload);
+                return Queue_Truncated;
+        }
+        if (_crc32(*payload, record.size) != record.crc) {
+                FREE(*payload);
+                return Queue_Corrupted;
+        }
+        *size = record.size;
+        return Queue_Record;
+}
+
+
+/**
+ * Position the segment file at the given offset. The records before the offset
+ * are read to collect the service names interned in the segment.
+ * @return true if the file was positioned, otherwise false
+ */
+static boolean_t _queueSeek(FILE *file, uint32_t offset, QueueNames_T *names) {
+        for (uint32_t position = 0; position < offset;) {
+                char *payload;
+                uint32_t size;
+                if (_queueRead(file, &payload, &size) != Queue_Record)
+                        break;
+                QueueEvent_T record;
+                _queueDecode((unsigned char *)payload, size, names, &record);
+                FREE(record.message);
+                FREE(payload);
+                position += sizeof(QueueRecord_T) + size;
+        }
+        return fseek(file, offset, SEEK_SET) == 0;
+}
+
+
+static void _queueSave() {
+        QueueIndex_T index = {.magic = QUEUE_MAGIC};
+        memcpy(index.cursor, queue.cursor, sizeof(index.cursor));
+        index.crc = _crc32(&index, sizeof(index) - sizeof(index.crc));
+        char path[PATH_MAX], temp[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", queue.dir, QUEUE_INDEX);
+        snprintf(temp, sizeof(temp), "%s/%s.tmp", queue.dir, QUEUE_INDEX);
+        int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) {
+                LogError("Cannot write the event queue index %s -- %s\n", temp, STRERROR);
                 return;
         }
+        boolean_t rv = write(fd, &index, sizeof(index)) == sizeof(index);
+        if (close(fd) || ! rv || rename(temp, path)) {
+                LogError("Cannot write the event queue index %s -- %s\n", path, STRERROR);
+                unlink(temp);
+        }
+}
 
-        /* compose the file name of actual timestamp and service name */
-        char file_name[PATH_MAX];
-        snprintf(file_name, PATH_MAX, "%s/%lld_%lx", Run.eventlist_dir, (long long)Time_now(), (long unsigned)E->source->name);
 
-        LogInfo("Adding event to the queue file %s for later delivery\n", file_name);
+/**
+ * Append the event to the last segment
+ * @param E An event object
+ * @param source The name of the service the event belongs to
+ * @param action The event action
+ * @return true if the event was queued, otherwise false
+ */
+static boolean_t _queueAppend(Event_T E, const char *source, Action_Type action) {
+        size_t sourceLength = strlen(source);
+        size_t messageLength = E->message ? strlen(E->message) : 0;
+        if (QUEUE_OVERHEAD + sourceLength + messageLength > QUEUE_RECORD_MAX) {
+                LogError("Aborting event - the event is too large\n");
+                return false;
+        }
+        /* The interned names are known for the segment which was appended to since the queue was opened only, start a new segment otherwise */
+        if (queue.size >= QUEUE_SEGMENT_SIZE || (queue.size && queue.interned != queue.last)) {
+                queue.last++;
+                queue.size = 0;
+        }
+        if (queue.interned != queue.last) {
+                _queueNamesReset(&queue.names);
+                queue.interned = queue.last;
+        }
+        int id;
+        boolean_t interned = _queueNamesIntern(&queue.names, source, &id);
+
+        unsigned char *data = ALLOC(sizeof(QueueRecord_T) + QUEUE_OVERHEAD + sourceLength + messageLength);
+        unsigned char *payload = data + sizeof(QueueRecord_T);
+        unsigned char *p = _queuePutVarint(payload, QUEUE_FORMAT);
+        p = _queuePutNumber(p, QueueField_Id, E->id);
+        p = _queuePutNumber(p, QueueField_Collected, E->collected.tv_sec);
+        p = _queuePutNumber(p, QueueField_CollectedUsec, E->collected.tv_usec);
+        p = _queuePutNumber(p, QueueField_Mode, E->mode);
+        p = _queuePutNumber(p, QueueField_ServiceType, E->type);
+        p = _queuePutNumber(p, QueueField_State, E->state);
+        p = _queuePutNumber(p, QueueField_StateChanged, E->state_changed);
+        p = _queuePutNumber(p, QueueField_Flag, E->flag);
+        p = _queuePutNumber(p, QueueField_StateMap, E->state_map);
+        p = _queuePutNumber(p, QueueField_Count, E->count);
+        p = _queuePutNumber(p, QueueField_Action, action);
+        p = _queuePutNumber(p, QueueField_ServiceId, id);
+        if (interned)
+                p = _queuePutString(p, QueueField_ServiceName, source, sourceLength);
+        if (messageLength)
+                p = _queuePutString(p, QueueField_Message, E->message, messageLength);
+        uint32_t size = (uint32_t)(p - payload);
+        QueueRecord_T *record = (QueueRecord_T *)data;
+        record->size = size;
+        record->crc = _crc32(payload, size);
+
+        char path[PATH_MAX];
+        _queuePath(path, sizeof(path), queue.last);
+        LogInfo("Adding event to the queue segment %s for later delivery\n", path);
+
+        boolean_t rv = false;
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0600);
+        if (fd < 0) {
+                LogError("Aborting event - cannot open the event queue segment %s -- %s\n", path, STRERROR);
+                queue.interned = UINT32_MAX;
+        } else {
+                struct stat st;
+                if (fstat(fd, &st) == 0)
+                        queue.size = (uint32_t)st.st_size;
+                ssize_t n = write(fd, data, sizeof(QueueRecord_T) + size);
+                if (n == (ssize_t)(sizeof(QueueRecord_T) + size)) {
+                        queue.size += n;
+                        queue.bytes += n;
+                        Counter_add(Counter_QueueWrites, 1);
+                        rv = true;
+                } else {
+                        LogError("Aborting event - unable to save event information to %s -- %s\n", path, n < 0 ? STRERROR : "short write");
+                        /* The name interned by this record was not written, continue in a new segment */
+                        queue.interned = UINT32_MAX;
+                        if (ftruncate(fd, queue.size))
+                                LogError("Cannot truncate the event queue segment %s -- %s\n", path, STRERROR);
+                }
+                close(fd);
+        }
+        FREE(data);
+        if (rv && E->flag != Handler_Succeeded) {
+                queue.count++;
+                for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++)
+                        if (E->flag & handlers[i])
+                                Run.handler_queue[handlers[i]]++;
+        }
+        return rv;
+}
 
-        FILE *file = fopen(file_name, "w");
+
+/**
+ * Convert the event file written by the previous Monit versions, which used
+ * one file per event, to a queue record and remove the file
+ * @param path The event file path
+ */
+static void _queueImport(const char *path) {
+        FILE *file = fopen(path, "r");
         if (! file) {
-                LogError("Aborting event - cannot open the event file %s -- %s\n", file_name, STRERROR);
+                LogError("Cannot open the event file %s -- %s\n", path, STRERROR);
                 return;
         }
+        boolean_t rv = false;
+        size_t size;
+        int *version = file_readQueue(file, &size);
+        if (! version || size != sizeof(int) || *version != EVENT_VERSION) {
+                DEBUG("Skipping file %s - not an event queue data format\n", path);
+                goto error1;
+        }
+        Event_T e = file_readQueue(file, &size);
+        if (! e)
+                goto error1;
+        if (size != sizeof(*e))
+                goto error2;
+        char *service = file_readQueue(file, &size);
+        if (! service)
+                goto error2;
+        service[size - 1] = 0;
+        if (! (e->message = file_readQueue(file, &size)))
+                goto error3;
+        e->message[size - 1] = 0;
+        Action_Type *action = file_readQueue(file, &size);
+        if (action && size == sizeof(Action_Type))
+                rv = _queueAppend(e, service, *action);
+        FREE(action);
+        FREE(e->message);
+error3:
+        FREE(service);
+error2:
+        FREE(e);
+        if (rv) {
+                DEBUG("Moved queued event %s to the event queue\n", path);
+                if (unlink(path) < 0)
+                        LogError("Failed to remove queued event file '%s' -- %s\n", path, STRERROR);
+        } else {
+                LogError("Cannot move queued event %s to the event queue\n", path);
+        }
+error1:
+        FREE(version);
+        fclose(file);
+}
 
-        boolean_t rv;
 
-        /* write event structure version */
-        int version = EVENT_VERSION;
-        if (! (rv = file_writeQueue(file, &version, sizeof(int))))
-                goto error;
+/**
+ * Count the records with pending handlers and truncate the record which was
+ * written partially at the end of the last segment (for example on crash)
+ */
+static void _queueScan() {
+        queue.count = 0;
+        memset(Run.handler_queue, 0, sizeof(Run.handler_queue));
+        for (QueuePosition_T position = _queueMinimum(); position.segment <= queue.last; position.segment++, position.offset = 0) {
+                char path[PATH_MAX];
+                _queuePath(path, sizeof(path), position.segment);
+                FILE *file = fopen(path, "r+");
+                if (! file) {
+                        if (errno != ENOENT)
+                                LogError("Cannot open the event queue segment %s -- %s\n", path, STRERROR);
+                        continue;
+                }
+                Queue_Status status = Queue_End;
+                if (fseek(file, position.offset, SEEK_SET) == 0) {
+                        char *payload;
+                        uint32_t size;
+                        while ((status = _queueRead(file, &payload, &size)) == Queue_Record) {
+                                QueueEvent_T record;
+                                _queueDecode((unsigned char *)payload, size, NULL, &record);
+                                Handler_Type pending = _queuePending(&record, position);
+                                if (pending != Handler_Succeeded) {
+                                        queue.count++;
+                                        for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++)
+                                                if (pending & handlers[i])
+                                                        Run.handler_queue[handlers[i]]++;
+                                }
+                                position.offset += sizeof(QueueRecord_T) + size;
+                                FREE(payload);
+                        }
+                }
+                if (position.segment == queue.last) {
+                        if (status != Queue_End) {
+                                LogError("Event queue segment %s is %s at offset %u, discarding the rest of the segment\n", path, status == Queue_Truncated ? "truncated" : "corrupted", position.offset);
+                                struct stat st;
+                                if (fstat(fileno(file), &st) == 0 && st.st_size > position.offset)
+                                        queue.bytes -= st.st_size - position.offset;
+                                if (ftruncate(fileno(file), position.offset))
+                                        LogError("Cannot truncate the event queue segment %s -- %s\n", path, STRERROR);
+                        }
+                        queue.size = position.offset;
+                } else if (status != Queue_End) {
+                        LogError("Event queue segment %s is %s at offset %u, skipping the rest of the segment\n", path, status == Queue_Truncated ? "truncated" : "corrupted", position.offset);
+                }
+                fclose(file);
+        }
+}
+
 
-        /* write event structure */
-        if (! (rv = file_writeQueue(file, E, sizeof(*E))))
-                goto error;
+/**
+ * Open the queue in the event queue directory, if it wasn't open already.
+ * The handler cursors are read from the index, the queued events are counted
+ * and event files from the previous Monit versions are added to the queue.
+ * @return true if the queue is open, otherwise false
+ */
+static boolean_t _queueOpen() {
+        if (queue.dir) {
+                if (IS(queue.dir, Run.eventlist_dir))
+                        return true;
+                FREE(queue.dir);
+        }
+        if (! file_checkQueueDirectory(Run.eventlist_dir))
+                return false;
+        DIR *dir = opendir(Run.eventlist_dir);
+        if (! dir) {
+                LogError("Cannot open the directory %s -- %s\n", Run.eventlist_dir, STRERROR);
+                return false;
+        }
+        queue.dir = Str_dup(Run.eventlist_dir);
+        _queueNamesReset(&queue.names);
+        queue.interned = UINT32_MAX;
+        for (uint32_t i = 0; i < 256; i++) {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+                queue.crc[i] = c;
+        }
 
-        /* write source */
-        if (! (rv = file_writeQueue(file, E->source->name, strlen(E->source->name) + 1)))
-                goto error;
+        /* find the oldest and the last segment */
+        boolean_t found = false;
+        uint32_t segment;
+        char path[PATH_MAX];
+        queue.first = UINT32_MAX;
+        queue.last = queue.size = 0;
+        queue.bytes = 0;
+        struct dirent *de;
+        while ((de = readdir(dir))) {
+                if (_queueSegment(de->d_name, &segment)) {
+                        struct stat st;
+                        snprintf(path, sizeof(path), "%s/%s", queue.dir, de->d_name);
+                        if (stat(path, &st) == 0)
+                                queue.bytes += st.st_size;
+                        found = true;
+                        if (segment < queue.first)
+                                queue.first = segment;
+                        if (segment > queue.last)
+                                queue.last = segment;
+                }
+        }
 
-        /* write message */
-        if (! (rv = file_writeQueue(file, E->message, E->message ? strlen(E->message) + 1 : 0)))
-                goto error;
+        /* read the handler cursors */
+        QueueIndex_T index;
+        boolean_t indexed = false;
+        snprintf(path, sizeof(path), "%s/%s", queue.dir, QUEUE_INDEX);
+        FILE *file = fopen(path, "r");
+        if (file) {
+                indexed = fread(&index, 1, sizeof(index), file) == sizeof(index) && index.magic == QUEUE_MAGIC && index.crc == _crc32(&index, sizeof(index) - sizeof(index.crc));
+                fclose(file);
+                if (! indexed)
+                        LogError("Event queue index %s is invalid, queued events will be delivered again\n", path);
+        }
+        if (! found)
+                queue.first = 0;
+        for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++) {
+                QueuePosition_T *cursor = &queue.cursor[handlers[i]];
+                *cursor = indexed ? index.cursor[handlers[i]] : (QueuePosition_T){queue.first, 0};
+                if (cursor->segment < queue.first)
+                        *cursor = (QueuePosition_T){queue.first, 0};
+                if (cursor->segment > queue.last)
+                        queue.last = cursor->segment;
+        }
+        if (! found)
+                queue.first = queue.last;
 
-        /* write event action */
-        Action_Type action = Event_get_action(E);
-        if (! (rv = file_writeQueue(file, &action, sizeof(Action_Type))))
-                goto error;
+        _queueScan();
 
-error:
-        fclose(file);
-        if (! rv) {
-                LogError("Aborting event - unable to save event information to %s\n",  file_name);
-                if (unlink(file_name) < 0)
-                        LogError("Failed to remove event file '%s' -- %s\n", file_name, STRERROR);
+        /* convert the event files from the previous Monit versions */
+        rewinddir(dir);
+        while ((de = readdir(dir))) {
+                snprintf(path, sizeof(path), "%s/%s", queue.dir, de->d_name);
+                if (! _queueSegment(de->d_name, &segment) && ! Str_startsWith(de->d_name, QUEUE_INDEX) && File_isFile(path))
+                        _queueImport(path);
+        }
+        closedir(dir);
+        DEBUG("Event queue %s opened: segments %u-%u, %d queued events\n", queue.dir, queue.first, queue.last, queue.count);
+        return true;
+}
+
+
+/**
+ * Remove the segments which were delivered by all handlers. If no event is
+ * pending, all segments are removed and the queue continues in a new segment.
+ * @param changed true if the handler cursors were moved
+ */
+static void _queueCompact(boolean_t changed) {
+        QueuePosition_T minimum = _queueMinimum();
+        if (! queue.count && (queue.size || queue.first != queue.last || _queueCompare(minimum, (QueuePosition_T){queue.last, 0}))) {
+                minimum = (QueuePosition_T){++queue.last, 0};
+                queue.size = 0;
+                for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++)
+                        queue.cursor[handlers[i]] = minimum;
+                changed = true;
+        }
+        for (; queue.first < minimum.segment; queue.first++) {
+                char path[PATH_MAX];
+                _queuePath(path, sizeof(path), queue.first);
+                DEBUG("Removing event queue segment %s\n", path);
+                struct stat st;
+                if (stat(path, &st) == 0)
+                        queue.bytes -= st.st_size;
+                if (unlink(path) < 0 && errno != ENOENT)
+                        LogError("Failed to remove event queue segment '%s' -- %s\n", path, STRERROR);
+        }
+        if (changed)
+                _queueSave();
+}
+
+
+/**
+ * Convert the decoded record to the event
+ * @param record The decoded record
+ * @param e The event object to fill
+ * @param a The action object to use for the event
+ * @param ea The event action object to use for the event
+ * @return true if the record contains valid event, otherwise false
+ */
+static boolean_t _queueEvent(QueueEvent_T *record, Event_T e, Action_T a, EventAction_T ea) {
+        if (! record->source) {
+                LogError("Aborting queued event - unknown service\n");
+                return false;
+        }
+        *e = record->event;
+        if (! (e->source = Util_getService(record->source))) {
+                LogError("Aborting queued event - service %s not found in monitor configuration\n", record->source);
+                return false;
+        }
+        e->message = record->message;
+        a->id = record->action;
+        switch (e->state) {
+                case State_Succeeded:
+                case State_ChangedNot:
+                        ea->succeeded = a;
+                        break;
+                case State_Failed:
+                case State_Changed:
+                case State_Init:
+                        ea->failed = a;
+                        break;
+                default:
+                        LogError("Aborting queued event -- invalid state: %d\n", e->state);
+                        return false;
+        }
+        e->action = ea;
+        return true;
+}
+
+
+/**
+ * Add the queued event to the M/Monit batch
+ */
+static void _queueBatchAdd(QueueBatch_T *batch, Event_T E, QueuePosition_T position, QueuePosition_T next) {
+        QueueBatchEvent_T *b = &batch->events[batch->count++];
+        b->event = *E;
+        b->event.message = Str_dup(E->message);
+        b->action = E->action->failed ? *E->action->failed : *E->action->succeeded;
+        b->eventaction = (struct myeventaction){};
+        if (E->state == State_Succeeded || E->state == State_ChangedNot)
+                b->eventaction.succeeded = &b->action;
+        else
+                b->eventaction.failed = &b->action;
+        b->event.action = &b->eventaction;
+        b->position = position;
+        batch->next = next;
+}
+
+
+/**
+ * Send the batched events to M/Monit in one message. If the message was
+ * delivered, the M/Monit cursor is moved behind the batched records.
+ * @return true if the cursor was moved
+ */
+static boolean_t _queueBatchFlush(QueueBatch_T *batch) {
+        if (! batch->count)
+                return false;
+        Event_T *events = CALLOC(batch->count, sizeof(Event_T));
+        for (int i = 0; i < batch->count; i++)
+                events[i] = &batch->events[i].event;
+        boolean_t sent = MMonit_sendEvents(events, batch->count) == Handler_Succeeded;
+        if (sent) {
+                queue.cursor[Handler_Mmonit] = batch->next;
+                LOCK(mutex)
+                {
+                        for (int i = 0; i < batch->count; i++) {
+                                QueueEvent_T record = {.event.flag = batch->events[i].event.flag};
+                                Run.handler_queue[Handler_Mmonit]--;
+                                if (_queuePending(&record, batch->events[i].position) == Handler_Succeeded)
+                                        queue.count--;
+                        }
+                }
+                END_LOCK;
+                DEBUG("M/Monit: %d queued events delivered\n", batch->count);
         } else {
-                if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Alert)
-                        Run.handler_queue[Handler_Alert]++;
-                if (! (Run.flags & Run_HandlerInit) && E->flag & Handler_Mmonit)
-                        Run.handler_queue[Handler_Mmonit]++;
+                LogError("M/Monit handler failed, retry scheduled for next cycle\n");
+                Run.handler_flag |= Handler_Mmonit;
         }
+        for (int i = 0; i < batch->count; i++)
+                FREE(batch->events[i].event.message);
+        batch->count = 0;
+        FREE(events);
+        return sent;
 }
 
 
 /**
- * Update the partialy handled event in the global queue
- * @param E An event object
- * @param file_name File name
+ * Retry the pending handlers of the queued event at the given position. The
+ * cursor of each handler which delivered the event or doesn't need it is moved
+ * to the next record. A handler which failed keeps its cursor at the event.
+ * The M/Monit events are collected in the batch if batching is enabled.
+ * @return true if some cursor was moved
  */
-static void _queueUpdate(Event_T E, const char *file_name) {
-        int version = EVENT_VERSION;
-        Action_Type action = Event_get_action(E);
-        boolean_t rv;
+static boolean_t _queueDeliver(QueueEvent_T *record, QueuePosition_T position, QueuePosition_T next, Action_T a, EventAction_T ea, QueueBatch_T *batch) {
+        boolean_t moved = false;
+        Handler_Type pending = _queuePending(record, position), delivered = Handler_Succeeded;
+        struct myevent event;
+        int valid = -1;
+        boolean_t batched = false;
+        for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++) {
+                Handler_Type handler = handlers[i];
+                boolean_t batching = handler == Handler_Mmonit && batch->count;
+                if (_queueCompare(batching ? batch->next : queue.cursor[handler], position))
+                        continue;
+                if (record->event.flag & handler) {
+                        if (Run.handler_flag & handler)
+                                continue;
+                        if (valid < 0 && (valid = _queueEvent(record, &event, a, ea)))
+                                LogInfo("Processing queued event of service %s\n", event.source->name);
+                        if (valid && handler == Handler_Mmonit && batch->size > 1) {
+                                _queueBatchAdd(batch, &event, position, next);
+                                batched = true;
+                                if (batch->count == batch->size && _queueBatchFlush(batch))
+                                        moved = true;
+                                continue;
+                        }
+                        if (batching) {
+                                // Send the batch before the cursor moves over the invalid record
+                                if (_queueBatchFlush(batch))
+                                        moved = true;
+                                batching = false;
+                                if (Run.handler_flag & handler)
+                                        continue;
+                        }
+                        if (valid) {
+                                if ((handler == Handler_Alert ? handle_alert(&event) : MMonit_send(&event)) == handler) {
+                                        LogError("%s handler failed, retry scheduled for next cycle\n", handler == Handler_Alert ? "Alert" : "M/Monit");
+                                        Run.handler_flag |= handler;
+                                        continue;
+                                }
+                        }
+                        delivered |= handler;
+                }
+                if (batching) {
+                        batch->next = next;
+                        continue;
+                }
+                queue.cursor[handler] = next;
+                moved = true;
+        }
+        if (delivered != Handler_Succeeded || pending != Handler_Succeeded) {
+                LOCK(mutex)
+                {
+                        for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++)
+                                if (delivered & handlers[i])
+                                        Run.handler_queue[handlers[i]]--;
+                        // The batched record is counted when the batch is sent
+                        if (pending != Handler_Succeeded && ! batched && _queuePending(record, position) == Handler_Succeeded)
+                                queue.count--;
+                }
+                END_LOCK;
+        }
+        return moved;
+}
+
 
+/**
+ * Add the partialy handled event to the global queue
+ * @param E An event object
+ */
+static void _queueAdd(Event_T E) {
         ASSERT(E);
         ASSERT(E->flag != Handler_Succeeded);
 
-        if (! file_checkQueueDirectory(Run.eventlist_dir)) {
-                LogError("Aborting event - cannot access the directory %s\n", Run.eventlist_dir);
-                return;
+        LOCK(mutex)
+        {
+                if (! _queueOpen())
+                        LogError("Aborting event - cannot access the directory %s\n", Run.eventlist_dir);
+                else if (Run.eventlist_slots >= 0 && queue.count >= Run.eventlist_slots)
+                        LogError("Aborting event - queue over quota\n");
+                else
+                        _queueAppend(E, E->source->name, Event_get_action(E));
         }
+        END_LOCK;
+}
 
-        DEBUG("Updating event in the queue file %s for later delivery\n", file_name);
 
-        FILE *file = fopen(file_name, "w");
-        if (! file) {
-                LogError("Aborting event - cannot open the event file %s -- %s\n", file_name, STRERROR);
-                return;
+/**
+ * Returns true if the automatic start or restart of the service is deferred
+ * by the restart backoff (see set restart backoff)
+ */
+static boolean_t _isBackoff(Service_T S) {
+        if (Run.restartBackoff.delay && S->backoff.deferred) {
+                long long remaining = S->backoff.deferred - Time_monotonic();
+                if (remaining > 0) {
+                        DEBUG("'%s' restart deferred for %s -- restart backoff after %d restarts in a row\n", S->name, Str_milliToTime(remaining, (char[23]){}), S->backoff.failures + 1);
+                        return true;
+                }
         }
+        return false;
+}
 
-        /* write event structure version */
-        if (! (rv = file_writeQueue(file, &version, sizeof(int))))
-                goto error;
-
-        /* write event structure */
-        if (! (rv = file_writeQueue(file, E, sizeof(*E))))
-                goto error;
-
-        /* write source */
-        if (! (rv = file_writeQueue(file, E->source->name, strlen(E->source->name) + 1)))
-                goto error;
 
-        /* write message */
-        if (! (rv = file_writeQueue(file, E->message, E->message ? strlen(E->message) + 1 : 0)))
-                goto error;
+/**
+ * Record the automatic start or restart of the service. The service which
+ * needs another restart before it stayed up for the backoff limit is counted
+ * as failing in a row, the next restart is deferred by the backoff delay,
+ * which doubles with each restart in a row up to the limit. Up to a quarter
+ * of the delay is random, so the services which failed together don't
+ * restart at the same time again.
+ */
+static void _backoff(Service_T S) {
+        if (! Run.restartBackoff.delay)
+                return;
+        long long now = Time_monotonic();
+        long long limit = Run.restartBackoff.limit * 1000LL;
+        if (S->backoff.restarted && now - S->backoff.restarted < limit) {
+                S->backoff.failures++;
+                long long delay = MIN(limit, Run.restartBackoff.delay * 1000LL << MIN(S->backoff.failures - 1, 20));
+                delay -= random() % (delay / 4 + 1);
+                S->backoff.deferred = now + delay;
+                if (S->backoff.failures == RESTART_CRASHLOOP)
+                        LogWarning("'%s' crash loop detected -- restarted %d times in a row, the next restarts are deferred up to %s\n", S->name, S->backoff.failures + 1, Str_milliToTime(limit, (char[23]){}));
+        } else {
+                if (S->backoff.failures >= RESTART_CRASHLOOP)
+                        LogInfo("'%s' crash loop ended\n", S->name);
+                S->backoff.failures = 0;
+                S->backoff.deferred = 0;
+        }
+        S->backoff.restarted = now;
+}
 
-        /* write event action */
-        if (! (rv = file_writeQueue(file, &action, sizeof(Action_Type))))
-                goto error;
 
-error:
-        fclose(file);
-        if (! rv) {
-                LogError("Aborting event - unable to update event information to %s\n", file_name);
-                if (unlink(file_name) < 0)
-                        LogError("Failed to remove event file '%s' -- %s\n", file_name, STRERROR);
+/**
+ * Returns true if the automatic start or restart of the service is deferred
+ * by the restart limit of the startup ramp (see set startup ramp). The service
+ * remains failed, so the action is retried after its next check.
+ */
+static boolean_t _isRamped(Service_T S) {
+        static struct {
+                long long start;
+                int count;
+        } slot = {};
+        static Mutex_T mutex = PTHREAD_MUTEX_INITIALIZER;
+        boolean_t rv = false;
+        long long now = Time_milli();
+        if (! Run.startupRamp.end || now >= Run.startupRamp.end)
+                return false;
+        LOCK(mutex)
+        {
+                if (now - slot.start >= Run.startupRamp.interval * 1000LL) {
+                        slot.start = now;
+                        slot.count = 0;
+                }
+                if (slot.count < Run.startupRamp.restarts)
+                        slot.count++;
+                else
+                        rv = true;
         }
+        END_LOCK;
+        if (rv)
+                LogInfo("'%s' restart deferred by the startup ramp -- %d restarts per %s at most\n", S->name, Run.startupRamp.restarts, Str_milliToTime(Run.startupRamp.interval * 1000LL, (char[23]){}));
+        return rv;
 }
 
 
@@ -284,15 +1212,13 @@ static void _handleAction(Event_T E, Action_T A) {
         E->flag = Handler_Succeeded;
 
         if (A->id != Action_Ignored) {
-                /* Alert and mmonit event notification are common actions */
-                E->flag |= MMonit_send(E);
-                E->flag |= handle_alert(E);
-                /* In the case that some subhandler failed, enqueue the event for partial reprocessing */
-                if (E->flag != Handler_Succeeded) {
-                        if (Run.eventlist_dir)
-                                _queueAdd(E);
-                        else
-                                LogError("Aborting event\n");
+                /* Alert and mmonit event notification are common actions, delivered in background if enabled */
+                if (! Delivery_post(E)) {
+                        E->flag |= MMonit_send(E);
+                        E->flag |= handle_alert(E);
+                        /* In the case that some subhandler failed, enqueue the event for partial reprocessing */
+                        if (E->flag != Handler_Succeeded)
+                                Event_queue_add(E);
                 }
                 /* Action event is handled already. For Instance events we don't want actions like stop to be executed to prevent the disabling of system service monitoring */
                 if (A->id == Action_Alert || E->id == Event_Instance) {
@@ -304,26 +1230,70 @@ static void _handleAction(Event_T E, Action_T A) {
                                 return;
                         }
                 } else {
+                        if ((A->id == Action_Start || A->id == Action_Restart) && E->source->mode != Monitor_Passive && (_isBackoff(E->source) || _isRamped(E->source)))
+                                return;
                         if (E->source->actionratelist && (A->id == Action_Start || A->id == Action_Restart))
                                 E->source->nstart++;
                         if (E->source->mode == Monitor_Passive && (A->id == Action_Start || A->id == Action_Stop  || A->id == Action_Restart))
                                 return;
+                        if (A->id == Action_Start || A->id == Action_Restart)
+                                _backoff(E->source);
                         control_service(E->source->name, A->id);
                 }
         }
 }
 
 
+/**
+ * We will handle only first succeeded event, recurrent succeeded events
+ * or insufficient succeeded events during failed service state are
+ * ignored. Failed events are handled each time.
+ * @param E An event object
+ * @return true if the event is ignored, otherwise false
+ */
+static boolean_t _isIgnored(Event_T E) {
+        return ! E->state_changed && (E->state == State_Succeeded || E->state == State_ChangedNot || ((E->state_map & 0x1) ^ 0x1));
+}
+
+
+/**
+ * The worst response time of the tests which generated the event for the structured log
+ * @return The response time [ms] or -1 if not available
+ */
+static double _latency(Service_T S, Event_T E) {
+        double latency = -1.;
+        if (E->id == Event_Connection) {
+                for (Port_T p = S->portlist; p; p = p->next)
+                        latency = p->response > latency ? p->response : latency;
+                for (Port_T p = S->socketlist; p; p = p->next)
+                        latency = p->response > latency ? p->response : latency;
+        } else if (E->id == Event_Icmp) {
+                for (Icmp_T i = S->icmplist; i; i = i->next)
+                        latency = i->response > latency ? i->response : latency;
+        }
+        return latency;
+}
+
+
+/**
+ * Log the event message with the service, event, state and latency fields
+ */
+static void _logEvent(Service_T S, Event_T E, int priority) {
+        static const char *states[] = {"succeeded", "failed", "changed", "changed not", "init"};
+        double latency = _latency(S, E);
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.3f", latency);
+        LogStructured(priority, (const char *[]){"service", S->name, "event", Event_get_description(E), "state", E->state <= State_Init ? states[E->state] : NULL, "latency", latency >= 0. ? buf : NULL, NULL}, "'%s' %s\n", S->name, E->message);
+}
+
+
 static void _handleEvent(Service_T S, Event_T E) {
         ASSERT(E);
         ASSERT(E->action);
         ASSERT(E->action->failed);
         ASSERT(E->action->succeeded);
 
-        /* We will handle only first succeeded event, recurrent succeeded events
-         * or insufficient succeeded events during failed service state are
-         * ignored. Failed events are handled each time. */
-        if (! E->state_changed && (E->state == State_Succeeded || E->state == State_ChangedNot || ((E->state_map & 0x1) ^ 0x1))) {
+        if (_isIgnored(E)) {
                 DEBUG("'%s' %s\n", S->name, E->message);
                 return;
         }
@@ -334,10 +1304,11 @@ static void _handleEvent(Service_T S, Event_T E) {
                  * logged. Instance and action events are logged always with priority
                  * info. */
                 if (E->state != State_Init || E->state_map & 0x1) {
+                        History_add(S, E);
                         if (E->state == State_Succeeded || E->state == State_ChangedNot || E->id == Event_Instance || E->id == Event_Action)
-                                LogInfo("'%s' %s\n", S->name, E->message);
+                                _logEvent(S, E, LOG_INFO);
                         else
-                                LogError("'%s' %s\n", S->name, E->message);
+                                _logEvent(S, E, LOG_ERR);
                 }
                 if (E->state == State_Init)
                         return;
@@ -379,33 +1350,40 @@ void Event_post(Service_T service, long id, State_Type state, EventAction_T acti
         ASSERT(action);
         ASSERT(s);
         ASSERT(state == State_Failed || state == State_Succeeded || state == State_Changed || state == State_ChangedNot);
+        PROBE3(event_post, service->name, id, state);
+        Counter_add(Counter_Events, 1);
 
         va_list ap;
         va_start(ap, s);
-        char *message = Str_vcat(s, ap);
-        va_end(ap);
 
-        Event_T e = service->eventlist;
-        while (e) {
-                if (e->action == action && e->id == id) {
-                        gettimeofday(&e->collected, NULL);
+        service->generation++;
 
-                        /* Shift the existing event flags to the left and set the first bit based on actual state */
-                        e->state_map <<= 1;
-                        e->state_map |= ((state == State_Succeeded || state == State_ChangedNot) ? 0 : 1);
-
-                        /* Update the message */
-                        FREE(e->message);
-                        e->message = message;
-                        break;
-                }
-                e = e->next;
+        /* Each action gets a slot in the service's event table on the first post. An action posted with different event ids (such as the link or upload tests) finds its other events in the event list */
+        if (! action->slot) {
+                action->slot = ++service->eventtable.size;
+                RESIZE(service->eventtable.events, service->eventtable.size * sizeof(Event_T));
+                service->eventtable.events[action->slot - 1] = NULL;
         }
-        if (! e) {
+        ASSERT(action->slot <= service->eventtable.size);
+        Event_T e = service->eventtable.events[action->slot - 1];
+        if (e && e->id != id)
+                for (e = service->eventlist; e && ! (e->action == action && e->id == id); e = e->next)
+                        ;
+        if (e) {
+                gettimeofday(&e->collected, NULL);
+
+                /* Shift the existing event flags to the left and set the first bit based on actual state */
+                e->state_map <<= 1;
+                e->state_map |= ((state == State_Succeeded || state == State_ChangedNot) ? 0 : 1);
+        } else {
                 /* Only first failed/changed event can initialize the queue for given event type, thus succeeded events are ignored until first error. */
                 if (state == State_Succeeded || state == State_ChangedNot) {
-                        DEBUG("'%s' %s\n", service->name, message);
-                        FREE(message);
+                        if (Run.debug) {
+                                char *message = Str_vcat(s, ap);
+                                DEBUG("'%s' %s\n", service->name, message);
+                                FREE(message);
+                        }
+                        va_end(ap);
                         return;
                 }
                 /* Initialize the event. The mandatory informations are cloned so the event is as standalone as possible and may be saved
@@ -419,9 +1397,10 @@ void Event_post(Service_T service, long id, State_Type state, EventAction_T acti
                 e->state = State_Init;
                 e->state_map = 1;
                 e->action = action;
-                e->message = message;
                 e->next = service->eventlist;
                 service->eventlist = e;
+                if (! service->eventtable.events[action->slot - 1])
+                        service->eventtable.events[action->slot - 1] = e;
         }
         e->state_changed = _checkState(e, state);
         /* In the case that the state changed, update it and reset the counter */
@@ -431,10 +1410,36 @@ void Event_post(Service_T service, long id, State_Type state, EventAction_T acti
         } else {
                 e->count++;
         }
+        /* The message is formatted only if the event will be handled or logged, the message of an ignored event is not used */
+        if (Run.debug || ! _isIgnored(e)) {
+                FREE(e->message);
+                e->message = Str_vcat(s, ap);
+        }
+        va_end(ap);
         _handleEvent(service, e);
 }
 
 
+/**
+ * Check if an event was posted for the action
+ * @param service The Service the event belongs to
+ * @param id The event identification
+ * @param action Description of the event action
+ * @return true if the event exists, otherwise false
+ */
+boolean_t Event_isPosted(Service_T service, long id, EventAction_T action) {
+        ASSERT(service);
+        ASSERT(action);
+        if (! action->slot)
+                return false;
+        Event_T e = service->eventtable.events[action->slot - 1];
+        if (e && e->id != id)
+                for (e = service->eventlist; e && ! (e->action == action && e->id == id); e = e->next)
+                        ;
+        return e != NULL;
+}
+
+
 /**
  * Get a textual description of actual event type.
  * @param E An event object
@@ -520,16 +1525,23 @@ void Event_queue_process() {
         if (! Run.eventlist_dir || (! (Run.flags & Run_HandlerInit) && ! Run.handler_queue[Handler_Alert] && ! Run.handler_queue[Handler_Mmonit]))
                 return;
 
-        DIR *dir = opendir(Run.eventlist_dir);
-        if (! dir) {
-                if (errno != ENOENT)
-                        LogError("Cannot open the directory %s -- %s\n", Run.eventlist_dir, STRERROR);
-                return;
+        boolean_t open = false;
+        uint32_t last = 0;
+        LOCK(mutex)
+        {
+                /* (Re)open the queue after the configuration was (re)loaded to count the queued events */
+                if (Run.flags & Run_HandlerInit)
+                        FREE(queue.dir);
+                if ((open = _queueOpen()))
+                        last = queue.last;
         }
+        END_LOCK;
+        Run.flags &= ~Run_HandlerInit;
+        if (! open)
+                return;
 
-        struct dirent *de = readdir(dir);
-        if (de)
-                DEBUG("Processing postponed events queue\n");
+        DEBUG("Processing postponed events queue\n");
+        PROBE1(event_queue_start, last);
 
         Action_T a;
         NEW(a);
@@ -537,148 +1549,110 @@ void Event_queue_process() {
         EventAction_T ea;
         NEW(ea);
 
-        while (de) {
-                int handlers_passed = 0;
-
-                /* In the case that all handlers failed, skip the further processing in this cycle. Alert handler is currently defined anytime (either explicitly or localhost by default) */
-                if ( (Run.mmonits && FLAG(Run.handler_flag, Handler_Mmonit) && FLAG(Run.handler_flag, Handler_Alert)) || FLAG(Run.handler_flag, Handler_Alert))
-                        break;
-
-                char file_name[PATH_MAX];
-                snprintf(file_name, sizeof(file_name), "%s/%s", Run.eventlist_dir, de->d_name);
-
-                if (File_isFile(file_name)) {
-                        LogInfo("Processing queued event %s\n", file_name);
-
-                        FILE *file = fopen(file_name, "r");
-                        if (! file) {
-                                LogError("Queued event processing failed - cannot open the file %s -- %s\n", file_name, STRERROR);
-                                goto error1;
-                        }
-
-                        size_t size;
-
-                        /* read event structure version */
-                        int *version = file_readQueue(file, &size);
-                        if (! version) {
-                                DEBUG("Skipping file %s - not an event queue data format\n", file_name);
-                                goto error2;
-                        }
-                        if (size != sizeof(int)) {
-                                LogError("Aborting queued event %s - invalid size %lu\n", file_name, (unsigned long)size);
-                                goto error3;
-                        }
-                        if (*version != EVENT_VERSION) {
-                                LogError("Aborting queued event %s - incompatible data format version %d\n", file_name, *version);
-                                goto error3;
-                        }
-
-                        /* read event structure */
-                        Event_T e = file_readQueue(file, &size);
-                        if (! e)
-                                goto error3;
-                        if (size != sizeof(*e))
-                                goto error4;
-
-                        /* read source */
-                        char *service = file_readQueue(file, &size);
-                        if (! service)
-                                goto error4;
-                        if (! (e->source = Util_getService(service))) {
-                                LogError("Aborting queued event %s - service %s not found in monitor configuration\n", file_name, service);
-                                FREE(service);
-                                goto error4;
-                        }
-                        FREE(service);
-
-                        /* read message */
-                        if (! (e->message = file_readQueue(file, &size)))
-                                goto error4;
-
-                        /* read event action */
-                        Action_Type *action = file_readQueue(file, &size);
-                        if (! action)
-                                goto error5;
-                        if (size != sizeof(Action_Type))
-                                goto error6;
-                        a->id = *action;
-                        switch (e->state) {
-                                case State_Succeeded:
-                                case State_ChangedNot:
-                                        ea->succeeded = a;
-                                        break;
-                                case State_Failed:
-                                case State_Changed:
-                                case State_Init:
-                                        ea->failed = a;
-                                        break;
-                                default:
-                                        LogError("Aborting queue event %s -- invalid state: %d\n", file_name, e->state);
-                                        goto error6;
-                        }
-                        e->action = ea;
-
-                        /* Retry all remaining handlers */
-
-                        /* alert */
-                        if (e->flag & Handler_Alert) {
-                                if (Run.flags & Run_HandlerInit)
-                                        Run.handler_queue[Handler_Alert]++;
-                                if ((Run.handler_flag & Handler_Alert) != Handler_Alert) {
-                                        if ( handle_alert(e) != Handler_Alert ) {
-                                                e->flag &= ~Handler_Alert;
-                                                Run.handler_queue[Handler_Alert]--;
-                                                handlers_passed++;
-                                        } else {
-                                                LogError("Alert handler failed, retry scheduled for next cycle\n");
-                                                Run.handler_flag |= Handler_Alert;
-                                        }
+        QueueBatch_T batch = {.size = Run.mmonits && Run.mmonitBatch.size > 1 ? Run.mmonitBatch.size : 1};
+        batch.events = CALLOC(batch.size, sizeof(QueueBatchEvent_T));
+
+        boolean_t changed = false;
+        for (QueuePosition_T position = _queueMinimum(); position.segment <= last; position.segment++, position.offset = 0) {
+                char path[PATH_MAX];
+                _queuePath(path, sizeof(path), position.segment);
+                FILE *file = fopen(path, "r");
+                Queue_Status status = Queue_End;
+                QueueNames_T names = {};
+                if (file) {
+                        if (_queueSeek(file, position.offset, &names)) {
+                                char *payload;
+                                uint32_t size;
+                                /* In the case that all handlers failed, skip the further processing in this cycle. Alert handler is currently defined anytime (either explicitly or localhost by default) */
+                                while (! ((Run.mmonits && FLAG(Run.handler_flag, Handler_Mmonit) && FLAG(Run.handler_flag, Handler_Alert)) || FLAG(Run.handler_flag, Handler_Alert)) && (status = _queueRead(file, &payload, &size)) == Queue_Record) {
+                                        QueuePosition_T next = {position.segment, position.offset + (uint32_t)sizeof(QueueRecord_T) + size};
+                                        QueueEvent_T record;
+                                        if (! _queueDecode((unsigned char *)payload, size, &names, &record))
+                                                LogError("Aborting queued event - invalid record\n");
+                                        if (_queueDeliver(&record, position, next, a, ea, &batch))
+                                                changed = true;
+                                        FREE(record.message);
+                                        position = next;
+                                        FREE(payload);
                                 }
                         }
-
-                        /* mmonit */
-                        if (e->flag & Handler_Mmonit) {
-                                if (Run.flags & Run_HandlerInit)
-                                        Run.handler_queue[Handler_Mmonit]++;
-                                if ((Run.handler_flag & Handler_Mmonit) != Handler_Mmonit) {
-                                        if ( MMonit_send(e) != Handler_Mmonit ) {
-                                                e->flag &= ~Handler_Mmonit;
-                                                Run.handler_queue[Handler_Mmonit]--;
-                                                handlers_passed++;
-                                        } else {
-                                                LogError("M/Monit handler failed, retry scheduled for next cycle\n");
-                                                Run.handler_flag |= Handler_Mmonit;
+                        fclose(file);
+                        _queueNamesReset(&names);
+                        if (_queueBatchFlush(&batch))
+                                changed = true;
+                        if (status == Queue_Record)
+                                break;
+                } else if (errno != ENOENT) {
+                        LogError("Cannot open the event queue segment %s -- %s\n", path, STRERROR);
+                        break;
+                }
+                if (status == Queue_Corrupted || (status == Queue_Truncated && position.segment < last)) {
+                        LogError("Event queue segment %s is %s at offset %u, skipping the rest of the segment\n", path, status == Queue_Truncated ? "truncated" : "corrupted", position.offset);
+                        /* Start a new segment for the events which will be added, so the rest of the segment may be skipped */
+                        if (position.segment == last) {
+                                LOCK(mutex)
+                                {
+                                        if (queue.last == last) {
+                                                queue.last++;
+                                                queue.size = 0;
                                         }
                                 }
+                                END_LOCK;
                         }
-
-                        /* If no error persists, remove it from the queue */
-                        if (e->flag == Handler_Succeeded) {
-                                DEBUG("Removing queued event %s\n", file_name);
-                                if (unlink(file_name) < 0)
-                                        LogError("Failed to remove queued event file '%s' -- %s\n", file_name, STRERROR);
-                        } else if (handlers_passed > 0) {
-                                DEBUG("Updating queued event %s (some handlers passed)\n", file_name);
-                                _queueUpdate(e, file_name);
+                } else if (position.segment == last) {
+                        break;
+                }
+                /* The segment was read up to the end, move the cursors which reached the end to the next segment */
+                for (int i = 0; i < (int)(sizeof(handlers) / sizeof(handlers[0])); i++) {
+                        QueuePosition_T *cursor = &queue.cursor[handlers[i]];
+                        if (cursor->segment == position.segment && cursor->offset >= position.offset) {
+                                *cursor = (QueuePosition_T){position.segment + 1, 0};
+                                changed = true;
                         }
-
-                error6:
-                        FREE(action);
-                error5:
-                        FREE(e->message);
-                error4:
-                        FREE(e);
-                error3:
-                        FREE(version);
-                error2:
-                        fclose(file);
                 }
-        error1:
-                de = readdir(dir);
         }
-        Run.flags &= ~Run_HandlerInit;
-        closedir(dir);
+
+        LOCK(mutex)
+        {
+                _queueCompact(changed);
+        }
+        END_LOCK;
+        PROBE1(event_queue_done, changed);
+        FREE(batch.events);
         FREE(a);
         FREE(ea);
 }
 
+
+void Event_queue_add(Event_T E) {
+        ASSERT(E);
+        PROBE3(event_queue_add, E->source->name, E->id, E->state);
+        if (Run.eventlist_dir)
+                _queueAdd(E);
+        else
+                LogError("Aborting event\n");
+}
+
+
+int Event_queue_count() {
+        int count = 0;
+        LOCK(mutex)
+        {
+                if (queue.dir)
+                        count = queue.count;
+        }
+        END_LOCK;
+        return count;
+}
+
+
+long long Event_queue_size() {
+        long long bytes = 0;
+        LOCK(mutex)
+        {
+                if (queue.dir)
+                        bytes = queue.bytes;
+        }
+        END_LOCK;
+        return bytes;
+}
@@ -102,6 +102,18 @@ extern EventTable_T Event_Table[];
 void Event_post(Service_T service, long id, State_Type state, EventAction_T action, char *s, ...) __attribute__((format (printf, 5, 6)));
 
 
+/**
+ * Check if an event was posted for the action. A test which succeeded
+ * may skip Event_post() and its message if there's no event yet, the
+ * succeeded state of a new event is ignored.
+ * @param service The Service the event belongs to
+ * @param id The event identification
+ * @param action Description of the event action
+ * @return true if the event exists, otherwise false
+ */
+boolean_t Event_isPosted(Service_T service, long id, EventAction_T action);
+
+
 /**
  * Get a textual description of actual event type. For instance if the
  * event type is possitive Event_Timestamp, the textual description is
@@ -141,4 +153,28 @@ const char *Event_get_action_description(Event_T E);
 void Event_queue_process();
 
 
+/**
+ * Add the event to the event queue for later delivery of the handlers
+ * which failed (E->flag). If the event queue is disabled, the event is
+ * dropped.
+ * @param E An event object
+ */
+void Event_queue_add(Event_T E);
+
+
+/**
+ * Get the number of queued events which were not delivered by all
+ * handlers yet. The count is compared with the queue slots limit.
+ * @return The number of queued events
+ */
+int Event_queue_count();
+
+
+/**
+ * Get the size of the event queue segment files
+ * @return The event queue size in bytes
+ */
+long long Event_queue_size();
+
+
 #endif
@@ -0,0 +1,580 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include "monit.h"
+#include "socket.h"
+#include "federation.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The poller thread fetches the agent status outside of the lock and
+ * merges it under the lock, the renderer reads the tree under the same
+ * lock. The agents list is the configuration of the running instance, the
+ * poller is stopped before the list is freed on reload and exit.
+ *
+ * The agent document is scanned, not parsed into a tree: the server part
+ * gives the host name, incarnation and cluster membership, each object of
+ * the services array is kept verbatim, keyed by the service name.
+ *
+ * In the cluster mode the agents are the peers of a cluster: each poll is
+ * a heartbeat and the peers which are reachable and report the cluster mode
+ * are the members together with this instance. The host checks are sharded
+ * by rendezvous hashing of the member and service names, so each member
+ * computes the same owner and when a member fails or comes back, only its
+ * hosts move.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define FEDERATION_BODY  (64 * 1024 * 1024)  /**< Maximum agent document size */
+#define FEDERATION_DEPTH 64                     /**< Maximum JSON nesting depth */
+
+
+/* The scanned agent document */
+typedef struct FederationStatus_T {
+        char *host;                              /**< The host name JSON string */
+        time_t incarnation;
+        unsigned long long generation;
+        boolean_t cluster;
+        int count;
+        struct myfederationservice *services;
+} FederationStatus_T;
+
+
+static struct {
+        boolean_t running;
+        boolean_t stopped;
+        Thread_T thread;
+        Sem_T wakeup;                  /**< Signalled when the thread should stop */
+        unsigned long long generation;    /**< Incremented when the tree changed */
+        unsigned long long rendered;         /**< Generation of the cached document */
+        StringBuffer_T cache;
+        int members;                       /**< Cluster members in the last round */
+} federation = {.generation = 1};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static const char *_ws(const char *p) {
+        while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+                p++;
+        return p;
+}
+
+
+/**
+ * Skip the JSON value
+ * @return The end of the value or NULL if the value is malformed
+ */
+static const char *_skip(const char *p, int depth) {
+        p = _ws(p);
+        if (*p == '"') {
+                for (p++; *p != '"'; p++)
+                        if (! *p || (*p == '\\' && ! *++p))
+                                return NULL;
+                return p + 1;
+        } else if (*p == '{' || *p == '[') {
+                char close = *p == '{' ? '}' : ']';
+                if (depth >= FEDERATION_DEPTH)
+                        return NULL;
+                p = _ws(p + 1);
+                if (*p == close)
+                        return p + 1;
+                while (true) {
+                        if (close == '}') {
+                                if (*p != '"' || ! (p = _skip(p, depth + 1)))
+                                        return NULL;
+                                p = _ws(p);
+                                if (*p++ != ':')
+                                        return NULL;
+                        }
+                        if (! (p = _skip(p, depth + 1)))
+                                return NULL;
+                        p = _ws(p);
+                        if (*p == close)
+                                return p + 1;
+                        if (*p++ != ',')
+                                return NULL;
+                        p = _ws(p);
+                }
+        }
+        // A number or literal
+        const char *start = p;
+        while (*p && ! strchr(",:}] \t\r\n", *p))
+                p++;
+        return p > start ? p : NULL;
+}
+
+
+/**
+ * Find the member of the JSON object
+ * @return The member value or NULL if not found
+ */
+static const char *_member(const char *p, const char *key) {
+        p = _ws(p);
+        if (*p != '{')
+                return NULL;
+        size_t length = strlen(key);
+        for (p = _ws(p + 1); *p == '"';) {
+                const char *name = p + 1;
+                if (! (p = _skip(p, 0)))
+                        return NULL;
+                boolean_t match = (size_t)(p - name - 1) == length && ! strncmp(name, key, length);
+                p = _ws(p);
+                if (*p++ != ':')
+                        return NULL;
+                p = _ws(p);
+                if (match)
+                        return p;
+                if (! (p = _skip(p, 1)))
+                        return NULL;
+                p = _ws(p);
+                if (*p != ',')
+                        return NULL;
+                p = _ws(p + 1);
+        }
+        return NULL;
+}
+
+
+static int _compareService(const void *a, const void *b) {
+        return strcmp(((const struct myfederationservice *)a)->name, ((const struct myfederationservice *)b)->name);
+}
+
+
+static void _freeServices(struct myfederationservice **services, int *count) {
+        for (int i = 0; i < *count; i++) {
+                FREE((*services)[i].name);
+                FREE((*services)[i].json);
+        }
+        FREE(*services);
+        *count = 0;
+}
+
+
+/**
+ * Scan the agent status document
+ * @return true if the document is valid, otherwise false
+ */
+static boolean_t _scan(const char *document, FederationStatus_T *status) {
+        const char *server = _member(document, "server");
+        const char *host = server ? _member(server, "localhostname") : NULL;
+        const char *incarnation = server ? _member(server, "incarnation") : NULL;
+        const char *cluster = server ? _member(server, "cluster") : NULL;
+        const char *generation = _member(document, "generation");
+        const char *p = _member(document, "services");
+        const char *end = host && *host == '"' ? _skip(host, 0) : NULL;
+        if (! end || ! incarnation || ! generation || ! p || *p != '[')
+                return false;
+        status->host = Str_ndup(host, end - host);
+        status->incarnation = (time_t)strtoll(incarnation, NULL, 10);
+        status->generation = strtoull(generation, NULL, 10);
+        status->cluster = cluster && Str_startsWith(cluster, "true");
+        for (p = _ws(p + 1); *p == '{';) {
+                const char *name = _member(p, "name");
+                const char *nameEnd = name && *name == '"' ? _skip(name, 0) : NULL;
+                if (! nameEnd || ! (end = _skip(p, 0)))
+                        return false;
+                RESIZE(status->services, (status->count + 1) * sizeof(struct myfederationservice));
+                status->services[status->count].name = Str_ndup(name + 1, nameEnd - name - 2);
+                status->services[status->count].json = Str_ndup(p, end - p);
+                status->count++;
+                p = _ws(end);
+                if (*p != ',')
+                        break;
+                p = _ws(p + 1);
+        }
+        return *p == ']';
+}
+
+
+/**
+ * Fetch the agent status changed after the generation
+ * @return true if succeeded, otherwise false
+ */
+static boolean_t _fetch(FederationAgent_T A, unsigned long long since, StringBuffer_T body) {
+        StringBuffer_clear(body);
+        Socket_T S = Socket_create(A->url->hostname, A->url->port, Socket_Tcp, Socket_Ip, A->ssl, A->timeout);
+        if (! S) {
+                DEBUG("Federation: cannot connect to %s\n", A->url->url);
+                return false;
+        }
+        boolean_t rv = false;
+        char buf[8192];
+        char *auth = Util_getBasicAuthHeader(A->url->user, A->url->password);
+        int length = (int)strlen(A->url->path);
+        if (length && A->url->path[length - 1] == '/')
+                length--;
+        if (Socket_print(S,
+                         "GET %.*s/_status?format=json&since=%llu HTTP/1.0\r\n"
+                         "Host: %s:%d\r\n"
+                         "Accept: application/json\r\n"
+                         "User-Agent: Monit/%s\r\n"
+                         "%s"
+                         "\r\n",
+                         length, A->url->path, since,
+                         A->url->hostname, A->url->port,
+                         VERSION,
+                         auth ? auth : "") < 0) {
+                DEBUG("Federation: cannot send the request to %s -- %s\n", A->url->url, STRERROR);
+        } else if (! Socket_readLine(S, buf, sizeof(buf))) {
+                DEBUG("Federation: no response from %s\n", A->url->url);
+        } else {
+                int status = 0;
+                if (sscanf(buf, "HTTP/%*d.%*d %d", &status) != 1 || status != 200) {
+                        DEBUG("Federation: %s returned %s\n", A->url->url, Str_chomp(buf));
+                } else {
+                        long long size = -1;
+                        while (Socket_readLine(S, buf, sizeof(buf)) && *Str_chomp(buf))
+                                if (Str_startsWith(buf, "Content-Length:"))
+                                        size = Str_parseLLong(Str_trim(buf + 15));
+                        // The HTTP/1.0 response ends with the Content-Length or when the agent closes the connection
+                        for (int n; (size < 0 || StringBuffer_length(body) < size) && StringBuffer_length(body) < FEDERATION_BODY && (n = Socket_read(S, buf, sizeof(buf))) > 0;)
+                                StringBuffer_appendBytes(body, buf, n);
+                        rv = size < 0 ? StringBuffer_length(body) > 0 : StringBuffer_length(body) == size;
+                        if (! rv)
+                                DEBUG("Federation: incomplete response from %s\n", A->url->url);
+                }
+        }
+        FREE(auth);
+        Socket_free(&S);
+        return rv;
+}
+
+
+/**
+ * Merge the delta into the agent services, must be called with the mutex locked
+ */
+static void _merge(FederationAgent_T A, FederationStatus_T *status) {
+        int count = A->count;
+        for (int i = 0; i < status->count; i++) {
+                struct myfederationservice *s = bsearch(&status->services[i], A->services, count, sizeof(struct myfederationservice), _compareService);
+                if (s) {
+                        FREE(s->json);
+                        s->json = status->services[i].json;
+                        FREE(status->services[i].name);
+                } else {
+                        RESIZE(A->services, (A->count + 1) * sizeof(struct myfederationservice));
+                        A->services[A->count++] = status->services[i];
+                }
+        }
+        if (A->count > count)
+                qsort(A->services, A->count, sizeof(struct myfederationservice), _compareService);
+        FREE(status->services);
+        status->count = 0;
+}
+
+
+static void _poll(FederationAgent_T A, StringBuffer_T body) {
+        FederationStatus_T status = {};
+        // Only this thread modifies the agent, it can read it without the lock
+        boolean_t full = ! A->generation;
+        boolean_t ok = _fetch(A, full ? 0 : A->generation, body) && _scan(StringBuffer_toString(body), &status);
+        if (ok && ! full && status.incarnation != A->incarnation) {
+                // The agent was restarted or reloaded: its generations started again and some services may be gone
+                FREE(status.host);
+                _freeServices(&status.services, &status.count);
+                full = true;
+                ok = _fetch(A, 0, body) && _scan(StringBuffer_toString(body), &status);
+        }
+        LOCK(mutex)
+        {
+                if (ok) {
+                        if (full || status.count || ! A->reachable || ! IS(A->host, status.host))
+                                federation.generation++;
+                        if (! A->reachable)
+                                LogInfo("Federation: agent %s is reachable\n", A->url->url);
+                        if (full) {
+                                _freeServices(&A->services, &A->count);
+                                qsort(status.services, status.count, sizeof(struct myfederationservice), _compareService);
+                                A->services = status.services;
+                                A->count = status.count;
+                                status.services = NULL;
+                                status.count = 0;
+                        } else {
+                                _merge(A, &status);
+                        }
+                        FREE(A->host);
+                        A->host = status.host;
+                        status.host = NULL;
+                        A->incarnation = status.incarnation;
+                        A->generation = status.generation;
+                        A->cluster = status.cluster;
+                        A->updated = Time_now();
+                        A->reachable = true;
+                } else if (A->reachable) {
+                        LogError("Federation: cannot get the status of agent %s\n", A->url->url);
+                        A->reachable = false;
+                        federation.generation++;
+                }
+        }
+        END_LOCK;
+        FREE(status.host);
+        _freeServices(&status.services, &status.count);
+}
+
+
+/**
+ * Test if the agent is a cluster member, must be called with the mutex locked
+ */
+static boolean_t _isMember(FederationAgent_T A) {
+        return A->reachable && A->cluster && A->host && strlen(A->host) > 2 && (strlen(A->host) - 2 != strlen(Run.system->name) || strncmp(A->host + 1, Run.system->name, strlen(A->host) - 2));
+}
+
+
+/**
+ * The rendezvous hash score of the member for the service: FNV-1a of both
+ * names finalized with the murmur3 mixer, so the scores of the members are
+ * independent
+ */
+static uint64_t _score(const char *member, size_t length, const char *name) {
+        uint64_t h = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++)
+                h = (h ^ (unsigned char)member[i]) * 1099511628211ULL;
+        h *= 1099511628211ULL; // The names separator
+        for (; *name; name++)
+                h = (h ^ (unsigned char)*name) * 1099511628211ULL;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+}
+
+
+/**
+ * Log the cluster membership change, must be called with the mutex locked
+ */
+static void _membership(void) {
+        int members = 1;
+        for (FederationAgent_T A = Run.federation.agents; A; A = A->next)
+                if (_isMember(A))
+                        members++;
+        if (members != federation.members) {
+                LogInfo("Cluster: %d member%s, the host checks are %s\n", members, members > 1 ? "s" : "", members > 1 ? "sharded" : "all checked by this instance");
+                federation.members = members;
+        }
+}
+
+
+static void *_poller(void *args) {
+        set_signal_block();
+        StringBuffer_T body = StringBuffer_create(65536);
+        LOCK(mutex)
+        {
+                while (! federation.stopped) {
+                        Mutex_unlock(mutex);
+                        for (FederationAgent_T A = Run.federation.agents; A && ! federation.stopped; A = A->next)
+                                _poll(A, body);
+                        Mutex_lock(mutex);
+                        if (Run.federation.cluster)
+                                _membership();
+                        if (! federation.stopped) {
+                                struct timespec wait = {.tv_sec = Time_now() + (Run.federation.interval > 0 ? Run.federation.interval : Run.polltime), .tv_nsec = 0};
+                                Sem_timeWait(federation.wakeup, mutex, wait);
+                        }
+                }
+        }
+        END_LOCK;
+        StringBuffer_free(&body);
+#ifdef HAVE_OPENSSL
+        Ssl_threadCleanup();
+#endif
+        return NULL;
+}
+
+
+/* Append the URL as JSON string, the URL has no control characters */
+static void _url(StringBuffer_T B, const char *url) {
+        StringBuffer_append(B, "\"");
+        for (; *url; url++)
+                StringBuffer_append(B, *url == '"' || *url == '\\' ? "\\%c" : "%c", *url);
+        StringBuffer_append(B, "\"");
+}
+
+
+/**
+ * Render the tree, must be called with the mutex locked
+ */
+static void _render(StringBuffer_T B) {
+        StringBuffer_append(B, "{\"generation\":%llu,\"hosts\":[", federation.generation);
+        for (FederationAgent_T A = Run.federation.agents; A; A = A->next) {
+                StringBuffer_append(B, "%s{\"host\":%s,\"url\":", A == Run.federation.agents ? "" : ",", A->host ? A->host : "null");
+                _url(B, A->url->url);
+                StringBuffer_append(B, ",\"reachable\":%s,\"updated\":%lld,\"incarnation\":%lld,\"generation\":%llu,\"services\":[", A->reachable ? "true" : "false", (long long)A->updated, (long long)A->incarnation, A->generation);
+                for (int i = 0; i < A->count; i++)
+                        StringBuffer_append(B, "%s%s", i ? "," : "", A->services[i].json);
+                StringBuffer_append(B, "]}");
+        }
+        StringBuffer_append(B, "]}");
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Federation_start() {
+        if (! Run.federation.agents)
+                return false;
+        LOCK(mutex)
+        {
+                if (! federation.running) {
+                        Sem_init(federation.wakeup);
+                        federation.stopped = false;
+                        Thread_create(federation.thread, _poller, NULL);
+                        federation.running = true;
+                        DEBUG("Federation poller started\n");
+                }
+        }
+        END_LOCK;
+        return true;
+}
+
+
+void Federation_stop() {
+        if (! federation.running)
+                return;
+        LOCK(mutex)
+        {
+                federation.stopped = true;
+                Sem_signal(federation.wakeup);
+        }
+        END_LOCK;
+        Thread_join(federation.thread);
+        LOCK(mutex)
+        {
+                if (federation.cache)
+                        StringBuffer_free(&federation.cache);
+                federation.generation++;
+                federation.members = 0;
+                Sem_destroy(federation.wakeup);
+                federation.running = false;
+        }
+        END_LOCK;
+}
+
+
+unsigned long long Federation_generation() {
+        unsigned long long generation;
+        LOCK(mutex)
+        {
+                generation = federation.generation;
+        }
+        END_LOCK;
+        return generation;
+}
+
+
+unsigned long long Federation_status(StringBuffer_T B) {
+        ASSERT(B);
+        unsigned long long generation;
+        LOCK(mutex)
+        {
+                if (! federation.cache) {
+                        federation.cache = StringBuffer_create(65536);
+                        federation.rendered = 0;
+                }
+                if (federation.rendered != federation.generation) {
+                        StringBuffer_clear(federation.cache);
+                        _render(federation.cache);
+                        federation.rendered = federation.generation;
+                }
+                StringBuffer_appendBytes(B, StringBuffer_toString(federation.cache), StringBuffer_length(federation.cache));
+                generation = federation.generation;
+        }
+        END_LOCK;
+        return generation;
+}
+
+
+boolean_t Federation_isOwner(const char *name) {
+        ASSERT(name);
+        if (! Run.federation.cluster)
+                return true;
+        boolean_t owner = true;
+        size_t length = strlen(Run.system->name);
+        uint64_t score = _score(Run.system->name, length, name);
+        LOCK(mutex)
+        {
+                for (FederationAgent_T A = Run.federation.agents; A; A = A->next) {
+                        if (_isMember(A)) {
+                                // The host is the JSON string of the agent name, the equal scores are ordered by the name
+                                size_t l = strlen(A->host) - 2;
+                                uint64_t s = _score(A->host + 1, l, name);
+                                if (s > score || (s == score && (l > length || (l == length && strncmp(A->host + 1, Run.system->name, l) > 0)))) {
+                                        owner = false;
+                                        break;
+                                }
+                        }
+                }
+        }
+        END_LOCK;
+        return owner;
+}
+
+
+void Federation_free(FederationAgent_T A) {
+        ASSERT(A);
+        LOCK(mutex)
+        {
+                FREE(A->host);
+                _freeServices(&A->services, &A->count);
+                federation.generation++;
+        }
+        END_LOCK;
+}
+
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_FEDERATION_H
+#define MONIT_FEDERATION_H
+
+
+/**
+ * Fleet federation. If enabled with "set federation", a thread polls the
+ * downstream monit agents with the delta status API (/_status?format=json
+ * &since=N) and merges the changed services into one status tree, grouped
+ * by the agent host. An agent whose incarnation changed (restart, reload)
+ * is polled for its full status. The tree is served at /_federation from
+ * a rendered document which is rebuilt only when the tree changed.
+ *
+ * With "set federation cluster" the agents are the peers of a cluster and
+ * the host checks are sharded between the reachable members.
+ * @file
+ */
+
+
+/**
+ * Start the federation poller
+ * @return true if the thread was started, otherwise false
+ */
+boolean_t Federation_start(void);
+
+
+/**
+ * Stop the federation poller and drop the cached document
+ */
+void Federation_stop(void);
+
+
+/**
+ * Get the generation of the merged status tree, it is incremented when
+ * an agent status changed
+ * @return The generation
+ */
+unsigned long long Federation_generation(void);
+
+
+/**
+ * Append the JSON formated federated status to the buffer
+ * @param B Output StringBuffer object
+ * @return The generation of the appended status
+ */
+unsigned long long Federation_status(StringBuffer_T B);
+
+
+/**
+ * Test if this instance checks the host service in the cluster mode. The
+ * owner of the service is the member with the highest rendezvous hash
+ * score, the members are this instance and the reachable agents which
+ * run in the cluster mode too.
+ * @param name The service name
+ * @return true if this instance is the owner or the cluster mode is not
+ * enabled, otherwise false
+ */
+boolean_t Federation_isOwner(const char *name);
+
+
+/**
+ * Free the merged status of the agent
+ * @param A A federation agent
+ */
+void Federation_free(FederationAgent_T A);
+
+
+#endif
@@ -66,6 +66,7 @@
 
 #include "monit.h"
 #include "engine.h"
+#include "counter.h"
 
 // libmonit
 #include "io/File.h"
@@ -131,6 +132,23 @@ time_t file_getTimestamp(char *object, mode_t type) {
 }
 
 
+void file_getStatTimes(struct stat *st, unsigned long long *mtime, unsigned long long *ctime) {
+        ASSERT(st);
+        ASSERT(mtime);
+        ASSERT(ctime);
+#if defined HAVE_STRUCT_STAT_ST_MTIM
+        *mtime = (unsigned long long)st->st_mtim.tv_sec * 1000000000ULL + st->st_mtim.tv_nsec;
+        *ctime = (unsigned long long)st->st_ctim.tv_sec * 1000000000ULL + st->st_ctim.tv_nsec;
+#elif defined HAVE_STRUCT_STAT_ST_MTIMESPEC
+        *mtime = (unsigned long long)st->st_mtimespec.tv_sec * 1000000000ULL + st->st_mtimespec.tv_nsec;
+        *ctime = (unsigned long long)st->st_ctimespec.tv_sec * 1000000000ULL + st->st_ctimespec.tv_nsec;
+#else
+        *mtime = (unsigned long long)st->st_mtime * 1000000000ULL;
+        *ctime = (unsigned long long)st->st_ctime * 1000000000ULL;
+#endif
+}
+
+
 char *file_findControlFile() {
         char *rcfile = CALLOC(sizeof(char), STRLEN + 1);
         snprintf(rcfile, STRLEN, "%s/.%s", Run.Env.home, MONITRC);
@@ -217,55 +235,6 @@ boolean_t file_checkQueueDirectory(char *path) {
 }
 
 
-boolean_t file_checkQueueLimit(char *path, int limit) {
-        if (limit >= 0) {
-                DIR *dir = opendir(path);
-                if (! dir) {
-                        LogError("Cannot open the event queue directory %s -- %s\n", path, STRERROR);
-                        return false;
-                }
-                int used = 0;
-                struct dirent *de = NULL;
-                while ((de = readdir(dir)) ) {
-                        char buf[PATH_MAX];
-                        snprintf(buf, sizeof(buf), "%s/%s", path, de->d_name);
-                        if (File_isFile(buf) && ++used > limit) {
-                                LogError("Event queue is full\n");
-                                closedir(dir);
-                                return false;
-                        }
-                }
-                closedir(dir);
-        }
-        return true;
-}
-
-
-boolean_t file_writeQueue(FILE *file, void *data, size_t size) {
-        ASSERT(file);
-        /* write size */
-        size_t rv = fwrite(&size, 1, sizeof(size_t), file);
-        if (rv != sizeof(size_t)) {
-                if (feof(file) || ferror(file))
-                        LogError("Queued event file: unable to write event size -- %s\n", feof(file) ? "end of file" : "stream error");
-                else
-                        LogError("Queued event file: unable to write event size -- read returned %lu bytes\n", (unsigned long)rv);
-                return false;
-        }
-        /* write data if any */
-        if (size > 0) {
-                if ((rv = fwrite(data, 1, size, file)) != size) {
-                        if (feof(file) || ferror(file))
-                                LogError("Queued event file: unable to write event size -- %s\n", feof(file) ? "end of file" : "stream error");
-                        else
-                                LogError("Queued event file: unable to write event size -- read returned %lu bytes\n", (unsigned long)rv);
-                        return false;
-                }
-        }
-        return true;
-}
-
-
 void *file_readQueue(FILE *file, size_t *size) {
         ASSERT(file);
         /* read size */
@@ -309,10 +278,12 @@ boolean_t file_readProc(char *buf, int buf_size, char *name, int pid, int *bytes
                 DEBUG("Cannot open proc file %s -- %s\n", filename, STRERROR);
                 return false;
         }
+        Counter_add(Counter_ProcFiles, 1);
 
         boolean_t rv = false;
         int bytes = (int)read(fd, buf, buf_size - 1);
         if (bytes >= 0) {
+                Counter_add(Counter_ProcBytes, bytes);
                 if (bytes_read)
                         *bytes_read = bytes;
                 buf[bytes] = 0;
@@ -56,6 +56,16 @@ void file_finalize();
 time_t file_getTimestamp(char *object, mode_t type);
 
 
+/**
+ * Get the object's modification and change time with nanosecond resolution
+ * where the platform provides it
+ * @param st The object's stat data
+ * @param mtime Pointer where the modification time [ns] will be stored
+ * @param ctime Pointer where the change time [ns] will be stored
+ */
+void file_getStatTimes(struct stat *st, unsigned long long *mtime, unsigned long long *ctime);
+
+
 /**
  * Search the system for the monit control file. Try first ~/.monitrc,
  * if that fails try /etc/monitrc, then /usr/local/etc/monitrc and
@@ -98,26 +108,8 @@ boolean_t file_checkQueueDirectory(char *path);
 
 
 /**
- * Check the queue size limit.
- * @param path The fully qualified path to the directory
- * @param mode The queue limit
- * @return true if the succeeded otherwise false
- */
-boolean_t file_checkQueueLimit(char *path, int limit);
-
-
-/**
- * Write data to the queue file
- * @param file Filedescriptor to write to
- * @param data Data to be written
- * @param size Size of the data to be written
- * @return true if the succeeded otherwise false
- */
-boolean_t file_writeQueue(FILE *file, void *data, size_t size);
-
-
-/**
- * Read the data from the queue file's actual position
+ * Read the data from the queue file's actual position. Used to convert the
+ * event files from the previous Monit versions to the event queue.
  * @param file Filedescriptor to read from
  * @param size Size of the data read
  * @return The data read if any or NULL. The size parameter is set
@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+
+#include "monit.h"
+#include "fileevents.h"
+
+// libmonit
+#include "system/Time.h"
+
+
+/**
+ *  File change events via the Linux inotify.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct FileWatch_T {
+        Service_T service;
+        int wd;                        /**< Watch descriptor or -1 if the path is not watched */
+        boolean_t changed;
+        time_t checked;                              /**< Time of the last check */
+} FileWatch_T;
+
+
+static struct {
+        int fd;
+        int changed;                 /**< Number of changed services not checked yet */
+        int count;
+        FileWatch_T *watches;                             /**< Sorted by service */
+        int indexed;
+        FileWatch_T **index;              /**< Watched paths sorted by descriptor */
+} _events = {.fd = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+
+static int _compareService(const void *a, const void *b) {
+        uintptr_t x = (uintptr_t)((const FileWatch_T *)a)->service;
+        uintptr_t y = (uintptr_t)((const FileWatch_T *)b)->service;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+static int _compareDescriptor(const void *a, const void *b) {
+        return (*(FileWatch_T * const *)a)->wd - (*(FileWatch_T * const *)b)->wd;
+}
+
+
+static void _setChanged(FileWatch_T *w) {
+        if (! w->changed) {
+                w->changed = true;
+                _events.changed++;
+        }
+}
+
+
+static void _reindex() {
+        _events.indexed = 0;
+        for (int i = 0; i < _events.count; i++)
+                if (_events.watches[i].wd >= 0)
+                        _events.index[_events.indexed++] = &_events.watches[i];
+        qsort(_events.index, _events.indexed, sizeof(FileWatch_T *), _compareDescriptor);
+}
+
+
+static boolean_t _watch(FileWatch_T *w) {
+        uint32_t mask = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF | IN_MASK_ADD;
+        if (w->service->type == Service_Directory)
+                mask |= IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO;
+        // Several services can watch the same path => the masks are merged (IN_MASK_ADD) and the services share the descriptor
+        if ((w->wd = inotify_add_watch(_events.fd, w->service->path, mask)) < 0) {
+                DEBUG("'%s' cannot watch %s -- %s\n", w->service->name, w->service->path, STRERROR);
+                return false;
+        }
+        return true;
+}
+
+
+/**
+ * Mark all services watching the given descriptor as changed
+ */
+static void _changed(int wd, uint32_t mask) {
+        FileWatch_T key = {.wd = wd}, *k = &key;
+        FileWatch_T **found = bsearch(&k, _events.index, _events.indexed, sizeof(FileWatch_T *), _compareDescriptor);
+        if (found) {
+                // Find the services sharing the descriptor
+                FileWatch_T **first = found, **last = found + 1;
+                while (first > _events.index && (*(first - 1))->wd == wd)
+                        first--;
+                while (last < _events.index + _events.indexed && (*last)->wd == wd)
+                        last++;
+                boolean_t removed = (mask & (IN_IGNORED | IN_MOVE_SELF | IN_DELETE_SELF)) != 0;
+                for (FileWatch_T **w = first; w < last; w++) {
+                        _setChanged(*w);
+                        // The path was replaced or removed and the watch follows the old inode => watch the path again on the next check
+                        if (removed)
+                                (*w)->wd = -1;
+                }
+                if (removed) {
+                        if (! (mask & IN_IGNORED))
+                                inotify_rm_watch(_events.fd, wd);
+                        _reindex();
+                }
+        }
+}
+
+
+static boolean_t _read() {
+        boolean_t changed = false;
+        char buf[8192] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+        ssize_t len;
+        while ((len = read(_events.fd, buf, sizeof(buf))) > 0) {
+                for (char *p = buf; p < buf + len; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+                        struct inotify_event *e = (struct inotify_event *)p;
+                        if (e->mask & IN_Q_OVERFLOW) {
+                                // Some events were lost => check all watched services
+                                DEBUG("File events -- queue overflow, events lost\n");
+                                for (int i = 0; i < _events.count; i++)
+                                        _setChanged(&_events.watches[i]);
+                                changed = true;
+                        } else {
+                                _changed(e->wd, e->mask);
+                                changed = true;
+                        }
+                }
+        }
+        if (len < 0 && errno != EAGAIN && errno != EINTR)
+                LogError("File events -- read failed: %s\n", STRERROR);
+        return changed;
+}
+
+
+static FileWatch_T *_find(Service_T s) {
+        FileWatch_T key = {.service = s};
+        return _events.count ? bsearch(&key, _events.watches, _events.count, sizeof(FileWatch_T), _compareService) : NULL;
+}
+
+
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t FileEvents_start(void) {
+#ifdef HAVE_SYS_INOTIFY_H
+        if (_events.fd >= 0)
+                return true;
+        if ((_events.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+                LogError("File events -- cannot initialize inotify: %s\n", STRERROR);
+                return false;
+        }
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_File || s->type == Service_Directory || s->type == Service_Fifo)
+                        _events.count++;
+        _events.watches = CALLOC(_events.count ? _events.count : 1, sizeof(FileWatch_T));
+        _events.index = CALLOC(_events.count ? _events.count : 1, sizeof(FileWatch_T *));
+        int i = 0;
+        for (Service_T s = servicelist; s && i < _events.count; s = s->next)
+                if (s->type == Service_File || s->type == Service_Directory || s->type == Service_Fifo)
+                        _events.watches[i++].service = s;
+        qsort(_events.watches, _events.count, sizeof(FileWatch_T), _compareService);
+        for (i = 0; i < _events.count; i++)
+                _watch(&_events.watches[i]);
+        _reindex();
+        DEBUG("File events -- watching %d of %d paths\n", _events.indexed, _events.count);
+        return true;
+#else
+        LogError("File events are not supported on this platform\n");
+        return false;
+#endif
+}
+
+
+void FileEvents_stop(void) {
+#ifdef HAVE_SYS_INOTIFY_H
+        if (_events.fd >= 0) {
+                // Closing the descriptor removes all watches
+                close(_events.fd);
+                _events.fd = -1;
+                FREE(_events.watches);
+                FREE(_events.index);
+                _events.count = _events.indexed = _events.changed = 0;
+                DEBUG("File events stopped\n");
+        }
+#endif
+}
+
+
+boolean_t FileEvents_poll(long long timeout) {
+#ifdef HAVE_SYS_INOTIFY_H
+        if (_events.fd >= 0) {
+                struct pollfd p = {.fd = _events.fd, .events = POLLIN};
+                if (poll(&p, 1, timeout > INT_MAX ? INT_MAX : (int)timeout) > 0)
+                        return _read();
+        }
+#endif
+        return false;
+}
+
+
+boolean_t FileEvents_hasChanged(void) {
+        return _events.changed > 0;
+}
+
+
+boolean_t FileEvents_isChanged(Service_T s) {
+#ifdef HAVE_SYS_INOTIFY_H
+        if (_events.fd >= 0) {
+                FileWatch_T *w = _find(s);
+                return w && w->changed;
+        }
+#endif
+        return false;
+}
+
+
+boolean_t FileEvents_isPending(Service_T s) {
+#ifdef HAVE_SYS_INOTIFY_H
+        if (_events.fd >= 0) {
+                FileWatch_T *w = _find(s);
+                if (w) {
+                        time_t now = Time_now();
+                        if (w->wd < 0) {
+                                // Not watched => poll the path and try to watch it again (for example the file was rotated or created meanwhile)
+                                if (_watch(w))
+                                        _reindex();
+                        } else if (! w->changed && now < w->checked + (time_t)Run.polltime * Run.fileEngine.recheckCycles) {
+                                return false;
+                        }
+                        if (w->changed) {
+                                w->changed = false;
+                                _events.changed--;
+                        }
+                        w->checked = now;
+                }
+        }
+#endif
+        return true;
+}
+
+
+boolean_t FileEvents_isRunning(void) {
+        return _events.fd >= 0;
+}
+
+
+int FileEvents_descriptor(void) {
+        return _events.fd;
+}
+
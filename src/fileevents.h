@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_FILEEVENTS_H
+#define MONIT_FILEEVENTS_H
+
+
+/**
+ * File change event source. On Linux the paths of the file, directory and
+ * fifo services are watched with inotify, so these services are checked only
+ * when the path changed, plus a periodic safety re-check. On other systems
+ * the interface is a noop and FileEvents_start() returns false.
+ *
+ * @file
+ */
+
+
+/**
+ * Add the watches for the file, directory and fifo services in the service list
+ * @return true if the watches were added, otherwise false
+ */
+boolean_t FileEvents_start(void);
+
+
+/**
+ * Remove all watches
+ */
+void FileEvents_stop(void);
+
+
+/**
+ * Wait up to the given time for a change of some watched path and collect
+ * the changes. The wait is interrupted by a signal.
+ * @param timeout Maximum wait time in milliseconds, 0 means don't wait
+ * @return true if some watched path changed, otherwise false
+ */
+boolean_t FileEvents_poll(long long timeout);
+
+
+/**
+ * Test if some service with a changed path wasn't checked yet
+ * @return true if a watched path changed, otherwise false
+ */
+boolean_t FileEvents_hasChanged(void);
+
+
+/**
+ * Test if the path of the given service changed and the service wasn't
+ * checked yet
+ * @param s A service
+ * @return true if the service path is watched and changed, otherwise false
+ */
+boolean_t FileEvents_isChanged(Service_T s);
+
+
+/**
+ * Test if the service should be checked: either its path changed, the path
+ * is not watched (for example because it doesn't exist) or the periodic
+ * re-check is due. If true is returned, the service is considered checked.
+ * @param s A service
+ * @return true if the service should be checked, otherwise false
+ */
+boolean_t FileEvents_isPending(Service_T s);
+
+
+/**
+ * Test if the file events are enabled
+ * @return true if the paths are watched, otherwise false
+ */
+boolean_t FileEvents_isRunning(void);
+
+
+/**
+ * Get the descriptor which becomes readable when a watched path changed, so
+ * the caller can wait for the file events together with other descriptors
+ * @return The descriptor or -1 if the file events are not running
+ */
+int FileEvents_descriptor(void);
+
+
+#endif
+
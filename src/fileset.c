@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_GLOB_H
+#include <glob.h>
+#endif
+
+#include "monit.h"
+#include "fileset.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static int _compareRecord(const void *a, const void *b) {
+        return strcmp(((const struct FileRecord_T *)a)->path, ((const struct FileRecord_T *)b)->path);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int FileSet_scan(FileSet_T set) {
+        ASSERT(set);
+        ASSERT(set->pattern);
+#ifdef HAVE_GLOB_H
+        glob_t globbuf;
+        int rv = glob(set->pattern, GLOB_MARK, NULL, &globbuf);
+        if (rv != 0 && rv != GLOB_NOMATCH) {
+                LogError("Cannot list the files matching %s -- %s\n", set->pattern, rv == GLOB_NOSPACE ? "out of memory" : "read error");
+                return -1;
+        }
+        int count = 0;
+        FileRecord_T records = NULL;
+        if (rv == 0 && globbuf.gl_pathc) {
+                records = CALLOC(globbuf.gl_pathc, sizeof(struct FileRecord_T));
+                for (size_t i = 0; i < globbuf.gl_pathc; i++) {
+                        // GLOB_MARK appends a slash to the directories, they are not members
+                        size_t length = strlen(globbuf.gl_pathv[i]);
+                        if (length && globbuf.gl_pathv[i][length - 1] == '/')
+                                continue;
+                        FileRecord_T old = set->count ? bsearch(&(struct FileRecord_T){.path = globbuf.gl_pathv[i]}, set->records, set->count, sizeof(struct FileRecord_T), _compareRecord) : NULL;
+                        if (old) {
+                                records[count] = *old;
+                                old->path = NULL;
+                        } else {
+                                records[count].path = Str_dup(globbuf.gl_pathv[i]);
+                        }
+                        count++;
+                }
+                qsort(records, count, sizeof(struct FileRecord_T), _compareRecord);
+        }
+        if (rv == 0)
+                globfree(&globbuf);
+        for (int i = 0; i < set->count; i++)
+                FREE(set->records[i].path);
+        FREE(set->records);
+        set->records = records;
+        set->count = count;
+        return count;
+#else
+        LogError("Cannot list the files matching %s -- glob is not supported on this platform\n", set->pattern);
+        return -1;
+#endif
+}
+
+
+boolean_t FileSet_checksum(FileRecord_T record, struct stat *st, Hash_Type type, MD_T sum) {
+        ASSERT(record);
+        ASSERT(st);
+        unsigned long long mtime, ctime;
+        file_getStatTimes(st, &mtime, &ctime);
+        if (record->known && *record->sum && record->inode == st->st_ino && record->size == st->st_size && record->mtime == mtime && record->ctime == ctime) {
+                memcpy(sum, record->sum, sizeof(MD_T));
+                return true;
+        }
+        return Util_getChecksum(record->path, type, sum, sizeof(MD_T));
+}
+
+
+void FileSet_free(FileSet_T *set) {
+        ASSERT(set && *set);
+        for (int i = 0; i < (*set)->count; i++)
+                FREE((*set)->records[i].path);
+        FREE((*set)->records);
+        FREE((*set)->pattern);
+        FREE(*set);
+}
+
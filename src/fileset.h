@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_FILESET_H
+#define MONIT_FILESET_H
+
+
+/**
+ * File set of a 'check file <name> matching <pattern>' service. The members
+ * are the regular files whose path matches the glob pattern, they are found
+ * with one glob(3) per cycle and each member is kept as a compact record
+ * instead of a service of its own. The test rules of the service apply to
+ * all members, the record keeps the values of the previous test of the
+ * member for the change tests and the checksum cache.
+ *
+ * @file
+ */
+
+
+/**
+ * The file set member
+ */
+typedef struct FileRecord_T {
+        char *path;
+        boolean_t known;       /**< true if the values are from the previous test */
+        ino_t inode;
+        off_t size;
+        time_t timestamp;                     /**< MAX(mtime, ctime) [s] */
+        unsigned long long mtime;                                /**< [ns] */
+        unsigned long long ctime;                                /**< [ns] */
+        int mode;
+        int uid;
+        int gid;
+        MD_T sum;                       /**< Checksum or empty if not computed */
+} *FileRecord_T;
+
+
+/**
+ * Find the members of the file set. The records of the paths which still
+ * match are kept, new paths get a record which is not known yet and the
+ * records of the paths which don't match anymore are removed. The records
+ * are sorted by path.
+ * @param set The file set
+ * @return The number of the members or -1 on error
+ */
+int FileSet_scan(FileSet_T set);
+
+
+/**
+ * Compute the checksum of the member. If the member is known and its
+ * inode, size, modification and change time didn't change, the checksum
+ * from the previous test is used.
+ * @param record The member
+ * @param st The current stat data of the member
+ * @param type The hash type
+ * @param sum The result buffer
+ * @return true on success, otherwise false
+ */
+boolean_t FileSet_checksum(FileRecord_T record, struct stat *st, Hash_Type type, MD_T sum);
+
+
+/**
+ * Free the file set and its records
+ * @param set The file set
+ */
+void FileSet_free(FileSet_T *set);
+
+
+#endif
@@ -32,6 +32,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
 // libmonit
 #include "util/List.h"
 
@@ -39,6 +43,18 @@
 #include "protocol.h"
 #include "ProcessTree.h"
 #include "engine.h"
+#include "checksumpool.h"
+#include "regexcache.h"
+#include "dirscan.h"
+#include "fileset.h"
+#include "treesum.h"
+#include "MMonit.h"
+#include "federation.h"
+#include "plugin.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 
 
 /* Private prototypes */
@@ -47,38 +63,24 @@ static void _gc_service(Service_T *);
 static void _gc_servicegroup(ServiceGroup_T *);
 static void _gc_mail_server(MailServer_T *);
 static void _gcportlist(Port_T *);
-static void _gcfilesystem(Filesystem_T *);
 static void _gcicmp(Icmp_T *);
-static void _gcpql(Resource_T *);
-static void _gcptl(Timestamp_T *);
-static void _gcparl(ActionRate_T *);
-static void _gc_action(Action_T *);
-static void _gc_eventaction(EventAction_T *);
-static void _gcpdl(Dependant_T *);
-static void _gcso(Size_T *);
-static void _gclinkstatus(LinkStatus_T *);
-static void _gclinkspeed(LinkSpeed_T *);
-static void _gclinksaturation(LinkSaturation_T *);
-static void _gcbandwidth(Bandwidth_T *);
 static void _gcmatch(Match_T *);
 static void _gcchecksum(Checksum_T *);
-static void _gcperm(Perm_T *);
-static void _gcstatus(Status_T *);
-static void _gcuid(Uid_T *);
-static void _gcgid(Gid_T *);
-static void _gcpid(Pid_T *);
-static void _gcppid(Pid_T *);
-static void _gcfsflag(Fsflag_T *);
-static void _gcnonexist(Nonexist_T *);
 static void _gcgeneric(Generic_T *);
 static void _gcath(Auth_T *);
 static void _gc_mmonit(Mmonit_T *);
+static void _gc_federationagent(FederationAgent_T *);
 static void _gc_url(URL_T *);
 static void _gc_request(Request_T *);
 
 
 /**
- *  Release allocated memory.
+ *  Release allocated memory. The plain configuration objects of a
+ *  service (the tests without runtime resources, the dependencies and
+ *  the event actions) are allocated from the service memory region by
+ *  the parser and released with it, the objects which hold runtime
+ *  resources such as sockets, regular expressions or running programs
+ *  are released one by one.
  *
  *  @file
  */
@@ -91,6 +93,8 @@ void gc() {
         Engine_destroyHostsAllow();
         if (Run.flags & Run_ProcessEngineEnabled)
                 ProcessTree_delete();
+        Util_resetServiceIndex();
+        status_xml_reset();
         if (servicelist)
                 _gc_service_list(&servicelist);
         if (servicegrouplist)
@@ -103,15 +107,14 @@ void gc() {
                 _gc_mail_server(&Run.mailservers);
         if (Run.mmonits)
                 _gc_mmonit(&Run.mmonits);
+        if (Run.federation.agents)
+                _gc_federationagent(&Run.federation.agents);
         FREE(Run.eventlist_dir);
         FREE(Run.mygroup);
-        if (Run.httpd.flags & Httpd_Net) {
-                FREE(Run.httpd.socket.net.address);
-                FREE(Run.httpd.socket.net.ssl.pem);
-                FREE(Run.httpd.socket.net.ssl.clientpem);
-        } else if (Run.httpd.flags & Httpd_Unix) {
-                FREE(Run.httpd.socket.unix.path);
-        }
+        FREE(Run.httpd.socket.net.address);
+        FREE(Run.httpd.socket.net.ssl.pem);
+        FREE(Run.httpd.socket.net.ssl.clientpem);
+        FREE(Run.httpd.socket.unix.path);
         if (Run.MailFormat.from)
                 Address_free(&(Run.MailFormat.from));
         if (Run.MailFormat.replyto)
@@ -145,6 +148,11 @@ void gccmd(command_t *c) {
 }
 
 
+void gc_service(Service_T *s) {
+        _gc_service(s);
+}
+
+
 void gc_event(Event_T *e) {
         ASSERT(e && *e);
         if ((*e)->next)
@@ -177,100 +185,74 @@ static void _gc_service_list(Service_T *s) {
 static void _gc_service(Service_T *s) {
         ASSERT(s&&*s);
         if ((*s)->program) {
+                if ((*s)->program->capture)
+                        Capture_free(&(*s)->program->capture);
                 if ((*s)->program->P)
                         Process_free(&(*s)->program->P);
                 if ((*s)->program->C)
                         Command_free(&(*s)->program->C);
+                if ((*s)->program->plugin)
+                        Plugin_free(&(*s)->program->plugin);
                 if ((*s)->program->args)
                         gccmd(&(*s)->program->args);
                 StringBuffer_free(&((*s)->program->output));
                 FREE((*s)->program);
         }
+        if ((*s)->snapshot.program.output)
+                StringBuffer_free(&(*s)->snapshot.program.output);
+        FREE((*s)->latency);
+        for (int i = 0; i < 2; i++)
+                if ((*s)->status.fragment[i])
+                        StringBuffer_free(&(*s)->status.fragment[i]);
+        if ((*s)->patternset)
+                PatternSet_free(&(*s)->patternset);
         if ((*s)->portlist)
                 _gcportlist(&(*s)->portlist);
         if ((*s)->socketlist)
                 _gcportlist(&(*s)->socketlist);
-        if ((*s)->filesystemlist)
-                _gcfilesystem(&(*s)->filesystemlist);
         if ((*s)->icmplist)
                 _gcicmp(&(*s)->icmplist);
         if ((*s)->maillist)
                 gc_mail_list(&(*s)->maillist);
-        if ((*s)->resourcelist)
-                _gcpql(&(*s)->resourcelist);
-        if ((*s)->timestamplist)
-                _gcptl(&(*s)->timestamplist);
-        if ((*s)->actionratelist)
-                _gcparl(&(*s)->actionratelist);
-        if ((*s)->sizelist)
-                _gcso(&(*s)->sizelist);
-        if ((*s)->linkstatuslist)
-                _gclinkstatus(&(*s)->linkstatuslist);
-        if ((*s)->linkspeedlist)
-                _gclinkspeed(&(*s)->linkspeedlist);
-        if ((*s)->linksaturationlist)
-                _gclinksaturation(&(*s)->linksaturationlist);
-        if ((*s)->uploadbyteslist)
-                _gcbandwidth(&(*s)->uploadbyteslist);
-        if ((*s)->uploadpacketslist)
-                _gcbandwidth(&(*s)->uploadpacketslist);
-        if ((*s)->downloadbyteslist)
-                _gcbandwidth(&(*s)->downloadbyteslist);
-        if ((*s)->downloadpacketslist)
-                _gcbandwidth(&(*s)->downloadpacketslist);
         if ((*s)->matchlist)
                 _gcmatch(&(*s)->matchlist);
         if ((*s)->matchignorelist)
                 _gcmatch(&(*s)->matchignorelist);
         if ((*s)->checksum)
                 _gcchecksum(&(*s)->checksum);
-        if ((*s)->perm)
-                _gcperm(&(*s)->perm);
-        if ((*s)->statuslist)
-                _gcstatus(&(*s)->statuslist);
-        if ((*s)->every.type == Every_Cron || (*s)->every.type == Every_NotInCron)
-                FREE((*s)->every.spec.cron);
-        if ((*s)->uid)
-                _gcuid(&(*s)->uid);
-        if ((*s)->euid)
-                _gcuid(&(*s)->euid);
-        if ((*s)->gid)
-                _gcgid(&(*s)->gid);
-        if ((*s)->pidlist)
-                _gcpid(&(*s)->pidlist);
-        if ((*s)->ppidlist)
-                _gcppid(&(*s)->ppidlist);
-        if ((*s)->fsflaglist)
-                _gcfsflag(&(*s)->fsflaglist);
-        if ((*s)->nonexistlist)
-                _gcnonexist(&(*s)->nonexistlist);
-        if ((*s)->dependantlist)
-                _gcpdl(&(*s)->dependantlist);
+        if ((*s)->dirscan)
+                DirScan_free(&(*s)->dirscan);
+        if ((*s)->fileset)
+                FileSet_free(&(*s)->fileset);
+        if ((*s)->treesum)
+                TreeSum_free(&(*s)->treesum);
+        if ((*s)->every.type == Every_Cron || (*s)->every.type == Every_NotInCron) {
+                FREE((*s)->every.spec.cron.string);
+                if ((*s)->every.spec.cron.compiled)
+                        Cron_free(&(*s)->every.spec.cron.compiled);
+        }
         if ((*s)->start)
                 gccmd(&(*s)->start);
         if ((*s)->stop)
                 gccmd(&(*s)->stop);
-        if ((*s)->action_DATA)
-                _gc_eventaction(&(*s)->action_DATA);
-        if ((*s)->action_EXEC)
-                _gc_eventaction(&(*s)->action_EXEC);
-        if ((*s)->action_INVALID)
-                _gc_eventaction(&(*s)->action_INVALID);
-        if ((*s)->action_MONIT_START)
-                _gc_eventaction(&(*s)->action_MONIT_START);
-        if ((*s)->action_MONIT_STOP)
-                _gc_eventaction(&(*s)->action_MONIT_STOP);
-        if ((*s)->action_ACTION)
-                _gc_eventaction(&(*s)->action_ACTION);
         if ((*s)->eventlist)
                 gc_event(&(*s)->eventlist);
+        FREE((*s)->eventtable.events);
         if ((*s)->inf) {
                 if ((*s)->type == Service_Net)
                         Link_free(&((*s)->inf->priv.net.stats));
+                else if ((*s)->type == Service_Process)
+                        FREE((*s)->inf->priv.process.thread.sample);
+                else if ((*s)->type == Service_File && (*s)->inf->priv.file.fd >= 0)
+                        close((*s)->inf->priv.file.fd);
                 FREE((*s)->inf);
         }
         FREE((*s)->name);
+        FREE((*s)->groups);
         FREE((*s)->path);
+        // The tests, the dependencies and the event actions are released with the region
+        if ((*s)->region)
+                Arena_free(&(*s)->region);
         (*s)->next = NULL;
         FREE(*s);
 }
@@ -290,9 +272,12 @@ static void _gc_request(Request_T *r) {
         ASSERT(r);
         if ((*r)->url)
                 _gc_url(&(*r)->url);
-        if ((*r)->regex)
-                regfree((*r)->regex);
-        FREE((*r)->regex);
+        while ((*r)->contents) {
+                RequestContent_T c = (*r)->contents;
+                (*r)->contents = c->next;
+                RegexCache_release(&c->regex);
+                FREE(c);
+        }
         FREE(*r);
 }
 
@@ -323,28 +308,14 @@ static void _gc_mail_server(MailServer_T *s) {
 }
 
 
-static void _gc_action(Action_T *a) {
-        ASSERT(a&&*a);
-        if ((*a)->exec)
-                gccmd(&(*a)->exec);
-        FREE(*a);
-}
-
-
-static void _gc_eventaction(EventAction_T *e) {
-        ASSERT(e&&*e);
-        _gc_action(&(*e)->failed);
-        _gc_action(&(*e)->succeeded);
-        FREE(*e);
-}
 
 
 static void _gcportlist(Port_T *p) {
         ASSERT(p&&*p);
         if ((*p)->next)
                 _gcportlist(&(*p)->next);
-        if ((*p)->action)
-                _gc_eventaction(&(*p)->action);
+        if ((*p)->session.socket)
+                Socket_free(&(*p)->session.socket);
         if ((*p)->url_request)
                 _gc_request(&(*p)->url_request);
         if ((*p)->family == Socket_Unix)
@@ -353,6 +324,14 @@ static void _gcportlist(Port_T *p) {
                 _gcssloptions(&((*p)->target.net.ssl));
         FREE((*p)->hostname);
         FREE((*p)->outgoing.ip);
+        FREE((*p)->responses.samples);
+        while ((*p)->metrics) {
+                ServerMetric_T m = (*p)->metrics;
+                (*p)->metrics = m->next;
+                FREE(m->name);
+                FREE(m->text);
+                FREE(m);
+        }
         if ((*p)->protocol->check == check_http) {
                 FREE((*p)->parameters.http.request);
                 FREE((*p)->parameters.http.checksum);
@@ -364,6 +343,36 @@ static void _gcportlist(Port_T *p) {
                         }
                         List_free(&(*p)->parameters.http.headers);
                 }
+        } else if ((*p)->protocol->check == check_http2) {
+                while ((*p)->parameters.http2.requests) {
+                        Http2Request_T r = (*p)->parameters.http2.requests;
+                        (*p)->parameters.http2.requests = r->next;
+                        while (r->contents) {
+                                RequestContent_T c = r->contents;
+                                r->contents = c->next;
+                                RegexCache_release(&c->regex);
+                                FREE(c);
+                        }
+                        FREE(r->path);
+                        FREE(r);
+                }
+                if ((*p)->parameters.http2.headers) {
+                        List_T l = (*p)->parameters.http2.headers;
+                        while (List_length(l) > 0) {
+                                char *s = List_pop(l);
+                                FREE(s);
+                        }
+                        List_free(&(*p)->parameters.http2.headers);
+                }
+        } else if ((*p)->protocol->check == check_grpc) {
+                if ((*p)->parameters.grpc.services) {
+                        List_T l = (*p)->parameters.grpc.services;
+                        while (List_length(l) > 0) {
+                                char *s = List_pop(l);
+                                FREE(s);
+                        }
+                        List_free(&(*p)->parameters.grpc.services);
+                }
         } else if ((*p)->protocol->check == check_generic) {
                 if ((*p)->parameters.generic.sendexpect)
                         _gcgeneric(&(*p)->parameters.generic.sendexpect);
@@ -377,6 +386,12 @@ static void _gcportlist(Port_T *p) {
                 FREE((*p)->parameters.smtp.password);
         } else if ((*p)->protocol->check == check_radius) {
                 FREE((*p)->parameters.radius.secret);
+        } else if ((*p)->protocol->check == check_snmp) {
+                FREE((*p)->parameters.snmp.community);
+                FREE((*p)->parameters.snmp.username);
+                FREE((*p)->parameters.snmp.password);
+                FREE((*p)->parameters.snmp.privacy);
+                FREE((*p)->parameters.snmp.engine);
         } else if ((*p)->protocol->check == check_websocket) {
                 FREE((*p)->parameters.websocket.host);
                 FREE((*p)->parameters.websocket.origin);
@@ -388,210 +403,48 @@ static void _gcportlist(Port_T *p) {
 }
 
 
-static void _gcfilesystem(Filesystem_T *d) {
-        ASSERT(d&&*d);
-        if ((*d)->next)
-                _gcfilesystem(&(*d)->next);
-        if ((*d)->action)
-                _gc_eventaction(&(*d)->action);
-        FREE(*d);
-}
-
 
 static void _gcicmp(Icmp_T *i) {
         ASSERT(i&&*i);
         if ((*i)->next)
                 _gcicmp(&(*i)->next);
         FREE((*i)->outgoing.ip);
-        if ((*i)->action)
-                _gc_eventaction(&(*i)->action);
         FREE(*i);
 }
 
 
-static void _gcpql(Resource_T *q) {
-        ASSERT(q);
-        if ((*q)->next)
-                _gcpql(&(*q)->next);
-        if ((*q)->action)
-                _gc_eventaction(&(*q)->action);
-        FREE(*q);
-}
-
-
-static void _gcptl(Timestamp_T *p) {
-        ASSERT(p);
-        if ((*p)->next)
-                _gcptl(&(*p)->next);
-        if ((*p)->action)
-                _gc_eventaction(&(*p)->action);
-        FREE(*p);
-}
-
-
-static void _gcparl(ActionRate_T *ar) {
-        ASSERT(ar);
-        if ((*ar)->next)
-                _gcparl(&(*ar)->next);
-        if ((*ar)->action)
-                _gc_eventaction(&(*ar)->action);
-        FREE(*ar);
-}
-
-
-static void _gcso(Size_T *s) {
-        ASSERT(s);
-        if ((*s)->next)
-                _gcso(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
-
-static void _gclinkstatus(LinkStatus_T *l) {
-        ASSERT(l);
-        if ((*l)->next)
-                _gclinkstatus(&(*l)->next);
-        if ((*l)->action)
-                _gc_eventaction(&(*l)->action);
-        FREE(*l);
-}
-
 
-static void _gclinkspeed(LinkSpeed_T *l) {
-        ASSERT(l);
-        if ((*l)->next)
-                _gclinkspeed(&(*l)->next);
-        if ((*l)->action)
-                _gc_eventaction(&(*l)->action);
-        FREE(*l);
-}
 
 
-static void _gclinksaturation(LinkSaturation_T *l) {
-        ASSERT(l);
-        if ((*l)->next)
-                _gclinksaturation(&(*l)->next);
-        if ((*l)->action)
-                _gc_eventaction(&(*l)->action);
-        FREE(*l);
-}
 
 
-static void _gcbandwidth(Bandwidth_T *b) {
-        ASSERT(b);
-        if ((*b)->next)
-                _gcbandwidth(&(*b)->next);
-        if ((*b)->action)
-                _gc_eventaction(&(*b)->action);
-        FREE(*b);
-}
 
 static void _gcmatch(Match_T *s) {
         ASSERT(s);
         if ((*s)->next)
                 _gcmatch(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
         FREE((*s)->match_path);
         FREE((*s)->match_string);
-        if ((*s)->regex_comp) {
-                regfree((*s)->regex_comp);
-                FREE((*s)->regex_comp);
-        }
+        FREE((*s)->container);
+        RegexCache_release(&(*s)->regex_comp);
         FREE(*s);
 }
 
 
 static void _gcchecksum(Checksum_T *s) {
         ASSERT(s);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
+        ChecksumPool_cancel(*s);
         FREE(*s);
 }
 
 
-static void _gcperm(Perm_T *s) {
-        ASSERT(s);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
-
 
-static void _gcstatus(Status_T *s) {
-        ASSERT(s);
-        if ((*s)->next)
-                _gcstatus(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
 
 
-static void _gcuid(Uid_T *s) {
-        ASSERT(s);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
 
 
-static void _gcgid(Gid_T *s) {
-        ASSERT(s);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
 
 
-static void _gcpid(Pid_T *s) {
-        ASSERT(s);
-        if ((*s)->next)
-                _gcpid(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
-
-
-static void _gcppid(Pid_T *s) {
-        ASSERT(s);
-        if ((*s)->next)
-                _gcppid(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
-
-
-static void _gcfsflag(Fsflag_T *s) {
-        ASSERT(s);
-        if ((*s)->next)
-                _gcfsflag(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
-
-
-static void _gcnonexist(Nonexist_T *s) {
-        ASSERT(s);
-        if ((*s)->next)
-                _gcnonexist(&(*s)->next);
-        if ((*s)->action)
-                _gc_eventaction(&(*s)->action);
-        FREE(*s);
-}
-
-
-static void _gcpdl(Dependant_T *d) {
-        ASSERT(d);
-        if ((*d)->next)
-                _gcpdl(&(*d)->next);
-        FREE((*d)->dependant);
-        FREE(*d);
-}
 
 
 static void _gcgeneric(Generic_T *g) {
@@ -599,9 +452,7 @@ static void _gcgeneric(Generic_T *g) {
         if ((*g)->next)
                 _gcgeneric(&(*g)->next);
         FREE((*g)->send);
-        if ((*g)->expect != NULL)
-                regfree((*g)->expect);
-        FREE((*g)->expect);
+        RegexCache_release(&(*g)->expect);
         FREE(*g);
 
 }
@@ -622,8 +473,21 @@ static void _gc_mmonit(Mmonit_T *recv) {
         ASSERT(recv);
         if ((*recv)->next)
                 _gc_mmonit(&(*recv)->next);
+        MMonit_close(*recv);
+        Mutex_destroy((*recv)->mutex);
         _gc_url(&(*recv)->url);
         _gcssloptions(&((*recv)->ssl));
         FREE(*recv);
 }
 
+
+static void _gc_federationagent(FederationAgent_T *agent) {
+        ASSERT(agent);
+        if ((*agent)->next)
+                _gc_federationagent(&(*agent)->next);
+        Federation_free(*agent);
+        _gc_url(&(*agent)->url);
+        _gcssloptions(&((*agent)->ssl));
+        FREE(*agent);
+}
+
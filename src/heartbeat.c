@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
+#include "monit.h"
+#include "heartbeat.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The listener thread reads the heartbeat datagrams from the unix socket,
+ * the datagram payload is the service name. The thread polls the socket
+ * together with a pipe, Heartbeat_stop() writes to the pipe to wake it.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+static struct {
+        int socket;
+        int wakeup[2];
+        boolean_t running;
+        boolean_t stopped;
+        char *path;
+        Thread_T thread;
+} listener = {.socket = -1, .wakeup = {-1, -1}};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _close(void) {
+        close(listener.socket);
+        listener.socket = -1;
+        for (int i = 0; i < 2; i++) {
+                if (listener.wakeup[i] >= 0) {
+                        close(listener.wakeup[i]);
+                        listener.wakeup[i] = -1;
+                }
+        }
+}
+
+
+static void *_listener(void *args) {
+        set_signal_block();
+        char name[STRLEN];
+        while (! __atomic_load_n(&listener.stopped, __ATOMIC_ACQUIRE)) {
+                struct pollfd fds[2] = {{.fd = listener.socket, .events = POLLIN}, {.fd = listener.wakeup[0], .events = POLLIN}};
+                int rv = poll(fds, 2, -1);
+                if (rv < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("Heartbeat socket poll failed -- %s\n", STRERROR);
+                        break;
+                }
+                ssize_t n;
+                while ((fds[0].revents & POLLIN) && (n = recv(listener.socket, name, sizeof(name) - 1, MSG_DONTWAIT)) >= 0) {
+                        name[n] = 0;
+                        if (! Heartbeat_post(Str_trim(name)))
+                                DEBUG("Heartbeat for unknown service '%s' ignored\n", name);
+                }
+        }
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Heartbeat_post(const char *name) {
+        Service_T s = Util_getService(name);
+        if (! s || ! s->heartbeat)
+                return false;
+        __atomic_store_n(&s->heartbeat->timestamp, Time_now(), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&s->heartbeat->count, 1, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->heartbeat->received, Time_monotonic(), __ATOMIC_RELEASE);
+        DEBUG("'%s' heartbeat received\n", s->name);
+        return true;
+}
+
+
+boolean_t Heartbeat_start() {
+        if (! Run.heartbeat.socket || listener.running)
+                return listener.running;
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", Run.heartbeat.socket) >= (int)sizeof(addr.sun_path)) {
+                LogError("Heartbeat socket path '%s' is too long\n", Run.heartbeat.socket);
+                return false;
+        }
+        if ((listener.socket = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+                LogError("Cannot create the heartbeat socket -- %s\n", STRERROR);
+                return false;
+        }
+        if (fcntl(listener.socket, F_SETFD, FD_CLOEXEC) == -1) {
+                LogError("Cannot set close on exec option -- %s\n", STRERROR);
+                goto error;
+        }
+        if (pipe(listener.wakeup) < 0) {
+                LogError("Cannot create the heartbeat listener pipe -- %s\n", STRERROR);
+                goto error;
+        }
+        fcntl(listener.wakeup[0], F_SETFD, FD_CLOEXEC);
+        fcntl(listener.wakeup[1], F_SETFD, FD_CLOEXEC);
+        // Remove the socket left by a previous instance, but nothing else
+        struct stat st;
+        if (lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+                unlink(addr.sun_path);
+        if (bind(listener.socket, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                LogError("Cannot bind the heartbeat socket '%s' -- %s\n", addr.sun_path, STRERROR);
+                goto error;
+        }
+        if (chmod(addr.sun_path, 0660) < 0)
+                LogError("Cannot set the heartbeat socket '%s' permission -- %s\n", addr.sun_path, STRERROR);
+        listener.path = Str_dup(addr.sun_path);
+        listener.stopped = false;
+        Thread_create(listener.thread, _listener, NULL);
+        listener.running = true;
+        DEBUG("Heartbeat listener started at %s\n", listener.path);
+        return true;
+error:
+        _close();
+        return false;
+}
+
+
+void Heartbeat_stop() {
+        if (! listener.running)
+                return;
+        __atomic_store_n(&listener.stopped, true, __ATOMIC_RELEASE);
+        if (write(listener.wakeup[1], "", 1) < 0)
+                LogError("Heartbeat listener wakeup failed -- %s\n", STRERROR);
+        Thread_join(listener.thread);
+        _close();
+        unlink(listener.path);
+        FREE(listener.path);
+        listener.running = false;
+}
+
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_HEARTBEAT_H
+#define MONIT_HEARTBEAT_H
+
+
+/**
+ * Passive heartbeat checks. The 'check heartbeat' service doesn't probe
+ * anything, the monitored job pushes a heartbeat instead: either a POST
+ * to the /_heartbeat/<service> URL of the HTTP interface, or a datagram
+ * with the service name sent to the unix socket set with 'set heartbeat
+ * socket'. The service fails when no heartbeat arrived within the
+ * deadline of its 'if no heartbeat' test.
+ *
+ * @file
+ */
+
+
+#define HEARTBEAT_PATH "/_heartbeat/"
+
+
+/**
+ * Record a heartbeat of the service. Safe to call from any thread.
+ * @param name The service name
+ * @return true if the heartbeat was recorded, false if there is no
+ * heartbeat service with the given name
+ */
+boolean_t Heartbeat_post(const char *name);
+
+
+/**
+ * Open the heartbeat socket if set with 'set heartbeat socket' and start
+ * the listener thread
+ * @return true if the listener was started, otherwise false
+ */
+boolean_t Heartbeat_start(void);
+
+
+/**
+ * Stop the listener thread and remove the heartbeat socket
+ */
+void Heartbeat_stop(void);
+
+
+#endif
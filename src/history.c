@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "event.h"
+#include "history.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+
+
+/**
+ *  Ring of recent events with the text arena.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct HistoryEntry_T {
+        unsigned long long sequence;           /**< Event sequence number, 0 = empty slot */
+        time_t collected;                                        /**< Event timestamp */
+        const char *description;                  /**< Static event description string */
+        unsigned long long offset;  /**< Arena position of the "service\0message\0" text */
+        unsigned int length;                                  /**< The text length */
+} HistoryEntry_T;
+
+
+static struct {
+        unsigned long long sequence;                     /**< Last event sequence number */
+        unsigned long long position;              /**< Total number of bytes written to the arena */
+        HistoryEntry_T entries[HISTORY_SLOTS];
+        char arena[HISTORY_ARENA];
+} history = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _write(const char *s, size_t length) {
+        for (size_t i = 0; i < length; i++)
+                history.arena[(history.position + i) % HISTORY_ARENA] = s[i];
+        history.position += length;
+}
+
+
+static void _read(char *s, unsigned long long offset, size_t length) {
+        for (size_t i = 0; i < length; i++)
+                s[i] = history.arena[(offset + i) % HISTORY_ARENA];
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void History_add(Service_T S, Event_T E) {
+        ASSERT(S);
+        ASSERT(E);
+        const char *message = NVLSTR(E->message);
+        size_t serviceLength = strlen(S->name) + 1;
+        size_t messageLength = strlen(message) + 1;
+        // Long messages are cut, so one event cannot take over the whole arena
+        if (messageLength > HISTORY_ARENA / 16)
+                messageLength = HISTORY_ARENA / 16;
+        if (serviceLength > STRLEN)
+                serviceLength = STRLEN;
+        LOCK(mutex)
+        {
+                HistoryEntry_T *entry = &history.entries[history.sequence % HISTORY_SLOTS];
+                entry->sequence = ++history.sequence;
+                entry->collected = E->collected.tv_sec;
+                entry->description = Event_get_description(E);
+                entry->offset = history.position;
+                entry->length = (unsigned int)(serviceLength + messageLength);
+                _write(S->name, serviceLength - 1);
+                _write("", 1);
+                _write(message, messageLength - 1);
+                _write("", 1);
+        }
+        END_LOCK;
+}
+
+
+void History_print(StringBuffer_T sb, unsigned long long before, int limit) {
+        ASSERT(sb);
+        LOCK(mutex)
+        {
+                unsigned long long sequence = before && before <= history.sequence ? before - 1 : history.sequence;
+                char text[STRLEN + HISTORY_ARENA / 16];
+                for (int count = 0; sequence > 0 && history.sequence - sequence < HISTORY_SLOTS && count < limit; sequence--, count++) {
+                        HistoryEntry_T *entry = &history.entries[(sequence - 1) % HISTORY_SLOTS];
+                        char timestamp[26];
+                        Time_string(entry->collected, timestamp);
+                        if (history.position - entry->offset <= HISTORY_ARENA) {
+                                _read(text, entry->offset, entry->length);
+                                StringBuffer_append(sb, "%llu %s '%s' %s: %s\n", entry->sequence, timestamp, text, entry->description, text + strlen(text) + 1);
+                        } else {
+                                // The text was overwritten by the newer events
+                                StringBuffer_append(sb, "%llu %s %s\n", entry->sequence, timestamp, entry->description);
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+size_t History_memory(void) {
+        return sizeof(history);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_HISTORY_H
+#define MONIT_HISTORY_H
+
+
+/**
+ * Recent event history. The events which Monit logs are also recorded in a
+ * fixed size in-memory ring: each slot holds the event timestamp, the event
+ * description and the position of the service name and the event message in
+ * a fixed size text arena, which is reused circularly as well. The memory use
+ * is thus constant, the oldest events and messages are overwritten by the new
+ * ones. The history is available via the HTTP interface (/_events).
+ *
+ * @file
+ */
+
+
+#define HISTORY_SLOTS 1024                           /**< Number of recorded events */
+#define HISTORY_ARENA 131072        /**< Size of the service name and message arena */
+
+
+/**
+ * Record the event
+ * @param S The service the event belongs to
+ * @param E An event object
+ */
+void History_add(Service_T S, Event_T E);
+
+
+/**
+ * Print the recorded events, the newest first. Each line starts with the
+ * event sequence number, which can be used as the before argument of the
+ * next call to get the following page.
+ * @param sb The output buffer
+ * @param before Print the events older than the event with the given
+ * sequence number, 0 means from the newest event
+ * @param limit Print at most limit events
+ */
+void History_print(StringBuffer_T sb, unsigned long long before, int limit);
+
+
+/**
+ * Get the memory used by the event history
+ * @return The size in bytes
+ */
+size_t History_memory(void);
+
+
+#endif
@@ -118,14 +118,22 @@ void monit_http(Httpd_Action action) {
                         running = false;
                         break;
                 case Httpd_Start:
+                        if (running)
+                                break;
                         if (Run.httpd.flags & Httpd_Net)
                                 LogDebug("Starting Monit HTTP server at [%s]:%d\n", Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "*", Run.httpd.socket.net.port);
-                        else if (Run.httpd.flags & Httpd_Unix)
+                        if (Run.httpd.flags & Httpd_Unix)
                                 LogDebug("Starting Monit HTTP server at %s\n", Run.httpd.socket.unix.path);
                         Thread_create(thread, thread_wrapper, NULL);
                         LogDebug("Monit HTTP server started\n");
                         running = true;
                         break;
+                case Httpd_Suspend:
+                        Engine_suspend();
+                        break;
+                case Httpd_Resume:
+                        Engine_resume();
+                        break;
                 default:
                         LogError("Monit: Unknown http server action\n");
                         break;
@@ -60,6 +60,10 @@
 #include <sys/stat.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
@@ -84,6 +88,17 @@
 #include "protocol.h"
 #include "Color.h"
 #include "Box.h"
+#include "profiler.h"
+#include "counter.h"
+#include "history.h"
+#include "snapshot.h"
+#include "series.h"
+#include "federation.h"
+#include "state.h"
+#include "wakeup.h"
+#include "rpc.h"
+#include "heartbeat.h"
+#include "plugin.h"
 
 
 #define ACTION(c) ! strncasecmp(req->url, c, sizeof(c))
@@ -99,10 +114,79 @@
 #define STATUS2     "/_status2"
 #define SUMMARY     "/_summary"
 #define REPORT      "/_report"
+#define METRICS     "/_metrics"
+#define MEMORY      "/_memory"
+#define EVENTS      "/_events"
+#define SERIES      "/_series"
+#define FEDERATION  "/_federation"
+#define CERTIFICATES "/_certificates"
 #define RUN         "/_runtime"
 #define VIEWLOG     "/_viewlog"
 #define DOACTION    "/_doaction"
 #define FAVICON     "/favicon.ico"
+#define STATIC      "/_static/"
+
+
+/* The log page shows the tail of the log, by default the last VIEWLOG_LINES lines and at most VIEWLOG_MAX bytes */
+#define VIEWLOG_LINES 1000
+#define VIEWLOG_MAX   1048576
+
+
+/* A status poll waits at most STATUS_WAIT seconds for a change, an event stream is closed after STATUS_STREAM seconds (the client reconnects). Each waiting client holds a HTTP worker, so at most STATUS_WAITERS clients may wait */
+#define STATUS_WAIT    60
+#define STATUS_STREAM  300
+#define STATUS_WAITERS 2
+
+/* A client which waits for the action result gets a notice every ACTION_NOTICE seconds and gives up after ACTION_WAIT seconds */
+#define ACTION_NOTICE  10
+#define ACTION_WAIT    3600
+static int _waiters = 0;
+
+
+/* The home page lists at most HOME_PAGE services per page by default, the 'limit' parameter 0 lists all */
+#define HOME_PAGE 500
+
+
+/* Serializes the service action requests, as the requests are processed by several threads */
+static Mutex_T mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* The static assets are cached for a year, the pages link them with the ETag in the query, so a changed asset gets a new URL */
+#define ASSET_CACHE "public, max-age=31536000"
+
+
+typedef enum {
+        Asset_Favicon = 0,
+        Asset_Css
+} __attribute__((__packed__)) Asset_Type;
+
+
+/* The embedded static assets. The body is decoded and compressed once on the first use and shared by all requests, the strong ETag is the hash of the body */
+static struct {
+        const char *path;
+        const char *type;
+        const char *source;
+        boolean_t base64;                   /**< The source is base64 encoded */
+        unsigned char *data;
+        int length;
+        unsigned char *gzip;                /**< The gzip body or NULL if not smaller */
+        int gzipLength;
+        char etag[20];
+} assets[] = {
+        [Asset_Favicon] = {FAVICON, "image/x-icon", FAVICON_ICO, true},
+        [Asset_Css] = {STATIC "monit.css", "text/css", MONIT_CSS, false}
+};
+static boolean_t assetsInitialized = false;
+static Mutex_T assetsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* The summary of all services, rendered again only after some service status changed */
+static struct {
+        Mutex_T mutex;
+        unsigned long long generation;          /**< Run.generation of the table */
+        int count;                           /**< Number of the listed services */
+        StringBuffer_T table;
+} summary = {.mutex = PTHREAD_MUTEX_INITIALIZER};
 
 
 typedef enum {
@@ -111,23 +195,48 @@ typedef enum {
 } __attribute__((__packed__)) Output_Type;
 
 
+typedef enum {
+        HomeState_All = 0,
+        HomeState_Ok,
+        HomeState_Failed,
+        HomeState_Unmonitored
+} __attribute__((__packed__)) HomeState_Type;
+
+
+/* Filter and page of the services listed on the home page */
+typedef struct HomeFilter_T {
+        char *name;                                /**< Service name prefix or NULL */
+        char *group;                               /**< Service group name or NULL */
+        int type;                               /**< Service type or -1 for all */
+        HomeState_Type state;
+        ServiceGroup_T members;         /**< The service group or NULL if not found */
+        int offset;                    /**< Number of the matching services to skip */
+        int limit;               /**< Maximum number of listed services, 0 = all */
+        int matched;                     /**< Number of the matching services so far */
+} *HomeFilter_T;
+
+
 /* Private prototypes */
 static boolean_t is_readonly(HttpRequest);
-static void printFavicon(HttpResponse);
+static void _initAssets(void);
+static void _printAsset(HttpRequest, HttpResponse);
 static void doGet(HttpRequest, HttpResponse);
 static void doPost(HttpRequest, HttpResponse);
 static void do_head(HttpResponse res, const char *path, const char *name, int refresh);
 static void do_foot(HttpResponse res);
 static void do_home(HttpRequest, HttpResponse);
-static void do_home_system(HttpRequest, HttpResponse);
-static void do_home_filesystem(HttpRequest, HttpResponse);
-static void do_home_directory(HttpRequest, HttpResponse);
-static void do_home_file(HttpRequest, HttpResponse);
-static void do_home_fifo(HttpRequest, HttpResponse);
-static void do_home_net(HttpRequest, HttpResponse);
-static void do_home_process(HttpRequest, HttpResponse);
-static void do_home_program(HttpRequest, HttpResponse);
-static void do_home_host(HttpRequest, HttpResponse);
+static void do_home_system(HttpResponse, HomeFilter_T);
+static void do_home_filesystem(HttpResponse, HomeFilter_T);
+static void do_home_directory(HttpResponse, HomeFilter_T);
+static void do_home_file(HttpResponse, HomeFilter_T);
+static void do_home_fifo(HttpResponse, HomeFilter_T);
+static void do_home_net(HttpResponse, HomeFilter_T);
+static void do_home_socket(HttpResponse, HomeFilter_T);
+static void do_home_heartbeat(HttpResponse, HomeFilter_T);
+static void do_home_metric(HttpResponse, HomeFilter_T);
+static void do_home_process(HttpResponse, HomeFilter_T);
+static void do_home_program(HttpResponse, HomeFilter_T);
+static void do_home_host(HttpResponse, HomeFilter_T);
 static void do_about(HttpRequest, HttpResponse);
 static void do_ping(HttpRequest, HttpResponse);
 static void do_getid(HttpRequest, HttpResponse);
@@ -150,6 +259,7 @@ static void print_service_rules_uid(HttpResponse, Service_T);
 static void print_service_rules_euid(HttpResponse, Service_T);
 static void print_service_rules_gid(HttpResponse, Service_T);
 static void print_service_rules_timestamp(HttpResponse, Service_T);
+static void print_service_rules_heartbeat(HttpResponse, Service_T);
 static void print_service_rules_fsflags(HttpResponse, Service_T);
 static void print_service_rules_filesystem(HttpResponse, Service_T);
 static void print_service_rules_size(HttpResponse, Service_T);
@@ -161,17 +271,34 @@ static void print_service_rules_uploadpackets(HttpResponse, Service_T);
 static void print_service_rules_downloadbytes(HttpResponse, Service_T);
 static void print_service_rules_downloadpackets(HttpResponse, Service_T);
 static void print_service_rules_uptime(HttpResponse, Service_T);
+static void print_service_rules_responsetime(HttpResponse, Service_T);
+static void print_service_rules_growth(HttpResponse, Service_T);
 static void print_service_rules_content(HttpResponse, Service_T);
 static void print_service_rules_checksum(HttpResponse, Service_T);
 static void print_service_rules_pid(HttpResponse, Service_T);
 static void print_service_rules_ppid(HttpResponse, Service_T);
 static void print_service_rules_program(HttpResponse, Service_T);
 static void print_service_rules_resource(HttpResponse, Service_T);
+static boolean_t _isRequested(HttpRequest, Service_T);
+static const char *_missingService(HttpRequest);
 static void print_status(HttpRequest, HttpResponse, int);
+static void _streamStatus(HttpResponse, unsigned long long);
+static void _streamProgress(HttpResponse, const char *, Service_T *, unsigned int *, int);
 static void print_summary(HttpRequest, HttpResponse);
 static void _printReport(HttpRequest req, HttpResponse res);
+static void _resetSummary(void);
+static void _printMetrics(HttpRequest req, HttpResponse res);
+static void _printMemory(HttpRequest req, HttpResponse res);
+static void _printEvents(HttpRequest req, HttpResponse res);
+static void _printSeries(HttpRequest req, HttpResponse res);
+static void _printFederation(HttpRequest req, HttpResponse res);
+static void _printCertificates(HttpRequest req, HttpResponse res);
+static void _handleRpc(HttpRequest req, HttpResponse res);
+static void _handleHeartbeat(HttpRequest req, HttpResponse res);
+static unsigned int _scheduleAction(Service_T s, Action_Type doaction, const char *action);
 static void status_service_txt(Service_T, HttpResponse);
 static char *get_monitoring_status(Output_Type, Service_T s, char *, int);
+static char *_getRestartBackoff(Service_T s, char *, int);
 static char *get_service_status(Output_Type, Service_T, char *, int);
 
 
@@ -264,7 +391,7 @@ static void _formatStatus(const char *name, Event_Type errorType, Output_Type ty
                                         column = 0;
                                         continue;
                                 } else if (column <= 200) {
-                                        StringBuffer_append(res->outputbuffer, "%c", _value[i]);
+                                        StringBuffer_appendChar(res->outputbuffer, _value[i]);
                                         column++;
                                 }
                         }
@@ -276,6 +403,44 @@ static void _formatStatus(const char *name, Event_Type errorType, Output_Type ty
 }
 
 
+static void _printResponseTimePercentiles(const char *name, Output_Type type, HttpResponse res, Service_T s, Port_T p) {
+        if (p->responses.count)
+                _formatStatus(name, Event_Null, type, res, s, true, "p50 %s, p90 %s, p99 %s over the last %d tests",
+                              Str_milliToTime(Util_getResponseTimePercentile(p, 50), (char[23]){}),
+                              Str_milliToTime(Util_getResponseTimePercentile(p, 90), (char[23]){}),
+                              Str_milliToTime(Util_getResponseTimePercentile(p, 99), (char[23]){}),
+                              p->responses.count);
+}
+
+
+static void _printResponseTimePhases(const char *name, Output_Type type, HttpResponse res, Service_T s, Port_T p) {
+        const char *names[] = {"dns", "connect", "tls", "first byte"};
+        double values[] = {p->phases.dns, p->phases.connect, p->phases.tls, p->phases.firstbyte};
+        char phases[STRLEN] = {};
+        for (int i = 0; i < 4; i++)
+                if (values[i] >= 0.)
+                        snprintf(phases + strlen(phases), sizeof(phases) - strlen(phases), "%s%s %s", *phases ? ", " : "", names[i], Str_milliToTime(values[i], (char[23]){}));
+        if (*phases)
+                _formatStatus(name, Event_Null, type, res, s, true, "%s", phases);
+}
+
+
+/**
+ * Print the available pressure stall information, the "some" and "full" shares averaged over 10, 60 and 300 seconds
+ */
+static void _printPressure(const char *scope, Output_Type type, HttpResponse res, Service_T s, Pressure_T *pressure) {
+        for (int i = 0; i <= Pressure_Last; i++) {
+                if (pressure[i].some[0] >= 0.) {
+                        char name[STRLEN];
+                        snprintf(name, sizeof(name), "%s%s pressure", scope, pressurenames[i]);
+                        _formatStatus(name, Event_Resource, type, res, s, true, "some %.1f%% %.1f%% %.1f%%, full %.1f%% %.1f%% %.1f%%",
+                                      pressure[i].some[0], pressure[i].some[1], pressure[i].some[2],
+                                      pressure[i].full[0] > 0. ? pressure[i].full[0] : 0., pressure[i].full[1] > 0. ? pressure[i].full[1] : 0., pressure[i].full[2] > 0. ? pressure[i].full[2] : 0.);
+                }
+        }
+}
+
+
 static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
         if (Util_hasServiceStatus(s)) {
                 switch (s->type) {
@@ -284,14 +449,46 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("cpu", Event_Resource, type, res, s, true, "%.1f%%us %.1f%%sy"
 #ifdef HAVE_CPU_WAIT
                                         " %.1f%%wa"
+#endif
+#ifdef HAVE_CPU_STEAL
+                                        " %.1f%%st"
 #endif
                                         , systeminfo.total_cpu_user_percent > 0. ? systeminfo.total_cpu_user_percent : 0., systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.
 #ifdef HAVE_CPU_WAIT
                                         , systeminfo.total_cpu_wait_percent > 0. ? systeminfo.total_cpu_wait_percent : 0.
+#endif
+#ifdef HAVE_CPU_STEAL
+                                        , systeminfo.total_cpu_steal_percent > 0. ? systeminfo.total_cpu_steal_percent : 0.
 #endif
                                 );
+                                if (systeminfo.cpu.count > 0) {
+                                        int busiest = -1;
+                                        for (int i = 0; i < systeminfo.cpu.count; i++)
+                                                if (systeminfo.cpu.usage[i] >= 0. && (busiest < 0 || systeminfo.cpu.usage[i] > systeminfo.cpu.usage[busiest]))
+                                                        busiest = i;
+                                        _formatStatus("busiest cpu", Event_Resource, type, res, s, busiest >= 0, "cpu%d %.1f%% [%.1f%% steal]", busiest, busiest >= 0 ? systeminfo.cpu.usage[busiest] : 0., busiest >= 0 ? systeminfo.cpu.steal[busiest] : 0.);
+                                }
+                                if (systeminfo.node.count > 1) {
+                                        StringBuffer_T nodes = StringBuffer_create(64);
+                                        for (int i = 0; i < systeminfo.node.count; i++)
+                                                if (systeminfo.node.usage[i] >= 0.)
+                                                        StringBuffer_append(nodes, "%snode%d %.1f%%", StringBuffer_length(nodes) ? " " : "", i, systeminfo.node.usage[i]);
+                                        _formatStatus("numa node cpu", Event_Resource, type, res, s, StringBuffer_length(nodes) > 0, "%s", StringBuffer_toString(nodes));
+                                        StringBuffer_free(&nodes);
+                                }
                                 _formatStatus("memory usage", Event_Resource, type, res, s, true, "%s [%.1f%%]", Str_bytesToSize(systeminfo.total_mem, (char[10]){}), systeminfo.total_mem_percent);
                                 _formatStatus("swap usage", Event_Resource, type, res, s, true, "%s [%.1f%%]", Str_bytesToSize(systeminfo.total_swap, (char[10]){}), systeminfo.total_swap_percent);
+                                _printPressure("", type, res, s, systeminfo.pressure);
+                                for (int i = 0; i < systeminfo.gpu.count; i++) {
+                                        GpuDevice_T *gpu = &systeminfo.gpu.device[i];
+                                        char name[32];
+                                        snprintf(name, sizeof(name), "gpu%d", i);
+                                        _formatStatus(name, Event_Resource, type, res, s, gpu->usage >= 0. && gpu->memory >= 0, "%.1f%% usage, %s [%.1f%%] memory, %.0f C [%s]", gpu->usage, Str_bytesToSize(gpu->memory, (char[10]){}), gpu->memory_percent, gpu->temperature, gpu->name);
+                                        if (gpu->ecc > 0) {
+                                                snprintf(name, sizeof(name), "gpu%d ecc errors", i);
+                                                _formatStatus(name, Event_Resource, type, res, s, true, "%lld", gpu->ecc);
+                                        }
+                                }
                                 _formatStatus("uptime", Event_Uptime, type, res, s, systeminfo.booted > 0, "%s", _getUptime(Time_now() - systeminfo.booted, (char[256]){}));
                                 _formatStatus("boot time", Event_Null, type, res, s, true, "%s", Time_string(systeminfo.booted, (char[32]){}));
                                 break;
@@ -313,6 +510,13 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("uid", Event_Uid, type, res, s, s->inf->priv.directory.uid >= 0, "%d", s->inf->priv.directory.uid);
                                 _formatStatus("gid", Event_Gid, type, res, s, s->inf->priv.directory.gid >= 0, "%d", s->inf->priv.directory.gid);
                                 _formatStatus("timestamp", Event_Timestamp, type, res, s, s->inf->priv.directory.timestamp > 0, "%s", Time_string(s->inf->priv.directory.timestamp, (char[32]){}));
+                                if (s->dirscan) {
+                                        _formatStatus("total size", Event_Resource, type, res, s, s->inf->priv.directory.tree.size >= 0, "%s", Str_bytesToSize(s->inf->priv.directory.tree.size, (char[10]){}));
+                                        _formatStatus("files", Event_Resource, type, res, s, s->inf->priv.directory.tree.files >= 0, "%lld", s->inf->priv.directory.tree.files);
+                                        _formatStatus("directories", Event_Resource, type, res, s, s->inf->priv.directory.tree.directories >= 0, "%lld", s->inf->priv.directory.tree.directories);
+                                        _formatStatus("oldest file", Event_Resource, type, res, s, s->inf->priv.directory.tree.oldest > 0, "%s", Time_string(s->inf->priv.directory.tree.oldest, (char[32]){}));
+                                        _formatStatus("newest file", Event_Resource, type, res, s, s->inf->priv.directory.tree.newest > 0, "%s", Time_string(s->inf->priv.directory.tree.newest, (char[32]){}));
+                                }
                                 break;
 
                         case Service_Fifo:
@@ -341,6 +545,31 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 }
                                 break;
 
+                        case Service_Socket:
+                                _formatStatus("connections", Event_Resource, type, res, s, s->inf->priv.socket.connections >= 0, "%d", s->inf->priv.socket.connections);
+                                _formatStatus("established", Event_Resource, type, res, s, s->inf->priv.socket.established >= 0, "%d", s->inf->priv.socket.established);
+                                _formatStatus("time wait", Event_Resource, type, res, s, s->inf->priv.socket.timewait >= 0, "%d", s->inf->priv.socket.timewait);
+                                _formatStatus("close wait", Event_Resource, type, res, s, s->inf->priv.socket.closewait >= 0, "%d", s->inf->priv.socket.closewait);
+                                _formatStatus("listen sockets", Event_Resource, type, res, s, s->inf->priv.socket.listen >= 0, "%d", s->inf->priv.socket.listen);
+                                _formatStatus("listen queue", Event_Resource, type, res, s, s->inf->priv.socket.queue >= 0, "%d/%d", s->inf->priv.socket.queue, s->inf->priv.socket.backlog);
+                                _formatStatus("listen drops", Event_Resource, type, res, s, s->inf->priv.socket.drops >= 0, "%lld", s->inf->priv.socket.drops);
+                                break;
+
+                        case Service_Metric:
+                                _formatStatus("metric type", Event_Null, type, res, s, true, "%s", metrictypenames[s->inf->priv.metric.type]);
+                                _formatStatus("value", Event_Resource, type, res, s, s->inf->priv.metric.type != Metric_Unknown, "%g", s->inf->priv.metric.value);
+                                _formatStatus("rate", Event_Resource, type, res, s, s->inf->priv.metric.rate >= 0, "%g per second", s->inf->priv.metric.rate);
+                                if (s->inf->priv.metric.type == Metric_Timer)
+                                        _formatStatus("max", Event_Resource, type, res, s, true, "%g", s->inf->priv.metric.max);
+                                _formatStatus("samples", Event_Null, type, res, s, true, "%llu", s->inf->priv.metric.samples);
+                                break;
+
+                        case Service_Heartbeat:
+                                _formatStatus("last heartbeat", Event_Heartbeat, type, res, s, s->inf->priv.heartbeat.timestamp > 0, "%s", Time_string(s->inf->priv.heartbeat.timestamp, (char[32]){}));
+                                _formatStatus("heartbeat age", Event_Heartbeat, type, res, s, s->inf->priv.heartbeat.age >= 0, "%s", _getUptime(s->inf->priv.heartbeat.age, (char[256]){}));
+                                _formatStatus("heartbeats", Event_Null, type, res, s, true, "%llu", s->inf->priv.heartbeat.count);
+                                break;
+
                         case Service_Filesystem:
                                 _formatStatus("permission", Event_Permission, type, res, s, s->inf->priv.filesystem.mode >= 0, "%o", s->inf->priv.filesystem.mode & 07777);
                                 _formatStatus("uid", Event_Uid, type, res, s, s->inf->priv.filesystem.uid >= 0, "%d", s->inf->priv.filesystem.uid);
@@ -360,6 +589,20 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                         _formatStatus("inodes total", Event_Null, type, res, s, true, "%lld", s->inf->priv.filesystem.f_files);
                                         _formatStatus("inodes free", Event_Resource, type, res, s, true, "%lld [%.1f%%]", s->inf->priv.filesystem.f_filesfree, (float)100 * (float)s->inf->priv.filesystem.f_filesfree / (float)s->inf->priv.filesystem.f_files);
                                 }
+                                if (s->inf->priv.filesystem.io.utilization >= 0.) {
+                                        _formatStatus("disk read", Event_Resource, type, res, s, true, "%s/s [%.1f operations/s]", Str_bytesToSize(s->inf->priv.filesystem.io.read_bytes, (char[10]){}), s->inf->priv.filesystem.io.read_operations);
+                                        _formatStatus("disk write", Event_Resource, type, res, s, true, "%s/s [%.1f operations/s]", Str_bytesToSize(s->inf->priv.filesystem.io.write_bytes, (char[10]){}), s->inf->priv.filesystem.io.write_operations);
+                                        _formatStatus("disk service time", Event_Resource, type, res, s, true, "%.3f ms", s->inf->priv.filesystem.io.service_time);
+                                        _formatStatus("disk utilization", Event_Resource, type, res, s, true, "%.1f%%", s->inf->priv.filesystem.io.utilization);
+                                }
+                                for (Quota_T q = s->quotalist; q; q = q->next) {
+                                        char name[STRLEN];
+                                        snprintf(name, sizeof(name), "quota %s%s %d", q->inode ? "inodes " : "", quotatypenames[q->type], q->id);
+                                        if (q->inode)
+                                                _formatStatus(name, Event_Resource, type, res, s, q->usage.found, "%lld of %lld", q->usage.used, q->usage.limit);
+                                        else
+                                                _formatStatus(name, Event_Resource, type, res, s, q->usage.found, "%s of %s", Str_bytesToSize(q->usage.used, (char[10]){}), q->usage.limit > 0 ? Str_bytesToSize(q->usage.limit, (char[10]){}) : "unlimited");
+                                }
                                 break;
 
                         case Service_Process:
@@ -376,13 +619,44 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                         _formatStatus("cpu total", Event_Resource, type, res, s, s->inf->priv.process.total_cpu_percent >= 0, "%.1f%%", s->inf->priv.process.total_cpu_percent);
                                         _formatStatus("memory", Event_Resource, type, res, s, s->inf->priv.process.mem_percent >= 0, "%.1f%% [%s]", s->inf->priv.process.mem_percent, Str_bytesToSize(s->inf->priv.process.mem, (char[10]){}));
                                         _formatStatus("memory total", Event_Resource, type, res, s, s->inf->priv.process.total_mem_percent >= 0, "%.1f%% [%s]", s->inf->priv.process.total_mem_percent, Str_bytesToSize(s->inf->priv.process.total_mem, (char[10]){}));
+                                        if (s->inf->priv.process.read_rate >= 0 || s->inf->priv.process.write_rate >= 0) {
+                                                _formatStatus("disk read", Event_Resource, type, res, s, s->inf->priv.process.read_rate >= 0, "%s/s", Str_bytesToSize(s->inf->priv.process.read_rate, (char[10]){}));
+                                                _formatStatus("disk write", Event_Resource, type, res, s, s->inf->priv.process.write_rate >= 0, "%s/s", Str_bytesToSize(s->inf->priv.process.write_rate, (char[10]){}));
+                                        }
+                                        if (s->inf->priv.process.voluntary_rate >= 0) {
+                                                _formatStatus("voluntary ctx switches", Event_Resource, type, res, s, true, "%.1f/s", s->inf->priv.process.voluntary_rate);
+                                                _formatStatus("nonvoluntary ctx switches", Event_Resource, type, res, s, s->inf->priv.process.nonvoluntary_rate >= 0, "%.1f/s", s->inf->priv.process.nonvoluntary_rate);
+                                        }
+                                        if (s->inf->priv.process.filedescriptors >= 0)
+                                                _formatStatus("file descriptors", Event_Resource, type, res, s, true, "%d", s->inf->priv.process.filedescriptors);
+                                        if (s->inf->priv.process.cgroup.memory >= 0)
+                                                _formatStatus("cgroup memory", Event_Resource, type, res, s, true, "%s", Str_bytesToSize(s->inf->priv.process.cgroup.memory, (char[10]){}));
+                                        _printPressure("cgroup ", type, res, s, s->inf->priv.process.cgroup.pressure);
+                                        if (s->inf->priv.process.cgroup.cpu_percent >= 0)
+                                                _formatStatus("cgroup cpu", Event_Resource, type, res, s, true, "%.1f%%", s->inf->priv.process.cgroup.cpu_percent);
+                                        if (s->inf->priv.process.cgroup.read_rate >= 0 || s->inf->priv.process.cgroup.write_rate >= 0) {
+                                                _formatStatus("cgroup disk read", Event_Resource, type, res, s, s->inf->priv.process.cgroup.read_rate >= 0, "%s/s", Str_bytesToSize(s->inf->priv.process.cgroup.read_rate, (char[10]){}));
+                                                _formatStatus("cgroup disk write", Event_Resource, type, res, s, s->inf->priv.process.cgroup.write_rate >= 0, "%s/s", Str_bytesToSize(s->inf->priv.process.cgroup.write_rate, (char[10]){}));
+                                        }
+                                        if (s->inf->priv.process.gpu_memory >= 0)
+                                                _formatStatus("gpu memory", Event_Resource, type, res, s, true, "%s", Str_bytesToSize(s->inf->priv.process.gpu_memory, (char[10]){}));
+                                        if (s->inf->priv.process.thread.cpu_percent >= 0)
+                                                _formatStatus("busiest thread cpu", Event_Resource, type, res, s, true, "%.1f%% [%d %s]", s->inf->priv.process.thread.cpu_percent, s->inf->priv.process.thread.tid, s->inf->priv.process.thread.name);
                                 }
                                 break;
 
                         case Service_Program:
-                                if (s->program->started) {
-                                        _formatStatus("last exit value", Event_Status, type, res, s, true, "%d", s->program->exitStatus);
-                                        _formatStatus("last output", Event_Status, type, res, s, StringBuffer_length(s->program->output), "%s", StringBuffer_toString(s->program->output)); //FIXME: use both columns
+                                if (s->snapshot.program.started) {
+                                        _formatStatus("last exit value", Event_Status, type, res, s, true, "%d", s->snapshot.program.exitStatus);
+                                        if (s->snapshot.program.usage.cpuTime >= 0)
+                                                _formatStatus("last cpu time", Event_Resource, type, res, s, true, "%s", Str_milliToTime(s->snapshot.program.usage.cpuTime / 1000., (char[23]){}));
+                                        if (s->snapshot.program.usage.memory >= 0)
+                                                _formatStatus("last peak memory", Event_Resource, type, res, s, true, "%s", Str_bytesToSize(s->snapshot.program.usage.memory, (char[10]){}));
+                                        if (s->snapshot.program.usage.runTime >= 0)
+                                                _formatStatus("last run time", Event_Resource, type, res, s, true, "%s", Str_milliToTime(s->snapshot.program.usage.runTime, (char[23]){}));
+                                        char *output = Snapshot_getOutput(s);
+                                        _formatStatus("last output", Event_Status, type, res, s, *output, "%s", output); //FIXME: use both columns
+                                        FREE(output);
                                 }
                                 break;
 
@@ -394,13 +668,19 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                                 _formatStatus("ping response time", Event_Icmp, type, res, s, true, "connection failed");
                         else
                                 _formatStatus("ping response time", Event_Connection, type, res, s, i->is_available != Connection_Init && i->response >= 0., "%s", Str_milliToTime(i->response, (char[23]){}));
+                        if (i->is_available == Connection_Ok && i->loss >= 0) {
+                                _formatStatus("ping jitter", Event_Icmp, type, res, s, true, "%s", Str_milliToTime(i->jitter, (char[23]){}));
+                                _formatStatus("ping loss", Event_Icmp, type, res, s, true, "%d%%", i->loss);
+                        }
                 }
                 for (Port_T p = s->portlist; p; p = p->next) {
                         if (p->is_available == Connection_Failed) {
                                 _formatStatus("port response time", Event_Connection, type, res, s, true, "FAILED to [%s]:%d%s type %s/%s %sprotocol %s", p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), p->target.net.ssl.flags ? "using SSL/TLS " : "", p->protocol->name);
                         } else {
-                                _formatStatus("port response time", Event_Connection, type, res, s, p->is_available != Connection_Init, "%s to %s:%d%s type %s/%s %s protocol %s", Str_milliToTime(p->response, (char[23]){}), p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), p->target.net.ssl.flags ? "using SSL/TLS " : "", p->protocol->name);
+                                _formatStatus("port response time", Event_Connection, type, res, s, p->is_available != Connection_Init, "%s to %s:%d%s type %s/%s%s %s protocol %s", Str_milliToTime(p->response, (char[23]){}), p->hostname, p->target.net.port, Util_portRequestDescription(p), Util_portTypeDescription(p), Util_portIpDescription(p), p->family != Socket_Ip || ! p->connected ? "" : p->connected == Socket_Ip6 ? " via IPv6" : " via IPv4", p->target.net.ssl.flags ? "using SSL/TLS " : "", p->protocol->name);
                         }
+                        _printResponseTimePercentiles("port response percentiles", type, res, s, p);
+                        _printResponseTimePhases("port response phases", type, res, s, p);
                 }
                 for (Port_T p = s->socketlist; p; p = p->next) {
                         if (p->is_available == Connection_Failed) {
@@ -408,6 +688,8 @@ static void _printStatus(Output_Type type, HttpResponse res, Service_T s) {
                         } else {
                                 _formatStatus("unix socket response time", Event_Connection, type, res, s, p->is_available != Connection_Init, "%s to %s type %s protocol %s", Str_milliToTime(p->response, (char[23]){}), p->target.unix.pathname, Util_portTypeDescription(p), p->protocol->name);
                         }
+                        _printResponseTimePercentiles("socket response percentiles", type, res, s, p);
+                        _printResponseTimePhases("socket response phases", type, res, s, p);
                 }
         }
         _formatStatus("data collected", Event_Null, type, res, s, true, "%s", Time_string(s->collected.tv_sec, (char[32]){}));
@@ -430,10 +712,31 @@ static void doPost(HttpRequest req, HttpResponse res) {
                 print_summary(req, res);
         else if (ACTION(REPORT))
                 _printReport(req, res);
-        else if (ACTION(DOACTION))
+        else if (ACTION(METRICS))
+                _printMetrics(req, res);
+        else if (ACTION(MEMORY))
+                _printMemory(req, res);
+        else if (ACTION(EVENTS))
+                _printEvents(req, res);
+        else if (ACTION(SERIES))
+                _printSeries(req, res);
+        else if (ACTION(FEDERATION))
+                _printFederation(req, res);
+        else if (ACTION(CERTIFICATES))
+                _printCertificates(req, res);
+        else if (ACTION(RPC_PATH))
+                _handleRpc(req, res);
+        else if (Str_startsWith(req->url, HEARTBEAT_PATH))
+                _handleHeartbeat(req, res);
+        else if (ACTION(DOACTION)) {
+                LOCK(mutex)
                 handle_do_action(req, res);
-        else
+                END_LOCK;
+        } else {
+                LOCK(mutex)
                 handle_action(req, res);
+                END_LOCK;
+        }
 }
 
 
@@ -444,9 +747,7 @@ static void doPost(HttpRequest req, HttpResponse res) {
 static void doGet(HttpRequest req, HttpResponse res) {
         set_content_type(res, "text/html");
         if (ACTION(HOME)) {
-                LOCK(Run.mutex)
                 do_home(req, res);
-                END_LOCK;
         } else if (ACTION(RUN)) {
                 handle_run(req, res);
         } else if (ACTION(TEST)) {
@@ -455,8 +756,8 @@ static void doGet(HttpRequest req, HttpResponse res) {
                 do_viewlog(req, res);
         } else if (ACTION(ABOUT)) {
                 do_about(req, res);
-        } else if (ACTION(FAVICON)) {
-                printFavicon(res);
+        } else if (ACTION(FAVICON) || Str_startsWith(req->url, STATIC)) {
+                _printAsset(req, res);
         } else if (ACTION(PING)) {
                 do_ping(req, res);
         } else if (ACTION(GETID)) {
@@ -469,10 +770,26 @@ static void doGet(HttpRequest req, HttpResponse res) {
                 print_summary(req, res);
         } else if (ACTION(REPORT)) {
                 _printReport(req, res);
+        } else if (ACTION(METRICS)) {
+                _printMetrics(req, res);
+        } else if (ACTION(MEMORY)) {
+                _printMemory(req, res);
+        } else if (ACTION(EVENTS)) {
+                _printEvents(req, res);
+        } else if (ACTION(SERIES)) {
+                _printSeries(req, res);
+        } else if (ACTION(FEDERATION)) {
+                _printFederation(req, res);
+        } else if (ACTION(CERTIFICATES)) {
+                _printCertificates(req, res);
         } else if (ACTION(DOACTION)) {
+                LOCK(mutex)
                 handle_do_action(req, res);
+                END_LOCK;
         } else {
+                LOCK(mutex)
                 handle_action(req, res);
+                END_LOCK;
         }
 }
 
@@ -485,69 +802,77 @@ static void is_monit_running(HttpRequest req, HttpResponse res) {
 }
 
 
-static void printFavicon(HttpResponse res) {
-        static size_t l;
-        Socket_T S = res->S;
-        static unsigned char *favicon = NULL;
-
-        if (! favicon) {
-                favicon = CALLOC(sizeof(unsigned char), strlen(FAVICON_ICO));
-                l = decode_base64(favicon, FAVICON_ICO);
+/**
+ * Decode and compress the static assets and compute their ETags, once. The page head links the
+ * stylesheet with its ETag, so this is called also by the handlers which hold the action mutex.
+ */
+static void _initAssets(void) {
+        if (__atomic_load_n(&assetsInitialized, __ATOMIC_ACQUIRE))
+                return;
+        LOCK(assetsMutex)
+        {
+                if (! assetsInitialized) {
+                        for (int i = 0; i < (int)(sizeof(assets) / sizeof(assets[0])); i++) {
+                                if (assets[i].base64) {
+                                        assets[i].data = CALLOC(sizeof(unsigned char), strlen(assets[i].source));
+                                        assets[i].length = (int)decode_base64(assets[i].data, assets[i].source);
+                                } else {
+                                        assets[i].data = (unsigned char *)Str_dup(assets[i].source);
+                                        assets[i].length = (int)strlen(assets[i].source);
+                                }
+                                assets[i].gzip = Util_gzip(assets[i].data, assets[i].length, &assets[i].gzipLength);
+                                // FNV-1a hash of the body
+                                unsigned long long hash = 14695981039346656037ULL;
+                                for (int j = 0; j < assets[i].length; j++)
+                                        hash = (hash ^ assets[i].data[j]) * 1099511628211ULL;
+                                snprintf(assets[i].etag, sizeof(assets[i].etag), "%016llx", hash);
+                        }
+                        __atomic_store_n(&assetsInitialized, true, __ATOMIC_RELEASE);
+                }
         }
-        if (l) {
-                res->is_committed = true;
-                Socket_print(S, "HTTP/1.0 200 OK\r\n");
-                Socket_print(S, "Content-length: %lu\r\n", (unsigned long)l);
-                Socket_print(S, "Content-Type: image/x-icon\r\n");
-                Socket_print(S, "Connection: close\r\n\r\n");
-                Socket_write(S, favicon, l);
+        END_LOCK;
+}
+
+
+/**
+ * Send the static asset with the strong ETag and the long Cache-Control, the client with the same
+ * ETag gets 304 and the client which accepts gzip gets the compressed body
+ */
+static void _printAsset(HttpRequest req, HttpResponse res) {
+        _initAssets();
+        for (int i = 0; i < (int)(sizeof(assets) / sizeof(assets[0])); i++) {
+                if (IS(req->url, assets[i].path)) {
+                        char etag[24];
+                        snprintf(etag, sizeof(etag), "\"%s\"", assets[i].etag);
+                        set_content_type(res, assets[i].type);
+                        set_header(res, "ETag", etag);
+                        set_header(res, "Cache-Control", ASSET_CACHE);
+                        if (assets[i].gzip)
+                                set_header(res, "Vary", "Accept-Encoding");
+                        const char *match = get_header(req, "If-None-Match");
+                        if (match && (Str_sub(match, etag) || IS(match, "*"))) {
+                                set_status(res, SC_NOT_MODIFIED);
+                        } else if (res->accepts_gzip && assets[i].gzip) {
+                                set_header(res, "Content-Encoding", "gzip");
+                                StringBuffer_appendBytes(res->outputbuffer, assets[i].gzip, assets[i].gzipLength);
+                        } else {
+                                StringBuffer_appendBytes(res->outputbuffer, assets[i].data, assets[i].length);
+                        }
+                        return;
+                }
         }
+        send_error(req, res, SC_NOT_FOUND, "The requested URL %s was not found on this server", req->url);
 }
 
 
 static void do_head(HttpResponse res, const char *path, const char *name, int refresh) {
+        _initAssets();
         StringBuffer_append(res->outputbuffer,
                             "<!DOCTYPE html>"\
                             "<html>"\
                             "<head>"\
                             "<title>Monit: %s</title> "\
-                            "<style type=\"text/css\"> "\
-                            " html, body {height: 100%%;margin: 0;} "\
-                            " body {background-color: white;font: normal normal normal 16px/20px 'HelveticaNeue', Helvetica, Arial, sans-serif; color:#222;} "\
-                            " h1 {padding:30px 0 10px 0; text-align:center;color:#222;font-size:28px;} "\
-                            " h2 {padding:20px 0 10px 0; text-align:center;color:#555;font-size:22px;} "\
-                            " a:hover {text-decoration: none;} "\
-                            " a {text-decoration: underline;color:#222} "\
-                            " table {border-collapse:collapse; border:0;} "\
-                            " .stripe {background:#EDF5FF} "\
-                            " .rule {background:#ddd} "\
-                            " .red-text {color:#ff0000;} "\
-                            " .green-text {color:#00ff00;} "\
-                            " .gray-text {color:#999999;} "\
-                            " .blue-text {color:#0000ff;} "\
-                            " .yellow-text {color:#ffff00;} "\
-                            " .orange-text {color:#ff8800;} "\
-                            " .short {overflow: hidden; text-overflow: ellipsis; white-space: nowrap; max-width: 350px;}"\
-                            " #wrap {min-height: 100%%;} "\
-                            " #main {overflow:auto; padding-bottom:50px;} "\
-                            " /*Opera Fix*/body:before {content:\"\";height:100%%;float:left;width:0;margin-top:-32767px;/} "\
-                            " #footer {position: relative;margin-top: -50px; height: 50px; clear:both; font-size:11px;color:#777;text-align:center;} "\
-                            " #footer a {color:#333;} #footer a:hover {text-decoration: none;} "\
-                            " #nav {background:#ddd;font:normal normal normal 14px/0px 'HelveticaNeue', Helvetica;} "\
-                            " #nav td {padding:5px 10px;} "\
-                            " #header {margin-bottom:30px;background:#EFF7FF} "\
-                            " #nav, #header {border-bottom:1px solid #ccc;} "\
-                            " #header-row {width:95%%;} "\
-                            " #header-row th {padding:30px 10px 10px 10px;font-size:120%%;} "\
-                            " #header-row td {padding:3px 10px;} "\
-                            " #header-row .first {min-width:200px;width:200px;white-space:nowrap;overflow:hidden;text-overflow:ellipsis;} "\
-                            " #status-table {width:95%%;} "\
-                            " #status-table th {text-align:left;background:#edf5ff;font-weight:normal;} "\
-                            " #status-table th, #status-table td, #status-table tr {border:1px solid #ccc;padding:5px;} "\
-                            " #buttons {font-size:20px; margin:40px 0 20px 0;} "\
-                            " #buttons td {padding-right:50px;} "\
-                            " #buttons input {font-size:18px;padding:5px;} "\
-                            "</style>"\
+                            "<link rel='stylesheet' type='text/css' href='_static/monit.css?%s'>"\
                             "<meta HTTP-EQUIV='REFRESH' CONTENT=%d> "\
                             "<meta HTTP-EQUIV='Expires' Content=0> "\
                             "<meta HTTP-EQUIV='Pragma' CONTENT='no-cache'> "\
@@ -562,7 +887,7 @@ static void do_head(HttpResponse res, const char *path, const char *name, int re
                             "  </tr>"\
                             "</table>"\
                             "<center>",
-                            Run.system->name, refresh, path, name, VERSION);
+                            Run.system->name, assets[Asset_Css].etag, refresh, path, name, VERSION);
 }
 
 
@@ -579,7 +904,138 @@ static void do_foot(HttpResponse res) {
 }
 
 
+/**
+ * Read the home page filter from the request parameters: name (the service
+ * name prefix), group, type, state (ok, failed or unmonitored), offset and
+ * limit
+ */
+static void _homeFilterInit(HttpRequest req, HomeFilter_T f) {
+        *f = (struct HomeFilter_T){.type = -1, .limit = HOME_PAGE};
+        char *name = Util_urlDecode((char *)get_parameter(req, "name"));
+        if (STR_DEF(name))
+                f->name = name;
+        char *group = Util_urlDecode((char *)get_parameter(req, "group"));
+        if (STR_DEF(group)) {
+                f->group = group;
+                f->members = Util_getServiceGroup(group);
+        }
+        char *type = Util_urlDecode((char *)get_parameter(req, "type"));
+        if (STR_DEF(type))
+                for (int i = 0; i <= Service_Last; i++)
+                        if (IS(type, servicetypes[i]))
+                                f->type = i;
+        const char *state = get_parameter(req, "state");
+        if (IS(state, "ok"))
+                f->state = HomeState_Ok;
+        else if (IS(state, "failed"))
+                f->state = HomeState_Failed;
+        else if (IS(state, "unmonitored"))
+                f->state = HomeState_Unmonitored;
+        const char *offset = get_parameter(req, "offset");
+        if (offset && Str_match("^[0-9]+$", offset))
+                f->offset = atoi(offset);
+        const char *limit = get_parameter(req, "limit");
+        if (limit && Str_match("^[0-9]+$", limit))
+                f->limit = atoi(limit);
+}
+
+
+/**
+ * Test the service (snapshot) against the filter and count the matching
+ * services
+ * @return true if the service matches and falls into the listed page
+ */
+static boolean_t _homeFilter(HomeFilter_T f, Service_T s) {
+        if (f->type >= 0 && (int)s->type != f->type)
+                return false;
+        if (f->name && ! Str_startsWith(s->name, f->name))
+                return false;
+        // The snapshot is a copy which shares the group bitset of the service
+        if (f->group && ! (f->members && Util_isGroupMember(s, f->members)))
+                return false;
+        switch (f->state) {
+                case HomeState_Ok:
+                        if (s->monitor == Monitor_Not || s->error)
+                                return false;
+                        break;
+                case HomeState_Failed:
+                        if (! s->error)
+                                return false;
+                        break;
+                case HomeState_Unmonitored:
+                        if (s->monitor != Monitor_Not)
+                                return false;
+                        break;
+                default:
+                        break;
+        }
+        f->matched++;
+        return f->matched > f->offset && (! f->limit || f->matched <= f->offset + f->limit);
+}
+
+
+static void _homeOption(HttpResponse res, const char *value, const char *label, boolean_t selected) {
+        StringBuffer_append(res->outputbuffer, "<option value='");
+        escapeHTML(res->outputbuffer, value);
+        StringBuffer_append(res->outputbuffer, "'%s>", selected ? " selected" : "");
+        escapeHTML(res->outputbuffer, label);
+        StringBuffer_append(res->outputbuffer, "</option>");
+}
+
+
+static void _homeForm(HttpResponse res, HomeFilter_T f) {
+        StringBuffer_append(res->outputbuffer, "<form method='GET' action='.'><p>Name <input type='text' name='name' size='16' value='");
+        escapeHTML(res->outputbuffer, NVLSTR(f->name));
+        StringBuffer_append(res->outputbuffer, "'> Group <select name='group'>");
+        _homeOption(res, "", "all", ! f->group);
+        for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next)
+                _homeOption(res, sg->name, sg->name, IS(f->group, sg->name));
+        StringBuffer_append(res->outputbuffer, "</select> Type <select name='type'>");
+        _homeOption(res, "", "all", f->type < 0);
+        for (int i = 0; i <= Service_Last; i++)
+                _homeOption(res, servicetypes[i], servicetypes[i], f->type == i);
+        StringBuffer_append(res->outputbuffer, "</select> State <select name='state'>");
+        _homeOption(res, "", "all", f->state == HomeState_All);
+        _homeOption(res, "ok", "ok", f->state == HomeState_Ok);
+        _homeOption(res, "failed", "failed", f->state == HomeState_Failed);
+        _homeOption(res, "unmonitored", "unmonitored", f->state == HomeState_Unmonitored);
+        StringBuffer_append(res->outputbuffer, "</select> <input type='hidden' name='limit' value='%d'><input type='submit' value='Filter'></p></form>", f->limit);
+}
+
+
+static void _homeLink(HttpResponse res, HomeFilter_T f, int offset, const char *label) {
+        static const char *states[] = {"", "ok", "failed", "unmonitored"};
+        char *name = Util_urlEncode(f->name ? f->name : "");
+        char *group = Util_urlEncode(f->group ? f->group : "");
+        char *type = Util_urlEncode(f->type >= 0 ? servicetypes[f->type] : "");
+        StringBuffer_append(res->outputbuffer, "<a href='.?name=%s&amp;group=%s&amp;type=%s&amp;state=%s&amp;offset=%d&amp;limit=%d'>%s</a> ", name, group, type, states[f->state], offset, f->limit, label);
+        FREE(name);
+        FREE(group);
+        FREE(type);
+}
+
+
+/**
+ * Print the position of the page and the links to the previous and the
+ * next page
+ */
+static void _homePages(HttpResponse res, HomeFilter_T f) {
+        int last = f->limit && f->matched > f->offset + f->limit ? f->offset + f->limit : f->matched;
+        if (f->offset < f->matched)
+                StringBuffer_append(res->outputbuffer, "<p>Services %d-%d of %d</p><p>", f->offset + 1, last, f->matched);
+        else
+                StringBuffer_append(res->outputbuffer, "<p>No matching services</p><p>");
+        if (f->offset > 0)
+                _homeLink(res, f, f->limit && f->offset > f->limit ? f->offset - f->limit : 0, "&lt;&lt; Previous");
+        if (last < f->matched)
+                _homeLink(res, f, last, "Next &gt;&gt;");
+        StringBuffer_append(res->outputbuffer, "</p>");
+}
+
+
 static void do_home(HttpRequest req, HttpResponse res) {
+        struct HomeFilter_T filter;
+        _homeFilterInit(req, &filter);
         do_head(res, "", "", Run.polltime);
         StringBuffer_append(res->outputbuffer,
                             "<table id='header' width='100%%'>"
@@ -590,17 +1046,23 @@ static void do_home(HttpRequest req, HttpResponse res) {
                             "  </td>"
                             " </tr>"
                             "</table>", Run.system->name);
-
-        do_home_system(req, res);
-        do_home_process(req, res);
-        do_home_program(req, res);
-        do_home_filesystem(req, res);
-        do_home_file(req, res);
-        do_home_fifo(req, res);
-        do_home_directory(req, res);
-        do_home_net(req, res);
-        do_home_host(req, res);
-
+        _homeForm(res, &filter);
+
+        // The rows are streamed to the client as they are rendered (see flush_response)
+        do_home_system(res, &filter);
+        do_home_process(res, &filter);
+        do_home_program(res, &filter);
+        do_home_filesystem(res, &filter);
+        do_home_file(res, &filter);
+        do_home_fifo(res, &filter);
+        do_home_directory(res, &filter);
+        do_home_net(res, &filter);
+        do_home_socket(res, &filter);
+        do_home_heartbeat(res, &filter);
+        do_home_metric(res, &filter);
+        do_home_host(res, &filter);
+
+        _homePages(res, &filter);
         do_foot(res);
 }
 
@@ -672,6 +1134,9 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
         StringBuffer_append(res->outputbuffer,
                             "<tr><td>Use syslog</td><td>%s</td></tr>",
                             (Run.flags & Run_UseSyslog) ? "True" : "False");
+        StringBuffer_append(res->outputbuffer,
+                            "<tr><td>Asynchronous log</td><td>%s</td></tr>",
+                            (Run.flags & Run_LogAsync) ? "True" : "False");
         if (Run.eventlist_dir) {
                 if (Run.eventlist_slots < 0)
                         snprintf(buf, STRLEN, "unlimited");
@@ -679,8 +1144,8 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
                         snprintf(buf, STRLEN, "%d", Run.eventlist_slots);
                 StringBuffer_append(res->outputbuffer,
                                     "<tr><td>Event queue</td>"
-                                    "<td>base directory %s with %d slots</td></tr>",
-                                    Run.eventlist_dir, Run.eventlist_slots);
+                                    "<td>base directory %s with %s slots, %d events queued (%s)</td></tr>",
+                                    Run.eventlist_dir, buf, Event_queue_count(), Str_bytesToSize(Event_queue_size(), (char[10]){}));
         }
 #ifdef HAVE_OPENSSL
         {
@@ -756,16 +1221,26 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
         StringBuffer_append(res->outputbuffer, "<tr><td>Limit for HTTP content buffer</td><td>%s</td></tr>", Str_bytesToSize(Run.limits.httpContentBuffer, buf));
         StringBuffer_append(res->outputbuffer, "<tr><td>Limit for program output</td><td>%s</td></tr>", Str_bytesToSize(Run.limits.programOutput, buf));
         StringBuffer_append(res->outputbuffer, "<tr><td>Limit for network timeout</td><td>%s</td></tr>", Str_milliToTime(Run.limits.networkTimeout, (char[23]){}));
+        StringBuffer_append(res->outputbuffer, "<tr><td>Socket read buffer</td><td>%s</td></tr>", Str_bytesToSize(Run.limits.socketBuffer, buf));
+        StringBuffer_append(res->outputbuffer, "<tr><td>Asynchronous log buffer</td><td>%s</td></tr>", Str_bytesToSize(Run.limits.logBuffer, buf));
         StringBuffer_append(res->outputbuffer,
                             "<tr><td>Poll time</td><td>%d seconds with start delay %d seconds</td></tr>",
                             Run.polltime, Run.startdelay);
+        if (Run.self.cycle >= 0)
+                StringBuffer_append(res->outputbuffer, "<tr><td>Last cycle duration</td><td>%s</td></tr>", Str_milliToTime(Run.self.cycle, (char[23]){}));
+        if (Run.cycle.budget)
+                StringBuffer_append(res->outputbuffer, "<tr><td>Cycle budget</td><td>%s with %d checks deferred in the last cycle, %llu in total</td></tr>", Str_milliToTime(Run.cycle.budget, (char[23]){}), Run.cycle.last, Run.cycle.deferrals);
+        if (Run.self.memory)
+                StringBuffer_append(res->outputbuffer, "<tr><td>Memory usage</td><td>%s</td></tr>", Str_bytesToSize(Run.self.memory, buf));
+        StringBuffer_append(res->outputbuffer, "<tr><td>Events waiting for delivery</td><td>%d</td></tr>", Run.self.queue);
         if (Run.httpd.flags & Httpd_Net) {
                 StringBuffer_append(res->outputbuffer,
                                     "<tr><td>httpd bind address</td><td>%s</td></tr>",
                                     Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "Any/All");
                 StringBuffer_append(res->outputbuffer,
                                     "<tr><td>httpd portnumber</td><td>%d</td></tr>", Run.httpd.socket.net.port);
-        } else if (Run.httpd.flags & Httpd_Unix) {
+        }
+        if (Run.httpd.flags & Httpd_Unix) {
                 StringBuffer_append(res->outputbuffer,
                                     "<tr><td>httpd unix socket</td><td>%s</td></tr>",
                                     Run.httpd.socket.unix.path);
@@ -811,7 +1286,7 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
                                     "<td><form method=POST action='_runtime'>Force validate now? <input type=hidden name='action' value='validate'>"
                                     "<input type=submit value='Go'></form></td>");
 
-                if ((Run.flags & Run_Log) && ! (Run.flags & Run_UseSyslog)) {
+                if ((Run.flags & Run_Log) && ! (Run.flags & (Run_UseSyslog | Run_UseJournal))) {
                         StringBuffer_append(res->outputbuffer,
                                             "<td><form method=GET action='_viewlog'>View Monit logfile? <input type=submit value='Go'></form></td>");
                 }
@@ -822,34 +1297,136 @@ static void do_runtime(HttpRequest req, HttpResponse res) {
 }
 
 
+/**
+ * Get the offset of the last lines in the file. The file is read
+ * backwards in small blocks until enough line feeds were found.
+ */
+static off_t _getTailOffset(int fd, off_t size, long long lines) {
+        char buf[4096];
+        for (off_t offset = size; offset > 0 && lines > 0; ) {
+                off_t start = offset > (off_t)sizeof(buf) ? offset - (off_t)sizeof(buf) : 0;
+                ssize_t n = pread(fd, buf, offset - start, start);
+                if (n <= 0)
+                        break;
+                for (ssize_t i = n - 1; i >= 0; i--)
+                        // The line feed at the end of the file terminates the last line, it doesn't start a new one
+                        if (buf[i] == '\n' && start + i < size - 1 && --lines == 0)
+                                return start + i + 1;
+                offset = start;
+        }
+        return 0;
+}
+
+
+/**
+ * Parse a single byte range (RFC 7233) of the file
+ * @return 1 if the range is valid, 0 if it should be ignored or -1 if
+ * the range is not satisfiable
+ */
+static int _getRange(const char *range, off_t size, off_t *offset, off_t *length) {
+        long long first, last;
+        if (! Str_startsWith(range, "bytes=") || strchr(range, ','))
+                return 0; // Multiple ranges are ignored, the full content is sent instead
+        range += 6;
+        if (sscanf(range, "-%lld", &last) == 1) {
+                if (last <= 0 || size == 0)
+                        return -1;
+                *offset = last < size ? size - last : 0;
+        } else if (sscanf(range, "%lld-%lld", &first, &last) == 2) {
+                if (first > last)
+                        return 0;
+                if (first >= size)
+                        return -1;
+                *offset = first;
+                size = last < size ? last + 1 : size;
+        } else if (sscanf(range, "%lld-", &first) == 1) {
+                if (first >= size)
+                        return -1;
+                *offset = first;
+        } else {
+                return 0;
+        }
+        *length = size - *offset;
+        return 1;
+}
+
+
+/**
+ * Send the raw log file. The file is streamed, the optional lines
+ * parameter limits the log to the last lines and the Range header
+ * selects a byte range.
+ */
+static void _printLog(HttpRequest req, HttpResponse res, int fd, off_t size, long long lines) {
+        off_t offset = lines > 0 ? _getTailOffset(fd, size, lines) : 0;
+        off_t length = size - offset;
+        const char *range = get_header(req, "Range");
+        if (range) {
+                int rv = _getRange(range, size, &offset, &length);
+                if (rv < 0) {
+                        char buf[STRLEN];
+                        snprintf(buf, sizeof(buf), "bytes */%lld", (long long)size);
+                        set_status(res, SC_RANGE_NOT_SATISFIABLE);
+                        set_header(res, "Content-Range", buf);
+                        close(fd);
+                        return;
+                } else if (rv > 0) {
+                        char buf[STRLEN];
+                        snprintf(buf, sizeof(buf), "bytes %lld-%lld/%lld", (long long)offset, (long long)(offset + length - 1), (long long)size);
+                        set_status(res, SC_PARTIAL_CONTENT);
+                        set_header(res, "Content-Range", buf);
+                }
+        }
+        set_content_type(res, "text/plain");
+        set_header(res, "Accept-Ranges", "bytes");
+        set_file(res, fd, offset, length);
+}
+
+
 static void do_viewlog(HttpRequest req, HttpResponse res) {
         if (is_readonly(req)) {
                 send_error(req, res, SC_FORBIDDEN, "You do not have sufficent privileges to access this page");
                 return;
         }
-        do_head(res, "_viewlog", "View log", 100);
-        if ((Run.flags & Run_Log) && ! (Run.flags & Run_UseSyslog)) {
+        const char *lines = get_parameter(req, "lines");
+        if (lines && ! Str_match("^[0-9]{1,9}$", lines)) {
+                send_error(req, res, SC_BAD_REQUEST, "Invalid lines: '%s'", lines);
+                return;
+        }
+        const char *format = get_parameter(req, "format");
+        boolean_t raw = (format && IS(format, "raw")) || get_header(req, "Range");
+        if (! raw)
+                do_head(res, "_viewlog", "View log", 100);
+        if ((Run.flags & Run_Log) && ! (Run.flags & (Run_UseSyslog | Run_UseJournal))) {
                 struct stat sb;
-                if (! stat(Run.files.log, &sb)) {
-                        FILE *f = fopen(Run.files.log, "r");
-                        if (f) {
-#define BUFSIZE 512
-                                size_t n;
-                                char buf[BUFSIZE+1];
-                                StringBuffer_append(res->outputbuffer, "<br><p><form><textarea cols=120 rows=30 readonly>");
-                                while ((n = fread(buf, sizeof(char), BUFSIZE, f)) > 0) {
-                                        buf[n] = 0;
-                                        StringBuffer_append(res->outputbuffer, "%s", buf);
-                                }
-                                fclose(f);
-                                StringBuffer_append(res->outputbuffer, "</textarea></form>");
-                        } else {
-                                StringBuffer_append(res->outputbuffer, "Error opening logfile: %s", STRERROR);
+                int fd = open(Run.files.log, O_RDONLY);
+                if (fd >= 0 && ! fstat(fd, &sb)) {
+                        if (raw) {
+                                _printLog(req, res, fd, sb.st_size, lines ? Str_parseLLong(lines) : 0);
+                                return;
                         }
+                        // The page shows the tail of the log, the full log is available in the raw format
+                        long long count = lines ? Str_parseLLong(lines) : VIEWLOG_LINES;
+                        off_t offset = _getTailOffset(fd, sb.st_size, count);
+                        if (sb.st_size - offset > VIEWLOG_MAX)
+                                offset = sb.st_size - VIEWLOG_MAX;
+                        StringBuffer_append(res->outputbuffer, "<br><p>The last %lld lines, <a href='_viewlog?format=raw'>full log</a></p><p><form><textarea cols=120 rows=30 readonly>", count);
+                        char buf[4096 + 1];
+                        for (ssize_t n; offset < sb.st_size && (n = pread(fd, buf, sb.st_size - offset < (off_t)sizeof(buf) - 1 ? sb.st_size - offset : (off_t)sizeof(buf) - 1, offset)) > 0; offset += n) {
+                                buf[n] = 0;
+                                escapeHTML(res->outputbuffer, buf);
+                                flush_response(res);
+                        }
+                        StringBuffer_append(res->outputbuffer, "</textarea></form>");
                 } else {
-                        StringBuffer_append(res->outputbuffer, "Error stating logfile: %s", STRERROR);
+                        StringBuffer_append(res->outputbuffer, "Error opening logfile: %s", STRERROR);
                 }
+                if (fd >= 0)
+                        close(fd);
         } else {
+                if (raw) {
+                        send_error(req, res, SC_NOT_FOUND, Run.flags & Run_Log ? "Monit uses syslog" : "Monit was started without logging");
+                        return;
+                }
                 StringBuffer_append(res->outputbuffer,
                                     "<b>Cannot view logfile:</b><br>");
                 if (! (Run.flags & Run_Log))
@@ -880,6 +1457,8 @@ static void handle_action(HttpRequest req, HttpResponse res) {
                         return;
                 }
                 s->doaction = doaction;
+                s->generation++;
+                _resetSummary();
                 const char *token = get_parameter(req, "token");
                 if (token) {
                         FREE(s->token);
@@ -887,17 +1466,57 @@ static void handle_action(HttpRequest req, HttpResponse res) {
                 }
                 LogInfo("'%s' %s on user request\n", s->name, action);
                 Run.flags |= Run_ActionPending; /* set the global flag */
-                do_wakeupcall();
+                Wakeup_signal();
         }
         do_service(req, res, s);
 }
 
 
+/**
+ * Stream the progress of the action: a line is sent when the action of a
+ * service finished and a notice every ACTION_NOTICE seconds while some are
+ * pending. The last line is the summary, the CLI parses it
+ */
+static void _streamProgress(HttpResponse res, const char *action, Service_T *services, unsigned int *requests, int count) {
+        Socket_T S = res->S;
+        res->is_committed = true;
+        if (Socket_print(S, "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n") < 0)
+                return;
+        int done = 0, failed = 0;
+        boolean_t gone = false;
+        boolean_t *finished = CALLOC(count, sizeof(boolean_t));
+        time_t notice = Time_now() + ACTION_NOTICE;
+        for (time_t deadline = Time_now() + ACTION_WAIT; ! gone && done < count && Time_now() < deadline && ! (Run.flags & (Run_Stopped | Run_DoReload));) {
+                for (int i = 0; i < count && ! gone; i++) {
+                        // The sequence numbers may wrap
+                        if (! finished[i] && (int)(__atomic_load_n(&services[i]->request.finished, __ATOMIC_ACQUIRE) - requests[i]) >= 0) {
+                                finished[i] = true;
+                                done++;
+                                if (services[i]->request.failed)
+                                        failed++;
+                                gone = Socket_print(S, "'%s' %s %s\n", services[i]->name, action, services[i]->request.failed ? "failed" : "done") < 0;
+                        }
+                }
+                if (! gone && done < count) {
+                        if (Time_now() >= notice) {
+                                gone = Socket_print(S, "Waiting for %d of %d services\n", count - done, count) < 0;
+                                notice = Time_now() + ACTION_NOTICE;
+                        }
+                        Time_usleep(100000);
+                }
+        }
+        if (! gone)
+                Socket_print(S, "%s: %d done, %d failed, %d pending\n", action, done - failed, failed, count - done);
+        FREE(finished);
+}
+
+
 static void handle_do_action(HttpRequest req, HttpResponse res) {
         Service_T s;
         Action_Type doaction = Action_Ignored;
         const char *action = get_parameter(req, "action");
         const char *token = get_parameter(req, "token");
+        boolean_t progress = get_parameter(req, "progress") != NULL;
 
         if (action) {
                 if (is_readonly(req)) {
@@ -908,17 +1527,27 @@ static void handle_do_action(HttpRequest req, HttpResponse res) {
                         send_error(req, res, SC_BAD_REQUEST, "Invalid action \"%s\"", action);
                         return;
                 }
-                for (HttpParameter p = req->params; p; p = p->next) {
-                        if (IS(p->name, "service")) {
-                                s  = Util_getService(p->value);
-                                if (! s) {
-                                        send_error(req, res, SC_BAD_REQUEST, "There is no service named \"%s\"", p->value ? p->value : "");
-                                        return;
-                                }
-                                s->doaction = doaction;
-                                LogInfo("'%s' %s on user request\n", s->name, action);
+                int count = 0, cursor = 0;
+                for (const char *name; (name = next_parameter(req, "service", &cursor)); count++) {
+                        if (! Util_getService(name)) {
+                                send_error(req, res, SC_BAD_REQUEST, "There is no service named \"%s\"", name);
+                                return;
                         }
                 }
+                if (progress && __atomic_add_fetch(&_waiters, 1, __ATOMIC_ACQ_REL) > STATUS_WAITERS) {
+                        __atomic_sub_fetch(&_waiters, 1, __ATOMIC_ACQ_REL);
+                        set_header(res, "Retry-After", "5");
+                        send_error(req, res, SC_SERVICE_UNAVAILABLE, "Too many clients are waiting for an action result");
+                        return;
+                }
+                Service_T *services = CALLOC(count ? count : 1, sizeof(Service_T));
+                unsigned int *requests = CALLOC(count ? count : 1, sizeof(unsigned int));
+                count = cursor = 0;
+                for (const char *name; (name = next_parameter(req, "service", &cursor));) {
+                        s = Util_getService(name);
+                        requests[count] = _scheduleAction(s, doaction, action);
+                        services[count++] = s;
+                }
                 /* Set token for last service only so we'll get it back after all services were handled */
                 if (token) {
                         Service_T q = NULL;
@@ -931,11 +1560,31 @@ static void handle_do_action(HttpRequest req, HttpResponse res) {
                         }
                 }
                 Run.flags |= Run_ActionPending;
-                do_wakeupcall();
+                Wakeup_signal();
+                if (progress) {
+                        _streamProgress(res, action, services, requests, count);
+                        __atomic_sub_fetch(&_waiters, 1, __ATOMIC_ACQ_REL);
+                }
+                FREE(requests);
+                FREE(services);
         }
 }
 
 
+/**
+ * Set the action for the service and return the request number to wait for
+ */
+static unsigned int _scheduleAction(Service_T s, Action_Type doaction, const char *action) {
+        // The request number is taken before the action is set, so the executor sees it
+        unsigned int request = __atomic_add_fetch(&s->request.requested, 1, __ATOMIC_ACQ_REL);
+        s->doaction = doaction;
+        s->generation++;
+        _resetSummary();
+        LogInfo("'%s' %s on user request\n", s->name, action);
+        return request;
+}
+
+
 static void handle_run(HttpRequest req, HttpResponse res) {
         const char *action = get_parameter(req, "action");
         if (action) {
@@ -945,7 +1594,8 @@ static void handle_run(HttpRequest req, HttpResponse res) {
                 }
                 if (IS(action, "validate")) {
                         LogInfo("The Monit http server woke up on user request\n");
-                        do_wakeupcall();
+                        Run.flags |= Run_DoWakeup;
+                        Wakeup_signal();
                 } else if (IS(action, "stop")) {
                         LogInfo("The Monit http server stopped on user request\n");
                         send_error(req, res, SC_SERVICE_UNAVAILABLE, "The Monit http server is stopped");
@@ -953,9 +1603,7 @@ static void handle_run(HttpRequest req, HttpResponse res) {
                         return;
                 }
         }
-        LOCK(Run.mutex)
         do_runtime(req, res);
-        END_LOCK;
 }
 
 
@@ -963,6 +1611,8 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         char buf[STRLEN];
 
         ASSERT(s);
+        struct myservice copy;
+        s = Snapshot_get(s, &copy);
 
         do_head(res, s->name, s->name, Run.polltime);
         StringBuffer_append(res->outputbuffer,
@@ -978,25 +1628,33 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
                             "</tr>",
                             servicetypes[s->type],
                             s->name);
-        if (s->type == Service_Process)
+        if (s->type == Service_Process) {
                 StringBuffer_append(res->outputbuffer, "<tr><td>%s</td><td>%s</td></tr>", s->matchlist ? "Match" : "Pid file", s->path);
-        else if (s->type == Service_Host)
+                if (s->matchlist && s->matchlist->container)
+                        StringBuffer_append(res->outputbuffer, "<tr><td>Container</td><td>%s</td></tr>", s->matchlist->container);
+        } else if (s->type == Service_Host)
                 StringBuffer_append(res->outputbuffer, "<tr><td>Address</td><td>%s</td></tr>", s->path);
         else if (s->type == Service_Net)
                 StringBuffer_append(res->outputbuffer, "<tr><td>Interface</td><td>%s</td></tr>", s->path);
-        else if (s->type != Service_System)
+        else if (s->type == Service_Socket) {
+                if (s->localport)
+                        StringBuffer_append(res->outputbuffer, "<tr><td>Port</td><td>%d</td></tr>", s->localport);
+                if (s->path)
+                        StringBuffer_append(res->outputbuffer, "<tr><td>Pid file</td><td>%s</td></tr>", s->path);
+        } else if (s->type != Service_System && s->type != Service_Heartbeat && s->type != Service_Metric)
                 StringBuffer_append(res->outputbuffer, "<tr><td>Path</td><td>%s</td></tr>", s->path);
         StringBuffer_append(res->outputbuffer, "<tr><td>Status</td><td>%s</td></tr>", get_service_status(HTML, s, buf, sizeof(buf)));
         for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next)
-                for (list_t m = sg->members->head; m; m = m->next)
-                        if (m->e == s)
-                                StringBuffer_append(res->outputbuffer, "<tr><td>Group</td><td class='blue-text'>%s</td></tr>", sg->name);
+                if (Util_isGroupMember(s, sg))
+                        StringBuffer_append(res->outputbuffer, "<tr><td>Group</td><td class='blue-text'>%s</td></tr>", sg->name);
         StringBuffer_append(res->outputbuffer,
                             "<tr><td>Monitoring status</td><td>%s</td></tr>", get_monitoring_status(HTML, s, buf, sizeof(buf)));
         StringBuffer_append(res->outputbuffer,
                             "<tr><td>Monitoring mode</td><td>%s</td></tr>", modenames[s->mode]);
         StringBuffer_append(res->outputbuffer,
                             "<tr><td>On reboot</td><td>%s</td></tr>", onrebootnames[s->onreboot]);
+        if (_getRestartBackoff(s, buf, sizeof(buf)))
+                StringBuffer_append(res->outputbuffer, "<tr><td>Restart backoff</td><td>%s</td></tr>", buf);
         for (Dependant_T d = s->dependantlist; d; d = d->next) {
                 if (d->dependant != NULL) {
                         StringBuffer_append(res->outputbuffer,
@@ -1056,9 +1714,11 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
                 if (s->every.type == Every_SkipCycles)
                         StringBuffer_append(res->outputbuffer, "every %d cycle", s->every.spec.cycle.number);
                 else if (s->every.type == Every_Cron)
-                        StringBuffer_append(res->outputbuffer, "every <code>\"%s\"</code>", s->every.spec.cron);
+                        StringBuffer_append(res->outputbuffer, "every <code>\"%s\"</code>", s->every.spec.cron.string);
                 else if (s->every.type == Every_NotInCron)
-                        StringBuffer_append(res->outputbuffer, "not every <code>\"%s\"</code>", s->every.spec.cron);
+                        StringBuffer_append(res->outputbuffer, "not every <code>\"%s\"</code>", s->every.spec.cron.string);
+                else if (s->every.type == Every_Interval)
+                        StringBuffer_append(res->outputbuffer, "every %d seconds", s->every.spec.interval.seconds);
                 StringBuffer_append(res->outputbuffer, "</td></tr>");
         }
         _printStatus(HTML, res, s);
@@ -1073,6 +1733,7 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         print_service_rules_euid(res, s);
         print_service_rules_gid(res, s);
         print_service_rules_timestamp(res, s);
+        print_service_rules_heartbeat(res, s);
         print_service_rules_fsflags(res, s);
         print_service_rules_filesystem(res, s);
         print_service_rules_size(res, s);
@@ -1084,6 +1745,8 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
         print_service_rules_downloadbytes(res, s);
         print_service_rules_downloadpackets(res, s);
         print_service_rules_uptime(res, s);
+        print_service_rules_responsetime(res, s);
+        print_service_rules_growth(res, s);
         print_service_rules_content(res, s);
         print_service_rules_checksum(res, s);
         print_service_rules_pid(res, s);
@@ -1097,10 +1760,14 @@ static void do_service(HttpRequest req, HttpResponse res, Service_T s) {
 }
 
 
-static void do_home_system(HttpRequest req, HttpResponse res) {
-        Service_T s = Run.system;
+static void do_home_system(HttpResponse res, HomeFilter_T filter) {
+        struct myservice copy;
+        Service_T s = Snapshot_get(Run.system, &copy);
         char buf[STRLEN];
 
+        if (! _homeFilter(filter, s))
+                return;
+
         StringBuffer_append(res->outputbuffer,
                             "<table id='header-row'>"
                             "<tr>"
@@ -1150,14 +1817,18 @@ static void do_home_system(HttpRequest req, HttpResponse res) {
 }
 
 
-static void do_home_process(HttpRequest req, HttpResponse res) {
+static void do_home_process(HttpResponse res, HomeFilter_T filter) {
         char      buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
                 if (s->type != Service_Process)
                         continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
@@ -1196,20 +1867,25 @@ static void do_home_process(HttpRequest req, HttpResponse res) {
                 }
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
 }
 
 
-static void do_home_program(HttpRequest req, HttpResponse res) {
+static void do_home_program(HttpResponse res, HomeFilter_T filter) {
         char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
                 if (s->type != Service_Program)
                         continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
@@ -1249,7 +1925,7 @@ static void do_home_program(HttpRequest req, HttpResponse res) {
                                                 else if (output[i] == '\r' || output[i] == '\n')
                                                         break;
                                                 else
-                                                        StringBuffer_append(res->outputbuffer, "%c", output[i]);
+                                                        StringBuffer_appendChar(res->outputbuffer, output[i]);
                                         }
                                 } else {
                                         StringBuffer_append(res->outputbuffer, "no output");
@@ -1265,6 +1941,7 @@ static void do_home_program(HttpRequest req, HttpResponse res) {
                 }
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
@@ -1272,14 +1949,18 @@ static void do_home_program(HttpRequest req, HttpResponse res) {
 }
 
 
-static void do_home_net(HttpRequest req, HttpResponse res) {
+static void do_home_net(HttpResponse res, HomeFilter_T filter) {
         char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
                 if (s->type != Service_Net)
                         continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
@@ -1307,28 +1988,33 @@ static void do_home_net(HttpRequest req, HttpResponse res) {
                 }
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
 }
 
 
-static void do_home_filesystem(HttpRequest req, HttpResponse res) {
+static void do_home_socket(HttpResponse res, HomeFilter_T filter) {
         char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Filesystem)
+                if (s->type != Service_Socket)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
                         continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
                                             "<tr>"
-                                            "<th align='left' class='first'>Filesystem</th>"
+                                            "<th align='left' class='first'>Socket</th>"
                                             "<th align='left'>Status</th>"
-                                            "<th align='right'>Space usage</th>"
-                                            "<th align='right'>Inodes usage</th>"
+                                            "<th align='right'>Connections</th>"
+                                            "<th align='right'>Listen queue</th>"
                                             "</tr>");
                         header = false;
                 }
@@ -1339,53 +2025,43 @@ static void do_home_filesystem(HttpRequest req, HttpResponse res) {
                                     on ? "class='stripe'" : "",
                                     s->name, s->name,
                                     get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s)) {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td align='right'>- [-]</td>"
-                                            "<td align='right'>- [-]</td>");
-                } else {
-                        StringBuffer_append(res->outputbuffer,
-                                            "<td align='right'>%.1f%% [%s]</td>",
-                                            s->inf->priv.filesystem.space_percent,
-                                            s->inf->priv.filesystem.f_bsize > 0 ? Str_bytesToSize(s->inf->priv.filesystem.space_total * s->inf->priv.filesystem.f_bsize, buf) : "0 MB");
-                        if (s->inf->priv.filesystem.f_files > 0) {
-                                StringBuffer_append(res->outputbuffer,
-                                                    "<td align='right'>%.1f%% [%lld objects]</td>",
-                                                    s->inf->priv.filesystem.inode_percent,
-                                                    s->inf->priv.filesystem.inode_total);
-                        } else {
-                                StringBuffer_append(res->outputbuffer,
-                                                    "<td align='right'>not supported by filesystem</td>");
-                        }
-                }
+                if (! Util_hasServiceStatus(s) || s->inf->priv.socket.connections < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.socket.connections);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.socket.queue < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d&#47;%d</td>", s->inf->priv.socket.queue, s->inf->priv.socket.backlog);
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
 }
 
 
-static void do_home_file(HttpRequest req, HttpResponse res) {
+static void do_home_heartbeat(HttpResponse res, HomeFilter_T filter) {
         char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_File)
+                if (s->type != Service_Heartbeat)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
                         continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
                                             "<tr>"
-                                            "<th align='left' class='first'>File</th>"
+                                            "<th align='left' class='first'>Heartbeat</th>"
                                             "<th align='left'>Status</th>"
-                                            "<th align='right'>Size</th>"
-                                            "<th align='right'>Permission</th>"
-                                            "<th align='right'>UID</th>"
-                                            "<th align='right'>GID</th>"
+                                            "<th align='right'>Last heartbeat</th>"
                                             "</tr>");
-
                         header = false;
                 }
                 StringBuffer_append(res->outputbuffer,
@@ -1395,47 +2071,39 @@ static void do_home_file(HttpRequest req, HttpResponse res) {
                                     on ? "class='stripe'" : "",
                                     s->name, s->name,
                                     get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || s->inf->priv.file.size < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%s</td>", Str_bytesToSize(s->inf->priv.file.size, (char[10]){}));
-                if (! Util_hasServiceStatus(s) || s->inf->priv.file.mode < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%04o</td>", s->inf->priv.file.mode & 07777);
-                if (! Util_hasServiceStatus(s) || s->inf->priv.file.uid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.file.uid);
-                if (! Util_hasServiceStatus(s) || s->inf->priv.file.gid < 0)
+                if (! Util_hasServiceStatus(s) || s->inf->priv.heartbeat.timestamp <= 0)
                         StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
                 else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.file.gid);
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%s</td>", Time_string(s->inf->priv.heartbeat.timestamp, (char[32]){}));
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
 }
 
 
-static void do_home_fifo(HttpRequest req, HttpResponse res) {
+static void do_home_metric(HttpResponse res, HomeFilter_T filter) {
         char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Fifo)
+                if (s->type != Service_Metric)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
                         continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
                                             "<tr>"
-                                            "<th align='left' class='first'>Fifo</th>"
+                                            "<th align='left' class='first'>Metric</th>"
                                             "<th align='left'>Status</th>"
-                                            "<th align='right'>Permission</th>"
-                                            "<th align='right'>UID</th>"
-                                            "<th align='right'>GID</th>"
+                                            "<th align='right'>Value</th>"
+                                            "<th align='right'>Rate</th>"
                                             "</tr>");
                         header = false;
                 }
@@ -1446,43 +2114,43 @@ static void do_home_fifo(HttpRequest req, HttpResponse res) {
                                     on ? "class='stripe'" : "",
                                     s->name, s->name,
                                     get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || s->inf->priv.fifo.mode < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%04o</td>", s->inf->priv.fifo.mode & 07777);
-                if (! Util_hasServiceStatus(s) || s->inf->priv.fifo.uid < 0)
+                if (! Util_hasServiceStatus(s) || s->inf->priv.metric.type == Metric_Unknown)
                         StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
                 else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.fifo.uid);
-                if (! Util_hasServiceStatus(s) || s->inf->priv.fifo.gid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%g</td>", s->inf->priv.metric.value);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.metric.rate < 0)
                         StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
                 else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.fifo.gid);
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%g&#47;s</td>", s->inf->priv.metric.rate);
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
 }
 
 
-static void do_home_directory(HttpRequest req, HttpResponse res) {
+static void do_home_filesystem(HttpResponse res, HomeFilter_T filter) {
         char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                if (s->type != Service_Directory)
+                if (s->type != Service_Filesystem)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
                         continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
                                             "<tr>"
-                                            "<th align='left' class='first'>Directory</th>"
+                                            "<th align='left' class='first'>Filesystem</th>"
                                             "<th align='left'>Status</th>"
-                                            "<th align='right'>Permission</th>"
-                                            "<th align='right'>UID</th>"
-                                            "<th align='right'>GID</th>"
+                                            "<th align='right'>Space usage</th>"
+                                            "<th align='right'>Inodes usage</th>"
                                             "</tr>");
                         header = false;
                 }
@@ -1493,34 +2161,208 @@ static void do_home_directory(HttpRequest req, HttpResponse res) {
                                     on ? "class='stripe'" : "",
                                     s->name, s->name,
                                     get_service_status(HTML, s, buf, sizeof(buf)));
-                if (! Util_hasServiceStatus(s) || s->inf->priv.directory.mode < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%04o</td>", s->inf->priv.directory.mode & 07777);
-                if (! Util_hasServiceStatus(s) || s->inf->priv.directory.uid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.directory.uid);
-                if (! Util_hasServiceStatus(s) || s->inf->priv.directory.gid < 0)
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
-                else
-                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.directory.gid);
-                StringBuffer_append(res->outputbuffer, "</tr>");
-                on = ! on;
-        }
-        if (! header)
-                StringBuffer_append(res->outputbuffer, "</table>");
-}
-
-
-static void do_home_host(HttpRequest req, HttpResponse res) {
-        char buf[STRLEN];
+                if (! Util_hasServiceStatus(s)) {
+                        StringBuffer_append(res->outputbuffer,
+                                            "<td align='right'>- [-]</td>"
+                                            "<td align='right'>- [-]</td>");
+                } else {
+                        StringBuffer_append(res->outputbuffer,
+                                            "<td align='right'>%.1f%% [%s]</td>",
+                                            s->inf->priv.filesystem.space_percent,
+                                            s->inf->priv.filesystem.f_bsize > 0 ? Str_bytesToSize(s->inf->priv.filesystem.space_total * s->inf->priv.filesystem.f_bsize, buf) : "0 MB");
+                        if (s->inf->priv.filesystem.f_files > 0) {
+                                StringBuffer_append(res->outputbuffer,
+                                                    "<td align='right'>%.1f%% [%lld objects]</td>",
+                                                    s->inf->priv.filesystem.inode_percent,
+                                                    s->inf->priv.filesystem.inode_total);
+                        } else {
+                                StringBuffer_append(res->outputbuffer,
+                                                    "<td align='right'>not supported by filesystem</td>");
+                        }
+                }
+                StringBuffer_append(res->outputbuffer, "</tr>");
+                on = ! on;
+                flush_response(res);
+        }
+        if (! header)
+                StringBuffer_append(res->outputbuffer, "</table>");
+}
+
+
+static void do_home_file(HttpResponse res, HomeFilter_T filter) {
+        char buf[STRLEN];
         boolean_t on = true;
         boolean_t header = true;
 
+        struct myservice copy;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                if (s->type != Service_File)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
+                if (header) {
+                        StringBuffer_append(res->outputbuffer,
+                                            "<table id='header-row'>"
+                                            "<tr>"
+                                            "<th align='left' class='first'>File</th>"
+                                            "<th align='left'>Status</th>"
+                                            "<th align='right'>Size</th>"
+                                            "<th align='right'>Permission</th>"
+                                            "<th align='right'>UID</th>"
+                                            "<th align='right'>GID</th>"
+                                            "</tr>");
+
+                        header = false;
+                }
+                StringBuffer_append(res->outputbuffer,
+                                    "<tr %s>"
+                                    "<td align='left'><a href='%s'>%s</a></td>"
+                                    "<td align='left'>%s</td>",
+                                    on ? "class='stripe'" : "",
+                                    s->name, s->name,
+                                    get_service_status(HTML, s, buf, sizeof(buf)));
+                if (! Util_hasServiceStatus(s) || s->inf->priv.file.size < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%s</td>", Str_bytesToSize(s->inf->priv.file.size, (char[10]){}));
+                if (! Util_hasServiceStatus(s) || s->inf->priv.file.mode < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%04o</td>", s->inf->priv.file.mode & 07777);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.file.uid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.file.uid);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.file.gid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.file.gid);
+                StringBuffer_append(res->outputbuffer, "</tr>");
+                on = ! on;
+                flush_response(res);
+        }
+        if (! header)
+                StringBuffer_append(res->outputbuffer, "</table>");
+}
+
+
+static void do_home_fifo(HttpResponse res, HomeFilter_T filter) {
+        char buf[STRLEN];
+        boolean_t on = true;
+        boolean_t header = true;
+
+        struct myservice copy;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                if (s->type != Service_Fifo)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
+                if (header) {
+                        StringBuffer_append(res->outputbuffer,
+                                            "<table id='header-row'>"
+                                            "<tr>"
+                                            "<th align='left' class='first'>Fifo</th>"
+                                            "<th align='left'>Status</th>"
+                                            "<th align='right'>Permission</th>"
+                                            "<th align='right'>UID</th>"
+                                            "<th align='right'>GID</th>"
+                                            "</tr>");
+                        header = false;
+                }
+                StringBuffer_append(res->outputbuffer,
+                                    "<tr %s>"
+                                    "<td align='left'><a href='%s'>%s</a></td>"
+                                    "<td align='left'>%s</td>",
+                                    on ? "class='stripe'" : "",
+                                    s->name, s->name,
+                                    get_service_status(HTML, s, buf, sizeof(buf)));
+                if (! Util_hasServiceStatus(s) || s->inf->priv.fifo.mode < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%04o</td>", s->inf->priv.fifo.mode & 07777);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.fifo.uid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.fifo.uid);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.fifo.gid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.fifo.gid);
+                StringBuffer_append(res->outputbuffer, "</tr>");
+                on = ! on;
+                flush_response(res);
+        }
+        if (! header)
+                StringBuffer_append(res->outputbuffer, "</table>");
+}
+
+
+static void do_home_directory(HttpResponse res, HomeFilter_T filter) {
+        char buf[STRLEN];
+        boolean_t on = true;
+        boolean_t header = true;
+
+        struct myservice copy;
+        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                if (s->type != Service_Directory)
+                        continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
+                if (header) {
+                        StringBuffer_append(res->outputbuffer,
+                                            "<table id='header-row'>"
+                                            "<tr>"
+                                            "<th align='left' class='first'>Directory</th>"
+                                            "<th align='left'>Status</th>"
+                                            "<th align='right'>Permission</th>"
+                                            "<th align='right'>UID</th>"
+                                            "<th align='right'>GID</th>"
+                                            "</tr>");
+                        header = false;
+                }
+                StringBuffer_append(res->outputbuffer,
+                                    "<tr %s>"
+                                    "<td align='left'><a href='%s'>%s</a></td>"
+                                    "<td align='left'>%s</td>",
+                                    on ? "class='stripe'" : "",
+                                    s->name, s->name,
+                                    get_service_status(HTML, s, buf, sizeof(buf)));
+                if (! Util_hasServiceStatus(s) || s->inf->priv.directory.mode < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%04o</td>", s->inf->priv.directory.mode & 07777);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.directory.uid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.directory.uid);
+                if (! Util_hasServiceStatus(s) || s->inf->priv.directory.gid < 0)
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>-</td>");
+                else
+                        StringBuffer_append(res->outputbuffer, "<td align='right'>%d</td>", s->inf->priv.directory.gid);
+                StringBuffer_append(res->outputbuffer, "</tr>");
+                on = ! on;
+                flush_response(res);
+        }
+        if (! header)
+                StringBuffer_append(res->outputbuffer, "</table>");
+}
+
+
+static void do_home_host(HttpResponse res, HomeFilter_T filter) {
+        char buf[STRLEN];
+        boolean_t on = true;
+        boolean_t header = true;
+
+        struct myservice copy;
         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
                 if (s->type != Service_Host)
                         continue;
+                s = Snapshot_get(s, &copy);
+                if (! _homeFilter(filter, s))
+                        continue;
                 if (header) {
                         StringBuffer_append(res->outputbuffer,
                                             "<table id='header-row'>"
@@ -1580,6 +2422,7 @@ static void do_home_host(HttpRequest req, HttpResponse res) {
                 }
                 StringBuffer_append(res->outputbuffer, "</tr>");
                 on = ! on;
+                flush_response(res);
         }
         if (! header)
                 StringBuffer_append(res->outputbuffer, "</table>");
@@ -1835,6 +2678,15 @@ static void print_service_rules_timestamp(HttpResponse res, Service_T s) {
 }
 
 
+static void print_service_rules_heartbeat(HttpResponse res, Service_T s) {
+        if (s->heartbeat) {
+                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Heartbeat</td><td>");
+                Util_printRule(res->outputbuffer, s->heartbeat->action, "If no heartbeat within %d second(s)", s->heartbeat->timeout);
+                StringBuffer_append(res->outputbuffer, "</td></tr>");
+        }
+}
+
+
 static void print_service_rules_fsflags(HttpResponse res, Service_T s) {
         for (Fsflag_T l = s->fsflaglist; l; l = l->next) {
                 StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Filesystem flags</td><td>");
@@ -1884,6 +2736,18 @@ static void print_service_rules_filesystem(HttpResponse res, Service_T s) {
                         StringBuffer_append(res->outputbuffer, "</td></tr>");
                 }
         }
+        for (Quota_T q = s->quotalist; q; q = q->next) {
+                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>%s %s %d</td><td>", q->inode ? "Quota inodes" : "Quota", quotatypenames[q->type], q->id);
+                if (q->limit_absolute > -1) {
+                        if (q->inode)
+                                Util_printRule(res->outputbuffer, q->action, "If %s %lld", operatornames[q->operator], q->limit_absolute);
+                        else
+                                Util_printRule(res->outputbuffer, q->action, "If %s %s", operatornames[q->operator], Str_bytesToSize(q->limit_absolute, (char[10]){}));
+                } else {
+                        Util_printRule(res->outputbuffer, q->action, "If %s %.1f%%", operatornames[q->operator], q->limit_percent);
+                }
+                StringBuffer_append(res->outputbuffer, "</td></tr>");
+        }
 }
 
 
@@ -1930,7 +2794,10 @@ static void print_service_rules_uploadbytes(HttpResponse res, Service_T s) {
         for (Bandwidth_T bl = s->uploadbyteslist; bl; bl = bl->next) {
                 if (bl->range == Time_Second) {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Upload bytes</td><td>");
-                        Util_printRule(res->outputbuffer, bl->action, "If %s %s/s", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}));
+                        if (bl->rangecount > 1)
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %s/s for %d seconds", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}), bl->rangecount);
+                        else
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %s/s", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}));
                 } else {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Total upload bytes</td><td>");
                         Util_printRule(res->outputbuffer, bl->action, "If %s %s in last %d %s(s)", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}), bl->rangecount, Util_timestr(bl->range));
@@ -1944,7 +2811,10 @@ static void print_service_rules_uploadpackets(HttpResponse res, Service_T s) {
         for (Bandwidth_T bl = s->uploadpacketslist; bl; bl = bl->next) {
                 if (bl->range == Time_Second) {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Upload packets</td><td>");
-                        Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets/s", operatornames[bl->operator], bl->limit);
+                        if (bl->rangecount > 1)
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets/s for %d seconds", operatornames[bl->operator], bl->limit, bl->rangecount);
+                        else
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets/s", operatornames[bl->operator], bl->limit);
                 } else {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Total upload packets</td><td>");
                         Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets in last %d %s(s)", operatornames[bl->operator], bl->limit, bl->rangecount, Util_timestr(bl->range));
@@ -1958,7 +2828,10 @@ static void print_service_rules_downloadbytes(HttpResponse res, Service_T s) {
         for (Bandwidth_T bl = s->downloadbyteslist; bl; bl = bl->next) {
                 if (bl->range == Time_Second) {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Download bytes</td><td>");
-                        Util_printRule(res->outputbuffer, bl->action, "If %s %s/s", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}));
+                        if (bl->rangecount > 1)
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %s/s for %d seconds", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}), bl->rangecount);
+                        else
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %s/s", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}));
                 } else {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Total download bytes</td><td>");
                         Util_printRule(res->outputbuffer, bl->action, "If %s %s in last %d %s(s)", operatornames[bl->operator], Str_bytesToSize(bl->limit, (char[10]){}), bl->rangecount, Util_timestr(bl->range));
@@ -1972,7 +2845,10 @@ static void print_service_rules_downloadpackets(HttpResponse res, Service_T s) {
         for (Bandwidth_T bl = s->downloadpacketslist; bl; bl = bl->next) {
                 if (bl->range == Time_Second) {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Download packets</td><td>");
-                        Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets/s", operatornames[bl->operator], bl->limit);
+                        if (bl->rangecount > 1)
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets/s for %d seconds", operatornames[bl->operator], bl->limit, bl->rangecount);
+                        else
+                                Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets/s", operatornames[bl->operator], bl->limit);
                 } else {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Total download packets</td><td>");
                         Util_printRule(res->outputbuffer, bl->action, "If %s %lld packets in last %d %s(s)", operatornames[bl->operator], bl->limit, bl->rangecount, Util_timestr(bl->range));
@@ -1982,6 +2858,24 @@ static void print_service_rules_downloadpackets(HttpResponse res, Service_T s) {
 }
 
 
+static void print_service_rules_responsetime(HttpResponse res, Service_T s) {
+        for (ResponseTime_T r = s->responsetimelist; r; r = r->next) {
+                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Response time</td><td>");
+                Util_printRule(res->outputbuffer, r->action, "If p%d response time %s %s", r->percentile, operatornames[r->operator], Str_milliToTime(r->limit, (char[23]){}));
+                StringBuffer_append(res->outputbuffer, "</td></tr>");
+        }
+}
+
+
+static void print_service_rules_growth(HttpResponse res, Service_T s) {
+        for (Growth_T g = s->growthlist; g; g = g->next) {
+                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Growth</td><td>");
+                Util_printRule(res->outputbuffer, g->action, "If %s grows %s %s", g->metric, operatornames[g->operator], Util_formatGrowth(g, g->limit, (char[STRLEN]){}));
+                StringBuffer_append(res->outputbuffer, "</td></tr>");
+        }
+}
+
+
 static void print_service_rules_uptime(HttpResponse res, Service_T s) {
         for (Uptime_T ul = s->uptimelist; ul; ul = ul->next) {
                 StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Uptime</td><td>");
@@ -2038,7 +2932,14 @@ static void print_service_rules_ppid(HttpResponse res, Service_T s) {
 
 static void print_service_rules_program(HttpResponse res, Service_T s) {
         if (s->type == Service_Program) {
-                StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Program timeout</td><td>Terminate the program if not finished within %d seconds</td></tr>", s->program->timeout);
+                if (s->program->plugin)
+                        StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Plugin timeout</td><td>Fail if the check takes longer than %s</td></tr>", Str_milliToTime(Plugin_getTimeout(s->program->plugin), (char[23]){}));
+                else
+                        StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Program timeout</td><td>Terminate the program if not finished within %d seconds</td></tr>", s->program->timeout);
+                if (s->program->outputLimit >= 0) {
+                        char limit[10];
+                        StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Program output</td><td>Keep the last %s</td></tr>", Str_bytesToSize(s->program->outputLimit, limit));
+                }
                 for (Status_T status = s->statuslist; status; status = status->next) {
                         StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>Test Exit value</td><td>");
                         if (status->operator == Operator_Changed)
@@ -2055,6 +2956,13 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
         char buf[STRLEN];
         for (Resource_T q = s->resourcelist; q; q = q->next) {
                 StringBuffer_append(res->outputbuffer, "<tr class='rule'><td>");
+                if (q->average) {
+                        char limit[STRLEN];
+                        StringBuffer_append(res->outputbuffer, "Average %s limit</td><td>", NVLSTR(Series_getMetric(s->type, q->resource_id)));
+                        Util_printRule(res->outputbuffer, q->action, "If %s %s for %s", operatornames[q->operator], Series_formatValue(q->resource_id, q->limit, limit), Str_milliToTime(q->average * 1000., (char[23]){}));
+                        StringBuffer_append(res->outputbuffer, "</td></tr>");
+                        continue;
+                }
                 switch (q->resource_id) {
                         case Resource_CpuPercent:
                                 StringBuffer_append(res->outputbuffer, "CPU usage limit");
@@ -2076,6 +2984,14 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                                 StringBuffer_append(res->outputbuffer, "CPU wait limit");
                                 break;
 
+                        case Resource_CpuSteal:
+                                StringBuffer_append(res->outputbuffer, "CPU steal limit");
+                                break;
+
+                        case Resource_CpuAny:
+                                StringBuffer_append(res->outputbuffer, "Any CPU usage limit");
+                                break;
+
                         case Resource_MemoryPercent:
                                 StringBuffer_append(res->outputbuffer, "Memory usage limit");
                                 break;
@@ -2119,6 +3035,172 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                         case Resource_MemoryPercentTotal:
                                 StringBuffer_append(res->outputbuffer, "Memory usage limit (incl. children)");
                                 break;
+
+                        case Resource_ReadBytes:
+                                StringBuffer_append(res->outputbuffer, "Disk read limit");
+                                break;
+
+                        case Resource_WriteBytes:
+                                StringBuffer_append(res->outputbuffer, "Disk write limit");
+                                break;
+
+                        case Resource_VoluntaryContextSwitches:
+                                StringBuffer_append(res->outputbuffer, "Voluntary context switches");
+                                break;
+
+                        case Resource_NonvoluntaryContextSwitches:
+                                StringBuffer_append(res->outputbuffer, "Nonvoluntary context switches");
+                                break;
+
+                        case Resource_FileDescriptors:
+                                StringBuffer_append(res->outputbuffer, "File descriptors");
+                                break;
+
+                        case Resource_CgroupMemory:
+                                StringBuffer_append(res->outputbuffer, "Cgroup memory limit");
+                                break;
+
+                        case Resource_Pressure:
+                        case Resource_CgroupPressure:
+                                {
+                                        char name[STRLEN];
+                                        Util_getPressureName(q, name, sizeof(name));
+                                        StringBuffer_append(res->outputbuffer, "%c%s", toupper(*name), name + 1);
+                                }
+                                break;
+
+                        case Resource_Meminfo:
+                                StringBuffer_append(res->outputbuffer, "Meminfo %s limit", q->meminfo);
+                                break;
+
+                        case Resource_CgroupCpuPercent:
+                                StringBuffer_append(res->outputbuffer, "Cgroup CPU usage limit");
+                                break;
+
+                        case Resource_CgroupReadBytes:
+                                StringBuffer_append(res->outputbuffer, "Cgroup disk read limit");
+                                break;
+
+                        case Resource_CgroupWriteBytes:
+                                StringBuffer_append(res->outputbuffer, "Cgroup disk write limit");
+                                break;
+
+                        case Resource_ThreadCpu:
+                                StringBuffer_append(res->outputbuffer, "Thread CPU usage limit");
+                                break;
+
+                        case Resource_DirectorySize:
+                                StringBuffer_append(res->outputbuffer, "Total size limit");
+                                break;
+
+                        case Resource_DirectoryFiles:
+                                StringBuffer_append(res->outputbuffer, "Files");
+                                break;
+
+                        case Resource_DirectoryOldest:
+                                StringBuffer_append(res->outputbuffer, "Oldest file");
+                                break;
+
+                        case Resource_DirectoryNewest:
+                                StringBuffer_append(res->outputbuffer, "Newest file");
+                                break;
+
+                        case Resource_ReadOperations:
+                                StringBuffer_append(res->outputbuffer, "Disk read operations");
+                                break;
+
+                        case Resource_WriteOperations:
+                                StringBuffer_append(res->outputbuffer, "Disk write operations");
+                                break;
+
+                        case Resource_ServiceTime:
+                                StringBuffer_append(res->outputbuffer, "Disk service time");
+                                break;
+
+                        case Resource_Utilization:
+                                StringBuffer_append(res->outputbuffer, "Disk utilization");
+                                break;
+
+                        case Resource_SocketConnections:
+                                StringBuffer_append(res->outputbuffer, "Connections");
+                                break;
+
+                        case Resource_SocketEstablished:
+                                StringBuffer_append(res->outputbuffer, "Established connections");
+                                break;
+
+                        case Resource_SocketTimeWait:
+                                StringBuffer_append(res->outputbuffer, "Time wait connections");
+                                break;
+
+                        case Resource_SocketCloseWait:
+                                StringBuffer_append(res->outputbuffer, "Close wait connections");
+                                break;
+
+                        case Resource_SocketListen:
+                                StringBuffer_append(res->outputbuffer, "Listen sockets");
+                                break;
+
+                        case Resource_SocketListenQueue:
+                                StringBuffer_append(res->outputbuffer, "Listen queue");
+                                break;
+
+                        case Resource_SocketListenDrops:
+                                StringBuffer_append(res->outputbuffer, "Listen drops");
+                                break;
+
+                        case Resource_MonitCycle:
+                                StringBuffer_append(res->outputbuffer, "Monit cycle");
+                                break;
+
+                        case Resource_MonitMemory:
+                                StringBuffer_append(res->outputbuffer, "Monit memory");
+                                break;
+
+                        case Resource_MonitQueue:
+                                StringBuffer_append(res->outputbuffer, "Monit queue");
+                                break;
+
+                        case Resource_ProgramCpuTime:
+                                StringBuffer_append(res->outputbuffer, "Program CPU time");
+                                break;
+
+                        case Resource_ProgramMemory:
+                                StringBuffer_append(res->outputbuffer, "Program memory");
+                                break;
+
+                        case Resource_ProgramRunTime:
+                                StringBuffer_append(res->outputbuffer, "Program run time");
+                                break;
+
+                        case Resource_MetricValue:
+                                StringBuffer_append(res->outputbuffer, "Metric value");
+                                break;
+
+                        case Resource_MetricRate:
+                                StringBuffer_append(res->outputbuffer, "Metric rate");
+                                break;
+
+                        case Resource_MetricMax:
+                                StringBuffer_append(res->outputbuffer, "Metric max");
+                                break;
+
+                        case Resource_GpuUsage:
+                                StringBuffer_append(res->outputbuffer, "GPU usage limit");
+                                break;
+
+                        case Resource_GpuMemoryPercent:
+                        case Resource_GpuMemory:
+                                StringBuffer_append(res->outputbuffer, "GPU memory limit");
+                                break;
+
+                        case Resource_GpuTemperature:
+                                StringBuffer_append(res->outputbuffer, "GPU temperature");
+                                break;
+
+                        case Resource_GpuEcc:
+                                StringBuffer_append(res->outputbuffer, "GPU ECC errors");
+                                break;
                         default:
                                 break;
                 }
@@ -2130,14 +3212,28 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                         case Resource_CpuUser:
                         case Resource_CpuSystem:
                         case Resource_CpuWait:
+                        case Resource_CpuSteal:
+                        case Resource_CpuAny:
                         case Resource_MemoryPercent:
                         case Resource_SwapPercent:
+                        case Resource_Pressure:
+                        case Resource_CgroupPressure:
+                        case Resource_CgroupCpuPercent:
+                        case Resource_ThreadCpu:
+                        case Resource_Utilization:
+                        case Resource_GpuUsage:
+                        case Resource_GpuMemoryPercent:
                                 Util_printRule(res->outputbuffer, q->action, "If %s %.1f%%", operatornames[q->operator], q->limit);
                                 break;
 
                         case Resource_MemoryKbyte:
                         case Resource_SwapKbyte:
                         case Resource_MemoryKbyteTotal:
+                        case Resource_CgroupMemory:
+                        case Resource_DirectorySize:
+                        case Resource_MonitMemory:
+                        case Resource_ProgramMemory:
+                        case Resource_GpuMemory:
                                 Util_printRule(res->outputbuffer, q->action, "If %s %s", operatornames[q->operator], Str_bytesToSize(q->limit, buf));
                                 break;
 
@@ -2147,10 +3243,73 @@ static void print_service_rules_resource(HttpResponse res, Service_T s) {
                                 Util_printRule(res->outputbuffer, q->action, "If %s %.1f", operatornames[q->operator], q->limit);
                                 break;
 
+                        case Resource_Meminfo:
+                                {
+                                        int i = Util_getMeminfo(&systeminfo, q->meminfo);
+                                        if (i >= 0 && ! systeminfo.meminfo.field[i].bytes)
+                                                Util_printRule(res->outputbuffer, q->action, "If %s %.0f", operatornames[q->operator], q->limit);
+                                        else
+                                                Util_printRule(res->outputbuffer, q->action, "If %s %s", operatornames[q->operator], Str_bytesToSize(q->limit, buf));
+                                }
+                                break;
+
                         case Resource_Threads:
                         case Resource_Children:
+                        case Resource_FileDescriptors:
+                        case Resource_DirectoryFiles:
+                        case Resource_SocketConnections:
+                        case Resource_SocketEstablished:
+                        case Resource_SocketTimeWait:
+                        case Resource_SocketCloseWait:
+                        case Resource_SocketListen:
+                        case Resource_SocketListenQueue:
+                        case Resource_SocketListenDrops:
+                        case Resource_MonitQueue:
+                        case Resource_GpuEcc:
                                 Util_printRule(res->outputbuffer, q->action, "If %s %.0f", operatornames[q->operator], q->limit);
                                 break;
+
+                        case Resource_DirectoryOldest:
+                        case Resource_DirectoryNewest:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %.0f second(s)", operatornames[q->operator], q->limit);
+                                break;
+
+                        case Resource_ReadBytes:
+                        case Resource_WriteBytes:
+                        case Resource_CgroupReadBytes:
+                        case Resource_CgroupWriteBytes:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %s/s", operatornames[q->operator], Str_bytesToSize(q->limit, buf));
+                                break;
+
+                        case Resource_VoluntaryContextSwitches:
+                        case Resource_NonvoluntaryContextSwitches:
+                        case Resource_ReadOperations:
+                        case Resource_WriteOperations:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %.0f/s", operatornames[q->operator], q->limit);
+                                break;
+
+                        case Resource_ServiceTime:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %.3f ms", operatornames[q->operator], q->limit);
+                                break;
+
+                        case Resource_MonitCycle:
+                        case Resource_ProgramCpuTime:
+                        case Resource_ProgramRunTime:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %s", operatornames[q->operator], Str_milliToTime(q->limit, (char[23]){}));
+                                break;
+
+                        case Resource_MetricValue:
+                        case Resource_MetricMax:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %g", operatornames[q->operator], q->limit);
+                                break;
+
+                        case Resource_MetricRate:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %g per second", operatornames[q->operator], q->limit);
+                                break;
+
+                        case Resource_GpuTemperature:
+                                Util_printRule(res->outputbuffer, q->action, "If %s %.0f C", operatornames[q->operator], q->limit);
+                                break;
                         default:
                                 break;
                 }
@@ -2171,16 +3330,83 @@ static boolean_t is_readonly(HttpRequest req) {
 /* ----------------------------------------------------------- Status output */
 
 
+/**
+ * Returns true if one of the service parameters names the service
+ */
+static boolean_t _isRequested(HttpRequest req, Service_T s) {
+        int cursor = 0;
+        for (const char *name; (name = next_parameter(req, "service", &cursor));)
+                if (IS(name, s->name))
+                        return true;
+        return false;
+}
+
+
+/**
+ * Returns the first service parameter which doesn't name a service or NULL
+ */
+static const char *_missingService(HttpRequest req) {
+        int cursor = 0;
+        for (const char *name; (name = next_parameter(req, "service", &cursor));)
+                if (! Util_getService(name))
+                        return name;
+        return NULL;
+}
+
+
 /* Print status in the given format. Text status is default. */
 static void print_status(HttpRequest req, HttpResponse res, int version) {
         const char *stringFormat = get_parameter(req, "format");
+        const char *stringSince = get_parameter(req, "since");
+        const char *stringWait = get_parameter(req, "wait");
+        const char *accept = get_header(req, "Accept");
+        // An EventSource client which reconnects tells the last generation it saw in the Last-Event-ID header
+        if (accept && Str_sub(accept, "text/event-stream") && get_header(req, "Last-Event-ID"))
+                stringSince = get_header(req, "Last-Event-ID");
+        if ((stringSince && ! Str_match("^[0-9]{1,19}$", stringSince)) || (stringWait && ! Str_match("^[0-9]{1,9}$", stringWait))) {
+                send_error(req, res, SC_BAD_REQUEST, "Invalid since or wait parameter");
+                return;
+        }
+        unsigned long long since = stringSince ? strtoull(stringSince, NULL, 10) : 0ULL;
+        int wait = stringWait ? Str_parseInt(stringWait) : 0;
+        if ((accept && Str_sub(accept, "text/event-stream")) || (since && wait > 0)) {
+                if (__atomic_add_fetch(&_waiters, 1, __ATOMIC_ACQ_REL) > STATUS_WAITERS) {
+                        __atomic_sub_fetch(&_waiters, 1, __ATOMIC_ACQ_REL);
+                        set_header(res, "Retry-After", "5");
+                        send_error(req, res, SC_SERVICE_UNAVAILABLE, "Too many clients are waiting for a status change");
+                        return;
+                }
+                if (accept && Str_sub(accept, "text/event-stream"))
+                        _streamStatus(res, since);
+                else
+                        Snapshot_wait(since, wait < STATUS_WAIT ? wait : STATUS_WAIT);
+                __atomic_sub_fetch(&_waiters, 1, __ATOMIC_ACQ_REL);
+                if (res->is_committed)
+                        return;
+        }
+        // The generation to pass as the since parameter of the next poll
+        char generation[32];
+        snprintf(generation, sizeof(generation), "%llu", __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE));
+        set_header(res, "X-Monit-Generation", generation);
         if (stringFormat && Str_startsWith(stringFormat, "xml")) {
+                // The weak ETag identifies the services status, the client can poll with If-None-Match to skip an unchanged document
                 char buf[STRLEN];
+                snprintf(buf, sizeof(buf), "W/\"%llx-%llx\"", (long long)Run.incarnation, status_xml_tag(version));
+                set_header(res, "ETag", buf);
+                const char *match = get_header(req, "If-None-Match");
+                if (match && Str_sub(match, buf)) {
+                        set_status(res, SC_NOT_MODIFIED);
+                        set_content_type(res, "text/xml");
+                        return;
+                }
                 StringBuffer_T sb = StringBuffer_create(256);
                 status_xml(sb, NULL, version, Socket_getLocalHost(req->S, buf, sizeof(buf)));
-                StringBuffer_append(res->outputbuffer, "%s", StringBuffer_toString(sb));
+                StringBuffer_appendBytes(res->outputbuffer, StringBuffer_toString(sb), StringBuffer_length(sb));
                 StringBuffer_free(&sb);
                 set_content_type(res, "text/xml");
+        } else if (stringFormat && Str_startsWith(stringFormat, "json")) {
+                status_json(res->outputbuffer, Socket_getLocalHost(req->S, (char[STRLEN]){}, STRLEN), since);
+                set_content_type(res, "application/json");
         } else {
                 set_content_type(res, "text/plain");
 
@@ -2188,21 +3414,31 @@ static void print_status(HttpRequest req, HttpResponse res, int version) {
 
                 int found = 0;
                 const char *stringGroup = Util_urlDecode((char *)get_parameter(req, "group"));
-                const char *stringService = Util_urlDecode((char *)get_parameter(req, "service"));
+                const char *stringService = _missingService(req);
+                if (stringService) {
+                        send_error(req, res, SC_BAD_REQUEST, "Service '%s' not found", stringService);
+                        return;
+                }
+                boolean_t all = ! get_parameter(req, "service");
                 if (stringGroup) {
-                        for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
-                                if (IS(stringGroup, sg->name)) {
-                                        for (list_t m = sg->members->head; m; m = m->next) {
-                                                status_service_txt(m->e, res);
-                                                found++;
+                        ServiceGroup_T sg = Util_getServiceGroup(stringGroup);
+                        if (sg) {
+                                for (list_t m = sg->members->head; m; m = m->next) {
+                                        Service_T s = m->e;
+                                        if (! since || ! s->changed || s->changed > since) {
+                                                status_service_txt(s, res);
+                                                flush_response(res);
                                         }
-                                        break;
+                                        found++;
                                 }
                         }
                 } else {
                         for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                                if (! stringService || IS(stringService, s->name)) {
-                                        status_service_txt(s, res);
+                                if (all || _isRequested(req, s)) {
+                                        if (! since || ! s->changed || s->changed > since) {
+                                                status_service_txt(s, res);
+                                                flush_response(res);
+                                        }
                                         found++;
                                 }
                         }
@@ -2210,8 +3446,6 @@ static void print_status(HttpRequest req, HttpResponse res, int version) {
                 if (found == 0) {
                         if (stringGroup)
                                 send_error(req, res, SC_BAD_REQUEST, "Service group '%s' not found", stringGroup);
-                        else if (stringService)
-                                send_error(req, res, SC_BAD_REQUEST, "Service '%s' not found", stringService);
                         else
                                 send_error(req, res, SC_BAD_REQUEST, "No service found");
                 }
@@ -2219,7 +3453,46 @@ static void print_status(HttpRequest req, HttpResponse res, int version) {
 }
 
 
+/**
+ * Stream the status changes as Server-Sent Events: each changed service
+ * is sent as a JSON "service" event, the event id is the generation, so
+ * the client resumes where it stopped when it reconnects
+ */
+static void _streamStatus(HttpResponse res, unsigned long long since) {
+        Socket_T S = res->S;
+        res->is_committed = true;
+        if (Socket_print(S, "HTTP/1.0 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\nretry: 1000\n\n") < 0)
+                return;
+        StringBuffer_T B = StringBuffer_create(1024);
+        for (time_t deadline = Time_now() + STATUS_STREAM; Time_now() < deadline && ! (Run.flags & (Run_Stopped | Run_DoReload));) {
+                unsigned long long generation = Snapshot_wait(since, 15);
+                StringBuffer_clear(B);
+                if (generation > since) {
+                        for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                                unsigned long long changed = __atomic_load_n(&s->changed, __ATOMIC_ACQUIRE);
+                                if (changed > since) {
+                                        StringBuffer_append(B, "event: service\ndata: ");
+                                        status_json_service(B, s);
+                                        StringBuffer_append(B, "\n\n");
+                                }
+                        }
+                        // The id alone updates the client's last event id once the whole batch arrived
+                        StringBuffer_append(B, "id: %llu\n\n", generation);
+                        since = generation;
+                } else {
+                        // Keep the intermediaries from closing the idle connection and notice a gone client
+                        StringBuffer_append(B, ": \n\n");
+                }
+                if (Socket_write(S, (void *)StringBuffer_toString(B), StringBuffer_length(B)) < 0)
+                        break;
+        }
+        StringBuffer_free(&B);
+}
+
+
 static void _printServiceSummary(Box_T t, Service_T s) {
+        struct myservice copy;
+        s = Snapshot_get(s, &copy);
         Box_printColumn(t, "%s", s->name);
         Box_printColumn(t, "%s", get_service_status(TXT, s, (char[STRLEN]){}, STRLEN));
         Box_printColumn(t, "%s", servicetypes[s->type]);
@@ -2238,6 +3511,65 @@ static int _printServiceSummaryByType(Box_T t, Service_Type type) {
 }
 
 
+static Box_T _newSummaryBox(StringBuffer_T b) {
+        return Box_new(b, 3, (BoxColumn_T []){{"Service Name", 31, false, BoxAlign_Left}, {"Status", 26, false, BoxAlign_Left}, {"Type", 13, false, BoxAlign_Left}}, true);
+}
+
+
+/**
+ * Print the summary table of all services. The table is cached until some
+ * service status changes or an action is requested, so the clients polling
+ * the summary get the same table without walking the service list again.
+ * @return The number of the listed services
+ */
+static int _printSummaryAll(StringBuffer_T b) {
+        int found;
+        LOCK(summary.mutex)
+        {
+                // Take the generation before rendering, a change published meanwhile renders the table again next time
+                unsigned long long generation = __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE);
+                if (! summary.table || summary.generation != generation) {
+                        if (! summary.table)
+                                summary.table = StringBuffer_create(1024);
+                        StringBuffer_clear(summary.table);
+                        Box_T t = _newSummaryBox(summary.table);
+                        summary.count = 0;
+                        summary.count += _printServiceSummaryByType(t, Service_System);
+                        summary.count += _printServiceSummaryByType(t, Service_Process);
+                        summary.count += _printServiceSummaryByType(t, Service_File);
+                        summary.count += _printServiceSummaryByType(t, Service_Fifo);
+                        summary.count += _printServiceSummaryByType(t, Service_Directory);
+                        summary.count += _printServiceSummaryByType(t, Service_Filesystem);
+                        summary.count += _printServiceSummaryByType(t, Service_Host);
+                        summary.count += _printServiceSummaryByType(t, Service_Net);
+                        summary.count += _printServiceSummaryByType(t, Service_Socket);
+                        summary.count += _printServiceSummaryByType(t, Service_Heartbeat);
+                        summary.count += _printServiceSummaryByType(t, Service_Metric);
+                        summary.count += _printServiceSummaryByType(t, Service_Program);
+                        Box_free(&t);
+                        summary.generation = generation;
+                }
+                StringBuffer_append(b, "%s", StringBuffer_toString(summary.table));
+                found = summary.count;
+        }
+        END_LOCK;
+        return found;
+}
+
+
+/**
+ * Drop the cached summary table, an action request changes the status
+ * shown by the summary before the check publishes it
+ */
+static void _resetSummary(void) {
+        LOCK(summary.mutex)
+        {
+                summary.generation = 0;
+        }
+        END_LOCK;
+}
+
+
 static void print_summary(HttpRequest req, HttpResponse res) {
         set_content_type(res, "text/plain");
 
@@ -2245,42 +3577,37 @@ static void print_summary(HttpRequest req, HttpResponse res) {
 
         int found = 0;
         const char *stringGroup = Util_urlDecode((char *)get_parameter(req, "group"));
-        const char *stringService = Util_urlDecode((char *)get_parameter(req, "service"));
-        Box_T t = Box_new(res->outputbuffer, 3, (BoxColumn_T []){{"Service Name", 31, false, BoxAlign_Left}, {"Status", 26, false, BoxAlign_Left}, {"Type", 13, false, BoxAlign_Left}}, true);
+        const char *stringService = _missingService(req);
+        if (stringService) {
+                send_error(req, res, SC_BAD_REQUEST, "Service '%s' not found", stringService);
+                return;
+        }
+        if (! stringGroup && ! get_parameter(req, "service")) {
+                if (_printSummaryAll(res->outputbuffer) == 0)
+                        send_error(req, res, SC_BAD_REQUEST, "No service found");
+                return;
+        }
+        Box_T t = _newSummaryBox(res->outputbuffer);
         if (stringGroup) {
-                for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
-                        if (IS(stringGroup, sg->name)) {
-                                for (list_t m = sg->members->head; m; m = m->next) {
-                                        _printServiceSummary(t, m->e);
-                                        found++;
-                                }
-                                break;
+                ServiceGroup_T sg = Util_getServiceGroup(stringGroup);
+                if (sg) {
+                        for (list_t m = sg->members->head; m; m = m->next) {
+                                _printServiceSummary(t, m->e);
+                                found++;
                         }
                 }
-        } else if (stringService) {
+        } else if (get_parameter(req, "service")) {
                 for (Service_T s = servicelist_conf; s; s = s->next_conf) {
-                        if (IS(stringService, s->name)) {
+                        if (_isRequested(req, s)) {
                                 _printServiceSummary(t, s);
                                 found++;
                         }
                 }
-        } else {
-                found += _printServiceSummaryByType(t, Service_System);
-                found += _printServiceSummaryByType(t, Service_Process);
-                found += _printServiceSummaryByType(t, Service_File);
-                found += _printServiceSummaryByType(t, Service_Fifo);
-                found += _printServiceSummaryByType(t, Service_Directory);
-                found += _printServiceSummaryByType(t, Service_Filesystem);
-                found += _printServiceSummaryByType(t, Service_Host);
-                found += _printServiceSummaryByType(t, Service_Net);
-                found += _printServiceSummaryByType(t, Service_Program);
         }
         Box_free(&t);
         if (found == 0) {
                 if (stringGroup)
                         send_error(req, res, SC_BAD_REQUEST, "Service group '%s' not found", stringGroup);
-                else if (stringService)
-                        send_error(req, res, SC_BAD_REQUEST, "Service '%s' not found", stringService);
                 else
                         send_error(req, res, SC_BAD_REQUEST, "No service found");
         }
@@ -2290,63 +3617,317 @@ static void print_summary(HttpRequest req, HttpResponse res) {
 static void _printReport(HttpRequest req, HttpResponse res) {
         set_content_type(res, "text/plain");
         const char *type = get_parameter(req, "type");
-        int count = 0;
+        // The counters follow the published service status, see Snapshot_count()
+        int up = Snapshot_count(SnapshotState_Up);
+        int down = Snapshot_count(SnapshotState_Down);
+        int init = Snapshot_count(SnapshotState_Initializing);
+        int unmonitored = Snapshot_count(SnapshotState_Unmonitored);
+        int total = up + down + init + unmonitored;
         if (! type) {
-                float up = 0, down = 0, init = 0, unmonitored = 0, total = 0;
-                for (Service_T s = servicelist; s; s = s->next) {
-                        if (s->monitor == Monitor_Not)
-                                unmonitored++;
-                        else if (s->monitor & Monitor_Init)
-                                init++;
-                        else if (s->error)
-                                down++;
-                        else
-                                up++;
-                        total++;
-                }
+                float percent = total ? 100. / total : 0;
                 StringBuffer_append(res->outputbuffer,
-                        "up:           %*.0f (%.1f%%)\n"
-                        "down:         %*.0f (%.1f%%)\n"
-                        "initialising: %*.0f (%.1f%%)\n"
-                        "unmonitored:  %*.0f (%.1f%%)\n"
-                        "total:        %*.0f services\n",
-                        3, up, 100. * up / total,
-                        3, down, 100. * down / total,
-                        3, init, 100. * init / total,
-                        3, unmonitored, 100. * unmonitored / total,
+                        "up:           %*d (%.1f%%)\n"
+                        "down:         %*d (%.1f%%)\n"
+                        "initialising: %*d (%.1f%%)\n"
+                        "unmonitored:  %*d (%.1f%%)\n"
+                        "total:        %*d services\n",
+                        3, up, up * percent,
+                        3, down, down * percent,
+                        3, init, init * percent,
+                        3, unmonitored, unmonitored * percent,
                         3, total);
         } else if (Str_isEqual(type, "up")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor != Monitor_Not && ! (s->monitor & Monitor_Init) && ! s->error)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%d\n", up);
         } else if (Str_isEqual(type, "down")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor != Monitor_Not && ! (s->monitor & Monitor_Init) && s->error)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%d\n", down);
         } else if (Str_startsWith(type, "initiali")) { // allow 'initiali(s|z)ing'
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor & Monitor_Init)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%d\n", init);
         } else if (Str_isEqual(type, "unmonitored")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        if (s->monitor == Monitor_Not)
-                                count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%d\n", unmonitored);
         } else if (Str_isEqual(type, "total")) {
-                for (Service_T s = servicelist; s; s = s->next)
-                        count++;
-                StringBuffer_append(res->outputbuffer, "%d\n", count);
+                StringBuffer_append(res->outputbuffer, "%d\n", total);
         } else {
                 send_error(req, res, SC_BAD_REQUEST, "Invalid report type: '%s'", type);
         }
 }
 
 
+static void _printMetrics(HttpRequest req, HttpResponse res) {
+        // A Prometheus scraper announces the text exposition format in the Accept header, other clients get the latency report
+        const char *format = get_parameter(req, "format");
+        const char *accept = get_header(req, "Accept");
+        if ((format && Str_startsWith(format, "prometheus")) || (accept && (Str_sub(accept, "openmetrics-text") || Str_sub(accept, "version=0.0.4")))) {
+                set_content_type(res, "text/plain; version=0.0.4");
+                status_prometheus(res->outputbuffer);
+                return;
+        }
+        set_content_type(res, "text/plain");
+        const char *limit = get_parameter(req, "limit");
+        if (limit && ! Str_match("^[0-9]+$", limit))
+                send_error(req, res, SC_BAD_REQUEST, "Invalid limit: '%s'", limit);
+        else {
+                Profiler_print(res->outputbuffer, limit ? atoi(limit) : 0);
+                StringBuffer_append(res->outputbuffer, "\n");
+                Counter_print(res->outputbuffer);
+        }
+}
+
+
+/**
+ * Print the memory accounting: the memory used by the subsystems which keep
+ * data across the cycles and the resident memory of Monit from the last cycle
+ */
+static void _printMemory(HttpRequest req, HttpResponse res) {
+        set_content_type(res, "text/plain");
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                count++;
+        struct {
+                const char *name;
+                size_t size;
+        } usage[] = {
+                {"services",      count * (sizeof(struct myservice) + sizeof(struct myinfo))},
+                {"process tree",  ProcessTree_memory()},
+                {"event history", History_memory()},
+                {"time series",   Series_memory()},
+                {"profiler",      Profiler_memory()},
+                {"state cache",   State_memory()},
+                {"log buffer",    log_memory()}
+        };
+        char buf[10];
+        size_t total = 0;
+        StringBuffer_append(res->outputbuffer, "%-32s %10s\n", "Subsystem", "size");
+        for (int i = 0; i < (int)(sizeof(usage) / sizeof(usage[0])); i++) {
+                StringBuffer_append(res->outputbuffer, "%-32s %10s\n", usage[i].name, Str_bytesToSize(usage[i].size, buf));
+                total += usage[i].size;
+        }
+        StringBuffer_append(res->outputbuffer, "%-32s %10s\n", "total accounted", Str_bytesToSize(total, buf));
+        if (Run.self.memory)
+                StringBuffer_append(res->outputbuffer, "%-32s %10s\n", "resident memory", Str_bytesToSize(Run.self.memory, buf));
+        StringBuffer_append(res->outputbuffer, "%-32s %10s\n", "low memory mode", Run.flags & Run_LowMemory ? "yes" : "no");
+}
+
+
+static void _printEvents(HttpRequest req, HttpResponse res) {
+        set_content_type(res, "text/plain");
+        const char *limit = get_parameter(req, "limit");
+        const char *before = get_parameter(req, "before");
+        if (limit && ! Str_match("^[0-9]+$", limit))
+                send_error(req, res, SC_BAD_REQUEST, "Invalid limit: '%s'", limit);
+        else if (before && ! Str_match("^[0-9]+$", before))
+                send_error(req, res, SC_BAD_REQUEST, "Invalid before: '%s'", before);
+        else
+                History_print(res->outputbuffer, before ? strtoull(before, NULL, 10) : 0, limit ? atoi(limit) : 50);
+}
+
+
+static void _printSeries(HttpRequest req, HttpResponse res) {
+        set_content_type(res, "text/plain");
+        const char *service = get_parameter(req, "service");
+        const char *metric = get_parameter(req, "metric");
+        const char *since = get_parameter(req, "since");
+        if (since && ! Str_match("^[0-9]+$", since))
+                send_error(req, res, SC_BAD_REQUEST, "Invalid since: '%s'", since);
+        else if (service && ! Util_getService(service))
+                send_error(req, res, SC_NOT_FOUND, "There is no service named '%s'", service);
+        else if (Series_print(res->outputbuffer, service, metric, since ? strtoll(since, NULL, 10) : 0) < 0)
+                send_error(req, res, SC_NOT_FOUND, "The time-series store is not enabled");
+}
+
+
+static RpcResult_Type _rpcStatus(HttpResponse res, RpcFrame_T *F, StringBuffer_T payload) {
+        char service[STRLEN], group[STRLEN];
+        if (! Rpc_getString(F, service, sizeof(service)) || ! Rpc_getString(F, group, sizeof(group)))
+                return RpcResult_BadRequest;
+        if (*service) {
+                Service_T s = Util_getService(service);
+                if (! s)
+                        return RpcResult_NotFound;
+                Rpc_putService(payload, s);
+                Rpc_reply(res->outputbuffer, F, RpcResult_Ok, 0, payload);
+                StringBuffer_clear(payload);
+        } else if (*group) {
+                ServiceGroup_T sg = Util_getServiceGroup(group);
+                // The group names of the binary protocol are case sensitive
+                if (! sg || ! Str_isEqual(group, sg->name))
+                        return RpcResult_NotFound;
+                for (list_t m = sg->members->head; m; m = m->next) {
+                        Rpc_putService(payload, m->e);
+                        Rpc_reply(res->outputbuffer, F, RpcResult_Ok, 0, payload);
+                        StringBuffer_clear(payload);
+                        flush_response(res);
+                }
+        } else {
+                for (Service_T s = servicelist_conf; s; s = s->next_conf) {
+                        Rpc_putService(payload, s);
+                        Rpc_reply(res->outputbuffer, F, RpcResult_Ok, 0, payload);
+                        StringBuffer_clear(payload);
+                        flush_response(res);
+                }
+        }
+        return RpcResult_Ok;
+}
+
+
+static RpcResult_Type _rpcAction(HttpRequest req, RpcFrame_T *F, StringBuffer_T payload) {
+        char action[STRLEN], service[STRLEN];
+        if (is_readonly(req))
+                return RpcResult_Forbidden;
+        Action_Type doaction;
+        if (! Rpc_getString(F, action, sizeof(action)) || (doaction = Util_getAction(action)) == Action_Ignored)
+                return RpcResult_BadRequest;
+        // Check all services first, the action is scheduled for all or none
+        RpcFrame_T services = *F;
+        while (F->length) {
+                if (! Rpc_getString(F, service, sizeof(service)))
+                        return RpcResult_BadRequest;
+                if (! Util_getService(service))
+                        return RpcResult_NotFound;
+        }
+        uint32_t count = 0;
+        LOCK(mutex)
+        while (services.length && Rpc_getString(&services, service, sizeof(service))) {
+                _scheduleAction(Util_getService(service), doaction, action);
+                count++;
+        }
+        END_LOCK;
+        if (count) {
+                Run.flags |= Run_ActionPending;
+                Wakeup_signal();
+        }
+        Rpc_putU32(payload, count);
+        return RpcResult_Ok;
+}
+
+
+/**
+ * Handle a batch of binary protocol requests, see rpc.h. The response
+ * frames are streamed as they are produced, a request which fails gets
+ * a single frame with the error result
+ */
+static void _handleHeartbeat(HttpRequest req, HttpResponse res) {
+        if (is_readonly(req)) {
+                send_error(req, res, SC_FORBIDDEN, "You do not have sufficent privileges to access this page");
+                return;
+        }
+        char *name = Util_urlDecode(Str_dup(req->url + strlen(HEARTBEAT_PATH)));
+        if (Heartbeat_post(name)) {
+                set_content_type(res, "text/plain");
+                StringBuffer_append(res->outputbuffer, "ok\n");
+        } else {
+                send_error(req, res, SC_NOT_FOUND, "There is no heartbeat service named \"%s\"", name);
+        }
+        FREE(name);
+}
+
+
+static void _handleRpc(HttpRequest req, HttpResponse res) {
+        if (! req->body) {
+                send_error(req, res, SC_UNSUPPORTED_MEDIA_TYPE, "The request content type must be %s", RPC_CONTENT_TYPE);
+                return;
+        }
+        set_content_type(res, RPC_CONTENT_TYPE);
+        RpcFrame_T F;
+        const unsigned char *data = req->body;
+        int length = req->body_length;
+        StringBuffer_T payload = StringBuffer_create(256);
+        while (Rpc_next(&data, &length, &F)) {
+                RpcResult_Type result = RpcResult_Ok;
+                switch (F.method) {
+                        case Rpc_Status:
+                                result = _rpcStatus(res, &F, payload);
+                                break;
+                        case Rpc_Summary:
+                                for (SnapshotState_Type state = 0; state <= SnapshotState_Last; state++)
+                                        Rpc_putU32(payload, Snapshot_count(state));
+                                Rpc_putU64(payload, Run.generation);
+                                break;
+                        case Rpc_Action:
+                                result = _rpcAction(req, &F, payload);
+                                break;
+                        case Rpc_Events:
+                                {
+                                        uint32_t limit;
+                                        uint64_t before;
+                                        if (Rpc_getU32(&F, &limit) && Rpc_getU64(&F, &before))
+                                                History_print(payload, before, limit ? (int)limit : 50);
+                                        else
+                                                result = RpcResult_BadRequest;
+                                }
+                                break;
+                        case Rpc_Series:
+                                {
+                                        char service[STRLEN], metric[STRLEN];
+                                        uint64_t since;
+                                        if (! Rpc_getString(&F, service, sizeof(service)) || ! Rpc_getString(&F, metric, sizeof(metric)) || ! Rpc_getU64(&F, &since))
+                                                result = RpcResult_BadRequest;
+                                        else if (*service && ! Util_getService(service))
+                                                result = RpcResult_NotFound;
+                                        else if (Series_print(payload, *service ? service : NULL, *metric ? metric : NULL, (time_t)since) < 0)
+                                                result = RpcResult_Unavailable;
+                                }
+                                break;
+                        default:
+                                result = RpcResult_BadRequest;
+                                break;
+                }
+                if (result != RpcResult_Ok)
+                        StringBuffer_clear(payload);
+                Rpc_reply(res->outputbuffer, &F, result, RPC_LAST, payload);
+                StringBuffer_clear(payload);
+                flush_response(res);
+        }
+        StringBuffer_free(&payload);
+        // A truncated frame ends the batch, the client sees the missing responses
+        if (length)
+                DEBUG("Truncated binary request frame from %s\n", Socket_getRemoteHost(req->S));
+}
+
+
+/**
+ * Print the status tree merged from the federation agents. The document
+ * is rendered only when the tree changed, the weak ETag lets the client
+ * skip an unchanged document
+ */
+static void _printFederation(HttpRequest req, HttpResponse res) {
+        if (! Run.federation.agents) {
+                send_error(req, res, SC_NOT_FOUND, "The federation is not enabled");
+                return;
+        }
+        char buf[STRLEN];
+        snprintf(buf, sizeof(buf), "W/\"%llx-%llx\"", (long long)Run.incarnation, Federation_generation());
+        const char *match = get_header(req, "If-None-Match");
+        if (match && Str_sub(match, buf)) {
+                set_header(res, "ETag", buf);
+                set_status(res, SC_NOT_MODIFIED);
+                set_content_type(res, "application/json");
+                return;
+        }
+        // The tree may change between the two calls, the ETag is of the sent document
+        snprintf(buf, sizeof(buf), "W/\"%llx-%llx\"", (long long)Run.incarnation, Federation_status(res->outputbuffer));
+        set_header(res, "ETag", buf);
+        set_content_type(res, "application/json");
+}
+
+
+/**
+ * Print the certificate inventory of the TLS connections made by the port
+ * tests, see Ssl_printCertificates()
+ */
+static void _printCertificates(HttpRequest req, HttpResponse res) {
+#ifdef HAVE_OPENSSL
+        set_content_type(res, "application/json");
+        Ssl_printCertificates(res->outputbuffer);
+#else
+        send_error(req, res, SC_NOT_FOUND, "SSL is not supported");
+#endif
+}
+
+
 static void status_service_txt(Service_T s, HttpResponse res) {
         char buf[STRLEN];
+        struct myservice copy;
+        s = Snapshot_get(s, &copy);
         StringBuffer_append(res->outputbuffer,
                 COLOR_BOLDCYAN "%s '%s'" COLOR_RESET "\n"
                 "  %-28s %s\n",
@@ -2361,11 +3942,28 @@ static void status_service_txt(Service_T s, HttpResponse res) {
         StringBuffer_append(res->outputbuffer,
                 "  %-28s %s\n",
                 "on reboot", onrebootnames[s->onreboot]);
+        if (_getRestartBackoff(s, buf, sizeof(buf)))
+                StringBuffer_append(res->outputbuffer, "  %-28s %s\n", "restart backoff", buf);
         _printStatus(TXT, res, s);
         StringBuffer_append(res->outputbuffer, "\n");
 }
 
 
+/**
+ * Describe the restart backoff of the service which failed again after restart
+ * @return buf or NULL if the service is not restarted in a row
+ */
+static char *_getRestartBackoff(Service_T s, char *buf, int buflen) {
+        if (s->backoff.failures < 1)
+                return NULL;
+        long long remaining = s->backoff.deferred - Time_monotonic();
+        int length = snprintf(buf, buflen, "%d restarts in a row%s", s->backoff.failures + 1, s->backoff.failures >= RESTART_CRASHLOOP ? " (crash loop)" : "");
+        if (remaining > 0 && length < buflen)
+                snprintf(buf + length, buflen - length, ", next restart deferred for %s", Str_milliToTime(remaining, (char[23]){}));
+        return buf;
+}
+
+
 static char *get_monitoring_status(Output_Type type, Service_T s, char *buf, int buflen) {
         ASSERT(s);
         ASSERT(buf);
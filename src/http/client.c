@@ -61,6 +61,7 @@
 #include "Box.h"
 
 // libmonit
+#include "system/Net.h"
 #include "exceptions/AssertException.h"
 #include "exceptions/IOException.h"
 
@@ -71,6 +72,23 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+struct response {
+        long long length;        // The body length, -1 if the body ends with the connection
+        boolean_t chunked;
+        boolean_t persistent;
+};
+
+
+/* A session keeps the connection to the daemon open for the following requests */
+static struct {
+        boolean_t open;
+        Socket_T S;
+} session = {};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -95,7 +113,7 @@ static char *_getBasicAuthHeader() {
 }
 
 
-static void _parseHttpResponse(Socket_T S) {
+static void _parseHttpResponse(Socket_T S, struct response *response) {
         char buf[1024];
         if (! Socket_readLine(S, buf, sizeof(buf)))
                 THROW(IOException, "Error receiving data -- %s", STRERROR);
@@ -126,11 +144,21 @@ static void _parseHttpResponse(Socket_T S) {
                 }
                 THROW(AssertException, "%s", message ? message : "cannot parse response");
         } else {
-                // Skip HTTP headers
+                // Read the HTTP headers which frame the body
+                response->length = -1;
+                response->chunked = response->persistent = false;
                 while (Socket_readLine(S, buf, sizeof(buf))) {
-                         if (! strncmp(buf, "\r\n", sizeof(buf)))
+                        if (! strncmp(buf, "\r\n", sizeof(buf)))
                                 break;
+                        if (Str_startsWith(buf, "Content-Length") && ! sscanf(buf, "%*s%*[: ]%lld", &response->length))
+                                THROW(IOException, "Invalid Content-Length header: %s", buf);
+                        else if (Str_startsWith(buf, "Transfer-Encoding") && Str_sub(buf, "chunked"))
+                                response->chunked = true;
+                        else if (Str_startsWith(buf, "Connection") && Str_sub(buf, "keep-alive"))
+                                response->persistent = true;
                 }
+                if (! response->chunked && response->length < 0)
+                        response->persistent = false;
         }
 }
 
@@ -138,15 +166,19 @@ static void _parseHttpResponse(Socket_T S) {
 static void _send(Socket_T S, const char *request, StringBuffer_T data) {
         _argument(data, "format", "text");
         char *_auth = _getBasicAuthHeader();
+        // A session asks for a persistent connection, HTTP/1.1 connections stay open unless closed
         int rv = Socket_print(S,
-                "POST %s HTTP/1.0\r\n"
+                "POST %s %s\r\n"
                 "Content-Type: application/x-www-form-urlencoded\r\n"
                 "Content-Length: %d\r\n"
+                 "%s"
                  "%s"
                  "\r\n"
                  "%s",
                 request,
+                session.open ? "HTTP/1.1" : "HTTP/1.0",
                 StringBuffer_length(data),
+                session.open ? "Host: localhost\r\n" : "",
                 _auth ? _auth : "",
                 StringBuffer_toString(data));
         FREE(_auth);
@@ -155,51 +187,139 @@ static void _send(Socket_T S, const char *request, StringBuffer_T data) {
 }
 
 
-static void _receive(Socket_T S) {
+static void _print(char *line, boolean_t strip, char *buf, int size) {
+        if (strip)
+                Color_strip(Box_strip(line));
+        printf("%s", line);
+        fflush(stdout);
+        if (buf)
+                snprintf(buf, size, "%s", line);
+}
+
+
+static void _read(Socket_T S, StringBuffer_T body, long long length) {
+        char data[8192];
+        while (length > 0) {
+                int n = Socket_read(S, data, (int)MIN(length, (long long)sizeof(data)));
+                if (n <= 0)
+                        THROW(IOException, "Error receiving data -- %s", n < 0 ? STRERROR : "incomplete response");
+                StringBuffer_appendBytes(body, data, n);
+                length -= n;
+        }
+}
+
+
+static void _readChunked(Socket_T S, StringBuffer_T body) {
         char buf[1024];
-        _parseHttpResponse(S);
+        long long length;
+        do {
+                if (! Socket_readLine(S, buf, sizeof(buf)) || sscanf(buf, "%llx", &length) != 1 || length < 0)
+                        THROW(IOException, "Invalid chunk in response");
+                _read(S, body, length);
+                // The chunk data is followed by CRLF, the last chunk by the (empty) trailer
+                if (length > 0 && ! Socket_readLine(S, buf, sizeof(buf)))
+                        THROW(IOException, "Error receiving data -- %s", STRERROR);
+        } while (length > 0);
+        while (Socket_readLine(S, buf, sizeof(buf)) && strncmp(buf, "\r\n", sizeof(buf)))
+                ;
+}
+
+
+/**
+ * Print the response, the last line is kept in buf unless it is NULL
+ * @return true if the connection can be reused for the next request
+ */
+static boolean_t _receive(Socket_T S, char *buf, int size) {
+        struct response response;
+        _parseHttpResponse(S, &response);
         boolean_t strip = (Run.flags & Run_Batch || ! Color_support()) ? true : false;
-        while (Socket_readLine(S, buf, sizeof(buf))) {
-                if (strip)
-                        Color_strip(Box_strip(buf));
-                printf("%s", buf);
+        if (response.chunked || response.length >= 0) {
+                // The framed body is read as a whole first, so a multibyte character split between the chunks is stripped in one piece
+                StringBuffer_T body = StringBuffer_create(1024);
+                TRY
+                {
+                        if (response.chunked)
+                                _readChunked(S, body);
+                        else
+                                _read(S, body, response.length);
+                        char *line = (char *)StringBuffer_toString(body);
+                        while (*line) {
+                                char *next = strchr(line, '\n');
+                                next = next ? next + 1 : line + strlen(line);
+                                char c = *next;
+                                *next = 0;
+                                _print(line, strip, buf, size);
+                                *next = c;
+                                line = next;
+                        }
+                }
+                FINALLY
+                {
+                        StringBuffer_free(&body);
+                }
+                END_TRY;
+        } else {
+                char line[1024];
+                while (Socket_readLine(S, line, sizeof(line)))
+                        _print(line, strip, buf, size);
         }
+        return response.persistent;
 }
 
 
-static boolean_t _client(const char *request, StringBuffer_T data) {
-        boolean_t status = false;
-        if (! exist_daemon()) {
-                LogError("Action failed: the monit daemon is not running\n");
-                return status;
-        }
+static Socket_T _connect() {
         Socket_T S = NULL;
-        if (Run.httpd.flags & Httpd_Net) {
-                // FIXME: Monit HTTP support IPv4 only currently ... when IPv6 is implemented change the family to Socket_Ip
+        // Prefer the unix socket if the user can connect to it, it saves the TCP (and SSL) handshake
+        if ((Run.httpd.flags & Httpd_Unix) && (! (Run.httpd.flags & Httpd_Net) || access(Run.httpd.socket.unix.path, R_OK | W_OK) == 0)) {
+                S = Socket_createUnix(Run.httpd.socket.unix.path, Socket_Tcp, Run.limits.networkTimeout);
+        } else if (Run.httpd.flags & Httpd_Net) {
                 SslOptions_T options = {
                         .flags = (Run.httpd.flags & Httpd_Ssl) ? SSL_Enabled : SSL_Disabled,
                         .clientpemfile = Run.httpd.socket.net.ssl.clientpem,
                         .allowSelfSigned = Run.httpd.flags & Httpd_AllowSelfSignedCertificates
                 };
-                S = Socket_create(Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "localhost", Run.httpd.socket.net.port, Socket_Tcp, Socket_Ip4, options, Run.limits.networkTimeout);
-        } else if (Run.httpd.flags & Httpd_Unix) {
-                S = Socket_createUnix(Run.httpd.socket.unix.path, Socket_Tcp, Run.limits.networkTimeout);
+                S = Socket_create(Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "localhost", Run.httpd.socket.net.port, Socket_Tcp, Socket_Ip, options, Run.limits.networkTimeout);
         } else {
                 LogError("Action failed: the monit HTTP interface is not enabled, please add the 'set httpd' statement and use an 'allow' option to allow monit to connect to it\n");
         }
-        if (S) {
+        return S;
+}
+
+
+static boolean_t _client(const char *request, StringBuffer_T data, char *last, int size) {
+        boolean_t status = false;
+        if (! exist_daemon()) {
+                LogError("Action failed: the monit daemon is not running\n");
+                return status;
+        }
+        Socket_T S = session.S;
+        session.S = NULL;
+        // The daemon closes an idle connection after a while, the idle socket is readable then as the end of file is pending
+        if (S && Net_canRead(Socket_getSocket(S), 0))
+                Socket_free(&S);
+        if (S || (S = _connect())) {
+                volatile boolean_t persistent = false;
                 TRY
                 {
+                        // The daemon sends a notice at least every 10 seconds while the client waits for the action result
+                        if (Run.flags & Run_ActionWait)
+                                Socket_setTimeout(S, MAX(Run.limits.networkTimeout, 30000));
                         _send(S, request, data);
-                        _receive(S);
+                        persistent = _receive(S, last, size);
                         status = true;
                 }
                 ELSE
                 {
+                        persistent = false;
                         LogError("%s\n", Exception_frame.message);
                 }
                 END_TRY;
-                Socket_free(&S);
+                if (session.open && persistent) {
+                        Socket_setTimeout(S, Run.limits.networkTimeout);
+                        session.S = S;
+                } else {
+                        Socket_free(&S);
+                }
         }
         return status;
 }
@@ -219,8 +339,21 @@ boolean_t HttpClient_action(const char *action, List_T services) {
         _argument(data, "action", action);
         for (list_t s = services->head; s; s = s->next)
                 _argument(data, "service", s->e);
-        boolean_t rv = _client("/_doaction", data);
+        if (Run.flags & Run_ActionWait)
+                _argument(data, "progress", "true");
+        char last[1024] = {};
+        boolean_t rv = _client("/_doaction", data, last, sizeof(last));
         StringBuffer_free(&data);
+        if (rv && (Run.flags & Run_ActionWait)) {
+                // The summary line: "<action>: <done> done, <failed> failed, <pending> pending"
+                int failed = 0, pending = 0;
+                if (sscanf(last, "%*s %*d done, %d failed, %d pending", &failed, &pending) != 2) {
+                        LogError("Action %s: the result is unknown\n", action);
+                        rv = false;
+                } else if (failed || pending) {
+                        rv = false;
+                }
+        }
         return rv;
 }
 
@@ -229,31 +362,71 @@ boolean_t HttpClient_report(const char *type) {
         StringBuffer_T data = StringBuffer_create(64);
         if (STR_DEF(type))
                 _argument(data, "type", type);
-        boolean_t rv = _client("/_report", data);
+        boolean_t rv = _client("/_report", data, NULL, 0);
+        StringBuffer_free(&data);
+        return rv;
+}
+
+
+boolean_t HttpClient_metrics(void) {
+        StringBuffer_T data = StringBuffer_create(64);
+        boolean_t rv = _client("/_metrics", data, NULL, 0);
         StringBuffer_free(&data);
         return rv;
 }
 
 
-boolean_t HttpClient_status(const char *group, const char *service) {
+boolean_t HttpClient_memory(void) {
+        StringBuffer_T data = StringBuffer_create(64);
+        boolean_t rv = _client("/_memory", data, NULL, 0);
+        StringBuffer_free(&data);
+        return rv;
+}
+
+
+boolean_t HttpClient_events(const char *limit) {
+        StringBuffer_T data = StringBuffer_create(64);
+        if (STR_DEF(limit))
+                _argument(data, "limit", limit);
+        boolean_t rv = _client("/_events", data, NULL, 0);
+        StringBuffer_free(&data);
+        return rv;
+}
+
+
+void HttpClient_open(void) {
+        session.open = true;
+}
+
+
+void HttpClient_close(void) {
+        session.open = false;
+        if (session.S)
+                Socket_free(&session.S);
+}
+
+
+boolean_t HttpClient_status(const char *group, List_T services) {
         StringBuffer_T data = StringBuffer_create(64);
-        if (STR_DEF(service))
-                _argument(data, "service", service);
+        if (services)
+                for (list_t s = services->head; s; s = s->next)
+                        _argument(data, "service", s->e);
         if (STR_DEF(group))
                 _argument(data, "group", group);
-        boolean_t rv = _client("/_status", data);
+        boolean_t rv = _client("/_status", data, NULL, 0);
         StringBuffer_free(&data);
         return rv;
 }
 
 
-boolean_t HttpClient_summary(const char *group, const char *service) {
+boolean_t HttpClient_summary(const char *group, List_T services) {
         StringBuffer_T data = StringBuffer_create(64);
-        if (STR_DEF(service))
-                _argument(data, "service", service);
+        if (services)
+                for (list_t s = services->head; s; s = s->next)
+                        _argument(data, "service", s->e);
         if (STR_DEF(group))
                 _argument(data, "group", group);
-        boolean_t rv = _client("/_summary", data);
+        boolean_t rv = _client("/_summary", data, NULL, 0);
         StringBuffer_free(&data);
         return rv;
 }
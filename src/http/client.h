@@ -27,7 +27,8 @@
 
 
 /**
- * Do service action
+ * Do service action. If Run_ActionWait is set, the daemon streams the
+ * result of each service until all are done
  * @param action A string representation of Action_Type
  * @param services List of services
  * @return true if succeeded otherwise false
@@ -43,22 +44,58 @@ boolean_t HttpClient_action(const char *action, List_T services);
 boolean_t HttpClient_report(const char *type);
 
 
+/**
+ * Print the poll cycle phases and service checks durations
+ * @return true if succeeded otherwise false
+ */
+boolean_t HttpClient_metrics(void);
+
+
+/**
+ * Print the memory used by the Monit subsystems
+ * @return true if succeeded otherwise false
+ */
+boolean_t HttpClient_memory(void);
+
+
+/**
+ * Print the recent events, the newest first
+ * @param limit The maximum number of events or NULL for the default
+ * @return true if succeeded otherwise false
+ */
+boolean_t HttpClient_events(const char *limit);
+
+
 /**
  * Print service status
  * @param group Service group or NULL
- * @param service Service name or NULL
+ * @param services List of service names or NULL for all services
  * @return true if succeeded otherwise false
  */
-boolean_t HttpClient_status(const char *group, const char *service);
+boolean_t HttpClient_status(const char *group, List_T services);
 
 
 /**
  * Print service summary
  * @param group Service group or NULL
- * @param service Service name or NULL
+ * @param services List of service names or NULL for all services
  * @return true if succeeded otherwise false
  */
-boolean_t HttpClient_summary(const char *group, const char *service);
+boolean_t HttpClient_summary(const char *group, List_T services);
+
+
+/**
+ * Open a session: the following requests reuse one persistent
+ * connection to the daemon. The connection is opened on the first
+ * request and reopened if the daemon closed it.
+ */
+void HttpClient_open(void);
+
+
+/**
+ * Close the session and its connection
+ */
+void HttpClient_close(void);
 
 
 #endif
@@ -80,6 +80,10 @@
 #include <arpa/inet.h>
 #endif
 
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
 #include "monit.h"
 #include "engine.h"
 #include "net.h"
@@ -90,6 +94,8 @@
 
 // libmonit
 #include "system/Net.h"
+#include "system/Time.h"
+#include "thread/Thread.h"
 #include "exceptions/AssertException.h"
 
 
@@ -98,9 +104,18 @@
  *  request and response to the processor module.
  *
  *  NOTE
- *    This server does not use threads or forks; Requests are
- *    serialized and pending requests will be popped from the
- *    connection queue when the current request finish.
+ *    The server thread accepts the connections and waits with poll()
+ *    for the request data of all accepted connections, each connection
+ *    has its own deadline. A connection with the request data pending
+ *    is passed to a small pool of worker threads, which do the SSL
+ *    handshake and process the request, so one slow client doesn't block
+ *    the others. Persistent (keep-alive) connections are returned to the
+ *    server thread after the response, pipelined requests are processed
+ *    by the worker directly.
+ *
+ *    The server can be suspended while Monit reloads the configuration:
+ *    the requests wait until the new configuration is in place, the
+ *    listeners stay open.
  *
  *    Since this server is written for monit, low traffic is expected.
  *    Connect from not-authenicated clients will be closed down
@@ -117,109 +132,159 @@
 
 
 typedef struct HostsAllow_T {
-        unsigned long network;
-        unsigned long mask;
+        int family;                                  /**< AF_INET or AF_INET6 */
+        int prefix;                            /**< Network prefix length [bits] */
+        unsigned char network[16];        /**< Network address, 4 or 16 bytes */
         /* For internal use */
         struct HostsAllow_T *next;
 } *HostsAllow_T;
 
 
+/* The allow list compiled to a binary trie of the network prefixes: node 0 is the IPv4 root, node 1 the IPv6 root, child 0 means none */
+typedef struct AclNode_T {
+        int child[2];
+        boolean_t allow;                  /**< A network prefix ends at this node */
+} AclNode_T;
+
+
+typedef struct Acl_T {
+        int count;
+        int size;
+        AclNode_T *nodes;
+} *Acl_T;
+
+
+#define ENGINE_LISTENERS 2               /**< Server sockets: TCP and unix socket */
+#define ENGINE_WORKERS 4                          /**< Request processing threads */
+#define ENGINE_PENDING 256     /**< Maximum number of connections waiting for the request */
+
+
+/* Server socket */
+typedef struct Listener_T {
+        int socket;
+        SslServer_T sslserver;           /**< SSL server or NULL if plaintext */
+} Listener_T;
+
+
+/* Accepted connection */
+typedef struct Connection_T {
+        int socket;
+        int requests;                   /**< Number of requests served so far */
+        socklen_t addrlen;
+        struct sockaddr_storage addr;
+        long long deadline;              /**< Time to receive the request [ms] */
+        SslServer_T sslserver;                 /**< The listener's SSL server */
+        Socket_T S;       /**< Connection object, NULL until the first request */
+} Connection_T;
+
+
+static struct {
+        boolean_t stopping;                 /**< The workers should stop */
+        int count;              /**< Connections waiting for the request data */
+        int ready;                      /**< Connections waiting for a worker */
+        int head;                        /**< Index of the first ready connection */
+        int idle;        /**< Persistent connections returned by the workers */
+        int listeners;                          /**< Number of server sockets */
+        int wakeup[2];              /**< Pipe to wake up the server thread */
+        Sem_T available;         /**< Signalled when a connection became ready */
+        Thread_T workers[ENGINE_WORKERS];
+        Listener_T listener[ENGINE_LISTENERS];
+        Connection_T waiting[ENGINE_PENDING];
+        Connection_T queue[ENGINE_PENDING];
+        Connection_T idling[ENGINE_PENDING];
+} engine = {};
+
+
 static volatile boolean_t stopped = false;
-static int myServerSocket = 0;
-#ifdef HAVE_OPENSSL
-SslServer_T mySSLServerConnection = NULL;
-#endif
 static HostsAllow_T hostlist = NULL;
+static Acl_T acl = NULL;             /**< The allow list in effect, NULL allows all */
+static int aclReaders = 0;         /**< Threads reading the acl, see _authenticateHost() */
 static Mutex_T mutex = PTHREAD_MUTEX_INITIALIZER;
+static Mutex_T queueMutex = PTHREAD_MUTEX_INITIALIZER;
+static Lock_T suspendLock = PTHREAD_RWLOCK_INITIALIZER;  /**< Held for writing while the configuration is reloaded */
 
 
 /* ----------------------------------------------------------------- Private */
 
 
 /**
- * Parse network string and return numeric IP and netmask
- * @param pattern A network identifier in IP/mask format to be parsed
- * @param net A structure holding IP and mask of the network
+ * Parse network string and return the network address and prefix length
+ * @param pattern A network identifier in IP/mask format to be parsed, the
+ * IPv4 mask may be a prefix length or a dotted netmask, the IPv6 mask a
+ * prefix length. A plain IP address is a host network.
+ * @param net A structure holding the network address and prefix
  * @return false if parsing fails otherwise true
  */
 static boolean_t _parseNetwork(char *pattern, HostsAllow_T net) {
         ASSERT(pattern);
         ASSERT(net);
 
-        char *longmask = NULL;
-        int shortmask = 0;
-        int slashcount = 0;
-        int dotcount = 0;
-        int count = 0;
-
         char buf[STRLEN];
         snprintf(buf, STRLEN, "%s", pattern);
-        char *temp = buf;
-        /* decide if we have xxx.xxx.xxx.xxx/yyy or xxx.xxx.xxx.xxx/yyy.yyy.yyy.yyy */
-        while (*temp) {
-                if (*temp == '/') {
-                        /* We have found a "/" -> we are preceeding to the netmask */
-                        if ((slashcount == 1) || (dotcount != 3))
-                                /* We have already found a "/" or we haven't had enough dots before finding the slash -> Error! */
-                                return false;
-                        *temp = 0;
-                        longmask = *(temp + 1) ? temp + 1 : NULL;
-                        count = 0;
-                        slashcount = 1;
-                        dotcount = 0;
-                } else if (*temp == '.') {
-                        /* We have found the next dot! */
-                        dotcount++;
-                } else if (! isdigit((int)*temp)) {
-                        /* No number, "." or "/" -> Error! */
+        char *mask = strchr(buf, '/');
+        if (mask) {
+                *mask++ = 0;
+                if (! *mask)
                         return false;
-                }
-                count++;
-                temp++;
         }
-        if (slashcount == 0) {
-                /* We have just host portion */
-                shortmask = 32;
-        } else if ((dotcount == 0) && (count > 1) && (count < 4)) {
-                /* We have no dots but 1 or 2 numbers after the slash -> short netmask */
-                if (longmask != NULL) {
-                        shortmask = atoi(longmask);
-                        longmask = NULL;
-                }
-        } else if (dotcount != 3) {
-                /* A long netmask requires three dots */
-                return false;
-        }
-        /* Parse the network */
-        struct in_addr inp;
-        if (! inet_aton(buf, &inp))
-                return false;
-        net->network = inp.s_addr;
-        /* Convert short netmasks to integer */
-        if (longmask == NULL) {
-                if ((shortmask > 32) || (shortmask < 0)) {
+#ifdef HAVE_IPV6
+        if (strchr(buf, ':')) {
+                net->family = AF_INET6;
+                if (inet_pton(AF_INET6, buf, net->network) != 1)
                         return false;
-                } else if ( shortmask == 32 ) {
-                        net->mask = -1;
-                } else {
-                        net->mask = (1 << shortmask) - 1;
-                        net->mask = htonl(net->mask << (32 - shortmask));
+                net->prefix = 128;
+                if (mask) {
+                        if (strlen(mask) > 3 || strspn(mask, "0123456789") != strlen(mask) || (net->prefix = atoi(mask)) > 128)
+                                return false;
                 }
-        } else {
-                /* Parse long netmasks */
-                if (! inet_aton(longmask, &inp))
+        } else
+#endif
+        {
+                /* The network must be xxx.xxx.xxx.xxx */
+                int dotcount = 0;
+                for (char *temp = buf; *temp; temp++) {
+                        if (*temp == '.')
+                                dotcount++;
+                        else if (! isdigit((int)*temp))
+                                return false;
+                }
+                struct in_addr inp;
+                if (dotcount != 3 || ! inet_aton(buf, &inp))
                         return false;
-                net->mask = inp.s_addr;
+                net->family = AF_INET;
+                memcpy(net->network, &inp, 4);
+                net->prefix = 32;
+                if (mask) {
+                        if (strspn(mask, "0123456789") == strlen(mask)) {
+                                /* Short netmask */
+                                if (strlen(mask) > 2 || (net->prefix = atoi(mask)) > 32)
+                                        return false;
+                        } else {
+                                /* Long netmask xxx.xxx.xxx.xxx, it must be contiguous */
+                                dotcount = 0;
+                                for (char *temp = mask; *temp; temp++)
+                                        if (*temp == '.')
+                                                dotcount++;
+                                if (dotcount != 3 || ! inet_aton(mask, &inp))
+                                        return false;
+                                uint32_t m = ntohl(inp.s_addr);
+                                if (~m & (~m + 1))
+                                        return false;
+                                for (net->prefix = 0; m; m <<= 1)
+                                        net->prefix++;
+                        }
+                }
         }
         /* Remove bogus network components */
-        net->network &= net->mask;
+        for (int i = net->prefix; i < (net->family == AF_INET ? 32 : 128); i++)
+                net->network[i / 8] &= ~(0x80 >> (i % 8));
         return true;
 }
 
 
 static boolean_t _hasHostAllow(HostsAllow_T host) {
         for (HostsAllow_T p = hostlist; p; p = p->next)
-                if ((p->network == host->network) && ((p->mask == host->mask)))
+                if (p->family == host->family && p->prefix == host->prefix && memcmp(p->network, host->network, sizeof(p->network)) == 0)
                         return true;
         return false;
 }
@@ -233,73 +298,338 @@ static void _destroyHostAllow(HostsAllow_T p) {
 }
 
 
+static void _addHostAllow(HostsAllow_T h, const char *type, const char *pattern) {
+        LOCK(mutex)
+        {
+                if (_hasHostAllow(h)) {
+                        LogWarning("Skipping redundant %s '%s'\n", type, pattern);
+                        FREE(h);
+                } else {
+                        DEBUG("Adding %s allow '%s'\n", type, pattern);
+                        h->next = hostlist;
+                        hostlist = h;
+                }
+        }
+        END_LOCK;
+}
+
+
+static void _aclInsert(Acl_T a, int root, const unsigned char *network, int prefix) {
+        int n = root;
+        for (int i = 0; i < prefix && ! a->nodes[n].allow; i++) {
+                int bit = (network[i / 8] >> (7 - i % 8)) & 1;
+                if (! a->nodes[n].child[bit]) {
+                        if (a->count >= a->size) {
+                                a->size *= 2;
+                                RESIZE(a->nodes, a->size * sizeof(AclNode_T));
+                        }
+                        a->nodes[a->count] = (AclNode_T){};
+                        a->nodes[n].child[bit] = a->count++;
+                }
+                n = a->nodes[n].child[bit];
+        }
+        // A shorter prefix covers the longer ones below
+        a->nodes[n] = (AclNode_T){.allow = true};
+}
+
+
+static boolean_t _aclMatch(Acl_T a, int root, const unsigned char *address, int bits) {
+        int n = root;
+        for (int i = 0; ! a->nodes[n].allow; i++) {
+                if (i == bits || ! (n = a->nodes[n].child[(address[i / 8] >> (7 - i % 8)) & 1]))
+                        return false;
+        }
+        return true;
+}
+
+
+static void _aclFree(Acl_T *a) {
+        if (*a) {
+                FREE((*a)->nodes);
+                FREE(*a);
+        }
+}
+
+
 /**
- * Returns true if remote host is allowed to connect, otherwise return false
+ * Compile the allow list and put it in effect. The server thread reads the
+ * acl without a lock, the previous acl is freed when no reader is left.
  */
-static boolean_t _authenticateHost(struct sockaddr *addr) {
-        if (addr->sa_family == AF_INET) { //FIXME: we support only IPv4 currently
-                boolean_t allow = false;
-                struct sockaddr_in *a = (struct sockaddr_in *)addr;
-                LOCK(mutex)
-                {
-                        if (! hostlist) {
-                                allow = true;
-                        } else  {
-                                for (HostsAllow_T p = hostlist; p; p = p->next) {
-                                        if ((p->network & p->mask) == (a->sin_addr.s_addr & p->mask)) {
-                                                allow = true;
-                                                break;
-                                        }
-                                }
-                        }
+static void _aclPublish(void) {
+        Acl_T a = NULL;
+        LOCK(mutex)
+        {
+                if (hostlist) {
+                        NEW(a);
+                        a->count = 2;
+                        a->size = 64;
+                        a->nodes = CALLOC(a->size, sizeof(AclNode_T));
+                        for (HostsAllow_T p = hostlist; p; p = p->next)
+                                _aclInsert(a, p->family == AF_INET ? 0 : 1, p->network, p->prefix);
                 }
-                END_LOCK;
-                if (! allow)
-                        LogError("Denied connection from non-authorized client [%s]\n", inet_ntoa(a->sin_addr));
-                return allow;
-        } else if (addr->sa_family == AF_UNIX) {
+        }
+        END_LOCK;
+        Acl_T old = __atomic_exchange_n(&acl, a, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&aclReaders, __ATOMIC_SEQ_CST) > 0)
+                Time_usleep(100);
+        _aclFree(&old);
+}
+
+
+/**
+ * Returns true if remote host is allowed to connect, otherwise return false
+ */
+static boolean_t _authenticateHost(struct sockaddr *addr, socklen_t addrlen) {
+        if (addr->sa_family == AF_UNIX)
                 return true;
-        } else {
-                return false;
+        boolean_t allow = false;
+        __atomic_add_fetch(&aclReaders, 1, __ATOMIC_SEQ_CST);
+        Acl_T a = __atomic_load_n(&acl, __ATOMIC_SEQ_CST);
+        if (addr->sa_family == AF_INET) {
+                allow = ! a || _aclMatch(a, 0, (const unsigned char *)&((struct sockaddr_in *)addr)->sin_addr, 32);
         }
+#ifdef HAVE_IPV6
+        else if (addr->sa_family == AF_INET6) {
+                struct in6_addr *address = &((struct sockaddr_in6 *)addr)->sin6_addr;
+                // The IPv4 clients of the dual stack socket have IPv4-mapped addresses
+                if (IN6_IS_ADDR_V4MAPPED(address))
+                        allow = ! a || _aclMatch(a, 0, address->s6_addr + 12, 32);
+                else
+                        allow = ! a || _aclMatch(a, 1, address->s6_addr, 128);
+        }
+#endif
+        __atomic_sub_fetch(&aclReaders, 1, __ATOMIC_SEQ_CST);
+        if (! allow) {
+                char host[NI_MAXHOST] = "unknown";
+                getnameinfo(addr, addrlen, host, sizeof(host), NULL, 0, NI_NUMERICHOST);
+                LogError("Denied connection from non-authorized client [%s]\n", host);
+        }
+        return allow;
+}
+
+
+static void _close(Connection_T *c) {
+        if (c->S)
+                Socket_free(&c->S);
+        else
+                Net_abort(c->socket);
 }
 
 
 /**
- * Accept connections from Clients and create a Socket_T object for each successful accept. If accept fails, return a NULL object
+ * Accept the connection from the client and add it to the connections which wait for the request
  */
-static Socket_T _socketProducer(int server, Httpd_Flags flags) {
-        int client;
-        struct sockaddr_storage addr_in;
-        struct sockaddr_un addr_un;
-        struct sockaddr *addr = NULL;
-        socklen_t addrlen;
-        if (Net_canRead(server, 1000)) {
-                if (flags & Httpd_Net) {
-                        addr = (struct sockaddr *)&addr_in;
-                        addrlen = sizeof(struct sockaddr_storage);
-                } else {
-                        addr = (struct sockaddr *)&addr_un;
-                        addrlen = sizeof(struct sockaddr_un);
-                }
-                if ((client = accept(server, addr, &addrlen)) < 0) {
+static void _accept(Listener_T *l) {
+        Connection_T *c = &engine.waiting[engine.count];
+        *c = (Connection_T){.addrlen = sizeof(c->addr), .sslserver = l->sslserver};
+        if ((c->socket = accept(l->socket, (struct sockaddr *)&c->addr, &c->addrlen)) < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
                         LogError("HTTP server: cannot accept connection -- %s\n", stopped ? "service stopped" : STRERROR);
-                        return NULL;
+                return;
+        }
+        // The previous allow list stays in effect while the server is suspended
+        if (! Net_setNonBlocking(c->socket) || ! _authenticateHost((struct sockaddr *)&c->addr, c->addrlen)) {
+                Net_abort(c->socket);
+                return;
+        }
+        if (engine.count >= ENGINE_PENDING - 1) {
+                LogError("HTTP server: too many pending connections, closing the connection\n");
+                Net_abort(c->socket);
+                return;
+        }
+        c->deadline = Time_milli() + REQUEST_TIMEOUT * 1000;
+        engine.count++;
+}
+
+
+/**
+ * Pass the connection with the request data pending to the workers
+ */
+static void _dispatch(Connection_T *c) {
+        boolean_t queued = false;
+        LOCK(queueMutex)
+        {
+                if (engine.ready < ENGINE_PENDING) {
+                        engine.queue[(engine.head + engine.ready) % ENGINE_PENDING] = *c;
+                        engine.ready++;
+                        Sem_signal(engine.available);
+                        queued = true;
                 }
-                if (Net_setNonBlocking(client) < 0 || ! Net_canRead(client, 500) || ! Net_canWrite(client, 500) || ! _authenticateHost(addr)) {
-                        Net_abort(client);
-                        return NULL;
+        }
+        END_LOCK;
+        if (! queued) {
+                LogError("HTTP server: all workers are busy, closing the connection\n");
+                _close(c);
+        }
+}
+
+
+/**
+ * Return the persistent connection to the server thread to wait for the next request
+ */
+static void _release(Connection_T *c) {
+        boolean_t returned = false;
+        LOCK(queueMutex)
+        {
+                if (engine.idle < ENGINE_PENDING) {
+                        c->deadline = Time_milli() + KEEPALIVE_TIMEOUT * 1000;
+                        engine.idling[engine.idle++] = *c;
+                        returned = true;
                 }
+        }
+        END_LOCK;
+        if (returned) {
+                if (write(engine.wakeup[1], "", 1) < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+                        DEBUG("HTTP server: cannot wake up the server thread -- %s\n", STRERROR);
+        } else {
+                _close(c);
+        }
+}
+
+
+static void _process(Connection_T *c) {
+        if (! c->S) {
+                c->S = Socket_createAccepted(c->socket, (struct sockaddr *)&c->addr, c->addrlen, c->sslserver);
+                if (! c->S)
+                        return;
+        }
+        // Process the pipelined requests which were received already, then wait for the next request in the server thread
+        boolean_t persistent;
+        do {
+                RLOCK(suspendLock)
+                {
+                        persistent = http_processor(c->S, c->requests++);
+                }
+                END_RLOCK;
+        } while (persistent && Socket_pending(c->S) > 0);
+        if (persistent)
+                _release(c);
+        else
+                Socket_free(&c->S);
+}
+
+
+static void *_worker(void *args) {
+        set_signal_block();
+        LOCK(queueMutex)
+        {
+                while (! engine.stopping) {
+                        if (! engine.ready) {
+                                Sem_wait(engine.available, queueMutex);
+                                continue;
+                        }
+                        Connection_T c = engine.queue[engine.head];
+                        engine.head = (engine.head + 1) % ENGINE_PENDING;
+                        engine.ready--;
+                        Mutex_unlock(queueMutex);
+                        _process(&c);
+                        Mutex_lock(queueMutex);
+                }
+        }
+        END_LOCK;
 #ifdef HAVE_OPENSSL
-                return Socket_createAccepted(client, addr, addrlen, mySSLServerConnection);
-#else
-                return Socket_createAccepted(client, addr, addrlen, NULL);
+        Ssl_threadCleanup();
 #endif
-        }
         return NULL;
 }
 
 
+/**
+ * Accept the connections and wait for the request data until the server is stopped
+ */
+/**
+ * Add the persistent connections returned by the workers to the connections which wait for the request
+ */
+static void _reclaim() {
+        char buf[64];
+        while (read(engine.wakeup[0], buf, sizeof(buf)) > 0)
+                ;
+        LOCK(queueMutex)
+        {
+                for (int i = 0; i < engine.idle; i++) {
+                        if (engine.count < ENGINE_PENDING - 1)
+                                engine.waiting[engine.count++] = engine.idling[i];
+                        else
+                                _close(&engine.idling[i]);
+                }
+                engine.idle = 0;
+        }
+        END_LOCK;
+}
+
+
+static void _serve() {
+        if (pipe(engine.wakeup) < 0) {
+                LogError("HTTP server: cannot create the wakeup pipe -- %s\n", STRERROR);
+                return;
+        }
+        Net_setNonBlocking(engine.wakeup[0]);
+        Net_setNonBlocking(engine.wakeup[1]);
+        Sem_init(engine.available);
+        engine.stopping = false;
+        engine.count = engine.ready = engine.head = engine.idle = 0;
+        for (int i = 0; i < ENGINE_WORKERS; i++)
+                Thread_create(engine.workers[i], _worker, NULL);
+        // The poll set: the server sockets, the wakeup pipe and the connections waiting for the request
+        int first = engine.listeners + 1;
+        struct pollfd fds[ENGINE_LISTENERS + 1 + ENGINE_PENDING];
+        while (! stopped) {
+                long long now = Time_milli();
+                int timeout = 1000;
+                for (int i = 0; i < engine.listeners; i++)
+                        fds[i] = (struct pollfd){.fd = engine.listener[i].socket, .events = POLLIN};
+                fds[engine.listeners] = (struct pollfd){.fd = engine.wakeup[0], .events = POLLIN};
+                for (int i = 0; i < engine.count; i++) {
+                        fds[first + i] = (struct pollfd){.fd = engine.waiting[i].socket, .events = POLLIN};
+                        if (engine.waiting[i].deadline - now < timeout)
+                                timeout = engine.waiting[i].deadline > now ? (int)(engine.waiting[i].deadline - now) : 0;
+                }
+                if (poll(fds, first + engine.count, timeout) < 0) {
+                        if (errno != EINTR)
+                                LogError("HTTP server: poll failed -- %s\n", STRERROR);
+                        continue;
+                }
+                // Pass the connections with the request data (or closed by the client) to the workers, close the timed out ones
+                now = Time_milli();
+                int waiting = 0;
+                for (int i = 0; i < engine.count; i++) {
+                        if (fds[first + i].revents)
+                                _dispatch(&engine.waiting[i]);
+                        else if (now >= engine.waiting[i].deadline)
+                                _close(&engine.waiting[i]);
+                        else
+                                engine.waiting[waiting++] = engine.waiting[i];
+                }
+                engine.count = waiting;
+                if (fds[engine.listeners].revents & POLLIN)
+                        _reclaim();
+                for (int i = 0; i < engine.listeners; i++)
+                        if (fds[i].revents & POLLIN)
+                                _accept(&engine.listener[i]);
+        }
+        for (int i = 0; i < engine.count; i++)
+                _close(&engine.waiting[i]);
+        engine.count = 0;
+        LOCK(queueMutex)
+        {
+                engine.stopping = true;
+                Sem_broadcast(engine.available);
+        }
+        END_LOCK;
+        for (int i = 0; i < ENGINE_WORKERS; i++)
+                Thread_join(engine.workers[i]);
+        // Close the connections which no worker picked up and the persistent connections returned during the shutdown
+        for (; engine.ready > 0; engine.ready--, engine.head = (engine.head + 1) % ENGINE_PENDING)
+                _close(&engine.queue[engine.head]);
+        for (int i = 0; i < engine.idle; i++)
+                _close(&engine.idling[i]);
+        engine.idle = 0;
+        Sem_destroy(engine.available);
+        close(engine.wakeup[0]);
+        close(engine.wakeup[1]);
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -307,42 +637,44 @@ void Engine_start() {
         Engine_cleanup();
         stopped = Run.flags & Run_Stopped;
         init_service();
-        //FIXME: we listen currently only on one server socket: either on IP or unix socket ... should support listening on multiple sockets (IPv4, IPv6, unix)
+        engine.listeners = 0;
         if (Run.httpd.flags & Httpd_Net) {
-                if ((myServerSocket = create_server_socket(Run.httpd.socket.net.address, Run.httpd.socket.net.port, 1024)) >= 0) {
+                int socket = create_server_socket(Run.httpd.socket.net.address, Run.httpd.socket.net.port, 1024);
+                if (socket >= 0) {
+                        Listener_T *l = &engine.listener[engine.listeners++];
+                        *l = (Listener_T){.socket = socket};
 #ifdef HAVE_OPENSSL
                         if (Run.httpd.flags & Httpd_Ssl) {
-                                if (! (mySSLServerConnection = SslServer_new(Run.httpd.socket.net.ssl.pem, Run.httpd.socket.net.ssl.clientpem, myServerSocket))) {
-                                        LogError("HTTP server: not available -- could not initialize SSL engine\n");
-                                        Net_close(myServerSocket);
-                                        return;
+                                if (! (l->sslserver = SslServer_new(Run.httpd.socket.net.ssl.pem, Run.httpd.socket.net.ssl.clientpem, socket))) {
+                                        LogError("HTTP server: TCP port %d not available -- could not initialize SSL engine\n", Run.httpd.socket.net.port);
+                                        Net_close(socket);
+                                        engine.listeners--;
                                 }
                         }
 #endif
-                        while (! stopped) {
-                                Socket_T S = _socketProducer(myServerSocket, Run.httpd.flags);
-                                if (S)
-                                        http_processor(S);
-                        }
-#ifdef HAVE_OPENSSL
-                        if (Run.httpd.flags & Httpd_Ssl)
-                                SslServer_free(&mySSLServerConnection);
-#endif
-                        Net_close(myServerSocket);
                 } else {
                         LogError("HTTP server: not available -- could not create a server socket at port %d -- %s\n", Run.httpd.socket.net.port, STRERROR);
                 }
-        } else if (Run.httpd.flags & Httpd_Unix) {
-                if ((myServerSocket = create_server_socket_unix(Run.httpd.socket.unix.path, 1024)) >= 0) {
-                        while (! stopped) {
-                                Socket_T S = _socketProducer(myServerSocket, Run.httpd.flags);
-                                if (S)
-                                        http_processor(S);
-                        }
-                        Net_close(myServerSocket);
-                } else {
+        }
+        if (Run.httpd.flags & Httpd_Unix) {
+                int socket = create_server_socket_unix(Run.httpd.socket.unix.path, 1024);
+                if (socket >= 0)
+                        engine.listener[engine.listeners++] = (Listener_T){.socket = socket};
+                else
                         LogError("HTTP server: not available -- could not create a server socket at %s -- %s\n", Run.httpd.socket.unix.path, STRERROR);
+        }
+        if (engine.listeners) {
+                _aclPublish();
+                _serve();
+                for (int i = 0; i < engine.listeners; i++) {
+#ifdef HAVE_OPENSSL
+                        if (engine.listener[i].sslserver)
+                                SslServer_free(&engine.listener[i].sslserver);
+#endif
+                        Net_close(engine.listener[i].socket);
                 }
+                engine.listeners = 0;
+                _aclFree(&acl);
         }
         Engine_cleanup();
 }
@@ -353,6 +685,17 @@ void Engine_stop() {
 }
 
 
+void Engine_suspend() {
+        Lock_write(suspendLock);
+}
+
+
+void Engine_resume() {
+        _aclPublish();
+        Lock_unlock(suspendLock);
+}
+
+
 void Engine_cleanup() {
         if (Run.httpd.flags & Httpd_Unix)
                 unlink(Run.httpd.socket.unix.path);
@@ -363,32 +706,36 @@ void Engine_cleanup() {
 boolean_t Engine_addHostAllow(char *pattern) {
         ASSERT(pattern);
         struct addrinfo *res, hints = {
-                .ai_family = AF_INET, /* we support just IPv4 currently */
+#ifdef HAVE_IPV6
+                .ai_family = AF_UNSPEC,
+#else
+                .ai_family = AF_INET,
+#endif
                 .ai_protocol = IPPROTO_TCP
         };
         int rv = false;
         if (! getaddrinfo(pattern, NULL, &hints, &res)) {
                 for (struct addrinfo *_res = res; _res; _res = _res->ai_next) {
+                        HostsAllow_T h;
                         if (_res->ai_family == AF_INET) {
-                                struct sockaddr_in *sin = (struct sockaddr_in *)_res->ai_addr;
-                                HostsAllow_T h;
                                 NEW(h);
-                                memcpy(&h->network, &sin->sin_addr, 4);
-                                h->mask = 0xffffffff;
-                                LOCK(mutex)
-                                {
-                                        if (_hasHostAllow(h))  {
-                                                LogWarning("Skipping redundant host '%s'\n", pattern);
-                                                FREE(h);
-                                        } else {
-                                                DEBUG("Adding host allow '%s'\n", pattern);
-                                                h->next = hostlist;
-                                                hostlist = h;
-                                        }
-                                        rv = true;
-                                }
-                                END_LOCK;
+                                h->family = AF_INET;
+                                h->prefix = 32;
+                                memcpy(h->network, &((struct sockaddr_in *)_res->ai_addr)->sin_addr, 4);
                         }
+#ifdef HAVE_IPV6
+                        else if (_res->ai_family == AF_INET6) {
+                                NEW(h);
+                                h->family = AF_INET6;
+                                h->prefix = 128;
+                                memcpy(h->network, &((struct sockaddr_in6 *)_res->ai_addr)->sin6_addr, 16);
+                        }
+#endif
+                        else {
+                                continue;
+                        }
+                        _addHostAllow(h, "host", pattern);
+                        rv = true;
                 }
                 freeaddrinfo(res);
         }
@@ -402,18 +749,7 @@ boolean_t Engine_addNetAllow(char *pattern) {
         HostsAllow_T h;
         NEW(h);
         if (_parseNetwork(pattern, h)) {
-                LOCK(mutex)
-                {
-                        if (_hasHostAllow(h)) {
-                                LogWarning("Skipping redundant net '%s'\n", pattern);
-                                FREE(h);
-                        } else {
-                                DEBUG("Adding net allow '%s'\n", pattern);
-                                h->next = hostlist;
-                                hostlist = h;
-                        }
-                }
-                END_LOCK;
+                _addHostAllow(h, "net", pattern);
                 return true;
         }
         FREE(h);
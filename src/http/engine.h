@@ -39,6 +39,19 @@ void Engine_start();
 void Engine_stop();
 
 
+/**
+ * Suspend the request processing, waits for the requests in progress.
+ * The connections are accepted and wait until Engine_resume() is called.
+ */
+void Engine_suspend();
+
+
+/**
+ * Resume the request processing suspended by Engine_suspend()
+ */
+void Engine_resume();
+
+
 /**
  * Cleanup the HTTPD server resources (remove unix socket).
  */
@@ -0,0 +1,499 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+// libmonit
+#include "util/List.h"
+
+#include "monit.h"
+#include "ProcessTree.h"
+#include "protocol.h"
+#include "snapshot.h"
+#include "counter.h"
+
+
+/**
+ *  JSON status document. The document is streamed straight from the
+ *  service objects into the buffer, the structure follows the XML status
+ *  (see xml.c), but the sizes are in bytes and the response times are in
+ *  seconds (null if the service is not available).
+ *
+ *  @file
+ */
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Append the string as JSON string (with the quotes)
+ * @param B Output StringBuffer object
+ * @param s String to escape, NULL is written as empty string
+ */
+static void _string(StringBuffer_T B, const char *s) {
+        StringBuffer_append(B, "\"");
+        if (s) {
+                const char *run = s;
+                for (; *s; s++) {
+                        unsigned char c = *s;
+                        if (c == '"' || c == '\\' || c < 0x20) {
+                                if (s > run)
+                                        StringBuffer_append(B, "%.*s", (int)(s - run), run);
+                                if (c == '"' || c == '\\')
+                                        StringBuffer_append(B, "\\%c", c);
+                                else if (c == '\n')
+                                        StringBuffer_append(B, "\\n");
+                                else if (c == '\r')
+                                        StringBuffer_append(B, "\\r");
+                                else if (c == '\t')
+                                        StringBuffer_append(B, "\\t");
+                                else
+                                        StringBuffer_append(B, "\\u%04x", c);
+                                run = s + 1;
+                        }
+                }
+                if (s > run)
+                        StringBuffer_append(B, "%.*s", (int)(s - run), run);
+        }
+        StringBuffer_append(B, "\"");
+}
+
+
+/**
+ * Append the response time in seconds or null if the connection failed
+ */
+static void _responsetime(StringBuffer_T B, boolean_t available, double milliseconds) {
+        if (available)
+                StringBuffer_append(B, "\"responsetime\":%.6f", milliseconds / 1000.);
+        else
+                StringBuffer_append(B, "\"responsetime\":null");
+}
+
+
+static void _percentiles(StringBuffer_T B, Port_T p) {
+        if (p->responses.count)
+                StringBuffer_append(B, ",\"percentiles\":{\"p50\":%.6f,\"p90\":%.6f,\"p99\":%.6f,\"samples\":%d}", Util_getResponseTimePercentile(p, 50) / 1000., Util_getResponseTimePercentile(p, 90) / 1000., Util_getResponseTimePercentile(p, 99) / 1000., p->responses.count);
+}
+
+
+/**
+ * Append the phases of the last response time in seconds, null if the phase was not measured
+ */
+static void _phases(StringBuffer_T B, Port_T p) {
+        const char *names[] = {"dns", "connect", "tls", "firstbyte"};
+        double values[] = {p->phases.dns, p->phases.connect, p->phases.tls, p->phases.firstbyte};
+        StringBuffer_append(B, ",\"phases\":{");
+        for (int i = 0; i < 4; i++) {
+                if (values[i] >= 0.)
+                        StringBuffer_append(B, "%s\"%s\":%.6f", i ? "," : "", names[i], values[i] / 1000.);
+                else
+                        StringBuffer_append(B, "%s\"%s\":null", i ? "," : "", names[i]);
+        }
+        StringBuffer_append(B, "}");
+}
+
+
+static void _server(StringBuffer_T B, const char *myip) {
+        StringBuffer_append(B, "\"server\":{\"id\":");
+        _string(B, Run.id);
+        StringBuffer_append(B, ",\"incarnation\":%lld,\"version\":", (long long)Run.incarnation);
+        _string(B, VERSION);
+        StringBuffer_append(B, ",\"uptime\":%lld,\"poll\":%d,\"startdelay\":%d,\"localhostname\":", (long long)ProcessTree_getProcessUptime(getpid()), Run.polltime, Run.startdelay);
+        _string(B, Run.system->name);
+        StringBuffer_append(B, ",\"controlfile\":");
+        _string(B, Run.files.control);
+        if (Run.federation.cluster)
+                StringBuffer_append(B, ",\"cluster\":true");
+        unsigned long long total[Counter_Last + 1], cycle[Counter_Last + 1];
+        Counter_read(total, cycle);
+        StringBuffer_append(B, ",\"counters\":{");
+        for (int i = 0; i <= Counter_Last; i++)
+                StringBuffer_append(B, "%s\"%s\":{\"total\":%llu,\"cycle\":%llu}", i ? "," : "", Counter_name(i), total[i], cycle[i]);
+        StringBuffer_append(B, "}");
+        if (Run.httpd.flags & Httpd_Net || Run.httpd.flags & Httpd_Unix) {
+                StringBuffer_append(B, ",\"httpd\":{");
+                if (Run.httpd.flags & Httpd_Net) {
+                        StringBuffer_append(B, "\"address\":");
+                        _string(B, Run.httpd.socket.net.address ? Run.httpd.socket.net.address : myip);
+                        StringBuffer_append(B, ",\"port\":%d,\"ssl\":%s%s", Run.httpd.socket.net.port, Run.httpd.flags & Httpd_Ssl ? "true" : "false", Run.httpd.flags & Httpd_Unix ? "," : "");
+                }
+                if (Run.httpd.flags & Httpd_Unix) {
+                        StringBuffer_append(B, "\"unixsocket\":");
+                        _string(B, Run.httpd.socket.unix.path);
+                }
+                StringBuffer_append(B, "}");
+        }
+        StringBuffer_append(B, "},\"platform\":{\"name\":");
+        _string(B, systeminfo.uname.sysname);
+        StringBuffer_append(B, ",\"release\":");
+        _string(B, systeminfo.uname.release);
+        StringBuffer_append(B, ",\"version\":");
+        _string(B, systeminfo.uname.version);
+        StringBuffer_append(B, ",\"machine\":");
+        _string(B, systeminfo.uname.machine);
+        StringBuffer_append(B, ",\"cpu\":%d,\"memory\":%llu,\"swap\":%llu}", systeminfo.cpus, (unsigned long long)systeminfo.mem_max, (unsigned long long)systeminfo.swap_max);
+}
+
+
+static void _service(StringBuffer_T B, Service_T S) {
+        StringBuffer_append(B, "{\"name\":");
+        _string(B, S->name);
+        StringBuffer_append(B,
+                            ",\"type\":%d,\"changed\":%llu,\"collected\":%lld.%06ld,\"status\":%d,\"status_hint\":%d,\"monitor\":%d,\"monitormode\":%d,\"pendingaction\":%d",
+                            S->type,
+                            S->changed,
+                            (long long)S->collected.tv_sec,
+                            (long)S->collected.tv_usec,
+                            S->error,
+                            S->error_hint,
+                            S->monitor,
+                            S->mode,
+                            S->doaction);
+        if (Util_hasServiceStatus(S)) {
+                switch (S->type) {
+                        case Service_File:
+                                StringBuffer_append(B, ",\"file\":{\"mode\":\"%o\",\"uid\":%d,\"gid\":%d,\"timestamp\":%lld,\"size\":%llu",
+                                                    S->inf->priv.file.mode & 07777,
+                                                    (int)S->inf->priv.file.uid,
+                                                    (int)S->inf->priv.file.gid,
+                                                    (long long)S->inf->priv.file.timestamp,
+                                                    (unsigned long long)S->inf->priv.file.size);
+                                if (S->checksum) {
+                                        StringBuffer_append(B, ",\"checksum\":{\"type\":\"%s\",\"value\":", checksumnames[S->checksum->type]);
+                                        _string(B, S->inf->priv.file.cs_sum);
+                                        StringBuffer_append(B, "}");
+                                }
+                                StringBuffer_append(B, "}");
+                                break;
+
+                        case Service_Directory:
+                                StringBuffer_append(B, ",\"directory\":{\"mode\":\"%o\",\"uid\":%d,\"gid\":%d,\"timestamp\":%lld",
+                                                    S->inf->priv.directory.mode & 07777,
+                                                    (int)S->inf->priv.directory.uid,
+                                                    (int)S->inf->priv.directory.gid,
+                                                    (long long)S->inf->priv.directory.timestamp);
+                                if (S->dirscan && S->inf->priv.directory.tree.files >= 0)
+                                        StringBuffer_append(B, ",\"tree\":{\"size\":%lld,\"files\":%lld,\"directories\":%lld,\"oldest\":%lld,\"newest\":%lld}",
+                                                            S->inf->priv.directory.tree.size,
+                                                            S->inf->priv.directory.tree.files,
+                                                            S->inf->priv.directory.tree.directories,
+                                                            (long long)S->inf->priv.directory.tree.oldest,
+                                                            (long long)S->inf->priv.directory.tree.newest);
+                                StringBuffer_append(B, "}");
+                                break;
+
+                        case Service_Fifo:
+                                StringBuffer_append(B, ",\"fifo\":{\"mode\":\"%o\",\"uid\":%d,\"gid\":%d,\"timestamp\":%lld}",
+                                                    S->inf->priv.fifo.mode & 07777,
+                                                    (int)S->inf->priv.fifo.uid,
+                                                    (int)S->inf->priv.fifo.gid,
+                                                    (long long)S->inf->priv.fifo.timestamp);
+                                break;
+
+                        case Service_Filesystem:
+                                StringBuffer_append(B, ",\"filesystem\":{\"mode\":\"%o\",\"uid\":%d,\"gid\":%d,\"flags\":%d,\"block\":{\"percent\":%.1f,\"usage\":%.0f,\"total\":%.0f}",
+                                                    S->inf->priv.filesystem.mode & 07777,
+                                                    (int)S->inf->priv.filesystem.uid,
+                                                    (int)S->inf->priv.filesystem.gid,
+                                                    S->inf->priv.filesystem.flags,
+                                                    S->inf->priv.filesystem.space_percent,
+                                                    S->inf->priv.filesystem.f_bsize > 0 ? (double)S->inf->priv.filesystem.space_total * (double)S->inf->priv.filesystem.f_bsize : 0.,
+                                                    S->inf->priv.filesystem.f_bsize > 0 ? (double)S->inf->priv.filesystem.f_blocks * (double)S->inf->priv.filesystem.f_bsize : 0.);
+                                if (S->inf->priv.filesystem.f_files > 0)
+                                        StringBuffer_append(B, ",\"inode\":{\"percent\":%.1f,\"usage\":%lld,\"total\":%lld}",
+                                                            S->inf->priv.filesystem.inode_percent,
+                                                            S->inf->priv.filesystem.inode_total,
+                                                            S->inf->priv.filesystem.f_files);
+                                if (S->inf->priv.filesystem.io.utilization >= 0.)
+                                        StringBuffer_append(B, ",\"io\":{\"read\":{\"bytes\":%.1f,\"operations\":%.1f},\"write\":{\"bytes\":%.1f,\"operations\":%.1f},\"servicetime\":%.3f,\"utilization\":%.1f}",
+                                                            S->inf->priv.filesystem.io.read_bytes,
+                                                            S->inf->priv.filesystem.io.read_operations,
+                                                            S->inf->priv.filesystem.io.write_bytes,
+                                                            S->inf->priv.filesystem.io.write_operations,
+                                                            S->inf->priv.filesystem.io.service_time,
+                                                            S->inf->priv.filesystem.io.utilization);
+                                StringBuffer_append(B, "}");
+                                break;
+
+                        case Service_Socket:
+                                StringBuffer_append(B,
+                                                    ",\"socket\":{\"connections\":%d,\"established\":%d,\"timewait\":%d,\"closewait\":%d,\"listen\":%d,\"queue\":%d,\"backlog\":%d,\"drops\":%lld}",
+                                                    S->inf->priv.socket.connections,
+                                                    S->inf->priv.socket.established,
+                                                    S->inf->priv.socket.timewait,
+                                                    S->inf->priv.socket.closewait,
+                                                    S->inf->priv.socket.listen,
+                                                    S->inf->priv.socket.queue,
+                                                    S->inf->priv.socket.backlog,
+                                                    S->inf->priv.socket.drops);
+                                break;
+
+                        case Service_Metric:
+                                StringBuffer_append(B,
+                                                    ",\"metric\":{\"type\":\"%s\",\"value\":%.17g,\"rate\":%.17g,\"max\":%.17g,\"samples\":%llu}",
+                                                    metrictypenames[S->inf->priv.metric.type],
+                                                    S->inf->priv.metric.value,
+                                                    S->inf->priv.metric.rate,
+                                                    S->inf->priv.metric.max,
+                                                    S->inf->priv.metric.samples);
+                                break;
+
+                        case Service_Heartbeat:
+                                StringBuffer_append(B,
+                                                    ",\"heartbeat\":{\"timestamp\":%lld,\"age\":%lld,\"count\":%llu}",
+                                                    (long long)S->inf->priv.heartbeat.timestamp,
+                                                    S->inf->priv.heartbeat.age,
+                                                    S->inf->priv.heartbeat.count);
+                                break;
+
+                        case Service_Net:
+                                StringBuffer_append(B,
+                                                    ",\"link\":{\"state\":%d,\"speed\":%lld,\"duplex\":%d,"
+                                                    "\"download\":{\"packets\":{\"now\":%lld,\"total\":%lld},\"bytes\":{\"now\":%lld,\"total\":%lld},\"errors\":{\"now\":%lld,\"total\":%lld}},"
+                                                    "\"upload\":{\"packets\":{\"now\":%lld,\"total\":%lld},\"bytes\":{\"now\":%lld,\"total\":%lld},\"errors\":{\"now\":%lld,\"total\":%lld}}}",
+                                                    Link_getState(S->inf->priv.net.stats),
+                                                    Link_getSpeed(S->inf->priv.net.stats),
+                                                    Link_getDuplex(S->inf->priv.net.stats),
+                                                    Link_getPacketsInPerSecond(S->inf->priv.net.stats),
+                                                    Link_getPacketsInTotal(S->inf->priv.net.stats),
+                                                    Link_getBytesInPerSecond(S->inf->priv.net.stats),
+                                                    Link_getBytesInTotal(S->inf->priv.net.stats),
+                                                    Link_getErrorsInPerSecond(S->inf->priv.net.stats),
+                                                    Link_getErrorsInTotal(S->inf->priv.net.stats),
+                                                    Link_getPacketsOutPerSecond(S->inf->priv.net.stats),
+                                                    Link_getPacketsOutTotal(S->inf->priv.net.stats),
+                                                    Link_getBytesOutPerSecond(S->inf->priv.net.stats),
+                                                    Link_getBytesOutTotal(S->inf->priv.net.stats),
+                                                    Link_getErrorsOutPerSecond(S->inf->priv.net.stats),
+                                                    Link_getErrorsOutTotal(S->inf->priv.net.stats));
+                                break;
+
+                        case Service_Process:
+                                StringBuffer_append(B, ",\"process\":{\"pid\":%d,\"ppid\":%d,\"uid\":%d,\"euid\":%d,\"gid\":%d,\"uptime\":%lld",
+                                                    S->inf->priv.process.pid,
+                                                    S->inf->priv.process.ppid,
+                                                    S->inf->priv.process.uid,
+                                                    S->inf->priv.process.euid,
+                                                    S->inf->priv.process.gid,
+                                                    (long long)S->inf->priv.process.uptime);
+                                if (Run.flags & Run_ProcessEngineEnabled)
+                                        StringBuffer_append(B, ",\"threads\":%d,\"children\":%d,\"memory\":{\"percent\":%.1f,\"percenttotal\":%.1f,\"bytes\":%llu,\"bytestotal\":%llu},\"cpu\":{\"percent\":%.1f,\"percenttotal\":%.1f}",
+                                                            S->inf->priv.process.threads,
+                                                            S->inf->priv.process.children,
+                                                            S->inf->priv.process.mem_percent,
+                                                            S->inf->priv.process.total_mem_percent,
+                                                            (unsigned long long)S->inf->priv.process.mem,
+                                                            (unsigned long long)S->inf->priv.process.total_mem,
+                                                            S->inf->priv.process.cpu_percent,
+                                                            S->inf->priv.process.total_cpu_percent);
+                                StringBuffer_append(B, "}");
+                                break;
+
+                        default:
+                                break;
+                }
+                if (S->icmplist) {
+                        StringBuffer_append(B, ",\"icmp\":[");
+                        for (Icmp_T i = S->icmplist; i; i = i->next) {
+                                StringBuffer_append(B, "%s{\"type\":\"%s\",", i == S->icmplist ? "" : ",", icmpnames[i->type]);
+                                _responsetime(B, i->is_available == Connection_Ok, i->response);
+                                if (i->is_available == Connection_Ok && i->loss >= 0)
+                                        StringBuffer_append(B, ",\"jitter\":%.6f,\"loss\":%d", i->jitter / 1000., i->loss);
+                                StringBuffer_append(B, "}");
+                        }
+                        StringBuffer_append(B, "]");
+                }
+                if (S->portlist) {
+                        StringBuffer_append(B, ",\"port\":[");
+                        for (Port_T p = S->portlist; p; p = p->next) {
+                                StringBuffer_append(B, "%s{\"hostname\":", p == S->portlist ? "" : ",");
+                                _string(B, p->hostname);
+                                StringBuffer_append(B, ",\"portnumber\":%d,\"request\":", p->target.net.port);
+                                _string(B, Util_portRequestDescription(p));
+                                StringBuffer_append(B, ",\"protocol\":");
+                                _string(B, p->protocol->name);
+                                StringBuffer_append(B, ",\"type\":");
+                                _string(B, Util_portTypeDescription(p));
+                                StringBuffer_append(B, ",");
+                                _responsetime(B, p->is_available == Connection_Ok, p->response);
+                                _percentiles(B, p);
+                                _phases(B, p);
+                                StringBuffer_append(B, "}");
+                        }
+                        StringBuffer_append(B, "]");
+                }
+                if (S->socketlist) {
+                        StringBuffer_append(B, ",\"unix\":[");
+                        for (Port_T p = S->socketlist; p; p = p->next) {
+                                StringBuffer_append(B, "%s{\"path\":", p == S->socketlist ? "" : ",");
+                                _string(B, p->target.unix.pathname);
+                                StringBuffer_append(B, ",\"protocol\":");
+                                _string(B, p->protocol->name);
+                                StringBuffer_append(B, ",");
+                                _responsetime(B, p->is_available == Connection_Ok, p->response);
+                                _percentiles(B, p);
+                                _phases(B, p);
+                                StringBuffer_append(B, "}");
+                        }
+                        StringBuffer_append(B, "]");
+                }
+                if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled)) {
+                        StringBuffer_append(B,
+                                            ",\"system\":{\"load\":{\"avg01\":%.2f,\"avg05\":%.2f,\"avg15\":%.2f},\"cpu\":{\"user\":%.1f,\"system\":%.1f"
+#ifdef HAVE_CPU_WAIT
+                                            ",\"wait\":%.1f"
+#endif
+#ifdef HAVE_CPU_STEAL
+                                            ",\"steal\":%.1f"
+#endif
+                                            "},\"memory\":{\"percent\":%.1f,\"bytes\":%llu},\"swap\":{\"percent\":%.1f,\"bytes\":%llu}",
+                                            systeminfo.loadavg[0],
+                                            systeminfo.loadavg[1],
+                                            systeminfo.loadavg[2],
+                                            systeminfo.total_cpu_user_percent > 0. ? systeminfo.total_cpu_user_percent : 0.,
+                                            systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.,
+#ifdef HAVE_CPU_WAIT
+                                            systeminfo.total_cpu_wait_percent > 0. ? systeminfo.total_cpu_wait_percent : 0.,
+#endif
+#ifdef HAVE_CPU_STEAL
+                                            systeminfo.total_cpu_steal_percent > 0. ? systeminfo.total_cpu_steal_percent : 0.,
+#endif
+                                            systeminfo.total_mem_percent,
+                                            (unsigned long long)systeminfo.total_mem,
+                                            systeminfo.total_swap_percent,
+                                            (unsigned long long)systeminfo.total_swap);
+                        if (systeminfo.cpu.count > 0) {
+                                StringBuffer_append(B, ",\"cpus\":[");
+                                for (int i = 0, n = 0; i < systeminfo.cpu.count; i++)
+                                        if (systeminfo.cpu.usage[i] >= 0.)
+                                                StringBuffer_append(B, "%s{\"id\":%d,\"node\":%d,\"usage\":%.1f,\"steal\":%.1f}", n++ ? "," : "", i, systeminfo.cpu.node[i], systeminfo.cpu.usage[i], systeminfo.cpu.steal[i]);
+                                StringBuffer_append(B, "]");
+                        }
+                        if (systeminfo.node.count > 1) {
+                                StringBuffer_append(B, ",\"nodes\":[");
+                                for (int i = 0, n = 0; i < systeminfo.node.count; i++)
+                                        if (systeminfo.node.usage[i] >= 0.)
+                                                StringBuffer_append(B, "%s{\"id\":%d,\"usage\":%.1f}", n++ ? "," : "", i, systeminfo.node.usage[i]);
+                                StringBuffer_append(B, "]");
+                        }
+                        if (systeminfo.pressure[Pressure_Cpu].some[0] >= 0. || systeminfo.pressure[Pressure_Memory].some[0] >= 0. || systeminfo.pressure[Pressure_Io].some[0] >= 0.) {
+                                StringBuffer_append(B, ",\"pressure\":{");
+                                for (int i = 0, n = 0; i <= Pressure_Last; i++) {
+                                        Pressure_T *p = &systeminfo.pressure[i];
+                                        if (p->some[0] >= 0.)
+                                                StringBuffer_append(B, "%s\"%s\":{\"some\":[%.2f,%.2f,%.2f],\"full\":[%.2f,%.2f,%.2f]}", n++ ? "," : "", pressurenames[i],
+                                                                    p->some[0], p->some[1], p->some[2], p->full[0] > 0. ? p->full[0] : 0., p->full[1] > 0. ? p->full[1] : 0., p->full[2] > 0. ? p->full[2] : 0.);
+                                }
+                                StringBuffer_append(B, "}");
+                        }
+                        StringBuffer_append(B, "}");
+                }
+                if (S->type == Service_Program && S->snapshot.program.started) {
+                        StringBuffer_append(B, ",\"program\":{\"started\":%lld,\"status\":%d,\"output\":", (long long)S->snapshot.program.started, S->snapshot.program.exitStatus);
+                        char *output = Snapshot_getOutput(S);
+                        _string(B, output);
+                        FREE(output);
+                        if (S->snapshot.program.usage.cpuTime >= 0)
+                                StringBuffer_append(B, ",\"usage\":{\"cputime\":%lld,\"memory\":%lld,\"runtime\":%lld}", S->snapshot.program.usage.cpuTime, S->snapshot.program.usage.memory, S->snapshot.program.usage.runTime);
+                        StringBuffer_append(B, "}");
+                }
+        }
+        StringBuffer_append(B, "}");
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Get the JSON formated status of the monitored services and resources.
+ * @param B Output StringBuffer object
+ * @param myip The client-side IP address
+ * @param since Only the services changed after this generation are listed,
+ * 0 lists all services (see Snapshot_wait())
+ */
+void status_json(StringBuffer_T B, const char *myip, unsigned long long since) {
+        // Read the generation first, a service changed while the document is generated is reported again by the next poll rather than lost
+        unsigned long long generation = __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE);
+        StringBuffer_append(B, "{");
+        _server(B, myip);
+        StringBuffer_append(B, ",\"generation\":%llu,\"services\":[", generation);
+        boolean_t first = true;
+        struct myservice copy;
+        for (Service_T S = servicelist_conf; S; S = S->next_conf) {
+                // A service which didn't publish a status yet was (re)loaded after the last poll
+                unsigned long long changed = __atomic_load_n(&S->changed, __ATOMIC_ACQUIRE);
+                if (since && changed && changed <= since)
+                        continue;
+                if (! first)
+                        StringBuffer_append(B, ",");
+                _service(B, Snapshot_get(S, &copy));
+                first = false;
+        }
+        StringBuffer_append(B, "],\"servicegroups\":[");
+        for (ServiceGroup_T SG = servicegrouplist; SG; SG = SG->next) {
+                StringBuffer_append(B, "%s{\"name\":", SG == servicegrouplist ? "" : ",");
+                _string(B, SG->name);
+                StringBuffer_append(B, ",\"services\":[");
+                for (list_t m = SG->members->head; m; m = m->next) {
+                        if (m != SG->members->head)
+                                StringBuffer_append(B, ",");
+                        _string(B, ((Service_T)m->e)->name);
+                }
+                StringBuffer_append(B, "]}");
+        }
+        StringBuffer_append(B, "]}");
+}
+
+
+/**
+ * Get the JSON formated status of a single service, as listed in the
+ * services array of the status document
+ * @param B Output StringBuffer object
+ * @param S The service
+ */
+void status_json_service(StringBuffer_T B, Service_T S) {
+        struct myservice copy;
+        _service(B, Snapshot_get(S, &copy));
+}
+
@@ -60,6 +60,10 @@
 #include <strings.h>
 #endif
 
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -68,12 +72,25 @@
 #include <limits.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
 #include "processor.h"
 #include "base64.h"
+#include "sha256.h"
+#include "probes.h"
+#include "rpc.h"
 
 // libmonit
 #include "util/Str.h"
 #include "system/Net.h"
+#include "system/Time.h"
+#include "thread/Thread.h"
 
 
 /**
@@ -102,27 +119,82 @@
 static int _httpPostLimit;
 
 
+/* The compressed body of the last responses with an ETag, the status documents are polled repeatedly while unchanged */
+#define GZIP_CACHE_SIZE 2
+static struct {
+        int next;
+        struct {
+                char *etag;
+                unsigned char *data;
+                int length;
+        } entry[GZIP_CACHE_SIZE];
+} gzipCache = {};
+static Mutex_T gzipMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* The verified Authorization headers, identified by a keyed digest, a repeated login skips the password check until the entry expires */
+#define AUTH_CACHE_SIZE 64
+#define AUTH_CACHE_TTL  300 // seconds
+static struct {
+        unsigned char key[32];
+        struct {
+                unsigned char digest[SHA256_DIGEST_SIZE];
+                char uname[STRLEN];
+                long long expires;
+        } entry[AUTH_CACHE_SIZE];
+} authCache = {};
+static Mutex_T authMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* The request headers used by the server and the cervlets, a perfect hash of the name gives the slot, see known_header() */
+static const char *knownHeaders[KNOWN_HEADERS] = {
+        [2] = "Authorization",
+        [3] = "Range",
+        [4] = "Accept-Encoding",
+        [5] = "Connection",
+        [7] = "Content-Type",
+        [9] = "Content-Length",
+        [10] = "If-None-Match",
+        [12] = "Host",
+        [13] = "Last-Event-ID",
+        [15] = "Accept"
+};
+
+
 /* -------------------------------------------------------------- Prototypes */
 
 
-static void do_service(Socket_T);
+static boolean_t do_service(Socket_T, int);
 static void destroy_entry(void *);
 static char *get_date(char *, int);
 static char *get_server(char *, int);
-static void create_headers(HttpRequest);
+static int read_header_block(Socket_T, char *, int);
+static const char *parse_request_line(HttpRequest, char **);
+static void parse_headers(HttpRequest, char *);
+static int known_header(const char *, int);
 static void send_response(HttpResponse);
 static boolean_t basic_authenticate(HttpRequest);
+static void get_credentials_digest(const char *, unsigned char *);
+static boolean_t get_cached_credentials(HttpRequest, const unsigned char *);
+static void cache_credentials(const unsigned char *, const char *);
 static void done(HttpRequest, HttpResponse);
 static void destroy_HttpRequest(HttpRequest);
 static void reset_response(HttpResponse res);
-static HttpParameter parse_parameters(char *);
+static void parse_parameters(HttpRequest, char *);
 static boolean_t create_parameters(HttpRequest req);
 static void destroy_HttpResponse(HttpResponse);
-static HttpRequest create_HttpRequest(Socket_T);
+static HttpRequest create_HttpRequest(Socket_T, boolean_t);
 static void internal_error(Socket_T, int, char *);
 static HttpResponse create_HttpResponse(Socket_T);
 static boolean_t is_authenticated(HttpRequest, HttpResponse);
-static int get_next_token(char *s, int *cursor, char **r);
+static boolean_t is_persistent(HttpRequest);
+static unsigned char *compress_response(HttpResponse, int *);
+static const char *get_response_header(HttpResponse, const char *);
+static void get_response_head(HttpResponse, StringBuffer_T, long long);
+static void send_chunk(HttpResponse, boolean_t);
+#ifdef HAVE_LIBZ
+static unsigned char *deflate_chunk(z_stream *, const char *, int *, boolean_t);
+#endif
 
 
 /*
@@ -142,16 +214,20 @@ struct  ServiceImpl {
 
 /**
  * Process a HTTP request. This is done by dispatching to the service
- * function.
+ * function. The caller owns the connection and should close it unless
+ * true is returned.
  * @param s A Socket_T representing the client connection
+ * @param requests The number of requests served on this connection already
+ * @return true if the connection should stay open for the next request,
+ * otherwise false
  */
-void *http_processor(Socket_T s) {
-        if (! Net_canRead(Socket_getSocket(s), REQUEST_TIMEOUT * 1000))
-                internal_error(s, SC_REQUEST_TIMEOUT, "Time out when handling the Request");
-        else
-                do_service(s);
-        Socket_free(&s);
-        return NULL;
+boolean_t http_processor(Socket_T s, int requests) {
+        if (! Socket_pending(s) && ! Net_canRead(Socket_getSocket(s), (requests ? KEEPALIVE_TIMEOUT : REQUEST_TIMEOUT) * 1000)) {
+                if (! requests)
+                        internal_error(s, SC_REQUEST_TIMEOUT, "Time out when handling the Request");
+                return false;
+        }
+        return do_service(s, requests);
 }
 
 
@@ -172,20 +248,42 @@ void Processor_setHttpPostLimit() {
         // Add space for each service
         for (Service_T s = servicelist; s; s = s->next)
                 _httpPostLimit += strlen("&service=") + strlen(s->name);
+        // Room for a batch of binary requests
+        _httpPostLimit += RPC_BATCH;
+}
+
+
+void Processor_resetAuthCache() {
+        LOCK(authMutex)
+        {
+                memset(authCache.entry, 0, sizeof(authCache.entry));
+                // A new key, the digests computed with the previous configuration never match again
+                int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+                if (fd < 0 || read(fd, authCache.key, sizeof(authCache.key)) != sizeof(authCache.key)) {
+                        for (int i = 0; i < (int)sizeof(authCache.key); i++)
+                                authCache.key[i] ^= (unsigned char)(random() ^ Time_micro() >> (i % 8));
+                }
+                if (fd >= 0)
+                        close(fd);
+        }
+        END_LOCK;
 }
 
 
 void escapeHTML(StringBuffer_T sb, const char *s) {
-        for (int i = 0; s[i]; i++) {
-                if (s[i] == '<')
-                        StringBuffer_append(sb, "&lt;");
-                else if (s[i] == '>')
-                        StringBuffer_append(sb, "&gt;");
-                else if (s[i] == '&')
-                        StringBuffer_append(sb, "&amp;");
-                else
-                        StringBuffer_append(sb, "%c", s[i]);
+        // Append the runs of plain characters at once, the log page escapes up to megabytes of text
+        const char *run = s;
+        for (; *s; s++) {
+                if (*s == '<' || *s == '>' || *s == '&') {
+                        StringBuffer_appendBytes(sb, run, (int)(s - run));
+                        if (*s == '&')
+                                StringBuffer_appendBytes(sb, "&amp;", 5);
+                        else
+                                StringBuffer_appendBytes(sb, *s == '<' ? "&lt;" : "&gt;", 4);
+                        run = s + 1;
+                }
         }
+        StringBuffer_appendBytes(sb, run, (int)(s - run));
 }
 
 
@@ -288,6 +386,56 @@ void set_content_type(HttpResponse res, const char *mime) {
 }
 
 
+/**
+ * Set the file range as the response body. The file is streamed to the
+ * client when the response is sent, without reading it into memory. The
+ * response takes over the file descriptor and closes it.
+ * @param res HttpResponse object
+ * @param fd The file descriptor
+ * @param offset The offset of the range in the file
+ * @param length The range length
+ */
+void set_file(HttpResponse res, int fd, off_t offset, off_t length) {
+        if (res->file.fd >= 0)
+                close(res->file.fd);
+        res->file.fd = fd;
+        res->file.offset = offset;
+        res->file.length = length;
+}
+
+
+/**
+ * Send the output collected so far to the client, so a large response is
+ * streamed while it is generated instead of buffered in full. The body is
+ * sent with the chunked transfer encoding and compressed on the fly if the
+ * client accepts it. The function does nothing for a HTTP/1.0 client, or
+ * while less than RESPONSE_CHUNK bytes are pending. The status and the
+ * headers cannot be changed after the first flush.
+ * @param res HttpResponse object
+ */
+void flush_response(HttpResponse res) {
+        if (res->is_committed || ! res->accepts_chunked || res->file.fd >= 0 || StringBuffer_length(res->outputbuffer) < RESPONSE_CHUNK)
+                return;
+        if (! res->is_chunked) {
+                res->protocol = "HTTP/1.1";
+#ifdef HAVE_LIBZ
+                if (res->accepts_gzip && ! get_response_header(res, "Content-Encoding")) {
+                        z_stream *z = CALLOC(1, sizeof(z_stream));
+                        // windowBits 15 + 16 writes the gzip header and trailer instead of the zlib ones
+                        if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK) {
+                                res->zstream = z;
+                                set_header(res, "Content-Encoding", "gzip");
+                                set_header(res, "Vary", "Accept-Encoding");
+                        } else {
+                                FREE(z);
+                        }
+                }
+#endif
+        }
+        send_chunk(res, false);
+}
+
+
 /**
  * Returns the value of the specified header
  * @param req HttpRequest object
@@ -295,9 +443,13 @@ void set_content_type(HttpResponse res, const char *mime) {
  * @return The value of the specified header, NULL if not found
  */
 const char *get_header(HttpRequest req, const char *name) {
-        for (HttpHeader p = req->headers; p; p = p->next)
-                if (IS(p->name, name))
-                        return (p->value);
+        int slot = known_header(name, (int)strlen(name));
+        if (slot >= 0)
+                return req->known[slot] ? req->block + req->headers[req->known[slot] - 1].value : NULL;
+        // The last header of the name wins, as for the known headers
+        for (int i = req->headerCount - 1; i >= 0; i--)
+                if (IS(req->block + req->headers[i].name, name))
+                        return req->block + req->headers[i].value;
         return NULL;
 }
 
@@ -309,9 +461,27 @@ const char *get_header(HttpRequest req, const char *name) {
  * @return The value of the specified parameter, or NULL if not found
  */
 const char *get_parameter(HttpRequest req, const char *name) {
-        for (HttpParameter p = req->params; p; p = p->next)
-                if (IS(p->name, name))
-                        return (p->value);
+        for (int i = req->paramCount - 1; i >= 0; i--)
+                if (IS(req->query + req->params[i].name, name))
+                        return req->query + req->params[i].value;
+        return NULL;
+}
+
+
+/**
+ * Iterates the values of a parameter which may be repeated, in the
+ * order of the query string. Start with the cursor set to 0.
+ * @param req HttpRequest object
+ * @param name The request parameter key to lookup the values for
+ * @param cursor The iteration state
+ * @return The next value of the parameter, or NULL if there are no more
+ */
+const char *next_parameter(HttpRequest req, const char *name, int *cursor) {
+        while (*cursor < req->paramCount) {
+                HttpField_T *p = &req->params[(*cursor)++];
+                if (IS(req->query + p->name, name))
+                        return req->query + p->value;
+        }
         return NULL;
 }
 
@@ -434,12 +604,17 @@ const char *get_status_string(int status) {
  * Receives standard HTTP requests from a client socket and dispatches
  * them to the doXXX methods defined in a cervlet module.
  */
-static void do_service(Socket_T s) {
+static boolean_t do_service(Socket_T s, int requests) {
+        boolean_t persistent = false;
         volatile HttpResponse res = create_HttpResponse(s);
-        volatile HttpRequest req = create_HttpRequest(s);
+        volatile HttpRequest req = create_HttpRequest(s, requests > 0);
         if (res && req) {
+                res->is_persistent = requests + 1 < KEEPALIVE_REQUESTS && is_persistent(req);
+                res->accepts_gzip = Util_acceptsGzip(get_header(req, "Accept-Encoding"));
+                res->accepts_chunked = IS(req->protocol, "1.1");
                 if (Run.httpd.flags & Httpd_Ssl)
                         set_header(res, "Strict-Transport-Security", "max-age=63072000; includeSubdomains; preload");
+                PROBE2(http_request_start, req->method, req->url);
                 if (is_authenticated(req, res)) {
                         if (IS(req->method, METHOD_GET))
                                 Impl.doGet(req, res);
@@ -448,9 +623,14 @@ static void do_service(Socket_T s) {
                         else
                                 send_error(req, res, SC_NOT_IMPLEMENTED, "Method not implemented");
                 }
+                // A response committed by the cervlet itself doesn't announce the persistent connection
+                boolean_t committed = res->is_committed;
                 send_response(res);
+                persistent = res->is_persistent && ! committed;
+                PROBE3(http_request_done, req->method, req->url, res->status);
         }
         done(req, res);
+        return persistent;
 }
 
 
@@ -458,9 +638,9 @@ static void do_service(Socket_T s) {
  * Return a (RFC1123) Date string
  */
 static char *get_date(char *result, int size) {
-        time_t now;
-        time(&now);
-        if (strftime(result, size, DATEFMT, gmtime(&now)) <= 0)
+        struct tm tm;
+        time_t now = time(NULL);
+        if (strftime(result, size, DATEFMT, gmtime_r(&now, &tm)) <= 0)
                 *result = 0;
         return result;
 }
@@ -475,35 +655,191 @@ static char *get_server(char *result, int size) {
 }
 
 
+/**
+ * Get the response header value or NULL if not set
+ */
+static const char *get_response_header(HttpResponse res, const char *name) {
+        for (HttpHeader p = res->headers; p; p = p->next)
+                if (IS(p->name, name))
+                        return p->value;
+        return NULL;
+}
+
+
+/**
+ * Compress the response body if the client accepts gzip. The compressed
+ * body of a response with an ETag is kept, so a repeated request for an
+ * unchanged document doesn't compress it again.
+ * @return The compressed body which the caller must free, or NULL if the
+ * body should be sent as is
+ */
+static unsigned char *compress_response(HttpResponse res, int *length) {
+        if (! res->accepts_gzip || StringBuffer_length(res->outputbuffer) < GZIP_MIN_LENGTH || get_response_header(res, "Content-Encoding"))
+                return NULL;
+        const char *etag = get_response_header(res, "ETag");
+        unsigned char *data = NULL;
+        if (etag) {
+                LOCK(gzipMutex)
+                {
+                        for (int i = 0; i < GZIP_CACHE_SIZE; i++) {
+                                if (gzipCache.entry[i].etag && IS(gzipCache.entry[i].etag, etag)) {
+                                        data = ALLOC(gzipCache.entry[i].length);
+                                        memcpy(data, gzipCache.entry[i].data, gzipCache.entry[i].length);
+                                        *length = gzipCache.entry[i].length;
+                                        break;
+                                }
+                        }
+                }
+                END_LOCK;
+                if (data)
+                        return data;
+        }
+        if ((data = Util_gzip(StringBuffer_toString(res->outputbuffer), StringBuffer_length(res->outputbuffer), length)) && etag) {
+                LOCK(gzipMutex)
+                {
+                        int i = gzipCache.next;
+                        gzipCache.next = (i + 1) % GZIP_CACHE_SIZE;
+                        FREE(gzipCache.entry[i].etag);
+                        FREE(gzipCache.entry[i].data);
+                        gzipCache.entry[i].etag = Str_dup(etag);
+                        gzipCache.entry[i].data = ALLOC(*length);
+                        memcpy(gzipCache.entry[i].data, data, *length);
+                        gzipCache.entry[i].length = *length;
+                }
+                END_LOCK;
+        }
+        return data;
+}
+
+
 /**
  * Send the response to the client. If the response has already been
  * commited, this function does nothing.
  */
 static void send_response(HttpResponse res) {
-        Socket_T S = res->S;
-
         if (! res->is_committed) {
-                char date[STRLEN];
-                char server[STRLEN];
-                char *headers = get_headers(res);
+                res->is_committed = true;
+                if (res->is_chunked) {
+                        send_chunk(res, true);
+                        return;
+                }
                 int length = StringBuffer_length(res->outputbuffer);
+                unsigned char *body = res->file.fd < 0 ? compress_response(res, &length) : NULL;
+                if (body) {
+                        set_header(res, "Content-Encoding", "gzip");
+                        set_header(res, "Vary", "Accept-Encoding");
+                }
+                StringBuffer_T sb = StringBuffer_create(RES_STRLEN);
+                get_response_head(res, sb, (long long)length + (res->file.fd >= 0 ? (long long)res->file.length : 0LL));
+                // Send the header and the body in one write, so the client of a persistent connection doesn't wait for a delayed segment
+                struct iovec iov[2] = {
+                        {.iov_base = (void *)StringBuffer_toString(sb), .iov_len = StringBuffer_length(sb)},
+                        {.iov_base = body ? (void *)body : (void *)StringBuffer_toString(res->outputbuffer), .iov_len = length}
+                };
+                if (Socket_writev(res->S, iov, 2) >= 0 && res->file.fd >= 0) {
+                        // The file body is streamed behind the header, a short write leaves the client with an incomplete body, so close the connection
+                        if (Socket_writeFile(res->S, res->file.fd, res->file.offset, (size_t)res->file.length) != res->file.length)
+                                res->is_persistent = false;
+                }
+                StringBuffer_free(&sb);
+                FREE(body);
+        }
+}
+
+
+/**
+ * Append the status line and the header block to the buffer. A negative
+ * length announces a chunked body.
+ */
+static void get_response_head(HttpResponse res, StringBuffer_T sb, long long length) {
+        char date[STRLEN];
+        char server[STRLEN];
+        char *headers = get_headers(res);
+        StringBuffer_append(sb, "%s %d %s\r\n", res->protocol, res->status, res->status_msg);
+        StringBuffer_append(sb, "Date: %s\r\n", get_date(date, STRLEN));
+        StringBuffer_append(sb, "Server: %s\r\n", get_server(server, STRLEN));
+        if (length < 0)
+                StringBuffer_append(sb, "Transfer-Encoding: chunked\r\n");
+        else
+                StringBuffer_append(sb, "Content-Length: %lld\r\n", length);
+        if (res->is_persistent)
+                StringBuffer_append(sb, "Connection: keep-alive\r\nKeep-Alive: timeout=%d\r\n", KEEPALIVE_TIMEOUT);
+        else
+                StringBuffer_append(sb, "Connection: close\r\n");
+        StringBuffer_append(sb, "%s\r\n", headers ? headers : "");
+        FREE(headers);
+}
+
+
+#ifdef HAVE_LIBZ
+/**
+ * Deflate the data into the compressed stream. A sync flush ends every
+ * chunk on a byte boundary, so the client can inflate what it received
+ * so far, the last chunk finishes the stream with the gzip trailer.
+ * @return The compressed data which the caller must free
+ */
+static unsigned char *deflate_chunk(z_stream *z, const char *data, int *length, boolean_t last) {
+        int size = *length / 2 + 64;
+        int used = 0;
+        int status;
+        unsigned char *out = ALLOC(size);
+        z->next_in = (unsigned char *)data;
+        z->avail_in = *length;
+        do {
+                if (used == size) {
+                        size *= 2;
+                        RESIZE(out, size);
+                }
+                z->next_out = out + used;
+                z->avail_out = size - used;
+                status = deflate(z, last ? Z_FINISH : Z_SYNC_FLUSH);
+                used = size - z->avail_out;
+        } while (status == Z_OK && z->avail_out == 0);
+        *length = used;
+        return out;
+}
+#endif
+
 
+/**
+ * Send the pending output as one chunk, preceded by the header on the
+ * first chunk. The last chunk is followed by the zero length chunk which
+ * ends the body. A failed write commits the response, so the remaining
+ * output is discarded and the connection is closed.
+ */
+static void send_chunk(HttpResponse res, boolean_t last) {
+        int length = StringBuffer_length(res->outputbuffer);
+        const char *data = StringBuffer_toString(res->outputbuffer);
+        unsigned char *compressed = NULL;
+        StringBuffer_T sb = StringBuffer_create(RES_STRLEN);
+        if (! res->is_chunked) {
+                res->is_chunked = true;
+                get_response_head(res, sb, -1);
+        }
+#ifdef HAVE_LIBZ
+        if (res->zstream) {
+                data = (const char *)(compressed = deflate_chunk(res->zstream, data, &length, last));
+                if (last) {
+                        deflateEnd(res->zstream);
+                        FREE(res->zstream);
+                }
+        }
+#endif
+        if (length > 0)
+                StringBuffer_append(sb, "%x\r\n", length);
+        const char *end = length > 0 ? (last ? "\r\n0\r\n\r\n" : "\r\n") : (last ? "0\r\n\r\n" : "");
+        struct iovec iov[3] = {
+                {.iov_base = (void *)StringBuffer_toString(sb), .iov_len = StringBuffer_length(sb)},
+                {.iov_base = (void *)data, .iov_len = length},
+                {.iov_base = (void *)end, .iov_len = strlen(end)}
+        };
+        if (Socket_writev(res->S, iov, 3) < 0) {
                 res->is_committed = true;
-                get_date(date, STRLEN);
-                get_server(server, STRLEN);
-                Socket_print(S, "%s %d %s\r\n", res->protocol, res->status,
-                             res->status_msg);
-                Socket_print(S, "Date: %s\r\n", date);
-                Socket_print(S, "Server: %s\r\n", server);
-                Socket_print(S, "Content-Length: %d\r\n", length);
-                Socket_print(S, "Connection: close\r\n");
-                if (headers)
-                        Socket_print(S, "%s", headers);
-                Socket_print(S, "\r\n");
-                if (length)
-                        Socket_write(S, (unsigned char *)StringBuffer_toString(res->outputbuffer), length);
-                FREE(headers);
+                res->is_persistent = false;
         }
+        StringBuffer_clear(res->outputbuffer);
+        StringBuffer_free(&sb);
+        FREE(compressed);
 }
 
 
@@ -511,34 +847,34 @@ static void send_response(HttpResponse res) {
 
 
 /**
- * Returns a new HttpRequest object wrapping the client request
+ * Returns a new HttpRequest object wrapping the client request. If the
+ * connection was kept open after a previous request, the client may close
+ * it instead of sending the next request, which is not an error.
  */
-static HttpRequest create_HttpRequest(Socket_T S) {
-        char line[REQ_STRLEN];
-        if (Socket_readLine(S, line, sizeof(line)) == NULL) {
-                internal_error(S, SC_BAD_REQUEST, "No request found");
+static HttpRequest create_HttpRequest(Socket_T S, boolean_t persistent) {
+        char block[REQUEST_HEADER_MAX];
+        int length = read_header_block(S, block, sizeof(block));
+        if (length <= 0) {
+                if (length < 0)
+                        internal_error(S, SC_BAD_REQUEST, "Request header too large");
+                else if (! persistent)
+                        internal_error(S, SC_BAD_REQUEST, "No request found");
                 return NULL;
         }
-        Str_chomp(line);
-        char method[STRLEN];
-        char url[REQ_STRLEN];
-        char protocol[STRLEN];
-        if (sscanf(line, "%255s %1023s HTTP/%3[1.0]", method, url, protocol) != 3) {
-                internal_error(S, SC_BAD_REQUEST, "Cannot parse request");
-                return NULL;
-        }
-        if (strlen(url) >= MAX_URL_LENGTH) {
-                internal_error(S, SC_BAD_REQUEST, "[error] URL too long");
+        // The request and all its data live in one arena, a single free releases them. The header block is copied once and parsed in place
+        Arena_T arena = Arena_new(REQUEST_ARENA);
+        HttpRequest req = Arena_calloc(arena, 1, sizeof(*req));
+        req->arena = arena;
+        req->S = S;
+        req->block = Arena_ndup(arena, block, length);
+        char *headers;
+        const char *error = parse_request_line(req, &headers);
+        if (error) {
+                destroy_HttpRequest(req);
+                internal_error(S, SC_BAD_REQUEST, (char *)error);
                 return NULL;
         }
-        HttpRequest req = NULL;
-        NEW(req);
-        req->S = S;
-        Util_urlDecode(url);
-        req->url = Str_dup(url);
-        req->method = Str_dup(method);
-        req->protocol = Str_dup(protocol);
-        create_headers(req);
+        parse_headers(req, headers);
         if (! create_parameters(req)) {
                 destroy_HttpRequest(req);
                 internal_error(S, SC_BAD_REQUEST, "Cannot parse Request parameters");
@@ -559,6 +895,8 @@ static HttpResponse create_HttpResponse(Socket_T S) {
         res->status = SC_OK;
         res->outputbuffer = StringBuffer_create(256);
         res->is_committed = false;
+        res->is_persistent = false;
+        res->file.fd = -1;
         res->protocol = SERVER_PROTOCOL;
         res->status_msg = get_status_string(SC_OK);
         return res;
@@ -566,28 +904,136 @@ static HttpResponse create_HttpResponse(Socket_T S) {
 
 
 /**
- * Create HTTP headers for the given request
+ * Read the request line and the headers up to the empty line into the
+ * given buffer, one copy from the socket buffer. Returns the length of
+ * the NUL terminated block, 0 if nothing was received or -1 if the
+ * block doesn't fit into the buffer
  */
-static void create_headers(HttpRequest req) {
-        char line[REQ_STRLEN] = {0};
-        while (Socket_readLine(req->S, line, sizeof(line)) && ! (Str_isEqual(line, "\r\n") || Str_isEqual(line, "\n"))) {
-                char *value = strchr(line, ':');
+static int read_header_block(Socket_T S, char *block, int size) {
+        const char *data;
+        int n, length = 0, line = 0;
+        while ((data = Socket_peekLine(S, &n))) {
+                if (length + n >= size)
+                        return -1;
+                memcpy(block + length, data, n);
+                Socket_consume(S, n);
+                length += n;
+                // A line longer than the socket buffer is returned in parts
+                if (block[length - 1] == '\n') {
+                        if (length - line == 1 || (length - line == 2 && block[line] == '\r'))
+                                break;
+                        line = length;
+                }
+        }
+        block[length] = 0;
+        return length;
+}
+
+
+/**
+ * Split the request line, "METHOD URL HTTP/VERSION", in place. Sets the
+ * start of the headers in the block. Returns NULL on success, otherwise
+ * the error message
+ */
+static const char *parse_request_line(HttpRequest req, char **headers) {
+        char *line = req->block;
+        char *end = strchr(line, '\n');
+        if (end)
+                *headers = end + 1;
+        else
+                *headers = end = line + strlen(line);
+        while (end > line && isspace((unsigned char)end[-1]))
+                end--;
+        *end = 0;
+        char *url = strpbrk(line, " \t");
+        if (! url || url - line >= STRLEN)
+                return "Cannot parse request";
+        *url++ = 0;
+        url += strspn(url, " \t");
+        char *protocol = strpbrk(url, " \t");
+        if (! protocol || protocol - url >= REQ_STRLEN)
+                return "Cannot parse request";
+        *protocol++ = 0;
+        protocol += strspn(protocol, " \t");
+        if (strncmp(protocol, "HTTP/", 5))
+                return "Cannot parse request";
+        protocol += 5;
+        size_t version = strspn(protocol, "1.0");
+        if (version == 0)
+                return "Cannot parse request";
+        protocol[version < 3 ? version : 3] = 0;
+        if (strlen(url) >= MAX_URL_LENGTH)
+                return "[error] URL too long";
+        Util_urlDecode(url);
+        req->method = line;
+        req->url = url;
+        req->protocol = protocol;
+        return NULL;
+}
+
+
+/**
+ * Split the header lines into name and value slices of the block, trimmed
+ * and NUL terminated in place. The known headers are indexed for get_header()
+ */
+static void parse_headers(HttpRequest req, char *headers) {
+        // One field per line at most
+        int lines = 1;
+        for (const char *p = headers; (p = strchr(p, '\n')); p++)
+                lines++;
+        req->headers = Arena_alloc(req->arena, lines * sizeof(HttpField_T));
+        for (char *line = headers; *line;) {
+                char *end = strchr(line, '\n');
+                char *next = end ? end + 1 : line + strlen(line);
+                if (! end)
+                        end = next;
+                while (end > line && end[-1] == '\r')
+                        end--;
+                if (end == line)
+                        break;
+                char *value = memchr(line, ':', end - line);
                 if (value) {
-                        HttpHeader header = NULL;
-                        NEW(header);
-                        *value++ = 0;
-                        Str_trim(line);
-                        Str_trim(value);
-                        Str_chomp(value);
-                        header->name = Str_dup(line);
-                        header->value = Str_dup(value);
-                        header->next = req->headers;
-                        req->headers = header;
+                        char *name = line, *nameEnd = value++;
+                        while (name < nameEnd && isspace((unsigned char)*name))
+                                name++;
+                        while (nameEnd > name && isspace((unsigned char)nameEnd[-1]))
+                                nameEnd--;
+                        while (value < end && isspace((unsigned char)*value))
+                                value++;
+                        while (end > value && isspace((unsigned char)end[-1]))
+                                end--;
+                        *nameEnd = 0;
+                        *end = 0;
+                        HttpField_T *field = &req->headers[req->headerCount++];
+                        field->name = (int)(name - req->block);
+                        field->nameLength = (int)(nameEnd - name);
+                        field->value = (int)(value - req->block);
+                        field->valueLength = (int)(end - value);
+                        // The last header of a name wins
+                        int slot = known_header(name, field->nameLength);
+                        if (slot >= 0)
+                                req->known[slot] = req->headerCount;
                 }
+                line = next;
         }
 }
 
 
+/**
+ * Perfect hash of the known header names, the name length and its first and
+ * last character (case folded) give a unique slot. Returns the slot of the
+ * header in knownHeaders or -1 if the header is not known
+ */
+static int known_header(const char *name, int length) {
+        if (length < 1)
+                return -1;
+        int slot = (length * 5 + tolower((unsigned char)name[0]) + (tolower((unsigned char)name[length - 1]) << 3)) & (KNOWN_HEADERS - 1);
+        if (knownHeaders[slot] && (int)strlen(knownHeaders[slot]) == length && strncasecmp(knownHeaders[slot], name, length) == 0)
+                return slot;
+        return -1;
+}
+
+
 /**
  * Create parameters for the given request. Returns false if an error
  * occurs.
@@ -600,30 +1046,32 @@ static boolean_t create_parameters(HttpRequest req) {
                 if (! content_length || sscanf(content_length, "%d", &len) != 1 || len < 0 || len > _httpPostLimit)
                         return false;
                 if (len != 0) {
-                        query_string = CALLOC(1, _httpPostLimit + 1);
+                        query_string = Arena_calloc(req->arena, 1, len + 1);
                         int n = Socket_read(req->S, query_string, len);
-                        if (n != len) {
-                                FREE(query_string);
+                        if (n != len)
                                 return false;
+                        // A binary body is passed as is to the cervlet
+                        const char *content_type = get_header(req, "Content-Type");
+                        if (content_type && Str_startsWith(content_type, RPC_CONTENT_TYPE)) {
+                                req->body = (const unsigned char *)query_string;
+                                req->body_length = len;
+                                return true;
                         }
                 }
         } else if (IS(req->method, METHOD_GET)) {
                 char *p = strchr(req->url, '?');
                 if (p) {
                         *p++ = 0;
-                        query_string = Str_dup(p);
+                        query_string = p;
                 }
         }
-        if (query_string) {
-                if (*query_string) {
-                        char *p = strchr(query_string, '/');
-                        if (p) {
-                                *p++ = 0;
-                                req->pathinfo = Str_dup(p);
-                        }
-                        req->params = parse_parameters(query_string);
+        if (query_string && *query_string) {
+                char *p = strchr(query_string, '/');
+                if (p) {
+                        *p++ = 0;
+                        req->pathinfo = p;
                 }
-                FREE(query_string);
+                parse_parameters(req, query_string);
         }
         return true;
 }
@@ -641,6 +1089,7 @@ static void reset_response(HttpResponse res) {
                 res->headers = NULL; /* Release Pragma */
         }
         StringBuffer_clear(res->outputbuffer);
+        set_file(res, -1, 0, 0);
 }
 
 
@@ -658,16 +1107,8 @@ static void done(HttpRequest req, HttpResponse res) {
  */
 static void destroy_HttpRequest(HttpRequest req) {
         if (req) {
-                FREE(req->method);
-                FREE(req->url);
-                FREE(req->pathinfo);
-                FREE(req->protocol);
-                FREE(req->remote_user);
-                if (req->headers)
-                        destroy_entry(req->headers);
-                if (req->params)
-                        destroy_entry(req->params);
-                FREE(req);
+                Arena_T arena = req->arena;
+                Arena_free(&arena);
         }
 }
 
@@ -680,14 +1121,21 @@ static void destroy_HttpResponse(HttpResponse res) {
                 StringBuffer_free(&(res->outputbuffer));
                 if (res->headers)
                         destroy_entry(res->headers);
+                if (res->file.fd >= 0)
+                        close(res->file.fd);
+#ifdef HAVE_LIBZ
+                if (res->zstream) {
+                        deflateEnd(res->zstream);
+                        FREE(res->zstream);
+                }
+#endif
                 FREE(res);
         }
 }
 
 
 /**
- * Free a (linked list of) http entry object(s). Both HttpHeader and
- * HttpParameter are of this type.
+ * Free a (linked list of) http entry object(s), the response headers
  */
 static void destroy_entry(void *p) {
         struct entry *h = p;
@@ -702,6 +1150,19 @@ static void destroy_entry(void *p) {
 /* ----------------------------------------------------- Checkers/Validators */
 
 
+/**
+ * Returns true if the client wants to keep the connection open: HTTP/1.1
+ * connections are persistent unless closed explicitly, HTTP/1.0 clients
+ * have to ask for keep-alive
+ */
+static boolean_t is_persistent(HttpRequest req) {
+        const char *connection = get_header(req, "Connection");
+        if (IS(req->protocol, "1.1"))
+                return ! (connection && Str_sub(connection, "close"));
+        return connection && Str_sub(connection, "keep-alive");
+}
+
+
 /**
  * Do Basic Authentication if this auth. style is allowed.
  */
@@ -728,6 +1189,10 @@ static boolean_t basic_authenticate(HttpRequest req) {
                 LogError("HttpRequest: access denied -- client %s: missing or invalid Authorization header\n", Socket_getRemoteHost(req->S));
                 return false;
         }
+        unsigned char digest[SHA256_DIGEST_SIZE];
+        get_credentials_digest(credentials, digest);
+        if (get_cached_credentials(req, digest))
+                return true;
         char buf[STRLEN] = {0};
         strncpy(buf, &credentials[6], sizeof(buf) - 1);
         char uname[STRLEN] = {0};
@@ -755,11 +1220,70 @@ static boolean_t basic_authenticate(HttpRequest req) {
                 LogError("HttpRequest: access denied -- client %s: wrong password for user '%s'\n", Socket_getRemoteHost(req->S), uname);
                 return false;
         }
-        req->remote_user = Str_dup(uname);
+        req->remote_user = Arena_dup(req->arena, uname);
+        cache_credentials(digest, uname);
         return true;
 }
 
 
+/**
+ * Compute the keyed digest of the Authorization header, the cache keeps
+ * no value which could be used to recover the password
+ */
+static void get_credentials_digest(const char *credentials, unsigned char *digest) {
+        sha256_context_t context;
+        sha256_init(&context);
+        LOCK(authMutex)
+        {
+                sha256_append(&context, authCache.key, sizeof(authCache.key));
+        }
+        END_LOCK;
+        sha256_append(&context, (const unsigned char *)credentials, strlen(credentials));
+        sha256_finish(&context, digest);
+}
+
+
+/**
+ * Authenticate the request with the cached credentials
+ * @return true if the same Authorization header was verified recently
+ */
+static boolean_t get_cached_credentials(HttpRequest req, const unsigned char *digest) {
+        boolean_t rv = false;
+        long long now = Time_monotonic();
+        LOCK(authMutex)
+        {
+                for (int i = 0; i < AUTH_CACHE_SIZE; i++) {
+                        if (authCache.entry[i].expires > now && memcmp(authCache.entry[i].digest, digest, SHA256_DIGEST_SIZE) == 0) {
+                                req->remote_user = Arena_dup(req->arena, authCache.entry[i].uname);
+                                rv = true;
+                                break;
+                        }
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+/**
+ * Cache the verified credentials, the entry which expires first is replaced
+ */
+static void cache_credentials(const unsigned char *digest, const char *uname) {
+        long long now = Time_monotonic();
+        LOCK(authMutex)
+        {
+                int slot = 0;
+                for (int i = 1; i < AUTH_CACHE_SIZE; i++)
+                        if (authCache.entry[i].expires < authCache.entry[slot].expires)
+                                slot = i;
+                memcpy(authCache.entry[slot].digest, digest, SHA256_DIGEST_SIZE);
+                snprintf(authCache.entry[slot].uname, sizeof(authCache.entry[slot].uname), "%s", uname);
+                authCache.entry[slot].expires = now + AUTH_CACHE_TTL * 1000LL;
+        }
+        END_LOCK;
+}
+
+
 /* --------------------------------------------------------------- Utilities */
 
 
@@ -793,67 +1317,30 @@ static void internal_error(Socket_T S, int status, char *msg) {
 
 
 /**
- * Parse request parameters from the given query string and return a
- * linked list of HttpParameters
- */
-static HttpParameter parse_parameters(char *query_string) {
-#define KEY 1
-#define VALUE 2
-        int token;
-        int cursor = 0;
-        char *key = NULL;
-        char *value = NULL;
-        HttpParameter head = NULL;
-
-        while ((token = get_next_token(query_string, &cursor, &value))) {
-                if (token == KEY)
-                        key = value;
-                else if (token == VALUE) {
-                        HttpParameter p = NULL;
-                        if (! key)
-                                goto error;
-                        NEW(p);
-                        p->name = key;
-                        p->value = value;
-                        p->next = head;
-                        head = p;
-                        key = NULL;
-                }
-        }
-        return head;
-error:
-        FREE(key);
-        FREE(value);
-        if ( head != NULL )
-                destroy_entry(head);
-        return NULL;
-}
-
-
-/**
- * A mini-scanner for tokenizing a query string
+ * Split the query string into parameter slices in place, the name and value
+ * are NUL terminated at the '=' and '&' separators. A token without a value
+ * is skipped
  */
-static int get_next_token(char *s, int *cursor, char **r) {
-        int i = *cursor;
-
-        while (s[*cursor]) {
-                if (s[*cursor+1] == '=') {
-                        *cursor += 1;
-                        *r = Str_ndup(&s[i], (*cursor-i));
-                        return KEY;
-                }
-                if (s[*cursor] == '=') {
-                        while (s[*cursor] && s[*cursor] != '&') *cursor += 1;
-                        if (s[*cursor] == '&') {
-                                *r = Str_ndup(&s[i+1], (*cursor-i)-1);
-                                *cursor += 1;
-                        }  else {
-                                *r = Str_ndup(&s[i+1], (*cursor-i));
-                        }
-                        return VALUE;
+static void parse_parameters(HttpRequest req, char *query_string) {
+        int count = 1;
+        for (const char *p = query_string; (p = strchr(p, '&')); p++)
+                count++;
+        req->query = query_string;
+        req->params = Arena_alloc(req->arena, count * sizeof(HttpField_T));
+        for (char *name = query_string; name;) {
+                char *next = strchr(name, '&');
+                if (next)
+                        *next++ = 0;
+                char *value = strchr(name, '=');
+                if (value) {
+                        *value++ = 0;
+                        HttpField_T *field = &req->params[req->paramCount++];
+                        field->name = (int)(name - query_string);
+                        field->nameLength = (int)(value - 1 - name);
+                        field->value = (int)(value - query_string);
+                        field->valueLength = (int)strlen(value);
                 }
-                *cursor += 1;
+                name = next;
         }
-        return 0;
 }
 
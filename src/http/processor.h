@@ -34,6 +34,9 @@
 #include "socket.h"
 #include "httpstatus.h"
 
+// libmonit
+#include "util/Arena.h"
+
 /* Server masquerade */
 #define SERVER_NAME        "monit"
 #define SERVER_VERSION     VERSION
@@ -55,6 +58,25 @@
 /* Request timeout in seconds */
 #define REQUEST_TIMEOUT    30
 
+/* Persistent connections: idle timeout in seconds and maximum number of requests per connection */
+#define KEEPALIVE_TIMEOUT  15
+#define KEEPALIVE_REQUESTS 100
+
+/* Responses shorter than this are sent uncompressed, the gzip framing would eat the gain */
+#define GZIP_MIN_LENGTH    1024
+
+/* A response is streamed in chunks of at least this size to HTTP/1.1 clients, see flush_response() */
+#define RESPONSE_CHUNK     16384
+
+/* The request data is allocated from an arena with blocks of this size, a typical request fits into one block */
+#define REQUEST_ARENA      4096
+
+/* Maximum size of the request line and headers */
+#define REQUEST_HEADER_MAX 8192
+
+/* Slots of the known request headers table, see get_header() */
+#define KNOWN_HEADERS      16
+
 struct entry {
         char *name;
         char *value;
@@ -65,7 +87,14 @@ struct entry {
 
 typedef struct entry *HttpHeader;
 
-typedef struct entry *HttpParameter;
+
+/* A request header or parameter: the name and value are slices of the request header block or of the query string, NUL terminated in place */
+typedef struct HttpField_T {
+        int name;
+        int nameLength;
+        int value;
+        int valueLength;
+} HttpField_T;
 
 
 typedef struct request {
@@ -75,9 +104,17 @@ typedef struct request {
         char *protocol;
         char *pathinfo;
         char *remote_user;
-        HttpHeader headers;
-        HttpParameter params;
+        char *block;       /* The request line and headers, parsed in place */
+        char *query;       /* The query string in the block or the POST body */
+        HttpField_T *headers;      /* Slices of the block */
+        int headerCount;
+        HttpField_T *params;       /* Slices of the query string */
+        int paramCount;
+        unsigned short known[KNOWN_HEADERS]; /* The known header index + 1, 0 = not sent */
+        const unsigned char *body; /* The raw body of a binary POST request, see rpc.h */
+        int body_length;
         Ssl_T ssl;
+        Arena_T arena;     /* The request data is freed with the arena */
 } *HttpRequest;
 
 
@@ -86,25 +123,39 @@ typedef struct response {
         Socket_T S;
         const char *protocol;
         boolean_t is_committed;
+        boolean_t is_persistent;
+        boolean_t accepts_gzip;
+        boolean_t accepts_chunked;
+        boolean_t is_chunked;      /* The header was sent and the body follows in chunks */
+        void *zstream;             /* The deflate stream of a compressed chunked body */
         HttpHeader headers;
         const char *status_msg;
         StringBuffer_T outputbuffer;
+        struct {
+                int fd;
+                off_t offset;
+                off_t length;
+        } file;                    /* The file body is sent after the outputbuffer if fd >= 0 */
         Ssl_T ssl;
 } *HttpResponse;
 
 
 /* Public prototypes */
-void *http_processor(Socket_T);
+boolean_t http_processor(Socket_T, int);
 char *get_headers(HttpResponse res);
 void set_status(HttpResponse res, int status);
 const char *get_status_string(int status_code);
 void add_Impl(void(*doGet)(HttpRequest, HttpResponse), void(*doPost)(HttpRequest, HttpResponse));
 void set_content_type(HttpResponse res, const char *mime);
+void set_file(HttpResponse res, int fd, off_t offset, off_t length);
+void flush_response(HttpResponse res);
 const char *get_header(HttpRequest req, const char *header_name);
 void escapeHTML(StringBuffer_T sb, const char *s);
 void send_error(HttpRequest, HttpResponse, int status, const char *message, ...);
 const char *get_parameter(HttpRequest req, const char *parameter_name);
+const char *next_parameter(HttpRequest req, const char *parameter_name, int *cursor);
 void set_header(HttpResponse res, const char *name, const char *value);
 void Processor_setHttpPostLimit();
+void Processor_resetAuthCache();
 
 #endif
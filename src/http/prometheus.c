@@ -0,0 +1,516 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "monit.h"
+#include "ProcessTree.h"
+#include "protocol.h"
+#include "snapshot.h"
+#include "counter.h"
+
+#ifdef HAVE_OPENSSL
+#include "SslServer.h"
+#endif
+
+
+/**
+ *  Prometheus text exposition format (version 0.0.4) of the service
+ *  status. The metric families are written in one pass over the service
+ *  list straight from the service status snapshots. Each sample is
+ *  labeled with the service name and type, the values use the base units
+ *  (bytes, seconds) and services without data are skipped.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct Family_T {
+        const char *name;
+        const char *type;
+        const char *help;
+        void (*sample)(StringBuffer_T B, Service_T S, const struct Family_T *F);
+} *Family_T;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Append the label value with the backslash, double-quote and line feed escaped
+ */
+static void _label(StringBuffer_T B, const char *s) {
+        const char *run = s;
+        for (; *s; s++) {
+                if (*s == '\\' || *s == '"' || *s == '\n') {
+                        if (s > run)
+                                StringBuffer_append(B, "%.*s", (int)(s - run), run);
+                        StringBuffer_append(B, *s == '\n' ? "\\n" : "\\%c", *s);
+                        run = s + 1;
+                }
+        }
+        if (s > run)
+                StringBuffer_append(B, "%.*s", (int)(s - run), run);
+}
+
+
+/**
+ * Start the sample line: metric name and the service labels. The caller
+ * may append more labels and must finish the line with _value()
+ */
+static void _begin(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        StringBuffer_append(B, "%s{service=\"", F->name);
+        _label(B, S->name);
+        StringBuffer_append(B, "\",type=\"%s\"", servicetypes[S->type]);
+}
+
+
+static void _value(StringBuffer_T B, double value) {
+        StringBuffer_append(B, "} %.15g\n", value);
+}
+
+
+static void _sample(StringBuffer_T B, Service_T S, const struct Family_T *F, double value) {
+        _begin(B, S, F);
+        _value(B, value);
+}
+
+
+static void _status(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        _sample(B, S, F, S->error);
+}
+
+
+static void _monitor(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        _sample(B, S, F, S->monitor);
+}
+
+
+static void _collected(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->collected.tv_sec > 0)
+                _sample(B, S, F, (double)S->collected.tv_sec + (double)S->collected.tv_usec / 1000000.);
+}
+
+
+static void _processCpu(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Process && Util_hasServiceStatus(S) && (Run.flags & Run_ProcessEngineEnabled) && S->inf->priv.process.cpu_percent >= 0.)
+                _sample(B, S, F, S->inf->priv.process.cpu_percent);
+}
+
+
+static void _processMemory(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Process && Util_hasServiceStatus(S) && (Run.flags & Run_ProcessEngineEnabled))
+                _sample(B, S, F, (double)S->inf->priv.process.mem);
+}
+
+
+static void _processThreads(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Process && Util_hasServiceStatus(S) && (Run.flags & Run_ProcessEngineEnabled) && S->inf->priv.process.threads >= 0)
+                _sample(B, S, F, S->inf->priv.process.threads);
+}
+
+
+static void _processChildren(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Process && Util_hasServiceStatus(S) && (Run.flags & Run_ProcessEngineEnabled))
+                _sample(B, S, F, S->inf->priv.process.children);
+}
+
+
+static void _processUptime(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Process && Util_hasServiceStatus(S) && S->inf->priv.process.uptime >= 0)
+                _sample(B, S, F, S->inf->priv.process.uptime);
+}
+
+
+static void _processGpuMemory(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Process && Util_hasServiceStatus(S) && S->inf->priv.process.gpu_memory >= 0)
+                _sample(B, S, F, (double)S->inf->priv.process.gpu_memory);
+}
+
+
+static void _filesystemSpace(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Filesystem && Util_hasServiceStatus(S) && S->inf->priv.filesystem.f_bsize > 0)
+                _sample(B, S, F, (double)S->inf->priv.filesystem.space_total * (double)S->inf->priv.filesystem.f_bsize);
+}
+
+
+static void _filesystemSpacePercent(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Filesystem && Util_hasServiceStatus(S) && S->inf->priv.filesystem.f_bsize > 0)
+                _sample(B, S, F, S->inf->priv.filesystem.space_percent);
+}
+
+
+static void _filesystemInodePercent(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Filesystem && Util_hasServiceStatus(S) && S->inf->priv.filesystem.f_files > 0)
+                _sample(B, S, F, S->inf->priv.filesystem.inode_percent);
+}
+
+
+static void _fileSize(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_File && Util_hasServiceStatus(S) && S->inf->priv.file.size >= 0)
+                _sample(B, S, F, (double)S->inf->priv.file.size);
+}
+
+
+static void _timestamp(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (Util_hasServiceStatus(S)) {
+                time_t timestamp = 0;
+                if (S->type == Service_File)
+                        timestamp = S->inf->priv.file.timestamp;
+                else if (S->type == Service_Directory)
+                        timestamp = S->inf->priv.directory.timestamp;
+                else if (S->type == Service_Fifo)
+                        timestamp = S->inf->priv.fifo.timestamp;
+                if (timestamp > 0)
+                        _sample(B, S, F, timestamp);
+        }
+}
+
+
+static void _netDownload(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Net && Util_hasServiceStatus(S) && Link_getState(S->inf->priv.net.stats) == 1)
+                _sample(B, S, F, (double)Link_getBytesInTotal(S->inf->priv.net.stats));
+}
+
+
+static void _netUpload(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Net && Util_hasServiceStatus(S) && Link_getState(S->inf->priv.net.stats) == 1)
+                _sample(B, S, F, (double)Link_getBytesOutTotal(S->inf->priv.net.stats));
+}
+
+
+static void _port(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (Util_hasServiceStatus(S)) {
+                for (Port_T p = S->portlist; p; p = p->next) {
+                        if (p->is_available == Connection_Ok) {
+                                _begin(B, S, F);
+                                StringBuffer_append(B, ",hostname=\"");
+                                _label(B, p->hostname ? p->hostname : "");
+                                StringBuffer_append(B, "\",port=\"%d\",protocol=\"%s\"", p->target.net.port, p->protocol->name ? p->protocol->name : "");
+                                _value(B, p->response / 1000.);
+                        }
+                }
+                for (Port_T p = S->socketlist; p; p = p->next) {
+                        if (p->is_available == Connection_Ok) {
+                                _begin(B, S, F);
+                                StringBuffer_append(B, ",path=\"");
+                                _label(B, p->target.unix.pathname ? p->target.unix.pathname : "");
+                                StringBuffer_append(B, "\",protocol=\"%s\"", p->protocol->name ? p->protocol->name : "");
+                                _value(B, p->response / 1000.);
+                        }
+                }
+        }
+}
+
+
+static void _icmp(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (Util_hasServiceStatus(S))
+                for (Icmp_T i = S->icmplist; i; i = i->next)
+                        if (i->is_available == Connection_Ok)
+                                _sample(B, S, F, i->response / 1000.);
+}
+
+
+static void _programStatus(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Program && Util_hasServiceStatus(S) && S->snapshot.program.started)
+                _sample(B, S, F, S->snapshot.program.exitStatus);
+}
+
+
+static void _programCpuTime(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Program && Util_hasServiceStatus(S) && S->snapshot.program.started && S->snapshot.program.usage.cpuTime >= 0)
+                _sample(B, S, F, S->snapshot.program.usage.cpuTime / 1000000.);
+}
+
+
+static void _programMemory(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Program && Util_hasServiceStatus(S) && S->snapshot.program.started && S->snapshot.program.usage.memory >= 0)
+                _sample(B, S, F, S->snapshot.program.usage.memory);
+}
+
+
+static void _programRunTime(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_Program && Util_hasServiceStatus(S) && S->snapshot.program.started && S->snapshot.program.usage.runTime >= 0)
+                _sample(B, S, F, S->snapshot.program.usage.runTime / 1000.);
+}
+
+
+static void _systemLoad(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled))
+                for (int i = 0; i < 3; i++) {
+                        _begin(B, S, F);
+                        StringBuffer_append(B, ",interval=\"%s\"", (char *[]){"1m", "5m", "15m"}[i]);
+                        _value(B, systeminfo.loadavg[i]);
+                }
+}
+
+
+static void _systemCpu(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled)) {
+                _begin(B, S, F);
+                StringBuffer_append(B, ",mode=\"user\"");
+                _value(B, systeminfo.total_cpu_user_percent > 0. ? systeminfo.total_cpu_user_percent : 0.);
+                _begin(B, S, F);
+                StringBuffer_append(B, ",mode=\"system\"");
+                _value(B, systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.);
+#ifdef HAVE_CPU_WAIT
+                _begin(B, S, F);
+                StringBuffer_append(B, ",mode=\"wait\"");
+                _value(B, systeminfo.total_cpu_wait_percent > 0. ? systeminfo.total_cpu_wait_percent : 0.);
+#endif
+#ifdef HAVE_CPU_STEAL
+                _begin(B, S, F);
+                StringBuffer_append(B, ",mode=\"steal\"");
+                _value(B, systeminfo.total_cpu_steal_percent > 0. ? systeminfo.total_cpu_steal_percent : 0.);
+#endif
+        }
+}
+
+
+static void _systemCpuCore(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled)) {
+                for (int i = 0; i < systeminfo.cpu.count; i++) {
+                        if (systeminfo.cpu.usage[i] >= 0.) {
+                                _begin(B, S, F);
+                                StringBuffer_append(B, ",cpu=\"%d\",node=\"%d\",mode=\"usage\"", i, systeminfo.cpu.node[i]);
+                                _value(B, systeminfo.cpu.usage[i]);
+                                _begin(B, S, F);
+                                StringBuffer_append(B, ",cpu=\"%d\",node=\"%d\",mode=\"steal\"", i, systeminfo.cpu.node[i]);
+                                _value(B, systeminfo.cpu.steal[i]);
+                        }
+                }
+        }
+}
+
+
+static void _systemPressure(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled)) {
+                for (int i = 0; i <= Pressure_Last; i++) {
+                        if (systeminfo.pressure[i].some[0] >= 0.) {
+                                for (int j = 0; j < 3; j++) {
+                                        _begin(B, S, F);
+                                        StringBuffer_append(B, ",resource=\"%s\",kind=\"some\",window=\"%s\"", pressurenames[i], pressurewindownames[j]);
+                                        _value(B, systeminfo.pressure[i].some[j]);
+                                        if (systeminfo.pressure[i].full[j] >= 0.) {
+                                                _begin(B, S, F);
+                                                StringBuffer_append(B, ",resource=\"%s\",kind=\"full\",window=\"%s\"", pressurenames[i], pressurewindownames[j]);
+                                                _value(B, systeminfo.pressure[i].full[j]);
+                                        }
+                                }
+                        }
+                }
+        }
+}
+
+
+static void _systemNode(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled) && systeminfo.node.count > 1) {
+                for (int i = 0; i < systeminfo.node.count; i++) {
+                        if (systeminfo.node.usage[i] >= 0.) {
+                                _begin(B, S, F);
+                                StringBuffer_append(B, ",node=\"%d\"", i);
+                                _value(B, systeminfo.node.usage[i]);
+                        }
+                }
+        }
+}
+
+
+static void _systemMemory(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled))
+                _sample(B, S, F, (double)systeminfo.total_mem);
+}
+
+
+static void _systemSwap(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled))
+                _sample(B, S, F, (double)systeminfo.total_swap);
+}
+
+
+static void _systemMeminfo(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled)) {
+                for (int i = 0; i < systeminfo.meminfo.count; i++) {
+                        _begin(B, S, F);
+                        StringBuffer_append(B, ",field=\"");
+                        _label(B, systeminfo.meminfo.field[i].name);
+                        StringBuffer_append(B, "\"");
+                        _value(B, (double)systeminfo.meminfo.field[i].value);
+                }
+        }
+}
+
+
+static void _systemGpu(StringBuffer_T B, Service_T S, const struct Family_T *F, Resource_Type id) {
+        if (S->type == Service_System && (Run.flags & Run_ProcessEngineEnabled)) {
+                for (int i = 0; i < systeminfo.gpu.count; i++) {
+                        GpuDevice_T *device = &systeminfo.gpu.device[i];
+                        double value = id == Resource_GpuUsage ? device->usage : id == Resource_GpuMemory ? device->memory : id == Resource_GpuTemperature ? device->temperature : device->ecc;
+                        if (value >= 0.) {
+                                _begin(B, S, F);
+                                StringBuffer_append(B, ",gpu=\"%d\",name=\"", i);
+                                _label(B, device->name);
+                                StringBuffer_append(B, "\"");
+                                _value(B, value);
+                        }
+                }
+        }
+}
+
+
+static void _systemGpuUsage(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        _systemGpu(B, S, F, Resource_GpuUsage);
+}
+
+
+static void _systemGpuMemory(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        _systemGpu(B, S, F, Resource_GpuMemory);
+}
+
+
+static void _systemGpuTemperature(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        _systemGpu(B, S, F, Resource_GpuTemperature);
+}
+
+
+static void _systemGpuEcc(StringBuffer_T B, Service_T S, const struct Family_T *F) {
+        _systemGpu(B, S, F, Resource_GpuEcc);
+}
+
+
+static const struct Family_T families[] = {
+        {"monit_service_status", "gauge", "Service error bitmap (0 = ok)", _status},
+        {"monit_service_monitor", "gauge", "Service monitoring state (0 = not monitored, 1 = monitored, 2 = initializing, 4 = waiting)", _monitor},
+        {"monit_service_collected_timestamp_seconds", "gauge", "Time of the last service check", _collected},
+        {"monit_process_cpu_percent", "gauge", "Process CPU usage in percent", _processCpu},
+        {"monit_process_memory_bytes", "gauge", "Process resident memory", _processMemory},
+        {"monit_process_threads", "gauge", "Number of process threads", _processThreads},
+        {"monit_process_children", "gauge", "Number of process children", _processChildren},
+        {"monit_process_uptime_seconds", "gauge", "Process uptime", _processUptime},
+        {"monit_process_gpu_memory_bytes", "gauge", "GPU memory used by the process and its children", _processGpuMemory},
+        {"monit_filesystem_space_used_bytes", "gauge", "Filesystem space used", _filesystemSpace},
+        {"monit_filesystem_space_used_percent", "gauge", "Filesystem space used in percent", _filesystemSpacePercent},
+        {"monit_filesystem_inode_used_percent", "gauge", "Filesystem inodes used in percent", _filesystemInodePercent},
+        {"monit_file_size_bytes", "gauge", "File size", _fileSize},
+        {"monit_file_timestamp_seconds", "gauge", "File, directory or fifo modification time", _timestamp},
+        {"monit_net_download_bytes_total", "counter", "Bytes received by the network interface", _netDownload},
+        {"monit_net_upload_bytes_total", "counter", "Bytes sent by the network interface", _netUpload},
+        {"monit_port_response_seconds", "gauge", "Port and unix socket response time", _port},
+        {"monit_icmp_response_seconds", "gauge", "ICMP response time", _icmp},
+        {"monit_program_exit_status", "gauge", "Program exit status", _programStatus},
+        {"monit_program_cpu_seconds", "gauge", "CPU time used by the last program run", _programCpuTime},
+        {"monit_program_memory_bytes", "gauge", "Peak resident memory of the last program run", _programMemory},
+        {"monit_program_run_seconds", "gauge", "Wall-clock time of the last program run", _programRunTime},
+        {"monit_system_load", "gauge", "System load average", _systemLoad},
+        {"monit_system_cpu_percent", "gauge", "System CPU usage in percent", _systemCpu},
+        {"monit_system_cpu_core_percent", "gauge", "Per-CPU usage and steal in percent", _systemCpuCore},
+        {"monit_system_numa_node_cpu_percent", "gauge", "CPU usage of the NUMA node in percent", _systemNode},
+        {"monit_system_pressure_percent", "gauge", "Share of time in which some or all tasks were stalled on the resource", _systemPressure},
+        {"monit_system_memory_used_bytes", "gauge", "System memory used", _systemMemory},
+        {"monit_system_swap_used_bytes", "gauge", "System swap used", _systemSwap},
+        {"monit_system_meminfo", "gauge", "System memory statistic field in bytes, the HugePages fields are page counts", _systemMeminfo},
+        {"monit_system_gpu_usage_percent", "gauge", "GPU busy time in percent", _systemGpuUsage},
+        {"monit_system_gpu_memory_used_bytes", "gauge", "GPU memory used", _systemGpuMemory},
+        {"monit_system_gpu_temperature_celsius", "gauge", "GPU temperature", _systemGpuTemperature},
+        {"monit_system_gpu_ecc_errors", "gauge", "Uncorrected GPU ECC errors since the driver load", _systemGpuEcc}
+};
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Get the service status in the Prometheus text exposition format.
+ * @param B Output StringBuffer object
+ */
+void status_prometheus(StringBuffer_T B) {
+        StringBuffer_append(B,
+                            "# HELP monit_uptime_seconds Monit daemon uptime\n"
+                            "# TYPE monit_uptime_seconds gauge\n"
+                            "monit_uptime_seconds %lld\n",
+                            (long long)ProcessTree_getProcessUptime(getpid()));
+        if (Run.cycle.budget)
+                StringBuffer_append(B,
+                                    "# HELP monit_check_deferrals_total Checks deferred to the next cycle by the cycle budget\n"
+                                    "# TYPE monit_check_deferrals_total counter\n"
+                                    "monit_check_deferrals_total %llu\n",
+                                    Run.cycle.deferrals);
+        unsigned long long counters[Counter_Last + 1];
+        Counter_read(counters, NULL);
+        StringBuffer_append(B,
+                            "# HELP monit_work_total Work done by Monit: files and bytes read from /proc, sockets opened, events posted, event queue writes, regex executions and allocations\n"
+                            "# TYPE monit_work_total counter\n");
+        for (int i = 0; i <= Counter_Last; i++)
+                StringBuffer_append(B, "monit_work_total{counter=\"%s\"} %llu\n", Counter_name(i), counters[i]);
+#ifdef HAVE_OPENSSL
+        if (Run.httpd.flags & Httpd_Ssl) {
+                unsigned long long full, resumed, failed;
+                SslServer_statistics(&full, &resumed, &failed);
+                StringBuffer_append(B,
+                                    "# HELP monit_tls_handshakes_total HTTPS interface TLS handshakes\n"
+                                    "# TYPE monit_tls_handshakes_total counter\n"
+                                    "monit_tls_handshakes_total{type=\"full\"} %llu\n"
+                                    "monit_tls_handshakes_total{type=\"resumed\"} %llu\n"
+                                    "monit_tls_handshakes_total{type=\"failed\"} %llu\n",
+                                    full, resumed, failed);
+        }
+#endif
+        // The samples of a family must be adjacent, so they are collected per family while the service status snapshot is taken just once per service
+        int count = (int)(sizeof(families) / sizeof(families[0]));
+        StringBuffer_T samples[count];
+        for (int i = 0; i < count; i++)
+                samples[i] = StringBuffer_create(64);
+        struct myservice copy;
+        for (Service_T S = servicelist_conf; S; S = S->next_conf) {
+                Service_T snapshot = Snapshot_get(S, &copy);
+                for (int i = 0; i < count; i++)
+                        families[i].sample(samples[i], snapshot, &families[i]);
+        }
+        for (int i = 0; i < count; i++) {
+                StringBuffer_append(B, "# HELP %s %s\n# TYPE %s %s\n%s", families[i].name, families[i].help, families[i].name, families[i].type, StringBuffer_toString(samples[i]));
+                StringBuffer_free(&samples[i]);
+        }
+}
+
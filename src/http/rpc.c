@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "statussegment.h"
+#include "rpc.h"
+
+
+/**
+ *  Encoding and decoding of the binary wire protocol frames, the methods
+ *  are dispatched by the cervlet.
+ *
+ *  @file
+ */
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static uint64_t _get(const unsigned char *p, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+                value = (value << 8) | p[i];
+        return value;
+}
+
+
+static void _put(StringBuffer_T B, uint64_t value, int bytes) {
+        unsigned char buf[8];
+        for (int i = bytes - 1; i >= 0; i--, value >>= 8)
+                buf[i] = value & 0xff;
+        StringBuffer_appendBytes(B, buf, bytes);
+}
+
+
+static boolean_t _consume(RpcFrame_T *F, uint64_t *value, int bytes) {
+        if (F->length < (uint32_t)bytes)
+                return false;
+        *value = _get(F->payload, bytes);
+        F->payload += bytes;
+        F->length -= bytes;
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Rpc_next(const unsigned char **data, int *length, RpcFrame_T *F) {
+        ASSERT(data);
+        ASSERT(length);
+        ASSERT(F);
+        // The frame length covers the method and the id at least
+        if (*length < 4)
+                return false;
+        uint32_t frame = (uint32_t)_get(*data, 4);
+        if (frame < 5 || frame > (uint32_t)(*length - 4))
+                return false;
+        F->method = (*data)[4];
+        F->id = (uint32_t)_get(*data + 5, 4);
+        F->payload = *data + 9;
+        F->length = frame - 5;
+        *data += frame + 4;
+        *length -= frame + 4;
+        return true;
+}
+
+
+boolean_t Rpc_getU32(RpcFrame_T *F, uint32_t *value) {
+        ASSERT(F);
+        ASSERT(value);
+        uint64_t v;
+        if (! _consume(F, &v, 4))
+                return false;
+        *value = (uint32_t)v;
+        return true;
+}
+
+
+boolean_t Rpc_getU64(RpcFrame_T *F, uint64_t *value) {
+        ASSERT(F);
+        ASSERT(value);
+        return _consume(F, value, 8);
+}
+
+
+char *Rpc_getString(RpcFrame_T *F, char *s, int size) {
+        ASSERT(F);
+        ASSERT(s);
+        ASSERT(size > 0);
+        uint64_t length;
+        if (F->length < 2 || (length = _get(F->payload, 2)) >= (uint64_t)size || length > F->length - 2)
+                return NULL;
+        memcpy(s, F->payload + 2, length);
+        s[length] = 0;
+        F->payload += length + 2;
+        F->length -= length + 2;
+        return s;
+}
+
+
+void Rpc_putU32(StringBuffer_T B, uint32_t value) {
+        _put(B, value, 4);
+}
+
+
+void Rpc_putU64(StringBuffer_T B, uint64_t value) {
+        _put(B, value, 8);
+}
+
+
+void Rpc_putDouble(StringBuffer_T B, double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        _put(B, bits, 8);
+}
+
+
+void Rpc_putString(StringBuffer_T B, const char *s) {
+        size_t length = s ? strlen(s) : 0;
+        if (length > 0xffff)
+                length = 0xffff;
+        _put(B, length, 2);
+        if (length)
+                StringBuffer_appendBytes(B, s, (int)length);
+}
+
+
+void Rpc_putService(StringBuffer_T B, Service_T S) {
+        ASSERT(S);
+        StatusRecord_T r;
+        StatusSegment_record(&r, S);
+        // The record name is truncated, send the full one
+        Rpc_putString(B, S->name);
+        Rpc_putU32(B, r.type);
+        Rpc_putU32(B, r.state);
+        Rpc_putU32(B, r.monitor);
+        Rpc_putU32(B, r.error);
+        Rpc_putU64(B, r.collected);
+        Rpc_putU64(B, r.pid);
+        Rpc_putU64(B, r.uptime);
+        Rpc_putU64(B, r.memory);
+        Rpc_putDouble(B, r.cpu);
+        Rpc_putDouble(B, r.response);
+        Rpc_putU32(B, r.exitStatus);
+}
+
+
+void Rpc_reply(StringBuffer_T B, RpcFrame_T *F, RpcResult_Type result, int flags, StringBuffer_T payload) {
+        ASSERT(B);
+        ASSERT(F);
+        int length = payload ? StringBuffer_length(payload) : 0;
+        _put(B, length + 7, 4);
+        _put(B, F->method, 1);
+        _put(B, F->id, 4);
+        _put(B, result, 1);
+        _put(B, flags, 1);
+        if (length)
+                StringBuffer_appendBytes(B, StringBuffer_toString(payload), length);
+}
+
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef RPC_H
+#define RPC_H
+
+#include "config.h"
+
+#include "monit.h"
+
+
+/**
+ * Binary wire protocol for programs which talk to the HTTP interface
+ * (the monit CLI, agents and collectors). A client POSTs a batch of
+ * request frames to RPC_PATH with the RPC_CONTENT_TYPE content type and
+ * reads back a stream of response frames; one request may produce more
+ * than one response frame and the frame with the RPC_LAST flag ends the
+ * responses of the request. The HTML, XML and JSON documents are kept
+ * for humans and browsers.
+ *
+ * All integers are unsigned and in network byte order, a double is sent
+ * as the 64 bit IEEE 754 representation and a string is a 16 bit length
+ * followed by the bytes without the terminating zero.
+ *
+ * <pre>
+ * Request:  u32 length | u8 method | u32 id | payload
+ * Response: u32 length | u8 method | u32 id | u8 result | u8 flags | payload
+ * </pre>
+ *
+ * The length covers the bytes which follow it. The id is chosen by the
+ * client and copied to the responses, so a batch may be matched back.
+ * The status method sends a frame per service and an empty last frame,
+ * the other methods send one frame. A failed request gets one frame with
+ * the error result and an empty payload.
+ *
+ * @file
+ */
+
+
+#define RPC_PATH         "/_rpc"
+#define RPC_CONTENT_TYPE "application/x-monit-rpc"
+#define RPC_VERSION      1
+
+/* The POST body limit grows by this size for a batch of requests, besides the room for an action on all services */
+#define RPC_BATCH        4096
+
+/* The response frame flags */
+#define RPC_LAST         0x1
+
+
+typedef enum {
+        Rpc_Status = 1,  /**< Request: string service, string group, empty for all. Response: one frame per service */
+        Rpc_Summary,     /**< Response: u32 up, u32 down, u32 initializing, u32 unmonitored, u64 generation */
+        Rpc_Action,      /**< Request: string action, string service... Response: u32 number of services */
+        Rpc_Events,      /**< Request: u32 limit, u64 before. Response: the event history text */
+        Rpc_Series       /**< Request: string service, string metric, u64 since. Response: the series text */
+} Rpc_Method;
+
+
+typedef enum {
+        RpcResult_Ok = 0,
+        RpcResult_BadRequest,
+        RpcResult_NotFound,
+        RpcResult_Forbidden,
+        RpcResult_Unavailable
+} RpcResult_Type;
+
+
+/**
+ * A request frame. The payload points into the request body and the
+ * Rpc_getXXX methods consume it.
+ */
+typedef struct RpcFrame_T {
+        uint8_t method;
+        uint32_t id;
+        const unsigned char *payload;
+        uint32_t length;                           /**< Unread payload length */
+} RpcFrame_T;
+
+
+/**
+ * Read the next request frame from the request body
+ * @param data The unread body, advanced past the frame
+ * @param length The unread body length, decremented by the frame length
+ * @param F The frame to fill
+ * @return true if a frame was read, false at the end of the body or if
+ * the frame is truncated
+ */
+boolean_t Rpc_next(const unsigned char **data, int *length, RpcFrame_T *F);
+
+
+/**
+ * Read an unsigned 32 bit integer from the frame payload
+ * @param F The request frame
+ * @param value The result
+ * @return true on success, false if the payload is too short
+ */
+boolean_t Rpc_getU32(RpcFrame_T *F, uint32_t *value);
+
+
+/**
+ * Read an unsigned 64 bit integer from the frame payload
+ * @param F The request frame
+ * @param value The result
+ * @return true on success, false if the payload is too short
+ */
+boolean_t Rpc_getU64(RpcFrame_T *F, uint64_t *value);
+
+
+/**
+ * Read a string from the frame payload. A string which doesn't fit into
+ * the buffer is an error.
+ * @param F The request frame
+ * @param s The result buffer
+ * @param size The size of the result buffer
+ * @return The zero terminated string or NULL if the payload is too short
+ */
+char *Rpc_getString(RpcFrame_T *F, char *s, int size);
+
+
+/**
+ * Append an unsigned 32 bit integer to the payload
+ * @param B The payload buffer
+ * @param value The value
+ */
+void Rpc_putU32(StringBuffer_T B, uint32_t value);
+
+
+/**
+ * Append an unsigned 64 bit integer to the payload
+ * @param B The payload buffer
+ * @param value The value
+ */
+void Rpc_putU64(StringBuffer_T B, uint64_t value);
+
+
+/**
+ * Append a double to the payload
+ * @param B The payload buffer
+ * @param value The value
+ */
+void Rpc_putDouble(StringBuffer_T B, double value);
+
+
+/**
+ * Append a string to the payload, a string longer than 65535 bytes is
+ * truncated
+ * @param B The payload buffer
+ * @param s The string, NULL is sent as an empty string
+ */
+void Rpc_putString(StringBuffer_T B, const char *s);
+
+
+/**
+ * Append the service status to the payload, the fields are those of the
+ * status segment record (see StatusRecord_T) in the record order
+ * @param B The payload buffer
+ * @param S The service
+ */
+void Rpc_putService(StringBuffer_T B, Service_T S);
+
+
+/**
+ * Append a response frame for the request
+ * @param B The response output buffer
+ * @param F The request frame
+ * @param result The result code
+ * @param flags The response frame flags
+ * @param payload The payload buffer or NULL for an empty payload
+ */
+void Rpc_reply(StringBuffer_T B, RpcFrame_T *F, RpcResult_Type result, int flags, StringBuffer_T payload);
+
+
+#endif
@@ -49,22 +49,47 @@
 #include <unistd.h>
 #endif
 
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
 // libmonit
 #include "util/List.h"
+#include "thread/Thread.h"
 
 #include "monit.h"
 #include "event.h"
 #include "ProcessTree.h"
 #include "protocol.h"
+#include "snapshot.h"
+#include "counter.h"
 
 
 /**
  *  XML routines for status and event notification message handling.
  *
+ *  The status of each service is rendered once per service generation
+ *  (see Service_T.generation) and cached in the service, the services
+ *  section of the document is assembled from the fragments and cached
+ *  until some service generation changes.
+ *
  *  @file
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+static struct {
+        unsigned int epoch;                /**< Incremented on configuration reload */
+        unsigned long long tag[2];  /**< Status tag of the cached section per format version */
+        StringBuffer_T services[2];         /**< The cached services and servicegroups */
+} cache = {};
+
+
+static Mutex_T mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -74,12 +99,16 @@
  * @param buf String to escape
  */
 static void _escapeCDATA(StringBuffer_T B, const char *buf) {
-        for (int i = 0; buf[i]; i++) {
-                if (buf[i] == '>' && i > 1 && (buf[i - 1] == ']' && buf[i - 2] == ']'))
-                        StringBuffer_append(B, "&gt;");
-                else
-                        StringBuffer_append(B, "%c", buf[i]);
+        // Append the runs between the stop sequences at once
+        int run = 0, i;
+        for (i = 0; buf[i]; i++) {
+                if (buf[i] == '>' && i > 1 && (buf[i - 1] == ']' && buf[i - 2] == ']')) {
+                        StringBuffer_appendBytes(B, buf + run, i - run);
+                        StringBuffer_appendBytes(B, "&gt;", 4);
+                        run = i + 1;
+                }
         }
+        StringBuffer_appendBytes(B, buf + run, i - run);
 }
 
 
@@ -115,6 +144,16 @@ static void document_head(StringBuffer_T B, int V, const char *myip) {
                             Run.system->name ? Run.system->name : "",
                             Run.files.control ? Run.files.control : "");
 
+        if (Run.eventlist_dir)
+                StringBuffer_append(B, "<eventqueue><slots>%d</slots><count>%d</count><size>%lld</size></eventqueue>", Run.eventlist_slots, Event_queue_count(), Event_queue_size());
+
+        unsigned long long total[Counter_Last + 1], cycle[Counter_Last + 1];
+        Counter_read(total, cycle);
+        StringBuffer_append(B, "<counters>");
+        for (int i = 0; i <= Counter_Last; i++)
+                StringBuffer_append(B, "<%s><total>%llu</total><cycle>%llu</cycle></%s>", Counter_name(i), total[i], cycle[i], Counter_name(i));
+        StringBuffer_append(B, "</counters>");
+
         if (Run.httpd.flags & Httpd_Net || Run.httpd.flags & Httpd_Unix) {
                 if (Run.httpd.flags & Httpd_Net)
                         StringBuffer_append(B, "<httpd><address>%s</address><port>%d</port><ssl>%d</ssl></httpd>", Run.httpd.socket.net.address ? Run.httpd.socket.net.address : myip ? myip : "", Run.httpd.socket.net.port, Run.httpd.flags & Httpd_Ssl);
@@ -185,8 +224,10 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                 StringBuffer_append(B, "<every><type>%d</type>", S->every.type);
                 if (S->every.type == 1)
                         StringBuffer_append(B, "<counter>%d</counter><number>%d</number>", S->every.spec.cycle.counter, S->every.spec.cycle.number);
+                else if (S->every.type == Every_Interval)
+                        StringBuffer_append(B, "<interval>%d</interval>", S->every.spec.interval.seconds);
                 else
-                        StringBuffer_append(B, "<cron>%s</cron>", S->every.spec.cron);
+                        StringBuffer_append(B, "<cron>%s</cron>", S->every.spec.cron.string);
                 StringBuffer_append(B, "</every>");
         }
         if (Util_hasServiceStatus(S)) {
@@ -217,6 +258,20 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                         (int)S->inf->priv.directory.uid,
                                         (int)S->inf->priv.directory.gid,
                                         (long long)S->inf->priv.directory.timestamp);
+                                if (S->dirscan && S->inf->priv.directory.tree.files >= 0)
+                                        StringBuffer_append(B,
+                                                "<tree>"
+                                                "<size>%lld</size>"
+                                                "<files>%lld</files>"
+                                                "<directories>%lld</directories>"
+                                                "<oldest>%lld</oldest>"
+                                                "<newest>%lld</newest>"
+                                                "</tree>",
+                                                S->inf->priv.directory.tree.size,
+                                                S->inf->priv.directory.tree.files,
+                                                S->inf->priv.directory.tree.directories,
+                                                (long long)S->inf->priv.directory.tree.oldest,
+                                                (long long)S->inf->priv.directory.tree.newest);
                                 break;
 
                         case Service_Fifo:
@@ -260,6 +315,71 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                                 S->inf->priv.filesystem.inode_total,
                                                 S->inf->priv.filesystem.f_files);
                                 }
+                                if (S->inf->priv.filesystem.io.utilization >= 0.) {
+                                        StringBuffer_append(B,
+                                                "<io>"
+                                                "<read><bytes>%.1f</bytes><operations>%.1f</operations></read>"
+                                                "<write><bytes>%.1f</bytes><operations>%.1f</operations></write>"
+                                                "<servicetime>%.3f</servicetime>"
+                                                "<utilization>%.1f</utilization>"
+                                                "</io>",
+                                                S->inf->priv.filesystem.io.read_bytes,
+                                                S->inf->priv.filesystem.io.read_operations,
+                                                S->inf->priv.filesystem.io.write_bytes,
+                                                S->inf->priv.filesystem.io.write_operations,
+                                                S->inf->priv.filesystem.io.service_time,
+                                                S->inf->priv.filesystem.io.utilization);
+                                }
+                                break;
+
+                        case Service_Socket:
+                                StringBuffer_append(B,
+                                        "<socket>"
+                                        "<connections>%d</connections>"
+                                        "<established>%d</established>"
+                                        "<timewait>%d</timewait>"
+                                        "<closewait>%d</closewait>"
+                                        "<listen>%d</listen>"
+                                        "<queue>%d</queue>"
+                                        "<backlog>%d</backlog>"
+                                        "<drops>%lld</drops>"
+                                        "</socket>",
+                                        S->inf->priv.socket.connections,
+                                        S->inf->priv.socket.established,
+                                        S->inf->priv.socket.timewait,
+                                        S->inf->priv.socket.closewait,
+                                        S->inf->priv.socket.listen,
+                                        S->inf->priv.socket.queue,
+                                        S->inf->priv.socket.backlog,
+                                        S->inf->priv.socket.drops);
+                                break;
+
+                        case Service_Metric:
+                                StringBuffer_append(B,
+                                        "<metric>"
+                                        "<type>%s</type>"
+                                        "<value>%.17g</value>"
+                                        "<rate>%.17g</rate>"
+                                        "<max>%.17g</max>"
+                                        "<samples>%llu</samples>"
+                                        "</metric>",
+                                        metrictypenames[S->inf->priv.metric.type],
+                                        S->inf->priv.metric.value,
+                                        S->inf->priv.metric.rate,
+                                        S->inf->priv.metric.max,
+                                        S->inf->priv.metric.samples);
+                                break;
+
+                        case Service_Heartbeat:
+                                StringBuffer_append(B,
+                                        "<heartbeat>"
+                                        "<timestamp>%lld</timestamp>"
+                                        "<age>%lld</age>"
+                                        "<count>%llu</count>"
+                                        "</heartbeat>",
+                                        (long long)S->inf->priv.heartbeat.timestamp,
+                                        S->inf->priv.heartbeat.age,
+                                        S->inf->priv.heartbeat.count);
                                 break;
 
                         case Service_Net:
@@ -406,6 +526,9 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                             "<system>%.1f</system>"
 #ifdef HAVE_CPU_WAIT
                                             "<wait>%.1f</wait>"
+#endif
+#ifdef HAVE_CPU_STEAL
+                                            "<steal>%.1f</steal>"
 #endif
                                             "</cpu>"
                                             "<memory>"
@@ -415,8 +538,7 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                             "<swap>"
                                             "<percent>%.1f</percent>"
                                             "<kilobyte>%llu</kilobyte>"
-                                            "</swap>"
-                                            "</system>",
+                                            "</swap>",
                                             systeminfo.loadavg[0],
                                             systeminfo.loadavg[1],
                                             systeminfo.loadavg[2],
@@ -424,30 +546,85 @@ static void status_service(Service_T S, StringBuffer_T B, int V) {
                                             systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.,
 #ifdef HAVE_CPU_WAIT
                                             systeminfo.total_cpu_wait_percent > 0. ? systeminfo.total_cpu_wait_percent : 0.,
+#endif
+#ifdef HAVE_CPU_STEAL
+                                            systeminfo.total_cpu_steal_percent > 0. ? systeminfo.total_cpu_steal_percent : 0.,
 #endif
                                             systeminfo.total_mem_percent,
                                             (unsigned long long)((double)systeminfo.total_mem / 1024.),               // Send as kB for backward compatibility
                                             systeminfo.total_swap_percent,
                                             (unsigned long long)((double)systeminfo.total_swap / 1024.));             // Send as kB for backward compatibility
+                        if (systeminfo.cpu.count > 0) {
+                                StringBuffer_append(B, "<cpus>");
+                                for (int i = 0; i < systeminfo.cpu.count; i++)
+                                        if (systeminfo.cpu.usage[i] >= 0.)
+                                                StringBuffer_append(B, "<cpu id=\"%d\" node=\"%d\"><usage>%.1f</usage><steal>%.1f</steal></cpu>", i, systeminfo.cpu.node[i], systeminfo.cpu.usage[i], systeminfo.cpu.steal[i]);
+                                StringBuffer_append(B, "</cpus>");
+                        }
+                        if (systeminfo.node.count > 1) {
+                                StringBuffer_append(B, "<nodes>");
+                                for (int i = 0; i < systeminfo.node.count; i++)
+                                        if (systeminfo.node.usage[i] >= 0.)
+                                                StringBuffer_append(B, "<node id=\"%d\"><usage>%.1f</usage></node>", i, systeminfo.node.usage[i]);
+                                StringBuffer_append(B, "</nodes>");
+                        }
+                        for (int i = 0; i <= Pressure_Last; i++) {
+                                Pressure_T *p = &systeminfo.pressure[i];
+                                if (p->some[0] >= 0.)
+                                        StringBuffer_append(B, "<pressure resource=\"%s\"><some>%.2f %.2f %.2f</some><full>%.2f %.2f %.2f</full></pressure>", pressurenames[i],
+                                                            p->some[0], p->some[1], p->some[2], p->full[0] > 0. ? p->full[0] : 0., p->full[1] > 0. ? p->full[1] : 0., p->full[2] > 0. ? p->full[2] : 0.);
+                        }
+                        StringBuffer_append(B, "</system>");
                 }
-                if (S->type == Service_Program && S->program->started) {
+                if (S->type == Service_Program && S->snapshot.program.started) {
                         StringBuffer_append(B,
                                             "<program>"
                                             "<started>%lld</started>"
                                             "<status>%d</status>"
                                             "<output><![CDATA[",
-                                            (long long)S->program->started,
-                                            S->program->exitStatus);
-                        _escapeCDATA(B, StringBuffer_toString(S->program->output));
-                        StringBuffer_append(B,
-                                            "]]></output>"
-                                            "</program>");
+                                            (long long)S->snapshot.program.started,
+                                            S->snapshot.program.exitStatus);
+                        char *output = Snapshot_getOutput(S);
+                        _escapeCDATA(B, output);
+                        FREE(output);
+                        StringBuffer_append(B, "]]></output>");
+                        if (S->snapshot.program.usage.cpuTime >= 0)
+                                StringBuffer_append(B,
+                                                    "<usage>"
+                                                    "<cputime>%lld</cputime>"
+                                                    "<memory>%lld</memory>"
+                                                    "<runtime>%lld</runtime>"
+                                                    "</usage>",
+                                                    S->snapshot.program.usage.cpuTime,
+                                                    S->snapshot.program.usage.memory,
+                                                    S->snapshot.program.usage.runTime);
+                        StringBuffer_append(B, "</program>");
                 }
         }
         StringBuffer_append(B, "</service>");
 }
 
 
+/**
+ * Append the service status fragment to the buffer, render it first if the
+ * service generation changed since the fragment was cached
+ */
+static void _cachedService(Service_T S, StringBuffer_T B, int V) {
+        int i = V == 2 ? 1 : 0;
+        if (! S->status.fragment[i]) {
+                S->status.fragment[i] = StringBuffer_create(512);
+        } else if (S->status.generation[i] == S->generation) {
+                StringBuffer_appendBytes(B, StringBuffer_toString(S->status.fragment[i]), StringBuffer_length(S->status.fragment[i]));
+                return;
+        }
+        S->status.generation[i] = S->generation;
+        StringBuffer_clear(S->status.fragment[i]);
+        struct myservice copy;
+        status_service(Snapshot_get(S, &copy), S->status.fragment[i], V);
+        StringBuffer_appendBytes(B, StringBuffer_toString(S->status.fragment[i]), StringBuffer_length(S->status.fragment[i]));
+}
+
+
 /**
  * Prints a servicegroups into the given buffer.
  * @param SG ServiceGroup object
@@ -505,22 +682,113 @@ static void status_event(Event_T E, StringBuffer_T B) {
  * @param myip The client-side IP address
  */
 void status_xml(StringBuffer_T B, Event_T E, int V, const char *myip) {
-        Service_T S;
-        ServiceGroup_T SG;
+        status_xml_events(B, E ? &E : NULL, E ? 1 : 0, V, myip);
+}
 
+
+/**
+ * Get a XML formated message for the notification of several events: the
+ * general status followed by an event element for each event
+ * @param E The event objects
+ * @param count The number of events
+ * @param V Format version
+ * @param myip The client-side IP address
+ */
+void status_xml_events(StringBuffer_T B, Event_T *E, int count, int V, const char *myip) {
+        int i = V == 2 ? 1 : 0;
         document_head(B, V, myip);
-        if (V == 2)
-                StringBuffer_append(B, "<services>");
-        for (S = servicelist_conf; S; S = S->next_conf)
-                status_service(S, B, V);
-        if (V == 2) {
+        LOCK(mutex)
+        {
+                unsigned long long tag = status_xml_tag(V);
+                if (! cache.services[i] || cache.tag[i] != tag) {
+                        if (! cache.services[i])
+                                cache.services[i] = StringBuffer_create(4096);
+                        StringBuffer_T C = cache.services[i];
+                        StringBuffer_clear(C);
+                        if (V == 2)
+                                StringBuffer_append(C, "<services>");
+                        for (Service_T S = servicelist_conf; S; S = S->next_conf)
+                                _cachedService(S, C, V);
+                        if (V == 2) {
+                                StringBuffer_append(C, "</services><servicegroups>");
+                                for (ServiceGroup_T SG = servicegrouplist; SG; SG = SG->next)
+                                        status_servicegroup(SG, C);
+                                StringBuffer_append(C, "</servicegroups>");
+                        }
+                        cache.tag[i] = tag;
+                }
+                StringBuffer_appendBytes(B, StringBuffer_toString(cache.services[i]), StringBuffer_length(cache.services[i]));
+        }
+        END_LOCK;
+        for (int k = 0; k < count; k++)
+                status_event(E[k], B);
+        document_foot(B);
+}
+
+
+/**
+ * Get a XML formated status message which lists only the services changed
+ * after the given generation. The services element carries the since and
+ * generation attributes so the receiver can tell it from the full status.
+ * @param since List the services changed after this generation
+ * @param V Format version, must be 2
+ * @param myip The client-side IP address
+ * @return The generation the message is current to
+ */
+unsigned long long status_xml_delta(StringBuffer_T B, unsigned long long since, int V, const char *myip) {
+        ASSERT(V == 2);
+        // Read the generation first, a service changed while the message is generated is sent again by the next delta rather than lost
+        unsigned long long generation = __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE);
+        document_head(B, V, myip);
+        LOCK(mutex)
+        {
+                StringBuffer_append(B, "<services since=\"%llu\" generation=\"%llu\">", since, generation);
+                for (Service_T S = servicelist_conf; S; S = S->next_conf) {
+                        // A service which didn't publish a status yet was (re)loaded after the last message
+                        unsigned long long changed = __atomic_load_n(&S->changed, __ATOMIC_ACQUIRE);
+                        if (! changed || changed > since)
+                                _cachedService(S, B, V);
+                }
                 StringBuffer_append(B, "</services><servicegroups>");
-                for (SG = servicegrouplist; SG; SG = SG->next)
+                for (ServiceGroup_T SG = servicegrouplist; SG; SG = SG->next)
                         status_servicegroup(SG, B);
                 StringBuffer_append(B, "</servicegroups>");
         }
-        if (E)
-                status_event(E, B);
+        END_LOCK;
         document_foot(B);
+        return generation;
+}
+
+
+/**
+ * Get the tag of the services status: it changes when the status of some
+ * service may have changed, the services were reloaded or the format differs
+ * @param V Format version
+ * @return The status tag
+ */
+unsigned long long status_xml_tag(int V) {
+        // FNV-1a over the identity and generation of each service
+        unsigned long long tag = 14695981039346656037ULL;
+        tag = (tag ^ (((unsigned long long)cache.epoch << 8) | V)) * 1099511628211ULL;
+        for (Service_T S = servicelist_conf; S; S = S->next_conf) {
+                tag = (tag ^ (uintptr_t)S) * 1099511628211ULL;
+                tag = (tag ^ S->generation) * 1099511628211ULL;
+        }
+        return tag;
+}
+
+
+/**
+ * Drop the cached services section, called when the services are freed
+ */
+void status_xml_reset() {
+        LOCK(mutex)
+        {
+                cache.epoch++;
+                for (int i = 0; i < 2; i++)
+                        if (cache.services[i])
+                                StringBuffer_free(&cache.services[i]);
+        }
+        END_LOCK;
 }
 
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include "monit.h"
+#include "ioprobe.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The probe jobs are queued in FIFO order and run by detached worker
+ * threads without holding the pool mutex. The job and its result buffer
+ * belong to the pool, so the caller may give up on a job which hangs: the
+ * job is then moved to the stuck list and freed by its worker when the
+ * probe returns eventually.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct IoJob_T {
+        IoProbe_T probe;
+        char *path;
+        void *result;
+        size_t size;
+        int rv;
+        int error;                       // errno of the probe
+        boolean_t running;
+        boolean_t done;
+        boolean_t abandoned;             // The caller timed out, the worker frees the job
+        long long started;
+        struct IoJob_T *next;
+} *IoJob_T;
+
+
+static struct {
+        boolean_t stopped;
+        int workers;                     // All workers including the stuck ones
+        int stuck;
+        boolean_t initialized;
+        Sem_T queued;
+        Sem_T done;
+        IoJob_T head;
+        IoJob_T tail;
+        IoJob_T stuckJobs;
+} pool = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _freeJob(IoJob_T *job) {
+        FREE((*job)->path);
+        FREE((*job)->result);
+        FREE(*job);
+}
+
+
+static void _unlinkStuck(IoJob_T job) {
+        for (IoJob_T *j = &pool.stuckJobs; *j; j = &(*j)->next) {
+                if (*j == job) {
+                        *j = job->next;
+                        break;
+                }
+        }
+        job->next = NULL;
+}
+
+
+static void _unlinkQueued(IoJob_T job) {
+        IoJob_T previous = NULL;
+        for (IoJob_T j = pool.head; j; previous = j, j = j->next) {
+                if (j == job) {
+                        if (previous)
+                                previous->next = j->next;
+                        else
+                                pool.head = j->next;
+                        if (pool.tail == j)
+                                pool.tail = previous;
+                        break;
+                }
+        }
+        job->next = NULL;
+}
+
+
+static void *_worker(void *args) {
+        set_signal_block();
+        LOCK(mutex)
+        {
+                // A worker above the configured number (a stuck worker which returned) exits after its job
+                while (! pool.stopped && pool.workers - pool.stuck <= Run.ioProbe.workers) {
+                        IoJob_T job = pool.head;
+                        if (! job) {
+                                Sem_wait(pool.queued, mutex);
+                                continue;
+                        }
+                        if (! (pool.head = job->next))
+                                pool.tail = NULL;
+                        job->next = NULL;
+                        job->running = true;
+                        Mutex_unlock(mutex);
+                        int rv = job->probe(job->path, job->result);
+                        int error = errno;
+                        Mutex_lock(mutex);
+                        if (job->abandoned) {
+                                LogInfo("I/O probe of %s returned after %lld ms, the worker left the quarantine\n", job->path, Time_monotonic() - job->started);
+                                _unlinkStuck(job);
+                                _freeJob(&job);
+                                pool.stuck--;
+                        } else {
+                                job->rv = rv;
+                                job->error = error;
+                                job->done = true;
+                                Sem_broadcast(pool.done);
+                        }
+                }
+                pool.workers--;
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+/* Start the workers up to the configured number of the healthy workers, must be called with the mutex locked */
+static boolean_t _spawn() {
+        if (! pool.initialized) {
+                Sem_init(pool.queued);
+                Sem_init(pool.done);
+                pool.initialized = true;
+        }
+        pool.stopped = false;
+        while (pool.workers - pool.stuck < Run.ioProbe.workers) {
+                if (pool.stuck >= IOPROBE_QUARANTINE)
+                        return pool.workers > pool.stuck;
+                Thread_T thread;
+                Thread_create(thread, _worker, NULL);
+                Thread_detach(thread);
+                pool.workers++;
+        }
+        return true;
+}
+
+
+static int _stat(const char *path, void *result) {
+        return stat(path, result);
+}
+
+
+static int _lstat(const char *path, void *result) {
+        return lstat(path, result);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int IoProbe_run(IoProbe_T probe, const char *path, void *result, size_t size) {
+        ASSERT(probe);
+        ASSERT(path);
+        ASSERT(result);
+        if (Run.ioProbe.timeout <= 0)
+                return probe(path, result);
+        int rv = -1, error = ETIMEDOUT;
+        LOCK(mutex)
+        {
+                IoJob_T job = NULL;
+                // The path whose probe is stuck is not probed again until the probe returns
+                for (IoJob_T j = pool.stuckJobs; j; j = j->next) {
+                        if (IS(j->path, path)) {
+                                DEBUG("I/O probe of %s skipped, the previous probe is stuck for %lld ms\n", path, Time_monotonic() - j->started);
+                                goto done;
+                        }
+                }
+                if (! _spawn()) {
+                        LogError("I/O probe of %s failed -- all I/O workers are stuck\n", path);
+                        error = EAGAIN;
+                        goto done;
+                }
+                NEW(job);
+                job->probe = probe;
+                job->path = Str_dup(path);
+                job->result = CALLOC(1, size);
+                job->size = size;
+                job->started = Time_monotonic();
+                if (pool.tail)
+                        pool.tail->next = job;
+                else
+                        pool.head = job;
+                pool.tail = job;
+                Sem_signal(pool.queued);
+                long long deadline = Time_milli() + Run.ioProbe.timeout * 1000LL;
+                while (! job->done && Time_milli() < deadline) {
+                        struct timespec wait = {.tv_sec = deadline / 1000, .tv_nsec = (deadline % 1000) * 1000000};
+                        Sem_timeWait(pool.done, mutex, wait);
+                }
+                if (job->done) {
+                        memcpy(result, job->result, size);
+                        rv = job->rv;
+                        error = job->error;
+                        _freeJob(&job);
+                } else if (! job->running) {
+                        // All workers are busy, the job didn't start
+                        _unlinkQueued(job);
+                        _freeJob(&job);
+                        LogError("I/O probe of %s timed out after %d s waiting for a worker\n", path, Run.ioProbe.timeout);
+                } else {
+                        job->abandoned = true;
+                        job->next = pool.stuckJobs;
+                        pool.stuckJobs = job;
+                        pool.stuck++;
+                        LogError("I/O probe of %s timed out after %d s, the worker is quarantined\n", path, Run.ioProbe.timeout);
+                }
+done:
+                ;
+        }
+        END_LOCK;
+        errno = error;
+        return rv;
+}
+
+
+int IoProbe_stat(const char *path, struct stat *st) {
+        return IoProbe_run(_stat, path, st, sizeof(struct stat));
+}
+
+
+int IoProbe_lstat(const char *path, struct stat *st) {
+        return IoProbe_run(_lstat, path, st, sizeof(struct stat));
+}
+
+
+int IoProbe_stuck() {
+        int stuck;
+        LOCK(mutex)
+        {
+                stuck = pool.stuck;
+        }
+        END_LOCK;
+        return stuck;
+}
+
+
+void IoProbe_stop() {
+        LOCK(mutex)
+        {
+                if (pool.initialized) {
+                        pool.stopped = true;
+                        Sem_broadcast(pool.queued);
+                }
+        }
+        END_LOCK;
+}
+
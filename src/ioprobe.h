@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_IOPROBE_H
+#define MONIT_IOPROBE_H
+
+
+/**
+ * Timeout bounded filesystem probes. If enabled with "set probe timeout",
+ * the stat(2) and statvfs(2) calls of the file, directory, fifo and
+ * filesystem checks run on a small pool of I/O worker threads and the
+ * check waits for the result at most the timeout. A probe which timed
+ * out, such as on a hung NFS or FUSE mount, fails with ETIMEDOUT and its
+ * worker is quarantined: it is replaced by a new worker and the path is
+ * not probed again until the stuck call returns, so one dead mount can't
+ * freeze the monitoring of the other services. Without the timeout the
+ * probe is called directly.
+ *
+ * @file
+ */
+
+
+#define IOPROBE_WORKERS    2      /**< Default number of the I/O workers */
+#define IOPROBE_QUARANTINE 16     /**< Maximum number of the stuck workers */
+
+
+/**
+ * A filesystem probe, such as a stat(2) wrapper
+ * @param path The path to probe
+ * @param result The result buffer
+ * @return 0 on success, otherwise -1 and errno is set
+ */
+typedef int (*IoProbe_T)(const char *path, void *result);
+
+
+/**
+ * Run the probe on an I/O worker and wait for it at most the probe timeout.
+ * The result is copied to the result buffer on success.
+ * @param probe The probe
+ * @param path The path to probe
+ * @param result The result buffer
+ * @param size The size of the result buffer
+ * @return 0 on success, otherwise -1 and errno is set, ETIMEDOUT if the
+ * probe timed out or the path is quarantined
+ */
+int IoProbe_run(IoProbe_T probe, const char *path, void *result, size_t size);
+
+
+/**
+ * Timeout bounded stat(2), see IoProbe_run()
+ * @param path The path
+ * @param st The stat buffer
+ * @return 0 on success, otherwise -1 and errno is set
+ */
+int IoProbe_stat(const char *path, struct stat *st);
+
+
+/**
+ * Timeout bounded lstat(2), see IoProbe_run()
+ * @param path The path
+ * @param st The stat buffer
+ * @return 0 on success, otherwise -1 and errno is set
+ */
+int IoProbe_lstat(const char *path, struct stat *st);
+
+
+/**
+ * Get the number of the quarantined workers which are stuck in a probe
+ * @return The number of the stuck workers
+ */
+int IoProbe_stuck(void);
+
+
+/**
+ * Stop the idle I/O workers. The stuck workers are left alone, they exit
+ * when their probe returns.
+ */
+void IoProbe_stop(void);
+
+
+#endif
@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#endif
+
+#include "monit.h"
+#include "isolation.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define CPU_LIMIT 1024
+
+
+#if defined HAVE_SCHED_SETAFFINITY && defined SCHED_IDLE && defined __NR_ioprio_set && defined __NR_ioprio_get
+
+
+/* See ioprio_set(2), glibc has no wrapper */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+
+
+/* The settings monit was started with, restored when the setting is removed by a reload */
+static struct {
+        boolean_t saved;
+        boolean_t affinitySet;
+        boolean_t policySet;
+        boolean_t ioPrioritySet;
+        int policy;
+        int ioPriority;
+        struct sched_param param;
+        cpu_set_t affinity;
+        char *cgroup;           // The cgroup monit was moved into
+} _isolation = {};
+
+
+#endif
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static boolean_t _parseCpuList(const char *list, unsigned char mask[CPU_LIMIT / 8]) {
+        if (! list)
+                return false;
+        const char *p = list;
+        while (true) {
+                char *end;
+                if (! isdigit((unsigned char)*p))
+                        return false;
+                long first = strtol(p, &end, 10);
+                long last = first;
+                p = end;
+                if (*p == '-') {
+                        if (! isdigit((unsigned char)*++p))
+                                return false;
+                        last = strtol(p, &end, 10);
+                        p = end;
+                }
+                if (first > last || last >= CPU_LIMIT)
+                        return false;
+                if (mask)
+                        for (long cpu = first; cpu <= last; cpu++)
+                                mask[cpu / 8] |= 1 << (cpu % 8);
+                if (*p == 0)
+                        return true;
+                if (*p++ != ',')
+                        return false;
+        }
+}
+
+
+#if defined HAVE_SCHED_SETAFFINITY && defined SCHED_IDLE && defined __NR_ioprio_set && defined __NR_ioprio_get
+
+
+static int _setAffinity(pid_t tid, const void *data) {
+        return sched_setaffinity(tid, sizeof(cpu_set_t), data);
+}
+
+
+static int _setPolicy(pid_t tid, const void *data) {
+        int policy = *(const int *)data;
+        // The normal policies require the static priority 0, the original policy is restored with its priority
+        struct sched_param param = policy == _isolation.policy ? _isolation.param : (struct sched_param){.sched_priority = 0};
+        return sched_setscheduler(tid, policy, &param);
+}
+
+
+static int _setIoPriority(pid_t tid, const void *data) {
+        return (int)syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, tid, *(const int *)data);
+}
+
+
+/**
+ * Apply the setting to all threads of the daemon. The CPU affinity and the scheduling class are per thread attributes on Linux
+ * @return true on success, otherwise false
+ */
+static boolean_t _forEachThread(int (*apply)(pid_t tid, const void *data), const void *data, const char *setting) {
+        DIR *dir = opendir("/proc/self/task");
+        if (! dir) {
+                LogError("Cannot set the daemon %s -- cannot read /proc/self/task: %s\n", setting, STRERROR);
+                return false;
+        }
+        boolean_t rv = true;
+        struct dirent *d;
+        while ((d = readdir(dir))) {
+                if (*d->d_name == '.')
+                        continue;
+                pid_t tid = (pid_t)strtol(d->d_name, NULL, 10);
+                // The thread may have exited meanwhile
+                if (apply(tid, data) != 0 && errno != ESRCH) {
+                        LogError("Cannot set the daemon %s -- %s\n", setting, STRERROR);
+                        rv = false;
+                        break;
+                }
+        }
+        closedir(dir);
+        return rv;
+}
+
+
+static void _applyAffinity() {
+        if (Run.isolation.affinity) {
+                unsigned char mask[CPU_LIMIT / 8] = {};
+                _parseCpuList(Run.isolation.affinity, mask);
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for (int cpu = 0; cpu < CPU_LIMIT && cpu < CPU_SETSIZE; cpu++)
+                        if (mask[cpu / 8] & (1 << (cpu % 8)))
+                                CPU_SET(cpu, &set);
+                if (_forEachThread(_setAffinity, &set, "CPU affinity")) {
+                        LogInfo("Monit daemon CPU affinity set to %s\n", Run.isolation.affinity);
+                        _isolation.affinitySet = true;
+                }
+        } else if (_isolation.affinitySet) {
+                if (_forEachThread(_setAffinity, &_isolation.affinity, "CPU affinity")) {
+                        LogInfo("Monit daemon CPU affinity reset\n");
+                        _isolation.affinitySet = false;
+                }
+        }
+}
+
+
+static void _applyPolicy() {
+        if (Run.isolation.policy != SchedulingPolicy_Default) {
+                int policy = Run.isolation.policy == SchedulingPolicy_Idle ? SCHED_IDLE : Run.isolation.policy == SchedulingPolicy_Batch ? SCHED_BATCH : SCHED_OTHER;
+                if (_forEachThread(_setPolicy, &policy, "scheduling policy")) {
+                        LogInfo("Monit daemon scheduling policy set to %s\n", policy == SCHED_IDLE ? "idle" : policy == SCHED_BATCH ? "batch" : "normal");
+                        _isolation.policySet = true;
+                }
+        } else if (_isolation.policySet) {
+                if (_forEachThread(_setPolicy, &_isolation.policy, "scheduling policy")) {
+                        LogInfo("Monit daemon scheduling policy reset\n");
+                        _isolation.policySet = false;
+                }
+        }
+}
+
+
+static void _applyIoPriority() {
+        if (Run.isolation.ioClass != IoPriority_Default) {
+                int priority = Run.isolation.ioClass == IoPriority_Idle ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT : (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | Run.isolation.ioLevel;
+                if (_forEachThread(_setIoPriority, &priority, "I/O priority")) {
+                        if (Run.isolation.ioClass == IoPriority_Idle)
+                                LogInfo("Monit daemon I/O priority set to idle\n");
+                        else
+                                LogInfo("Monit daemon I/O priority set to best-effort level %d\n", Run.isolation.ioLevel);
+                        _isolation.ioPrioritySet = true;
+                }
+        } else if (_isolation.ioPrioritySet) {
+                if (_forEachThread(_setIoPriority, &_isolation.ioPriority, "I/O priority")) {
+                        LogInfo("Monit daemon I/O priority reset\n");
+                        _isolation.ioPrioritySet = false;
+                }
+        }
+}
+
+
+static void _applyCgroup() {
+        if (! Run.isolation.cgroup) {
+                if (_isolation.cgroup)
+                        LogInfo("Monit daemon stays in the cgroup %s\n", _isolation.cgroup);
+                return;
+        }
+        if (IS(Run.isolation.cgroup, _isolation.cgroup))
+                return;
+        // Writing the pid to cgroup.procs moves all threads of the process, both in cgroup v1 and v2
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/cgroup.procs", Run.isolation.cgroup);
+        FILE *f = fopen(path, "w");
+        if (! f) {
+                LogError("Cannot move the daemon to the cgroup %s -- %s\n", Run.isolation.cgroup, STRERROR);
+                return;
+        }
+        fprintf(f, "%d\n", (int)getpid());
+        // The write is checked by the kernel when the buffer is flushed
+        if (fclose(f) != 0) {
+                LogError("Cannot move the daemon to the cgroup %s -- %s\n", Run.isolation.cgroup, STRERROR);
+                return;
+        }
+        LogInfo("Monit daemon moved to the cgroup %s\n", Run.isolation.cgroup);
+        FREE(_isolation.cgroup);
+        _isolation.cgroup = Str_dup(Run.isolation.cgroup);
+}
+
+
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Isolation_isCpuList(const char *list) {
+        return _parseCpuList(list, NULL);
+}
+
+
+#if defined HAVE_SCHED_SETAFFINITY && defined SCHED_IDLE && defined __NR_ioprio_set && defined __NR_ioprio_get
+
+
+void Isolation_apply() {
+        if (! _isolation.saved) {
+                if (sched_getaffinity(0, sizeof(cpu_set_t), &_isolation.affinity) != 0) {
+                        CPU_ZERO(&_isolation.affinity);
+                        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                                CPU_SET(cpu, &_isolation.affinity);
+                }
+                if ((_isolation.policy = sched_getscheduler(0)) < 0 || sched_getparam(0, &_isolation.param) != 0) {
+                        _isolation.policy = SCHED_OTHER;
+                        _isolation.param.sched_priority = 0;
+                }
+                if ((_isolation.ioPriority = (int)syscall(__NR_ioprio_get, IOPRIO_WHO_PROCESS, 0)) < 0)
+                        _isolation.ioPriority = 0;
+                _isolation.saved = true;
+        }
+        _applyCgroup();
+        _applyAffinity();
+        _applyPolicy();
+        _applyIoPriority();
+}
+
+
+#else
+
+
+void Isolation_apply() {
+        if (Run.isolation.affinity || Run.isolation.policy != SchedulingPolicy_Default || Run.isolation.ioClass != IoPriority_Default || Run.isolation.cgroup)
+                LogWarning("The daemon affinity, priority, ioprio and cgroup settings are not supported on this system\n");
+}
+
+
+#endif
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_ISOLATION_H
+#define MONIT_ISOLATION_H
+
+
+/**
+ * Confinement of the monit daemon, so the monitoring overhead doesn't
+ * interfere with the monitored workload: the CPU affinity, the CPU and I/O
+ * scheduling class of all daemon threads and the cgroup of the daemon, set
+ * with the "set daemon affinity|priority|ioprio|cgroup" statements. The
+ * threads started later inherit the settings from the thread which created
+ * them. The settings are supported on Linux only, on other systems a
+ * warning is logged.
+ *
+ * @file
+ */
+
+
+/**
+ * Check the syntax of a CPU list such as "0-3,8"
+ * @param list The CPU list
+ * @return true if the list is valid, otherwise false
+ */
+boolean_t Isolation_isCpuList(const char *list);
+
+
+/**
+ * Apply the Run.isolation settings to all threads of the daemon. The settings
+ * removed by a reload are reset to the state monit was started with, except
+ * for the cgroup, which monit can't leave.
+ */
+void Isolation_apply(void);
+
+
+#endif
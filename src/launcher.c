@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_PWD_H
+#include <pwd.h>
+#endif
+
+#ifdef HAVE_GRP_H
+#include <grp.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#include "monit.h"
+#include "launcher.h"
+
+// libmonit
+#include "system/System.h"
+
+
+/**
+ *  Program launcher. The request is a fixed header followed by the
+ *  arguments and the environment as NUL terminated strings, the reply is
+ *  the Launcher_Error bitmap.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct LauncherRequest_T {
+        int uid;
+        int gid;
+        int daemon;
+        int argc;
+        int envc;
+        int length;                             /**< Length of the strings */
+} LauncherRequest_T;
+
+
+/* The launcher socket of the daemon and the pid of the helper, -1 if not running */
+static struct {
+        int socket;
+        pid_t pid;
+        Mutex_T mutex;
+} launcher = {.socket = -1, .pid = -1, .mutex = PTHREAD_MUTEX_INITIALIZER};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/* Fork twice, so the program is not a child of the caller and init reaps it. Returns the exit status of the first child */
+static int _start(char **argv, char **envp, int uid, int gid, boolean_t daemon) {
+        sigset_t mask, save;
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        pthread_sigmask(SIG_BLOCK, &mask, &save);
+        int status = 0;
+        pid_t pid = fork();
+        if (pid < 0) {
+                pthread_sigmask(SIG_SETMASK, &save, NULL);
+                return Launcher_Fork;
+        } else if (pid == 0) {
+                if (gid >= 0 && setgid(gid) != 0)
+                        status |= Launcher_Setgid;
+                if (uid >= 0) {
+                        struct passwd *user = getpwuid(uid);
+                        if (user) {
+                                if (initgroups(user->pw_name, getgid()) == 0) {
+                                        if (setuid(uid) != 0)
+                                                status |= Launcher_Setuid;
+                                } else {
+                                        status |= Launcher_Initgroups;
+                                }
+                        } else {
+                                status |= Launcher_Getpwuid;
+                        }
+                }
+                if (! daemon) {
+                        for (int i = 0; i < 3; i++)
+                                if (close(i) == -1 || open("/dev/null", O_RDWR) != i)
+                                        status |= Launcher_Redirect;
+                }
+                System_closeDescriptors(3);
+                setsid();
+                pid = fork();
+                if (pid < 0) {
+                        status |= Launcher_Fork;
+                        _exit(status);
+                } else if (pid == 0) {
+                        // Reset all signals, so the spawned process is *not* created with any inherited SIG_BLOCKs
+                        sigemptyset(&mask);
+                        pthread_sigmask(SIG_SETMASK, &mask, NULL);
+                        signal(SIGINT, SIG_DFL);
+                        signal(SIGHUP, SIG_DFL);
+                        signal(SIGTERM, SIG_DFL);
+                        signal(SIGUSR1, SIG_DFL);
+                        signal(SIGPIPE, SIG_DFL);
+                        (void)execve(argv[0], argv, envp);
+                        _exit(errno);
+                }
+                // Exit the first child and return the errors to the parent
+                _exit(status);
+        }
+        if (waitpid(pid, &status, 0) != pid)
+                status = 0;
+        pthread_sigmask(SIG_SETMASK, &save, NULL);
+        return WEXITSTATUS(status);
+}
+
+
+static boolean_t _read(int fd, void *buf, size_t length) {
+        for (size_t n = 0; n < length;) {
+                ssize_t r = read(fd, (char *)buf + n, length - n);
+                if (r > 0)
+                        n += r;
+                else if (r == 0 || errno != EINTR)
+                        return false;
+        }
+        return true;
+}
+
+
+static boolean_t _write(int fd, const void *buf, size_t length) {
+        for (size_t n = 0; n < length;) {
+                ssize_t w = send(fd, (const char *)buf + n, length - n, MSG_NOSIGNAL);
+                if (w > 0)
+                        n += w;
+                else if (w < 0 && errno != EINTR)
+                        return false;
+        }
+        return true;
+}
+
+
+/* Split the NUL terminated strings to the vector, returns the position after the last string */
+static char *_split(char *data, char *end, char **vector, int count) {
+        for (int i = 0; i < count; i++) {
+                char *s = memchr(data, 0, end - data);
+                if (! s)
+                        return NULL;
+                vector[i] = data;
+                data = s + 1;
+        }
+        vector[count] = NULL;
+        return data;
+}
+
+
+/* The helper process: start the programs until the daemon closes the socket */
+static void _serve(int fd) {
+        signal(SIGTERM, SIG_IGN);
+        signal(SIGINT, SIG_IGN);
+        signal(SIGHUP, SIG_IGN);
+        signal(SIGUSR1, SIG_IGN);
+        while (true) {
+                LauncherRequest_T request;
+                if (! _read(fd, &request, sizeof(request)) || request.argc < 1 || request.envc < 0 || request.length < 1)
+                        _exit(0);
+                char *data = malloc(request.length);
+                char **argv = malloc((request.argc + 1) * sizeof(char *));
+                char **envp = malloc((request.envc + 1) * sizeof(char *));
+                if (! data || ! argv || ! envp || ! _read(fd, data, request.length))
+                        _exit(1);
+                char *end = data + request.length;
+                char *next = _split(data, end, argv, request.argc);
+                if (! next || ! _split(next, end, envp, request.envc))
+                        _exit(1);
+                // The first child closes the socket before the program is started, see _start()
+                int status = _start(argv, envp, request.uid, request.gid, request.daemon);
+                free(envp);
+                free(argv);
+                free(data);
+                if (! _write(fd, &status, sizeof(status)))
+                        _exit(0);
+        }
+}
+
+
+static int _count(char **vector, int *length) {
+        int count = 0;
+        for (; vector[count]; count++)
+                *length += strlen(vector[count]) + 1;
+        return count;
+}
+
+
+/* Send the request to the helper, returns false if it is not available */
+static boolean_t _send(char **argv, char **envp, int uid, int gid, int *status) {
+        LauncherRequest_T request = {.uid = uid, .gid = gid, .daemon = (Run.flags & Run_Daemon) ? 1 : 0};
+        request.argc = _count(argv, &request.length);
+        request.envc = _count(envp, &request.length);
+        char *data = CALLOC(1, request.length);
+        char *p = data;
+        for (char **v = argv; *v; v++)
+                p = stpcpy(p, *v) + 1;
+        for (char **v = envp; *v; v++)
+                p = stpcpy(p, *v) + 1;
+        boolean_t rv = _write(launcher.socket, &request, sizeof(request)) && _write(launcher.socket, data, request.length) && _read(launcher.socket, status, sizeof(*status));
+        FREE(data);
+        return rv;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Launcher_init(void) {
+        if (! (Run.flags & Run_Launcher) || launcher.pid > 0)
+                return;
+        int fd[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0) {
+                LogError("Cannot create the program launcher socket -- %s\n", STRERROR);
+                return;
+        }
+        pid_t pid = fork();
+        if (pid < 0) {
+                LogError("Cannot start the program launcher -- %s\n", STRERROR);
+                close(fd[0]);
+                close(fd[1]);
+        } else if (pid == 0) {
+                close(fd[0]);
+                if (fd[1] != 3) {
+                        dup2(fd[1], 3);
+                        close(fd[1]);
+                }
+                System_closeDescriptors(4);
+                _serve(3);
+        } else {
+                close(fd[1]);
+                fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+                launcher.socket = fd[0];
+                launcher.pid = pid;
+                DEBUG("Program launcher started with pid %d\n", pid);
+        }
+}
+
+
+int Launcher_execute(char **argv, char **envp, int uid, int gid) {
+        ASSERT(argv && argv[0]);
+        ASSERT(envp);
+        int status = 0;
+        boolean_t sent = false;
+        LOCK(launcher.mutex)
+        {
+                if (launcher.socket >= 0) {
+                        errno = 0;
+                        if (! (sent = _send(argv, envp, uid, gid, &status))) {
+                                LogError("Program launcher stopped -- %s, the programs are started by Monit\n", errno ? STRERROR : "connection closed");
+                                close(launcher.socket);
+                                launcher.socket = -1;
+                                waitpid(launcher.pid, NULL, WNOHANG);
+                                launcher.pid = -1;
+                        }
+                }
+        }
+        END_LOCK;
+        return sent ? status : _start(argv, envp, uid, gid, Run.flags & Run_Daemon);
+}
+
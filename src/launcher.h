@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_LAUNCHER_H
+#define MONIT_LAUNCHER_H
+
+
+/**
+ * Program launcher of the exec action. The program is started detached
+ * from Monit by forking twice, and forking a big Monit process copies its
+ * page tables. With 'set launcher' a small helper process is forked when
+ * the daemon starts, before the threads are started and the service data
+ * are collected, and the programs are started by the helper: the daemon
+ * sends the program arguments, environment and credentials over a socket
+ * pair and the helper replies with the result. If the helper is not
+ * running, the program is started by the daemon itself.
+ *
+ * @file
+ */
+
+
+/* The errors of the program start, see Launcher_execute(). Do not exceed 8 bits here */
+typedef enum {
+        Launcher_Setgid     = 0x1,
+        Launcher_Setuid     = 0x2,
+        Launcher_Initgroups = 0x4,
+        Launcher_Redirect   = 0x8,
+        Launcher_Fork       = 0x10,
+        Launcher_Getpwuid   = 0x20
+} __attribute__((__packed__)) Launcher_Error;
+
+
+/**
+ * Start the launcher helper process if enabled with 'set launcher'. Must
+ * be called before the threads are started.
+ */
+void Launcher_init(void);
+
+
+/**
+ * Start the program detached from Monit, by the launcher helper if it is
+ * running, otherwise by forking the daemon. The call returns once the
+ * program was forked, it doesn't wait for the program.
+ * @param argv The program path and arguments, NULL terminated
+ * @param envp The program environment, NULL terminated
+ * @param uid The user id of the program or -1 to keep the Monit user
+ * @param gid The group id of the program or -1 to keep the Monit group
+ * @return A bitmap of Launcher_Error, 0 if the program was started
+ */
+int Launcher_execute(char **argv, char **envp, int uid, int gid);
+
+
+#endif
+
@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_ARPA_INET_H
+#include <arpa/inet.h>
+#endif
+
+#ifdef HAVE_NET_IF_H
+#include <net/if.h>
+#endif
+
+#if defined HAVE_LINUX_RTNETLINK_H
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#define LINK_EVENTS_NETLINK 1
+#elif defined HAVE_NET_ROUTE_H
+#include <net/route.h>
+#ifdef RTM_IFINFO
+#define LINK_EVENTS_ROUTE 1
+#endif
+#endif
+
+#include "monit.h"
+#include "linkevents.h"
+
+
+/**
+ *  Network link events via the Linux rtnetlink or the BSD routing socket.
+ *
+ *  The notifications are sent for any change of the link attributes, so the
+ *  last known state of each interface is kept and only a change of the
+ *  up/running flags (and of the link state on BSD) marks the services as
+ *  changed. The speed and duplex are not part of the notifications, but the
+ *  driver renegotiates them with a carrier change, which triggers the
+ *  re-check. The network services monitoring the interface of an address
+ *  are re-checked on a state change of any interface.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct LinkWatch_T {
+        Service_T service;
+        boolean_t address;       /**< The service monitors the interface of an address */
+        boolean_t changed;
+} LinkWatch_T;
+
+
+typedef struct LinkState_T {
+        int index;                                       /**< Interface index */
+        int state;                                      /**< Link state flags */
+} LinkState_T;
+
+
+static struct {
+        int fd;
+        int changed;                 /**< Number of changed services not checked yet */
+        int count;
+        LinkWatch_T *watches;                             /**< Sorted by service */
+        int states;
+        LinkState_T *state;            /**< Last known state of the interfaces */
+} _links = {.fd = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+#if defined LINK_EVENTS_NETLINK || defined LINK_EVENTS_ROUTE
+
+
+static int _compareService(const void *a, const void *b) {
+        uintptr_t x = (uintptr_t)((const LinkWatch_T *)a)->service;
+        uintptr_t y = (uintptr_t)((const LinkWatch_T *)b)->service;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+static void _setChanged(LinkWatch_T *w) {
+        if (! __atomic_exchange_n(&w->changed, true, __ATOMIC_RELAXED))
+                __atomic_add_fetch(&_links.changed, 1, __ATOMIC_RELAXED);
+}
+
+
+static boolean_t _isAddress(const char *path) {
+        unsigned char buf[sizeof(struct in6_addr)];
+        return inet_pton(AF_INET, path, buf) == 1 || inet_pton(AF_INET6, path, buf) == 1;
+}
+
+
+/**
+ * Update the state of the given interface and mark the network services of
+ * the interface as changed if the state changed. The state -1 means that the
+ * interface was removed.
+ */
+static boolean_t _update(int index, const char *name, int state) {
+        int i = 0;
+        while (i < _links.states && _links.state[i].index != index)
+                i++;
+        if (i < _links.states) {
+                if (_links.state[i].state == state)
+                        return false;
+                if (state < 0)
+                        _links.state[i] = _links.state[--_links.states];
+                else
+                        _links.state[i].state = state;
+        } else if (state >= 0) {
+                RESIZE(_links.state, (_links.states + 1) * sizeof(LinkState_T));
+                _links.state[_links.states++] = (LinkState_T){.index = index, .state = state};
+        }
+        DEBUG("Link events -- %s %s\n", name ? name : "interface", state < 0 ? "removed" : "state changed");
+        boolean_t changed = false;
+        for (int j = 0; j < _links.count; j++) {
+                LinkWatch_T *w = &_links.watches[j];
+                if (w->address || (name && IS(w->service->path, name))) {
+                        _setChanged(w);
+                        changed = true;
+                }
+        }
+        return changed;
+}
+
+
+/**
+ * Some notifications were lost => forget the interface states and check all network services
+ */
+static void _overflow(void) {
+        DEBUG("Link events -- queue overflow, events lost\n");
+        _links.states = 0;
+        for (int i = 0; i < _links.count; i++)
+                _setChanged(&_links.watches[i]);
+}
+
+
+#ifdef LINK_EVENTS_NETLINK
+
+
+static int _open(void) {
+        int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_ROUTE);
+        if (fd < 0) {
+                LogError("Link events -- cannot create the rtnetlink socket: %s\n", STRERROR);
+                return -1;
+        }
+        struct sockaddr_nl addr = {.nl_family = AF_NETLINK, .nl_groups = RTMGRP_LINK};
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                LogError("Link events -- cannot subscribe to the link notifications: %s\n", STRERROR);
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+
+static boolean_t _read(void) {
+        boolean_t changed = false;
+        char buf[8192] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+        ssize_t len;
+        while ((len = recv(_links.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+                        if (h->nlmsg_type == RTM_NEWLINK || h->nlmsg_type == RTM_DELLINK) {
+                                struct ifinfomsg *ifi = NLMSG_DATA(h);
+                                const char *name = NULL;
+                                int attrlen = IFLA_PAYLOAD(h);
+                                for (struct rtattr *a = IFLA_RTA(ifi); RTA_OK(a, attrlen); a = RTA_NEXT(a, attrlen))
+                                        if (a->rta_type == IFLA_IFNAME)
+                                                name = RTA_DATA(a);
+                                if (_update(ifi->ifi_index, name, h->nlmsg_type == RTM_DELLINK ? -1 : (int)(ifi->ifi_flags & (IFF_UP | IFF_RUNNING))))
+                                        changed = true;
+                        }
+                }
+        }
+        if (len < 0) {
+                if (errno == ENOBUFS) {
+                        _overflow();
+                        changed = true;
+                } else if (errno != EAGAIN && errno != EINTR) {
+                        LogError("Link events -- read failed: %s\n", STRERROR);
+                }
+        }
+        return changed;
+}
+
+
+#else
+
+
+static int _open(void) {
+        int fd = socket(PF_ROUTE, SOCK_RAW, AF_UNSPEC);
+        if (fd < 0) {
+                LogError("Link events -- cannot create the routing socket: %s\n", STRERROR);
+                return -1;
+        }
+        int flags = fcntl(fd, F_GETFL);
+        if (flags == -1 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1 || fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+                LogError("Link events -- cannot set the routing socket flags: %s\n", STRERROR);
+                close(fd);
+                return -1;
+        }
+        return fd;
+}
+
+
+static boolean_t _read(void) {
+        boolean_t changed = false;
+        char buf[8192] __attribute__ ((aligned(__alignof__(struct if_msghdr))));
+        ssize_t len;
+        while ((len = recv(_links.fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                // All routing messages start with the length, version and type fields of if_msghdr
+                for (char *p = buf; p + 4 <= buf + len; ) {
+                        struct if_msghdr *m = (struct if_msghdr *)p;
+                        if (! m->ifm_msglen || p + m->ifm_msglen > buf + len)
+                                break;
+                        if (m->ifm_type == RTM_IFINFO) {
+                                char name[IF_NAMESIZE];
+                                int state = m->ifm_flags & (IFF_UP | IFF_RUNNING);
+#ifdef LINK_STATE_UP
+                                state |= (m->ifm_data.ifi_link_state & 0xff) << 16;
+#endif
+                                if (_update(m->ifm_index, if_indextoname(m->ifm_index, name), state))
+                                        changed = true;
+                        }
+#ifdef RTM_IFANNOUNCE
+                        else if (m->ifm_type == RTM_IFANNOUNCE) {
+                                struct if_announcemsghdr *a = (struct if_announcemsghdr *)p;
+                                if (a->ifan_what == IFAN_DEPARTURE && _update(a->ifan_index, a->ifan_name, -1))
+                                        changed = true;
+                        }
+#endif
+                        p += m->ifm_msglen;
+                }
+        }
+        if (len < 0) {
+                if (errno == ENOBUFS) {
+                        _overflow();
+                        changed = true;
+                } else if (errno != EAGAIN && errno != EINTR) {
+                        LogError("Link events -- read failed: %s\n", STRERROR);
+                }
+        }
+        return changed;
+}
+
+
+#endif
+
+
+static LinkWatch_T *_find(Service_T s) {
+        LinkWatch_T key = {.service = s};
+        return _links.count ? bsearch(&key, _links.watches, _links.count, sizeof(LinkWatch_T), _compareService) : NULL;
+}
+
+
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t LinkEvents_start(void) {
+#if defined LINK_EVENTS_NETLINK || defined LINK_EVENTS_ROUTE
+        if (_links.fd >= 0)
+                return true;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Net)
+                        _links.count++;
+        if (! _links.count)
+                return false;
+        if ((_links.fd = _open()) < 0) {
+                _links.count = 0;
+                return false;
+        }
+        _links.watches = CALLOC(_links.count, sizeof(LinkWatch_T));
+        int i = 0;
+        for (Service_T s = servicelist; s && i < _links.count; s = s->next)
+                if (s->type == Service_Net)
+                        _links.watches[i++] = (LinkWatch_T){.service = s, .address = _isAddress(s->path)};
+        qsort(_links.watches, _links.count, sizeof(LinkWatch_T), _compareService);
+        DEBUG("Link events -- watching %d network services\n", _links.count);
+        return true;
+#else
+        return false;
+#endif
+}
+
+
+void LinkEvents_stop(void) {
+#if defined LINK_EVENTS_NETLINK || defined LINK_EVENTS_ROUTE
+        if (_links.fd >= 0) {
+                close(_links.fd);
+                _links.fd = -1;
+                FREE(_links.watches);
+                FREE(_links.state);
+                _links.count = _links.states = _links.changed = 0;
+                DEBUG("Link events stopped\n");
+        }
+#endif
+}
+
+
+boolean_t LinkEvents_poll(void) {
+#if defined LINK_EVENTS_NETLINK || defined LINK_EVENTS_ROUTE
+        if (_links.fd >= 0)
+                return _read();
+#endif
+        return false;
+}
+
+
+boolean_t LinkEvents_hasChanged(void) {
+        return __atomic_load_n(&_links.changed, __ATOMIC_RELAXED) > 0;
+}
+
+
+boolean_t LinkEvents_isChanged(Service_T s) {
+#if defined LINK_EVENTS_NETLINK || defined LINK_EVENTS_ROUTE
+        if (_links.fd >= 0) {
+                LinkWatch_T *w = _find(s);
+                return w && __atomic_load_n(&w->changed, __ATOMIC_RELAXED);
+        }
+#endif
+        return false;
+}
+
+
+void LinkEvents_checked(Service_T s) {
+#if defined LINK_EVENTS_NETLINK || defined LINK_EVENTS_ROUTE
+        if (_links.fd >= 0) {
+                LinkWatch_T *w = _find(s);
+                if (w && __atomic_exchange_n(&w->changed, false, __ATOMIC_RELAXED))
+                        __atomic_sub_fetch(&_links.changed, 1, __ATOMIC_RELAXED);
+        }
+#endif
+}
+
+
+int LinkEvents_descriptor(void) {
+        return _links.fd;
+}
+
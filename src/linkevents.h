@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_LINKEVENTS_H
+#define MONIT_LINKEVENTS_H
+
+
+/**
+ * Network link event source. The link state changes are received from the
+ * kernel as they happen (rtnetlink RTM_NEWLINK/RTM_DELLINK notifications on
+ * Linux, routing socket RTM_IFINFO/RTM_IFANNOUNCE messages on BSD), so the
+ * network services of the affected interface are re-checked immediately
+ * instead of in the next cycle. The events are enabled automatically if some
+ * network service exists; on other systems the interface is a noop.
+ *
+ * @file
+ */
+
+
+/**
+ * Subscribe to the link notifications if the service list contains some
+ * network service
+ * @return true if the link events are enabled, otherwise false
+ */
+boolean_t LinkEvents_start(void);
+
+
+/**
+ * Unsubscribe from the link notifications
+ */
+void LinkEvents_stop(void);
+
+
+/**
+ * Collect the pending link notifications without waiting
+ * @return true if the state of some link changed, otherwise false
+ */
+boolean_t LinkEvents_poll(void);
+
+
+/**
+ * Test if the link of some network service changed and the service wasn't
+ * checked yet
+ * @return true if some link changed, otherwise false
+ */
+boolean_t LinkEvents_hasChanged(void);
+
+
+/**
+ * Test if the link of the given network service changed and the service
+ * wasn't checked yet
+ * @param s A service
+ * @return true if the link changed, otherwise false
+ */
+boolean_t LinkEvents_isChanged(Service_T s);
+
+
+/**
+ * Note that the link of the given network service was checked. Safe to call
+ * from the check workers.
+ * @param s A service
+ */
+void LinkEvents_checked(Service_T s);
+
+
+/**
+ * Get the descriptor which becomes readable when a link notification arrived,
+ * so the caller can wait for the link events together with other descriptors
+ * @return The descriptor or -1 if the link events are not running
+ */
+int LinkEvents_descriptor(void);
+
+
+#endif
+
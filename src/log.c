@@ -44,6 +44,10 @@
 #include <syslog.h>
 #endif
 
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -52,6 +56,14 @@
 #include <strings.h>
 #endif
 
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -68,10 +80,24 @@
 #include <sys/stat.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
 #include "monit.h"
 
 // libmonit
 #include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 
 
 /**
@@ -79,6 +105,22 @@
  *  with a preceding timestamp. Methods support both syslog or own
  *  logfile.
  *
+ *  In the asynchronous mode the messages are formatted by the caller
+ *  and copied to a ring buffer without locking. The ring is written by
+ *  the log thread, which batches the messages with writev(2). A producer
+ *  reserves the record space by moving the ring head with compare and
+ *  swap, copies the message and commits the record by setting its length.
+ *  The log thread writes the committed records in order and moves the
+ *  tail. If the ring is full the message is dropped and counted. The
+ *  critical messages are logged synchronously, as the program may abort.
+ *
+ *  The structured messages carry key/value fields (service, event, ...)
+ *  which are written by the json and journal log formats and sent to the
+ *  systemd journal as MONIT_<KEY> fields. The journal format is the
+ *  systemd journal export format, the values with a new line are length
+ *  prefixed. The rate limit is kept per message site, which is the format
+ *  string of the log call.
+ *
  *  @file
  */
 
@@ -86,10 +128,76 @@
 /* ------------------------------------------------------------- Definitions */
 
 
+#define LOG_BATCH 64                 /**< Maximum messages written in one batch */
+#define LOG_RINGMIN 4096                         /**< Minimum ring size [B] */
+#define LOG_FIELDS 16                   /**< Maximum fields of a structured message */
+#define LOG_SITES 256                              /**< Rate limit table size */
+#define LOG_JOURNALSOCKET "/run/systemd/journal/socket"
+
+
 static FILE *LOG = NULL;
+static int JOURNAL = -1;
 static Mutex_T log_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 
+/**
+ * The record header is followed by the NUL terminated message and the NUL
+ * terminated keys and values of the fields, ended by an empty key. The records
+ * are 16 bytes aligned and don't wrap, a record which doesn't fit the end of
+ * the ring is preceded by a padding record
+ */
+typedef struct LogRecord_T {
+        uint32_t length;            /**< Record length, 0 until the record is committed */
+        int32_t priority;               /**< Message priority, -1 for the padding */
+        int64_t time;                               /**< Time of the message */
+} LogRecord_T;
+
+
+/**
+ * Cache of the formated timestamp, the time changes once per second
+ */
+typedef struct LogTime_T {
+        time_t time;
+        char text[STRLEN];
+} LogTime_T;
+
+
+static struct {
+        boolean_t running;                /**< true if producers use the ring */
+        boolean_t stopped;
+        boolean_t sleeping;            /**< true while the log thread is idle */
+        int producers;                /**< Number of producers using the ring */
+        unsigned long long head;      /**< Next free ring position (reserved) */
+        unsigned long long tail;      /**< Position of the oldest unwritten record */
+        unsigned long long dropped;       /**< Messages dropped since last report */
+        size_t size;                            /**< Ring size, the power of 2 */
+        char *ring;
+        Thread_T thread;
+        Sem_T wakeup;
+        LogTime_T time;                  /**< Timestamp cache of the log thread */
+} async = {};
+
+
+static Mutex_T async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LogTime_T log_time = {};
+
+
+/**
+ * Rate limit state of a message site, the sites which hash to the same slot
+ * replace each other
+ */
+typedef struct LogSite_T {
+        const char *site;                             /**< Message format string */
+        long long start;                /**< Start of the rate limit interval [s] */
+        int count;                          /**< Messages logged in the interval */
+        int suppressed;                  /**< Messages suppressed in the interval */
+} LogSite_T;
+
+
+static Mutex_T ratelimit_mutex = PTHREAD_MUTEX_INITIALIZER;
+static LogSite_T ratelimit[LOG_SITES] = {};
+
+
 static struct mylogpriority {
         int  priority;
         char *description;
@@ -111,8 +219,13 @@ static struct mylogpriority {
 
 static boolean_t open_log();
 static const char *logPriorityDescription(int p);
-static void log_log(int priority, const char *s, va_list ap);
+static void log_log(int priority, const char **fields, const char *s, va_list ap);
+static void log_write(int priority, const char **fields, const char *s, va_list ap);
 static void log_backtrace();
+static const char *log_timestamp(LogTime_T *cache, time_t time);
+static boolean_t async_log(int priority, const char **fields, const char *s, va_list ap);
+static void *async_writer(void *args);
+static void log_atfork();
 
 
 /* ------------------------------------------------------------------ Public */
@@ -141,7 +254,7 @@ void LogEmergency(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_EMERG, s, ap);
+        log_log(LOG_EMERG, NULL, s, ap);
         va_end(ap);
         log_backtrace();
 }
@@ -155,7 +268,7 @@ void LogAlert(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_ALERT, s, ap);
+        log_log(LOG_ALERT, NULL, s, ap);
         va_end(ap);
         log_backtrace();
 }
@@ -169,7 +282,7 @@ void LogCritical(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_CRIT, s, ap);
+        log_log(LOG_CRIT, NULL, s, ap);
         va_end(ap);
         log_backtrace();
 }
@@ -182,7 +295,7 @@ void vLogAbortHandler(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        log_log(LOG_CRIT, s, ap);
+        log_log(LOG_CRIT, NULL, s, ap);
         va_end(ap_copy);
         if (Run.debug)
                 abort();
@@ -198,7 +311,7 @@ void LogError(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_ERR, s, ap);
+        log_log(LOG_ERR, NULL, s, ap);
         va_end(ap);
         log_backtrace();
 }
@@ -212,7 +325,7 @@ void vLogError(const char *s, va_list ap) {
         ASSERT(s);
         va_list ap_copy;
         va_copy(ap_copy, ap);
-        log_log(LOG_ERR, s, ap);
+        log_log(LOG_ERR, NULL, s, ap);
         va_end(ap_copy);
         log_backtrace();
 }
@@ -226,7 +339,7 @@ void LogWarning(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_WARNING, s, ap);
+        log_log(LOG_WARNING, NULL, s, ap);
         va_end(ap);
 }
 
@@ -239,7 +352,7 @@ void LogNotice(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_NOTICE, s, ap);
+        log_log(LOG_NOTICE, NULL, s, ap);
         va_end(ap);
 }
 
@@ -252,7 +365,7 @@ void LogInfo(const char *s, ...) {
         ASSERT(s);
         va_list ap;
         va_start(ap, s);
-        log_log(LOG_INFO, s, ap);
+        log_log(LOG_INFO, NULL, s, ap);
         va_end(ap);
 }
 
@@ -266,7 +379,85 @@ void LogDebug(const char *s, ...) {
         if (Run.debug) {
                 va_list ap;
                 va_start(ap, s);
-                log_log(LOG_DEBUG, s, ap);
+                log_log(LOG_DEBUG, NULL, s, ap);
+                va_end(ap);
+        }
+}
+
+
+/**
+ * Start the log thread if the asynchronous log is enabled. Must be called
+ * after the daemon was started, the thread doesn't survive fork(2)
+ */
+void log_start() {
+        if (! (Run.flags & Run_Log) || ! (Run.flags & Run_LogAsync) || async.running)
+                return;
+        size_t size = LOG_RINGMIN;
+        while (size < Run.limits.logBuffer)
+                size <<= 1;
+        static boolean_t atfork = false;
+        if (! atfork) {
+                pthread_atfork(NULL, NULL, log_atfork);
+                atfork = true;
+        }
+        async.ring = CALLOC(1, size);
+        async.size = size;
+        async.head = async.tail = async.dropped = 0ULL;
+        async.time.time = 0;
+        async.stopped = false;
+        Sem_init(async.wakeup);
+        Thread_create(async.thread, async_writer, NULL);
+        __atomic_store_n(&async.running, true, __ATOMIC_SEQ_CST);
+        DEBUG("Asynchronous log started with %s buffer\n", Str_bytesToSize(size, (char[10]){}));
+}
+
+
+/**
+ * Stop the log thread, the queued messages are written first
+ */
+void log_stop() {
+        if (! __atomic_load_n(&async.running, __ATOMIC_SEQ_CST))
+                return;
+        // New messages are logged synchronously, wait for the producers which already use the ring
+        __atomic_store_n(&async.running, false, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&async.producers, __ATOMIC_SEQ_CST) > 0)
+                Time_usleep(1000);
+        LOCK(async_mutex)
+        {
+                async.stopped = true;
+                Sem_signal(async.wakeup);
+        }
+        END_LOCK;
+        Thread_join(async.thread);
+        Sem_destroy(async.wakeup);
+        FREE(async.ring);
+        async.size = 0;
+}
+
+
+/**
+ * Get the size of the asynchronous log ring
+ */
+size_t log_memory() {
+        return __atomic_load_n(&async.running, __ATOMIC_SEQ_CST) ? async.size : 0;
+}
+
+
+/**
+ * Log a message with key/value fields. The fields are written by the json
+ * and journal formats and sent to the systemd journal, the text format and
+ * syslog get the message only.
+ * @param priority The message priority (LOG_ERR, LOG_INFO, ...)
+ * @param fields NULL terminated list of keys and values, a NULL value skips
+ * the field
+ * @param s A formated (printf-style) string to log
+ */
+void LogStructured(int priority, const char **fields, const char *s, ...) {
+        ASSERT(s);
+        if (priority < LOG_DEBUG || Run.debug) {
+                va_list ap;
+                va_start(ap, s);
+                log_log(priority, fields, s, ap);
                 va_end(ap);
         }
 }
@@ -276,6 +467,7 @@ void LogDebug(const char *s, ...) {
  * Close the log file or syslog
  */
 void log_close() {
+        log_stop();
         if (Run.flags & Run_UseSyslog) {
                 closelog();
         }
@@ -283,6 +475,10 @@ void log_close() {
                 LogError("Error closing the log file -- %s\n", STRERROR);
         }
         LOG = NULL;
+        if (JOURNAL >= 0) {
+                close(JOURNAL);
+                JOURNAL = -1;
+        }
 }
 
 
@@ -304,8 +500,15 @@ void vsyslog (int facility_priority, const char *format, va_list arglist) {
  * Open a log file or syslog
  */
 static boolean_t open_log() {
+        log_time.time = async.time.time = 0; // The log format may have changed
         if (Run.flags & Run_UseSyslog) {
                 openlog(prog, LOG_PID, Run.facility);
+        } else if (Run.flags & Run_UseJournal) {
+                if ((JOURNAL = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+                        LogError("Error opening the systemd journal socket -- %s\n", STRERROR);
+                        return false;
+                }
+                fcntl(JOURNAL, F_SETFD, FD_CLOEXEC);
         } else {
                 LOG = fopen(Run.files.log, "a+");
                 if (! LOG) {
@@ -338,12 +541,168 @@ static const char *logPriorityDescription(int p) {
 
 
 /**
- * Log a message to monits logfile or syslog.
+ * Log a message bypassing the rate limit
+ */
+static void log_internal(int priority, const char *s, ...) {
+        va_list ap;
+        va_start(ap, s);
+        log_write(priority, NULL, s, ap);
+        va_end(ap);
+}
+
+
+/**
+ * Count the message of the site in the current rate limit interval
+ * @param site The message site (format string)
+ * @param suppressed Set to the number of the messages suppressed in the
+ * previous interval of the site
+ * @return true if the message should be logged
+ */
+static boolean_t log_ratelimit(const char *site, int *suppressed) {
+        boolean_t allowed = true, first = false;
+        long long now = Time_monotonic() / 1000;
+        *suppressed = 0;
+        LOCK(ratelimit_mutex)
+        {
+                LogSite_T *e = &ratelimit[((uintptr_t)site >> 3) % LOG_SITES];
+                if (e->site != site || now - e->start >= Run.logging.rateInterval) {
+                        if (e->site == site)
+                                *suppressed = e->suppressed;
+                        e->site = site;
+                        e->start = now;
+                        e->count = e->suppressed = 0;
+                }
+                if (++e->count > Run.logging.rateLimit) {
+                        allowed = false;
+                        first = ++e->suppressed == 1;
+                }
+        }
+        END_LOCK;
+        if (first)
+                log_internal(LOG_WARNING, "Log rate limit of %d messages per %d seconds reached, suppressing similar messages\n", Run.logging.rateLimit, Run.logging.rateInterval);
+        return allowed;
+}
+
+
+/**
+ * Log a message to monits logfile or syslog, the repeated messages are rate
+ * limited if the rate limit is set
  * @param priority A message priority
+ * @param fields NULL terminated list of keys and values or NULL
  * @param s A formated (printf-style) string to log
  */
-static void log_log(int priority, const char *s, va_list ap) {
+static void log_log(int priority, const char **fields, const char *s, va_list ap) {
         ASSERT(s);
+        if (Run.logging.rateLimit > 0 && priority > LOG_CRIT) {
+                int suppressed;
+                if (! log_ratelimit(s, &suppressed))
+                        return;
+                if (suppressed)
+                        log_internal(priority, "Suppressed %d similar messages in last %d seconds\n", suppressed, Run.logging.rateInterval);
+        }
+        log_write(priority, fields, s, ap);
+}
+
+
+/**
+ * Append the string as JSON string (with the quotes), the trailing new line is removed
+ */
+static void log_jsonString(StringBuffer_T B, const char *s) {
+        const char *end = s + strlen(s);
+        while (end > s && end[-1] == '\n')
+                end--;
+        StringBuffer_appendChar(B, '"');
+        const char *run = s;
+        for (; s < end; s++) {
+                unsigned char c = *s;
+                if (c == '"' || c == '\\' || c < 0x20) {
+                        StringBuffer_appendBytes(B, run, (int)(s - run));
+                        if (c == '"' || c == '\\')
+                                StringBuffer_append(B, "\\%c", c);
+                        else if (c == '\n')
+                                StringBuffer_append(B, "\\n");
+                        else if (c == '\t')
+                                StringBuffer_append(B, "\\t");
+                        else
+                                StringBuffer_append(B, "\\u%04x", c);
+                        run = s + 1;
+                }
+        }
+        StringBuffer_appendBytes(B, run, (int)(s - run));
+        StringBuffer_appendChar(B, '"');
+}
+
+
+/**
+ * Append the journal field. The value with a new line is written as the field
+ * name followed by the 64 bits little endian value length and the value
+ */
+static void log_journalField(StringBuffer_T B, const char *prefix, const char *key, const char *value) {
+        size_t length = strlen(value);
+        while (length && value[length - 1] == '\n')
+                length--;
+        StringBuffer_append(B, "%s", prefix);
+        for (const char *k = key; *k; k++)
+                StringBuffer_appendChar(B, isalnum((unsigned char)*k) ? toupper((unsigned char)*k) : '_');
+        if (memchr(value, '\n', length)) {
+                StringBuffer_appendChar(B, '\n');
+                for (int i = 0; i < 8; i++)
+                        StringBuffer_appendChar(B, (char)((unsigned long long)length >> (8 * i)));
+        } else {
+                StringBuffer_appendChar(B, '=');
+        }
+        StringBuffer_appendBytes(B, value, (int)length);
+        StringBuffer_appendChar(B, '\n');
+}
+
+
+/**
+ * Render the message in the json or journal format. The journal export format
+ * has the realtime timestamp and is ended by an empty line, the systemd journal
+ * socket gets the fields only
+ */
+static void log_render(StringBuffer_T B, LogTime_T *cache, time_t time, int priority, const char *message, const char **fields) {
+        if (Run.flags & Run_UseJournal || Run.logging.format == LogFormat_Journal) {
+                boolean_t export = ! (Run.flags & Run_UseJournal);
+                if (export)
+                        StringBuffer_append(B, "__REALTIME_TIMESTAMP=%lld\n", (long long)time * 1000000LL);
+                StringBuffer_append(B, "PRIORITY=%d\nSYSLOG_IDENTIFIER=%s\n", priority, prog ? prog : "monit");
+                log_journalField(B, "", "message", message);
+                for (int i = 0; fields && fields[i]; i += 2)
+                        if (fields[i + 1])
+                                log_journalField(B, "MONIT_", fields[i], fields[i + 1]);
+                if (export)
+                        StringBuffer_append(B, "\n");
+        } else {
+                StringBuffer_append(B, "{\"time\":\"%s\",\"priority\":\"%s\",\"message\":", log_timestamp(cache, time), logPriorityDescription(priority));
+                log_jsonString(B, message);
+                for (int i = 0; fields && fields[i]; i += 2) {
+                        if (fields[i + 1]) {
+                                StringBuffer_append(B, ",");
+                                log_jsonString(B, fields[i]);
+                                StringBuffer_append(B, ":");
+                                log_jsonString(B, fields[i + 1]);
+                        }
+                }
+                StringBuffer_append(B, "}\n");
+        }
+}
+
+
+static void log_journalSend(StringBuffer_T B) {
+        struct sockaddr_un address = {.sun_family = AF_UNIX};
+        snprintf(address.sun_path, sizeof(address.sun_path), "%s", LOG_JOURNALSOCKET);
+        if (sendto(JOURNAL, StringBuffer_toString(B), StringBuffer_length(B), 0, (struct sockaddr *)&address, sizeof(address)) < 0)
+                ; // The journal isn't running, nobody to report to
+}
+
+
+/**
+ * Write the message to the console and the log
+ */
+static void log_write(int priority, const char **fields, const char *s, va_list ap) {
+        if (priority > LOG_CRIT && async_log(priority, fields, s, ap))
+                return;
 #ifdef HAVE_VA_COPY
         va_list ap_copy;
 #endif
@@ -368,9 +727,25 @@ static void log_log(int priority, const char *s, va_list ap) {
 #else
                                 vsyslog(priority, s, ap);
 #endif
+                        } else if (JOURNAL >= 0 || (LOG && Run.logging.format != LogFormat_Text)) {
+                                char *message;
+#ifdef HAVE_VA_COPY
+                                va_copy(ap_copy, ap);
+                                message = Str_vcat(s, ap_copy);
+                                va_end(ap_copy);
+#else
+                                message = Str_vcat(s, ap);
+#endif
+                                StringBuffer_T B = StringBuffer_create(256);
+                                log_render(B, &log_time, time(NULL), priority, message, fields);
+                                if (JOURNAL >= 0)
+                                        log_journalSend(B);
+                                else
+                                        fwrite(StringBuffer_toString(B), 1, StringBuffer_length(B), LOG);
+                                StringBuffer_free(&B);
+                                FREE(message);
                         } else if (LOG) {
-                                char datetime[STRLEN];
-                                fprintf(LOG, "[%s] %-8s : ", Time_fmt(datetime, sizeof(datetime), TIMEFORMAT, time(NULL)), logPriorityDescription(priority));
+                                fprintf(LOG, "[%s] %-8s : ", log_timestamp(&log_time, time(NULL)), logPriorityDescription(priority));
 #ifdef HAVE_VA_COPY
                                 va_copy(ap_copy, ap);
                                 vfprintf(LOG, s, ap_copy);
@@ -404,3 +779,214 @@ static void log_backtrace() {
 #endif
 }
 
+
+/**
+ * The child process has no log thread, log synchronously
+ */
+static void log_atfork() {
+        async.running = false;
+}
+
+
+/**
+ * Format the timestamp, the cache is updated once per second
+ */
+static const char *log_timestamp(LogTime_T *cache, time_t time) {
+        if (cache->time != time) {
+                Time_fmt(cache->text, sizeof(cache->text), Run.logging.format == LogFormat_Json ? "%Y-%m-%dT%H:%M:%S%z" : TIMEFORMAT, time);
+                cache->time = time;
+        }
+        return cache->text;
+}
+
+
+/**
+ * Copy the message to the ring buffer
+ * @return false if the asynchronous log isn't running, the message should
+ * be logged synchronously
+ */
+static boolean_t async_log(int priority, const char **fields, const char *s, va_list ap) {
+        if (! __atomic_load_n(&async.running, __ATOMIC_ACQUIRE))
+                return false;
+        __atomic_add_fetch(&async.producers, 1, __ATOMIC_SEQ_CST);
+        if (! __atomic_load_n(&async.running, __ATOMIC_SEQ_CST)) {
+                __atomic_sub_fetch(&async.producers, 1, __ATOMIC_SEQ_CST);
+                return false;
+        }
+        char buffer[1024];
+        char *message = buffer;
+        va_list ap_copy;
+        va_copy(ap_copy, ap);
+        int length = vsnprintf(buffer, sizeof(buffer), s, ap_copy);
+        va_end(ap_copy);
+        if (length < 0) {
+                length = 0;
+                *buffer = 0;
+        } else if (length >= (int)sizeof(buffer)) {
+                message = ALLOC(length + 1);
+                va_copy(ap_copy, ap);
+                vsnprintf(message, length + 1, s, ap_copy);
+                va_end(ap_copy);
+        }
+        size_t extra = 1;
+        for (int i = 0; fields && fields[i] && i < 2 * LOG_FIELDS; i += 2)
+                if (fields[i + 1])
+                        extra += strlen(fields[i]) + 1 + strlen(fields[i + 1]) + 1;
+        size_t mask = async.size - 1;
+        unsigned long long need = (sizeof(LogRecord_T) + length + 1 + extra + 15) & ~15ULL;
+        unsigned long long head = __atomic_load_n(&async.head, __ATOMIC_ACQUIRE);
+        unsigned long long pad;
+        boolean_t reserved = false;
+        do {
+                unsigned long long tail = __atomic_load_n(&async.tail, __ATOMIC_ACQUIRE);
+                unsigned long long contiguous = async.size - (head & mask);
+                pad = need > contiguous ? contiguous : 0ULL;
+                if (need > async.size || head + pad + need - tail > async.size)
+                        break;
+                reserved = __atomic_compare_exchange_n(&async.head, &head, head + pad + need, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+        } while (! reserved);
+        if (reserved) {
+                if (pad) {
+                        LogRecord_T *r = (LogRecord_T *)(async.ring + (head & mask));
+                        r->priority = -1;
+                        __atomic_store_n(&r->length, (uint32_t)pad, __ATOMIC_RELEASE);
+                        head += pad;
+                }
+                LogRecord_T *r = (LogRecord_T *)(async.ring + (head & mask));
+                r->priority = priority;
+                r->time = time(NULL);
+                char *data = (char *)(r + 1);
+                memcpy(data, message, length + 1);
+                data += length + 1;
+                for (int i = 0; fields && fields[i] && i < 2 * LOG_FIELDS; i += 2) {
+                        if (fields[i + 1]) {
+                                for (int j = 0; j < 2; j++) {
+                                        size_t n = strlen(fields[i + j]) + 1;
+                                        memcpy(data, fields[i + j], n);
+                                        data += n;
+                                }
+                        }
+                }
+                *data = 0;
+                __atomic_store_n(&r->length, (uint32_t)need, __ATOMIC_SEQ_CST);
+                // The log thread sets the flag before it checks the ring for the last time, so either it sees the record or we see the flag
+                if (__atomic_load_n(&async.sleeping, __ATOMIC_SEQ_CST)) {
+                        LOCK(async_mutex)
+                        {
+                                Sem_signal(async.wakeup);
+                        }
+                        END_LOCK;
+                }
+        } else {
+                __atomic_add_fetch(&async.dropped, 1, __ATOMIC_ACQ_REL);
+        }
+        if (message != buffer)
+                FREE(message);
+        __atomic_sub_fetch(&async.producers, 1, __ATOMIC_SEQ_CST);
+        return true;
+}
+
+
+static boolean_t async_isPending() {
+        if (async.tail == __atomic_load_n(&async.head, __ATOMIC_SEQ_CST))
+                return false;
+        LogRecord_T *r = (LogRecord_T *)(async.ring + (async.tail & (async.size - 1)));
+        return __atomic_load_n(&r->length, __ATOMIC_SEQ_CST) > 0;
+}
+
+
+/**
+ * Write a batch of the committed records and release their space
+ * @return true if some records were written
+ */
+static boolean_t async_flush(StringBuffer_T B) {
+        int files = 0, consoles[2] = {};
+        struct iovec file[2 * LOG_BATCH], console[2][LOG_BATCH];
+        char prefix[LOG_BATCH][STRLEN];
+        size_t mask = async.size - 1;
+        unsigned long long position = async.tail;
+        unsigned long long head = __atomic_load_n(&async.head, __ATOMIC_ACQUIRE);
+        for (int records = 0; position < head && records < LOG_BATCH; records++) {
+                LogRecord_T *r = (LogRecord_T *)(async.ring + (position & mask));
+                uint32_t length = __atomic_load_n(&r->length, __ATOMIC_ACQUIRE);
+                if (! length)
+                        break; // Not committed yet
+                if (r->priority >= 0) {
+                        char *message = (char *)(r + 1);
+                        size_t size = strlen(message);
+                        int stream = r->priority < LOG_INFO ? 0 : 1;
+                        console[stream][consoles[stream]++] = (struct iovec){.iov_base = message, .iov_len = size};
+                        if (Run.flags & Run_UseSyslog) {
+                                syslog(r->priority, "%s", message);
+                        } else if (JOURNAL >= 0 || (LOG && Run.logging.format != LogFormat_Text)) {
+                                const char *fields[2 * LOG_FIELDS + 1];
+                                int n = 0;
+                                for (char *f = message + size + 1; *f && n < 2 * LOG_FIELDS; n++)
+                                        fields[n] = f, f += strlen(f) + 1;
+                                fields[n] = NULL;
+                                log_render(B, &async.time, (time_t)r->time, r->priority, message, fields);
+                                if (JOURNAL >= 0) {
+                                        log_journalSend(B);
+                                        StringBuffer_clear(B);
+                                }
+                        } else if (LOG) {
+                                int n = snprintf(prefix[records], sizeof(prefix[records]), "[%s] %-8s : ", log_timestamp(&async.time, (time_t)r->time), logPriorityDescription(r->priority));
+                                file[files++] = (struct iovec){.iov_base = prefix[records], .iov_len = n};
+                                file[files++] = (struct iovec){.iov_base = message, .iov_len = size};
+                        }
+                }
+                position += length;
+        }
+        if (position == async.tail)
+                return false;
+        if (consoles[0] && writev(STDERR_FILENO, console[0], consoles[0]) < 0)
+                ; // Nobody to report to
+        if (consoles[1] && writev(STDOUT_FILENO, console[1], consoles[1]) < 0)
+                ;
+        if (files && LOG && writev(fileno(LOG), file, files) < 0)
+                ;
+        if (StringBuffer_length(B) && LOG && write(fileno(LOG), StringBuffer_toString(B), StringBuffer_length(B)) < 0)
+                ;
+        StringBuffer_clear(B);
+        // Zero the space, the length of a record is its commit flag
+        unsigned long long start = async.tail & mask, end = position & mask;
+        if (start < end) {
+                memset(async.ring + start, 0, end - start);
+        } else {
+                memset(async.ring + start, 0, async.size - start);
+                memset(async.ring, 0, end);
+        }
+        __atomic_store_n(&async.tail, position, __ATOMIC_RELEASE);
+        return true;
+}
+
+
+static void *async_writer(void *args) {
+        set_signal_block();
+        StringBuffer_T B = StringBuffer_create(4096);
+        while (true) {
+                if (async_flush(B))
+                        continue;
+                unsigned long long dropped = __atomic_exchange_n(&async.dropped, 0ULL, __ATOMIC_ACQ_REL);
+                if (dropped) {
+                        LogWarning("Log buffer is full, %llu messages dropped\n", dropped);
+                        continue;
+                }
+                boolean_t stopped = false;
+                LOCK(async_mutex)
+                {
+                        __atomic_store_n(&async.sleeping, true, __ATOMIC_SEQ_CST);
+                        if (! async.stopped && ! async_isPending()) {
+                                struct timespec wait = {.tv_sec = Time_now() + 1, .tv_nsec = 0};
+                                Sem_timeWait(async.wakeup, async_mutex, wait);
+                        }
+                        __atomic_store_n(&async.sleeping, false, __ATOMIC_SEQ_CST);
+                        stopped = async.stopped && ! async_isPending();
+                }
+                END_LOCK;
+                if (stopped)
+                        break;
+        }
+        StringBuffer_free(&B);
+        return NULL;
+}
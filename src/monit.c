@@ -70,10 +70,42 @@
 #include <sys/wait.h>
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
 #include "monit.h"
 #include "net.h"
 #include "ProcessTree.h"
+#include "ProcessEvents.h"
+#include "ExitAccounting.h"
+#include "Gpu.h"
+#include "PressureEvents.h"
+#include "series.h"
+#include "fileevents.h"
+#include "linkevents.h"
+#include "discovery.h"
+#include "checksumpool.h"
+#include "delivery.h"
+#include "resolver.h"
+#include "alert.h"
+#include "statbatch.h"
+#include "ioprobe.h"
+#include "socktable.h"
+#include "portshare.h"
+#include "heartbeat.h"
+#include "statsd.h"
+#include "federation.h"
+#include "ping.h"
+#include "udpbatch.h"
+#include "isolation.h"
+#include "wakeup.h"
+#include "launcher.h"
+#include "profiler.h"
+#include "counter.h"
 #include "state.h"
+#include "snapshot.h"
+#include "statussegment.h"
 #include "event.h"
 #include "engine.h"
 #include "client.h"
@@ -105,8 +137,11 @@
 static void  do_init();                       /* Initialize this application */
 static void  do_reinit();           /* Re-initialize the runtime application */
 static void  do_action(char **);         /* Dispatch to the submitted action */
+static boolean_t do_client(const char *, char **);  /* Run a client command */
+static boolean_t do_shell();       /* Run client commands over one connection */
 static void  do_exit();                                    /* Finalize monit */
 static void  do_default();                              /* Do default action */
+static void  do_discovery();            /* Apply the changed discovery files */
 static void  handle_options(int, char **);         /* Handle program options */
 static void  help();                 /* Print program help message to stdout */
 static void  version();                         /* Print version information */
@@ -114,7 +149,9 @@ static void *heartbeat(void *args);              /* M/Monit heartbeat thread */
 static RETSIGTYPE do_reload(int);       /* Signalhandler for a daemon reload */
 static RETSIGTYPE do_destroy(int);   /* Signalhandler for monit finalization */
 static RETSIGTYPE do_wakeup(int);  /* Signalhandler for a daemon wakeup call */
+static RETSIGTYPE do_childexit(int);        /* Signalhandler for a child exit */
 static void waitforchildren(void); /* Wait for any child process not running */
+static boolean_t is_listener(Httpd_Flags, int, const char *, const char *); /* Is the httpd setup the same */
 
 
 
@@ -136,11 +173,15 @@ static volatile boolean_t heartbeatRunning = false;
 char *actionnames[] = {"ignore", "alert", "restart", "stop", "exec", "unmonitor", "start", "monitor", ""};
 char *modenames[] = {"active", "passive"};
 char *onrebootnames[] = {"start", "nostart", "laststate"};
-char *checksumnames[] = {"UNKNOWN", "MD5", "SHA1"};
+char *checksumnames[] = {"UNKNOWN", "MD5", "SHA1", "SHA256", "XXH64"};
 char *operatornames[] = {"less than", "less than or equal to", "greater than", "greater than or equal to", "equal to", "not equal to", "changed"};
 char *operatorshortnames[] = {"<", "<=", ">", ">=", "=", "!=", "<>"};
-char *statusnames[] = {"Accessible", "Accessible", "Accessible", "Running", "Online with all services", "Running", "Accessible", "Status ok", "UP"};
-char *servicetypes[] = {"Filesystem", "Directory", "File", "Process", "Remote Host", "System", "Fifo", "Program", "Network"};
+char *pressurenames[] = {"cpu", "memory", "io"};
+char *pressurewindownames[] = {"avg10", "avg60", "avg300"};
+char *statusnames[] = {"Accessible", "Accessible", "Accessible", "Running", "Online with all services", "Running", "Accessible", "Status ok", "UP", "Accessible", "Alive", "Status ok"};
+char *servicetypes[] = {"Filesystem", "Directory", "File", "Process", "Remote Host", "System", "Fifo", "Program", "Network", "Socket", "Heartbeat", "Metric"};
+char *metrictypenames[] = {"unknown", "counter", "gauge", "timer"};
+char *quotatypenames[] = {"user", "group", "project"};
 char *pathnames[] = {"Path", "Path", "Path", "Pid file", "Path", "", "Path"};
 char *icmpnames[] = {"Reply", "", "", "Destination Unreachable", "Source Quench", "Redirect", "", "", "Ping", "", "", "Time Exceeded", "Parameter Problem", "Timestamp Request", "Timestamp Reply", "Information Request", "Information Reply", "Address Mask Request", "Address Mask Reply"};
 char *sslnames[] = {"auto", "v2", "v3", "tlsv1", "tlsv1.1", "tlsv1.2"};
@@ -156,6 +197,7 @@ int main(int argc, char **argv) {
         Bootstrap(); // Bootstrap libmonit
         Bootstrap_setAbortHandler(vLogAbortHandler);  // Abort Monit on exceptions thrown by libmonit
         Bootstrap_setErrorHandler(vLogError);
+        Counter_init(); // Count the allocations per thread
         setlocale(LC_ALL, "C");
         prog = File_basename(argv[0]);
 #ifdef HAVE_OPENSSL
@@ -321,32 +363,59 @@ static void do_reinit() {
                 "Reinitializing Monit - Control file '%s'\n",
                 Run.files.control);
 
-        /* Wait non-blocking for any children that has exited. Since we
-         reinitialize any information about children we have setup to wait
-         for will be lost. This may create zombie processes until Monit
-         itself exit. However, Monit will wait on all children that has exited
-         before it ifself exit. TODO: Later refactored versions will use a
-         globale process table which a sigchld handler can check */
-        waitforchildren();
+        /* The children are not reaped here: the check programs of the reused
+         services keep running and their exit status is collected by the
+         check, the check programs of the released services are killed and
+         waited for by gc_service() and the exec action programs are not our
+         children */
 
         if (Run.mmonits && heartbeatRunning) {
                 Sem_signal(heartbeatCond);
                 Thread_join(heartbeatThread);
                 heartbeatRunning = false;
         }
+        Federation_stop();
+        Heartbeat_stop();
+        Statsd_stop();
+
+        ProcessEvents_stop();
+        ExitAccounting_stop();
+        Gpu_stop();
+        PressureEvents_stop();
+        FileEvents_stop();
+        LinkEvents_stop();
+        ChecksumPool_stop();
+        Delivery_stop();
+        Alert_flush(true);
+        Resolver_stop();
+        Capture_stop();
+        log_stop();
+
+        /* Suspend the http interface, the listener stays open unless its setup changes. The SSL server is
+         restarted, as the cached SSL contexts are dropped below */
+        Httpd_Flags httpdFlags = Run.httpd.flags;
+        int httpdPort = Run.httpd.socket.net.port;
+        char *httpdAddress = Str_dup(Run.httpd.socket.net.address);
+        char *httpdPath = Str_dup(Run.httpd.socket.unix.path);
+        if (httpdFlags & Httpd_Ssl)
+                monit_http(Httpd_Stop);
+        else
+                monit_http(Httpd_Suspend);
 
         Run.flags &= ~Run_DoReload;
 
-        /* Stop http interface */
-        if (Run.httpd.flags & Httpd_Net || Run.httpd.flags & Httpd_Unix)
-                monit_http(Httpd_Stop);
-
-        /* Save the current state (no changes are possible now since the http thread is stopped) */
+        /* Save the current state (no changes are possible now since the http requests are suspended) */
         State_save();
         State_close();
 
-        /* Run the garbage collector */
+        /* Keep the services aside, the unchanged ones are reused, run the garbage collector on the rest */
+        Service_T previous = servicelist;
+        servicelist = servicelist_conf = NULL;
         gc();
+#ifdef HAVE_OPENSSL
+        /* Drop the cached SSL contexts and sessions, the certificates may have changed */
+        Ssl_reset();
+#endif
 
         if (! parse(Run.files.control)) {
                 LogError("%s stopped -- configuration file parsing error\n", prog);
@@ -369,19 +438,49 @@ static void do_reinit() {
         /* Reinitialize Runtime file variables */
         file_init();
 
+        /* Apply the daemon confinement settings to all threads */
+        Isolation_apply();
+
         if (! file_createPidFile(Run.files.pid)) {
                 LogError("%s stopped -- cannot create a pid file\n", prog);
                 exit(1);
         }
 
+        /* The services of the discovery files are added again, the unchanged ones are reused below */
+        Discovery_load();
+
         /* Update service data from the state repository */
         if (! State_open())
                 exit(1);
         State_restore();
 
-        /* Start http interface */
+        /* The services with unchanged configuration keep their runtime data */
+        int reused = Util_reuseServices(previous);
+        LogInfo("Reloaded %d services, %d services unchanged\n", Util_getNumberOfServices() - reused, reused);
+        Snapshot_reset();
+        StatusSegment_open();
+        validate_ramp();
+
+        /* Resume the http interface, restart it if the listener changed */
+        if (! (httpdFlags & Httpd_Ssl)) {
+                monit_http(Httpd_Resume);
+                if (! is_listener(httpdFlags, httpdPort, httpdAddress, httpdPath)) {
+                        monit_http(Httpd_Stop);
+                        if ((httpdFlags & Httpd_Unix) && ! ((Run.httpd.flags & Httpd_Unix) && IS(httpdPath, Run.httpd.socket.unix.path)))
+                                unlink(httpdPath);
+                }
+        }
         if (can_http())
                 monit_http(Httpd_Start);
+        else
+                monit_http(Httpd_Stop);
+        FREE(httpdAddress);
+        FREE(httpdPath);
+
+        Resolver_start();
+        Capture_start();
+        log_start();
+        Delivery_start();
 
         /* send the monit startup notification */
         Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_START, "Monit reloaded");
@@ -390,6 +489,48 @@ static void do_reinit() {
                 Thread_create(heartbeatThread, heartbeat, NULL);
                 heartbeatRunning = true;
         }
+        Federation_start();
+        Heartbeat_start();
+        Statsd_start();
+
+        if (Run.flags & Run_ProcessEvents)
+                ProcessEvents_start();
+
+        if (Run.flags & Run_ExitAccounting)
+                ExitAccounting_start();
+
+        if (Run.gpu.enabled)
+                Gpu_start();
+
+        if (Run.flags & Run_PressureEvents)
+                PressureEvents_start();
+
+        if (Run.flags & Run_FileEvents)
+                FileEvents_start();
+
+        LinkEvents_start();
+
+        ChecksumPool_start();
+
+        /* The time-series are kept if the store setup didn't change */
+        if (Run.seriesEngine.slots)
+                Series_start();
+        else
+                Series_stop();
+}
+
+
+/**
+ * Check whether the http interface listens as before the reload
+ */
+static boolean_t is_listener(Httpd_Flags flags, int port, const char *address, const char *path) {
+        if ((flags ^ Run.httpd.flags) & (Httpd_Net | Httpd_Unix | Httpd_Ssl))
+                return false;
+        if ((flags & Httpd_Net) && (port != Run.httpd.socket.net.port || (address || Run.httpd.socket.net.address ? ! IS(address, Run.httpd.socket.net.address) : false)))
+                return false;
+        if ((flags & Httpd_Unix) && ! IS(path, Run.httpd.socket.unix.path))
+                return false;
+        return true;
 }
 
 
@@ -407,55 +548,18 @@ static void do_action(char **args) {
                    IS(action, "stop")      ||
                    IS(action, "monitor")   ||
                    IS(action, "unmonitor") ||
-                   IS(action, "restart")) {
-                char *service = args[++optind];
-                if (Run.mygroup || service) {
-                        int errors = 0;
-                        List_T services = List_new();
-                        if (Run.mygroup) {
-                                for (ServiceGroup_T sg = servicegrouplist; sg; sg = sg->next) {
-                                        if (IS(Run.mygroup, sg->name)) {
-                                                for (list_t m = sg->members->head; m; m = m->next) {
-                                                        Service_T s = m->e;
-                                                        List_append(services, s->name);
-                                                }
-                                                break;
-                                        }
-                                }
-                                if (List_length(services) == 0) {
-                                        List_free(&services);
-                                        LogError("Group '%s' not found\n", Run.mygroup);
-                                        exit(1);
-                                }
-                        } else if (IS(service, "all")) {
-                                for (Service_T s = servicelist; s; s = s->next)
-                                        List_append(services, s->name);
-                        } else {
-                                List_append(services, service);
-                        }
-                        errors = exist_daemon() ? (HttpClient_action(action, services) ? 0 : 1) : control_service_string(services, action);
-                        List_free(&services);
-                        if (errors)
-                                exit(1);
-                } else {
-                        LogError("Please specify a service name or 'all' after %s\n", action);
+                   IS(action, "restart")   ||
+                   IS(action, "status")    ||
+                   IS(action, "summary")   ||
+                   IS(action, "report")) {
+                if (! do_client(action, args + optind + 1))
+                        exit(1);
+        } else if (IS(action, "shell")) {
+                if (! do_shell())
                         exit(1);
-                }
         } else if (IS(action, "reload")) {
                 LogInfo("Reinitializing %s daemon\n", prog);
                 kill_daemon(SIGHUP);
-        } else if (IS(action, "status")) {
-                char *service = args[++optind];
-                if (! HttpClient_status(Run.mygroup, service))
-                        exit(1);
-        } else if (IS(action, "summary")) {
-                char *service = args[++optind];
-                if (! HttpClient_summary(Run.mygroup, service))
-                        exit(1);
-        } else if (IS(action, "report")) {
-                char *type = args[++optind];
-                if (! HttpClient_report(type))
-                        exit(1);
         } else if (IS(action, "procmatch")) {
                 char *pattern = args[++optind];
                 if (! pattern) {
@@ -463,12 +567,42 @@ static void do_action(char **args) {
                         exit(1);
                 }
                 ProcessTree_testMatch(pattern);
+        } else if (IS(action, "procsnapshot")) {
+                char *mode = args[++optind];
+                char *directory = mode ? args[++optind] : NULL;
+                if (! directory || (! IS(mode, "record") && ! IS(mode, "replay"))) {
+                        printf("Invalid syntax - usage: procsnapshot record|replay <directory> [cycles]\n");
+                        exit(1);
+                }
+                if (IS(mode, "record")) {
+                        ProcessTree_record(directory);
+                } else {
+                        int cycles = args[optind + 1] ? (int)strtol(args[optind + 1], NULL, 10) : 100;
+                        if (cycles <= 0) {
+                                printf("Invalid number of cycles -- %s\n", args[optind + 1]);
+                                exit(1);
+                        }
+                        ProcessTree_replay(directory, cycles);
+                }
+        } else if (IS(action, "procbench")) {
+                int cycles = args[optind + 1] ? (int)strtol(args[optind + 1], NULL, 10) : 10;
+                if (cycles <= 0) {
+                        printf("Invalid number of cycles -- %s\n", args[optind + 1]);
+                        exit(1);
+                }
+                ProcessTree_benchmark(cycles);
+        } else if (IS(action, "servicebench")) {
+                int cycles = args[optind + 1] ? (int)strtol(args[optind + 1], NULL, 10) : 100;
+                if (cycles <= 0) {
+                        printf("Invalid number of cycles -- %s\n", args[optind + 1]);
+                        exit(1);
+                }
+                validate_benchmark(cycles);
         } else if (IS(action, "quit")) {
                 kill_daemon(SIGTERM);
         } else if (IS(action, "validate")) {
                 if (do_wakeupcall()) {
-                        char *service = args[++optind];
-                        HttpClient_status(Run.mygroup, service);
+                        do_client("status", args + optind + 1);
                 } else {
                         _validateOnce();
                 }
@@ -480,6 +614,106 @@ static void do_action(char **args) {
 }
 
 
+/**
+ * Run a client command, the arguments are the NULL terminated list of
+ * words following the command
+ * @return true if succeeded otherwise false
+ */
+static boolean_t do_client(const char *action, char **args) {
+        boolean_t rv = true;
+        List_T services = List_new();
+        if (IS(action, "start")     ||
+            IS(action, "stop")      ||
+            IS(action, "monitor")   ||
+            IS(action, "unmonitor") ||
+            IS(action, "restart")) {
+                if (Run.mygroup) {
+                        ServiceGroup_T sg = Util_getServiceGroup(Run.mygroup);
+                        if (sg) {
+                                for (list_t m = sg->members->head; m; m = m->next) {
+                                        Service_T s = m->e;
+                                        List_append(services, s->name);
+                                }
+                        }
+                        if (List_length(services) == 0) {
+                                LogError("Group '%s' not found\n", Run.mygroup);
+                                rv = false;
+                        }
+                } else if (IS(*args, "all")) {
+                        for (Service_T s = servicelist; s; s = s->next)
+                                List_append(services, s->name);
+                } else {
+                        for (; *args; args++)
+                                List_append(services, *args);
+                        if (List_length(services) == 0) {
+                                LogError("Please specify a service name or 'all' after %s\n", action);
+                                rv = false;
+                        }
+                }
+                if (rv)
+                        rv = exist_daemon() ? HttpClient_action(action, services) : control_service_string(services, action) == 0;
+        } else if (IS(action, "status") || IS(action, "summary")) {
+                // All the named services are queried in one request
+                for (; *args; args++)
+                        List_append(services, *args);
+                List_T list = List_length(services) ? services : NULL;
+                rv = IS(action, "status") ? HttpClient_status(Run.mygroup, list) : HttpClient_summary(Run.mygroup, list);
+        } else if (IS(action, "report")) {
+                char *type = *args;
+                if (IS(type, "events"))
+                        rv = HttpClient_events(args[1]);
+                else if (IS(type, "memory"))
+                        rv = HttpClient_memory();
+                else
+                        rv = IS(type, "metrics") ? HttpClient_metrics() : HttpClient_report(type);
+        } else {
+                LogError("Invalid command -- %s\n", action);
+                rv = false;
+        }
+        List_free(&services);
+        return rv;
+}
+
+
+/**
+ * Read client commands from stdin, one per line, and run them over one
+ * persistent connection to the daemon until end of file or exit
+ * @return true if all commands succeeded otherwise false
+ */
+static boolean_t do_shell() {
+        if (! exist_daemon()) {
+                LogError("The monit daemon is not running\n");
+                return false;
+        }
+        boolean_t rv = true;
+        boolean_t prompt = isatty(STDIN_FILENO) && ! (Run.flags & Run_Batch);
+        char line[STRLEN];
+        char *args[64];
+        HttpClient_open();
+        while (true) {
+                if (prompt) {
+                        printf("monit> ");
+                        fflush(stdout);
+                }
+                if (! fgets(line, sizeof(line), stdin))
+                        break;
+                int count = 0;
+                char *next = NULL;
+                for (char *word = strtok_r(line, " \t\r\n", &next); word && count < 63; word = strtok_r(NULL, " \t\r\n", &next))
+                        args[count++] = word;
+                args[count] = NULL;
+                if (count == 0 || *args[0] == '#')
+                        continue;
+                if (IS(args[0], "exit"))
+                        break;
+                if (! do_client(args[0], args + 1))
+                        rv = false;
+        }
+        HttpClient_close();
+        return rv;
+}
+
+
 /**
  * Finalize monit
  */
@@ -495,12 +729,38 @@ static void do_exit() {
                         Thread_join(heartbeatThread);
                         heartbeatRunning = false;
                 }
+                Federation_stop();
+                Heartbeat_stop();
+                Statsd_stop();
+
+                ProcessEvents_stop();
+                ExitAccounting_stop();
+                Gpu_stop();
+                PressureEvents_stop();
+                FileEvents_stop();
+                LinkEvents_stop();
+                ChecksumPool_stop();
+                StatBatch_stop();
+                IoProbe_stop();
+                SockTable_stop();
+                PortShare_stop();
+                Ping_stop();
+                UdpBatch_stop();
+                Series_stop();
+                Discovery_stop();
+
+                StatusSegment_close();
 
                 LogInfo("Monit daemon with pid [%d] stopped\n", (int)getpid());
 
                 /* send the monit stop notification */
                 Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_STOP, "Monit %s stopped", VERSION);
         }
+        Delivery_stop();
+        Alert_flush(true);
+        Resolver_stop();
+        Capture_stop();
+        log_stop();
         gc();
 #ifdef HAVE_OPENSSL
         Ssl_stop();
@@ -521,7 +781,9 @@ static void do_default() {
 
                 Run.flags &= ~Run_Once;
                 if (can_http()) {
-                        if (Run.httpd.flags & Httpd_Net)
+                        if ((Run.httpd.flags & Httpd_Net) && (Run.httpd.flags & Httpd_Unix))
+                                LogInfo("Starting Monit %s daemon with http interface at [%s]:%d and %s\n", VERSION, Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "*", Run.httpd.socket.net.port, Run.httpd.socket.unix.path);
+                        else if (Run.httpd.flags & Httpd_Net)
                                 LogInfo("Starting Monit %s daemon with http interface at [%s]:%d\n", VERSION, Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "*", Run.httpd.socket.net.port);
                         else if (Run.httpd.flags & Httpd_Unix)
                                 LogInfo("Starting Monit %s daemon with http interface at %s\n", VERSION, Run.httpd.socket.unix.path);
@@ -540,9 +802,26 @@ static void do_default() {
                         exit(1);
                 }
 
+                /* Confine the daemon before the other threads are started, they inherit the settings */
+                Isolation_apply();
+
+                /* Fork the program launcher while the daemon is small and has no threads */
+                Launcher_init();
+
+                /* The signal handlers and the HTTP actions wake up the main loop via the wakeup pipe */
+                Wakeup_init();
+
+                /* The exit status of a check program is collected as soon as it exits */
+                signal(SIGCHLD, do_childexit);
+
+                /* The services of the discovery files are added before their state is restored */
+                Discovery_load();
+
                 if (! State_open())
                         exit(1);
                 State_restore();
+                Snapshot_reset();
+                StatusSegment_open();
 
                 atexit(file_finalize);
 
@@ -550,9 +829,9 @@ static void do_default() {
                         time_t now = Time_now();
                         time_t delay = now + Run.startdelay;
 
-                        /* sleep can be interrupted by signal => make sure we paused long enough */
+                        /* The wait can be interrupted by a wakeup => make sure we paused long enough */
                         while (now < delay) {
-                                sleep((unsigned int)(delay - now));
+                                Wakeup_wait((delay - now) * 1000LL);
                                 if (Run.flags & Run_Stopped)
                                         do_exit();
                                 now = Time_now();
@@ -562,6 +841,11 @@ static void do_default() {
                 if (can_http())
                         monit_http(Httpd_Start);
 
+                Resolver_start();
+                Capture_start();
+                log_start();
+                Delivery_start();
+
                 /* send the monit startup notification */
                 Event_post(Run.system, Event_Instance, State_Changed, Run.system->action_MONIT_START, "Monit %s started", VERSION);
 
@@ -569,18 +853,87 @@ static void do_default() {
                         Thread_create(heartbeatThread, heartbeat, NULL);
                         heartbeatRunning = true;
                 }
+                Federation_start();
+                Heartbeat_start();
+                Statsd_start();
+
+                if (Run.flags & Run_ProcessEvents)
+                        ProcessEvents_start();
+
+                if (Run.flags & Run_ExitAccounting)
+                        ExitAccounting_start();
+
+                if (Run.gpu.enabled)
+                        Gpu_start();
+
+                if (Run.flags & Run_PressureEvents)
+                        PressureEvents_start();
+
+                if (Run.flags & Run_FileEvents)
+                        FileEvents_start();
 
+                /* The network services are re-checked as soon as their link changed */
+                LinkEvents_start();
+
+                ChecksumPool_start();
+
+                if (Run.seriesEngine.slots)
+                        Series_start();
+
+                /* The first checks of the services are spread over the startup ramp */
+                validate_ramp();
+
+                long long planned = 0; // The planned start of the next cycle in the adaptive pacing mode
                 while (true) {
+                        long long start = planned ? planned : Time_milli();
+                        planned = 0;
+                        do_discovery();
                         validate();
+                        long long saved = Profiler_now();
                         State_save();
-
-                        /* In the case that there is no pending action then sleep */
-                        if (! (Run.flags & Run_ActionPending) && ! (Run.flags & Run_Stopped))
-                                sleep(Run.polltime);
+                        Profiler_phase(Phase_StateSave, Profiler_now() - saved);
+
+                        /* In the case that there is no pending action or wakeup request (received while validating) then sleep until the next cycle. The services with own check interval and the services with changed watched path are checked meanwhile as they are due */
+                        long long cycle;
+                        if (Run.flags & Run_PacingAdaptive) {
+                                /* Keep the fixed cadence: the next cycle starts one poll time after the planned start of this cycle, regardless of the cycle duration */
+                                long long now = Time_milli();
+                                cycle = start + Run.polltime * 1000LL;
+                                if (now >= cycle) {
+                                        LogWarning("Monit cycle took %s, which is longer than the poll time of %ds -- starting the next cycle now\n", Str_milliToTime(now - start, (char[23]){}), Run.polltime);
+                                        cycle = now;
+                                } else {
+                                        DEBUG("Monit cycle took %s\n", Str_milliToTime(now - start, (char[23]){}));
+                                }
+                        } else {
+                                cycle = Time_milli() + Run.polltime * 1000LL;
+                        }
+                        while (! (Run.flags & Run_ActionPending) && ! (Run.flags & Run_Stopped) && ! (Run.flags & Run_DoWakeup)) {
+                                long long now = Time_milli();
+                                long long next = validate_next();
+                                if (next && next <= now) {
+                                        validate_scheduled();
+                                        State_save();
+                                        continue;
+                                }
+                                if (now >= cycle) {
+                                        if (Run.flags & Run_PacingAdaptive)
+                                                planned = cycle;
+                                        break;
+                                }
+                                long long wait = (next && next < cycle ? next : cycle) - now;
+                                /* The wait ends on a wakeup (signal or user action) or a path change, the loop will then recalculate the wait time */
+                                Wakeup_wait(wait);
+                        }
 
                         if (Run.flags & Run_DoWakeup) {
                                 Run.flags &= ~Run_DoWakeup;
-                                LogInfo("Awakened by User defined signal 1\n");
+                                if (ProcessEvents_hasExited())
+                                        DEBUG("Awakened by monitored process exit\n");
+                                else if (PressureEvents_isStalled())
+                                        DEBUG("Awakened by pressure stall\n");
+                                else
+                                        LogInfo("Awakened by User defined signal 1\n");
                         }
 
                         if (Run.flags & Run_Stopped)
@@ -594,6 +947,26 @@ static void do_default() {
 }
 
 
+/**
+ * Add and remove the services of the changed discovery files before the
+ * cycle. The http requests are suspended meanwhile. The path and link
+ * watches follow the service list order, so they are restarted.
+ */
+static void do_discovery() {
+        if (! Discovery_scan())
+                return;
+        monit_http(Httpd_Suspend);
+        Discovery_apply();
+        monit_http(Httpd_Resume);
+        if (Run.flags & Run_FileEvents) {
+                FileEvents_stop();
+                FileEvents_start();
+        }
+        LinkEvents_stop();
+        LinkEvents_start();
+}
+
+
 /**
  * Handle program options - Options set from the commandline
  * takes precedence over those found in the control file
@@ -617,6 +990,8 @@ static void handle_options(int argc, char **argv) {
                 {"help",        no_argument,            NULL,   'h'},
                 {"resetid",     no_argument,            NULL,   'r'},
                 {"test",        no_argument,            NULL,   't'},
+                {"profile",     no_argument,            NULL,   'P'},
+                {"wait",        no_argument,            NULL,   'W'},
                 {"verbose",     no_argument,            NULL,   'v'},
                 {"batch",       no_argument,            NULL,   'B'},
                 {"interactive", no_argument,            NULL,   'I'},
@@ -664,6 +1039,8 @@ static void handle_options(int argc, char **argv) {
                                         Run.files.log = Str_dup(optarg);
                                         if (IS(Run.files.log, "syslog"))
                                                 Run.flags |= Run_UseSyslog;
+                                        else if (IS(Run.files.log, "journald"))
+                                                Run.flags |= Run_UseJournal;
                                         Run.flags |= Run_Log;
                                         break;
                                 }
@@ -697,6 +1074,16 @@ static void handle_options(int argc, char **argv) {
                                         deferred_opt = 't';
                                         break;
                                 }
+                                case 'P':
+                                {
+                                        Run.flags |= Run_ParseProfile;
+                                        break;
+                                }
+                                case 'W':
+                                {
+                                        Run.flags |= Run_ActionWait;
+                                        break;
+                                }
                                 case 'v':
                                 {
                                         Run.debug++;
@@ -760,6 +1147,8 @@ static void handle_options(int argc, char **argv) {
                 {
                         do_init(); // Parses control file and initialize program, exit on error
                         printf("Control file syntax OK\n");
+                        if (Run.flags & Run_ParseProfile)
+                                parse_profile();
                         exit(0);
                         break;
                 }
@@ -806,30 +1195,41 @@ static void help() {
                 " --resetid     Reset Monit's unique ID. Use with caution\n"
                 " -B            Batch command line mode (nontabular output with no colors)\n"
                 " -t            Run syntax check for the control file\n"
+                " --profile     With -t, print the parse time of each included file\n"
+                " --wait        Wait for the result of the start, stop, restart, monitor and\n"
+                "               unmonitor actions and print the progress\n"
                 " -v            Verbose mode, work noisy (diagnostic output)\n"
                 " -vv           Very verbose mode, same as -v plus log stacktrace on error\n"
-                " -H [filename] Print SHA1 and MD5 hashes of the file or of stdin if the\n"
+                " -H [filename] Print SHA1, MD5, SHA256 and XXH64 hashes of the file or stdin if the\n"
                 "               filename is omited; monit will exit afterwards\n"
                 " -V            Print version number and patchlevel\n"
                 " -h            Print this text\n"
                 "Optional commands are as follows:\n"
                 " start all                      - Start all services\n"
-                " start <name>                   - Only start the named service\n"
+                " start <name>+                  - Only start the named service(s)\n"
                 " stop all                       - Stop all services\n"
-                " stop <name>                    - Stop the named service\n"
+                " stop <name>+                   - Stop the named service(s)\n"
                 " restart all                    - Stop and start all services\n"
-                " restart <name>                 - Only restart the named service\n"
+                " restart <name>+                - Only restart the named service(s)\n"
                 " monitor all                    - Enable monitoring of all services\n"
-                " monitor <name>                 - Only enable monitoring of the named service\n"
+                " monitor <name>+                - Only enable monitoring of the named service(s)\n"
                 " unmonitor all                  - Disable monitoring of all services\n"
-                " unmonitor <name>               - Only disable monitoring of the named service\n"
+                " unmonitor <name>+              - Only disable monitoring of the named service(s)\n"
                 " reload                         - Reinitialize monit\n"
-                " status [name]                  - Print full status information for service(s)\n"
-                " summary [name]                 - Print short status information for service(s)\n"
+                " status [name]+                 - Print full status information for service(s)\n"
+                " summary [name]+                - Print short status information for service(s)\n"
                 " report [up | down | initialising | unmonitored | total] - Report services state\n"
+                " report metrics                 - Report the poll cycle and service check durations and the work counters\n"
+                " report memory                  - Report the memory used by the Monit subsystems\n"
+                " report events [number]         - Report the recent events, the newest first\n"
                 " quit                           - Kill monit daemon process\n"
                 " validate                       - Check all services and start if not running\n"
+                " shell                          - Read commands from stdin, one connection for all\n"
                 " procmatch <pattern>            - Test process matching pattern\n"
+                " procsnapshot record <dir>      - Record the process table to a snapshot directory\n"
+                " procsnapshot replay <dir> [n]  - Benchmark the process collector with a snapshot\n"
+                " procbench [n]                  - Benchmark the process tree build with 1k, 10k and 100k processes\n"
+                " servicebench [n]               - Benchmark the service list walks of each cycle\n"
                 "\n"
                 "(Action arguments operate on services defined in the control file)\n",
                 prog);
@@ -885,6 +1285,7 @@ static void *heartbeat(void *args) {
  */
 static RETSIGTYPE do_reload(int sig) {
         Run.flags |= Run_DoReload;
+        Wakeup_signal();
 }
 
 
@@ -893,6 +1294,7 @@ static RETSIGTYPE do_reload(int sig) {
  */
 static RETSIGTYPE do_destroy(int sig) {
         Run.flags |= Run_Stopped;
+        Wakeup_signal();
 }
 
 
@@ -901,6 +1303,20 @@ static RETSIGTYPE do_destroy(int sig) {
  */
 static RETSIGTYPE do_wakeup(int sig) {
         Run.flags |= Run_DoWakeup;
+        Wakeup_signal();
+}
+
+
+/**
+ * Signalhandler for a child exit: the main loop collects the exit status of
+ * the check programs, the children are not reaped here as their owners wait
+ * for them
+ */
+static RETSIGTYPE do_childexit(int sig) {
+        int saved = errno;
+        validate_childexit();
+        Wakeup_signal();
+        errno = saved;
 }
 
 
@@ -89,6 +89,10 @@
 #include <sys/socket.h>
 #endif
 
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
 #ifdef HAVE_MACH_BOOLEAN_H
 #include <mach/boolean.h>
 #endif
@@ -124,6 +128,9 @@ typedef enum {
 #include "util/Str.h"
 #include "util/StringBuffer.h"
 #include "system/Link.h"
+#include "system/Cron.h"
+#include "util/PatternSet.h"
+#include "util/Arena.h"
 #include "thread/Thread.h"
 
 
@@ -156,6 +163,9 @@ typedef enum {
 #define START_DELAY        0
 #define EXEC_TIMEOUT       30
 #define PROGRAM_TIMEOUT    300
+#define RESTART_BACKOFF    300  /**< Default restart backoff limit [s] */
+#define STARTUP_RAMP_RESTARTS 1  /**< Default automatic (re)starts per second during the startup ramp */
+#define RESTART_CRASHLOOP  3  /**< Restarts in a row which make a crash loop */
 
 
 //FIXME: refactor Run_Flags to bit field
@@ -173,19 +183,61 @@ typedef enum {
         Run_Stopped              = 0x400,                          /**< Stop Monit */
         Run_DoReload             = 0x800,                        /**< Reload Monit */
         Run_DoWakeup             = 0x1000,                       /**< Wakeup Monit */
-        Run_Batch                = 0x2000                      /**< CLI batch mode */
+        Run_Batch                = 0x2000,                     /**< CLI batch mode */
+        Run_ProcessEvents        = 0x4000,   /**< Process lifecycle events enabled */
+        Run_FileEvents           = 0x8000,         /**< File change events enabled */
+        Run_PacingAdaptive       = 0x10000,   /**< Keep the fixed poll cycle cadence */
+        Run_PacingSpread         = 0x20000, /**< Spread the checks over the poll cycle */
+        Run_ChecksumCache        = 0x40000,   /**< Skip checksum of unchanged files */
+        Run_StatBatch            = 0x80000,    /**< Batch the file stat via io_uring */
+        Run_PingBatch            = 0x100000, /**< Send the ping tests on shared sockets */
+        Run_LogAsync             = 0x200000,         /**< Write the log asynchronously */
+        Run_UseJournal           = 0x400000,              /**< Use the systemd journal */
+        Run_ParseProfile         = 0x800000,   /**< Report the parse time per file */
+        Run_ActionWait           = 0x1000000, /**< The CLI waits for the action result */
+        Run_PressureEvents       = 0x2000000, /**< Pressure stall triggers enabled */
+        Run_ProcessCpuCore       = 0x4000000, /**< Process CPU usage in percent of one core */
+        Run_UdpBatch             = 0x8000000, /**< Send the UDP port tests on shared sockets */
+        Run_LowMemory            = 0x10000000, /**< Smaller default buffers and histograms */
+        Run_Launcher             = 0x20000000, /**< Start the programs by the launcher */
+        Run_ExitAccounting       = 0x40000000  /**< Account the exited processes */
 } __attribute__((__packed__)) Run_Flags;
 
 
+typedef enum {
+        LogFormat_Text = 0,
+        LogFormat_Json,
+        LogFormat_Journal
+} __attribute__((__packed__)) LogFormat_Type;
+
+
+typedef enum {
+        SchedulingPolicy_Default = 0,
+        SchedulingPolicy_Normal,
+        SchedulingPolicy_Batch,
+        SchedulingPolicy_Idle
+} __attribute__((__packed__)) SchedulingPolicy_Type;
+
+
+typedef enum {
+        IoPriority_Default = 0,
+        IoPriority_BestEffort,
+        IoPriority_Idle
+} __attribute__((__packed__)) IoPriority_Type;
+
+
 typedef enum {
         ProcessEngine_None               = 0x0,
-        ProcessEngine_CollectCommandLine = 0x1
+        ProcessEngine_CollectCommandLine = 0x1,
+        ProcessEngine_CollectContainer   = 0x2
 } __attribute__((__packed__)) ProcessEngine_Flags;
 
 
 typedef enum {
         Httpd_Start = 1,
-        Httpd_Stop
+        Httpd_Stop,
+        Httpd_Suspend,
+        Httpd_Resume
 } __attribute__((__packed__)) Httpd_Action;
 
 
@@ -193,7 +245,8 @@ typedef enum {
         Every_Cycle = 0,
         Every_SkipCycles,
         Every_Cron,
-        Every_NotInCron
+        Every_NotInCron,
+        Every_Interval
 } __attribute__((__packed__)) Every_Type;
 
 
@@ -286,7 +339,10 @@ typedef enum {
         Service_Fifo,
         Service_Program,
         Service_Net,
-        Service_Last = Service_Net
+        Service_Socket,
+        Service_Heartbeat,
+        Service_Metric,
+        Service_Last = Service_Metric
 } __attribute__((__packed__)) Service_Type;
 
 
@@ -310,10 +366,77 @@ typedef enum {
         Resource_CpuPercentTotal,
         Resource_SwapPercent,
         Resource_SwapKbyte,
-        Resource_Threads
+        Resource_Threads,
+        Resource_ReadBytes,
+        Resource_WriteBytes,
+        Resource_VoluntaryContextSwitches,
+        Resource_NonvoluntaryContextSwitches,
+        Resource_FileDescriptors,
+        Resource_CgroupMemory,
+        Resource_CgroupPressure,
+        Resource_CgroupCpuPercent,
+        Resource_CgroupReadBytes,
+        Resource_CgroupWriteBytes,
+        Resource_DirectorySize,
+        Resource_DirectoryFiles,
+        Resource_DirectoryOldest,
+        Resource_DirectoryNewest,
+        Resource_ReadOperations,
+        Resource_WriteOperations,
+        Resource_ServiceTime,
+        Resource_Utilization,
+        Resource_CpuSteal,
+        Resource_CpuAny,
+        Resource_Pressure,
+        Resource_Meminfo,
+        Resource_ThreadCpu,
+        Resource_SocketConnections,
+        Resource_SocketEstablished,
+        Resource_SocketTimeWait,
+        Resource_SocketCloseWait,
+        Resource_SocketListen,
+        Resource_SocketListenQueue,
+        Resource_SocketListenDrops,
+        Resource_MonitCycle,
+        Resource_MonitMemory,
+        Resource_MonitQueue,
+        Resource_ProgramCpuTime,
+        Resource_ProgramMemory,
+        Resource_ProgramRunTime,
+        Resource_MetricValue,
+        Resource_MetricRate,
+        Resource_MetricMax,
+        Resource_GpuUsage,
+        Resource_GpuMemoryPercent,
+        Resource_GpuMemory,
+        Resource_GpuTemperature,
+        Resource_GpuEcc
 } __attribute__((__packed__)) Resource_Type;
 
 
+typedef enum {
+        Metric_Unknown = 0,
+        Metric_Counter,
+        Metric_Gauge,
+        Metric_Timer
+} __attribute__((__packed__)) Metric_Type;
+
+
+typedef enum {
+        Quota_User = 0,
+        Quota_Group,
+        Quota_Project
+} __attribute__((__packed__)) Quota_Type;
+
+
+typedef enum {
+        Pressure_Cpu = 0,
+        Pressure_Memory,
+        Pressure_Io,
+        Pressure_Last = Pressure_Io
+} __attribute__((__packed__)) Pressure_Type;
+
+
 
 typedef enum {
         Digest_Cleartext = 1,
@@ -335,6 +458,8 @@ typedef enum {
         Hash_Unknown = 0,
         Hash_Md5,
         Hash_Sha1,
+        Hash_Sha256,
+        Hash_Xxh64,
         Hash_Default = Hash_Md5
 } __attribute__((__packed__)) Hash_Type;
 
@@ -351,6 +476,19 @@ typedef enum {
 #define MD_SIZE 65
 
 
+/* Number of the recent port response times kept for the percentiles */
+#define RESPONSE_SAMPLES 128
+
+
+/* Maximum number of the system memory statistic fields and their name length (Linux /proc/meminfo) */
+#define MEMINFO_MAX 128
+#define MEMINFO_NAMELEN 32
+
+
+/* Maximum number of the GPUs with statistics */
+#define GPU_MAX 16
+
+
 #define ICMP_SIZE 64
 #define ICMP_MAXSIZE 1500
 #define ICMP_ATTEMPT_COUNT 3
@@ -362,9 +500,18 @@ typedef enum {
 #define LIMIT_PROGRAMOUTPUT     512
 #define LIMIT_HTTPCONTENTBUFFER 1048576
 #define LIMIT_NETWORKTIMEOUT    5000
+#define LIMIT_SOCKETBUFFER      16384
+#define LIMIT_LOGBUFFER         65536
+
+
+/* Default limits in the low memory mode ('set low memory') */
+#define LOWMEMORY_HTTPCONTENTBUFFER 65536
+#define LOWMEMORY_SOCKETBUFFER      4096
+#define LOWMEMORY_LOGBUFFER         8192
 
 
 #include "socket.h"
+#include "capture.h"
 
 
 /** ------------------------------------------------- Special purpose macros */
@@ -413,6 +560,8 @@ typedef struct mylimits {
         uint32_t httpContentBuffer;  /**< Maximum tested HTTP content length [B] */
         uint32_t programOutput;           /**< Program output truncate limit [B] */
         uint32_t networkTimeout;               /**< Default network timeout [ms] */
+        uint32_t socketBuffer;                 /**< Socket read buffer size [B] */
+        uint32_t logBuffer;               /**< Asynchronous log buffer size [B] */
 } Limits_T;
 
 
@@ -448,6 +597,7 @@ typedef struct myaction {
 typedef struct myeventaction {
         Action_T  failed;                  /**< Action in the case of failure down */
         Action_T  succeeded;                    /**< Action in the case of failure up */
+        int       slot;     /**< Service event table index + 1, 0 if not assigned yet */
 } *EventAction_T;
 
 
@@ -464,14 +614,33 @@ typedef struct myurl {
 } *URL_T;
 
 
+/** Defines a HTTP response content test */
+typedef struct myrequestcontent {
+        Operator_Type operator;         /**< Response content comparison operator */
+        regex_t *regex;                   /* regex used to test the response body */
+        struct myrequestcontent *next;                  /**< next test in chain */
+} *RequestContent_T;
+
+
 /** Defines a HTTP client request object */
 typedef struct myrequest {
         URL_T url;                                               /**< URL request */
-        Operator_Type operator;         /**< Response content comparison operator */
-        regex_t *regex;                   /* regex used to test the response body */
+        RequestContent_T contents;         /**< Response content tests or NULL */
 } *Request_T;
 
 
+/** Defines a HTTP/2 request, sent as one stream of the port connection */
+typedef struct myhttp2request {
+        char *path;                                              /**< Request path */
+        Operator_Type operator;                          /**< HTTP status operator */
+        int status;                                              /**< HTTP status */
+        Operator_Type latencyOperator;                 /**< Response time operator */
+        int latency;              /**< Response time limit [ms] or 0 if not tested */
+        RequestContent_T contents;         /**< Response content tests or NULL */
+        struct myhttp2request *next;                    /**< next request in chain */
+} *Http2Request_T;
+
+
 /** Defines an event notification and status receiver object */
 typedef struct mymmonit {
         URL_T url;                                             /**< URL definition */
@@ -479,10 +648,42 @@ typedef struct mymmonit {
         int timeout;                /**< The timeout to wait for connection or i/o */
 
         /** For internal use */
+        boolean_t gzip;            /**< true if the server accepts gzip uploads */
+        Mutex_T mutex;         /**< Serializes the senders of this server */
+        struct {
+                Socket_T socket;      /**< Persistent connection or NULL */
+                time_t used;             /**< Last use of the connection */
+        } connection;
+        struct {
+                unsigned long long acknowledged; /**< Generation accepted by the server, 0 = none */
+                int count;            /**< Delta heartbeats since the last full status */
+        } heartbeat;
         struct mymmonit *next;                         /**< next receiver in chain */
 } *Mmonit_T;
 
 
+/** Defines a downstream monit agent polled by the federation */
+typedef struct myfederationagent {
+        URL_T url;                                 /**< The agent's http interface */
+        SslOptions_T ssl;                                      /**< SSL definition */
+        int timeout;                /**< The timeout to wait for connection or i/o */
+
+        /** For internal use */
+        char *host;                      /**< The agent's host name, NULL = unknown */
+        time_t incarnation;      /**< The agent's incarnation of the merged status */
+        unsigned long long generation;  /**< Generation of the merged status, 0 = none */
+        time_t updated;                     /**< Time of the last successful poll */
+        boolean_t reachable;                  /**< true if the last poll succeeded */
+        boolean_t cluster;          /**< true if the agent is a cluster member */
+        int count;                                       /**< Number of services */
+        struct myfederationservice {
+                char *name;
+                char *json;           /**< The service object of the agent status */
+        } *services;                                    /**< Services sorted by name */
+        struct myfederationagent *next;                   /**< next agent in chain */
+} *FederationAgent_T;
+
+
 /** Defines a mailinglist object */
 typedef struct mymail {
         char *to;                         /**< Mail address for alert notification */
@@ -523,6 +724,33 @@ typedef struct myauthentication {
 } *Auth_T;
 
 
+/** Pressure stall information: the share of time in which some or all non-idle tasks were stalled waiting for the resource, averaged over 10, 60 and 300 seconds [%], -1 if n/a */
+typedef struct Pressure_T {
+        float some[3];
+        float full[3];
+} Pressure_T;
+
+
+/** One thread of a process, as sampled by the per-thread collector */
+typedef struct ProcessThread_T {
+        pid_t tid;                                                     /**< Thread ID */
+        double time;                                      /**< Consumed CPU time [s] */
+        char name[16];                                               /**< Thread name */
+} ProcessThread_T;
+
+
+/** One GPU, as sampled by the GPU collector, see Gpu.h. The values are -1 if n/a */
+typedef struct GpuDevice_T {
+        char name[64];                                              /**< Device name */
+        float usage;                  /**< Busy time in the last sample period [%] */
+        float memory_percent;                               /**< Memory in use [%] */
+        long long memory;                                   /**< Memory in use [B] */
+        long long memory_max;                                /**< Memory size [B] */
+        float temperature;                                    /**< Temperature [C] */
+        long long ecc;           /**< Uncorrected ECC errors since the driver load */
+} GpuDevice_T;
+
+
 /** Defines data for systemwide statistic */
 //FIXME: structurize the data
 typedef struct mysysteminfo {
@@ -532,6 +760,30 @@ typedef struct mysysteminfo {
         float total_cpu_user_percent;                               /**< Total CPU in use in user space [%] */
         float total_cpu_syst_percent;                             /**< Total CPU in use in kernel space [%] */
         float total_cpu_wait_percent;                                  /**< Total CPU in use in waiting [%] */
+        float total_cpu_steal_percent;                        /**< Total CPU stolen by the hypervisor [%] */
+        struct {
+                int count;                                     /**< Number of CPUs with statistics, 0 if n/a */
+                float *usage;                     /**< CPU usage [%] indexed by the CPU number, -1 if n/a */
+                float *steal;                     /**< CPU steal [%] indexed by the CPU number, -1 if n/a */
+                short *node;                                                   /**< NUMA node of the CPU */
+        } cpu;
+        struct {
+                int count;                                          /**< Number of NUMA nodes, 0 if n/a */
+                float *usage;                          /**< Node CPU usage [%] indexed by the node number */
+        } node;
+        Pressure_T pressure[Pressure_Last + 1];          /**< Pressure stall information per resource */
+        struct {
+                int count;                               /**< Number of memory statistic fields, 0 if n/a */
+                struct {
+                        char name[MEMINFO_NAMELEN];                                /**< Field name */
+                        boolean_t bytes;                 /**< true if the value is in bytes, false if a count */
+                        uint64_t value;                                                 /**< Field value */
+                } field[MEMINFO_MAX];
+        } meminfo;                                          /**< All system memory statistic fields */
+        struct {
+                int count;                                               /**< Number of GPUs, 0 if n/a */
+                GpuDevice_T device[GPU_MAX];
+        } gpu;                                                   /**< GPU statistics, see Gpu.h */
         size_t argmax;                                                   /**< Program arguments maximum [B] */
         uint64_t mem_max;                                                   /**< Maximal system real memory */
         uint64_t swap_max;                                                                   /**< Swap size */
@@ -542,7 +794,6 @@ typedef struct mysysteminfo {
         struct timeval collected;                                             /**< When were data collected */
         uint64_t booted; /**< System boot time (seconds since UNIX epoch, using platform-agnostic uint64_t) */
         double time;                                                                      /**< 1/10 seconds */
-        double time_prev;                                                                 /**< 1/10 seconds */
 } SystemInfo_T;
 
 
@@ -550,6 +801,7 @@ typedef struct mysysteminfo {
 typedef struct Protocol_T {
         const char *name;                                       /**< Protocol name */
         void (*check)(Socket_T);          /**< Protocol verification function */
+        void (*ping)(Socket_T);   /**< Test of a persistent session or NULL if n/a */
 } *Protocol_T;
 
 
@@ -569,6 +821,22 @@ typedef struct outgoing {
 } Outgoing_T;
 
 
+/** Defines a threshold on a server statistic read by the protocol test */
+typedef struct myservermetric {
+        char *name;                                           /**< Statistic name */
+        Operator_Type operator;                            /**< Comparison operator */
+        double limit;                                        /**< Numeric threshold */
+        char *text;                  /**< Text value to compare, or NULL if numeric */
+        boolean_t rate;           /**< true if the limit applies to the change per second */
+        /** For internal use */
+        boolean_t found;                   /**< true if the server sent the statistic */
+        char value[64];                                     /**< The received value */
+        double last;                       /**< The previous value of the rate test */
+        long long sampled;    /**< Time of the previous value [us, monotonic], 0 if none */
+        struct myservermetric *next;                           /**< next metric in chain */
+} *ServerMetric_T;
+
+
 /** Defines a port object */
 typedef struct myport {
         char *hostname;                                     /**< Hostname to check */
@@ -588,8 +856,31 @@ typedef struct myport {
         double response;                 /**< Socket connection response time [ms] */
         Socket_Type type;           /**< Socket type used for connection (UDP/TCP) */
         Socket_Family family;    /**< Socket family used for connection (NET/UNIX) */
+        Socket_Family connected;     /**< IP version of the last connection or 0 */
         Connection_State is_available;               /**< Server/port availability */
+        struct {
+                double dns;                   /**< Name resolution time [ms], -1 if n/a */
+                double connect;          /**< TCP connect round-trip time [ms], -1 if n/a */
+                double tls;                      /**< TLS handshake time [ms], -1 if n/a */
+                double firstbyte;  /**< Time to the first response byte [ms], -1 if n/a */
+        } phases;                              /**< Breakdown of the last response time */
+        struct {
+                boolean_t valid;              /**< true if the port was tested in this cycle */
+                double dns;
+                double response;
+                char error[STRLEN];
+        } prefetch;                         /**< Batched UDP test result, see udpbatch.h */
+        struct {
+                boolean_t enabled;    /**< true if the session is kept open between cycles */
+                Socket_T socket;                      /**< The open session or NULL */
+        } session;
+        struct {
+                int count;                            /**< Number of samples collected */
+                int next;                            /**< Index of the next sample slot */
+                float *samples;     /**< Ring of the last RESPONSE_SAMPLES response times [ms] */
+        } responses;
         EventAction_T action;  /**< Description of the action upon event occurence */
+        ServerMetric_T metrics;          /**< Server statistic thresholds (optional) */
         /** Protocol specific parameters */
         union {
                 struct {
@@ -617,6 +908,7 @@ typedef struct myport {
                 } apachestatus;
                 struct {
                         Generic_T sendexpect;
+                        boolean_t pipeline;       /**< Send all strings before the expects */
                 } generic;
                 struct {
                         Hash_Type hashtype;           /**< Type of hash for a checksum (optional) */
@@ -626,6 +918,13 @@ typedef struct myport {
                         char *checksum;                         /**< Document checksum (optional) */
                         List_T headers;      /**< List of headers to send with request (optional) */
                 } http;
+                struct {
+                        Http2Request_T requests;   /**< Requests multiplexed as streams */
+                        List_T headers;      /**< List of headers to send with request (optional) */
+                } http2;
+                struct {
+                        List_T services;      /**< Names of the services to check (optional) */
+                } grpc;
                 struct {
                         char *username;
                         char *password;
@@ -641,6 +940,15 @@ typedef struct myport {
                         char *username;
                         char *password;
                 } smtp;
+                struct {
+                        int version;                                /**< 1, 2 (v2c) or 3 */
+                        char *community;                          /**< v1 and v2c community */
+                        char *username;                               /**< SNMPv3 user name */
+                        char *password;       /**< SNMPv3 authentication passphrase (optional) */
+                        char *privacy;               /**< SNMPv3 privacy passphrase (optional) */
+                        Hash_Type authentication;              /**< Hash_Md5 or Hash_Sha1 */
+                        struct SnmpEngine_T *engine;   /**< The discovered SNMPv3 engine, see snmp.c */
+                } snmp;
                 struct {
                         int version;
                         char *host;
@@ -665,16 +973,25 @@ typedef struct myicmp {
         Connection_State is_available;    /**< Flag for the server is availability */
         Socket_Family family;                 /**< ICMP family used for connection */
         double response;                         /**< ICMP ECHO response time [ms] */
+        double jitter;            /**< ICMP ECHO response time jitter [ms], -1 if n/a */
+        int loss;                     /**< ICMP ECHO requests lost [%], -1 if n/a */
         Outgoing_T outgoing;                                 /**< Outgoing address */
         EventAction_T action;  /**< Description of the action upon event occurence */
 
         /** For internal use */
+        struct {
+                boolean_t valid;              /**< true if the host was pinged in this cycle */
+                double response;
+                double jitter;
+                int loss;
+        } prefetch;                            /**< Batched ping result, see ping.h */
         struct myicmp *next;                               /**< next icmp in chain */
 } *Icmp_T;
 
 
 typedef struct mydependant {
         char *dependant;                            /**< name of dependant service */
+        struct myservice *service;    /**< The dependant service (resolved on parse) */
 
         /** For internal use */
         struct mydependant *next;             /**< next dependant service in chain */
@@ -686,6 +1003,13 @@ typedef struct myresource {
         Resource_Type resource_id;                     /**< Which value is checked */
         Operator_Type operator;                           /**< Comparison operator */
         double limit;                                   /**< Limit of the resource */
+        struct {
+                Pressure_Type type;                         /**< The stalled resource */
+                boolean_t full;            /**< true if all tasks stalled, false if some tasks */
+                int window;                /**< Average window index: 0 = 10s, 1 = 60s, 2 = 300s */
+        } pressure;                                      /**< Pressure stall test selector */
+        char *meminfo;                               /**< The memory statistic field name or NULL */
+        int average;               /**< Test the average over the window [s], 0 = actual value */
         EventAction_T action;  /**< Description of the action upon event occurence */
 
         /** For internal use */
@@ -693,6 +1017,15 @@ typedef struct myresource {
 } *Resource_T;
 
 
+/** Defines a resource test compiled for the evaluation loop, see compile_resources() */
+typedef struct myresourcerule {
+        boolean_t (*value)(struct myservice *s, double *value); /**< Metric accessor, false while initializing, NULL if the test is always evaluated in full */
+        Operator_Type operator;                           /**< Comparison operator */
+        double limit;                                   /**< Limit of the resource */
+        Resource_T resource;                                  /**< The resource test */
+} *ResourceRule_T;
+
+
 /** Defines timestamp object */
 typedef struct mytimestamp {
         boolean_t initialized;              /**< true if timestamp was initialized */
@@ -721,14 +1054,21 @@ typedef struct myactionrate {
 /** Defines when to run a check for a service. This type suports both the old
  cycle based every statement and the new cron-format version */
 typedef struct myevery {
-        Every_Type type; /**< 0 = not set, 1 = cycle, 2 = cron, 3 = negated cron */
+        Every_Type type; /**< 0 = not set, 1 = cycle, 2 = cron, 3 = negated cron, 4 = interval */
         time_t last_run;
         union {
                 struct {
                         int number; /**< Check this program at a given cycles */
                         int counter; /**< Counter for number. When counter == number, check */
                 } cycle; /**< Old cycle based every check */
-                char *cron; /* A crontab format string */
+                struct {
+                        int seconds; /**< Check the service in this interval, independently of the poll cycle */
+                        long long next; /**< Time of the next scheduled check [ms] */
+                } interval;
+                struct {
+                        char *string; /**< A crontab format string */
+                        Cron_T compiled; /**< The string compiled at parse time */
+                } cron;
         } spec;
 } Every_T;
 
@@ -744,6 +1084,14 @@ typedef struct mystatus {
 } *Status_T;
 
 
+/** Defines the resources used by the last program run */
+struct myprogramusage {
+        long long cpuTime;            /**< User and system CPU time [µs], -1 = n/a */
+        long long memory;                   /**< Peak resident memory [B], -1 = n/a */
+        long long runTime;                     /**< Wall-clock run time [ms], -1 = n/a */
+};
+
+
 typedef struct myprogram {
         Process_T P;          /**< A Process_T object representing the sub-process */
         Command_T C;          /**< A Command_T object for creating the sub-process */
@@ -751,7 +1099,11 @@ typedef struct myprogram {
         time_t started;                      /**< When the sub-process was started */
         int timeout;           /**< Seconds the program may run until it is killed */
         int exitStatus;                 /**< Sub-process exit status for reporting */
+        struct myprogramusage usage;           /**< Resources used by the last run */
+        int outputLimit;      /**< Captured output size [B], -1 = programOutput limit */
+        Capture_T capture;                  /**< Output capture of the sub-process */
         StringBuffer_T output;                            /**< Last program output */
+        struct Plugin_T *plugin;      /**< In-process plugin check or NULL, see plugin.h */
 } *Program_T;
 
 
@@ -768,6 +1120,32 @@ typedef struct mysize {
 } *Size_T;
 
 
+/** Defines response time percentile object */
+typedef struct myresponsetime {
+        int percentile;                     /**< Percentile of the response times */
+        Operator_Type operator;                           /**< Comparison operator */
+        double limit;                                 /**< Response time limit [ms] */
+        EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        struct myresponsetime *next;              /**< next response time in chain */
+} *ResponseTime_T;
+
+
+/** Defines growth rate object */
+typedef struct mygrowth {
+        char *metric;                      /**< The metric in the time-series store */
+        Operator_Type operator;                           /**< Comparison operator */
+        double limit;                                 /**< Growth limit per time unit */
+        int unit;                                           /**< The time unit [s] */
+        boolean_t bytes;                                /**< true if the metric is an amount */
+        EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        struct mygrowth *next;                           /**< next growth in chain */
+} *Growth_T;
+
+
 /** Defines uptime object */
 typedef struct myuptime {
         Operator_Type operator;                           /**< Comparison operator */
@@ -819,6 +1197,67 @@ typedef struct mybandwidth {
 } *Bandwidth_T;
 
 
+/** Defines the recursive directory scan object */
+typedef struct mydirscan {
+        int depth;                       /**< Maximum scan depth, 0 means unlimited */
+        boolean_t incremental;   /**< Reuse the content of unchanged directories */
+
+        /** For internal use */
+        int scans;                          /**< Scans since the last full rescan */
+        struct DirScanNode_T *root;          /**< Cached directory tree, see dirscan.h */
+} *DirScan_T;
+
+
+/** Defines the directory tree checksum test */
+typedef struct mytreesum {
+        Hash_Type type;                                           /**< Hash type */
+        EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        char *file;                                  /**< The saved tree file */
+        MD_T hash;                                  /**< The root directory hash */
+        struct TreeSumNode_T *root;        /**< The Merkle tree, see treesum.h */
+} *TreeSum_T;
+
+
+/** Defines the deadline test of the 'check heartbeat' service */
+typedef struct myheartbeat {
+        int timeout;                                 /**< Heartbeat deadline [s] */
+        EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        long long started;     /**< The deadline start if no heartbeat [ms], monotonic */
+        long long received;  /**< Last heartbeat [ms], monotonic, 0 = none, see heartbeat.h */
+        time_t timestamp;                         /**< Last heartbeat, 0 = none */
+        unsigned long long count;                       /**< Heartbeats received */
+} *Heartbeat_T;
+
+
+/** Defines the accumulator of a 'check metric' service, see statsd.h */
+typedef struct mymetric {
+        Metric_Type type;                             /**< Type of the last sample */
+        unsigned long long samples;                         /**< Samples received */
+        double total;                  /**< Sum of the counter or timer samples */
+        double last;                    /**< Gauge value or the last timer sample */
+        double max;         /**< Longest timer sample since the last collection */
+
+        /** For internal use by the check */
+        unsigned long long _samples;          /**< Samples at the last collection */
+        double _total;                          /**< Total at the last collection */
+        long long _collected;         /**< Last collection [ms], monotonic, 0 = none */
+} *Metric_T;
+
+
+/** Defines the file set of a 'check file matching' service */
+typedef struct myfileset {
+        char *pattern;                    /**< Glob pattern of the member paths */
+
+        /** For internal use */
+        int count;                                        /**< Number of members */
+        struct FileRecord_T *records;   /**< Members sorted by path, see fileset.h */
+} *FileSet_T;
+
+
 /** Defines checksum object */
 typedef struct mychecksum {
         boolean_t initialized;               /**< true if checksum was initialized */
@@ -827,6 +1266,9 @@ typedef struct mychecksum {
         int   length;                                      /**< Length of the hash */
         MD_T  hash;                     /**< A checksum hash computed for the path */
         EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        struct ChecksumJob_T *job;   /**< Background computation, see checksumpool.h */
 } *Checksum_T;
 
 
@@ -843,6 +1285,7 @@ typedef struct mymatch {
         boolean_t not;                                           /**< Invert match */
         char    *match_string;                                   /**< Match string */ //FIXME: union?
         char    *match_path;                         /**< File with matching rules */ //FIXME: union?
+        char    *container;         /**< Container to restrict the process match to */
         regex_t *regex_comp;                                    /**< Match compile */
         StringBuffer_T log;    /**< The temporary buffer used to record the matches */
         EventAction_T action;  /**< Description of the action upon event occurence */
@@ -905,6 +1348,26 @@ typedef struct myfilesystem {
 } *Filesystem_T;
 
 
+/** Defines a filesystem quota test of one user, group or project */
+typedef struct myquota {
+        Quota_Type type;                           /**< User, group or project quota */
+        boolean_t inode;                 /**< true for the inode quota, false for space */
+        Operator_Type operator;                           /**< Comparison operator */
+        int id;                                       /**< User, group or project id */
+        long long limit_absolute;                  /**< Watermark - bytes or inodes */
+        float limit_percent;                /**< Watermark - percent of the quota limit */
+        EventAction_T action;  /**< Description of the action upon event occurence */
+
+        /** For internal use */
+        struct {
+                boolean_t found;                /**< false if the id has no quota entry */
+                long long used;                     /**< Used space [B] or inodes */
+                long long limit;     /**< Hard limit, else the soft limit, 0 = no limit */
+        } usage;                                       /**< Usage from the last cycle */
+        struct myquota *next;                             /**< next quota in chain */
+} *Quota_T;
+
+
 /** Defines service data */
 typedef struct myinfo {
         union {
@@ -924,6 +1387,14 @@ typedef struct myinfo {
                         int uid;                                              /**< Owner's uid */
                         int gid;                                              /**< Owner's gid */
                         int mode;                                              /**< Permission */
+                        struct {
+                                double read_bytes;                   /**< Read rate [B/s] */
+                                double write_bytes;                 /**< Write rate [B/s] */
+                                double read_operations;        /**< Read operations [1/s] */
+                                double write_operations;      /**< Write operations [1/s] */
+                                double service_time;      /**< Average I/O service time [ms] */
+                                double utilization;    /**< Percent of time the device was busy */
+                        } io;                          /**< Block device I/O statistics */
                 } filesystem;
 
                 struct {
@@ -935,7 +1406,15 @@ typedef struct myinfo {
                         off_t readpos;                        /**< Position for regex matching */
                         ino_t inode;                                                /**< Inode */
                         ino_t inode_prev;               /**< Previous inode for regex matching */
+                        int fd;                /**< Descriptor of the matched file kept open or -1 */
                         MD_T  cs_sum;                                            /**< Checksum */ //FIXME: allocate dynamically only when necessary
+                        struct {
+                                unsigned long long inode;         /**< Inode of the hashed file */
+                                unsigned long long size;           /**< Size of the hashed file */
+                                unsigned long long mtime; /**< Modification time of the hashed file [ns] */
+                                unsigned long long ctime;     /**< Change time of the hashed file [ns] */
+                                int cycles;           /**< Cycles since the checksum was computed */
+                        } cs_cache;                   /**< Stat data of the file when checksum was computed */
                 } file;
 
                 struct {
@@ -943,6 +1422,13 @@ typedef struct myinfo {
                         int mode;                                              /**< Permission */
                         int uid;                                              /**< Owner's uid */
                         int gid;                                              /**< Owner's gid */
+                        struct {
+                                long long size;                /**< Total size of the files */
+                                long long files;                     /**< Number of files */
+                                long long directories;         /**< Number of subdirectories */
+                                time_t oldest;    /**< Modification time of the oldest file */
+                                time_t newest;    /**< Modification time of the newest file */
+                        } tree;                              /**< Recursive directory scan */
                 } directory;
 
                 struct {
@@ -970,11 +1456,74 @@ typedef struct myinfo {
                         float cpu_percent;                                     /**< percentage */
                         float total_cpu_percent;                               /**< percentage */
                         time_t uptime;                                     /**< Process uptime */
+                        int filedescriptors;                        /**< Open file descriptors */
+                        double read_rate;                                /**< Disk read [B/s] */
+                        double write_rate;                              /**< Disk write [B/s] */
+                        double voluntary_rate;         /**< Voluntary context switches [1/s] */
+                        double nonvoluntary_rate;   /**< Nonvoluntary context switches [1/s] */
+                        struct {
+                                pid_t pid;                             /**< Sampled process */
+                                long long time;                   /**< Sample timestamp [ms] */
+                                long long read_bytes;
+                                long long write_bytes;
+                                long long voluntary;
+                                long long nonvoluntary;
+                        } sample;                   /**< Counters from the previous cycle */
+                        struct {
+                                long long memory;                  /**< Memory usage [B] */
+                                Pressure_T pressure[Pressure_Last + 1];  /**< Pressure stall information */
+                                float cpu_percent;                  /**< CPU usage [%] */
+                                double read_rate;                /**< Disk read [B/s] */
+                                double write_rate;              /**< Disk write [B/s] */
+                                struct {
+                                        pid_t pid;
+                                        long long time;
+                                        long long cpu_usec;
+                                        long long read_bytes;
+                                        long long write_bytes;
+                                } sample;
+                        } cgroup;           /**< Statistics of the process' cgroup */
+                        struct {
+                                float cpu_percent;    /**< CPU usage of the busiest thread [%] */
+                                pid_t tid;                        /**< The busiest thread ID */
+                                char name[16];                  /**< The busiest thread name */
+                                pid_t pid;                             /**< Sampled process */
+                                long long time;                   /**< Sample timestamp [ms] */
+                                int count;                             /**< Sampled threads */
+                                ProcessThread_T *sample;   /**< Threads from the previous cycle */
+                        } thread;     /**< Per-thread statistics, sampled only for thread tests */
+                        long long gpu_memory;   /**< GPU memory with children [B], -1 if n/a */
                 } process;
 
                 struct {
                         Link_T stats;
                 } net;
+
+                struct {
+                        int connections;        /**< TCP sockets which are not listening */
+                        int established;              /**< Established connections */
+                        int timewait;                 /**< Connections in TIME_WAIT */
+                        int closewait;               /**< Connections in CLOSE_WAIT */
+                        int listen;                             /**< Listening sockets */
+                        int queue;          /**< Longest accept queue of the listeners */
+                        int backlog;             /**< Backlog of the longest queue */
+                        long long drops;   /**< Listen queue drops since last cycle */
+                        long long _drops; /**< Listen drops counter from last cycle */
+                } socket;
+
+                struct {
+                        time_t timestamp;                 /**< Last heartbeat, 0 = none */
+                        long long age; /**< Seconds since the last heartbeat or the deadline start, -1 = unknown */
+                        unsigned long long count;               /**< Heartbeats received */
+                } heartbeat;
+
+                struct {
+                        Metric_Type type;        /**< Metric type, Metric_Unknown = no sample */
+                        double value; /**< Gauge value, counter increment or timer mean in the last cycle */
+                        double rate; /**< Counter increment or samples per second in the last cycle, -1 = unknown */
+                        double max;                  /**< Longest timer sample in the last cycle */
+                        unsigned long long samples;                 /**< Samples received */
+                } metric;
         } priv;
 } *Info_T;
 
@@ -983,18 +1532,45 @@ typedef struct myinfo {
 //FIXME: use union for type-specific rules
 typedef struct myservice {
 
-        /** Common parameters */
-        char *name;                                  /**< Service descriptive name */
+        /**
+         * The fields used by the service list walks of the validation loop,
+         * the scheduler and the status come first, so they share the first
+         * cache lines. The test rules and the large runtime data follow.
+         */
+        struct myservice *next;                         /**< next service in chain */
+        struct myservice *next_conf;      /**< next service according to conf file */
+        struct myservice *next_depend;           /**< next depend service in chain */
         State_Type (*check)(struct myservice *);/**< Service verification function */
-        boolean_t visited; /**< Service visited flag, set if dependencies are used */
+        char *name;                                  /**< Service descriptive name */
         Service_Type type;                             /**< Monitored service type */
         Monitor_State monitor;                             /**< Monitor state flag */
         Monitor_Mode mode;                    /**< Monitoring mode for the service */
-        Onreboot_Type onreboot;                                /**< On reboot mode */
         Action_Type doaction;                 /**< Action scheduled by http thread */
+        boolean_t visited; /**< Service visited flag, set if dependencies are used */
+        int  error;                                        /**< Error flags bitmap */
+        int  error_hint;                 /**< Failed/Changed hint for error bitmap */
         int  ncycle;                          /**< The number of the current cycle */
         int  nstart;           /**< The number of current starts with this service */
+        struct {
+                int failures;       /**< Restarts in a row, the service didn't stay up */
+                long long restarted;    /**< Last automatic (re)start [ms], monotonic */
+                long long deferred;  /**< Next restart is deferred until [ms], monotonic */
+        } backoff;                          /**< Restart backoff, see event.c */
+        struct {
+                long long stable;   /**< The service has no error since [ms], 0 = failed */
+                long long retry;     /**< Fast re-check of the failed service at [ms], 0 = none */
+                long long resume;   /**< The stable service is not checked before [ms], 0 = none */
+                int interval;                    /**< Actual decayed check interval [s] */
+        } adaptive;                    /**< Adaptive check interval, see validate.c */
+        long long ramp;   /**< The first check is deferred until [ms], 0 = none, see validate.c */
+        boolean_t priority;    /**< true if the cycle budget never defers the check */
+        boolean_t deferred;  /**< true if the cycle budget deferred the last check */
+        unsigned int generation;     /**< Bumped when the service status may change */
+        unsigned long long changed;     /**< Run.generation of the last status change */
         Every_T every;              /**< Timespec for when to run check of service */
+
+        /** Common parameters */
+        Onreboot_Type onreboot;                                /**< On reboot mode */
         command_t start;                    /**< The start command for the service */
         command_t stop;                      /**< The stop command for the service */
         command_t restart;                /**< The restart command for the service */
@@ -1002,20 +1578,36 @@ typedef struct myservice {
 
         Dependant_T dependantlist;                     /**< Dependant service list */
         Mail_T maillist;                       /**< Alert notification mailinglist */
+        unsigned long long *groups;   /**< Bitset of the service groups by group id */
+        int groupsSize;                       /**< Number of words in the groups bitset */
 
         /** Test rules and event handlers */
         ActionRate_T actionratelist;                    /**< ActionRate check list */
         Checksum_T  checksum;                                  /**< Checksum check */
+        DirScan_T   dirscan;                       /**< Recursive directory scan */
+        FileSet_T   fileset;                  /**< File set members or NULL */
+        TreeSum_T   treesum;                        /**< Directory tree checksum */
+        Heartbeat_T heartbeat;                          /**< Heartbeat deadline test */
+        Metric_T    metric;                         /**< Push metric accumulator */
+        int         localport;          /**< TCP port selected by check socket */
         Filesystem_T filesystemlist;                    /**< Filesystem check list */
+        Quota_T quotalist;                         /**< Filesystem quota check list */
         Icmp_T      icmplist;                                 /**< ICMP check list */
         Perm_T      perm;                                    /**< Permission check */
         Port_T      portlist;                            /**< Portnumbers to check */
         Port_T      socketlist;                         /**< Unix sockets to check */
         Resource_T  resourcelist;                          /**< Resouce check list */
+        struct {
+                int count;
+                ResourceRule_T rules;   /**< The resourcelist as a dense array, allocated from the region */
+        } resourceplan;
         Size_T      sizelist;                                 /**< Size check list */
         Uptime_T    uptimelist;                             /**< Uptime check list */
+        ResponseTime_T responsetimelist;    /**< Port response time percentile check list */
+        Growth_T    growthlist;                        /**< Metric growth rate check list */
         Match_T     matchlist;                             /**< Content Match list */
         Match_T     matchignorelist;                /**< Content Match ignore list */
+        PatternSet_T patternset;  /**< The ignore and match patterns, built on first test */
         Timestamp_T timestamplist;                       /**< Timestamp check list */
         Pid_T       pidlist;                                   /**< Pid check list */
         Pid_T       ppidlist;                                 /**< PPid check list */
@@ -1043,12 +1635,15 @@ typedef struct myservice {
         EventAction_T action_MONIT_STOP;           /**< Monit instance stop action */
         EventAction_T action_ACTION;           /**< Action requested by CLI or GUI */
 
-        /** Runtime parameters */
-        int                error;                          /**< Error flags bitmap */
-        int                error_hint;   /**< Failed/Changed hint for error bitmap */
         Info_T             inf;                          /**< Service check result */
         struct timeval     collected;                /**< When were data collected */ //FIXME: replace with uint64_t? (all places where timeval is used) ... Time_milli()?
         char              *token;                                /**< Action token */
+        struct {
+                unsigned int requested;      /**< Number of the last requested action */
+                unsigned int executing;           /**< The request being executed */
+                unsigned int finished;               /**< The last finished request */
+                boolean_t failed;            /**< true if the finished request failed */
+        } request;                /**< Progress of the user actions, see control.c */
 
         /** Events */
         struct myevent {
@@ -1068,15 +1663,49 @@ typedef struct myservice {
                 /** For internal use */
                 struct myevent   *next;                         /**< next event in chain */
         } *eventlist;                                     /**< Pending events list */
+        struct {
+                int size;
+                struct myevent **events;  /**< The first event of each action by slot */
+        } eventtable;
 
         /** Context specific parameters */
         char *path;  /**< Path to the filesys, file, directory or process pid file */
 
         /** For internal use */
         Mutex_T mutex;                  /**< Mutex used for action synchronization */
-        struct myservice *next;                         /**< next service in chain */
-        struct myservice *next_conf;      /**< next service according to conf file */
-        struct myservice *next_depend;           /**< next depend service in chain */
+        struct Histogram_T *latency;     /**< Check duration histogram, see profiler.h */
+        struct {
+                boolean_t valid;             /**< true if the path was stat'ed in this cycle */
+                int error;                            /**< errno if the stat failed or 0 */
+                struct stat st;
+        } prefetch;                         /**< Batched stat result, see statbatch.h */
+        struct {
+                unsigned long long inode;              /**< Inode of the parsed pidfile */
+                unsigned long long size;                /**< Size of the parsed pidfile */
+                unsigned long long mtime; /**< Modification time of the parsed pidfile [ns] */
+                pid_t pid;                      /**< The parsed pid or 0 if not cached */
+        } pidfile;                            /**< Pidfile cache, see Util_getServicePid() */
+        struct {
+                unsigned int sequence;       /**< Odd while the snapshot is written */
+                int error;                                  /**< Error flags bitmap */
+                int error_hint;             /**< Failed/Changed hint for error bitmap */
+                struct timeval collected;               /**< When were data collected */
+                Monitor_State monitor;                     /**< Monitor state flag */
+                Action_Type doaction;                       /**< Scheduled action */
+                struct myinfo inf;                               /**< The service data */
+                struct {
+                        time_t started;                   /**< Program start time */
+                        int exitStatus;                  /**< Program exit status */
+                        struct myprogramusage usage;   /**< Program resource usage */
+                        StringBuffer_T output;    /**< See Snapshot_getOutput() */
+                } program;
+        } snapshot;           /**< Status published by the last check, see snapshot.h */
+        struct {
+                unsigned int generation[2];  /**< Service generation of the fragments */
+                StringBuffer_T fragment[2];    /**< XML status per format version */
+        } status;                      /**< Cached status XML fragments, see xml.c */
+        unsigned long long fingerprint;   /**< Hash of the service configuration */
+        Arena_T region;     /**< Memory of the test and action objects, see p.y */
 } *Service_T;
 
 
@@ -1086,6 +1715,7 @@ typedef struct myevent *Event_T;
 typedef struct myservicegroup {
         char *name;                                     /**< name of service group */
         List_T members;                                 /**< Service group members */
+        int id;                        /**< Bit of the group in the service bitsets */
 
         /** For internal use */
         struct myservicegroup *next;              /**< next service group in chain */
@@ -1103,10 +1733,115 @@ struct myrun {
                 char *pid;                              /**< This programs pidfile */
                 char *id;                       /**< The file with unique monit id */
                 char *state;            /**< The file with the saved runtime state */
+                char *status;       /**< The shared memory status segment or NULL */
         } files;
         char *mygroup;                              /**< Group Name of the Service */
         MD_T id;                                              /**< Unique monit id */
         Limits_T limits;                                       /**< Default limits */
+        struct {
+                int collectorThreads;  /**< Max. number of process collector threads */
+        } processEngine;
+        struct {
+                int workers;                   /**< Number of parallel check workers */
+        } checkEngine;
+        struct {
+                int workers;         /**< Number of parallel start/stop workers */
+        } controlEngine;
+        struct {
+                int recheckCycles; /**< Re-check unchanged watched paths every N cycles */
+        } fileEngine;
+        struct {
+                int verifyCycles;  /**< Recompute cached checksums every N cycles, 0 = never */
+        } checksumCache;
+        struct {
+                int workers;     /**< Number of background checksum workers, 0 = none */
+        } checksumEngine;
+        struct {
+                int timeout;   /**< Filesystem probe timeout [s], 0 = no timeout */
+                int workers;                  /**< Number of the I/O probe workers */
+        } ioProbe;
+        struct {
+                char *socket;          /**< The heartbeat datagram socket or NULL */
+        } heartbeat;
+        struct {
+                char *directory;   /**< The service discovery directory or NULL */
+        } discovery;
+        struct {
+                int port;                   /**< Statsd UDP port, 0 = no UDP listener */
+                char *address;            /**< Statsd UDP bind address or NULL */
+                char *socket;              /**< Statsd datagram socket or NULL */
+        } statsd;
+        struct {
+                int slots;      /**< Background event delivery queue size, 0 = none */
+        } deliveryEngine;
+        struct {
+                int slots;               /**< Number of time-series slots, 0 = none */
+                char *file;          /**< The file backing the time-series or NULL */
+        } seriesEngine;
+        struct {
+                int size;     /**< M/Monit events per message, 0 = one per message */
+                int delay;         /**< Seconds to wait for more events to batch */
+        } mmonitBatch;
+        struct {
+                int full;   /**< Delta heartbeat, full status every N heartbeats, 0 = none */
+        } mmonitDelta;
+        struct {
+                int interval;           /**< Seconds between the polls, 0 = poll cycle */
+                boolean_t cluster;  /**< Shard the host checks between the agents */
+                FederationAgent_T agents;          /**< Downstream agents or NULL */
+        } federation;
+        struct {
+                int sync; /**< State file fsync: 0 = every save, N = at most every N seconds, -1 = on stop only */
+        } stateEngine;
+        struct {
+                int window;          /**< Alert digest window in seconds, 0 = none */
+        } alertDigest;
+        struct {
+                char *affinity;        /**< CPU list of the daemon threads or NULL */
+                SchedulingPolicy_Type policy;   /**< CPU scheduling policy */
+                IoPriority_Type ioClass;             /**< I/O scheduling class */
+                int ioLevel;          /**< Best-effort I/O priority level (0-7) */
+                char *cgroup;      /**< The cgroup to move the daemon into or NULL */
+        } isolation;                                  /**< See isolation.h */
+        struct {
+                long long cycle;    /**< Duration of the last poll cycle [ms] or -1 */
+                unsigned long long memory;    /**< Monit resident memory [B] */
+                int queue;  /**< Events waiting in the event and delivery queue */
+        } self;                   /**< Monit's own resource usage, see check_system */
+        struct {
+                int delay;       /**< First restart backoff delay [s], 0 = no backoff */
+                int limit;                   /**< Maximum restart backoff delay [s] */
+        } restartBackoff;
+        struct {
+                int window;    /**< The first checks are spread over [s], 0 = no ramp */
+                int restarts;   /**< Maximum automatic (re)starts per interval in the ramp */
+                int interval;                  /**< The restart limit interval [s] */
+                long long end;                 /**< The current ramp ends at [ms], 0 = none */
+        } startupRamp;                              /**< Startup ramp, see validate.c */
+        struct {
+                int budget;  /**< Time budget of the checks in one cycle [ms], 0 = none */
+                unsigned long long deferrals;    /**< Checks deferred by the budget */
+                int last;       /**< Checks deferred by the budget in the last cycle */
+        } cycle;                                     /**< Cycle budget, see validate.c */
+        struct {
+                int failed;  /**< Re-check a failed or changed service after [s], 0 = next cycle */
+                int stable;    /**< Maximum check interval of a stable service [s], 0 = off */
+                int after;           /**< The service is stable after no error for [s] */
+        } adaptive;                   /**< Adaptive check interval, see validate.c */
+        struct {
+                boolean_t enabled;  /**< Collect the GPU statistics, see Gpu.h */
+        } gpu;
+        struct {
+                int ttl;              /**< DNS cache entry lifetime [s], 0 = no cache */
+        } resolverCache;
+        struct {
+                int interval; /**< Full TLS handshake interval of tested certificates [s] */
+        } certificateCache;
+        struct {
+                LogFormat_Type format;                    /**< Log file format */
+                int rateLimit;      /**< Maximum messages per site, 0 = no limit */
+                int rateInterval;                /**< Rate limit interval [s] */
+        } logging;
         SslOptions_T ssl;                                 /**< Default SSL options */
         int  polltime;        /**< In deamon mode, the sleeptime (sec) between run */
         int  startdelay;                    /**< the sleeptime (sec) after startup */
@@ -1114,6 +1849,7 @@ struct myrun {
         int  eventlist_slots;          /**< The event queue size - number of slots */
         int mailserver_timeout; /**< Connect and read timeout ms for a SMTP server */
         time_t incarnation;              /**< Unique ID for running monit instance */
+        unsigned long long generation; /**< Bumped when some service status changed */
         int  handler_queue[Handler_Max + 1];       /**< The handlers queue counter */
         Service_T system;                          /**< The general system service */
         char *eventlist_dir;                   /**< The event queue base directory */
@@ -1121,7 +1857,7 @@ struct myrun {
         /** An object holding Monit HTTP interface setup */
         struct {
                 Httpd_Flags flags;
-                union {
+                struct {
                         struct {
                                 int  port;
                                 char *address;
@@ -1176,8 +1912,12 @@ extern char *onrebootnames[];
 extern char *checksumnames[];
 extern char *operatornames[];
 extern char *operatorshortnames[];
+extern char *pressurenames[];
+extern char *pressurewindownames[];
 extern char *statusnames[];
 extern char *servicetypes[];
+extern char *metrictypenames[];
+extern char *quotatypenames[];
 extern char *pathnames[];
 extern char *icmpnames[];
 extern char *sslnames[];
@@ -1194,8 +1934,11 @@ extern char *sslnames[];
 /* FIXME: move remaining prototypes into seperate header-files */
 
 boolean_t parse(char *);
+boolean_t parse_discovered(const char *, Service_T *);
+void parse_profile();
 boolean_t control_service(const char *, Action_Type);
 boolean_t control_service_string(List_T, const char *);
+int  control_services(Service_T *, int, Action_Type, boolean_t *);
 void  spawn(Service_T, command_t, Event_T);
 boolean_t log_init();
 void  LogEmergency(const char *, ...) __attribute__((format (printf, 1, 2)));
@@ -1206,20 +1949,30 @@ void  LogWarning(const char *, ...) __attribute__((format (printf, 1, 2)));
 void  LogNotice(const char *, ...) __attribute__((format (printf, 1, 2)));
 void  LogInfo(const char *, ...) __attribute__((format (printf, 1, 2)));
 void  LogDebug(const char *, ...) __attribute__((format (printf, 1, 2)));
+void  LogStructured(int, const char **, const char *, ...) __attribute__((format (printf, 3, 4)));
 void  vLogError(const char *s, va_list ap);
 void  vLogAbortHandler(const char *s, va_list ap);
 void  log_close();
+void  log_start();
+void  log_stop();
+size_t log_memory();
 #ifndef HAVE_VSYSLOG
 #ifdef HAVE_SYSLOG
 void vsyslog (int, const char *, va_list);
 #endif /* HAVE_SYSLOG */
 #endif /* HAVE_VSYSLOG */
 int   validate();
+int   validate_scheduled();
+long long validate_next();
+void  validate_benchmark(int);
+void  validate_ramp();
+void  validate_childexit();
 void  daemonize();
 void  gc();
 void  gc_mail_list(Mail_T *);
 void  gccmd(command_t *);
 void  gc_event(Event_T *e);
+void  gc_service(Service_T *);
 boolean_t kill_daemon(int);
 int   exist_daemon();
 boolean_t sendmail(Mail_T);
@@ -1236,8 +1989,19 @@ State_Type check_system(Service_T);
 State_Type check_fifo(Service_T);
 State_Type check_program(Service_T);
 State_Type check_net(Service_T);
+State_Type check_socket(Service_T);
+State_Type check_heartbeat(Service_T);
+State_Type check_metric(Service_T);
+void  compile_resources(Service_T);
 int  check_URL(Service_T s);
 void status_xml(StringBuffer_T, Event_T, int, const char *);
+void status_xml_events(StringBuffer_T, Event_T *, int, int, const char *);
+unsigned long long status_xml_delta(StringBuffer_T, unsigned long long, int, const char *);
+unsigned long long status_xml_tag(int);
+void status_xml_reset();
+void status_json(StringBuffer_T, const char *, unsigned long long);
+void status_json_service(StringBuffer_T, Service_T);
+void status_prometheus(StringBuffer_T);
 boolean_t  do_wakeupcall();
 
 #endif
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_MONITPLUGIN_H
+#define MONIT_MONITPLUGIN_H
+
+#include <stddef.h>
+
+
+/**
+ * The plugin ABI of the in-process checks ('check plugin'). A plugin is a
+ * shared object which Monit loads with dlopen(3) and calls in the check
+ * cycle instead of forking a program. The plugin includes this header and
+ * exports the following symbols with C linkage:
+ *
+ * <pre>
+ * const int monit_plugin_abi = MONIT_PLUGIN_ABI;                      // required
+ * int  monit_plugin_init(const monit_plugin_host_t *host, int argc, char *argv[], void **context); // optional
+ * int  monit_plugin_check(void *context, char *output, size_t size);  // required
+ * void monit_plugin_free(void *context);                              // optional
+ * </pre>
+ *
+ * monit_plugin_init() is called once when the service is checked for the
+ * first time, argv[0] is the plugin path and the other arguments are the
+ * arguments from the control file. It returns 0 on success and may store a
+ * context which is passed to the other functions. monit_plugin_check()
+ * performs the check, writes a short message to the output buffer and
+ * returns the status which is tested like the exit status of a check
+ * program (0 usually means success). monit_plugin_free() is called when
+ * the service is removed, for example on reload.
+ *
+ * The check runs on the Monit check thread: it must not block longer than
+ * the check timeout, must not call exit(3) or change the signal handling,
+ * and must be reentrant if several services use the same plugin with
+ * different contexts. The plugin should use the host functions for the I/O,
+ * so the Monit timeouts and logging apply.
+ *
+ * @file
+ */
+
+
+#define MONIT_PLUGIN_ABI 1
+
+
+/**
+ * The functions Monit provides to the plugin. The structure is valid during
+ * the whole life of the plugin context.
+ */
+typedef struct monit_plugin_host {
+        int abi;                                          /**< MONIT_PLUGIN_ABI */
+        const char *service;                                    /**< Service name */
+        /** Log an informational message prefixed with the service name */
+        void (*log)(const struct monit_plugin_host *host, const char *format, ...) __attribute__((format (printf, 2, 3)));
+        /** Connect to the TCP host and port, timeout in milliseconds, returns NULL on error */
+        void *(*connect)(const char *host, int port, int timeout);
+        /** Connect to the unix socket, timeout in milliseconds, returns NULL on error */
+        void *(*connectUnix)(const char *path, int timeout);
+        /** Write the buffer to the connection, returns the number of bytes written or -1 on error */
+        int (*write)(void *connection, const void *buffer, size_t size);
+        /** Read at most size bytes from the connection, returns the number of bytes read or -1 on error */
+        int (*read)(void *connection, void *buffer, size_t size);
+        /** Read a line from the connection to the buffer, returns the buffer or NULL on error or end of input */
+        char *(*readLine)(void *connection, char *line, int size);
+        /** Close the connection */
+        void (*close)(void *connection);
+        /** Read at most size - 1 bytes of the file and terminate them with NUL, returns the number of bytes read or -1 on error */
+        long long (*readFile)(const char *path, char *buffer, size_t size);
+} monit_plugin_host_t;
+
+
+#endif
+
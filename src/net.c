@@ -138,6 +138,7 @@
 
 #include "monit.h"
 #include "net.h"
+#include "resolver.h"
 
 // libmonit
 #include "system/Net.h"
@@ -178,51 +179,31 @@ static unsigned short _checksum(unsigned char *_addr, int count) {
 
 
 
-/* ------------------------------------------------------------------ Public */
-
-
-boolean_t check_host(const char *hostname) {
-        ASSERT(hostname);
-        struct addrinfo hints = {
-#ifdef AI_ADDRCONFIG
-                .ai_flags = AI_ADDRCONFIG
-#endif
-        };
-        struct addrinfo *res;
-        if (getaddrinfo(hostname, NULL, &hints, &res) == 0) {
-                freeaddrinfo(res);
-                return true;
-        }
-        return false;
-}
-
-
-//FIXME: we support IPv4 only currently
-int create_server_socket(const char *address, int port, int backlog) {
-        int s = socket(AF_INET, SOCK_STREAM, 0);
+/**
+ * Create the server socket bound to the address
+ * @param dualstack If true, the socket is an IPv6 socket which accepts the
+ * IPv4 connections too. The errors are logged in the debug mode only, the
+ * caller falls back to an IPv4 socket.
+ */
+static int _createServerSocket(struct sockaddr *addr, socklen_t addrlen, int backlog, boolean_t dualstack) {
+        int s = socket(addr->sa_family, SOCK_STREAM, 0);
         if (s < 0) {
-                LogError("Cannot create socket -- %s\n", STRERROR);
+                if (dualstack)
+                        DEBUG("Cannot create IPv6 socket, listening on IPv4 only -- %s\n", STRERROR);
+                else
+                        LogError("Cannot create socket -- %s\n", STRERROR);
                 return -1;
         }
-        struct sockaddr_in addr;
-        memset(&addr, 0, sizeof(struct sockaddr_in));
-        if (address) {
-                struct addrinfo *result, hints = {
-                        .ai_family = AF_INET
-                };
-                int status = getaddrinfo(address, NULL, &hints, &result);
-                if (status) {
-                        LogError("Cannot translate '%s' to IP address -- %s\n", address, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+        int flag = 1;
+#ifdef HAVE_IPV6
+        if (dualstack) {
+                int off = 0;
+                if (setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) < 0) {
+                        DEBUG("Cannot create dual stack IPv6 socket, listening on IPv4 only -- %s\n", STRERROR);
                         goto error;
                 }
-                memcpy(&addr, result->ai_addr, result->ai_addrlen);
-                freeaddrinfo(result);
-        } else {
-                addr.sin_addr.s_addr = htonl(INADDR_ANY);
         }
-        addr.sin_family = AF_INET;
-        addr.sin_port = htons(port);
-        int flag = 1;
+#endif
         if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (char *)&flag, sizeof(flag)) < 0)  {
                 LogError("Cannot set reuseaddr option -- %s\n", STRERROR);
                 goto error;
@@ -233,8 +214,11 @@ int create_server_socket(const char *address, int port, int backlog) {
                 LogError("Cannot set close on exec option -- %s\n", STRERROR);
                 goto error;
         }
-        if (bind(s, (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) < 0) {
-                LogError("Cannot bind -- %s\n", STRERROR);
+        if (bind(s, addr, addrlen) < 0) {
+                if (dualstack && errno == EADDRNOTAVAIL)
+                        DEBUG("Cannot bind IPv6 socket, listening on IPv4 only -- %s\n", STRERROR);
+                else
+                        LogError("Cannot bind -- %s\n", STRERROR);
                 goto error;
         }
         if (listen(s, backlog) < 0) {
@@ -249,6 +233,67 @@ error:
 }
 
 
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t check_host(const char *hostname) {
+        ASSERT(hostname);
+        struct addrinfo hints = {
+#ifdef AI_ADDRCONFIG
+                .ai_flags = AI_ADDRCONFIG
+#endif
+        };
+        struct addrinfo *res;
+        if (Resolver_get(hostname, 0, &hints, &res) == 0) {
+                Resolver_free(res);
+                return true;
+        }
+        return false;
+}
+
+
+int create_server_socket(const char *address, int port, int backlog) {
+        if (address) {
+                // Prefer IPv4, so a hostname such as localhost keeps the IPv4 binding, an IPv6 address is accepted too
+                struct addrinfo *result, hints = {
+                        .ai_family = AF_INET,
+                        .ai_socktype = SOCK_STREAM
+                };
+                int status = getaddrinfo(address, NULL, &hints, &result);
+#ifdef HAVE_IPV6
+                if (status) {
+                        hints.ai_family = AF_INET6;
+                        status = getaddrinfo(address, NULL, &hints, &result);
+                }
+#endif
+                if (status) {
+                        LogError("Cannot translate '%s' to IP address -- %s\n", address, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+                        return -1;
+                }
+                struct sockaddr_storage addr = {};
+                socklen_t addrlen = result->ai_addrlen;
+                memcpy(&addr, result->ai_addr, addrlen);
+                freeaddrinfo(result);
+                if (addr.ss_family == AF_INET)
+                        ((struct sockaddr_in *)&addr)->sin_port = htons(port);
+#ifdef HAVE_IPV6
+                else
+                        ((struct sockaddr_in6 *)&addr)->sin6_port = htons(port);
+#endif
+                return _createServerSocket((struct sockaddr *)&addr, addrlen, backlog, false);
+        }
+#ifdef HAVE_IPV6
+        // Accept the IPv6 and IPv4 connections on one socket, the IPv4 clients connect with IPv4-mapped addresses
+        struct sockaddr_in6 any6 = {.sin6_family = AF_INET6, .sin6_port = htons(port), .sin6_addr = IN6ADDR_ANY_INIT};
+        int s = _createServerSocket((struct sockaddr *)&any6, sizeof(any6), backlog, true);
+        if (s >= 0)
+                return s;
+#endif
+        struct sockaddr_in any = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+        return _createServerSocket((struct sockaddr *)&any, sizeof(any), backlog, false);
+}
+
+
 int create_server_socket_unix(const char *path, int backlog) {
         int s = socket(AF_UNIX, SOCK_STREAM, 0);
         if (s < 0) {
@@ -471,7 +516,7 @@ double icmp_echo(const char *hostname, Socket_Family family, Outgoing_T *outgoin
                         LogError("Invalid socket family %d\n", family);
                         return response;
         }
-        int status = getaddrinfo(hostname, NULL, &hints, &result);
+        int status = Resolver_get(hostname, 0, &hints, &result);
         if (status) {
                 LogError("Ping for %s -- getaddrinfo failed: %s\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
                 return response;
@@ -525,7 +570,7 @@ error1:
         if (rv == -1)
                 LogError("Socket %d close failed -- %s\n", s, STRERROR);
 error2:
-        freeaddrinfo(result);
+        Resolver_free(result);
         return response;
 }
 
@@ -41,10 +41,25 @@
 #include <errno.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
 #include "monit.h"
 #include "socket.h"
 #include "event.h"
 #include "MMonit.h"
+#include "processor.h"
+
+// libmonit
+#include "system/Net.h"
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 
 
 /**
@@ -54,98 +69,277 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+/* A persistent connection idle for longer than this (seconds) is closed, the server has most likely dropped it meanwhile */
+#define MMONIT_IDLE 120
+
+
 /* ----------------------------------------------------------------- Private */
 
 
 /**
- * Send message to the server
+ * Get the connection to the server: the persistent connection if it is
+ * still open, otherwise a new one
+ * @param C An mmonit object
+ * @param reused Set to true if the persistent connection is reused
+ * @return The connection or NULL if the connection failed
+ */
+static Socket_T _connect(Mmonit_T C, boolean_t *reused) {
+        // A readable idle connection was closed by the server (or is out of sync), don't reuse it
+        if (C->connection.socket && (Time_now() - C->connection.used > MMONIT_IDLE || Net_canRead(Socket_getSocket(C->connection.socket), 0)))
+                Socket_free(&C->connection.socket);
+        *reused = C->connection.socket != NULL;
+        if (! C->connection.socket)
+                C->connection.socket = Socket_create(C->url->hostname, C->url->port, Socket_Tcp, Socket_Ip, C->ssl, C->timeout);
+        return C->connection.socket;
+}
+
+
+/**
+ * Send message to the server. The message is compressed if the server
+ * announced that it accepts gzip content (RFC 7694)
  * @param C An mmonit object
  * @param D Data to send
  * @return true if the message sending succeeded otherwise false
  */
 static boolean_t _send(Socket_T socket, Mmonit_T C, const char *D) {
+        int length = (int)strlen(D);
+        unsigned char *body = C->gzip && length >= GZIP_MIN_LENGTH ? Util_gzip(D, length, &length) : NULL;
         char *auth = Util_getBasicAuthHeader(C->url->user, C->url->password);
-        int rv = Socket_print(socket,
-                              "POST %s HTTP/1.1\r\n"
-                              "Host: %s:%d\r\n"
-                              "Content-Type: text/xml\r\n"
-                              "Content-Length: %lu\r\n"
-                              "Pragma: no-cache\r\n"
-                              "Accept: */*\r\n"
-                              "User-Agent: Monit/%s\r\n"
-                              "%s"
-                              "\r\n"
-                              "%s",
-                              C->url->path,
-                              C->url->hostname, C->url->port,
-                              (unsigned long)strlen(D),
-                              VERSION,
-                              auth ? auth : "",
-                              D);
+        StringBuffer_T header = StringBuffer_create(256);
+        StringBuffer_append(header,
+                            "POST %s HTTP/1.1\r\n"
+                            "Host: %s:%d\r\n"
+                            "Content-Type: text/xml\r\n"
+                            "Content-Length: %lu\r\n"
+                            "%s"
+                            "Pragma: no-cache\r\n"
+                            "Accept: */*\r\n"
+                            "User-Agent: Monit/%s\r\n"
+                            "%s"
+                            "\r\n",
+                            C->url->path,
+                            C->url->hostname, C->url->port,
+                            (unsigned long)length,
+                            body ? "Content-Encoding: gzip\r\n" : "",
+                            VERSION,
+                            auth ? auth : "");
+        // Send the header and the message in one write, a separate small write would wait for the delayed ACK of the server on a persistent connection
+        struct iovec iov[2] = {
+                {.iov_base = (void *)StringBuffer_toString(header), .iov_len = StringBuffer_length(header)},
+                {.iov_base = body ? (void *)body : (void *)D, .iov_len = length}
+        };
+        int rv = Socket_writev(socket, iov, 2);
+        StringBuffer_free(&header);
         FREE(auth);
-        if (rv <0) {
-                LogError("M/Monit: error sending data to %s -- %s\n", C->url->url, STRERROR);
+        FREE(body);
+        return rv >= 0;
+}
+
+
+/**
+ * Read the response body, so the next request on the connection starts
+ * at the next response
+ * @param length The Content-Length or -1 for a chunked body
+ * @return true if the body was read otherwise false
+ */
+static boolean_t _drain(Socket_T socket, long long length) {
+        char buf[STRLEN];
+        if (length < 0) {
+                // Chunked body: the size lines and chunks, ended by the zero size chunk and the trailer
+                while ((length = Socket_readLine(socket, buf, sizeof(buf)) ? strtoll(buf, NULL, 16) : -1) > 0)
+                        if (! _drain(socket, length + 2))
+                                return false;
+                if (length < 0)
+                        return false;
+                while (Socket_readLine(socket, buf, sizeof(buf)))
+                        if (! *Str_chomp(buf))
+                                return true;
                 return false;
         }
+        for (int n; length > 0; length -= n)
+                if ((n = Socket_read(socket, buf, length < (long long)sizeof(buf) ? (int)length : (int)sizeof(buf))) <= 0)
+                        return false;
         return true;
 }
 
 
 /**
- * Check that the server returns a valid HTTP response
+ * Check that the server returns a valid HTTP response. The Accept-Encoding
+ * response header tells if the server accepts compressed messages. The
+ * response body is read if the connection can be kept for the next message
  * @param C An mmonit object
+ * @param status Set to the response status code, 0 if no response was received
+ * @param keepalive Set to true if the connection can be reused
  * @return true if the response is valid otherwise false
  */
-static boolean_t _receive(Socket_T socket, Mmonit_T C) {
-        int  status;
+static boolean_t _receive(Socket_T socket, Mmonit_T C, int *status, boolean_t *keepalive) {
         char buf[STRLEN];
-        if (! Socket_readLine(socket, buf, sizeof(buf))) {
-                LogError("M/Monit: error receiving data from %s -- %s\n", C->url->url, STRERROR);
+        *status = 0;
+        *keepalive = false;
+        if (! Socket_readLine(socket, buf, sizeof(buf)))
                 return false;
-        }
         Str_chomp(buf);
-        int n = sscanf(buf, "%*s %d", &status);
-        if (n != 1 || (status >= 400)) {
+        int minor = 0;
+        int n = sscanf(buf, "HTTP/1.%d %d", &minor, status);
+        if (n != 2 || (*status >= 400)) {
                 LogError("M/Monit: message sending failed to %s -- %s\n", C->url->url, buf);
+                // Retry with an uncompressed message next time if the server refused the compressed one
+                if (*status == SC_UNSUPPORTED_MEDIA_TYPE)
+                        C->gzip = false;
+                if (! *status)
+                        *status = -1;
                 return false;
         }
+        // A HTTP/1.1 connection is persistent unless the server closes it, the body must be delimited to find the next response
+        boolean_t gzip = false;
+        boolean_t persistent = minor >= 1;
+        long long length = *status == 204 || *status == 304 ? 0 : LLONG_MIN;
+        char header[STRLEN];
+        while (Socket_readLine(socket, header, sizeof(header))) {
+                Str_chomp(header);
+                if (! *header)
+                        break;
+                if (Str_startsWith(header, "Accept-Encoding:"))
+                        gzip = Util_acceptsGzip(header + 16);
+                else if (Str_startsWith(header, "Content-Length:"))
+                        length = Str_parseLLong(Str_trim(header + 15));
+                else if (Str_startsWith(header, "Transfer-Encoding:") && Str_sub(header + 18, "chunked"))
+                        length = -1;
+                else if (Str_startsWith(header, "Connection:"))
+                        persistent = Str_sub(header + 11, "keep-alive") || (persistent && ! Str_sub(header + 11, "close"));
+        }
+        C->gzip = gzip;
+        *keepalive = persistent && length != LLONG_MIN && _drain(socket, length);
         return true;
 }
 
 
+/**
+ * Post the status with the events to the M/Monit server. The senders (the
+ * heartbeat, the event handler, the event queue and the delivery thread of
+ * the server) share the persistent connection, the server lock serializes
+ * them
+ * @param C An mmonit object
+ * @param E The events or NULL for status
+ * @param count The number of events
+ * @param sb The message buffer
+ * @return true if the server accepted the message otherwise false
+ */
+static boolean_t _postTo(Mmonit_T C, Event_T *E, int count, StringBuffer_T sb) {
+        boolean_t rv = false;
+        const char *kind = count > 1 ? "events" : count ? "event" : "status";
+        LOCK(C->mutex)
+        {
+                int status = 0;
+                boolean_t reused = false;
+                boolean_t keepalive = false;
+                boolean_t delta = false;
+                unsigned long long generation = 0;
+                for (Socket_T socket; (socket = _connect(C, &reused));) {
+                        char buf[STRLEN];
+                        StringBuffer_clear(sb);
+                        // A delta heartbeat lists only the services changed since the status the server accepted last, every Run.mmonitDelta.full-th heartbeat is full to resynchronize
+                        delta = ! count && Run.mmonitDelta.full && C->heartbeat.acknowledged && C->heartbeat.count + 1 < Run.mmonitDelta.full;
+                        if (delta) {
+                                generation = status_xml_delta(sb, C->heartbeat.acknowledged, 2, Socket_getLocalHost(socket, buf, sizeof(buf)));
+                        } else {
+                                generation = __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE);
+                                status_xml_events(sb, E, count, 2, Socket_getLocalHost(socket, buf, sizeof(buf)));
+                        }
+                        if (! _send(socket, C, StringBuffer_toString(sb))) {
+                                if (reused) {
+                                        // The server closed the persistent connection meanwhile, send the message on a new connection
+                                        Socket_free(&C->connection.socket);
+                                        continue;
+                                }
+                                LogError("M/Monit: cannot send %s message to %s -- %s\n", kind, C->url->url, STRERROR);
+                        } else if (_receive(socket, C, &status, &keepalive)) {
+                                rv = true;
+                                C->heartbeat.acknowledged = generation;
+                                C->heartbeat.count = delta ? C->heartbeat.count + 1 : 0;
+                                DEBUG("M/Monit: %s%s message sent to %s\n", delta ? "delta " : "", kind, C->url->url);
+                        } else if (! status && reused) {
+                                Socket_free(&C->connection.socket);
+                                continue;
+                        } else {
+                                // The server may have lost the state the delta refers to, send the full status next time
+                                C->heartbeat.acknowledged = 0;
+                                if (! status)
+                                        LogError("M/Monit: error receiving data from %s -- %s\n", C->url->url, STRERROR);
+                                LogError("M/Monit: %s message to %s failed\n", kind, C->url->url);
+                        }
+                        break;
+                }
+                if (! C->connection.socket)
+                        LogError("M/Monit: cannot open a connection to %s\n", C->url->url);
+                else if (keepalive)
+                        C->connection.used = Time_now();
+                else
+                        Socket_free(&C->connection.socket);
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+/**
+ * Post the status with the events to each M/Monit server
+ * @param E The events or NULL for status
+ * @param count The number of events
+ * @return If failed, return Handler_Mmonit flag or Handler_Succeeded flag if succeeded
+ */
+static Handler_Type _post(Event_T *E, int count) {
+        Handler_Type rv = Handler_Mmonit;
+        StringBuffer_T sb = StringBuffer_create(256);
+        for (Mmonit_T C = Run.mmonits; C; C = C->next)
+                if (_postTo(C, E, count, sb))
+                        rv = Handler_Succeeded; // Return success if at least one M/Monit succeeded
+        StringBuffer_free(&sb);
+        return rv;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
 Handler_Type MMonit_send(Event_T E) {
-        Handler_Type rv = Handler_Mmonit;
         /* The event is sent to mmonit just once - only in the case that the state changed */
         if (! Run.mmonits || (E && ! E->state_changed))
                 return Handler_Succeeded;
+        return _post(E ? &E : NULL, E ? 1 : 0);
+}
+
+
+Handler_Type MMonit_sendEvents(Event_T *E, int count) {
+        ASSERT(E);
+        if (! Run.mmonits || count < 1)
+                return Handler_Succeeded;
+        return _post(E, count);
+}
+
+
+Handler_Type MMonit_sendTo(Mmonit_T C, Event_T *E, int count) {
+        ASSERT(C);
+        ASSERT(E);
+        if (count < 1)
+                return Handler_Succeeded;
         StringBuffer_T sb = StringBuffer_create(256);
-        for (Mmonit_T C = Run.mmonits; C; C = C->next) {
-                Socket_T  socket = Socket_create(C->url->hostname, C->url->port, Socket_Tcp, Socket_Ip, C->ssl, C->timeout);
-                if (! socket) {
-                        LogError("M/Monit: cannot open a connection to %s\n", C->url->url);
-                        goto error;
-                }
-                char buf[STRLEN];
-                status_xml(sb, E, 2, Socket_getLocalHost(socket, buf, sizeof(buf)));
-                if (! _send(socket, C, StringBuffer_toString(sb))) {
-                        LogError("M/Monit: cannot send %s message to %s\n", E ? "event" : "status", C->url->url);
-                        goto error;
-                }
-                StringBuffer_clear(sb);
-                if (! _receive(socket, C)) {
-                        LogError("M/Monit: %s message to %s failed\n", E ? "event" : "status", C->url->url);
-                        goto error;
-                }
-                rv = Handler_Succeeded; // Return success if at least one M/Monit succeeded
-                DEBUG("M/Monit: %s message sent to %s\n", E ? "event" : "status", C->url->url);
-        error:
-                if (socket)
-                        Socket_free(&socket);
-        }
+        boolean_t sent = _postTo(C, E, count, sb);
         StringBuffer_free(&sb);
-        return rv;
+        return sent ? Handler_Succeeded : Handler_Mmonit;
+}
+
+
+void MMonit_close(Mmonit_T C) {
+        ASSERT(C);
+        LOCK(C->mutex)
+        {
+                if (C->connection.socket)
+                        Socket_free(&C->connection.socket);
+        }
+        END_LOCK;
 }
 
@@ -42,5 +42,34 @@
 Handler_Type MMonit_send(Event_T);
 
 
+/**
+ * Post several events in one message to M/Monit, see "set mmonit batch".
+ * The caller sends only the events whose state changed
+ * @param E The event objects
+ * @param count The number of events
+ * @return If failed, return Handler_Mmonit flag or Handler_Succeeded flag if succeeded
+ */
+Handler_Type MMonit_sendEvents(Event_T *E, int count);
+
+
+/**
+ * Post the events in one message to the given M/Monit server only. The
+ * servers have separate connections and locks, so the events can be sent
+ * to several servers at the same time by one thread per server
+ * @param C An mmonit object
+ * @param E The event objects
+ * @param count The number of events
+ * @return If failed, return Handler_Mmonit flag or Handler_Succeeded flag if succeeded
+ */
+Handler_Type MMonit_sendTo(Mmonit_T C, Event_T *E, int count);
+
+
+/**
+ * Close the persistent connection to the M/Monit server
+ * @param C An mmonit object
+ */
+void MMonit_close(Mmonit_T C);
+
+
 #endif
 
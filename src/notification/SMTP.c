@@ -64,6 +64,7 @@
 #include "SMTP.h"
 
 // libmonit
+#include "util/StringBuffer.h"
 #include "exceptions/IOException.h"
 
 
@@ -71,6 +72,7 @@
  * Implementation of the SMTP interface.
  *
  * RFCs:
+ *      https://tools.ietf.org/html/rfc2920
  *      https://tools.ietf.org/html/rfc3207
  *      https://tools.ietf.org/html/rfc4616
  *      https://tools.ietf.org/html/rfc4954
@@ -88,7 +90,8 @@ typedef enum {
         MTA_None      = 0x0,
         MTA_StartTLS  = 0x1,
         MTA_AuthPlain = 0x2,
-        MTA_AuthLogin = 0x4
+        MTA_AuthLogin = 0x4,
+        MTA_Pipelining = 0x8
 } __attribute__((__packed__)) MTA_Flags;
 
 
@@ -102,6 +105,7 @@ typedef enum {
         SMTP_RcptTo,
         SMTP_DataBegin,
         SMTP_DataCommit,
+        SMTP_Reset,
         SMTP_Quit
 } __attribute__((__packed__)) SMTP_State;
 
@@ -112,6 +116,11 @@ struct T {
         SMTP_State state;
         Socket_T socket;
         const char *name;
+        struct {
+                int count;                             /**< Number of queued commands */
+                int codes[3];             /**< Expected status codes of the commands */
+                StringBuffer_T commands;                /**< Commands not sent yet */
+        } pipeline;
 };
 
 
@@ -119,10 +128,15 @@ struct T {
 
 
 // Note: we parse currently only flags for which we have some use
-static void _parseFlags(T S, const char *line) {
+static void _parseFlags(void *data, const char *line) {
+        T S = data;
+        if (strlen(line) < 4)
+                return;
         const char *flag = line + 4;
         if (Str_startsWith(flag, "STARTTLS")) {
                 S->flags |= MTA_StartTLS;
+        } else if (Str_startsWith(flag, "PIPELINING")) {
+                S->flags |= MTA_Pipelining;
         } else if (Str_startsWith(flag, "AUTH")) {
                 if (Str_sub(flag, " PLAIN"))
                         S->flags |= MTA_AuthPlain;
@@ -144,18 +158,70 @@ static void _send(T S, const char *data, ...) {
 }
 
 
-static void _receive(T S, int code, void (*callback)(T S, const char *line)) {
-        int status = 0;
+static void _receive(T S, int code, void (*callback)(void *data, const char *line)) {
         char line[STRLEN];
-        do {
-                if (! Socket_readLine(S->socket, line, sizeof(line)))
-                        THROW(IOException, "Error receiving data from the mailserver -- %s", STRERROR);
-                Str_chomp(line);
-                if (strlen(line) < 4 || sscanf(line, "%d", &status) != 1 || status != code)
-                        THROW(IOException, "Mailserver response error -- %s", line);
-                if (callback)
-                        callback(S, line);
-        } while (line[3] == '-'); // multi-line response
+        int status = Socket_readResponse(S->socket, line, sizeof(line), callback, S);
+        if (status < 0)
+                THROW(IOException, "Error receiving data from the mailserver -- %s", STRERROR);
+        if (status != code)
+                THROW(IOException, "Mailserver response error -- %s", line);
+}
+
+
+// Queue the command if the server supports pipelining (RFC 2920), otherwise send it and check the response
+static void _command(T S, int code, const char *data, ...) {
+        va_list ap;
+        va_start(ap, data);
+        char *msg = Str_vcat(data, ap);
+        va_end(ap);
+        if (S->flags & MTA_Pipelining) {
+                if (! S->pipeline.commands)
+                        S->pipeline.commands = StringBuffer_create(256);
+                StringBuffer_append(S->pipeline.commands, "%s", msg);
+                S->pipeline.codes[S->pipeline.count++] = code;
+                FREE(msg);
+        } else {
+                TRY
+                {
+                        _send(S, "%s", msg);
+                }
+                FINALLY
+                {
+                        FREE(msg);
+                }
+                END_TRY;
+                _receive(S, code, NULL);
+        }
+}
+
+
+// Send the queued commands at once and check the responses in order. All responses are read, to keep in sync with the server, and the first failure is reported.
+static void _flush(T S) {
+        if (S->pipeline.count) {
+                int count = S->pipeline.count;
+                S->pipeline.count = 0;
+                _send(S, "%s", StringBuffer_toString(S->pipeline.commands));
+                StringBuffer_clear(S->pipeline.commands);
+                char error[STRLEN] = {};
+                for (int i = 0; i < count; i++) {
+                        char line[STRLEN];
+                        int status = Socket_readResponse(S->socket, line, sizeof(line), NULL, NULL);
+                        if (status < 0)
+                                THROW(IOException, "Error receiving data from the mailserver -- %s", STRERROR);
+                        if (status == 0)
+                                THROW(IOException, "Mailserver response error -- %s", line);
+                        if (status != S->pipeline.codes[i]) {
+                                if (! *error)
+                                        snprintf(error, sizeof(error), "%s", line);
+                        } else if (status == 354 && *error) {
+                                // The server accepted the DATA command though a previous command failed, terminate the empty message
+                                _send(S, ".\r\n");
+                                _receive(S, 250, NULL);
+                        }
+                }
+                if (*error)
+                        THROW(IOException, "Mailserver response error -- %s", error);
+        }
 }
 
 
@@ -184,12 +250,22 @@ void SMTP_free(T *S) {
         }
         FINALLY
         {
+                if ((*S)->pipeline.commands)
+                        StringBuffer_free(&((*S)->pipeline.commands));
                 FREE(*S);
         }
         END_TRY;
 }
 
 
+void SMTP_discard(T *S) {
+        ASSERT(S && *S);
+        if ((*S)->pipeline.commands)
+                StringBuffer_free(&((*S)->pipeline.commands));
+        FREE(*S);
+}
+
+
 void SMTP_greeting(T S) {
         ASSERT(S);
         _receive(S, 220, NULL);
@@ -290,8 +366,7 @@ void SMTP_auth(T S, const char *username, const char *password) {
 void SMTP_from(T S, const char *from) {
         ASSERT(S);
         ASSERT(from);
-        _send(S, "MAIL FROM: <%s>\r\n", from);
-        _receive(S, 250, NULL);
+        _command(S, 250, "MAIL FROM: <%s>\r\n", from);
         S->state = SMTP_MailFrom;
 }
 
@@ -299,20 +374,29 @@ void SMTP_from(T S, const char *from) {
 void SMTP_to(T S, const char *to) {
         ASSERT(S);
         ASSERT(to);
-        _send(S, "RCPT TO: <%s>\r\n", to);
-        _receive(S, 250, NULL);
+        _command(S, 250, "RCPT TO: <%s>\r\n", to);
         S->state = SMTP_RcptTo;
 }
 
 
 void SMTP_dataBegin(T S) {
         ASSERT(S);
-        _send(S, "DATA\r\n");
-        _receive(S, 354, NULL);
+        _command(S, 354, "DATA\r\n");
+        _flush(S);
         S->state = SMTP_DataBegin;
 }
 
 
+void SMTP_data(T S, const char *content) {
+        ASSERT(S);
+        ASSERT(content);
+        // One write for the content and the end of data mark, a separate small write would wait for the delayed ACK of the server
+        _send(S, "%s\r\n.\r\n", content);
+        _receive(S, 250, NULL);
+        S->state = SMTP_DataCommit;
+}
+
+
 void SMTP_dataCommit(T S) {
         ASSERT(S);
         _send(S, "\r\n.\r\n");
@@ -321,6 +405,14 @@ void SMTP_dataCommit(T S) {
 }
 
 
+void SMTP_reset(T S) {
+        ASSERT(S);
+        _send(S, "RSET\r\n");
+        _receive(S, 250, NULL);
+        S->state = SMTP_Reset;
+}
+
+
 void SMTP_quit(T S) {
         _send(S, "QUIT\r\n");
         _receive(S, 221, NULL);
@@ -107,6 +107,15 @@ T SMTP_new(Socket_T socket);
 void SMTP_free(T *S);
 
 
+/**
+ * Destroy the SMTP protocol object without sending the QUIT command,
+ * used when the connection to the server was lost.
+ * @param S A reference to the SMTP protocol object
+ * @exception AssertException if reference is NULL
+ */
+void SMTP_discard(T *S);
+
+
 /**
  * Read an SMTP server greeting and check for status code 220 in
  * response.
@@ -149,7 +158,8 @@ void SMTP_auth(T S, const char *username, const char *password);
 
 /**
  * Send a MAIL FROM command to the SMTP server and check for status
- * code 250 in response.
+ * code 250 in response. If the server supports pipelining, the command
+ * is sent and checked with the DATA command (see SMTP_dataBegin()).
  * @param S The SMTP protocol object
  * @param from A sender address
  * @exception AssertException if S or from is NULL, IOException if failed
@@ -159,7 +169,8 @@ void SMTP_from(T S, const char *from);
 
 /**
  * Send a RCPT TO command to the SMTP server and check for status
- * code 250 in response.
+ * code 250 in response. If the server supports pipelining, the command
+ * is sent and checked with the DATA command (see SMTP_dataBegin()).
  * @param S The SMTP protocol object
  * @param to A recipient address
  * @exception AssertException if S or to is NULL, IOException if failed
@@ -169,13 +180,25 @@ void SMTP_to(T S, const char *to);
 
 /**
  * Send a DATA command to the SMTP server and check for status
- * code 354 in response.
+ * code 354 in response. If the server supports pipelining, the queued
+ * MAIL FROM and RCPT TO commands are sent with it in one write.
  * @param S The SMTP protocol object
  * @exception AssertException if S is NULL, IOException if failed
  */
 void SMTP_dataBegin(T S);
 
 
+/**
+ * Send the message content (headers and body, with the lines starting
+ * with a dot escaped) and commit SMTP DATA, check for status code 250
+ * in response.
+ * @param S The SMTP protocol object
+ * @param content The message content
+ * @exception AssertException if S or content is NULL, IOException if failed
+ */
+void SMTP_data(T S, const char *content);
+
+
 /**
  * Commit SMTP DATA and check for status code 250 in response.
  * @param S The SMTP protocol object
@@ -184,6 +207,16 @@ void SMTP_dataBegin(T S);
 void SMTP_dataCommit(T S);
 
 
+/**
+ * Send a RSET command to the SMTP server and check for status code
+ * 250 in response. Used to start the next mail transaction on a
+ * session kept open.
+ * @param S The SMTP protocol object
+ * @exception AssertException if S is NULL, IOException if failed
+ */
+void SMTP_reset(T S);
+
+
 /**
  * Send a QUIT command to the SMTP server and check for status
  * code 221 in response.
@@ -125,10 +125,19 @@
 #include "ProcessTree.h"
 #include "device.h"
 #include "processor.h"
+#include "regexcache.h"
+#include "series.h"
+#include "isolation.h"
+#include "statussegment.h"
+#include "ioprobe.h"
+#include "plugin.h"
+#include "discovery.h"
 
 // libmonit
 #include "io/File.h"
 #include "util/Str.h"
+#include "util/Arena.h"
+#include "util/HashMap.h"
 #include "thread/Thread.h"
 
 
@@ -153,6 +162,8 @@ void  yyerror(const char *,...);
 void  yyerror2(const char *,...);
 void  yywarning(const char *,...);
 void  yywarning2(const char *,...);
+void  hashtoken(const char *, int);
+void  hashsection(boolean_t);
 
 /* lexer interface */
 int yylex(void);
@@ -164,6 +175,11 @@ extern char *argyytext;
 extern char *currentfile;
 extern char *argcurrentfile;
 extern int buffer_stack_ptr;
+extern void lexbegin(const char *);
+extern void lexreset(void);
+
+/* Exported to the lexer */
+boolean_t discovering = false;           /**< A discovery file is parsed */
 
 /* Local variables */
 static int cfg_errflag = 0;
@@ -174,6 +190,7 @@ static command_t command = NULL;
 static command_t command1 = NULL;
 static command_t command2 = NULL;
 static Service_T depend_list = NULL;
+static Service_T discovered = NULL;      /**< The services of the discovery file */
 static struct myuid uidset;
 static struct mygid gidset;
 static struct mypid pidset;
@@ -184,6 +201,8 @@ static struct mystatus statusset;
 static struct myperm permset;
 static struct mysize sizeset;
 static struct myuptime uptimeset;
+static struct myresponsetime responsetimeset;
+static struct mygrowth growthset;
 static struct mylinkstatus linkstatusset;
 static struct mylinkspeed linkspeedset;
 static struct mylinksaturation linksaturationset;
@@ -195,7 +214,9 @@ static struct SslOptions_T sslset;
 static struct myport portset;
 static struct mymailserver mailserverset;
 static struct mymmonit mmonitset;
+static struct myfederationagent federationset;
 static struct myfilesystem filesystemset;
+static struct myquota quotaset;
 static struct myresource resourceset;
 static struct mychecksum checksumset;
 static struct mytimestamp timestampset;
@@ -209,14 +230,29 @@ static unsigned repeat = 0;
 static unsigned repeat1 = 0;
 static unsigned repeat2 = 0;
 static Digest_Type digesttype = Digest_Cleartext;
+static struct {
+        boolean_t service;            /**< The current section is a check statement */
+        unsigned long long section;                 /**< Hash of the current section */
+        unsigned long long global;                  /**< Hash of the set statements */
+} confighash;
+static HashMap_T servicegroupindex = NULL;    /**< Service groups by name */
+
+#define CONFIGHASH_SEED 14695981039346656037ULL
+#define CONFIGHASH_PRIME 1099511628211ULL
 
 #define BITMAP_MAX (sizeof(long long) * 8)
 
+/* The configuration objects of a service are allocated from its memory region, see gc.c */
+#define CONFIG_REGION 1024
+#define REGION_NEW(s, p) ((p) = Arena_calloc((s)->region, 1, (long)sizeof *(p)))
+
 
 /* -------------------------------------------------------------- Prototypes */
 
 static void  preparse();
 static void  postparse();
+static void  reset_sets();
+static void  completeservice(Service_T);
 static boolean_t _parseOutgoingAddress(const char *ip, Outgoing_T *outgoing);
 static void  addmail(char *, Mail_T, Mail_T *);
 static Service_T createservice(Service_Type, char *, char *, State_Type (*)(Service_T));
@@ -226,10 +262,19 @@ static void  addservicegroup(char *);
 static void  addport(Port_T *, Port_T);
 static void  addhttpheader(Port_T, const char *);
 static void  addresource(Resource_T);
+static void  setpressure(Resource_Type, int);
+static void  setaverage(Resource_Type, int, int);
+static void  setgpuresource(Resource_Type, Operator_Type, double);
+static void  adddirscan(void);
+static void  addfileset(void);
+static void  addtreesum(Checksum_T);
 static void  addtimestamp(Timestamp_T);
+static void  addheartbeat(int, Action_Type, Action_Type);
 static void  addactionrate(ActionRate_T);
 static void  addsize(Size_T);
 static void  adduptime(Uptime_T);
+static void  addresponsetime(ResponseTime_T);
+static void  addgrowth(Growth_T);
 static void  addpid(Pid_T);
 static void  addppid(Pid_T);
 static void  addfsflag(Fsflag_T);
@@ -239,11 +284,14 @@ static void  addlinkspeed(Service_T, LinkSpeed_T);
 static void  addlinksaturation(Service_T, LinkSaturation_T);
 static void  addbandwidth(Bandwidth_T *, Bandwidth_T);
 static void  addfilesystem(Filesystem_T);
+static void  addquota(Quota_T);
+static int   get_projid(char *);
 static void  addicmp(Icmp_T);
 static void  addgeneric(Port_T, char*, char*);
 static void  addcommand(int, unsigned);
 static void  addargument(char *);
 static void  addmmonit(Mmonit_T);
+static void  addfederationagent(FederationAgent_T);
 static void  addmailserver(MailServer_T);
 static boolean_t addcredentials(char *, char *, Digest_Type, boolean_t);
 #ifdef HAVE_LIBPAM
@@ -262,20 +310,33 @@ static Gid_T addgid(Gid_T);
 static void  addeuid(uid_t);
 static void  addegid(gid_t);
 static void  addeventaction(EventAction_T *, Action_Type, Action_Type);
+static command_t _regioncommand(Service_T, command_t *);
+static void  _addeventaction(Service_T, EventAction_T *, Action_Type, Action_Type);
 static void  prepare_urlrequest(URL_T U);
 static void  seturlrequest(int, char *);
+static Http2Request_T addhttp2request(char *);
+static void  addhttp2content(int, char *);
+static void  addhttp2header(const char *);
+static void  addgrpcservice(char *);
+static void  addservermetric(char *, Operator_Type, double, char *, boolean_t);
+static void  checksnmp(Port_T);
 static void  setlogfile(char *);
+static void  setjournal();
+static void  setlogratelimit(int, int);
 static void  setpidfile(char *);
 static void  reset_sslset();
 static void  reset_mailset();
 static void  reset_mailserverset();
 static void  reset_mmonitset();
+static void  reset_federationset();
 static void  reset_portset();
 static void  reset_resourceset();
 static void  reset_timestampset();
 static void  reset_actionrateset();
 static void  reset_sizeset();
 static void  reset_uptimeset();
+static void  reset_responsetimeset();
+static void  reset_growthset();
 static void  reset_pidset();
 static void  reset_ppidset();
 static void  reset_fsflagset();
@@ -290,13 +351,17 @@ static void  reset_uidset();
 static void  reset_gidset();
 static void  reset_statusset();
 static void  reset_filesystemset();
+static void  reset_quotaset();
 static void  reset_icmpset();
 static void  reset_rateset(struct myrate *);
 static void  check_name(char *);
 static int   check_perm(int);
 static void  check_exec(char *);
+static void  check_plugin(char *);
 static int   cleanup_hash_string(char *);
 static void  check_depend();
+static void  depend_visit(Service_T, Service_T **);
+static boolean_t discovered_visit(Service_T, Service_T **);
 static void  setsyslog(char *);
 static command_t copycommand(command_t);
 static int verifyMaxForward(int);
@@ -313,32 +378,49 @@ static int verifyMaxForward(int);
 
 %token IF ELSE THEN OR FAILED
 %token SET LOGFILE FACILITY DAEMON SYSLOG MAILSERVER HTTPD ALLOW REJECTOPT ADDRESS INIT TERMINAL BATCH
-%token READONLY CLEARTEXT MD5HASH SHA1HASH CRYPT DELAY
+%token PROCESS EVENTS COLLECTOR ACCOUNTING
+%token READONLY CLEARTEXT MD5HASH SHA1HASH SHA256HASH XXH64HASH CRYPT DELAY
 %token PEMFILE ENABLE DISABLE SSL CLIENTPEMFILE ALLOWSELFCERTIFICATION SELFSIGNED VERIFY CERTIFICATE CACERTIFICATEFILE CACERTIFICATEPATH VALID
 %token INTERFACE LINK PACKET BYTEIN BYTEOUT PACKETIN PACKETOUT SPEED SATURATION UPLOAD DOWNLOAD TOTAL
 %token IDFILE STATEFILE SEND EXPECT CYCLE COUNT REMINDER REPEAT
-%token LIMITS SENDEXPECTBUFFER EXPECTBUFFER FILECONTENTBUFFER HTTPCONTENTBUFFER PROGRAMOUTPUT NETWORKTIMEOUT
+%token LIMITS SENDEXPECTBUFFER EXPECTBUFFER FILECONTENTBUFFER HTTPCONTENTBUFFER PROGRAMOUTPUT NETWORKTIMEOUT SOCKETBUFFER
 %token PIDFILE START STOP PATHTOK
 %token HOST HOSTNAME PORT IPV4 IPV6 TYPE UDP TCP TCPSSL PROTOCOL CONNECTION
+%token CONNECTIONS ESTABLISHED TIMEWAIT CLOSEWAIT LISTENSOCKETS LISTENQUEUE LISTENDROPS
 %token ALERT NOALERT MAILFORMAT UNIXSOCKET SIGNATURE
 %token TIMEOUT RETRY RESTART CHECKSUM EVERY NOTEVERY
 %token DEFAULT HTTP HTTPS APACHESTATUS FTP SMTP SMTPS POP POPS IMAP IMAPS CLAMAV NNTP NTP3 MYSQL DNS WEBSOCKET
 %token SSH DWP LDAP2 LDAP3 RDATE RSYNC TNS PGSQL POSTFIXPOLICY SIP LMTP GPS RADIUS MEMCACHE REDIS MONGODB SIEVE
+%token HTTP2 LATENCY GRPC SERVICE PIPELINE METRIC SNMP COMMUNITY PRIVACY
 %token <string> STRING PATH MAILADDR MAILFROM MAILSENDER MAILREPLYTO MAILSUBJECT
-%token <string> MAILBODY SERVICENAME STRINGNAME
+%token <string> MAILBODY SERVICENAME STRINGNAME MEMINFO
 %token <number> NUMBER PERCENT LOGLIMIT CLOSELIMIT DNSLIMIT KEEPALIVELIMIT
 %token <number> REPLYLIMIT REQUESTLIMIT STARTLIMIT WAITLIMIT GRACEFULLIMIT
-%token <number> CLEANUPLIMIT
+%token <number> CLEANUPLIMIT RESPONSETIME PRESSURE PRIORITY
 %token <real> REAL
-%token CHECKPROC CHECKFILESYS CHECKFILE CHECKDIR CHECKHOST CHECKSYSTEM CHECKFIFO CHECKPROGRAM CHECKNET
+%token CHECKPROC CHECKFILESYS CHECKFILE CHECKDIR CHECKHOST CHECKSYSTEM CHECKFIFO CHECKPROGRAM CHECKNET CHECKSOCKET CHECKHEARTBEAT CHECKMETRIC CHECKPLUGIN
 %token THREADS CHILDREN STATUS ORIGIN VERSIONOPT
+%token DISKREAD DISKWRITE VOLUNTARYCONTEXTSWITCHES NONVOLUNTARYCONTEXTSWITCHES FILEDESCRIPTORS
+%token AFFINITY IOPRIO IOPRIOIDLE MONITCYCLE MONITMEMORY MONITQUEUE
+%token PROGRAMCPU PROGRAMMEMORY PROGRAMRUNTIME
+%token GPU GPUUSAGE GPUMEMORY GPUTEMPERATURE GPUECC
+%token CGROUP CHECKWORKERS CONTROLWORKERS FILEEVENTS PRESSUREEVENTS ADAPTIVE SPREAD CHECKSUMCACHE CHECKSUMWORKERS
+%token LOWMEMORY LAUNCHER RESTARTBACKOFF STATUSSEGMENT ADAPTIVECHECKS STABLE AFTER
+%token STARTUPRAMP
+%token CYCLEBUDGET PRIORITYHIGH
+%token PROBETIMEOUT PROBEWORKERS TREECHECKSUM HEARTBEATSOCKET NOHEARTBEAT DISCOVERYDIRECTORY
+%token STATSD METRICVALUE METRICRATE METRICMAX
+%token FILES OLDEST NEWEST SCAN DEPTH INCREMENTAL SERIES AVERAGE GROWS
+%token DISKSERVICETIME DISKUTILIZATION OPERATION STATBATCH EVENTDELIVERY SYNC DIGEST
 %token RESOURCE MEMORY TOTALMEMORY LOADAVG1 LOADAVG5 LOADAVG15 SWAP
-%token MODE ACTIVE PASSIVE MANUAL ONREBOOT NOSTART LASTSTATE CPU TOTALCPU CPUUSER CPUSYSTEM CPUWAIT
+%token MODE ACTIVE PASSIVE MANUAL ONREBOOT NOSTART LASTSTATE CPU TOTALCPU CPUUSER CPUSYSTEM CPUWAIT CPUSTEAL ANYCPU ANYTHREADCPU
+%token CPUCORE CPUMACHINE
 %token GROUP REQUEST DEPENDS BASEDIR SLOT EVENTQUEUE SECRET HOSTHEADER
 %token UID EUID GID MMONIT INSTANCE USERNAME PASSWORD
 %token TIMESTAMP CHANGED MILLISECOND SECOND MINUTE HOUR DAY MONTH
 %token SSLAUTO SSLV2 SSLV3 TLSV1 TLSV11 TLSV12 CERTMD5 AUTO
 %token BYTE KILOBYTE MEGABYTE GIGABYTE
+%token QUOTA
 %token INODE SPACE TFREE PERMISSION SIZE MATCH NOT IGNORE ACTION UPTIME
 %token EXEC UNMONITOR PING PING4 PING6 ICMP ICMPECHO NONEXIST EXIST INVALID DATA RECOVERED PASSED SUCCEEDED
 %token URL CONTENT PID PPID FSFLAG
@@ -348,8 +430,15 @@ static int verifyMaxForward(int);
 %token <string> TARGET TIMESPEC HTTPHEADER
 %token <number> MAXFORWARD
 %token FIPS
+%token FEDERATION AGENT CLUSTER
+%token HEARTBEATDELTA FULLEVERY DNSCACHE CERTIFICATECACHE PINGBATCH UDPBATCH PERSISTENT OUTPUT ASYNC LOGBUFFER
+%token FORMAT TEXT JSON JOURNAL JOURNALD RATELIMIT
+%token CONTAINER
 
 %left GREATER GREATEROREQUAL LESS LESSOREQUAL EQUAL NOTEQUAL
+/* A content test after "protocol http2" belongs to the last HTTP/2 request, not to the url request */
+%nonassoc HTTP2
+%nonassoc CONTENT
 
 
 %%
@@ -365,9 +454,37 @@ statement       : setalert
                 | setssl
                 | setdaemon
                 | setterminal
+                | setprocess
+                | setgpu
+                | setcheckworkers
+                | setcontrolworkers
+                | setfileevents
+                | setpressureevents
+                | setchecksumcache
+                | setstatbatch
+                | setpingbatch
+                | setudpbatch
+                | setchecksumworkers
+                | setprobetimeout
+                | setprobeworkers
+                | setheartbeatsocket
+                | setdiscovery
+                | setstatsd
+                | seteventdelivery
+                | setseries
+                | setdnscache
+                | setcertificatecache
+                | setrestartbackoff
+                | setstartupramp
+                | setcyclebudget
+                | setadaptivechecks
+                | setstatussegment
                 | setlog
                 | seteventqueue
                 | setmmonits
+                | setfederation
+                | setmmonitbatch
+                | setmmonitdelta
                 | setmailservers
                 | setmailformat
                 | sethttpd
@@ -377,6 +494,8 @@ statement       : setalert
                 | setexpectbuffer
                 | setinit
                 | setlimits
+                | setlowmemory
+                | setlauncher
                 | setfips
                 | checkproc optproclist
                 | checkfile optfilelist
@@ -386,7 +505,11 @@ statement       : setalert
                 | checksystem optsystemlist
                 | checkfifo optfifolist
                 | checkprogram optprogramlist
+                | checkplugin optprogramlist
                 | checknet optnetlist
+                | checksocket optsocketlist
+                | checkheartbeat optheartbeatlist
+                | checkmetric optmetriclist
                 ;
 
 optproclist     : /* EMPTY */
@@ -406,14 +529,17 @@ optproc         : start
                 | connection
                 | connectionurl
                 | connectionunix
+                | responsetime
                 | actionrate
                 | alert
                 | every
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 | resourceprocess
+                | growth
                 ;
 
 optfilelist      : /* EMPTY */
@@ -433,9 +559,11 @@ optfile         : start
                 | gid
                 | checksum
                 | size
+                | growth
                 | match
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 ;
@@ -455,11 +583,15 @@ optfilesys      : start
                 | gid
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 | inode
                 | space
+                | quota
                 | fsflag
+                | resourcefs
+                | growth
                 ;
 
 optdirlist      : /* EMPTY */
@@ -479,8 +611,13 @@ optdir          : start
                 | gid
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
+                | dirscan
+                | treechecksum
+                | resourcedir
+                | growth
                 ;
 
 opthostlist     : /* EMPTY */
@@ -492,12 +629,15 @@ opthost         : start
                 | restart
                 | connection
                 | connectionurl
+                | responsetime
+                | growth
                 | icmp
                 | actionrate
                 | alert
                 | every
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 ;
@@ -518,6 +658,61 @@ optnet          : start
                 | every
                 | mode
                 | onreboot
+                | priorityhigh
+                | alert
+                | group
+                | depend
+                ;
+
+optsocketlist   : /* EMPTY */
+                | optsocketlist optsocket
+                ;
+
+optsocket       : start
+                | stop
+                | restart
+                | resourcesocket
+                | actionrate
+                | every
+                | mode
+                | onreboot
+                | priorityhigh
+                | alert
+                | group
+                | depend
+                ;
+
+optheartbeatlist : /* EMPTY */
+                | optheartbeatlist optheartbeat
+                ;
+
+optheartbeat    : start
+                | stop
+                | restart
+                | heartbeat
+                | actionrate
+                | every
+                | mode
+                | onreboot
+                | priorityhigh
+                | alert
+                | group
+                | depend
+                ;
+
+optmetriclist   : /* EMPTY */
+                | optmetriclist optmetric
+                ;
+
+optmetric       : start
+                | stop
+                | restart
+                | resourcemetric
+                | actionrate
+                | every
+                | mode
+                | onreboot
+                | priorityhigh
                 | alert
                 | group
                 | depend
@@ -535,10 +730,12 @@ optsystem       : start
                 | every
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 | resourcesystem
                 | uptime
+                | growth
                 ;
 
 optfifolist     : /* EMPTY */
@@ -558,6 +755,7 @@ optfifo         : start
                 | gid
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 ;
@@ -574,9 +772,11 @@ optprogram      : start
                 | every
                 | mode
                 | onreboot
+                | priorityhigh
                 | group
                 | depend
                 | statusvalue
+                | resourceprogram
                 ;
 
 setalert        : SET alertmail formatlist reminder {
@@ -590,9 +790,12 @@ setalert        : SET alertmail formatlist reminder {
                    mailset.events = ~mailset.events;
                    addmail($<string>2, &mailset, &Run.maillist);
                   }
+                | SET ALERT DIGEST NUMBER SECOND {
+                    Run.alertDigest.window = $4;
+                  }
                 ;
 
-setdaemon       : SET DAEMON NUMBER startdelay {
+setdaemon       : SET DAEMON NUMBER startdelay pacing {
                     if (! (Run.flags & Run_Daemon) || ihp.daemon) {
                       ihp.daemon     = true;
                       Run.flags      |= Run_Daemon;
@@ -600,6 +803,41 @@ setdaemon       : SET DAEMON NUMBER startdelay {
                       Run.startdelay = $<number>4;
                     }
                   }
+                | SET DAEMON AFFINITY STRING {
+                        if (! Isolation_isCpuList($4))
+                                yyerror2("Invalid CPU list '%s' -- expected for example \"0-3,8\"", $4);
+                        FREE(Run.isolation.affinity);
+                        Run.isolation.affinity = $4;
+                  }
+                | SET DAEMON AFFINITY NUMBER {
+                        FREE(Run.isolation.affinity);
+                        Run.isolation.affinity = Str_cat("%d", $4);
+                  }
+                | SET DAEMON PRIORITY {
+                        Run.isolation.policy = $3;
+                  }
+                | SET DAEMON IOPRIOIDLE {
+                        Run.isolation.ioClass = IoPriority_Idle;
+                  }
+                | SET DAEMON IOPRIO NUMBER {
+                        if ($4 > 7)
+                                yyerror2("The I/O priority level must be in the range 0-7");
+                        Run.isolation.ioClass = IoPriority_BestEffort;
+                        Run.isolation.ioLevel = $4;
+                  }
+                | SET DAEMON CGROUP PATH {
+                        FREE(Run.isolation.cgroup);
+                        Run.isolation.cgroup = $4;
+                  }
+                ;
+
+pacing          : /* EMPTY */
+                | ADAPTIVE {
+                        Run.flags |= Run_PacingAdaptive;
+                  }
+                | ADAPTIVE SPREAD {
+                        Run.flags |= Run_PacingAdaptive | Run_PacingSpread;
+                  }
                 ;
 
 setterminal     : SET TERMINAL BATCH {
@@ -607,6 +845,264 @@ setterminal     : SET TERMINAL BATCH {
                   }
                 ;
 
+setgpu          : SET GPU {
+                        Run.gpu.enabled = true;
+                  }
+                ;
+
+setprocess      : SET PROCESS EVENTS {
+                        Run.flags |= Run_ProcessEvents;
+                  }
+                | SET PROCESS ACCOUNTING {
+                        Run.flags |= Run_ExitAccounting;
+                  }
+                | SET PROCESS COLLECTOR THREADS NUMBER {
+                        if ($5 < 1)
+                                yyerror2("The number of process collector threads must be greater than 0");
+                        Run.processEngine.collectorThreads = $5;
+                  }
+                | SET PROCESS CPUCORE {
+                        Run.flags |= Run_ProcessCpuCore;
+                  }
+                | SET PROCESS CPUMACHINE {
+                        Run.flags &= ~Run_ProcessCpuCore;
+                  }
+                ;
+
+setfileevents   : SET FILEEVENTS {
+                        Run.flags |= Run_FileEvents;
+                  }
+                | SET FILEEVENTS EVERY NUMBER CYCLE {
+                        if ($4 < 1)
+                                yyerror2("The number of file events re-check cycles must be greater than 0");
+                        Run.flags |= Run_FileEvents;
+                        Run.fileEngine.recheckCycles = $4;
+                  }
+                ;
+
+setpressureevents : SET PRESSUREEVENTS {
+                        Run.flags |= Run_PressureEvents;
+                  }
+                ;
+
+setlowmemory    : SET LOWMEMORY {
+                        Run.flags |= Run_LowMemory;
+                  }
+                ;
+
+setlauncher     : SET LAUNCHER {
+                        Run.flags |= Run_Launcher;
+                  }
+                ;
+
+setstatussegment : SET STATUSSEGMENT {
+                        FREE(Run.files.status);
+                        Run.files.status = Str_dup(STATUSSEGMENT_PATH);
+                  }
+                | SET STATUSSEGMENT PATH {
+                        FREE(Run.files.status);
+                        Run.files.status = $3;
+                  }
+                ;
+
+setchecksumcache : SET CHECKSUMCACHE {
+                        Run.flags |= Run_ChecksumCache;
+                  }
+                | SET CHECKSUMCACHE VERIFY EVERY NUMBER CYCLE {
+                        if ($5 < 1)
+                                yyerror2("The number of checksum cache verify cycles must be greater than 0");
+                        Run.flags |= Run_ChecksumCache;
+                        Run.checksumCache.verifyCycles = $5;
+                  }
+                ;
+
+setstatbatch    : SET STATBATCH {
+                        Run.flags |= Run_StatBatch;
+                  }
+                ;
+
+setpingbatch    : SET PINGBATCH {
+                        Run.flags |= Run_PingBatch;
+                  }
+                ;
+
+setudpbatch     : SET UDPBATCH {
+                        Run.flags |= Run_UdpBatch;
+                  }
+                ;
+
+setchecksumworkers : SET CHECKSUMWORKERS NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of checksum workers must be greater than 0");
+                        Run.checksumEngine.workers = $3;
+                  }
+                ;
+
+setprobetimeout : SET PROBETIMEOUT NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The probe timeout must be greater than 0");
+                        Run.ioProbe.timeout = $3 * $<number>4;
+                  }
+                ;
+
+setprobeworkers : SET PROBEWORKERS NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of probe workers must be greater than 0");
+                        Run.ioProbe.workers = $3;
+                  }
+                ;
+
+setheartbeatsocket : SET HEARTBEATSOCKET PATH {
+                        FREE(Run.heartbeat.socket);
+                        Run.heartbeat.socket = $3;
+                  }
+                ;
+
+setdiscovery    : SET DISCOVERYDIRECTORY PATH {
+                        FREE(Run.discovery.directory);
+                        Run.discovery.directory = $3;
+                  }
+                ;
+
+setstatsd       : SET STATSD PORT NUMBER statsdaddress {
+                        if ($4 <= 0 || $4 > 65535)
+                                yyerror2("Invalid port number %d", $4);
+                        Run.statsd.port = $4;
+                  }
+                | SET STATSD UNIXSOCKET PATH {
+                        FREE(Run.statsd.socket);
+                        Run.statsd.socket = $4;
+                  }
+                ;
+
+statsdaddress   : /* EMPTY */
+                | ADDRESS STRING {
+                        FREE(Run.statsd.address);
+                        Run.statsd.address = $2;
+                  }
+                ;
+
+seteventdelivery : SET EVENTDELIVERY SLOT NUMBER {
+                        if ($4 < 1)
+                                yyerror2("The number of event delivery slots must be greater than 0");
+                        Run.deliveryEngine.slots = $4;
+                  }
+                ;
+
+setseries       : SET SERIES seriesoptlist
+                ;
+
+seriesoptlist   : /* EMPTY */ {
+                        Run.seriesEngine.slots = SERIES_SLOTS;
+                  }
+                | seriesoptlist seriesopt
+                ;
+
+seriesopt       : SLOT NUMBER {
+                        if ($2 < 1)
+                                yyerror2("The number of series slots must be greater than 0");
+                        Run.seriesEngine.slots = $2;
+                  }
+                | PATHTOK PATH {
+                        FREE(Run.seriesEngine.file);
+                        Run.seriesEngine.file = $2;
+                  }
+                ;
+
+setdnscache     : SET DNSCACHE NUMBER SECOND {
+                        if ($3 < 1)
+                                yyerror2("The DNS cache TTL must be greater than 0");
+                        Run.resolverCache.ttl = $3;
+                  }
+                ;
+
+setcertificatecache : SET CERTIFICATECACHE NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The certificate cache interval must be greater than 0");
+                        Run.certificateCache.interval = $3 * $<number>4;
+                  }
+                ;
+
+setrestartbackoff : SET RESTARTBACKOFF NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The restart backoff delay must be greater than 0");
+                        Run.restartBackoff.delay = $3 * $<number>4;
+                        Run.restartBackoff.limit = MAX(Run.restartBackoff.delay, RESTART_BACKOFF);
+                  }
+                | SET RESTARTBACKOFF NUMBER time NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The restart backoff delay must be greater than 0");
+                        if ($5 * $<number>6 < $3 * $<number>4)
+                                yyerror2("The restart backoff limit must not be less than the delay");
+                        Run.restartBackoff.delay = $3 * $<number>4;
+                        Run.restartBackoff.limit = $5 * $<number>6;
+                  }
+                ;
+
+setstartupramp  : SET STARTUPRAMP NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The startup ramp window must be greater than 0");
+                        Run.startupRamp.window = $3 * $<number>4;
+                        Run.startupRamp.restarts = STARTUP_RAMP_RESTARTS;
+                        Run.startupRamp.interval = 1;
+                  }
+                | SET STARTUPRAMP NUMBER time NUMBER RESTART NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The startup ramp window must be greater than 0");
+                        if ($5 < 1 || $7 < 1)
+                                yyerror2("The startup ramp restart limit must be greater than 0");
+                        Run.startupRamp.window = $3 * $<number>4;
+                        Run.startupRamp.restarts = $5;
+                        Run.startupRamp.interval = $7 * $<number>8;
+                  }
+                ;
+
+setcyclebudget  : SET CYCLEBUDGET NUMBER time {
+                        if ($3 < 1)
+                                yyerror2("The cycle budget must be greater than 0");
+                        Run.cycle.budget = $3 * $<number>4 * 1000;
+                  }
+                | SET CYCLEBUDGET NUMBER MILLISECOND {
+                        if ($3 < 1)
+                                yyerror2("The cycle budget must be greater than 0");
+                        Run.cycle.budget = $3;
+                  }
+                ;
+
+setadaptivechecks : SET ADAPTIVECHECKS adaptivecheckoptlist
+                ;
+
+adaptivecheckoptlist : adaptivecheckopt
+                | adaptivecheckoptlist adaptivecheckopt
+                ;
+
+adaptivecheckopt : FAILED NUMBER time {
+                        if ($2 < 1)
+                                yyerror2("The failed service check interval must be greater than 0");
+                        Run.adaptive.failed = $2 * $<number>3;
+                  }
+                | STABLE NUMBER time AFTER NUMBER time {
+                        if ($2 < 1)
+                                yyerror2("The stable service check interval must be greater than 0");
+                        Run.adaptive.stable = $2 * $<number>3;
+                        Run.adaptive.after = $5 * $<number>6;
+                  }
+                ;
+
+setcheckworkers : SET CHECKWORKERS NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of check workers must be greater than 0");
+                        Run.checkEngine.workers = $3;
+                  }
+                ;
+
+setcontrolworkers : SET CONTROLWORKERS NUMBER {
+                        if ($3 < 1)
+                                yyerror2("The number of control workers must be greater than 0");
+                        Run.controlEngine.workers = $3;
+                  }
+                ;
+
 startdelay      : /* EMPTY */        { $<number>$ = START_DELAY; }
                 | START DELAY NUMBER { $<number>$ = $3; }
                 ;
@@ -647,6 +1143,14 @@ limit           : SENDEXPECTBUFFER ':' NUMBER unit {
                 | NETWORKTIMEOUT ':' NUMBER SECOND {
                         Run.limits.networkTimeout= $3 * 1000;
                   }
+                | SOCKETBUFFER ':' NUMBER unit {
+                        if ($3 * $<number>4 < 1024)
+                                yyerror2("The socket buffer must be at least 1 kB");
+                        Run.limits.socketBuffer = $3 * $<number>4;
+                  }
+                | LOGBUFFER ':' NUMBER unit {
+                        Run.limits.logBuffer = $3 * $<number>4;
+                  }
                 ;
 
 setfips         : SET FIPS {
@@ -654,20 +1158,47 @@ setfips         : SET FIPS {
                   }
                 ;
 
-setlog          : SET LOGFILE PATH   {
+setlog          : SET LOGFILE PATH logoptionlist {
                    if (! Run.files.log || ihp.logfile) {
                      ihp.logfile = true;
                      setlogfile($3);
-                     Run.flags &= ~Run_UseSyslog;
+                     Run.flags &= ~(Run_UseSyslog | Run_UseJournal);
                      Run.flags |= Run_Log;
                    }
                   }
-                | SET LOGFILE SYSLOG {
+                | SET LOGFILE SYSLOG logoptionlist {
                     setsyslog(NULL);
                   }
-                | SET LOGFILE SYSLOG FACILITY STRING {
+                | SET LOGFILE SYSLOG FACILITY STRING logoptionlist {
                     setsyslog($5); FREE($5);
                   }
+                | SET LOGFILE JOURNALD logoptionlist {
+                    setjournal();
+                  }
+                ;
+
+logoptionlist   : /* EMPTY */
+                | logoptionlist logoption
+                ;
+
+logoption       : ASYNC {
+                        Run.flags |= Run_LogAsync;
+                  }
+                | FORMAT TEXT {
+                        Run.logging.format = LogFormat_Text;
+                  }
+                | FORMAT JSON {
+                        Run.logging.format = LogFormat_Json;
+                  }
+                | FORMAT JOURNAL {
+                        Run.logging.format = LogFormat_Journal;
+                  }
+                | RATELIMIT NUMBER NUMBER SECOND {
+                        setlogratelimit($2, $3);
+                  }
+                | RATELIMIT NUMBER NUMBER MINUTE {
+                        setlogratelimit($2, $3 * 60);
+                  }
                 ;
 
 seteventqueue   : SET EVENTQUEUE BASEDIR PATH {
@@ -691,6 +1222,15 @@ setidfile       : SET IDFILE PATH {
 setstatefile    : SET STATEFILE PATH {
                     Run.files.state = $3;
                   }
+                | SET STATEFILE SYNC CYCLE {
+                    Run.stateEngine.sync = 0;
+                  }
+                | SET STATEFILE SYNC NUMBER SECOND {
+                    Run.stateEngine.sync = $4;
+                  }
+                | SET STATEFILE SYNC STOP {
+                    Run.stateEngine.sync = -1;
+                  }
                 ;
 
 setpid          : SET PIDFILE PATH {
@@ -704,6 +1244,74 @@ setpid          : SET PIDFILE PATH {
 setmmonits      : SET MMONIT mmonitlist
                 ;
 
+setmmonitbatch  : SET MMONIT BATCH NUMBER EVENTS mmonitbatchdelay {
+                        if ($4 < 1)
+                                yyerror2("The M/Monit batch size must be greater than 0");
+                        Run.mmonitBatch.size = $4;
+                  }
+                ;
+
+mmonitbatchdelay : /* EMPTY */ {
+                        Run.mmonitBatch.delay = 1;
+                  }
+                | DELAY NUMBER SECOND {
+                        Run.mmonitBatch.delay = $2;
+                  }
+                ;
+
+setmmonitdelta  : SET MMONIT HEARTBEATDELTA mmonitdeltafull
+                ;
+
+mmonitdeltafull : /* EMPTY */ {
+                        Run.mmonitDelta.full = 10;
+                  }
+                | FULLEVERY NUMBER CYCLE {
+                        if ($2 < 1)
+                                yyerror2("The M/Monit full heartbeat interval must be greater than 0");
+                        Run.mmonitDelta.full = $2;
+                  }
+                ;
+
+setfederation   : SET FEDERATION federationcluster federationinterval federationagentlist
+                ;
+
+federationcluster : /* EMPTY */
+                  | CLUSTER {
+                        Run.federation.cluster = true;
+                    }
+                  ;
+
+federationinterval : /* EMPTY */
+                   | EVERY NUMBER SECOND {
+                        if ($2 < 1)
+                                yyerror2("The federation poll interval must be greater than 0");
+                        Run.federation.interval = $2;
+                     }
+                   ;
+
+federationagentlist : federationagent
+                    | federationagentlist federationagent
+                    ;
+
+federationagent : AGENT URLOBJECT federationagentoptlist {
+                        federationset.url = $<url>2;
+                        addfederationagent(&federationset);
+                  }
+                ;
+
+federationagentoptlist : /* EMPTY */
+                       | federationagentoptlist federationagentopt
+                       ;
+
+federationagentopt : TIMEOUT NUMBER SECOND {
+                        federationset.timeout = $<number>2 * 1000; // net timeout is in milliseconds internally
+                     }
+                   | ssl
+                   | sslchecksum
+                   | sslversion
+                   | certmd5
+                   ;
+
 mmonitlist      : mmonit credentials
                 | mmonitlist mmonit credentials
                 ;
@@ -972,6 +1580,7 @@ sethttpd        : SET HTTPD PORT NUMBER httpdnetlist {
                  }
                 | SET HTTPD UNIXSOCKET PATH httpdunixlist {
                         Run.httpd.flags |= Httpd_Unix;
+                        FREE(Run.httpd.socket.unix.path);
                         Run.httpd.socket.unix.path = $4;
                  }
                 ;
@@ -1147,25 +1756,42 @@ checkproc       : CHECKPROC SERVICENAME PIDFILE PATH {
                 | CHECKPROC SERVICENAME PATHTOK PATH {
                     createservice(Service_Process, $<string>2, $4, check_process);
                   }
-                | CHECKPROC SERVICENAME MATCH STRING {
+                | CHECKPROC SERVICENAME MATCH STRING proccontainer {
                     createservice(Service_Process, $<string>2, $4, check_process);
                     matchset.ignore = false;
                     matchset.match_path = NULL;
                     matchset.match_string = Str_dup($4);
+                    matchset.container = $<string>5;
                     addmatch(&matchset, Action_Ignored, 0);
+                    matchset.container = NULL;
                   }
-                | CHECKPROC SERVICENAME MATCH PATH {
+                | CHECKPROC SERVICENAME MATCH PATH proccontainer {
                     createservice(Service_Process, $<string>2, $4, check_process);
                     matchset.ignore = false;
                     matchset.match_path = NULL;
                     matchset.match_string = Str_dup($4);
+                    matchset.container = $<string>5;
                     addmatch(&matchset, Action_Ignored, 0);
+                    matchset.container = NULL;
                   }
                 ;
 
+proccontainer   : /* EMPTY */ { $<string>$ = NULL; }
+                | CONTAINER STRING { $<string>$ = $2; }
+                | CONTAINER PATH { $<string>$ = $2; }
+                ;
+
 checkfile       : CHECKFILE SERVICENAME PATHTOK PATH {
                     createservice(Service_File, $<string>2, $4, check_file);
                   }
+                | CHECKFILE SERVICENAME MATCH STRING {
+                    createservice(Service_File, $<string>2, $4, check_file);
+                    addfileset();
+                  }
+                | CHECKFILE SERVICENAME MATCH PATH {
+                    createservice(Service_File, $<string>2, $4, check_file);
+                    addfileset();
+                  }
                 ;
 
 checkfilesys    : CHECKFILESYS SERVICENAME PATHTOK PATH {
@@ -1200,6 +1826,40 @@ checknet        : CHECKNET SERVICENAME ADDRESS STRING {
                   }
                 ;
 
+checksocket     : CHECKSOCKET SERVICENAME {
+                    createservice(Service_Socket, $<string>2, NULL, check_socket);
+                  }
+                | CHECKSOCKET SERVICENAME socketport {
+                    createservice(Service_Socket, $<string>2, NULL, check_socket);
+                    current->localport = $<number>3;
+                  }
+                | CHECKSOCKET SERVICENAME PIDFILE PATH {
+                    createservice(Service_Socket, $<string>2, $4, check_socket);
+                  }
+                | CHECKSOCKET SERVICENAME socketport PIDFILE PATH {
+                    createservice(Service_Socket, $<string>2, $5, check_socket);
+                    current->localport = $<number>3;
+                  }
+                ;
+
+checkheartbeat  : CHECKHEARTBEAT SERVICENAME {
+                    createservice(Service_Heartbeat, $<string>2, NULL, check_heartbeat);
+                  }
+                ;
+
+checkmetric     : CHECKMETRIC SERVICENAME {
+                    createservice(Service_Metric, $<string>2, NULL, check_metric);
+                    REGION_NEW(current, current->metric);
+                  }
+                ;
+
+socketport      : PORT NUMBER {
+                    if ($2 <= 0 || $2 > 65535)
+                        yyerror2("Invalid port number %d", $2);
+                    $<number>$ = $2;
+                  }
+                ;
+
 checksystem     : CHECKSYSTEM SERVICENAME {
                         char *servicename = $<string>2;
                         if (Str_sub(servicename, "$HOST")) {
@@ -1220,19 +1880,33 @@ checkfifo       : CHECKFIFO SERVICENAME PATHTOK PATH {
                   }
                 ;
 
-checkprogram    : CHECKPROGRAM SERVICENAME PATHTOK argumentlist programtimeout {
+checkprogram    : CHECKPROGRAM SERVICENAME PATHTOK argumentlist programtimeout programoutputlimit {
                         command_t c = command; // Current command
                         check_exec(c->arg[0]);
                         createservice(Service_Program, $<string>2, NULL, check_program);
                         current->program->timeout = $<number>5;
+                        current->program->outputLimit = $<number>6;
                         current->program->output = StringBuffer_create(64);
+                        current->program->usage = (struct myprogramusage){.cpuTime = -1, .memory = -1, .runTime = -1};
                  }
-                | CHECKPROGRAM SERVICENAME PATHTOK argumentlist useroptionlist programtimeout {
+                | CHECKPROGRAM SERVICENAME PATHTOK argumentlist useroptionlist programtimeout programoutputlimit {
                         command_t c = command; // Current command
                         check_exec(c->arg[0]);
                         createservice(Service_Program, $<string>2, NULL, check_program);
                         current->program->timeout = $<number>6;
+                        current->program->outputLimit = $<number>7;
                         current->program->output = StringBuffer_create(64);
+                        current->program->usage = (struct myprogramusage){.cpuTime = -1, .memory = -1, .runTime = -1};
+                 }
+                ;
+
+checkplugin     : CHECKPLUGIN SERVICENAME PATHTOK argumentlist plugintimeout {
+                        command_t c = command; // Current command
+                        check_plugin(c->arg[0]);
+                        createservice(Service_Program, $<string>2, NULL, check_program);
+                        current->program->output = StringBuffer_create(64);
+                        current->program->usage = (struct myprogramusage){.cpuTime = -1, .memory = -1, .runTime = -1};
+                        current->program->plugin = Plugin_new(current->name, current->program->args, $<number>5);
                  }
                 ;
 
@@ -1335,6 +2009,7 @@ connectionopt   : ip
                 | connectiontimeout
                 | outgoing
                 | retry
+                | persistent
                 | ssl
                 | sslchecksum
                 | sslexpire
@@ -1374,6 +2049,7 @@ connectionuxopt : type
                 | sendexpect
                 | connectiontimeout
                 | retry
+                | persistent
                 ;
 
 icmp            : IF FAILED ICMP icmptype icmpoptlist rate1 THEN action1 recovery {
@@ -1484,6 +2160,12 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                         portset.type = Socket_Tcp;
                         portset.protocol = Protocol_get(Protocol_HTTP);
                  }
+                | PROTOCOL HTTP2 http2list {
+                        portset.protocol = Protocol_get(Protocol_HTTP2);
+                  }
+                | PROTOCOL GRPC grpclist {
+                        portset.protocol = Protocol_get(Protocol_GRPC);
+                  }
                 | PROTOCOL IMAP {
                         portset.protocol = Protocol_get(Protocol_IMAP);
                   }
@@ -1545,7 +2227,7 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL RDATE {
                         portset.protocol = Protocol_get(Protocol_RDATE);
                   }
-                | PROTOCOL REDIS  {
+                | PROTOCOL REDIS servermetriclist {
                         portset.protocol = Protocol_get(Protocol_REDIS);
                   }
                 | PROTOCOL RSYNC {
@@ -1566,12 +2248,16 @@ protocol        : PROTOCOL APACHESTATUS apache_stat_list {
                 | PROTOCOL RADIUS radiuslist {
                         portset.protocol = Protocol_get(Protocol_RADIUS);
                   }
-                | PROTOCOL MEMCACHE {
+                | PROTOCOL MEMCACHE servermetriclist {
                         portset.protocol = Protocol_get(Protocol_MEMCACHE);
                   }
                 | PROTOCOL WEBSOCKET websocketlist {
                         portset.protocol = Protocol_get(Protocol_WEBSOCKET);
                   }
+                | PROTOCOL SNMP snmplist {
+                        portset.protocol = Protocol_get(Protocol_SNMP);
+                        portset.type = Socket_Udp;
+                  }
                 ;
 
 sendexpect      : SEND STRING {
@@ -1582,6 +2268,10 @@ sendexpect      : SEND STRING {
                     portset.protocol = Protocol_get(Protocol_GENERIC);
                     addgeneric(&portset, NULL, $2);
                   }
+                | PIPELINE {
+                    portset.protocol = Protocol_get(Protocol_GENERIC);
+                    portset.parameters.generic.pipeline = true;
+                  }
                 ;
 
 websocketlist   : websocket
@@ -1629,32 +2319,84 @@ mysql           : username {
                 | password {
                         portset.parameters.mysql.password = $<string>1;
                   }
+                | servermetric
                 ;
 
-target          : TARGET MAILADDR {
-                    $<string>$ = $2;
-                  }
-                | TARGET STRING {
-                    $<string>$ = $2;
-                  }
+servermetriclist : /* EMPTY */
+                | servermetriclist servermetric
                 ;
 
-maxforward      : MAXFORWARD NUMBER {
-                     $<number>$ = verifyMaxForward($2);
+servermetric    : METRIC STRING operator NUMBER {
+                        addservermetric($2, $<number>3, $4, NULL, false);
+                  }
+                | METRIC STRING operator REAL {
+                        addservermetric($2, $<number>3, $4, NULL, false);
+                  }
+                | METRIC STRING operator STRING {
+                        addservermetric($2, $<number>3, 0., $4, false);
+                  }
+                | METRIC STRING METRICRATE operator NUMBER {
+                        addservermetric($2, $<number>4, $5, NULL, true);
+                  }
+                | METRIC STRING METRICRATE operator REAL {
+                        addservermetric($2, $<number>4, $5, NULL, true);
                   }
                 ;
 
-siplist         : /* EMPTY */
-                | siplist sip
+snmplist        : /* EMPTY */
+                | snmplist snmp
                 ;
 
-sip             : target {
-                        portset.parameters.sip.target = $<string>1;
+snmp            : COMMUNITY STRING {
+                        portset.parameters.snmp.community = $2;
                   }
-                | maxforward {
-                        portset.parameters.sip.maxforward = $<number>1;
+                | VERSIONOPT NUMBER {
+                        if ($2 < 1 || $2 > 3)
+                                yyerror2("SNMP version %d is not supported -- use 1, 2 or 3", $2);
+                        portset.parameters.snmp.version = $2;
                   }
-                ;
+                | username {
+                        portset.parameters.snmp.username = $<string>1;
+                  }
+                | password {
+                        portset.parameters.snmp.password = $<string>1;
+                  }
+                | PRIVACY STRING {
+                        portset.parameters.snmp.privacy = $2;
+                  }
+                | MD5HASH {
+                        portset.parameters.snmp.authentication = Hash_Md5;
+                  }
+                | SHA1HASH {
+                        portset.parameters.snmp.authentication = Hash_Sha1;
+                  }
+                | servermetric
+                ;
+
+target          : TARGET MAILADDR {
+                    $<string>$ = $2;
+                  }
+                | TARGET STRING {
+                    $<string>$ = $2;
+                  }
+                ;
+
+maxforward      : MAXFORWARD NUMBER {
+                     $<number>$ = verifyMaxForward($2);
+                  }
+                ;
+
+siplist         : /* EMPTY */
+                | siplist sip
+                ;
+
+sip             : target {
+                        portset.parameters.sip.target = $<string>1;
+                  }
+                | maxforward {
+                        portset.parameters.sip.maxforward = $<number>1;
+                  }
+                ;
 
 httplist        : /* EMPTY */
                 | httplist http
@@ -1696,6 +2438,52 @@ httpheaderlist  : /* EMPTY */
                  }
                 ;
 
+http2list       : /* EMPTY */
+                | http2list http2
+                ;
+
+http2           : REQUEST PATH {
+                    addhttp2request(Util_urlEncode($2));
+                    FREE($2);
+                  }
+                | STATUS operator NUMBER {
+                    Http2Request_T r = addhttp2request(NULL);
+                    r->operator = $<number>2;
+                    r->status = $<number>3;
+                  }
+                | CONTENT urloperator STRING {
+                    addhttp2content($<number>2, $<string>3);
+                    FREE($3);
+                  }
+                | LATENCY operator NUMBER MILLISECOND {
+                    Http2Request_T r = addhttp2request(NULL);
+                    if ($<number>3 <= 0)
+                        yyerror2("The response time limit must be greater than zero");
+                    r->latencyOperator = $<number>2;
+                    r->latency = $<number>3;
+                  }
+                | HOSTHEADER STRING {
+                    addhttp2header(Str_cat("Host:%s", $2));
+                    FREE($2);
+                  }
+                | '[' http2headerlist ']'
+                ;
+
+http2headerlist : /* EMPTY */
+                | http2headerlist HTTPHEADER {
+                        addhttp2header($2);
+                 }
+                ;
+
+grpclist        : /* EMPTY */
+                | grpclist grpc
+                ;
+
+grpc            : SERVICE STRING {
+                    addgrpcservice($2);
+                  }
+                ;
+
 secret          : SECRET STRING {
                     $<string>$ = $2;
                   }
@@ -1785,6 +2573,62 @@ uptime          : IF UPTIME operator NUMBER time rate1 THEN action1 recovery {
                     adduptime(&uptimeset);
                   }
 
+responsetime    : IF RESPONSETIME operator value MILLISECOND rate1 THEN action1 recovery {
+                        if ($<number>2 < 1 || $<number>2 > 99)
+                                yyerror2("The response time percentile must be between 1 and 99");
+                        responsetimeset.percentile = $<number>2;
+                        responsetimeset.operator = $<number>3;
+                        responsetimeset.limit = $<real>4;
+                        addeventaction(&(responsetimeset).action, $<number>8, $<number>9);
+                        addresponsetime(&responsetimeset);
+                  }
+                ;
+
+growth          : IF growthmetric GROWS operator value growthunit time rate1 THEN action1 recovery {
+                        if ($<number>6)
+                                growthset.bytes = true;
+                        growthset.operator = $<number>4;
+                        growthset.limit = $<real>5 * ($<number>6 ? $<number>6 : 1);
+                        growthset.unit = $<number>7;
+                        addeventaction(&(growthset).action, $<number>10, $<number>11);
+                        addgrowth(&growthset);
+                  }
+                ;
+
+growthmetric    : SIZE {
+                        if (current->type != Service_File && current->type != Service_Directory)
+                                yyerror2("The size growth test is supported in the file and directory services only");
+                        growthset.metric = Str_dup("size");
+                        growthset.bytes = true;
+                  }
+                | FILES {
+                        if (current->type != Service_Directory)
+                                yyerror2("The files growth test is supported in the directory service only");
+                        growthset.metric = Str_dup("files");
+                  }
+                | SPACE {
+                        if (current->type != Service_Filesystem)
+                                yyerror2("The space growth test is supported in the filesystem service only");
+                        growthset.metric = Str_dup("space");
+                        growthset.bytes = true;
+                  }
+                | INODE {
+                        if (current->type != Service_Filesystem)
+                                yyerror2("The inode growth test is supported in the filesystem service only");
+                        growthset.metric = Str_dup("inode");
+                  }
+                | SERIES STRING {
+                        growthset.metric = $2;
+                  }
+                ;
+
+growthunit      : /* EMPTY */  { $<number>$ = 0; }
+                | BYTE         { $<number>$ = Unit_Byte; }
+                | KILOBYTE     { $<number>$ = Unit_Kilobyte; }
+                | MEGABYTE     { $<number>$ = Unit_Megabyte; }
+                | GIGABYTE     { $<number>$ = Unit_Gigabyte; }
+                ;
+
 icmpcount       : COUNT NUMBER {
                         icmpset.count = $<number>2;
                  }
@@ -1821,6 +2665,25 @@ programtimeout  : /* EMPTY */ {
                   }
                 ;
 
+plugintimeout   : /* EMPTY */ {
+                   $<number>$ = PLUGIN_TIMEOUT;
+                  }
+                | TIMEOUT NUMBER MILLISECOND {
+                   $<number>$ = $2;
+                  }
+                | TIMEOUT NUMBER SECOND {
+                   $<number>$ = $2 * 1000;
+                  }
+                ;
+
+programoutputlimit : /* EMPTY */ {
+                   $<number>$ = -1; // Use the programOutput limit
+                  }
+                | OUTPUT NUMBER unit {
+                   $<number>$ = $2 * $<number>3;
+                  }
+                ;
+
 nettimeout      : /* EMPTY */ {
                    $<number>$ = Run.limits.networkTimeout;
                   }
@@ -1839,6 +2702,11 @@ retry           : RETRY NUMBER {
                   }
                 ;
 
+persistent      : PERSISTENT {
+                        portset.session.enabled = true;
+                  }
+                ;
+
 actionrate      : IF NUMBER RESTART NUMBER CYCLE THEN action1 {
                    actionrateset.count = $2;
                    actionrateset.cycle = $4;
@@ -1940,11 +2808,27 @@ every           : EVERY NUMBER CYCLE {
                  }
                 | EVERY TIMESPEC {
                    current->every.type = Every_Cron;
-                   current->every.spec.cron = $2;
+                   current->every.spec.cron.string = $2;
+                   if (! (current->every.spec.cron.compiled = Cron_new($2)))
+                        yyerror2("Invalid cron specification \"%s\"", $2);
+                 }
+                | EVERY NUMBER SECOND {
+                   if ($2 < 1)
+                        yyerror2("The check interval must be greater than 0");
+                   current->every.type = Every_Interval;
+                   current->every.spec.interval.seconds = $2;
+                 }
+                | EVERY NUMBER totaltime {
+                   if ($2 < 1)
+                        yyerror2("The check interval must be greater than 0");
+                   current->every.type = Every_Interval;
+                   current->every.spec.interval.seconds = $2 * $<number>3;
                  }
                 | NOTEVERY TIMESPEC {
                    current->every.type = Every_NotInCron;
-                   current->every.spec.cron = $2;
+                   current->every.spec.cron.string = $2;
+                   if (! (current->every.spec.cron.compiled = Cron_new($2)))
+                        yyerror2("Invalid cron specification \"%s\"", $2);
                  }
                 ;
 
@@ -1972,6 +2856,11 @@ onreboot        : ONREBOOT START {
                   }
                 ;
 
+priorityhigh    : PRIORITYHIGH {
+                        current->priority = true;
+                  }
+                ;
+
 group           : GROUP STRINGNAME {
                         addservicegroup($2);
                         FREE($2);
@@ -2020,6 +2909,13 @@ resourceprocessopt  : resourcecpuproc
                     | resourcethreads
                     | resourcechild
                     | resourceload
+                    | resourcedisk
+                    | resourcecontextswitches
+                    | resourcefiledescriptors
+                    | resourcecgroup
+                    | resourcethreadcpu
+                    | resourceaverage
+                    | resourcegpuproc
                     ;
 
 resourcesystem  : IF resourcesystemlist rate1 THEN action1 recovery {
@@ -2036,8 +2932,173 @@ resourcesystemopt  : resourceload
                    | resourcemem
                    | resourceswap
                    | resourcecpu
+                   | resourcepressure
+                   | resourcememinfo
+                   | resourceaverage
+                   | resourcemonit
+                   | resourcegpu
+                   ;
+
+resourceprogram : IF resourceprogramopt rate1 THEN action1 recovery {
+                     addeventaction(&(resourceset).action, $<number>5, $<number>6);
+                     addresource(&resourceset);
+                   }
+                ;
+
+resourceprogramopt : PROGRAMCPU operator value MILLISECOND {
+                        resourceset.resource_id = Resource_ProgramCpuTime;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3;
+                     }
+                   | PROGRAMCPU operator value SECOND {
+                        resourceset.resource_id = Resource_ProgramCpuTime;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3 * 1000.;
+                     }
+                   | PROGRAMMEMORY operator value unit {
+                        resourceset.resource_id = Resource_ProgramMemory;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3 * $<number>4;
+                     }
+                   | PROGRAMRUNTIME operator value MILLISECOND {
+                        resourceset.resource_id = Resource_ProgramRunTime;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3;
+                     }
+                   | PROGRAMRUNTIME operator value SECOND {
+                        resourceset.resource_id = Resource_ProgramRunTime;
+                        resourceset.operator = $<number>2;
+                        resourceset.limit = $<real>3 * 1000.;
+                     }
                    ;
 
+resourcesocket  : IF resourcesocketopt rate1 THEN action1 recovery {
+                     addeventaction(&(resourceset).action, $<number>5, $<number>6);
+                     addresource(&resourceset);
+                   }
+                ;
+
+resourcemetric  : IF resourcemetricopt rate1 THEN action1 recovery {
+                     addeventaction(&(resourceset).action, $<number>5, $<number>6);
+                     addresource(&resourceset);
+                   }
+                ;
+
+resourcemetricopt : metricresource operator value {
+                      resourceset.resource_id = $<number>1;
+                      resourceset.operator = $<number>2;
+                      resourceset.limit = $<real>3;
+                    }
+                  ;
+
+metricresource  : METRICVALUE        { $<number>$ = Resource_MetricValue; }
+                | METRICRATE         { $<number>$ = Resource_MetricRate; }
+                | METRICRATE SECOND  { $<number>$ = Resource_MetricRate; }
+                | METRICMAX          { $<number>$ = Resource_MetricMax; }
+                ;
+
+resourcesocketopt : socketresource operator NUMBER {
+                      resourceset.resource_id = $<number>1;
+                      resourceset.operator = $<number>2;
+                      resourceset.limit = $3;
+                    }
+                  ;
+
+socketresource  : CONNECTIONS   { $<number>$ = Resource_SocketConnections; }
+                | ESTABLISHED   { $<number>$ = Resource_SocketEstablished; }
+                | TIMEWAIT      { $<number>$ = Resource_SocketTimeWait; }
+                | CLOSEWAIT     { $<number>$ = Resource_SocketCloseWait; }
+                | LISTENSOCKETS { $<number>$ = Resource_SocketListen; }
+                | LISTENQUEUE   { $<number>$ = Resource_SocketListenQueue; }
+                | LISTENDROPS   { $<number>$ = Resource_SocketListenDrops; }
+                ;
+
+resourcefs      : IF resourcefslist rate1 THEN action1 recovery {
+                     addeventaction(&(resourceset).action, $<number>5, $<number>6);
+                     addresource(&resourceset);
+                   }
+                ;
+
+resourcefslist  : resourcefsopt
+                | resourcefslist resourcefsopt
+                ;
+
+resourcefsopt   : resourcedisk
+                | DISKREAD operator NUMBER OPERATION {
+                    resourceset.resource_id = Resource_ReadOperations;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<number>3;
+                  }
+                | DISKWRITE operator NUMBER OPERATION {
+                    resourceset.resource_id = Resource_WriteOperations;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<number>3;
+                  }
+                | DISKSERVICETIME operator value MILLISECOND {
+                    resourceset.resource_id = Resource_ServiceTime;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3;
+                  }
+                | DISKUTILIZATION operator value PERCENT {
+                    resourceset.resource_id = Resource_Utilization;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3;
+                  }
+                ;
+
+resourcedir     : IF resourcedirlist rate1 THEN action1 recovery {
+                     addeventaction(&(resourceset).action, $<number>5, $<number>6);
+                     addresource(&resourceset);
+                   }
+                ;
+
+resourcedirlist : resourcediropt
+                | resourcedirlist resourcediropt
+                ;
+
+resourcediropt  : TOTAL SIZE operator value unit {
+                    adddirscan();
+                    resourceset.resource_id = Resource_DirectorySize;
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4 * $<number>5;
+                  }
+                | FILES operator NUMBER {
+                    adddirscan();
+                    resourceset.resource_id = Resource_DirectoryFiles;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<number>3;
+                  }
+                | OLDEST operator NUMBER time {
+                    adddirscan();
+                    resourceset.resource_id = Resource_DirectoryOldest;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $3 * $<number>4;
+                  }
+                | NEWEST operator NUMBER time {
+                    adddirscan();
+                    resourceset.resource_id = Resource_DirectoryNewest;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $3 * $<number>4;
+                  }
+                ;
+
+dirscan         : SCAN dirscanoptlist
+                ;
+
+dirscanoptlist  : /* EMPTY */ {
+                    adddirscan();
+                  }
+                | dirscanoptlist dirscanopt
+                ;
+
+dirscanopt      : DEPTH NUMBER {
+                    current->dirscan->depth = $<number>2;
+                  }
+                | INCREMENTAL {
+                    current->dirscan->incremental = true;
+                  }
+                ;
+
 resourcecpuproc : CPU operator NUMBER PERCENT {
                     resourceset.resource_id = Resource_CpuPercent;
                     resourceset.operator = $<number>2;
@@ -2050,6 +3111,97 @@ resourcecpuproc : CPU operator NUMBER PERCENT {
                   }
                 ;
 
+resourcepressure : PRESSURE operator value PERCENT {
+                    setpressure(Resource_Pressure, $<number>1);
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3;
+                  }
+                ;
+
+resourcememinfo : MEMINFO operator value unit {
+                    resourceset.resource_id = Resource_Meminfo;
+                    resourceset.meminfo = $1;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3 * $<number>4;
+                  }
+                ;
+
+resourcemonit   : MONITCYCLE operator value MILLISECOND {
+                    resourceset.resource_id = Resource_MonitCycle;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3;
+                  }
+                | MONITCYCLE operator value SECOND {
+                    resourceset.resource_id = Resource_MonitCycle;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3 * 1000.;
+                  }
+                | MONITMEMORY operator value unit {
+                    resourceset.resource_id = Resource_MonitMemory;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3 * $<number>4;
+                  }
+                | MONITQUEUE operator NUMBER {
+                    resourceset.resource_id = Resource_MonitQueue;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $3;
+                  }
+                ;
+
+resourcegpu     : GPUUSAGE operator value PERCENT {
+                    setgpuresource(Resource_GpuUsage, $<number>2, $<real>3);
+                  }
+                | GPUMEMORY operator value PERCENT {
+                    setgpuresource(Resource_GpuMemoryPercent, $<number>2, $<real>3);
+                  }
+                | GPUMEMORY operator value unit {
+                    setgpuresource(Resource_GpuMemory, $<number>2, $<real>3 * $<number>4);
+                  }
+                | GPUTEMPERATURE operator value {
+                    setgpuresource(Resource_GpuTemperature, $<number>2, $<real>3);
+                  }
+                | GPUECC operator NUMBER {
+                    setgpuresource(Resource_GpuEcc, $<number>2, $3);
+                  }
+                ;
+
+resourcegpuproc : GPUMEMORY operator value unit {
+                    setgpuresource(Resource_GpuMemory, $<number>2, $<real>3 * $<number>4);
+                  }
+                ;
+
+resourceaverage : AVERAGE averageid operator value averageunit NUMBER averagetime {
+                    setaverage($<number>2, $<number>5, $6 * $<number>7);
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4 * ($<number>5 ? $<number>5 : 1);
+                  }
+                ;
+
+averageid       : CPU         { $<number>$ = Resource_CpuPercent; }
+                | TOTALCPU    { $<number>$ = Resource_CpuPercentTotal; }
+                | CPUUSER     { $<number>$ = Resource_CpuUser; }
+                | CPUSYSTEM   { $<number>$ = Resource_CpuSystem; }
+                | CPUWAIT     { $<number>$ = Resource_CpuWait; }
+                | MEMORY      { $<number>$ = Resource_MemoryPercent; }
+                | TOTALMEMORY { $<number>$ = Resource_MemoryPercentTotal; }
+                | SWAP        { $<number>$ = Resource_SwapPercent; }
+                | LOADAVG1    { $<number>$ = Resource_LoadAverage1m; }
+                | LOADAVG5    { $<number>$ = Resource_LoadAverage5m; }
+                | LOADAVG15   { $<number>$ = Resource_LoadAverage15m; }
+                | THREADS     { $<number>$ = Resource_Threads; }
+                | CHILDREN    { $<number>$ = Resource_Children; }
+                ;
+
+averageunit     : PERCENT     { $<number>$ = 0; }
+                | unit        { $<number>$ = $<number>1; }
+                ;
+
+averagetime     : SECOND      { $<number>$ = Time_Second; }
+                | MINUTE      { $<number>$ = Time_Minute; }
+                | HOUR        { $<number>$ = Time_Hour; }
+                | DAY         { $<number>$ = Time_Day; }
+                ;
+
 resourcecpu     : resourcecpuid operator NUMBER PERCENT {
                     resourceset.resource_id = $<number>1;
                     resourceset.operator = $<number>2;
@@ -2060,6 +3212,8 @@ resourcecpu     : resourcecpuid operator NUMBER PERCENT {
 resourcecpuid   : CPUUSER   { $<number>$ = Resource_CpuUser; }
                 | CPUSYSTEM { $<number>$ = Resource_CpuSystem; }
                 | CPUWAIT   { $<number>$ = Resource_CpuWait; }
+                | CPUSTEAL  { $<number>$ = Resource_CpuSteal; }
+                | ANYCPU    { $<number>$ = Resource_CpuAny; }
                 | CPU       { $<number>$ = Resource_CpuPercent; }
                 ;
 
@@ -2111,6 +3265,71 @@ resourcechild   : CHILDREN operator NUMBER {
                   }
                 ;
 
+resourcedisk    : DISKREAD operator value unit {
+                    resourceset.resource_id = Resource_ReadBytes;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3 * $<number>4;
+                  }
+                | DISKWRITE operator value unit {
+                    resourceset.resource_id = Resource_WriteBytes;
+                    resourceset.operator = $<number>2;
+                    resourceset.limit = $<real>3 * $<number>4;
+                  }
+                ;
+
+resourcecontextswitches : VOLUNTARYCONTEXTSWITCHES operator NUMBER {
+                            resourceset.resource_id = Resource_VoluntaryContextSwitches;
+                            resourceset.operator = $<number>2;
+                            resourceset.limit = $<number>3;
+                          }
+                        | NONVOLUNTARYCONTEXTSWITCHES operator NUMBER {
+                            resourceset.resource_id = Resource_NonvoluntaryContextSwitches;
+                            resourceset.operator = $<number>2;
+                            resourceset.limit = $<number>3;
+                          }
+                        ;
+
+resourcefiledescriptors : FILEDESCRIPTORS operator NUMBER {
+                            resourceset.resource_id = Resource_FileDescriptors;
+                            resourceset.operator = $<number>2;
+                            resourceset.limit = $<number>3;
+                          }
+                        ;
+
+resourcecgroup  : CGROUP MEMORY operator value unit {
+                    resourceset.resource_id = Resource_CgroupMemory;
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4 * $<number>5;
+                  }
+                | CGROUP PRESSURE operator value PERCENT {
+                    setpressure(Resource_CgroupPressure, $<number>2);
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4;
+                  }
+                | CGROUP CPU operator value PERCENT {
+                    resourceset.resource_id = Resource_CgroupCpuPercent;
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4;
+                  }
+                | CGROUP DISKREAD operator value unit {
+                    resourceset.resource_id = Resource_CgroupReadBytes;
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4 * $<number>5;
+                  }
+                | CGROUP DISKWRITE operator value unit {
+                    resourceset.resource_id = Resource_CgroupWriteBytes;
+                    resourceset.operator = $<number>3;
+                    resourceset.limit = $<real>4 * $<number>5;
+                  }
+                ;
+
+resourcethreadcpu : ANYTHREADCPU operator value PERCENT {
+                      resourceset.resource_id = Resource_ThreadCpu;
+                      resourceset.operator = $<number>2;
+                      resourceset.limit = $<real>3;
+                    }
+                  ;
+
 resourceload    : resourceloadavg operator value {
                     resourceset.resource_id = $<number>1;
                     resourceset.operator = $<number>2;
@@ -2140,6 +3359,11 @@ timestamp       : IF TIMESTAMP operator NUMBER time rate1 THEN action1 recovery
                   }
                 ;
 
+heartbeat       : IF NOHEARTBEAT NUMBER time rate1 THEN action1 recovery {
+                    addheartbeat($3 * $<number>4, $<number>7, $<number>8);
+                  }
+                ;
+
 operator        : /* EMPTY */    { $<number>$ = Operator_Equal; }
                 | GREATER        { $<number>$ = Operator_Greater; }
                 | GREATEROREQUAL { $<number>$ = Operator_GreaterOrEqual; }
@@ -2165,6 +3389,15 @@ totaltime       : MINUTE      { $<number>$ = Time_Minute; }
 currenttime     : /* EMPTY */ { $<number>$ = Time_Second; }
                 | SECOND      { $<number>$ = Time_Second; }
 
+currentrate     : rate1 { $<number>$ = 1; }
+                | NUMBER SECOND rate1 {
+                        if ($<number>1 < 1) {
+                                yyerror2("The rate range must be greater than 0 seconds");
+                        }
+                        $<number>$ = $<number>1;
+                  }
+                ;
+
 repeat          : /* EMPTY */ {
                         repeat = 0;
                   }
@@ -2304,9 +3537,17 @@ checksum        : IF FAILED hashtype CHECKSUM rate1 THEN action1 recovery {
                     addchecksum(&checksumset);
                   }
                 ;
+treechecksum    : IF CHANGED hashtype TREECHECKSUM rate1 THEN action1 {
+                    addeventaction(&(checksumset).action, $<number>7, Action_Ignored);
+                    addtreesum(&checksumset);
+                  }
+                ;
+
 hashtype        : /* EMPTY */ { checksumset.type = Hash_Unknown; }
                 | MD5HASH     { checksumset.type = Hash_Md5; }
                 | SHA1HASH    { checksumset.type = Hash_Sha1; }
+                | SHA256HASH  { checksumset.type = Hash_Sha256; }
+                | XXH64HASH   { checksumset.type = Hash_Xxh64; }
                 ;
 
 inode           : IF INODE operator NUMBER rate1 THEN action1 recovery {
@@ -2373,6 +3614,40 @@ space           : IF SPACE operator value unit rate1 THEN action1 recovery {
                   }
                 ;
 
+quota           : IF quotatype quotaid operator value unit rate1 THEN action1 recovery {
+                    if (quotaset.inode && $<number>6 != Unit_Byte)
+                        yyerror2("The inode quota limit is a number of inodes");
+                    quotaset.operator = $<number>4;
+                    quotaset.limit_absolute = (long long)((double)$<real>5 * (double)$<number>6);
+                    addeventaction(&(quotaset).action, $<number>9, $<number>10);
+                    addquota(&quotaset);
+                  }
+                | IF quotatype quotaid operator NUMBER PERCENT rate1 THEN action1 recovery {
+                    quotaset.operator = $<number>4;
+                    quotaset.limit_percent = $5;
+                    addeventaction(&(quotaset).action, $<number>9, $<number>10);
+                    addquota(&quotaset);
+                  }
+                ;
+
+quotatype       : QUOTA {
+                    quotaset.type = $<number>1 & 0xf;
+                    quotaset.inode = $<number>1 & 0x10 ? true : false;
+                  }
+                ;
+
+quotaid         : NUMBER { quotaset.id = $1; }
+                | STRING {
+                    if (quotaset.type == Quota_User)
+                        quotaset.id = get_uid($1, 0);
+                    else if (quotaset.type == Quota_Group)
+                        quotaset.id = get_gid($1, 0);
+                    else
+                        quotaset.id = get_projid($1);
+                    FREE($1);
+                  }
+                ;
+
 fsflag          : IF CHANGED FSFLAG rate1 THEN action1 {
                     addeventaction(&(fsflagset).action, $<number>6, Action_Ignored);
                     addfsflag(&fsflagset);
@@ -2537,10 +3812,10 @@ linksaturation : IF SATURATION operator NUMBER PERCENT rate1 THEN action1 recove
                   }
                 ;
 
-upload          : IF UPLOAD operator NUMBER unit currenttime rate1 THEN action1 recovery {
+upload          : IF UPLOAD operator NUMBER unit currenttime currentrate THEN action1 recovery {
                     bandwidthset.operator = $<number>3;
                     bandwidthset.limit = ((unsigned long long)$4 * $<number>5);
-                    bandwidthset.rangecount = 1;
+                    bandwidthset.rangecount = $<number>7;
                     bandwidthset.range = $<number>6;
                     addeventaction(&(bandwidthset).action, $<number>9, $<number>10);
                     addbandwidth(&(current->uploadbyteslist), &bandwidthset);
@@ -2561,10 +3836,10 @@ upload          : IF UPLOAD operator NUMBER unit currenttime rate1 THEN action1
                     addeventaction(&(bandwidthset).action, $<number>11, $<number>12);
                     addbandwidth(&(current->uploadbyteslist), &bandwidthset);
                   }
-                | IF UPLOAD operator NUMBER PACKET currenttime rate1 THEN action1 recovery {
+                | IF UPLOAD operator NUMBER PACKET currenttime currentrate THEN action1 recovery {
                     bandwidthset.operator = $<number>3;
                     bandwidthset.limit = (unsigned long long)$4;
-                    bandwidthset.rangecount = 1;
+                    bandwidthset.rangecount = $<number>7;
                     bandwidthset.range = $<number>6;
                     addeventaction(&(bandwidthset).action, $<number>9, $<number>10);
                     addbandwidth(&(current->uploadpacketslist), &bandwidthset);
@@ -2587,10 +3862,10 @@ upload          : IF UPLOAD operator NUMBER unit currenttime rate1 THEN action1
                   }
                 ;
 
-download        : IF DOWNLOAD operator NUMBER unit currenttime rate1 THEN action1 recovery {
+download        : IF DOWNLOAD operator NUMBER unit currenttime currentrate THEN action1 recovery {
                     bandwidthset.operator = $<number>3;
                     bandwidthset.limit = ((unsigned long long)$4 * $<number>5);
-                    bandwidthset.rangecount = 1;
+                    bandwidthset.rangecount = $<number>7;
                     bandwidthset.range = $<number>6;
                     addeventaction(&(bandwidthset).action, $<number>9, $<number>10);
                     addbandwidth(&(current->downloadbyteslist), &bandwidthset);
@@ -2611,10 +3886,10 @@ download        : IF DOWNLOAD operator NUMBER unit currenttime rate1 THEN action
                     addeventaction(&(bandwidthset).action, $<number>11, $<number>12);
                     addbandwidth(&(current->downloadbyteslist), &bandwidthset);
                   }
-                | IF DOWNLOAD operator NUMBER PACKET currenttime rate1 THEN action1 recovery {
+                | IF DOWNLOAD operator NUMBER PACKET currenttime currentrate THEN action1 recovery {
                     bandwidthset.operator = $<number>3;
                     bandwidthset.limit = (unsigned long long)$4;
-                    bandwidthset.rangecount = 1;
+                    bandwidthset.rangecount = $<number>7;
                     bandwidthset.range = $<number>6;
                     addeventaction(&(bandwidthset).action, $<number>9, $<number>10);
                     addbandwidth(&(current->downloadpacketslist), &bandwidthset);
@@ -2731,6 +4006,40 @@ void yywarning2(const char *s, ...) {
 
 }
 
+
+/*
+ * Fingerprint routines, called by the lexer for every token. The tokens of a
+ * check statement are hashed into the service fingerprint, the tokens of the
+ * set statements into the global hash, which is folded into every service
+ * fingerprint in postparse(). Whitespace and comments are ignored. The reload
+ * keeps the runtime objects of the services with an unchanged fingerprint.
+ */
+void hashtoken(const char *text, int length) {
+        if (! length || *text == '#')
+                return;
+        unsigned long long *hash = confighash.service ? &confighash.section : &confighash.global;
+        for (int i = 0; i < length; i++) {
+                if (! isspace((unsigned char)text[i])) {
+                        *hash ^= (unsigned char)text[i];
+                        *hash *= CONFIGHASH_PRIME;
+                }
+        }
+        // Token separator
+        *hash *= CONFIGHASH_PRIME;
+}
+
+
+/*
+ * Close the current section when the lexer finds a new check or set
+ * statement: the current service is the one the finished section belongs to
+ */
+void hashsection(boolean_t service) {
+        if (confighash.service && current)
+                current->fingerprint = confighash.section;
+        confighash.service = service;
+        confighash.section = CONFIGHASH_SEED;
+}
+
 /*
  * The Parser hook - start parsing the control file
  * Returns true if parsing succeeded, otherwise false
@@ -2740,6 +4049,7 @@ boolean_t parse(char *controlfile) {
         ASSERT(controlfile);
 
         servicelist = tail = current = NULL;
+        Util_resetServiceIndex();
 
         if ((yyin = fopen(controlfile,"r")) == (FILE *)NULL) {
                 LogError("Cannot open the control file '%s' -- %s\n", controlfile, STRERROR);
@@ -2747,6 +4057,7 @@ boolean_t parse(char *controlfile) {
         }
 
         currentfile = Str_dup(controlfile);
+        lexbegin(controlfile);
 
         /*
          * Creation of the global service list is synchronized
@@ -2757,6 +4068,7 @@ boolean_t parse(char *controlfile) {
                 yyparse();
                 fclose(yyin);
                 postparse();
+                HashMap_free(&servicegroupindex);
         }
         END_LOCK;
 
@@ -2777,6 +4089,91 @@ boolean_t parse(char *controlfile) {
 }
 
 
+/*
+ * Parse a discovery file, see discovery.h. The file has check statements
+ * only, which can use the templates of the control file. The services are
+ * not added to the service list, they are returned in the services list
+ * (chained by the next link in the depend order). Returns true if parsing
+ * succeeded, otherwise false and no service
+ */
+boolean_t parse_discovered(const char *file, Service_T *services) {
+
+        ASSERT(file);
+        ASSERT(services);
+
+        *services = NULL;
+
+        if ((yyin = fopen(file, "r")) == (FILE *)NULL) {
+                LogError("Cannot open the discovery file '%s' -- %s\n", file, STRERROR);
+                return false;
+        }
+
+        currentfile = Str_dup(file);
+
+        LOCK(Run.mutex)
+        {
+                /* The settings and templates of the control file stay, the set statements fold into its global hash */
+                unsigned long long global = confighash.global;
+                buffer_stack_ptr      = 0;
+                lineno                = 1;
+                arglineno             = 1;
+                argcurrentfile        = NULL;
+                cfg_errflag           = 0;
+                discovering           = true;
+                discovered = tail = current = NULL;
+                command = command1 = command2 = NULL;
+                confighash.service    = false;
+                confighash.section    = CONFIGHASH_SEED;
+                servicegroupindex     = HashMap_new(64, Str_cmp, Str_hash);
+                for (ServiceGroup_T g = servicegrouplist; g; g = g->next)
+                        HashMap_put(servicegroupindex, g->name, g);
+                reset_sets();
+                yyparse();
+                lexreset();
+                fclose(yyin);
+                hashsection(false);
+                if (current)
+                        addservice(current);
+                confighash.global = global;
+                discovering = false;
+                HashMap_free(&servicegroupindex);
+                if (! cfg_errflag) {
+                        Service_T *dlt = &depend_list;
+                        depend_list = NULL;
+                        for (Service_T s = discovered; s; s = s->next) {
+                                if (! s->visited && ! discovered_visit(s, &dlt)) {
+                                        cfg_errflag++;
+                                        break;
+                                }
+                        }
+                }
+                if (cfg_errflag) {
+                        while (discovered) {
+                                Service_T s = discovered;
+                                discovered = s->next;
+                                Util_ungroupService(s);
+                                gc_service(&s);
+                        }
+                } else {
+                        for (Service_T s = depend_list; s; s = s->next_depend) {
+                                s->next = s->next_conf = s->next_depend;
+                                completeservice(s);
+                        }
+                        *services = depend_list;
+                }
+                depend_list = discovered = tail = current = NULL;
+        }
+        END_LOCK;
+
+        FREE(currentfile);
+
+        if (argyytext != NULL)
+                FREE(argyytext);
+
+        return cfg_errflag == 0;
+}
+
+
 /* ----------------------------------------------------------------- Private */
 
 
@@ -2793,11 +4190,14 @@ static void preparse() {
         argcurrentfile              = NULL;
         argyytext                   = NULL;
         /* Reset parser */
+        servicegroupindex            = HashMap_new(64, Str_cmp, Str_hash);
         Run.limits.sendExpectBuffer  = LIMIT_SENDEXPECTBUFFER;
         Run.limits.fileContentBuffer = LIMIT_FILECONTENTBUFFER;
         Run.limits.httpContentBuffer = LIMIT_HTTPCONTENTBUFFER;
         Run.limits.programOutput     = LIMIT_PROGRAMOUTPUT;
         Run.limits.networkTimeout    = LIMIT_NETWORKTIMEOUT;
+        Run.limits.socketBuffer      = LIMIT_SOCKETBUFFER;
+        Run.limits.logBuffer         = LIMIT_LOGBUFFER;
         Run.mmonitcredentials        = NULL;
         Run.httpd.flags              = Httpd_Disabled | Httpd_Signature;
         Run.httpd.credentials        = NULL;
@@ -2814,13 +4214,64 @@ static void preparse() {
         Run.MailFormat.subject       = NULL;
         Run.MailFormat.message       = NULL;
         depend_list                  = NULL;
+        confighash.service           = false;
+        confighash.section           = CONFIGHASH_SEED;
+        confighash.global            = CONFIGHASH_SEED;
         Run.flags |= Run_HandlerInit | Run_MmonitCredentials;
+        Run.flags &= ~(Run_ProcessEvents | Run_PressureEvents | Run_ProcessCpuCore | Run_LowMemory | Run_Launcher | Run_ExitAccounting);
+        Run.processEngine.collectorThreads = 1;
+        Run.flags &= ~(Run_FileEvents | Run_PacingAdaptive | Run_PacingSpread | Run_ChecksumCache | Run_StatBatch | Run_PingBatch | Run_UdpBatch | Run_LogAsync);
+        Run.fileEngine.recheckCycles = 10;
+        Run.checksumCache.verifyCycles = 0;
+        Run.checksumEngine.workers = 0;
+        Run.ioProbe.timeout = 0;
+        Run.ioProbe.workers = IOPROBE_WORKERS;
+        FREE(Run.heartbeat.socket);
+        FREE(Run.discovery.directory);
+        Run.statsd.port = 0;
+        FREE(Run.statsd.address);
+        FREE(Run.statsd.socket);
+        Run.deliveryEngine.slots = 0;
+        Run.seriesEngine.slots = 0;
+        FREE(Run.seriesEngine.file);
+        Run.mmonitBatch.size = 0;
+        Run.mmonitBatch.delay = 0;
+        Run.mmonitDelta.full = 0;
+        Run.federation.interval = 0;
+        Run.federation.cluster = false;
+        Run.stateEngine.sync = 0;
+        Run.alertDigest.window = 0;
+        FREE(Run.isolation.affinity);
+        FREE(Run.isolation.cgroup);
+        Run.isolation.policy = SchedulingPolicy_Default;
+        Run.isolation.ioClass = IoPriority_Default;
+        Run.isolation.ioLevel = 0;
+        Run.self.cycle = -1;
+        Run.resolverCache.ttl = 0;
+        Run.certificateCache.interval = 0;
+        FREE(Run.files.status);
+        Run.restartBackoff.delay = 0;
+        Run.restartBackoff.limit = 0;
+        Run.startupRamp.window = Run.startupRamp.restarts = Run.startupRamp.interval = 0;
+        Run.cycle.budget = 0;
+        Run.gpu.enabled = false;
+        Run.startupRamp.end = 0;
+        Run.adaptive.failed = Run.adaptive.stable = Run.adaptive.after = 0;
+        Run.logging.format = LogFormat_Text;
+        Run.logging.rateLimit = 0;
+        Run.logging.rateInterval = 60;
+        Run.checkEngine.workers = 1;
+        Run.controlEngine.workers = 1;
         for (int i = 0; i <= Handler_Max; i++)
                 Run.handler_queue[i] = 0;
+        reset_sets();
+}
 
-        /*
-         * Initialize objects
-         */
+
+/**
+ * Initialize the objects which collect the statement arguments
+ */
+static void reset_sets() {
         reset_uidset();
         reset_gidset();
         reset_statusset();
@@ -2829,6 +4280,7 @@ static void preparse() {
         reset_sslset();
         reset_mailserverset();
         reset_mmonitset();
+        reset_federationset();
         reset_portset();
         reset_permset();
         reset_icmpset();
@@ -2840,6 +4292,7 @@ static void preparse() {
         reset_rateset(&rate1);
         reset_rateset(&rate2);
         reset_filesystemset();
+        reset_quotaset();
         reset_resourceset();
         reset_checksumset();
         reset_timestampset();
@@ -2854,6 +4307,9 @@ static void postparse() {
         if (cfg_errflag)
                 return;
 
+        /* Close the last section of the control file */
+        hashsection(false);
+
         /* If defined - add the last service to the service list */
         if (current)
                 addservice(current);
@@ -2867,6 +4323,16 @@ static void postparse() {
         if (Run.files.log)
                 Run.flags |= Run_Log;
 
+        /* The low memory mode lowers the default limits, the limits which were set explicitly are kept */
+        if (Run.flags & Run_LowMemory) {
+                if (Run.limits.httpContentBuffer == LIMIT_HTTPCONTENTBUFFER)
+                        Run.limits.httpContentBuffer = LOWMEMORY_HTTPCONTENTBUFFER;
+                if (Run.limits.socketBuffer == LIMIT_SOCKETBUFFER)
+                        Run.limits.socketBuffer = LOWMEMORY_SOCKETBUFFER;
+                if (Run.limits.logBuffer == LIMIT_LOGBUFFER)
+                        Run.limits.logBuffer = LOWMEMORY_LOGBUFFER;
+        }
+
         /* Add the default general system service if not specified explicitly: service name default to hostname */
         if (! Run.system) {
                 char hostname[STRLEN];
@@ -2881,8 +4347,8 @@ static void postparse() {
                 Run.system = createservice(Service_System, Str_dup(hostname), NULL, check_system);
                 addservice(Run.system);
         }
-        addeventaction(&(Run.system->action_MONIT_START), Action_Start, Action_Ignored);
-        addeventaction(&(Run.system->action_MONIT_STOP), Action_Stop,  Action_Ignored);
+        _addeventaction(Run.system, &(Run.system->action_MONIT_START), Action_Start, Action_Ignored);
+        _addeventaction(Run.system, &(Run.system->action_MONIT_STOP), Action_Stop,  Action_Ignored);
 
         if (Run.mmonits) {
                 if (Run.httpd.flags & Httpd_Net) {
@@ -2904,6 +4370,9 @@ static void postparse() {
                 }
         }
 
+        for (Service_T s = servicelist; s; s = s->next)
+                completeservice(s);
+
         /* Check the sanity of any dependency graph */
         check_depend();
 
@@ -2912,6 +4381,21 @@ static void postparse() {
 #endif
 
         Processor_setHttpPostLimit();
+        Processor_resetAuthCache();
+}
+
+
+/*
+ * The global settings are part of every service configuration, the resource
+ * tests are compiled for the evaluation loop
+ */
+static void completeservice(Service_T s) {
+        for (int i = 0; i < (int)sizeof(confighash.global); i++) {
+                s->fingerprint ^= (confighash.global >> (8 * i)) & 0xff;
+                s->fingerprint *= CONFIGHASH_PRIME;
+        }
+        if (s->type == Service_Process || s->type == Service_System)
+                compile_resources(s);
 }
 
 
@@ -2946,8 +4430,11 @@ static Service_T createservice(Service_Type type, char *name, char *value, State
         NEW(current);
 
         current->type = type;
+        current->region = Arena_new(CONFIG_REGION);
 
         NEW(current->inf);
+        if (type == Service_File)
+                current->inf->priv.file.fd = -1;
         Util_resetInfo(current);
 
         if (type == Service_Program) {
@@ -2955,6 +4442,7 @@ static Service_T createservice(Service_Type type, char *name, char *value, State
                 current->program->args = command;
                 command = NULL;
                 current->program->timeout = PROGRAM_TIMEOUT;
+                current->program->outputLimit = -1;
         }
 
         /* Set default values */
@@ -2997,18 +4485,21 @@ static void addservice(Service_T s) {
                 case Service_Program:
                         // Verify that a program test has a status test
                         if (! s->statuslist) {
-                                LogError("'check program %s' is incomplete: Please add an 'if status != n' test\n", s->name);
+                                LogError("'check %s %s' is incomplete: Please add an 'if status != n' test\n", s->program->plugin ? "plugin" : "program", s->name);
                                 cfg_errflag++;
                         }
-                        // Create the Command object
                         char program[PATH_MAX];
                         strncpy(program, s->program->args->arg[0], sizeof(program) - 1);
-                        s->program->C = Command_new(program, NULL);
-                        for (int i = 1; i < s->program->args->length; i++) {
-                                Command_appendArgument(s->program->C, s->program->args->arg[i]);
+                        for (int i = 1; i < s->program->args->length; i++)
                                 snprintf(program + strlen(program), sizeof(program) - strlen(program) - 1, " %s", s->program->args->arg[i]);
-                        }
                         s->path = Str_dup(program);
+                        // The plugin is called in-process, there is no command
+                        if (s->program->plugin)
+                                break;
+                        // Create the Command object
+                        s->program->C = Command_new(s->program->args->arg[0], NULL);
+                        for (int i = 1; i < s->program->args->length; i++)
+                                Command_appendArgument(s->program->C, s->program->args->arg[i]);
                         if (s->program->args->has_uid)
                                 Command_setUid(s->program->C, s->program->args->uid);
                         if (s->program->args->has_gid)
@@ -3016,6 +4507,13 @@ static void addservice(Service_T s) {
                         // Set environment
                         Command_setEnv(s->program->C, "MONIT_SERVICE", s->name);
                         break;
+                case Service_Heartbeat:
+                        // Verify that a heartbeat service has a deadline
+                        if (! s->heartbeat) {
+                                LogError("'check heartbeat %s' is incomplete: Please add an 'if no heartbeat within n seconds' test\n", s->name);
+                                cfg_errflag++;
+                        }
+                        break;
                 case Service_Net:
                         if (! s->linkstatuslist) {
                                 // Add link status test if not defined
@@ -3044,6 +4542,16 @@ static void addservice(Service_T s) {
                         break;
         }
 
+        /* The services of a discovery file are kept aside, see parse_discovered() */
+        if (discovering) {
+                if (tail != NULL)
+                        tail->next = s;
+                else
+                        discovered = s;
+                tail = s;
+                return;
+        }
+
         /* Add the service to the end of the service list */
         if (tail != NULL) {
                 tail->next = s;
@@ -3053,6 +4561,7 @@ static void addservice(Service_T s) {
                 servicelist_conf = s;
         }
         tail = s;
+        Util_indexService(s);
 }
 
 
@@ -3065,19 +4574,12 @@ static void addservicegroup(char *name) {
         ASSERT(name);
 
         /* Check if service group with the same name is defined already */
-        for (g = servicegrouplist; g; g = g->next)
-                if (IS(g->name, name))
-                        break;
-
-        if (! g) {
-                NEW(g);
-                g->name = Str_dup(name);
-                g->members = List_new();
-                g->next = servicegrouplist;
-                servicegrouplist = g;
+        if (! (g = HashMap_get(servicegroupindex, name))) {
+                g = Util_newServiceGroup(name);
+                HashMap_put(servicegroupindex, g->name, g);
         }
 
-        List_append(g->members, current);
+        Util_groupService(current, g);
 }
 
 
@@ -3090,12 +4592,13 @@ static void adddependant(char *dependant) {
 
         ASSERT(dependant);
 
-        NEW(d);
+        REGION_NEW(current, d);
 
         if (current->dependantlist)
                 d->next = current->dependantlist;
 
-        d->dependant = dependant;
+        d->dependant = Arena_dup(current->region, dependant);
+        FREE(dependant);
         current->dependantlist = d;
 
 }
@@ -3134,20 +4637,27 @@ static void addport(Port_T *list, Port_T port) {
 
         if (port->protocol->check == check_radius && port->type != Socket_Udp)
                 yyerror("Radius protocol test supports UDP only");
+        if (port->protocol->check == check_snmp)
+                checksnmp(port);
+        if (port->session.enabled && ! port->protocol->ping)
+                yyerror2("Persistent session is not supported by the %s protocol test", port->protocol->name);
 
         Port_T p;
         NEW(p);
         p->is_available       = Connection_Init;
+        p->phases.dns         = p->phases.connect = p->phases.tls = p->phases.firstbyte = -1.;
         p->type               = port->type;
         p->socket             = port->socket;
         p->family             = port->family;
         p->action             = port->action;
         p->timeout            = port->timeout;
         p->retry              = port->retry;
+        p->session.enabled    = port->session.enabled;
         p->protocol           = port->protocol;
         p->hostname           = port->hostname;
         p->url_request        = port->url_request;
         p->outgoing           = port->outgoing;
+        p->metrics            = port->metrics;
         if (p->family == Socket_Unix) {
                 p->target.unix.pathname = port->target.unix.pathname;
         } else {
@@ -3167,6 +4677,8 @@ static void addport(Port_T *list, Port_T port) {
                         p->target.net.ssl.clientpemfile = sslset.clientpemfile;
                         p->target.net.ssl.CACertificateFile = sslset.CACertificateFile;
                         p->target.net.ssl.CACertificatePath = sslset.CACertificatePath;
+                        if (p->protocol->check == check_http2 || p->protocol->check == check_grpc)
+                                p->target.net.ssl.protocol = "h2";
 #else
                         yyerror("SSL check cannot be activated -- SSL disabled");
 #endif
@@ -3204,6 +4716,141 @@ static void addhttpheader(Port_T port, const char *header) {
 }
 
 
+/*
+ * Get the current HTTP/2 request of the port. A new request is appended if
+ * the path is set, the options apply to the last request (the options before
+ * the first path belong to the first request, which is "/" without a path)
+ */
+static Http2Request_T addhttp2request(char *path) {
+        Http2Request_T *last = &portset.parameters.http2.requests;
+        while (*last && (*last)->next)
+                last = &(*last)->next;
+        if (*last && ! path)
+                return *last;
+        if (*last && ! (*last)->path) {
+                // Options were given before the first request path
+                (*last)->path = path;
+                return *last;
+        }
+        Http2Request_T r;
+        NEW(r);
+        r->path = path;
+        if (*last)
+                (*last)->next = r;
+        else
+                *last = r;
+        return r;
+}
+
+
+/*
+ * Add a content test to the current HTTP/2 request
+ */
+static void addhttp2content(int operator, char *regex) {
+        ASSERT(regex);
+        Http2Request_T r = addhttp2request(NULL);
+        char errbuf[STRLEN];
+        RequestContent_T content;
+        NEW(content);
+        content->operator = operator;
+        if (! (content->regex = RegexCache_get(regex, errbuf, STRLEN)))
+                yyerror2("Regex parsing error: %s", errbuf);
+        RequestContent_T *last = &r->contents;
+        while (*last)
+                last = &(*last)->next;
+        *last = content;
+}
+
+
+static void addhttp2header(const char *header) {
+        if (! portset.parameters.http2.headers)
+                portset.parameters.http2.headers = List_new();
+        List_append(portset.parameters.http2.headers, (char *)header);
+}
+
+
+/*
+ * Add a server statistic threshold to the current port, the text value can be
+ * compared for equality only, the rate limit applies to the change per second
+ */
+static void addservermetric(char *name, Operator_Type operator, double limit, char *text, boolean_t rate) {
+        if (operator == Operator_Changed)
+                yyerror2("The changed operator is not supported by the metric test");
+        else if (text && operator != Operator_Equal && operator != Operator_NotEqual)
+                yyerror2("The metric '%s' value '%s' can be compared with = or != only", name, text);
+        ServerMetric_T m;
+        NEW(m);
+        m->name = name;
+        m->operator = operator;
+        m->limit = limit;
+        m->text = text;
+        m->rate = rate;
+        ServerMetric_T *last = &portset.metrics;
+        while (*last)
+                last = &(*last)->next;
+        *last = m;
+}
+
+
+/*
+ * Check the SNMP options of the port and set the defaults: version 2c with the
+ * "public" community, SHA1 authentication for SNMPv3
+ */
+static void checksnmp(Port_T port) {
+        if (port->type != Socket_Udp)
+                yyerror("SNMP protocol test supports UDP only");
+        if (! port->parameters.snmp.version)
+                port->parameters.snmp.version = 2;
+        if (port->parameters.snmp.version < 3) {
+                if (port->parameters.snmp.username || port->parameters.snmp.password || port->parameters.snmp.privacy)
+                        yyerror("SNMP username, password and privacy require version 3");
+                if (! port->parameters.snmp.community)
+                        port->parameters.snmp.community = Str_dup("public");
+        } else {
+                if (port->parameters.snmp.community)
+                        yyerror("SNMP community is not used by version 3 -- use username");
+                if (! port->parameters.snmp.username)
+                        yyerror("SNMP version 3 requires the username");
+                else if (strlen(port->parameters.snmp.username) > 32)
+                        yyerror("SNMP username too long -- the maximum is 32 characters");
+                if (port->parameters.snmp.password && strlen(port->parameters.snmp.password) < 8)
+                        yyerror("SNMP password too short -- the minimum is 8 characters");
+                if (port->parameters.snmp.privacy) {
+#ifdef HAVE_OPENSSL
+                        if (! port->parameters.snmp.password)
+                                yyerror("SNMP privacy requires the authentication password");
+                        else if (strlen(port->parameters.snmp.privacy) < 8)
+                                yyerror("SNMP privacy passphrase too short -- the minimum is 8 characters");
+#else
+                        yyerror("SNMP privacy cannot be activated -- SSL disabled");
+#endif
+                }
+        }
+        if (! port->parameters.snmp.authentication)
+                port->parameters.snmp.authentication = Hash_Sha1;
+        for (ServerMetric_T m = port->metrics; m; m = m->next) {
+                // The metric names are the object identifiers in the dotted form as reported, the leading dot is optional
+                if (*m->name == '.')
+                        memmove(m->name, m->name + 1, strlen(m->name));
+                size_t length = strlen(m->name);
+                if (! length || strspn(m->name, "0123456789.") != length || *m->name == '.' || m->name[length - 1] == '.' || strstr(m->name, ".."))
+                        yyerror2("Invalid SNMP object identifier '%s' -- use the numeric form such as 1.3.6.1.2.1.1.3.0", m->name);
+        }
+}
+
+
+/*
+ * Add a service name to the gRPC health check of the port
+ */
+static void addgrpcservice(char *name) {
+        if (strlen(name) > 127)
+                yyerror2("gRPC service name too long, the maximum is 127 characters");
+        if (! portset.parameters.grpc.services)
+                portset.parameters.grpc.services = List_new();
+        List_append(portset.parameters.grpc.services, name);
+}
+
+
 /*
  * Add a new resource object to the current service resource list
  */
@@ -3212,13 +4859,16 @@ static void addresource(Resource_T rr) {
 
         ASSERT(rr);
 
-        NEW(r);
-        if (! (Run.flags & Run_ProcessEngineEnabled))
+        REGION_NEW(current, r);
+        if (current->type != Service_Directory && current->type != Service_Filesystem && current->type != Service_Metric && ! (Run.flags & Run_ProcessEngineEnabled))
                 yyerror("Cannot activate service check. The process status engine was disabled. On certain systems you must run monit as root to utilize this feature)\n");
         r->resource_id = rr->resource_id;
         r->limit       = rr->limit;
         r->action      = rr->action;
         r->operator    = rr->operator;
+        r->pressure    = rr->pressure;
+        r->meminfo     = rr->meminfo ? Arena_dup(current->region, rr->meminfo) : NULL;
+        r->average     = rr->average;
         r->next        = current->resourcelist;
 
         current->resourcelist = r;
@@ -3226,6 +4876,58 @@ static void addresource(Resource_T rr) {
 }
 
 
+/*
+ * Set the pressure resource test, the selector is encoded by the lexer as
+ * (Pressure_Type << 3) | (full << 2) | window
+ */
+static void setpressure(Resource_Type id, int selector) {
+        resourceset.resource_id = id;
+        resourceset.pressure.type = selector >> 3;
+        resourceset.pressure.full = selector & 4 ? true : false;
+        resourceset.pressure.window = selector & 3;
+}
+
+
+/*
+ * Set the average resource test. The memory and swap averages are amounts
+ * if the limit has a byte unit (unit > 0), percentages otherwise.
+ */
+static void setaverage(Resource_Type id, int unit, int window) {
+        if (unit) {
+                if (id == Resource_MemoryPercent)
+                        id = Resource_MemoryKbyte;
+                else if (id == Resource_MemoryPercentTotal)
+                        id = Resource_MemoryKbyteTotal;
+                else if (id == Resource_SwapPercent)
+                        id = Resource_SwapKbyte;
+                else if (id != Resource_LoadAverage1m && id != Resource_LoadAverage5m && id != Resource_LoadAverage15m && id != Resource_Threads && id != Resource_Children)
+                        yyerror2("The average cpu limit must be a percentage");
+        } else if (id == Resource_LoadAverage1m || id == Resource_LoadAverage5m || id == Resource_LoadAverage15m || id == Resource_Threads || id == Resource_Children) {
+                yyerror2("The average limit cannot be a percentage");
+        }
+        if (! Series_getMetric(current->type, id))
+                yyerror2("The average test of this resource is not supported in the %s service", servicetypes[current->type]);
+        if (window < 1)
+                yyerror2("The average window must be greater than 0");
+        resourceset.resource_id = id;
+        resourceset.average = window;
+        // The average needs the time-series store, use the default setup unless set
+        if (! Run.seriesEngine.slots)
+                Run.seriesEngine.slots = SERIES_SLOTS;
+}
+
+
+/*
+ * Set the GPU resource test, the GPU collector is started for it
+ */
+static void setgpuresource(Resource_Type id, Operator_Type operator, double limit) {
+        resourceset.resource_id = id;
+        resourceset.operator = operator;
+        resourceset.limit = limit;
+        Run.gpu.enabled = true;
+}
+
+
 /*
  * Add a new file object to the current service timestamp list
  */
@@ -3233,7 +4935,7 @@ static void addtimestamp(Timestamp_T ts) {
         ASSERT(ts);
 
         Timestamp_T t;
-        NEW(t);
+        REGION_NEW(current, t);
         t->operator     = ts->operator;
         t->time         = ts->time;
         t->action       = ts->action;
@@ -3255,6 +4957,20 @@ static void addtimestamp(Timestamp_T ts) {
 }
 
 
+/*
+ * Set the heartbeat deadline test of the current service
+ */
+static void addheartbeat(int timeout, Action_Type failed, Action_Type succeeded) {
+        if (current->heartbeat)
+                yyerror2("The heartbeat test is already defined");
+        if (timeout <= 0)
+                yyerror2("The heartbeat deadline must be greater than 0");
+        REGION_NEW(current, current->heartbeat);
+        current->heartbeat->timeout = timeout;
+        addeventaction(&(current->heartbeat)->action, failed, succeeded);
+}
+
+
 /*
  * Add a new object to the current service actionrate list
  */
@@ -3268,7 +4984,7 @@ static void addactionrate(ActionRate_T ar) {
         if (ar->count <= 0 || ar->cycle <= 0)
                 yyerror2("Zero or negative values not allowed in a action rate statement");
 
-        NEW(a);
+        REGION_NEW(current, a);
         a->count  = ar->count;
         a->cycle  = ar->cycle;
         a->action = ar->action;
@@ -3290,7 +5006,7 @@ static void addsize(Size_T ss) {
 
         ASSERT(ss);
 
-        NEW(s);
+        REGION_NEW(current, s);
         s->operator     = ss->operator;
         s->size         = ss->size;
         s->action       = ss->action;
@@ -3317,7 +5033,7 @@ static void adduptime(Uptime_T uu) {
 
         ASSERT(uu);
 
-        NEW(u);
+        REGION_NEW(current, u);
         u->operator = uu->operator;
         u->uptime = uu->uptime;
         u->action = uu->action;
@@ -3329,6 +5045,54 @@ static void adduptime(Uptime_T uu) {
 }
 
 
+/*
+ * Add a new response time percentile object to the current service list
+ */
+static void addresponsetime(ResponseTime_T rr) {
+        ResponseTime_T r;
+
+        ASSERT(rr);
+
+        REGION_NEW(current, r);
+        r->percentile = rr->percentile;
+        r->operator = rr->operator;
+        r->limit = rr->limit;
+        r->action = rr->action;
+
+        r->next = current->responsetimelist;
+        current->responsetimelist = r;
+
+        reset_responsetimeset();
+}
+
+
+/*
+ * Add a new growth rate object to the current service growth list
+ */
+static void addgrowth(Growth_T gg) {
+        Growth_T g;
+
+        ASSERT(gg);
+
+        REGION_NEW(current, g);
+        g->metric = Arena_dup(current->region, gg->metric);
+        g->operator = gg->operator;
+        g->limit = gg->limit;
+        g->unit = gg->unit;
+        g->bytes = gg->bytes;
+        g->action = gg->action;
+
+        g->next = current->growthlist;
+        current->growthlist = g;
+
+        // The growth needs the time-series store, use the default setup unless set
+        if (! Run.seriesEngine.slots)
+                Run.seriesEngine.slots = SERIES_SLOTS;
+
+        reset_growthset();
+}
+
+
 /*
  * Add a new Pid object to the current service pid list
  */
@@ -3336,7 +5100,7 @@ static void addpid(Pid_T pp) {
         ASSERT(pp);
 
         Pid_T p;
-        NEW(p);
+        REGION_NEW(current, p);
         p->action = pp->action;
 
         p->next = current->pidlist;
@@ -3353,7 +5117,7 @@ static void addppid(Pid_T pp) {
         ASSERT(pp);
 
         Pid_T p;
-        NEW(p);
+        REGION_NEW(current, p);
         p->action = pp->action;
 
         p->next = current->ppidlist;
@@ -3370,7 +5134,7 @@ static void addfsflag(Fsflag_T ff) {
         ASSERT(ff);
 
         Fsflag_T f;
-        NEW(f);
+        REGION_NEW(current, f);
         f->action = ff->action;
 
         f->next = current->fsflaglist;
@@ -3387,7 +5151,7 @@ static void addnonexist(Nonexist_T ff) {
         ASSERT(ff);
 
         Nonexist_T f;
-        NEW(f);
+        REGION_NEW(current, f);
         f->action = ff->action;
 
         f->next = current->nonexistlist;
@@ -3397,6 +5161,40 @@ static void addnonexist(Nonexist_T ff) {
 }
 
 
+/*
+ * Enable the recursive scan of the current directory service
+ */
+static void adddirscan() {
+        if (! current->dirscan)
+                NEW(current->dirscan);
+}
+
+
+/*
+ * Set the file set of the current file service, its path is the glob pattern of the members
+ */
+static void addfileset() {
+        if (*current->path != '/')
+                yyerror2("The file set pattern must be an absolute path");
+        NEW(current->fileset);
+        current->fileset->pattern = Str_dup(current->path);
+}
+
+
+/*
+ * Set the directory tree checksum test in the current service
+ */
+static void addtreesum(Checksum_T cs) {
+        ASSERT(cs);
+        if (current->treesum)
+                yyerror2("The tree checksum test is already defined");
+        NEW(current->treesum);
+        current->treesum->type = cs->type == Hash_Unknown ? Hash_Default : cs->type;
+        current->treesum->action = cs->action;
+        reset_checksumset();
+}
+
+
 /*
  * Set Checksum object in the current service
  */
@@ -3405,12 +5203,19 @@ static void addchecksum(Checksum_T cs) {
 
         cs->initialized = true;
 
-        if (! *cs->hash) {
+        if (! *cs->hash && current->fileset) {
+                /* The file set members are compared with their own previous checksum */
+                if (cs->type == Hash_Unknown)
+                        cs->type = Hash_Default;
+                cs->test_changes = true;
+        } else if (! *cs->hash) {
                 if (cs->type == Hash_Unknown)
                         cs->type = Hash_Default;
                 if (! (Util_getChecksum(current->path, cs->type, cs->hash, sizeof(cs->hash)))) {
                         /* If the file doesn't exist, set dummy value */
-                        snprintf(cs->hash, sizeof(cs->hash), cs->type == Hash_Md5 ? "00000000000000000000000000000000" : "0000000000000000000000000000000000000000");
+                        int length = Util_getHashLength(cs->type);
+                        memset(cs->hash, '0', length);
+                        cs->hash[length] = 0;
                         cs->initialized = false;
                         yywarning2("Cannot compute a checksum for file %s", current->path);
                 }
@@ -3422,12 +5227,14 @@ static void addchecksum(Checksum_T cs) {
                         cs->type = Hash_Md5;
                 } else if (len == 40) {
                         cs->type = Hash_Sha1;
+                } else if (len == 64) {
+                        cs->type = Hash_Sha256;
                 } else {
                         yyerror2("Unknown checksum type [%s] for file %s", cs->hash, current->path);
                         reset_checksumset();
                         return;
                 }
-        } else if ((cs->type == Hash_Md5 && len != 32) || (cs->type == Hash_Sha1 && len != 40)) {
+        } else if (len != Util_getHashLength(cs->type)) {
                 yyerror2("Invalid checksum [%s] for file %s", cs->hash, current->path);
                 reset_checksumset();
                 return;
@@ -3455,7 +5262,7 @@ static void addperm(Perm_T ps) {
         ASSERT(ps);
 
         Perm_T p;
-        NEW(p);
+        REGION_NEW(current, p);
         p->action = ps->action;
         p->test_changes = ps->test_changes;
         if (p->test_changes) {
@@ -3477,7 +5284,7 @@ static void addlinkstatus(Service_T s, LinkStatus_T L) {
         ASSERT(L);
         
         LinkStatus_T l;
-        NEW(l);
+        REGION_NEW(s, l);
         l->action = L->action;
         
         l->next = s->linkstatuslist;
@@ -3491,7 +5298,7 @@ static void addlinkspeed(Service_T s, LinkSpeed_T L) {
         ASSERT(L);
         
         LinkSpeed_T l;
-        NEW(l);
+        REGION_NEW(s, l);
         l->action = L->action;
         
         l->next = s->linkspeedlist;
@@ -3505,7 +5312,7 @@ static void addlinksaturation(Service_T s, LinkSaturation_T L) {
         ASSERT(L);
         
         LinkSaturation_T l;
-        NEW(l);
+        REGION_NEW(s, l);
         l->operator = L->operator;
         l->limit = L->limit;
         l->action = L->action;
@@ -3526,6 +5333,8 @@ static void addbandwidth(Bandwidth_T *list, Bandwidth_T b) {
 
         if (b->rangecount * b->range > 24 * Time_Hour) {
                 yyerror2("Maximum range for total test is 24 hours");
+        } else if (b->range == Time_Second && b->rangecount > 3600) {
+                yyerror2("Maximum value for [second(s)] unit is 3600");
         } else if (b->range == Time_Minute && b->rangecount > 60) {
                 yyerror2("Maximum value for [minute(s)] unit is 60");
         } else if (b->range == Time_Hour && b->rangecount > 24) {
@@ -3539,7 +5348,7 @@ static void addbandwidth(Bandwidth_T *list, Bandwidth_T b) {
                         b->range = Time_Hour;
                 }
                 Bandwidth_T bandwidth;
-                NEW(bandwidth);
+                REGION_NEW(current, bandwidth);
                 bandwidth->operator = b->operator;
                 bandwidth->limit = b->limit;
                 bandwidth->rangecount = b->rangecount;
@@ -3547,6 +5356,9 @@ static void addbandwidth(Bandwidth_T *list, Bandwidth_T b) {
                 bandwidth->action = b->action;
                 bandwidth->next = *list;
                 *list = bandwidth;
+                // Keep a per second history long enough for the rate range
+                if (b->range == Time_Second && b->rangecount > 1 && b->rangecount > Link_getHistory(current->inf->priv.net.stats))
+                        Link_setHistory(current->inf->priv.net.stats, b->rangecount);
         }
         reset_bandwidthset();
 }
@@ -3573,11 +5385,14 @@ static void addmatch(Match_T ms, int actionnumber, int linenumber) {
 
         ASSERT(ms);
 
+        if (current->fileset)
+                yyerror2("The content test is not supported by the file set service");
+
         NEW(m);
-        NEW(m->regex_comp);
 
         m->match_string = ms->match_string;
         m->match_path   = ms->match_path ? Str_dup(ms->match_path) : NULL;
+        m->container    = ms->container;
         m->action       = ms->action;
         m->not          = ms->not;
         m->ignore       = ms->ignore;
@@ -3585,11 +5400,8 @@ static void addmatch(Match_T ms, int actionnumber, int linenumber) {
 
         addeventaction(&(m->action), actionnumber, Action_Ignored);
 
-        int reg_return = regcomp(m->regex_comp, ms->match_string, REG_NOSUB|REG_EXTENDED);
-
-        if (reg_return != 0) {
-                char errbuf[STRLEN];
-                regerror(reg_return, ms->regex_comp, errbuf, STRLEN);
+        char errbuf[STRLEN];
+        if (! (m->regex_comp = RegexCache_get(ms->match_string, errbuf, STRLEN))) {
                 if (m->match_path != NULL)
                         yyerror2("Regex parsing error: %s on line %i of", errbuf, linenumber);
                 else
@@ -3659,7 +5471,7 @@ static void addmatchpath(Match_T ms, Action_Type actionnumber) {
 static void addstatus(Status_T status) {
         Status_T s;
         ASSERT(status);
-        NEW(s);
+        REGION_NEW(current, s);
         s->initialized = status->initialized;
         s->return_value = status->return_value;
         s->operator = status->operator;
@@ -3678,7 +5490,7 @@ static Uid_T adduid(Uid_T u) {
         ASSERT(u);
 
         Uid_T uid;
-        NEW(uid);
+        REGION_NEW(current, uid);
         uid->uid = u->uid;
         uid->action = u->action;
         reset_uidset();
@@ -3693,7 +5505,7 @@ static Gid_T addgid(Gid_T g) {
         ASSERT(g);
 
         Gid_T gid;
-        NEW(gid);
+        REGION_NEW(current, gid);
         gid->gid = g->gid;
         gid->action = g->action;
         reset_gidset();
@@ -3709,7 +5521,7 @@ static void addfilesystem(Filesystem_T ds) {
 
         ASSERT(ds);
 
-        NEW(dev);
+        REGION_NEW(current, dev);
         dev->resource           = ds->resource;
         dev->operator           = ds->operator;
         dev->limit_absolute     = ds->limit_absolute;
@@ -3724,6 +5536,29 @@ static void addfilesystem(Filesystem_T ds) {
 }
 
 
+/*
+ * Add a new quota object to the current service's quota list
+ */
+static void addquota(Quota_T qs) {
+        ASSERT(qs);
+
+        Quota_T q;
+        REGION_NEW(current, q);
+        q->type           = qs->type;
+        q->inode          = qs->inode;
+        q->operator       = qs->operator;
+        q->id             = qs->id;
+        q->limit_absolute = qs->limit_absolute;
+        q->limit_percent  = qs->limit_percent;
+        q->action         = qs->action;
+
+        q->next           = current->quotalist;
+        current->quotalist = q;
+
+        reset_quotaset();
+}
+
+
 /*
  * Add a new icmp object to the current service's icmp list
  */
@@ -3742,6 +5577,8 @@ static void addicmp(Icmp_T is) {
         icmp->outgoing     = is->outgoing;
         icmp->is_available = Connection_Init;
         icmp->response     = -1;
+        icmp->jitter       = -1;
+        icmp->loss         = -1;
 
         icmp->next         = current->icmplist;
         current->icmplist  = icmp;
@@ -3754,13 +5591,36 @@ static void addicmp(Icmp_T is) {
  * Set EventAction object
  */
 static void addeventaction(EventAction_T *_ea, Action_Type failed, Action_Type succeeded) {
+        _addeventaction(current, _ea, failed, succeeded);
+}
+
+
+/*
+ * Move the command into the service memory region
+ */
+static command_t _regioncommand(Service_T s, command_t *c) {
+        command_t r;
+        REGION_NEW(s, r);
+        *r = **c;
+        for (int i = 0; (*c)->arg[i]; i++)
+                r->arg[i] = Arena_dup(s->region, (*c)->arg[i]);
+        gccmd(c);
+        return r;
+}
+
+
+/*
+ * Set the event action of the service test
+ */
+static void _addeventaction(Service_T s, EventAction_T *_ea, Action_Type failed, Action_Type succeeded) {
         EventAction_T ea;
 
+        ASSERT(s);
         ASSERT(_ea);
 
-        NEW(ea);
-        NEW(ea->failed);
-        NEW(ea->succeeded);
+        REGION_NEW(s, ea);
+        REGION_NEW(s, ea->failed);
+        REGION_NEW(s, ea->succeeded);
 
         ea->failed->id = failed;
         ea->failed->repeat = repeat1;
@@ -3768,8 +5628,7 @@ static void addeventaction(EventAction_T *_ea, Action_Type failed, Action_Type s
         ea->failed->cycles = rate1.cycles;
         if (failed == Action_Exec) {
                 ASSERT(command1);
-                ea->failed->exec = command1;
-                command1 = NULL;
+                ea->failed->exec = _regioncommand(s, &command1);
         }
 
         ea->succeeded->id = succeeded;
@@ -3778,8 +5637,7 @@ static void addeventaction(EventAction_T *_ea, Action_Type failed, Action_Type s
         ea->succeeded->cycles = rate2.cycles;
         if (succeeded == Action_Exec) {
                 ASSERT(command2);
-                ea->succeeded->exec = command2;
-                command2 = NULL;
+                ea->succeeded->exec = _regioncommand(s, &command2);
         }
         *_ea = ea;
         reset_rateset(&rate);
@@ -3807,15 +5665,10 @@ static void addgeneric(Port_T port, char *send, char *expect) {
                 g->send = send;
                 g->expect = NULL;
         } else if (expect) {
-                int reg_return;
-                NEW(g->expect);
-                reg_return = regcomp(g->expect, expect, REG_NOSUB|REG_EXTENDED);
-                FREE(expect);
-                if (reg_return != 0) {
-                        char errbuf[STRLEN];
-                        regerror(reg_return, g->expect, errbuf, STRLEN);
+                char errbuf[STRLEN];
+                if (! (g->expect = RegexCache_get(expect, errbuf, STRLEN)))
                         yyerror2("Regex parsing error: %s", errbuf);
-                }
+                FREE(expect);
                 g->send = NULL;
         }
 }
@@ -3887,7 +5740,7 @@ static void prepare_urlrequest(URL_T U) {
 
 
 /*
- * Set the url request for a port
+ * Add a content test to the url request of a port
  */
 static void  seturlrequest(int operator, char *regex) {
 
@@ -3895,15 +5748,17 @@ static void  seturlrequest(int operator, char *regex) {
 
         if (! urlrequest)
                 NEW(urlrequest);
-        urlrequest->operator = operator;
-        int reg_return;
-        NEW(urlrequest->regex);
-        reg_return = regcomp(urlrequest->regex, regex, REG_NOSUB|REG_EXTENDED);
-        if (reg_return != 0) {
-                char errbuf[STRLEN];
-                regerror(reg_return, urlrequest->regex, errbuf, STRLEN);
+        char errbuf[STRLEN];
+        RequestContent_T content;
+        NEW(content);
+        content->operator = operator;
+        if (! (content->regex = RegexCache_get(regex, errbuf, STRLEN)))
                 yyerror2("Regex parsing error: %s", errbuf);
-        }
+        // Keep the configuration order, all the tests are applied to one read of the response body
+        RequestContent_T *last = &urlrequest->contents;
+        while (*last)
+                last = &(*last)->next;
+        *last = content;
 }
 
 
@@ -3934,6 +5789,7 @@ static void addmmonit(Mmonit_T mmonit) {
 #endif
         }
         c->timeout = mmonit->timeout;
+        pthread_mutex_init(&c->mutex, NULL);
         c->next = NULL;
 
         if (Run.mmonits) {
@@ -3949,6 +5805,48 @@ static void addmmonit(Mmonit_T mmonit) {
 }
 
 
+/*
+ * Add a new downstream agent to the federation
+ */
+static void addfederationagent(FederationAgent_T agent) {
+        ASSERT(agent->url);
+
+        FederationAgent_T a;
+        NEW(a);
+        a->url = agent->url;
+        a->ssl.flags = sslset.flags;
+        a->ssl.verify = sslset.verify;
+        a->ssl.allowSelfSigned = sslset.allowSelfSigned;
+        a->ssl.minimumValidDays = sslset.minimumValidDays;
+        a->ssl.version = sslset.version;
+        a->ssl.checksumType = sslset.checksumType;
+        a->ssl.checksum = sslset.checksum;
+        a->ssl.clientpemfile = sslset.clientpemfile;
+        a->ssl.CACertificateFile = sslset.CACertificateFile;
+        a->ssl.CACertificatePath = sslset.CACertificatePath;
+        if (IS(a->url->protocol, "https")) {
+#ifdef HAVE_OPENSSL
+                a->ssl.flags = SSL_Enabled;
+#else
+                yyerror("SSL check cannot be activated -- SSL disabled");
+#endif
+        }
+        a->timeout = agent->timeout;
+        a->next = NULL;
+
+        if (Run.federation.agents) {
+                FederationAgent_T A;
+                for (A = Run.federation.agents; A->next; A = A->next)
+                        /* Empty */ ;
+                A->next = a;
+        } else {
+                Run.federation.agents = a;
+        }
+        reset_sslset();
+        reset_federationset();
+}
+
+
 /*
  * Add a new smtp server to the mail server list
  */
@@ -4046,6 +5944,31 @@ static gid_t get_gid(char *group, gid_t gid) {
 }
 
 
+/*
+ * Return the project id of the named project in /etc/projid, which has
+ * the "name:id" format used by the XFS and ext4 project quota tools
+ */
+static int get_projid(char *project) {
+        char line[STRLEN];
+        FILE *f = fopen("/etc/projid", "r");
+        if (f) {
+                while (fgets(line, sizeof(line), f)) {
+                        char *id = strchr(line, ':');
+                        if (id && *line != '#') {
+                                *id++ = 0;
+                                if (IS(Str_trim(line), project)) {
+                                        fclose(f);
+                                        return (int)strtol(id, NULL, 10);
+                                }
+                        }
+                }
+                fclose(f);
+        }
+        yyerror2("Requested project not found in /etc/projid");
+        return 0;
+}
+
+
 /*
  * Add a new user id to the current command object.
  */
@@ -4088,6 +6011,32 @@ static void setlogfile(char *logfile) {
 }
 
 
+/*
+ * Log to the systemd journal
+ */
+static void setjournal() {
+        if (! Run.files.log || ihp.logfile) {
+                ihp.logfile = true;
+                setlogfile(Str_dup("journald"));
+                Run.flags &= ~Run_UseSyslog;
+                Run.flags |= Run_UseJournal | Run_Log;
+        }
+}
+
+
+/*
+ * Set the log rate limit per message site
+ */
+static void setlogratelimit(int count, int interval) {
+        if (count < 1)
+                yyerror2("The log rate limit must be greater than 0");
+        else if (interval < 1)
+                yyerror2("The log rate limit interval must be greater than 0 seconds");
+        Run.logging.rateLimit = count;
+        Run.logging.rateInterval = interval;
+}
+
+
 /*
  * Reset the pidfile if changed
  */
@@ -4264,6 +6213,7 @@ static void setsyslog(char *facility) {
         if (! Run.files.log || ihp.logfile) {
                 ihp.logfile = true;
                 setlogfile(Str_dup("syslog"));
+                Run.flags &= ~Run_UseJournal;
                 Run.flags |= Run_UseSyslog;
                 Run.flags |= Run_Log;
         }
@@ -4331,6 +6281,15 @@ static void reset_mmonitset() {
 }
 
 
+/*
+ * Reset the federation agent set to default values
+ */
+static void reset_federationset() {
+        memset(&federationset, 0, sizeof(struct myfederationagent));
+        federationset.timeout = Run.limits.networkTimeout;
+}
+
+
 /*
  * Reset the Port set to default values
  */
@@ -4354,6 +6313,11 @@ static void reset_resourceset() {
         resourceset.limit = 0;
         resourceset.action = NULL;
         resourceset.operator = Operator_Equal;
+        resourceset.pressure.type = Pressure_Cpu;
+        resourceset.pressure.full = false;
+        resourceset.pressure.window = 0;
+        FREE(resourceset.meminfo);
+        resourceset.average = 0;
 }
 
 
@@ -4400,6 +6364,24 @@ static void reset_uptimeset() {
 }
 
 
+static void reset_responsetimeset() {
+        responsetimeset.percentile = 0;
+        responsetimeset.operator = Operator_Greater;
+        responsetimeset.limit = 0.;
+        responsetimeset.action = NULL;
+}
+
+
+static void reset_growthset() {
+        FREE(growthset.metric);
+        growthset.operator = Operator_Greater;
+        growthset.limit = 0.;
+        growthset.unit = Time_Second;
+        growthset.bytes = false;
+        growthset.action = NULL;
+}
+
+
 static void reset_linkstatusset() {
         linkstatusset.action = NULL;
 }
@@ -4512,6 +6494,14 @@ static void reset_gidset() {
 /*
  * Reset the Filesystem set to default values
  */
+static void reset_quotaset() {
+        memset(&quotaset, 0, sizeof(struct myquota));
+        quotaset.operator = Operator_Equal;
+        quotaset.limit_absolute = -1;
+        quotaset.limit_percent = -1.;
+}
+
+
 static void reset_filesystemset() {
         filesystemset.resource = 0;
         filesystemset.operator = Operator_Equal;
@@ -4551,7 +6541,10 @@ static void reset_rateset(struct myrate *rate) {
 static void check_name(char *name) {
         ASSERT(name);
 
-        if (Util_existService(name) || (current && IS(name, current->name)))
+        boolean_t conflict = Util_existService(name) || (current && IS(name, current->name));
+        for (Service_T s = discovering ? discovered : NULL; s && ! conflict; s = s->next)
+                conflict = IS(name, s->name);
+        if (conflict)
                 yyerror2("Service name conflict, %s already defined", name);
         if (name && *name == '/')
                 yyerror2("Service name '%s' must not start with '/' -- ", name);
@@ -4577,53 +6570,45 @@ static int check_perm(int perm) {
 }
 
 
+/*
+ * Append the service to the depend list after the services it depends on
+ * (depth first post-order). A service which was visited, but isn't in the
+ * list yet, is on the current path and closes a depend loop.
+ */
+static void depend_visit(Service_T s, Service_T **dlt) {
+        s->visited = true;
+        for (Dependant_T d = s->dependantlist; d; d = d->next) {
+                Service_T dp = d->service ? d->service : (d->service = Util_getService(d->dependant));
+                if (! dp) {
+                        LogError("Depend service '%s' is not defined in the control file\n", d->dependant);
+                        exit(1);
+                }
+                if (! dp->visited) {
+                        depend_visit(dp, dlt);
+                } else if (! dp->next_depend && *dlt != &dp->next_depend) {
+                        LogError("Found a depend loop in the control file involving the service '%s'\n", dp->name);
+                        exit(1);
+                }
+        }
+        **dlt = s;
+        *dlt = &s->next_depend;
+}
+
+
 /*
  * Check the dependency graph for errors
  * by doing a topological sort, thereby finding any cycles.
  * Assures that graph is a Directed Acyclic Graph (DAG).
+ * Every service and dependency is visited once.
  */
 static void check_depend() {
         Service_T s;
-        Service_T depends_on = NULL;
         Service_T* dlt = &depend_list; /* the current tail of it                                 */
-        boolean_t done;                /* no unvisited nodes left?                               */
-        boolean_t found_some;          /* last iteration found anything new ?                    */
         depend_list = NULL;            /* depend_list will be the topological sorted servicelist */
 
-        do {
-                done = true;
-                found_some = false;
-                for (s = servicelist; s; s = s->next) {
-                        Dependant_T d;
-                        if (s->visited)
-                                continue;
-                        done = false; // still unvisited nodes
-                        depends_on = NULL;
-                        for (d = s->dependantlist; d; d = d->next) {
-                                Service_T dp = Util_getService(d->dependant);
-                                if (! dp) {
-                                        LogError("Depend service '%s' is not defined in the control file\n", d->dependant);
-                                        exit(1);
-                                }
-                                if (! dp->visited) {
-                                        depends_on = dp;
-                                }
-                        }
-
-                        if (! depends_on) {
-                                s->visited = true;
-                                found_some = true;
-                                *dlt = s;
-                                dlt = &s->next_depend;
-                        }
-                }
-        } while (found_some && ! done);
-
-        if (! done) {
-                ASSERT(depends_on);
-                LogError("Found a depend loop in the control file involving the service '%s'\n", depends_on->name);
-                exit(1);
-        }
+        for (s = servicelist; s; s = s->next)
+                if (! s->visited)
+                        depend_visit(s, &dlt);
 
         ASSERT(depend_list);
         servicelist = depend_list;
@@ -4633,6 +6618,42 @@ static void check_depend() {
 }
 
 
+/*
+ * Append the service of a discovery file to the depend list after the
+ * services it depends on, like depend_visit(). The discovered services may
+ * depend on each other and on the control file services, which are checked
+ * first already. Returns false if a dependency is missing or closes a loop
+ */
+static boolean_t discovered_visit(Service_T s, Service_T **dlt) {
+        s->visited = true;
+        for (Dependant_T d = s->dependantlist; d; d = d->next) {
+                Service_T dp = NULL;
+                for (Service_T x = discovered; x && ! dp; x = x->next)
+                        if (IS(x->name, d->dependant))
+                                dp = x;
+                if (! dp) {
+                        // The services of another discovery file may be removed while this one stays
+                        if (Discovery_isDiscovered(d->dependant) || ! (d->service = Util_getService(d->dependant))) {
+                                LogError("%s: depend service '%s' is not defined in the control file or in this file\n", currentfile, d->dependant);
+                                return false;
+                        }
+                        continue;
+                }
+                d->service = dp;
+                if (! dp->visited) {
+                        if (! discovered_visit(dp, dlt))
+                                return false;
+                } else if (! dp->next_depend && *dlt != &dp->next_depend) {
+                        LogError("%s: found a depend loop involving the service '%s'\n", currentfile, dp->name);
+                        return false;
+                }
+        }
+        **dlt = s;
+        *dlt = &s->next_depend;
+        return true;
+}
+
+
 /*
  * Check if the executable exist
  */
@@ -4644,6 +6665,17 @@ static void check_exec(char *exec) {
 }
 
 
+/*
+ * Check that the given plugin is a readable file
+ */
+static void check_plugin(char *plugin) {
+        if (! File_exist(plugin))
+                yywarning2("Plugin does not exist:");
+        else if (! File_isReadable(plugin))
+                yywarning2("Plugin is not readable:");
+}
+
+
 /* Return a valid max forward value for SIP header */
 static int verifyMaxForward(int mf) {
         if (mf >= 0 && mf <= 255)
@@ -0,0 +1,565 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_SYSTM_H
+#include <netinet/in_systm.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_NETINET_IP_H
+#include <netinet/ip.h>
+#endif
+
+#ifdef HAVE_NETINET_IP_ICMP_H
+#include <netinet/ip_icmp.h>
+#endif
+
+#ifdef HAVE_NETINET_ICMP6_H
+#include <netinet/icmp6.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#ifdef HAVE_STDDEF_H
+#include <stddef.h>
+#else
+#define offsetof(st, m) ((size_t) ( (char *)&((st *)(0))->m - (char *)0 ))
+#endif
+
+#include "monit.h"
+#include "net.h"
+#include "resolver.h"
+#include "ping.h"
+
+// libmonit
+#include "system/Time.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+/* The sequence number is 16 bit, the requests of one batch must not wrap around */
+#define PING_REQUESTS 32768
+
+
+/* Read the replies after this many requests, so the socket buffer doesn't overflow */
+#define PING_BURST 32
+
+
+/* Receive buffer size of the shared sockets */
+#define PING_BUFFER (1024 * 1024)
+
+
+typedef enum {
+        Ping_Ip4 = 0,
+        Ping_Ip6,
+        Ping_Last = Ping_Ip6
+} Ping_Family;
+
+
+typedef struct PingProbe_T {
+        Service_T service;
+        Icmp_T icmp;
+        Ping_Family family;
+        struct sockaddr_storage addr;
+        socklen_t addrlen;
+        int sent;
+        int received;
+        double sum;                                /**< Sum of the response times [ms] */
+        double last;                                   /**< The last response time [ms] */
+        double variation;      /**< Sum of the consecutive response time differences [ms] */
+} PingProbe_T;
+
+
+typedef struct PingRequest_T {
+        PingProbe_T *probe;
+        int round;
+        int64_t sent;                                  /**< Timestamp in the payload [us] */
+        boolean_t answered;
+} PingRequest_T;
+
+
+static struct {
+        struct {
+                int fd;
+                boolean_t raw;                 /**< false for the unprivileged datagram socket */
+        } sockets[Ping_Last + 1];
+        uint16_t id;
+        uint16_t sequence;                            /**< Sequence number of the next request */
+} ping = {.sockets = {{.fd = -1}, {.fd = -1}}};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static unsigned short _checksum(unsigned char *_addr, int count) {
+        long sum = 0;
+        unsigned short *addr = (unsigned short *)_addr;
+        while (count > 1) {
+                sum += *addr++;
+                count -= 2;
+        }
+        if (count > 0)
+                sum += *(unsigned char *)addr;
+        while (sum >> 16)
+                sum = (sum & 0xffff) + (sum >> 16);
+        return ~sum;
+}
+
+
+/**
+ * Open the shared socket of the family. The raw socket requires privileges,
+ * Linux allows the datagram ICMP socket also for the groups listed in the
+ * net.ipv4.ping_group_range sysctl.
+ * @return 0 on success, -2 if not permitted, otherwise -1
+ */
+static int _open(Ping_Family family) {
+        if (ping.sockets[family].fd >= 0)
+                return 0;
+        int domain = AF_INET, protocol = IPPROTO_ICMP;
+#ifdef HAVE_IPV6
+        if (family == Ping_Ip6) {
+                domain = AF_INET6;
+                protocol = IPPROTO_ICMPV6;
+        }
+#else
+        if (family == Ping_Ip6)
+                return -1;
+#endif
+        boolean_t raw = true;
+        int fd = socket(domain, SOCK_RAW, protocol);
+        if (fd < 0 && (errno == EACCES || errno == EPERM)) {
+                fd = socket(domain, SOCK_DGRAM, protocol);
+                raw = false;
+        }
+        if (fd < 0) {
+                if (errno == EACCES || errno == EPERM) {
+                        DEBUG("Ping batch -- cannot create the IPv%d socket: %s\n", family == Ping_Ip4 ? 4 : 6, STRERROR);
+                        return -2;
+                }
+                LogError("Ping batch -- cannot create the IPv%d socket: %s\n", family == Ping_Ip4 ? 4 : 6, STRERROR);
+                return -1;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int buffer = PING_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        if (raw) {
+                int ttl = 255;
+                if (family == Ping_Ip4) {
+                        setsockopt(fd, IPPROTO_IP, IP_TTL, &ttl, sizeof(ttl));
+                }
+#ifdef HAVE_IPV6
+                else {
+                        struct icmp6_filter filter;
+                        ICMP6_FILTER_SETBLOCKALL(&filter);
+                        ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filter);
+                        setsockopt(fd, IPPROTO_IPV6, IPV6_UNICAST_HOPS, &ttl, sizeof(ttl));
+                        setsockopt(fd, IPPROTO_ICMPV6, ICMP6_FILTER, &filter, sizeof(struct icmp6_filter));
+                }
+#endif
+        }
+        ping.sockets[family].fd = fd;
+        ping.sockets[family].raw = raw;
+        // Use other id than icmp_echo(), so the late replies don't mix; the datagram socket sets the id itself
+        ping.id = (getpid() & 0xFFFF) ^ 0x8000;
+        DEBUG("Ping batch -- using the %s IPv%d socket\n", raw ? "raw" : "datagram", family == Ping_Ip4 ? 4 : 6);
+        return 0;
+}
+
+
+/**
+ * Resolve the host of the ping test and open the socket for its address
+ * @return 0 on success, -2 if the socket is not permitted, otherwise -1
+ */
+static int _resolve(PingProbe_T *p) {
+        struct addrinfo *result, hints = {
+#ifdef AI_ADDRCONFIG
+                .ai_flags = AI_ADDRCONFIG
+#endif
+        };
+        switch (p->icmp->family) {
+                case Socket_Ip:
+                        hints.ai_family = AF_UNSPEC;
+                        break;
+                case Socket_Ip4:
+                        hints.ai_family = AF_INET;
+                        break;
+#ifdef HAVE_IPV6
+                case Socket_Ip6:
+                        hints.ai_family = AF_INET6;
+                        break;
+#endif
+                default:
+                        return -1;
+        }
+        // Leave the errors to icmp_echo(), the fallback reports them
+        if (Resolver_get(p->service->path, 0, &hints, &result))
+                return -1;
+        int rv = -1;
+        for (struct addrinfo *a = result; a && rv != 0; a = a->ai_next) {
+                Ping_Family family;
+                if (a->ai_family == AF_INET)
+                        family = Ping_Ip4;
+#ifdef HAVE_IPV6
+                else if (a->ai_family == AF_INET6)
+                        family = Ping_Ip6;
+#endif
+                else
+                        continue;
+                int status = _open(family);
+                if (status == 0) {
+                        p->family = family;
+                        p->addrlen = a->ai_addrlen;
+                        memcpy(&p->addr, a->ai_addr, a->ai_addrlen);
+                        rv = 0;
+                } else if (status == -2) {
+                        rv = -2;
+                }
+        }
+        Resolver_free(result);
+        return rv;
+}
+
+
+static boolean_t _send(PingRequest_T *r, uint16_t sequence) {
+        PingProbe_T *p = r->probe;
+        char buf[ICMP_MAXSIZE] = {};
+        int header = 0;
+        // The payload carries the timestamp, the reply is matched by it
+        int size = MAX(p->icmp->size, (int)sizeof(int64_t));
+        if (p->family == Ping_Ip4) {
+                struct icmp *icmp4 = (struct icmp *)buf;
+                header = offsetof(struct icmp, icmp_data);
+                if (header + size > sizeof(buf))
+                        goto toolarge;
+                icmp4->icmp_type = ICMP_ECHO;
+                icmp4->icmp_id = htons(ping.id);
+                icmp4->icmp_seq = htons(sequence);
+                memcpy(icmp4->icmp_data, &r->sent, sizeof(int64_t));
+                icmp4->icmp_cksum = _checksum((unsigned char *)icmp4, header + size);
+        }
+#ifdef HAVE_IPV6
+        else {
+                struct icmp6_hdr *icmp6 = (struct icmp6_hdr *)buf;
+                header = sizeof(struct icmp6_hdr);
+                if (header + size > sizeof(buf))
+                        goto toolarge;
+                icmp6->icmp6_type = ICMP6_ECHO_REQUEST;
+                icmp6->icmp6_id = htons(ping.id);
+                icmp6->icmp6_seq = htons(sequence);
+                memcpy(icmp6 + 1, &r->sent, sizeof(int64_t));
+        }
+#endif
+        ssize_t n;
+        do {
+                n = sendto(ping.sockets[p->family].fd, buf, header + size, 0, (struct sockaddr *)&p->addr, p->addrlen);
+        } while (n == -1 && errno == EINTR);
+        if (n < 0) {
+                LogError("Ping request for %s %d/%d failed -- %s\n", p->service->path, r->round, p->icmp->count, STRERROR);
+                return false;
+        }
+        return true;
+toolarge:
+        LogError("Ping request for %s failed -- too large (%d vs. maximum %lu bytes)\n", p->service->path, size, (unsigned long)(sizeof(buf) - header));
+        return false;
+}
+
+
+static boolean_t _isFrom(PingProbe_T *p, struct sockaddr_storage *from) {
+        if (from->ss_family != p->addr.ss_family)
+                return false;
+        if (from->ss_family == AF_INET)
+                return memcmp(&((struct sockaddr_in *)from)->sin_addr, &((struct sockaddr_in *)&p->addr)->sin_addr, sizeof(struct in_addr)) == 0;
+#ifdef HAVE_IPV6
+        if (from->ss_family == AF_INET6)
+                return memcmp(&((struct sockaddr_in6 *)from)->sin6_addr, &((struct sockaddr_in6 *)&p->addr)->sin6_addr, sizeof(struct in6_addr)) == 0;
+#endif
+        return false;
+}
+
+
+/**
+ * Read the pending replies from the socket and match them with the requests
+ * by the sequence number, the timestamp and the source address. The raw
+ * socket receives all ICMP messages of the host, the others are skipped.
+ */
+static void _receive(Ping_Family family, PingRequest_T *requests, int count, uint16_t first, int round, int *pending) {
+        char buf[ICMP_MAXSIZE];
+        while (true) {
+                struct sockaddr_storage from;
+                socklen_t addrlen = sizeof(from);
+                ssize_t n = recvfrom(ping.sockets[family].fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &addrlen);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        if (errno != EAGAIN && errno != EWOULDBLOCK)
+                                LogError("Ping batch -- cannot read the reply: %s\n", STRERROR);
+                        return;
+                }
+                long long received = Time_micro();
+                boolean_t isReply = false;
+                uint16_t id = 0, sequence = 0;
+                unsigned char *data = NULL;
+                if (family == Ping_Ip4) {
+                        int offset = ping.sockets[family].raw ? ((struct ip *)buf)->ip_hl * 4 : 0;
+                        if (n >= offset + (int)offsetof(struct icmp, icmp_data) + (int)sizeof(int64_t)) {
+                                struct icmp *icmp4 = (struct icmp *)(buf + offset);
+                                isReply = icmp4->icmp_type == ICMP_ECHOREPLY;
+                                id = ntohs(icmp4->icmp_id);
+                                sequence = ntohs(icmp4->icmp_seq);
+                                data = (unsigned char *)icmp4->icmp_data;
+                        }
+                }
+#ifdef HAVE_IPV6
+                else if (n >= (int)(sizeof(struct icmp6_hdr) + sizeof(int64_t))) {
+                        struct icmp6_hdr *icmp6 = (struct icmp6_hdr *)buf;
+                        isReply = icmp6->icmp6_type == ICMP6_ECHO_REPLY;
+                        id = ntohs(icmp6->icmp6_id);
+                        sequence = ntohs(icmp6->icmp6_seq);
+                        data = (unsigned char *)(icmp6 + 1);
+                }
+#endif
+                if (! isReply || (ping.sockets[family].raw && id != ping.id))
+                        continue;
+                uint16_t index = sequence - first;
+                if (index >= count)
+                        continue; // Reply to an earlier batch or to other process
+                PingRequest_T *r = &requests[index];
+                int64_t sent;
+                memcpy(&sent, data, sizeof(int64_t));
+                if (r->answered || sent != r->sent || ! _isFrom(r->probe, &from))
+                        continue;
+                PingProbe_T *p = r->probe;
+                double response = (double)(received - r->sent) / 1000.;
+                if (response > p->icmp->timeout)
+                        continue; // Too late, the request is counted as lost
+                r->answered = true;
+                if (p->received)
+                        p->variation += response > p->last ? response - p->last : p->last - response;
+                p->last = response;
+                p->sum += response;
+                p->received++;
+                if (r->round == round)
+                        (*pending)--;
+                DEBUG("Ping response for %s %d/%d succeeded -- received id=%d sequence=%d response_time=%s\n", p->service->path, r->round, p->icmp->count, id, sequence, Str_milliToTime(response, (char[23]){}));
+        }
+}
+
+
+static void _drain(PingRequest_T *requests, int count, uint16_t first, int round, int *pending) {
+        for (int i = 0; i <= Ping_Last; i++)
+                if (ping.sockets[i].fd >= 0)
+                        _receive(i, requests, count, first, round, pending);
+}
+
+
+/**
+ * Wait for the replies of the round, until all requests of the round were
+ * answered or the timeout elapsed
+ */
+static void _wait(PingRequest_T *requests, int count, uint16_t first, int round, int pending, int timeout) {
+        long long started = Time_micro(), deadline = started + timeout * 1000LL;
+        while (pending > 0 && ! (Run.flags & Run_Stopped)) {
+                long long now = Time_micro();
+                if (now >= deadline || now < started)
+                        break;
+                struct pollfd fds[Ping_Last + 1];
+                Ping_Family families[Ping_Last + 1];
+                int nfds = 0;
+                for (int i = 0; i <= Ping_Last; i++) {
+                        if (ping.sockets[i].fd >= 0) {
+                                fds[nfds].fd = ping.sockets[i].fd;
+                                fds[nfds].events = POLLIN;
+                                fds[nfds].revents = 0;
+                                families[nfds++] = i;
+                        }
+                }
+                int rv = poll(fds, nfds, (int)((deadline - now + 999) / 1000));
+                if (rv < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("Ping batch -- poll failed: %s\n", STRERROR);
+                        return;
+                }
+                for (int i = 0; i < nfds; i++)
+                        if (fds[i].revents & POLLIN)
+                                _receive(families[i], requests, count, first, round, &pending);
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Ping_run() {
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next) {
+                        icmp->prefetch.valid = false;
+                        // The skipped cycles are decided by the check, don't ping in vain
+                        if (s->monitor != Monitor_Not && s->every.type == Every_Cycle && icmp->type == ICMP_ECHO && ! icmp->outgoing.ip)
+                                count++;
+                }
+        }
+        if (! (Run.flags & Run_PingBatch) || ! count)
+                return;
+        // The spread checks run during the whole cycle, the prefetched data would be stale
+        if (Run.flags & Run_PacingSpread)
+                return;
+        PingProbe_T *probes = CALLOC(count, sizeof(PingProbe_T));
+        int n = 0, total = 0, rounds = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next) {
+                        if (s->monitor != Monitor_Not && s->every.type == Every_Cycle && icmp->type == ICMP_ECHO && ! icmp->outgoing.ip && total + icmp->count <= PING_REQUESTS) {
+                                PingProbe_T *p = &probes[n];
+                                p->service = s;
+                                p->icmp = icmp;
+                                int status = _resolve(p);
+                                if (status == 0) {
+                                        total += icmp->count;
+                                        rounds = MAX(rounds, icmp->count);
+                                        n++;
+                                } else if (status == -2) {
+                                        // Same result as icmp_echo() without the permission
+                                        icmp->prefetch.response = -2.;
+                                        icmp->prefetch.jitter = -1.;
+                                        icmp->prefetch.loss = -1;
+                                        icmp->prefetch.valid = true;
+                                }
+                        }
+                }
+        }
+        PingRequest_T *requests = CALLOC(MAX(total, 1), sizeof(PingRequest_T));
+        uint16_t first = ping.sequence;
+        int sent = 0;
+        for (int round = 1; round <= rounds && ! (Run.flags & Run_Stopped); round++) {
+                int pending = 0, timeout = 0;
+                for (int i = 0; i < n; i++) {
+                        PingProbe_T *p = &probes[i];
+                        if (p->icmp->count >= round) {
+                                PingRequest_T *r = &requests[sent];
+                                r->probe = p;
+                                r->round = round;
+                                r->sent = Time_micro();
+                                p->sent++;
+                                if (_send(r, first + sent)) {
+                                        pending++;
+                                        timeout = MAX(timeout, p->icmp->timeout);
+                                } else {
+                                        r->answered = true; // Counted as lost, but don't match
+                                }
+                                if (++sent % PING_BURST == 0)
+                                        _drain(requests, sent, first, round, &pending);
+                        }
+                }
+                _wait(requests, sent, first, round, pending, timeout);
+        }
+        ping.sequence = first + sent;
+        for (int i = 0; i < n; i++) {
+                PingProbe_T *p = &probes[i];
+                if (! p->sent)
+                        continue; // Stopped
+                Icmp_T icmp = p->icmp;
+                icmp->prefetch.response = p->received ? p->sum / p->received : -1.;
+                icmp->prefetch.jitter = p->received > 1 ? p->variation / (p->received - 1) : 0.;
+                icmp->prefetch.loss = (p->sent - p->received) * 100 / p->sent;
+                icmp->prefetch.valid = true;
+                if (! p->received)
+                        LogError("Ping for %s failed -- no response to %d requests within %s\n", p->service->path, p->sent, Str_milliToTime(icmp->timeout, (char[23]){}));
+        }
+        FREE(requests);
+        FREE(probes);
+}
+
+
+void Ping_stop() {
+        for (int i = 0; i <= Ping_Last; i++) {
+                if (ping.sockets[i].fd >= 0) {
+                        close(ping.sockets[i].fd);
+                        ping.sockets[i].fd = -1;
+                }
+        }
+}
+
+
+double Ping_echo(Service_T s, Icmp_T icmp) {
+        ASSERT(s);
+        ASSERT(icmp);
+        if (icmp->prefetch.valid) {
+                icmp->prefetch.valid = false;
+                icmp->jitter = icmp->prefetch.jitter;
+                icmp->loss = icmp->prefetch.loss;
+                return icmp->prefetch.response;
+        }
+        icmp->jitter = -1.;
+        icmp->loss = -1;
+        return icmp_echo(s->path, icmp->family, &(icmp->outgoing), icmp->size, icmp->timeout, icmp->count);
+}
+
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PING_H
+#define MONIT_PING_H
+
+
+/**
+ * Batched ping tests. If enabled with "set ping batch", the echo requests
+ * of all ping tests are sent at the beginning of the cycle on one shared
+ * IPv4 and one shared IPv6 socket, instead of one socket and a serial
+ * request/reply round trip per host. The replies are matched with their
+ * hosts by the sequence number and the timestamp in the payload. Each host
+ * gets all of its COUNT requests, one per round, so the response time,
+ * jitter and loss are measured. The rounds end as soon as all hosts
+ * replied, or after the longest timeout. The ping tests with an outgoing
+ * address, or of services which are not tested every cycle, fall back to
+ * icmp_echo().
+ *
+ * @file
+ */
+
+
+/**
+ * Send the echo requests of the ping tests and collect the replies. The
+ * results are valid until they are consumed by Ping_echo() or until the
+ * next batch.
+ */
+void Ping_run(void);
+
+
+/**
+ * Close the shared sockets
+ */
+void Ping_stop(void);
+
+
+/**
+ * Get the response time of the ping test. The prefetched result, including
+ * the jitter and loss, is used and consumed if available, otherwise
+ * icmp_echo() is called.
+ * @param s A host service
+ * @param icmp The ping test
+ * @return The response time in milliseconds, -1 if the test failed or
+ * -2 if the monit user cannot create the socket
+ */
+double Ping_echo(Service_T s, Icmp_T icmp);
+
+
+#endif
+
@@ -0,0 +1,294 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDARG_H
+#include <stdarg.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+
+#include "monit.h"
+#include "socket.h"
+#include "monitplugin.h"
+#include "plugin.h"
+
+// libmonit
+#include "system/Time.h"
+
+
+/**
+ *  Shared object plugin checks.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T Plugin_T
+struct T {
+        char *service;
+        char *path;
+        int argc;
+        char **argv;
+        int timeout;                                   /**< Check time budget [ms] */
+        void *handle;                       /**< dlopen handle, NULL if not loaded */
+        void *context;                                  /**< Plugin context */
+        int (*check)(void *context, char *output, size_t size);
+        void (*free)(void *context);
+        monit_plugin_host_t host;
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _log(const monit_plugin_host_t *host, const char *format, ...) {
+        char message[STRLEN];
+        va_list ap;
+        va_start(ap, format);
+        vsnprintf(message, sizeof(message), format, ap);
+        va_end(ap);
+        LogInfo("'%s' %s\n", host->service, message);
+}
+
+
+static void *_connect(const char *host, int port, int timeout) {
+        return Socket_new(host, port, Socket_Tcp, Socket_Ip, SSL_Disabled, timeout);
+}
+
+
+static void *_connectUnix(const char *path, int timeout) {
+        return Socket_createUnix(path, Socket_Tcp, timeout);
+}
+
+
+static int _write(void *connection, const void *buffer, size_t size) {
+        return Socket_write(connection, (void *)buffer, size);
+}
+
+
+static int _read(void *connection, void *buffer, size_t size) {
+        return Socket_read(connection, buffer, (int)size);
+}
+
+
+static char *_readLine(void *connection, char *line, int size) {
+        return Socket_readLine(connection, line, size);
+}
+
+
+static void _close(void *connection) {
+        Socket_T S = connection;
+        Socket_free(&S);
+}
+
+
+static long long _readFile(const char *path, char *buffer, size_t size) {
+        if (! size)
+                return -1;
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+                return -1;
+        size_t total = 0;
+        while (total < size - 1) {
+                ssize_t n = read(fd, buffer + total, size - 1 - total);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        close(fd);
+                        return -1;
+                }
+                if (n == 0)
+                        break;
+                total += n;
+        }
+        buffer[total] = 0;
+        close(fd);
+        return total;
+}
+
+
+static long long _cpuTime(void) {
+#ifdef CLOCK_THREAD_CPUTIME_ID
+        struct timespec t;
+        if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) == 0)
+                return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+#endif
+        return -1;
+}
+
+
+#ifdef HAVE_DLFCN_H
+
+
+static boolean_t _load(T P, StringBuffer_T output) {
+        if (! (P->handle = dlopen(P->path, RTLD_NOW | RTLD_LOCAL))) {
+                StringBuffer_append(output, "cannot load the plugin -- %s", dlerror());
+                return false;
+        }
+        const int *abi = dlsym(P->handle, "monit_plugin_abi");
+        if (! abi || *abi != MONIT_PLUGIN_ABI) {
+                StringBuffer_append(output, "the plugin ABI version %d is not supported, expected %d", abi ? *abi : 0, MONIT_PLUGIN_ABI);
+                goto error;
+        }
+        if (! (*(void **)&P->check = dlsym(P->handle, "monit_plugin_check"))) {
+                StringBuffer_append(output, "the plugin doesn't export monit_plugin_check");
+                goto error;
+        }
+        *(void **)&P->free = dlsym(P->handle, "monit_plugin_free");
+        int (*init)(const monit_plugin_host_t *, int, char *[], void **);
+        if ((*(void **)&init = dlsym(P->handle, "monit_plugin_init"))) {
+                int rv = init(&P->host, P->argc, P->argv, &P->context);
+                if (rv != 0) {
+                        StringBuffer_append(output, "the plugin initialization failed with status %d", rv);
+                        goto error;
+                }
+        }
+        DEBUG("'%s' plugin %s loaded\n", P->host.service, P->path);
+        return true;
+error:
+        dlclose(P->handle);
+        P->handle = NULL;
+        P->check = NULL;
+        P->free = NULL;
+        P->context = NULL;
+        return false;
+}
+
+
+#endif
+
+
+/* ---------------------------------------------------------------- Public */
+
+
+T Plugin_new(const char *service, command_t args, int timeout) {
+        ASSERT(service);
+        ASSERT(args);
+        ASSERT(args->length > 0);
+        T P;
+        NEW(P);
+        P->service = Str_dup(service);
+        P->path = Str_dup(args->arg[0]);
+        P->argc = args->length;
+        P->argv = CALLOC(args->length + 1, sizeof(char *));
+        for (int i = 0; i < args->length; i++)
+                P->argv[i] = Str_dup(args->arg[i]);
+        P->timeout = timeout;
+        P->host = (monit_plugin_host_t){
+                .abi = MONIT_PLUGIN_ABI,
+                .service = P->service,
+                .log = _log,
+                .connect = _connect,
+                .connectUnix = _connectUnix,
+                .write = _write,
+                .read = _read,
+                .readLine = _readLine,
+                .close = _close,
+                .readFile = _readFile
+        };
+        return P;
+}
+
+
+void Plugin_free(T *P) {
+        ASSERT(P && *P);
+#ifdef HAVE_DLFCN_H
+        if ((*P)->handle) {
+                if ((*P)->free)
+                        (*P)->free((*P)->context);
+                dlclose((*P)->handle);
+        }
+#endif
+        for (int i = 0; i < (*P)->argc; i++)
+                FREE((*P)->argv[i]);
+        FREE((*P)->argv);
+        FREE((*P)->path);
+        FREE((*P)->service);
+        FREE(*P);
+}
+
+
+int Plugin_getTimeout(T P) {
+        ASSERT(P);
+        return P->timeout;
+}
+
+
+int Plugin_check(T P, StringBuffer_T output, struct myprogramusage *usage) {
+        ASSERT(P);
+        ASSERT(output);
+        ASSERT(usage);
+        *usage = (struct myprogramusage){.cpuTime = -1, .memory = -1, .runTime = -1};
+#ifdef HAVE_DLFCN_H
+        if (! P->handle && ! _load(P, output))
+                return -1;
+        char message[STRLEN] = {};
+        long long started = Time_monotonicMicro();
+        long long cpu = _cpuTime();
+        int status = P->check(P->context, message, sizeof(message));
+        if (cpu >= 0)
+                usage->cpuTime = _cpuTime() - cpu;
+        usage->runTime = (Time_monotonicMicro() - started) / 1000;
+        message[sizeof(message) - 1] = 0;
+        StringBuffer_append(output, "%s", message);
+        return status;
+#else
+        StringBuffer_append(output, "plugins are not supported on this platform");
+        return -1;
+#endif
+}
+
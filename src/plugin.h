@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PLUGIN_H
+#define MONIT_PLUGIN_H
+
+
+/**
+ * In-process plugin checks. A 'check plugin' service is a check program
+ * whose check is a shared object implementing the monitplugin.h ABI: the
+ * plugin is loaded when the service is checked for the first time and its
+ * check function is called on the check thread, so the check costs a
+ * function call instead of a fork, exec and interpreter startup. The result
+ * is evaluated by the program status and resource tests.
+ *
+ * @file
+ */
+
+
+#define PLUGIN_TIMEOUT 1000           /**< Default check time budget [ms] */
+
+
+typedef struct Plugin_T *Plugin_T;
+
+
+/**
+ * Create a plugin for the service. The shared object is not loaded yet.
+ * @param service The service name
+ * @param args The plugin path and the arguments
+ * @param timeout The check time budget [ms]
+ * @return A new plugin object
+ */
+Plugin_T Plugin_new(const char *service, command_t args, int timeout);
+
+
+/**
+ * Release the plugin context and unload the shared object
+ * @param P A plugin object reference
+ */
+void Plugin_free(Plugin_T *P);
+
+
+/**
+ * Get the check time budget
+ * @param P A plugin object
+ * @return The time budget [ms]
+ */
+int Plugin_getTimeout(Plugin_T P);
+
+
+/**
+ * Load the plugin if not loaded yet and run the check. If the plugin cannot
+ * be loaded, the status is -1 and the output contains the reason. The CPU
+ * time of the calling thread and the wall-clock time of the check are
+ * stored in the usage, the memory is not available.
+ * @param P A plugin object
+ * @param output The buffer for the plugin message
+ * @param usage The resource usage of the check
+ * @return The check status
+ */
+int Plugin_check(Plugin_T P, StringBuffer_T output, struct myprogramusage *usage);
+
+
+#endif
+
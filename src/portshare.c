@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "protocol.h"
+#include "portshare.h"
+
+// libmonit
+#include "exceptions/AssertException.h"
+#include "thread/Thread.h"
+#include "util/List.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define PORTSHARE_PRIME 1099511628211ULL
+
+
+/* The test of one endpoint in the current check pass */
+typedef struct PortShareEntry_T {
+        unsigned long long hash;
+        Port_T port;                        /**< The port which runs the test */
+        boolean_t done;
+        State_Type state;
+        double response;
+        Socket_Family connected;
+        Connection_State is_available;
+        struct {
+                double dns;
+                double connect;
+                double tls;
+                double firstbyte;
+        } phases;
+        char report[STRLEN];
+        int next;                     /**< Next entry in the bucket or -1 */
+} PortShareEntry_T;
+
+
+static struct {
+        int count;
+        int size;
+        int mask;
+        int *buckets;
+        PortShareEntry_T *entries;
+} table = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t finished = PTHREAD_COND_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static inline void _hashBytes(unsigned long long *hash, const void *data, size_t length) {
+        for (size_t i = 0; i < length; i++) {
+                *hash ^= ((const unsigned char *)data)[i];
+                *hash *= PORTSHARE_PRIME;
+        }
+}
+
+
+static inline void _hashString(unsigned long long *hash, const char *s) {
+        if (s)
+                _hashBytes(hash, s, strlen(s));
+        *hash *= PORTSHARE_PRIME;
+}
+
+
+static inline boolean_t _isEqualString(const char *a, const char *b) {
+        return a == b || Str_isByteEqual(a, b);
+}
+
+
+static boolean_t _isEmpty(const void *data, size_t length) {
+        for (size_t i = 0; i < length; i++)
+                if (((const unsigned char *)data)[i])
+                        return false;
+        return true;
+}
+
+
+/**
+ * The port can share the test if its protocol parameters are none or the HTTP request
+ */
+static boolean_t _isShareable(Port_T p) {
+        if (p->session.enabled || p->url_request || p->metrics)
+                return false;
+        return _isEmpty(&p->parameters, sizeof(p->parameters)) || p->protocol->check == check_http;
+}
+
+
+static unsigned long long _hash(Port_T p) {
+        unsigned long long hash = 14695981039346656037ULL;
+        _hashString(&hash, p->hostname);
+        _hashString(&hash, p->outgoing.ip);
+        _hashString(&hash, p->protocol->name);
+        _hashBytes(&hash, &p->family, sizeof(p->family));
+        _hashBytes(&hash, &p->type, sizeof(p->type));
+        _hashBytes(&hash, &p->timeout, sizeof(p->timeout));
+        _hashBytes(&hash, &p->retry, sizeof(p->retry));
+        if (p->family == Socket_Unix) {
+                _hashString(&hash, p->target.unix.pathname);
+        } else {
+                _hashBytes(&hash, &p->target.net.port, sizeof(p->target.net.port));
+                _hashBytes(&hash, &p->target.net.ssl.flags, sizeof(p->target.net.ssl.flags));
+        }
+        if (p->protocol->check == check_http) {
+                _hashString(&hash, p->parameters.http.request);
+                _hashBytes(&hash, &p->parameters.http.status, sizeof(p->parameters.http.status));
+        }
+        return hash;
+}
+
+
+static boolean_t _isEqualSsl(SslOptions_T *a, SslOptions_T *b) {
+        return a->flags == b->flags &&
+               a->verify == b->verify &&
+               a->allowSelfSigned == b->allowSelfSigned &&
+               a->version == b->version &&
+               a->checksumType == b->checksumType &&
+               a->minimumValidDays == b->minimumValidDays &&
+               _isEqualString(a->checksum, b->checksum) &&
+               _isEqualString(a->clientpemfile, b->clientpemfile) &&
+               _isEqualString(a->CACertificateFile, b->CACertificateFile) &&
+               _isEqualString(a->CACertificatePath, b->CACertificatePath) &&
+               _isEqualString(a->protocol, b->protocol);
+}
+
+
+static boolean_t _isEqualHeaders(List_T a, List_T b) {
+        list_t x = a ? a->head : NULL, y = b ? b->head : NULL;
+        for (; x && y; x = x->next, y = y->next)
+                if (! _isEqualString(x->e, y->e))
+                        return false;
+        return ! x && ! y;
+}
+
+
+/**
+ * Test if the ports have the same test definition (the ports are shareable)
+ */
+static boolean_t _isEqual(Port_T a, Port_T b) {
+        if (a->protocol != b->protocol || a->family != b->family || a->type != b->type || a->timeout != b->timeout || a->retry != b->retry)
+                return false;
+        if (! _isEqualString(a->hostname, b->hostname) || ! _isEqualString(a->outgoing.ip, b->outgoing.ip))
+                return false;
+        if (a->family == Socket_Unix) {
+                if (! _isEqualString(a->target.unix.pathname, b->target.unix.pathname))
+                        return false;
+        } else if (a->target.net.port != b->target.net.port || ! _isEqualSsl(&a->target.net.ssl, &b->target.net.ssl)) {
+                return false;
+        }
+        if (a->protocol->check == check_http)
+                return a->parameters.http.hashtype == b->parameters.http.hashtype &&
+                       a->parameters.http.operator == b->parameters.http.operator &&
+                       a->parameters.http.status == b->parameters.http.status &&
+                       _isEqualString(a->parameters.http.request, b->parameters.http.request) &&
+                       _isEqualString(a->parameters.http.checksum, b->parameters.http.checksum) &&
+                       _isEqualHeaders(a->parameters.http.headers, b->parameters.http.headers);
+        return true;
+}
+
+
+static void _resize() {
+        table.size = table.size ? table.size * 2 : 64;
+        RESIZE(table.entries, table.size * sizeof(PortShareEntry_T));
+        FREE(table.buckets);
+        table.mask = table.size - 1;
+        table.buckets = ALLOC(table.size * sizeof(int));
+        memset(table.buckets, -1, table.size * sizeof(int));
+        for (int i = 0; i < table.count; i++) {
+                int bucket = table.entries[i].hash & table.mask;
+                table.entries[i].next = table.buckets[bucket];
+                table.buckets[bucket] = i;
+        }
+}
+
+
+static void _copyResult(PortShareEntry_T *e, Port_T p) {
+        p->response = e->response;
+        p->connected = e->connected;
+        p->is_available = e->is_available;
+        p->phases.dns = e->phases.dns;
+        p->phases.connect = e->phases.connect;
+        p->phases.tls = e->phases.tls;
+        p->phases.firstbyte = e->phases.firstbyte;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void PortShare_invalidate() {
+        LOCK(mutex)
+        {
+                table.count = 0;
+                if (table.buckets)
+                        memset(table.buckets, -1, table.size * sizeof(int));
+        }
+        END_LOCK;
+}
+
+
+void PortShare_stop() {
+        LOCK(mutex)
+        {
+                FREE(table.entries);
+                FREE(table.buckets);
+                table.count = table.size = table.mask = 0;
+        }
+        END_LOCK;
+}
+
+
+boolean_t PortShare_acquire(Port_T p, State_Type *state, char *report, int reportlen) {
+        ASSERT(p);
+        if (! _isShareable(p))
+                return false;
+        boolean_t shared = false;
+        unsigned long long hash = _hash(p);
+        LOCK(mutex)
+        {
+                int found = -1;
+                for (int i = table.size ? table.buckets[hash & table.mask] : -1; i != -1; i = table.entries[i].next) {
+                        if (table.entries[i].hash == hash && _isEqual(table.entries[i].port, p)) {
+                                found = i;
+                                break;
+                        }
+                }
+                if (found != -1) {
+                        // The table can grow while we wait, so the entry is accessed by the index
+                        while (! table.entries[found].done)
+                                Sem_wait(finished, mutex);
+                        PortShareEntry_T *e = &table.entries[found];
+                        *state = e->state;
+                        snprintf(report, reportlen, "%s", e->report);
+                        _copyResult(e, p);
+                        shared = true;
+                } else {
+                        if (table.count == table.size)
+                                _resize();
+                        int bucket = hash & table.mask;
+                        table.entries[table.count] = (PortShareEntry_T){.hash = hash, .port = p, .next = table.buckets[bucket]};
+                        table.buckets[bucket] = table.count++;
+                }
+        }
+        END_LOCK;
+        return shared;
+}
+
+
+void PortShare_release(Port_T p, State_Type state, const char *report) {
+        ASSERT(p);
+        if (! _isShareable(p))
+                return;
+        unsigned long long hash = _hash(p);
+        LOCK(mutex)
+        {
+                for (int i = table.size ? table.buckets[hash & table.mask] : -1; i != -1; i = table.entries[i].next) {
+                        PortShareEntry_T *e = &table.entries[i];
+                        if (e->port == p && ! e->done) {
+                                e->state = state;
+                                e->response = p->response;
+                                e->connected = p->connected;
+                                e->is_available = p->is_available;
+                                e->phases.dns = p->phases.dns;
+                                e->phases.connect = p->phases.connect;
+                                e->phases.tls = p->phases.tls;
+                                e->phases.firstbyte = p->phases.firstbyte;
+                                snprintf(e->report, sizeof(e->report), "%s", report ? report : "");
+                                e->done = true;
+                                break;
+                        }
+                }
+                Sem_broadcast(finished);
+        }
+        END_LOCK;
+}
+
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PORTSHARE_H
+#define MONIT_PORTSHARE_H
+
+
+/**
+ * Shared connection tests. The services often test the same endpoint, for
+ * example several application services with the same database port test.
+ * The tests with the same definition (host, port or unix socket, socket
+ * type, protocol and its parameters, SSL options, outgoing address,
+ * timeout and retry) are done once per check pass: the first service
+ * which tests the endpoint runs the test, the other services get its
+ * result, which is copied into their port (so the response time and the
+ * events are still per service). If the test is in progress in another
+ * check worker, the service waits for it. The ports with a persistent
+ * session, an URL request, server metrics or protocol parameters other
+ * than the HTTP request are always tested separately.
+ *
+ * @file
+ */
+
+
+/**
+ * Forget the results of the previous check pass. Called at the beginning
+ * of the cycle and of the scheduled checks between the cycles.
+ */
+void PortShare_invalidate(void);
+
+
+/**
+ * Release the table
+ */
+void PortShare_stop(void);
+
+
+/**
+ * Get the result of the same test done in this check pass. If there is
+ * no such result, the caller becomes the owner of the test: it has to
+ * test the port and pass the result to PortShare_release()
+ * @param p The port to test
+ * @param state The test result
+ * @param report The error description if the test failed
+ * @param reportlen The report buffer size
+ * @return true if the result was copied into the port, state and report,
+ * false if the caller has to test the port
+ */
+boolean_t PortShare_acquire(Port_T p, State_Type *state, char *report, int reportlen);
+
+
+/**
+ * Publish the result of the port test and wake up the services waiting
+ * for it. Does nothing if the port is not shared.
+ * @param p The tested port
+ * @param state The test result
+ * @param report The error description if the test failed
+ */
+void PortShare_release(Port_T p, State_Type state, const char *report);
+
+
+#endif
+
@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROBES_H
+#define MONIT_PROBES_H
+
+
+/**
+ * Static tracing probes (USDT) on the hot paths, in the "monit" provider.
+ * The probes are compiled in with 'configure --enable-usdt' and can be
+ * attached with perf, bpftrace or systemtap. An unattached probe costs a
+ * single nop instruction, without the option the macros expand to nothing
+ * and the arguments are not evaluated. The probe arguments are cheap to
+ * compute, such as pointers to the existing strings, numbers and states:
+ *
+ * <pre>
+ *  check_start(name, type)                     check_done(name, type, state)
+ *  processtree_start()                         processtree_done(count)
+ *  socket_test_start(name, protocol)           socket_test_done(name, protocol, state)
+ *  event_post(name, id, state)                 event_queue_add(name, id, state)
+ *  event_queue_start(segment)                  event_queue_done(changed)
+ *  http_request_start(method, url)             http_request_done(method, url, status)
+ *  state_save_start()                          state_save_done()
+ * </pre>
+ *
+ * @file
+ */
+
+
+#ifdef HAVE_USDT
+
+#include <sys/sdt.h>
+
+#define PROBE0(name) DTRACE_PROBE(monit, name)
+#define PROBE1(name, a) DTRACE_PROBE1(monit, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(monit, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(monit, name, a, b, c)
+
+#else
+
+#define PROBE0(name)
+#define PROBE1(name, a)
+#define PROBE2(name, a, b)
+#define PROBE3(name, a, b, c)
+
+#endif
+
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#if defined HAVE_LINUX_TASKSTATS_H && defined HAVE_LINUX_GENETLINK_H
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+// The taskstats version 13 (Linux 6.0) reports the thread group of the task
+#if TASKSTATS_VERSION >= 13
+#define HAVE_TASKSTATS 1
+#endif
+#endif
+
+#include "monit.h"
+#include "ExitAccounting.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Exit accounting via the Linux taskstats netlink interface.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define ACCOUNTS_INITIAL 1024
+#define ACCOUNTS_MAX 65536
+#define RECEIVE_BUFFER 1048576
+
+
+static struct {
+        int socket;
+        volatile boolean_t running;
+        Thread_T thread;
+        Mutex_T mutex;
+        int family;                         /**< The taskstats netlink family */
+        int count;
+        int size;
+        ExitAccount_T *table;
+        unsigned long lost;  /**< Records lost since the last take, full table */
+} _accounting = {.socket = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static ExitAccount_T *_slot(ExitAccount_T *table, int size, pid_t tgid) {
+        for (unsigned int i = ((unsigned int)tgid * 2654435761U) & (size - 1), n = 0; n < (unsigned int)size; i = (i + 1) & (size - 1), n++)
+                if (table[i].tgid == tgid || ! table[i].tgid)
+                        return &table[i];
+        return NULL;
+}
+
+
+#ifdef HAVE_TASKSTATS
+
+
+/**
+ * Find the first attribute of the given type in the attribute stream
+ */
+static struct nlattr *_attribute(void *data, int length, int type) {
+        for (struct nlattr *a = data; length >= NLA_HDRLEN && a->nla_len >= NLA_HDRLEN && a->nla_len <= length; length -= NLA_ALIGN(a->nla_len), a = (struct nlattr *)((char *)a + NLA_ALIGN(a->nla_len)))
+                if ((a->nla_type & NLA_TYPE_MASK) == type)
+                        return a;
+        return NULL;
+}
+
+
+static boolean_t _request(int s, int family, int command, int attribute, const void *data, int length) {
+        struct {
+                struct nlmsghdr header;
+                struct genlmsghdr genl;
+                char attributes[NLA_HDRLEN + 256];
+        } request = {};
+        ASSERT(length <= 256);
+        struct nlattr *a = (struct nlattr *)request.attributes;
+        a->nla_type = attribute;
+        a->nla_len = NLA_HDRLEN + length;
+        memcpy((char *)a + NLA_HDRLEN, data, length);
+        request.header.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN + NLA_ALIGN(a->nla_len));
+        request.header.nlmsg_type = family;
+        request.header.nlmsg_flags = NLM_F_REQUEST;
+        request.genl.cmd = command;
+        request.genl.version = 1;
+        struct sockaddr_nl kernel = {.nl_family = AF_NETLINK};
+        return sendto(s, &request, request.header.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) >= 0;
+}
+
+
+/**
+ * Resolve the taskstats generic netlink family
+ * @return The family ID or -1 on error
+ */
+static int _resolveFamily(int s) {
+        if (! _request(s, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, CTRL_ATTR_FAMILY_NAME, TASKSTATS_GENL_NAME, sizeof(TASKSTATS_GENL_NAME)))
+                return -1;
+        char buf[4096] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+        ssize_t len = recv(s, buf, sizeof(buf), 0);
+        for (struct nlmsghdr *h = (struct nlmsghdr *)buf; len > 0 && NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+                if (h->nlmsg_type == NLMSG_ERROR) {
+                        errno = -((struct nlmsgerr *)NLMSG_DATA(h))->error;
+                        return -1;
+                }
+                struct nlattr *a = _attribute((char *)NLMSG_DATA(h) + GENL_HDRLEN, h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), CTRL_ATTR_FAMILY_ID);
+                if (a)
+                        return *(uint16_t *)((char *)a + NLA_HDRLEN);
+        }
+        errno = ENOENT;
+        return -1;
+}
+
+
+/**
+ * Register or deregister the listener for the exits on all CPUs
+ */
+static boolean_t _register(int s, int attribute) {
+        char cpumask[32];
+        long cpus = sysconf(_SC_NPROCESSORS_CONF);
+        int length = snprintf(cpumask, sizeof(cpumask), "0-%ld", cpus > 1 ? cpus - 1 : 0);
+        return _request(s, _accounting.family, TASKSTATS_CMD_GET, attribute, cpumask, length + 1);
+}
+
+
+static void _grow(void) {
+        int size = _accounting.size ? _accounting.size * 2 : ACCOUNTS_INITIAL;
+        ExitAccount_T *table = CALLOC(size, sizeof(ExitAccount_T));
+        for (int i = 0; i < _accounting.size; i++)
+                if (_accounting.table[i].tgid)
+                        *_slot(table, size, _accounting.table[i].tgid) = _accounting.table[i];
+        FREE(_accounting.table);
+        _accounting.table = table;
+        _accounting.size = size;
+}
+
+
+static void _account(struct taskstats *t) {
+        if (! t->ac_tgid)
+                return;
+        LOCK(_accounting.mutex)
+        {
+                if (_accounting.count * 2 >= _accounting.size && _accounting.size < ACCOUNTS_MAX)
+                        _grow();
+                ExitAccount_T *a = _slot(_accounting.table, _accounting.size, t->ac_tgid);
+                if (a) {
+                        if (! a->tgid) {
+                                a->tgid = t->ac_tgid;
+                                _accounting.count++;
+                        }
+                        a->ppid = t->ac_ppid;
+                        a->tasks++;
+                        a->cpu += t->ac_utime + t->ac_stime;
+                        if (t->hiwater_rss > a->rss)
+                                a->rss = t->hiwater_rss;
+                } else {
+                        _accounting.lost++;
+                }
+        }
+        END_LOCK;
+}
+
+
+static void *_listen(void *args) {
+        set_signal_block();
+        char buf[16384] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+        while (_accounting.running) {
+                struct pollfd p = {.fd = _accounting.socket, .events = POLLIN};
+                int n = poll(&p, 1, 1000); // Timeout to check the running flag
+                if (n <= 0) {
+                        if (n < 0 && errno != EINTR) {
+                                LogError("Exit accounting -- poll failed: %s\n", STRERROR);
+                                break;
+                        }
+                        continue;
+                }
+                ssize_t len = recv(_accounting.socket, buf, sizeof(buf), 0);
+                if (len < 0) {
+                        if (errno == ENOBUFS) {
+                                // The socket buffer overflowed, the exits of some processes are not accounted
+                                DEBUG("Exit accounting -- receive buffer overflow, records lost\n");
+                                _accounting.lost++;
+                        } else if (errno != EINTR) {
+                                LogError("Exit accounting -- receive failed: %s\n", STRERROR);
+                                break;
+                        }
+                        continue;
+                }
+                for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+                        if (h->nlmsg_type == NLMSG_ERROR) {
+                                int error = ((struct nlmsgerr *)NLMSG_DATA(h))->error;
+                                if (error) {
+                                        LogError("Exit accounting -- cannot register the listener: %s\n", strerror(-error));
+                                        _accounting.running = false;
+                                }
+                                continue;
+                        }
+                        if (h->nlmsg_type != _accounting.family || h->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+                                continue;
+                        // The per-task record, the per-group record carries only the delay accounting
+                        struct nlattr *aggregate = _attribute((char *)NLMSG_DATA(h) + GENL_HDRLEN, h->nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN), TASKSTATS_TYPE_AGGR_PID);
+                        struct nlattr *stats = aggregate ? _attribute((char *)aggregate + NLA_HDRLEN, aggregate->nla_len - NLA_HDRLEN, TASKSTATS_TYPE_STATS) : NULL;
+                        if (stats) {
+                                struct taskstats t = {};
+                                memcpy(&t, (char *)stats + NLA_HDRLEN, MIN(sizeof(t), (size_t)(stats->nla_len - NLA_HDRLEN)));
+                                if (t.version < 13) {
+                                        LogError("Exit accounting -- the kernel taskstats version %d doesn't report the thread group, version 13 (Linux 6.0) is required\n", t.version);
+                                        _accounting.running = false;
+                                        break;
+                                }
+                                _account(&t);
+                        }
+                }
+        }
+        _accounting.running = false;
+        return NULL;
+}
+
+
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t ExitAccounting_start(void) {
+#ifdef HAVE_TASKSTATS
+        if (_accounting.running)
+                return true;
+        if ((_accounting.socket = socket(PF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0) {
+                LogError("Exit accounting -- cannot create netlink socket: %s\n", STRERROR);
+                return false;
+        }
+        struct sockaddr_nl address = {.nl_family = AF_NETLINK};
+        if (bind(_accounting.socket, (struct sockaddr *)&address, sizeof(address)) < 0 || (_accounting.family = _resolveFamily(_accounting.socket)) < 0) {
+                LogError("Exit accounting -- the taskstats interface is not available: %s\n", STRERROR);
+                goto error;
+        }
+        // A process burst can produce thousands of records faster than the listener reads them
+        setsockopt(_accounting.socket, SOL_SOCKET, SO_RCVBUF, &(int){RECEIVE_BUFFER}, sizeof(int));
+        if (! _register(_accounting.socket, TASKSTATS_CMD_ATTR_REGISTER_CPUMASK)) {
+                LogError("Exit accounting -- cannot register the listener: %s\n", STRERROR);
+                goto error;
+        }
+        Mutex_init(_accounting.mutex);
+        _accounting.running = true;
+        Thread_create(_accounting.thread, _listen, NULL);
+        DEBUG("Exit accounting listener started\n");
+        return true;
+error:
+        close(_accounting.socket);
+        _accounting.socket = -1;
+        return false;
+#else
+        LogError("Exit accounting is not supported on this platform\n");
+        return false;
+#endif
+}
+
+
+void ExitAccounting_stop(void) {
+#ifdef HAVE_TASKSTATS
+        if (_accounting.socket >= 0) {
+                _accounting.running = false;
+                Thread_join(_accounting.thread);
+                _register(_accounting.socket, TASKSTATS_CMD_ATTR_DEREGISTER_CPUMASK);
+                close(_accounting.socket);
+                _accounting.socket = -1;
+                FREE(_accounting.table);
+                _accounting.count = _accounting.size = 0;
+                _accounting.lost = 0;
+                Mutex_destroy(_accounting.mutex);
+                DEBUG("Exit accounting listener stopped\n");
+        }
+#endif
+}
+
+
+int ExitAccounting_take(ExitAccount_T **accounts) {
+        ASSERT(accounts);
+        int size = 0;
+        *accounts = NULL;
+        if (_accounting.socket >= 0) {
+                LOCK(_accounting.mutex)
+                {
+                        if (_accounting.lost)
+                                DEBUG("Exit accounting -- %lu records lost since the last cycle\n", _accounting.lost);
+                        *accounts = _accounting.table;
+                        size = _accounting.size;
+                        _accounting.table = NULL;
+                        _accounting.count = _accounting.size = 0;
+                        _accounting.lost = 0;
+                }
+                END_LOCK;
+        }
+        return size;
+}
+
+
+ExitAccount_T *ExitAccounting_find(ExitAccount_T *accounts, int size, pid_t tgid) {
+        if (! accounts || ! size || tgid <= 0)
+                return NULL;
+        ExitAccount_T *a = _slot(accounts, size, tgid);
+        return a && a->tgid == tgid ? a : NULL;
+}
+
+
+boolean_t ExitAccounting_isRunning(void) {
+        return _accounting.running;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_EXITACCOUNTING_H
+#define MONIT_EXITACCOUNTING_H
+
+
+/**
+ * Exit accounting of the short-lived processes. On Linux the kernel sends the
+ * accounting record of each exiting task via the taskstats netlink interface,
+ * the listener thread aggregates the records by the thread group and the
+ * process tree scan credits the CPU time of the exited processes to their
+ * nearest living ancestor. A process which lived shorter than the poll cycle
+ * is thus accounted in the total CPU usage of its parent even though the scan
+ * never saw it. On other systems the interface is a noop and
+ * ExitAccounting_start() returns false.
+ *
+ * @file
+ */
+
+
+/**
+ * The processes of one thread group which exited since the last
+ * ExitAccounting_take() call
+ */
+typedef struct ExitAccount_T {
+        pid_t tgid;                       /**< Thread group ID, 0 = free slot */
+        pid_t ppid;                                     /**< Parent process ID */
+        int tasks;                                /**< Number of exited tasks */
+        unsigned long long cpu;        /**< User and system CPU time [us] */
+        unsigned long long rss;     /**< Highest resident set size [kB] */
+} ExitAccount_T;
+
+
+/**
+ * Start the exit accounting listener thread
+ * @return true if the listener was started, otherwise false
+ */
+boolean_t ExitAccounting_start(void);
+
+
+/**
+ * Stop the exit accounting listener thread
+ */
+void ExitAccounting_stop(void);
+
+
+/**
+ * Take the records collected since the last call. The table is open
+ * addressed by the thread group ID, use ExitAccounting_find() to look
+ * up a group. The caller must free the table.
+ * @param accounts Set to the table or NULL if nothing was collected
+ * @return The table size
+ */
+int ExitAccounting_take(ExitAccount_T **accounts);
+
+
+/**
+ * Find the thread group in the table returned by ExitAccounting_take()
+ * @param accounts The table
+ * @param size The table size
+ * @param tgid Thread group ID
+ * @return The record or NULL if the group didn't exit
+ */
+ExitAccount_T *ExitAccounting_find(ExitAccount_T *accounts, int size, pid_t tgid);
+
+
+/**
+ * Test if the exit accounting listener is running
+ * @return true if the listener is running, otherwise false
+ */
+boolean_t ExitAccounting_isRunning(void);
+
+
+#endif
@@ -0,0 +1,496 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_DLFCN_H
+#include <dlfcn.h>
+#endif
+
+#include "monit.h"
+#include "Gpu.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  GPU statistics via NVML or ROCm SMI, loaded with dlopen(3).
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define PROCESSES_INITIAL 64
+#define PROCESSES_MAX 4096
+
+
+// The subset of the NVML and ROCm SMI interfaces used by the collector, see nvml.h and rocm_smi.h
+#define NVML_SUCCESS 0
+#define NVML_ERROR_INSUFFICIENT_SIZE 7
+#define NVML_TEMPERATURE_GPU 0
+#define NVML_MEMORY_ERROR_TYPE_UNCORRECTED 1
+#define NVML_VOLATILE_ECC 0
+#define NVML_VALUE_NOT_AVAILABLE (~0ULL)
+#define RSMI_STATUS_SUCCESS 0
+#define RSMI_MEM_TYPE_VRAM 0
+#define RSMI_TEMP_TYPE_EDGE 0
+#define RSMI_TEMP_CURRENT 0
+#define RSMI_GPU_BLOCK_FIRST 0x1
+#define RSMI_GPU_BLOCK_LAST 0x2000
+
+
+typedef struct {
+        unsigned int gpu;
+        unsigned int memory;
+} nvmlUtilization_t;
+
+
+typedef struct {
+        unsigned long long total;
+        unsigned long long free;
+        unsigned long long used;
+} nvmlMemory_t;
+
+
+// The process info of nvmlDeviceGetComputeRunningProcesses_v2 and _v3
+typedef struct {
+        unsigned int pid;
+        unsigned long long usedGpuMemory;
+        unsigned int gpuInstanceId;
+        unsigned int computeInstanceId;
+} nvmlProcessInfo_t;
+
+
+// The process info of the original nvmlDeviceGetComputeRunningProcesses
+typedef struct {
+        unsigned int pid;
+        unsigned long long usedGpuMemory;
+} nvmlProcessInfo_v1_t;
+
+
+typedef struct {
+        uint32_t process_id;
+        uint32_t pasid;
+        uint64_t vram_usage;
+        uint64_t sdma_usage;
+        uint32_t cu_occupancy;
+} rsmi_process_info_t;
+
+
+typedef struct {
+        uint64_t correctable_err;
+        uint64_t uncorrectable_err;
+} rsmi_error_count_t;
+
+
+typedef enum {
+        Gpu_None = 0,
+        Gpu_Nvml,
+        Gpu_Rocm
+} Gpu_Library;
+
+
+typedef struct GpuProcess_T {
+        pid_t pid;
+        long long memory;
+} GpuProcess_T;
+
+
+static struct {
+        Gpu_Library library;
+        void *handle;
+        Mutex_T mutex;
+        int count;                              /**< Processes using some GPU */
+        GpuProcess_T *process;                       /**< Sorted by the PID */
+        struct {
+                int (*init)(void);
+                int (*shutdown)(void);
+                int (*getCount)(unsigned int *);
+                int (*getHandle)(unsigned int, void **);
+                int (*getName)(void *, char *, unsigned int);
+                int (*getUtilization)(void *, nvmlUtilization_t *);
+                int (*getMemory)(void *, nvmlMemory_t *);
+                int (*getTemperature)(void *, int, unsigned int *);
+                int (*getEcc)(void *, int, int, unsigned long long *);
+                int (*getProcesses[2])(void *, unsigned int *, void *);  /**< Compute and graphics */
+                size_t processSize;                  /**< The process info size */
+                void *device[GPU_MAX];
+        } nvml;
+        struct {
+                int (*init)(uint64_t);
+                int (*shutdown)(void);
+                int (*getCount)(uint32_t *);
+                int (*getName)(uint32_t, char *, size_t);
+                int (*getBusy)(uint32_t, uint32_t *);
+                int (*getMemoryUsage)(uint32_t, int, uint64_t *);
+                int (*getMemoryTotal)(uint32_t, int, uint64_t *);
+                int (*getTemperature)(uint32_t, uint32_t, int, int64_t *);
+                int (*getEcc)(uint32_t, int, rsmi_error_count_t *);
+                int (*getProcesses)(rsmi_process_info_t *, uint32_t *);
+        } rocm;
+} _gpu;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static int _processCompare(const void *a, const void *b) {
+        pid_t x = ((const GpuProcess_T *)a)->pid, y = ((const GpuProcess_T *)b)->pid;
+        return x < y ? -1 : x > y;
+}
+
+
+static void _addProcess(GpuProcess_T **list, int *count, int *size, pid_t pid, long long memory) {
+        if (*count >= *size) {
+                if (*size >= PROCESSES_MAX)
+                        return;
+                *size = *size ? *size * 2 : PROCESSES_INITIAL;
+                RESIZE(*list, *size * sizeof(GpuProcess_T));
+        }
+        (*list)[*count].pid = pid;
+        (*list)[*count].memory = memory;
+        (*count)++;
+}
+
+
+/**
+ * Sort the processes by the PID and merge the entries of one process on several
+ * GPUs, then replace the list of the last sample
+ */
+static void _setProcesses(GpuProcess_T *list, int count) {
+        int merged = 0;
+        if (count > 0) {
+                qsort(list, count, sizeof(GpuProcess_T), _processCompare);
+                for (int i = 1; i < count; i++) {
+                        if (list[i].pid == list[merged].pid)
+                                list[merged].memory += list[i].memory;
+                        else
+                                list[++merged] = list[i];
+                }
+                merged++;
+        }
+        LOCK(_gpu.mutex)
+        {
+                FREE(_gpu.process);
+                _gpu.process = list;
+                _gpu.count = merged;
+        }
+        END_LOCK;
+}
+
+
+#ifdef HAVE_DLFCN_H
+
+
+static void *_symbol(const char *name) {
+        void *symbol = dlsym(_gpu.handle, name);
+        if (! symbol)
+                DEBUG("GPU statistics -- %s not found\n", name);
+        return symbol;
+}
+
+
+static boolean_t _loadNvml(void) {
+        if (! (_gpu.handle = dlopen("libnvidia-ml.so.1", RTLD_NOW | RTLD_LOCAL)))
+                return false;
+        if (! (*(void **)&_gpu.nvml.init = _symbol("nvmlInit_v2")) ||
+            ! (*(void **)&_gpu.nvml.shutdown = _symbol("nvmlShutdown")) ||
+            ! (*(void **)&_gpu.nvml.getCount = _symbol("nvmlDeviceGetCount_v2")) ||
+            ! (*(void **)&_gpu.nvml.getHandle = _symbol("nvmlDeviceGetHandleByIndex_v2")) ||
+            ! (*(void **)&_gpu.nvml.getName = _symbol("nvmlDeviceGetName")) ||
+            ! (*(void **)&_gpu.nvml.getUtilization = _symbol("nvmlDeviceGetUtilizationRates")) ||
+            ! (*(void **)&_gpu.nvml.getMemory = _symbol("nvmlDeviceGetMemoryInfo")) ||
+            ! (*(void **)&_gpu.nvml.getTemperature = _symbol("nvmlDeviceGetTemperature")))
+                goto error;
+        // Optional: the ECC counters and the per-process memory
+        *(void **)&_gpu.nvml.getEcc = _symbol("nvmlDeviceGetTotalEccErrors");
+        _gpu.nvml.processSize = sizeof(nvmlProcessInfo_t);
+        if (! (*(void **)&_gpu.nvml.getProcesses[0] = dlsym(_gpu.handle, "nvmlDeviceGetComputeRunningProcesses_v3")) || ! (*(void **)&_gpu.nvml.getProcesses[1] = dlsym(_gpu.handle, "nvmlDeviceGetGraphicsRunningProcesses_v3"))) {
+                if (! (*(void **)&_gpu.nvml.getProcesses[0] = dlsym(_gpu.handle, "nvmlDeviceGetComputeRunningProcesses_v2")) || ! (*(void **)&_gpu.nvml.getProcesses[1] = dlsym(_gpu.handle, "nvmlDeviceGetGraphicsRunningProcesses_v2"))) {
+                        *(void **)&_gpu.nvml.getProcesses[0] = dlsym(_gpu.handle, "nvmlDeviceGetComputeRunningProcesses");
+                        *(void **)&_gpu.nvml.getProcesses[1] = dlsym(_gpu.handle, "nvmlDeviceGetGraphicsRunningProcesses");
+                        _gpu.nvml.processSize = sizeof(nvmlProcessInfo_v1_t);
+                }
+        }
+        int rv = _gpu.nvml.init();
+        if (rv != NVML_SUCCESS) {
+                LogError("GPU statistics -- NVML initialization failed with status %d\n", rv);
+                goto error;
+        }
+        unsigned int count = 0;
+        if ((rv = _gpu.nvml.getCount(&count)) != NVML_SUCCESS) {
+                LogError("GPU statistics -- NVML cannot get the number of devices, status %d\n", rv);
+                _gpu.nvml.shutdown();
+                goto error;
+        }
+        if (count > GPU_MAX) {
+                LogError("GPU statistics -- %u devices found, only the first %d are monitored\n", count, GPU_MAX);
+                count = GPU_MAX;
+        }
+        systeminfo.gpu.count = 0;
+        for (unsigned int i = 0; i < count; i++) {
+                GpuDevice_T *device = &systeminfo.gpu.device[systeminfo.gpu.count];
+                if (_gpu.nvml.getHandle(i, &_gpu.nvml.device[systeminfo.gpu.count]) != NVML_SUCCESS) {
+                        LogError("GPU statistics -- NVML cannot get the device %u\n", i);
+                        continue;
+                }
+                if (_gpu.nvml.getName(_gpu.nvml.device[systeminfo.gpu.count], device->name, sizeof(device->name)) != NVML_SUCCESS)
+                        snprintf(device->name, sizeof(device->name), "GPU %u", i);
+                systeminfo.gpu.count++;
+        }
+        _gpu.library = Gpu_Nvml;
+        return true;
+error:
+        dlclose(_gpu.handle);
+        _gpu.handle = NULL;
+        return false;
+}
+
+
+static boolean_t _loadRocm(void) {
+        if (! (_gpu.handle = dlopen("librocm_smi64.so.1", RTLD_NOW | RTLD_LOCAL)) && ! (_gpu.handle = dlopen("librocm_smi64.so", RTLD_NOW | RTLD_LOCAL)))
+                return false;
+        if (! (*(void **)&_gpu.rocm.init = _symbol("rsmi_init")) ||
+            ! (*(void **)&_gpu.rocm.shutdown = _symbol("rsmi_shut_down")) ||
+            ! (*(void **)&_gpu.rocm.getCount = _symbol("rsmi_num_monitor_devices")) ||
+            ! (*(void **)&_gpu.rocm.getBusy = _symbol("rsmi_dev_busy_percent_get")) ||
+            ! (*(void **)&_gpu.rocm.getMemoryUsage = _symbol("rsmi_dev_memory_usage_get")) ||
+            ! (*(void **)&_gpu.rocm.getMemoryTotal = _symbol("rsmi_dev_memory_total_get")) ||
+            ! (*(void **)&_gpu.rocm.getTemperature = _symbol("rsmi_dev_temp_metric_get")))
+                goto error;
+        // Optional: the device name, the ECC counters and the per-process memory
+        *(void **)&_gpu.rocm.getName = _symbol("rsmi_dev_name_get");
+        *(void **)&_gpu.rocm.getEcc = _symbol("rsmi_dev_ecc_count_get");
+        *(void **)&_gpu.rocm.getProcesses = _symbol("rsmi_compute_process_info_get");
+        int rv = _gpu.rocm.init(0);
+        if (rv != RSMI_STATUS_SUCCESS) {
+                LogError("GPU statistics -- ROCm SMI initialization failed with status %d\n", rv);
+                goto error;
+        }
+        uint32_t count = 0;
+        if ((rv = _gpu.rocm.getCount(&count)) != RSMI_STATUS_SUCCESS) {
+                LogError("GPU statistics -- ROCm SMI cannot get the number of devices, status %d\n", rv);
+                _gpu.rocm.shutdown();
+                goto error;
+        }
+        if (count > GPU_MAX) {
+                LogError("GPU statistics -- %u devices found, only the first %d are monitored\n", count, GPU_MAX);
+                count = GPU_MAX;
+        }
+        for (uint32_t i = 0; i < count; i++) {
+                GpuDevice_T *device = &systeminfo.gpu.device[i];
+                if (! _gpu.rocm.getName || _gpu.rocm.getName(i, device->name, sizeof(device->name)) != RSMI_STATUS_SUCCESS)
+                        snprintf(device->name, sizeof(device->name), "GPU %u", i);
+        }
+        systeminfo.gpu.count = count;
+        _gpu.library = Gpu_Rocm;
+        return true;
+error:
+        dlclose(_gpu.handle);
+        _gpu.handle = NULL;
+        return false;
+}
+
+
+#endif
+
+
+static void _resetDevice(GpuDevice_T *device) {
+        device->usage = device->memory_percent = device->temperature = -1.;
+        device->memory = device->memory_max = device->ecc = -1LL;
+}
+
+
+static void _setMemory(GpuDevice_T *device, unsigned long long used, unsigned long long total) {
+        device->memory = used;
+        device->memory_max = total;
+        device->memory_percent = total > 0 ? 100. * (double)used / (double)total : -1.;
+}
+
+
+static void _updateNvml(void) {
+        GpuProcess_T *list = NULL;
+        int count = 0, size = 0;
+        unsigned int length = 32;
+        void *info = CALLOC(length, _gpu.nvml.processSize);
+        for (int i = 0; i < systeminfo.gpu.count; i++) {
+                void *handle = _gpu.nvml.device[i];
+                GpuDevice_T *device = &systeminfo.gpu.device[i];
+                _resetDevice(device);
+                nvmlUtilization_t utilization;
+                if (_gpu.nvml.getUtilization(handle, &utilization) == NVML_SUCCESS)
+                        device->usage = utilization.gpu;
+                nvmlMemory_t memory;
+                if (_gpu.nvml.getMemory(handle, &memory) == NVML_SUCCESS)
+                        _setMemory(device, memory.used, memory.total);
+                unsigned int temperature;
+                if (_gpu.nvml.getTemperature(handle, NVML_TEMPERATURE_GPU, &temperature) == NVML_SUCCESS)
+                        device->temperature = temperature;
+                unsigned long long ecc;
+                // Not supported on the devices without ECC memory or with ECC disabled
+                if (_gpu.nvml.getEcc && _gpu.nvml.getEcc(handle, NVML_MEMORY_ERROR_TYPE_UNCORRECTED, NVML_VOLATILE_ECC, &ecc) == NVML_SUCCESS)
+                        device->ecc = ecc;
+                for (int k = 0; k < 2; k++) {
+                        if (! _gpu.nvml.getProcesses[k])
+                                continue;
+                        unsigned int n = length;
+                        int rv = _gpu.nvml.getProcesses[k](handle, &n, info);
+                        if (rv == NVML_ERROR_INSUFFICIENT_SIZE && n > length && n <= PROCESSES_MAX) {
+                                length = n;
+                                RESIZE(info, length * _gpu.nvml.processSize);
+                                rv = _gpu.nvml.getProcesses[k](handle, &n, info);
+                        }
+                        if (rv != NVML_SUCCESS)
+                                continue;
+                        for (unsigned int j = 0; j < n && j < length; j++) {
+                                const nvmlProcessInfo_v1_t *p = (const nvmlProcessInfo_v1_t *)((char *)info + j * _gpu.nvml.processSize);
+                                // The memory is not available in the vGPU guests and on Windows WDDM, the PID is counted anyway
+                                _addProcess(&list, &count, &size, p->pid, p->usedGpuMemory == NVML_VALUE_NOT_AVAILABLE ? 0LL : (long long)p->usedGpuMemory);
+                        }
+                }
+        }
+        FREE(info);
+        _setProcesses(list, count);
+}
+
+
+static void _updateRocm(void) {
+        for (int i = 0; i < systeminfo.gpu.count; i++) {
+                GpuDevice_T *device = &systeminfo.gpu.device[i];
+                _resetDevice(device);
+                uint32_t busy;
+                if (_gpu.rocm.getBusy(i, &busy) == RSMI_STATUS_SUCCESS)
+                        device->usage = busy;
+                uint64_t used, total;
+                if (_gpu.rocm.getMemoryUsage(i, RSMI_MEM_TYPE_VRAM, &used) == RSMI_STATUS_SUCCESS && _gpu.rocm.getMemoryTotal(i, RSMI_MEM_TYPE_VRAM, &total) == RSMI_STATUS_SUCCESS)
+                        _setMemory(device, used, total);
+                int64_t temperature;
+                if (_gpu.rocm.getTemperature(i, RSMI_TEMP_TYPE_EDGE, RSMI_TEMP_CURRENT, &temperature) == RSMI_STATUS_SUCCESS)
+                        device->temperature = temperature / 1000.;
+                if (_gpu.rocm.getEcc) {
+                        // The ECC errors are counted per hardware block
+                        for (int block = RSMI_GPU_BLOCK_FIRST; block <= RSMI_GPU_BLOCK_LAST; block <<= 1) {
+                                rsmi_error_count_t ecc;
+                                if (_gpu.rocm.getEcc(i, block, &ecc) == RSMI_STATUS_SUCCESS)
+                                        device->ecc = (device->ecc < 0 ? 0 : device->ecc) + ecc.uncorrectable_err;
+                        }
+                }
+        }
+        GpuProcess_T *list = NULL;
+        int count = 0, size = 0;
+        uint32_t n = 0;
+        // The VRAM usage of the process is the sum over all devices
+        if (_gpu.rocm.getProcesses && _gpu.rocm.getProcesses(NULL, &n) == RSMI_STATUS_SUCCESS && n > 0) {
+                n = n > PROCESSES_MAX ? PROCESSES_MAX : n;
+                rsmi_process_info_t *info = CALLOC(n, sizeof(rsmi_process_info_t));
+                if (_gpu.rocm.getProcesses(info, &n) == RSMI_STATUS_SUCCESS)
+                        for (uint32_t j = 0; j < n; j++)
+                                _addProcess(&list, &count, &size, info[j].process_id, info[j].vram_usage);
+                FREE(info);
+        }
+        _setProcesses(list, count);
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Gpu_start(void) {
+        if (_gpu.library != Gpu_None)
+                return true;
+#ifdef HAVE_DLFCN_H
+        if (_loadNvml() || _loadRocm()) {
+                Mutex_init(_gpu.mutex);
+                LogInfo("GPU statistics via %s, %d device(s)\n", _gpu.library == Gpu_Nvml ? "NVML" : "ROCm SMI", systeminfo.gpu.count);
+                return true;
+        }
+#endif
+        LogError("GPU statistics -- neither the NVML nor the ROCm SMI library is available\n");
+        return false;
+}
+
+
+void Gpu_stop(void) {
+#ifdef HAVE_DLFCN_H
+        if (_gpu.library == Gpu_None)
+                return;
+        if (_gpu.library == Gpu_Nvml)
+                _gpu.nvml.shutdown();
+        else
+                _gpu.rocm.shutdown();
+        dlclose(_gpu.handle);
+        _gpu.handle = NULL;
+        _gpu.library = Gpu_None;
+        systeminfo.gpu.count = 0;
+        FREE(_gpu.process);
+        _gpu.count = 0;
+        Mutex_destroy(_gpu.mutex);
+#endif
+}
+
+
+void Gpu_update(void) {
+        if (_gpu.library == Gpu_Nvml)
+                _updateNvml();
+        else if (_gpu.library == Gpu_Rocm)
+                _updateRocm();
+}
+
+
+long long Gpu_processMemory(pid_t pid) {
+        if (_gpu.library == Gpu_None)
+                return -1LL;
+        long long memory = 0LL;
+        LOCK(_gpu.mutex)
+        {
+                GpuProcess_T *p = _gpu.count ? bsearch(&(GpuProcess_T){.pid = pid}, _gpu.process, _gpu.count, sizeof(GpuProcess_T), _processCompare) : NULL;
+                if (p)
+                        memory = p->memory;
+        }
+        END_LOCK;
+        return memory;
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_GPU_H
+#define MONIT_GPU_H
+
+
+/**
+ * GPU statistics collector. The vendor management library is loaded at
+ * runtime, so Monit neither links with it nor forks a command line tool
+ * in each cycle: NVML (libnvidia-ml) for the NVIDIA GPUs, or ROCm SMI
+ * (librocm_smi64) for the AMD GPUs if NVML is not available. The library
+ * is initialized once, Gpu_update() samples the usage, the memory, the
+ * temperature and the uncorrected ECC errors of each device into
+ * systeminfo.gpu and the GPU memory used by each process. The collector
+ * is started if 'set gpu' or some GPU resource test is configured.
+ *
+ * @file
+ */
+
+
+/**
+ * Load the GPU management library and initialize it
+ * @return true if a library was loaded, otherwise false
+ */
+boolean_t Gpu_start(void);
+
+
+/**
+ * Shut the GPU management library down and unload it
+ */
+void Gpu_stop(void);
+
+
+/**
+ * Sample the GPU statistics into systeminfo.gpu and the per-process GPU
+ * memory. Noop if the collector is not started.
+ */
+void Gpu_update(void);
+
+
+/**
+ * Get the GPU memory used by the process on all GPUs in the last sample
+ * @param pid The process ID
+ * @return The memory [B], 0 if the process doesn't use a GPU or -1 if
+ * the collector is not started
+ */
+long long Gpu_processMemory(pid_t pid);
+
+
+#endif
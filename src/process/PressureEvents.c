@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#include "monit.h"
+#include "PressureEvents.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Pressure stall events via the Linux PSI triggers (see Documentation/accounting/psi.rst).
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define TRIGGERS_MAX 16
+
+#define TRIGGER_WINDOW 10000000 // The tracking window [us], the kernel accepts 0.5s-10s (unprivileged users multiples of 2s)
+
+
+static struct {
+        volatile boolean_t running;
+        volatile boolean_t stalled;
+        Thread_T thread;
+        int count;
+        struct pollfd triggers[TRIGGERS_MAX];
+} _events = {};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+#ifdef LINUX
+
+
+/**
+ * Register the trigger: the stall time threshold is the limit share of the window
+ */
+static boolean_t _register(Resource_T r) {
+        char path[64], trigger[64];
+        snprintf(path, sizeof(path), "/proc/pressure/%s", pressurenames[r->pressure.type]);
+        long long threshold = (long long)(r->limit / 100. * TRIGGER_WINDOW);
+        if (threshold <= 0 || threshold >= TRIGGER_WINDOW)
+                return false;
+        int length = snprintf(trigger, sizeof(trigger), "%s %lld %d", r->pressure.full ? "full" : "some", threshold, TRIGGER_WINDOW);
+        int fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+                LogError("Pressure events -- cannot open %s: %s\n", path, STRERROR);
+                return false;
+        }
+        if (write(fd, trigger, length + 1) < 0) {
+                LogError("Pressure events -- cannot register the trigger '%s' in %s: %s\n", trigger, path, STRERROR);
+                close(fd);
+                return false;
+        }
+        DEBUG("Pressure events -- trigger '%s' registered in %s\n", trigger, path);
+        _events.triggers[_events.count].fd = fd;
+        _events.triggers[_events.count].events = POLLPRI;
+        _events.count++;
+        return true;
+}
+
+
+static void *_listen(void *args) {
+        set_signal_block();
+        while (_events.running) {
+                int n = poll(_events.triggers, _events.count, 1000); // Timeout to check the running flag
+                if (n <= 0) {
+                        if (n < 0 && errno != EINTR) {
+                                LogError("Pressure events -- poll failed: %s\n", STRERROR);
+                                break;
+                        }
+                        continue;
+                }
+                for (int i = 0; i < _events.count; i++) {
+                        if (_events.triggers[i].revents & POLLERR) {
+                                LogError("Pressure events -- the trigger was removed by the kernel\n");
+                                _events.running = false;
+                        } else if (_events.triggers[i].revents & POLLPRI) {
+                                _events.stalled = true;
+                        }
+                }
+                if (_events.stalled) {
+                        DEBUG("Pressure stall -- waking up the validation\n");
+                        // Wakeup the main thread, this thread has the signal blocked
+                        kill(getpid(), SIGUSR1);
+                }
+        }
+        _events.running = false;
+        return NULL;
+}
+
+
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t PressureEvents_start(void) {
+#ifdef LINUX
+        if (_events.count || ! Run.system)
+                return _events.running;
+        // The triggers wake up the validation when the stall exceeds the limit, the tests with other operators are checked in the poll cycle
+        for (Resource_T r = Run.system->resourcelist; r && _events.count < TRIGGERS_MAX; r = r->next)
+                if (r->resource_id == Resource_Pressure && (r->operator == Operator_Greater || r->operator == Operator_GreaterOrEqual))
+                        _register(r);
+        if (! _events.count) {
+                DEBUG("Pressure events -- no system pressure test with a trigger\n");
+                return false;
+        }
+        _events.stalled = false;
+        _events.running = true;
+        Thread_create(_events.thread, _listen, NULL);
+        DEBUG("Pressure events listener started\n");
+        return true;
+#else
+        LogError("Pressure events are not supported on this platform\n");
+        return false;
+#endif
+}
+
+
+void PressureEvents_stop(void) {
+#ifdef LINUX
+        if (_events.count) {
+                _events.running = false;
+                Thread_join(_events.thread);
+                for (int i = 0; i < _events.count; i++)
+                        close(_events.triggers[i].fd);
+                _events.count = 0;
+                DEBUG("Pressure events listener stopped\n");
+        }
+#endif
+}
+
+
+boolean_t PressureEvents_isStalled(void) {
+        boolean_t rv = _events.stalled;
+        _events.stalled = false;
+        return rv;
+}
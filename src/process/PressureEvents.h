@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PRESSUREEVENTS_H
+#define MONIT_PRESSUREEVENTS_H
+
+
+/**
+ * Pressure stall event source. On Linux a PSI trigger is registered in
+ * /proc/pressure for each system pressure test with the greater than
+ * operator, so Monit wakes up and checks the system as soon as the stall
+ * exceeds the limit instead of on the next poll cycle. On other systems
+ * the interface is a noop and PressureEvents_start() returns false.
+ *
+ * @file
+ */
+
+
+/**
+ * Register the triggers of the system pressure tests and start the listener
+ * thread
+ * @return true if the listener was started, otherwise false
+ */
+boolean_t PressureEvents_start(void);
+
+
+/**
+ * Stop the listener thread and remove the triggers
+ */
+void PressureEvents_stop(void);
+
+
+/**
+ * Test if some trigger fired since the last call, the flag is reset
+ * @return true if a pressure stall event was received, otherwise false
+ */
+boolean_t PressureEvents_isStalled(void);
+
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#if defined HAVE_LINUX_CONNECTOR_H && defined HAVE_LINUX_CN_PROC_H
+#include <linux/netlink.h>
+#include <linux/connector.h>
+#include <linux/cn_proc.h>
+#define HAVE_PROC_CONNECTOR 1
+#endif
+
+#include "monit.h"
+#include "ProcessEvents.h"
+
+// libmonit
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Process lifecycle events via the Linux netlink proc connector.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define EXITED_MAX 256
+
+
+static struct {
+        int socket;
+        volatile boolean_t running;
+        Thread_T thread;
+        Mutex_T mutex;
+        volatile unsigned long generation;
+        struct {
+                int count;
+                pid_t *list;                                       /**< Sorted */
+        } watched;
+        struct {
+                int count;
+                pid_t list[EXITED_MAX];
+        } exited;
+} _events = {.socket = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static int _compare(const void *a, const void *b) {
+        return *(const pid_t *)a - *(const pid_t *)b;
+}
+
+
+#ifdef HAVE_PROC_CONNECTOR
+
+
+static void _exited(pid_t pid) {
+        boolean_t watched = false;
+        LOCK(_events.mutex)
+        {
+                if (_events.watched.count && bsearch(&pid, _events.watched.list, _events.watched.count, sizeof(pid_t), _compare)) {
+                        watched = true;
+                        if (_events.exited.count < EXITED_MAX)
+                                _events.exited.list[_events.exited.count++] = pid;
+                }
+        }
+        END_LOCK;
+        if (watched) {
+                DEBUG("Process with pid %d exited -- waking up the validation\n", pid);
+                // Wakeup the main thread, this thread has the signal blocked
+                kill(getpid(), SIGUSR1);
+        }
+}
+
+
+static boolean_t _subscribe(int s, enum proc_cn_mcast_op op) {
+        struct __attribute__ ((aligned(NLMSG_ALIGNTO))) {
+                struct nlmsghdr header;
+                struct __attribute__ ((__packed__)) {
+                        struct cn_msg message;
+                        enum proc_cn_mcast_op op;
+                } body;
+        } request = {};
+        request.header.nlmsg_len = sizeof(request);
+        request.header.nlmsg_pid = getpid();
+        request.header.nlmsg_type = NLMSG_DONE;
+        request.body.message.id.idx = CN_IDX_PROC;
+        request.body.message.id.val = CN_VAL_PROC;
+        request.body.message.len = sizeof(enum proc_cn_mcast_op);
+        request.body.op = op;
+        return send(s, &request, sizeof(request), 0) >= 0;
+}
+
+
+static void *_listen(void *args) {
+        set_signal_block();
+        char buf[8192] __attribute__ ((aligned(NLMSG_ALIGNTO)));
+        while (_events.running) {
+                struct pollfd p = {.fd = _events.socket, .events = POLLIN};
+                int n = poll(&p, 1, 1000); // Timeout to check the running flag
+                if (n <= 0) {
+                        if (n < 0 && errno != EINTR) {
+                                LogError("Process events -- poll failed: %s\n", STRERROR);
+                                break;
+                        }
+                        continue;
+                }
+                ssize_t len = recv(_events.socket, buf, sizeof(buf), 0);
+                if (len < 0) {
+                        if (errno == ENOBUFS) {
+                                // The socket buffer overflowed and some events were lost => invalidate the generation, exits will be caught by the next scan
+                                DEBUG("Process events -- receive buffer overflow, events lost\n");
+                                _events.generation++;
+                        } else if (errno != EINTR) {
+                                LogError("Process events -- receive failed: %s\n", STRERROR);
+                                break;
+                        }
+                        continue;
+                }
+                for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, len); h = NLMSG_NEXT(h, len)) {
+                        if (h->nlmsg_type == NLMSG_ERROR || h->nlmsg_type == NLMSG_OVERRUN) {
+                                _events.generation++;
+                                break;
+                        }
+                        struct cn_msg *message = NLMSG_DATA(h);
+                        if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC)
+                                continue;
+                        struct proc_event *e = (struct proc_event *)message->data;
+                        switch (e->what) {
+                                case PROC_EVENT_FORK:
+                                case PROC_EVENT_EXEC:
+                                        _events.generation++;
+                                        break;
+                                case PROC_EVENT_EXIT:
+                                        // Ignore thread exits
+                                        if (e->event_data.exit.process_pid == e->event_data.exit.process_tgid)
+                                                _exited(e->event_data.exit.process_pid);
+                                        break;
+                                default:
+                                        break;
+                        }
+                }
+        }
+        _events.running = false;
+        return NULL;
+}
+
+
+#endif
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t ProcessEvents_start(void) {
+#ifdef HAVE_PROC_CONNECTOR
+        if (_events.running)
+                return true;
+        if ((_events.socket = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR)) < 0) {
+                LogError("Process events -- cannot create netlink socket: %s\n", STRERROR);
+                return false;
+        }
+        struct sockaddr_nl address = {.nl_family = AF_NETLINK, .nl_groups = CN_IDX_PROC, .nl_pid = getpid()};
+        if (bind(_events.socket, (struct sockaddr *)&address, sizeof(address)) < 0 || ! _subscribe(_events.socket, PROC_CN_MCAST_LISTEN)) {
+                LogError("Process events -- cannot subscribe to the proc connector: %s\n", STRERROR);
+                close(_events.socket);
+                _events.socket = -1;
+                return false;
+        }
+        Mutex_init(_events.mutex);
+        _events.running = true;
+        Thread_create(_events.thread, _listen, NULL);
+        DEBUG("Process events listener started\n");
+        return true;
+#else
+        LogError("Process events are not supported on this platform\n");
+        return false;
+#endif
+}
+
+
+void ProcessEvents_stop(void) {
+#ifdef HAVE_PROC_CONNECTOR
+        if (_events.socket >= 0) {
+                _events.running = false;
+                Thread_join(_events.thread);
+                _subscribe(_events.socket, PROC_CN_MCAST_IGNORE);
+                close(_events.socket);
+                _events.socket = -1;
+                FREE(_events.watched.list);
+                _events.watched.count = 0;
+                _events.exited.count = 0;
+                Mutex_destroy(_events.mutex);
+                DEBUG("Process events listener stopped\n");
+        }
+#endif
+}
+
+
+void ProcessEvents_watch(pid_t *pids, int count) {
+        if (_events.socket >= 0) {
+                pid_t *list = NULL;
+                if (count > 0) {
+                        list = ALLOC(count * sizeof(pid_t));
+                        memcpy(list, pids, count * sizeof(pid_t));
+                        qsort(list, count, sizeof(pid_t), _compare);
+                }
+                LOCK(_events.mutex)
+                {
+                        FREE(_events.watched.list);
+                        _events.watched.list = list;
+                        _events.watched.count = count;
+                        _events.exited.count = 0;
+                }
+                END_LOCK;
+        }
+}
+
+
+boolean_t ProcessEvents_isExited(pid_t pid) {
+        boolean_t rv = false;
+        if (_events.socket >= 0) {
+                LOCK(_events.mutex)
+                {
+                        for (int i = 0; i < _events.exited.count; i++) {
+                                if (_events.exited.list[i] == pid) {
+                                        rv = true;
+                                        break;
+                                }
+                        }
+                }
+                END_LOCK;
+        }
+        return rv;
+}
+
+
+boolean_t ProcessEvents_hasExited(void) {
+        boolean_t rv = false;
+        if (_events.socket >= 0) {
+                LOCK(_events.mutex)
+                {
+                        rv = _events.exited.count > 0;
+                }
+                END_LOCK;
+        }
+        return rv;
+}
+
+
+unsigned long ProcessEvents_getGeneration(void) {
+        return _events.generation;
+}
+
+
+boolean_t ProcessEvents_isRunning(void) {
+        return _events.running;
+}
+
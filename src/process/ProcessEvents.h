@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_PROCESSEVENTS_H
+#define MONIT_PROCESSEVENTS_H
+
+
+/**
+ * Process lifecycle event source. On Linux the events are received from the
+ * netlink proc connector, so Monit learns about the exit of a monitored
+ * process immediately instead of on the next poll cycle. On other systems
+ * the interface is a noop and ProcessEvents_start() returns false.
+ *
+ * @file
+ */
+
+
+/**
+ * Start the process event listener thread
+ * @return true if the listener was started, otherwise false
+ */
+boolean_t ProcessEvents_start(void);
+
+
+/**
+ * Stop the process event listener thread
+ */
+void ProcessEvents_stop(void);
+
+
+/**
+ * Set the PIDs whose exit should wake up the validate cycle. The list is
+ * copied and replaces the previous one, the exited PIDs list is reset.
+ * @param pids Array of monitored PIDs
+ * @param count Number of PIDs in the array
+ */
+void ProcessEvents_watch(pid_t *pids, int count);
+
+
+/**
+ * Test if the given PID exited since the last ProcessEvents_watch() call
+ * @param pid Process PID
+ * @return true if the process exit event was received, otherwise false
+ */
+boolean_t ProcessEvents_isExited(pid_t pid);
+
+
+/**
+ * Test if some monitored process exited since the last ProcessEvents_watch() call
+ * @return true if an exit event of a watched PID was received, otherwise false
+ */
+boolean_t ProcessEvents_hasExited(void);
+
+
+/**
+ * Get the process lifecycle generation. The counter is incremented on every
+ * fork and exec event (and when events were lost), so if it didn't change
+ * since the last process tree scan, no new process could have appeared.
+ * @return The generation counter
+ */
+unsigned long ProcessEvents_getGeneration(void);
+
+
+/**
+ * Test if the process event listener is running
+ * @return true if the listener is running, otherwise false
+ */
+boolean_t ProcessEvents_isRunning(void);
+
+
+#endif
+
@@ -40,6 +40,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
 #endif
@@ -63,9 +67,14 @@
 #include "monit.h"
 #include "event.h"
 #include "ProcessTree.h"
+#include "Gpu.h"
+#include "ProcessEvents.h"
+#include "ExitAccounting.h"
 #include "process_sysdep.h"
 #include "Box.h"
 #include "Color.h"
+#include "probes.h"
+#include "counter.h"
 
 // libmonit
 #include "system/Time.h"
@@ -81,20 +90,155 @@
 /* ------------------------------------------------------------- Definitions */
 
 
+/**
+ * PID -> ptree index lookup table using open addressing with linear probing.
+ * The table is rebuilt with the process tree each cycle, the slots contain
+ * ptree index + 1, so zero marks an empty slot.
+ */
+typedef struct ProcessIndex_T {
+        int count;
+        int mask;
+        int *slots;
+} ProcessIndex_T;
+
+
+/**
+ * Combined matcher for "check process ... matching" services. All patterns are
+ * evaluated in one pass over the process tree and the resulting service -> process
+ * assignment is reused until the tree is collected again. Each pattern is indexed
+ * by the first two bytes of the longest literal which any match must contain, so
+ * one scan of the command line selects the candidate patterns and the regex engine
+ * runs only for them. Patterns without such literal are candidates for every process.
+ */
+#define PATTERN_LITERAL 64
+
+typedef struct ProcessPattern_T {
+        Service_T service;
+        regex_t *regex;
+        char literal[PATTERN_LITERAL];
+        int length;
+        int next;      // Next pattern in the same bucket or -1
+        int seen;      // The last process which this pattern was tested against
+        int found;     // The selected process or -1
+} ProcessPattern_T;
+
+typedef struct ProcessMatcher_T {
+        boolean_t valid;              // The assignment is valid for the current process tree
+        int count;
+        int mask;
+        int generic;                  // Chain of patterns without literal
+        int *buckets;
+        ProcessPattern_T *patterns;   // Sorted by the service
+        unsigned char bigrams[65536 / 8];
+} ProcessMatcher_T;
+
+
+/**
+ * Container index for the "matching ... in container" services. The processes are
+ * grouped by the container: by the PID namespace if it differs from the Monit one,
+ * otherwise by the cgroup (such as the containers which share the host PID namespace
+ * or the systemd units). The index is built once per tree generation, the match then
+ * scans only the processes of the selected containers instead of the whole host.
+ */
+typedef struct ProcessContainer_T {
+        ino_t namespace;
+        const char *cgroup;           // The cgroup of the container's oldest process
+        int first;                    // The first process in ProcessContainers_T.members
+        int count;
+} ProcessContainer_T;
+
+typedef struct ProcessContainers_T {
+        boolean_t valid;              // The index is valid for the current process tree
+        ino_t host;                   // The Monit PID namespace
+        int count;
+        int *members;                 // The process tree entries sorted by the container
+        ProcessContainer_T *containers;
+} ProcessContainers_T;
+
+
 static int ptreesize = 0;
 static ProcessTree_T *ptree = NULL;
+static ProcessIndex_T pindex = {};
+static int *ptreechildren = NULL;
+static ProcessMatcher_T matcher = {};
+static ProcessContainers_T containers = {};
+static ProcessEngine_Flags ptreeflags = ProcessEngine_None; // Optional data collected in the current tree generation
+static size_t ptreememory = 0; // Memory used by the current tree generation, read by the HTTP interface
+static int synthetic = 0; // Number of generated processes which the tree build benchmark uses instead of the process table
+static int syntheticcycle = 0;
+static long long exitAccounted = 0; // Monotonic time of the last exit accounting [ms]
 
 
 /* ----------------------------------------------------------------- Private */
 
 
+static inline unsigned _hash(pid_t pid) {
+        return (unsigned)pid * 2654435761U; // Knuth's multiplicative hash
+}
+
+
+static void _indexFree(ProcessIndex_T *index) {
+        FREE(index->slots);
+        index->count = 0;
+        index->mask = 0;
+}
+
+
+static void _indexInsert(ProcessIndex_T *index, ProcessTree_T *pt, int entry);
+
+
+static void _indexResize(ProcessIndex_T *index, ProcessTree_T *pt, int capacity) {
+        int *slots = index->slots;
+        int size = slots ? index->mask + 1 : 0;
+        int newsize = 16;
+        while (newsize < capacity * 2) // Keep the load factor <= 0.5
+                newsize <<= 1;
+        index->slots = CALLOC(sizeof(int), newsize);
+        index->mask = newsize - 1;
+        index->count = 0;
+        for (int i = 0; i < size; i++)
+                if (slots[i])
+                        _indexInsert(index, pt, slots[i] - 1);
+        FREE(slots);
+}
+
+
+/**
+ * Add the ptree entry to the index. If the PID is already indexed, the first entry wins (same result as the linear scan)
+ * @param index The PID index
+ * @param pt The process tree the index belongs to
+ * @param entry ptree index of the process
+ */
+static void _indexInsert(ProcessIndex_T *index, ProcessTree_T *pt, int entry) {
+        if (! index->slots || (index->count + 1) * 2 > index->mask + 1)
+                _indexResize(index, pt, index->count + 1);
+        for (unsigned i = _hash(pt[entry].pid) & index->mask; ; i = (i + 1) & index->mask) {
+                if (! index->slots[i]) {
+                        index->slots[i] = entry + 1;
+                        index->count++;
+                        return;
+                } else if (pt[index->slots[i] - 1].pid == pt[entry].pid) {
+                        return;
+                }
+        }
+}
+
+
+static void _indexBuild(ProcessIndex_T *index, ProcessTree_T *pt, int size) {
+        _indexFree(index);
+        _indexResize(index, pt, size);
+        for (int i = 0; i < size; i++)
+                _indexInsert(index, pt, i);
+}
+
+
 static void _delete(ProcessTree_T **pt, int *size) {
         ASSERT(pt);
         ProcessTree_T *_pt = *pt;
         if (_pt) {
                 for (int i = 0; i < *size; i++) {
                         FREE(_pt[i].cmdline);
-                        FREE(_pt[i].children.list);
+                        FREE(_pt[i].container.cgroup);
                 }
                 FREE(_pt);
                 *pt = NULL;
@@ -107,130 +251,682 @@ static void _delete(ProcessTree_T **pt, int *size) {
  * Search a leaf in the processtree
  * @param pid  pid of the process
  * @param pt  processtree
- * @param treesize  size of the processtree
+ * @param index  PID index of the processtree
  * @return process index if succeeded otherwise -1
  */
-static int _findProcess(int pid, ProcessTree_T *pt, int size) {
-        if (size > 0) {
-                for (int i = 0; i < size; i++)
-                        if (pid == pt[i].pid)
-                                return i;
+static int _findProcess(int pid, ProcessTree_T *pt, ProcessIndex_T *index) {
+        if (index->count > 0) {
+                for (unsigned i = _hash(pid) & index->mask; index->slots[i]; i = (i + 1) & index->mask)
+                        if (pid == pt[index->slots[i] - 1].pid)
+                                return index->slots[i] - 1;
         }
         return -1;
 }
 
 
 /**
- * Fill data in the process tree by recusively walking through it
+ * Connect the children to their parents: the children of all processes are
+ * stored in one array, each process has the offset and count of its children
  * @param pt process tree
- * @param i process index
- */
-static void _fillProcessTree(ProcessTree_T *pt, int index) {
-        if (! pt[index].visited) {
-                pt[index].visited            = true;
-                pt[index].children.total     = pt[index].children.count;
-                pt[index].memory.usage_total = pt[index].memory.usage;
-                pt[index].cpu.usage_total    = pt[index].cpu.usage;
-                for (int i = 0; i < pt[index].children.count; i++)
-                        _fillProcessTree(pt, pt[index].children.list[i]);
-                if (pt[index].parent != -1 && pt[index].parent != index) {
-                        ProcessTree_T *parent_pt       = &pt[pt[index].parent];
-                        parent_pt->children.total     += pt[index].children.total;
-                        parent_pt->memory.usage_total += pt[index].memory.usage_total;
-                        parent_pt->cpu.usage_total    += pt[index].cpu.usage_total;
+ * @param size process tree size
+ */
+static void _linkProcessTree(ProcessTree_T *pt, int size) {
+        int offset = 0;
+        for (int i = 0; i < size; i++) {
+                pt[i].children.offset = offset;
+                offset += pt[i].children.count;
+                pt[i].children.count = 0;
+        }
+        ptreechildren = ALLOC((offset ? offset : 1) * sizeof(int));
+        for (int i = 0; i < size; i++) {
+                int parent = pt[i].parent;
+                if (parent != i)
+                        ptreechildren[pt[parent].children.offset + pt[parent].children.count++] = i;
+        }
+}
+
+
+/**
+ * Fill data in the process tree: the processes are ordered breadth-first from
+ * the root, then the totals are accumulated in reverse order, so each process
+ * is complete before it is added to its parent
+ * @param pt process tree
+ * @param size process tree size
+ * @param root root process index
+ */
+static void _fillProcessTree(ProcessTree_T *pt, int size, int root) {
+        int *order = ALLOC(size * sizeof(int));
+        int count = 0;
+        order[count++] = root;
+        pt[root].visited = true;
+        for (int i = 0; i < count; i++) {
+                ProcessTree_T *p = &pt[order[i]];
+                p->children.total     = p->children.count;
+                p->memory.usage_total = p->memory.usage;
+                p->cpu.usage_total    = p->cpu.usage + p->cpu.exited;
+                for (int j = p->children.offset; j < p->children.offset + p->children.count; j++) {
+                        int child = ptreechildren[j];
+                        if (! pt[child].visited) {
+                                pt[child].visited = true;
+                                order[count++] = child;
+                        }
                 }
         }
+        for (int i = count - 1; i > 0; i--) {
+                ProcessTree_T *p      = &pt[order[i]];
+                ProcessTree_T *parent = &pt[p->parent];
+                parent->children.total     += p->children.total;
+                parent->memory.usage_total += p->memory.usage_total;
+                parent->cpu.usage_total    += p->cpu.usage_total;
+        }
+        FREE(order);
+}
+
+
+/**
+ * Get the upper bound of the process CPU usage: one core is 100% if the usage is
+ * measured per core, otherwise the whole machine is 100%
+ */
+static inline float _cpuUsageMax(void) {
+        return (Run.flags & Run_ProcessCpuCore) && systeminfo.cpus > 0 ? 100. * systeminfo.cpus : 100.;
 }
 
 
 /**
- * Adjust the CPU usage based on the available system resources: number of CPU cores the application may utilize. Single threaded application may utilized only one CPU core, 4 threaded application 4 cores, etc.. If the application
- * has more threads then the machine has cores, it is limited by number of cores, not threads.
+ * Compute the process CPU usage from the CPU time consumed between the previous
+ * and the current sample of the process. Each sample has its own monotonic clock
+ * timestamp, so the usage is not affected by the poll cycle jitter or by the wall
+ * clock steps. The usage is either the percent of one CPU core or of the whole
+ * machine (all cores), see "set process cpu usage per core".
  * @param now Current process informations
  * @param prev Process informations from previous cycle
- * @param delta The delta of system time between current and previous cycle
  * @return Process' CPU usage [%] since last cycle
  */
-static float _cpuUsage(ProcessTree_T *now, ProcessTree_T *prev, double delta) {
-        if (systeminfo.cpus > 0 && delta > 0 && prev->cpu.time > 0 && now->cpu.time > prev->cpu.time) {
-                int divisor;
-                if (now->threads > 1) {
-                        if (now->threads >= systeminfo.cpus) {
-                                // Multithreaded application with more threads then CPU cores
-                                divisor = systeminfo.cpus;
-                        } else {
-                                // Multithreaded application with less threads then CPU cores
-                                divisor = now->threads;
-                        }
-                } else {
-                        // Single threaded application
-                        divisor = 1;
-                }
-                float usage = (100. * (now->cpu.time - prev->cpu.time) / delta) / divisor;
-                return usage > 100. ? 100. : usage;
+static float _cpuUsage(ProcessTree_T *now, ProcessTree_T *prev) {
+        long long interval = now->cpu.sampled - prev->cpu.sampled;
+        if (systeminfo.cpus > 0 && interval > 0 && prev->cpu.time > 0 && now->cpu.time > prev->cpu.time) {
+                // The CPU time is in 1/10 s, the sampling interval in ms
+                float usage = 100. * (now->cpu.time - prev->cpu.time) * 100. / interval;
+                if (! (Run.flags & Run_ProcessCpuCore))
+                        usage /= systeminfo.cpus;
+                float max = _cpuUsageMax();
+                return usage > max ? max : usage;
         }
         return 0.;
 }
 
 
+/**
+ * Credit the CPU time of the processes which exited since the last scan to
+ * their nearest living ancestor, found by following the parents of the exited
+ * processes. The time which the previous scan accounted already is subtracted.
+ * @param pt The new process tree
+ * @param oldptree The process tree from the previous cycle or NULL
+ * @param oldpindex The index of the old process tree
+ */
+static void _accountExited(ProcessTree_T *pt, ProcessTree_T *oldptree, ProcessIndex_T *oldpindex) {
+        ExitAccount_T *accounts = NULL;
+        int size = ExitAccounting_take(&accounts);
+        long long now = Time_monotonic();
+        long long interval = now - exitAccounted;
+        boolean_t valid = exitAccounted && interval > 0 && systeminfo.cpus > 0;
+        exitAccounted = now;
+        if (! accounts)
+                return;
+        int exited = 0, credited = 0;
+        for (int i = 0; i < size; i++) {
+                ExitAccount_T *a = &accounts[i];
+                // The exited threads of a living process are accounted in the process CPU time already
+                if (! a->tgid || _findProcess(a->tgid, pt, &pindex) != -1)
+                        continue;
+                exited++;
+                if (! valid)
+                        continue;
+                int entry = -1;
+                pid_t ppid = a->ppid;
+                for (int depth = 0; depth < 32 && ppid > 0 && (entry = _findProcess(ppid, pt, &pindex)) == -1; depth++) {
+                        ExitAccount_T *parent = ExitAccounting_find(accounts, size, ppid);
+                        ppid = parent ? parent->ppid : 0;
+                }
+                if (entry == -1)
+                        continue;
+                // The CPU time is in us, the old tree CPU time in 1/10 s
+                double cpu = a->cpu;
+                int oldentry = oldptree ? _findProcess(a->tgid, oldptree, oldpindex) : -1;
+                if (oldentry != -1)
+                        cpu -= oldptree[oldentry].cpu.time * 100000.;
+                if (cpu > 0) {
+                        float usage = cpu / 10. / interval;
+                        if (! (Run.flags & Run_ProcessCpuCore))
+                                usage /= systeminfo.cpus;
+                        pt[entry].cpu.exited += usage;
+                        credited++;
+                }
+        }
+        FREE(accounts);
+        DEBUG("Exit accounting -- %d processes exited since the last scan, %d credited to the living ancestors\n", exited, credited);
+}
+
+
+/**
+ * Test the process against the pattern: select the oldest matching process whose parent doesn't match the pattern
+ * @return The process entry if it is preferred to the found one, otherwise found
+ */
+static int _matchProcess(regex_t *regex, int i, int found) {
+        if (ptree[i].cmdline && regexec(regex, ptree[i].cmdline, 0, NULL, 0) == 0 && (i == ptree[i].parent || ! ptree[ptree[i].parent].cmdline || regexec(regex, ptree[ptree[i].parent].cmdline, 0, NULL, 0) != 0) && (found == -1 || ptree[found].uptime < ptree[i].uptime))
+                return i;
+        return found;
+}
+
+
 static int _match(regex_t *regex) {
         int found = -1;
-        // Scan the whole process tree and find the oldest matching process whose parent doesn't match the pattern
+        // Scan the whole process tree
         for (int i = 0; i < ptreesize; i++)
-                if (ptree[i].cmdline && regexec(regex, ptree[i].cmdline, 0, NULL, 0) == 0 && (i == ptree[i].parent || ! ptree[ptree[i].parent].cmdline || regexec(regex, ptree[ptree[i].parent].cmdline, 0, NULL, 0) != 0) && (found == -1 || ptree[found].uptime < ptree[i].uptime))
-                        found = i;
+                found = _matchProcess(regex, i, found);
         return found >= 0 ? ptree[found].pid : -1;
 }
 
 
-/* ------------------------------------------------------------------ Public */
+static void _containerFree() {
+        FREE(containers.members);
+        FREE(containers.containers);
+        containers.count = 0;
+        containers.valid = false;
+}
 
 
 /**
- * Initialize the process tree
- * @return treesize >= 0 if succeeded otherwise < 0
+ * The container key of the process: the PID namespace and for the processes in the Monit PID namespace also the cgroup
  */
-int ProcessTree_init(ProcessEngine_Flags pflags) {
+static int _compareContainerKey(int x, int y) {
+        if (ptree[x].container.namespace != ptree[y].container.namespace)
+                return ptree[x].container.namespace < ptree[y].container.namespace ? -1 : 1;
+        if (ptree[x].container.namespace != containers.host)
+                return 0;
+        return strcmp(ptree[x].container.cgroup ? ptree[x].container.cgroup : "", ptree[y].container.cgroup ? ptree[y].container.cgroup : "");
+}
+
+
+static int _compareContainer(const void *a, const void *b) {
+        int x = *(const int *)a, y = *(const int *)b;
+        int c = _compareContainerKey(x, y);
+        return c ? c : x - y;
+}
+
+
+static void _containerBuild() {
+        _containerFree();
+        int self = _findProcess(getpid(), ptree, &pindex);
+        containers.host = self >= 0 ? ptree[self].container.namespace : 0;
+        int count = 0;
+        containers.members = ALLOC(ptreesize * sizeof(int));
+        for (int i = 0; i < ptreesize; i++)
+                if (ptree[i].cmdline)
+                        containers.members[count++] = i;
+        qsort(containers.members, count, sizeof(int), _compareContainer);
+        for (int i = 0; i < count; i++)
+                if (i == 0 || _compareContainerKey(containers.members[i - 1], containers.members[i]))
+                        containers.count++;
+        containers.containers = CALLOC(containers.count ? containers.count : 1, sizeof(ProcessContainer_T));
+        for (int i = 0, c = -1; i < count; i++) {
+                int entry = containers.members[i];
+                if (i == 0 || _compareContainerKey(containers.members[i - 1], entry)) {
+                        containers.containers[++c].namespace = ptree[entry].container.namespace;
+                        containers.containers[c].first = i;
+                }
+                ProcessContainer_T *container = &containers.containers[c];
+                if (! container->count++ || ptree[containers.members[container->first]].uptime < ptree[entry].uptime) {
+                        // Keep the oldest process first, its cgroup names the container
+                        containers.members[i] = containers.members[container->first];
+                        containers.members[container->first] = entry;
+                        container->cgroup = ptree[entry].container.cgroup;
+                }
+        }
+        containers.valid = true;
+}
+
+
+/**
+ * Test if the container is selected by the name: the name is either the cgroup path (or its parent) if it starts
+ * with '/', otherwise a part of the cgroup path, such as the container ID or its prefix
+ */
+static boolean_t _isContainer(ProcessContainer_T *container, const char *name) {
+        if (! container->cgroup)
+                return false;
+        if (*name == '/') {
+                size_t length = strlen(name);
+                return strncmp(container->cgroup, name, length) == 0 && (container->cgroup[length] == 0 || container->cgroup[length] == '/' || name[length - 1] == '/');
+        }
+        return strstr(container->cgroup, name) != NULL;
+}
+
+
+/**
+ * Select the process matching the pattern in the named containers
+ */
+static int _matchContainer(regex_t *regex, const char *name) {
+        if (! containers.valid)
+                _containerBuild();
+        int found = -1;
+        for (int i = 0; i < containers.count; i++) {
+                ProcessContainer_T *container = &containers.containers[i];
+                if (_isContainer(container, name))
+                        for (int j = container->first; j < container->first + container->count; j++)
+                                found = _matchProcess(regex, containers.members[j], found);
+        }
+        return found >= 0 ? ptree[found].pid : -1;
+}
+
+
+static int _compareService(const void *a, const void *b) {
+        uintptr_t x = (uintptr_t)((const ProcessPattern_T *)a)->service;
+        uintptr_t y = (uintptr_t)((const ProcessPattern_T *)b)->service;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+static inline int _bigram(const char *s) {
+        return (unsigned char)s[0] << 8 | (unsigned char)s[1];
+}
+
+
+static void _matcherFree() {
+        FREE(matcher.patterns);
+        FREE(matcher.buckets);
+        matcher.count = 0;
+        matcher.valid = false;
+}
+
+
+static void _matcherBuild() {
+        _matcherFree();
+        memset(matcher.bigrams, 0, sizeof(matcher.bigrams));
+        matcher.generic = -1;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Process && s->matchlist && ! s->matchlist->container)
+                        matcher.count++;
+        if (matcher.count) {
+                matcher.patterns = CALLOC(matcher.count, sizeof(ProcessPattern_T));
+                int i = 0;
+                for (Service_T s = servicelist; s; s = s->next) {
+                        if (s->type == Service_Process && s->matchlist && ! s->matchlist->container) {
+                                matcher.patterns[i].service = s;
+                                matcher.patterns[i].regex = s->matchlist->regex_comp;
+                                matcher.patterns[i].length = Util_getRegexLiteral(s->matchlist->match_string, matcher.patterns[i].literal, PATTERN_LITERAL);
+                                i++;
+                        }
+                }
+                qsort(matcher.patterns, matcher.count, sizeof(ProcessPattern_T), _compareService);
+                int size = 1;
+                while (size < matcher.count * 2)
+                        size <<= 1;
+                matcher.mask = size - 1;
+                matcher.buckets = ALLOC(size * sizeof(int));
+                memset(matcher.buckets, -1, size * sizeof(int));
+                for (i = 0; i < matcher.count; i++) {
+                        ProcessPattern_T *p = &matcher.patterns[i];
+                        if (p->length >= 2) {
+                                int bigram = _bigram(p->literal);
+                                int bucket = _hash(bigram) & matcher.mask;
+                                matcher.bigrams[bigram >> 3] |= 1 << (bigram & 7);
+                                p->next = matcher.buckets[bucket];
+                                matcher.buckets[bucket] = i;
+                        } else {
+                                p->next = matcher.generic;
+                                matcher.generic = i;
+                        }
+                }
+        }
+}
+
+
+static boolean_t _matchPattern(ProcessPattern_T *p, const char *cmdline) {
+        return cmdline && (p->length == 0 || strstr(cmdline, p->literal)) && regexec(p->regex, cmdline, 0, NULL, 0) == 0;
+}
+
+
+/**
+ * Test the candidate pattern against the process: select the oldest matching process whose parent doesn't match the pattern
+ */
+static void _matchCandidate(ProcessPattern_T *p, int i) {
+        if (p->seen != i) {
+                p->seen = i;
+                if (regexec(p->regex, ptree[i].cmdline, 0, NULL, 0) == 0 && (i == ptree[i].parent || ! _matchPattern(p, ptree[ptree[i].parent].cmdline)) && (p->found == -1 || ptree[p->found].uptime < ptree[i].uptime))
+                        p->found = i;
+        }
+}
+
+
+/**
+ * Assign the processes to all matching services in one pass over the process tree
+ */
+static void _matchAll() {
+        _matcherBuild();
+        for (int i = 0; i < matcher.count; i++) {
+                matcher.patterns[i].seen = -1;
+                matcher.patterns[i].found = -1;
+        }
+        for (int i = 0; i < ptreesize; i++) {
+                const char *cmdline = ptree[i].cmdline;
+                if (cmdline && *cmdline) {
+                        for (int j = matcher.generic; j != -1; j = matcher.patterns[j].next)
+                                _matchCandidate(&matcher.patterns[j], i);
+                        for (const char *c = cmdline; *c && *(c + 1); c++) {
+                                int bigram = _bigram(c);
+                                if (matcher.bigrams[bigram >> 3] & (1 << (bigram & 7))) {
+                                        for (int j = matcher.buckets[_hash(bigram) & matcher.mask]; j != -1; j = matcher.patterns[j].next) {
+                                                ProcessPattern_T *p = &matcher.patterns[j];
+                                                if (p->seen != i && _bigram(p->literal) == bigram && strncmp(c, p->literal, p->length) == 0)
+                                                        _matchCandidate(p, i);
+                                        }
+                                }
+                        }
+                }
+        }
+        matcher.valid = true;
+}
+
+
+static int _matchService(Service_T s) {
+        if (s->matchlist->container)
+                return _matchContainer(s->matchlist->regex_comp, s->matchlist->container);
+        if (! matcher.valid)
+                _matchAll();
+        ProcessPattern_T key = {.service = s};
+        ProcessPattern_T *p = bsearch(&key, matcher.patterns, matcher.count, sizeof(ProcessPattern_T), _compareService);
+        if (p)
+                return p->found >= 0 ? ptree[p->found].pid : -1;
+        // The service is not in the matcher (such as service created after the assignment), match it separately
+        return _match(s->matchlist->regex_comp);
+}
+
+
+static double _rate(long long current, long long previous, double seconds) {
+        return current >= 0 && previous >= 0 && current >= previous ? (double)(current - previous) / seconds : -1.;
+}
+
+
+/**
+ * Update the extended statistics of the monitored process. They are collected lazily
+ * only for the processes of monitored services and the rates are computed from the
+ * counters sampled in the previous cycle
+ */
+static void _updateProcessDetail(Service_T s, ProcessTree_T *pt) {
+        if (! pt->detail.collected) {
+                pt->detail.collected = true;
+                pt->detail.filedescriptors = -1;
+                pt->detail.read_bytes = pt->detail.write_bytes = pt->detail.voluntary = pt->detail.nonvoluntary = -1LL;
+                getprocessdetail_sysdep(pt);
+        }
+        long long now = Time_milli();
+        s->inf->priv.process.filedescriptors = pt->detail.filedescriptors;
+        if (s->inf->priv.process.sample.pid == pt->pid && now > s->inf->priv.process.sample.time) {
+                double seconds = (double)(now - s->inf->priv.process.sample.time) / 1000.;
+                s->inf->priv.process.read_rate         = _rate(pt->detail.read_bytes, s->inf->priv.process.sample.read_bytes, seconds);
+                s->inf->priv.process.write_rate        = _rate(pt->detail.write_bytes, s->inf->priv.process.sample.write_bytes, seconds);
+                s->inf->priv.process.voluntary_rate    = _rate(pt->detail.voluntary, s->inf->priv.process.sample.voluntary, seconds);
+                s->inf->priv.process.nonvoluntary_rate = _rate(pt->detail.nonvoluntary, s->inf->priv.process.sample.nonvoluntary, seconds);
+        } else if (s->inf->priv.process.sample.pid != pt->pid) {
+                s->inf->priv.process.read_rate = s->inf->priv.process.write_rate = s->inf->priv.process.voluntary_rate = s->inf->priv.process.nonvoluntary_rate = -1.;
+        } else {
+                return; // Sampled again in the same millisecond, keep the previous sample
+        }
+        s->inf->priv.process.sample.pid          = pt->pid;
+        s->inf->priv.process.sample.time         = now;
+        s->inf->priv.process.sample.read_bytes   = pt->detail.read_bytes;
+        s->inf->priv.process.sample.write_bytes  = pt->detail.write_bytes;
+        s->inf->priv.process.sample.voluntary    = pt->detail.voluntary;
+        s->inf->priv.process.sample.nonvoluntary = pt->detail.nonvoluntary;
+}
+
+
+static boolean_t _hasCgroupResource(Service_T s) {
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (r->resource_id >= Resource_CgroupMemory && r->resource_id <= Resource_CgroupWriteBytes)
+                        return true;
+        return false;
+}
+
+
+/**
+ * Update the statistics of the cgroup which the monitored process belongs to. They
+ * are collected only if the service has some cgroup resource test
+ */
+static void _updateProcessCgroup(Service_T s, ProcessTree_T *pt) {
+        if (! _hasCgroupResource(s))
+                return;
+        if (! pt->cgroup.collected) {
+                pt->cgroup.collected = true;
+                pt->cgroup.memory = pt->cgroup.cpu_usec = pt->cgroup.read_bytes = pt->cgroup.write_bytes = -1LL;
+                Util_resetPressure(pt->cgroup.pressure);
+                getprocesscgroup_sysdep(pt);
+        }
+        long long now = Time_milli();
+        s->inf->priv.process.cgroup.memory = pt->cgroup.memory;
+        memcpy(s->inf->priv.process.cgroup.pressure, pt->cgroup.pressure, sizeof(pt->cgroup.pressure));
+        if (s->inf->priv.process.cgroup.sample.pid == pt->pid && now > s->inf->priv.process.cgroup.sample.time) {
+                double seconds = (double)(now - s->inf->priv.process.cgroup.sample.time) / 1000.;
+                double usec = _rate(pt->cgroup.cpu_usec, s->inf->priv.process.cgroup.sample.cpu_usec, seconds);
+                s->inf->priv.process.cgroup.cpu_percent = usec >= 0 && systeminfo.cpus > 0 ? usec / 10000. / systeminfo.cpus : -1.;
+                s->inf->priv.process.cgroup.read_rate   = _rate(pt->cgroup.read_bytes, s->inf->priv.process.cgroup.sample.read_bytes, seconds);
+                s->inf->priv.process.cgroup.write_rate  = _rate(pt->cgroup.write_bytes, s->inf->priv.process.cgroup.sample.write_bytes, seconds);
+        } else if (s->inf->priv.process.cgroup.sample.pid != pt->pid) {
+                s->inf->priv.process.cgroup.cpu_percent = -1.;
+                s->inf->priv.process.cgroup.read_rate = s->inf->priv.process.cgroup.write_rate = -1.;
+        } else {
+                return; // Sampled again in the same millisecond, keep the previous sample
+        }
+        s->inf->priv.process.cgroup.sample.pid         = pt->pid;
+        s->inf->priv.process.cgroup.sample.time        = now;
+        s->inf->priv.process.cgroup.sample.cpu_usec    = pt->cgroup.cpu_usec;
+        s->inf->priv.process.cgroup.sample.read_bytes  = pt->cgroup.read_bytes;
+        s->inf->priv.process.cgroup.sample.write_bytes = pt->cgroup.write_bytes;
+}
+
+
+static boolean_t _hasGpuResource(Service_T s) {
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (r->resource_id == Resource_GpuMemory)
+                        return true;
+        return false;
+}
+
+
+/**
+ * Sum the GPU memory of the process and its descendants, walked breadth first
+ * (bounded by the tree size, like _fillProcessTree())
+ */
+static long long _gpuMemory(int leaf) {
+        long long memory = Gpu_processMemory(ptree[leaf].pid);
+        if (memory < 0)
+                return memory;
+        int *queue = ALLOC(ptreesize * sizeof(int));
+        int count = 0;
+        queue[count++] = leaf;
+        for (int i = 0; i < count; i++) {
+                ProcessTree_T *p = &ptree[queue[i]];
+                for (int j = p->children.offset; j < p->children.offset + p->children.count && count < ptreesize; j++) {
+                        int child = ptreechildren[j];
+                        memory += Gpu_processMemory(ptree[child].pid);
+                        queue[count++] = child;
+                }
+        }
+        FREE(queue);
+        return memory;
+}
+
+
+/**
+ * Update the GPU memory used by the monitored process and its descendants. It is
+ * looked up only if the service has some GPU resource test
+ */
+static void _updateProcessGpu(Service_T s, int leaf) {
+        if (_hasGpuResource(s))
+                s->inf->priv.process.gpu_memory = _gpuMemory(leaf);
+}
+
+
+static boolean_t _hasThreadResource(Service_T s) {
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (r->resource_id == Resource_ThreadCpu)
+                        return true;
+        return false;
+}
+
+
+static int _threadCompare(const void *a, const void *b) {
+        pid_t x = ((const ProcessThread_T *)a)->tid, y = ((const ProcessThread_T *)b)->tid;
+        return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Update the CPU usage of the busiest thread of the monitored process. The threads
+ * are collected only if the service has some thread resource test, so the cost
+ * doesn't depend on the number of threads on the host. The usage of each thread is
+ * computed from its CPU time in the previous cycle (the threads are kept sorted by
+ * TID), it is the percent of one CPU core.
+ */
+static void _updateProcessThreads(Service_T s, ProcessTree_T *pt) {
+        if (! _hasThreadResource(s))
+                return;
+        ProcessThread_T *threads = NULL;
+        int size = 0;
+        int count = getprocessthreads_sysdep(pt->pid, &threads, &size);
+        if (count < 0) {
+                FREE(threads);
+                s->inf->priv.process.thread.cpu_percent = -1.;
+                s->inf->priv.process.thread.pid = -1;
+                return;
+        }
+        long long now = Time_milli();
+        if (s->inf->priv.process.thread.pid == pt->pid && now <= s->inf->priv.process.thread.time) {
+                FREE(threads);
+                return; // Sampled again in the same millisecond, keep the previous sample
+        }
+        qsort(threads, count, sizeof(ProcessThread_T), _threadCompare);
+        s->inf->priv.process.thread.cpu_percent = -1.;
+        if (s->inf->priv.process.thread.pid == pt->pid) {
+                double seconds = (double)(now - s->inf->priv.process.thread.time) / 1000.;
+                for (int i = 0; i < count; i++) {
+                        ProcessThread_T *old = bsearch(&threads[i], s->inf->priv.process.thread.sample, s->inf->priv.process.thread.count, sizeof(ProcessThread_T), _threadCompare);
+                        if (! old || threads[i].time < old->time)
+                                continue; // New thread
+                        float usage = 100. * (threads[i].time - old->time) / seconds;
+                        if (usage > s->inf->priv.process.thread.cpu_percent) {
+                                s->inf->priv.process.thread.cpu_percent = usage > 100. ? 100. : usage;
+                                s->inf->priv.process.thread.tid = threads[i].tid;
+                                snprintf(s->inf->priv.process.thread.name, sizeof(s->inf->priv.process.thread.name), "%s", threads[i].name);
+                        }
+                }
+        }
+        FREE(s->inf->priv.process.thread.sample);
+        s->inf->priv.process.thread.sample = threads;
+        s->inf->priv.process.thread.count  = count;
+        s->inf->priv.process.thread.pid    = pt->pid;
+        s->inf->priv.process.thread.time   = now;
+}
+
+
+/**
+ * Generate the process table of the tree build benchmark. PID 1 has the parent 0 which is not listed, as on Linux, the
+ * other processes have a parent among the processes before them, so the tree has a realistic fan-out. The PIDs are
+ * sparse and 1% of the processes get a new PID in each cycle, so the lookups in the old tree both hit and miss. The
+ * table is the same on each run.
+ * @param reference The new process table
+ * @param count The number of processes
+ * @return The number of processes
+ */
+static int _synthesize(ProcessTree_T **reference, int count) {
+        ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), count);
+        unsigned int seed = 1;
+        syntheticcycle++;
+        for (int i = 0; i < count; i++) {
+                // The process i gets a new PID in the cycles where (cycle + i) % 100 == 0, the PIDs stay unique
+                pt[i].pid = i ? 1 + 4 * i + 4 * count * ((syntheticcycle + i) / 100) : 1;
+                seed = seed * 1103515245 + 12345;
+                pt[i].ppid = i ? pt[(seed >> 16) % i].pid : 0;
+                pt[i].threads = 1 + i % 4;
+                pt[i].uptime = 86400 - i % 86400;
+                pt[i].memory.usage = 4096ULL * (1 + i % 1000);
+                pt[i].cpu.time = syntheticcycle * (1 + i % 5);
+                pt[i].cpu.sampled = syntheticcycle * 1000LL;
+        }
+        *reference = pt;
+        return count;
+}
+
+
+/**
+ * Collect the process tree. If upgrade is true and the tree exists already, the
+ * new tree belongs to the same generation (monitoring cycle) as the old one: it
+ * is rescanned just to collect the additional data requested by pflags and the
+ * CPU usage is inherited from the old tree, as the time elapsed since the last
+ * scan is too short for the CPU usage to be meaningful.
+ */
+static int _initProcessTree(ProcessEngine_Flags pflags, boolean_t upgrade) {
         ProcessTree_T *oldptree = ptree;
         int oldptreesize = ptreesize;
+        ProcessIndex_T oldpindex = pindex; // The index built in the previous cycle is still valid for the old ptree
+        pindex = (ProcessIndex_T){};
         if (oldptree) {
                 ptree = NULL;
                 ptreesize = 0;
                 // We need only process' cpu.time from the old ptree, so free dynamically allocated parts which we don't need before initializing new ptree (so the memory can be reused, otherwise the memory footprint will hold two ptrees)
                 for (int i = 0; i < oldptreesize; i++) {
                         FREE(oldptree[i].cmdline);
-                        FREE(oldptree[i].children.list);
+                        FREE(oldptree[i].container.cgroup);
                 }
         }
+        FREE(ptreechildren);
 
-        systeminfo.time_prev = systeminfo.time;
-        systeminfo.time = Time_milli() / 100.;
-        if ((ptreesize = initprocesstree_sysdep(&ptree, pflags)) <= 0 || ! ptree) {
+        upgrade = upgrade && oldptree;
+        if (! upgrade) {
+                systeminfo.time = Time_milli() / 100.;
+        }
+        ptreeflags = ProcessEngine_None;
+        matcher.valid = false;
+        containers.valid = false;
+        if ((ptreesize = synthetic ? _synthesize(&ptree, synthetic) : initprocesstree_sysdep(&ptree, pflags)) <= 0 || ! ptree) {
                 DEBUG("System statistic -- cannot initialize the process tree -- process resource monitoring disabled\n");
                 Run.flags &= ~Run_ProcessEngineEnabled;
                 if (oldptree)
                         _delete(&oldptree, &oldptreesize);
+                _indexFree(&oldpindex);
                 return -1;
         } else if (! (Run.flags & Run_ProcessEngineEnabled)) {
                 DEBUG("System statistic -- initialization of the process tree succeeded -- process resource monitoring enabled\n");
                 Run.flags |= Run_ProcessEngineEnabled;
         }
 
+        _indexBuild(&pindex, ptree, ptreesize);
+
         int root = -1; // Main process. Not all systems have main process with PID 1 (such as Solaris zones and FreeBSD jails), so we try to find process which is parent of itself
         ProcessTree_T *pt = ptree;
-        double time_delta = systeminfo.time - systeminfo.time_prev;
+        long long sampled = Time_monotonic(); // For the platforms which don't timestamp each process
         for (int i = 0; i < (volatile int)ptreesize; i ++) {
+                if (! pt[i].cpu.sampled)
+                        pt[i].cpu.sampled = sampled;
                 if (oldptree) {
-                        int oldentry = _findProcess(pt[i].pid, oldptree, oldptreesize);
-                        if (oldentry != -1)
-                                pt[i].cpu.usage = _cpuUsage(&pt[i], &oldptree[oldentry], time_delta);
+                        int oldentry = _findProcess(pt[i].pid, oldptree, &oldpindex);
+                        if (oldentry != -1) {
+                                if (upgrade) {
+                                        pt[i].cpu.time = oldptree[oldentry].cpu.time;
+                                        pt[i].cpu.sampled = oldptree[oldentry].cpu.sampled;
+                                        pt[i].cpu.usage = oldptree[oldentry].cpu.usage;
+                                        pt[i].cpu.exited = oldptree[oldentry].cpu.exited;
+                                } else {
+                                        pt[i].cpu.usage = _cpuUsage(&pt[i], &oldptree[oldentry]);
+                                }
+                        }
                 }
                 // Note: on DragonFly, main process is swapper with pid 0 and ppid -1, so take also this case into consideration
                 if ((pt[i].pid == pt[i].ppid) || (pt[i].ppid == -1)) {
                         root = pt[i].parent = i;
                 } else {
                         // Find this process' parent
-                        int parent = _findProcess(pt[i].ppid, pt, ptreesize);
+                        int parent = _findProcess(pt[i].ppid, pt, &pindex);
                         if (parent == -1) {
                                 /* Parent process wasn't found - on Linux this is normal: main process with PID 0 is not listed, similarly in FreeBSD jail.
                                  * We create virtual process entry for missing parent so we can have full tree-like structure with root. */
@@ -238,32 +934,66 @@ int ProcessTree_init(ProcessEngine_Flags pflags) {
                                 pt = RESIZE(ptree, ptreesize * sizeof(ProcessTree_T));
                                 memset(&pt[parent], 0, sizeof(ProcessTree_T));
                                 root = pt[parent].ppid = pt[parent].pid = pt[i].ppid;
+                                _indexInsert(&pindex, pt, parent);
                         }
                         pt[i].parent = parent;
-                        // Connect the child (this process) to the parent
-                        RESIZE(pt[parent].children.list, sizeof(int) * (pt[parent].children.count + 1));
-                        pt[parent].children.list[pt[parent].children.count] = i;
+                        // Count the children, they are connected to the parent when the tree is complete
                         pt[parent].children.count++;
                 }
         }
+        if (! upgrade)
+                _accountExited(pt, oldptree, &oldpindex);
         FREE(oldptree); // Free the rest of old ptree
+        _indexFree(&oldpindex);
         if (root == -1) {
                 DEBUG("System statistic error -- cannot find root process id\n");
                 _delete(&ptree, &ptreesize);
+                _indexFree(&pindex);
                 return -1;
         }
 
-        _fillProcessTree(pt, root);
+        _linkProcessTree(pt, ptreesize);
+        _fillProcessTree(pt, ptreesize, root);
+        ptreeflags = pflags;
+
+        size_t memory = sizeof(matcher) + ptreesize * (sizeof(ProcessTree_T) + sizeof(int)) + (pindex.slots ? (pindex.mask + 1) * sizeof(int) : 0) + matcher.count * sizeof(ProcessPattern_T) + (matcher.buckets ? (matcher.mask + 1) * sizeof(int) : 0);
+        for (int i = 0; i < ptreesize; i++) {
+                if (pt[i].cmdline)
+                        memory += strlen(pt[i].cmdline) + 1;
+                if (pt[i].container.cgroup)
+                        memory += strlen(pt[i].container.cgroup) + 1;
+        }
+        __atomic_store_n(&ptreememory, memory, __ATOMIC_RELAXED);
 
         return ptreesize;
 }
 
 
+/* ------------------------------------------------------------------ Public */
+
+
+/**
+ * Initialize the process tree
+ * @return treesize >= 0 if succeeded otherwise < 0
+ */
+int ProcessTree_init(ProcessEngine_Flags pflags) {
+        PROBE0(processtree_start);
+        int count = _initProcessTree(pflags, false);
+        PROBE1(processtree_done, count);
+        return count;
+}
+
+
 /**
  * Delete the process tree
  */
 void ProcessTree_delete() {
         _delete(&ptree, &ptreesize);
+        FREE(ptreechildren);
+        _indexFree(&pindex);
+        _matcherFree();
+        _containerFree();
+        ptreeflags = ProcessEngine_None;
 }
 
 
@@ -274,7 +1004,7 @@ boolean_t ProcessTree_updateProcess(Service_T s, pid_t pid) {
         s->inf->priv.process._pid = s->inf->priv.process.pid;
         s->inf->priv.process.pid  = pid;
 
-        int leaf = _findProcess(pid, ptree, ptreesize);
+        int leaf = _findProcess(pid, ptree, &pindex);
         if (leaf != -1) {
                 /* save the previous ppid and set actual one */
                 s->inf->priv.process._ppid             = s->inf->priv.process.ppid;
@@ -287,13 +1017,17 @@ boolean_t ProcessTree_updateProcess(Service_T s, pid_t pid) {
                 s->inf->priv.process.children          = ptree[leaf].children.total;
                 s->inf->priv.process.zombie            = ptree[leaf].zombie;
                 s->inf->priv.process.cpu_percent       = ptree[leaf].cpu.usage;
-                s->inf->priv.process.total_cpu_percent = ptree[leaf].cpu.usage_total > 100. ? 100. : ptree[leaf].cpu.usage_total;
+                s->inf->priv.process.total_cpu_percent = ptree[leaf].cpu.usage_total > _cpuUsageMax() ? _cpuUsageMax() : ptree[leaf].cpu.usage_total;
                 s->inf->priv.process.mem               = ptree[leaf].memory.usage;
                 s->inf->priv.process.total_mem         = ptree[leaf].memory.usage_total;
                 if (systeminfo.mem_max > 0) {
                         s->inf->priv.process.total_mem_percent = ptree[leaf].memory.usage_total >= systeminfo.mem_max ? 100. : (100. * (double)ptree[leaf].memory.usage_total / (double)systeminfo.mem_max);
                         s->inf->priv.process.mem_percent       = ptree[leaf].memory.usage >= systeminfo.mem_max ? 100. : (100. * (double)ptree[leaf].memory.usage / (double)systeminfo.mem_max);
                 }
+                _updateProcessDetail(s, &ptree[leaf]);
+                _updateProcessCgroup(s, &ptree[leaf]);
+                _updateProcessThreads(s, &ptree[leaf]);
+                _updateProcessGpu(s, leaf);
                 return true;
         }
         Util_resetInfo(s);
@@ -303,27 +1037,43 @@ boolean_t ProcessTree_updateProcess(Service_T s, pid_t pid) {
 
 time_t ProcessTree_getProcessUptime(pid_t pid) {
         if (ptree) {
-                int leaf = _findProcess(pid, ptree, ptreesize);
+                int leaf = _findProcess(pid, ptree, &pindex);
                 return (time_t)((leaf >= 0 && leaf < ptreesize) ? ptree[leaf].uptime : -1);
         }
         return 0;
 }
 
 
+uint64_t ProcessTree_getProcessMemory(pid_t pid) {
+        if (ptree) {
+                int leaf = _findProcess(pid, ptree, &pindex);
+                return (leaf >= 0 && leaf < ptreesize) ? ptree[leaf].memory.usage : 0;
+        }
+        return 0;
+}
+
+
+size_t ProcessTree_memory(void) {
+        return __atomic_load_n(&ptreememory, __ATOMIC_RELAXED);
+}
+
+
 pid_t ProcessTree_findProcess(Service_T s) {
         ASSERT(s);
-        // Test the cached PID first
-        if (s->inf->priv.process.pid > 0) {
+        // Test the cached PID first (unless we know it exited already from the process events)
+        if (s->inf->priv.process.pid > 0 && ! ProcessEvents_isExited(s->inf->priv.process.pid)) {
                 errno = 0;
                 if (getpgid(s->inf->priv.process.pid) > -1 || errno == EPERM)
                         return s->inf->priv.process.pid;
         }
         // If the cached PID is not running, scan for the process again
         if (s->matchlist) {
-                // Update the process tree including command line
-                ProcessTree_init(ProcessEngine_CollectCommandLine);
+                // Collect the command lines (and the containers) lazily, once per tree generation: the first matching service which needs them upgrades the current tree, the others reuse it
+                ProcessEngine_Flags pflags = ProcessEngine_CollectCommandLine | (s->matchlist->container ? ProcessEngine_CollectContainer : ProcessEngine_None);
+                if ((ptreeflags & pflags) != pflags)
+                        _initProcessTree(ptreeflags | pflags, true);
                 if (Run.flags & Run_ProcessEngineEnabled) {
-                        int pid = _match(s->matchlist->regex_comp);
+                        int pid = _matchService(s);
                         if (pid >= 0)
                                 return pid;
                 } else {
@@ -332,7 +1082,7 @@ pid_t ProcessTree_findProcess(Service_T s) {
                         return ! (s->error & Event_Nonexist);
                 }
         } else {
-                pid_t pid = Util_getPid(s->path);
+                pid_t pid = Util_getServicePid(s);
                 if (pid > 0) {
                         errno = 0;
                         if (getpgid(pid) > -1 || errno == EPERM)
@@ -400,6 +1150,125 @@ void ProcessTree_testMatch(char *pattern) {
 }
 
 
+
+/**
+ * @return The allocations made since Monit started, by all threads as the collector may run in several
+ */
+static long long _allocations(void) {
+        unsigned long long total[Counter_Last + 1];
+        Counter_read(total, NULL);
+        return (long long)total[Counter_Allocations];
+}
+
+
+/**
+ * Replay the snapshot with the given process engine flags. The first cycle starts with an empty tree and cache, the
+ * following cycles find the processes of the previous one as the daemon does
+ * @return true if succeeded otherwise false
+ */
+static boolean_t _replay(const char *directory, ProcessEngine_Flags pflags, const char *name, int cycles, StringBuffer_T result) {
+        ProcessTree_delete();
+        if (! replayprocesstree_sysdep(directory))
+                return false;
+        long long first = 0LL, firstAllocations = 0LL, total = 0LL, allocations = 0LL;
+        int count = 0;
+        for (int i = 0; i <= cycles; i++) {
+                long long allocated = _allocations();
+                long long start = Time_monotonicMicro();
+                if ((count = ProcessTree_init(pflags)) <= 0) {
+                        LogError("Cannot replay the process snapshot %s\n", directory);
+                        return false;
+                }
+                long long elapsed = Time_monotonicMicro() - start;
+                if (i == 0) {
+                        first = elapsed;
+                        firstAllocations = _allocations() - allocated;
+                } else {
+                        total += elapsed;
+                        allocations += _allocations() - allocated;
+                }
+        }
+        StringBuffer_append(result, "%s{\"flags\": \"%s\", \"processes\": %d, \"first_cycle_ns_per_process\": %.1f, \"first_cycle_allocations\": %lld, \"ns_per_process\": %.1f, \"allocations_per_cycle\": %.1f}",
+                            StringBuffer_length(result) ? ", " : "", name, count, first * 1000. / count, firstAllocations, total * 1000. / ((double)cycles * count), (double)allocations / cycles);
+        return true;
+}
+
+
+/**
+ * Record the raw process table inputs of one collector pass to the directory
+ * @param directory The snapshot directory
+ */
+void ProcessTree_record(char *directory) {
+        int count = recordprocesstree_sysdep(directory);
+        if (count < 0)
+                exit(1);
+        printf("Recorded %d processes to %s\n", count, directory);
+}
+
+
+/**
+ * Replay the snapshot through the process collector and the tree builder and print the cost per process and the
+ * allocations per cycle as one JSON object
+ * @param directory The snapshot directory
+ * @param cycles Number of measured cycles after the first one
+ */
+void ProcessTree_replay(char *directory, int cycles) {
+        StringBuffer_T result = StringBuffer_create(256);
+        boolean_t rv = _replay(directory, ProcessEngine_None, "none", cycles, result) && _replay(directory, ProcessEngine_CollectCommandLine | ProcessEngine_CollectContainer, "cmdline,container", cycles, result);
+        if (rv)
+                printf("{\"cycles\": %d, \"runs\": [%s]}\n", cycles, StringBuffer_toString(result));
+        StringBuffer_free(&result);
+        ProcessTree_delete();
+        if (! rv)
+                exit(1);
+}
+
+
+/**
+ * Build the process tree from the generated process tables of 1k, 10k and 100k processes in a loop and print the
+ * cost of the tree build and of the PID lookup per process and the allocations per cycle as one JSON object
+ * @param cycles Number of measured cycles after the first one
+ */
+void ProcessTree_benchmark(int cycles) {
+        StringBuffer_T result = StringBuffer_create(256);
+        int sizes[] = {1000, 10000, 100000};
+        for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+                ProcessTree_delete();
+                synthetic = sizes[s];
+                syntheticcycle = 0;
+                long long first = 0LL, total = 0LL, lookup = 0LL, allocations = 0LL;
+                int count = 0;
+                for (int i = 0; i <= cycles; i++) {
+                        long long allocated = _allocations();
+                        long long start = Time_monotonicMicro();
+                        if ((count = ProcessTree_init(ProcessEngine_None)) <= 0) {
+                                LogError("Cannot build the process tree of %d processes\n", synthetic);
+                                exit(1);
+                        }
+                        long long elapsed = Time_monotonicMicro() - start;
+                        if (i == 0) {
+                                first = elapsed;
+                        } else {
+                                total += elapsed;
+                                allocations += _allocations() - allocated;
+                                // Look up each process as the process checks do
+                                start = Time_monotonicMicro();
+                                for (int j = 0; j < ptreesize; j++)
+                                        if (ProcessTree_getProcessUptime(ptree[j].pid) < 0)
+                                                LogError("Process %d not found\n", ptree[j].pid);
+                                lookup += Time_monotonicMicro() - start;
+                        }
+                }
+                StringBuffer_append(result, "%s{\"processes\": %d, \"first_cycle_ns_per_process\": %.1f, \"ns_per_process\": %.1f, \"lookup_ns\": %.1f, \"allocations_per_cycle\": %.1f}",
+                                    s ? ", " : "", count, first * 1000. / count, total * 1000. / ((double)cycles * count), lookup * 1000. / ((double)cycles * count), (double)allocations / cycles);
+        }
+        printf("{\"cycles\": %d, \"runs\": [%s]}\n", cycles, StringBuffer_toString(result));
+        StringBuffer_free(&result);
+        ProcessTree_delete();
+        synthetic = 0;
+}
+
+
 //FIXME: move to standalone system class
 boolean_t init_system_info(void) {
         memset(&systeminfo, 0, sizeof(SystemInfo_T));
@@ -411,6 +1280,8 @@ boolean_t init_system_info(void) {
         systeminfo.total_cpu_user_percent = -1.;
         systeminfo.total_cpu_syst_percent = -1.;
         systeminfo.total_cpu_wait_percent = -1.;
+        systeminfo.total_cpu_steal_percent = -1.;
+        Util_resetPressure(systeminfo.pressure);
         return (init_process_info_sysdep());
 }
 
@@ -435,6 +1306,11 @@ boolean_t update_system_info() {
                         goto error3;
                 }
 
+                // The pressure stall information is optional (Linux 4.20 and later)
+                used_system_pressure_sysdep(&systeminfo);
+
+                Gpu_update();
+
                 return true;
         }
 
@@ -451,6 +1327,10 @@ error3:
         systeminfo.total_cpu_user_percent = 0.;
         systeminfo.total_cpu_syst_percent = 0.;
         systeminfo.total_cpu_wait_percent = 0.;
+        systeminfo.total_cpu_steal_percent = 0.;
+        for (int i = 0; i < systeminfo.cpu.count; i++)
+                systeminfo.cpu.usage[i] = systeminfo.cpu.steal[i] = -1.;
+        Util_resetPressure(systeminfo.pressure);
 
         return false;
 }
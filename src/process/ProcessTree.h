@@ -43,17 +43,39 @@ typedef struct ProcessTree_T {
         struct {
                 float usage;
                 float usage_total;
+                float exited;   /**< Usage of the exited descendants credited to the process */
                 double time;
+                long long sampled;            /**< Monotonic clock timestamp of the sample [ms] */
         } cpu;
         struct {
                 int count;
                 int total;
-                int *list;
+                int offset;
         } children;
         struct {
                 uint64_t usage;
                 uint64_t usage_total;
         } memory;
+        struct {
+                boolean_t collected;
+                int filedescriptors;
+                long long read_bytes;
+                long long write_bytes;
+                long long voluntary;
+                long long nonvoluntary;
+        } detail;
+        struct {
+                boolean_t collected;
+                Pressure_T pressure[Pressure_Last + 1];
+                long long memory;
+                long long cpu_usec;
+                long long read_bytes;
+                long long write_bytes;
+        } cgroup;
+        struct {
+                ino_t namespace;                        /**< PID namespace inode or 0 */
+                char *cgroup;                           /**< cgroup path or NULL */
+        } container;
         time_t uptime;
         char *cmdline;
 } ProcessTree_T;
@@ -90,6 +112,22 @@ boolean_t ProcessTree_updateProcess(Service_T s, pid_t pid);
 time_t ProcessTree_getProcessUptime(pid_t pid);
 
 
+/**
+ * Get process resident memory
+ * @param pid Process PID
+ * @return The memory usage of the process in bytes or 0 if the process is not in the process tree
+ */
+uint64_t ProcessTree_getProcessMemory(pid_t pid);
+
+
+/**
+ * Get the memory used by the process tree of the last cycle: the process
+ * entries, the command lines, the PID index and the process matcher
+ * @return The size in bytes
+ */
+size_t ProcessTree_memory(void);
+
+
 /**
  * Find the process in the process tree
  * @param s The service being checked
@@ -105,6 +143,33 @@ pid_t ProcessTree_findProcess(Service_T s);
 void ProcessTree_testMatch(char *pattern);
 
 
+/**
+ * Record the process table inputs of one collector pass (the /proc files
+ * on Linux, the kinfo_proc array on FreeBSD and macOS) to the directory
+ * @param directory The new snapshot directory
+ */
+void ProcessTree_record(char *directory);
+
+
+/**
+ * Replay a recorded snapshot through the process collector and the tree
+ * builder in a loop and print the time per process and the allocations
+ * per cycle. The process tree is read from the snapshot from now on.
+ * @param directory The snapshot directory
+ * @param cycles Number of measured cycles
+ */
+void ProcessTree_replay(char *directory, int cycles);
+
+
+/**
+ * Build the process tree from generated process tables of 1k, 10k and
+ * 100k processes in a loop and print the time of the tree build and of
+ * the PID lookup per process and the allocations per cycle.
+ * @param cycles Number of measured cycles
+ */
+void ProcessTree_benchmark(int cycles);
+
+
 /**
  * Initialize the system information
  * @return true if succeeded otherwise false.
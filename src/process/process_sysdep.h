@@ -30,6 +30,12 @@ int init_proc_info_sysdep(void);
 int getloadavg_sysdep (double *, int);
 boolean_t used_system_memory_sysdep(SystemInfo_T *);
 boolean_t used_system_cpu_sysdep(SystemInfo_T *);
+boolean_t used_system_pressure_sysdep(SystemInfo_T *);
 int    initprocesstree_sysdep(ProcessTree_T **, ProcessEngine_Flags);
+boolean_t getprocessdetail_sysdep(ProcessTree_T *);
+boolean_t getprocesscgroup_sysdep(ProcessTree_T *);
+int    getprocessthreads_sysdep(pid_t, ProcessThread_T **, int *);
+int    recordprocesstree_sysdep(const char *);
+boolean_t replayprocesstree_sysdep(const char *);
 
 #endif
@@ -25,10 +25,22 @@
 
 #include "config.h"
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -72,6 +84,127 @@ static long total_old    = 0;
 static long cpu_user_old = 0;
 static long cpu_syst_old = 0;
 
+/* The process table and the arguments buffers are kept between the cycles, the process table buffer grows to the high-water mark */
+static size_t pinfosize = 0;
+static struct kinfo_proc *pinfo = NULL;
+static size_t replaysize = 0; // The size of a replayed snapshot in pinfo, the sysctl is skipped if set
+static char *args = NULL;
+
+
+/**
+ * The command line of a process doesn't change for its lifetime in practice. The cache is keyed by (pid, start time,
+ * name) so a recycled PID or an exec is detected as a new process, and saves the KERN_PROCARGS2 sysctl for the
+ * processes seen in the previous cycle. The entries are kept sorted by PID.
+ */
+typedef struct ProcessCache_T {
+        pid_t pid;
+        struct timeval start;
+        char name[MAXCOMLEN + 1];
+        char *cmdline;
+} ProcessCache_T;
+
+static int cachesize = 0;
+static ProcessCache_T *cache = NULL;
+
+
+static int _cacheCompare(const void *a, const void *b) {
+        return ((const ProcessCache_T *)a)->pid - ((const ProcessCache_T *)b)->pid;
+}
+
+
+static ProcessCache_T *_cacheFind(struct kinfo_proc *p) {
+        if (cache) {
+                ProcessCache_T *c = bsearch(&(ProcessCache_T){.pid = p->kp_proc.p_pid}, cache, cachesize, sizeof(ProcessCache_T), _cacheCompare);
+                if (c && c->cmdline && c->start.tv_sec == p->kp_proc.p_starttime.tv_sec && c->start.tv_usec == p->kp_proc.p_starttime.tv_usec && IS(c->name, p->kp_proc.p_comm))
+                        return c;
+        }
+        return NULL;
+}
+
+
+static void _cacheFree(ProcessCache_T **c, int *size) {
+        for (int i = 0; i < *size; i++)
+                FREE((*c)[i].cmdline);
+        FREE(*c);
+        *size = 0;
+}
+
+
+static char *_getCommandLine(struct kinfo_proc *p, StringBuffer_T cmdline) {
+        size_t size = systeminfo.argmax;
+        int mib[] = {CTL_KERN, KERN_PROCARGS2, p->kp_proc.p_pid};
+        if (sysctl(mib, 3, args, &size, NULL, 0) != -1) {
+                /* KERN_PROCARGS2 sysctl() returns following pseudo structure:
+                 *        struct {
+                 *                int argc
+                 *                char execname[];
+                 *                char argv[argc][];
+                 *                char env[][];
+                 *        }
+                 * The strings are terminated with '\0' and may have variable '\0' padding
+                 */
+                int argc = *args;
+                char *a = args + sizeof(int); // arguments beginning
+                StringBuffer_clear(cmdline);
+                a += strlen(a); // skip exename
+                while (argc && a < args + systeminfo.argmax) {
+                        if (*a == 0) { // skip terminating 0 and variable length 0 padding
+                                a++;
+                                continue;
+                        }
+                        StringBuffer_append(cmdline, argc-- ? "%s " : "%s", a);
+                        a += strlen(a);
+                }
+                if (StringBuffer_length(StringBuffer_trim(cmdline)))
+                        return Str_dup(StringBuffer_toString(cmdline));
+        }
+        return Str_dup(p->kp_proc.p_comm);
+}
+
+
+/* The kinfo_proc array is recorded as is, so a snapshot is replayed on the same OS release and architecture only */
+#define SNAPSHOT_FILE "kinfo_proc"
+
+
+static boolean_t _writeSnapshot(const char *directory, const void *data, size_t size) {
+        char path[PATH_MAX];
+        if (mkdir(directory, 0755) != 0) {
+                LogError("Cannot create snapshot directory %s -- %s\n", directory, STRERROR);
+                return false;
+        }
+        snprintf(path, sizeof(path), "%s/%s", directory, SNAPSHOT_FILE);
+        FILE *f = fopen(path, "w");
+        if (! f || fwrite(data, 1, size, f) != size || fclose(f) != 0) {
+                LogError("Cannot write snapshot file %s -- %s\n", path, STRERROR);
+                if (f)
+                        fclose(f);
+                return false;
+        }
+        return true;
+}
+
+
+static void *_readSnapshot(const char *directory, size_t *size) {
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", directory, SNAPSHOT_FILE);
+        FILE *f = fopen(path, "r");
+        if (! f || fstat(fileno(f), &st) != 0 || st.st_size < (off_t)sizeof(struct kinfo_proc) || st.st_size % sizeof(struct kinfo_proc)) {
+                LogError("Cannot read snapshot file %s -- %s\n", path, f ? "not a process snapshot of this system" : STRERROR);
+                if (f)
+                        fclose(f);
+                return NULL;
+        }
+        void *data = ALLOC(st.st_size);
+        if (fread(data, 1, st.st_size, f) != (size_t)st.st_size) {
+                LogError("Cannot read snapshot file %s -- %s\n", path, STRERROR);
+                FREE(data);
+        }
+        fclose(f);
+        *size = st.st_size;
+        return data;
+}
+
 
 /* ------------------------------------------------------------------ Public */
 
@@ -121,26 +254,29 @@ boolean_t init_process_info_sysdep(void) {
  * @return treesize > 0 if succeeded otherwise 0
  */
 int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags) {
-        size_t pinfo_size = 0;
         int mib[] = {CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0};
-        if (sysctl(mib, 4, NULL, &pinfo_size, NULL, 0) < 0) {
-                LogError("system statistic error -- sysctl failed: %s\n", STRERROR);
-                return 0;
-        }
-        struct kinfo_proc *pinfo = CALLOC(1, pinfo_size);
-        if (sysctl(mib, 4, pinfo, &pinfo_size, NULL, 0)) {
-                FREE(pinfo);
-                LogError("system statistic error -- sysctl failed: %s\n", STRERROR);
-                return 0;
+        size_t size = replaysize ? replaysize : pinfosize;
+        // The size is probed only if the process table outgrew the buffer, with headroom for the processes started meanwhile
+        for (int attempt = 0; ! replaysize && (! pinfo || sysctl(mib, 4, pinfo, &size, NULL, 0) < 0); attempt++) {
+                if ((pinfo && errno != ENOMEM) || attempt > 2 || sysctl(mib, 4, NULL, &size, NULL, 0) < 0) {
+                        LogError("system statistic error -- sysctl failed: %s\n", STRERROR);
+                        return 0;
+                }
+                pinfosize = size + size / 8;
+                RESIZE(pinfo, pinfosize);
+                size = pinfosize;
         }
-        size_t treesize = pinfo_size / sizeof(struct kinfo_proc);
+        size_t treesize = size / sizeof(struct kinfo_proc);
         ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), treesize);
 
-        char *args = NULL;
+        int newcachesize = 0;
+        ProcessCache_T *newcache = NULL;
         StringBuffer_T cmdline = NULL;
         if (pflags & ProcessEngine_CollectCommandLine) {
                 cmdline = StringBuffer_create(64);
-                args = CALLOC(1, systeminfo.argmax + 1);
+                newcache = CALLOC(sizeof(ProcessCache_T), treesize);
+                if (! args)
+                        args = CALLOC(1, systeminfo.argmax + 1);
         }
         for (int i = 0; i < treesize; i++) {
                 pt[i].uptime    = systeminfo.time / 10. - pinfo[i].kp_proc.p_starttime.tv_sec;
@@ -151,39 +287,19 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 pt[i].cred.euid = pinfo[i].kp_eproc.e_ucred.cr_uid;
                 pt[i].cred.gid  = pinfo[i].kp_eproc.e_pcred.p_rgid;
                 if (pflags & ProcessEngine_CollectCommandLine) {
-                        size_t size = systeminfo.argmax;
-                        mib[0] = CTL_KERN;
-                        mib[1] = KERN_PROCARGS2;
-                        mib[2] = pt[i].pid;
-                        if (sysctl(mib, 3, args, &size, NULL, 0) != -1) {
-                                /* KERN_PROCARGS2 sysctl() returns following pseudo structure:
-                                 *        struct {
-                                 *                int argc
-                                 *                char execname[];
-                                 *                char argv[argc][];
-                                 *                char env[][];
-                                 *        }
-                                 * The strings are terminated with '\0' and may have variable '\0' padding
-                                 */
-                                int argc = *args;
-                                char *p = args + sizeof(int); // arguments beginning
-                                StringBuffer_clear(cmdline);
-                                p += strlen(p); // skip exename
-                                while (argc && p < args + systeminfo.argmax) {
-                                        if (*p == 0) { // skip terminating 0 and variable length 0 padding
-                                                p++;
-                                                continue;
-                                        }
-                                        StringBuffer_append(cmdline, argc-- ? "%s " : "%s", p);
-                                        p += strlen(p);
-                                }
-                                if (StringBuffer_length(cmdline))
-                                        pt[i].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
-                        }
-                        if (! pt[i].cmdline || ! *pt[i].cmdline) {
-                                FREE(pt[i].cmdline);
-                                pt[i].cmdline = Str_dup(pinfo[i].kp_proc.p_comm);
+                        ProcessCache_T *c = &newcache[newcachesize++];
+                        ProcessCache_T *cached = _cacheFind(&pinfo[i]);
+                        if (cached) {
+                                // Known process: reuse the command line from the previous cycle
+                                *c = *cached;
+                                cached->cmdline = NULL; // Moved to the new cache
+                        } else {
+                                c->pid = pinfo[i].kp_proc.p_pid;
+                                c->start = pinfo[i].kp_proc.p_starttime;
+                                snprintf(c->name, sizeof(c->name), "%s", pinfo[i].kp_proc.p_comm);
+                                c->cmdline = _getCommandLine(&pinfo[i], cmdline);
                         }
+                        pt[i].cmdline = Str_dup(c->cmdline);
                 }
                 if (! pt[i].zombie) {
                         struct proc_taskinfo tinfo;
@@ -202,16 +318,63 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
         }
         if (pflags & ProcessEngine_CollectCommandLine) {
                 StringBuffer_free(&cmdline);
-                FREE(args);
+                qsort(newcache, newcachesize, sizeof(ProcessCache_T), _cacheCompare);
         }
-        FREE(pinfo);
+        _cacheFree(&cache, &cachesize);
+        cache = newcache;
+        cachesize = newcachesize;
 
         *reference = pt;
-        
+
         return (int)treesize;
 }
 
 
+/**
+ * Record the kinfo_proc array which one collector pass reads. The command lines and the task info are not recorded,
+ * the replay gets them from the live system for the processes which still exist
+ * @param directory The snapshot directory, it must not exist
+ * @return Number of recorded processes or -1 on error
+ */
+int recordprocesstree_sysdep(const char *directory) {
+        ASSERT(directory);
+        int mib[] = {CTL_KERN, KERN_PROC, KERN_PROC_ALL, 0};
+        size_t size = 0;
+        if (sysctl(mib, 4, NULL, &size, NULL, 0) < 0) {
+                LogError("system statistic error -- sysctl failed: %s\n", STRERROR);
+                return -1;
+        }
+        size += size / 8;
+        struct kinfo_proc *snapshot = ALLOC(size);
+        int count = -1;
+        if (sysctl(mib, 4, snapshot, &size, NULL, 0) < 0)
+                LogError("system statistic error -- sysctl failed: %s\n", STRERROR);
+        else if (_writeSnapshot(directory, snapshot, size))
+                count = (int)(size / sizeof(struct kinfo_proc));
+        FREE(snapshot);
+        return count;
+}
+
+
+/**
+ * Read the processes from the snapshot instead of the kernel from now on
+ * @param directory The snapshot directory
+ * @return true if succeeded otherwise false
+ */
+boolean_t replayprocesstree_sysdep(const char *directory) {
+        ASSERT(directory);
+        size_t size;
+        struct kinfo_proc *snapshot = _readSnapshot(directory, &size);
+        if (! snapshot)
+                return false;
+        FREE(pinfo);
+        pinfo = snapshot;
+        pinfosize = replaysize = size;
+        _cacheFree(&cache, &cachesize);
+        return true;
+}
+
+
 /**
  * This routine returns 'nelem' double precision floats containing
  * the load averages in 'loadv'; at most 3 values will be returned.
@@ -285,3 +448,47 @@ boolean_t used_system_cpu_sysdep(SystemInfo_T *si) {
         }
         return false;
 }
+
+
+/**
+ * The extended process statistics (disk I/O, context switches and open file
+ * descriptors) are not collected on this platform.
+ * @param pt Process tree entry
+ * @return false
+ */
+boolean_t getprocessdetail_sysdep(ProcessTree_T *pt) {
+        return false;
+}
+
+
+/**
+ * The pressure stall information is available on Linux only.
+ * @param si System info
+ * @return false
+ */
+boolean_t used_system_pressure_sysdep(SystemInfo_T *si) {
+        return false;
+}
+
+
+/**
+ * The cgroup statistics are available on Linux only.
+ * @param pt Process tree entry
+ * @return false
+ */
+boolean_t getprocesscgroup_sysdep(ProcessTree_T *pt) {
+        return false;
+}
+
+
+/**
+ * The per-thread statistics are available on Linux only.
+ * @param pid Process PID
+ * @param threads The threads array
+ * @param size The number of allocated threads array entries
+ * @return -1
+ */
+int getprocessthreads_sysdep(pid_t pid, ProcessThread_T **threads, int *size) {
+        return -1;
+}
+
@@ -25,10 +25,22 @@
 
 #include "config.h"
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
@@ -89,6 +101,108 @@ static long total_old    = 0;
 static long cpu_user_old = 0;
 static long cpu_syst_old = 0;
 
+static kvm_t *kvm_handle = NULL; // Kept open between the cycles, reopened after an error
+
+/* The process table of a replayed snapshot, used instead of kvm_getprocs() if set */
+static int replaysize = 0;
+static struct kinfo_proc *replay = NULL;
+
+
+/**
+ * The command line of a process doesn't change for its lifetime in practice. The cache is keyed by (pid, start time,
+ * name) so a recycled PID or an exec is detected as a new process, and saves the kvm_getargv() call for the processes
+ * seen in the previous cycle. The entries are kept sorted by PID.
+ */
+typedef struct ProcessCache_T {
+        pid_t pid;
+        struct timeval start;
+        char name[COMMLEN + 1];
+        char *cmdline;
+} ProcessCache_T;
+
+static int cachesize = 0;
+static ProcessCache_T *cache = NULL;
+
+
+static int _cacheCompare(const void *a, const void *b) {
+        return ((const ProcessCache_T *)a)->pid - ((const ProcessCache_T *)b)->pid;
+}
+
+
+static ProcessCache_T *_cacheFind(struct kinfo_proc *pinfo) {
+        if (cache) {
+                ProcessCache_T *c = bsearch(&(ProcessCache_T){.pid = pinfo->ki_pid}, cache, cachesize, sizeof(ProcessCache_T), _cacheCompare);
+                if (c && c->cmdline && c->start.tv_sec == pinfo->ki_start.tv_sec && c->start.tv_usec == pinfo->ki_start.tv_usec && IS(c->name, pinfo->ki_comm))
+                        return c;
+        }
+        return NULL;
+}
+
+
+static void _cacheFree(ProcessCache_T **c, int *size) {
+        for (int i = 0; i < *size; i++)
+                FREE((*c)[i].cmdline);
+        FREE(*c);
+        *size = 0;
+}
+
+
+static char *_getCommandLine(struct kinfo_proc *pinfo, StringBuffer_T cmdline) {
+        char **args = kvm_getargv(kvm_handle, pinfo, 0);
+        if (args) {
+                StringBuffer_clear(cmdline);
+                for (int j = 0; args[j]; j++)
+                        StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
+                if (StringBuffer_length(StringBuffer_trim(cmdline)))
+                        return Str_dup(StringBuffer_toString(cmdline));
+        }
+        return Str_dup(pinfo->ki_comm);
+}
+
+
+/* The kinfo_proc array is recorded as is, so a snapshot is replayed on the same OS release and architecture only */
+#define SNAPSHOT_FILE "kinfo_proc"
+
+
+static boolean_t _writeSnapshot(const char *directory, const void *data, size_t size) {
+        char path[PATH_MAX];
+        if (mkdir(directory, 0755) != 0) {
+                LogError("Cannot create snapshot directory %s -- %s\n", directory, STRERROR);
+                return false;
+        }
+        snprintf(path, sizeof(path), "%s/%s", directory, SNAPSHOT_FILE);
+        FILE *f = fopen(path, "w");
+        if (! f || fwrite(data, 1, size, f) != size || fclose(f) != 0) {
+                LogError("Cannot write snapshot file %s -- %s\n", path, STRERROR);
+                if (f)
+                        fclose(f);
+                return false;
+        }
+        return true;
+}
+
+
+static void *_readSnapshot(const char *directory, size_t *size) {
+        char path[PATH_MAX];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", directory, SNAPSHOT_FILE);
+        FILE *f = fopen(path, "r");
+        if (! f || fstat(fileno(f), &st) != 0 || st.st_size < (off_t)sizeof(struct kinfo_proc) || st.st_size % sizeof(struct kinfo_proc)) {
+                LogError("Cannot read snapshot file %s -- %s\n", path, f ? "not a process snapshot of this system" : STRERROR);
+                if (f)
+                        fclose(f);
+                return NULL;
+        }
+        void *data = ALLOC(st.st_size);
+        if (fread(data, 1, st.st_size, f) != (size_t)st.st_size) {
+                LogError("Cannot read snapshot file %s -- %s\n", path, STRERROR);
+                FREE(data);
+        }
+        fclose(f);
+        *size = st.st_size;
+        return data;
+}
+
 
 /* ------------------------------------------------------------------ Public */
 
@@ -135,25 +249,29 @@ boolean_t init_process_info_sysdep(void) {
  * @return treesize > 0 if succeeded otherwise 0.
  */
 int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags) {
-        kvm_t *kvm_handle = kvm_open(NULL, _PATH_DEVNULL, NULL, O_RDONLY, prog);
-        if (! kvm_handle) {
+        if (! kvm_handle && ! (kvm_handle = kvm_open(NULL, _PATH_DEVNULL, NULL, O_RDONLY, prog))) {
                 LogError("system statistic error -- cannot initialize kvm interface\n");
                 return 0;
         }
 
-        int treesize;
-        struct kinfo_proc *pinfo = kvm_getprocs(kvm_handle, KERN_PROC_PROC, 0, &treesize);
+        int treesize = replaysize;
+        struct kinfo_proc *pinfo = replay ? replay : kvm_getprocs(kvm_handle, KERN_PROC_PROC, 0, &treesize);
         if (! pinfo || (treesize < 1)) {
                 LogError("system statistic error -- cannot get process tree\n");
                 kvm_close(kvm_handle);
+                kvm_handle = NULL;
                 return 0;
         }
 
         ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), treesize);
 
+        int newcachesize = 0;
+        ProcessCache_T *newcache = NULL;
         StringBuffer_T cmdline = NULL;
-        if (pflags & ProcessEngine_CollectCommandLine)
+        if (pflags & ProcessEngine_CollectCommandLine) {
                 cmdline = StringBuffer_create(64);
+                newcache = CALLOC(sizeof(ProcessCache_T), treesize);
+        }
         for (int i = 0; i < treesize; i++) {
                 pt[i].pid          = pinfo[i].ki_pid;
                 pt[i].ppid         = pinfo[i].ki_ppid;
@@ -166,30 +284,76 @@ int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags
                 pt[i].memory.usage = (uint64_t)pinfo[i].ki_rssize * (uint64_t)pagesize;
                 pt[i].zombie       = pinfo[i].ki_stat == SZOMB ? true : false;
                 if (pflags & ProcessEngine_CollectCommandLine) {
-                        char **args = kvm_getargv(kvm_handle, &pinfo[i], 0);
-                        if (args) {
-                                StringBuffer_clear(cmdline);
-                                for (int j = 0; args[j]; j++)
-                                        StringBuffer_append(cmdline, args[j + 1] ? "%s " : "%s", args[j]);
-                                if (StringBuffer_length(cmdline))
-                                        pt[i].cmdline = Str_dup(StringBuffer_toString(StringBuffer_trim(cmdline)));
-                        }
-                        if (! pt[i].cmdline || ! *pt[i].cmdline) {
-                                FREE(pt[i].cmdline);
-                                pt[i].cmdline = Str_dup(pinfo[i].ki_comm);
+                        ProcessCache_T *c = &newcache[newcachesize++];
+                        ProcessCache_T *cached = _cacheFind(&pinfo[i]);
+                        if (cached) {
+                                // Known process: reuse the command line from the previous cycle
+                                *c = *cached;
+                                cached->cmdline = NULL; // Moved to the new cache
+                        } else {
+                                c->pid = pinfo[i].ki_pid;
+                                c->start = pinfo[i].ki_start;
+                                snprintf(c->name, sizeof(c->name), "%s", pinfo[i].ki_comm);
+                                c->cmdline = _getCommandLine(&pinfo[i], cmdline);
                         }
+                        pt[i].cmdline = Str_dup(c->cmdline);
                 }
         }
-        if (pflags & ProcessEngine_CollectCommandLine)
+        if (pflags & ProcessEngine_CollectCommandLine) {
                 StringBuffer_free(&cmdline);
+                qsort(newcache, newcachesize, sizeof(ProcessCache_T), _cacheCompare);
+        }
+        _cacheFree(&cache, &cachesize);
+        cache = newcache;
+        cachesize = newcachesize;
 
         *reference = pt;
-        kvm_close(kvm_handle);
 
         return treesize;
 }
 
 
+/**
+ * Record the kinfo_proc array which one collector pass reads. The command lines are not recorded, the replay
+ * gets them from the live system for the processes which still exist
+ * @param directory The snapshot directory, it must not exist
+ * @return Number of recorded processes or -1 on error
+ */
+int recordprocesstree_sysdep(const char *directory) {
+        ASSERT(directory);
+        if (! kvm_handle && ! (kvm_handle = kvm_open(NULL, _PATH_DEVNULL, NULL, O_RDONLY, prog))) {
+                LogError("system statistic error -- cannot initialize kvm interface\n");
+                return -1;
+        }
+        int treesize;
+        struct kinfo_proc *pinfo = kvm_getprocs(kvm_handle, KERN_PROC_PROC, 0, &treesize);
+        if (! pinfo || (treesize < 1)) {
+                LogError("system statistic error -- cannot get process tree\n");
+                return -1;
+        }
+        return _writeSnapshot(directory, pinfo, treesize * sizeof(struct kinfo_proc)) ? treesize : -1;
+}
+
+
+/**
+ * Read the processes from the snapshot instead of the kernel from now on
+ * @param directory The snapshot directory
+ * @return true if succeeded otherwise false
+ */
+boolean_t replayprocesstree_sysdep(const char *directory) {
+        ASSERT(directory);
+        size_t size;
+        struct kinfo_proc *snapshot = _readSnapshot(directory, &size);
+        if (! snapshot)
+                return false;
+        FREE(replay);
+        replay = snapshot;
+        replaysize = (int)(size / sizeof(struct kinfo_proc));
+        _cacheFree(&cache, &cachesize);
+        return true;
+}
+
+
 /**
  * This routine returns 'nelem' double precision floats containing
  * the load averages in 'loadv'; at most 3 values will be returned.
@@ -300,3 +464,46 @@ boolean_t used_system_cpu_sysdep(SystemInfo_T *si) {
         return true;
 }
 
+
+/**
+ * The extended process statistics (disk I/O, context switches and open file
+ * descriptors) are not collected on this platform.
+ * @param pt Process tree entry
+ * @return false
+ */
+boolean_t getprocessdetail_sysdep(ProcessTree_T *pt) {
+        return false;
+}
+
+
+/**
+ * The pressure stall information is available on Linux only.
+ * @param si System info
+ * @return false
+ */
+boolean_t used_system_pressure_sysdep(SystemInfo_T *si) {
+        return false;
+}
+
+
+/**
+ * The cgroup statistics are available on Linux only.
+ * @param pt Process tree entry
+ * @return false
+ */
+boolean_t getprocesscgroup_sysdep(ProcessTree_T *pt) {
+        return false;
+}
+
+
+/**
+ * The per-thread statistics are available on Linux only.
+ * @param pid Process PID
+ * @param threads The threads array
+ * @param size The number of allocated threads array entries
+ * @return -1
+ */
+int getprocessthreads_sysdep(pid_t pid, ProcessThread_T **threads, int *size) {
+        return -1;
+}
+
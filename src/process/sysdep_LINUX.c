@@ -65,8 +65,12 @@
 #include <asm/param.h>
 #endif
 
-#ifdef HAVE_GLOB_H
-#include <glob.h>
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
 #endif
 
 #ifdef HAVE_SYS_SYSINFO_H
@@ -76,9 +80,12 @@
 #include "monit.h"
 #include "ProcessTree.h"
 #include "process_sysdep.h"
+#include "counter.h"
 
 // libmonit
 #include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
 
 /**
  *  System dependent resource gathering code for Linux.
@@ -95,12 +102,103 @@
 static unsigned long long old_cpu_user     = 0;
 static unsigned long long old_cpu_syst     = 0;
 static unsigned long long old_cpu_wait     = 0;
+static unsigned long long old_cpu_steal    = 0;
 static unsigned long long old_cpu_total    = 0;
 
 static long page_size = 0;
 
 static double hz = 0.;
 
+
+/**
+ * Per-process data which don't change for the process lifetime in practice (credentials, command line and container). The
+ * cache is keyed by (pid, starttime) so a recycled PID is detected as a new process. The entries are kept sorted by PID.
+ */
+typedef struct ProcessCache_T {
+        pid_t pid;
+        boolean_t settled;               /**< false if the process was too young when cached (it may still drop privileges) */
+        unsigned long long starttime;
+        char name[32];                                               /**< Process name from /proc/PID/stat */
+        int uid;
+        int euid;
+        int gid;
+        char *cmdline;
+        struct {
+                boolean_t collected;
+                ino_t namespace;
+                char *cgroup;
+        } container;
+} ProcessCache_T;
+
+static int cachesize = 0;
+static ProcessCache_T *cache = NULL;
+
+#define PROCESS_SETTLED 10 // Process age [s] after which we consider its credentials stable
+
+#define PROCESS_COLLECTOR_CHUNK 1024 // Minimum number of processes per collector thread
+
+#define SNAPSHOT_STARTTIME "starttime" // The system start time file in a snapshot, the PID directories are next to it
+
+
+/**
+ * The /proc directory descriptor is cached, the per-process files are opened relative to it. The PID list and the
+ * directory entries buffer are reused between cycles. When a snapshot is replayed, the descriptor refers to the
+ * snapshot directory and the system start time is the recorded one.
+ */
+static int proc_fd = -1;
+static time_t replay_starttime = 0;
+static int pidlistsize = 0;
+static pid_t *pidlist = NULL;
+static char dirbuf[32768];
+static const char *cgroup_root = NULL; // The cgroup v2 (unified) hierarchy mount point or NULL if not available
+
+
+/**
+ * The previous /proc/stat tick counters per CPU and the per-node accumulators, indexed by the CPU and node number. The
+ * arrays and the /proc/stat buffer are allocated for the configured CPU count at startup, the usage is published in
+ * systeminfo.cpu and systeminfo.node.
+ */
+#define CPU_TICKS 8 // user, nice, system, idle, iowait, irq, softirq, steal
+
+#define MAX_NODES 1024 // Linux MAX_NUMNODES
+
+static struct {
+        int size;
+        unsigned long long *busy;
+        unsigned long long *steal;
+        unsigned long long *total;
+        unsigned long long *nodebusy;
+        unsigned long long *nodetotal;
+} percpu = {};
+static int statsize = 0;
+static char *statbuf = NULL;
+
+static boolean_t pressure_available = false; // The /proc/pressure files exist (Linux 4.20 and later with CONFIG_PSI)
+
+static const char *pressurefiles[] = {"cpu.pressure", "memory.pressure", "io.pressure"}; // The cgroup pressure files indexed by Pressure_Type
+
+
+/* Layout of the getdents64 record, glibc doesn't export it (struct dirent64 has different semantics) */
+struct linux_dirent64 {
+        uint64_t       d_ino;
+        int64_t        d_off;
+        unsigned short d_reclen;
+        unsigned char  d_type;
+        char           d_name[];
+};
+
+
+/* The subset of /proc/PID/stat fields used by the process tree */
+typedef struct ProcessStat_T {
+        char state;
+        int ppid;
+        unsigned long utime;
+        unsigned long stime;
+        int threads;
+        unsigned long long starttime;
+        long rss;
+} ProcessStat_T;
+
 /**
  * Get system start time
  * @return seconds since unix epoch
@@ -115,6 +213,320 @@ static time_t get_starttime() {
 }
 
 
+static int _cacheCompare(const void *a, const void *b) {
+        return ((const ProcessCache_T *)a)->pid - ((const ProcessCache_T *)b)->pid;
+}
+
+
+/**
+ * Find the process in the cache from the previous cycle
+ * @param pid Process PID
+ * @param starttime Process start time in jiffies since boot
+ * @param name Process name
+ * @return The cache entry or NULL if the process wasn't seen before (or the PID was recycled)
+ */
+static ProcessCache_T *_cacheFind(pid_t pid, unsigned long long starttime, const char *name) {
+        if (cache) {
+                ProcessCache_T *c = bsearch(&(ProcessCache_T){.pid = pid}, cache, cachesize, sizeof(ProcessCache_T), _cacheCompare);
+                if (c && c->settled && c->starttime == starttime && Str_isEqual(c->name, name)) // The name changes on exec
+                        return c;
+        }
+        return NULL;
+}
+
+
+static void _cacheFree(ProcessCache_T **c, int *size) {
+        for (int i = 0; i < *size; i++) {
+                FREE((*c)[i].cmdline);
+                FREE((*c)[i].container.cgroup);
+        }
+        FREE(*c);
+        *size = 0;
+}
+
+
+/**
+ * Read the list of PIDs from /proc using getdents64 on the cached /proc descriptor. The PIDs are stored in pidlist.
+ * @return Number of PIDs found or -1 on error
+ */
+static int _readPidList() {
+        if (lseek(proc_fd, 0, SEEK_SET) < 0) {
+                LogError("system statistic error -- cannot rewind /proc: %s\n", STRERROR);
+                return -1;
+        }
+        int count = 0;
+        long n;
+        while ((n = syscall(SYS_getdents64, proc_fd, dirbuf, sizeof(dirbuf))) > 0) {
+                for (long offset = 0; offset < n;) {
+                        struct linux_dirent64 *d = (struct linux_dirent64 *)(dirbuf + offset);
+                        offset += d->d_reclen;
+                        if (d->d_type != DT_DIR && d->d_type != DT_UNKNOWN)
+                                continue;
+                        pid_t pid = 0;
+                        const char *c = d->d_name;
+                        for (; *c >= '0' && *c <= '9'; c++)
+                                pid = pid * 10 + (*c - '0');
+                        if (*c || c == d->d_name)
+                                continue; // Not a process directory
+                        if (count >= pidlistsize) {
+                                pidlistsize = pidlistsize ? pidlistsize * 2 : 1024;
+                                RESIZE(pidlist, pidlistsize * sizeof(pid_t));
+                        }
+                        pidlist[count++] = pid;
+                }
+        }
+        if (n < 0) {
+                LogError("system statistic error -- cannot read /proc: %s\n", STRERROR);
+                return -1;
+        }
+        return count;
+}
+
+
+/**
+ * Read the /proc/PID/<name> file relative to the cached /proc descriptor
+ * @param buf Destination buffer
+ * @param size Buffer size
+ * @param pid Process PID
+ * @param name File name
+ * @param bytes_read Optional, number of bytes read
+ * @return true if succeeded otherwise false
+ */
+static boolean_t _readProcessFile(char *buf, int size, pid_t pid, const char *name, int *bytes_read) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d/%s", pid, name);
+        int fd = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("Cannot open proc file /proc/%s -- %s\n", path, STRERROR);
+                return false;
+        }
+        Counter_add(Counter_ProcFiles, 1);
+        int bytes = (int)read(fd, buf, size - 1);
+        close(fd);
+        if (bytes < 0) {
+                DEBUG("Cannot read proc file /proc/%s -- %s\n", path, STRERROR);
+                return false;
+        }
+        Counter_add(Counter_ProcBytes, bytes);
+        buf[bytes] = 0;
+        if (bytes_read)
+                *bytes_read = bytes;
+        return true;
+}
+
+
+static inline char *_nextField(char *c) {
+        while (*c && *c != ' ')
+                c++;
+        while (*c == ' ')
+                c++;
+        return c;
+}
+
+
+static inline unsigned long long _parseUnsigned(char *c) {
+        unsigned long long v = 0ULL;
+        for (; *c >= '0' && *c <= '9'; c++)
+                v = v * 10 + (*c - '0');
+        return v;
+}
+
+
+static inline long long _parseSigned(char *c) {
+        return *c == '-' ? -(long long)_parseUnsigned(c + 1) : (long long)_parseUnsigned(c);
+}
+
+
+/**
+ * Parse the /proc/PID/stat content in one pass (see proc(5) for the fields layout)
+ * @param buf The stat file content, the process name is terminated in place
+ * @param name Output, pointer to the process name within buf
+ * @param stat Output, parsed fields
+ * @return true if succeeded otherwise false
+ */
+static boolean_t _parseStat(char *buf, char **name, ProcessStat_T *stat) {
+        // The process name may contain spaces and parentheses, it is delimited by the first '(' and the last ')'
+        char *start = strchr(buf, '(');
+        char *end = strrchr(buf, ')');
+        if (! start || ! end || end < start || ! end[1])
+                return false;
+        *end = 0;
+        *name = start + 1;
+        char *c = end + 2; // Field 3: state
+        stat->state = *c;
+        for (int field = 3; *c && field <= 24; field++, c = _nextField(c)) {
+                switch (field) {
+                        case 4:
+                                stat->ppid = (int)_parseSigned(c);
+                                break;
+                        case 14:
+                                stat->utime = (unsigned long)_parseUnsigned(c);
+                                break;
+                        case 15:
+                                stat->stime = (unsigned long)_parseUnsigned(c);
+                                break;
+                        case 20:
+                                stat->threads = (int)_parseSigned(c);
+                                break;
+                        case 22:
+                                stat->starttime = _parseUnsigned(c);
+                                break;
+                        case 24:
+                                stat->rss = (long)_parseSigned(c);
+                                return true;
+                        default:
+                                break;
+                }
+        }
+        return false;
+}
+
+
+/**
+ * Parse the tick counters of one /proc/stat cpu line (see proc(5)), the counters missing on older kernels are zero
+ * @param c Pointer to the first counter, advanced to the next line
+ * @param ticks Output, the counters
+ * @return The number of counters parsed
+ */
+static int _parseTicks(char **c, unsigned long long ticks[CPU_TICKS]) {
+        int count = 0;
+        for (char *end; count < CPU_TICKS; count++, *c = end) {
+                ticks[count] = strtoull(*c, &end, 10);
+                if (end == *c)
+                        break;
+        }
+        for (int i = count; i < CPU_TICKS; i++)
+                ticks[i] = 0ULL;
+        char *eol = strchr(*c, '\n');
+        *c = eol ? eol + 1 : *c + strlen(*c);
+        return count;
+}
+
+
+/**
+ * Parse the pressure stall information (see Documentation/accounting/psi.rst): the "some" and "full" lines with the
+ * avg10, avg60 and avg300 shares. The missing values are left unchanged.
+ * @param buf The pressure file content
+ * @param pressure Output, the parsed values
+ */
+static void _parsePressure(const char *buf, Pressure_T *pressure) {
+        for (const char *c = buf; *c; c++) {
+                float *values = Str_startsWith(c, "some ") ? pressure->some : Str_startsWith(c, "full ") ? pressure->full : NULL;
+                if (values)
+                        sscanf(c + 5, "avg10=%f avg60=%f avg300=%f", &values[0], &values[1], &values[2]);
+                if (! (c = strchr(c, '\n')))
+                        break;
+        }
+}
+
+
+/**
+ * Map the CPUs to the NUMA nodes using the /sys/devices/system/node/nodeN/cpulist files (e.g. "0-3,8-11")
+ */
+static void _initNodes(void) {
+        DIR *dir = opendir("/sys/devices/system/node");
+        if (! dir) {
+                DEBUG("system statistic -- NUMA topology not available\n");
+                return;
+        }
+        int nodes = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+                int node;
+                if (sscanf(entry->d_name, "node%d", &node) != 1 || node < 0 || node >= MAX_NODES)
+                        continue;
+                char path[STRLEN], buf[4096];
+                snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+                int fd = open(path, O_RDONLY | O_CLOEXEC);
+                if (fd < 0)
+                        continue;
+                int bytes = (int)read(fd, buf, sizeof(buf) - 1);
+                close(fd);
+                if (bytes <= 0)
+                        continue;
+                buf[bytes] = 0;
+                for (char *c = buf, *end; ; c = end + 1) {
+                        long first = strtol(c, &end, 10), last = first;
+                        if (end == c)
+                                break;
+                        if (*end == '-')
+                                last = strtol(end + 1, &end, 10);
+                        for (long cpu = first; cpu <= last && cpu < percpu.size; cpu++)
+                                systeminfo.cpu.node[cpu] = node;
+                        if (*end != ',')
+                                break;
+                }
+                if (node >= nodes)
+                        nodes = node + 1;
+        }
+        closedir(dir);
+        if (nodes > 0) {
+                systeminfo.node.usage = CALLOC(nodes, sizeof(float));
+                percpu.nodebusy = CALLOC(nodes, sizeof(unsigned long long));
+                percpu.nodetotal = CALLOC(nodes, sizeof(unsigned long long));
+                for (int i = 0; i < nodes; i++)
+                        systeminfo.node.usage[i] = -1.;
+                systeminfo.node.count = nodes;
+        }
+}
+
+
+/**
+ * Update the per-CPU and per-node usage from the cpuN lines of /proc/stat. The usage is the user, system and interrupt
+ * time share, the steal is the time the hypervisor gave to other guests.
+ * @param si System info to update
+ * @param c The /proc/stat content following the aggregate cpu line
+ */
+static void _updateCpus(SystemInfo_T *si, char *c) {
+        unsigned long long ticks[CPU_TICKS];
+        for (int i = 0; i < si->node.count; i++)
+                percpu.nodebusy[i] = percpu.nodetotal[i] = 0ULL;
+        int next = 0; // The CPUs missing in /proc/stat are offline
+        while (Str_startsWith(c, "cpu")) {
+                char *end;
+                long cpu = strtol(c + 3, &end, 10);
+                c = end;
+                if (_parseTicks(&c, ticks) < 4 || cpu < next || cpu >= percpu.size)
+                        continue;
+                for (; next < cpu; next++)
+                        si->cpu.usage[next] = si->cpu.steal[next] = -1.;
+                next = cpu + 1;
+                unsigned long long busy = ticks[0] + ticks[1] + ticks[2] + ticks[5] + ticks[6];
+                unsigned long long total = busy + ticks[3] + ticks[4] + ticks[7];
+                if (percpu.total[cpu] == 0ULL || total < percpu.total[cpu]) {
+                        si->cpu.usage[cpu] = si->cpu.steal[cpu] = -1.; // First sample
+                } else {
+                        unsigned long long delta = total - percpu.total[cpu];
+                        si->cpu.usage[cpu] = delta ? 100. * (double)(busy - percpu.busy[cpu]) / delta : 0.;
+                        si->cpu.steal[cpu] = delta ? 100. * (double)(ticks[7] - percpu.steal[cpu]) / delta : 0.;
+                        if (si->node.count) {
+                                percpu.nodebusy[si->cpu.node[cpu]] += busy - percpu.busy[cpu];
+                                percpu.nodetotal[si->cpu.node[cpu]] += delta;
+                        }
+                }
+                percpu.busy[cpu] = busy;
+                percpu.steal[cpu] = ticks[7];
+                percpu.total[cpu] = total;
+        }
+        for (; next < percpu.size; next++)
+                si->cpu.usage[next] = si->cpu.steal[next] = -1.;
+        for (int i = 0; i < si->node.count; i++)
+                si->node.usage[i] = percpu.nodetotal[i] ? 100. * (double)percpu.nodebusy[i] / percpu.nodetotal[i] : -1.;
+}
+
+
+/**
+ * Get the value of the given /proc/meminfo field parsed by used_system_memory_sysdep()
+ */
+static boolean_t _getMeminfo(SystemInfo_T *si, const char *name, uint64_t *value) {
+        int i = Util_getMeminfo(si, name);
+        if (i < 0)
+                return false;
+        *value = si->meminfo.field[i].value;
+        return true;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -122,6 +534,11 @@ boolean_t init_process_info_sysdep(void) {
         char *ptr;
         char  buf[4096];
 
+        if (proc_fd < 0 && (proc_fd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+                DEBUG("system statistic error -- cannot open /proc: %s\n", STRERROR);
+                return false;
+        }
+
         if ((hz = sysconf(_SC_CLK_TCK)) <= 0.) {
                 DEBUG("system statistic error -- cannot get hz: %s\n", STRERROR);
                 return false;
@@ -155,6 +572,25 @@ boolean_t init_process_info_sysdep(void) {
                 systeminfo.cpus = 1;
         }
 
+        percpu.size = systeminfo.cpus;
+        percpu.busy = CALLOC(percpu.size, sizeof(unsigned long long));
+        percpu.steal = CALLOC(percpu.size, sizeof(unsigned long long));
+        percpu.total = CALLOC(percpu.size, sizeof(unsigned long long));
+        systeminfo.cpu.usage = CALLOC(percpu.size, sizeof(float));
+        systeminfo.cpu.steal = CALLOC(percpu.size, sizeof(float));
+        systeminfo.cpu.node = CALLOC(percpu.size, sizeof(short));
+        for (int i = 0; i < percpu.size; i++)
+                systeminfo.cpu.usage[i] = systeminfo.cpu.steal[i] = -1.;
+        systeminfo.cpu.count = percpu.size;
+        statsize = 4096 + percpu.size * 256; // The cpu lines precede the long interrupt counters
+        statbuf = CALLOC(1, statsize);
+        _initNodes();
+
+        if (access("/proc/pressure", F_OK) == 0)
+                pressure_available = true;
+        else
+                DEBUG("system statistic -- pressure stall information not available\n");
+
         if (! file_readProc(buf, sizeof(buf), "stat", -1, NULL)) {
                 DEBUG("system statistic error -- cannot read /proc/stat\n");
                 return false;
@@ -170,10 +606,188 @@ boolean_t init_process_info_sysdep(void) {
         }
         systeminfo.booted = booted;
 
+        if (access("/sys/fs/cgroup/cgroup.controllers", F_OK) == 0)
+                cgroup_root = "/sys/fs/cgroup";
+        else if (access("/sys/fs/cgroup/unified/cgroup.controllers", F_OK) == 0)
+                cgroup_root = "/sys/fs/cgroup/unified"; // Hybrid hierarchy
+        else
+                DEBUG("system statistic -- cgroup v2 hierarchy not found, cgroup resource statistics disabled\n");
+
         return true;
 }
 
 
+/**
+ * Read the container identity of the process: the PID namespace inode and the cgroup path. The cgroup v2 (unified)
+ * hierarchy path is preferred, on the v1 hierarchy the path of the first controller is used. The path is as seen
+ * from the Monit cgroup namespace.
+ * @param pid Process PID
+ * @param namespace The PID namespace inode or 0 if the kernel has no PID namespaces
+ * @param cgroup The allocated cgroup path or NULL if the kernel has no cgroups
+ */
+static void _readContainer(pid_t pid, ino_t *namespace, char **cgroup) {
+        char buf[4096], path[64];
+        struct stat st;
+        snprintf(path, sizeof(path), "%d/ns/pid", pid);
+        *namespace = fstatat(proc_fd, path, &st, 0) == 0 ? st.st_ino : 0;
+        *cgroup = NULL;
+        if (_readProcessFile(buf, sizeof(buf), pid, "cgroup", NULL)) {
+                // One line per hierarchy: "id:controllers:/path", the unified hierarchy entry has the format "0::/path"
+                char *line = strstr(buf, "0::/");
+                if (! line || (line != buf && *(line - 1) != '\n'))
+                        line = buf;
+                char *c = strchr(line, ':');
+                if (c && (c = strchr(c + 1, ':')))
+                        *cgroup = Str_ndup(c + 1, (int)strcspn(c + 1, "\n"));
+        }
+}
+
+
+/**
+ * Collect the process data from /proc/PID files
+ * @param pid Process PID
+ * @param pt The process tree entry to fill
+ * @param c The new cache entry to fill
+ * @param pflags Process engine flags
+ * @param starttime System start time
+ * @return true if succeeded otherwise false
+ */
+static boolean_t _collectProcess(pid_t pid, ProcessTree_T *pt, ProcessCache_T *c, ProcessEngine_Flags pflags, time_t starttime) {
+        int            bytes = 0;
+        char          *tmp = NULL;
+        char          *procname = NULL;
+        char           buf[4096];
+        ProcessStat_T  stat = {};
+
+        /********** /proc/PID/stat **********/
+        if (! _readProcessFile(buf, sizeof(buf), pid, "stat", NULL)) {
+                DEBUG("system statistic error -- cannot read /proc/%d/stat\n", pid);
+                return false;
+        }
+        if (! _parseStat(buf, &procname, &stat)) {
+                DEBUG("system statistic error -- file /proc/%d/stat parse error\n", pid);
+                return false;
+        }
+        long long sampled = Time_monotonic(); // The CPU time sample timestamp, the collector threads scan the processes in parallel
+
+        ProcessCache_T *cached = _cacheFind(pid, stat.starttime, procname);
+        if (cached) {
+                // Known process: reuse the credentials and the command line from the previous cycle
+                *c = *cached;
+                cached->cmdline = NULL; // Moved to the new cache
+                cached->container.cgroup = NULL;
+        } else {
+                c->starttime = stat.starttime;
+                snprintf(c->name, sizeof(c->name), "%s", procname);
+
+                /********** /proc/PID/status **********/
+                char status[4096];
+                if (! _readProcessFile(status, sizeof(status), pid, "status", NULL)) {
+                        DEBUG("system statistic error -- cannot read /proc/%d/status\n", pid);
+                        return false;
+                }
+                if (! (tmp = strstr(status, "Uid:"))) {
+                        DEBUG("system statistic error -- cannot find process uid\n");
+                        return false;
+                }
+                if (sscanf(tmp + 4, "\t%d\t%d", &c->uid, &c->euid) != 2) {
+                        DEBUG("system statistic error -- cannot read process uid\n");
+                        return false;
+                }
+                if (! (tmp = strstr(status, "Gid:"))) {
+                        DEBUG("system statistic error -- cannot find process gid\n");
+                        return false;
+                }
+                if (sscanf(tmp + 4, "\t%d", &c->gid) != 1) {
+                        DEBUG("system statistic error -- cannot read process gid\n");
+                        return false;
+                }
+        }
+
+        /********** /proc/PID/cmdline **********/
+        if ((pflags & ProcessEngine_CollectCommandLine) && ! c->cmdline) {
+                char cmdline[4096];
+                if (! _readProcessFile(cmdline, sizeof(cmdline), pid, "cmdline", &bytes)) {
+                        DEBUG("system statistic error -- cannot read /proc/%d/cmdline\n", pid);
+                        return false;
+                }
+                for (int j = 0; j < (bytes - 1); j++) // The cmdline file contains argv elements/strings terminated separated by '\0' => join the string
+                        if (cmdline[j] == 0)
+                                cmdline[j] = ' ';
+                c->cmdline = Str_dup(*cmdline ? cmdline : procname);
+        }
+
+        /********** /proc/PID/cgroup and /proc/PID/ns/pid **********/
+        if ((pflags & ProcessEngine_CollectContainer) && ! c->container.collected) {
+                _readContainer(pid, &c->container.namespace, &c->container.cgroup);
+                c->container.collected = true;
+        }
+
+        /* Set the data in ptree only if all process related reads succeeded (prevent partial data in the case that we failed during data gathering) */
+        pt->pid = pid;
+        pt->ppid = stat.ppid;
+        pt->cred.uid = c->uid;
+        pt->cred.euid = c->euid;
+        pt->cred.gid = c->gid;
+        pt->threads = stat.threads;
+        pt->uptime = starttime > 0 ? (systeminfo.time / 10. - (starttime + (time_t)(stat.starttime / hz))) : 0;
+        pt->cpu.time = (double)(stat.utime + stat.stime) / hz * 10.; // jiffies -> seconds = 1/hz
+        pt->cpu.sampled = sampled;
+        pt->memory.usage = (uint64_t)stat.rss * (uint64_t)page_size;
+        pt->zombie = stat.state == 'Z' ? true : false;
+        if (pflags & ProcessEngine_CollectCommandLine)
+                pt->cmdline = Str_dup(c->cmdline);
+        if (pflags & ProcessEngine_CollectContainer) {
+                pt->container.namespace = c->container.namespace;
+                pt->container.cgroup = Str_dup(c->container.cgroup);
+        }
+        c->pid = pid;
+        c->settled = pt->uptime > PROCESS_SETTLED;
+        return true;
+}
+
+
+/**
+ * Process collector worker arguments. Each worker fills its own slab [from, to) of the process tree and the new cache
+ */
+typedef struct ProcessCollector_T {
+        int from;
+        int to;
+        ProcessTree_T *pt;
+        ProcessCache_T *cache;
+        ProcessEngine_Flags pflags;
+        time_t starttime;
+} ProcessCollector_T;
+
+
+static void _collect(ProcessCollector_T *collector) {
+        for (int i = collector->from; i < collector->to; i++)
+                if (! _collectProcess(pidlist[i], &collector->pt[i], &collector->cache[i], collector->pflags, collector->starttime))
+                        memset(&collector->cache[i], 0, sizeof(ProcessCache_T)); // Drop partial data (pid 0 marks an unused cache slot)
+}
+
+
+/**
+ * Collector worker thread. The calling thread collects the first slab itself with _collect() and keeps its signal mask
+ */
+static void *_collectWorker(void *args) {
+        set_signal_block();
+        _collect(args);
+        return NULL;
+}
+
+
+/**
+ * Get the number of collector threads to use for the given number of processes. Small process tables are collected serially
+ * @param treesize Number of processes
+ * @return Number of threads, 1 for serial collection
+ */
+static int _collectorThreads(int treesize) {
+        int threads = MIN(Run.processEngine.collectorThreads, systeminfo.cpus);
+        return MAX(1, MIN(threads, treesize / PROCESS_COLLECTOR_CHUNK));
+}
+
+
 /**
  * Read all processes of the proc files system to initialize the process tree
  * @param reference reference of ProcessTree
@@ -181,124 +795,382 @@ boolean_t init_process_info_sysdep(void) {
  * @return treesize > 0 if succeeded otherwise 0
  */
 int initprocesstree_sysdep(ProcessTree_T **reference, ProcessEngine_Flags pflags) {
-        int                 rv, bytes = 0;
-        int                 treesize = 0;
-        int                 stat_pid = 0;
-        int                 stat_ppid = 0;
-        int                 stat_uid = 0;
-        int                 stat_euid = 0;
-        int                 stat_gid = 0;
-        char               *tmp = NULL;
-        char                procname[STRLEN];
-        char                buf[4096];
-        char                stat_item_state;
-        long                stat_item_cutime = 0;
-        long                stat_item_cstime = 0;
-        long                stat_item_rss = 0;
-        int                 stat_item_threads = 0;
-        glob_t              globbuf;
-        unsigned long       stat_item_utime = 0;
-        unsigned long       stat_item_stime = 0;
-        unsigned long long  stat_item_starttime = 0ULL;
-
         ASSERT(reference);
 
         /* Find all processes in the /proc directory */
-        if ((rv = glob("/proc/[0-9]*", 0, NULL, &globbuf))) {
-                LogError("system statistic error -- glob failed: %d (%s)\n", rv, STRERROR);
+        int treesize = _readPidList();
+        if (treesize <= 0)
                 return 0;
-        }
-
-        treesize = globbuf.gl_pathc;
 
         ProcessTree_T *pt = CALLOC(sizeof(ProcessTree_T), treesize);
+        ProcessCache_T *newcache = CALLOC(sizeof(ProcessCache_T), treesize);
 
         /* Insert data from /proc directory */
-        time_t starttime = get_starttime();
-        for (int i = 0; i < treesize; i++) {
-                stat_pid = atoi(globbuf.gl_pathv[i] + 6); // skip "/proc/"
+        time_t starttime = replay_starttime ? replay_starttime : get_starttime();
+        int threads = _collectorThreads(treesize);
+        ProcessCollector_T collectors[threads];
+        for (int i = 0; i < threads; i++)
+                collectors[i] = (ProcessCollector_T){.from = treesize * i / threads, .to = treesize * (i + 1) / threads, .pt = pt, .cache = newcache, .pflags = pflags, .starttime = starttime};
+        if (threads > 1) {
+                Thread_T workers[threads - 1];
+                for (int i = 1; i < threads; i++)
+                        Thread_create(workers[i - 1], _collectWorker, &collectors[i]);
+                _collect(&collectors[0]);
+                for (int i = 1; i < threads; i++)
+                        Thread_join(workers[i - 1]);
+        } else {
+                _collect(&collectors[0]);
+        }
 
-                /********** /proc/PID/stat **********/
-                if (! file_readProc(buf, sizeof(buf), "stat", stat_pid, NULL)) {
-                        DEBUG("system statistic error -- cannot read /proc/%d/stat\n", stat_pid);
-                        continue;
-                }
-                if (! (tmp = strrchr(buf, ')'))) {
-                        DEBUG("system statistic error -- file /proc/%d/stat parse error\n", stat_pid);
-                        continue;
-                }
-                *tmp = 0;
-                if (sscanf(buf, "%*d (%255s", procname) != 1) {
-                        DEBUG("system statistic error -- file /proc/%d/stat process name parse error\n", stat_pid);
-                        continue;
-                }
-                tmp += 2;
-                if (sscanf(tmp,
-                           "%c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu %ld %ld %*d %*d %d %*u %llu %*u %ld %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*u %*d %*d\n",
-                           &stat_item_state,
-                           &stat_ppid,
-                           &stat_item_utime,
-                           &stat_item_stime,
-                           &stat_item_cutime,
-                           &stat_item_cstime,
-                           &stat_item_threads,
-                           &stat_item_starttime,
-                           &stat_item_rss) != 9) {
-                        DEBUG("system statistic error -- file /proc/%d/stat parse error\n", stat_pid);
-                        continue;
-                }
+        /* Merge the slabs: compact the new cache and replace the old one */
+        int newcachesize = 0;
+        for (int i = 0; i < treesize; i++)
+                if (newcache[i].pid)
+                        newcache[newcachesize++] = newcache[i];
+        _cacheFree(&cache, &cachesize);
+        qsort(newcache, newcachesize, sizeof(ProcessCache_T), _cacheCompare);
+        cache = newcache;
+        cachesize = newcachesize;
 
-                /********** /proc/PID/status **********/
-                if (! file_readProc(buf, sizeof(buf), "status", stat_pid, NULL)) {
-                        DEBUG("system statistic error -- cannot read /proc/%d/status\n", stat_pid);
-                        continue;
+        *reference = pt;
+
+        return treesize;
+}
+
+
+/**
+ * Copy the /proc/PID/<name> file to the snapshot directory
+ * @param snapshot_fd The snapshot directory descriptor
+ * @param pid Process PID
+ * @param name File name
+ * @return true if succeeded otherwise false
+ */
+static boolean_t _recordProcessFile(int snapshot_fd, pid_t pid, const char *name) {
+        char path[64];
+        snprintf(path, sizeof(path), "%d/%s", pid, name);
+        int in = openat(proc_fd, path, O_RDONLY | O_CLOEXEC);
+        if (in < 0)
+                return false; // The process exited meanwhile
+        int out = openat(snapshot_fd, path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (out < 0) {
+                LogError("Cannot create snapshot file %s -- %s\n", path, STRERROR);
+                close(in);
+                return false;
+        }
+        char buf[8192];
+        boolean_t rv = true;
+        ssize_t n;
+        while ((n = read(in, buf, sizeof(buf))) > 0) {
+                if (write(out, buf, n) != n) {
+                        LogError("Cannot write snapshot file %s -- %s\n", path, STRERROR);
+                        rv = false;
+                        break;
                 }
-                if (! (tmp = strstr(buf, "Uid:"))) {
-                        DEBUG("system statistic error -- cannot find process uid\n");
-                        continue;
+        }
+        close(in);
+        close(out);
+        return rv;
+}
+
+
+/**
+ * Record the /proc files which one collector pass reads: the stat, status, cmdline and cgroup file of each process
+ * in a PID subdirectory, and the system start time
+ * @param directory The snapshot directory, it must not exist
+ * @return Number of recorded processes or -1 on error
+ */
+int recordprocesstree_sysdep(const char *directory) {
+        ASSERT(directory);
+        // A new directory, so no process directories of an older snapshot are left over
+        if (mkdir(directory, 0755) != 0) {
+                LogError("Cannot create snapshot directory %s -- %s\n", directory, STRERROR);
+                return -1;
+        }
+        int snapshot_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (snapshot_fd < 0) {
+                LogError("Cannot open snapshot directory %s -- %s\n", directory, STRERROR);
+                return -1;
+        }
+        int count = -1;
+        char buf[32];
+        int length = snprintf(buf, sizeof(buf), "%lld\n", (long long)get_starttime());
+        int fd = openat(snapshot_fd, SNAPSHOT_STARTTIME, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        boolean_t written = fd >= 0 && write(fd, buf, length) == length;
+        if (fd >= 0)
+                close(fd);
+        if (! written) {
+                LogError("Cannot write snapshot file %s/%s -- %s\n", directory, SNAPSHOT_STARTTIME, STRERROR);
+                goto done;
+        }
+        int treesize = _readPidList();
+        if (treesize < 0)
+                goto done;
+        count = 0;
+        for (int i = 0; i < treesize; i++) {
+                char path[32];
+                snprintf(path, sizeof(path), "%d", pidlist[i]);
+                if (mkdirat(snapshot_fd, path, 0755) != 0 && errno != EEXIST) {
+                        LogError("Cannot create snapshot directory %s/%s -- %s\n", directory, path, STRERROR);
+                        count = -1;
+                        goto done;
                 }
-                if (sscanf(tmp + 4, "\t%d\t%d", &stat_uid, &stat_euid) != 2) {
-                        DEBUG("system statistic error -- cannot read process uid\n");
+                if (! _recordProcessFile(snapshot_fd, pidlist[i], "stat")) {
+                        unlinkat(snapshot_fd, path, AT_REMOVEDIR); // The process exited meanwhile
                         continue;
                 }
-                if (! (tmp = strstr(buf, "Gid:"))) {
-                        DEBUG("system statistic error -- cannot find process gid\n");
-                        continue;
+                // The status, cmdline and cgroup files are read for new processes only, the replay reads them in the first cycle
+                _recordProcessFile(snapshot_fd, pidlist[i], "status");
+                _recordProcessFile(snapshot_fd, pidlist[i], "cmdline");
+                _recordProcessFile(snapshot_fd, pidlist[i], "cgroup");
+                count++;
+        }
+done:
+        close(snapshot_fd);
+        return count;
+}
+
+
+/**
+ * Read the processes from the snapshot directory instead of /proc from now on. The per-process files which were not
+ * recorded (such as ns/pid) are not found, the system-wide statistics are still read from /proc
+ * @param directory The snapshot directory
+ * @return true if succeeded otherwise false
+ */
+boolean_t replayprocesstree_sysdep(const char *directory) {
+        ASSERT(directory);
+        char buf[32];
+        int snapshot_fd = open(directory, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (snapshot_fd < 0) {
+                LogError("Cannot open snapshot directory %s -- %s\n", directory, STRERROR);
+                return false;
+        }
+        int fd = openat(snapshot_fd, SNAPSHOT_STARTTIME, O_RDONLY | O_CLOEXEC);
+        ssize_t n = fd >= 0 ? read(fd, buf, sizeof(buf) - 1) : -1;
+        if (fd >= 0)
+                close(fd);
+        if (n <= 0) {
+                LogError("Cannot read snapshot file %s/%s -- not a Linux process snapshot\n", directory, SNAPSHOT_STARTTIME);
+                close(snapshot_fd);
+                return false;
+        }
+        buf[n] = 0;
+        replay_starttime = (time_t)strtoll(buf, NULL, 10);
+        if (proc_fd >= 0)
+                close(proc_fd);
+        proc_fd = snapshot_fd;
+        _cacheFree(&cache, &cachesize);
+        return true;
+}
+
+
+/**
+ * Read the /proc/PID/status counter with the given "name:" prefix
+ * @return The counter value or -1 if not found
+ */
+static long long _statusCounter(const char *status, const char *name) {
+        int length = strlen(name);
+        for (const char *c = status; c && *c; c = strchr(c, '\n'), c = c ? c + 1 : NULL) {
+                if (! strncmp(c, name, length)) {
+                        for (c += length; *c == ' ' || *c == '\t'; c++)
+                                ;
+                        return (long long)_parseUnsigned((char *)c);
                 }
-                if (sscanf(tmp + 4, "\t%d", &stat_gid) != 1) {
-                        DEBUG("system statistic error -- cannot read process gid\n");
-                        continue;
+        }
+        return -1LL;
+}
+
+
+/**
+ * Count the open file descriptors in /proc/PID/fd
+ * @return The descriptors count or -1 if not available
+ */
+static int _countFileDescriptors(pid_t pid) {
+        char path[64], buf[8192];
+        snprintf(path, sizeof(path), "%d/fd", pid);
+        int fd = openat(proc_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("Cannot open proc directory /proc/%s -- %s\n", path, STRERROR);
+                return -1;
+        }
+        int count = 0;
+        long n;
+        while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+                for (long offset = 0; offset < n;) {
+                        struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + offset);
+                        offset += d->d_reclen;
+                        if (*d->d_name != '.')
+                                count++;
                 }
+        }
+        close(fd);
+        return n < 0 ? -1 : count;
+}
+
+
+/**
+ * Collect the extended process statistics (disk I/O, context switches and
+ * open file descriptors). The values which are not available are set to -1.
+ * @param pt Process tree entry with the PID set
+ * @return true if at least some statistics were collected otherwise false
+ */
+boolean_t getprocessdetail_sysdep(ProcessTree_T *pt) {
+        char buf[4096];
+        pt->detail.read_bytes = pt->detail.write_bytes = pt->detail.voluntary = pt->detail.nonvoluntary = -1LL;
+        if (_readProcessFile(buf, sizeof(buf), pt->pid, "io", NULL)) {
+                pt->detail.read_bytes = _statusCounter(buf, "read_bytes:");
+                pt->detail.write_bytes = _statusCounter(buf, "write_bytes:");
+        }
+        if (_readProcessFile(buf, sizeof(buf), pt->pid, "status", NULL)) {
+                pt->detail.voluntary = _statusCounter(buf, "voluntary_ctxt_switches:");
+                pt->detail.nonvoluntary = _statusCounter(buf, "nonvoluntary_ctxt_switches:");
+        }
+        pt->detail.filedescriptors = _countFileDescriptors(pt->pid);
+        return pt->detail.read_bytes >= 0 || pt->detail.voluntary >= 0 || pt->detail.filedescriptors >= 0;
+}
+
 
-                /********** /proc/PID/cmdline **********/
-                if (pflags & ProcessEngine_CollectCommandLine) {
-                        if (! file_readProc(buf, sizeof(buf), "cmdline", stat_pid, &bytes)) {
-                                DEBUG("system statistic error -- cannot read /proc/%d/cmdline\n", stat_pid);
+/**
+ * Collect the threads of the process from the /proc/PID/task/TID/stat files. The
+ * files are parsed with the process stat parser, the threads which exited while
+ * scanning are skipped.
+ * @param pid Process PID
+ * @param threads The threads array, resized as needed
+ * @param size The number of allocated threads array entries
+ * @return The number of threads collected or -1 if not available
+ */
+int getprocessthreads_sysdep(pid_t pid, ProcessThread_T **threads, int *size) {
+        char path[64], buf[8192];
+        snprintf(path, sizeof(path), "%d/task", pid);
+        int fd = openat(proc_fd, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("Cannot open proc directory /proc/%s -- %s\n", path, STRERROR);
+                return -1;
+        }
+        int count = 0;
+        long n;
+        while ((n = syscall(SYS_getdents64, fd, buf, sizeof(buf))) > 0) {
+                for (long offset = 0; offset < n;) {
+                        struct linux_dirent64 *d = (struct linux_dirent64 *)(buf + offset);
+                        offset += d->d_reclen;
+                        if (*d->d_name < '0' || *d->d_name > '9')
+                                continue;
+                        char stat[1024], *name;
+                        snprintf(path, sizeof(path), "%s/stat", d->d_name);
+                        int statfd = openat(fd, path, O_RDONLY | O_CLOEXEC);
+                        if (statfd < 0)
                                 continue;
+                        int bytes = (int)read(statfd, stat, sizeof(stat) - 1);
+                        close(statfd);
+                        if (bytes <= 0)
+                                continue;
+                        stat[bytes] = 0;
+                        ProcessStat_T ps = {};
+                        if (! _parseStat(stat, &name, &ps))
+                                continue;
+                        if (count >= *size) {
+                                *size = *size ? *size * 2 : 16;
+                                RESIZE(*threads, *size * sizeof(ProcessThread_T));
                         }
-                        for (int j = 0; j < (bytes - 1); j++) // The cmdline file contains argv elements/strings terminated separated by '\0' => join the string
-                                if (buf[j] == 0)
-                                        buf[j] = ' ';
-                        pt[i].cmdline = Str_dup(*buf ? buf : procname);
+                        ProcessThread_T *t = &(*threads)[count++];
+                        t->tid = (pid_t)_parseUnsigned(d->d_name);
+                        t->time = (double)(ps.utime + ps.stime) / hz;
+                        snprintf(t->name, sizeof(t->name), "%s", name);
                 }
+        }
+        close(fd);
+        return n < 0 ? -1 : count;
+}
 
-                /* Set the data in ptree only if all process related reads succeeded (prevent partial data in the case that continue was called during data gathering) */
-                pt[i].pid = stat_pid;
-                pt[i].ppid = stat_ppid;
-                pt[i].cred.uid = stat_uid;
-                pt[i].cred.euid = stat_euid;
-                pt[i].cred.gid = stat_gid;
-                pt[i].threads = stat_item_threads;
-                pt[i].uptime = starttime > 0 ? (systeminfo.time / 10. - (starttime + (time_t)(stat_item_starttime / hz))) : 0;
-                pt[i].cpu.time = (double)(stat_item_utime + stat_item_stime) / hz * 10.; // jiffies -> seconds = 1/hz
-                pt[i].memory.usage = (uint64_t)stat_item_rss * (uint64_t)page_size;
-                pt[i].zombie = stat_item_state == 'Z' ? true : false;
+
+/**
+ * Read the file from the cgroup directory
+ * @return true if succeeded otherwise false
+ */
+static boolean_t _readCgroupFile(char *buf, int size, const char *cgroup, const char *name) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s%s/%s", cgroup_root, cgroup, name);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+                DEBUG("Cannot open cgroup file %s -- %s\n", path, STRERROR);
+                return false;
         }
+        int bytes = (int)read(fd, buf, size - 1);
+        close(fd);
+        if (bytes < 0) {
+                DEBUG("Cannot read cgroup file %s -- %s\n", path, STRERROR);
+                return false;
+        }
+        buf[bytes] = 0;
+        return true;
+}
 
-        *reference = pt;
-        globfree(&globbuf);
 
-        return treesize;
+/**
+ * Collect the statistics of the cgroup v2 which the process belongs to. The cost
+ * doesn't depend on the number of processes in the cgroup, the kernel maintains
+ * the totals. The values which are not available are set to -1.
+ * @param pt Process tree entry with the PID set
+ * @return true if succeeded otherwise false
+ */
+boolean_t getprocesscgroup_sysdep(ProcessTree_T *pt) {
+        char buf[8192], cgroup[PATH_MAX];
+        pt->cgroup.memory = pt->cgroup.cpu_usec = pt->cgroup.read_bytes = pt->cgroup.write_bytes = -1LL;
+        Util_resetPressure(pt->cgroup.pressure);
+        if (! cgroup_root || ! _readProcessFile(buf, sizeof(buf), pt->pid, "cgroup", NULL))
+                return false;
+        // The unified hierarchy entry has the format "0::/path"
+        char *path = strstr(buf, "0::/");
+        if (! path || (path != buf && *(path - 1) != '\n'))
+                return false;
+        path += 3;
+        int length = (int)strcspn(path, "\n");
+        if (length >= (int)sizeof(cgroup))
+                return false;
+        memcpy(cgroup, path, length);
+        cgroup[length] = 0;
+        if (length == 1)
+                *cgroup = 0; // Root cgroup
+        if (_readCgroupFile(buf, sizeof(buf), cgroup, "memory.current"))
+                pt->cgroup.memory = (long long)_parseUnsigned(buf);
+        if (_readCgroupFile(buf, sizeof(buf), cgroup, "cpu.stat"))
+                pt->cgroup.cpu_usec = _statusCounter(buf, "usage_usec");
+        if (_readCgroupFile(buf, sizeof(buf), cgroup, "io.stat")) {
+                // One line per device: "<major>:<minor> rbytes=N wbytes=N rios=N wios=N ..."
+                pt->cgroup.read_bytes = pt->cgroup.write_bytes = 0LL;
+                for (char *c = buf; (c = strchr(c, ' ')); c++) {
+                        if (! strncmp(c + 1, "rbytes=", 7))
+                                pt->cgroup.read_bytes += _parseUnsigned(c + 8);
+                        else if (! strncmp(c + 1, "wbytes=", 7))
+                                pt->cgroup.write_bytes += _parseUnsigned(c + 8);
+                }
+        }
+        for (int i = 0; i <= Pressure_Last; i++)
+                if (_readCgroupFile(buf, sizeof(buf), cgroup, pressurefiles[i]))
+                        _parsePressure(buf, &pt->cgroup.pressure[i]);
+        return true;
+}
+
+
+/**
+ * Collect the system pressure stall information from /proc/pressure.
+ * The values which are not available are set to -1.
+ * @param si System info to update
+ * @return true if succeeded otherwise false (not available)
+ */
+boolean_t used_system_pressure_sysdep(SystemInfo_T *si) {
+        boolean_t rv = false;
+        Util_resetPressure(si->pressure);
+        if (pressure_available) {
+                char buf[STRLEN], name[32];
+                for (int i = 0; i <= Pressure_Last; i++) {
+                        snprintf(name, sizeof(name), "pressure/%s", pressurenames[i]);
+                        if (file_readProc(buf, sizeof(buf), name, -1, NULL)) {
+                                _parsePressure(buf, &si->pressure[i]);
+                                rv = true;
+                        }
+                }
+        }
+        return rv;
 }
 
 
@@ -333,50 +1205,77 @@ int getloadavg_sysdep(double *loadv, int nelem) {
  * @return: true if successful, false if failed
  */
 boolean_t used_system_memory_sysdep(SystemInfo_T *si) {
-        char          *ptr;
-        char           buf[2048];
-        unsigned long  mem_free = 0UL;
-        unsigned long  buffers = 0UL;
-        unsigned long  cached = 0UL;
-        unsigned long  slabreclaimable = 0UL;
-        unsigned long  swap_total = 0UL;
-        unsigned long  swap_free = 0UL;
+        char buf[8192];
 
         if (! file_readProc(buf, sizeof(buf), "meminfo", -1, NULL)) {
-                LogError("system statistic error -- cannot get real memory free amount\n");
+                LogError("system statistic error -- cannot read /proc/meminfo\n");
                 goto error;
         }
 
+        // One pass over the "Name:   value [kB]" lines, all fields go to the table
+        si->meminfo.count = 0;
+        for (char *line = buf, *next; *line && si->meminfo.count < MEMINFO_MAX; line = next) {
+                if ((next = strchr(line, '\n')))
+                        *next++ = 0;
+                else
+                        next = line + strlen(line);
+                char *colon = strchr(line, ':');
+                if (! colon || colon == line || colon - line >= MEMINFO_NAMELEN)
+                        continue;
+                char *unit;
+                unsigned long long value = strtoull(colon + 1, &unit, 10);
+                if (unit == colon + 1)
+                        continue;
+                while (*unit == ' ')
+                        unit++;
+                boolean_t bytes = Str_startsWith(unit, "kB");
+                int i = si->meminfo.count++;
+                strncpy(si->meminfo.field[i].name, line, colon - line);
+                si->meminfo.field[i].name[colon - line] = 0;
+                si->meminfo.field[i].bytes = bytes;
+                si->meminfo.field[i].value = bytes ? value * 1024ULL : value;
+        }
+
         /* Memory */
-        if (! (ptr = strstr(buf, "MemFree:")) || sscanf(ptr + 8, "%ld", &mem_free) != 1) {
+        uint64_t mem_free, available;
+        if (! _getMeminfo(si, "MemFree", &mem_free)) {
                 LogError("system statistic error -- cannot get real memory free amount\n");
                 goto error;
         }
-        if (! (ptr = strstr(buf, "Buffers:")) || sscanf(ptr + 8, "%ld", &buffers) != 1)
-                DEBUG("system statistic error -- cannot get real memory buffers amount\n");
-        if (! (ptr = strstr(buf, "Cached:")) || sscanf(ptr + 7, "%ld", &cached) != 1)
-                DEBUG("system statistic error -- cannot get real memory cache amount\n");
-        if (! (ptr = strstr(buf, "SReclaimable:")) || sscanf(ptr + 13, "%ld", &slabreclaimable) != 1)
-                DEBUG("system statistic error -- cannot get slab reclaimable memory amount\n");
-        si->total_mem = systeminfo.mem_max - (uint64_t)(mem_free + buffers + cached + slabreclaimable) * 1024;
+        if (_getMeminfo(si, "MemAvailable", &available)) {
+                // Linux 3.14 and later: the kernel estimate of the memory available without swapping
+                si->total_mem = si->mem_max > available ? si->mem_max - available : 0ULL;
+        } else {
+                uint64_t buffers = 0ULL, cached = 0ULL, slabreclaimable = 0ULL, usable;
+                if (! _getMeminfo(si, "Buffers", &buffers))
+                        DEBUG("system statistic error -- cannot get real memory buffers amount\n");
+                if (! _getMeminfo(si, "Cached", &cached))
+                        DEBUG("system statistic error -- cannot get real memory cache amount\n");
+                if (! _getMeminfo(si, "SReclaimable", &slabreclaimable))
+                        DEBUG("system statistic error -- cannot get slab reclaimable memory amount\n");
+                usable = mem_free + buffers + cached + slabreclaimable;
+                si->total_mem = si->mem_max > usable ? si->mem_max - usable : 0ULL;
+        }
 
         /* Swap */
-        if (! (ptr = strstr(buf, "SwapTotal:")) || sscanf(ptr + 10, "%ld", &swap_total) != 1) {
+        uint64_t swap_total, swap_free;
+        if (! _getMeminfo(si, "SwapTotal", &swap_total)) {
                 LogError("system statistic error -- cannot get swap total amount\n");
                 goto error;
         }
-        if (! (ptr = strstr(buf, "SwapFree:")) || sscanf(ptr + 9, "%ld", &swap_free) != 1) {
+        if (! _getMeminfo(si, "SwapFree", &swap_free)) {
                 LogError("system statistic error -- cannot get swap free amount\n");
                 goto error;
         }
-        si->swap_max = (uint64_t)swap_total * 1024;
-        si->total_swap = (uint64_t)(swap_total - swap_free) * 1024;
+        si->swap_max = swap_total;
+        si->total_swap = swap_total > swap_free ? swap_total - swap_free : 0ULL;
 
         return true;
 
 error:
         si->total_mem = 0ULL;
         si->swap_max = 0ULL;
+        si->meminfo.count = 0;
         return false;
 }
 
@@ -386,65 +1285,57 @@ error:
  * @return: true if successful, false if failed (or not available)
  */
 boolean_t used_system_cpu_sysdep(SystemInfo_T *si) {
-        boolean_t rv;
-        unsigned long long cpu_total;
-        unsigned long long cpu_user;
-        unsigned long long cpu_nice;
-        unsigned long long cpu_syst;
-        unsigned long long cpu_idle;
-        unsigned long long cpu_wait;
-        unsigned long long cpu_irq;
-        unsigned long long cpu_softirq;
-        char buf[STRLEN];
+        unsigned long long ticks[CPU_TICKS];
 
-        if (! file_readProc(buf, sizeof(buf), "stat", -1, NULL)) {
+        // The aggregate and the per-CPU counters are parsed from the same read
+        if (! file_readProc(statbuf, statsize, "stat", -1, NULL)) {
                 LogError("system statistic error -- cannot read /proc/stat\n");
                 goto error;
         }
 
-        rv = sscanf(buf, "cpu %llu %llu %llu %llu %llu %llu %llu",
-                    &cpu_user,
-                    &cpu_nice,
-                    &cpu_syst,
-                    &cpu_idle,
-                    &cpu_wait,
-                    &cpu_irq,
-                    &cpu_softirq);
-        if (rv < 4) {
+        char *c = statbuf + 3;
+        if (! Str_startsWith(statbuf, "cpu ") || _parseTicks(&c, ticks) < 4) {
                 LogError("system statistic error -- cannot read cpu usage\n");
                 goto error;
-        } else if (rv == 4) {
-                /* linux 2.4.x doesn't support these values */
-                cpu_wait    = 0;
-                cpu_irq     = 0;
-                cpu_softirq = 0;
         }
 
-        cpu_total = cpu_user + cpu_nice + cpu_syst + cpu_idle + cpu_wait + cpu_irq + cpu_softirq;
-        cpu_user  = cpu_user + cpu_nice;
+        // linux 2.4.x doesn't support the wait, irq, softirq and steal counters, they're zero
+        unsigned long long cpu_user  = ticks[0] + ticks[1];
+        unsigned long long cpu_syst  = ticks[2];
+        unsigned long long cpu_wait  = ticks[4];
+        unsigned long long cpu_steal = ticks[7];
+        unsigned long long cpu_total = 0ULL;
+        for (int i = 0; i < CPU_TICKS; i++)
+                cpu_total += ticks[i];
 
         if (old_cpu_total == 0) {
                 si->total_cpu_user_percent = -1.;
                 si->total_cpu_syst_percent = -1.;
                 si->total_cpu_wait_percent = -1.;
+                si->total_cpu_steal_percent = -1.;
         } else {
                 unsigned long long delta = cpu_total - old_cpu_total;
 
                 si->total_cpu_user_percent = 100. * (double)(cpu_user - old_cpu_user) / delta;
                 si->total_cpu_syst_percent = 100. * (double)(cpu_syst - old_cpu_syst) / delta;
                 si->total_cpu_wait_percent = 100. * (double)(cpu_wait - old_cpu_wait) / delta;
+                si->total_cpu_steal_percent = 100. * (double)(cpu_steal - old_cpu_steal) / delta;
         }
 
         old_cpu_user  = cpu_user;
         old_cpu_syst  = cpu_syst;
         old_cpu_wait  = cpu_wait;
+        old_cpu_steal = cpu_steal;
         old_cpu_total = cpu_total;
+
+        _updateCpus(si, c);
         return true;
 
 error:
         si->total_cpu_user_percent = 0.;
         si->total_cpu_syst_percent = 0.;
         si->total_cpu_wait_percent = 0.;
+        si->total_cpu_steal_percent = 0.;
         return false;
 }
 
@@ -286,3 +286,66 @@ boolean_t used_system_cpu_sysdep(SystemInfo_T *si) {
         return true;
 }
 
+
+/**
+ * The extended process statistics (disk I/O, context switches and open file
+ * descriptors) are not collected on this platform.
+ * @param pt Process tree entry
+ * @return false
+ */
+boolean_t getprocessdetail_sysdep(ProcessTree_T *pt) {
+        return false;
+}
+
+
+/**
+ * The pressure stall information is available on Linux only.
+ * @param si System info
+ * @return false
+ */
+boolean_t used_system_pressure_sysdep(SystemInfo_T *si) {
+        return false;
+}
+
+
+/**
+ * The cgroup statistics are available on Linux only.
+ * @param pt Process tree entry
+ * @return false
+ */
+boolean_t getprocesscgroup_sysdep(ProcessTree_T *pt) {
+        return false;
+}
+
+
+/**
+ * The per-thread statistics are available on Linux only.
+ * @param pid Process PID
+ * @param threads The threads array
+ * @param size The number of allocated threads array entries
+ * @return -1
+ */
+int getprocessthreads_sysdep(pid_t pid, ProcessThread_T **threads, int *size) {
+        return -1;
+}
+
+
+/**
+ * Process snapshots are not supported on this platform
+ * @return -1
+ */
+int recordprocesstree_sysdep(const char *directory) {
+        LogError("Process snapshots are not supported on this platform\n");
+        return -1;
+}
+
+
+/**
+ * Process snapshots are not supported on this platform
+ * @return false
+ */
+boolean_t replayprocesstree_sysdep(const char *directory) {
+        LogError("Process snapshots are not supported on this platform\n");
+        return false;
+}
+
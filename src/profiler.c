@@ -0,0 +1,260 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include "monit.h"
+#include "profiler.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+
+
+/**
+ *  Poll cycle phases and service checks latency histograms.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SUBBUCKETS 4                              // Buckets per power of two
+#define BUCKETS (35 * SUBBUCKETS)                // Up to 2^35 us (about 9.5 hours)
+
+
+typedef struct Histogram_T {
+        unsigned long long count;
+        unsigned long long sum;                            /**< Microseconds */
+        unsigned long long min;
+        unsigned long long max;
+        unsigned long long last;
+        unsigned int buckets[BUCKETS];
+} Histogram_T;
+
+
+typedef struct ServiceLatency_T {
+        Service_T service;
+        unsigned long long p99;
+} ServiceLatency_T;
+
+
+static const char *phasenames[] = {"cycle", "event queue", "system info", "process tree", "stat batch", "ping batch", "udp batch", "service checks", "state save"};
+
+
+static Mutex_T mutex = PTHREAD_MUTEX_INITIALIZER;
+static Histogram_T phases[Phase_Last + 1];
+static Histogram_T types[Service_Last + 1];
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * The values 0-3 have own buckets, the higher values are split by the most
+ * significant bit and the two bits below it
+ */
+static int _bucket(unsigned long long value) {
+        if (value < SUBBUCKETS)
+                return (int)value;
+        int msb = 63 - __builtin_clzll(value);
+        int index = (msb - 1) * SUBBUCKETS + (int)((value >> (msb - 2)) & (SUBBUCKETS - 1));
+        return index < BUCKETS ? index : BUCKETS - 1;
+}
+
+
+/**
+ * @return The highest value which falls into the bucket
+ */
+static unsigned long long _bucketLimit(int index) {
+        if (index < SUBBUCKETS)
+                return index;
+        int msb = index / SUBBUCKETS + 1;
+        return ((unsigned long long)(SUBBUCKETS + index % SUBBUCKETS + 1) << (msb - 2)) - 1;
+}
+
+
+static void _record(Histogram_T *h, long long elapsed) {
+        unsigned long long value = elapsed > 0 ? elapsed : 0;
+        if (! h->count || value < h->min)
+                h->min = value;
+        if (value > h->max)
+                h->max = value;
+        h->last = value;
+        h->sum += value;
+        h->count++;
+        h->buckets[_bucket(value)]++;
+}
+
+
+static unsigned long long _percentile(Histogram_T *h, double percentile) {
+        unsigned long long rank = (unsigned long long)(h->count * percentile / 100.), total = 0;
+        for (int i = 0; i < BUCKETS; i++) {
+                total += h->buckets[i];
+                if (total > rank) {
+                        unsigned long long limit = _bucketLimit(i);
+                        return limit < h->max ? limit : h->max;
+                }
+        }
+        return h->max;
+}
+
+
+static char *_time(unsigned long long micro, char s[23]) {
+        return Str_milliToTime(micro / 1000., s);
+}
+
+
+static void _printHeader(StringBuffer_T sb, const char *title) {
+        StringBuffer_append(sb, "%-32s %10s %10s %10s %10s %10s %10s %10s %10s\n", title, "count", "last", "min", "avg", "p50", "p90", "p99", "max");
+}
+
+
+static void _printHistogram(StringBuffer_T sb, const char *name, Histogram_T *h) {
+        if (h->count)
+                StringBuffer_append(sb, "%-32.32s %10llu %10s %10s %10s %10s %10s %10s %10s\n",
+                        name,
+                        h->count,
+                        _time(h->last, (char[23]){}),
+                        _time(h->min, (char[23]){}),
+                        _time(h->sum / h->count, (char[23]){}),
+                        _time(_percentile(h, 50), (char[23]){}),
+                        _time(_percentile(h, 90), (char[23]){}),
+                        _time(_percentile(h, 99), (char[23]){}),
+                        _time(h->max, (char[23]){}));
+}
+
+
+static int _compareLatency(const void *a, const void *b) {
+        unsigned long long x = ((const ServiceLatency_T *)a)->p99;
+        unsigned long long y = ((const ServiceLatency_T *)b)->p99;
+        return x > y ? -1 : x < y ? 1 : 0;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+long long Profiler_now(void) {
+#ifdef CLOCK_MONOTONIC
+        struct timespec t;
+        if (clock_gettime(CLOCK_MONOTONIC, &t) == 0)
+                return (long long)t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+#endif
+        return Time_micro();
+}
+
+
+void Profiler_phase(Profiler_Phase phase, long long elapsed) {
+        LOCK(mutex)
+        {
+                _record(&phases[phase], elapsed);
+        }
+        END_LOCK;
+}
+
+
+void Profiler_check(Service_T s, long long elapsed) {
+        ASSERT(s);
+        LOCK(mutex)
+        {
+                // In the low memory mode only the service type histograms are kept
+                if (! (Run.flags & Run_LowMemory)) {
+                        if (! s->latency)
+                                NEW(s->latency);
+                        _record(s->latency, elapsed);
+                }
+                _record(&types[s->type], elapsed);
+        }
+        END_LOCK;
+}
+
+
+void Profiler_print(StringBuffer_T sb, int limit) {
+        ASSERT(sb);
+        LOCK(mutex)
+        {
+                _printHeader(sb, "Cycle phase");
+                for (int i = 0; i <= Phase_Last; i++)
+                        _printHistogram(sb, phasenames[i], &phases[i]);
+                StringBuffer_append(sb, "\n");
+                _printHeader(sb, "Service type");
+                for (int i = 0; i <= Service_Last; i++)
+                        _printHistogram(sb, servicetypes[i], &types[i]);
+                int count = 0;
+                for (Service_T s = servicelist; s; s = s->next)
+                        if (s->latency)
+                                count++;
+                if (count) {
+                        ServiceLatency_T *services = CALLOC(count, sizeof(ServiceLatency_T));
+                        int i = 0;
+                        for (Service_T s = servicelist; s && i < count; s = s->next) {
+                                if (s->latency) {
+                                        services[i].service = s;
+                                        services[i++].p99 = _percentile(s->latency, 99);
+                                }
+                        }
+                        qsort(services, count, sizeof(ServiceLatency_T), _compareLatency);
+                        StringBuffer_append(sb, "\n");
+                        _printHeader(sb, "Service");
+                        for (i = 0; i < count && (! limit || i < limit); i++)
+                                _printHistogram(sb, services[i].service->name, services[i].service->latency);
+                        FREE(services);
+                }
+        }
+        END_LOCK;
+}
+
+
+size_t Profiler_memory(void) {
+        size_t size = sizeof(phases) + sizeof(types);
+        LOCK(mutex)
+        {
+                for (Service_T s = servicelist; s; s = s->next)
+                        if (s->latency)
+                                size += sizeof(Histogram_T);
+        }
+        END_LOCK;
+        return size;
+}
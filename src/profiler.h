@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_PROFILER_H
+#define MONIT_PROFILER_H
+
+
+/**
+ * Poll cycle profiler. The duration of each cycle phase and of each service
+ * check is measured with the monotonic clock and recorded in latency
+ * histograms with logarithmic buckets (four buckets per power of two, so the
+ * percentiles are accurate to 25%). A histogram is kept per cycle phase, per
+ * service type and per service, the report is available via the HTTP
+ * interface ('monit report metrics').
+ *
+ * @file
+ */
+
+
+typedef enum {
+        Phase_Cycle = 0,                                  /**< The whole validate() */
+        Phase_EventQueue,                             /**< Event_queue_process() */
+        Phase_SystemInfo,                              /**< update_system_info() */
+        Phase_ProcessTree,                                /**< ProcessTree_init() */
+        Phase_StatBatch,                                     /**< StatBatch_run() */
+        Phase_PingBatch,                                          /**< Ping_run() */
+        Phase_UdpBatch,                                       /**< UdpBatch_run() */
+        Phase_Checks,                                   /**< All service checks */
+        Phase_StateSave,                                       /**< State_save() */
+        Phase_Last = Phase_StateSave
+} __attribute__((__packed__)) Profiler_Phase;
+
+
+/**
+ * Get the monotonic time, which is not affected by the system clock changes
+ * @return The monotonic time in microseconds
+ */
+long long Profiler_now(void);
+
+
+/**
+ * Record the duration of a cycle phase
+ * @param phase The cycle phase
+ * @param elapsed The phase duration in microseconds
+ */
+void Profiler_phase(Profiler_Phase phase, long long elapsed);
+
+
+/**
+ * Record the duration of a service check, both in the service and in the
+ * service type histogram
+ * @param s A service
+ * @param elapsed The check duration in microseconds
+ */
+void Profiler_check(Service_T s, long long elapsed);
+
+
+/**
+ * Print the report: the phases, the service types and the services sorted
+ * by the 99th percentile of the check duration, the slowest first
+ * @param sb The output buffer
+ * @param limit Print at most limit services, 0 means all
+ */
+void Profiler_print(StringBuffer_T sb, int limit);
+
+
+/**
+ * Get the memory used by the histograms
+ * @return The size in bytes
+ */
+size_t Profiler_memory(void);
+
+
+#endif
@@ -48,18 +48,22 @@
  *
  *  @file
  */
-void check_dns(Socket_T socket) {
-        int            offset_request  = 0;
-        int            offset_response = 0;
-        int            rc;
-        unsigned char  buf[STRLEN];
-        unsigned char *response = NULL;
-        unsigned char  request[19] = {
-                0x00,          /** Request Length field for DNS via TCP */
-                0x11,
 
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define DNS_REQUEST  17
+#define DNS_RESPONSE 14
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int request_dns(Port_T P, unsigned char *buf, int size, uint64_t id) {
+        unsigned char request[DNS_REQUEST] = {
                 0x00,                                /** Transaction ID */
-                0x01,
+                0x00,
 
                 0x01,                                         /** Flags */
                 0x00,
@@ -86,6 +90,50 @@ void check_dns(Socket_T socket) {
                 0x00,                                     /** Class: IN */
                 0x01
         };
+        ASSERT(size >= (int)sizeof(request));
+        request[0] = (id >> 8) & 0xff;
+        request[1] = id & 0xff;
+        memcpy(buf, request, sizeof(request));
+        return sizeof(request);
+}
+
+
+void response_dns(Port_T P, const unsigned char *response, int length) {
+        int rc;
+
+        if (length < DNS_RESPONSE)
+                THROW(IOException, "DNS: response too short -- received %d bytes, expected at least %d", length, DNS_RESPONSE);
+
+        /* Compare flags: */
+
+        /* Response type */
+        if ((response[2] & 0x80) != 0x80)
+                THROW(IOException, "DNS: invalid response type: 0x%x", response[2] & 0x80);
+
+        /* Response code: accept request refusal as correct response as the server may disallow NS root query but the negative response means, it reacts to requests */
+        rc = response[3] & 0x0F;
+        if (rc != 0x0 && rc != 0x5)
+                THROW(IOException, "DNS: invalid response code: 0x%x", rc);
+
+        /* Compare queries count (it should be one as in our request): */
+        if (response[4] != 0x00 && response[5] != 0x01)
+                THROW(IOException, "DNS: invalid query count in response -- received 0x%x%x, expected 1", response[4], response[5]);
+
+        /* Compare answer and authority resource record counts (they shouldn't be both zero) */
+        if (rc == 0 && response[6] == 0x00 && response[7] == 0x00 && response[8] == 0x00 && response[9] == 0x00)
+                THROW(IOException, "DNS: no answer or authority records returned");
+}
+
+
+void check_dns(Socket_T socket) {
+        int            offset_request  = 0;
+        int            offset_response = 0;
+        int            n;
+        unsigned char  buf[STRLEN];
+        unsigned char  request[2 + DNS_REQUEST] = {
+                0x00,          /** Request Length field for DNS via TCP */
+                DNS_REQUEST
+        };
 
         ASSERT(socket);
 
@@ -103,36 +151,18 @@ void check_dns(Socket_T socket) {
                         break;
         }
 
+        request_dns(Socket_getPort(socket), request + 2, sizeof(request) - 2, 1);
         if (Socket_write(socket, (unsigned char *)request + offset_request, sizeof(request) - offset_request) < 0)
                 THROW(IOException, "DNS: error sending query -- %s", STRERROR);
 
         /* Response should have at least 14 bytes */
-        if (Socket_read(socket, (unsigned char *)buf, 15) <= 14)
+        if ((n = Socket_read(socket, (unsigned char *)buf, offset_response + DNS_RESPONSE + 1)) <= offset_response + DNS_RESPONSE)
                 THROW(IOException, "DNS: error receiving response -- %s", STRERROR);
 
-        response = buf + offset_response;
-
         /* Compare transaction ID (it should be the same as in our request): */
-        if (response[0] != 0x00 && response[1] != 0x01)
-                THROW(IOException, "DNS: response transaction ID mismatch -- received 0x%x%x, expected 0x1", response[0], response[1]);
-
-        /* Compare flags: */
+        if (buf[offset_response] != 0x00 || buf[offset_response + 1] != 0x01)
+                THROW(IOException, "DNS: response transaction ID mismatch -- received 0x%x%x, expected 0x1", buf[offset_response], buf[offset_response + 1]);
 
-        /* Response type */
-        if ((response[2] & 0x80) != 0x80)
-                THROW(IOException, "DNS: invalid response type: 0x%x", response[2] & 0x80);
-
-        /* Response code: accept request refusal as correct response as the server may disallow NS root query but the negative response means, it reacts to requests */
-        rc = response[3] & 0x0F;
-        if (rc != 0x0 && rc != 0x5)
-                THROW(IOException, "DNS: invalid response code: 0x%x", rc);
-
-        /* Compare queries count (it should be one as in our request): */
-        if (response[4] != 0x00 && response[5] != 0x01)
-                THROW(IOException, "DNS: invalid query count in response -- received 0x%x%x, expected 1", response[4], response[5]);
-
-        /* Compare answer and authority resource record counts (they shouldn't be both zero) */
-        if (rc == 0 && response[6] == 0x00 && response[7] == 0x00 && response[8] == 0x00 && response[9] == 0x00)
-                THROW(IOException, "DNS: no answer or authority records returned");
+        response_dns(Socket_getPort(socket), buf + offset_response, n - offset_response);
 }
 
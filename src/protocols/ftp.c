@@ -44,19 +44,15 @@ void check_ftp(Socket_T socket) {
 
         ASSERT(socket);
 
-        do {
-                if (! Socket_readLine(socket, buf, STRLEN))
-                        THROW(IOException, "FTP: error receiving data -- %s", STRERROR);
-                Str_chomp(buf);
-        } while (buf[3] == '-'); // Discard multi-line response
-        if (sscanf(buf, "%d", &status) != 1 || status != 220)
+        if ((status = Socket_readResponse(socket, buf, sizeof(buf), NULL, NULL)) < 0)
+                THROW(IOException, "FTP: error receiving data -- %s", STRERROR);
+        if (status != 220)
                 THROW(IOException, "FTP greeting error: %s", buf);
         if (Socket_print(socket, "QUIT\r\n") < 0)
                 THROW(IOException, "FTP: error sending data -- %s", STRERROR);
-        if (! Socket_readLine(socket, buf, STRLEN))
+        if ((status = Socket_readResponse(socket, buf, sizeof(buf), NULL, NULL)) < 0)
                 THROW(IOException, "FTP: error receiving data -- %s", STRERROR);
-        Str_chomp(buf);
-        if (sscanf(buf, "%d", &status) != 1 || status != 221)
+        if (status != 221)
                 THROW(IOException, "FTP quit error: %s", buf);
 }
 
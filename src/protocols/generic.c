@@ -35,6 +35,7 @@
 #include "protocol.h"
 
 // libmonit
+#include "system/Time.h"
 #include "exceptions/IOException.h"
 
 /* Escape zero i.e. '\0' in expect buffer with "\0" so zero can be tested in expect strings as "\0". If there are no '\0' in the buffer it is returned as it is */
@@ -59,6 +60,101 @@ static char *_escapeZeroInExpectBuffer(char *s, int n) {
 }
 
 
+/* Append the received byte to the expect buffer, '\0' is escaped as "\0" like in _escapeZeroInExpectBuffer() */
+static void _appendExpectBuffer(char *buf, int *length, int c) {
+        if (c == 0) {
+                buf[(*length)++] = '\\';
+                buf[(*length)++] = '0';
+        } else {
+                buf[(*length)++] = c;
+        }
+        buf[*length] = 0;
+}
+
+
+/* Match the expect against the received data, ending at each line end in turn. Returns the length of the first matching part, or 0 if there is no match yet */
+static int _matchExpectBuffer(regex_t *expect, char *buf, int length) {
+        for (char *end = buf; end < buf + length;) {
+                char *eol = memchr(end, '\n', buf + length - end);
+                end = eol ? eol + 1 : buf + length;
+                char c = *end;
+                *end = 0;
+                int rv = regexec(expect, buf, 0, NULL, 0);
+                *end = c;
+                if (rv == 0)
+                        return (int)(end - buf);
+        }
+        return 0;
+}
+
+
+/* Pipelined dialogue: all the strings are sent at once, then each expect consumes the received data up to the end of the line where it matched */
+static void _pipeline(Socket_T socket, Generic_T sendexpect) {
+        long long start = Time_micro();
+        long long deadline = start / 1000 + Socket_getTimeout(socket);
+        int timeout = Socket_getTimeout(socket);
+        char timeline[STRLEN] = {};
+        int step = 1;
+        for (Generic_T g = sendexpect; g; g = g->next, step++) {
+                if (g->send) {
+                        char *X = Str_dup(g->send);
+                        int l = Util_handle0Escapes(X);
+                        int rv = Socket_write(socket, X, l);
+                        FREE(X);
+                        if (rv < 0)
+                                THROW(IOException, "GENERIC: step %d -- error sending data -- %s", step, STRERROR);
+                        double elapsed = (Time_micro() - start) / 1000.;
+                        snprintf(timeline + strlen(timeline), sizeof(timeline) - strlen(timeline), "%s%d sent %.3f ms", *timeline ? ", " : "", step, elapsed);
+                        DEBUG("GENERIC: [%.3f ms] step %d sent: '%s'\n", elapsed, step, g->send);
+                }
+        }
+        char *buf = CALLOC(sizeof(char), Run.limits.sendExpectBuffer + 1);
+        int length = 0;
+        TRY
+        {
+                step = 1;
+                for (Generic_T g = sendexpect; g; g = g->next, step++) {
+                        if (! g->expect)
+                                continue;
+                        int matched;
+                        while (! (matched = _matchExpectBuffer(g->expect, buf, length))) {
+                                const char *error = NULL;
+                                long long remaining = deadline - Time_milli();
+                                if (length + 2 > Run.limits.sendExpectBuffer) {
+                                        error = "the expect buffer is full";
+                                } else if (remaining <= 0) {
+                                        error = "no match within the timeout";
+                                } else {
+                                        Socket_setTimeout(socket, (int)remaining);
+                                        int c = Socket_readByte(socket);
+                                        if (c < 0) {
+                                                error = Time_milli() >= deadline ? "no match within the timeout" : "connection closed";
+                                        } else {
+                                                _appendExpectBuffer(buf, &length, c);
+                                                // Take the rest of the received data without waiting
+                                                while (Socket_pending(socket) > 0 && length + 2 <= Run.limits.sendExpectBuffer)
+                                                        _appendExpectBuffer(buf, &length, Socket_readByte(socket));
+                                        }
+                                }
+                                if (error)
+                                        THROW(IOException, "GENERIC: step %d failed at %.3f ms -- %s, received [%s] (steps: %s)", step, (Time_micro() - start) / 1000., error, Str_trunc(Str_trim(buf), STRLEN / 2), timeline);
+                        }
+                        double elapsed = (Time_micro() - start) / 1000.;
+                        snprintf(timeline + strlen(timeline), sizeof(timeline) - strlen(timeline), "%s%d matched %.3f ms", *timeline ? ", " : "", step, elapsed);
+                        DEBUG("GENERIC: [%.3f ms] step %d successfully received: '%.*s'\n", elapsed, step, MIN(matched, STRLEN), buf);
+                        length -= matched;
+                        memmove(buf, buf + matched, length + 1);
+                }
+        }
+        FINALLY
+        {
+                Socket_setTimeout(socket, timeout);
+                FREE(buf);
+        }
+        END_TRY;
+}
+
+
 /**
  *  Generic service test.
  *
@@ -68,8 +164,14 @@ void check_generic(Socket_T socket) {
         ASSERT(socket);
 
         Generic_T g = NULL;
-        if (Socket_getPort(socket))
-                g = ((Port_T)(Socket_getPort(socket)))->parameters.generic.sendexpect;
+        if (Socket_getPort(socket)) {
+                Port_T P = Socket_getPort(socket);
+                g = P->parameters.generic.sendexpect;
+                if (P->parameters.generic.pipeline) {
+                        _pipeline(socket, g);
+                        return;
+                }
+        }
 
         char *buf = CALLOC(sizeof(char), Run.limits.sendExpectBuffer + 1);
 
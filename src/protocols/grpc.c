@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "protocol.h"
+#include "http2.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/IOException.h"
+
+
+/**
+ *  A gRPC health check (grpc.health.v1.Health/Check).
+ *
+ *  The Check call of each service is sent as a concurrent stream on one
+ *  HTTP/2 connection, the port fails unless all the services are SERVING.
+ *  Without services the overall server health is checked (the empty
+ *  service name). The port timeout is sent to the server as the call
+ *  deadline (grpc-timeout).
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define GRPC_PATH "/grpc.health.v1.Health/Check"
+#define GRPC_LIMIT 1024
+
+
+/* The grpc.health.v1.HealthCheckResponse.ServingStatus values */
+static const char *servingStatus[] = {"UNKNOWN", "SERVING", "NOT_SERVING", "SERVICE_UNKNOWN"};
+
+
+/* The gRPC status codes */
+static const char *statusCodes[] = {
+        "OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED", "NOT_FOUND", "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED",
+        "FAILED_PRECONDITION", "ABORTED", "OUT_OF_RANGE", "UNIMPLEMENTED", "INTERNAL", "UNAVAILABLE", "DATA_LOSS", "UNAUTHENTICATED"
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/* Read a protobuf varint, return the position after it or NULL if truncated */
+static const unsigned char *_varint(const unsigned char *p, const unsigned char *end, unsigned long long *value) {
+        *value = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+                unsigned char c = *p++;
+                *value |= (unsigned long long)(c & 0x7f) << shift;
+                if (! (c & 0x80))
+                        return p;
+        }
+        return NULL;
+}
+
+
+/**
+ * Parse the HealthCheckResponse message: field 1 (varint) is the serving status, the other fields are skipped
+ * @return The serving status or -1 if the message is malformed
+ */
+static int _parseResponse(const unsigned char *message, int length) {
+        int status = 0; // A missing field has the default value UNKNOWN
+        const unsigned char *p = message, *end = message + length;
+        while (p < end) {
+                unsigned long long key, value;
+                if (! (p = _varint(p, end, &key)))
+                        return -1;
+                switch (key & 7) {
+                        case 0:
+                                if (! (p = _varint(p, end, &value)))
+                                        return -1;
+                                if (key >> 3 == 1)
+                                        status = value > 3 ? 0 : (int)value;
+                                break;
+                        case 1:
+                                p += 8;
+                                break;
+                        case 2:
+                                if (! (p = _varint(p, end, &value)) || value > (unsigned long long)(end - p))
+                                        return -1;
+                                p += value;
+                                break;
+                        case 5:
+                                p += 4;
+                                break;
+                        default:
+                                return -1;
+                }
+        }
+        return p == end ? status : -1;
+}
+
+
+/* Check the response of the stream, the failure is written to error */
+static void _checkResponse(Http2_T C, int stream, char *error, int size) {
+        int status = Http2_getStatus(C, stream);
+        const char *grpcStatus = Http2_getHeader(C, stream, "grpc-status");
+        if (Http2_getError(C, stream)) {
+                snprintf(error, size, "%s", Http2_getError(C, stream));
+        } else if (status < 0) {
+                snprintf(error, size, "no response status");
+        } else if (status != 200) {
+                snprintf(error, size, "server returned HTTP status %d", status);
+        } else if (! grpcStatus) {
+                snprintf(error, size, "no grpc-status in the response");
+        } else if (! Str_isEqual(grpcStatus, "0")) {
+                int code = Str_parseInt(grpcStatus);
+                const char *message = Http2_getHeader(C, stream, "grpc-message");
+                snprintf(error, size, "call failed with status %s%s%s", code > 0 && code < (int)(sizeof(statusCodes) / sizeof(statusCodes[0])) ? statusCodes[code] : grpcStatus, message ? " -- " : "", message ? message : "");
+        } else {
+                int length;
+                const unsigned char *body = (const unsigned char *)Http2_getBody(C, stream, &length);
+                // The length-prefixed message: compression flag and 32-bit length
+                if (length < 5 || body[0] != 0 || ((unsigned)body[1] << 24 | body[2] << 16 | body[3] << 8 | body[4]) != (unsigned)(length - 5)) {
+                        snprintf(error, size, "invalid response message");
+                } else {
+                        int serving = _parseResponse(body + 5, length - 5);
+                        if (serving < 0)
+                                snprintf(error, size, "invalid response message");
+                        else if (serving != 1)
+                                snprintf(error, size, "status %s", servingStatus[serving]);
+                }
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void check_grpc(Socket_T socket) {
+        ASSERT(socket);
+        Port_T P = Socket_getPort(socket);
+        ASSERT(P);
+        char timeout[32];
+        snprintf(timeout, sizeof(timeout), "grpc-timeout: %dm", P->timeout);
+        List_T headers = List_new();
+        List_append(headers, "content-type: application/grpc");
+        List_append(headers, "te: trailers");
+        List_append(headers, timeout);
+        List_T services = P->parameters.grpc.services;
+        Http2_T C = Http2_new(socket);
+        TRY
+        {
+                // HealthCheckRequest with the field 1 (service name), the empty name is the default value and not sent
+                int count = services ? List_length(services) : 1;
+                list_t s = services ? services->head : NULL;
+                for (int i = 0; i < count; i++, s = s ? s->next : NULL) {
+                        const char *service = s ? s->e : "";
+                        int length = (int)strlen(service);
+                        unsigned char request[7 + 127] = {};
+                        if (length) {
+                                request[4] = length + 2;
+                                request[5] = 0x0a;
+                                request[6] = length;
+                                memcpy(request + 7, service, length);
+                        }
+                        Http2_request(C, "POST", GRPC_PATH, headers, request, 5 + request[4], GRPC_LIMIT);
+                }
+                Http2_wait(C, Time_milli() + P->timeout);
+                // Test all the services and report all the failures at once
+                char report[STRLEN] = {};
+                s = services ? services->head : NULL;
+                for (int i = 0; i < count; i++, s = s ? s->next : NULL) {
+                        char error[STRLEN] = {};
+                        const char *service = s ? s->e : "server";
+                        _checkResponse(C, i, error, sizeof(error));
+                        if (*error)
+                                snprintf(report + strlen(report), sizeof(report) - strlen(report), "%s%s -- %s", *report ? "; " : "", service, error);
+                        else
+                                DEBUG("GRPC: %s -- SERVING in %.3f ms\n", service, Http2_getResponseTime(C, i));
+                }
+                if (*report)
+                        THROW(IOException, "GRPC error: %s", report);
+        }
+        FINALLY
+        {
+                Http2_free(&C);
+                List_free(&headers);
+        }
+        END_TRY;
+}
+
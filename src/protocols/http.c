@@ -24,10 +24,22 @@
 
 #include "config.h"
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #endif
 
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
 #include "md5.h"
 #include "sha1.h"
 #include "base64.h"
@@ -50,6 +62,10 @@
  *
  *  If the status code is >= 400, an error has occurred.
  *
+ *  The response body is read once, the content tests and the checksum
+ *  test are applied to the same read. The chunked transfer encoding is
+ *  decoded before the tests.
+ *
  *  @file
  */
 
@@ -70,104 +86,174 @@ static boolean_t _hasHeader(List_T list, const char *name) {
 }
 
 
-static void do_regex(Socket_T socket, int content_length, Request_T R) {
-        boolean_t rv = false;
-
-        if (content_length == 0)
-                THROW(IOException, "HTTP error: No content returned from server");
-        else if (content_length < 0 || content_length > Run.limits.httpContentBuffer) /* content_length < 0 if no Content-Length header was found */
-                content_length = Run.limits.httpContentBuffer;
-
+/* The response body reader */
+typedef struct Body_T {
+        Socket_T socket;
+        boolean_t chunked;                   /**< Chunked transfer encoding */
+        boolean_t done;                          /**< The whole body was read */
+        boolean_t truncated;        /**< The connection closed before the end */
+        long long remaining;  /**< Bytes left in the body or chunk, -1 = until closed */
         char error[STRLEN];
-        int size = 0, length = content_length, buflen = content_length + 1;
-        char *buf = ALLOC(buflen);
-        do {
-                int n = Socket_read(socket, &buf[size], length);
-                if (n <= 0)
-                        break;
-                size += n;
-                length -= n;
-        } while (length > 0);
+} Body_T;
+
 
-        if (size == 0) {
-                snprintf(error, sizeof(error), "Receiving data -- %s", STRERROR);
-                goto error;
+/**
+ * Read the next part of the response body, the chunked transfer encoding
+ * is decoded, so the caller gets the document bytes only. The exact sizes
+ * are read, the reader doesn't wait for data past the end of the body.
+ * @return The number of bytes read, 0 at the end of the body or -1 on error
+ */
+static int _readBody(Body_T *B, char *buf, int size) {
+        if (B->done)
+                return 0;
+        if (B->chunked && B->remaining == 0) {
+                char line[STRLEN];
+                if (! Socket_readLine(B->socket, line, sizeof(line))) {
+                        snprintf(B->error, sizeof(B->error), "Receiving chunk size -- %s", STRERROR);
+                        return -1;
+                }
+                char *end;
+                long long chunk = strtoll(line, &end, 16);
+                if (end == line || chunk < 0) {
+                        snprintf(B->error, sizeof(B->error), "Invalid chunk size '%s'", Str_chomp(line));
+                        return -1;
+                }
+                if (chunk == 0) {
+                        // The last chunk, skip the trailer
+                        while (Socket_readLine(B->socket, line, sizeof(line)) && *Str_chomp(line))
+                                ;
+                        B->done = true;
+                        return 0;
+                }
+                B->remaining = chunk;
+        } else if (B->remaining == 0) {
+                B->done = true;
+                return 0;
+        }
+        if (B->remaining > 0 && B->remaining < size)
+                size = (int)B->remaining;
+        int n = Socket_read(B->socket, buf, size);
+        if (n <= 0) {
+                // A body without the length ends when the server closes the connection
+                B->truncated = B->remaining >= 0;
+                B->done = true;
+                return 0;
+        }
+        if (B->remaining > 0) {
+                B->remaining -= n;
+                if (B->chunked && B->remaining == 0) {
+                        char crlf[8];
+                        Socket_readLine(B->socket, crlf, sizeof(crlf));
+                }
         }
-        buf[size] = 0;
-
-        int regex_return = regexec(R->regex, buf, 0, NULL, 0);
-        FREE(buf);
-        switch (R->operator) {
-                case Operator_Equal:
-                        if (regex_return == 0) {
-                                rv = true;
+        return n;
+}
+
+
+/**
+ * Test the response body content with all the content tests
+ * @return true if all tests succeeded, otherwise false and the error is set
+ */
+static boolean_t _checkContent(RequestContent_T contents, const char *content, char *error, int size) {
+        for (RequestContent_T c = contents; c; c = c->next) {
+                int regex_return = regexec(c->regex, content, 0, NULL, 0);
+                switch (c->operator) {
+                        case Operator_Equal:
+                                if (regex_return != 0) {
+                                        char errbuf[STRLEN];
+                                        regerror(regex_return, NULL, errbuf, sizeof(errbuf));
+                                        snprintf(error, size, "Regular expression doesn't match: %s", errbuf);
+                                        return false;
+                                }
                                 DEBUG("HTTP: Regular expression matches\n");
-                        } else {
-                                char errbuf[STRLEN];
-                                regerror(regex_return, NULL, errbuf, sizeof(errbuf));
-                                snprintf(error, sizeof(error), "Regular expression doesn't match: %s", errbuf);
-                        }
-                        break;
-                case Operator_NotEqual:
-                        if (regex_return == 0) {
-                                snprintf(error, sizeof(error), "Regular expression matches");
-                        } else {
-                                rv = true;
+                                break;
+                        case Operator_NotEqual:
+                                if (regex_return == 0) {
+                                        snprintf(error, size, "Regular expression matches");
+                                        return false;
+                                }
                                 DEBUG("HTTP: Regular expression doesn't match\n");
-                        }
-                        break;
-                default:
-                        snprintf(error, sizeof(error), "Invalid content operator");
-                        break;
+                                break;
+                        default:
+                                snprintf(error, size, "Invalid content operator");
+                                return false;
+                }
         }
-
-error:
-        if (! rv)
-                THROW(IOException, "HTTP error: %s", error);
+        return true;
 }
 
 
-static void check_request_checksum(Socket_T socket, int content_length, char *checksum, Hash_Type hashtype) {
-        int n, keylength = 0;
-        MD_T result, hash;
+/**
+ * Read the response body once and pass it to all the body tests: the
+ * content tests get the first httpContentBuffer bytes, the checksum is
+ * computed incrementally over the whole body. The body is read only until
+ * all the tests are decided.
+ */
+static void _checkBody(Body_T *B, Port_T P) {
+        RequestContent_T contents = P->url_request ? P->url_request->contents : NULL;
+        Hash_Type hashtype = P->parameters.http.checksum ? P->parameters.http.hashtype : Hash_Unknown;
         md5_context_t ctx_md5;
         sha1_context_t ctx_sha1;
+        if (hashtype == Hash_Md5)
+                md5_init(&ctx_md5);
+        else if (hashtype == Hash_Sha1)
+                sha1_init(&ctx_sha1);
+        else if (hashtype != Hash_Unknown)
+                THROW(IOException, "HTTP checksum error: Unknown hash type");
+        // The content buffer grows as the body is read, up to the limit, so a short document doesn't allocate the whole limit
+        int limit = contents ? Run.limits.httpContentBuffer : 0, size = 0, capacity = 0;
+        char *content = NULL;
+        long long total = 0;
         char buf[8192];
-
-        if (content_length <= 0) {
-                DEBUG("HTTP warning: Response does not contain a valid Content-Length -- cannot compute checksum\n");
-                return;
+        while ((contents && size < limit) || hashtype != Hash_Unknown) {
+                if (contents && size < limit && size == capacity) {
+                        capacity = capacity ? (capacity > limit / 2 ? limit : capacity * 2) : (limit < (int)sizeof(buf) ? limit : (int)sizeof(buf));
+                        RESIZE(content, capacity + 1);
+                }
+                // Fill the content buffer first, once the content tests are decided the rest of the body is read for the checksum only
+                char *data = contents && size < limit ? content + size : buf;
+                int n = _readBody(B, data, data == buf ? (int)sizeof(buf) : capacity - size);
+                if (n <= 0)
+                        break;
+                if (hashtype == Hash_Md5)
+                        md5_append(&ctx_md5, (const md5_byte_t *)data, n);
+                else if (hashtype == Hash_Sha1)
+                        sha1_append(&ctx_sha1, (const md5_byte_t *)data, n);
+                if (data != buf)
+                        size += n;
+                total += n;
         }
-
-        switch (hashtype) {
-                case Hash_Md5:
-                        md5_init(&ctx_md5);
-                        while (content_length > 0) {
-                                if ((n = Socket_read(socket, buf, content_length > sizeof(buf) ? sizeof(buf) : content_length)) < 0)
-                                        break;
-                                md5_append(&ctx_md5, (const md5_byte_t *)buf, n);
-                                content_length -= n;
-                        }
+        DEBUG("HTTP: Read %lld bytes of the response body%s\n", total, B->done ? "" : " (the rest is not tested)");
+        char error[STRLEN] = {};
+        if (*B->error) {
+                snprintf(error, sizeof(error), "%s", B->error);
+        } else if (contents) {
+                if (total == 0) {
+                        snprintf(error, sizeof(error), "No content returned from server");
+                } else if (content) {
+                        content[size] = 0;
+                        _checkContent(contents, content, error, sizeof(error));
+                }
+        }
+        FREE(content);
+        if (*error)
+                THROW(IOException, "HTTP error: %s", error);
+        if (hashtype != Hash_Unknown) {
+                if (B->truncated)
+                        THROW(IOException, "HTTP checksum error: Incomplete document -- %lld bytes received", total);
+                MD_T result, hash;
+                int keylength;
+                if (hashtype == Hash_Md5) {
                         md5_finish(&ctx_md5, (md5_byte_t *)hash);
                         keylength = 16; /* Raw key bytes not string chars! */
-                        break;
-                case Hash_Sha1:
-                        sha1_init(&ctx_sha1);
-                        while (content_length > 0) {
-                                if ((n = Socket_read(socket, buf, content_length > sizeof(buf) ? sizeof(buf) : content_length)) < 0)
-                                        break;
-                                sha1_append(&ctx_sha1, (md5_byte_t *)buf, n);
-                                content_length -= n;
-                        }
+                } else {
                         sha1_finish(&ctx_sha1, (md5_byte_t *)hash);
                         keylength = 20; /* Raw key bytes not string chars! */
-                        break;
-                default:
-                        THROW(IOException, "HTTP checksum error: Unknown hash type");
+                }
+                if (strncasecmp(Util_digest2Bytes((unsigned char *)hash, keylength, result), P->parameters.http.checksum, keylength * 2) != 0)
+                        THROW(IOException, "HTTP checksum error: Document checksum mismatch");
+                DEBUG("HTTP: Succeeded testing document checksum\n");
         }
-        if (strncasecmp(Util_digest2Bytes((unsigned char *)hash, keylength, result), checksum, keylength * 2) != 0)
-                THROW(IOException, "HTTP checksum error: Document checksum mismatch");
-        DEBUG("HTTP: Succeeded testing document checksum\n");
 }
 
 
@@ -177,7 +263,7 @@ static void check_request_checksum(Socket_T socket, int content_length, char *ch
  * @param s A socket
  */
 static void check_request(Socket_T socket, Port_T P) {
-        int status, content_length = -1;
+        int status;
         char buf[512];
         if (! Socket_readLine(socket, buf, sizeof(buf)))
                 THROW(IOException, "HTTP: Error receiving data -- %s", STRERROR);
@@ -186,31 +272,38 @@ static void check_request(Socket_T socket, Port_T P) {
                 THROW(IOException, "HTTP error: Cannot parse HTTP status in response: %s", buf);
         if (! Util_evalQExpression(P->parameters.http.operator, status, P->parameters.http.status ? P->parameters.http.status : 400))
                 THROW(IOException, "HTTP error: Server returned status %d", status);
-        /* Get Content-Length header value */
-        while (Socket_readLine(socket, buf, sizeof(buf))) {
-                if ((buf[0] == '\r' && buf[1] == '\n') || (buf[0] == '\n'))
+        // The responses to HEAD and the 1xx, 204 and 304 responses have no body
+        Body_T B = {.socket = socket, .remaining = (status >= 100 && status < 200) || status == 204 || status == 304 ? 0 : -1};
+        /* Get the Content-Length and Transfer-Encoding header values, the headers are scanned in the socket buffer and only these headers are copied */
+        const char *line;
+        int length;
+        while ((line = Socket_peekLine(socket, &length))) {
+                Socket_consume(socket, length);
+                if ((length >= 2 && line[0] == '\r' && line[1] == '\n') || (line[0] == '\n'))
                         break;
-                Str_chomp(buf);
-                if (Str_startsWith(buf, "Content-Length")) {
+                if (length > 14 && ! strncasecmp(line, "Content-Length", 14)) {
+                        int content_length = -1;
+                        snprintf(buf, sizeof(buf), "%.*s", length, line);
+                        Str_chomp(buf);
                         if (! sscanf(buf, "%*s%*[: ]%d", &content_length))
                                 THROW(IOException, "HTTP error: Parsing Content-Length response header '%s'", buf);
                         if (content_length < 0)
                                 THROW(IOException, "HTTP error: Illegal Content-Length response header '%s'", buf);
+                        if (! B.chunked && B.remaining)
+                                B.remaining = content_length;
+                } else if (length > 17 && ! strncasecmp(line, "Transfer-Encoding", 17)) {
+                        snprintf(buf, sizeof(buf), "%.*s", length, line);
+                        for (char *c = buf; *c; c++)
+                                *c = tolower((unsigned char)*c);
+                        // The chunked encoding overrides the Content-Length (RFC 7230, 3.3.3)
+                        if (Str_sub(buf, "chunked") && B.remaining) {
+                                B.chunked = true;
+                                B.remaining = 0;
+                        }
                 }
         }
-        /* FIXME:
-         * we read the data from the socket inside do_regex() and also check_request_checksum() independently => these two cannot be used together - only one wil read the data. Refactor the spaghetti code and consolidate the read
-         * function, so data are ready before we test the content (read once, allow to apply different tests / many times) */
-        /* FIXME:
-         * We don't support chuncked transfer encoding and rely on Content-Length only ... this has two problems:
-         * 1.) we read chunk headers to buffer as part of data and apply checksum test and regex test to it => technically wrong, as the pattern we're looking for may be split in different chunks and won't match, checksum completyly wrong
-         * 2.) the read of chunked data is slowed downed by read delay (https://bitbucket.org/tildeslash/monit/issues/254/hosts-check-is-too-long)
-         * I.e. implement support for Chunked encoding (see above FIXME comment - we should have one read function, which can be used to read data and reuse it for all tests)
-         */
-        if (P->url_request && P->url_request->regex)
-                do_regex(socket, content_length, P->url_request);
-        if (P->parameters.http.checksum)
-                check_request_checksum(socket, content_length, P->parameters.http.checksum, P->parameters.http.hashtype);
+        if ((P->url_request && P->url_request->contents) || P->parameters.http.checksum)
+                _checkBody(&B, P);
 }
 
 
@@ -258,7 +351,7 @@ void check_http(Socket_T socket) {
                             "Accept: */*\r\n"
                             "Connection: close\r\n"
                             "%s",
-                            ((P->url_request && P->url_request->regex) || P->parameters.http.checksum) ? "GET" : "HEAD",
+                            ((P->url_request && P->url_request->contents) || P->parameters.http.checksum) ? "GET" : "HEAD",
                             P->parameters.http.request ? P->parameters.http.request : "/",
                             get_auth_header(P, (char[STRLEN]){0}, STRLEN));
         if (! _hasHeader(P->parameters.http.headers, "Host"))
@@ -0,0 +1,947 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STDARG_H
+#include <stdarg.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STRINGS_H
+#include <strings.h>
+#endif
+
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#include "protocol.h"
+#include "http2.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/IOException.h"
+
+
+/**
+ *  A HTTP/2 test.
+ *
+ *  All the requests of the port are sent as concurrent streams on one
+ *  connection. The status, the response time and the content of each
+ *  response are tested separately, the port fails if any stream fails.
+ *  Without content tests the stream is cancelled as soon as the response
+ *  headers arrive.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define T Http2_T
+
+
+#define HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+
+
+/* SETTINGS_MAX_FRAME_SIZE, we use the default in both directions */
+#define HTTP2_FRAME_SIZE 16384
+
+
+/* SETTINGS_HEADER_TABLE_SIZE of our HPACK decoder, the default */
+#define HTTP2_TABLE_SIZE 4096
+
+
+/* Maximum size of a response header block (HEADERS and CONTINUATION frames) */
+#define HTTP2_BLOCK_SIZE 65536
+
+
+/* Maximum flow control window, the connection and stream windows are opened to it */
+#define HTTP2_WINDOW 0x7fffffff
+
+
+/* Concurrent streams until the server's SETTINGS_MAX_CONCURRENT_STREAMS arrives, the minimum recommended by RFC 7540 */
+#define HTTP2_STREAMS 100
+
+
+typedef enum {
+        Frame_Data = 0,
+        Frame_Headers,
+        Frame_Priority,
+        Frame_RstStream,
+        Frame_Settings,
+        Frame_PushPromise,
+        Frame_Ping,
+        Frame_Goaway,
+        Frame_WindowUpdate,
+        Frame_Continuation
+} __attribute__((__packed__)) Frame_Type;
+
+
+#define FLAG_END_STREAM  0x01
+#define FLAG_ACK         0x01
+#define FLAG_END_HEADERS 0x04
+#define FLAG_PADDED      0x08
+#define FLAG_PRIORITY    0x20
+
+
+#define SETTINGS_ENABLE_PUSH            0x2
+#define SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define SETTINGS_INITIAL_WINDOW_SIZE    0x4
+
+
+#define ERROR_CANCEL 0x8
+
+
+static const char *errorNames[] = {
+        "NO_ERROR", "PROTOCOL_ERROR", "INTERNAL_ERROR", "FLOW_CONTROL_ERROR", "SETTINGS_TIMEOUT", "STREAM_CLOSED", "FRAME_SIZE_ERROR",
+        "REFUSED_STREAM", "CANCEL", "COMPRESSION_ERROR", "CONNECT_ERROR", "ENHANCE_YOUR_CALM", "INADEQUATE_SECURITY", "HTTP_1_1_REQUIRED"
+};
+
+
+/* HPACK static table (RFC 7541, Appendix A), the index 0 is unused */
+static const struct {
+        const char *name;
+        const char *value;
+} staticTable[] = {
+        {NULL, NULL},
+        {":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"}, {":path", "/index.html"}, {":scheme", "http"},
+        {":scheme", "https"}, {":status", "200"}, {":status", "204"}, {":status", "206"}, {":status", "304"}, {":status", "400"},
+        {":status", "404"}, {":status", "500"}, {"accept-charset", ""}, {"accept-encoding", "gzip, deflate"}, {"accept-language", ""},
+        {"accept-ranges", ""}, {"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""}, {"authorization", ""},
+        {"cache-control", ""}, {"content-disposition", ""}, {"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+        {"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""}, {"date", ""}, {"etag", ""}, {"expect", ""},
+        {"expires", ""}, {"from", ""}, {"host", ""}, {"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+        {"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""}, {"max-forwards", ""}, {"proxy-authenticate", ""},
+        {"proxy-authorization", ""}, {"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""}, {"set-cookie", ""},
+        {"strict-transport-security", ""}, {"transfer-encoding", ""}, {"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""}
+};
+#define STATIC_TABLE_LENGTH 61
+
+
+/* The HPACK Huffman code (RFC 7541, Appendix B) is canonical, it's described by the number of codes of each length (1-30 bits) and the symbols in the code order, 256 is EOS */
+static const unsigned char huffmanCounts[31] = {
+        0, 0, 0, 0, 0, 10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4
+};
+static const unsigned short huffmanSymbols[257] = {
+        48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+        52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+        110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+        77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+        119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+        43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+        195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+        179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+        163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+        233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+        158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+        144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+        200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+        212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+        2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+        21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+        256
+};
+
+
+/* Growing byte buffer, the data is always NUL terminated */
+typedef struct Buffer_T {
+        unsigned char *data;
+        int length;
+        int size;
+} Buffer_T;
+
+
+typedef struct Header_T {
+        char *name;
+        char *value;
+        struct Header_T *next;
+} *Header_T;
+
+
+typedef enum {
+        Stream_Pending = 0,
+        Stream_Open,
+        Stream_Closed
+} __attribute__((__packed__)) Stream_State;
+
+
+typedef struct Stream_T {
+        Stream_State state;
+        boolean_t responded;                  /**< The final response headers arrived */
+        uint32_t id;
+        int status;
+        int limit;                                /**< Response body bytes to keep */
+        long long started;                                  /**< Request sent [us] */
+        long long finished;                                /**< Stream closed [us] */
+        Buffer_T request;                      /**< HPACK encoded request headers */
+        Buffer_T data;                                         /**< Request body */
+        Buffer_T body;                                        /**< Response body */
+        Header_T headers;                        /**< Response headers and trailers */
+        char error[STRLEN];
+} *Stream_T;
+
+
+struct T {
+        Socket_T socket;
+        boolean_t secure;
+        boolean_t goaway;                        /**< The server closes the connection */
+        int count;                                              /**< Number of streams */
+        int size;
+        int opened;                   /**< Number of streams sent, in the index order */
+        int active;                                        /**< Number of open streams */
+        int maxStreams;                    /**< The server's concurrent streams limit */
+        struct Stream_T *streams;                /**< Stream i has the id 2 * i + 1 */
+        struct {
+                uint32_t stream;          /**< Stream of the incomplete header block or 0 */
+                boolean_t endStream;             /**< END_STREAM flag of the HEADERS frame */
+                Buffer_T data;
+        } block;
+        struct {
+                int count;
+                int size;                            /**< Table size as defined by HPACK */
+                int maxSize;
+                int capacity;
+                struct {
+                        char *name;
+                        char *value;
+                } *entries;                                   /**< The newest entry first */
+        } table;
+        Buffer_T name;                                 /**< Decoded header name scratch */
+        Buffer_T value;                               /**< Decoded header value scratch */
+        Buffer_T out;                                            /**< Unsent frames */
+        char authority[STRLEN];
+        unsigned char frame[HTTP2_FRAME_SIZE];
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _append(Buffer_T *b, const void *data, int length) {
+        if (b->length + length + 1 > b->size) {
+                b->size = MAX(b->size * 2, b->length + length + 1);
+                RESIZE(b->data, b->size);
+        }
+        memcpy(b->data + b->length, data, length);
+        b->length += length;
+        b->data[b->length] = 0;
+}
+
+
+static void _byte(Buffer_T *b, unsigned char c) {
+        _append(b, &c, 1);
+}
+
+
+static uint32_t _uint32(const unsigned char *p) {
+        return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+
+static const char *_errorName(uint32_t code) {
+        return code < sizeof(errorNames) / sizeof(errorNames[0]) ? errorNames[code] : "UNKNOWN_ERROR";
+}
+
+
+/* ------------------------------------------------------------ HPACK encoder */
+
+
+static void _encodeInteger(Buffer_T *b, int prefix, unsigned char flags, uint32_t value) {
+        uint32_t max = (1U << prefix) - 1;
+        if (value < max) {
+                _byte(b, flags | value);
+                return;
+        }
+        _byte(b, flags | max);
+        for (value -= max; value >= 128; value >>= 7)
+                _byte(b, (value & 0x7f) | 0x80);
+        _byte(b, value);
+}
+
+
+static void _encodeString(Buffer_T *b, const char *s) {
+        int length = (int)strlen(s);
+        _encodeInteger(b, 7, 0x00, length);
+        _append(b, s, length);
+}
+
+
+/* Literal header field without indexing, with the name from the static table if index > 0 */
+static void _encodeHeader(Buffer_T *b, int index, const char *name, const char *value) {
+        _encodeInteger(b, 4, 0x00, index);
+        if (! index)
+                _encodeString(b, name);
+        _encodeString(b, value);
+}
+
+
+/* ------------------------------------------------------------ HPACK decoder */
+
+
+static uint32_t _decodeInteger(const unsigned char **p, const unsigned char *end, int prefix) {
+        uint32_t max = (1U << prefix) - 1;
+        uint32_t value = *(*p)++ & max;
+        if (value < max)
+                return value;
+        for (int shift = 0; shift <= 21; shift += 7) {
+                if (*p >= end)
+                        break;
+                unsigned char c = *(*p)++;
+                value += (uint32_t)(c & 0x7f) << shift;
+                if (! (c & 0x80))
+                        return value;
+        }
+        THROW(IOException, "HTTP2: invalid HPACK integer");
+        return 0;
+}
+
+
+static void _decodeHuffman(const unsigned char *data, int length, Buffer_T *out) {
+        // Canonical code decoding: code is the bits read since the last symbol, first the first code of the current length
+        int code = 0, first = 0, index = 0, bits = 0;
+        boolean_t ones = true;
+        for (int i = 0; i < length; i++) {
+                for (int b = 7; b >= 0; b--) {
+                        int bit = (data[i] >> b) & 1;
+                        code |= bit;
+                        ones = ones && bit;
+                        int count = huffmanCounts[++bits];
+                        if (code - count < first) {
+                                int symbol = huffmanSymbols[index + code - first];
+                                if (symbol == 256)
+                                        THROW(IOException, "HTTP2: invalid HPACK string -- EOS symbol");
+                                _byte(out, (unsigned char)symbol);
+                                code = first = index = bits = 0;
+                                ones = true;
+                        } else {
+                                if (bits == 30)
+                                        THROW(IOException, "HTTP2: invalid HPACK Huffman code");
+                                index += count;
+                                first = (first + count) << 1;
+                                code <<= 1;
+                        }
+                }
+        }
+        // The padding is the most significant bits of EOS, all ones, shorter than 8 bits
+        if (bits > 7 || ! ones)
+                THROW(IOException, "HTTP2: invalid HPACK Huffman padding");
+}
+
+
+static void _decodeString(const unsigned char **p, const unsigned char *end, Buffer_T *out) {
+        if (*p >= end)
+                THROW(IOException, "HTTP2: truncated HPACK string");
+        boolean_t huffman = **p & 0x80;
+        uint32_t length = _decodeInteger(p, end, 7);
+        if (length > (uint32_t)(end - *p))
+                THROW(IOException, "HTTP2: invalid HPACK string length");
+        out->length = 0;
+        _append(out, "", 0);
+        if (huffman)
+                _decodeHuffman(*p, length, out);
+        else
+                _append(out, *p, length);
+        *p += length;
+}
+
+
+static void _evict(T C, int size) {
+        while (C->table.count && C->table.size + size > C->table.maxSize) {
+                C->table.count--;
+                C->table.size -= strlen(C->table.entries[C->table.count].name) + strlen(C->table.entries[C->table.count].value) + 32;
+                FREE(C->table.entries[C->table.count].name);
+                FREE(C->table.entries[C->table.count].value);
+        }
+}
+
+
+static void _insert(T C, const char *name, const char *value) {
+        int size = (int)(strlen(name) + strlen(value) + 32);
+        _evict(C, size);
+        // An entry larger than the table empties the table and isn't added
+        if (size > C->table.maxSize)
+                return;
+        if (C->table.count >= C->table.capacity) {
+                C->table.capacity = C->table.capacity ? C->table.capacity * 2 : 32;
+                RESIZE(C->table.entries, C->table.capacity * sizeof(C->table.entries[0]));
+        }
+        memmove(C->table.entries + 1, C->table.entries, C->table.count * sizeof(C->table.entries[0]));
+        C->table.entries[0].name = Str_dup(name);
+        C->table.entries[0].value = Str_dup(value);
+        C->table.count++;
+        C->table.size += size;
+}
+
+
+/* Copy the indexed name and value to the scratch buffers, the dynamic table entry may be evicted before the header is used */
+static void _lookup(T C, uint32_t index, boolean_t value) {
+        const char *n = NULL, *v = NULL;
+        if (index == 0) {
+                THROW(IOException, "HTTP2: invalid HPACK index 0");
+        } else if (index <= STATIC_TABLE_LENGTH) {
+                n = staticTable[index].name;
+                v = staticTable[index].value;
+        } else if (index - STATIC_TABLE_LENGTH <= (uint32_t)C->table.count) {
+                n = C->table.entries[index - STATIC_TABLE_LENGTH - 1].name;
+                v = C->table.entries[index - STATIC_TABLE_LENGTH - 1].value;
+        } else {
+                THROW(IOException, "HTTP2: invalid HPACK index %u", index);
+        }
+        C->name.length = 0;
+        _append(&C->name, n, (int)strlen(n));
+        if (value) {
+                C->value.length = 0;
+                _append(&C->value, v, (int)strlen(v));
+        }
+}
+
+
+static Stream_T _stream(T C, uint32_t id) {
+        if (id & 1) {
+                uint32_t index = (id - 1) / 2;
+                if (index < (uint32_t)C->opened && C->streams[index].state == Stream_Open)
+                        return &C->streams[index];
+        }
+        return NULL;
+}
+
+
+static void _setHeader(Stream_T s, const char *name, const char *value, int *status) {
+        if (*name == ':') {
+                if (IS(name, ":status"))
+                        *status = (int)strtol(value, NULL, 10);
+        } else if (s) {
+                Header_T h;
+                NEW(h);
+                h->name = Str_dup(name);
+                h->value = Str_dup(value);
+                Header_T *last = &s->headers;
+                while (*last)
+                        last = &(*last)->next;
+                *last = h;
+        }
+}
+
+
+/* Decode a complete header block. The block is decoded even if the stream is not open, the dynamic table must stay in sync with the server. */
+static void _decodeBlock(T C, Stream_T s) {
+        int status = -1;
+        const unsigned char *p = C->block.data.data, *end = p + C->block.data.length;
+        while (p < end) {
+                if (*p & 0x80) {
+                        // Indexed header field
+                        _lookup(C, _decodeInteger(&p, end, 7), true);
+                } else if ((*p & 0xe0) == 0x20) {
+                        // Dynamic table size update
+                        uint32_t size = _decodeInteger(&p, end, 5);
+                        if (size > HTTP2_TABLE_SIZE)
+                                THROW(IOException, "HTTP2: invalid HPACK table size %u", size);
+                        C->table.maxSize = size;
+                        _evict(C, 0);
+                        continue;
+                } else {
+                        // Literal header field with incremental indexing (01), without indexing (0000) or never indexed (0001)
+                        boolean_t indexing = (*p & 0xc0) == 0x40;
+                        uint32_t index = _decodeInteger(&p, end, indexing ? 6 : 4);
+                        if (index)
+                                _lookup(C, index, false);
+                        else
+                                _decodeString(&p, end, &C->name);
+                        _decodeString(&p, end, &C->value);
+                        if (indexing)
+                                _insert(C, (char *)C->name.data, (char *)C->value.data);
+                }
+                _setHeader(s, (char *)C->name.data, (char *)C->value.data, &status);
+        }
+        // The informational (1xx) responses precede the final response
+        if (s && ! s->responded && status >= 200) {
+                s->responded = true;
+                s->status = status;
+        }
+}
+
+
+/* --------------------------------------------------------------- Framing */
+
+
+static void _frame(T C, Frame_Type type, int flags, uint32_t stream, const void *payload, int length) {
+        unsigned char header[9] = {length >> 16, length >> 8, length, type, flags, (stream >> 24) & 0x7f, stream >> 16, stream >> 8, stream};
+        _append(&C->out, header, sizeof(header));
+        if (length)
+                _append(&C->out, payload, length);
+}
+
+
+static void _flush(T C, long long deadline) {
+        if (C->out.length) {
+                Socket_setTimeout(C->socket, (int)MAX(1LL, deadline - Time_milli()));
+                if (Socket_write(C->socket, C->out.data, C->out.length) != C->out.length)
+                        THROW(IOException, "HTTP2: error sending data -- %s", STRERROR);
+                C->out.length = 0;
+        }
+}
+
+
+static void _close(T C, Stream_T s, const char *error, ...) __attribute__((format (printf, 3, 4)));
+static void _close(T C, Stream_T s, const char *error, ...) {
+        if (s->state == Stream_Open)
+                C->active--;
+        s->state = Stream_Closed;
+        s->finished = Time_micro();
+        if (error) {
+                va_list ap;
+                va_start(ap, error);
+                vsnprintf(s->error, sizeof(s->error), error, ap);
+                va_end(ap);
+        }
+}
+
+
+/* Cancel a stream when we have all we need from the response */
+static void _cancel(T C, Stream_T s) {
+        unsigned char code[4] = {0, 0, 0, ERROR_CANCEL};
+        _frame(C, Frame_RstStream, 0, s->id, code, sizeof(code));
+        _close(C, s, NULL);
+}
+
+
+/* Send the pending requests up to the server's concurrent streams limit */
+static void _open(T C) {
+        while (C->opened < C->count && C->active < C->maxStreams && ! C->goaway) {
+                Stream_T s = &C->streams[C->opened];
+                s->id = 2 * C->opened + 1;
+                _frame(C, Frame_Headers, FLAG_END_HEADERS | (s->data.length ? 0 : FLAG_END_STREAM), s->id, s->request.data, s->request.length);
+                if (s->data.length)
+                        _frame(C, Frame_Data, FLAG_END_STREAM, s->id, s->data.data, s->data.length);
+                s->state = Stream_Open;
+                s->started = Time_micro();
+                C->opened++;
+                C->active++;
+        }
+}
+
+
+/* Read exactly length bytes before the deadline. Returns false on timeout */
+static boolean_t _read(T C, void *data, int length, long long deadline) {
+        long long timeout = deadline - Time_milli();
+        if (timeout <= 0)
+                return false;
+        Socket_setTimeout(C->socket, (int)timeout);
+        if (Socket_read(C->socket, data, length) == length)
+                return true;
+        if (Time_milli() >= deadline)
+                return false;
+        THROW(IOException, "HTTP2: connection closed by the server");
+        return false;
+}
+
+
+/* Strip the padding of a DATA or HEADERS frame */
+static void _unpad(unsigned char **payload, int *length) {
+        if (*length < 1 || **payload >= *length)
+                THROW(IOException, "HTTP2: invalid frame padding");
+        *length -= **payload + 1;
+        (*payload)++;
+}
+
+
+static void _headers(T C) {
+        Stream_T s = _stream(C, C->block.stream);
+        _decodeBlock(C, s);
+        if (s) {
+                if (C->block.endStream)
+                        _close(C, s, NULL);
+                else if (s->responded && s->limit == 0)
+                        _cancel(C, s);
+        }
+        C->block.stream = 0;
+}
+
+
+static void _handleFrame(T C, Frame_Type type, int flags, uint32_t id, unsigned char *payload, int length) {
+        if (C->block.stream && type != Frame_Continuation)
+                THROW(IOException, "HTTP2: protocol error -- expected a CONTINUATION frame");
+        Stream_T s = _stream(C, id);
+        switch (type) {
+                case Frame_Data:
+                        if (! id)
+                                THROW(IOException, "HTTP2: protocol error -- DATA frame on the connection stream");
+                        if (flags & FLAG_PADDED)
+                                _unpad(&payload, &length);
+                        if (s) {
+                                if (s->body.length + length > s->limit) {
+                                        _append(&s->body, payload, s->limit - s->body.length);
+                                        _cancel(C, s);
+                                } else {
+                                        _append(&s->body, payload, length);
+                                        if (flags & FLAG_END_STREAM)
+                                                _close(C, s, NULL);
+                                }
+                        }
+                        break;
+                case Frame_Headers:
+                        if (! id)
+                                THROW(IOException, "HTTP2: protocol error -- HEADERS frame on the connection stream");
+                        if (flags & FLAG_PADDED)
+                                _unpad(&payload, &length);
+                        if (flags & FLAG_PRIORITY) {
+                                if (length < 5)
+                                        THROW(IOException, "HTTP2: invalid HEADERS frame");
+                                payload += 5;
+                                length -= 5;
+                        }
+                        C->block.stream = id;
+                        C->block.endStream = flags & FLAG_END_STREAM;
+                        C->block.data.length = 0;
+                        _append(&C->block.data, payload, length);
+                        if (flags & FLAG_END_HEADERS)
+                                _headers(C);
+                        break;
+                case Frame_Continuation:
+                        if (! C->block.stream || id != C->block.stream)
+                                THROW(IOException, "HTTP2: protocol error -- unexpected CONTINUATION frame");
+                        if (C->block.data.length + length > HTTP2_BLOCK_SIZE)
+                                THROW(IOException, "HTTP2: response headers too large");
+                        _append(&C->block.data, payload, length);
+                        if (flags & FLAG_END_HEADERS)
+                                _headers(C);
+                        break;
+                case Frame_RstStream:
+                        if (length != 4)
+                                THROW(IOException, "HTTP2: invalid RST_STREAM frame");
+                        if (s)
+                                _close(C, s, "stream reset by the server -- %s", _errorName(_uint32(payload)));
+                        break;
+                case Frame_Settings:
+                        if (id || length % 6)
+                                THROW(IOException, "HTTP2: invalid SETTINGS frame");
+                        if (! (flags & FLAG_ACK)) {
+                                for (int i = 0; i < length; i += 6) {
+                                        int setting = payload[i] << 8 | payload[i + 1];
+                                        if (setting == SETTINGS_MAX_CONCURRENT_STREAMS)
+                                                C->maxStreams = (int)MIN(_uint32(payload + i + 2), (uint32_t)HTTP2_STREAMS * 10);
+                                }
+                                _frame(C, Frame_Settings, FLAG_ACK, 0, NULL, 0);
+                        }
+                        break;
+                case Frame_PushPromise:
+                        THROW(IOException, "HTTP2: protocol error -- PUSH_PROMISE frame, the push is disabled");
+                        break;
+                case Frame_Ping:
+                        if (id || length != 8)
+                                THROW(IOException, "HTTP2: invalid PING frame");
+                        if (! (flags & FLAG_ACK))
+                                _frame(C, Frame_Ping, FLAG_ACK, 0, payload, length);
+                        break;
+                case Frame_Goaway:
+                        if (id || length < 8)
+                                THROW(IOException, "HTTP2: invalid GOAWAY frame");
+                        {
+                                // The streams above the last stream id were not processed
+                                uint32_t last = _uint32(payload) & 0x7fffffff;
+                                const char *error = _errorName(_uint32(payload + 4));
+                                C->goaway = true;
+                                for (int i = 0; i < C->opened; i++)
+                                        if (C->streams[i].state == Stream_Open && C->streams[i].id > last)
+                                                _close(C, &C->streams[i], "stream refused by the server -- GOAWAY %s", error);
+                        }
+                        break;
+                default:
+                        // PRIORITY, WINDOW_UPDATE and the unknown frame types are ignored
+                        break;
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+T Http2_new(Socket_T socket) {
+        ASSERT(socket);
+        T C;
+        NEW(C);
+        C->socket = socket;
+        C->secure = Socket_isSecure(socket);
+        C->maxStreams = HTTP2_STREAMS;
+        C->table.maxSize = HTTP2_TABLE_SIZE;
+        Util_getHTTPHostHeader(socket, C->authority, sizeof(C->authority));
+        // The connection preface, the server push is disabled and the flow control windows are opened to the maximum, the body limit is applied by cancelling the stream
+        _append(&C->out, HTTP2_PREFACE, (int)strlen(HTTP2_PREFACE));
+        unsigned char settings[] = {
+                0, SETTINGS_ENABLE_PUSH, 0, 0, 0, 0,
+                0, SETTINGS_INITIAL_WINDOW_SIZE, HTTP2_WINDOW >> 24, (HTTP2_WINDOW >> 16) & 0xff, (HTTP2_WINDOW >> 8) & 0xff, HTTP2_WINDOW & 0xff
+        };
+        _frame(C, Frame_Settings, 0, 0, settings, sizeof(settings));
+        uint32_t increment = HTTP2_WINDOW - 65535;
+        unsigned char window[4] = {increment >> 24, increment >> 16, increment >> 8, increment};
+        _frame(C, Frame_WindowUpdate, 0, 0, window, sizeof(window));
+        return C;
+}
+
+
+void Http2_free(T *C) {
+        ASSERT(C && *C);
+        for (int i = 0; i < (*C)->count; i++) {
+                Stream_T s = &(*C)->streams[i];
+                while (s->headers) {
+                        Header_T h = s->headers;
+                        s->headers = h->next;
+                        FREE(h->name);
+                        FREE(h->value);
+                        FREE(h);
+                }
+                FREE(s->request.data);
+                FREE(s->data.data);
+                FREE(s->body.data);
+        }
+        for (int i = 0; i < (*C)->table.count; i++) {
+                FREE((*C)->table.entries[i].name);
+                FREE((*C)->table.entries[i].value);
+        }
+        FREE((*C)->table.entries);
+        FREE((*C)->streams);
+        FREE((*C)->block.data.data);
+        FREE((*C)->name.data);
+        FREE((*C)->value.data);
+        FREE((*C)->out.data);
+        FREE(*C);
+}
+
+
+int Http2_request(T C, const char *method, const char *path, List_T headers, const void *body, int length, int limit) {
+        ASSERT(C);
+        ASSERT(method);
+        ASSERT(path);
+        if (C->count >= C->size) {
+                C->size = C->size ? C->size * 2 : 8;
+                RESIZE(C->streams, C->size * sizeof(struct Stream_T));
+        }
+        Stream_T s = &C->streams[C->count++];
+        memset(s, 0, sizeof(struct Stream_T));
+        s->status = -1;
+        s->limit = limit;
+        // The pseudo-headers first, from the static table where possible
+        if (IS(method, "GET"))
+                _byte(&s->request, 0x82);
+        else if (IS(method, "POST"))
+                _byte(&s->request, 0x83);
+        else
+                _encodeHeader(&s->request, 2, NULL, method);
+        _byte(&s->request, C->secure ? 0x87 : 0x86);
+        if (IS(path, "/"))
+                _byte(&s->request, 0x84);
+        else
+                _encodeHeader(&s->request, 4, NULL, path);
+        const char *authority = C->authority;
+        boolean_t agent = false;
+        if (headers) {
+                for (list_t p = headers->head; p; p = p->next) {
+                        const char *header = p->e;
+                        if (strncasecmp(header, "Host:", 5) == 0)
+                                authority = header + 5 + strspn(header + 5, " \t");
+                }
+        }
+        _encodeHeader(&s->request, 1, NULL, authority);
+        if (headers) {
+                for (list_t p = headers->head; p; p = p->next) {
+                        const char *header = p->e;
+                        const char *value = strchr(header, ':');
+                        if (! value)
+                                continue;
+                        // The header names are lower case and the connection specific headers are not allowed in HTTP/2
+                        char name[STRLEN];
+                        snprintf(name, sizeof(name), "%.*s", (int)(value - header), header);
+                        Str_trim(name);
+                        for (char *c = name; *c; c++)
+                                *c = tolower((unsigned char)*c);
+                        if (Str_isEqual(name, "host") || Str_isEqual(name, "connection") || Str_isEqual(name, "keep-alive") || Str_isEqual(name, "proxy-connection") || Str_isEqual(name, "transfer-encoding") || Str_isEqual(name, "upgrade"))
+                                continue;
+                        if (Str_isEqual(name, "user-agent"))
+                                agent = true;
+                        _encodeHeader(&s->request, 0, name, value + 1 + strspn(value + 1, " \t"));
+                }
+        }
+        if (! agent)
+                _encodeHeader(&s->request, 58, NULL, "Monit/" VERSION);
+        if (s->request.length > HTTP2_FRAME_SIZE)
+                THROW(IOException, "HTTP2: request headers too large");
+        if (length > HTTP2_FRAME_SIZE)
+                THROW(IOException, "HTTP2: request body too large");
+        if (body && length > 0)
+                _append(&s->data, body, length);
+        return C->count - 1;
+}
+
+
+void Http2_wait(T C, long long deadline) {
+        ASSERT(C);
+        _open(C);
+        _flush(C, deadline);
+        unsigned char header[9];
+        while (C->active > 0 || (C->opened < C->count && ! C->goaway)) {
+                if (! _read(C, header, sizeof(header), deadline))
+                        break;
+                int length = header[0] << 16 | header[1] << 8 | header[2];
+                if (length > HTTP2_FRAME_SIZE)
+                        THROW(IOException, "HTTP2: frame size %d exceeds the maximum", length);
+                if (length && ! _read(C, C->frame, length, deadline))
+                        break;
+                _handleFrame(C, header[3], header[4], _uint32(header + 5) & 0x7fffffff, C->frame, length);
+                _open(C);
+                _flush(C, deadline);
+        }
+        for (int i = 0; i < C->count; i++) {
+                Stream_T s = &C->streams[i];
+                if (s->state == Stream_Open)
+                        _close(C, s, "no response within the timeout");
+                else if (s->state == Stream_Pending)
+                        _close(C, s, C->goaway ? "not sent, the server closed the connection" : "not sent within the timeout");
+        }
+}
+
+
+int Http2_getStatus(T C, int stream) {
+        ASSERT(C);
+        ASSERT(stream >= 0 && stream < C->count);
+        return C->streams[stream].status;
+}
+
+
+const char *Http2_getHeader(T C, int stream, const char *name) {
+        ASSERT(C);
+        ASSERT(stream >= 0 && stream < C->count);
+        ASSERT(name);
+        for (Header_T h = C->streams[stream].headers; h; h = h->next)
+                if (IS(h->name, name))
+                        return h->value;
+        return NULL;
+}
+
+
+const char *Http2_getBody(T C, int stream, int *length) {
+        ASSERT(C);
+        ASSERT(stream >= 0 && stream < C->count);
+        Stream_T s = &C->streams[stream];
+        if (length)
+                *length = s->body.length;
+        return s->body.data ? (const char *)s->body.data : "";
+}
+
+
+double Http2_getResponseTime(T C, int stream) {
+        ASSERT(C);
+        ASSERT(stream >= 0 && stream < C->count);
+        Stream_T s = &C->streams[stream];
+        return s->state == Stream_Closed && s->started && ! *s->error ? (double)(s->finished - s->started) / 1000. : -1.;
+}
+
+
+const char *Http2_getError(T C, int stream) {
+        ASSERT(C);
+        ASSERT(stream >= 0 && stream < C->count);
+        return *C->streams[stream].error ? C->streams[stream].error : NULL;
+}
+
+
+/* ------------------------------------------------------ HTTP/2 protocol test */
+
+
+static boolean_t _checkContent(RequestContent_T contents, const char *content, char *error, int size) {
+        for (RequestContent_T c = contents; c; c = c->next) {
+                int rv = regexec(c->regex, content, 0, NULL, 0);
+                if (c->operator == Operator_Equal && rv != 0) {
+                        snprintf(error, size, "content doesn't match");
+                        return false;
+                } else if (c->operator == Operator_NotEqual && rv == 0) {
+                        snprintf(error, size, "content matches");
+                        return false;
+                }
+        }
+        return true;
+}
+
+
+void check_http2(Socket_T socket) {
+        ASSERT(socket);
+        Port_T P = Socket_getPort(socket);
+        ASSERT(P);
+        struct myhttp2request root = {.path = "/"};
+        Http2Request_T requests = P->parameters.http2.requests ? P->parameters.http2.requests : &root;
+        Http2_T C = Http2_new(socket);
+        TRY
+        {
+                for (Http2Request_T r = requests; r; r = r->next)
+                        Http2_request(C, "GET", r->path ? r->path : "/", P->parameters.http2.headers, NULL, 0, r->contents ? Run.limits.httpContentBuffer : 0);
+                Http2_wait(C, Time_milli() + P->timeout);
+                // Test all the streams and report all the failures at once
+                char report[STRLEN] = {};
+                int i = 0;
+                for (Http2Request_T r = requests; r; r = r->next, i++) {
+                        char error[STRLEN] = {};
+                        const char *path = r->path ? r->path : "/";
+                        int status = Http2_getStatus(C, i);
+                        double responsetime = Http2_getResponseTime(C, i);
+                        if (Http2_getError(C, i))
+                                snprintf(error, sizeof(error), "%s", Http2_getError(C, i));
+                        else if (status < 0)
+                                snprintf(error, sizeof(error), "no response status");
+                        else if (! Util_evalQExpression(r->operator, status, r->status ? r->status : 400))
+                                snprintf(error, sizeof(error), "server returned status %d", status);
+                        else if (r->latency && ! Util_evalQExpression(r->latencyOperator, (long long)responsetime, r->latency))
+                                snprintf(error, sizeof(error), "response time %.3f ms", responsetime);
+                        else
+                                _checkContent(r->contents, Http2_getBody(C, i, NULL), error, sizeof(error));
+                        if (*error)
+                                snprintf(report + strlen(report), sizeof(report) - strlen(report), "%s%s -- %s", *report ? "; " : "", path, error);
+                        else
+                                DEBUG("HTTP2: %s -- status %d in %.3f ms\n", path, status, responsetime);
+                }
+                if (*report)
+                        THROW(IOException, "HTTP2 error: %s", report);
+        }
+        FINALLY
+        {
+                Http2_free(&C);
+        }
+        END_TRY;
+}
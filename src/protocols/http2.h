@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_HTTP2_H
+#define MONIT_HTTP2_H
+
+#include "config.h"
+
+#include "monit.h"
+#include "socket.h"
+
+
+/**
+ * A minimal HTTP/2 client (RFC 7540) for the protocol tests. The requests
+ * are queued with Http2_request() and sent as concurrent streams on one
+ * connection by Http2_wait(), which reads the responses until all streams
+ * are closed or the deadline passes. The number of open streams follows
+ * the server's SETTINGS_MAX_CONCURRENT_STREAMS, the remaining requests
+ * are sent as the streams close.
+ *
+ * The request headers are sent as HPACK literals without indexing, the
+ * response headers are decoded with the static and dynamic tables and
+ * the Huffman code (RFC 7541). The flow control window is opened to the
+ * maximum when the connection starts, a stream is cancelled when its
+ * body limit is reached.
+ *
+ * On a TLS socket the "h2" protocol must be negotiated with ALPN (see
+ * Ssl_setApplicationProtocol()), on a plain socket the connection starts
+ * with the prior knowledge of HTTP/2 support (h2c).
+ *
+ * @file
+ */
+
+
+#define T Http2_T
+typedef struct T *T;
+
+
+/**
+ * Create a new HTTP/2 connection on a connected socket
+ * @param socket The socket, it's not owned by the connection
+ * @return A new connection object
+ */
+T Http2_new(Socket_T socket);
+
+
+/**
+ * Destroy a HTTP/2 connection object
+ * @param C A reference to the connection object
+ */
+void Http2_free(T *C);
+
+
+/**
+ * Queue a request. The request is sent by Http2_wait().
+ * @param C A connection object
+ * @param method The request method, for example "GET"
+ * @param path The request path
+ * @param headers Optional list of "Name: value" request headers. A Host
+ * header sets the request authority.
+ * @param body Optional request body
+ * @param length The body length
+ * @param limit Number of response body bytes to keep, the stream is
+ * cancelled when the limit is reached. If 0, the stream is cancelled as
+ * soon as the response headers arrive.
+ * @return The stream index for the response getters
+ * @exception IOException if the request headers are too large
+ */
+int Http2_request(T C, const char *method, const char *path, List_T headers, const void *body, int length, int limit);
+
+
+/**
+ * Send the queued requests and read the responses until all streams are
+ * closed or the deadline passes. The streams which didn't finish in time
+ * get a timeout error.
+ * @param C A connection object
+ * @param deadline The deadline in milliseconds (see Time_milli())
+ * @exception IOException if the connection failed
+ */
+void Http2_wait(T C, long long deadline);
+
+
+/**
+ * Get the response status of the stream
+ * @param C A connection object
+ * @param stream The stream index
+ * @return The HTTP status or -1 if no response was received
+ */
+int Http2_getStatus(T C, int stream);
+
+
+/**
+ * Get the response header or trailer of the stream
+ * @param C A connection object
+ * @param stream The stream index
+ * @param name The header name in lower case
+ * @return The header value or NULL if not received
+ */
+const char *Http2_getHeader(T C, int stream, const char *name);
+
+
+/**
+ * Get the response body of the stream, up to the stream limit
+ * @param C A connection object
+ * @param stream The stream index
+ * @param length Output: the body length (optional)
+ * @return The NUL terminated body (possibly truncated), never NULL
+ */
+const char *Http2_getBody(T C, int stream, int *length);
+
+
+/**
+ * Get the response time of the stream, measured from the request until
+ * the stream closed
+ * @param C A connection object
+ * @param stream The stream index
+ * @return The response time in milliseconds or -1 if the stream didn't close
+ */
+double Http2_getResponseTime(T C, int stream);
+
+
+/**
+ * Get the error of the stream
+ * @param C A connection object
+ * @param stream The stream index
+ * @return The error description or NULL if the stream closed normally
+ */
+const char *Http2_getError(T C, int stream);
+
+
+#undef T
+#endif
@@ -43,14 +43,11 @@ static void say(Socket_T socket, char *msg) {
 
 
 static void expect(Socket_T socket, int expect) {
-        int status;
         char buf[STRLEN];
-        do {
-                if (! Socket_readLine(socket, buf, STRLEN))
-                        THROW(IOException, "LMTP: error receiving data -- %s", STRERROR);
-                Str_chomp(buf);
-        } while (buf[3] == '-'); // Discard multi-line response
-        if (sscanf(buf, "%d", &status) != 1 || status != expect)
+        int status = Socket_readResponse(socket, buf, sizeof(buf), NULL, NULL);
+        if (status < 0)
+                THROW(IOException, "LMTP: error receiving data -- %s", STRERROR);
+        if (status != expect)
                 THROW(IOException, "LMTP error: %s", buf);
 }
 
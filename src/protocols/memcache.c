@@ -49,10 +49,61 @@
 #define UNKNOWN_COMMAND    0x0081
 #define OUT_OF_MEMORY      0x0082
 
+/* Opcodes */
+#define OPCODE_NOOP        0x0a
+#define OPCODE_STAT        0x10
+
+
+/* Read the STAT responses, one per statistic and an empty one at the end, and keep the statistics tested by the port metrics */
+static void _stat(Socket_T socket, Port_T P) {
+        unsigned char request[MEMCACHELEN] = {MAGIC_REQUEST, OPCODE_STAT};
+        if (Socket_write(socket, request, sizeof(request)) <= 0)
+                THROW(IOException, "MEMCACHE: error sending STAT request -- %s", STRERROR);
+        Protocol_resetMetrics(P);
+        while (true) {
+                unsigned char response[MEMCACHELEN];
+                if (Socket_read(socket, response, sizeof(response)) != MEMCACHELEN)
+                        THROW(IOException, "MEMCACHE: error receiving STAT response -- %s", STRERROR);
+                if (response[0] != MAGIC_RESPONSE || response[1] != OPCODE_STAT)
+                        THROW(IOException, "MEMCACHE: Invalid STAT response");
+                unsigned int status = (response[6] << 8) | response[7];
+                if (status != NO_ERROR)
+                        THROW(IOException, "MEMCACHE: STAT error -- response code %u", status);
+                unsigned int keylength = (response[2] << 8) | response[3];
+                unsigned int extraslength = response[4];
+                unsigned int bodylength = (unsigned)response[8] << 24 | response[9] << 16 | response[10] << 8 | response[11];
+                if (keylength == 0)
+                        break;
+                if (extraslength + keylength > bodylength)
+                        THROW(IOException, "MEMCACHE: Invalid STAT response length %u", bodylength);
+                // The statistics are short, such as "evictions" and "12345", a longer one is truncated
+                char body[STRLEN];
+                unsigned int length = MIN(bodylength, sizeof(body) - 1);
+                if (Socket_read(socket, body, length) != (int)length)
+                        THROW(IOException, "MEMCACHE: error receiving STAT response -- %s", STRERROR);
+                for (unsigned int skip = bodylength - length; skip > 0;) {
+                        char b[STRLEN];
+                        int n = Socket_read(socket, b, MIN(skip, sizeof(b)));
+                        if (n <= 0)
+                                THROW(IOException, "MEMCACHE: error receiving STAT response -- %s", STRERROR);
+                        skip -= n;
+                }
+                body[length] = 0;
+                if (extraslength + keylength > length)
+                        continue;
+                char name[STRLEN];
+                snprintf(name, sizeof(name), "%.*s", (int)keylength, body + extraslength);
+                Protocol_setMetric(P, name, body + extraslength + keylength);
+        }
+        Protocol_checkMetrics(P, "MEMCACHE");
+}
+
+
 /**
  *  Memcache binary protocol
  *
- *  Send No-op request
+ *  Send No-op request. If the port has metrics, the statistics are requested
+ *  with the STAT command and tested.
  *
  *  @file
  */
@@ -63,7 +114,7 @@ void check_memcache(Socket_T socket) {
 
         unsigned char request[MEMCACHELEN] = {
                 MAGIC_REQUEST,                    /** Magic */
-                0x0a,                             /** Opcode */
+                OPCODE_NOOP,                      /** Opcode */
                 0x00, 0x00,                       /** Key length */
                 0x00,                             /** Extra length */
                 0x00,                             /** Data type */
@@ -115,6 +166,11 @@ void check_memcache(Socket_T socket) {
                         THROW(IOException, "MEMCACHELEN: Unknow response code %u -- error occured", status);
                         break;
         }
+        Port_T P = Socket_getPort(socket);
+        if (P && P->metrics)
+                _stat(socket, P);
+        // The No-op request leaves the session usable, a persistent session is tested with the same request
+        Socket_keep(socket);
 }
 
 
@@ -236,6 +236,40 @@ static void _getPadding(mysql_response_t *response, int count) {
 }
 
 
+// Length encoded integer (see http://dev.mysql.com/doc/internals/en/integer.html#packet-Protocol::LengthEncodedInteger)
+static uint64_t _getLengthEncodedInteger(mysql_response_t *response) {
+        uint8_t first = _getUInt1(response);
+        if (first < 0xfb)
+                return first;
+        else if (first == 0xfc)
+                return _getUInt2(response);
+        else if (first == 0xfd)
+                return _getUInt3(response);
+        else if (first == 0xfe) {
+                uint64_t low = _getUInt4(response);
+                return low | (uint64_t)_getUInt4(response) << 32;
+        }
+        THROW(IOException, "Invalid length encoded integer");
+        return 0;
+}
+
+
+// Length encoded string (see http://dev.mysql.com/doc/internals/en/string.html#packet-Protocol::LengthEncodedString), NULL (0xfb) is returned as an empty string and the string of a truncated packet is truncated
+static char *_getLengthEncodedString(mysql_response_t *response, char *s, int size) {
+        if (response->cursor < response->limit && (uint8_t)*response->cursor == 0xfb) {
+                response->cursor++;
+                *s = 0;
+                return s;
+        }
+        uint64_t length = _getLengthEncodedInteger(response);
+        if (length > (uint64_t)(response->limit - response->cursor))
+                length = response->limit - response->cursor;
+        snprintf(s, size, "%.*s", (int)length, response->cursor);
+        response->cursor += length;
+        return s;
+}
+
+
 /* ----------------------------------------------------------- Data setter */
 
 
@@ -361,6 +395,68 @@ static void _response(mysql_t *mysql) {
 }
 
 
+// Read a packet of the result set, the payload is truncated to the buffer size and the rest of a longer packet is skipped
+static void _readPacket(mysql_t *mysql) {
+        memset(&mysql->response, 0, sizeof(mysql_response_t));
+        mysql->response.cursor = mysql->response.buf;
+        mysql->response.limit = mysql->response.buf + sizeof(mysql->response.buf);
+        if (Socket_read(mysql->socket, mysql->response.cursor, 4) < 4)
+                THROW(IOException, "Error receiving server response -- %s", STRERROR);
+        mysql->response.len = _getUInt3(&mysql->response);
+        mysql->response.seq = _getUInt1(&mysql->response);
+        uint32_t length = mysql->response.len > STRLEN ? STRLEN : mysql->response.len;
+        if (Socket_read(mysql->socket, mysql->response.cursor, length) != (int)length)
+                THROW(IOException, "Error receiving server response -- %s", STRERROR);
+        for (uint32_t skip = mysql->response.len - length; skip > 0;) {
+                char buf[STRLEN];
+                int n = Socket_read(mysql->socket, buf, skip > sizeof(buf) ? sizeof(buf) : skip);
+                if (n <= 0)
+                        THROW(IOException, "Error receiving server response -- %s", STRERROR);
+                skip -= n;
+        }
+        mysql->response.limit = mysql->response.cursor + length;
+}
+
+
+// EOF packet of the result set, a row cannot start with 0xfe in a packet shorter than 9 bytes
+static boolean_t _isEof(mysql_t *mysql) {
+        return mysql->response.len < 9 && mysql->response.cursor < mysql->response.limit && (uint8_t)*mysql->response.cursor == MYSQL_EOF;
+}
+
+
+// Text result set of SHOW GLOBAL STATUS (see http://dev.mysql.com/doc/internals/en/com-query-response.html): column count, column definitions, EOF, rows with the variable name and value, EOF
+static void _responseStatus(mysql_t *mysql) {
+        _readPacket(mysql);
+        if ((uint8_t)*mysql->response.cursor == MYSQL_ERROR) {
+                mysql->response.header = _getUInt1(&mysql->response);
+                _responseError(mysql);
+        }
+        uint64_t columns = _getLengthEncodedInteger(&mysql->response);
+        if (columns != 2)
+                THROW(IOException, "Unexpected SHOW GLOBAL STATUS result with %llu columns", (unsigned long long)columns);
+        for (uint64_t i = 0; i < columns; i++)
+                _readPacket(mysql);
+        _readPacket(mysql);
+        if (! _isEof(mysql))
+                THROW(IOException, "Invalid SHOW GLOBAL STATUS result -- EOF packet expected");
+        Protocol_resetMetrics(mysql->port);
+        while (true) {
+                _readPacket(mysql);
+                if (_isEof(mysql))
+                        break;
+                if ((uint8_t)*mysql->response.cursor == MYSQL_ERROR) {
+                        mysql->response.header = _getUInt1(&mysql->response);
+                        _responseError(mysql);
+                }
+                char name[STRLEN], value[STRLEN];
+                _getLengthEncodedString(&mysql->response, name, sizeof(name));
+                _getLengthEncodedString(&mysql->response, value, sizeof(value));
+                Protocol_setMetric(mysql->port, name, value);
+        }
+        mysql->state = MySQL_Ok;
+}
+
+
 /* ------------------------------------------------------ Request handlers */
 
 
@@ -447,22 +543,21 @@ static void _requestPing(mysql_t *mysql) {
 }
 
 
-/*
-// Note: we currently don't implement COM_QUERY *response* handler (OK/EOF packet with payload), if it'll be added and COM_QUERY used, uncomment the following COM_QUERY request implementation.
-//
-//   Usage (for example):
-//      _requestQuery(&mysql, "show global status");
-//
-
-// COM_QUERY packet (see http://dev.mysql.com/doc/internals/en/com-query.html)
-static void _requestQuery(mysql_t *mysql, const unsigned char *query) {
+// COM_QUERY packet (see http://dev.mysql.com/doc/internals/en/com-query.html), the only query response handled is the SHOW GLOBAL STATUS result set
+static void _requestQuery(mysql_t *mysql, const char *query) {
         ASSERT(mysql->state == MySQL_Ok);
         _initRequest(mysql, 0);
         _setUInt1(&mysql->request, COM_QUERY);
         _setData(&mysql->request, query, strlen(query));
         _sendRequest(mysql);
 }
-*/
+
+
+// Read the server status variables for the port metrics
+static void _requestStatus(mysql_t *mysql) {
+        _requestQuery(mysql, "SHOW GLOBAL STATUS");
+        _responseStatus(mysql);
+}
 
 
 /* ---------------------------------------------------------------- Public */
@@ -470,6 +565,7 @@ static void _requestQuery(mysql_t *mysql, const unsigned char *query) {
 
 /**
  * Simple MySQL test. Connect to MySQL and read Server Handshake Packet. If we can read the packet and it is not an error packet we assume the server is up and working.
+ * If the port has metrics, the login is required and the status variables are tested.
  *
  *  @see http://dev.mysql.com/doc/internals/en/client-server-protocol.html
  */
@@ -491,11 +587,35 @@ void check_mysql(Socket_T socket) {
                         RETHROW;
         }
         END_TRY;
-        // If we're logged in, ping and quit
+        // If we're logged in, ping and quit, unless the session is persistent
         if (mysql.state == MySQL_Ok) {
                 _requestPing(&mysql);
                 _response(&mysql);
-                _requestQuit(&mysql);
+                if (mysql.port->metrics)
+                        _requestStatus(&mysql);
+                if (! Socket_keep(socket))
+                        _requestQuit(&mysql);
+                if (mysql.port->metrics)
+                        Protocol_checkMetrics(mysql.port, "MYSQL");
+        } else if (mysql.port->metrics) {
+                THROW(IOException, "Login failed, the server status cannot be read");
+        }
+}
+
+
+/**
+ * Test the persistent MySQL session with COM_PING, the session was logged in by check_mysql()
+ */
+void ping_mysql(Socket_T socket) {
+        ASSERT(socket);
+        mysql_t mysql = {.state = MySQL_Ok, .socket = socket, .port = Socket_getPort(socket)};
+        _requestPing(&mysql);
+        _response(&mysql);
+        if (mysql.state != MySQL_Ok)
+                THROW(IOException, "Invalid COM_PING response -- not MySQL protocol");
+        if (mysql.port->metrics) {
+                _requestStatus(&mysql);
+                Protocol_checkMetrics(mysql.port, "MYSQL");
         }
 }
 
@@ -46,24 +46,18 @@ void check_nntp(Socket_T socket) {
 
         ASSERT(socket);
 
-        if (! Socket_readLine(socket, buf, sizeof(buf)))
+        if ((status = Socket_readResponse(socket, buf, sizeof(buf), NULL, NULL)) < 0)
                 THROW(IOException, "NNTP: error receiving data -- %s", STRERROR);
 
-        Str_chomp(buf);
-
-        sscanf(buf, "%d %*s", &status);
         if (status != 200)
                 THROW(IOException, "NNTP error: %s", buf);
 
         if (Socket_print(socket, "QUIT\r\n") < 0)
                 THROW(IOException, "NNTP: error sending data -- %s", STRERROR);
 
-        if (! Socket_readLine(socket, buf, sizeof(buf)))
+        if ((status = Socket_readResponse(socket, buf, sizeof(buf), NULL, NULL)) < 0)
                 THROW(IOException, "NNTP: error receiving data -- %s", STRERROR);
 
-        Str_chomp(buf);
-
-        sscanf(buf, "%d %*s", &status);
         if (status != 205)
                 THROW(IOException, "NNTP error: %s", buf);
 }
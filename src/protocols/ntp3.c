@@ -52,36 +52,32 @@
 #define NTP_VERSION       3 /** Version Number: 3                      */
 #define NTP_MODE_CLIENT   3 /** Mode:           Client                 */
 #define NTP_MODE_SERVER   4 /** Mode:           Server                 */
+#define NTP_TRANSMIT     40 /** Offset of the transmit timestamp       */
 
 
 /* ------------------------------------------------------------------ Public */
 
 
-void check_ntp3(Socket_T socket) {
-        int  br;
-        char ntpRequest[NTPLEN] = {};
-        char ntpResponse[NTPLEN] = {};
-
-        ASSERT(socket);
-
+int request_ntp3(Port_T P, unsigned char *buf, int size, uint64_t id) {
+        ASSERT(size >= NTPLEN);
+        memset(buf, 0, NTPLEN);
         /*
          Prepare NTP request. The first octet consists of:
          bits 0-1 ... Leap Indicator
          bits 2-4 ... Version Number
          bits 5-7 ... Mode
          */
-        ntpRequest[0]= (NTP_LEAP_NOTSYNC << 6) | (NTP_VERSION << 3) | (NTP_MODE_CLIENT);
-
-        /* Send request to NTP server */
-        if (Socket_write(socket, ntpRequest, NTPLEN) <= 0)
-                THROW(IOException, "NTP: error sending NTP request -- %s", STRERROR);
+        buf[0] = (NTP_LEAP_NOTSYNC << 6) | (NTP_VERSION << 3) | (NTP_MODE_CLIENT);
+        /* The transmit timestamp is returned by the server as the originate timestamp */
+        for (int i = 0; i < 8; i++)
+                buf[NTP_TRANSMIT + i] = (id >> (56 - i * 8)) & 0xff;
+        return NTPLEN;
+}
 
-        /* Receive and validate response */
-        if ((br = Socket_read(socket, ntpResponse, NTPLEN)) <= 0)
-                THROW(IOException, "NTP: did not receive answer from server -- %s", STRERROR);
 
-        if (br != NTPLEN)
-                THROW(IOException, "NTP: Received %d bytes from server, expected %d bytes", br, NTPLEN);
+void response_ntp3(Port_T P, const unsigned char *response, int length) {
+        if (length != NTPLEN)
+                THROW(IOException, "NTP: Received %d bytes from server, expected %d bytes", length, NTPLEN);
 
         /*
          Compare NTP response. The first octet consists of:
@@ -89,11 +85,32 @@ void check_ntp3(Socket_T socket) {
          bits 2-4 ... Version Number
          bits 5-7 ... Mode
          */
-        if ((ntpResponse[0] & 0x07) != NTP_MODE_SERVER)
+        if ((response[0] & 0x07) != NTP_MODE_SERVER)
                 THROW(IOException, "NTP: Server mode error");
-        if ((ntpResponse[0] & 0x38) != NTP_VERSION << 3)
+        if ((response[0] & 0x38) != NTP_VERSION << 3)
                 THROW(IOException, "NTP: Server protocol version error");
-        if ((ntpResponse[0] & 0xc0) == NTP_LEAP_NOTSYNC << 6)
+        if ((response[0] & 0xc0) == NTP_LEAP_NOTSYNC << 6)
                 THROW(IOException, "NTP: Server not synchronized");
 }
 
+
+void check_ntp3(Socket_T socket) {
+        int  br;
+        unsigned char ntpRequest[NTPLEN] = {};
+        unsigned char ntpResponse[NTPLEN] = {};
+
+        ASSERT(socket);
+
+        request_ntp3(Socket_getPort(socket), ntpRequest, sizeof(ntpRequest), 0);
+
+        /* Send request to NTP server */
+        if (Socket_write(socket, ntpRequest, NTPLEN) <= 0)
+                THROW(IOException, "NTP: error sending NTP request -- %s", STRERROR);
+
+        /* Receive and validate response */
+        if ((br = Socket_read(socket, ntpResponse, NTPLEN)) <= 0)
+                THROW(IOException, "NTP: did not receive answer from server -- %s", STRERROR);
+
+        response_ntp3(Socket_getPort(socket), ntpResponse, br);
+}
+
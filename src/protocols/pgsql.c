@@ -34,6 +34,33 @@
 #include "exceptions/IOException.h"
 
 
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Read the backend messages up to ReadyForQuery, the session is then
+ * ready for the next query
+ */
+static void _readyForQuery(Socket_T socket) {
+        unsigned char header[5];
+        do {
+                if (Socket_read(socket, header, sizeof(header)) != sizeof(header))
+                        THROW(IOException, "PGSQL: error receiving data -- %s", STRERROR);
+                if (*header == 'E')
+                        THROW(IOException, "PGSQL: server returned error");
+                uint32_t length = (uint32_t)header[1] << 24 | (uint32_t)header[2] << 16 | (uint32_t)header[3] << 8 | (uint32_t)header[4];
+                if (length < 4)
+                        THROW(IOException, "PGSQL: invalid message length %u", length);
+                for (length -= 4; length > 0; length--)
+                        if (Socket_readByte(socket) < 0)
+                                THROW(IOException, "PGSQL: error receiving data -- %s", STRERROR);
+        } while (*header != 'Z');
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
 /**
  *  PostgreSQL test.
  *
@@ -119,8 +146,11 @@ void check_pgsql(Socket_T socket) {
 
         /** Successful connection */
         if (! memcmp((unsigned char *)buf, (unsigned char *)responseAuthOk, 9)) {
-                /** This is where suspicious people can do SELECT query that I dont */
-                Socket_write(socket, (unsigned char *)requestTerm, sizeof(requestTerm));
+                /** A persistent session is kept logged in, ping_pgsql() does the SELECT query */
+                if (Socket_keep(socket))
+                        _readyForQuery(socket);
+                else
+                        Socket_write(socket, (unsigned char *)requestTerm, sizeof(requestTerm));
                 return;
         }
 
@@ -131,3 +161,29 @@ void check_pgsql(Socket_T socket) {
         THROW(IOException, "PGSQL: unknown error");
 }
 
+
+/**
+ *  Test the persistent PostgreSQL session with a "SELECT 1" query, the
+ *  session was logged in by check_pgsql().
+ */
+void ping_pgsql(Socket_T socket) {
+        unsigned char requestQuery[14] = {
+                0x51,                              /** Type Q */
+
+                0x00,                              /** Length */
+                0x00,
+                0x00,
+                0x0d,
+
+                0x53, 0x45, 0x4c, 0x45, 0x43, 0x54, 0x20, 0x31,  /** SELECT 1 */
+
+                0x00
+        };
+
+        ASSERT(socket);
+
+        if (Socket_write(socket, (unsigned char *)requestQuery, sizeof(requestQuery)) <= 0)
+                THROW(IOException, "PGSQL: error sending data -- %s", STRERROR);
+        _readyForQuery(socket);
+}
+
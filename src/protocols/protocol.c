@@ -36,8 +36,16 @@
 #include <string.h>
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
 #include "protocol.h"
 
+// libmonit
+#include "system/Time.h"
+#include "exceptions/IOException.h"
+
 static Protocol_T protocols[] = {
         &(struct Protocol_T){"DEFAULT",         check_default},
         &(struct Protocol_T){"HTTP",            check_http},
@@ -55,21 +63,24 @@ static Protocol_T protocols[] = {
         &(struct Protocol_T){"generic",         check_generic},
         &(struct Protocol_T){"APACHESTATUS",    check_apache_status},
         &(struct Protocol_T){"NTP3",            check_ntp3},
-        &(struct Protocol_T){"MYSQL",           check_mysql},
+        &(struct Protocol_T){"MYSQL",           check_mysql,     ping_mysql},
         &(struct Protocol_T){"DNS",             check_dns},
         &(struct Protocol_T){"POSTFIX-POLICY",  check_postfix_policy},
         &(struct Protocol_T){"TNS",             check_tns},
-        &(struct Protocol_T){"PGSQL",           check_pgsql},
+        &(struct Protocol_T){"PGSQL",           check_pgsql,     ping_pgsql},
         &(struct Protocol_T){"CLAMAV",          check_clamav},
         &(struct Protocol_T){"SIP",             check_sip},
         &(struct Protocol_T){"LMTP",            check_lmtp},
         &(struct Protocol_T){"GPS",             check_gps},
         &(struct Protocol_T){"RADIUS",          check_radius},
-        &(struct Protocol_T){"MEMCACHE",        check_memcache},
-        &(struct Protocol_T){"WEBSOCKET",       check_websocket},
-        &(struct Protocol_T){"REDIS",           check_redis},
+        &(struct Protocol_T){"MEMCACHE",        check_memcache,  check_memcache},
+        &(struct Protocol_T){"WEBSOCKET",       check_websocket, ping_websocket},
+        &(struct Protocol_T){"REDIS",           check_redis,     check_redis},
         &(struct Protocol_T){"MONGODB",         check_mongodb},
-        &(struct Protocol_T){"SIEVE",           check_sieve}
+        &(struct Protocol_T){"SIEVE",           check_sieve},
+        &(struct Protocol_T){"HTTP2",           check_http2},
+        &(struct Protocol_T){"GRPC",            check_grpc},
+        &(struct Protocol_T){"SNMP",            check_snmp}
 };
 
 
@@ -83,3 +94,65 @@ Protocol_T Protocol_get(Protocol_Type type) {
 }
 
 
+void Protocol_resetMetrics(Port_T P) {
+        ASSERT(P);
+        for (ServerMetric_T m = P->metrics; m; m = m->next)
+                m->found = false;
+}
+
+
+void Protocol_setMetric(Port_T P, const char *name, const char *value) {
+        ASSERT(P);
+        ASSERT(name);
+        ASSERT(value);
+        for (ServerMetric_T m = P->metrics; m; m = m->next) {
+                if (Str_isEqual(m->name, name)) {
+                        snprintf(m->value, sizeof(m->value), "%s", value);
+                        Str_trim(m->value);
+                        m->found = true;
+                }
+        }
+}
+
+
+void Protocol_checkMetrics(Port_T P, const char *protocol) {
+        ASSERT(P);
+        char report[STRLEN] = {};
+        for (ServerMetric_T m = P->metrics; m; m = m->next) {
+                char error[STRLEN] = {};
+                if (! m->found) {
+                        snprintf(error, sizeof(error), "%s not reported by the server", m->name);
+                } else if (m->text) {
+                        if (Str_isEqual(m->value, m->text) != (m->operator == Operator_Equal))
+                                snprintf(error, sizeof(error), "%s is '%s', expected %s '%s'", m->name, m->value, operatorshortnames[m->operator], m->text);
+                } else {
+                        char *end;
+                        double value = strtod(m->value, &end);
+                        if (end == m->value || *end) {
+                                snprintf(error, sizeof(error), "%s is '%s', not a number", m->name, m->value);
+                        } else if (m->rate) {
+                                // The counter is compared as the change per second since the previous test, a counter reset starts over
+                                long long now = Time_monotonicMicro(), sampled = m->sampled;
+                                double last = m->last;
+                                m->last = value;
+                                m->sampled = now;
+                                if (! sampled || value < last || now <= sampled) {
+                                        DEBUG("%s: %s is %s, the rate is known after the next test\n", protocol, m->name, m->value);
+                                        continue;
+                                }
+                                double rate = (value - last) * 1000000. / (now - sampled);
+                                if (! Util_evalDoubleQExpression(m->operator, rate, m->limit))
+                                        snprintf(error, sizeof(error), "%s rate is %.2f/s, expected %s %.15g", m->name, rate, operatorshortnames[m->operator], m->limit);
+                        } else if (! Util_evalDoubleQExpression(m->operator, value, m->limit)) {
+                                snprintf(error, sizeof(error), "%s is %s, expected %s %.15g", m->name, m->value, operatorshortnames[m->operator], m->limit);
+                        }
+                }
+                if (*error)
+                        snprintf(report + strlen(report), sizeof(report) - strlen(report), "%s%s", *report ? "; " : "", error);
+                else
+                        DEBUG("%s: %s is %s\n", protocol, m->name, m->value);
+        }
+        if (*report)
+                THROW(IOException, "%s: %s", protocol, report);
+}
+
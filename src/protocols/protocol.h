@@ -63,7 +63,10 @@ typedef enum {
         Protocol_WEBSOCKET,
         Protocol_REDIS,
         Protocol_MONGODB,
-        Protocol_SIEVE
+        Protocol_SIEVE,
+        Protocol_HTTP2,
+        Protocol_GRPC,
+        Protocol_SNMP
 } Protocol_Type;
 
 
@@ -73,7 +76,9 @@ void check_dns(Socket_T);
 void check_dwp(Socket_T);
 void check_ftp(Socket_T);
 void check_generic(Socket_T);
+void check_grpc(Socket_T);
 void check_http(Socket_T);
+void check_http2(Socket_T);
 void check_imap(Socket_T);
 void check_clamav(Socket_T);
 void check_ldap2(Socket_T);
@@ -86,6 +91,7 @@ void check_postfix_policy(Socket_T);
 void check_pop(Socket_T);
 void check_sieve(Socket_T);
 void check_smtp(Socket_T);
+void check_snmp(Socket_T);
 void check_ssh(Socket_T);
 void check_redis(Socket_T);
 void check_rdate(Socket_T);
@@ -100,10 +106,46 @@ void check_memcache(Socket_T);
 void check_websocket(Socket_T);
 
 
+/* Tests of a persistent session */
+void ping_mysql(Socket_T);
+void ping_pgsql(Socket_T);
+void ping_websocket(Socket_T);
+
+
+/* Datagrams of the batched UDP tests (see udpbatch.h), the response is checked after it was matched by the transaction ID. The request returns its length or -1 if it doesn't fit in the buffer. */
+int request_dns(Port_T P, unsigned char *buf, int size, uint64_t id);
+void response_dns(Port_T P, const unsigned char *response, int length);
+int request_ntp3(Port_T P, unsigned char *buf, int size, uint64_t id);
+void response_ntp3(Port_T P, const unsigned char *response, int length);
+int request_snmp(Port_T P, unsigned char *buf, int size, uint64_t id);
+void response_snmp(Port_T P, const unsigned char *response, int length);
+boolean_t id_snmp(const unsigned char *response, int length, uint64_t *id);
+
+
 /*
  * Returns a protocol object for the given protocol type
  */
 Protocol_T Protocol_get(Protocol_Type type);
 
 
+/*
+ * Forget the server statistics received by the previous test of the port
+ */
+void Protocol_resetMetrics(Port_T P);
+
+
+/*
+ * Keep the server statistic if a metric of the port tests it
+ */
+void Protocol_setMetric(Port_T P, const char *name, const char *value);
+
+
+/*
+ * Test the received server statistics against the metric thresholds of the
+ * port and throw IOException listing all the failed metrics. The rate
+ * metrics are tested as the change per second since the previous test.
+ */
+void Protocol_checkMetrics(Port_T P, const char *protocol);
+
+
 #endif
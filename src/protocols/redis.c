@@ -24,12 +24,69 @@
 
 #include "config.h"
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
 #include "protocol.h"
 
 // libmonit
 #include "exceptions/IOException.h"
 
 
+/* ----------------------------------------------------------- Definitions */
+
+
+#define REDIS_INFO_MAX (1024 * 1024)
+
+
+/* -------------------------------------------------------------- Private */
+
+
+/* Read the INFO bulk string and keep the "name:value" lines tested by the port metrics */
+static void _info(Socket_T socket, Port_T P) {
+        char buf[STRLEN];
+        if (Socket_print(socket, "*1\r\n$4\r\nINFO\r\n") < 0)
+                THROW(IOException, "REDIS: INFO command error -- %s", STRERROR);
+        if (! Socket_readLine(socket, buf, sizeof(buf)))
+                THROW(IOException, "REDIS: INFO response error -- %s", STRERROR);
+        Str_chomp(buf);
+        if (*buf != '$')
+                THROW(IOException, "REDIS: INFO error -- %s", buf);
+        int length = Str_parseInt(buf + 1);
+        if (length < 0 || length > REDIS_INFO_MAX)
+                THROW(IOException, "REDIS: INFO response error -- invalid length %d", length);
+        char *info = ALLOC(length + 3);
+        TRY
+        {
+                if (Socket_read(socket, info, length + 2) != length + 2)
+                        THROW(IOException, "REDIS: INFO response error -- %s", STRERROR);
+                info[length] = 0;
+                Protocol_resetMetrics(P);
+                for (char *line = info, *next; line && *line; line = next) {
+                        next = strchr(line, '\n');
+                        if (next)
+                                *next++ = 0;
+                        char *value = strchr(line, ':');
+                        if (*line != '#' && value) {
+                                *value++ = 0;
+                                Protocol_setMetric(P, line, value);
+                        }
+                }
+        }
+        FINALLY
+        {
+                FREE(info);
+        }
+        END_TRY;
+        Protocol_checkMetrics(P, "REDIS");
+}
+
+
 /* --------------------------------------------------------------- Public */
 
 
@@ -38,7 +95,8 @@
  *
  *     1. send a PING command
  *     2. expect a PONG response
- *     3. send a QUIT command
+ *     3. if the port has metrics, send an INFO command and test the statistics
+ *     4. send a QUIT command unless the session is persistent
  *
  * @see http://redis.io/topics/protocol
  *
@@ -55,7 +113,10 @@ void check_redis(Socket_T socket) {
         Str_chomp(buf);
         if (! Str_isEqual(buf, "+PONG") && ! Str_startsWith(buf, "-NOAUTH")) // We accept authentication error (-NOAUTH Authentication required): redis responded to request, but requires authentication => we assume it works
                 THROW(IOException, "REDIS: PING error -- %s", buf);
-        if (Socket_print(socket, "*1\r\n$4\r\nQUIT\r\n") < 0)
+        Port_T P = Socket_getPort(socket);
+        if (P && P->metrics)
+                _info(socket, P);
+        if (! Socket_keep(socket) && Socket_print(socket, "*1\r\n$4\r\nQUIT\r\n") < 0)
                 THROW(IOException, "REDIS: QUIT command error -- %s", STRERROR);
 }
 
@@ -0,0 +1,922 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+#include "md5.h"
+#include "sha1.h"
+#include "protocol.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/IOException.h"
+
+
+/**
+ *  SNMP test
+ *
+ *  Reads the object identifiers configured as the metrics of the port with
+ *  one GetRequest and checks the values against the metric thresholds. If no
+ *  metric is configured, sysUpTime.0 is read to test that the agent answers.
+ *
+ *  SNMP v1 and v2c use the community. SNMPv3 uses the User-based Security
+ *  Model (RFC 3414) with HMAC-MD5-96 or HMAC-SHA-96 authentication and the
+ *  AES-128 privacy (RFC 3826), the engine is discovered by the first test and
+ *  rediscovered if the agent reports an unknown engine or time window.
+ *
+ *  The v1 and v2c tests are sent by the UDP batch (see udpbatch.h), which
+ *  matches the reply by the request ID, SNMPv3 is tested on its own socket.
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define SNMP_DATAGRAM  1472 /** Largest request and reply [B] */
+#define SNMP_UPTIME    "1.3.6.1.2.1.1.3.0" /** sysUpTime.0, read if no metric is configured */
+#define SNMP_KEY       20 /** Largest localized key (SHA1) */
+#define SNMP_DIGEST    12 /** Length of the truncated HMAC-96 */
+#define SNMP_SALT      8 /** Length of the AES salt */
+#define SNMP_ENGINE    32 /** Largest engine ID */
+#define SNMP_EXPANSION 1048576 /** The passphrase is repeated to 1MB for the key (RFC 3414 A.2.1) */
+#define SNMP_ATTEMPTS  3 /** Exchanges of one SNMPv3 test: discovery, time synchronization and the request */
+
+
+/* BER and SNMP tags */
+#define Ber_Integer        0x02
+#define Ber_OctetString    0x04
+#define Ber_Null           0x05
+#define Ber_Oid            0x06
+#define Ber_Sequence       0x30
+#define Ber_IpAddress      0x40
+#define Ber_Counter32      0x41
+#define Ber_Gauge32        0x42
+#define Ber_TimeTicks      0x43
+#define Ber_Opaque         0x44
+#define Ber_Counter64      0x46
+#define Pdu_Get            0xA0
+#define Pdu_Response       0xA2
+#define Pdu_Report         0xA8
+
+
+/* SNMPv3 message flags */
+#define Usm_Auth           0x01
+#define Usm_Priv           0x02
+#define Usm_Reportable     0x04
+
+
+/* usmStats reported by the SNMPv3 agent */
+#define Usm_NotInTimeWindows "1.3.6.1.6.3.15.1.1.2.0"
+#define Usm_UnknownEngineIDs "1.3.6.1.6.3.15.1.1.4.0"
+
+
+/* The discovered SNMPv3 engine and the keys localized to it, see Port_T parameters */
+struct SnmpEngine_T {
+        unsigned char id[SNMP_ENGINE];
+        int length;                                        /**< Engine ID length */
+        long long boots;                                     /**< snmpEngineBoots */
+        long long time;             /**< snmpEngineTime at the synchronization [s] */
+        long long synced;         /**< Time of the synchronization [us, monotonic] */
+        int keyLength;
+        unsigned char authKey[SNMP_KEY];
+        unsigned char privKey[SNMP_KEY];
+        uint64_t salt;                               /**< The last AES salt used */
+};
+
+
+/* BER encoder, the length is back-patched when the constructed value ends */
+typedef struct Ber_T {
+        unsigned char *buf;
+        int size;
+        int length;
+        boolean_t overflow;
+} Ber_T;
+
+
+/* A decoded tag, length and value */
+typedef struct Tlv_T {
+        unsigned char tag;
+        const unsigned char *value;
+        int length;
+} Tlv_T;
+
+
+/* The parsed SNMPv3 message */
+typedef struct Usm_T {
+        long long id;                                                 /**< msgID */
+        int flags;                                                 /**< msgFlags */
+        Tlv_T engine;                                /**< msgAuthoritativeEngineID */
+        long long boots;                          /**< msgAuthoritativeEngineBoots */
+        long long time;                            /**< msgAuthoritativeEngineTime */
+        Tlv_T auth;                                /**< msgAuthenticationParameters */
+        Tlv_T priv;                                       /**< msgPrivacyParameters */
+        Tlv_T data;                          /**< The scopedPDU or encryptedPDU */
+} Usm_T;
+
+
+typedef struct Digest_T {
+        Hash_Type type;
+        union {
+                md5_context_t md5;
+                sha1_context_t sha1;
+        } ctx;
+} Digest_T;
+
+
+static const char *errorStatus[] = {
+        "noError", "tooBig", "noSuchName", "badValue", "readOnly", "genErr", "noAccess", "wrongType", "wrongLength", "wrongEncoding",
+        "wrongValue", "noCreation", "inconsistentValue", "resourceUnavailable", "commitFailed", "undoFailed", "authorizationError",
+        "notWritable", "inconsistentName"
+};
+
+
+static const char *usmStats[] = {
+        "unknown", "unsupported security level", "message not in time window", "unknown user name", "unknown engine ID", "wrong digest", "decryption error"
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _put(Ber_T *b, const void *data, int length) {
+        if (b->overflow || b->length + length > b->size) {
+                b->overflow = true;
+                return;
+        }
+        memcpy(b->buf + b->length, data, length);
+        b->length += length;
+}
+
+
+/**
+ * Start the constructed value
+ * @return The offset of its content, to be passed to _end()
+ */
+static int _begin(Ber_T *b, unsigned char tag) {
+        _put(b, (unsigned char[]){tag, 0}, 2);
+        return b->length;
+}
+
+
+/**
+ * End the constructed value, the content is moved if the length doesn't fit in one byte
+ */
+static void _end(Ber_T *b, int start) {
+        if (b->overflow)
+                return;
+        int length = b->length - start;
+        int extra = length < 0x80 ? 0 : length < 0x100 ? 1 : 2;
+        if (b->length + extra > b->size) {
+                b->overflow = true;
+                return;
+        }
+        memmove(b->buf + start + extra, b->buf + start, length);
+        if (extra == 0) {
+                b->buf[start - 1] = length;
+        } else if (extra == 1) {
+                b->buf[start - 1] = 0x81;
+                b->buf[start] = length;
+        } else {
+                b->buf[start - 1] = 0x82;
+                b->buf[start] = length >> 8;
+                b->buf[start + 1] = length & 0xFF;
+        }
+        b->length += extra;
+}
+
+
+static void _octets(Ber_T *b, unsigned char tag, const void *data, int length) {
+        int start = _begin(b, tag);
+        _put(b, data, length);
+        _end(b, start);
+}
+
+
+static void _integer(Ber_T *b, long long value) {
+        unsigned char c[8];
+        int n = 0;
+        // The shortest two's complement form
+        do {
+                c[7 - n++] = value & 0xFF;
+                value >>= 8;
+        } while (n < 8 && ! ((value == 0 && ! (c[8 - n] & 0x80)) || (value == -1 && (c[8 - n] & 0x80))));
+        _octets(b, Ber_Integer, c + 8 - n, n);
+}
+
+
+static void _arc(Ber_T *b, uint32_t arc) {
+        unsigned char c[5];
+        int n = 0;
+        do {
+                c[4 - n] = (arc & 0x7F) | (n ? 0x80 : 0);
+                arc >>= 7;
+                n++;
+        } while (arc);
+        _put(b, c + 5 - n, n);
+}
+
+
+/**
+ * Encode the object identifier in the dotted form, the leading dot is optional
+ * @return true on success, false if the object identifier is invalid
+ */
+static boolean_t _oid(Ber_T *b, const char *oid) {
+        uint32_t arcs[128];
+        int n = 0;
+        const char *s = *oid == '.' ? oid + 1 : oid;
+        while (*s) {
+                if (! isdigit((unsigned char)*s) || n == (int)(sizeof(arcs) / sizeof(arcs[0])))
+                        return false;
+                char *end;
+                unsigned long long arc = strtoull(s, &end, 10);
+                if (arc > UINT32_MAX)
+                        return false;
+                arcs[n++] = (uint32_t)arc;
+                s = end;
+                if (*s == '.' && ! *++s)
+                        return false;
+        }
+        if (n < 2 || arcs[0] > 2 || (arcs[0] < 2 && arcs[1] > 39) || arcs[1] > UINT32_MAX - 80)
+                return false;
+        int start = _begin(b, Ber_Oid);
+        _arc(b, arcs[0] * 40 + arcs[1]);
+        for (int i = 2; i < n; i++)
+                _arc(b, arcs[i]);
+        _end(b, start);
+        return true;
+}
+
+
+/**
+ * Read the next value
+ * @return true on success, false if the value is truncated
+ */
+static boolean_t _next(const unsigned char **p, const unsigned char *end, Tlv_T *t) {
+        if (end - *p < 2)
+                return false;
+        t->tag = *(*p)++;
+        unsigned int length = *(*p)++;
+        if (length & 0x80) {
+                int n = length & 0x7F;
+                if (n < 1 || n > 4 || end - *p < n)
+                        return false;
+                for (length = 0; n--; (*p)++)
+                        length = length << 8 | **p;
+        }
+        if ((unsigned int)(end - *p) < length)
+                return false;
+        t->value = *p;
+        t->length = length;
+        *p += length;
+        return true;
+}
+
+
+static void _expect(const unsigned char **p, const unsigned char *end, unsigned char tag, Tlv_T *t) {
+        if (! _next(p, end, t) || t->tag != tag)
+                THROW(IOException, "SNMP: malformed reply");
+}
+
+
+static long long _toInteger(Tlv_T *t) {
+        if (t->length < 1 || t->length > 8)
+                THROW(IOException, "SNMP: malformed integer in the reply");
+        uint64_t value = t->value[0] & 0x80 ? UINT64_MAX : 0;
+        for (int i = 0; i < t->length; i++)
+                value = value << 8 | t->value[i];
+        return (long long)value;
+}
+
+
+static boolean_t _toUnsigned(Tlv_T *t, unsigned long long *value) {
+        if (t->length < 1 || t->length > 9 || (t->length == 9 && t->value[0]))
+                return false;
+        *value = 0;
+        for (int i = 0; i < t->length; i++)
+                *value = *value << 8 | t->value[i];
+        return true;
+}
+
+
+static boolean_t _oidToString(Tlv_T *t, char *s, int size) {
+        int length = 0;
+        uint64_t arc = 0;
+        *s = 0;
+        for (int i = 0; i < t->length; i++) {
+                arc = arc << 7 | (t->value[i] & 0x7F);
+                if (arc > UINT32_MAX + 80ULL)
+                        return false;
+                if (t->value[i] & 0x80)
+                        continue;
+                if (! length)
+                        length = snprintf(s, size, "%d.%llu", arc < 80 ? (int)(arc / 40) : 2, (unsigned long long)(arc < 80 ? arc % 40 : arc - 80));
+                else
+                        length += snprintf(s + length, size - length, ".%llu", (unsigned long long)arc);
+                if (length >= size)
+                        return false;
+                arc = 0;
+        }
+        return length > 0 && ! (t->value[t->length - 1] & 0x80);
+}
+
+
+/**
+ * Render the value as the metric text
+ * @return true on success, false if the agent has no value (noSuchObject, noSuchInstance, endOfMibView) or the type is not supported
+ */
+static boolean_t _toString(Tlv_T *t, char *s, int size) {
+        unsigned long long value;
+        switch (t->tag) {
+                case Ber_Integer:
+                        snprintf(s, size, "%lld", _toInteger(t));
+                        return true;
+                case Ber_Counter32:
+                case Ber_Gauge32:
+                case Ber_TimeTicks:
+                case Ber_Counter64:
+                        if (! _toUnsigned(t, &value))
+                                return false;
+                        snprintf(s, size, "%llu", value);
+                        return true;
+                case Ber_OctetString:
+                case Ber_Opaque:
+                        for (int i = 0; i < t->length; i++) {
+                                if (! isprint(t->value[i]) && ! isspace(t->value[i])) {
+                                        // Binary string, such as the MAC address
+                                        *s = 0;
+                                        for (int j = 0, length = 0; j < t->length && length < size - 3; j++)
+                                                length += snprintf(s + length, size - length, "%s%02x", j ? ":" : "", t->value[j]);
+                                        return true;
+                                }
+                        }
+                        snprintf(s, size, "%.*s", t->length, t->value);
+                        return true;
+                case Ber_Oid:
+                        return _oidToString(t, s, size);
+                case Ber_IpAddress:
+                        if (t->length != 4)
+                                return false;
+                        snprintf(s, size, "%d.%d.%d.%d", t->value[0], t->value[1], t->value[2], t->value[3]);
+                        return true;
+                default:
+                        return false;
+        }
+}
+
+
+static boolean_t _isFirst(Port_T P, ServerMetric_T m) {
+        for (ServerMetric_T n = P->metrics; n != m; n = n->next)
+                if (Str_isEqual(n->name, m->name))
+                        return false;
+        return true;
+}
+
+
+static boolean_t _varbind(Ber_T *b, const char *oid) {
+        int start = _begin(b, Ber_Sequence);
+        if (! _oid(b, oid))
+                return false;
+        _put(b, (unsigned char[]){Ber_Null, 0}, 2);
+        _end(b, start);
+        return true;
+}
+
+
+/**
+ * Encode the GetRequest with all metrics of the port
+ * @return true on success, false if an object identifier is invalid or the request is too long
+ */
+static boolean_t _pdu(Ber_T *b, Port_T P, int32_t id) {
+        int pdu = _begin(b, Pdu_Get);
+        _integer(b, id);
+        _integer(b, 0); // error-status
+        _integer(b, 0); // error-index
+        int list = _begin(b, Ber_Sequence);
+        if (! P->metrics && ! _varbind(b, SNMP_UPTIME))
+                return false;
+        for (ServerMetric_T m = P->metrics; m; m = m->next)
+                if (_isFirst(P, m) && ! _varbind(b, m->name))
+                        return false;
+        _end(b, list);
+        _end(b, pdu);
+        return ! b->overflow;
+}
+
+
+/**
+ * Check the Response PDU and the metrics
+ * @param id The request ID or -1 if the reply was matched already
+ */
+static void _response(Port_T P, Tlv_T *pdu, long long id) {
+        const unsigned char *p = pdu->value, *end = p + pdu->length;
+        Tlv_T t, list;
+        if (pdu->tag != Pdu_Response)
+                THROW(IOException, "SNMP: unexpected PDU type 0x%02x in the reply", pdu->tag);
+        _expect(&p, end, Ber_Integer, &t);
+        if (id >= 0 && _toInteger(&t) != id)
+                THROW(IOException, "SNMP: the reply doesn't match the request ID");
+        _expect(&p, end, Ber_Integer, &t);
+        long long status = _toInteger(&t);
+        _expect(&p, end, Ber_Integer, &t);
+        long long index = _toInteger(&t);
+        if (status)
+                THROW(IOException, "SNMP: the agent replied with error %s (variable %lld)", status > 0 && status < (long long)(sizeof(errorStatus) / sizeof(errorStatus[0])) ? errorStatus[status] : "unknown", index);
+        _expect(&p, end, Ber_Sequence, &list);
+        Protocol_resetMetrics(P);
+        for (p = list.value, end = p + list.length; p < end;) {
+                Tlv_T varbind, oid, value;
+                _expect(&p, end, Ber_Sequence, &varbind);
+                const unsigned char *q = varbind.value;
+                _expect(&q, varbind.value + varbind.length, Ber_Oid, &oid);
+                if (! _next(&q, varbind.value + varbind.length, &value))
+                        THROW(IOException, "SNMP: malformed reply");
+                char name[STRLEN], text[64];
+                if (_oidToString(&oid, name, sizeof(name)) && _toString(&value, text, sizeof(text)))
+                        Protocol_setMetric(P, name, text);
+        }
+        Protocol_checkMetrics(P, "SNMP");
+}
+
+
+/**
+ * Check the v1 or v2c reply
+ * @param id The request ID or -1 if the reply was matched already
+ */
+static void _communityResponse(Port_T P, const unsigned char *response, int length, long long id) {
+        const unsigned char *p = response, *end = response + length;
+        Tlv_T message, t, pdu;
+        _expect(&p, end, Ber_Sequence, &message);
+        p = message.value;
+        end = p + message.length;
+        _expect(&p, end, Ber_Integer, &t);
+        if (_toInteger(&t) != (P->parameters.snmp.version == 1 ? 0 : 1))
+                THROW(IOException, "SNMP: the reply version doesn't match the request");
+        _expect(&p, end, Ber_OctetString, &t);
+        if (! _next(&p, end, &pdu))
+                THROW(IOException, "SNMP: malformed reply");
+        _response(P, &pdu, id);
+}
+
+
+/**
+ * Read the reply message, Socket_read() would wait for more datagrams, the length is read from the BER header first
+ * @return The length of the reply
+ */
+static int _receive(Socket_T socket, unsigned char *buf, int size) {
+        if (Socket_read(socket, buf, 2) != 2)
+                THROW(IOException, "SNMP: did not receive answer from agent -- %s", STRERROR);
+        int header = 2, length = buf[1];
+        if (length & 0x80) {
+                header += length & 0x7F;
+                if (header > 4 || Socket_read(socket, buf + 2, header - 2) != header - 2)
+                        THROW(IOException, "SNMP: malformed reply");
+                length = 0;
+                for (int i = 2; i < header; i++)
+                        length = length << 8 | buf[i];
+        }
+        if (buf[0] != Ber_Sequence || header + length > size)
+                THROW(IOException, "SNMP: malformed reply");
+        if (Socket_read(socket, buf + header, length) != length)
+                THROW(IOException, "SNMP: the reply is truncated");
+        return header + length;
+}
+
+
+static int32_t _id(void) {
+        return (int32_t)(random() & 0x7FFFFFFF);
+}
+
+
+/* ------------------------------------------------------------------ SNMPv3 */
+
+
+static void _digestInit(Digest_T *d, Hash_Type type) {
+        d->type = type;
+        if (type == Hash_Md5)
+                md5_init(&d->ctx.md5);
+        else
+                sha1_init(&d->ctx.sha1);
+}
+
+
+static void _digestAppend(Digest_T *d, const unsigned char *data, int length) {
+        if (d->type == Hash_Md5)
+                md5_append(&d->ctx.md5, (const md5_byte_t *)data, length);
+        else
+                sha1_append(&d->ctx.sha1, data, length);
+}
+
+
+static void _digestFinish(Digest_T *d, unsigned char *digest) {
+        if (d->type == Hash_Md5)
+                md5_finish(&d->ctx.md5, digest);
+        else
+                sha1_finish(&d->ctx.sha1, digest);
+}
+
+
+static int _keyLength(Hash_Type type) {
+        return type == Hash_Md5 ? 16 : SHA1_DIGEST_SIZE;
+}
+
+
+/**
+ * Localize the passphrase to the engine (RFC 3414 A.2)
+ */
+static void _localize(Hash_Type type, const char *passphrase, struct SnmpEngine_T *e, unsigned char *key) {
+        Digest_T d;
+        unsigned char block[64], ku[SNMP_KEY];
+        int length = (int)strlen(passphrase);
+        _digestInit(&d, type);
+        for (int count = 0, index = 0; count < SNMP_EXPANSION; count += sizeof(block)) {
+                for (int i = 0; i < (int)sizeof(block); i++)
+                        block[i] = passphrase[index++ % length];
+                _digestAppend(&d, block, sizeof(block));
+        }
+        _digestFinish(&d, ku);
+        _digestInit(&d, type);
+        _digestAppend(&d, ku, _keyLength(type));
+        _digestAppend(&d, e->id, e->length);
+        _digestAppend(&d, ku, _keyLength(type));
+        _digestFinish(&d, key);
+}
+
+
+static void _hmac(Hash_Type type, const unsigned char *key, int keyLength, const unsigned char *data, int length, unsigned char *digest) {
+        Digest_T d;
+        unsigned char pad[64], inner[SNMP_KEY];
+        memset(pad, 0x36, sizeof(pad));
+        for (int i = 0; i < keyLength; i++)
+                pad[i] ^= key[i];
+        _digestInit(&d, type);
+        _digestAppend(&d, pad, sizeof(pad));
+        _digestAppend(&d, data, length);
+        _digestFinish(&d, inner);
+        memset(pad, 0x5c, sizeof(pad));
+        for (int i = 0; i < keyLength; i++)
+                pad[i] ^= key[i];
+        _digestInit(&d, type);
+        _digestAppend(&d, pad, sizeof(pad));
+        _digestAppend(&d, inner, keyLength);
+        _digestFinish(&d, digest);
+}
+
+
+/**
+ * AES-128-CFB with the IV of RFC 3826 3.1.2.1: the engine boots and time and the salt
+ * @return true on success, otherwise false
+ */
+static boolean_t _aes(boolean_t encrypt, const unsigned char *key, long long boots, long long time, const unsigned char *salt, const unsigned char *in, int length, unsigned char *out) {
+#ifdef HAVE_OPENSSL
+        unsigned char iv[16] = {
+                boots >> 24, boots >> 16, boots >> 8, boots,
+                time >> 24, time >> 16, time >> 8, time
+        };
+        memcpy(iv + 8, salt, SNMP_SALT);
+        int n = 0, final = 0;
+        EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+        boolean_t rv = ctx && EVP_CipherInit_ex(ctx, EVP_aes_128_cfb128(), NULL, key, iv, encrypt) && EVP_CipherUpdate(ctx, out, &n, in, length) && EVP_CipherFinal_ex(ctx, out + n, &final);
+        EVP_CIPHER_CTX_free(ctx);
+        return rv;
+#else
+        return false;
+#endif
+}
+
+
+/**
+ * Parse the SNMPv3 message
+ */
+static void _parseUsm(const unsigned char *message, int length, Usm_T *u) {
+        const unsigned char *p = message, *end = message + length;
+        Tlv_T t, global, security, usm;
+        _expect(&p, end, Ber_Sequence, &t);
+        p = t.value;
+        end = p + t.length;
+        _expect(&p, end, Ber_Integer, &t);
+        if (_toInteger(&t) != 3)
+                THROW(IOException, "SNMP: the reply version doesn't match the request");
+        _expect(&p, end, Ber_Sequence, &global);
+        const unsigned char *q = global.value, *qend = q + global.length;
+        _expect(&q, qend, Ber_Integer, &t);
+        u->id = _toInteger(&t);
+        _expect(&q, qend, Ber_Integer, &t);
+        _expect(&q, qend, Ber_OctetString, &t);
+        if (t.length != 1)
+                THROW(IOException, "SNMP: malformed reply");
+        u->flags = t.value[0];
+        _expect(&p, end, Ber_OctetString, &security);
+        q = security.value;
+        qend = q + security.length;
+        _expect(&q, qend, Ber_Sequence, &usm);
+        q = usm.value;
+        qend = q + usm.length;
+        _expect(&q, qend, Ber_OctetString, &u->engine);
+        _expect(&q, qend, Ber_Integer, &t);
+        u->boots = _toInteger(&t);
+        _expect(&q, qend, Ber_Integer, &t);
+        u->time = _toInteger(&t);
+        _expect(&q, qend, Ber_OctetString, &t); // msgUserName
+        _expect(&q, qend, Ber_OctetString, &u->auth);
+        _expect(&q, qend, Ber_OctetString, &u->priv);
+        if (! _next(&p, end, &u->data))
+                THROW(IOException, "SNMP: malformed reply");
+}
+
+
+/**
+ * Encode the SNMPv3 GetRequest, or the discovery request if the engine is not known yet
+ * @return The length of the request or -1 if it cannot be built
+ */
+static int _usmRequest(Port_T P, struct SnmpEngine_T *e, unsigned char *buf, int size, int32_t id) {
+        boolean_t discovery = ! e->length;
+        int flags = Usm_Reportable;
+        if (! discovery && P->parameters.snmp.password)
+                flags |= Usm_Auth;
+        if (! discovery && P->parameters.snmp.privacy)
+                flags |= Usm_Priv;
+        long long boots = e->boots, time = e->time + (e->synced ? (Time_monotonicMicro() - e->synced) / 1000000 : 0);
+        unsigned char salt[SNMP_SALT] = {};
+        if (flags & Usm_Priv) {
+                e->salt++;
+                for (int i = 0; i < SNMP_SALT; i++)
+                        salt[i] = e->salt >> (56 - i * 8);
+        }
+        // The scopedPDU
+        unsigned char scoped[SNMP_DATAGRAM];
+        Ber_T s = {.buf = scoped, .size = sizeof(scoped)};
+        int start = _begin(&s, Ber_Sequence);
+        _octets(&s, Ber_OctetString, e->id, e->length); // contextEngineID
+        _octets(&s, Ber_OctetString, "", 0); // contextName
+        if (! _pdu(&s, P, id))
+                return -1;
+        _end(&s, start);
+        if (s.overflow)
+                return -1;
+        // The message
+        Ber_T b = {.buf = buf, .size = size};
+        int message = _begin(&b, Ber_Sequence);
+        _integer(&b, 3);
+        int global = _begin(&b, Ber_Sequence);
+        _integer(&b, id);
+        _integer(&b, SNMP_DATAGRAM);
+        _octets(&b, Ber_OctetString, (unsigned char[]){flags}, 1);
+        _integer(&b, 3); // The User-based Security Model
+        _end(&b, global);
+        int security = _begin(&b, Ber_OctetString);
+        int usm = _begin(&b, Ber_Sequence);
+        _octets(&b, Ber_OctetString, e->id, e->length);
+        _integer(&b, boots);
+        _integer(&b, time);
+        _octets(&b, Ber_OctetString, P->parameters.snmp.username, discovery ? 0 : (int)strlen(P->parameters.snmp.username));
+        _octets(&b, Ber_OctetString, (unsigned char[SNMP_DIGEST]){}, flags & Usm_Auth ? SNMP_DIGEST : 0); // Signed below
+        _octets(&b, Ber_OctetString, salt, flags & Usm_Priv ? SNMP_SALT : 0);
+        _end(&b, usm);
+        _end(&b, security);
+        if (flags & Usm_Priv) {
+                unsigned char encrypted[SNMP_DATAGRAM];
+                if (! _aes(true, e->privKey, boots, time, salt, scoped, s.length, encrypted))
+                        return -1;
+                _octets(&b, Ber_OctetString, encrypted, s.length);
+        } else {
+                _put(&b, scoped, s.length);
+        }
+        _end(&b, message);
+        if (b.overflow)
+                return -1;
+        if (flags & Usm_Auth) {
+                Usm_T u;
+                unsigned char digest[SNMP_KEY];
+                _parseUsm(buf, b.length, &u);
+                _hmac(P->parameters.snmp.authentication, e->authKey, e->keyLength, buf, b.length, digest);
+                memcpy((unsigned char *)u.auth.value, digest, SNMP_DIGEST);
+        }
+        return b.length;
+}
+
+
+/**
+ * Synchronize with the engine of the reply, the keys are localized if the engine ID changed
+ */
+static void _synchronize(Port_T P, struct SnmpEngine_T *e, Usm_T *u) {
+        if (u->engine.length < 1 || u->engine.length > SNMP_ENGINE)
+                THROW(IOException, "SNMP: invalid engine ID in the reply");
+        if (e->length != u->engine.length || memcmp(e->id, u->engine.value, e->length)) {
+                memcpy(e->id, u->engine.value, u->engine.length);
+                e->length = u->engine.length;
+                e->keyLength = _keyLength(P->parameters.snmp.authentication);
+                if (P->parameters.snmp.password)
+                        _localize(P->parameters.snmp.authentication, P->parameters.snmp.password, e, e->authKey);
+                if (P->parameters.snmp.privacy)
+                        _localize(P->parameters.snmp.authentication, P->parameters.snmp.privacy, e, e->privKey);
+        }
+        e->boots = u->boots;
+        e->time = u->time;
+        e->synced = Time_monotonicMicro();
+}
+
+
+/**
+ * Verify the HMAC of the reply, the authentication parameters are zeroed in the reply buffer
+ */
+static void _authenticate(Port_T P, struct SnmpEngine_T *e, unsigned char *reply, int length, Usm_T *u) {
+        if (! P->parameters.snmp.password || ! e->length || u->auth.length != SNMP_DIGEST)
+                THROW(IOException, "SNMP: unexpected authentication parameters in the reply");
+        unsigned char received[SNMP_DIGEST], digest[SNMP_KEY];
+        memcpy(received, u->auth.value, SNMP_DIGEST);
+        memset((unsigned char *)u->auth.value, 0, SNMP_DIGEST);
+        _hmac(P->parameters.snmp.authentication, e->authKey, e->keyLength, reply, length, digest);
+        if (memcmp(received, digest, SNMP_DIGEST))
+                THROW(IOException, "SNMP: the reply authentication failed -- wrong password?");
+}
+
+
+static void _usm(Socket_T socket, Port_T P) {
+        struct SnmpEngine_T *e = P->parameters.snmp.engine;
+        if (! e) {
+                e = P->parameters.snmp.engine = CALLOC(1, sizeof(struct SnmpEngine_T));
+                e->salt = (uint64_t)random() << 32 | (uint64_t)random();
+        }
+        for (int attempt = 0; attempt < SNMP_ATTEMPTS; attempt++) {
+                unsigned char request[SNMP_DATAGRAM], reply[SNMP_DATAGRAM], decrypted[SNMP_DATAGRAM];
+                int32_t id = _id();
+                boolean_t discovery = ! e->length;
+                int length = _usmRequest(P, e, request, sizeof(request), id);
+                if (length < 0)
+                        THROW(IOException, "SNMP: cannot build the request -- invalid object identifier or more metrics than fit in %d bytes", SNMP_DATAGRAM);
+                if (Socket_write(socket, request, length) <= 0)
+                        THROW(IOException, "SNMP: error sending request -- %s", STRERROR);
+                length = _receive(socket, reply, sizeof(reply));
+                Usm_T u;
+                _parseUsm(reply, length, &u);
+                if (u.id != id)
+                        THROW(IOException, "SNMP: the reply doesn't match the request ID");
+                if (u.flags & Usm_Auth)
+                        _authenticate(P, e, reply, length, &u);
+                Tlv_T scoped = u.data;
+                if (u.flags & Usm_Priv) {
+                        if (! P->parameters.snmp.privacy || u.data.tag != Ber_OctetString || u.priv.length != SNMP_SALT || ! _aes(false, e->privKey, u.boots, u.time, u.priv.value, u.data.value, u.data.length, decrypted))
+                                THROW(IOException, "SNMP: cannot decrypt the reply");
+                        const unsigned char *p = decrypted;
+                        _expect(&p, decrypted + u.data.length, Ber_Sequence, &scoped);
+                } else if (scoped.tag != Ber_Sequence) {
+                        THROW(IOException, "SNMP: malformed reply");
+                }
+                Tlv_T t, pdu;
+                const unsigned char *p = scoped.value, *end = p + scoped.length;
+                _expect(&p, end, Ber_OctetString, &t); // contextEngineID
+                _expect(&p, end, Ber_OctetString, &t); // contextName
+                if (! _next(&p, end, &pdu))
+                        THROW(IOException, "SNMP: malformed reply");
+                if (pdu.tag != Pdu_Report) {
+                        if (P->parameters.snmp.password && ! (u.flags & Usm_Auth))
+                                THROW(IOException, "SNMP: the reply is not authenticated");
+                        _synchronize(P, e, &u);
+                        _response(P, &pdu, id);
+                        return;
+                }
+                // The report names the usmStats counter of the failure
+                char report[STRLEN] = {};
+                Tlv_T list, varbind, oid;
+                p = pdu.value;
+                end = p + pdu.length;
+                for (int i = 0; i < 3; i++)
+                        _expect(&p, end, Ber_Integer, &t);
+                _expect(&p, end, Ber_Sequence, &list);
+                p = list.value;
+                if (_next(&p, list.value + list.length, &varbind)) {
+                        p = varbind.value;
+                        _expect(&p, varbind.value + varbind.length, Ber_Oid, &oid);
+                        _oidToString(&oid, report, sizeof(report));
+                }
+                if (Str_isEqual(report, Usm_UnknownEngineIDs) && discovery) {
+                        _synchronize(P, e, &u);
+                        DEBUG("SNMP: discovered the engine of [%s]:%d\n", P->hostname, P->target.net.port);
+                } else if (Str_isEqual(report, Usm_NotInTimeWindows) && (u.flags & Usm_Auth)) {
+                        _synchronize(P, e, &u);
+                } else if (Str_isEqual(report, Usm_UnknownEngineIDs)) {
+                        // The engine restarted with another ID, discover it again
+                        e->length = 0;
+                        e->boots = e->time = e->synced = 0;
+                } else {
+                        int stat = Str_startsWith(report, "1.3.6.1.6.3.15.1.1.") ? atoi(report + 19) : 0;
+                        THROW(IOException, "SNMP: the agent reported %s", stat > 0 && stat < (int)(sizeof(usmStats) / sizeof(usmStats[0])) ? usmStats[stat] : *report ? report : "an error");
+                }
+        }
+        THROW(IOException, "SNMP: the agent did not accept the request after the engine discovery");
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int request_snmp(Port_T P, unsigned char *buf, int size, uint64_t id) {
+        ASSERT(P);
+        Ber_T b = {.buf = buf, .size = MIN(size, SNMP_DATAGRAM)};
+        int message = _begin(&b, Ber_Sequence);
+        _integer(&b, P->parameters.snmp.version == 1 ? 0 : 1);
+        _octets(&b, Ber_OctetString, P->parameters.snmp.community, (int)strlen(P->parameters.snmp.community));
+        if (! _pdu(&b, P, (int32_t)(id & 0x7FFFFFFF)))
+                return -1;
+        _end(&b, message);
+        return b.overflow ? -1 : b.length;
+}
+
+
+void response_snmp(Port_T P, const unsigned char *response, int length) {
+        ASSERT(P);
+        _communityResponse(P, response, length, -1);
+}
+
+
+boolean_t id_snmp(const unsigned char *response, int length, uint64_t *id) {
+        const unsigned char *p = response, *end = response + length;
+        Tlv_T message, t;
+        if (! _next(&p, end, &message) || message.tag != Ber_Sequence)
+                return false;
+        p = message.value;
+        end = p + message.length;
+        // The version, the community, the PDU and the request ID
+        if (! _next(&p, end, &t) || t.tag != Ber_Integer || t.length != 1 || t.value[0] > 1)
+                return false;
+        if (! _next(&p, end, &t) || t.tag != Ber_OctetString)
+                return false;
+        if (! _next(&p, end, &message) || message.tag != Pdu_Response)
+                return false;
+        p = message.value;
+        end = p + message.length;
+        if (! _next(&p, end, &t) || t.tag != Ber_Integer || t.length < 1 || t.length > 4)
+                return false;
+        *id = 0;
+        for (int i = 0; i < t.length; i++)
+                *id = *id << 8 | t.value[i];
+        return true;
+}
+
+
+void check_snmp(Socket_T socket) {
+        ASSERT(socket);
+        Port_T P = Socket_getPort(socket);
+        ASSERT(P);
+        if (P->parameters.snmp.version == 3) {
+                _usm(socket, P);
+                return;
+        }
+        unsigned char request[SNMP_DATAGRAM], response[SNMP_DATAGRAM];
+        int32_t id = _id();
+        int length = request_snmp(P, request, sizeof(request), id);
+        if (length < 0)
+                THROW(IOException, "SNMP: cannot build the request -- invalid object identifier or more metrics than fit in %d bytes", SNMP_DATAGRAM);
+        if (Socket_write(socket, request, length) <= 0)
+                THROW(IOException, "SNMP: error sending request -- %s", STRERROR);
+        length = _receive(socket, response, sizeof(response));
+        _communityResponse(P, response, length, id);
+}
+
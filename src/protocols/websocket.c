@@ -31,6 +31,7 @@
 #include "protocol.h"
 
 // libmonit
+#include "system/Time.h"
 #include "exceptions/IOException.h"
 
 
@@ -39,44 +40,124 @@
  *
  *  http://tools.ietf.org/html/rfc6455
  *
- *  Establish websocket connection, send ping and close.
+ *  Establish websocket connection, send ping and close. If the port is
+ *  persistent, the connection is kept open and the next cycles only send
+ *  the ping.
  *
  *  @file
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+#define WEBSOCKET_CLOSE        0x8
+#define WEBSOCKET_PING         0x9
+#define WEBSOCKET_PONG         0xA
+
+
+/* Largest frame payload which is read and skipped, a realtime server may send data frames between the cycles */
+#define WEBSOCKET_MAXPAYLOAD   (16 * 1024 * 1024)
+
+
+/* The client frames must be masked, the key is arbitrary */
+static const unsigned char mask[4] = {0x5b, 0x63, 0x68, 0x84};
+
+
 /* ----------------------------------------------------------------- Private */
 
 
-static void read_response(Socket_T socket, int opcode) {
-        int n;
-        do {
+static void _read(Socket_T socket, void *buf, int length) {
+        if (length > 0 && Socket_read(socket, buf, length) != length)
+                THROW(IOException, "WEBSOCKET: response data read error -- %s", STRERROR);
+}
+
+
+/**
+ * Read one frame, the payload up to size bytes is kept and the rest skipped
+ * @return The frame opcode
+ */
+static int _readFrame(Socket_T socket, unsigned char *payload, int size, int *length) {
+        unsigned char header[8];
+        if (Socket_read(socket, header, 2) != 2)
+                THROW(IOException, "WEBSOCKET: response header read error -- %s", STRERROR);
+        int opcode = header[0] & 0xF;
+        boolean_t masked = header[1] & 0x80;
+        unsigned long long n = header[1] & 0x7F;
+        if (n == 126) {
+                _read(socket, header, 2);
+                n = (header[0] << 8) | header[1];
+        } else if (n == 127) {
+                _read(socket, header, 8);
+                n = 0;
+                for (int i = 0; i < 8; i++)
+                        n = (n << 8) | header[i];
+        }
+        if (n > WEBSOCKET_MAXPAYLOAD)
+                THROW(IOException, "WEBSOCKET: response data read error -- unexpected payload size: %llu", n);
+        unsigned char key[4] = {};
+        if (masked)
+                _read(socket, key, 4);
+        *length = (int)(n < (unsigned long long)size ? n : (unsigned long long)size);
+        _read(socket, payload, *length);
+        for (int i = 0; masked && i < *length; i++)
+                payload[i] ^= key[i % 4];
+        for (int skip = (int)n - *length; skip > 0;) {
                 char buf[STRLEN];
-                // Read frame header
-                if ((n = Socket_read(socket, buf, 2)) != 2)
-                        THROW(IOException, "WEBSOCKET: response header read error -- %s", STRERROR);
-                /*
-                 * As we don't know the specific protocol used by this websocket server, the pipeline
-                 * may contain some frames sent by server before the response we're waiting for (such
-                 * as chat prompt sent by the server on connect) => drain frames until we find what
-                 * we need or timeout
-                 */
-                if ((*buf & 0xF) != opcode) {
-                        // Skip payload of current frame
-                        unsigned payload_size = *(buf + 1) & 0x7F;
-                        if (payload_size <= sizeof(buf)) {
-                                if ((n = Socket_read(socket, buf, payload_size)) != payload_size)
-                                        THROW(IOException, "WEBSOCKET: response data read error");
-                        } else {
-                                /* STRLEN buffer should be sufficient for any frame spuriously sent by
-                                 * the server. Guard against too large frames. If in real life such
-                                 * situation will be valid (payload > STRLEN), then fix */
-                                THROW(IOException, "WEBSOCKET: response data read error -- unexpected payload size: %d", payload_size);
-                        }
-                } else {
-                        break; // Found frame with matching opcode
-                }
-        } while (n > 0);
+                int chunk = skip < (int)sizeof(buf) ? skip : (int)sizeof(buf);
+                _read(socket, buf, chunk);
+                skip -= chunk;
+        }
+        return opcode;
+}
+
+
+static void _writeFrame(Socket_T socket, int opcode, const unsigned char *payload, int length) {
+        ASSERT(length < 126);
+        unsigned char frame[6 + 125];
+        frame[0] = 0x80 | opcode;                      // Fin:True, Opcode
+        frame[1] = 0x80 | length;                      // Mask:True, Payload length
+        memcpy(frame + 2, mask, sizeof(mask));
+        for (int i = 0; i < length; i++)
+                frame[6 + i] = payload[i] ^ mask[i % 4];
+        if (Socket_write(socket, frame, 6 + length) < 0)
+                THROW(IOException, "WEBSOCKET: error sending %s -- %s", opcode == WEBSOCKET_PING ? "ping" : opcode == WEBSOCKET_PONG ? "pong" : "close", STRERROR);
+}
+
+
+/**
+ * Read frames until the expected one arrives or the read times out. As we don't know the specific protocol used by
+ * this websocket server, the pipeline may contain some frames sent by server before the response we're waiting for
+ * (such as chat prompt sent by the server on connect, or the data of a realtime feed since the last cycle) => drain
+ * them. The server's ping is answered, so it keeps the persistent connection open.
+ * @param expect The expected opcode
+ * @param data If not NULL, the expected payload (the pong echoes the ping payload, the pongs of earlier pings are skipped)
+ */
+static void _expect(Socket_T socket, int expect, const unsigned char *data, int datalength) {
+        while (true) {
+                unsigned char payload[125];
+                int length;
+                int opcode = _readFrame(socket, payload, sizeof(payload), &length);
+                if (opcode == expect && (! data || (length == datalength && memcmp(payload, data, length) == 0)))
+                        return;
+                if (opcode == WEBSOCKET_PING)
+                        _writeFrame(socket, WEBSOCKET_PONG, payload, length);
+                else if (opcode == WEBSOCKET_CLOSE)
+                        THROW(IOException, "WEBSOCKET: the server closed the connection");
+        }
+}
+
+
+/**
+ * Send the ping and wait for the pong. The payload is the time of the ping, so the pong is matched with it.
+ */
+static void _ping(Socket_T socket) {
+        unsigned char payload[8];
+        uint64_t now = (uint64_t)Time_monotonicMicro();
+        for (int i = 0; i < 8; i++)
+                payload[i] = (now >> (56 - i * 8)) & 0xFF;
+        _writeFrame(socket, WEBSOCKET_PING, payload, sizeof(payload));
+        _expect(socket, WEBSOCKET_PONG, payload, sizeof(payload));
 }
 
 
@@ -117,28 +198,22 @@ void check_websocket(Socket_T socket) {
         while (Socket_readLine(socket, buf, sizeof(buf)) && ! Str_isEqual(buf, "\r\n"))
                 ; // drop remaining HTTP response headers from the pipeline
 
-        // Ping
-        unsigned char ping[6] = {
-                0x89,                  // Fin:True, Opcode:Ping
-                0x80,                  // Mask:True, Payload:0
-                0x5b, 0x63, 0x68, 0x84 // Key
-        };
-        if (Socket_write(socket, ping, sizeof(ping)) < 0)
-                THROW(IOException, "WEBSOCKET: error sending ping -- %s", STRERROR);
-
-        // Pong: verify response opcode is Pong (0xA)
-        read_response(socket, 0xA);
-
-        // Close request
-        unsigned char close_request[6] = {
-                0x88,                  // Fin:True, Opcode:Close
-                0x80,                  // Mask:True, Payload:0
-                0x5b, 0x63, 0x68, 0x84 // Key
-        };
-        if (Socket_write(socket, close_request, sizeof(close_request)) < 0)
-                THROW(IOException, "WEBSOCKET: error sending close -- %s", STRERROR);
-
-        // Close response (0x8)
-        read_response(socket, 0x8);
+        _ping(socket);
+
+        // Keep the connection open for ping_websocket() if the port is persistent, otherwise close
+        if (! Socket_keep(socket)) {
+                _writeFrame(socket, WEBSOCKET_CLOSE, NULL, 0);
+                _expect(socket, WEBSOCKET_CLOSE, NULL, 0);
+        }
+}
+
+
+/**
+ * Test the persistent websocket connection with a ping, the connection was upgraded by check_websocket(). A stalled
+ * connection, which doesn't answer the ping within the port timeout, fails and is reconnected.
+ */
+void ping_websocket(Socket_T socket) {
+        ASSERT(socket);
+        _ping(socket);
 }
 
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "regexcache.h"
+
+// libmonit
+#include "util/HashMap.h"
+#include "thread/Thread.h"
+
+
+/**
+ * The compiled expressions are indexed by pattern and reference counted.
+ * The regex is the first member of the entry, so the entry is found from
+ * the expression handed out without a second index.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+typedef struct RegexEntry_T {
+        regex_t regex;
+        char *pattern;
+        int references;
+} *RegexEntry_T;
+
+
+static HashMap_T cache = NULL;
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+regex_t *RegexCache_get(const char *pattern, char *error, int size) {
+        ASSERT(pattern);
+        RegexEntry_T e = NULL;
+        LOCK(mutex)
+        {
+                if (! cache)
+                        cache = HashMap_new(64, Str_cmp, Str_hash);
+                if ((e = HashMap_get(cache, pattern))) {
+                        e->references++;
+                } else {
+                        NEW(e);
+                        int status = regcomp(&e->regex, pattern, REG_NOSUB|REG_EXTENDED);
+                        if (status == 0) {
+                                e->pattern = Str_dup(pattern);
+                                e->references = 1;
+                                HashMap_put(cache, e->pattern, e);
+                        } else {
+                                if (error)
+                                        regerror(status, &e->regex, error, size);
+                                FREE(e);
+                        }
+                }
+        }
+        END_LOCK;
+        return e ? &e->regex : NULL;
+}
+
+
+void RegexCache_release(regex_t **regex) {
+        ASSERT(regex);
+        if (*regex) {
+                RegexEntry_T e = (RegexEntry_T)*regex;
+                LOCK(mutex)
+                {
+                        if (--e->references == 0) {
+                                HashMap_remove(cache, e->pattern);
+                                regfree(&e->regex);
+                                FREE(e->pattern);
+                                FREE(e);
+                        }
+                }
+                END_LOCK;
+                *regex = NULL;
+        }
+}
+
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_REGEXCACHE_H
+#define MONIT_REGEXCACHE_H
+
+#include <regex.h>
+
+#include "monit.h"
+
+
+/**
+ * Shared compiled regular expressions. The parser compiles each distinct
+ * pattern of the match, content and url tests once, services using the same
+ * pattern share the compiled expression. The expression is freed when the
+ * last test using it is released.
+ *
+ * @file
+ */
+
+
+/**
+ * Get the compiled expression of the pattern, it is compiled with the
+ * REG_NOSUB|REG_EXTENDED flags on the first use
+ * @param pattern A regular expression
+ * @param error A buffer for the error description if compilation failed
+ * @param size Size of the error buffer
+ * @return The compiled expression or NULL if compilation failed
+ */
+regex_t *RegexCache_get(const char *pattern, char *error, int size);
+
+
+/**
+ * Release the expression returned by RegexCache_get() and set it to NULL
+ * @param regex A reference to the compiled expression (may be NULL)
+ */
+void RegexCache_release(regex_t **regex);
+
+
+#endif
+
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#include "monit.h"
+#include "resolver.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The cache entry keeps a copy of the addresses returned by getaddrinfo(3)
+ * for the host name and hints, without the port. Resolver_get() returns a
+ * fresh copy with the port set, so the caller never holds cache memory.
+ * getaddrinfo(3) doesn't report the DNS record TTL, the entries expire after
+ * the configured TTL.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define RESOLVER_UNUSED 10          /**< Drop entries unused for this many TTLs */
+
+
+typedef struct ResolverAddress_T {
+        int family;
+        int socktype;
+        int protocol;
+        socklen_t addrlen;
+        struct sockaddr_storage addr;
+} ResolverAddress_T;
+
+
+typedef struct ResolverEntry_T {
+        char *hostname;
+        struct addrinfo hints;                        /**< Flags, family, socktype and protocol */
+        int count;                                           /**< Number of addresses */
+        ResolverAddress_T *addresses;
+        time_t resolved;                                /**< Time of the last lookup */
+        time_t used;                                      /**< Time of the last use */
+        boolean_t queued;                          /**< true if the refresh is pending */
+        struct ResolverEntry_T *next;
+} *ResolverEntry_T;
+
+
+static struct {
+        boolean_t running;
+        boolean_t stopped;
+        Thread_T thread;
+        Sem_T queued;                     /**< Signalled when a refresh was queued */
+        ResolverEntry_T entries;
+} resolver = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static boolean_t _isEqual(const struct addrinfo *a, const struct addrinfo *b) {
+        return a->ai_flags == b->ai_flags && a->ai_family == b->ai_family && a->ai_socktype == b->ai_socktype && a->ai_protocol == b->ai_protocol;
+}
+
+
+static void _setPort(struct sockaddr *addr, int port) {
+        if (addr->sa_family == AF_INET)
+                ((struct sockaddr_in *)addr)->sin_port = htons(port);
+#ifdef HAVE_IPV6
+        else if (addr->sa_family == AF_INET6)
+                ((struct sockaddr_in6 *)addr)->sin6_port = htons(port);
+#endif
+}
+
+
+/**
+ * Build the address list of Resolver_get() from the addresses
+ */
+static struct addrinfo *_copy(ResolverAddress_T *addresses, int count, int port) {
+        struct addrinfo *result = NULL, **last = &result;
+        for (int i = 0; i < count; i++) {
+                struct addrinfo *a = CALLOC(1, sizeof(struct addrinfo) + sizeof(struct sockaddr_storage));
+                a->ai_family = addresses[i].family;
+                a->ai_socktype = addresses[i].socktype;
+                a->ai_protocol = addresses[i].protocol;
+                a->ai_addrlen = addresses[i].addrlen;
+                a->ai_addr = (struct sockaddr *)(a + 1);
+                memcpy(a->ai_addr, &addresses[i].addr, addresses[i].addrlen);
+                _setPort(a->ai_addr, port);
+                *last = a;
+                last = &a->ai_next;
+        }
+        return result;
+}
+
+
+/**
+ * Lookup the host name, the addresses are stored without the port
+ */
+static int _lookup(const char *hostname, const struct addrinfo *hints, ResolverAddress_T **addresses, int *count) {
+        struct addrinfo *result;
+        int status = getaddrinfo(hostname, NULL, hints, &result);
+        if (status == 0) {
+                *count = 0;
+                for (struct addrinfo *r = result; r; r = r->ai_next)
+                        if (r->ai_addrlen <= sizeof(struct sockaddr_storage))
+                                (*count)++;
+                *addresses = CALLOC(*count ? *count : 1, sizeof(ResolverAddress_T));
+                int i = 0;
+                for (struct addrinfo *r = result; r; r = r->ai_next) {
+                        if (r->ai_addrlen <= sizeof(struct sockaddr_storage)) {
+                                (*addresses)[i].family = r->ai_family;
+                                (*addresses)[i].socktype = r->ai_socktype;
+                                (*addresses)[i].protocol = r->ai_protocol;
+                                (*addresses)[i].addrlen = r->ai_addrlen;
+                                memcpy(&(*addresses)[i].addr, r->ai_addr, r->ai_addrlen);
+                                i++;
+                        }
+                }
+                freeaddrinfo(result);
+        }
+        return status;
+}
+
+
+static void _freeEntry(ResolverEntry_T *e) {
+        FREE((*e)->hostname);
+        FREE((*e)->addresses);
+        FREE(*e);
+}
+
+
+/**
+ * Refresh the queued entries and drop the entries which were not used for a long time
+ */
+static void *_worker(void *args) {
+        set_signal_block();
+        LOCK(mutex)
+        {
+                while (! resolver.stopped) {
+                        ResolverEntry_T e;
+                        for (e = resolver.entries; e && ! e->queued; e = e->next)
+                                ;
+                        if (! e) {
+                                struct timespec wait = {.tv_sec = Time_now() + Run.resolverCache.ttl, .tv_nsec = 0};
+                                Sem_timeWait(resolver.queued, mutex, wait);
+                                time_t now = Time_now();
+                                for (ResolverEntry_T *p = &resolver.entries; *p;) {
+                                        if (now - (*p)->used > (time_t)Run.resolverCache.ttl * RESOLVER_UNUSED) {
+                                                ResolverEntry_T t = *p;
+                                                *p = t->next;
+                                                _freeEntry(&t);
+                                        } else {
+                                                p = &(*p)->next;
+                                        }
+                                }
+                                continue;
+                        }
+                        // Lookup without the lock, the entry isn't freed meanwhile as only this thread drops entries
+                        char *hostname = Str_dup(e->hostname);
+                        struct addrinfo hints = e->hints;
+                        Mutex_unlock(mutex);
+                        int count = 0;
+                        ResolverAddress_T *addresses = NULL;
+                        int status = _lookup(hostname, &hints, &addresses, &count);
+                        Mutex_lock(mutex);
+                        e->queued = false;
+                        e->resolved = Time_now();
+                        if (status == 0 && count > 0) {
+                                FREE(e->addresses);
+                                e->addresses = addresses;
+                                e->count = count;
+                        } else {
+                                FREE(addresses);
+                                LogError("Cannot refresh the addresses of '%s' -- %s, using the cached addresses\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+                        }
+                        FREE(hostname);
+                }
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Resolver_start() {
+        if (Run.resolverCache.ttl < 1)
+                return false;
+        LOCK(mutex)
+        {
+                if (! resolver.running) {
+                        Sem_init(resolver.queued);
+                        resolver.stopped = false;
+                        Thread_create(resolver.thread, _worker, NULL);
+                        resolver.running = true;
+                        DEBUG("Resolver thread started with %d seconds cache TTL\n", Run.resolverCache.ttl);
+                }
+        }
+        END_LOCK;
+        return true;
+}
+
+
+void Resolver_stop() {
+        if (resolver.running) {
+                LOCK(mutex)
+                {
+                        resolver.stopped = true;
+                        Sem_signal(resolver.queued);
+                }
+                END_LOCK;
+                Thread_join(resolver.thread);
+        }
+        LOCK(mutex)
+        {
+                while (resolver.entries) {
+                        ResolverEntry_T e = resolver.entries;
+                        resolver.entries = e->next;
+                        _freeEntry(&e);
+                }
+                if (resolver.running) {
+                        Sem_destroy(resolver.queued);
+                        resolver.running = false;
+                }
+        }
+        END_LOCK;
+}
+
+
+int Resolver_get(const char *hostname, int port, const struct addrinfo *hints, struct addrinfo **result) {
+        ASSERT(hostname);
+        ASSERT(hints);
+        ASSERT(result);
+        *result = NULL;
+        time_t now = Time_now();
+        boolean_t found = false;
+        if (Run.resolverCache.ttl > 0) {
+                LOCK(mutex)
+                {
+                        for (ResolverEntry_T e = resolver.entries; e; e = e->next) {
+                                if (_isEqual(&e->hints, hints) && IS(e->hostname, hostname)) {
+                                        e->used = now;
+                                        if (now - e->resolved < Run.resolverCache.ttl || resolver.running) {
+                                                // Use the expired addresses while the resolver thread refreshes them
+                                                if (now - e->resolved >= Run.resolverCache.ttl && ! e->queued) {
+                                                        e->queued = true;
+                                                        Sem_signal(resolver.queued);
+                                                }
+                                                *result = _copy(e->addresses, e->count, port);
+                                                found = true;
+                                        }
+                                        break;
+                                }
+                        }
+                }
+                END_LOCK;
+        }
+        if (found)
+                return 0;
+        int count = 0;
+        ResolverAddress_T *addresses = NULL;
+        int status = _lookup(hostname, hints, &addresses, &count);
+        if (status == 0) {
+                *result = _copy(addresses, count, port);
+                if (Run.resolverCache.ttl > 0 && count > 0) {
+                        LOCK(mutex)
+                        {
+                                ResolverEntry_T e;
+                                for (e = resolver.entries; e; e = e->next)
+                                        if (_isEqual(&e->hints, hints) && IS(e->hostname, hostname))
+                                                break;
+                                if (! e) {
+                                        NEW(e);
+                                        e->hostname = Str_dup(hostname);
+                                        e->hints.ai_flags = hints->ai_flags;
+                                        e->hints.ai_family = hints->ai_family;
+                                        e->hints.ai_socktype = hints->ai_socktype;
+                                        e->hints.ai_protocol = hints->ai_protocol;
+                                        e->next = resolver.entries;
+                                        resolver.entries = e;
+                                }
+                                FREE(e->addresses);
+                                e->addresses = addresses;
+                                e->count = count;
+                                e->resolved = e->used = now;
+                                addresses = NULL;
+                        }
+                        END_LOCK;
+                }
+        } else if (Run.resolverCache.ttl > 0) {
+                // The name server failed, use the expired addresses if we have them
+                LOCK(mutex)
+                {
+                        for (ResolverEntry_T e = resolver.entries; e; e = e->next) {
+                                if (_isEqual(&e->hints, hints) && IS(e->hostname, hostname)) {
+                                        LogError("Cannot refresh the addresses of '%s' -- %s, using the cached addresses\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+                                        e->resolved = now;
+                                        *result = _copy(e->addresses, e->count, port);
+                                        status = 0;
+                                        break;
+                                }
+                        }
+                }
+                END_LOCK;
+        }
+        FREE(addresses);
+        return status;
+}
+
+
+void Resolver_free(struct addrinfo *result) {
+        while (result) {
+                struct addrinfo *next = result->ai_next;
+                FREE(result);
+                result = next;
+        }
+}
+
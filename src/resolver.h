@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_RESOLVER_H
+#define MONIT_RESOLVER_H
+
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+
+/**
+ * Host name resolution with a cache. If enabled with "set dns cache ttl N
+ * seconds", the addresses of a host are cached for N seconds. An expired
+ * entry is still used and refreshed by the resolver thread in the
+ * background, so a slow name server doesn't stall the service checks, and
+ * the last known addresses stay in use while the name server fails. Without
+ * the cache, or before the first successful lookup, getaddrinfo(3) is
+ * called directly.
+ *
+ * @file
+ */
+
+
+/**
+ * Start the resolver thread which refreshes the expired cache entries
+ * @return true if the thread was started, otherwise false
+ */
+boolean_t Resolver_start(void);
+
+
+/**
+ * Stop the resolver thread and drop the cache
+ */
+void Resolver_stop(void);
+
+
+/**
+ * Resolve the host name like getaddrinfo(3)
+ * @param hostname The host name or address
+ * @param port The port number to set in the addresses, 0 for none
+ * @param hints The getaddrinfo(3) hints
+ * @param result The address list, must be freed with Resolver_free()
+ * @return 0 on success, otherwise the getaddrinfo(3) error code
+ */
+int Resolver_get(const char *hostname, int port, const struct addrinfo *hints, struct addrinfo **result);
+
+
+/**
+ * Free the address list returned by Resolver_get()
+ * @param result The address list
+ */
+void Resolver_free(struct addrinfo *result);
+
+
+#endif
+
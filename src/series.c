@@ -0,0 +1,765 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "monit.h"
+#include "series.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "util/HashMap.h"
+
+
+/**
+ *  Time-series store with Gorilla compressed blocks.
+ *
+ *  A block starts with the first sample in the header, each following
+ *  sample appends the timestamp and the value to the bit stream:
+ *
+ *  timestamp, the delta of the deltas D in seconds:
+ *      0                   '0'
+ *      [-63, 64]           '10' + 7 bits
+ *      [-255, 256]         '110' + 9 bits
+ *      [-2047, 2048]       '1110' + 12 bits
+ *      otherwise           '1111' + 32 bits
+ *
+ *  value, the XOR X with the previous value:
+ *      0                   '0'
+ *      in previous window  '10' + the meaningful bits of X
+ *      otherwise           '11' + 5 bits leading zeros + 6 bits length - 1 + the meaningful bits of X
+ *
+ *  A new block is started if the sample may not fit in the actual one.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#ifndef MAP_ANONYMOUS
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#define SERIES_MAGIC "MONITTS"
+#define SERIES_VERSION 1
+#define SAMPLE_MAXBITS (4 + 32 + 2 + 5 + 6 + 64)     // The longest encoded sample
+#define NO_WINDOW 0xff
+
+
+typedef struct SeriesBlock_T {
+        int64_t first;                                  /**< Timestamp of the first sample */
+        int64_t last;                                    /**< Timestamp of the last sample */
+        int64_t delta;                                 /**< Delta of the last two timestamps */
+        uint64_t origin;                      /**< Value of the first sample (IEEE 754 bits) */
+        uint64_t value;                                      /**< Value of the last sample */
+        uint32_t count;                                              /**< Number of samples */
+        uint32_t bits;                                            /**< Number of used data bits */
+        uint8_t leading;                         /**< Leading zeros of the last XOR window */
+        uint8_t trailing;                       /**< Trailing zeros of the last XOR window */
+        uint8_t data[SERIES_BLOCKSIZE];
+} SeriesBlock_T;
+
+
+typedef struct SeriesSlot_T {
+        char key[SERIES_KEYLEN];                 /**< "service\tmetric", empty = free slot */
+        uint32_t head;                                         /**< Index of the actual block */
+        uint32_t used;                                           /**< Number of used blocks */
+        SeriesBlock_T block[SERIES_BLOCKS];
+} SeriesSlot_T;
+
+
+typedef struct SeriesHeader_T {
+        char magic[8];
+        uint32_t version;
+        uint32_t slots;
+        uint32_t blocks;
+        uint32_t blocksize;
+} SeriesHeader_T;
+
+
+typedef struct SeriesCursor_T {
+        const SeriesBlock_T *block;
+        uint32_t index;                                          /**< Index of the next sample */
+        uint32_t position;                                         /**< Next bit of the stream */
+        int64_t timestamp;
+        int64_t delta;
+        uint64_t value;
+        uint8_t leading;
+        uint8_t trailing;
+} SeriesCursor_T;
+
+
+static struct {
+        SeriesHeader_T *header;                                   /**< The mapped store or NULL */
+        SeriesSlot_T *slots;
+        size_t size;                                               /**< Size of the mapping */
+        int count;                                                    /**< Number of slots */
+        char *file;                                       /**< The backing file or NULL */
+        HashMap_T index;                                            /**< Slot by the key */
+} store = {};
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _write(SeriesBlock_T *b, uint64_t value, int bits) {
+        for (int i = bits - 1; i >= 0; i--, b->bits++)
+                if ((value >> i) & 1)
+                        b->data[b->bits >> 3] |= 0x80 >> (b->bits & 7);
+}
+
+
+static uint64_t _read(SeriesCursor_T *c, int bits) {
+        uint64_t value = 0;
+        for (int i = 0; i < bits; i++, c->position++)
+                value = (value << 1) | ((c->block->data[c->position >> 3] >> (7 - (c->position & 7))) & 1);
+        return value;
+}
+
+
+static void _encodeTimestamp(SeriesBlock_T *b, int64_t dod) {
+        if (dod == 0) {
+                _write(b, 0, 1);
+        } else if (dod >= -63 && dod <= 64) {
+                _write(b, 2, 2);
+                _write(b, (uint64_t)(dod + 63), 7);
+        } else if (dod >= -255 && dod <= 256) {
+                _write(b, 6, 3);
+                _write(b, (uint64_t)(dod + 255), 9);
+        } else if (dod >= -2047 && dod <= 2048) {
+                _write(b, 14, 4);
+                _write(b, (uint64_t)(dod + 2047), 12);
+        } else {
+                _write(b, 15, 4);
+                _write(b, (uint64_t)(uint32_t)(int32_t)dod, 32);
+        }
+}
+
+
+static int64_t _decodeTimestamp(SeriesCursor_T *c) {
+        if (! _read(c, 1))
+                return 0;
+        if (! _read(c, 1))
+                return (int64_t)_read(c, 7) - 63;
+        if (! _read(c, 1))
+                return (int64_t)_read(c, 9) - 255;
+        if (! _read(c, 1))
+                return (int64_t)_read(c, 12) - 2047;
+        return (int32_t)(uint32_t)_read(c, 32);
+}
+
+
+static void _encodeValue(SeriesBlock_T *b, uint64_t value) {
+        uint64_t x = value ^ b->value;
+        if (! x) {
+                _write(b, 0, 1);
+                return;
+        }
+        int leading = __builtin_clzll(x);
+        int trailing = __builtin_ctzll(x);
+        if (leading > 31)
+                leading = 31;
+        if (b->leading != NO_WINDOW && leading >= b->leading && trailing >= b->trailing) {
+                _write(b, 2, 2);
+                _write(b, x >> b->trailing, 64 - b->leading - b->trailing);
+        } else {
+                int length = 64 - leading - trailing;
+                _write(b, 3, 2);
+                _write(b, (uint64_t)leading, 5);
+                _write(b, (uint64_t)(length - 1), 6);
+                _write(b, x >> trailing, length);
+                b->leading = (uint8_t)leading;
+                b->trailing = (uint8_t)trailing;
+        }
+}
+
+
+static uint64_t _decodeValue(SeriesCursor_T *c) {
+        if (! _read(c, 1))
+                return c->value;
+        if (_read(c, 1)) {
+                c->leading = (uint8_t)_read(c, 5);
+                int length = (int)_read(c, 6) + 1;
+                c->trailing = (uint8_t)(64 - c->leading - length);
+        }
+        return c->value ^ (_read(c, 64 - c->leading - c->trailing) << c->trailing);
+}
+
+
+static double _toDouble(uint64_t bits) {
+        double value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+}
+
+
+/**
+ * Get the next sample of the block
+ * @return true if there was a sample, false at the end of the block
+ */
+static boolean_t _next(SeriesCursor_T *c, int64_t *timestamp, double *value) {
+        const SeriesBlock_T *b = c->block;
+        if (c->index >= b->count)
+                return false;
+        if (c->index == 0) {
+                c->timestamp = b->first;
+                c->value = b->origin;
+        } else {
+                c->delta += _decodeTimestamp(c);
+                c->timestamp += c->delta;
+                c->value = _decodeValue(c);
+        }
+        c->index++;
+        *timestamp = c->timestamp;
+        *value = _toDouble(c->value);
+        return true;
+}
+
+
+static void _startBlock(SeriesBlock_T *b, int64_t timestamp, uint64_t value) {
+        memset(b, 0, sizeof(*b));
+        b->first = b->last = timestamp;
+        b->origin = b->value = value;
+        b->count = 1;
+        b->leading = NO_WINDOW;
+}
+
+
+static void _append(SeriesSlot_T *slot, int64_t timestamp, double value) {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        if (! slot->used) {
+                slot->head = 0;
+                slot->used = 1;
+                _startBlock(&slot->block[0], timestamp, bits);
+                return;
+        }
+        SeriesBlock_T *b = &slot->block[slot->head];
+        int64_t delta = timestamp - b->last;
+        int64_t dod = delta - b->delta;
+        // The blocks are kept in time order, a clock step back starts a new block
+        if (timestamp >= b->last && dod >= INT32_MIN && dod <= INT32_MAX && b->bits + SAMPLE_MAXBITS <= SERIES_BLOCKSIZE * 8) {
+                _encodeTimestamp(b, dod);
+                _encodeValue(b, bits);
+                b->delta = delta;
+                b->last = timestamp;
+                b->value = bits;
+                b->count++;
+        } else {
+                slot->head = (slot->head + 1) % SERIES_BLOCKS;
+                if (slot->used < SERIES_BLOCKS)
+                        slot->used++;
+                _startBlock(&slot->block[slot->head], timestamp, bits);
+        }
+}
+
+
+static SeriesBlock_T *_block(SeriesSlot_T *slot, uint32_t i) {
+        // The i-th block from the oldest one
+        return &slot->block[(slot->head + SERIES_BLOCKS - slot->used + 1 + i) % SERIES_BLOCKS];
+}
+
+
+static int64_t _lastUpdate(SeriesSlot_T *slot) {
+        return slot->used ? slot->block[slot->head].last : 0;
+}
+
+
+static boolean_t _key(char key[SERIES_KEYLEN], const char *service, const char *metric) {
+        return snprintf(key, SERIES_KEYLEN, "%s\t%s", service, metric) < SERIES_KEYLEN;
+}
+
+
+/**
+ * Get the slot of the key. If create is true and the key has no slot, a
+ * free slot is assigned, if there is none, the least recently updated
+ * slot is reused.
+ */
+static SeriesSlot_T *_slot(const char *key, boolean_t create) {
+        SeriesSlot_T *slot = HashMap_get(store.index, key);
+        if (slot || ! create)
+                return slot;
+        for (int i = 0; i < store.count; i++) {
+                if (! *store.slots[i].key) {
+                        slot = &store.slots[i];
+                        break;
+                }
+                if (! slot || _lastUpdate(&store.slots[i]) < _lastUpdate(slot))
+                        slot = &store.slots[i];
+        }
+        if (*slot->key) {
+                DEBUG("Series store is full -- reusing the slot of '%s'\n", slot->key);
+                HashMap_remove(store.index, slot->key);
+        }
+        memset(slot, 0, sizeof(*slot));
+        snprintf(slot->key, sizeof(slot->key), "%s", key);
+        HashMap_put(store.index, slot->key, slot);
+        return slot;
+}
+
+
+static void _add(Service_T S, const char *metric, int64_t timestamp, double value) {
+        char key[SERIES_KEYLEN];
+        if (_key(key, S->name, metric))
+                _append(_slot(key, true), timestamp, value);
+}
+
+
+static void _unmap() {
+        if (store.header) {
+                if (store.file && msync(store.header, store.size, MS_SYNC) != 0)
+                        LogError("Series file %s sync failed -- %s\n", store.file, STRERROR);
+                munmap(store.header, store.size);
+                store.header = NULL;
+                store.slots = NULL;
+        }
+        if (store.index)
+                HashMap_free(&store.index);
+        FREE(store.file);
+        store.count = 0;
+        store.size = 0;
+}
+
+
+static boolean_t _map(const char *file, int count) {
+        size_t size = sizeof(SeriesHeader_T) + (size_t)count * sizeof(SeriesSlot_T);
+        boolean_t valid = false;
+        void *p;
+        if (file) {
+                int fd = open(file, O_RDWR | O_CREAT, 0600);
+                if (fd < 0) {
+                        LogError("Series file %s open failed -- %s\n", file, STRERROR);
+                        return false;
+                }
+                struct stat st;
+                valid = fstat(fd, &st) == 0 && (size_t)st.st_size == size;
+                if (! valid && (ftruncate(fd, 0) != 0 || ftruncate(fd, size) != 0)) {
+                        LogError("Series file %s resize failed -- %s\n", file, STRERROR);
+                        close(fd);
+                        return false;
+                }
+                p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                close(fd);
+        } else {
+                p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        }
+        if (p == MAP_FAILED) {
+                LogError("Series store mapping failed -- %s\n", STRERROR);
+                return false;
+        }
+        store.header = p;
+        store.slots = (SeriesSlot_T *)((char *)p + sizeof(SeriesHeader_T));
+        store.size = size;
+        store.count = count;
+        store.file = file ? Str_dup(file) : NULL;
+        store.index = HashMap_new(count, Str_cmp, Str_hash);
+        if (valid && ! strncmp(store.header->magic, SERIES_MAGIC, sizeof(store.header->magic)) && store.header->version == SERIES_VERSION && store.header->slots == (uint32_t)count && store.header->blocks == SERIES_BLOCKS && store.header->blocksize == SERIES_BLOCKSIZE) {
+                // Index the series kept in the file
+                int series = 0;
+                for (int i = 0; i < count; i++) {
+                        SeriesSlot_T *slot = &store.slots[i];
+                        if (! *slot->key)
+                                continue;
+                        if (! memchr(slot->key, 0, sizeof(slot->key)) || slot->head >= SERIES_BLOCKS || slot->used > SERIES_BLOCKS || HashMap_get(store.index, slot->key)) {
+                                memset(slot, 0, sizeof(*slot));
+                                continue;
+                        }
+                        HashMap_put(store.index, slot->key, slot);
+                        series++;
+                }
+                DEBUG("Series file %s restored with %d series\n", file, series);
+        } else {
+                if (file)
+                        memset(p, 0, size);
+                snprintf(store.header->magic, sizeof(store.header->magic), "%s", SERIES_MAGIC);
+                store.header->version = SERIES_VERSION;
+                store.header->slots = count;
+                store.header->blocks = SERIES_BLOCKS;
+                store.header->blocksize = SERIES_BLOCKSIZE;
+        }
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Series_start() {
+        boolean_t rv = true;
+        LOCK(mutex)
+        {
+                if (! store.header || store.count != Run.seriesEngine.slots || ! IS(store.file, Run.seriesEngine.file)) {
+                        _unmap();
+                        if ((rv = _map(Run.seriesEngine.file, Run.seriesEngine.slots)))
+                                DEBUG("Series store started with %d slots (%s)\n", store.count, Str_bytesToSize(store.size, (char[10]){}));
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
+void Series_stop() {
+        LOCK(mutex)
+        {
+                _unmap();
+        }
+        END_LOCK;
+}
+
+
+void Series_record(Service_T S) {
+        ASSERT(S);
+        if (! store.header)
+                return;
+        int64_t now = Time_now();
+        LOCK(mutex)
+        {
+                if (store.header) {
+                        switch (S->type) {
+                                case Service_System:
+                                        if (systeminfo.total_cpu_user_percent >= 0.) {
+                                                _add(S, "cpu", now, systeminfo.total_cpu_user_percent + (systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.) + (systeminfo.total_cpu_wait_percent > 0. ? systeminfo.total_cpu_wait_percent : 0.));
+                                                _add(S, "cpu.user", now, systeminfo.total_cpu_user_percent);
+                                        }
+                                        if (systeminfo.total_cpu_syst_percent >= 0.)
+                                                _add(S, "cpu.system", now, systeminfo.total_cpu_syst_percent);
+                                        if (systeminfo.total_cpu_wait_percent >= 0.)
+                                                _add(S, "cpu.wait", now, systeminfo.total_cpu_wait_percent);
+                                        _add(S, "memory", now, systeminfo.total_mem);
+                                        _add(S, "memory.percent", now, systeminfo.total_mem_percent);
+                                        _add(S, "swap", now, systeminfo.total_swap);
+                                        _add(S, "swap.percent", now, systeminfo.total_swap_percent);
+                                        _add(S, "loadavg.1m", now, systeminfo.loadavg[0]);
+                                        _add(S, "loadavg.5m", now, systeminfo.loadavg[1]);
+                                        _add(S, "loadavg.15m", now, systeminfo.loadavg[2]);
+                                        break;
+                                case Service_Process:
+                                        if (S->inf->priv.process.cpu_percent >= 0.)
+                                                _add(S, "cpu", now, S->inf->priv.process.cpu_percent);
+                                        if (S->inf->priv.process.total_cpu_percent >= 0.)
+                                                _add(S, "cpu.total", now, S->inf->priv.process.total_cpu_percent);
+                                        if (S->inf->priv.process.mem_percent >= 0.) {
+                                                _add(S, "memory", now, S->inf->priv.process.mem);
+                                                _add(S, "memory.percent", now, S->inf->priv.process.mem_percent);
+                                        }
+                                        if (S->inf->priv.process.total_mem_percent >= 0.) {
+                                                _add(S, "memory.total", now, S->inf->priv.process.total_mem);
+                                                _add(S, "memory.total.percent", now, S->inf->priv.process.total_mem_percent);
+                                        }
+                                        if (S->inf->priv.process.threads >= 0)
+                                                _add(S, "threads", now, S->inf->priv.process.threads);
+                                        if (S->inf->priv.process.children >= 0)
+                                                _add(S, "children", now, S->inf->priv.process.children);
+                                        break;
+                                case Service_Filesystem:
+                                        if (S->inf->priv.filesystem.space_percent >= 0.) {
+                                                _add(S, "space", now, (double)S->inf->priv.filesystem.space_total * S->inf->priv.filesystem.f_bsize);
+                                                _add(S, "space.percent", now, S->inf->priv.filesystem.space_percent);
+                                        }
+                                        if (S->inf->priv.filesystem.inode_total > 0) {
+                                                _add(S, "inode", now, S->inf->priv.filesystem.inode_total);
+                                                _add(S, "inode.percent", now, S->inf->priv.filesystem.inode_percent);
+                                        }
+                                        break;
+                                case Service_File:
+                                        _add(S, "size", now, S->inf->priv.file.size);
+                                        break;
+                                case Service_Directory:
+                                        if (S->dirscan) {
+                                                _add(S, "size", now, S->inf->priv.directory.tree.size);
+                                                _add(S, "files", now, S->inf->priv.directory.tree.files);
+                                        }
+                                        break;
+                                default:
+                                        break;
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+void Series_recordResponse(Service_T S, Port_T P) {
+        ASSERT(S);
+        ASSERT(P);
+        if (! store.header || P->response < 0.)
+                return;
+        char metric[STRLEN];
+        if (P->family == Socket_Unix)
+                snprintf(metric, sizeof(metric), "response.%s", P->target.unix.pathname);
+        else
+                snprintf(metric, sizeof(metric), "response.%s:%d", P->hostname, P->target.net.port);
+        int64_t now = Time_now();
+        // The phases of the response time are separate series: "response.<target>.dns", ".connect", ".tls" and ".firstbyte"
+        struct {
+                const char *name;
+                double value;
+        } phases[] = {{"dns", P->phases.dns}, {"connect", P->phases.connect}, {"tls", P->phases.tls}, {"firstbyte", P->phases.firstbyte}};
+        LOCK(mutex)
+        {
+                if (store.header) {
+                        _add(S, metric, now, P->response);
+                        for (int i = 0; i < (int)(sizeof(phases) / sizeof(phases[0])); i++) {
+                                if (phases[i].value >= 0.) {
+                                        // A truncated name would be another series, skip it as _key() does for a too long key
+                                        char phase[STRLEN];
+                                        if (snprintf(phase, sizeof(phase), "%s.%s", metric, phases[i].name) < (int)sizeof(phase))
+                                                _add(S, phase, now, phases[i].value);
+                                }
+                        }
+                }
+        }
+        END_LOCK;
+}
+
+
+const char *Series_getMetric(Service_Type type, Resource_Type resource) {
+        if (type == Service_System) {
+                switch (resource) {
+                        case Resource_CpuPercent:    return "cpu";
+                        case Resource_CpuUser:       return "cpu.user";
+                        case Resource_CpuSystem:     return "cpu.system";
+                        case Resource_CpuWait:       return "cpu.wait";
+                        case Resource_MemoryKbyte:   return "memory";
+                        case Resource_MemoryPercent: return "memory.percent";
+                        case Resource_SwapKbyte:     return "swap";
+                        case Resource_SwapPercent:   return "swap.percent";
+                        case Resource_LoadAverage1m: return "loadavg.1m";
+                        case Resource_LoadAverage5m: return "loadavg.5m";
+                        case Resource_LoadAverage15m: return "loadavg.15m";
+                        default:                     return NULL;
+                }
+        } else if (type == Service_Process) {
+                switch (resource) {
+                        case Resource_CpuPercent:         return "cpu";
+                        case Resource_CpuPercentTotal:    return "cpu.total";
+                        case Resource_MemoryKbyte:        return "memory";
+                        case Resource_MemoryPercent:      return "memory.percent";
+                        case Resource_MemoryKbyteTotal:   return "memory.total";
+                        case Resource_MemoryPercentTotal: return "memory.total.percent";
+                        case Resource_Threads:            return "threads";
+                        case Resource_Children:           return "children";
+                        default:                          return NULL;
+                }
+        }
+        return NULL;
+}
+
+
+char *Series_formatValue(Resource_Type resource, double value, char buf[STRLEN]) {
+        switch (resource) {
+                case Resource_MemoryKbyte:
+                case Resource_MemoryKbyteTotal:
+                case Resource_SwapKbyte:
+                        return Str_bytesToSize(value, buf);
+                case Resource_LoadAverage1m:
+                case Resource_LoadAverage5m:
+                case Resource_LoadAverage15m:
+                case Resource_Threads:
+                case Resource_Children:
+                        snprintf(buf, STRLEN, "%.1f", value);
+                        return buf;
+                default:
+                        snprintf(buf, STRLEN, "%.1f%%", value);
+                        return buf;
+        }
+}
+
+
+boolean_t Series_average(Service_T S, const char *metric, int window, double *average) {
+        ASSERT(S);
+        ASSERT(metric);
+        ASSERT(average);
+        boolean_t covered = false;
+        char key[SERIES_KEYLEN];
+        if (! store.header || ! _key(key, S->name, metric))
+                return false;
+        int64_t since = Time_now() - window;
+        LOCK(mutex)
+        {
+                SeriesSlot_T *slot = store.header ? _slot(key, false) : NULL;
+                // The series must reach back to the window start, with the tolerance of one cycle
+                if (slot && slot->used && _block(slot, 0)->first <= since + Run.polltime) {
+                        double sum = 0.;
+                        long count = 0;
+                        for (uint32_t i = 0; i < slot->used; i++) {
+                                SeriesCursor_T cursor = {.block = _block(slot, i)};
+                                if (cursor.block->last < since)
+                                        continue;
+                                int64_t timestamp;
+                                double value;
+                                while (_next(&cursor, &timestamp, &value)) {
+                                        if (timestamp >= since) {
+                                                sum += value;
+                                                count++;
+                                        }
+                                }
+                        }
+                        if (count) {
+                                *average = sum / count;
+                                covered = true;
+                        }
+                }
+        }
+        END_LOCK;
+        return covered;
+}
+
+
+boolean_t Series_rate(Service_T S, const char *metric, int window, double *rate) {
+        ASSERT(S);
+        ASSERT(metric);
+        ASSERT(rate);
+        boolean_t computed = false;
+        char key[SERIES_KEYLEN];
+        if (! store.header || ! _key(key, S->name, metric))
+                return false;
+        LOCK(mutex)
+        {
+                SeriesSlot_T *slot = store.header ? _slot(key, false) : NULL;
+                if (slot && slot->used) {
+                        int64_t since = _lastUpdate(slot) - window;
+                        // The base is the oldest sample in the window, or the last one before it if the window holds only the newest sample
+                        int64_t timestamp, before = -1, first = -1, last = -1;
+                        double value, beforeValue = 0., firstValue = 0., lastValue = 0.;
+                        for (uint32_t i = 0; i < slot->used; i++) {
+                                SeriesCursor_T cursor = {.block = _block(slot, i)};
+                                while (_next(&cursor, &timestamp, &value)) {
+                                        if (timestamp < since) {
+                                                before = timestamp;
+                                                beforeValue = value;
+                                        } else if (first < 0) {
+                                                first = timestamp;
+                                                firstValue = value;
+                                        }
+                                        last = timestamp;
+                                        lastValue = value;
+                                }
+                        }
+                        if (first >= 0 && first < last) {
+                                *rate = (lastValue - firstValue) / (last - first);
+                                computed = true;
+                        } else if (before >= 0 && before < last) {
+                                *rate = (lastValue - beforeValue) / (last - before);
+                                computed = true;
+                        }
+                }
+        }
+        END_LOCK;
+        return computed;
+}
+
+
+int Series_print(StringBuffer_T sb, const char *service, const char *metric, time_t since) {
+        ASSERT(sb);
+        int lines = -1;
+        LOCK(mutex)
+        {
+                if (store.header) {
+                        lines = 0;
+                        for (int i = 0; i < store.count; i++) {
+                                SeriesSlot_T *slot = &store.slots[i];
+                                if (! *slot->key || ! slot->used)
+                                        continue;
+                                char key[SERIES_KEYLEN];
+                                snprintf(key, sizeof(key), "%s", slot->key);
+                                char *name = strrchr(key, '\t');
+                                *name++ = 0;
+                                if (! service) {
+                                        uint32_t samples = 0;
+                                        for (uint32_t j = 0; j < slot->used; j++)
+                                                samples += _block(slot, j)->count;
+                                        StringBuffer_append(sb, "%s %s %u %lld %lld\n", key, name, samples, (long long)_block(slot, 0)->first, (long long)_lastUpdate(slot));
+                                        lines++;
+                                } else if (IS(key, service) && (! metric || IS(name, metric))) {
+                                        for (uint32_t j = 0; j < slot->used; j++) {
+                                                SeriesCursor_T cursor = {.block = _block(slot, j)};
+                                                if (cursor.block->last < since)
+                                                        continue;
+                                                int64_t timestamp;
+                                                double value;
+                                                while (_next(&cursor, &timestamp, &value)) {
+                                                        if (timestamp >= since) {
+                                                                StringBuffer_append(sb, "%s %lld %.15g\n", name, (long long)timestamp, value);
+                                                                lines++;
+                                                        }
+                                                }
+                                        }
+                                }
+                        }
+                }
+        }
+        END_LOCK;
+        return lines;
+}
+
+
+size_t Series_memory(void) {
+        size_t size = 0;
+        LOCK(mutex)
+        {
+                size = store.header ? store.size : 0;
+        }
+        END_LOCK;
+        return size;
+}
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_SERIES_H
+#define MONIT_SERIES_H
+
+
+/**
+ * Local time-series store of the service metrics. Each metric (for example
+ * the cpu usage of a process service or the space usage of a filesystem)
+ * has one slot with a fixed number of compressed blocks, which are reused
+ * circularly, so the oldest samples are dropped and the memory use is
+ * constant: Run.seriesEngine.slots * sizeof(slot). The samples are Gorilla
+ * compressed, the timestamps are stored as the delta of the deltas and the
+ * values as the XOR with the previous value, so a sample of a metric
+ * checked in a fixed interval usually takes a few bits only. If a file is
+ * set, the store is a shared mapping of the file and survives a restart.
+ *
+ * The series are available via the HTTP interface (/_series) and are used
+ * by the average resource tests, for example "if average cpu > 80% for 10
+ * minutes then alert", and by the growth tests, for example "if size grows
+ * > 100 MB per minute then alert".
+ *
+ * @file
+ */
+
+
+#define SERIES_SLOTS 256                   /**< Default number of series slots */
+#define SERIES_BLOCKS 16                   /**< Compressed blocks per series */
+#define SERIES_BLOCKSIZE 480                /**< Compressed block data size [B] */
+#define SERIES_KEYLEN 128           /**< Maximum length of "service\tmetric" */
+
+
+/**
+ * Start the store as set by Run.seriesEngine. If the store already runs
+ * with the same setup (after a reload), it is kept with its samples.
+ * @return true if the store runs
+ */
+boolean_t Series_start(void);
+
+
+/**
+ * Stop the store and release its memory, a file backed store is synced
+ */
+void Series_stop(void);
+
+
+/**
+ * Record the actual metrics of the service. The metrics depend on the
+ * service type, the values which are not available yet are skipped.
+ * Does nothing if the store doesn't run.
+ * @param S The service
+ */
+void Series_record(Service_T S);
+
+
+/**
+ * Record the response time of a successful port or unix socket test as
+ * the "response.<host>:<port>" or "response.<path>" metric of the service.
+ * Does nothing if the store doesn't run.
+ * @param S The service
+ * @param P The port
+ */
+void Series_recordResponse(Service_T S, Port_T P);
+
+
+/**
+ * Get the name of the metric tested by the average resource test
+ * @param type The service type
+ * @param resource The resource test
+ * @return The metric name or NULL if the resource of the service type
+ * cannot be averaged
+ */
+const char *Series_getMetric(Service_Type type, Resource_Type resource);
+
+
+/**
+ * Format the value of the averaged resource: an amount, a percentage or
+ * a plain number depending on the resource
+ * @param resource The resource
+ * @param value The value
+ * @param buf The output buffer
+ * @return A pointer to buf
+ */
+char *Series_formatValue(Resource_Type resource, double value, char buf[STRLEN]);
+
+
+/**
+ * Compute the average value of the metric over the given time window
+ * @param S The service
+ * @param metric The metric name
+ * @param window The window length in seconds, ending now
+ * @param average The average output
+ * @return true if the series covers the whole window, false if it is
+ * too short (Monit was started recently) or the store doesn't run
+ */
+boolean_t Series_average(Service_T S, const char *metric, int window, double *average);
+
+
+/**
+ * Compute the growth rate of the metric, the slope between the newest
+ * sample and the oldest one within the window before it. If the window
+ * holds only the newest sample, the previous sample is used instead.
+ * @param S The service
+ * @param metric The metric name
+ * @param window The window length in seconds, ending at the newest sample
+ * @param rate The rate output [1/s], negative if the metric decreases
+ * @return true if the rate was computed, false if the series has less
+ * than two samples or the store doesn't run
+ */
+boolean_t Series_rate(Service_T S, const char *metric, int window, double *rate);
+
+
+/**
+ * Print the series samples, one "metric timestamp value" line per sample.
+ * Without the service, print one "service metric samples first last"
+ * line per series.
+ * @param sb The output buffer
+ * @param service The service name or NULL
+ * @param metric The metric name or NULL for all metrics of the service
+ * @param since Print the samples not older than this timestamp
+ * @return The number of printed lines or -1 if the store doesn't run
+ */
+int Series_print(StringBuffer_T sb, const char *service, const char *metric, time_t since);
+
+
+/**
+ * Get the size of the series store mapping
+ * @return The size in bytes, 0 if the store doesn't run
+ */
+size_t Series_memory(void);
+
+
+#endif
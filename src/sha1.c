@@ -64,9 +64,11 @@ static void sha1_transform(unsigned int state[5], const unsigned char buffer[64]
                 unsigned char c[64];
                 unsigned int l[16];
         } CHAR64LONG16;
-        CHAR64LONG16* block;
+        CHAR64LONG16 workspace;
+        CHAR64LONG16* block = &workspace;
 
-        block = (CHAR64LONG16*)buffer;
+        /* Work on a copy, the block expansion modifies the data in place and the caller's buffer must stay intact */
+        memcpy(block, buffer, 64);
 
         /* Copy context->state[] to working vars */
         a = state[0];
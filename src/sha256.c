@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "sha256.h"
+
+
+/**
+ * SHA-256 as specified in FIPS 180-4. Used when Monit is built without
+ * OpenSSL, otherwise the OpenSSL implementation is preferred.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define ror(value, bits) (((value) >> (bits)) | ((value) << (32 - (bits))))
+
+#define Ch(x, y, z)  (((x) & (y)) ^ (~(x) & (z)))
+#define Maj(x, y, z) (((x) & (y)) ^ ((x) & (z)) ^ ((y) & (z)))
+#define S0(x)        (ror(x, 2) ^ ror(x, 13) ^ ror(x, 22))
+#define S1(x)        (ror(x, 6) ^ ror(x, 11) ^ ror(x, 25))
+#define s0(x)        (ror(x, 7) ^ ror(x, 18) ^ ((x) >> 3))
+#define s1(x)        (ror(x, 17) ^ ror(x, 19) ^ ((x) >> 10))
+
+
+static const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/* Hash a single 512-bit block */
+static void _transform(uint32_t state[8], const unsigned char block[64]) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+                w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | (uint32_t)block[i * 4 + 3];
+        for (int i = 16; i < 64; i++)
+                w[i] = s1(w[i - 2]) + w[i - 7] + s0(w[i - 15]) + w[i - 16];
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+                uint32_t t1 = h + S1(e) + Ch(e, f, g) + K[i] + w[i];
+                uint32_t t2 = S0(a) + Maj(a, b, c);
+                h = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void sha256_init(sha256_context_t *context) {
+        static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+        memcpy(context->state, initial, sizeof(initial));
+        context->count = 0;
+}
+
+
+void sha256_append(sha256_context_t *context, const unsigned char *data, size_t len) {
+        size_t used = context->count % 64;
+        context->count += len;
+        if (used) {
+                size_t fill = 64 - used;
+                if (len < fill) {
+                        memcpy(context->buffer + used, data, len);
+                        return;
+                }
+                memcpy(context->buffer + used, data, fill);
+                _transform(context->state, context->buffer);
+                data += fill;
+                len -= fill;
+        }
+        for (; len >= 64; data += 64, len -= 64)
+                _transform(context->state, data);
+        if (len)
+                memcpy(context->buffer, data, len);
+}
+
+
+void sha256_finish(sha256_context_t *context, unsigned char digest[SHA256_DIGEST_SIZE]) {
+        uint64_t bits = context->count * 8;
+        size_t used = context->count % 64;
+        context->buffer[used++] = 0x80;
+        if (used > 56) {
+                memset(context->buffer + used, 0, 64 - used);
+                _transform(context->state, context->buffer);
+                used = 0;
+        }
+        memset(context->buffer + used, 0, 56 - used);
+        for (int i = 0; i < 8; i++)
+                context->buffer[56 + i] = (unsigned char)(bits >> (56 - i * 8));
+        _transform(context->state, context->buffer);
+        for (int i = 0; i < 8; i++) {
+                digest[i * 4]     = (unsigned char)(context->state[i] >> 24);
+                digest[i * 4 + 1] = (unsigned char)(context->state[i] >> 16);
+                digest[i * 4 + 2] = (unsigned char)(context->state[i] >> 8);
+                digest[i * 4 + 3] = (unsigned char)context->state[i];
+        }
+        memset(context, 0, sizeof(*context));
+}
+
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include "monit.h"
+#include "snapshot.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ *  Sequence counter guarded service status snapshots.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+/* Serializes the publishers, the readers take it only to copy the program output */
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* Signaled when some service status changed, see Snapshot_wait() */
+static Sem_T changed = PTHREAD_COND_INITIALIZER;
+
+
+/* The number of services per state of their published snapshot, see Snapshot_count() */
+static int counts[SnapshotState_Last + 1];
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static SnapshotState_Type _state(Monitor_State monitor, int error) {
+        if (monitor == Monitor_Not)
+                return SnapshotState_Unmonitored;
+        else if (monitor & Monitor_Init)
+                return SnapshotState_Initializing;
+        else if (error)
+                return SnapshotState_Down;
+        return SnapshotState_Up;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Snapshot_publish(Service_T S) {
+        ASSERT(S);
+        LOCK(mutex)
+        {
+                // The services which were never published are not counted yet
+                if (S->snapshot.sequence)
+                        __atomic_sub_fetch(&counts[_state(S->snapshot.monitor, S->snapshot.error)], 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&counts[_state(S->monitor, S->error)], 1, __ATOMIC_RELAXED);
+                // An odd sequence tells the readers that the snapshot is being written
+                __atomic_store_n(&S->snapshot.sequence, S->snapshot.sequence + 1, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_RELEASE);
+                // The collection time alone doesn't make a change, a delta poll would return every checked service otherwise
+                boolean_t change = ! S->changed || S->snapshot.error != S->error || S->snapshot.error_hint != S->error_hint || S->snapshot.monitor != S->monitor || S->snapshot.doaction != S->doaction || memcmp(&S->snapshot.inf, S->inf, sizeof(struct myinfo));
+                S->snapshot.inf = *S->inf;
+                S->snapshot.error = S->error;
+                S->snapshot.error_hint = S->error_hint;
+                S->snapshot.collected = S->collected;
+                S->snapshot.monitor = S->monitor;
+                S->snapshot.doaction = S->doaction;
+                if (S->program) {
+                        change = change || S->snapshot.program.started != S->program->started || S->snapshot.program.exitStatus != S->program->exitStatus || memcmp(&S->snapshot.program.usage, &S->program->usage, sizeof(struct myprogramusage));
+                        S->snapshot.program.started = S->program->started;
+                        S->snapshot.program.exitStatus = S->program->exitStatus;
+                        S->snapshot.program.usage = S->program->usage;
+                        // The check rewrites the output buffer in place, the readers get the published copy
+                        if (! S->snapshot.program.output)
+                                S->snapshot.program.output = StringBuffer_create(64);
+                        if (! IS(StringBuffer_toString(S->snapshot.program.output), StringBuffer_toString(S->program->output))) {
+                                StringBuffer_clear(S->snapshot.program.output);
+                                StringBuffer_append(S->snapshot.program.output, "%s", StringBuffer_toString(S->program->output));
+                                change = true;
+                        }
+                }
+                __atomic_store_n(&S->snapshot.sequence, S->snapshot.sequence + 1, __ATOMIC_RELEASE);
+                if (change) {
+                        __atomic_store_n(&S->changed, __atomic_add_fetch(&Run.generation, 1, __ATOMIC_RELAXED), __ATOMIC_RELEASE);
+                        Sem_broadcast(changed);
+                }
+        }
+        END_LOCK;
+}
+
+
+Service_T Snapshot_get(Service_T S, struct myservice *copy) {
+        ASSERT(S);
+        ASSERT(copy);
+        *copy = *S;
+        unsigned int sequence;
+        do {
+                while ((sequence = __atomic_load_n(&S->snapshot.sequence, __ATOMIC_ACQUIRE)) & 1)
+                        ;
+                copy->snapshot.inf = S->snapshot.inf;
+                copy->snapshot.error = S->snapshot.error;
+                copy->snapshot.error_hint = S->snapshot.error_hint;
+                copy->snapshot.collected = S->snapshot.collected;
+                copy->snapshot.program.started = S->snapshot.program.started;
+                copy->snapshot.program.exitStatus = S->snapshot.program.exitStatus;
+                copy->snapshot.program.usage = S->snapshot.program.usage;
+                __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        } while (sequence != __atomic_load_n(&S->snapshot.sequence, __ATOMIC_RELAXED));
+        copy->inf = &copy->snapshot.inf;
+        copy->error = copy->snapshot.error;
+        copy->error_hint = copy->snapshot.error_hint;
+        copy->collected = copy->snapshot.collected;
+        return copy;
+}
+
+
+SnapshotState_Type Snapshot_state(Service_T S) {
+        ASSERT(S);
+        return _state(S->snapshot.monitor, S->snapshot.error);
+}
+
+
+char *Snapshot_getOutput(Service_T S) {
+        ASSERT(S);
+        char *output;
+        LOCK(mutex)
+        {
+                output = Str_dup(S->snapshot.program.output ? StringBuffer_toString(S->snapshot.program.output) : "");
+        }
+        END_LOCK;
+        return output;
+}
+
+
+unsigned long long Snapshot_wait(unsigned long long since, int timeout) {
+        unsigned long long generation;
+        time_t deadline = Time_now() + timeout;
+        LOCK(mutex)
+        {
+                // Wake up every second to notice the shutdown or reload, the waiting HTTP worker would hold it up otherwise
+                while (Run.generation <= since && Time_now() < deadline && ! (Run.flags & (Run_Stopped | Run_DoReload))) {
+                        struct timespec wait = {.tv_sec = Time_now() + 1, .tv_nsec = 0};
+                        Sem_timeWait(changed, mutex, wait);
+                }
+                generation = Run.generation;
+        }
+        END_LOCK;
+        return generation;
+}
+
+
+int Snapshot_count(SnapshotState_Type state) {
+        ASSERT(state >= SnapshotState_Up && state <= SnapshotState_Last);
+        return __atomic_load_n(&counts[state], __ATOMIC_RELAXED);
+}
+
+
+void Snapshot_reset(void) {
+        LOCK(mutex)
+        {
+                memset(counts, 0, sizeof(counts));
+                // The services reused from the previous configuration keep their snapshot
+                for (Service_T s = servicelist; s; s = s->next)
+                        if (s->snapshot.sequence)
+                                counts[_state(s->snapshot.monitor, s->snapshot.error)]++;
+                // The service list changed, the readers caching the status by the generation must render it again
+                __atomic_add_fetch(&Run.generation, 1, __ATOMIC_RELEASE);
+                Sem_broadcast(changed);
+        }
+        END_LOCK;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (! s->snapshot.sequence)
+                        Snapshot_publish(s);
+}
+
+
+void Snapshot_remove(Service_T S) {
+        ASSERT(S);
+        LOCK(mutex)
+        {
+                if (S->snapshot.sequence)
+                        __atomic_sub_fetch(&counts[_state(S->snapshot.monitor, S->snapshot.error)], 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&Run.generation, 1, __ATOMIC_RELEASE);
+                Sem_broadcast(changed);
+        }
+        END_LOCK;
+}
+
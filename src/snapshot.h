@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_SNAPSHOT_H
+#define MONIT_SNAPSHOT_H
+
+
+/**
+ * Service status snapshots. A service check updates the service data in
+ * place, so a reader running at the same time (the HTTP interface, the
+ * M/Monit status) could see a half updated status. The check therefore
+ * publishes a copy of the service data, the error flags and the
+ * collection time when it is done, and the readers render from that
+ * copy. The snapshot is guarded by a sequence counter: the reader copies
+ * it without a lock and retries if a check published a new one meanwhile,
+ * so the readers never block the checks and vice versa.
+ *
+ * @file
+ */
+
+
+/**
+ * The service states counted by the snapshots, see Snapshot_count()
+ */
+typedef enum {
+        SnapshotState_Up = 0,
+        SnapshotState_Down,
+        SnapshotState_Initializing,
+        SnapshotState_Unmonitored
+} SnapshotState_Type;
+
+
+#define SnapshotState_Last SnapshotState_Unmonitored
+
+
+/**
+ * Publish the actual service status for the readers
+ * @param S The service
+ */
+void Snapshot_publish(Service_T S);
+
+
+/**
+ * Get a consistent copy of the published service status. The copy is a
+ * shallow copy of the service whose data, error flags and collection time
+ * are taken from the snapshot, so it can be passed to the functions which
+ * read the service status instead of the service itself. The copy must
+ * not be modified.
+ * @param S The service
+ * @param copy The storage for the copy
+ * @return The copy
+ */
+Service_T Snapshot_get(Service_T S, struct myservice *copy);
+
+
+/**
+ * Get the state of the published service status
+ * @param S The service or its copy returned by Snapshot_get()
+ * @return The service state
+ */
+SnapshotState_Type Snapshot_state(Service_T S);
+
+
+/**
+ * Get a copy of the published program output. The program start time
+ * and exit status are part of the copy returned by Snapshot_get(), in
+ * snapshot.program, the output is copied under the publisher lock as
+ * its length is not bounded.
+ * @param S The service or its copy returned by Snapshot_get()
+ * @return The output, the caller must free it
+ */
+char *Snapshot_getOutput(Service_T S);
+
+
+/**
+ * Wait until some service status changes. Publishing a snapshot which
+ * differs from the previous one bumps the Run.generation counter and
+ * records its value in Service_T.changed, so a poller can ask for the
+ * services changed since the generation it saw last. The collection
+ * time alone is not a change.
+ * @param since The generation the caller has seen
+ * @param timeout The maximum time to wait in seconds
+ * @return The actual generation, greater than since unless the wait
+ * timed out or Monit is stopping
+ */
+unsigned long long Snapshot_wait(unsigned long long since, int timeout);
+
+
+
+/**
+ * Get the number of services in the given state. The counters follow the
+ * published snapshots, so the status report doesn't have to walk the
+ * service list.
+ * @param state The service state
+ * @return The number of services in the state
+ */
+int Snapshot_count(SnapshotState_Type state);
+
+
+/**
+ * Recount the services after the service list was built or reloaded and
+ * publish the services which were not published yet. Must be called
+ * before the service list is shared with the other threads.
+ */
+void Snapshot_reset(void);
+
+
+/**
+ * Uncount the service which is removed from the service list by the
+ * service discovery, the readers render the list again
+ * @param S The service
+ */
+void Snapshot_remove(Service_T S);
+
+
+#endif
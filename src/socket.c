@@ -32,6 +32,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
 #endif
@@ -72,10 +76,16 @@
 #include <netdb.h>
 #endif
 
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
+
 #include "net.h"
 #include "monit.h"
 #include "socket.h"
 #include "SslServer.h"
+#include "resolver.h"
+#include "counter.h"
 
 // libmonit
 #include "exceptions/assert.h"
@@ -102,8 +112,18 @@ typedef enum {
 } __attribute__((__packed__)) Connection_Type;
 
 
-// One TCP frame data size
-#define RBUFFER_SIZE 1460
+// RFC 8305 connection attempt delay [ms], the next address is tried if the connection isn't established meanwhile
+#define CONNECT_DELAY 250
+
+
+// The maximum number of addresses tried for one connection
+#define CONNECT_ADDRESSES 16
+
+
+// The number of buffers a single writev(2) call accepts, if the system doesn't tell
+#ifndef IOV_MAX
+#define IOV_MAX 16
+#endif
 
 
 #define T Socket_T
@@ -116,13 +136,19 @@ struct T {
         int timeout; // milliseconds
         int length;
         int offset;
+        int capacity; // size of the read buffer
         char *host;
         Port_T Port;
+        boolean_t keep; // the protocol test left the session reusable
+        double connect; // the TCP round-trip time of the connect in milliseconds, -1 if n/a
+        double handshake; // the TLS handshake time in milliseconds, -1 if n/a
+        long long ready; // Time_monotonicMicro() when the socket was handed to the protocol
+        long long firstbyte; // Time_monotonicMicro() when the first byte was received, 0 if not yet
 #ifdef HAVE_OPENSSL
         Ssl_T ssl;
         SslServer_T sslserver;
 #endif
-        unsigned char buffer[RBUFFER_SIZE + 1];
+        unsigned char *buffer;
 };
 
 
@@ -137,20 +163,23 @@ struct T {
  * @return the length of data read or -1 if an error occured
  */
 static int _fill(T S, int timeout) {
+        // Keep the data which was not consumed yet (a line returned by Socket_peekLine() may span the fill)
+        S->length -= S->offset;
+        if (S->length > 0 && S->offset > 0)
+                memmove(S->buffer, S->buffer + S->offset, S->length);
         S->offset = 0;
-        S->length = 0;
-        if (S->type == Socket_Udp)
-                timeout = 500;
         int n;
 #ifdef HAVE_OPENSSL
         if (S->ssl)
-                n = Ssl_read(S->ssl, S->buffer + S->length, RBUFFER_SIZE - S->length, timeout);
+                n = Ssl_read(S->ssl, S->buffer + S->length, S->capacity - S->length, timeout);
         else
 #endif
-                n = (int)Net_read(S->socket, S->buffer + S->length,  RBUFFER_SIZE - S->length, timeout);
-        if (n > 0)
+                n = (int)Net_read(S->socket, S->buffer + S->length,  S->capacity - S->length, timeout);
+        if (n > 0) {
+                if (! S->firstbyte)
+                        S->firstbyte = Time_monotonicMicro();
                 S->length += n;
-        else if (n < 0)
+        } else if (n < 0)
                 return -1;
         else if (! (errno == EAGAIN || errno == EWOULDBLOCK)) // Peer closed connection
                 return -1;
@@ -158,6 +187,58 @@ static int _fill(T S, int timeout) {
 }
 
 
+/*
+ * Create a Socket object for the connected socket, the read buffer size is
+ * set by the socket buffer limit
+ */
+static T _new(int socket, Socket_Type type, int timeout) {
+        T S;
+        NEW(S);
+        S->socket = socket;
+        S->type = type;
+        S->timeout = timeout;
+        S->capacity = Run.limits.socketBuffer > 0 ? Run.limits.socketBuffer : LIMIT_SOCKETBUFFER;
+        S->buffer = ALLOC(S->capacity + 1);
+        S->connect = S->handshake = -1.;
+        S->ready = Time_monotonicMicro();
+        return S;
+}
+
+
+/*
+ * Get the smoothed round-trip time of the TCP connection from the kernel, right after the
+ * connect it is the time of the handshake without the scheduling delay of the process
+ * @return The round-trip time in milliseconds or -1 if not available
+ */
+/* Return the three digit status code which starts the line or 0 if there is none */
+static inline int _parseStatus(const char *line, int length) {
+        if (length < 3 || (unsigned)(line[0] - '0') > 9 || (unsigned)(line[1] - '0') > 9 || (unsigned)(line[2] - '0') > 9)
+                return 0;
+        return (line[0] - '0') * 100 + (line[1] - '0') * 10 + (line[2] - '0');
+}
+
+
+/* Copy the line without the line terminator to s and NUL terminate it */
+static void _copyLine(char *s, int size, const char *line, int length) {
+        while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+                length--;
+        length = MIN(length, size - 1);
+        memcpy(s, line, length);
+        s[length] = 0;
+}
+
+
+static double _getRoundTripTime(int socket) {
+#if defined TCP_INFO && (defined __linux__ || defined __FreeBSD__)
+        struct tcp_info info;
+        socklen_t length = sizeof(info);
+        if (getsockopt(socket, IPPROTO_TCP, TCP_INFO, &info, &length) == 0 && info.tcpi_rtt > 0)
+                return info.tcpi_rtt / 1000.;
+#endif
+        return -1.;
+}
+
+
 int _getPort(const struct sockaddr *addr, socklen_t addrlen) {
         if (addr->sa_family == AF_INET)
                 return ntohs(((struct sockaddr_in *)addr)->sin_port);
@@ -225,56 +306,208 @@ static boolean_t _doConnect(int s, const struct sockaddr *addr, socklen_t addrle
 }
 
 
-T _createIpSocket(const char *host, const struct sockaddr *addr, socklen_t addrlen, const struct sockaddr *localaddr, socklen_t localaddrlen, int family, int type, int protocol, SslOptions_T ssl, int timeout) {
-        ASSERT(host);
-        char error[STRLEN];
-        int s = socket(family, type, protocol);
-        if (s >= 0) {
-                if (localaddr) {
-                        if (bind(s, localaddr, localaddrlen) < 0) {
-                                snprintf(error, sizeof(error), "Cannot bind to outgoing address -- %s", STRERROR);
-                                goto error;
+/**
+ * Order the addresses for the connection race: the address families
+ * alternate, beginning with the preferred family or with the family of
+ * the first address (RFC 8305 section 4). The addresses which don't match
+ * the outgoing address family are skipped.
+ * @return The number of addresses
+ */
+static int _sortAddresses(struct addrinfo *result, int preferred, socklen_t localaddrlen, struct addrinfo **addresses) {
+        struct addrinfo *primary[CONNECT_ADDRESSES], *secondary[CONNECT_ADDRESSES];
+        int p = 0, q = 0;
+        for (struct addrinfo *r = result; r; r = r->ai_next) {
+                if (localaddrlen && localaddrlen != r->ai_addrlen)
+                        continue;
+                if (! preferred)
+                        preferred = r->ai_family;
+                if (r->ai_family == preferred) {
+                        if (p < CONNECT_ADDRESSES)
+                                primary[p++] = r;
+                } else if (q < CONNECT_ADDRESSES) {
+                        secondary[q++] = r;
+                }
+        }
+        int count = 0;
+        for (int i = 0; (i < p || i < q) && count < CONNECT_ADDRESSES; i++) {
+                if (i < p)
+                        addresses[count++] = primary[i];
+                if (i < q && count < CONNECT_ADDRESSES)
+                        addresses[count++] = secondary[i];
+        }
+        return count;
+}
+
+
+/**
+ * Start the non-blocking connection to the address
+ * @return The socket or -1 on error, connected is set to true if the
+ * connection was established immediately
+ */
+static int _startConnect(struct addrinfo *addr, const struct sockaddr *localaddr, socklen_t localaddrlen, boolean_t *connected, char *error, int errorlen) {
+        *connected = false;
+        int s = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+        if (s < 0) {
+                snprintf(error, errorlen, "Cannot create socket to %s -- %s", _addressToString(addr->ai_addr, addr->ai_addrlen, (char[STRLEN]){}, STRLEN), STRERROR);
+                return -1;
+        }
+        Counter_add(Counter_Sockets, 1);
+        if (localaddr && bind(s, localaddr, localaddrlen) < 0) {
+                snprintf(error, errorlen, "Cannot bind to outgoing address -- %s", STRERROR);
+        } else if (! Net_setNonBlocking(s)) {
+                snprintf(error, errorlen, "Cannot set nonblocking socket -- %s", STRERROR);
+        } else if (fcntl(s, F_SETFD, FD_CLOEXEC) == -1) {
+                snprintf(error, errorlen, "Cannot set socket close on exec -- %s", STRERROR);
+        } else if (connect(s, addr->ai_addr, addr->ai_addrlen) == 0) {
+                *connected = true;
+                return s;
+        } else if (errno == EINPROGRESS) {
+                return s;
+        } else {
+                snprintf(error, errorlen, "%s", STRERROR);
+        }
+        Net_close(s);
+        return -1;
+}
+
+
+/**
+ * Connect to the first address which accepts the connection. The attempts
+ * are started CONNECT_DELAY apart, or at once when the previous attempt
+ * failed, and then run in parallel (RFC 8305 section 5). All attempts
+ * share one timeout, so a broken address family doesn't add its timeout
+ * to the connection time. The addresses which were tried are marked, after
+ * a timeout all of them.
+ * @return The connected socket or -1 on error
+ */
+static int _race(struct addrinfo **addresses, boolean_t *tried, int count, const struct sockaddr *localaddr, socklen_t localaddrlen, int timeout, int *winner, char *error, int errorlen) {
+        struct pollfd fds[CONNECT_ADDRESSES];
+        int indexes[CONNECT_ADDRESSES];
+        int pending = 0, next = 0, s = -1;
+        long long deadline = Time_milli() + timeout;
+        snprintf(error, errorlen, "No address to connect to");
+        while (s < 0) {
+                while (next < count && tried[next])
+                        next++;
+                if (next < count) {
+                        int i = next++;
+                        boolean_t connected;
+                        int fd = _startConnect(addresses[i], localaddr, localaddrlen, &connected, error, errorlen);
+                        if (fd < 0) {
+                                tried[i] = true;
+                                continue;
+                        } else if (connected) {
+                                s = fd;
+                                *winner = i;
+                                break;
                         }
+                        fds[pending].fd = fd;
+                        fds[pending].events = POLLIN | POLLOUT;
+                        fds[pending].revents = 0;
+                        indexes[pending++] = i;
                 }
-                if (Net_setNonBlocking(s)) {
-                        if (fcntl(s, F_SETFD, FD_CLOEXEC) != -1) {
-                                if (_doConnect(s, addr, addrlen, timeout, error, sizeof(error))) {
-                                        T S;
-                                        NEW(S);
-                                        S->socket = s;
-                                        S->type = type;
-                                        S->family = family == AF_INET ? Socket_Ip4 : Socket_Ip6;
-                                        S->timeout = timeout;
-                                        S->host = Str_dup(host);
-                                        S->port = _getPort(addr, addrlen);
-                                        S->connection_type = Connection_Client;
-                                        if (ssl.flags == SSL_Enabled) {
-                                                TRY
-                                                {
-                                                        Socket_enableSsl(S, ssl, host);
-                                                }
-                                                ELSE
-                                                {
-                                                        Socket_free(&S);
-                                                        RETHROW;
-                                                }
-                                                END_TRY;
-                                        }
-                                        return S;
+                if (! pending) {
+                        if (next < count)
+                                continue;
+                        break;
+                }
+                long long remaining = deadline - Time_milli();
+                if (remaining <= 0) {
+                        snprintf(error, errorlen, "Connection timed out");
+                        for (int i = 0; i < count; i++)
+                                tried[i] = true;
+                        break;
+                }
+                while (next < count && tried[next])
+                        next++;
+                int rv = poll(fds, pending, (int)(next < count ? MIN(remaining, CONNECT_DELAY) : remaining));
+                if (rv < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        snprintf(error, errorlen, "Poll failed: %s", STRERROR);
+                        break;
+                }
+                for (int k = 0; k < pending && s < 0;) {
+                        if (fds[k].revents) {
+                                int status = 0;
+                                socklen_t statuslen = sizeof(status);
+                                if (getsockopt(fds[k].fd, SOL_SOCKET, SO_ERROR, &status, &statuslen) < 0)
+                                        status = errno;
+                                if (! status) {
+                                        s = fds[k].fd;
+                                        *winner = indexes[k];
+                                } else {
+                                        snprintf(error, errorlen, "%s", strerror(status));
+                                        tried[indexes[k]] = true;
+                                        Net_close(fds[k].fd);
                                 }
+                                fds[k] = fds[--pending];
+                                indexes[k] = indexes[pending];
                         } else {
-                                snprintf(error, sizeof(error), "Cannot set socket close on exec -- %s", STRERROR);
+                                k++;
                         }
-                } else {
-                        snprintf(error, sizeof(error), "Cannot set nonblocking socket -- %s", STRERROR);
                 }
-error:
-                Net_close(s);
-        } else {
-                snprintf(error, sizeof(error), "Cannot create socket to %s -- %s", _addressToString(addr, addrlen, (char[STRLEN]){}, STRLEN), STRERROR);
         }
-        THROW(IOException, "%s", error);
-        return NULL;
+        // Abandon the slower attempts
+        for (int k = 0; k < pending; k++)
+                Net_close(fds[k].fd);
+        if (s >= 0)
+                tried[*winner] = true;
+        return s;
+}
+
+
+/**
+ * Create the client Socket for the descriptor connected to addr by _race(), the connection was started at start [us]
+ * @exception IOException if the SSL handshake failed
+ */
+static T _createClient(const char *host, int s, struct addrinfo *addr, SslOptions_T ssl, int timeout, long long start) {
+        T S = _new(s, addr->ai_socktype, timeout);
+        if (S->type == Socket_Tcp && (S->connect = _getRoundTripTime(s)) < 0.)
+                S->connect = (S->ready - start) / 1000.;
+        S->family = addr->ai_family == AF_INET ? Socket_Ip4 : Socket_Ip6;
+        S->host = Str_dup(host);
+        S->port = _getPort(addr->ai_addr, addr->ai_addrlen);
+        S->connection_type = Connection_Client;
+        DEBUG("Connected to %s\n", _addressToString(addr->ai_addr, addr->ai_addrlen, (char[STRLEN]){}, STRLEN));
+        if (ssl.flags == SSL_Enabled) {
+                TRY
+                {
+                        Socket_enableSsl(S, ssl, host);
+                }
+                ELSE
+                {
+                        Socket_free(&S);
+                        RETHROW;
+                }
+                END_TRY;
+                S->ready = Time_monotonicMicro();
+        }
+        return S;
+}
+
+
+/**
+ * Connect to one of the addresses, see _race()
+ * @exception IOException if the connection failed
+ */
+static T _createIpSocket(const char *host, struct addrinfo **addresses, boolean_t *tried, int count, const struct sockaddr *localaddr, socklen_t localaddrlen, SslOptions_T ssl, int timeout) {
+        ASSERT(host);
+        char error[STRLEN];
+        int winner = -1;
+        long long start = Time_monotonicMicro();
+        int s = _race(addresses, tried, count, localaddr, localaddrlen, timeout, &winner, error, sizeof(error));
+        if (s < 0)
+                THROW(IOException, "%s", error);
+        return _createClient(host, s, addresses[winner], ssl, timeout, start);
+}
+
+
+static boolean_t _isTried(boolean_t *tried, int count) {
+        for (int i = 0; i < count; i++)
+                if (! tried[i])
+                        return false;
+        return true;
 }
 
 
@@ -303,9 +536,7 @@ struct addrinfo *_resolve(const char *hostname, int port, Socket_Type type, Sock
                         LogError("Invalid socket family %d\n", family);
                         return NULL;
         }
-        char _port[6];
-        snprintf(_port, sizeof(_port), "%d", port);
-        int status = getaddrinfo(hostname, _port, &hints, &result);
+        int status = Resolver_get(hostname, port, &hints, &result);
         if (status != 0) {
                 LogError("Cannot translate '%s' to IP address -- %s\n", hostname, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
                 return NULL;
@@ -319,18 +550,15 @@ static T _createUnixSocket(const char *pathname, Socket_Type type, int timeout)
         ASSERT(pathname);
         int s = socket(PF_UNIX, type, 0);
         if (s >= 0) {
+                Counter_add(Counter_Sockets, 1);
                 unixsocket.sun_family = AF_UNIX;
                 snprintf(unixsocket.sun_path, sizeof(unixsocket.sun_path), "%s", pathname);
                 if (Net_setNonBlocking(s)) {
                         char error[STRLEN];
                         if (_doConnect(s, (struct sockaddr *)&unixsocket, sizeof(unixsocket), timeout, error, sizeof(error))) {
-                                T S;
-                                NEW(S);
+                                T S = _new(s, type, timeout);
                                 S->connection_type = Connection_Client;
                                 S->family = Socket_Unix;
-                                S->type = type;
-                                S->socket = s;
-                                S->timeout = timeout;
                                 S->host = Str_dup(LOCALHOST);
                                 return S;
                         }
@@ -360,12 +588,15 @@ T Socket_create(const char *host, int port, Socket_Type type, Socket_Family fami
         volatile T S = NULL;
         struct addrinfo *result = _resolve(host, port, type, family);
         if (result) {
-                char error[STRLEN];
+                char error[STRLEN] = "No address to connect to";
+                struct addrinfo *addresses[CONNECT_ADDRESSES];
+                boolean_t tried[CONNECT_ADDRESSES] = {};
+                int count = _sortAddresses(result, 0, 0, addresses);
                 // The host may resolve to multiple IPs and if at least one succeeded, we have no problem and don't have to flood the log with partial errors => log only the last error
-                for (struct addrinfo *r = result; r && S == NULL; r = r->ai_next) {
+                while (S == NULL && ! _isTried(tried, count)) {
                         TRY
                         {
-                                S = _createIpSocket(host, r->ai_addr, r->ai_addrlen, NULL, 0, r->ai_family, r->ai_socktype, r->ai_protocol, ssl, timeout);
+                                S = _createIpSocket(host, addresses, tried, count, NULL, 0, ssl, timeout);
                         }
                         ELSE
                         {
@@ -373,7 +604,7 @@ T Socket_create(const char *host, int port, Socket_Type type, Socket_Family fami
                         }
                         END_TRY;
                 }
-                freeaddrinfo(result);
+                Resolver_free(result);
                 if (! S)
                         LogError("Cannot create socket to [%s]:%d -- %s\n", host, port, error);
         }
@@ -381,6 +612,57 @@ T Socket_create(const char *host, int port, Socket_Type type, Socket_Family fami
 }
 
 
+T Socket_createAny(const char **hosts, const int *ports, SslOptions_T *ssl, int count, int timeout, int *winner) {
+        ASSERT(hosts);
+        ASSERT(ports);
+        ASSERT(ssl);
+        ASSERT(count > 0);
+        ASSERT(timeout > 0);
+        ASSERT(winner);
+        volatile T S = NULL;
+        char error[STRLEN + EXCEPTION_MESSAGE_LENGTH] = "No address to connect to"; // The host and port followed by the exception message
+        struct addrinfo *results[count];
+        struct addrinfo *addresses[CONNECT_ADDRESSES];
+        int owners[CONNECT_ADDRESSES];
+        boolean_t tried[CONNECT_ADDRESSES] = {};
+        int total = 0;
+        // The hosts race in the given order, each with its own addresses sorted by the RFC 8305 rules
+        for (int i = 0; i < count; i++) {
+                if ((results[i] = _resolve(hosts[i], ports[i], Socket_Tcp, Socket_Ip))) {
+                        struct addrinfo *sorted[CONNECT_ADDRESSES];
+                        int n = _sortAddresses(results[i], 0, 0, sorted);
+                        for (int j = 0; j < n && total < CONNECT_ADDRESSES; j++, total++) {
+                                addresses[total] = sorted[j];
+                                owners[total] = i;
+                        }
+                }
+        }
+        while (S == NULL && ! _isTried(tried, total)) {
+                int w = -1;
+                long long start = Time_monotonicMicro();
+                int s = _race(addresses, tried, total, NULL, 0, timeout, &w, error, sizeof(error));
+                if (s >= 0) {
+                        TRY
+                        {
+                                S = _createClient(hosts[owners[w]], s, addresses[w], ssl[owners[w]], timeout, start);
+                                *winner = owners[w];
+                        }
+                        ELSE
+                        {
+                                snprintf(error, sizeof(error), "[%s]:%d -- %s", hosts[owners[w]], ports[owners[w]], Exception_frame.message);
+                        }
+                        END_TRY;
+                }
+        }
+        for (int i = 0; i < count; i++)
+                if (results[i])
+                        Resolver_free(results[i]);
+        if (! S)
+                LogError("Cannot create socket to any of %d hosts -- %s\n", count, error);
+        return S;
+}
+
+
 T Socket_createUnix(const char *path, Socket_Type type, int timeout) {
         ASSERT(path);
         ASSERT(timeout > 0);
@@ -391,17 +673,31 @@ T Socket_createUnix(const char *path, Socket_Type type, int timeout) {
 T Socket_createAccepted(int socket, struct sockaddr *addr, socklen_t addrlen, void *sslserver) {
         ASSERT(socket >= 0);
         ASSERT(addr);
-        T S;
-        NEW(S);
-        S->socket = socket;
-        S->timeout = Run.limits.networkTimeout;
+        T S = _new(socket, Socket_Tcp, Run.limits.networkTimeout);
         S->connection_type = Connection_Server;
-        S->type = Socket_Tcp;
         if (addr->sa_family == AF_INET) {
                 struct sockaddr_in *a = (struct sockaddr_in *)addr;
                 S->family = Socket_Ip4;
                 S->port = _getPort(addr, addrlen);
                 S->host = Str_dup(inet_ntoa(a->sin_addr));
+        }
+#ifdef HAVE_IPV6
+        else if (addr->sa_family == AF_INET6) {
+                struct in6_addr *a = &((struct sockaddr_in6 *)addr)->sin6_addr;
+                char host[INET6_ADDRSTRLEN] = {};
+                // An IPv4 client of the dual stack server socket is reported with its IPv4 address
+                if (IN6_IS_ADDR_V4MAPPED(a)) {
+                        S->family = Socket_Ip4;
+                        inet_ntop(AF_INET, a->s6_addr + 12, host, sizeof(host));
+                } else {
+                        S->family = Socket_Ip6;
+                        inet_ntop(AF_INET6, a, host, sizeof(host));
+                }
+                S->port = _getPort(addr, addrlen);
+                S->host = Str_dup(host);
+        }
+#endif
+        if (addr->sa_family == AF_INET || addr->sa_family == AF_INET6) {
 #ifdef HAVE_OPENSSL
                 if (sslserver) {
                         S->sslserver = sslserver;
@@ -436,6 +732,7 @@ void Socket_free(T *S) {
                 Net_shutdown((*S)->socket, SHUT_RDWR);
                 Net_close((*S)->socket);
         }
+        FREE((*S)->buffer);
         FREE((*S)->host);
         FREE(*S);
 }
@@ -466,6 +763,17 @@ boolean_t Socket_isSecure(T S) {
 }
 
 
+int Socket_pending(T S) {
+        ASSERT(S);
+        int n = S->length - S->offset;
+#ifdef HAVE_OPENSSL
+        if (S->ssl)
+                n += Ssl_pending(S->ssl);
+#endif
+        return n;
+}
+
+
 int Socket_getSocket(T S) {
         ASSERT(S);
         return S->socket;
@@ -484,6 +792,16 @@ void *Socket_getPort(T S) {
 }
 
 
+boolean_t Socket_keep(T S) {
+        ASSERT(S);
+        if (S->Port && S->Port->session.enabled) {
+                S->keep = true;
+                return true;
+        }
+        return false;
+}
+
+
 int Socket_getRemotePort(T S) {
         ASSERT(S);
         return S->port;
@@ -524,17 +842,78 @@ const char *Socket_getLocalHost(T S, char *host, int hostlen) {
 }
 
 
+/**
+ * Test the persistent session of the port if it is open. A failed session
+ * is closed, so the caller reconnects.
+ * @return true if the session passed the test, otherwise false
+ */
+/* Keep the connection phases of the socket in the port, the first byte is measured from the time the socket was ready for the protocol */
+static void _setPhases(Port_T p, T S) {
+        p->phases.connect = S->connect;
+        p->phases.tls = S->handshake;
+        p->phases.firstbyte = S->firstbyte ? (S->firstbyte - S->ready) / 1000. : -1.;
+}
+
+
+static boolean_t _testSession(Port_T p) {
+        if (! p->session.socket)
+                return false;
+        volatile boolean_t passed = false;
+        TRY
+        {
+                // The session is connected already, only the time to the first byte of the ping is measured
+                p->session.socket->ready = Time_monotonicMicro();
+                p->session.socket->firstbyte = 0;
+                p->protocol->ping(p->session.socket);
+                if (p->session.socket->firstbyte)
+                        p->phases.firstbyte = (p->session.socket->firstbyte - p->session.socket->ready) / 1000.;
+                passed = true;
+        }
+        ELSE
+        {
+                if (p->family == Socket_Unix)
+                        DEBUG("Persistent session to %s failed, reconnecting -- %s\n", p->target.unix.pathname, Exception_frame.message);
+                else
+                        DEBUG("Persistent session to [%s]:%d failed, reconnecting -- %s\n", p->hostname, p->target.net.port, Exception_frame.message);
+        }
+        END_TRY;
+        if (! passed)
+                Socket_free(&(p->session.socket));
+        return passed;
+}
+
+
+/**
+ * Keep the tested socket as the persistent session of the port if the
+ * protocol test left it reusable
+ * @return true if the socket was kept, otherwise false
+ */
+static boolean_t _keepSession(Port_T p, T S) {
+        if (S->keep && p->session.enabled && p->protocol->ping) {
+                p->session.socket = S;
+                return true;
+        }
+        return false;
+}
+
+
 static void _testUnix(Port_T p) {
-        T S = _createUnixSocket(p->target.unix.pathname, p->type, p->timeout);
+        if (_testSession(p))
+                return;
+        volatile T S = _createUnixSocket(p->target.unix.pathname, p->type, p->timeout);
         if (S) {
                 S->Port = p;
                 TRY
                 {
                         p->protocol->check(S);
+                        _setPhases(p, S);
+                        if (_keepSession(p, S))
+                                S = NULL;
                 }
                 FINALLY
                 {
-                        Socket_free(&S);
+                        if (S)
+                                Socket_free((Socket_T *)&S);
                 }
                 END_TRY;
         } else {
@@ -544,38 +923,51 @@ static void _testUnix(Port_T p) {
 
 
 static void _testIp(Port_T p) {
+        if (_testSession(p))
+                return;
         char error[STRLEN];
         Connection_State is_available = Connection_Failed;
+        long long start = Time_monotonicMicro();
         struct addrinfo *result = _resolve(p->hostname, p->target.net.port, p->type, p->family);
+        p->phases.dns = (Time_monotonicMicro() - start) / 1000.;
         if (result) {
+                struct addrinfo *addresses[CONNECT_ADDRESSES];
+                boolean_t tried[CONNECT_ADDRESSES] = {};
+                const struct sockaddr *localaddr = p->outgoing.addrlen ? (struct sockaddr *)&(p->outgoing.addr) : NULL;
+                // Begin with the address family which won the last time, a broken family doesn't delay every check
+                int count = _sortAddresses(result, p->connected == Socket_Ip4 ? AF_INET : p->connected == Socket_Ip6 ? AF_INET6 : 0, p->outgoing.addrlen, addresses);
+                if (! count)
+                        snprintf(error, sizeof(error), "No target IP with family matching our outgoing address '%s' was found", p->outgoing.ip);
                 // The host may resolve to multiple IPs and if at least one succeeded, we have no problem and don't have to flood the log with partial errors => log only the last error
-                for (struct addrinfo *r = result; r && is_available != Connection_Ok; r = r->ai_next) {
-                        if (p->outgoing.addrlen == 0 || p->outgoing.addrlen == r->ai_addrlen) {
-                                const struct sockaddr *localaddr = p->outgoing.addrlen ? (struct sockaddr *)&(p->outgoing.addr) : NULL;
-                                volatile T S = NULL;
-                                TRY
-                                {
-                                        S = _createIpSocket(p->hostname, r->ai_addr, r->ai_addrlen, localaddr, p->outgoing.addrlen, r->ai_family, r->ai_socktype, r->ai_protocol, p->target.net.ssl, p->timeout);
-                                        S->Port = p;
-                                        p->protocol->check(S);
-                                        is_available = Connection_Ok;
-                                }
-                                ELSE
-                                {
-                                        snprintf(error, sizeof(error), "%s", Exception_frame.message);
-                                        DEBUG("Socket test failed for %s -- %s\n", _addressToString(r->ai_addr, r->ai_addrlen, (char[STRLEN]){}, STRLEN), error);
-                                }
-                                FINALLY
-                                {
-                                        if (S)
-                                                Socket_free((Socket_T *)&S);
-                                }
-                                END_TRY;
-                        } else {
-                                snprintf(error, sizeof(error), "No target IP with family matching our outgoing address '%s' was found", p->outgoing.ip);
+                while (is_available != Connection_Ok && ! _isTried(tried, count)) {
+                        volatile T S = NULL;
+                        TRY
+                        {
+                                S = _createIpSocket(p->hostname, addresses, tried, count, localaddr, p->outgoing.addrlen, p->target.net.ssl, p->timeout);
+                                S->Port = p;
+                                p->connected = S->family;
+                                p->protocol->check(S);
+                                is_available = Connection_Ok;
+                                _setPhases(p, S);
+                                if (_keepSession(p, S))
+                                        S = NULL;
                         }
+                        ELSE
+                        {
+                                // The phases of the failed connection show how far it got
+                                if (S)
+                                        _setPhases(p, S);
+                                snprintf(error, sizeof(error), "%s", Exception_frame.message);
+                                DEBUG("Socket test failed for [%s]:%d -- %s\n", p->hostname, p->target.net.port, error);
+                        }
+                        FINALLY
+                        {
+                                if (S)
+                                        Socket_free((Socket_T *)&S);
+                        }
+                        END_TRY;
                 }
-                freeaddrinfo(result);
+                Resolver_free(result);
                 if (is_available != Connection_Ok)
                         THROW(IOException, "%s", error);
         } else {
@@ -590,9 +982,10 @@ static void _testIp(Port_T p) {
 void Socket_test(void *P) {
         ASSERT(P);
         Port_T p = P;
+        p->phases.dns = p->phases.connect = p->phases.tls = p->phases.firstbyte = -1.;
         TRY
         {
-                int64_t start = Time_micro();
+                int64_t start = Time_monotonicMicro();
                 switch (p->family) {
                         case Socket_Unix:
                                 _testUnix(p);
@@ -606,7 +999,7 @@ void Socket_test(void *P) {
                                 THROW(IOException, "Invalid socket family %d\n", p->family);
                                 break;
                 }
-                p->response = (double)(Time_micro() - start) / 1000.; // Convert microseconds to milliseconds
+                p->response = (double)(Time_monotonicMicro() - start) / 1000.; // Convert microseconds to milliseconds
                 p->is_available = Connection_Ok;
         }
         ELSE
@@ -649,7 +1042,12 @@ void Socket_enableSsl(T S, SslOptions_T ssl, const char *name)  {
                 else if (Run.ssl.checksum)
                         Ssl_setCertificateChecksum(S->ssl, Run.ssl.checksumType, Run.ssl.checksum);
 
+                if (ssl.protocol)
+                        Ssl_setApplicationProtocol(S->ssl, ssl.protocol);
+
+                long long start = Time_monotonicMicro();
                 Ssl_connect(S->ssl, S->socket, S->timeout, name);
+                S->handshake = (Time_monotonicMicro() - start) / 1000.;
         }
 #endif
 }
@@ -698,6 +1096,85 @@ int Socket_write(T S, void *b, size_t size) {
 }
 
 
+int Socket_writev(T S, struct iovec *iov, int count) {
+        ASSERT(S);
+        ASSERT(iov);
+        size_t size = 0;
+        for (int i = 0; i < count; i++)
+                size += iov[i].iov_len;
+        if (Socket_isSecure(S)) {
+                unsigned char *data = ALLOC(size + 1);
+                size_t length = 0;
+                for (int i = 0; i < count; i++) {
+                        memcpy(data + length, iov[i].iov_base, iov[i].iov_len);
+                        length += iov[i].iov_len;
+                }
+                int n = Socket_write(S, data, size);
+                FREE(data);
+                return n;
+        }
+        size_t sent = 0;
+        while (count > 0) {
+                ssize_t n = writev(S->socket, iov, count > IOV_MAX ? IOV_MAX : count);
+                if (n < 0) {
+                        if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && Net_canWrite(S->socket, S->timeout))
+                                continue;
+                        return -1;
+                }
+                sent += n;
+                // Skip the buffers sent and continue a partial write from where it stopped
+                while (count > 0 && (size_t)n >= iov->iov_len) {
+                        n -= iov->iov_len;
+                        iov++;
+                        count--;
+                }
+                if (count > 0) {
+                        iov->iov_base = (char *)iov->iov_base + n;
+                        iov->iov_len -= n;
+                }
+        }
+        return (int)sent;
+}
+
+
+long long Socket_writeFile(T S, int fd, off_t offset, size_t size) {
+        ASSERT(S);
+        ASSERT(fd >= 0);
+        size_t sent = 0;
+#ifdef HAVE_SYS_SENDFILE_H
+        if (! Socket_isSecure(S)) {
+                while (sent < size) {
+                        ssize_t n = sendfile(S->socket, fd, &offset, size - sent);
+                        if (n < 0) {
+                                if ((errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) && Net_canWrite(S->socket, S->timeout))
+                                        continue;
+                                return -1;
+                        }
+                        if (n == 0)
+                                break; // The file was truncated
+                        sent += n;
+                }
+                return (long long)sent;
+        }
+#endif
+        char buf[8192];
+        while (sent < size) {
+                ssize_t n = pread(fd, buf, size - sent < sizeof(buf) ? size - sent : sizeof(buf), offset);
+                if (n < 0 && errno == EINTR)
+                        continue;
+                if (n < 0)
+                        return -1;
+                if (n == 0)
+                        break;
+                if (Socket_write(S, buf, n) != n)
+                        return -1;
+                offset += n;
+                sent += n;
+        }
+        return (long long)sent;
+}
+
+
 int Socket_readByte(T S) {
         ASSERT(S);
         if (S->offset >= S->length)
@@ -708,27 +1185,117 @@ int Socket_readByte(T S) {
 
 
 int Socket_read(T S, void *b, int size) {
-        int c;
-        unsigned char *p = b;
         ASSERT(S);
-        while ((size-- > 0) && ((c = Socket_readByte(S)) >= 0))
-                *p++ = c;
-        return (int)((long)p - (long)b);
+        unsigned char *p = b;
+        int n = 0;
+        while (n < size) {
+                if (S->offset >= S->length && _fill(S, S->timeout) <= 0)
+                        break;
+                int chunk = MIN(S->length - S->offset, size - n);
+                memcpy(p + n, S->buffer + S->offset, chunk);
+                S->offset += chunk;
+                n += chunk;
+        }
+        return n;
 }
 
 
 char *Socket_readLine(T S, char *s, int size) {
-        int c;
-        unsigned char *p = (unsigned char *)s;
         ASSERT(S);
-        while (--size && ((c = Socket_readByte(S)) > 0)) { // Stop when \0 is read
-                *p++ = c;
-                if (c == '\n')
+        int n = 0;
+        while (n < size - 1) {
+                if (S->offset >= S->length && _fill(S, S->timeout) <= 0)
+                        break;
+                unsigned char *b = S->buffer + S->offset;
+                int available = MIN(S->length - S->offset, size - 1 - n);
+                unsigned char *eol = memchr(b, '\n', available);
+                int chunk = eol ? (int)(eol - b) + 1 : available;
+                // Stop when \0 is read, it is consumed but not stored
+                unsigned char *nul = memchr(b, 0, chunk);
+                if (nul) {
+                        memcpy(s + n, b, nul - b);
+                        n += nul - b;
+                        S->offset += (int)(nul - b) + 1;
+                        break;
+                }
+                memcpy(s + n, b, chunk);
+                n += chunk;
+                S->offset += chunk;
+                if (eol)
                         break;
         }
-        *p = 0;
-        if (*s)
-                return s;
-        return NULL;
+        s[n] = 0;
+        return n ? s : NULL;
+}
+
+
+const char *Socket_peekLine(T S, int *length) {
+        ASSERT(S);
+        ASSERT(length);
+        int scanned = 0;
+        while (true) {
+                unsigned char *eol = memchr(S->buffer + S->offset + scanned, '\n', S->length - S->offset - scanned);
+                if (eol) {
+                        *length = (int)(eol - (S->buffer + S->offset)) + 1;
+                        return (const char *)(S->buffer + S->offset);
+                }
+                scanned = S->length - S->offset;
+                // A line which doesn't fit the buffer is returned in parts
+                if (scanned >= S->capacity || _fill(S, S->timeout) <= 0)
+                        break;
+        }
+        *length = S->length - S->offset;
+        return *length > 0 ? (const char *)(S->buffer + S->offset) : NULL;
+}
+
+
+void Socket_consume(T S, int length) {
+        ASSERT(S);
+        ASSERT(length >= 0 && length <= S->length - S->offset);
+        S->offset += length;
+}
+
+
+int Socket_readResponse(T S, char *s, int size, void (*callback)(void *data, const char *line), void *data) {
+        ASSERT(S);
+        ASSERT(s);
+        ASSERT(size > 0);
+        *s = 0;
+        int status = 0, length;
+        boolean_t continued = false;
+        const char *line;
+        while ((line = Socket_peekLine(S, &length))) {
+                Socket_consume(S, length);
+                // The rest of a line which didn't fit the buffer
+                boolean_t rest = continued;
+                continued = line[length - 1] != '\n';
+                if (rest)
+                        continue;
+                int code = _parseStatus(line, length);
+                if (! status) {
+                        // The first line must have a status code
+                        if (! code) {
+                                _copyLine(s, size, line, length);
+                                return 0;
+                        }
+                        status = code;
+                } else if (code != status) {
+                        // Text line inside a multi-line response (RFC 959)
+                        continue;
+                }
+                if (callback || length == 3 || line[3] != '-')
+                        _copyLine(s, size, line, length);
+                if (callback)
+                        callback(data, s);
+                if (length == 3 || line[3] != '-') {
+                        // Skip the rest of a long last line
+                        while (continued && (line = Socket_peekLine(S, &length))) {
+                                Socket_consume(S, length);
+                                continued = line[length - 1] != '\n';
+                        }
+                        return status;
+                }
+        }
+        return -1;
 }
 
@@ -86,6 +86,23 @@ T Socket_new(const char *host, int port, Socket_Type type, Socket_Family family,
 T Socket_create(const char *host, int port, Socket_Type type, Socket_Family family, SslOptions_T ssl, int timeout);
 
 
+/**
+ * Create a new TCP Socket connected to the first of the given hosts which
+ * answers. The hosts race in the given order: the connection attempts are
+ * staggered by 250 milliseconds and the first established connection wins, so
+ * a dead host costs only the delay instead of the whole timeout. The timeout
+ * is shared by all attempts.
+ * @param hosts The host names
+ * @param ports The port number of each host
+ * @param ssl The SSL options of each host
+ * @param count The number of hosts
+ * @param timeout The timeout value in milliseconds
+ * @param winner Set to the index of the connected host
+ * @return The connected Socket or NULL if no host answered
+ */
+T Socket_createAny(const char **hosts, const int *ports, SslOptions_T *ssl, int count, int timeout, int *winner);
+
+
 /**
  * Create a new unix Socket for given path for connect and read.
  * Otherwise, same as socket_new().
@@ -145,6 +162,15 @@ int Socket_getTimeout(T S);
 boolean_t Socket_isSecure(T S);
 
 
+/**
+ * Get the number of bytes which were received already and can be read
+ * without waiting for the socket, such as a pipelined request
+ * @param S A Socket_T object
+ * @return The number of buffered bytes
+ */
+int Socket_pending(T S);
+
+
 /**
  * Get the underlying socket descriptor
  * @param S A Socket_T object
@@ -170,6 +196,18 @@ Socket_Type Socket_getType(T S);
 void *Socket_getPort(T S);
 
 
+/**
+ * Mark the session as reusable. A protocol test calls this method when
+ * the session is left in a state where the protocol's ping can continue.
+ * If the port is persistent, the socket is kept open after the test and
+ * the protocol shall not close the session.
+ * @param S A Socket_T object
+ * @return true if the port is persistent and the session will be kept,
+ * otherwise false
+ */
+boolean_t Socket_keep(T S);
+
+
 /**
  * Get the remote port number the socket is connected to
  * @param S A Socket_T object
@@ -243,6 +281,33 @@ int Socket_print(T S, const char *m, ...) __attribute__((format (printf, 2, 3)))
 int Socket_write(T S, void *b, size_t size);
 
 
+/**
+ * Write the buffers described by the iovec array as one message. A plain
+ * socket sends the buffers with a single writev(2) call where possible,
+ * for SSL the buffers are joined, so the data is sent in as few records
+ * as possible. The iovec array is advanced in place on a partial write.
+ * @param S A Socket_T object
+ * @param iov The buffers to be written
+ * @param count The number of buffers in iov
+ * @return The bytes sent or -1 if an error occured
+ */
+int Socket_writev(T S, struct iovec *iov, int count);
+
+
+/**
+ * Write size bytes of the file from the given offset. A plain socket
+ * sends the file with sendfile(2) where available, otherwise (and for
+ * SSL) the file is read and written in small chunks, so the file is
+ * never loaded into memory.
+ * @param S A Socket_T object
+ * @param fd The file descriptor
+ * @param offset The file offset to start at
+ * @param size The number of bytes to send
+ * @return The bytes sent or -1 if an error occured
+ */
+long long Socket_writeFile(T S, int fd, off_t offset, size_t size);
+
+
 /**
  * Read a single byte. The byte is returned as an int in the range 0
  * to 255.
@@ -276,6 +341,58 @@ int Socket_read(T S, void *b, int size);
 char *Socket_readLine(T S, char *s, int size);
 
 
+/**
+ * Return the next line in the socket read buffer without copying it.
+ * The line includes the newline and is <i>not</i> NUL terminated. If
+ * the line doesn't fit the buffer (see the socketBuffer limit) or the
+ * stream ended before a newline, the available data is returned and
+ * the rest of the line follows as the next line. The line is not
+ * consumed, call Socket_consume() to skip it. The returned pointer is
+ * valid until the next read from the socket. Example:
+ * <pre>
+ * const char *line;
+ * int length;
+ * while ((line = Socket_peekLine(S, &length))) {
+ *         Socket_consume(S, length);
+ *         // parse line[0..length-1] in place
+ * }
+ * </pre>
+ * @param S A Socket_T object
+ * @param length Output, the length of the line in bytes
+ * @return The line or NULL on error or when end of file occurs while
+ * no data is available
+ */
+const char *Socket_peekLine(T S, int *length);
+
+
+/**
+ * Consume length bytes of the data returned by Socket_peekLine()
+ * @param S A Socket_T object
+ * @param length The number of bytes to skip, at most the length
+ * returned by Socket_peekLine()
+ */
+void Socket_consume(T S, int length);
+
+
+/**
+ * Read a response with a three digit status code, as used by SMTP,
+ * LMTP, FTP and NNTP. The lines are scanned in place in the socket read
+ * buffer: a multi-line response ("250-" continuation lines) is consumed
+ * up to the last line ("250 "). Lines inside a multi-line response which
+ * don't start with the status code are skipped (RFC 959). The last line
+ * is copied to s without the line terminator.
+ * @param S A Socket_T object
+ * @param s A character buffer for the last line
+ * @param size The size of the buffer s
+ * @param callback Optional function called with each line of the response
+ * which starts with the status code. The line is passed in the buffer s.
+ * @param data User data passed to the callback
+ * @return The status code, 0 if the response doesn't start with a status
+ * code or -1 on error or when end of file occurs before the last line
+ */
+int Socket_readResponse(T S, char *s, int size, void (*callback)(void *data, const char *line), void *data);
+
+
 #undef T
 #endif
 
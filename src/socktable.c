@@ -0,0 +1,370 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#endif
+
+#if defined HAVE_LINUX_SOCK_DIAG_H && defined HAVE_LINUX_INET_DIAG_H
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#endif
+
+#include "monit.h"
+#include "file.h"
+#include "util.h"
+#include "socktable.h"
+
+// libmonit
+#include "thread/Thread.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined HAVE_LINUX_SOCK_DIAG_H && defined HAVE_LINUX_INET_DIAG_H
+
+
+#define SOCKTABLE_PORTS 65536
+
+
+/* One TCP socket from the dump */
+typedef struct SockEntry_T {
+        uint32_t inode;
+        uint32_t rqueue;           /**< Accept queue length of a listening socket */
+        uint32_t wqueue;                    /**< Backlog of a listening socket */
+        uint16_t port;                                          /**< Local port */
+        uint8_t state;                                           /**< TCP state */
+} SockEntry_T;
+
+
+/* The sockets of the current cycle, sorted by the local port: the sockets of port P are entries[index[P] .. index[P + 1]) */
+static struct {
+        boolean_t valid;
+        int count;
+        int size;
+        SockEntry_T *entries;
+        SockEntry_T *dump;                                /**< Unsorted dump buffer */
+        int *index;
+        long long drops;                           /**< TcpExt ListenDrops counter */
+} table;
+
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static boolean_t _dumpFamily(int family) {
+        int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+        if (fd < 0) {
+                LogError("socket table -- cannot create the sock_diag netlink socket: %s\n", STRERROR);
+                return false;
+        }
+        struct {
+                struct nlmsghdr nlh;
+                struct inet_diag_req_v2 req;
+        } request = {
+                .nlh = {.nlmsg_len = sizeof(request), .nlmsg_type = SOCK_DIAG_BY_FAMILY, .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP},
+                .req = {.sdiag_family = family, .sdiag_protocol = IPPROTO_TCP, .idiag_states = ~0U}
+        };
+        if (send(fd, &request, sizeof(request), 0) < 0) {
+                LogError("socket table -- cannot send the sock_diag request: %s\n", STRERROR);
+                close(fd);
+                return false;
+        }
+        boolean_t rv = false;
+        char buf[32768] __attribute__((aligned(NLMSG_ALIGNTO)));
+        for (boolean_t done = false; ! done;) {
+                ssize_t n = recv(fd, buf, sizeof(buf), 0);
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("socket table -- cannot read the sock_diag response: %s\n", STRERROR);
+                        break;
+                } else if (n == 0) {
+                        break;
+                }
+                for (struct nlmsghdr *h = (struct nlmsghdr *)buf; NLMSG_OK(h, n); h = NLMSG_NEXT(h, n)) {
+                        if (h->nlmsg_type == NLMSG_DONE) {
+                                done = rv = true;
+                                break;
+                        } else if (h->nlmsg_type == NLMSG_ERROR) {
+                                struct nlmsgerr *e = NLMSG_DATA(h);
+                                // The IPv6 dump fails if the IPv6 is disabled, that's not an error
+                                if (family == AF_INET6 && e->error == -ENOENT)
+                                        rv = true;
+                                else
+                                        LogError("socket table -- sock_diag error: %s\n", strerror(-e->error));
+                                done = true;
+                                break;
+                        } else if (h->nlmsg_type == SOCK_DIAG_BY_FAMILY) {
+                                struct inet_diag_msg *m = NLMSG_DATA(h);
+                                if (table.count >= table.size) {
+                                        table.size = table.size ? table.size * 2 : 1024;
+                                        RESIZE(table.dump, table.size * sizeof(SockEntry_T));
+                                }
+                                table.dump[table.count++] = (SockEntry_T){.inode = m->idiag_inode, .rqueue = m->idiag_rqueue, .wqueue = m->idiag_wqueue, .port = ntohs(m->id.idiag_sport), .state = m->idiag_state};
+                        }
+                }
+        }
+        close(fd);
+        return rv;
+}
+
+
+/* Read the host-wide TcpExt ListenDrops counter, the header line lists the field names and the next line the values */
+static long long _readListenDrops(void) {
+        char buf[8192];
+        if (! file_readProc(buf, sizeof(buf), "net/netstat", -1, NULL))
+                return -1LL;
+        char *header = strstr(buf, "TcpExt:");
+        char *values = header ? strstr(header + 7, "TcpExt:") : NULL;
+        if (! values)
+                return -1LL;
+        for (char *name = header + 7, *value = values + 7; name < values && *value;) {
+                while (*name == ' ')
+                        name++;
+                while (*value == ' ')
+                        value++;
+                if (Str_startsWith(name, "ListenDrops ") || Str_startsWith(name, "ListenDrops\n"))
+                        return strtoll(value, NULL, 10);
+                name += strcspn(name, " \n");
+                value += strcspn(value, " \n");
+        }
+        return -1LL;
+}
+
+
+/* Dump the sockets and index them by the local port (counting sort) */
+static boolean_t _dump(void) {
+        table.count = 0;
+        if (! _dumpFamily(AF_INET) || ! _dumpFamily(AF_INET6))
+                return false;
+        if (! table.index)
+                table.index = CALLOC(SOCKTABLE_PORTS + 1, sizeof(int));
+        else
+                memset(table.index, 0, (SOCKTABLE_PORTS + 1) * sizeof(int));
+        for (int i = 0; i < table.count; i++)
+                table.index[table.dump[i].port + 1]++;
+        for (int i = 0; i < SOCKTABLE_PORTS; i++)
+                table.index[i + 1] += table.index[i];
+        RESIZE(table.entries, (table.size ? table.size : 1) * sizeof(SockEntry_T));
+        for (int i = 0; i < table.count; i++)
+                table.entries[table.index[table.dump[i].port]++] = table.dump[i];
+        // Each index[P] moved to the end of port P, which is the start of port P + 1
+        memmove(table.index + 1, table.index, SOCKTABLE_PORTS * sizeof(int));
+        table.index[0] = 0;
+        table.drops = _readListenDrops();
+        return true;
+}
+
+
+static int _compareInode(const void *a, const void *b) {
+        uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+
+/**
+ * Collect the inodes of the sockets owned by the process from the "socket:[inode]" links in /proc/PID/fd
+ * @return The number of inodes (sorted) or -1 if the process descriptors cannot be read
+ */
+static int _readSocketInodes(pid_t pid, uint32_t **inodes) {
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/%d/fd", pid);
+        DIR *dir = opendir(path);
+        if (! dir) {
+                DEBUG("socket table -- cannot read %s: %s\n", path, STRERROR);
+                return -1;
+        }
+        int count = 0, size = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+                char target[64];
+                ssize_t n = readlinkat(dirfd(dir), entry->d_name, target, sizeof(target) - 1);
+                if (n <= 8)
+                        continue;
+                target[n] = 0;
+                if (! Str_startsWith(target, "socket:["))
+                        continue;
+                if (count >= size) {
+                        size = size ? size * 2 : 64;
+                        RESIZE(*inodes, size * sizeof(uint32_t));
+                }
+                (*inodes)[count++] = (uint32_t)strtoul(target + 8, NULL, 10);
+        }
+        closedir(dir);
+        qsort(*inodes, count, sizeof(uint32_t), _compareInode);
+        return count;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void SockTable_invalidate() {
+        LOCK(mutex)
+        {
+                table.valid = false;
+        }
+        END_LOCK;
+}
+
+
+void SockTable_stop() {
+        LOCK(mutex)
+        {
+                FREE(table.dump);
+                FREE(table.entries);
+                FREE(table.index);
+                table.count = table.size = 0;
+                table.valid = false;
+        }
+        END_LOCK;
+}
+
+
+boolean_t SockTable_update(Service_T s) {
+        ASSERT(s);
+        uint32_t *inodes = NULL;
+        int inodecount = 0;
+        if (s->path) {
+                pid_t pid = Util_getServicePid(s);
+                if (pid <= 0 || (inodecount = _readSocketInodes(pid, &inodes)) < 0) {
+                        FREE(inodes);
+                        return false;
+                }
+        }
+        boolean_t rv = false;
+        LOCK(mutex)
+        {
+                if (! table.valid)
+                        table.valid = _dump();
+                if (table.valid) {
+                        rv = true;
+                        int connections = 0, established = 0, timewait = 0, closewait = 0, listen = 0, queue = 0, backlog = 0;
+                        int from = s->localport ? table.index[s->localport] : 0;
+                        int to = s->localport ? table.index[s->localport + 1] : table.count;
+                        for (int i = from; i < to; i++) {
+                                SockEntry_T *e = &table.entries[i];
+                                if (s->path && ! bsearch(&e->inode, inodes, inodecount, sizeof(uint32_t), _compareInode))
+                                        continue;
+                                if (e->state == TCP_LISTEN) {
+                                        listen++;
+                                        if ((int)e->rqueue >= queue) {
+                                                queue = e->rqueue;
+                                                backlog = e->wqueue;
+                                        }
+                                        continue;
+                                }
+                                connections++;
+                                if (e->state == TCP_ESTABLISHED)
+                                        established++;
+                                else if (e->state == TCP_TIME_WAIT)
+                                        timewait++;
+                                else if (e->state == TCP_CLOSE_WAIT)
+                                        closewait++;
+                        }
+                        s->inf->priv.socket.connections = connections;
+                        s->inf->priv.socket.established = established;
+                        s->inf->priv.socket.timewait = timewait;
+                        s->inf->priv.socket.closewait = closewait;
+                        s->inf->priv.socket.listen = listen;
+                        s->inf->priv.socket.queue = listen ? queue : -1;
+                        s->inf->priv.socket.backlog = listen ? backlog : -1;
+                        s->inf->priv.socket.drops = s->inf->priv.socket._drops >= 0 && table.drops >= s->inf->priv.socket._drops ? table.drops - s->inf->priv.socket._drops : -1LL;
+                        s->inf->priv.socket._drops = table.drops;
+                }
+        }
+        END_LOCK;
+        FREE(inodes);
+        return rv;
+}
+
+
+#else
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void SockTable_invalidate() {
+}
+
+
+void SockTable_stop() {
+}
+
+
+boolean_t SockTable_update(Service_T s) {
+        ASSERT(s);
+        DEBUG("socket table -- not available on this platform\n");
+        return false;
+}
+
+
+#endif
+
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_SOCKTABLE_H
+#define MONIT_SOCKTABLE_H
+
+
+/**
+ * TCP connection table of the "check socket" services. On Linux, all TCP
+ * sockets (IPv4 and IPv6) are fetched with one netlink sock_diag dump when
+ * the first socket service is checked in the cycle. The table is indexed
+ * by the local port and shared by all socket services in the cycle. A
+ * service selects the sockets of one port, the sockets owned by the process
+ * in its pidfile (matched by the socket inode in /proc/PID/fd), or both.
+ * The listen queue drops are the host-wide TcpExt ListenDrops counter from
+ * /proc/net/netstat, the kernel doesn't count them per listener. On other
+ * systems the table is not available.
+ *
+ * @file
+ */
+
+
+/**
+ * Mark the table stale, the next SockTable_update() dumps the sockets
+ * again. Called at the beginning of the cycle.
+ */
+void SockTable_invalidate(void);
+
+
+/**
+ * Release the table
+ */
+void SockTable_stop(void);
+
+
+/**
+ * Update the socket statistics of the service from the table of this
+ * cycle. The table is dumped first if it is stale.
+ * @param s A socket service
+ * @return true if succeeded, false if the table or the owning process
+ * is not available
+ */
+boolean_t SockTable_update(Service_T s);
+
+
+#endif
+
@@ -32,6 +32,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_STDARG_H
+#include <stdarg.h>
+#endif
+
 #ifdef HAVE_ERRNO_H
 #include <errno.h>
 #endif
@@ -80,16 +84,19 @@
 #include "alert.h"
 #include "monit.h"
 #include "engine.h"
+#include "launcher.h"
 
 // libmonit
 #include "util/Str.h"
+#include "util/Arena.h"
 #include "system/Time.h"
 
 
 /**
- *  Function for spawning of a process. This function fork's twice to
- *  avoid creating any zombie processes. Inspired by code from
- *  W. Richard Stevens book, APUE.
+ *  Function for spawning of a process. The process is forked twice to
+ *  avoid creating any zombie processes, by the launcher helper if it
+ *  runs, see launcher.h. Inspired by code from W. Richard Stevens book,
+ *  APUE.
  *
  *  @file
  */
@@ -98,43 +105,75 @@
 /* ------------------------------------------------------------- Definitions */
 
 
-/* Do not exceed 8 bits here */
-enum ExitStatus_E {
-        setgid_ERROR     = 0x1,
-        setuid_ERROR     = 0x2,
-        initgroups_ERROR = 0x4,
-        redirect_ERROR   = 0x8,
-        fork_ERROR       = 0x10,
-        getpwuid_ERROR   = 0x20
-} __attribute__((__packed__));
+/* The number of the MONIT_xxx variables at most and the arena block size for the program environment */
+#define MONIT_VARIABLES   9
+#define ENVIRONMENT_ARENA 8192
 
 
 /* ----------------------------------------------------------------- Private */
 
 
+/* Format the "name=value" environment variable in the arena */
+static char *_variable(Arena_T arena, const char *format, ...) __attribute__((format (printf, 2, 3)));
+static char *_variable(Arena_T arena, const char *format, ...) {
+        va_list ap;
+        va_start(ap, format);
+        int length = vsnprintf(NULL, 0, format, ap);
+        va_end(ap);
+        char *variable = Arena_alloc(arena, length + 1);
+        va_start(ap, format);
+        vsnprintf(variable, length + 1, format, ap);
+        va_end(ap);
+        return variable;
+}
+
+
 /*
- * Setup the environment with special MONIT_xxx variables. The program
- * executed may use such variable for various purposes.
+ * Build the environment of the program: the special MONIT_xxx variables
+ * followed by the environment of monit. The program executed may use such
+ * variable for various purposes. The environment is built in the arena
+ * before fork, so the child process doesn't allocate memory before exec and
+ * the global environment is never modified. The strings of the monit
+ * environment are referenced, not copied.
  */
-static void set_monit_environment(Service_T S, command_t C, Event_T E, const char *date) {
-        setenv("MONIT_DATE", date, 1);
-        setenv("MONIT_SERVICE", S->name, 1);
-        setenv("MONIT_HOST", Run.system->name, 1);
-        setenv("MONIT_EVENT", E ? Event_get_description(E) : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event", 1);
-        setenv("MONIT_DESCRIPTION", E ? E->message : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event", 1);
+static char **build_environment(Arena_T arena, Service_T S, command_t C, Event_T E, const char *date) {
+        extern char **environ;
+        int count = 0;
+        for (char **e = environ; *e; e++)
+                count++;
+        char **environment = Arena_calloc(arena, count + MONIT_VARIABLES + 1, sizeof(char *));
+        int n = 0;
+        environment[n++] = _variable(arena, "MONIT_DATE=%s", date);
+        environment[n++] = _variable(arena, "MONIT_SERVICE=%s", S->name);
+        environment[n++] = _variable(arena, "MONIT_HOST=%s", Run.system->name);
+        environment[n++] = _variable(arena, "MONIT_EVENT=%s", E ? Event_get_description(E) : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event");
+        environment[n++] = _variable(arena, "MONIT_DESCRIPTION=%s", E ? E->message : C == S->start ? "Started" : C == S->stop ? "Stopped" : "No Event");
         switch (S->type) {
                 case Service_Process:
-                        putenv(Str_cat("MONIT_PROCESS_PID=%d", S->inf->priv.process.pid));
-                        putenv(Str_cat("MONIT_PROCESS_MEMORY=%llu", (unsigned long long)((double)S->inf->priv.process.mem / 1024.)));
-                        putenv(Str_cat("MONIT_PROCESS_CHILDREN=%d", S->inf->priv.process.children));
-                        putenv(Str_cat("MONIT_PROCESS_CPU_PERCENT=%.1f", S->inf->priv.process.cpu_percent));
+                        environment[n++] = _variable(arena, "MONIT_PROCESS_PID=%d", S->inf->priv.process.pid);
+                        environment[n++] = _variable(arena, "MONIT_PROCESS_MEMORY=%llu", (unsigned long long)((double)S->inf->priv.process.mem / 1024.));
+                        environment[n++] = _variable(arena, "MONIT_PROCESS_CHILDREN=%d", S->inf->priv.process.children);
+                        environment[n++] = _variable(arena, "MONIT_PROCESS_CPU_PERCENT=%.1f", S->inf->priv.process.cpu_percent);
                         break;
                 case Service_Program:
-                        putenv(Str_cat("MONIT_PROGRAM_STATUS=%d", S->program->exitStatus));
+                        environment[n++] = _variable(arena, "MONIT_PROGRAM_STATUS=%d", S->program->exitStatus);
                         break;
                 default:
                         break;
         }
+        // Add the environment of monit, except the variables set above
+        int monit = n;
+        for (char **e = environ; *e; e++) {
+                boolean_t found = false;
+                if (strncmp(*e, "MONIT_", 6) == 0) {
+                        size_t length = strcspn(*e, "=") + 1;
+                        for (int i = 0; i < monit && ! found; i++)
+                                found = strncmp(*e, environment[i], length) == 0;
+                }
+                if (! found)
+                        environment[n++] = *e;
+        }
+        return environment;
 }
 
 
@@ -149,11 +188,6 @@ static void set_monit_environment(Service_T S, command_t C, Event_T E, const cha
  * @param E An optional event object. May be NULL.
  */
 void spawn(Service_T S, command_t C, Event_T E) {
-        pid_t pid;
-        sigset_t mask;
-        sigset_t save;
-        int stat_loc = 0;
-        int exit_status;
         char date[42];
 
         ASSERT(S);
@@ -164,109 +198,28 @@ void spawn(Service_T S, command_t C, Event_T E) {
                 return;
         }
 
-        /*
-         * Block SIGCHLD
-         */
-        sigemptyset(&mask);
-        sigaddset(&mask, SIGCHLD);
-        pthread_sigmask(SIG_BLOCK, &mask, &save);
-
         Time_string(Time_now(), date);
-        pid = fork();
-        if (pid < 0) {
-                LogError("Cannot fork a new process -- %s\n", STRERROR);
-                pthread_sigmask(SIG_SETMASK, &save, NULL);
-                return;
-        }
-
-        if (pid == 0) {
-                if (C->has_gid) {
-                        if (setgid(C->gid) != 0) {
-                                stat_loc |= setgid_ERROR;
-                        }
-                }
-                if (C->has_uid) {
-                        struct passwd *user = getpwuid(C->uid);
-                        if (user) {
-                                if (initgroups(user->pw_name, getgid()) == 0) {
-                                        if (setuid(C->uid) != 0) {
-                                                stat_loc |= setuid_ERROR;
-                                        }
-                                } else {
-                                        stat_loc |= initgroups_ERROR;
-                                }
-                        } else {
-                                stat_loc |= getpwuid_ERROR;
-                        }
-                }
-
-                set_monit_environment(S, C, E, date);
+        Arena_T arena = Arena_new(ENVIRONMENT_ARENA);
+        char **environment = build_environment(arena, S, C, E, date);
+        int exit_status = Launcher_execute(C->arg, environment, C->has_uid ? (int)C->uid : -1, C->has_gid ? (int)C->gid : -1);
+        Arena_free(&arena);
 
-                if (! (Run.flags & Run_Daemon)) {
-                        for (int i = 0; i < 3; i++)
-                                if (close(i) == -1 || open("/dev/null", O_RDWR) != i)
-                                        stat_loc |= redirect_ERROR;
-                }
-
-                Util_closeFds();
-
-                setsid();
-
-                pid = fork();
-                if (pid < 0) {
-                        stat_loc |= fork_ERROR;
-                        _exit(stat_loc);
-                }
-
-                if (pid == 0) {
-                        /*
-                         * Reset all signals, so the spawned process is *not* created
-                         * with any inherited SIG_BLOCKs
-                         */
-                        sigemptyset(&mask);
-                        pthread_sigmask(SIG_SETMASK, &mask, NULL);
-                        signal(SIGINT, SIG_DFL);
-                        signal(SIGHUP, SIG_DFL);
-                        signal(SIGTERM, SIG_DFL);
-                        signal(SIGUSR1, SIG_DFL);
-                        signal(SIGPIPE, SIG_DFL);
-
-                        (void) execv(C->arg[0], C->arg);
-                        _exit(errno);
-                }
-
-                /* Exit first child and return errors to parent */
-                _exit(stat_loc);
-        }
-
-        /* Wait for first child - aka second parent, to exit */
-        if (waitpid(pid, &stat_loc, 0) != pid) {
-                LogError("Waitpid error\n");
-        }
-
-        exit_status = WEXITSTATUS(stat_loc);
-        if (exit_status & setgid_ERROR)
+        if (exit_status & Launcher_Setgid)
                 LogError("Failed to change gid to '%d' for '%s'\n", C->gid, C->arg[0]);
-        if (exit_status & setuid_ERROR)
+        if (exit_status & Launcher_Setuid)
                 LogError("Failed to change uid to '%d' for '%s'\n", C->uid, C->arg[0]);
-        if (exit_status & initgroups_ERROR)
+        if (exit_status & Launcher_Initgroups)
                 LogError("initgroups for UID %d failed when executing '%s'\n", C->uid, C->arg[0]);
-        if (exit_status & fork_ERROR)
+        if (exit_status & Launcher_Fork)
                 LogError("Cannot fork a new process for '%s'\n", C->arg[0]);
-        if (exit_status & redirect_ERROR)
+        if (exit_status & Launcher_Redirect)
                 LogError("Cannot redirect IO to /dev/null for '%s'\n", C->arg[0]);
-        if (exit_status & getpwuid_ERROR)
+        if (exit_status & Launcher_Getpwuid)
                 LogError("UID %d not found on the system when executing '%s'\n", C->uid, C->arg[0]);
 
         /*
-         * Restore the signal mask
-         */
-        pthread_sigmask(SIG_SETMASK, &save, NULL);
-
-        /*
-         * We do not need to wait for the second child since we forked twice,
+         * We do not need to wait for the program since it was forked twice,
          * the init system-process will wait for it. So we just return
          */
-
 }
 
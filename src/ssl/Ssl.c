@@ -76,6 +76,11 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
 
 #include "monit.h"
 #include "Ssl.h"
@@ -121,6 +126,83 @@
 #define SSLERROR ERR_error_string(ERR_get_error(),NULL)
 
 
+/**
+ * Maximum number of cached client sessions per context
+ */
+#define SSL_SESSIONS 256
+
+
+/**
+ * The server session cache size and the session lifetime [s]. The sessions are resumed from the cache (TLSv1.2 session
+ * ID) or from the session ticket
+ */
+#define SSL_SERVER_SESSIONS 1024
+#define SSL_SERVER_SESSION_TIMEOUT 7200
+
+
+/**
+ * The server ciphers: forward secret ECDHE key exchange with AEAD ciphers first, the TLSv1.3 cipher suites are set separately
+ */
+#define SSL_SERVER_CIPHER_LIST "ECDHE+AESGCM:ECDHE+CHACHA20:ECDHE:ALL:!DES:!RC4:!aNULL:!eNULL:!LOW:!EXP:!IDEA:!MD5"
+#define SSL_SERVER_CIPHER_SUITES "TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256:TLS_AES_128_GCM_SHA256"
+#define SSL_SERVER_GROUPS "X25519:P-256:P-384"
+
+
+/**
+ * Session ticket key rotation interval [s]. The tickets encrypted with the previous key are still accepted (and renewed
+ * with the current key), so a ticket is valid for at least one interval
+ */
+#define SSL_TICKET_ROTATE 3600
+
+
+/**
+ * Session ticket key: the key name sent in the ticket, the AES-256 and HMAC-SHA256 keys
+ */
+typedef struct SslTicketKey_T {
+        unsigned char name[16];
+        unsigned char aes[32];
+        unsigned char hmac[32];
+        time_t created;                                       /**< 0 if not used */
+} SslTicketKey_T;
+
+
+/**
+ * Client session cached for a server (name and address), offered on the next connection to resume it
+ */
+typedef struct SslSession_T {
+        char *key;
+        SSL_SESSION *session;
+        struct SslSession_T *next;
+} *SslSession_T;
+
+
+/**
+ * Server certificate chain of the last full handshake with a server (name and address). The validity and checksum of a
+ * resumed session are tested with it, the cache is also the certificate inventory (see Ssl_printCertificates())
+ */
+typedef struct SslCertificate_T {
+        char *key;
+        STACK_OF(X509) *chain;
+        time_t checked;                             /**< Time of the last full handshake */
+        struct SslCertificate_T *next;
+} *SslCertificate_T;
+
+
+/**
+ * Client context shared by all connections with the same options, the cache holds a context reference, each connection handler holds its own
+ */
+typedef struct SslContext_T {
+        Ssl_Version version;
+        char *CACertificateFile;
+        char *CACertificatePath;
+        char *clientpem;
+        SSL_CTX *ctx;
+        int count;
+        SslSession_T sessions;
+        struct SslContext_T *next;
+} *SslContext_T;
+
+
 #define T Ssl_T
 struct T {
         boolean_t accepted;
@@ -132,8 +214,11 @@ struct T {
         int minimumValidDays;
         SSL *handler;
         SSL_CTX *ctx;
+        SslContext_T context;
         X509 *certificate;
         char *clientpemfile;
+        char *session;
+        char *protocol;
         MD_T checksum;
         char error[128];
 };
@@ -149,6 +234,16 @@ struct SslServer_T {
 
 static Mutex_T *instanceMutexTable;
 static int session_id_context = 1;
+static SslContext_T contexts = NULL;
+static SslCertificate_T certificates = NULL;
+static Mutex_T contextMutex = PTHREAD_MUTEX_INITIALIZER;
+static Mutex_T ticketMutex = PTHREAD_MUTEX_INITIALIZER;
+static SslTicketKey_T ticketKeys[2] = {}; // The current and the previous key
+static struct {
+        unsigned long long full;
+        unsigned long long resumed;
+        unsigned long long failed;
+} handshakes = {};
 
 
 /* ----------------------------------------------------------------- Private */
@@ -178,60 +273,67 @@ static void _mutexLock(int mode, int n, const char *file, int line) {
 }
 
 
-static int _checkExpiration(T C, X509_STORE_CTX *ctx, X509 *certificate) {
-        if (C->minimumValidDays) {
-                // If we have warn-X-days-before-expire condition, check the certificate validity (already expired certificates are catched in preverify => we don't need to handle them here).
-                int deltadays = 0;
+/**
+ * Get the end of the certificate validity
+ * @return The notAfter time or 0 if the field is invalid
+ */
+static time_t _getNotAfter(X509 *certificate) {
 #ifdef HAVE_ASN1_TIME_DIFF
-                int deltaseconds;
-                if (! ASN1_TIME_diff(&deltadays, &deltaseconds, NULL, X509_get_notAfter(certificate))) {
-                        X509_STORE_CTX_set_error(ctx, X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD);
-                        snprintf(C->error, sizeof(C->error), "invalid time format (in certificate's notAfter field)");
-                        return 0;
-                }
+        int days, seconds;
+        if (! ASN1_TIME_diff(&days, &seconds, NULL, X509_get_notAfter(certificate)))
+                return 0;
+        return Time_now() + days * 86400LL + seconds;
 #else
-                ASN1_GENERALIZEDTIME *t = ASN1_TIME_to_generalizedtime(X509_get_notAfter(certificate), NULL);
-                if (! t) {
-                        X509_STORE_CTX_set_error(ctx, X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD);
-                        snprintf(C->error, sizeof(C->error), "invalid time format (in certificate's notAfter field)");
-                        return 0;
-                }
+        volatile time_t notAfter = 0;
+        ASN1_GENERALIZEDTIME *t = ASN1_TIME_to_generalizedtime(X509_get_notAfter(certificate), NULL);
+        if (t) {
                 TRY
                 {
-                        deltadays = (double)(Time_toTimestamp((const char *)t->data) - Time_now()) / 86400.;
+                        notAfter = Time_toTimestamp((const char *)t->data);
                 }
                 ELSE
                 {
-                        X509_STORE_CTX_set_error(ctx, X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD);
-                        snprintf(C->error, sizeof(C->error), "invalid time format (in certificate's notAfter field) -- %s", t->data);
-                }
-                FINALLY
-                {
-                        ASN1_STRING_free(t);
+                        DEBUG("SSL: invalid time format (in certificate's notAfter field) -- %s\n", t->data);
                 }
                 END_TRY;
+                ASN1_STRING_free(t);
+        }
+        return notAfter;
 #endif
+}
+
+
+static int _checkExpiration(T C, X509 *certificate) {
+        if (C->minimumValidDays) {
+                // If we have warn-X-days-before-expire condition, check the certificate validity (already expired certificates are catched in preverify => we don't need to handle them here).
+                time_t notAfter = _getNotAfter(certificate);
+                if (! notAfter) {
+                        snprintf(C->error, sizeof(C->error), "invalid time format (in certificate's notAfter field)");
+                        return X509_V_ERR_ERROR_IN_CERT_NOT_AFTER_FIELD;
+                }
+                int deltadays = (int)((notAfter - Time_now()) / 86400);
                 if (deltadays < C->minimumValidDays) {
-                        X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                         snprintf(C->error, sizeof(C->error), "certificate expire in %d days matches check limit [valid > %d days]", deltadays, C->minimumValidDays);
-                        return 0;
+                        return X509_V_ERR_APPLICATION_VERIFICATION;
                 }
         }
-        return 1;
+        return X509_V_OK;
 }
 
 
-static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
-        if (X509_STORE_CTX_get_error_depth(ctx) == 0 && *C->checksum) {
+/**
+ * Compare the server certificate (depth 0) with the expected checksum
+ */
+static int _checkChecksum(T C, X509 *certificate) {
+        if (*C->checksum) {
                 unsigned int len, i = 0;
                 unsigned char checksum[EVP_MAX_MD_SIZE];
                 const EVP_MD *hash = NULL;
                 switch (C->checksumType) {
                         case Hash_Md5:
                                 if (Run.flags & Run_FipsEnabled) {
-                                        X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                         snprintf(C->error, sizeof(C->error), "SSL certificate MD5 checksum is not supported in FIPS mode, please use SHA1");
-                                        return 0;
+                                        return X509_V_ERR_APPLICATION_VERIFICATION;
                                 } else {
                                         hash = EVP_md5();
                                 }
@@ -240,22 +342,20 @@ static int _checkChecksum(T C, X509_STORE_CTX *ctx, X509 *certificate) {
                                 hash = EVP_sha1();
                                 break;
                         default:
-                                X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                 snprintf(C->error, sizeof(C->error), "Invalid SSL certificate checksum type (0x%x)", C->checksumType);
-                                return 0;
+                                return X509_V_ERR_APPLICATION_VERIFICATION;
                 }
                 X509_digest(certificate, hash, checksum, &len);
                 while ((i < len) && (C->checksum[2 * i] != '\0') && (C->checksum[2 * i + 1] != '\0')) {
                         unsigned char c = (C->checksum[2 * i] > 57 ? C->checksum[2 * i] - 87 : C->checksum[2 * i] - 48) * 0x10 + (C->checksum[2 * i + 1] > 57 ? C->checksum[2 * i + 1] - 87 : C->checksum[2 * i + 1] - 48);
                         if (c != checksum[i]) {
-                                X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                                 snprintf(C->error, sizeof(C->error), "SSL server certificate checksum failed");
-                                return 0;
+                                return X509_V_ERR_APPLICATION_VERIFICATION;
                         }
                         i++;
                 }
         }
-        return 1;
+        return X509_V_OK;
 }
 
 
@@ -282,7 +382,14 @@ static int _verifyServerCertificates(int preverify_ok, X509_STORE_CTX *ctx) {
         } else {
                 X509 *certificate = X509_STORE_CTX_get_current_cert(ctx);
                 if (certificate) {
-                        return (_checkExpiration(C, ctx, certificate) && _checkChecksum(C, ctx, certificate));
+                        int error = _checkExpiration(C, certificate);
+                        if (error == X509_V_OK && X509_STORE_CTX_get_error_depth(ctx) == 0)
+                                error = _checkChecksum(C, certificate);
+                        if (error != X509_V_OK) {
+                                X509_STORE_CTX_set_error(ctx, error);
+                                return 0;
+                        }
+                        return 1;
                 } else {
                         X509_STORE_CTX_set_error(ctx, X509_V_ERR_APPLICATION_VERIFICATION);
                         snprintf(C->error, sizeof(C->error), "cannot get SSL server certificate");
@@ -338,76 +445,65 @@ static boolean_t _setServerNameIdentification(T C, const char *hostname) {
 }
 
 
-static boolean_t _setClientCertificate(T C, const char *file) {
-        if (SSL_CTX_use_certificate_chain_file(C->ctx, file) != 1) {
+static boolean_t _setClientCertificate(SSL_CTX *ctx, const char *file) {
+        if (SSL_CTX_use_certificate_chain_file(ctx, file) != 1) {
                 LogError("SSL client certificate chain loading failed: %s\n", SSLERROR);
                 return false;
         }
-        if (SSL_CTX_use_PrivateKey_file(C->ctx, file, SSL_FILETYPE_PEM) != 1) {
+        if (SSL_CTX_use_PrivateKey_file(ctx, file, SSL_FILETYPE_PEM) != 1) {
                 LogError("SSL client private key loading failed: %s\n", SSLERROR);
                 return false;
         }
-        if (SSL_CTX_check_private_key(C->ctx) != 1) {
+        if (SSL_CTX_check_private_key(ctx) != 1) {
                 LogError("SSL client private key doesn't match the certificate: %s\n", SSLERROR);
                 return false;
         }
-        C->clientpemfile = Str_dup(file);
         return true;
 }
 
 
-/* ------------------------------------------------------------------ Public */
-
-
-void Ssl_start() {
-        SSL_library_init();
-        SSL_load_error_strings();
-        if (File_exist(URANDOM_DEVICE))
-                RAND_load_file(URANDOM_DEVICE, RANDOM_BYTES);
-        else if (File_exist(RANDOM_DEVICE))
-                RAND_load_file(RANDOM_DEVICE, RANDOM_BYTES);
-        else
-                THROW(AssertException, "SSL: cannot find %s nor %s on the system", URANDOM_DEVICE, RANDOM_DEVICE);
-        int locks = CRYPTO_num_locks();
-        instanceMutexTable = CALLOC(locks, sizeof(Mutex_T));
-        for (int i = 0; i < locks; i++)
-                Mutex_init(instanceMutexTable[i]);
-        CRYPTO_set_id_callback(_threadID);
-        CRYPTO_set_locking_callback(_mutexLock);
-}
-
-
-void Ssl_stop() {
-        CRYPTO_set_id_callback(NULL);
-        CRYPTO_set_locking_callback(NULL);
-        for (int i = 0; i < CRYPTO_num_locks(); i++)
-                Mutex_destroy(instanceMutexTable[i]);
-        FREE(instanceMutexTable);
-        RAND_cleanup();
-        ERR_free_strings();
-        Ssl_threadCleanup();
-}
-
-
-void Ssl_threadCleanup() {
-        ERR_remove_state(0);
-}
-
-
-void Ssl_setFipsMode(boolean_t enabled) {
-#ifdef OPENSSL_FIPS
-        if (enabled && ! FIPS_mode() && ! FIPS_mode_set(1))
-                THROW(AssertException, "SSL: cannot enter FIPS mode -- %s", SSLERROR);
-        else if (! enabled && FIPS_mode() && ! FIPS_mode_set(0))
-                THROW(AssertException, "SSL: cannot exit FIPS mode -- %s", SSLERROR);
-#endif
+/**
+ * New session callback: keep the session for the server the connection was made to. Runs after the handshake or,
+ * with TLSv1.3, when the server sends the session ticket. Returns 1 if the cache took the session reference.
+ */
+static int _newSession(SSL *handler, SSL_SESSION *session) {
+        T C = SSL_get_app_data(handler);
+        if (! C || ! C->session || ! C->context)
+                return 0;
+        LOCK(contextMutex)
+        {
+                SslContext_T context = C->context;
+                SslSession_T s = context->sessions, *prev = &context->sessions;
+                for (; s && ! IS(s->key, C->session); prev = &s->next, s = s->next)
+                        ;
+                if (s) {
+                        *prev = s->next;
+                        SSL_SESSION_free(s->session);
+                } else {
+                        NEW(s);
+                        s->key = Str_dup(C->session);
+                        if (++context->count > SSL_SESSIONS) {
+                                // Drop the least recently stored session
+                                SslSession_T *last = &context->sessions;
+                                while ((*last)->next)
+                                        last = &(*last)->next;
+                                SSL_SESSION_free((*last)->session);
+                                FREE((*last)->key);
+                                FREE(*last);
+                                context->count--;
+                        }
+                }
+                s->session = session;
+                s->next = context->sessions;
+                context->sessions = s;
+        }
+        END_LOCK;
+        return 1;
 }
 
 
-T Ssl_new(Ssl_Version version, const char *CACertificateFile, const char *CACertificatePath, const char *clientpem) {
-        T C;
-        NEW(C);
-        C->version = version;
+static SSL_CTX *_newContext(Ssl_Version version, const char *CACertificateFile, const char *CACertificatePath, const char *clientpem) {
+        SSL_CTX *ctx = NULL;
         const SSL_METHOD *method;
         switch (version) {
                 case SSL_V2:
@@ -456,28 +552,240 @@ T Ssl_new(Ssl_Version version, const char *CACertificateFile, const char *CACert
                 LogError("SSL: client method initialization failed -- %s\n", SSLERROR);
                 goto sslerror;
         }
-        if (! (C->ctx = SSL_CTX_new(method))) {
+        if (! (ctx = SSL_CTX_new(method))) {
                 LogError("SSL: client context initialization failed -- %s\n", SSLERROR);
                 goto sslerror;
         }
-        SSL_CTX_set_default_verify_paths(C->ctx);
+        SSL_CTX_set_default_verify_paths(ctx);
         if (CACertificateFile || CACertificatePath) {
-                if (! SSL_CTX_load_verify_locations(C->ctx, CACertificateFile, CACertificatePath)) {
+                if (! SSL_CTX_load_verify_locations(ctx, CACertificateFile, CACertificatePath)) {
                         LogError("SSL: CA certificates loading failed -- %s\n", SSLERROR);
                         goto sslerror;
                 }
         }
-        if (clientpem && ! _setClientCertificate(C, clientpem))
+        if (clientpem && ! _setClientCertificate(ctx, clientpem))
                 goto sslerror;
         if (version == SSL_Auto)
-                SSL_CTX_set_options(C->ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
+                SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3);
 #ifdef SSL_OP_NO_COMPRESSION
-        SSL_CTX_set_options(C->ctx, SSL_OP_NO_COMPRESSION);
+        SSL_CTX_set_options(ctx, SSL_OP_NO_COMPRESSION);
 #endif
-        if (SSL_CTX_set_cipher_list(C->ctx, CIPHER_LIST) != 1) {
+        if (SSL_CTX_set_cipher_list(ctx, CIPHER_LIST) != 1) {
                 LogError("SSL: client cipher list [%s] error -- no valid ciphers\n", CIPHER_LIST);
                 goto sslerror;
         }
+        // The sessions are kept by the context cache per server, the OpenSSL internal cache is for servers
+        SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx, _newSession);
+        return ctx;
+sslerror:
+        if (ctx)
+                SSL_CTX_free(ctx);
+        return NULL;
+}
+
+
+static boolean_t _isEqual(const char *a, const char *b) {
+        return a == b || Str_isByteEqual(a, b);
+}
+
+
+/**
+ * Get the cached client context for the options or create it. Must be called with the contextMutex locked.
+ */
+static SslContext_T _getContext(Ssl_Version version, const char *CACertificateFile, const char *CACertificatePath, const char *clientpem) {
+        for (SslContext_T c = contexts; c; c = c->next)
+                if (c->version == version && _isEqual(c->CACertificateFile, CACertificateFile) && _isEqual(c->CACertificatePath, CACertificatePath) && _isEqual(c->clientpem, clientpem))
+                        return c;
+        SSL_CTX *ctx = _newContext(version, CACertificateFile, CACertificatePath, clientpem);
+        if (! ctx)
+                return NULL;
+        SslContext_T c;
+        NEW(c);
+        c->version = version;
+        c->CACertificateFile = CACertificateFile ? Str_dup(CACertificateFile) : NULL;
+        c->CACertificatePath = CACertificatePath ? Str_dup(CACertificatePath) : NULL;
+        c->clientpem = clientpem ? Str_dup(clientpem) : NULL;
+        c->ctx = ctx;
+        c->next = contexts;
+        contexts = c;
+        return c;
+}
+
+
+static SslSession_T _getSession(SslContext_T context, const char *key) {
+        for (SslSession_T s = context->sessions; s; s = s->next)
+                if (IS(s->key, key))
+                        return s;
+        return NULL;
+}
+
+
+static SslCertificate_T _getCertificate(const char *key) {
+        for (SslCertificate_T c = certificates; c; c = c->next)
+                if (IS(c->key, key))
+                        return c;
+        return NULL;
+}
+
+
+/**
+ * Keep the certificate chain sent by the server in the full handshake
+ */
+static void _saveCertificates(T C) {
+        STACK_OF(X509) *chain = SSL_get_peer_cert_chain(C->handler);
+        if (! chain || ! sk_X509_num(chain))
+                return;
+        LOCK(contextMutex)
+        {
+                SslCertificate_T c = _getCertificate(C->session);
+                if (c) {
+                        sk_X509_pop_free(c->chain, X509_free);
+                } else {
+                        NEW(c);
+                        c->key = Str_dup(C->session);
+                        c->next = certificates;
+                        certificates = c;
+                }
+                c->chain = X509_chain_up_ref(chain);
+                c->checked = Time_now();
+        }
+        END_LOCK;
+}
+
+
+/**
+ * Test the validity and checksum of the resumed session with the certificate chain of the last full handshake
+ * @return true if passed, otherwise false and the C->error is set
+ */
+static boolean_t _checkCachedCertificates(T C) {
+        int error = X509_V_ERR_APPLICATION_VERIFICATION;
+        snprintf(C->error, sizeof(C->error), "the certificate of the resumed session is not cached");
+        LOCK(contextMutex)
+        {
+                SslCertificate_T c = _getCertificate(C->session);
+                if (c) {
+                        *C->error = 0;
+                        error = X509_V_OK;
+                        for (int i = 0; i < sk_X509_num(c->chain) && error == X509_V_OK; i++)
+                                error = _checkExpiration(C, sk_X509_value(c->chain, i));
+                        if (error == X509_V_OK)
+                                error = _checkChecksum(C, sk_X509_value(c->chain, 0));
+                }
+        }
+        END_LOCK;
+        return error == X509_V_OK;
+}
+
+
+static void _printString(StringBuffer_T B, const char *s) {
+        StringBuffer_append(B, "\"");
+        for (; *s; s++) {
+                if (*s == '"' || *s == '\\')
+                        StringBuffer_append(B, "\\%c", *s);
+                else if ((unsigned char)*s < 0x20)
+                        StringBuffer_append(B, "\\u%04x", (unsigned char)*s);
+                else
+                        StringBuffer_append(B, "%c", *s);
+        }
+        StringBuffer_append(B, "\"");
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void Ssl_start() {
+        SSL_library_init();
+        SSL_load_error_strings();
+        if (File_exist(URANDOM_DEVICE))
+                RAND_load_file(URANDOM_DEVICE, RANDOM_BYTES);
+        else if (File_exist(RANDOM_DEVICE))
+                RAND_load_file(RANDOM_DEVICE, RANDOM_BYTES);
+        else
+                THROW(AssertException, "SSL: cannot find %s nor %s on the system", URANDOM_DEVICE, RANDOM_DEVICE);
+        int locks = CRYPTO_num_locks();
+        instanceMutexTable = CALLOC(locks, sizeof(Mutex_T));
+        for (int i = 0; i < locks; i++)
+                Mutex_init(instanceMutexTable[i]);
+        CRYPTO_set_id_callback(_threadID);
+        CRYPTO_set_locking_callback(_mutexLock);
+}
+
+
+void Ssl_stop() {
+        Ssl_reset();
+        CRYPTO_set_id_callback(NULL);
+        CRYPTO_set_locking_callback(NULL);
+        for (int i = 0; i < CRYPTO_num_locks(); i++)
+                Mutex_destroy(instanceMutexTable[i]);
+        FREE(instanceMutexTable);
+        RAND_cleanup();
+        ERR_free_strings();
+        Ssl_threadCleanup();
+}
+
+
+void Ssl_reset() {
+        LOCK(contextMutex)
+        {
+                while (contexts) {
+                        SslContext_T c = contexts;
+                        contexts = c->next;
+                        while (c->sessions) {
+                                SslSession_T s = c->sessions;
+                                c->sessions = s->next;
+                                SSL_SESSION_free(s->session);
+                                FREE(s->key);
+                                FREE(s);
+                        }
+                        SSL_CTX_free(c->ctx); // Connections still open hold their own reference
+                        FREE(c->CACertificateFile);
+                        FREE(c->CACertificatePath);
+                        FREE(c->clientpem);
+                        FREE(c);
+                }
+                while (certificates) {
+                        SslCertificate_T c = certificates;
+                        certificates = c->next;
+                        sk_X509_pop_free(c->chain, X509_free);
+                        FREE(c->key);
+                        FREE(c);
+                }
+        }
+        END_LOCK;
+}
+
+
+void Ssl_threadCleanup() {
+        ERR_remove_state(0);
+}
+
+
+void Ssl_setFipsMode(boolean_t enabled) {
+#ifdef OPENSSL_FIPS
+        if (enabled && ! FIPS_mode() && ! FIPS_mode_set(1))
+                THROW(AssertException, "SSL: cannot enter FIPS mode -- %s", SSLERROR);
+        else if (! enabled && FIPS_mode() && ! FIPS_mode_set(0))
+                THROW(AssertException, "SSL: cannot exit FIPS mode -- %s", SSLERROR);
+#endif
+}
+
+
+T Ssl_new(Ssl_Version version, const char *CACertificateFile, const char *CACertificatePath, const char *clientpem) {
+        T C;
+        NEW(C);
+        C->version = version;
+        LOCK(contextMutex)
+        {
+                if ((C->context = _getContext(version, CACertificateFile, CACertificatePath, clientpem)))
+                        C->ctx = C->context->ctx;
+        }
+        END_LOCK;
+        if (! C->ctx)
+                goto sslerror;
+        if (clientpem)
+                C->clientpemfile = Str_dup(clientpem);
         if (! (C->handler = SSL_new(C->ctx))) {
                 LogError("SSL: cannot create client handler -- %s\n", SSLERROR);
                 goto sslerror;
@@ -496,9 +804,10 @@ void Ssl_free(T *C) {
         ASSERT(C && *C);
         if ((*C)->handler)
                 SSL_free((*C)->handler);
-        if ((*C)->ctx && ! (*C)->accepted)
-                SSL_CTX_free((*C)->ctx);
+        // The client context belongs to the context cache, the accepted connection context to the server
         FREE((*C)->clientpemfile);
+        FREE((*C)->session);
+        FREE((*C)->protocol);
         FREE(*C);
 }
 
@@ -518,6 +827,36 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
         SSL_set_connect_state(C->handler);
         SSL_set_fd(C->handler, C->socket);
         _setServerNameIdentification(C, name);
+        if (C->protocol) {
+#ifdef HAVE_ALPN
+                // ALPN wire format: the protocol name prefixed with its length
+                unsigned char protos[256];
+                int length = snprintf((char *)protos, sizeof(protos), "%c%s", (int)strlen(C->protocol), C->protocol);
+                if (SSL_set_alpn_protos(C->handler, protos, length) != 0)
+                        THROW(IOException, "SSL: cannot set the application protocol %s -- %s", C->protocol, SSLERROR);
+#else
+                THROW(IOException, "SSL: cannot negotiate the application protocol %s -- ALPN is not supported by the SSL library", C->protocol);
+#endif
+        }
+        // Offer the session of the previous connection to the server. The resumed handshake skips the certificate verification callback, so if the certificate
+        // checksum or validity is tested, resume only until the certificate cache interval passed and test the certificates of the last full handshake
+        boolean_t tested = *C->checksum || C->minimumValidDays > 0;
+        if (C->context && ! C->session) {
+                char host[NI_MAXHOST], port[NI_MAXSERV];
+                struct sockaddr_storage addr;
+                socklen_t addrlen = sizeof(addr);
+                if (getpeername(C->socket, (struct sockaddr *)&addr, &addrlen) == 0 && getnameinfo((struct sockaddr *)&addr, addrlen, host, sizeof(host), port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) == 0) {
+                        C->session = Str_cat("%s [%s]:%s", name ? name : "", host, port);
+                        LOCK(contextMutex)
+                        {
+                                SslSession_T s = _getSession(C->context, C->session);
+                                SslCertificate_T c = tested ? _getCertificate(C->session) : NULL;
+                                if (s && (! tested || (c && Time_now() - c->checked < Run.certificateCache.interval)))
+                                        SSL_set_session(C->handler, s->session);
+                        }
+                        END_LOCK;
+                }
+        }
         boolean_t retry = false;
         do {
                 int rv = SSL_connect(C->handler);
@@ -543,6 +882,24 @@ void Ssl_connect(T C, int socket, int timeout, const char *name) {
                         break;
                 }
         } while (retry);
+        if (C->session) {
+                if (SSL_session_reused(C->handler)) {
+                        DEBUG("SSL: session resumed with %s\n", C->session);
+                        if (tested && ! _checkCachedCertificates(C))
+                                THROW(IOException, "SSL server certificate verification error: %s", C->error);
+                } else {
+                        _saveCertificates(C);
+                }
+        }
+#ifdef HAVE_ALPN
+        if (C->protocol) {
+                const unsigned char *selected = NULL;
+                unsigned int length = 0;
+                SSL_get0_alpn_selected(C->handler, &selected, &length);
+                if (length != strlen(C->protocol) || memcmp(selected, C->protocol, length) != 0)
+                        THROW(IOException, "SSL: the server did not negotiate the application protocol %s", C->protocol);
+        }
+#endif
 }
 
 
@@ -628,6 +985,12 @@ int Ssl_read(T C, void *b, int size, int timeout) {
 }
 
 
+int Ssl_pending(T C) {
+        ASSERT(C);
+        return SSL_pending(C->handler);
+}
+
+
 void Ssl_setVerifyCertificates(T C, boolean_t verify) {
         ASSERT(C);
         C->verify = verify;
@@ -646,6 +1009,14 @@ void Ssl_setCertificateMinimumValidDays(T C, int days) {
 }
 
 
+void Ssl_setApplicationProtocol(T C, const char *protocol) {
+        ASSERT(C);
+        ASSERT(! protocol || strlen(protocol) < 256);
+        FREE(C->protocol);
+        C->protocol = protocol ? Str_dup(protocol) : NULL;
+}
+
+
 void Ssl_setCertificateChecksum(T C, short type, const char *checksum) {
         ASSERT(C);
         if (checksum) {
@@ -681,9 +1052,111 @@ char *Ssl_printOptions(SslOptions_T *options, char *b, int size) {
 }
 
 
+void Ssl_printCertificates(StringBuffer_T B) {
+        ASSERT(B);
+        char buf[STRLEN];
+        StringBuffer_append(B, "[");
+        LOCK(contextMutex)
+        {
+                time_t now = Time_now();
+                for (SslCertificate_T c = certificates; c; c = c->next) {
+                        StringBuffer_append(B, "%s{\"target\":", c == certificates ? "" : ",");
+                        _printString(B, c->key);
+                        StringBuffer_append(B, ",\"checked\":%lld,\"chain\":[", (long long)c->checked);
+                        for (int i = 0; i < sk_X509_num(c->chain); i++) {
+                                X509 *certificate = sk_X509_value(c->chain, i);
+                                time_t notAfter = _getNotAfter(certificate);
+                                StringBuffer_append(B, "%s{\"subject\":", i ? "," : "");
+                                _printString(B, X509_NAME_oneline(X509_get_subject_name(certificate), buf, sizeof(buf)));
+                                StringBuffer_append(B, ",\"issuer\":");
+                                _printString(B, X509_NAME_oneline(X509_get_issuer_name(certificate), buf, sizeof(buf)));
+                                if (notAfter)
+                                        StringBuffer_append(B, ",\"notafter\":%lld,\"days\":%lld}", (long long)notAfter, (long long)(notAfter - now) / 86400);
+                                else
+                                        StringBuffer_append(B, ",\"notafter\":null,\"days\":null}");
+                        }
+                        StringBuffer_append(B, "]}");
+                }
+        }
+        END_LOCK;
+        StringBuffer_append(B, "]\n");
+}
+
+
 /* -------------------------------------------------------------- SSL Server */
 
 
+/**
+ * Generate the new current ticket key if the current one is older than SSL_TICKET_ROTATE, the current key becomes the
+ * previous one. Must be called with ticketMutex locked.
+ * @return true if the current key is valid
+ */
+static boolean_t _rotateTicketKeys(void) {
+        time_t now = Time_now();
+        if (ticketKeys[0].created && now - ticketKeys[0].created < SSL_TICKET_ROTATE && now >= ticketKeys[0].created)
+                return true;
+        SslTicketKey_T key = {.created = now};
+        if (RAND_bytes(key.name, sizeof(key.name)) != 1 || RAND_bytes(key.aes, sizeof(key.aes)) != 1 || RAND_bytes(key.hmac, sizeof(key.hmac)) != 1) {
+                LogError("SSL: session ticket key generation failed -- %s\n", SSLERROR);
+                return false;
+        }
+        OPENSSL_cleanse(&ticketKeys[1], sizeof(SslTicketKey_T));
+        ticketKeys[1] = ticketKeys[0];
+        ticketKeys[0] = key;
+        OPENSSL_cleanse(&key, sizeof(key));
+        DEBUG("SSL: session ticket key rotated\n");
+        return true;
+}
+
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+typedef EVP_MAC_CTX TicketMac_T;
+static boolean_t _initTicketMac(TicketMac_T *mac, SslTicketKey_T *key) {
+        OSSL_PARAM params[] = {OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, "SHA256", 0), OSSL_PARAM_construct_end()};
+        return EVP_MAC_init(mac, key->hmac, sizeof(key->hmac), params) == 1;
+}
+#else
+typedef HMAC_CTX TicketMac_T;
+static boolean_t _initTicketMac(TicketMac_T *mac, SslTicketKey_T *key) {
+        return HMAC_Init_ex(mac, key->hmac, sizeof(key->hmac), EVP_sha256(), NULL) == 1;
+}
+#endif
+
+
+/**
+ * Session ticket key callback: encrypt the new tickets with the current key, decrypt the tickets with the current or
+ * the previous key. Returns 1 if the ticket was encrypted or decrypted, 2 if it has to be renewed, 0 if the key is
+ * unknown (full handshake) and -1 on error.
+ */
+static int _ticketKey(__attribute__ ((unused)) SSL *handler, unsigned char name[16], unsigned char *iv, EVP_CIPHER_CTX *cipher, TicketMac_T *mac, int encrypt) {
+        int rv = 0;
+        LOCK(ticketMutex)
+        {
+                if (! _rotateTicketKeys()) {
+                        rv = -1;
+                } else if (encrypt) {
+                        SslTicketKey_T *key = &ticketKeys[0];
+                        if (RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) == 1 && EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key->aes, iv) == 1 && _initTicketMac(mac, key)) {
+                                memcpy(name, key->name, sizeof(key->name));
+                                rv = 1;
+                        } else {
+                                rv = -1;
+                        }
+                } else {
+                        for (int i = 0; i < 2; i++) {
+                                SslTicketKey_T *key = &ticketKeys[i];
+                                if (key->created && memcmp(name, key->name, sizeof(key->name)) == 0) {
+                                        rv = _initTicketMac(mac, key) && EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), NULL, key->aes, iv) == 1 ? (i == 0 ? 1 : 2) : -1;
+                                        break;
+                                }
+                        }
+                }
+        }
+        END_LOCK;
+        return rv;
+}
+
+
 SslServer_T SslServer_new(char *pemfile, char *clientpemfile, int socket) {
         ASSERT(pemfile);
         ASSERT(socket >= 0);
@@ -706,17 +1179,26 @@ SslServer_T SslServer_new(char *pemfile, char *clientpemfile, int socket) {
                 LogError("SSL: server session id context initialization failed -- %s\n", SSLERROR);
                 goto sslerror;
         }
-        if (SSL_CTX_set_cipher_list(S->ctx, CIPHER_LIST) != 1) {
-                LogError("SSL: server cipher list [%s] error -- no valid ciphers\n", CIPHER_LIST);
+        if (SSL_CTX_set_cipher_list(S->ctx, SSL_SERVER_CIPHER_LIST) != 1) {
+                LogError("SSL: server cipher list [%s] error -- no valid ciphers\n", SSL_SERVER_CIPHER_LIST);
                 goto sslerror;
         }
+#ifdef TLS1_3_VERSION
+        if (SSL_CTX_set_ciphersuites(S->ctx, SSL_SERVER_CIPHER_SUITES) != 1)
+                LogWarning("SSL: server TLSv1.3 cipher suites [%s] error -- using the defaults\n", SSL_SERVER_CIPHER_SUITES);
+#endif
+        SSL_CTX_set_options(S->ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
 #ifdef SSL_MODE_RELEASE_BUFFERS
         SSL_CTX_set_mode(S->ctx, SSL_MODE_RELEASE_BUFFERS);
 #endif
 #ifdef SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION
         SSL_CTX_set_options(S->ctx, SSL_OP_NO_SESSION_RESUMPTION_ON_RENEGOTIATION);
 #endif
-#ifdef SSL_CTRL_SET_ECDH_AUTO
+#ifdef SSL_CTRL_SET_GROUPS_LIST
+        SSL_CTX_set_options(S->ctx, SSL_OP_SINGLE_ECDH_USE);
+        if (SSL_CTX_set1_groups_list(S->ctx, SSL_SERVER_GROUPS) != 1)
+                DEBUG("SSL: server key exchange groups [%s] not available -- using the defaults\n", SSL_SERVER_GROUPS);
+#elif defined SSL_CTRL_SET_ECDH_AUTO
         SSL_CTX_set_options(S->ctx, SSL_OP_SINGLE_ECDH_USE);
         SSL_CTX_set_ecdh_auto(S->ctx, 1);
 #elif defined HAVE_EC_KEY
@@ -731,7 +1213,15 @@ SslServer_T SslServer_new(char *pemfile, char *clientpemfile, int socket) {
 #ifdef SSL_OP_NO_COMPRESSION
         SSL_CTX_set_options(S->ctx, SSL_OP_NO_COMPRESSION);
 #endif
-        SSL_CTX_set_session_cache_mode(S->ctx, SSL_SESS_CACHE_OFF);
+        // The clients which reconnect often (such as the scrapers, the HTTP server closes the connection after each request) resume the session instead of the full handshake
+        SSL_CTX_set_session_cache_mode(S->ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(S->ctx, SSL_SERVER_SESSIONS);
+        SSL_CTX_set_timeout(S->ctx, SSL_SERVER_SESSION_TIMEOUT);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        SSL_CTX_set_tlsext_ticket_key_evp_cb(S->ctx, _ticketKey);
+#else
+        SSL_CTX_set_tlsext_ticket_key_cb(S->ctx, _ticketKey);
+#endif
         if (SSL_CTX_use_certificate_chain_file(S->ctx, pemfile) != 1) {
                 LogError("SSL: server certificate chain loading failed -- %s\n", SSLERROR);
                 goto sslerror;
@@ -835,14 +1325,26 @@ boolean_t SslServer_accept(T C, int socket, int timeout) {
                                                 LogError("SSL client certificate verification error: %s\n", *C->error ? C->error : X509_verify_cert_error_string(rv));
                                         else
                                                 LogError("SSL accept error: %s\n", SSLERROR);
+                                        __atomic_add_fetch(&handshakes.failed, 1, __ATOMIC_RELAXED);
                                         return false;
                         }
                 } else {
                         break;
                 }
         } while (retry);
+        if (SSL_session_reused(C->handler))
+                __atomic_add_fetch(&handshakes.resumed, 1, __ATOMIC_RELAXED);
+        else
+                __atomic_add_fetch(&handshakes.full, 1, __ATOMIC_RELAXED);
         return true;
 }
 
+
+void SslServer_statistics(unsigned long long *full, unsigned long long *resumed, unsigned long long *failed) {
+        *full = __atomic_load_n(&handshakes.full, __ATOMIC_RELAXED);
+        *resumed = __atomic_load_n(&handshakes.resumed, __ATOMIC_RELAXED);
+        *failed = __atomic_load_n(&handshakes.failed, __ATOMIC_RELAXED);
+}
+
 #endif
 
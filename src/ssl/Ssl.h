@@ -28,6 +28,9 @@
 
 #include "config.h"
 
+// libmonit
+#include "util/StringBuffer.h"
+
 
 typedef enum {
         SSL_Disabled = 0,
@@ -57,6 +60,7 @@ typedef struct SslOptions_T {
         char *clientpemfile;                      /**< Optional client certificate */
         char *CACertificateFile;             /**< Path to CA certificates PEM file */
         char *CACertificatePath;            /**< Path to CA certificates directory */
+        const char *protocol;      /**< Application protocol to negotiate (ALPN) */
 } SslOptions_T;
 
 
@@ -82,6 +86,13 @@ void Ssl_start();
 void Ssl_stop();
 
 
+/**
+ * Drop the cached client contexts and sessions, so the next connections
+ * read the certificate files again. Open connections are not affected.
+ */
+void Ssl_reset();
+
+
 /**
  * Cleanup thread's error queue.
  */
@@ -115,7 +126,8 @@ void Ssl_free(T *C);
 
 /**
  * Connect a socket using SSL. If name is set and TLS is used,
- * the Server Name Indication (SNI) TLS extension is enabled.
+ * the Server Name Indication (SNI) TLS extension is enabled. If an
+ * application protocol is set, it's negotiated with ALPN.
  * @param C An SSL connection object
  * @param socket A socket
  * @param timeout Milliseconds to wait for connection to be established
@@ -154,6 +166,15 @@ int Ssl_write(T C, void *b, int size, int timeout);
 int Ssl_read(T C, void *b, int size, int timeout);
 
 
+/**
+ * Get the number of decrypted bytes which can be read without waiting
+ * for the socket
+ * @param C An SSL connection object
+ * @return Number of bytes buffered in the SSL connection
+ */
+int Ssl_pending(T C);
+
+
 /**
  * Set whether SSL server certificates should be verified.
  * @param C An SSL connection object
@@ -187,6 +208,15 @@ void Ssl_setCertificateMinimumValidDays(T C, int days);
 void Ssl_setCertificateChecksum(T C, short type, const char *checksum);
 
 
+/**
+ * Set the application protocol to negotiate with the TLS ALPN extension,
+ * for example "h2". Ssl_connect() fails if the server doesn't select it.
+ * @param C An SSL connection object
+ * @param protocol The protocol name or NULL to skip ALPN
+ */
+void Ssl_setApplicationProtocol(T C, const char *protocol);
+
+
 /**
  * Print SSL options string representation to the given buffer.
  * @param options SSL options object
@@ -197,6 +227,15 @@ void Ssl_setCertificateChecksum(T C, short type, const char *checksum);
 char *Ssl_printOptions(SslOptions_T *options, char *b, int size);
 
 
+/**
+ * Print the certificate inventory as JSON: the certificate chain of the
+ * last full handshake with each server (SNI name and address), with the
+ * subject, issuer and the end of validity of each certificate
+ * @param B Output buffer
+ */
+void Ssl_printCertificates(StringBuffer_T B);
+
+
 #undef T
 #endif
 
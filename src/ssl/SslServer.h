@@ -76,6 +76,15 @@ void SslServer_freeConnection(T S, Ssl_T *C);
 boolean_t SslServer_accept(Ssl_T C, int socket, int timeout);
 
 
+/**
+ * Get the number of the SSL handshakes of the server connections since start
+ * @param full Output: the number of full handshakes
+ * @param resumed Output: the number of handshakes which resumed a session
+ * @param failed Output: the number of failed handshakes
+ */
+void SslServer_statistics(unsigned long long *full, unsigned long long *resumed, unsigned long long *failed);
+
+
 #undef T
 #endif
 
@@ -0,0 +1,304 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h>
+#endif
+
+#ifdef HAVE_LINUX_IO_URING_H
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+
+#include "monit.h"
+#include "statbatch.h"
+#include "ioprobe.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#if defined HAVE_LINUX_IO_URING_H && defined __NR_io_uring_setup && defined STATX_BASIC_STATS
+
+
+/* Number of submission queue entries, larger batches are submitted in chunks */
+#define STATBATCH_ENTRIES 256
+
+
+/* Don't use the batch for small configurations, the ring setup doesn't pay off */
+#define STATBATCH_MINIMUM 8
+
+
+static struct {
+        int fd;
+        boolean_t disabled;
+        unsigned *sqHead;
+        unsigned *sqTail;
+        unsigned *sqMask;
+        unsigned *sqArray;
+        unsigned *cqHead;
+        unsigned *cqTail;
+        unsigned *cqMask;
+        struct io_uring_sqe *sqes;
+        struct io_uring_cqe *cqes;
+        void *sqRing;
+        void *cqRing;
+        size_t sqRingSize;
+        size_t cqRingSize;
+        size_t sqesSize;
+        Service_T services[STATBATCH_ENTRIES];
+        struct statx results[STATBATCH_ENTRIES];   /**< Not on the stack, the kernel writes here */
+} ring = {.fd = -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static boolean_t _setup() {
+        struct io_uring_params params = {};
+        if ((ring.fd = (int)syscall(__NR_io_uring_setup, STATBATCH_ENTRIES, &params)) < 0) {
+                DEBUG("Batched stat disabled -- io_uring is not available: %s\n", STRERROR);
+                return false;
+        }
+        fcntl(ring.fd, F_SETFD, FD_CLOEXEC);
+        ring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        ring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        ring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+                ring.sqRingSize = ring.cqRingSize = MAX(ring.sqRingSize, ring.cqRingSize);
+        if ((ring.sqRing = mmap(NULL, ring.sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING)) == MAP_FAILED)
+                goto error;
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+                ring.cqRing = ring.sqRing;
+        else if ((ring.cqRing = mmap(NULL, ring.cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING)) == MAP_FAILED)
+                goto error;
+        if ((ring.sqes = mmap(NULL, ring.sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES)) == MAP_FAILED)
+                goto error;
+        ring.sqHead = (unsigned *)((char *)ring.sqRing + params.sq_off.head);
+        ring.sqTail = (unsigned *)((char *)ring.sqRing + params.sq_off.tail);
+        ring.sqMask = (unsigned *)((char *)ring.sqRing + params.sq_off.ring_mask);
+        ring.sqArray = (unsigned *)((char *)ring.sqRing + params.sq_off.array);
+        ring.cqHead = (unsigned *)((char *)ring.cqRing + params.cq_off.head);
+        ring.cqTail = (unsigned *)((char *)ring.cqRing + params.cq_off.tail);
+        ring.cqMask = (unsigned *)((char *)ring.cqRing + params.cq_off.ring_mask);
+        ring.cqes = (struct io_uring_cqe *)((char *)ring.cqRing + params.cq_off.cqes);
+        DEBUG("Batched stat using io_uring enabled\n");
+        return true;
+error:
+        DEBUG("Batched stat disabled -- cannot map the io_uring queues: %s\n", STRERROR);
+        StatBatch_stop();
+        return false;
+}
+
+
+static void _toStat(struct statx *x, struct stat *st) {
+        memset(st, 0, sizeof(*st));
+        st->st_dev = makedev(x->stx_dev_major, x->stx_dev_minor);
+        st->st_ino = x->stx_ino;
+        st->st_mode = x->stx_mode;
+        st->st_nlink = x->stx_nlink;
+        st->st_uid = x->stx_uid;
+        st->st_gid = x->stx_gid;
+        st->st_rdev = makedev(x->stx_rdev_major, x->stx_rdev_minor);
+        st->st_size = x->stx_size;
+        st->st_blksize = x->stx_blksize;
+        st->st_blocks = x->stx_blocks;
+        st->st_atim.tv_sec = x->stx_atime.tv_sec;
+        st->st_atim.tv_nsec = x->stx_atime.tv_nsec;
+        st->st_mtim.tv_sec = x->stx_mtime.tv_sec;
+        st->st_mtim.tv_nsec = x->stx_mtime.tv_nsec;
+        st->st_ctim.tv_sec = x->stx_ctime.tv_sec;
+        st->st_ctim.tv_nsec = x->stx_ctime.tv_nsec;
+}
+
+
+/* Submit the statx operations of the services and wait for their completion */
+static boolean_t _submit(int count) {
+        unsigned tail = *ring.sqTail, mask = *ring.sqMask;
+        for (int i = 0; i < count; i++, tail++) {
+                unsigned index = tail & mask;
+                struct io_uring_sqe *sqe = &ring.sqes[index];
+                memset(sqe, 0, sizeof(*sqe));
+                sqe->opcode = IORING_OP_STATX;
+                sqe->fd = AT_FDCWD;
+                sqe->addr = (unsigned long long)(uintptr_t)ring.services[i]->path;
+                sqe->len = STATX_BASIC_STATS;
+                sqe->off = (unsigned long long)(uintptr_t)&ring.results[i];
+                sqe->user_data = i;
+                ring.sqArray[index] = index;
+        }
+        __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+        int submitted = 0, completed = 0;
+        while (completed < count) {
+                long rv = syscall(__NR_io_uring_enter, ring.fd, count - submitted, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+                if (rv < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("Batched stat failed -- %s\n", STRERROR);
+                        return false;
+                }
+                submitted += rv;
+                unsigned head = *ring.cqHead;
+                while (head != __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE)) {
+                        struct io_uring_cqe *cqe = &ring.cqes[head & *ring.cqMask];
+                        Service_T s = ring.services[cqe->user_data];
+                        if (cqe->res < 0) {
+                                s->prefetch.error = -cqe->res;
+                        } else {
+                                s->prefetch.error = 0;
+                                _toStat(&ring.results[cqe->user_data], &s->prefetch.st);
+                        }
+                        s->prefetch.valid = true;
+                        head++;
+                        completed++;
+                }
+                __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+        }
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void StatBatch_run() {
+        if (! (Run.flags & Run_StatBatch) || ring.disabled)
+                return;
+        // The spread checks run during the whole cycle, the prefetched data would be stale
+        if (Run.flags & Run_PacingSpread)
+                return;
+        // The batch waits for all completions without a timeout, the bounded probes are used instead
+        if (Run.ioProbe.timeout)
+                return;
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                s->prefetch.valid = false;
+                if (s->monitor != Monitor_Not && ! s->fileset && (s->type == Service_File || s->type == Service_Directory || s->type == Service_Fifo))
+                        count++;
+        }
+        if (count < STATBATCH_MINIMUM)
+                return;
+        if (ring.fd == -1 && ! _setup()) {
+                ring.disabled = true;
+                return;
+        }
+        int n = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                if (s->monitor != Monitor_Not && ! s->fileset && (s->type == Service_File || s->type == Service_Directory || s->type == Service_Fifo)) {
+                        ring.services[n++] = s;
+                        if (n == STATBATCH_ENTRIES) {
+                                if (! _submit(n))
+                                        goto error;
+                                n = 0;
+                        }
+                }
+        }
+        if (n && ! _submit(n))
+                goto error;
+        return;
+error:
+        // Operations may be in flight, don't reuse the ring or the result buffer
+        ring.disabled = true;
+}
+
+
+void StatBatch_stop() {
+        if (ring.sqes && ring.sqes != MAP_FAILED)
+                munmap(ring.sqes, ring.sqesSize);
+        if (ring.cqRing && ring.cqRing != MAP_FAILED && ring.cqRing != ring.sqRing)
+                munmap(ring.cqRing, ring.cqRingSize);
+        if (ring.sqRing && ring.sqRing != MAP_FAILED)
+                munmap(ring.sqRing, ring.sqRingSize);
+        if (ring.fd != -1)
+                close(ring.fd);
+        ring.sqes = NULL;
+        ring.cqRing = ring.sqRing = NULL;
+        ring.fd = -1;
+}
+
+
+#else
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void StatBatch_run() {
+}
+
+
+void StatBatch_stop() {
+}
+
+
+#endif
+
+
+int StatBatch_stat(Service_T s, struct stat *st) {
+        ASSERT(s);
+        ASSERT(st);
+        if (s->prefetch.valid) {
+                s->prefetch.valid = false;
+                if (s->prefetch.error) {
+                        errno = s->prefetch.error;
+                        return -1;
+                }
+                *st = s->prefetch.st;
+                return 0;
+        }
+        return IoProbe_stat(s->path, st);
+}
+
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_STATBATCH_H
+#define MONIT_STATBATCH_H
+
+
+/**
+ * Batched stat of the file, directory and fifo services. If enabled with
+ * "set stat batch" on Linux with io_uring, the paths of all monitored
+ * services are stat'ed with one submission at the beginning of the cycle,
+ * instead of one stat(2) call per service. The kernel runs the lookups
+ * in parallel, which helps if they block, such as on network filesystems
+ * or with a cold inode cache. The checks consume the prefetched result. On other systems,
+ * or if io_uring is not available, StatBatch_run() does nothing and
+ * StatBatch_stat() falls back to stat(2).
+ *
+ * @file
+ */
+
+
+/**
+ * Stat the paths of the monitored file, directory and fifo services in
+ * one batch. The results are valid until they are consumed by
+ * StatBatch_stat() or until the next batch.
+ */
+void StatBatch_run(void);
+
+
+/**
+ * Release the io_uring instance
+ */
+void StatBatch_stop(void);
+
+
+/**
+ * Get the stat data of the service path. The prefetched result is used
+ * and consumed if available, otherwise stat(2) is called.
+ * @param s A file, directory or fifo service
+ * @param st The stat buffer
+ * @return 0 on success, otherwise -1 and errno is set
+ */
+int StatBatch_stat(Service_T s, struct stat *st);
+
+
+#endif
+
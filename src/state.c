@@ -52,8 +52,11 @@
 
 #include "monit.h"
 #include "state.h"
+#include "probes.h"
 
 // libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
 #include "exceptions/IOException.h"
 
 
@@ -84,9 +87,21 @@
  *    5.) size, checksum, timestamp, permissions, link speed, filesystem flags
  *        for the change observation test
  *
+ *    6.) inode, size, modification and change time of the file when its
+ *        checksum was computed
+ *        Allows to skip the checksum computation after Monit restart if the
+ *        checksum cache is enabled and the file didn't change.
+ *
  * Data is stored in binary form in the statefile using the following format:
  *    <MAGIC><VERSION>{<SERVICE_STATE>}+
  *
+ * Each service state has a fixed size slot, so State_save() keeps a copy of
+ * the last written states and rewrites in place only the slots of services
+ * which changed since the previous save. If the service list layout changed
+ * (Monit reload, first save), the whole file is written to a temporary file
+ * which then atomically replaces the state file. The fsync policy is set by
+ * "set statefile sync".
+ *
  * When the persistent field needs to be added, update the State_Version along
  * with State_restore() and State_save(). The version allows to recognize the
  * service state structure and file format.
@@ -106,10 +121,57 @@ typedef enum {
         StateVersion0 = 0,
         StateVersion1,
         StateVersion2,
-        StateVersion3
+        StateVersion3,
+        StateVersion4
 } State_Version;
 
 
+/* Extended format version 4 */
+typedef struct mystate4 {
+        char               name[STRLEN];
+        int                type;
+        int                monitor;
+        int                nstart;
+        int                ncycle;
+        union {
+                struct {
+                        time_t timestamp;
+                        int mode;
+                } directory;
+
+                struct {
+                        unsigned long long inode;
+                        unsigned long long readpos;
+                        unsigned long long size;
+                        unsigned long long timestamp;
+                        int mode;
+                        MD_T hash;
+                        struct {
+                                unsigned long long inode;
+                                unsigned long long size;
+                                unsigned long long mtime;
+                                unsigned long long ctime;
+                        } checksum;
+                } file;
+
+                struct {
+                        unsigned long long timestamp;
+                        int mode;
+                } fifo;
+
+                struct {
+                        int mode;
+                        int flags;
+                } filesystem;
+
+                struct {
+                        int duplex;
+                        long long speed;
+                } net;
+        } priv;
+} State4_T;
+
+
 /* Extended format version 3 */
 typedef struct mystate3 {
         char               name[STRLEN];
@@ -184,6 +246,18 @@ typedef struct mystate0 {
 
 static int file = -1;
 static uint64_t booted = 0ULL;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+        int count;              // Number of service slots in the state file, 0 = rewrite the file
+        int size;               // Allocated slots
+        State4_T *states;       // Last written service states
+        boolean_t dirty;        // Written data which wasn't synced yet
+        time_t synced;          // Last fsync timestamp
+} cache = {};
+
+
+/* Offset of the first service slot: <MAGIC><VERSION><BOOTED> */
+#define STATE_HEADER (2 * sizeof(int) + sizeof(uint64_t))
 
 
 /* ----------------------------------------------------------------- Private */
@@ -247,7 +321,22 @@ static void _updateSize(Service_T S, unsigned long long size) {
 static void _updateChecksum(Service_T S, char *hash) {
         if (S->checksum && S->checksum->test_changes) {
                 S->checksum->initialized = false;
-                strncpy(S->checksum->hash, hash, sizeof(S->checksum->hash));
+                snprintf(S->checksum->hash, sizeof(S->checksum->hash), "%.*s", (int)sizeof(MD_T) - 1, hash);
+        }
+}
+
+
+static void _updateChecksumCache(Service_T S, char *hash, unsigned long long inode, unsigned long long size, unsigned long long mtime, unsigned long long ctime) {
+        if (S->checksum && inode) {
+                // Restore only the checksum of the same hash type, the configuration may have changed
+                if (strnlen(hash, sizeof(S->inf->priv.file.cs_sum)) == Util_getHashLength(S->checksum->type)) {
+                        snprintf(S->inf->priv.file.cs_sum, sizeof(S->inf->priv.file.cs_sum), "%.*s", (int)sizeof(MD_T) - 1, hash);
+                        S->inf->priv.file.cs_cache.inode = inode;
+                        S->inf->priv.file.cs_cache.size = size;
+                        S->inf->priv.file.cs_cache.mtime = mtime;
+                        S->inf->priv.file.cs_cache.ctime = ctime;
+                        S->inf->priv.file.cs_cache.cycles = 0;
+                }
         }
 }
 
@@ -266,43 +355,140 @@ static void _updateLinkSpeed(Service_T S, int duplex, long long speed) {
 }
 
 
+/**
+ * Read all remaining service states from the state file in one pass
+ * @param size The service state structure size
+ * @param count Output: number of service states read
+ * @return The service states array, the caller must free it
+ */
+static void *_readStates(size_t size, int *count) {
+        off_t offset = lseek(file, 0L, SEEK_CUR);
+        off_t end = lseek(file, 0L, SEEK_END);
+        if (offset == -1 || end == -1 || lseek(file, offset, SEEK_SET) == -1)
+                THROW(IOException, "Unable to seek");
+        *count = (int)((end - offset) / size);
+        char *states = CALLOC(*count + 1, size);
+        ssize_t length = (ssize_t)(*count * size);
+        for (ssize_t n = 0, total = 0; total < length; total += n) {
+                if ((n = read(file, states + total, length - total)) <= 0) {
+                        FREE(states);
+                        THROW(IOException, "Unable to read service state");
+                }
+        }
+        return states;
+}
+
+
+/**
+ * Get the service for the saved state. The states are saved in the service
+ * list order, so unless the configuration changed the service is the one
+ * which follows the previously restored service and no lookup is needed.
+ * @param name The saved service name
+ * @param next Input: expected service, output: next expected service
+ * @return The service or NULL if not found
+ */
+static Service_T _getService(const char *name, Service_T *next) {
+        Service_T s = *next;
+        if (! s || ! IS(s->name, name))
+                s = Util_getService(name);
+        if (s)
+                *next = s->next;
+        return s;
+}
+
+
+static void _restoreV4() {
+        // System header
+        if (read(file, &booted, sizeof(booted)) != sizeof(booted))
+                THROW(IOException, "Unable to read system boot time");
+        // Services state
+        int count;
+        State4_T *states = _readStates(sizeof(State4_T), &count);
+        Service_T next = servicelist;
+        for (int i = 0; i < count; i++) {
+                State4_T *state = &states[i];
+                Service_T service = _getService(state->name, &next);
+                if (service && service->type == state->type) {
+                        _updateStart(service, state->nstart, state->ncycle);
+                        _updateMonitor(service, state->monitor);
+                        switch (service->type) {
+                                case Service_Directory:
+                                        _updatePermission(service, state->priv.directory.mode);
+                                        _updateTimestamp(service, state->priv.directory.timestamp);
+                                        break;
+
+                                case Service_Fifo:
+                                        _updatePermission(service, state->priv.fifo.mode);
+                                        _updateTimestamp(service, state->priv.fifo.timestamp);
+                                        break;
+
+                                case Service_File:
+                                        _updatePermission(service, state->priv.file.mode);
+                                        _updateTimestamp(service, state->priv.file.timestamp);
+                                        _updateFilePosition(service, state->priv.file.inode, state->priv.file.readpos);
+                                        _updateSize(service, state->priv.file.size);
+                                        _updateChecksum(service, state->priv.file.hash);
+                                        _updateChecksumCache(service, state->priv.file.hash, state->priv.file.checksum.inode, state->priv.file.checksum.size, state->priv.file.checksum.mtime, state->priv.file.checksum.ctime);
+                                        break;
+
+                                case Service_Filesystem:
+                                        _updatePermission(service, state->priv.filesystem.mode);
+                                        _updateFilesystemFlags(service, state->priv.filesystem.flags);
+                                        break;
+
+                                case Service_Net:
+                                        _updateLinkSpeed(service, state->priv.net.duplex, state->priv.net.speed);
+                                        break;
+
+                                default:
+                                        break;
+                        }
+                }
+        }
+        FREE(states);
+}
+
+
 static void _restoreV3() {
         // System header
         if (read(file, &booted, sizeof(booted)) != sizeof(booted))
                 THROW(IOException, "Unable to read system boot time");
         // Services state
-        State3_T state;
-        while (read(file, &state, sizeof(state)) == sizeof(state)) {
-                Service_T service = Util_getService(state.name);
-                if (service && service->type == state.type) {
-                        _updateStart(service, state.nstart, state.ncycle);
-                        _updateMonitor(service, state.monitor);
+        int count;
+        State3_T *states = _readStates(sizeof(State3_T), &count);
+        Service_T next = servicelist;
+        for (int i = 0; i < count; i++) {
+                State3_T *state = &states[i];
+                Service_T service = _getService(state->name, &next);
+                if (service && service->type == state->type) {
+                        _updateStart(service, state->nstart, state->ncycle);
+                        _updateMonitor(service, state->monitor);
                         switch (service->type) {
                                 case Service_Directory:
-                                        _updatePermission(service, state.priv.directory.mode);
-                                        _updateTimestamp(service, state.priv.directory.timestamp);
+                                        _updatePermission(service, state->priv.directory.mode);
+                                        _updateTimestamp(service, state->priv.directory.timestamp);
                                         break;
 
                                 case Service_Fifo:
-                                        _updatePermission(service, state.priv.fifo.mode);
-                                        _updateTimestamp(service, state.priv.fifo.timestamp);
+                                        _updatePermission(service, state->priv.fifo.mode);
+                                        _updateTimestamp(service, state->priv.fifo.timestamp);
                                         break;
 
                                 case Service_File:
-                                        _updatePermission(service, state.priv.file.mode);
-                                        _updateTimestamp(service, state.priv.file.timestamp);
-                                        _updateFilePosition(service, state.priv.file.inode, state.priv.file.readpos);
-                                        _updateSize(service, state.priv.file.size);
-                                        _updateChecksum(service, state.priv.file.hash);
+                                        _updatePermission(service, state->priv.file.mode);
+                                        _updateTimestamp(service, state->priv.file.timestamp);
+                                        _updateFilePosition(service, state->priv.file.inode, state->priv.file.readpos);
+                                        _updateSize(service, state->priv.file.size);
+                                        _updateChecksum(service, state->priv.file.hash);
                                         break;
 
                                 case Service_Filesystem:
-                                        _updatePermission(service, state.priv.filesystem.mode);
-                                        _updateFilesystemFlags(service, state.priv.filesystem.flags);
+                                        _updatePermission(service, state->priv.filesystem.mode);
+                                        _updateFilesystemFlags(service, state->priv.filesystem.flags);
                                         break;
 
                                 case Service_Net:
-                                        _updateLinkSpeed(service, state.priv.net.duplex, state.priv.net.speed);
+                                        _updateLinkSpeed(service, state->priv.net.duplex, state->priv.net.speed);
                                         break;
 
                                 default:
@@ -310,6 +496,7 @@ static void _restoreV3() {
                         }
                 }
         }
+        FREE(states);
 }
 
 
@@ -317,38 +504,41 @@ static void _restoreV2() {
         // System header
         booted = systeminfo.booted; // No boot time available => for backward compatibility, act as if the system was not rebooted, as we don't know if monit was only restarted or machine rebooted
         // Services state
-        State2_T state;
-        while (read(file, &state, sizeof(state)) == sizeof(state)) {
-                Service_T service = Util_getService(state.name);
-                if (service && service->type == state.type) {
-                        _updateStart(service, state.nstart, state.ncycle);
-                        _updateMonitor(service, state.monitor);
+        int count;
+        State2_T *states = _readStates(sizeof(State2_T), &count);
+        Service_T next = servicelist;
+        for (int i = 0; i < count; i++) {
+                State2_T *state = &states[i];
+                Service_T service = _getService(state->name, &next);
+                if (service && service->type == state->type) {
+                        _updateStart(service, state->nstart, state->ncycle);
+                        _updateMonitor(service, state->monitor);
                         switch (service->type) {
                                 case Service_Directory:
-                                        _updatePermission(service, state.priv.directory.mode);
-                                        _updateTimestamp(service, state.priv.directory.timestamp);
+                                        _updatePermission(service, state->priv.directory.mode);
+                                        _updateTimestamp(service, state->priv.directory.timestamp);
                                         break;
 
                                 case Service_Fifo:
-                                        _updatePermission(service, state.priv.fifo.mode);
-                                        _updateTimestamp(service, state.priv.fifo.timestamp);
+                                        _updatePermission(service, state->priv.fifo.mode);
+                                        _updateTimestamp(service, state->priv.fifo.timestamp);
                                         break;
 
                                 case Service_File:
-                                        _updatePermission(service, state.priv.file.mode);
-                                        _updateTimestamp(service, state.priv.file.timestamp);
-                                        _updateFilePosition(service, state.priv.file.inode, state.priv.file.readpos);
-                                        _updateSize(service, state.priv.file.size);
-                                        _updateChecksum(service, state.priv.file.hash);
+                                        _updatePermission(service, state->priv.file.mode);
+                                        _updateTimestamp(service, state->priv.file.timestamp);
+                                        _updateFilePosition(service, state->priv.file.inode, state->priv.file.readpos);
+                                        _updateSize(service, state->priv.file.size);
+                                        _updateChecksum(service, state->priv.file.hash);
                                         break;
 
                                 case Service_Filesystem:
-                                        _updatePermission(service, state.priv.filesystem.mode);
-                                        _updateFilesystemFlags(service, state.priv.filesystem.flags);
+                                        _updatePermission(service, state->priv.filesystem.mode);
+                                        _updateFilesystemFlags(service, state->priv.filesystem.flags);
                                         break;
 
                                 case Service_Net:
-                                        _updateLinkSpeed(service, state.priv.net.duplex, state.priv.net.speed);
+                                        _updateLinkSpeed(service, state->priv.net.duplex, state->priv.net.speed);
                                         break;
 
                                 default:
@@ -356,6 +546,7 @@ static void _restoreV2() {
                         }
                 }
         }
+        FREE(states);
 }
 
 
@@ -363,16 +554,20 @@ static void _restoreV1() {
         // System header
         booted = systeminfo.booted; // No boot time available => for backward compatibility, act as if the system was not rebooted, as we don't know if monit was only restarted or machine rebooted
         // Services state
-        State1_T state;
-        while (read(file, &state, sizeof(state)) == sizeof(state)) {
-                Service_T service = Util_getService(state.name);
-                if (service && service->type == state.type) {
-                        _updateStart(service, state.nstart, state.ncycle);
-                        _updateMonitor(service, state.monitor);
+        int count;
+        State1_T *states = _readStates(sizeof(State1_T), &count);
+        Service_T next = servicelist;
+        for (int i = 0; i < count; i++) {
+                State1_T *state = &states[i];
+                Service_T service = _getService(state->name, &next);
+                if (service && service->type == state->type) {
+                        _updateStart(service, state->nstart, state->ncycle);
+                        _updateMonitor(service, state->monitor);
                         if (service->type == Service_File)
-                                _updateFilePosition(service, state.priv.file.inode, state.priv.file.readpos);
+                                _updateFilePosition(service, state->priv.file.inode, state->priv.file.readpos);
                 }
         }
+        FREE(states);
 }
 
 
@@ -393,11 +588,117 @@ static void _restoreV0(int services) {
 }
 
 
+static void _getState(Service_T S, State4_T *state) {
+        memset(state, 0, sizeof(State4_T));
+        snprintf(state->name, sizeof(state->name), "%s", S->name);
+        state->type = S->type;
+        state->monitor = S->monitor & ~Monitor_Waiting;
+        state->nstart = S->nstart;
+        state->ncycle = S->ncycle;
+        switch (S->type) {
+                case Service_Directory:
+                        state->priv.directory.timestamp = (unsigned long long)S->inf->priv.directory.timestamp;
+                        if (S->perm)
+                                state->priv.directory.mode = S->perm->perm;
+                        break;
+
+                case Service_Fifo:
+                        state->priv.fifo.timestamp = (unsigned long long)S->inf->priv.fifo.timestamp;
+                        if (S->perm)
+                                state->priv.fifo.mode = S->perm->perm;
+                        break;
+
+                case Service_File:
+                        state->priv.file.inode = S->inf->priv.file.inode;
+                        state->priv.file.readpos = S->inf->priv.file.readpos;
+                        state->priv.file.size = (unsigned long long)S->inf->priv.file.size;
+                        state->priv.file.timestamp = (unsigned long long)S->inf->priv.file.timestamp;
+                        if (S->checksum) {
+                                strncpy(state->priv.file.hash, S->inf->priv.file.cs_sum, sizeof(state->priv.file.hash));
+                                state->priv.file.checksum.inode = S->inf->priv.file.cs_cache.inode;
+                                state->priv.file.checksum.size = S->inf->priv.file.cs_cache.size;
+                                state->priv.file.checksum.mtime = S->inf->priv.file.cs_cache.mtime;
+                                state->priv.file.checksum.ctime = S->inf->priv.file.cs_cache.ctime;
+                        }
+                        if (S->perm)
+                                state->priv.file.mode = S->perm->perm;
+                        break;
+
+                case Service_Filesystem:
+                        if (S->perm)
+                                state->priv.filesystem.mode = S->perm->perm;
+                        state->priv.filesystem.flags = S->inf->priv.filesystem.flags;
+                        break;
+
+                case Service_Net:
+                        if (S->linkspeedlist) {
+                                state->priv.net.duplex = S->linkspeedlist->duplex;
+                                state->priv.net.speed = S->linkspeedlist->speed;
+                        }
+                        break;
+
+                default:
+                        break;
+        }
+}
+
+
+static void _sync() {
+        if (fsync(file))
+                THROW(IOException, "Unable to sync -- %s", STRERROR);
+        cache.dirty = false;
+        cache.synced = Time_now();
+}
+
+
+static void _rewrite() {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s.tmp", Run.files.state);
+        int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd == -1)
+                THROW(IOException, "Unable to create %s -- %s", path, STRERROR);
+        TRY
+        {
+                int magic = 0;
+                if (write(fd, &magic, sizeof(magic)) != sizeof(magic))
+                        THROW(IOException, "Unable to write magic");
+                // Save always using the latest format version
+                int version = StateVersion4;
+                if (write(fd, &version, sizeof(version)) != sizeof(version))
+                        THROW(IOException, "Unable to write format version");
+                if (write(fd, &systeminfo.booted, sizeof(systeminfo.booted)) != sizeof(systeminfo.booted))
+                        THROW(IOException, "Unable to write system boot time");
+                ssize_t size = cache.count * sizeof(State4_T);
+                if (size && write(fd, cache.states, size) != size)
+                        THROW(IOException, "Unable to write service state");
+                // The new file must be on disk before it replaces the old one, otherwise a crash may leave an empty state file
+                if (fsync(fd))
+                        THROW(IOException, "Unable to sync -- %s", STRERROR);
+                if (rename(path, Run.files.state))
+                        THROW(IOException, "Unable to rename %s -- %s", path, STRERROR);
+        }
+        ELSE
+        {
+                close(fd);
+                unlink(path);
+                cache.count = 0;
+                RETHROW;
+        }
+        END_TRY;
+        close(file);
+        file = fd;
+        cache.dirty = false;
+        cache.synced = Time_now();
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
 boolean_t State_open() {
         State_close();
+        // The first save after open rewrites the whole file
+        cache.count = 0;
         if ((file = open(Run.files.state, O_RDWR | O_CREAT, 0600)) == -1) {
                 LogError("State file '%s': cannot open for write -- %s\n", Run.files.state, STRERROR);
                 return false;
@@ -409,6 +710,9 @@ boolean_t State_open() {
 
 void State_close() {
         if (file != -1) {
+                if (cache.dirty && fsync(file))
+                        LogError("State file '%s': sync error -- %s\n", Run.files.state, STRERROR);
+                cache.dirty = false;
                 if (close(file) == -1)
                         LogError("State file '%s': close error -- %s\n", Run.files.state, STRERROR);
                 else
@@ -418,80 +722,51 @@ void State_close() {
 
 
 void State_save() {
-        TRY
+        PROBE0(state_save_start);
+        LOCK(mutex)
         {
-                if (ftruncate(file, 0L) == -1)
-                        THROW(IOException, "Unable to truncate");
-                if (lseek(file, 0L, SEEK_SET) == -1)
-                        THROW(IOException, "Unable to seek");
-                int magic = 0;
-                if (write(file, &magic, sizeof(magic)) != sizeof(magic))
-                        THROW(IOException, "Unable to write magic");
-                // Save always using the latest format version
-                int version = StateVersion3;
-                if (write(file, &version, sizeof(version)) != sizeof(version))
-                        THROW(IOException, "Unable to write format version");
-                if (write(file, &systeminfo.booted, sizeof(systeminfo.booted)) != sizeof(systeminfo.booted))
-                        THROW(IOException, "Unable to write system boot time");
-                for (Service_T service = servicelist; service; service = service->next) {
-                        State3_T state;
-                        memset(&state, 0, sizeof(state));
-                        snprintf(state.name, sizeof(state.name), "%s", service->name);
-                        state.type = service->type;
-                        state.monitor = service->monitor & ~Monitor_Waiting;
-                        state.nstart = service->nstart;
-                        state.ncycle = service->ncycle;
-                        switch (service->type) {
-                                case Service_Directory:
-                                        state.priv.directory.timestamp = (unsigned long long)service->inf->priv.directory.timestamp;
-                                        if (service->perm)
-                                                state.priv.directory.mode = service->perm->perm;
-                                        break;
-
-                                case Service_Fifo:
-                                        state.priv.fifo.timestamp = (unsigned long long)service->inf->priv.fifo.timestamp;
-                                        if (service->perm)
-                                                state.priv.fifo.mode = service->perm->perm;
-                                        break;
-
-                                case Service_File:
-                                        state.priv.file.inode = service->inf->priv.file.inode;
-                                        state.priv.file.readpos = service->inf->priv.file.readpos;
-                                        state.priv.file.size = (unsigned long long)service->inf->priv.file.size;
-                                        state.priv.file.timestamp = (unsigned long long)service->inf->priv.file.timestamp;
-                                        if (service->checksum)
-                                                strncpy(state.priv.file.hash, service->inf->priv.file.cs_sum, sizeof(state.priv.file.hash));
-                                        if (service->perm)
-                                                state.priv.file.mode = service->perm->perm;
-                                        break;
-
-                                case Service_Filesystem:
-                                        if (service->perm)
-                                                state.priv.filesystem.mode = service->perm->perm;
-                                        state.priv.filesystem.flags = service->inf->priv.filesystem.flags;
-                                        break;
-
-                                case Service_Net:
-                                        if (service->linkspeedlist) {
-                                                state.priv.net.duplex = service->linkspeedlist->duplex;
-                                                state.priv.net.speed = service->linkspeedlist->speed;
+                TRY
+                {
+                        int count = 0;
+                        for (Service_T service = servicelist; service; service = service->next)
+                                count++;
+                        boolean_t rewrite = cache.count != count;
+                        if (count > cache.size) {
+                                RESIZE(cache.states, count * sizeof(State4_T));
+                                cache.size = count;
+                        }
+                        cache.count = count;
+                        int slot = 0;
+                        for (Service_T service = servicelist; service; service = service->next, slot++) {
+                                State4_T state;
+                                _getState(service, &state);
+                                if (rewrite || memcmp(&state, &cache.states[slot], sizeof(state))) {
+                                        // The service in this slot was replaced => the layout changed
+                                        if (! IS(state.name, cache.states[slot].name) || state.type != cache.states[slot].type)
+                                                rewrite = true;
+                                        cache.states[slot] = state;
+                                        if (! rewrite) {
+                                                if (pwrite(file, &state, sizeof(state), STATE_HEADER + slot * sizeof(state)) != sizeof(state)) {
+                                                        cache.count = 0;
+                                                        THROW(IOException, "Unable to write service state");
+                                                }
+                                                cache.dirty = true;
                                         }
-                                        break;
-
-                                default:
-                                        break;
+                                }
                         }
-                        if (write(file, &state, sizeof(state)) != sizeof(state))
-                                THROW(IOException, "Unable to write service state");
+                        if (rewrite)
+                                _rewrite();
+                        else if (cache.dirty && (Run.stateEngine.sync == 0 || (Run.stateEngine.sync > 0 && Time_now() - cache.synced >= Run.stateEngine.sync)))
+                                _sync();
                 }
-                if (fsync(file))
-                        THROW(IOException, "Unable to sync -- %s", STRERROR);
-        }
-        ELSE
-        {
-                LogError("State file '%s': %s\n", Run.files.state, Exception_frame.message);
+                ELSE
+                {
+                        LogError("State file '%s': %s\n", Run.files.state, Exception_frame.message);
+                }
+                END_TRY;
         }
-        END_TRY;
+        END_LOCK;
+        PROBE0(state_save_done);
 }
 
 
@@ -524,6 +799,9 @@ void State_restore() {
                                 case StateVersion3:
                                         _restoreV3();
                                         break;
+                                case StateVersion4:
+                                        _restoreV4();
+                                        break;
                                 default:
                                         LogWarning("State file '%s': incompatible version %d\n", Run.files.state, version);
                                         break;
@@ -537,3 +815,13 @@ void State_restore() {
         END_TRY;
 }
 
+
+size_t State_memory(void) {
+        size_t size = 0;
+        LOCK(mutex)
+        {
+                size = cache.size * sizeof(State4_T);
+        }
+        END_LOCK;
+        return size;
+}
@@ -83,4 +83,11 @@ void State_save();
 void State_restore();
 
 
+/**
+ * Get the memory used by the cache of the last written service states
+ * @return The size in bytes
+ */
+size_t State_memory(void);
+
+
 #endif
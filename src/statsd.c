@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#include "monit.h"
+#include "statsd.h"
+
+// libmonit
+#include "system/Time.h"
+#include "thread/Thread.h"
+#include "exceptions/AssertException.h"
+
+
+/**
+ * The listener thread polls the UDP and the unix socket together with a
+ * pipe, Statsd_stop() writes to the pipe to wake it. The datagrams are
+ * read in batches until the sockets are drained.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define STATSD_DATAGRAM 8192
+
+
+static struct {
+        int udp;
+        int local;
+        int wakeup[2];
+        boolean_t running;
+        boolean_t stopped;
+        char *path;
+        Thread_T thread;
+} listener = {.udp = -1, .local = -1, .wakeup = {-1, -1}};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _close(void) {
+        int *fds[] = {&listener.udp, &listener.local, &listener.wakeup[0], &listener.wakeup[1]};
+        for (int i = 0; i < (int)(sizeof(fds) / sizeof(fds[0])); i++) {
+                if (*fds[i] >= 0) {
+                        close(*fds[i]);
+                        *fds[i] = -1;
+                }
+        }
+}
+
+
+static Metric_Type _type(const char *type) {
+        if (IS(type, "c"))
+                return Metric_Counter;
+        if (IS(type, "g"))
+                return Metric_Gauge;
+        if (IS(type, "ms") || IS(type, "h"))
+                return Metric_Timer;
+        return Metric_Unknown;
+}
+
+
+/* The listener thread is the only writer, so it may read the accumulator fields without the atomics */
+static void _add(Metric_T m, Metric_Type type, double value, boolean_t relative) {
+        double v;
+        switch (type) {
+                case Metric_Counter:
+                        v = m->total + value;
+                        __atomic_store(&m->total, &v, __ATOMIC_RELAXED);
+                        break;
+                case Metric_Gauge:
+                        v = relative ? m->last + value : value;
+                        __atomic_store(&m->last, &v, __ATOMIC_RELAXED);
+                        break;
+                case Metric_Timer:
+                        {
+                                v = m->total + value;
+                                __atomic_store(&m->total, &v, __ATOMIC_RELAXED);
+                                __atomic_store(&m->last, &value, __ATOMIC_RELAXED);
+                                // The check resets the maximum, so the update must be atomic
+                                double max;
+                                __atomic_load(&m->max, &max, __ATOMIC_RELAXED);
+                                while (value > max && ! __atomic_compare_exchange(&m->max, &max, &value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                                        ;
+                        }
+                        break;
+                default:
+                        return;
+        }
+        __atomic_store_n(&m->type, type, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&m->samples, 1, __ATOMIC_RELEASE);
+}
+
+
+/* Parse the statsd line "<name>:<value>|<type>[|@<sample rate>][|#<tags>]" */
+static boolean_t _sample(char *line) {
+        char *value = strchr(line, ':');
+        if (! value)
+                return false;
+        *value++ = 0;
+        char *type = strchr(value, '|');
+        if (! type)
+                return false;
+        *type++ = 0;
+        char *options = strchr(type, '|');
+        if (options)
+                *options++ = 0;
+        Metric_Type t = _type(type);
+        if (t == Metric_Unknown)
+                return false;
+        char *end;
+        double v = strtod(value, &end);
+        if (end == value || *end)
+                return false;
+        while (options && *options) {
+                char *next = strchr(options, '|');
+                if (next)
+                        *next++ = 0;
+                if (*options == '@' && t == Metric_Counter) {
+                        double rate = strtod(options + 1, NULL);
+                        if (rate > 0. && rate <= 1.)
+                                v /= rate;
+                }
+                options = next;
+        }
+        Service_T s = Util_getService(line);
+        if (! s || ! s->metric) {
+                DEBUG("Statsd sample of unknown metric '%s' dropped\n", line);
+                return false;
+        }
+        _add(s->metric, t, v, t == Metric_Gauge && (*value == '+' || *value == '-'));
+        return true;
+}
+
+
+static void _read(int socket) {
+        char buf[STATSD_DATAGRAM + 1];
+        ssize_t n;
+        while ((n = recv(socket, buf, STATSD_DATAGRAM, MSG_DONTWAIT)) >= 0) {
+                buf[n] = 0;
+                Statsd_parse(buf);
+        }
+}
+
+
+static void *_listener(void *args) {
+        set_signal_block();
+        while (! __atomic_load_n(&listener.stopped, __ATOMIC_ACQUIRE)) {
+                struct pollfd fds[3] = {{.fd = listener.wakeup[0], .events = POLLIN}, {.fd = listener.udp, .events = POLLIN}, {.fd = listener.local, .events = POLLIN}};
+                if (poll(fds, 3, -1) < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("Statsd socket poll failed -- %s\n", STRERROR);
+                        break;
+                }
+                for (int i = 1; i < 3; i++)
+                        if (fds[i].revents & POLLIN)
+                                _read(fds[i].fd);
+        }
+        return NULL;
+}
+
+
+static int _openUdp(void) {
+        struct addrinfo *result, hints = {
+                .ai_flags = AI_PASSIVE | AI_NUMERICSERV,
+                .ai_socktype = SOCK_DGRAM
+        };
+        char port[8];
+        snprintf(port, sizeof(port), "%d", Run.statsd.port);
+        const char *address = Run.statsd.address ? Run.statsd.address : STATSD_ADDRESS;
+        int status = getaddrinfo(address, port, &hints, &result);
+        if (status) {
+                LogError("Cannot translate '%s' to IP address -- %s\n", address, status == EAI_SYSTEM ? STRERROR : gai_strerror(status));
+                return -1;
+        }
+        int s = socket(result->ai_family, SOCK_DGRAM, 0);
+        if (s < 0) {
+                LogError("Cannot create the statsd socket -- %s\n", STRERROR);
+        } else if (fcntl(s, F_SETFD, FD_CLOEXEC) == -1 || bind(s, result->ai_addr, result->ai_addrlen) < 0) {
+                LogError("Cannot bind the statsd socket to %s port %d -- %s\n", address, Run.statsd.port, STRERROR);
+                close(s);
+                s = -1;
+        }
+        freeaddrinfo(result);
+        return s;
+}
+
+
+static int _openUnix(void) {
+        struct sockaddr_un addr = {.sun_family = AF_UNIX};
+        if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", Run.statsd.socket) >= (int)sizeof(addr.sun_path)) {
+                LogError("Statsd socket path '%s' is too long\n", Run.statsd.socket);
+                return -1;
+        }
+        int s = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (s < 0) {
+                LogError("Cannot create the statsd socket -- %s\n", STRERROR);
+                return -1;
+        }
+        // Remove the socket left by a previous instance, but nothing else
+        struct stat st;
+        if (lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode))
+                unlink(addr.sun_path);
+        if (fcntl(s, F_SETFD, FD_CLOEXEC) == -1 || bind(s, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+                LogError("Cannot bind the statsd socket '%s' -- %s\n", addr.sun_path, STRERROR);
+                close(s);
+                return -1;
+        }
+        if (chmod(addr.sun_path, 0660) < 0)
+                LogError("Cannot set the statsd socket '%s' permission -- %s\n", addr.sun_path, STRERROR);
+        listener.path = Str_dup(addr.sun_path);
+        return s;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int Statsd_parse(char *text) {
+        ASSERT(text);
+        int count = 0;
+        for (char *line = text, *next; line; line = next) {
+                if ((next = strchr(line, '\n')))
+                        *next++ = 0;
+                if (*Str_trim(line) && _sample(line))
+                        count++;
+        }
+        return count;
+}
+
+
+boolean_t Statsd_collect(Service_T s) {
+        ASSERT(s);
+        ASSERT(s->metric);
+        Metric_T m = s->metric;
+        unsigned long long samples = __atomic_load_n(&m->samples, __ATOMIC_ACQUIRE);
+        s->inf->priv.metric.samples = samples;
+        if (! samples)
+                return false;
+        double total, last, max = 0.;
+        __atomic_load(&m->total, &total, __ATOMIC_RELAXED);
+        __atomic_load(&m->last, &last, __ATOMIC_RELAXED);
+        __atomic_exchange(&m->max, &max, &max, __ATOMIC_RELAXED);
+        Metric_Type type = __atomic_load_n(&m->type, __ATOMIC_RELAXED);
+        long long now = Time_monotonic();
+        double elapsed = m->_collected ? (now - m->_collected) / 1000. : 0.;
+        unsigned long long count = samples - m->_samples;
+        s->inf->priv.metric.type = type;
+        switch (type) {
+                case Metric_Counter:
+                        s->inf->priv.metric.value = total - m->_total;
+                        s->inf->priv.metric.max = s->inf->priv.metric.value;
+                        s->inf->priv.metric.rate = elapsed > 0. ? s->inf->priv.metric.value / elapsed : -1.;
+                        break;
+                case Metric_Timer:
+                        s->inf->priv.metric.value = count ? (total - m->_total) / count : 0.;
+                        s->inf->priv.metric.max = max;
+                        s->inf->priv.metric.rate = elapsed > 0. ? count / elapsed : -1.;
+                        break;
+                default:
+                        s->inf->priv.metric.value = last;
+                        s->inf->priv.metric.max = last;
+                        s->inf->priv.metric.rate = elapsed > 0. ? count / elapsed : -1.;
+                        break;
+        }
+        m->_samples = samples;
+        m->_total = total;
+        m->_collected = now;
+        return true;
+}
+
+
+boolean_t Statsd_start() {
+        if ((! Run.statsd.port && ! Run.statsd.socket) || listener.running)
+                return listener.running;
+        if (pipe(listener.wakeup) < 0) {
+                LogError("Cannot create the statsd listener pipe -- %s\n", STRERROR);
+                return false;
+        }
+        fcntl(listener.wakeup[0], F_SETFD, FD_CLOEXEC);
+        fcntl(listener.wakeup[1], F_SETFD, FD_CLOEXEC);
+        if (Run.statsd.port)
+                listener.udp = _openUdp();
+        if (Run.statsd.socket)
+                listener.local = _openUnix();
+        if (listener.udp < 0 && listener.local < 0) {
+                _close();
+                return false;
+        }
+        listener.stopped = false;
+        Thread_create(listener.thread, _listener, NULL);
+        listener.running = true;
+        DEBUG("Statsd listener started\n");
+        return true;
+}
+
+
+void Statsd_stop() {
+        if (! listener.running)
+                return;
+        __atomic_store_n(&listener.stopped, true, __ATOMIC_RELEASE);
+        if (write(listener.wakeup[1], "", 1) < 0)
+                LogError("Statsd listener wakeup failed -- %s\n", STRERROR);
+        Thread_join(listener.thread);
+        _close();
+        if (listener.path) {
+                unlink(listener.path);
+                FREE(listener.path);
+        }
+        listener.running = false;
+}
+
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_STATSD_H
+#define MONIT_STATSD_H
+
+
+/**
+ * Push metrics ingestion. If enabled with 'set statsd', a listener thread
+ * reads the statsd formated datagrams from a UDP port and/or a unix socket.
+ * A datagram has one or more lines:
+ *
+ *   <name>:<value>|<c|g|ms|h>[|@<sample rate>][|#<tags>]
+ *
+ * The sample of a metric is added to the accumulator of the 'check metric'
+ * service with the same name, the samples of unknown metrics and of the
+ * sets (|s) are dropped. The listener is the only writer of the
+ * accumulators, it publishes the cumulative totals with atomic stores, so
+ * the check reads them without a lock and computes the values of the
+ * last cycle from the difference.
+ *
+ * @file
+ */
+
+
+#define STATSD_PORT    8125
+#define STATSD_ADDRESS "127.0.0.1"
+
+
+/**
+ * Add the samples in the statsd formated text to the metric accumulators.
+ * The text is modified.
+ * @param text The statsd lines
+ * @return The number of accepted samples
+ */
+int Statsd_parse(char *text);
+
+
+/**
+ * Compute the metric values of the last cycle from the accumulator and
+ * store them in the service info
+ * @param s A metric service
+ * @return true if the metric has some sample, otherwise false
+ */
+boolean_t Statsd_collect(Service_T s);
+
+
+/**
+ * Open the sockets set with 'set statsd' and start the listener thread
+ * @return true if the listener was started, otherwise false
+ */
+boolean_t Statsd_start(void);
+
+
+/**
+ * Stop the listener thread and close the sockets
+ */
+void Statsd_stop(void);
+
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "monit.h"
+#include "snapshot.h"
+#include "statussegment.h"
+
+// libmonit
+#include "system/Time.h"
+
+
+/**
+ *  Shared memory status segment, written by the main thread only.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+static struct {
+        StatusHeader_T *header;                           /**< The mapped segment or NULL */
+        StatusRecord_T *records;
+        size_t size;                                              /**< Size of the mapping */
+        char *file;                                                 /**< The segment file */
+        unsigned long long generation;   /**< Run.generation of the last record update */
+} segment = {};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static double _response(Service_T S) {
+        double response = -1.;
+        for (Port_T p = S->portlist; p; p = p->next)
+                if (p->is_available == Connection_Ok && p->response > response)
+                        response = p->response;
+        for (Port_T p = S->socketlist; p; p = p->next)
+                if (p->is_available == Connection_Ok && p->response > response)
+                        response = p->response;
+        for (Icmp_T i = S->icmplist; i; i = i->next)
+                if (i->is_available == Connection_Ok && i->response > response)
+                        response = i->response;
+        return response;
+}
+
+
+static void _invalidate(void) {
+        if (segment.header) {
+                // Tell the readers which still have the segment mapped that it's gone
+                __atomic_store_n(&segment.header->magic[0], 0, __ATOMIC_RELEASE);
+                munmap(segment.header, segment.size);
+                segment.header = NULL;
+                segment.records = NULL;
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void StatusSegment_record(StatusRecord_T *R, Service_T S) {
+        struct myservice copy;
+        Service_T s = Snapshot_get(S, &copy);
+        snprintf(R->name, sizeof(R->name), "%s", s->name);
+        R->type = s->type;
+        R->state = Snapshot_state(s);
+        R->monitor = s->snapshot.monitor;
+        R->error = s->error;
+        R->collected = (int64_t)s->collected.tv_sec * 1000 + s->collected.tv_usec / 1000;
+        R->pid = R->uptime = R->memory = -1;
+        R->cpu = R->response = -1.;
+        R->exitStatus = -1;
+        if (Util_hasServiceStatus(s)) {
+                if (s->type == Service_Process && s->inf->priv.process.pid > 0) {
+                        R->pid = s->inf->priv.process.pid;
+                        R->uptime = s->inf->priv.process.uptime;
+                        R->memory = s->inf->priv.process.total_mem;
+                        R->cpu = s->inf->priv.process.total_cpu_percent;
+                } else if (s->type == Service_Program && s->snapshot.program.started) {
+                        R->exitStatus = s->snapshot.program.exitStatus;
+                }
+                R->response = _response(s);
+        }
+}
+
+
+void StatusSegment_open(void) {
+        int count = Util_getNumberOfServices();
+        const char *file = Run.files.status;
+        if (segment.header && IS(file, segment.file) && segment.header->count == (uint32_t)count) {
+                // The service list may have been reordered by the reload, rewrite all records
+                segment.generation = 0;
+                StatusSegment_update();
+                return;
+        }
+        StatusSegment_close();
+        if (! file)
+                return;
+        // Build the segment aside and rename it, so a reader never maps a half initialized file
+        char temporary[PATH_MAX];
+        snprintf(temporary, sizeof(temporary), "%s.tmp", file);
+        size_t size = sizeof(StatusHeader_T) + (size_t)count * sizeof(StatusRecord_T);
+        int fd = open(temporary, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+                LogError("Status segment %s open failed -- %s\n", temporary, STRERROR);
+                return;
+        }
+        if (ftruncate(fd, size) != 0) {
+                LogError("Status segment %s resize failed -- %s\n", temporary, STRERROR);
+                close(fd);
+                unlink(temporary);
+                return;
+        }
+        void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) {
+                LogError("Status segment %s mapping failed -- %s\n", temporary, STRERROR);
+                unlink(temporary);
+                return;
+        }
+        segment.header = p;
+        segment.records = (StatusRecord_T *)((char *)p + sizeof(StatusHeader_T));
+        segment.size = size;
+        segment.generation = 0;
+        segment.header->version = STATUSSEGMENT_VERSION;
+        segment.header->count = count;
+        segment.header->recordSize = sizeof(StatusRecord_T);
+        segment.header->pid = getpid();
+        StatusSegment_update();
+        snprintf(segment.header->magic, sizeof(segment.header->magic), "%s", STATUSSEGMENT_MAGIC);
+        if (rename(temporary, file) != 0) {
+                LogError("Status segment %s rename failed -- %s\n", file, STRERROR);
+                munmap(segment.header, segment.size);
+                segment.header = NULL;
+                segment.records = NULL;
+                unlink(temporary);
+                return;
+        }
+        segment.file = Str_dup(file);
+        DEBUG("Status segment %s created with %d services\n", file, count);
+}
+
+
+void StatusSegment_update(void) {
+        if (! segment.header)
+                return;
+        unsigned long long generation = __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE);
+        // An odd sequence tells the readers that the segment is being written
+        __atomic_store_n(&segment.header->sequence, segment.header->sequence + 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        if (generation != segment.generation || ! segment.generation) {
+                int i = 0;
+                for (Service_T s = servicelist; s && i < (int)segment.header->count; s = s->next, i++)
+                        if (! segment.generation || __atomic_load_n(&s->changed, __ATOMIC_ACQUIRE) > segment.generation)
+                                StatusSegment_record(&segment.records[i], s);
+                segment.header->generation = generation;
+                segment.generation = generation;
+        }
+        segment.header->updated = Time_milli();
+        __atomic_store_n(&segment.header->sequence, segment.header->sequence + 1, __ATOMIC_RELEASE);
+}
+
+
+void StatusSegment_close(void) {
+        _invalidate();
+        if (segment.file) {
+                unlink(segment.file);
+                FREE(segment.file);
+        }
+}
+
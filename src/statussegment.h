@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_STATUSSEGMENT_H
+#define MONIT_STATUSSEGMENT_H
+
+
+/**
+ * Shared memory status segment. With 'set status segment' the daemon
+ * keeps the status of the services in a memory mapped file (by default
+ * in /dev/shm), so the local tools can read it without asking the HTTP
+ * interface. The segment is rewritten after each check cycle and after
+ * the checks which run between the cycles.
+ *
+ * The file is a StatusHeader_T followed by StatusHeader_T.count records
+ * of StatusHeader_T.recordSize bytes, the fields are in the host byte
+ * order. A reader maps the file read-only and copies the records under
+ * the sequence lock: it reads the sequence, retries while it is odd,
+ * copies the records and retries if the sequence changed meanwhile.
+ * When the daemon stops or reloads a changed service list, the magic
+ * is cleared and the file is replaced, the reader has to map the file
+ * again then.
+ *
+ * @file
+ */
+
+
+#define STATUSSEGMENT_MAGIC "MONITST"
+#define STATUSSEGMENT_VERSION 1
+#define STATUSSEGMENT_PATH "/dev/shm/monit.status"
+#define STATUSSEGMENT_NAME 64
+
+
+/**
+ * The segment header
+ */
+typedef struct StatusHeader_T {
+        char magic[8];                                 /**< STATUSSEGMENT_MAGIC or empty */
+        uint32_t version;                                  /**< STATUSSEGMENT_VERSION */
+        uint32_t count;                                        /**< Number of records */
+        uint32_t recordSize;                           /**< Size of one record [B] */
+        uint32_t pid;                                      /**< Monit daemon pid */
+        uint64_t sequence;                    /**< Odd while the records are written */
+        int64_t updated;                        /**< Last update [ms since the epoch] */
+        uint64_t generation;               /**< Run.generation at the last update */
+} StatusHeader_T;
+
+
+/**
+ * The service status record. The metrics which don't apply to the service
+ * type or which are not available are -1.
+ */
+typedef struct StatusRecord_T {
+        char name[STATUSSEGMENT_NAME];       /**< Service name, truncated if longer */
+        uint32_t type;                                             /**< Service_Type */
+        uint32_t state;                                    /**< SnapshotState_Type */
+        uint32_t monitor;                                 /**< Monitor_State flags */
+        uint32_t error;                        /**< Event_Type flags of failed tests */
+        int64_t collected;                  /**< Data collected [ms since the epoch] */
+        int64_t pid;                                               /**< Process id */
+        int64_t uptime;                                    /**< Process uptime [s] */
+        int64_t memory;                 /**< Process memory with children [B] */
+        double cpu;                            /**< Process cpu with children [%] */
+        double response;   /**< Slowest port, socket or ping response time [ms] */
+        int32_t exitStatus;                              /**< Program exit status */
+        uint32_t reserved;
+} StatusRecord_T;
+
+
+/**
+ * Fill the status record from the published snapshot of the service.
+ * Safe to call from any thread.
+ * @param R The record
+ * @param S The service
+ */
+void StatusSegment_record(StatusRecord_T *R, Service_T S);
+
+
+/**
+ * Create the status segment if enabled with 'set status segment', or
+ * replace it if the service list changed. Must be called after the
+ * service list was built or reloaded.
+ */
+void StatusSegment_open(void);
+
+
+/**
+ * Update the records of the services whose status changed since the
+ * last update and the update time
+ */
+void StatusSegment_update(void);
+
+
+/**
+ * Invalidate and remove the status segment
+ */
+void StatusSegment_close(void);
+
+
+#endif
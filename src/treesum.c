@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_CTYPE_H
+#include <ctype.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_DIRENT_H
+#include <dirent.h>
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#include "monit.h"
+#include "treesum.h"
+
+// libmonit
+#include "util/StringBuffer.h"
+#include "exceptions/AssertException.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define TREESUM_MAGIC "MONITTR"
+#define TREESUM_VERSION 1
+
+
+#ifndef O_DIRECTORY
+#define O_DIRECTORY 0
+#endif
+
+#ifndef O_NOFOLLOW
+#define O_NOFOLLOW 0
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+
+/* The file record: the stat data and the content hash */
+typedef struct TreeSumFile_T {
+        char *name;
+        int kind;                  // 'f' regular file, 'l' symbolic link, 'o' other
+        unsigned long long inode;
+        unsigned long long size;
+        unsigned long long mtime;
+        unsigned long long ctime;
+        int mode;
+        int uid;
+        int gid;
+        MD_T hash;                 // Empty for the other files or if unreadable
+} *TreeSumFile_T;
+
+
+/* The directory node: the hash of its entries, the files and the subdirectories sorted by name */
+typedef struct TreeSumNode_T {
+        char *name;
+        unsigned long long device;
+        unsigned long long inode;
+        unsigned long long mtime;
+        unsigned long long ctime;
+        MD_T hash;                 // Empty until the node was hashed
+        int fileCount;
+        struct TreeSumFile_T *files;
+        int count;
+        struct TreeSumNode_T *children;
+} *TreeSumNode_T;
+
+
+/* The state of one update */
+typedef struct Diff_T {
+        Hash_Type type;
+        int count;                 // The number of changed paths
+        boolean_t report;          // false while a new subtree is built
+        boolean_t dirty;           // The tree has to be saved
+        StringBuffer_T changes;
+} Diff_T;
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static void _freeNode(TreeSumNode_T node) {
+        for (int i = 0; i < node->fileCount; i++)
+                FREE(node->files[i].name);
+        FREE(node->files);
+        for (int i = 0; i < node->count; i++)
+                _freeNode(&node->children[i]);
+        FREE(node->children);
+        FREE(node->name);
+}
+
+
+static int _compareFile(const void *a, const void *b) {
+        return strcmp(((const struct TreeSumFile_T *)a)->name, ((const struct TreeSumFile_T *)b)->name);
+}
+
+
+static int _compareNode(const void *a, const void *b) {
+        return strcmp(((const struct TreeSumNode_T *)a)->name, ((const struct TreeSumNode_T *)b)->name);
+}
+
+
+static void _report(Diff_T *d, char operation, const char *path, const char *name, boolean_t directory) {
+        if (d->report) {
+                if (d->count++ < TREESUM_REPORT)
+                        StringBuffer_append(d->changes, "%c %s%s%s\n", operation, path, name, directory ? "/" : "");
+        }
+}
+
+
+static int _kind(mode_t mode) {
+        return S_ISREG(mode) ? 'f' : S_ISLNK(mode) ? 'l' : 'o';
+}
+
+
+static void _setFile(TreeSumFile_T f, struct stat *st) {
+        f->kind = _kind(st->st_mode);
+        f->inode = st->st_ino;
+        f->size = st->st_size;
+        file_getStatTimes(st, &f->mtime, &f->ctime);
+        f->mode = st->st_mode & 07777;
+        f->uid = st->st_uid;
+        f->gid = st->st_gid;
+}
+
+
+static void _hashFile(Diff_T *d, int fd, TreeSumFile_T f) {
+        *f->hash = 0;
+        if (f->kind == 'f') {
+                // Non-blocking open, the file may be replaced with a fifo meanwhile
+                int file = openat(fd, f->name, O_RDONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+                if (file == -1) {
+                        DEBUG("Tree checksum: cannot open %s -- %s\n", f->name, STRERROR);
+                        return;
+                }
+                if (! Util_getStreamDigests(file, 1, &d->type, &f->hash))
+                        *f->hash = 0;
+                close(file);
+        } else if (f->kind == 'l') {
+                char target[PATH_MAX];
+                ssize_t n = readlinkat(fd, f->name, target, sizeof(target));
+                if (n >= 0)
+                        Util_getBufferDigest(target, n, d->type, f->hash);
+        }
+}
+
+
+/* Update the file record if its stat data changed, the content is hashed again only if the inode, size, type or modification time changed */
+static boolean_t _refreshFile(Diff_T *d, int fd, const char *path, TreeSumFile_T f, struct stat *st) {
+        unsigned long long mtime, ctime;
+        file_getStatTimes(st, &mtime, &ctime);
+        if (f->inode == (unsigned long long)st->st_ino && f->size == (unsigned long long)st->st_size && f->mtime == mtime && f->ctime == ctime && f->kind == _kind(st->st_mode))
+                return false;
+        boolean_t content = f->inode != (unsigned long long)st->st_ino || f->size != (unsigned long long)st->st_size || f->mtime != mtime || f->kind != _kind(st->st_mode);
+        struct TreeSumFile_T previous = *f;
+        _setFile(f, st);
+        if (content)
+                _hashFile(d, fd, f);
+        d->dirty = true;
+        if (strcmp(previous.hash, f->hash) || previous.mode != f->mode || previous.uid != f->uid || previous.gid != f->gid) {
+                _report(d, '~', path, f->name, false);
+                return true;
+        }
+        return false;
+}
+
+
+/* Hash the entries of the directory, returns true if the directory hash changed */
+static boolean_t _digestNode(Diff_T *d, TreeSumNode_T node) {
+        StringBuffer_T entries = StringBuffer_create(256);
+        for (int i = 0; i < node->fileCount; i++) {
+                TreeSumFile_T f = &node->files[i];
+                StringBuffer_append(entries, "%c %s %04o %d %d %s\n", f->kind, f->name, f->mode, f->uid, f->gid, f->hash);
+        }
+        for (int i = 0; i < node->count; i++)
+                StringBuffer_append(entries, "d %s %s\n", node->children[i].name, node->children[i].hash);
+        MD_T hash = {};
+        Util_getBufferDigest(StringBuffer_toString(entries), StringBuffer_length(entries), d->type, hash);
+        StringBuffer_free(&entries);
+        if (IS(hash, node->hash))
+                return false;
+        snprintf(node->hash, sizeof(node->hash), "%s", hash);
+        d->dirty = true;
+        return true;
+}
+
+
+static boolean_t _update(Diff_T *d, int fd, const char *path, TreeSumNode_T node);
+
+
+static boolean_t _updateChildren(Diff_T *d, int fd, const char *path, TreeSumNode_T node) {
+        boolean_t changed = false;
+        for (int i = 0; i < node->count; i++) {
+                TreeSumNode_T child = &node->children[i];
+                int childfd = openat(fd, child->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+                if (childfd == -1) {
+                        DEBUG("Tree checksum: cannot open %s%s -- %s\n", path, child->name, STRERROR);
+                        continue;
+                }
+                char childPath[PATH_MAX];
+                snprintf(childPath, sizeof(childPath), "%s%s/", path, child->name);
+                // The new directory was reported already, its content is not
+                boolean_t report = d->report;
+                if (! *child->hash)
+                        d->report = false;
+                if (_update(d, childfd, childPath, child))
+                        changed = true;
+                d->report = report;
+        }
+        return changed;
+}
+
+
+/**
+ * Update the node of the directory open as fd (the descriptor is consumed). If the
+ * directory's modification and change time didn't change, its entries are the same
+ * and only their stat data is tested, otherwise the directory is read and the added
+ * and removed entries are reported. Returns true if the directory hash changed.
+ */
+static boolean_t _update(Diff_T *d, int fd, const char *path, TreeSumNode_T node) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                DEBUG("Tree checksum: cannot stat %s -- %s\n", path, STRERROR);
+                close(fd);
+                return false;
+        }
+        unsigned long long mtime, ctime;
+        file_getStatTimes(&st, &mtime, &ctime);
+        boolean_t changed = false;
+        if (*node->hash && node->inode == (unsigned long long)st.st_ino && node->device == (unsigned long long)st.st_dev && node->mtime == mtime && node->ctime == ctime) {
+                boolean_t rescan = false;
+                for (int i = 0; i < node->fileCount; i++) {
+                        struct stat est;
+                        if (fstatat(fd, node->files[i].name, &est, AT_SYMLINK_NOFOLLOW) != 0 || S_ISDIR(est.st_mode)) {
+                                // The entry was replaced meanwhile, read the directory (the updated records are not reported again)
+                                rescan = true;
+                                break;
+                        }
+                        if (_refreshFile(d, fd, path, &node->files[i], &est))
+                                changed = true;
+                }
+                if (! rescan) {
+                        if (_updateChildren(d, fd, path, node))
+                                changed = true;
+                        close(fd);
+                        return changed ? _digestNode(d, node) : false;
+                }
+        }
+        DIR *dir = fdopendir(fd);
+        if (! dir) {
+                DEBUG("Tree checksum: cannot read %s -- %s\n", path, STRERROR);
+                close(fd);
+                return false;
+        }
+        struct TreeSumNode_T previous = *node;
+        char *keptFiles = CALLOC(1, previous.fileCount + 1);
+        char *keptChildren = CALLOC(1, previous.count + 1);
+        node->device = st.st_dev;
+        node->inode = st.st_ino;
+        node->mtime = mtime;
+        node->ctime = ctime;
+        node->fileCount = node->count = 0;
+        node->files = NULL;
+        node->children = NULL;
+        int filesSize = 0, childrenSize = 0;
+        struct dirent *entry;
+        while ((entry = readdir(dir))) {
+                if (entry->d_name[0] == '.' && (entry->d_name[1] == 0 || (entry->d_name[1] == '.' && entry->d_name[2] == 0)))
+                        continue;
+                struct stat est;
+                if (fstatat(dirfd(dir), entry->d_name, &est, AT_SYMLINK_NOFOLLOW) != 0)
+                        continue; // The entry was removed meanwhile
+                if (S_ISDIR(est.st_mode)) {
+                        if (est.st_dev != st.st_dev)
+                                continue;
+                        if (node->count == childrenSize) {
+                                childrenSize = childrenSize ? childrenSize * 2 : 8;
+                                RESIZE(node->children, childrenSize * sizeof(struct TreeSumNode_T));
+                        }
+                        TreeSumNode_T child = &node->children[node->count++];
+                        TreeSumNode_T cached = previous.count ? bsearch(&(struct TreeSumNode_T){.name = entry->d_name}, previous.children, previous.count, sizeof(struct TreeSumNode_T), _compareNode) : NULL;
+                        if (cached) {
+                                *child = *cached; // Ownership of the subtree moved to the new node
+                                keptChildren[cached - previous.children] = 1;
+                        } else {
+                                memset(child, 0, sizeof(*child));
+                                child->name = Str_dup(entry->d_name);
+                                _report(d, '+', path, entry->d_name, true);
+                                changed = true;
+                        }
+                } else {
+                        if (node->fileCount == filesSize) {
+                                filesSize = filesSize ? filesSize * 2 : 8;
+                                RESIZE(node->files, filesSize * sizeof(struct TreeSumFile_T));
+                        }
+                        TreeSumFile_T file = &node->files[node->fileCount++];
+                        TreeSumFile_T cached = previous.fileCount ? bsearch(&(struct TreeSumFile_T){.name = entry->d_name}, previous.files, previous.fileCount, sizeof(struct TreeSumFile_T), _compareFile) : NULL;
+                        if (cached) {
+                                *file = *cached;
+                                keptFiles[cached - previous.files] = 1;
+                                if (_refreshFile(d, dirfd(dir), path, file, &est))
+                                        changed = true;
+                        } else {
+                                memset(file, 0, sizeof(*file));
+                                file->name = Str_dup(entry->d_name);
+                                _setFile(file, &est);
+                                _hashFile(d, dirfd(dir), file);
+                                _report(d, '+', path, entry->d_name, false);
+                                changed = true;
+                        }
+                }
+        }
+        if (node->fileCount)
+                qsort(node->files, node->fileCount, sizeof(struct TreeSumFile_T), _compareFile);
+        if (node->count)
+                qsort(node->children, node->count, sizeof(struct TreeSumNode_T), _compareNode);
+        // Report and free the entries which were removed
+        for (int i = 0; i < previous.fileCount; i++) {
+                if (! keptFiles[i]) {
+                        _report(d, '-', path, previous.files[i].name, false);
+                        FREE(previous.files[i].name);
+                        changed = true;
+                }
+        }
+        for (int i = 0; i < previous.count; i++) {
+                if (! keptChildren[i]) {
+                        _report(d, '-', path, previous.children[i].name, true);
+                        _freeNode(&previous.children[i]);
+                        changed = true;
+                }
+        }
+        FREE(previous.files);
+        FREE(previous.children);
+        FREE(keptFiles);
+        FREE(keptChildren);
+        if (_updateChildren(d, dirfd(dir), path, node))
+                changed = true;
+        closedir(dir);
+        d->dirty = true;
+        return (changed || ! *node->hash) ? _digestNode(d, node) : false;
+}
+
+
+/* ------------------------------------------------------------ Persistence */
+
+
+static boolean_t _writeNumber(FILE *f, unsigned long long n) {
+        uint64_t value = n;
+        return fwrite(&value, sizeof(value), 1, f) == 1;
+}
+
+
+static boolean_t _writeString(FILE *f, const char *s) {
+        uint16_t length = strlen(s);
+        return fwrite(&length, sizeof(length), 1, f) == 1 && fwrite(s, 1, length, f) == length;
+}
+
+
+static boolean_t _writeNode(FILE *f, TreeSumNode_T node) {
+        if (! _writeString(f, node->name) || ! _writeNumber(f, node->device) || ! _writeNumber(f, node->inode) || ! _writeNumber(f, node->mtime) || ! _writeNumber(f, node->ctime) || ! _writeString(f, node->hash) || ! _writeNumber(f, node->fileCount))
+                return false;
+        for (int i = 0; i < node->fileCount; i++) {
+                TreeSumFile_T file = &node->files[i];
+                if (! _writeString(f, file->name) || ! _writeNumber(f, file->kind) || ! _writeNumber(f, file->inode) || ! _writeNumber(f, file->size) || ! _writeNumber(f, file->mtime) || ! _writeNumber(f, file->ctime) || ! _writeNumber(f, file->mode) || ! _writeNumber(f, file->uid) || ! _writeNumber(f, file->gid) || ! _writeString(f, file->hash))
+                        return false;
+        }
+        if (! _writeNumber(f, node->count))
+                return false;
+        for (int i = 0; i < node->count; i++)
+                if (! _writeNode(f, &node->children[i]))
+                        return false;
+        return true;
+}
+
+
+static boolean_t _readNumber(FILE *f, unsigned long long *n) {
+        uint64_t value;
+        if (fread(&value, sizeof(value), 1, f) != 1)
+                return false;
+        *n = value;
+        return true;
+}
+
+
+static boolean_t _readInt(FILE *f, int *n) {
+        unsigned long long value;
+        if (! _readNumber(f, &value) || value > INT_MAX)
+                return false;
+        *n = (int)value;
+        return true;
+}
+
+
+static boolean_t _readString(FILE *f, char *s, size_t size) {
+        uint16_t length;
+        if (fread(&length, sizeof(length), 1, f) != 1 || length >= size || fread(s, 1, length, f) != length)
+                return false;
+        s[length] = 0;
+        return true;
+}
+
+
+static boolean_t _readNode(FILE *f, TreeSumNode_T node) {
+        char name[PATH_MAX];
+        if (! _readString(f, name, sizeof(name)))
+                return false;
+        node->name = Str_dup(name);
+        if (! _readNumber(f, &node->device) || ! _readNumber(f, &node->inode) || ! _readNumber(f, &node->mtime) || ! _readNumber(f, &node->ctime) || ! _readString(f, node->hash, sizeof(node->hash)))
+                return false;
+        int count;
+        if (! _readInt(f, &count))
+                return false;
+        if (count) {
+                node->files = CALLOC(count, sizeof(struct TreeSumFile_T));
+                while (node->fileCount < count) {
+                        if (! _readString(f, name, sizeof(name)))
+                                return false;
+                        TreeSumFile_T file = &node->files[node->fileCount++];
+                        file->name = Str_dup(name);
+                        if (! _readInt(f, &file->kind) || ! _readNumber(f, &file->inode) || ! _readNumber(f, &file->size) || ! _readNumber(f, &file->mtime) || ! _readNumber(f, &file->ctime) || ! _readInt(f, &file->mode) || ! _readInt(f, &file->uid) || ! _readInt(f, &file->gid) || ! _readString(f, file->hash, sizeof(file->hash)))
+                                return false;
+                }
+        }
+        if (! _readInt(f, &count))
+                return false;
+        if (count) {
+                node->children = CALLOC(count, sizeof(struct TreeSumNode_T));
+                // The partially read node is counted, so it is freed with the tree on error
+                while (node->count < count)
+                        if (! _readNode(f, &node->children[node->count++]))
+                                return false;
+        }
+        return true;
+}
+
+
+/* The tree is saved next to the state file, the service name is part of the file name */
+static const char *_path(Service_T s) {
+        if (! s->treesum->file) {
+                char name[STRLEN];
+                snprintf(name, sizeof(name), "%s", s->name);
+                for (char *c = name; *c; c++)
+                        if (! isalnum((unsigned char)*c) && *c != '-' && *c != '.')
+                                *c = '_';
+                s->treesum->file = Str_cat("%s.tree.%s", Run.files.state, name);
+        }
+        return s->treesum->file;
+}
+
+
+static void _save(Service_T s) {
+        const char *path = _path(s);
+        char temporary[PATH_MAX];
+        snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+        FILE *f = fopen(temporary, "w");
+        if (! f) {
+                LogError("'%s' cannot save the tree checksum to %s -- %s\n", s->name, temporary, STRERROR);
+                return;
+        }
+        uint32_t version = TREESUM_VERSION, type = s->treesum->type;
+        boolean_t rv = fwrite(TREESUM_MAGIC, sizeof(TREESUM_MAGIC), 1, f) == 1 && fwrite(&version, sizeof(version), 1, f) == 1 && fwrite(&type, sizeof(type), 1, f) == 1 && _writeNode(f, s->treesum->root);
+        if (fclose(f) != 0 || ! rv || rename(temporary, path) != 0) {
+                LogError("'%s' cannot save the tree checksum to %s -- %s\n", s->name, path, STRERROR);
+                unlink(temporary);
+        }
+}
+
+
+/* Load the saved tree, returns false if there is no usable saved tree of this directory */
+static boolean_t _load(Service_T s) {
+        FILE *f = fopen(_path(s), "r");
+        if (! f)
+                return false;
+        char magic[sizeof(TREESUM_MAGIC)];
+        uint32_t version, type;
+        struct TreeSumNode_T root = {};
+        boolean_t rv = fread(magic, sizeof(magic), 1, f) == 1 && ! memcmp(magic, TREESUM_MAGIC, sizeof(magic)) && fread(&version, sizeof(version), 1, f) == 1 && version == TREESUM_VERSION && fread(&type, sizeof(type), 1, f) == 1 && type == s->treesum->type && _readNode(f, &root) && IS(root.name, s->path);
+        fclose(f);
+        if (! rv) {
+                LogWarning("'%s' the saved tree checksum %s is not usable, building a new one\n", s->name, _path(s));
+                _freeNode(&root);
+                return false;
+        }
+        _freeNode(s->treesum->root);
+        *s->treesum->root = root;
+        return true;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+int TreeSum_update(Service_T s, StringBuffer_T changes) {
+        ASSERT(s);
+        ASSERT(s->treesum);
+        ASSERT(changes);
+        TreeSum_T treesum = s->treesum;
+        int fd = open(s->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd == -1) {
+                LogError("'%s' cannot open directory %s -- %s\n", s->name, s->path, STRERROR);
+                return -1;
+        }
+        Diff_T d = {.type = treesum->type, .report = true, .changes = changes};
+        if (! treesum->root) {
+                NEW(treesum->root);
+                treesum->root->name = Str_dup(s->path);
+                // Without the saved tree the first update builds the tree only
+                if (! _load(s))
+                        d.report = false;
+        }
+        _update(&d, fd, "", treesum->root);
+        snprintf(treesum->hash, sizeof(treesum->hash), "%s", treesum->root->hash);
+        if (d.dirty)
+                _save(s);
+        if (! d.report)
+                DEBUG("'%s' tree checksum built: %s\n", s->name, treesum->hash);
+        else if (d.count > TREESUM_REPORT)
+                StringBuffer_append(changes, "... and %d more\n", d.count - TREESUM_REPORT);
+        return d.count;
+}
+
+
+void TreeSum_free(TreeSum_T *treesum) {
+        ASSERT(treesum && *treesum);
+        if ((*treesum)->root) {
+                _freeNode((*treesum)->root);
+                FREE((*treesum)->root);
+        }
+        FREE((*treesum)->file);
+        FREE(*treesum);
+}
+
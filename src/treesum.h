@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_TREESUM_H
+#define MONIT_TREESUM_H
+
+
+/**
+ * Directory tree checksum ('if changed tree checksum' in a directory
+ * service). The scanner keeps a Merkle tree of the directory: each file
+ * record holds its stat data and the content hash (the link target hash
+ * for a symbolic link), each directory hash is the hash of the names and
+ * hashes of its entries. A file is hashed again only if its stat data
+ * changed, the directory entries are read again only if the directory's
+ * modification or change time changed, so an unchanged tree costs one
+ * fstatat(2) per entry. The paths which were added, removed or changed
+ * are reported. The tree is saved next to the state file, so the changes
+ * made while Monit was not running are reported after start too.
+ * Symbolic links are not followed and directories on other filesystems
+ * are not descended into.
+ *
+ * @file
+ */
+
+
+#define TREESUM_REPORT 20      /**< Changed paths listed in the report */
+
+
+/**
+ * Update the tree checksum of the directory service. The first update
+ * without a saved tree only builds the tree.
+ * @param s A directory service with the tree checksum test
+ * @param changes The list of the changed paths, one per line prefixed by
+ * '+' (added), '-' (removed) or '~' (changed), at most TREESUM_REPORT paths
+ * are listed
+ * @return The number of the changed paths or -1 if the directory cannot be
+ * read
+ */
+int TreeSum_update(Service_T s, StringBuffer_T changes);
+
+
+/**
+ * Free the tree checksum test and its tree
+ * @param treesum The tree checksum object
+ */
+void TreeSum_free(TreeSum_T *treesum);
+
+
+#endif
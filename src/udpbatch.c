@@ -0,0 +1,587 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+
+#include "config.h"
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#endif
+
+#include "monit.h"
+#include "resolver.h"
+#include "protocol.h"
+#include "udpbatch.h"
+
+// libmonit
+#include "system/Time.h"
+#include "exceptions/IOException.h"
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+/* The DNS transaction ID is 16 bit, the requests of one batch must not wrap around */
+#define UDP_REQUESTS 65536
+
+
+/* Number of datagrams per sendmmsg/recvmmsg call, the replies are read after each burst so the socket buffer doesn't overflow */
+#define UDP_BURST 64
+
+
+/* Receive buffer size of the shared sockets */
+#define UDP_BUFFER (1024 * 1024)
+
+
+/* Largest request or reply which is kept, the longer replies are truncated. The SNMP request and reply carry all metrics of the port, allow the Ethernet MTU. */
+#define UDP_DATAGRAM 1472
+
+
+typedef enum {
+        Udp_Ip4 = 0,
+        Udp_Ip6,
+        Udp_Last = Udp_Ip6
+} Udp_Family;
+
+
+/* The protocols which can be batched and the position of the transaction ID in their reply */
+typedef struct UdpProtocol_T {
+        void (*check)(Socket_T);
+        int (*request)(Port_T P, unsigned char *buf, int size, uint64_t id);
+        void (*response)(Port_T P, const unsigned char *response, int length);
+        int offset;                         /**< Offset of the transaction ID in the reply */
+        int length;                        /**< Length of the transaction ID [bytes] */
+        boolean_t (*identify)(const unsigned char *response, int length, uint64_t *id); /**< Read the transaction ID if it has no fixed offset */
+} UdpProtocol_T;
+
+
+static const UdpProtocol_T protocols[] = {
+        {check_dns,  request_dns,  response_dns,  0,  2, NULL},   // Query ID
+        {check_ntp3, request_ntp3, response_ntp3, 24, 8, NULL},   // Originate timestamp, the transmit timestamp of the request
+        {check_snmp, request_snmp, response_snmp, -1, 4, id_snmp} // Request ID, 31 bit in the BER encoded PDU
+};
+
+
+typedef struct UdpProbe_T {
+        Port_T port;
+        const UdpProtocol_T *protocol;
+        Udp_Family family;
+        struct sockaddr_storage addr;
+        socklen_t addrlen;
+        uint64_t id;
+        double dns;                                 /**< Name resolution time [ms] */
+        long long sent;                               /**< Send timestamp [us] */
+        long long deadline;                          /**< Reply deadline [us] */
+        boolean_t done;
+} UdpProbe_T;
+
+
+static struct {
+        int sockets[Udp_Last + 1];
+        uint32_t cookie;                 /**< High half of the NTP transaction ID */
+        uint32_t sequence;              /**< Transaction number of the next request */
+} udp = {.sockets = {-1, -1}};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+/**
+ * Open the shared socket of the family
+ * @return true on success, otherwise false
+ */
+static boolean_t _open(Udp_Family family) {
+        if (udp.sockets[family] >= 0)
+                return true;
+        int domain = AF_INET;
+#ifdef HAVE_IPV6
+        if (family == Udp_Ip6)
+                domain = AF_INET6;
+#else
+        if (family == Udp_Ip6)
+                return false;
+#endif
+        int fd = socket(domain, SOCK_DGRAM, IPPROTO_UDP);
+        if (fd < 0) {
+                LogError("UDP batch -- cannot create the IPv%d socket: %s\n", family == Udp_Ip4 ? 4 : 6, STRERROR);
+                return false;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        int buffer = UDP_BUFFER;
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        udp.sockets[family] = fd;
+        if (! udp.cookie)
+                udp.cookie = (uint32_t)(Time_micro() ^ getpid()) | 1;
+        return true;
+}
+
+
+static const UdpProtocol_T *_getProtocol(Port_T p) {
+        for (int i = 0; i < (int)(sizeof(protocols) / sizeof(protocols[0])); i++)
+                if (p->protocol->check == protocols[i].check)
+                        return &protocols[i];
+        return NULL;
+}
+
+
+static boolean_t _isBatched(Service_T s, Port_T p) {
+        // The skipped cycles are decided by the check, don't test in vain
+        if (s->monitor == Monitor_Not || s->every.type != Every_Cycle || p->type != Socket_Udp || p->family == Socket_Unix || p->outgoing.addrlen)
+                return false;
+        // SNMPv3 discovers the engine first, it is tested on its own socket
+        if (p->protocol->check == check_snmp && p->parameters.snmp.version == 3)
+                return false;
+        return _getProtocol(p) != NULL;
+}
+
+
+/**
+ * Resolve the host of the port and open the socket for its address
+ * @return true on success, otherwise false and the port is left to Socket_test()
+ */
+static boolean_t _resolve(UdpProbe_T *u) {
+        Port_T p = u->port;
+        struct addrinfo *result, hints = {
+#ifdef AI_ADDRCONFIG
+                .ai_flags = AI_ADDRCONFIG,
+#endif
+                .ai_socktype = SOCK_DGRAM,
+                .ai_protocol = IPPROTO_UDP
+        };
+        switch (p->family) {
+                case Socket_Ip:
+                        hints.ai_family = AF_UNSPEC;
+                        break;
+                case Socket_Ip4:
+                        hints.ai_family = AF_INET;
+                        break;
+#ifdef HAVE_IPV6
+                case Socket_Ip6:
+                        hints.ai_family = AF_INET6;
+                        break;
+#endif
+                default:
+                        return false;
+        }
+        long long start = Time_monotonicMicro();
+        // Leave the errors to Socket_test(), the fallback reports them
+        if (Resolver_get(p->hostname, p->target.net.port, &hints, &result))
+                return false;
+        u->dns = (Time_monotonicMicro() - start) / 1000.;
+        boolean_t rv = false;
+        for (struct addrinfo *a = result; a && ! rv; a = a->ai_next) {
+                Udp_Family family;
+                if (a->ai_family == AF_INET)
+                        family = Udp_Ip4;
+#ifdef HAVE_IPV6
+                else if (a->ai_family == AF_INET6)
+                        family = Udp_Ip6;
+#endif
+                else
+                        continue;
+                if (_open(family)) {
+                        u->family = family;
+                        u->addrlen = a->ai_addrlen;
+                        memcpy(&u->addr, a->ai_addr, a->ai_addrlen);
+                        rv = true;
+                }
+        }
+        Resolver_free(result);
+        return rv;
+}
+
+
+static boolean_t _isFrom(UdpProbe_T *u, struct sockaddr_storage *from) {
+        if (from->ss_family != u->addr.ss_family)
+                return false;
+        if (from->ss_family == AF_INET) {
+                struct sockaddr_in *a = (struct sockaddr_in *)from, *b = (struct sockaddr_in *)&u->addr;
+                return a->sin_port == b->sin_port && memcmp(&a->sin_addr, &b->sin_addr, sizeof(struct in_addr)) == 0;
+        }
+#ifdef HAVE_IPV6
+        if (from->ss_family == AF_INET6) {
+                struct sockaddr_in6 *a = (struct sockaddr_in6 *)from, *b = (struct sockaddr_in6 *)&u->addr;
+                return a->sin6_port == b->sin6_port && memcmp(&a->sin6_addr, &b->sin6_addr, sizeof(struct in6_addr)) == 0;
+        }
+#endif
+        return false;
+}
+
+
+static void _finish(UdpProbe_T *u, const char *error, ...) __attribute__((format (printf, 2, 3)));
+static void _finish(UdpProbe_T *u, const char *error, ...) {
+        Port_T p = u->port;
+        u->done = true;
+        p->prefetch.dns = u->dns;
+        p->prefetch.response = -1.;
+        *p->prefetch.error = 0;
+        if (error) {
+                va_list ap;
+                va_start(ap, error);
+                vsnprintf(p->prefetch.error, sizeof(p->prefetch.error), error, ap);
+                va_end(ap);
+                DEBUG("UDP batch -- test of [%s]:%d failed -- %s\n", p->hostname, p->target.net.port, p->prefetch.error);
+        }
+        p->prefetch.valid = true;
+}
+
+
+/**
+ * Match the reply with the request by the transaction ID and the source
+ * address and check the reply. The replies to earlier batches, to other
+ * ports and the replies after the port timeout are skipped.
+ */
+static void _reply(UdpProbe_T *probes, int count, uint32_t first, const unsigned char *buf, int length, struct sockaddr_storage *from, long long received, int *pending) {
+        // Try the ID of each protocol; the match is confirmed by the whole ID and the source
+        for (int i = 0; i < (int)(sizeof(protocols) / sizeof(protocols[0])); i++) {
+                const UdpProtocol_T *protocol = &protocols[i];
+                uint64_t id = 0;
+                if (protocol->identify) {
+                        if (! protocol->identify(buf, length, &id))
+                                continue;
+                } else {
+                        if (length < protocol->offset + protocol->length)
+                                continue;
+                        for (int j = 0; j < protocol->length; j++)
+                                id = id << 8 | buf[protocol->offset + j];
+                }
+                uint32_t index = (uint32_t)id - first;
+                if (protocol->length == 2)
+                        index &= 0xFFFF;
+                else if (protocol->length == 4)
+                        index &= 0x7FFFFFFF;
+                if (index >= (uint32_t)count)
+                        continue;
+                UdpProbe_T *u = &probes[index];
+                if (u->done || u->protocol != protocol || u->id != id || ! _isFrom(u, from))
+                        continue;
+                if (received > u->deadline)
+                        return; // Too late, the timeout is reported when the batch ends
+                double response = (double)(received - u->sent) / 1000.;
+                TRY
+                {
+                        protocol->response(u->port, buf, length);
+                        _finish(u, NULL);
+                        u->port->prefetch.response = response;
+                        DEBUG("UDP batch -- test of [%s]:%d succeeded -- response_time=%s\n", u->port->hostname, u->port->target.net.port, Str_milliToTime(response, (char[23]){}));
+                }
+                ELSE
+                {
+                        _finish(u, "%s", Exception_frame.message);
+                }
+                END_TRY;
+                (*pending)--;
+                return;
+        }
+}
+
+
+/**
+ * Read the pending replies from the socket, up to UDP_BURST datagrams per call
+ */
+static void _receive(Udp_Family family, UdpProbe_T *probes, int count, uint32_t first, int *pending) {
+        unsigned char buf[UDP_BURST][UDP_DATAGRAM];
+        struct sockaddr_storage from[UDP_BURST];
+#ifdef HAVE_RECVMMSG
+        struct iovec iov[UDP_BURST];
+        struct mmsghdr msgs[UDP_BURST];
+#endif
+        while (*pending > 0) {
+                int n;
+#ifdef HAVE_RECVMMSG
+                memset(msgs, 0, sizeof(msgs));
+                for (int i = 0; i < UDP_BURST; i++) {
+                        iov[i].iov_base = buf[i];
+                        iov[i].iov_len = UDP_DATAGRAM;
+                        msgs[i].msg_hdr.msg_iov = &iov[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                        msgs[i].msg_hdr.msg_name = &from[i];
+                        msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+                }
+                n = recvmmsg(udp.sockets[family], msgs, UDP_BURST, MSG_DONTWAIT, NULL);
+#else
+                socklen_t addrlen = sizeof(from[0]);
+                ssize_t length = recvfrom(udp.sockets[family], buf[0], UDP_DATAGRAM, 0, (struct sockaddr *)&from[0], &addrlen);
+                n = length < 0 ? -1 : 1;
+#endif
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        // The ICMP errors of the unconnected socket are not bound to a port, the port times out
+                        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNREFUSED)
+                                LogError("UDP batch -- cannot read the reply: %s\n", STRERROR);
+                        if (errno != ECONNREFUSED)
+                                return;
+                        continue;
+                }
+                long long received = Time_monotonicMicro();
+                for (int i = 0; i < n; i++) {
+#ifdef HAVE_RECVMMSG
+                        int length = (int)msgs[i].msg_len;
+#endif
+                        _reply(probes, count, first, buf[i], (int)length, &from[i], received, pending);
+                }
+#ifdef HAVE_RECVMMSG
+                if (n < UDP_BURST)
+                        return;
+#endif
+        }
+}
+
+
+static void _drain(UdpProbe_T *probes, int count, uint32_t first, int *pending) {
+        for (int i = 0; i <= Udp_Last; i++)
+                if (udp.sockets[i] >= 0)
+                        _receive(i, probes, count, first, pending);
+}
+
+
+/**
+ * Send the requests of the probes, which all have the same family
+ * @return The number of the requests sent, the failed request is finished
+ * with the error and counted too
+ */
+static int _send(UdpProbe_T **burst, int count, int *pending) {
+        unsigned char buf[UDP_BURST][UDP_DATAGRAM];
+        int length[UDP_BURST];
+        int total = count;
+        count = 0;
+        for (int i = 0; i < total; i++) {
+                if ((length[count] = burst[i]->protocol->request(burst[i]->port, buf[count], UDP_DATAGRAM, burst[i]->id)) < 0)
+                        _finish(burst[i], "%s: the request doesn't fit in %d bytes", burst[i]->port->protocol->name, UDP_DATAGRAM);
+                else
+                        burst[count++] = burst[i];
+        }
+        int fd = udp.sockets[burst[0]->family];
+        int sent = 0;
+        while (sent < count) {
+                long long now = Time_monotonicMicro();
+                int n;
+#ifdef HAVE_SENDMMSG
+                struct iovec iov[UDP_BURST];
+                struct mmsghdr msgs[UDP_BURST] = {};
+                for (int i = sent; i < count; i++) {
+                        iov[i].iov_base = buf[i];
+                        iov[i].iov_len = length[i];
+                        msgs[i].msg_hdr.msg_iov = &iov[i];
+                        msgs[i].msg_hdr.msg_iovlen = 1;
+                        msgs[i].msg_hdr.msg_name = &burst[i]->addr;
+                        msgs[i].msg_hdr.msg_namelen = burst[i]->addrlen;
+                }
+                n = sendmmsg(fd, msgs + sent, count - sent, 0);
+#else
+                n = sendto(fd, buf[sent], length[sent], 0, (struct sockaddr *)&burst[sent]->addr, burst[sent]->addrlen) < 0 ? -1 : 1;
+#endif
+                if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        // The first request of the call failed, finish it and send the rest
+                        _finish(burst[sent], "%s: error sending request -- %s", burst[sent]->port->protocol->name, STRERROR);
+                        sent++;
+                        continue;
+                }
+                for (int i = sent; i < sent + n; i++) {
+                        burst[i]->sent = now;
+                        burst[i]->deadline = now + burst[i]->port->timeout * 1000LL;
+                        (*pending)++;
+                }
+                sent += n;
+        }
+        return total;
+}
+
+
+/**
+ * Wait for the replies until all ports replied or the last timeout passed.
+ * The ports are finished with the timeout error as their deadlines pass.
+ */
+static void _wait(UdpProbe_T *probes, int count, uint32_t first, int pending) {
+        while (pending > 0 && ! (Run.flags & Run_Stopped)) {
+                long long now = Time_monotonicMicro(), deadline = 0;
+                for (int i = 0; i < count; i++) {
+                        UdpProbe_T *u = &probes[i];
+                        if (u->done || ! u->sent)
+                                continue;
+                        if (now > u->deadline) {
+                                _finish(u, "%s: did not receive answer from server within %s", u->port->protocol->name, Str_milliToTime(u->port->timeout, (char[23]){}));
+                                pending--;
+                        } else if (! deadline || u->deadline < deadline) {
+                                deadline = u->deadline;
+                        }
+                }
+                if (pending <= 0)
+                        break;
+                struct pollfd fds[Udp_Last + 1];
+                Udp_Family families[Udp_Last + 1];
+                int nfds = 0;
+                for (int i = 0; i <= Udp_Last; i++) {
+                        if (udp.sockets[i] >= 0) {
+                                fds[nfds].fd = udp.sockets[i];
+                                fds[nfds].events = POLLIN;
+                                fds[nfds].revents = 0;
+                                families[nfds++] = i;
+                        }
+                }
+                // Wake up at the nearest deadline, so each port waits for its own timeout only
+                int rv = poll(fds, nfds, (int)((deadline - now + 999) / 1000));
+                if (rv < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        LogError("UDP batch -- poll failed: %s\n", STRERROR);
+                        return;
+                }
+                for (int i = 0; i < nfds; i++)
+                        if (fds[i].revents & (POLLIN | POLLERR))
+                                _receive(families[i], probes, count, first, &pending);
+        }
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void UdpBatch_run() {
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                for (Port_T p = s->portlist; p; p = p->next) {
+                        p->prefetch.valid = false;
+                        if (_isBatched(s, p))
+                                count++;
+                }
+        }
+        if (! (Run.flags & Run_UdpBatch) || ! count)
+                return;
+        // The spread checks run during the whole cycle, the prefetched data would be stale
+        if (Run.flags & Run_PacingSpread)
+                return;
+        count = MIN(count, UDP_REQUESTS);
+        UdpProbe_T *probes = CALLOC(count, sizeof(UdpProbe_T));
+        uint32_t first = udp.sequence;
+        int n = 0;
+        for (Service_T s = servicelist; s && n < count; s = s->next) {
+                for (Port_T p = s->portlist; p && n < count; p = p->next) {
+                        if (_isBatched(s, p)) {
+                                UdpProbe_T *u = &probes[n];
+                                u->port = p;
+                                u->protocol = _getProtocol(p);
+                                if (_resolve(u)) {
+                                        uint32_t sequence = first + n;
+                                        u->id = u->protocol->length == 2 ? (sequence & 0xFFFF) : u->protocol->length == 4 ? (sequence & 0x7FFFFFFF) : ((uint64_t)udp.cookie << 32 | sequence);
+                                        n++;
+                                } else {
+                                        memset(u, 0, sizeof(UdpProbe_T));
+                                }
+                        }
+                }
+        }
+        udp.sequence = first + n;
+        int pending = 0;
+        for (Udp_Family family = 0; family <= Udp_Last; family++) {
+                UdpProbe_T *burst[UDP_BURST];
+                int length = 0;
+                for (int i = 0; i <= n && ! (Run.flags & Run_Stopped); i++) {
+                        if (i < n && probes[i].family == family)
+                                burst[length++] = &probes[i];
+                        if (length && (length == UDP_BURST || i == n)) {
+                                _send(burst, length, &pending);
+                                length = 0;
+                                _drain(probes, n, first, &pending);
+                        }
+                }
+        }
+        _wait(probes, n, first, pending);
+        FREE(probes);
+}
+
+
+void UdpBatch_stop() {
+        for (int i = 0; i <= Udp_Last; i++) {
+                if (udp.sockets[i] >= 0) {
+                        close(udp.sockets[i]);
+                        udp.sockets[i] = -1;
+                }
+        }
+}
+
+
+boolean_t UdpBatch_test(Port_T p) {
+        ASSERT(p);
+        if (! p->prefetch.valid)
+                return false;
+        p->prefetch.valid = false;
+        p->phases.dns = p->prefetch.dns;
+        p->phases.connect = p->phases.tls = -1.;
+        p->phases.firstbyte = p->prefetch.response;
+        if (*p->prefetch.error) {
+                p->is_available = Connection_Failed;
+                p->response = -1.;
+                THROW(IOException, "%s", p->prefetch.error);
+        }
+        p->response = p->prefetch.dns + p->prefetch.response;
+        p->is_available = Connection_Ok;
+        return true;
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#ifndef MONIT_UDPBATCH_H
+#define MONIT_UDPBATCH_H
+
+
+/**
+ * Batched UDP protocol tests. If enabled with "set udp batch", the DNS,
+ * NTP and SNMP v1/v2c requests of all UDP port tests are sent at the
+ * beginning of the cycle on one shared IPv4 and one shared IPv6 socket,
+ * with sendmmsg(2) where available, instead of one socket and a serial
+ * request/response round trip per port. The replies are collected with
+ * recvmmsg(2) and matched with their ports by the transaction ID (the DNS
+ * query ID, the NTP originate timestamp or the SNMP request ID) and the
+ * source address. Each port waits up to its own timeout, the batch ends
+ * as soon as all ports replied or the last timeout passed. The ports with
+ * an outgoing address, of services which are not tested every cycle and
+ * the SNMPv3 ports fall back to Socket_test().
+ *
+ * @file
+ */
+
+
+/**
+ * Send the requests of the UDP port tests and collect the replies. The
+ * results are valid until they are consumed by UdpBatch_test() or until
+ * the next batch.
+ */
+void UdpBatch_run(void);
+
+
+/**
+ * Close the shared sockets
+ */
+void UdpBatch_stop(void);
+
+
+/**
+ * Use the prefetched result of the port test if available. The response
+ * time and the phases of the port are set as by Socket_test().
+ * @param p A port
+ * @return true if the port was tested in the batch, false if it must be
+ * tested with Socket_test()
+ * @exception IOException if the port test in the batch failed
+ */
+boolean_t UdpBatch_test(Port_T p);
+
+
+#endif
+
@@ -56,6 +56,10 @@
 #include <fcntl.h>
 #endif
 
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -108,31 +112,93 @@
 #include <grp.h>
 #endif
 
+#ifdef HAVE_OPENSSL
+#include <openssl/evp.h>
+#endif
+
+#ifdef HAVE_ZLIB_H
+#include <zlib.h>
+#endif
+
 #include "monit.h"
 #include "engine.h"
+#include "snapshot.h"
+#include "series.h"
 #include "md5.h"
 #include "md5_crypt.h"
 #include "sha1.h"
+#include "sha256.h"
+#include "xxhash.h"
 #include "base64.h"
 #include "alert.h"
 #include "ProcessTree.h"
 #include "event.h"
 #include "state.h"
 #include "protocol.h"
+#include "statsd.h"
+#include "plugin.h"
 
 // libmonit
 #include "io/File.h"
 #include "system/Time.h"
+#include "system/System.h"
+#include "thread/Thread.h"
 #include "exceptions/AssertException.h"
 #include "exceptions/IOException.h"
 
 
+/* The checksum read block size */
+#define HASHBLOCKSIZE 262144
+
+/* Files larger than this are dropped from the page cache while the checksum is computed */
+#define HASHDONTNEEDSIZE 67108864
+
+
 struct ad_user {
         const char *login;
         const char *passwd;
 };
 
 
+/* Message digest computation context. OpenSSL is preferred if available as it provides CPU accelerated implementations */
+typedef struct {
+        Hash_Type type;
+#ifdef HAVE_OPENSSL
+        EVP_MD_CTX *evp;
+#endif
+        union {
+                md5_context_t md5;
+                sha1_context_t sha1;
+                sha256_context_t sha256;
+                xxh64_context_t xxh64;
+        } ctx;
+} Digest_T;
+
+
+/* The service name index: open addressing hash table with linear probing, maintained by the parser and
+ the service discovery. The heartbeat and statsd listeners look up the services while the discovery changes
+ the index: a removed service leaves a tombstone and a replaced table is kept until the next reset */
+static struct {
+        int count;                                  /**< Services and tombstones */
+        int size;                                           /**< Power of 2 */
+        Service_T *table;
+        List_T retired;                            /**< The replaced tables */
+} serviceindex = {};
+
+
+static struct myservice tombstone = {};
+
+
+/* A service of the previous configuration, see Util_reuseServices() */
+typedef struct ReusableService_T {
+        Service_T service;
+        boolean_t reused;
+} ReusableService_T;
+
+
+static Mutex_T cryptMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
 /* Unsafe URL characters: <>\"#%{}|\\^[] ` */
 static const unsigned char urlunsafe[256] = {
         1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
@@ -415,6 +481,111 @@ static Auth_T PAMcheckUserGroup(const char *uname) {
 #endif
 
 
+static void _digestInit(Digest_T *digest, Hash_Type type) {
+        digest->type = type;
+#ifdef HAVE_OPENSSL
+        const EVP_MD *md = NULL;
+        switch (type) {
+                case Hash_Md5:
+                        md = EVP_md5();
+                        break;
+                case Hash_Sha1:
+                        md = EVP_sha1();
+                        break;
+                case Hash_Sha256:
+                        md = EVP_sha256();
+                        break;
+                default:
+                        break;
+        }
+        if (md && (digest->evp = EVP_MD_CTX_create())) {
+                if (EVP_DigestInit_ex(digest->evp, md, NULL) == 1)
+                        return;
+                // The digest may be unavailable (for example MD5 in FIPS mode) => use the built-in implementation
+                EVP_MD_CTX_destroy(digest->evp);
+        }
+        digest->evp = NULL;
+#endif
+        switch (type) {
+                case Hash_Md5:
+                        md5_init(&digest->ctx.md5);
+                        break;
+                case Hash_Sha1:
+                        sha1_init(&digest->ctx.sha1);
+                        break;
+                case Hash_Sha256:
+                        sha256_init(&digest->ctx.sha256);
+                        break;
+                case Hash_Xxh64:
+                        xxh64_init(&digest->ctx.xxh64);
+                        break;
+                default:
+                        break;
+        }
+}
+
+
+static void _digestAppend(Digest_T *digest, const unsigned char *data, size_t length) {
+#ifdef HAVE_OPENSSL
+        if (digest->evp) {
+                EVP_DigestUpdate(digest->evp, data, length);
+                return;
+        }
+#endif
+        switch (digest->type) {
+                case Hash_Md5:
+                        md5_append(&digest->ctx.md5, (const md5_byte_t *)data, (int)length);
+                        break;
+                case Hash_Sha1:
+                        sha1_append(&digest->ctx.sha1, data, length);
+                        break;
+                case Hash_Sha256:
+                        sha256_append(&digest->ctx.sha256, data, length);
+                        break;
+                case Hash_Xxh64:
+                        xxh64_append(&digest->ctx.xxh64, data, length);
+                        break;
+                default:
+                        break;
+        }
+}
+
+
+/* Write the digest to result and return its length in bytes or -1 on error */
+static int _digestFinish(Digest_T *digest, unsigned char *result) {
+#ifdef HAVE_OPENSSL
+        if (digest->evp) {
+                unsigned int length = 0;
+                int rv = EVP_DigestFinal_ex(digest->evp, result, &length);
+                EVP_MD_CTX_destroy(digest->evp);
+                return rv == 1 ? (int)length : -1;
+        }
+#endif
+        switch (digest->type) {
+                case Hash_Md5:
+                        md5_finish(&digest->ctx.md5, result);
+                        return 16;
+                case Hash_Sha1:
+                        sha1_finish(&digest->ctx.sha1, result);
+                        return SHA1_DIGEST_SIZE;
+                case Hash_Sha256:
+                        sha256_finish(&digest->ctx.sha256, result);
+                        return SHA256_DIGEST_SIZE;
+                case Hash_Xxh64:
+                        xxh64_finish(&digest->ctx.xxh64, result);
+                        return XXH64_DIGEST_SIZE;
+                default:
+                        return -1;
+        }
+}
+
+
+static int _compareFloat(const void *a, const void *b) {
+        float x = *(const float *)a, y = *(const float *)b;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
 /* ------------------------------------------------------------------ Public */
 
 
@@ -582,126 +753,131 @@ char *Util_digest2Bytes(unsigned char *digest, int mdlen, MD_T result) {
 }
 
 
-boolean_t Util_getStreamDigests(FILE *stream, void *sha1_resblock, void *md5_resblock) {
-#define HASHBLOCKSIZE 4096
-        md5_context_t ctx_md5;
-        sha1_context_t ctx_sha1;
-        unsigned char buffer[HASHBLOCKSIZE + 72];
-        size_t sum;
-
-        /* Initialize the computation contexts */
-        if (md5_resblock)
-                md5_init(&ctx_md5);
-        if (sha1_resblock)
-                sha1_init(&ctx_sha1);
-
-        /* Iterate over full file contents */
-        while (1)  {
-                /* We read the file in blocks of HASHBLOCKSIZE bytes. One call of the computation function processes the whole buffer so that with the next round of the loop another block can be read */
-                size_t n;
-                sum = 0;
-
-                /* Read block. Take care for partial reads */
-                while (1) {
-                        n = fread(buffer + sum, 1, HASHBLOCKSIZE - sum, stream);
-                        sum += n;
-                        if (sum == HASHBLOCKSIZE)
-                                break;
-                        if (n == 0) {
-                                /* Check for the error flag IFF N == 0, so that we don't exit the loop after a partial read due to e.g., EAGAIN or EWOULDBLOCK */
-                                if (ferror(stream))
-                                        return false;
-                                goto process_partial_block;
-                        }
+int Util_getHashLength(Hash_Type hashtype) {
+        switch (hashtype) {
+                case Hash_Md5:
+                        return 32;
+                case Hash_Sha1:
+                        return 40;
+                case Hash_Sha256:
+                        return 64;
+                case Hash_Xxh64:
+                        return 16;
+                default:
+                        return 0;
+        }
+}
+
 
-                        /* We've read at least one byte, so ignore errors. But always check for EOF, since feof may be true even though N > 0. Otherwise, we could end up calling fread after EOF */
-                        if (feof(stream))
-                                goto process_partial_block;
+boolean_t Util_getStreamDigests(int fd, int count, const Hash_Type *hashtype, MD_T *result) {
+        ASSERT(count > 0);
+        ASSERT(hashtype);
+        ASSERT(result);
+        Digest_T digest[count];
+        for (int i = 0; i < count; i++)
+                _digestInit(&digest[i], hashtype[i]);
+        // Large files are dropped from the page cache behind the read position, so checksumming them doesn't evict the cache of other files
+        struct stat st;
+        boolean_t dontneed = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > HASHDONTNEEDSIZE;
+#ifdef POSIX_FADV_SEQUENTIAL
+        if (dontneed)
+                posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        boolean_t rv = true;
+        unsigned char *buffer = ALLOC(HASHBLOCKSIZE);
+        off_t offset = 0, dropped = 0;
+        while (true) {
+                ssize_t n = read(fd, buffer, HASHBLOCKSIZE);
+                if (n == 0) {
+                        break;
+                } else if (n < 0) {
+                        if (errno == EINTR)
+                                continue;
+                        rv = false;
+                        break;
                 }
+                for (int i = 0; i < count; i++)
+                        _digestAppend(&digest[i], buffer, n);
+                offset += n;
+#ifdef POSIX_FADV_DONTNEED
+                if (dontneed && offset - dropped >= HASHBLOCKSIZE * 64) {
+                        posix_fadvise(fd, dropped, offset - dropped, POSIX_FADV_DONTNEED);
+                        dropped = offset;
+                }
+#endif
+        }
+#ifdef POSIX_FADV_DONTNEED
+        if (dontneed && offset > dropped)
+                posix_fadvise(fd, dropped, offset - dropped, POSIX_FADV_DONTNEED);
+#endif
+        FREE(buffer);
+        for (int i = 0; i < count; i++) {
+                unsigned char md[SHA256_DIGEST_SIZE]; // The longest digest
+                int length = _digestFinish(&digest[i], md);
+                if (length > 0)
+                        Util_digest2Bytes(md, length, result[i]);
+                else
+                        rv = false;
+        }
+        return rv;
+}
+
 
-                /* Process buffer with HASHBLOCKSIZE bytes. Note that HASHBLOCKSIZE % 64 == 0 */
-                if (md5_resblock)
-                        md5_append(&ctx_md5, (const md5_byte_t *)buffer, HASHBLOCKSIZE);
-                if (sha1_resblock)
-                        sha1_append(&ctx_sha1, buffer, HASHBLOCKSIZE);
-        }
-
-process_partial_block:
-        /* Process any remaining bytes */
-        if (sum > 0) {
-                if (md5_resblock)
-                        md5_append(&ctx_md5, (const md5_byte_t *)buffer, (int)sum);
-                if (sha1_resblock)
-                        sha1_append(&ctx_sha1, buffer, sum);
-        }
-        /* Construct result in desired memory */
-        if (md5_resblock)
-                md5_finish(&ctx_md5, md5_resblock);
-        if (sha1_resblock)
-                sha1_finish(&ctx_sha1, sha1_resblock);
+boolean_t Util_getBufferDigest(const void *data, size_t length, Hash_Type hashtype, MD_T result) {
+        ASSERT(data || ! length);
+        ASSERT(result);
+        Digest_T digest;
+        _digestInit(&digest, hashtype);
+        _digestAppend(&digest, data, length);
+        unsigned char md[SHA256_DIGEST_SIZE]; // The longest digest
+        int mdlength = _digestFinish(&digest, md);
+        if (mdlength <= 0)
+                return false;
+        Util_digest2Bytes(md, mdlength, result);
         return true;
 }
 
 
 void Util_printHash(char *file) {
-        MD_T hash;
-        unsigned char sha1[STRLEN], md5[STRLEN];
-        FILE *fhandle = NULL;
-
-        if (! (fhandle = file ? fopen(file, "r") : stdin) || ! Util_getStreamDigests(fhandle, sha1, md5) || (file && fclose(fhandle))) {
+        Hash_Type hashtype[] = {Hash_Sha1, Hash_Md5, Hash_Sha256, Hash_Xxh64};
+        MD_T hash[4];
+        int fd = -1;
+        if ((fd = file ? open(file, O_RDONLY) : STDIN_FILENO) == -1 || ! Util_getStreamDigests(fd, 4, hashtype, hash) || (file && close(fd))) {
                 printf("%s: %s\n", file, STRERROR);
                 exit(1);
         }
-        printf("SHA1(%s) = %s\n", file ? file : "stdin", Util_digest2Bytes(sha1, 20, hash));
-        printf("MD5(%s)  = %s\n", file ? file : "stdin", Util_digest2Bytes(md5, 16, hash));
+        printf("SHA1(%s)   = %s\n", file ? file : "stdin", hash[0]);
+        printf("MD5(%s)    = %s\n", file ? file : "stdin", hash[1]);
+        printf("SHA256(%s) = %s\n", file ? file : "stdin", hash[2]);
+        printf("XXH64(%s)  = %s\n", file ? file : "stdin", hash[3]);
 }
 
 
 boolean_t Util_getChecksum(char *file, Hash_Type hashtype, char *buf, int bufsize) {
-        int hashlength = 16;
-
         ASSERT(file);
         ASSERT(buf);
         ASSERT(bufsize >= sizeof(MD_T));
 
-        switch (hashtype) {
-                case Hash_Md5:
-                        hashlength = 16;
-                        break;
-                case Hash_Sha1:
-                        hashlength = 20;
-                        break;
-                default:
-                        LogError("checksum: invalid hash type: 0x%x\n", hashtype);
-                        return false;
+        if (! Util_getHashLength(hashtype)) {
+                LogError("checksum: invalid hash type: 0x%x\n", hashtype);
+                return false;
         }
 
         if (File_isFile(file)) {
-                FILE *f = fopen(file, "r");
-                if (f) {
-                        boolean_t fresult = false;
+                int fd = open(file, O_RDONLY);
+                if (fd != -1) {
                         MD_T sum;
+                        boolean_t fresult = Util_getStreamDigests(fd, 1, &hashtype, &sum);
 
-                        switch (hashtype) {
-                                case Hash_Md5:
-                                        fresult = Util_getStreamDigests(f, NULL, sum);
-                                        break;
-                                case Hash_Sha1:
-                                        fresult = Util_getStreamDigests(f, sum, NULL);
-                                        break;
-                                default:
-                                        break;
-                        }
-
-                        if (fclose(f))
+                        if (close(fd))
                                 LogError("checksum: error closing file '%s' -- %s\n", file, STRERROR);
 
                         if (! fresult) {
-                                LogError("checksum: file %s stream error (0x%x)\n", file, fresult);
+                                LogError("checksum: file %s read error -- %s\n", file, STRERROR);
                                 return false;
                         }
 
-                        Util_digest2Bytes((unsigned char *)sum, hashlength, buf);
+                        snprintf(buf, bufsize, "%s", sum);
                         return true;
 
                 } else
@@ -751,6 +927,16 @@ void Util_hmacMD5(const unsigned char *data, int datalen, const unsigned char *k
 
 Service_T Util_getService(const char *name) {
         ASSERT(name);
+        // The size is read first: the table is replaced by a larger one before the size changes, so the probe stays in the table
+        int size = __atomic_load_n(&serviceindex.size, __ATOMIC_ACQUIRE);
+        if (size) {
+                Service_T *table = __atomic_load_n(&serviceindex.table, __ATOMIC_ACQUIRE);
+                Service_T s;
+                for (unsigned int i = Str_hash(name) & (size - 1); (s = __atomic_load_n(&table[i], __ATOMIC_ACQUIRE)); i = (i + 1) & (size - 1))
+                        if (s != &tombstone && IS(s->name, name))
+                                return s;
+                return NULL;
+        }
         for (Service_T s = servicelist; s; s = s->next)
                 if (IS(s->name, name))
                         return s;
@@ -758,6 +944,231 @@ Service_T Util_getService(const char *name) {
 }
 
 
+void Util_indexService(Service_T s) {
+        ASSERT(s);
+        // Keep the load factor below 1/2, the tombstones are dropped when the table is rebuilt
+        if (2 * (serviceindex.count + 1) > serviceindex.size) {
+                int count = 0;
+                for (int i = 0; i < serviceindex.size; i++)
+                        if (serviceindex.table[i] && serviceindex.table[i] != &tombstone)
+                                count++;
+                int size = serviceindex.size ? serviceindex.size : 64;
+                while (4 * (count + 1) > size)
+                        size *= 2;
+                Service_T *table = CALLOC(size, sizeof(Service_T));
+                for (int i = 0; i < serviceindex.size; i++) {
+                        if (serviceindex.table[i] && serviceindex.table[i] != &tombstone) {
+                                unsigned int j = Str_hash(serviceindex.table[i]->name) & (size - 1);
+                                while (table[j])
+                                        j = (j + 1) & (size - 1);
+                                table[j] = serviceindex.table[i];
+                        }
+                }
+                if (serviceindex.table) {
+                        if (! serviceindex.retired)
+                                serviceindex.retired = List_new();
+                        List_append(serviceindex.retired, serviceindex.table);
+                }
+                __atomic_store_n(&serviceindex.table, table, __ATOMIC_RELEASE);
+                __atomic_store_n(&serviceindex.size, size, __ATOMIC_RELEASE);
+                serviceindex.count = count;
+        }
+        unsigned int i = Str_hash(s->name) & (serviceindex.size - 1);
+        while (serviceindex.table[i])
+                i = (i + 1) & (serviceindex.size - 1);
+        __atomic_store_n(&serviceindex.table[i], s, __ATOMIC_RELEASE);
+        serviceindex.count++;
+}
+
+
+void Util_unindexService(Service_T s) {
+        ASSERT(s);
+        if (! serviceindex.size)
+                return;
+        for (unsigned int i = Str_hash(s->name) & (serviceindex.size - 1); serviceindex.table[i]; i = (i + 1) & (serviceindex.size - 1)) {
+                if (serviceindex.table[i] == s) {
+                        __atomic_store_n(&serviceindex.table[i], &tombstone, __ATOMIC_RELEASE);
+                        break;
+                }
+        }
+}
+
+
+void Util_resetServiceIndex() {
+        FREE(serviceindex.table);
+        serviceindex.count = serviceindex.size = 0;
+        if (serviceindex.retired) {
+                while (List_length(serviceindex.retired) > 0) {
+                        Service_T *table = List_pop(serviceindex.retired);
+                        FREE(table);
+                }
+                List_free(&serviceindex.retired);
+        }
+}
+
+
+ServiceGroup_T Util_newServiceGroup(const char *name) {
+        ASSERT(name);
+        // The ids of the freed groups are reused, so the bitsets stay as small as the number of groups
+        int count = 0;
+        for (ServiceGroup_T g = servicegrouplist; g; g = g->next)
+                count++;
+        boolean_t *used = CALLOC(count + 1, sizeof(boolean_t));
+        for (ServiceGroup_T g = servicegrouplist; g; g = g->next)
+                if (g->id <= count)
+                        used[g->id] = true;
+        ServiceGroup_T g;
+        NEW(g);
+        while (used[g->id])
+                g->id++;
+        FREE(used);
+        g->name = Str_dup(name);
+        g->members = List_new();
+        g->next = servicegrouplist;
+        servicegrouplist = g;
+        return g;
+}
+
+
+ServiceGroup_T Util_getServiceGroup(const char *name) {
+        if (name)
+                for (ServiceGroup_T g = servicegrouplist; g; g = g->next)
+                        if (IS(g->name, name))
+                                return g;
+        return NULL;
+}
+
+
+void Util_groupService(Service_T s, ServiceGroup_T g) {
+        ASSERT(s);
+        ASSERT(g);
+        int word = g->id / 64;
+        if (word >= s->groupsSize) {
+                // The bitset grows while the service is parsed, before it is published
+                RESIZE(s->groups, (word + 1) * sizeof(unsigned long long));
+                memset(s->groups + s->groupsSize, 0, (word + 1 - s->groupsSize) * sizeof(unsigned long long));
+                s->groupsSize = word + 1;
+        }
+        s->groups[word] |= 1ULL << (g->id % 64);
+        List_append(g->members, s);
+}
+
+
+boolean_t Util_isGroupMember(Service_T s, ServiceGroup_T g) {
+        ASSERT(s);
+        ASSERT(g);
+        int word = g->id / 64;
+        return word < s->groupsSize && (s->groups[word] & (1ULL << (g->id % 64)));
+}
+
+
+void Util_ungroupService(Service_T s) {
+        ASSERT(s);
+        for (int i = 0; i < s->groupsSize; i++)
+                s->groups[i] = 0;
+        for (ServiceGroup_T *g = &servicegrouplist; *g;) {
+                List_remove((*g)->members, s);
+                if (List_length((*g)->members) == 0) {
+                        // The group was created for the service
+                        ServiceGroup_T e = *g;
+                        *g = e->next;
+                        List_free(&e->members);
+                        FREE(e->name);
+                        FREE(e);
+                } else {
+                        g = &(*g)->next;
+                }
+        }
+}
+
+
+/**
+ * Find the previous service with the same name, type and configuration fingerprint
+ */
+static ReusableService_T *_findReusable(ReusableService_T *table, int size, Service_T s) {
+        for (unsigned int i = Str_hash(s->name) & (size - 1); table[i].service; i = (i + 1) & (size - 1))
+                if (IS(table[i].service->name, s->name))
+                        return table[i].service->type == s->type && table[i].service->fingerprint == s->fingerprint ? &table[i] : NULL;
+        return NULL;
+}
+
+
+int Util_reuseServices(Service_T previous) {
+        int count = 0, size = 64;
+        for (Service_T s = previous; s; s = s->next)
+                count++;
+        while (size < 2 * count)
+                size *= 2;
+        ReusableService_T *table = CALLOC(size, sizeof(ReusableService_T));
+        for (Service_T s = previous; s; s = s->next) {
+                unsigned int i = Str_hash(s->name) & (size - 1);
+                while (table[i].service)
+                        i = (i + 1) & (size - 1);
+                table[i].service = s;
+        }
+        // Replace the new services by the previous ones in the check order list, the discarded ones are chained by the next link
+        int reused = 0;
+        Service_T discarded = NULL;
+        for (Service_T *s = &servicelist; *s; s = &(*s)->next) {
+                ReusableService_T *r = _findReusable(table, size, *s);
+                if (r) {
+                        Service_T n = *s;
+                        r->service->next = n->next;
+                        // The group ids are those of the new configuration
+                        unsigned long long *groups = r->service->groups;
+                        int groupsSize = r->service->groupsSize;
+                        r->service->groups = n->groups;
+                        r->service->groupsSize = n->groupsSize;
+                        n->groups = groups;
+                        n->groupsSize = groupsSize;
+                        r->reused = true;
+                        *s = r->service;
+                        n->next = discarded;
+                        discarded = n;
+                        reused++;
+                }
+        }
+        if (reused) {
+                for (Service_T s = servicelist; s; s = s->next)
+                        s->next_depend = s->next;
+                for (Service_T *s = &servicelist_conf; *s; s = &(*s)->next_conf) {
+                        ReusableService_T *r = _findReusable(table, size, *s);
+                        if (r) {
+                                r->service->next_conf = (*s)->next_conf;
+                                *s = r->service;
+                        }
+                }
+                for (ServiceGroup_T g = servicegrouplist; g; g = g->next) {
+                        for (list_t m = g->members->head; m; m = m->next) {
+                                ReusableService_T *r = _findReusable(table, size, m->e);
+                                if (r)
+                                        m->e = r->service;
+                        }
+                }
+                ReusableService_T *r = _findReusable(table, size, Run.system);
+                if (r)
+                        Run.system = r->service;
+                // Rebuild the service index and reconnect the dependencies, the previous services refer to the previous dependencies
+                Util_resetServiceIndex();
+                for (Service_T s = servicelist; s; s = s->next)
+                        Util_indexService(s);
+                for (Service_T s = servicelist; s; s = s->next)
+                        for (Dependant_T d = s->dependantlist; d; d = d->next)
+                                d->service = Util_getService(d->dependant);
+        }
+        while (discarded) {
+                Service_T s = discarded;
+                discarded = s->next;
+                gc_service(&s);
+        }
+        for (int i = 0; i < size; i++)
+                if (table[i].service && ! table[i].reused)
+                        gc_service(&table[i].service);
+        FREE(table);
+        return reused;
+}
+
+
 int Util_getNumberOfServices() {
         int i = 0;
         Service_T s;
@@ -784,6 +1195,10 @@ void Util_printRunList() {
         printf(" %-18s = %s\n", "Debug", Run.debug ? "True" : "False");
         printf(" %-18s = %s\n", "Log", (Run.flags & Run_Log) ? "True" : "False");
         printf(" %-18s = %s\n", "Use syslog", (Run.flags & Run_UseSyslog) ? "True" : "False");
+        printf(" %-18s = %s\n", "Asynchronous log", (Run.flags & Run_LogAsync) ? "True" : "False");
+        printf(" %-18s = %s\n", "Log format", Run.logging.format == LogFormat_Json ? "json" : Run.logging.format == LogFormat_Journal ? "journal" : "text");
+        if (Run.logging.rateLimit > 0)
+                printf(" %-18s = %d messages per %d seconds\n", "Log rate limit", Run.logging.rateLimit, Run.logging.rateInterval);
         printf(" %-18s = %s\n", "Is Daemon", (Run.flags & Run_Daemon) ? "True" : "False");
         printf(" %-18s = %s\n", "Use process engine", (Run.flags & Run_ProcessEngineEnabled) ? "True" : "False");
         printf(" %-18s = {\n", "Limits");
@@ -792,6 +1207,8 @@ void Util_printRunList() {
         printf(" %-18s =   fileContentBuffer: %s\n", " ", Str_bytesToSize(Run.limits.fileContentBuffer, buf));
         printf(" %-18s =   httpContentBuffer: %s\n", " ", Str_bytesToSize(Run.limits.httpContentBuffer, buf));
         printf(" %-18s =   networkTimeout:    %s\n", " ", Str_milliToTime(Run.limits.networkTimeout, (char[23]){}));
+        printf(" %-18s =   socketBuffer:      %s\n", " ", Str_bytesToSize(Run.limits.socketBuffer, buf));
+        printf(" %-18s =   logBuffer:         %s\n", " ", Str_bytesToSize(Run.limits.logBuffer, buf));
         printf(" %-18s = }\n", " ");
         printf(" %-18s = %d seconds with start delay %d seconds\n", "Poll time", Run.polltime, Run.startdelay);
 
@@ -887,7 +1304,8 @@ void Util_printRunList() {
                         printf(" %-18s = %s\n", "httpd bind address", Run.httpd.socket.net.address ? Run.httpd.socket.net.address : "Any/All");
                         printf(" %-18s = %d\n", "httpd portnumber", Run.httpd.socket.net.port);
                         printf(" %-18s = %s\n", "httpd ssl", Run.httpd.flags & Httpd_Ssl ? "Enabled" : "Disabled");
-                } else if (Run.httpd.flags & Httpd_Unix) {
+                }
+                if (Run.httpd.flags & Httpd_Unix) {
                         printf(" %-18s = %s\n", "httpd unix socket", Run.httpd.socket.unix.path);
                 }
                 printf(" %-18s = %s\n", "httpd signature", Run.httpd.flags & Httpd_Signature ? "Enabled" : "Disabled");
@@ -927,14 +1345,12 @@ void Util_printService(Service_T s) {
         printf("%-21s = %s\n", StringBuffer_toString(StringBuffer_append(buf, "%s Name", servicetypes[s->type])), s->name);
 
         for (ServiceGroup_T o = servicegrouplist; o; o = o->next) {
-                for (list_t m = o->members->head; m; m = m->next) {
-                        if (m->e == s) {
-                                if (! sgheader) {
-                                        printf(" %-20s = %s", "Group", o->name);
-                                        sgheader = true;
-                                } else {
-                                        printf(", %s", o->name);
-                                }
+                if (Util_isGroupMember(s, o)) {
+                        if (! sgheader) {
+                                printf(" %-20s = %s", "Group", o->name);
+                                sgheader = true;
+                        } else {
+                                printf(", %s", o->name);
                         }
                 }
         }
@@ -942,14 +1358,29 @@ void Util_printService(Service_T s) {
                 printf("\n");
 
         if (s->type == Service_Process) {
-                if (s->matchlist)
+                if (s->matchlist) {
                         printf(" %-20s = %s\n", "Match", s->path);
-                else
+                        if (s->matchlist->container)
+                                printf(" %-20s = %s\n", "Container", s->matchlist->container);
+                } else
                         printf(" %-20s = %s\n", "Pid file", s->path);
         } else if (s->type == Service_Host) {
                 printf(" %-20s = %s\n", "Address", s->path);
         } else if (s->type == Service_Net) {
                 printf(" %-20s = %s\n", "Interface", s->path);
+        } else if (s->type == Service_Socket) {
+                if (s->localport)
+                        printf(" %-20s = %d\n", "Port", s->localport);
+                if (s->path)
+                        printf(" %-20s = %s\n", "Pid file", s->path);
+        } else if (s->type == Service_Metric) {
+                if (Run.statsd.port)
+                        printf(" %-20s = %s:%d\n", "Statsd address", Run.statsd.address ? Run.statsd.address : STATSD_ADDRESS, Run.statsd.port);
+                if (Run.statsd.socket)
+                        printf(" %-20s = %s\n", "Statsd socket", Run.statsd.socket);
+        } else if (s->type == Service_Heartbeat) {
+                if (Run.heartbeat.socket)
+                        printf(" %-20s = %s\n", "Heartbeat socket", Run.heartbeat.socket);
         } else if (s->type != Service_System) {
                 printf(" %-20s = %s\n", "Path", s->path);
         }
@@ -1017,8 +1448,16 @@ void Util_printService(Service_T s) {
         }
 
         if (s->type == Service_Program) {
-                printf(" %-20s = ", "Program timeout");
-                printf("terminate the program if not finished within %d seconds\n", s->program->timeout);
+                if (s->program->plugin) {
+                        printf(" %-20s = fail if the check takes longer than %s\n", "Plugin timeout", Str_milliToTime(Plugin_getTimeout(s->program->plugin), (char[23]){}));
+                } else {
+                        printf(" %-20s = ", "Program timeout");
+                        printf("terminate the program if not finished within %d seconds\n", s->program->timeout);
+                }
+                if (s->program->outputLimit >= 0) {
+                        char limit[10];
+                        printf(" %-20s = keep the last %s\n", "Program output", Str_bytesToSize(s->program->outputLimit, limit));
+                }
                 for (Status_T o = s->statuslist; o; o = o->next) {
                         StringBuffer_clear(buf);
                         if (o->operator == Operator_Changed)
@@ -1128,6 +1567,11 @@ void Util_printService(Service_T s) {
                        );
         }
 
+        if (s->heartbeat) {
+                StringBuffer_clear(buf);
+                printf(" %-20s = %s\n", "Heartbeat", StringBuffer_toString(Util_printRule(buf, s->heartbeat->action, "if no heartbeat within %d second(s)", s->heartbeat->timeout)));
+        }
+
         for (Size_T o = s->sizelist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 printf(" %-20s = %s\n", "Size",
@@ -1157,7 +1601,10 @@ void Util_printService(Service_T s) {
         for (Bandwidth_T o = s->uploadbyteslist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 if (o->range == Time_Second) {
-                        printf(" %-20s = %s\n", "Upload bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
+                        if (o->rangecount > 1)
+                                printf(" %-20s = %s\n", "Upload bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s for %d seconds", operatornames[o->operator], Str_bytesToSize(o->limit, buffer), o->rangecount)));
+                        else
+                                printf(" %-20s = %s\n", "Upload bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
                 } else {
                         printf(" %-20s = %s\n", "Total upload bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s in last %d %s(s)", operatornames[o->operator], Str_bytesToSize(o->limit, buffer), o->rangecount, Util_timestr(o->range))));
                 }
@@ -1166,7 +1613,10 @@ void Util_printService(Service_T s) {
         for (Bandwidth_T o = s->uploadpacketslist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 if (o->range == Time_Second) {
-                        printf(" %-20s = %s\n", "Upload packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets/s", operatornames[o->operator], o->limit)));
+                        if (o->rangecount > 1)
+                                printf(" %-20s = %s\n", "Upload packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets/s for %d seconds", operatornames[o->operator], o->limit, o->rangecount)));
+                        else
+                                printf(" %-20s = %s\n", "Upload packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets/s", operatornames[o->operator], o->limit)));
                 } else {
                         printf(" %-20s = %s\n", "Total upload packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets in last %d %s(s)", operatornames[o->operator], o->limit, o->rangecount, Util_timestr(o->range))));
                 }
@@ -1175,7 +1625,10 @@ void Util_printService(Service_T s) {
         for (Bandwidth_T o = s->downloadbyteslist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 if (o->range == Time_Second) {
-                        printf(" %-20s = %s\n", "Download bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
+                        if (o->rangecount > 1)
+                                printf(" %-20s = %s\n", "Download bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s for %d seconds", operatornames[o->operator], Str_bytesToSize(o->limit, buffer), o->rangecount)));
+                        else
+                                printf(" %-20s = %s\n", "Download bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
                 } else {
                         printf(" %-20s = %s\n", "Total download bytes", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s in last %d %s(s)", operatornames[o->operator], Str_bytesToSize(o->limit, buffer), o->rangecount, Util_timestr(o->range))));
                 }
@@ -1184,7 +1637,10 @@ void Util_printService(Service_T s) {
         for (Bandwidth_T o = s->downloadpacketslist; o; o = o->next) {
                 StringBuffer_clear(buf);
                 if (o->range == Time_Second) {
-                        printf(" %-20s = %s\n", "Download packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets/s", operatornames[o->operator], o->limit)));
+                        if (o->rangecount > 1)
+                                printf(" %-20s = %s\n", "Download packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets/s for %d seconds", operatornames[o->operator], o->limit, o->rangecount)));
+                        else
+                                printf(" %-20s = %s\n", "Download packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets/s", operatornames[o->operator], o->limit)));
                 } else {
                         printf(" %-20s = %s\n", "Total downl. packets", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %lld packets in last %d %s(s)", operatornames[o->operator], o->limit, o->rangecount, Util_timestr(o->range))));
                 }
@@ -1195,6 +1651,16 @@ void Util_printService(Service_T s) {
                 printf(" %-20s = %s\n", "Uptime", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %llu second(s)", operatornames[o->operator], o->uptime)));
         }
 
+        for (ResponseTime_T o = s->responsetimelist; o; o = o->next) {
+                StringBuffer_clear(buf);
+                printf(" %-20s = %s\n", "Response time", StringBuffer_toString(Util_printRule(buf, o->action, "if p%d response time %s %s", o->percentile, operatornames[o->operator], Str_milliToTime(o->limit, (char[23]){}))));
+        }
+
+        for (Growth_T o = s->growthlist; o; o = o->next) {
+                StringBuffer_clear(buf);
+                printf(" %-20s = %s\n", "Growth", StringBuffer_toString(Util_printRule(buf, o->action, "if %s grows %s %s", o->metric, operatornames[o->operator], Util_formatGrowth(o, o->limit, (char[STRLEN]){}))));
+        }
+
         if (s->type != Service_Process) {
                 for (Match_T o = s->matchignorelist; o; o = o->next) {
                         StringBuffer_clear(buf);
@@ -1245,8 +1711,24 @@ void Util_printService(Service_T s) {
                 }
         }
 
+        for (Quota_T o = s->quotalist; o; o = o->next) {
+                char name[STRLEN];
+                StringBuffer_clear(buf);
+                snprintf(name, sizeof(name), "%s %s %d", o->inode ? "Quota inodes" : "Quota", quotatypenames[o->type], o->id);
+                if (o->limit_absolute > -1)
+                        printf(" %-20s = %s\n", name, StringBuffer_toString(o->inode ? Util_printRule(buf, o->action, "if %s %lld", operatornames[o->operator], o->limit_absolute) : Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Str_bytesToSize(o->limit_absolute, buffer))));
+                else
+                        printf(" %-20s = %s\n", name, StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.1f%%", operatornames[o->operator], o->limit_percent)));
+        }
+
         for (Resource_T o = s->resourcelist; o; o = o->next) {
                 StringBuffer_clear(buf);
+                if (o->average) {
+                        char name[STRLEN], limit[STRLEN];
+                        snprintf(name, sizeof(name), "Average %s", NVLSTR(Series_getMetric(s->type, o->resource_id)));
+                        printf(" %-20s = %s\n", name, StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s for %s", operatornames[o->operator], Series_formatValue(o->resource_id, o->limit, limit), Str_milliToTime(o->average * 1000., (char[23]){}))));
+                        continue;
+                }
                 switch (o->resource_id) {
                         case Resource_CpuPercent:
                                 printf(" %-20s = ", "CPU usage limit");
@@ -1268,6 +1750,14 @@ void Util_printService(Service_T s) {
                                 printf(" %-20s = ", "CPU wait limit");
                                 break;
 
+                        case Resource_CpuSteal:
+                                printf(" %-20s = ", "CPU steal limit");
+                                break;
+
+                        case Resource_CpuAny:
+                                printf(" %-20s = ", "Any CPU usage limit");
+                                break;
+
                         case Resource_MemoryPercent:
                                 printf(" %-20s = ", "Memory usage limit");
                                 break;
@@ -1311,6 +1801,177 @@ void Util_printService(Service_T s) {
                         case Resource_MemoryPercentTotal:
                                 printf(" %-20s = ", "Memory usage limit (incl. children)");
                                 break;
+
+                        case Resource_ReadBytes:
+                                printf(" %-20s = ", "Disk read limit");
+                                break;
+
+                        case Resource_WriteBytes:
+                                printf(" %-20s = ", "Disk write limit");
+                                break;
+
+                        case Resource_VoluntaryContextSwitches:
+                                printf(" %-20s = ", "Voluntary context switches");
+                                break;
+
+                        case Resource_NonvoluntaryContextSwitches:
+                                printf(" %-20s = ", "Nonvoluntary context switches");
+                                break;
+
+                        case Resource_FileDescriptors:
+                                printf(" %-20s = ", "File descriptors");
+                                break;
+
+                        case Resource_CgroupMemory:
+                                printf(" %-20s = ", "Cgroup memory limit");
+                                break;
+
+                        case Resource_Pressure:
+                        case Resource_CgroupPressure:
+                                {
+                                        char name[STRLEN];
+                                        Util_getPressureName(o, name, sizeof(name));
+                                        *name = toupper(*name);
+                                        printf(" %-20s = ", name);
+                                }
+                                break;
+
+                        case Resource_Meminfo:
+                                {
+                                        char name[STRLEN];
+                                        snprintf(name, sizeof(name), "Meminfo %s", o->meminfo);
+                                        printf(" %-20s = ", name);
+                                }
+                                break;
+
+                        case Resource_CgroupCpuPercent:
+                                printf(" %-20s = ", "Cgroup CPU usage limit");
+                                break;
+
+                        case Resource_CgroupReadBytes:
+                                printf(" %-20s = ", "Cgroup disk read limit");
+                                break;
+
+                        case Resource_CgroupWriteBytes:
+                                printf(" %-20s = ", "Cgroup disk write limit");
+                                break;
+
+                        case Resource_ThreadCpu:
+                                printf(" %-20s = ", "Thread CPU usage limit");
+                                break;
+
+                        case Resource_DirectorySize:
+                                printf(" %-20s = ", "Total size limit");
+                                break;
+
+                        case Resource_DirectoryFiles:
+                                printf(" %-20s = ", "Files");
+                                break;
+
+                        case Resource_DirectoryOldest:
+                                printf(" %-20s = ", "Oldest file");
+                                break;
+
+                        case Resource_DirectoryNewest:
+                                printf(" %-20s = ", "Newest file");
+                                break;
+
+                        case Resource_ReadOperations:
+                                printf(" %-20s = ", "Disk read operations");
+                                break;
+
+                        case Resource_WriteOperations:
+                                printf(" %-20s = ", "Disk write operations");
+                                break;
+
+                        case Resource_ServiceTime:
+                                printf(" %-20s = ", "Disk service time");
+                                break;
+
+                        case Resource_Utilization:
+                                printf(" %-20s = ", "Disk utilization");
+                                break;
+
+                        case Resource_SocketConnections:
+                                printf(" %-20s = ", "Connections");
+                                break;
+
+                        case Resource_SocketEstablished:
+                                printf(" %-20s = ", "Established");
+                                break;
+
+                        case Resource_SocketTimeWait:
+                                printf(" %-20s = ", "Time wait");
+                                break;
+
+                        case Resource_SocketCloseWait:
+                                printf(" %-20s = ", "Close wait");
+                                break;
+
+                        case Resource_SocketListen:
+                                printf(" %-20s = ", "Listen sockets");
+                                break;
+
+                        case Resource_SocketListenQueue:
+                                printf(" %-20s = ", "Listen queue");
+                                break;
+
+                        case Resource_SocketListenDrops:
+                                printf(" %-20s = ", "Listen drops");
+                                break;
+
+                        case Resource_MonitCycle:
+                                printf(" %-20s = ", "Monit cycle");
+                                break;
+
+                        case Resource_MonitMemory:
+                                printf(" %-20s = ", "Monit memory");
+                                break;
+
+                        case Resource_MonitQueue:
+                                printf(" %-20s = ", "Monit queue");
+                                break;
+
+                        case Resource_ProgramCpuTime:
+                                printf(" %-20s = ", "Program CPU time");
+                                break;
+
+                        case Resource_ProgramMemory:
+                                printf(" %-20s = ", "Program memory");
+                                break;
+
+                        case Resource_ProgramRunTime:
+                                printf(" %-20s = ", "Program run time");
+                                break;
+
+                        case Resource_MetricValue:
+                                printf(" %-20s = ", "Metric value");
+                                break;
+
+                        case Resource_MetricRate:
+                                printf(" %-20s = ", "Metric rate");
+                                break;
+
+                        case Resource_MetricMax:
+                                printf(" %-20s = ", "Metric max");
+                                break;
+
+                        case Resource_GpuUsage:
+                                printf(" %-20s = ", "GPU usage limit");
+                                break;
+
+                        case Resource_GpuMemoryPercent:
+                        case Resource_GpuMemory:
+                                printf(" %-20s = ", "GPU memory limit");
+                                break;
+
+                        case Resource_GpuTemperature:
+                                printf(" %-20s = ", "GPU temperature");
+                                break;
+
+                        case Resource_GpuEcc:
+                                printf(" %-20s = ", "GPU ECC errors");
+                                break;
                         default:
                                 break;
                 }
@@ -1321,14 +1982,28 @@ void Util_printService(Service_T s) {
                         case Resource_CpuUser:
                         case Resource_CpuSystem:
                         case Resource_CpuWait:
+                        case Resource_CpuSteal:
+                        case Resource_CpuAny:
                         case Resource_MemoryPercent:
                         case Resource_SwapPercent:
+                        case Resource_Pressure:
+                        case Resource_CgroupPressure:
+                        case Resource_CgroupCpuPercent:
+                        case Resource_ThreadCpu:
+                        case Resource_Utilization:
+                        case Resource_GpuUsage:
+                        case Resource_GpuMemoryPercent:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.1f%%", operatornames[o->operator], o->limit)));
                                 break;
 
                         case Resource_MemoryKbyte:
                         case Resource_SwapKbyte:
                         case Resource_MemoryKbyteTotal:
+                        case Resource_CgroupMemory:
+                        case Resource_DirectorySize:
+                        case Resource_MonitMemory:
+                        case Resource_ProgramMemory:
+                        case Resource_GpuMemory:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
                                 break;
 
@@ -1338,11 +2013,75 @@ void Util_printService(Service_T s) {
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.1f", operatornames[o->operator], o->limit)));
                                 break;
 
+                        case Resource_Meminfo:
+                                {
+                                        // The HugePages_* fields are counts, the others bytes
+                                        int i = Util_getMeminfo(&systeminfo, o->meminfo);
+                                        if (i >= 0 && ! systeminfo.meminfo.field[i].bytes)
+                                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.0f", operatornames[o->operator], o->limit)));
+                                        else
+                                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
+                                }
+                                break;
+
                         case Resource_Threads:
                         case Resource_Children:
+                        case Resource_FileDescriptors:
+                        case Resource_DirectoryFiles:
+                        case Resource_SocketConnections:
+                        case Resource_SocketEstablished:
+                        case Resource_SocketTimeWait:
+                        case Resource_SocketCloseWait:
+                        case Resource_SocketListen:
+                        case Resource_SocketListenQueue:
+                        case Resource_SocketListenDrops:
+                        case Resource_MonitQueue:
+                        case Resource_GpuEcc:
                                 printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.0f", operatornames[o->operator], o->limit)));
                                 break;
 
+                        case Resource_DirectoryOldest:
+                        case Resource_DirectoryNewest:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.0f second(s)", operatornames[o->operator], o->limit)));
+                                break;
+
+                        case Resource_ReadBytes:
+                        case Resource_WriteBytes:
+                        case Resource_CgroupReadBytes:
+                        case Resource_CgroupWriteBytes:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s/s", operatornames[o->operator], Str_bytesToSize(o->limit, buffer))));
+                                break;
+
+                        case Resource_VoluntaryContextSwitches:
+                        case Resource_NonvoluntaryContextSwitches:
+                        case Resource_ReadOperations:
+                        case Resource_WriteOperations:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.0f/s", operatornames[o->operator], o->limit)));
+                                break;
+
+                        case Resource_ServiceTime:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.3f ms", operatornames[o->operator], o->limit)));
+                                break;
+
+                        case Resource_MonitCycle:
+                        case Resource_ProgramCpuTime:
+                        case Resource_ProgramRunTime:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %s", operatornames[o->operator], Str_milliToTime(o->limit, (char[23]){}))));
+                                break;
+
+                        case Resource_MetricValue:
+                        case Resource_MetricMax:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %g", operatornames[o->operator], o->limit)));
+                                break;
+
+                        case Resource_MetricRate:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %g per second", operatornames[o->operator], o->limit)));
+                                break;
+
+                        case Resource_GpuTemperature:
+                                printf("%s", StringBuffer_toString(Util_printRule(buf, o->action, "if %s %.0f C", operatornames[o->operator], o->limit)));
+                                break;
+
                         default:
                                 break;
                 }
@@ -1352,9 +2091,11 @@ void Util_printService(Service_T s) {
         if (s->every.type == Every_SkipCycles)
                 printf(" %-20s = Check service every %d cycles\n", "Every", s->every.spec.cycle.number);
         else if (s->every.type == Every_Cron)
-                printf(" %-20s = Check service every %s\n", "Every", s->every.spec.cron);
+                printf(" %-20s = Check service every %s\n", "Every", s->every.spec.cron.string);
         else if (s->every.type == Every_NotInCron)
-                printf(" %-20s = Don't check service every %s\n", "Every", s->every.spec.cron);
+                printf(" %-20s = Don't check service every %s\n", "Every", s->every.spec.cron.string);
+        else if (s->every.type == Every_Interval)
+                printf(" %-20s = Check service every %d seconds\n", "Every", s->every.spec.interval.seconds);
 
         for (ActionRate_T o = s->actionratelist; o; o = o->next) {
                 StringBuffer_clear(buf);
@@ -1469,6 +2210,57 @@ pid_t Util_getPid(char *pidfile) {
 }
 
 
+pid_t Util_getServicePid(Service_T s) {
+        ASSERT(s);
+        ASSERT(s->path);
+        // Non-blocking open, so a fifo in place of the pidfile can't block the check
+        int fd = open(s->path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+                if (errno == ENOENT)
+                        DEBUG("pidfile '%s' does not exist\n", s->path);
+                else
+                        LogError("Error opening the pidfile '%s' -- %s\n", s->path, STRERROR);
+                s->pidfile.pid = 0;
+                return 0;
+        }
+        pid_t pid = 0;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+                LogError("Error getting the pidfile '%s' status -- %s\n", s->path, STRERROR);
+        } else if (! S_ISREG(st.st_mode)) {
+                LogError("pidfile '%s' is not a regular file\n", s->path);
+        } else {
+                unsigned long long mtime, ctime;
+                file_getStatTimes(&st, &mtime, &ctime);
+                if (s->pidfile.pid > 0 && s->pidfile.inode == (unsigned long long)st.st_ino && s->pidfile.size == (unsigned long long)st.st_size && s->pidfile.mtime == mtime) {
+                        pid = s->pidfile.pid;
+                } else {
+                        char buf[32];
+                        ssize_t n = read(fd, buf, sizeof(buf) - 1);
+                        long value = -1;
+                        if (n > 0) {
+                                buf[n] = 0;
+                                char *end;
+                                value = strtol(buf, &end, 10);
+                                if (end == buf)
+                                        value = -1;
+                        }
+                        if (value < 0) {
+                                LogError("Error reading pid from file '%s'\n", s->path);
+                        } else {
+                                pid = (pid_t)value;
+                                s->pidfile.inode = st.st_ino;
+                                s->pidfile.size = st.st_size;
+                                s->pidfile.mtime = mtime;
+                        }
+                }
+        }
+        close(fd);
+        s->pidfile.pid = pid;
+        return pid;
+}
+
+
 boolean_t Util_isurlsafe(const char *url) {
         ASSERT(url && *url);
         for (int i = 0; url[i]; i++)
@@ -1560,14 +2352,7 @@ void Util_redirectStdFds() {
 
 
 void Util_closeFds() {
-        int i;
-#ifdef HAVE_UNISTD_H
-        int max_descriptors = getdtablesize();
-#else
-        int max_descriptors = 1024;
-#endif
-        for (i = 3; i < max_descriptors; i++)
-                close(i);
+        System_closeDescriptors(3);
         errno = 0;
 }
 
@@ -1632,9 +2417,20 @@ boolean_t Util_checkCredentials(char *uname, char *outside) {
                         char salt[3];
                         char *temp;
                         snprintf(salt, 3, "%c%c", c->passwd[0], c->passwd[1]);
-                        temp = crypt(outside, salt);
-                        outside_crypt[sizeof(outside_crypt) - 1] = 0;
-                        strncpy(outside_crypt, temp, sizeof(outside_crypt) - 1);
+                        // crypt(3) returns a static buffer and the HTTP workers may check the credentials concurrently
+                        boolean_t ok = false;
+                        LOCK(cryptMutex)
+                        {
+                                if ((temp = crypt(outside, salt))) {
+                                        snprintf(outside_crypt, sizeof(outside_crypt), "%s", temp);
+                                        ok = true;
+                                }
+                        }
+                        END_LOCK;
+                        if (! ok) {
+                                LogError("Cannot generate crypt digest -- %s\n", STRERROR);
+                                return false;
+                        }
                         break;
                 }
 #ifdef HAVE_LIBPAM
@@ -1652,6 +2448,32 @@ boolean_t Util_checkCredentials(char *uname, char *outside) {
 }
 
 
+void Util_resetPressure(Pressure_T *pressure) {
+        for (int i = 0; i <= Pressure_Last; i++)
+                for (int j = 0; j < 3; j++)
+                        pressure[i].some[j] = pressure[i].full[j] = -1.;
+}
+
+
+float Util_getPressure(Pressure_T *pressure, Resource_T r) {
+        return r->pressure.full ? pressure[r->pressure.type].full[r->pressure.window] : pressure[r->pressure.type].some[r->pressure.window];
+}
+
+
+char *Util_getPressureName(Resource_T r, char *buf, int size) {
+        snprintf(buf, size, "%s%s pressure %s %s", r->resource_id == Resource_CgroupPressure ? "cgroup " : "", pressurenames[r->pressure.type], r->pressure.full ? "full" : "some", pressurewindownames[r->pressure.window]);
+        return buf;
+}
+
+
+int Util_getMeminfo(SystemInfo_T *si, const char *name) {
+        for (int i = 0; i < si->meminfo.count; i++)
+                if (Str_isEqual(si->meminfo.field[i].name, name))
+                        return i;
+        return -1;
+}
+
+
 void Util_resetInfo(Service_T s) {
         switch (s->type) {
                 case Service_Filesystem:
@@ -1670,6 +2492,12 @@ void Util_resetInfo(Service_T s) {
                         s->inf->priv.filesystem.mode = -1;
                         s->inf->priv.filesystem.uid = -1;
                         s->inf->priv.filesystem.gid = -1;
+                        s->inf->priv.filesystem.io.read_bytes = -1.;
+                        s->inf->priv.filesystem.io.write_bytes = -1.;
+                        s->inf->priv.filesystem.io.read_operations = -1.;
+                        s->inf->priv.filesystem.io.write_operations = -1.;
+                        s->inf->priv.filesystem.io.service_time = -1.;
+                        s->inf->priv.filesystem.io.utilization = -1.;
                         break;
                 case Service_File:
                         // persistent: st_inode, readpos
@@ -1680,12 +2508,18 @@ void Util_resetInfo(Service_T s) {
                         s->inf->priv.file.gid = -1;
                         s->inf->priv.file.timestamp = 0;
                         *s->inf->priv.file.cs_sum = 0;
+                        memset(&s->inf->priv.file.cs_cache, 0, sizeof(s->inf->priv.file.cs_cache));
                         break;
                 case Service_Directory:
                         s->inf->priv.directory.mode = -1;
                         s->inf->priv.directory.uid = -1;
                         s->inf->priv.directory.gid = -1;
                         s->inf->priv.directory.timestamp = 0;
+                        s->inf->priv.directory.tree.size = -1LL;
+                        s->inf->priv.directory.tree.files = -1LL;
+                        s->inf->priv.directory.tree.directories = -1LL;
+                        s->inf->priv.directory.tree.oldest = 0;
+                        s->inf->priv.directory.tree.newest = 0;
                         break;
                 case Service_Fifo:
                         s->inf->priv.fifo.mode = -1;
@@ -1711,14 +2545,52 @@ void Util_resetInfo(Service_T s) {
                         s->inf->priv.process.cpu_percent = -1.;
                         s->inf->priv.process.total_cpu_percent = -1.;
                         s->inf->priv.process.uptime = -1;
+                        s->inf->priv.process.filedescriptors = -1;
+                        s->inf->priv.process.read_rate = -1.;
+                        s->inf->priv.process.write_rate = -1.;
+                        s->inf->priv.process.voluntary_rate = -1.;
+                        s->inf->priv.process.nonvoluntary_rate = -1.;
+                        s->inf->priv.process.sample.pid = -1;
+                        s->inf->priv.process.cgroup.memory = -1LL;
+                        Util_resetPressure(s->inf->priv.process.cgroup.pressure);
+                        s->inf->priv.process.cgroup.cpu_percent = -1.;
+                        s->inf->priv.process.cgroup.read_rate = -1.;
+                        s->inf->priv.process.cgroup.write_rate = -1.;
+                        s->inf->priv.process.cgroup.sample.pid = -1;
+                        s->inf->priv.process.thread.cpu_percent = -1.;
+                        s->inf->priv.process.thread.pid = -1;
+                        s->inf->priv.process.thread.count = 0;
+                        s->inf->priv.process.gpu_memory = -1LL;
                         break;
                 case Service_Net:
                         if (s->inf->priv.net.stats)
                                 Link_reset(s->inf->priv.net.stats);
                         break;
+                case Service_Socket:
+                        s->inf->priv.socket.connections = -1;
+                        s->inf->priv.socket.established = -1;
+                        s->inf->priv.socket.timewait = -1;
+                        s->inf->priv.socket.closewait = -1;
+                        s->inf->priv.socket.listen = -1;
+                        s->inf->priv.socket.queue = -1;
+                        s->inf->priv.socket.backlog = -1;
+                        s->inf->priv.socket.drops = -1LL;
+                        s->inf->priv.socket._drops = -1LL;
+                        break;
+                case Service_Metric:
+                        s->inf->priv.metric.type = Metric_Unknown;
+                        s->inf->priv.metric.rate = -1.;
+                        break;
+                case Service_Heartbeat:
+                        s->inf->priv.heartbeat.age = -1LL;
+                        // The deadline starts again with the next check, the heartbeat data are kept
+                        if (s->heartbeat)
+                                s->heartbeat->started = 0LL;
+                        break;
                 default:
                         break;
         }
+        Snapshot_publish(s);
 }
 
 
@@ -1812,6 +2684,7 @@ void Util_monitorSet(Service_T s) {
         ASSERT(s);
         if (s->monitor == Monitor_Not) {
                 s->monitor = Monitor_Init;
+                s->generation++;
                 DEBUG("'%s' monitoring enabled\n", s->name);
                 State_save();
         }
@@ -1822,15 +2695,20 @@ void Util_monitorUnset(Service_T s) {
         ASSERT(s);
         if (s->monitor != Monitor_Not) {
                 s->monitor = Monitor_Not;
+                s->generation++;
                 DEBUG("'%s' monitoring disabled\n", s->name);
         }
         s->nstart = 0;
         s->ncycle = 0;
+        memset(&s->backoff, 0, sizeof(s->backoff));
+        memset(&s->adaptive, 0, sizeof(s->adaptive));
         if (s->every.type == Every_SkipCycles)
                 s->every.spec.cycle.counter = 0;
         s->error = Event_Null;
         if (s->eventlist)
                 gc_event(&s->eventlist);
+        if (s->eventtable.events)
+                memset(s->eventtable.events, 0, s->eventtable.size * sizeof(Event_T));
         Util_resetInfo(s);
         State_save();
 }
@@ -1907,6 +2785,31 @@ StringBuffer_T Util_printRule(StringBuffer_T buf, EventAction_T action, const ch
 }
 
 
+void Util_addResponseTime(Port_T p) {
+        ASSERT(p);
+        if (p->response < 0.)
+                return;
+        if (! p->responses.samples)
+                p->responses.samples = CALLOC(RESPONSE_SAMPLES, sizeof(float));
+        p->responses.samples[p->responses.next] = (float)p->response;
+        p->responses.next = (p->responses.next + 1) % RESPONSE_SAMPLES;
+        if (p->responses.count < RESPONSE_SAMPLES)
+                p->responses.count++;
+}
+
+
+double Util_getResponseTimePercentile(Port_T p, int percentile) {
+        ASSERT(p);
+        if (! p->responses.count)
+                return -1.;
+        float sorted[RESPONSE_SAMPLES];
+        memcpy(sorted, p->responses.samples, p->responses.count * sizeof(float));
+        qsort(sorted, p->responses.count, sizeof(float), _compareFloat);
+        int rank = (percentile * p->responses.count + 99) / 100;
+        return sorted[MAX(rank, 1) - 1];
+}
+
+
 const char *Util_portIpDescription(Port_T p) {
         switch (p->family) {
                 case Socket_Ip:
@@ -1937,6 +2840,8 @@ const char *Util_portRequestDescription(Port_T p) {
         char *request = "";
         if (p->protocol->check == check_http && p->parameters.http.request)
                 request = p->parameters.http.request;
+        else if (p->protocol->check == check_http2 && p->parameters.http2.requests && p->parameters.http2.requests->path && ! p->parameters.http2.requests->next)
+                request = p->parameters.http2.requests->path;
         else if (p->protocol->check == check_websocket && p->parameters.websocket.request)
                 request = p->parameters.websocket.request;
         return request;
@@ -1975,3 +2880,169 @@ const char *Util_timestr(int time) {
         return NULL;
 }
 
+
+char *Util_formatGrowth(Growth_T g, double value, char buf[STRLEN]) {
+        ASSERT(g);
+        ASSERT(buf);
+        char amount[STRLEN];
+        if (g->bytes) {
+                // Shrinking amounts are negative, Str_bytesToSize scales positive values only
+                amount[0] = '-';
+                Str_bytesToSize(value < 0. ? -value : value, value < 0. ? amount + 1 : amount);
+        } else
+                snprintf(amount, sizeof(amount), "%.1f", value);
+        snprintf(buf, STRLEN, "%s per %s", amount, Util_timestr(g->unit));
+        return buf;
+}
+
+
+
+int Util_getRegexLiteral(const char *pattern, char *literal, int size) {
+        ASSERT(pattern);
+        ASSERT(literal);
+        ASSERT(size > 0);
+        int best = 0, length = 0, depth = 0;
+        char current[STRLEN];
+        char longest[STRLEN];
+        for (const char *p = pattern; *p; p++) {
+                boolean_t quantifier = false;
+                const char *atom = NULL;
+                switch (*p) {
+                        case '|':
+                                if (depth == 0) {
+                                        // Top level alternation: no literal is required
+                                        *literal = 0;
+                                        return 0;
+                                }
+                                break;
+                        case '(':
+                                depth++;
+                                break;
+                        case ')':
+                                if (depth > 0)
+                                        depth--;
+                                break;
+                        case '[':
+                                // Skip the bracket expression, the closing bracket may be the first member of the list
+                                if (*(p + 1) == '^')
+                                        p++;
+                                if (*(p + 1) == ']')
+                                        p++;
+                                while (*(p + 1) && *(p + 1) != ']') {
+                                        p++;
+                                        if (*p == '[' && (*(p + 1) == ':' || *(p + 1) == '.' || *(p + 1) == '=')) {
+                                                char delimiter = *(p + 1);
+                                                for (p += 2; *p && ! (*p == delimiter && *(p + 1) == ']'); p++)
+                                                        ;
+                                                if (! *p)
+                                                        p--;
+                                                else
+                                                        p++;
+                                        }
+                                }
+                                if (*(p + 1))
+                                        p++;
+                                break;
+                        case '*':
+                        case '?':
+                        case '+':
+                        case '{':
+                                quantifier = true;
+                                break;
+                        case '.':
+                        case '^':
+                        case '$':
+                                break;
+                        case '\\':
+                                // Escaped special character is a literal, escaped alphanumeric character is a GNU extension (such as \w or \b)
+                                if (*(p + 1) && ! isalnum((unsigned char)*(p + 1)))
+                                        atom = ++p;
+                                else if (*(p + 1))
+                                        p++;
+                                break;
+                        default:
+                                atom = p;
+                                break;
+                }
+                if (atom && depth == 0) {
+                        if (length < (int)sizeof(current) - 1)
+                                current[length++] = *atom;
+                        continue;
+                }
+                if (quantifier) {
+                        // The quantified atom is optional (except for '+'), the literal run cannot continue after the quantifier
+                        if (*p != '+' && length > 0 && depth == 0)
+                                length--;
+                        if (*p == '{')
+                                while (*(p + 1) && *p != '}')
+                                        p++;
+                }
+                if (length > best) {
+                        best = length;
+                        memcpy(longest, current, length);
+                }
+                length = 0;
+        }
+        if (length > best) {
+                best = length;
+                memcpy(longest, current, length);
+        }
+        best = MIN(best, size - 1);
+        memcpy(literal, longest, best);
+        literal[best] = 0;
+        return best;
+}
+
+
+unsigned char *Util_gzip(const void *data, int length, int *compressed) {
+        ASSERT(data);
+        ASSERT(compressed);
+#ifdef HAVE_LIBZ
+        z_stream z = {};
+        // windowBits 15 + 16 writes the gzip header and trailer instead of the zlib ones
+        if (deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+                return NULL;
+        // The bound covers the compressed data and the gzip framing, so a single deflate call finishes the stream
+        int size = (int)deflateBound(&z, length);
+        unsigned char *result = ALLOC(size);
+        z.next_in = (Bytef *)data;
+        z.avail_in = length;
+        z.next_out = result;
+        z.avail_out = size;
+        int rv = deflate(&z, Z_FINISH);
+        *compressed = (int)z.total_out;
+        deflateEnd(&z);
+        if (rv == Z_STREAM_END && *compressed < length)
+                return result;
+        FREE(result);
+#endif
+        return NULL;
+}
+
+
+boolean_t Util_acceptsGzip(const char *acceptEncoding) {
+        double gzip = -1., any = -1.;
+        for (const char *p = acceptEncoding; p && *p; ) {
+                while (*p == ' ' || *p == '\t' || *p == ',')
+                        p++;
+                int n = (int)strcspn(p, " \t;,");
+                const char *coding = p;
+                const char *e = p + strcspn(p, ",");
+                double q = 1.;
+                const char *weight = memchr(p, ';', e - p);
+                if (weight) {
+                        for (weight++; *weight == ' ' || *weight == '\t'; weight++)
+                                ;
+                        if ((*weight == 'q' || *weight == 'Q') && sscanf(weight + 1, " = %lf", &q) != 1)
+                                q = 1.;
+                }
+                if (n == 4 && ! strncasecmp(coding, "gzip", 4))
+                        gzip = q;
+                else if (n == 1 && *coding == '*')
+                        any = q;
+                p = e;
+        }
+        // An explicit gzip entry takes precedence over the wildcard
+        return gzip >= 0. ? gzip > 0. : any > 0.;
+}
+
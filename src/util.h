@@ -82,20 +82,39 @@ char *Util_digest2Bytes(unsigned char *digest, int mdlen, MD_T result);
 
 
 /**
- * Compute SHA1 and MD5 message digests simultaneously for bytes read
- * from STREAM (suitable for stdin, which is not always rewindable).
- * The resulting message digest numbers will be written into the first
- * bytes of resblock buffers.
- * @param stream The stream from where the digests are computed
- * @param sha_resblock The buffer to write the SHA1 result to or NULL to skip the SHA1
- * @param md5_resblock The buffer to write the MD5 result to or NULL to skip the MD5
+ * Get the length of the hex encoded message digest of the given hash type
+ * @param hashtype The hash type
+ * @return The digest string length or 0 if the hash type is unknown
+ */
+int Util_getHashLength(Hash_Type hashtype);
+
+
+/**
+ * Compute message digests simultaneously for bytes read from the file
+ * descriptor (suitable for stdin, which is not always rewindable). The
+ * hex encoded digests are written to the result buffers.
+ * @param fd The file descriptor from where the digests are computed
+ * @param count The number of digests to compute
+ * @param hashtype Array of count hash types
+ * @param result Array of count buffers for the digests
+ * @return false if failed, otherwise true
+ */
+boolean_t Util_getStreamDigests(int fd, int count, const Hash_Type *hashtype, MD_T *result);
+
+
+/**
+ * Compute the hex encoded message digest of the buffer
+ * @param data The data
+ * @param length The data length
+ * @param hashtype The hash type
+ * @param result The buffer for the digest
  * @return false if failed, otherwise true
  */
-boolean_t Util_getStreamDigests(FILE *stream, void *sha_resblock, void *md5_resblock);
+boolean_t Util_getBufferDigest(const void *data, size_t length, Hash_Type hashtype, MD_T result);
 
 
 /**
- * Print MD5 and SHA1 hashes to standard output for given file or standard input
+ * Print MD5, SHA1, SHA256 and XXH64 hashes to standard output for given file or standard input
  * @param file The file for which the hashes will be printed or NULL for stdin
  */
 void Util_printHash(char *file);
@@ -104,7 +123,7 @@ void Util_printHash(char *file);
 /**
  * Store the checksum of given file in supplied buffer
  * @param file The file for which to compute the checksum
- * @param hashtype The hash type (Hash_Md5 or Hash_Sha1)
+ * @param hashtype The hash type (Hash_Md5, Hash_Sha1, Hash_Sha256 or Hash_Xxh64)
  * @param buf The buffer where the result will be stored
  * @param bufsize The size of the buffer
  * @return false if failed, otherwise true
@@ -130,6 +149,87 @@ void Util_hmacMD5(const unsigned char *data, int datalen, const unsigned char *k
 Service_T Util_getService(const char *name);
 
 
+/**
+ * Add the service to the service name index used by Util_getService(). The
+ * parser adds each service, the index is reset before the service list is
+ * freed (on reload and exit).
+ * @param s A service
+ */
+void Util_indexService(Service_T s);
+
+
+/**
+ * Remove the service from the service name index, used by the service
+ * discovery. The heartbeat and statsd listeners may hold the service for a
+ * moment after it was removed, so the caller defers freeing it.
+ * @param s A service
+ */
+void Util_unindexService(Service_T s);
+
+
+/**
+ * Remove all services from the service name index
+ */
+void Util_resetServiceIndex();
+
+
+/**
+ * Add a new service group with the lowest free group id to the service
+ * group list
+ * @param name The group name
+ * @return The new service group
+ */
+ServiceGroup_T Util_newServiceGroup(const char *name);
+
+
+/**
+ * Get the service group of the given name
+ * @param name The group name
+ * @return The service group or NULL if not found
+ */
+ServiceGroup_T Util_getServiceGroup(const char *name);
+
+
+/**
+ * Add the service to the service group members and set the group bit of
+ * the service
+ * @param s A service
+ * @param g A service group
+ */
+void Util_groupService(Service_T s, ServiceGroup_T g);
+
+
+/**
+ * Test if the service is a member of the group, a constant time bit test
+ * which works for a service snapshot too
+ * @param s A service
+ * @param g A service group
+ * @return true if the service is in the group otherwise false
+ */
+boolean_t Util_isGroupMember(Service_T s, ServiceGroup_T g);
+
+
+/**
+ * Remove the service from the service groups, the groups which are left
+ * empty are freed
+ * @param s A service
+ */
+void Util_ungroupService(Service_T s);
+
+
+/**
+ * Keep the services of the previous configuration whose name, type and
+ * configuration fingerprint didn't change on reload, so their runtime data
+ * (test baselines, link history, running programs) survive. The previous
+ * service replaces the new one in the service lists, the service groups and
+ * the dependencies, the new one is freed as are the previous services which
+ * were not reused.
+ * @param previous The service list of the previous configuration
+ * @return The number of reused services
+ */
+int Util_reuseServices(Service_T previous);
+
+
 /**
  * @param name A service name as stated in the config file
  * @return true if the service name exist in the
@@ -183,6 +283,16 @@ char *Util_monitId(char *idfile);
 pid_t Util_getPid(char *pidfile);
 
 
+/**
+ * Read the pid from the pidfile of the process service (Service_T.path).
+ * The parsed pid is cached with the inode, size and modification time of
+ * the pidfile, the file is read again only if it was rewritten or replaced.
+ * @param s A process service with the pidfile path
+ * @return the pid or 0 if the pid could not be read from the file
+ */
+pid_t Util_getServicePid(Service_T s);
+
+
 /**
  * Returns true if url contains url safe characters otherwise false
  * @param url an url string to test
@@ -233,9 +343,8 @@ void Util_redirectStdFds();
 
 
 /*
- * Close all filedescriptors except standard. Everything
- * seems to have getdtablesize, so we'll use it here, and back
- * out to use 1024 if getdtablesize not available.
+ * Close all filedescriptors except standard. Uses close_range(2)
+ * or closefrom(3) where available, see System_closeDescriptors().
  */
 
 void Util_closeFds();
@@ -267,6 +376,43 @@ boolean_t Util_checkCredentials(char *uname, char *outside);
 void Util_resetInfo(Service_T s);
 
 
+/**
+ * Reset the pressure stall information of all resources to not available
+ * @param pressure Array of Pressure_Last + 1 entries indexed by Pressure_Type
+ */
+void Util_resetPressure(Pressure_T *pressure);
+
+
+/**
+ * Get the pressure stall value selected by the resource test
+ * @param pressure Array of Pressure_Last + 1 entries indexed by Pressure_Type
+ * @param r A pressure resource test
+ * @return The stall share [%] or -1 if not available
+ */
+float Util_getPressure(Pressure_T *pressure, Resource_T r);
+
+
+/**
+ * Get the name of the value tested by the pressure resource test, for
+ * example "memory pressure some avg10"
+ * @param r A pressure resource test
+ * @param buf Output buffer
+ * @param size Size of the output buffer
+ * @return A pointer to buf
+ */
+char *Util_getPressureName(Resource_T r, char *buf, int size);
+
+
+/**
+ * Get a system memory statistic field by name, for example "Dirty"
+ * @param si The system information
+ * @param name The field name, the comparison is case insensitive
+ * @return The index of the field in si->meminfo.field or -1 if the
+ * field is not available
+ */
+int Util_getMeminfo(SystemInfo_T *si, const char *name);
+
+
 /**
  * Are service status data available?
  * @param s The service to test
@@ -393,6 +539,23 @@ const char *Util_portRequestDescription(Port_T p);
 char *Util_portDescription(Port_T p, char *buf, int bufsize);
 
 
+/**
+ * Add the last successful response time of the port to its ring of recent
+ * response times
+ * @param p A port structure
+ */
+void Util_addResponseTime(Port_T p);
+
+
+/**
+ * Get the percentile of the recent port response times (nearest rank)
+ * @param p A port structure
+ * @param percentile The percentile (1-99)
+ * @return The response time in milliseconds or -1 if no sample is available
+ */
+double Util_getResponseTimePercentile(Port_T p, int percentile);
+
+
 /**
  * Return string presentation of TIME_* unit
  *  @param time The TIME_* unit (see monit.h)
@@ -401,5 +564,51 @@ char *Util_portDescription(Port_T p, char *buf, int bufsize);
 const char *Util_timestr(int time);
 
 
+/**
+ * Format the growth rate of the metric tested by the growth rule, for
+ * example "10.5 MB per minute"
+ * @param g The growth rule
+ * @param value The growth per the time unit of the rule
+ * @param buf The output buffer
+ * @return A pointer to buf
+ */
+char *Util_formatGrowth(Growth_T g, double value, char buf[STRLEN]);
+
+
+/**
+ * Get the longest literal substring which must be present in any string
+ * matched by the given POSIX extended regular expression. The extraction
+ * is conservative: patterns with top-level alternation yield no literal.
+ * If the literal is longer than the buffer, its prefix is returned.
+ * @param pattern The regular expression
+ * @param literal Buffer for the literal
+ * @param size The buffer size
+ * @return The literal length, zero if the pattern has no required literal
+ */
+int Util_getRegexLiteral(const char *pattern, char *literal, int size);
+
+
+/**
+ * Compress the data in the gzip format (RFC 1952).
+ * @param data The data to compress
+ * @param length The data length
+ * @param compressed Output: the compressed data length
+ * @return The compressed data which the caller must free, or NULL if
+ * monit was built without zlib, the compression failed or the data did
+ * not get smaller
+ */
+unsigned char *Util_gzip(const void *data, int length, int *compressed);
+
+
+/**
+ * Check if the gzip content coding is acceptable according to the given
+ * Accept-Encoding header value (RFC 7231 section 5.3.4). A zero quality
+ * value refuses the coding.
+ * @param acceptEncoding The Accept-Encoding header value, may be NULL
+ * @return true if the gzip coding is acceptable, otherwise false
+ */
+boolean_t Util_acceptsGzip(const char *acceptEncoding);
+
+
 #endif
 
@@ -41,6 +41,10 @@
 #include <stdlib.h>
 #endif
 
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
 #ifdef HAVE_SIGNAL_H
 #include <signal.h>
 #endif
@@ -53,6 +57,14 @@
 #include <sys/types.h>
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
@@ -100,13 +112,39 @@
 #include "net.h"
 #include "device.h"
 #include "ProcessTree.h"
+#include "ProcessEvents.h"
+#include "fileevents.h"
+#include "linkevents.h"
+#include "plugin.h"
+#include "checksumpool.h"
+#include "delivery.h"
+#include "statussegment.h"
+#include "dirscan.h"
+#include "statbatch.h"
+#include "ioprobe.h"
+#include "fileset.h"
+#include "treesum.h"
+#include "socktable.h"
+#include "statsd.h"
+#include "ping.h"
+#include "udpbatch.h"
+#include "profiler.h"
+#include "counter.h"
+#include "snapshot.h"
+#include "series.h"
 #include "protocol.h"
+#include "probes.h"
+#include "portshare.h"
+#include "federation.h"
+#include "state.h"
 
 // libmonit
 #include "system/Time.h"
 #include "io/File.h"
 #include "io/InputStream.h"
 #include "exceptions/AssertException.h"
+#include "thread/Thread.h"
+#include "util/Arena.h"
 
 /**
  *  Implementation of validation engine
@@ -115,58 +153,324 @@
  */
 
 
+/* ------------------------------------------------------------- Definitions */
+
+
+/**
+ * The parallel check executor: the services are checked by a pool of worker
+ * threads which hold the executor mutex all the time except when they wait for
+ * network I/O. The events, actions and service state updates are thus serialized
+ * while the network latencies of different services overlap. A service is
+ * dispatched only after all services it depends on were checked in this cycle.
+ */
+typedef struct CheckJob_T {
+        Service_T service;
+        int pending;   // Number of dependencies not checked yet in this cycle
+        int offset;    // Dependants of this service in the executor.dependants array
+        int count;
+} CheckJob_T;
+
+
+static struct {
+        boolean_t active;
+        Mutex_T mutex;
+        Sem_T ready;             // Signalled when some job was finished
+        int count;
+        int done;
+        int head;
+        int tail;
+        int errors;
+        int *queue;              // Jobs ready to be dispatched
+        int *dependants;
+        CheckJob_T *jobs;
+} executor = {};
+
+
+/**
+ * A connection test which runs in its own thread, see _checkConnections()
+ */
+typedef struct PortProbe_T {
+        Service_T service;
+        Port_T port;
+        State_Type state;
+        char report[STRLEN];
+} PortProbe_T;
+
+
+/**
+ * The scheduler of services with own check interval ("every N seconds") and cron
+ * services ("every <cron>"): a binary min-heap ordered by the time of the next
+ * check. The heap is rebuilt in each poll cycle, between the cycles only the due
+ * services are popped and checked. The deadline of a service can be postponed by
+ * a check in the poll cycle, so the key stored in the heap can be older than the
+ * service deadline: such entries are reinserted with the current deadline when
+ * popped.
+ */
+typedef struct ScheduledCheck_T {
+        long long deadline;
+        Service_T service;
+} ScheduledCheck_T;
+
+
+static struct {
+        int count;
+        int size;
+        ScheduledCheck_T *heap;
+} scheduler = {};
+
+
+/**
+ * The cycle budget (set cycle budget) bounds the time of the checks in one
+ * validate() cycle. When the deadline passed, the remaining services are
+ * deferred to the next cycle, except the services with high priority, the
+ * programs and the services deferred in the last cycle, so a service is
+ * deferred at most one cycle in a row. The workers count the deferrals.
+ */
+static struct {
+        long long deadline;     /**< The checks are deferred after [ms], 0 = none */
+        int count;                       /**< Checks deferred in this cycle */
+} budget = {};
+
+
+/**
+ * The scratch memory of the validate cycle, such as the executor jobs and
+ * the action batches. It is used by the validate thread only and released
+ * as a whole at the start of the next cycle.
+ */
+#define CYCLE_ARENA 16384
+static Arena_T cycleArena = NULL;
+
+
+/* Set by the SIGCHLD handler when some child exited, see validate_childexit() */
+static volatile sig_atomic_t childExited = 0;
+
+
+/**
+ * The content match reader: the file is read in large blocks and the lines are
+ * matched in place (the '\n' is replaced with '\0' in the block), instead of
+ * a seek and a stdio read per line. The position is the file offset of the
+ * first line which was not returned yet.
+ */
+#define TAILER_BLOCK 262144
+
+
+typedef struct Tailer_T {
+        int fd;
+        boolean_t error;
+        off_t position;
+        size_t start;                               // The first byte of the next line
+        size_t end;                                 // The end of the data read
+        size_t size;
+        char *buffer;
+} Tailer_T;
+
+
+/* The number of the members listed in a file set event, the rest is only counted */
+#define FILESET_REPORT 10
+
+
+/* The members which failed or changed in a file set test */
+typedef struct FileSetReport_T {
+        int count;
+        StringBuffer_T members;
+} FileSetReport_T;
+
+
 /* ----------------------------------------------------------------- Private */
 
 
 /**
- * Read program output into stringbuffer. Limit the output per Run.limits.programOutput
+ * Let other check workers run while this one waits for network I/O
  */
-static void _programOutput(InputStream_T I, StringBuffer_T S) {
-        int n;
-        char buf[STRLEN];
-        InputStream_setTimeout(I, 0);
-        do {
-                n = InputStream_readBytes(I, buf, sizeof(buf) - 1);
-                if (n) {
-                        buf[n] = 0;
-                        StringBuffer_append(S, "%s", buf);
-                }
-        } while (n > 0 && StringBuffer_length(S) < Run.limits.programOutput);
+static inline void _executorRelease() {
+        if (executor.active)
+                Mutex_unlock(executor.mutex);
+}
+
+
+static inline void _executorAcquire() {
+        if (executor.active)
+                Mutex_lock(executor.mutex);
 }
 
 
 /**
- * Test the connection and protocol
+ * Test the connection and protocol, retry on failure. The test doesn't post
+ * events, so it can run without the executor lock. The same test of another
+ * service in this pass is done only once, see portshare.h
  */
-static State_Type _checkConnection(Service_T s, Port_T p) {
-        ASSERT(s);
-        ASSERT(p);
+static State_Type _testConnection(Service_T s, Port_T p, char *report, int reportlen) {
         volatile int retry_count = p->retry;
         volatile State_Type rv = State_Succeeded;
         char buf[STRLEN];
-        char report[STRLEN] = {};
+        State_Type shared;
+        if (PortShare_acquire(p, &shared, report, reportlen)) {
+                DEBUG("'%s' shared the protocol [%s] test result at %s\n", s->name, p->protocol->name, Util_portDescription(p, buf, sizeof(buf)));
+                return shared;
+        }
 retry:
+        PROBE2(socket_test_start, s->name, p->protocol->name);
         TRY
         {
-                Socket_test(p);
+                if (! UdpBatch_test(p))
+                        Socket_test(p);
                 rv = State_Succeeded;
-                DEBUG("'%s' succeeded testing protocol [%s] at %s [response time %s]\n", s->name, p->protocol->name, Util_portDescription(p, buf, sizeof(buf)), Str_milliToTime(p->response, (char[23]){}));
         }
         ELSE
         {
                 rv = State_Failed;
-                snprintf(report, STRLEN, "failed protocol test [%s] at %s -- %s", p->protocol->name, Util_portDescription(p, buf, sizeof(buf)), Exception_frame.message);
+                snprintf(report, reportlen, "failed protocol test [%s] at %s -- %s", p->protocol->name, Util_portDescription(p, buf, sizeof(buf)), Exception_frame.message);
         }
         END_TRY;
-        if (rv == State_Failed) {
-                if (retry_count-- > 1) {
-                        DEBUG("'%s' %s (attempt %d/%d)\n", s->name, report, p->retry - retry_count, p->retry);
-                        goto retry;
-                }
+        PROBE3(socket_test_done, s->name, p->protocol->name, rv);
+        if (rv == State_Succeeded) {
+                DEBUG("'%s' succeeded testing protocol [%s] at %s [response time %s]\n", s->name, p->protocol->name, Util_portDescription(p, buf, sizeof(buf)), Str_milliToTime(p->response, (char[23]){}));
+        } else if (retry_count-- > 1) {
+                DEBUG("'%s' %s (attempt %d/%d)\n", s->name, report, p->retry - retry_count, p->retry);
+                goto retry;
+        }
+        PortShare_release(p, rv, report);
+        return rv;
+}
+
+
+static void _postConnection(Service_T s, Port_T p, State_Type state, const char *report) {
+        if (state == State_Failed) {
                 Event_post(s, Event_Connection, State_Failed, p->action, "%s", report);
         } else {
-                Event_post(s, Event_Connection, State_Succeeded, p->action, "connection succeeded to %s", Util_portDescription(p, buf, sizeof(buf)));
+                Util_addResponseTime(p);
+                Series_recordResponse(s, p);
+                Event_post(s, Event_Connection, State_Succeeded, p->action, "connection succeeded to %s", Util_portDescription(p, (char[STRLEN]){}, STRLEN));
+        }
+}
+
+
+/**
+ * Test the response time percentiles of the ports and unix sockets. A rule
+ * fails if the percentile of any of them matches, the slowest is reported
+ */
+static State_Type _checkResponseTimes(Service_T s) {
+        ASSERT(s);
+        State_Type rv = State_Succeeded;
+        for (ResponseTime_T r = s->responsetimelist; r; r = r->next) {
+                Port_T worst = NULL;
+                double value = -1.;
+                Port_T lists[] = {s->portlist, s->socketlist};
+                for (int i = 0; i < 2; i++) {
+                        for (Port_T p = lists[i]; p; p = p->next) {
+                                double percentile = Util_getResponseTimePercentile(p, r->percentile);
+                                if (percentile >= 0. && (! worst || percentile > value)) {
+                                        worst = p;
+                                        value = percentile;
+                                }
+                        }
+                }
+                if (! worst) {
+                        DEBUG("'%s' response time test skipped -- no response time collected yet\n", s->name);
+                        continue;
+                }
+                char description[STRLEN];
+                Util_portDescription(worst, description, sizeof(description));
+                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                        rv = State_Failed;
+                        Event_post(s, Event_Connection, State_Failed, r->action, "p%d response time of %s is %s over the last %d tests, matches resource limit [p%d response time %s %s]", r->percentile, description, Str_milliToTime(value, (char[23]){}), worst->responses.count, r->percentile, operatorshortnames[r->operator], Str_milliToTime(r->limit, (char[23]){}));
+                } else {
+                        Event_post(s, Event_Connection, State_Succeeded, r->action, "p%d response time test succeeded [p%d response time of %s is %s]", r->percentile, r->percentile, description, Str_milliToTime(value, (char[23]){}));
+                }
+        }
+        return rv;
+}
+
+
+/**
+ * Test the growth rates of the recorded metrics. The rate is the slope of
+ * the metric over the last time unit of the rule, see Series_rate()
+ */
+static State_Type _checkGrowth(Service_T s) {
+        ASSERT(s);
+        State_Type rv = State_Succeeded;
+        for (Growth_T g = s->growthlist; g; g = g->next) {
+                double rate;
+                if (! Series_rate(s, g->metric, g->unit, &rate)) {
+                        DEBUG("'%s' %s growth check skipped (collecting samples)\n", s->name, g->metric);
+                        continue;
+                }
+                rate *= g->unit;
+                char buf1[STRLEN], buf2[STRLEN];
+                if (Util_evalDoubleQExpression(g->operator, rate, g->limit)) {
+                        rv = State_Failed;
+                        Event_post(s, Event_Resource, State_Failed, g->action, "%s growth of %s matches resource limit [%s growth%s%s]", g->metric, Util_formatGrowth(g, rate, buf1), g->metric, operatorshortnames[g->operator], Util_formatGrowth(g, g->limit, buf2));
+                } else {
+                        Event_post(s, Event_Resource, State_Succeeded, g->action, "%s growth check succeeded [current %s growth=%s]", g->metric, g->metric, Util_formatGrowth(g, rate, buf1));
+                }
+        }
+        return rv;
+}
+
+
+/**
+ * Test the connection and protocol
+ */
+static State_Type _checkConnection(Service_T s, Port_T p) {
+        ASSERT(s);
+        ASSERT(p);
+        char report[STRLEN] = {};
+        _executorRelease();
+        State_Type rv = _testConnection(s, p, report, sizeof(report));
+        _executorAcquire();
+        _postConnection(s, p, rv, report);
+        return rv;
+}
+
+
+static void *_probeConnection(void *args) {
+        set_signal_block();
+        PortProbe_T *probe = args;
+        probe->state = _testConnection(probe->service, probe->port, probe->report, sizeof(probe->report));
+        return NULL;
+}
+
+
+/**
+ * Test the connections in the port list. If the parallel check is enabled, the
+ * ports are probed concurrently (at most Run.checkEngine.workers at once), so
+ * the service check takes about as long as the slowest port. The events are
+ * posted in the port list order when all probes finished
+ */
+static State_Type _checkConnections(Service_T s, Port_T list) {
+        State_Type rv = State_Succeeded;
+        int count = 0;
+        for (Port_T p = list; p; p = p->next)
+                count++;
+        if (Run.checkEngine.workers < 2 || count < 2) {
+                for (Port_T p = list; p; p = p->next)
+                        if (_checkConnection(s, p) == State_Failed)
+                                rv = State_Failed;
+                return rv;
+        }
+        PortProbe_T *probes = CALLOC(count, sizeof(PortProbe_T));
+        Thread_T *threads = CALLOC(count, sizeof(Thread_T));
+        int i = 0;
+        for (Port_T p = list; p; p = p->next, i++) {
+                probes[i].service = s;
+                probes[i].port = p;
+        }
+        _executorRelease();
+        for (int batch = 0; batch < count; batch += Run.checkEngine.workers) {
+                int end = MIN(count, batch + Run.checkEngine.workers);
+                for (i = batch; i < end; i++)
+                        Thread_create(threads[i], _probeConnection, &probes[i]);
+                for (i = batch; i < end; i++)
+                        Thread_join(threads[i]);
         }
+        _executorAcquire();
+        for (i = 0; i < count; i++) {
+                _postConnection(s, probes[i].port, probes[i].state, probes[i].report);
+                if (probes[i].state == State_Failed)
+                        rv = State_Failed;
+        }
+        FREE(threads);
+        FREE(probes);
         return rv;
 }
 
@@ -221,6 +525,63 @@ static State_Type _checkProcessPpid(Service_T s) {
 }
 
 
+/**
+ * Check the average of the resource over the window, from the time-series store
+ */
+static State_Type _checkAverageResource(Service_T s, Resource_T r) {
+        State_Type rv = State_Succeeded;
+        char report[STRLEN] = {}, buf1[STRLEN], buf2[STRLEN];
+        const char *metric = Series_getMetric(s->type, r->resource_id);
+        double average;
+        if (! metric) {
+                LogError("'%s' error -- the resource ID %d cannot be averaged\n", s->name, r->resource_id);
+                return State_Failed;
+        } else if (! Series_average(s, metric, r->average, &average)) {
+                DEBUG("'%s' average %s check skipped (collecting %s of samples)\n", s->name, metric, Str_milliToTime(r->average * 1000., (char[23]){}));
+                return State_Init;
+        } else if (Util_evalDoubleQExpression(r->operator, average, r->limit)) {
+                rv = State_Failed;
+                snprintf(report, STRLEN, "average %s of %s over %s matches resource limit [average %s%s%s]", metric, Series_formatValue(r->resource_id, average, buf1), Str_milliToTime(r->average * 1000., (char[23]){}), metric, operatorshortnames[r->operator], Series_formatValue(r->resource_id, r->limit, buf2));
+        } else {
+                snprintf(report, STRLEN, "average %s check succeeded [current average %s over %s=%s]", metric, metric, Str_milliToTime(r->average * 1000., (char[23]){}), Series_formatValue(r->resource_id, average, buf1));
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/**
+ * Get the GPU statistic of the resource test
+ */
+static double _gpuValue(Resource_Type id, GpuDevice_T *device) {
+        switch (id) {
+                case Resource_GpuUsage:          return device->usage;
+                case Resource_GpuMemoryPercent:  return device->memory_percent;
+                case Resource_GpuMemory:         return device->memory;
+                case Resource_GpuTemperature:    return device->temperature;
+                default:                         return device->ecc;
+        }
+}
+
+
+/**
+ * Get the GPU with the highest value of the resource test, so a system test
+ * matches if any GPU matches
+ * @return The device index or -1 if the value is not available
+ */
+static int _gpuHighest(Resource_Type id, double *value) {
+        int highest = -1;
+        for (int i = 0; i < systeminfo.gpu.count; i++) {
+                double v = _gpuValue(id, &systeminfo.gpu.device[i]);
+                if (v >= 0. && (highest < 0 || v > *value)) {
+                        highest = i;
+                        *value = v;
+                }
+        }
+        return highest;
+}
+
+
 /**
  * Check process resources
  */
@@ -229,6 +590,8 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
         ASSERT(r);
         State_Type rv = State_Succeeded;
         char report[STRLEN] = {}, buf1[STRLEN], buf2[STRLEN];
+        if (r->average)
+                return _checkAverageResource(s, r);
         switch (r->resource_id) {
                 case Resource_CpuPercent:
                         {
@@ -303,6 +666,52 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         }
                         break;
 
+                case Resource_CpuSteal:
+                        if (systeminfo.total_cpu_steal_percent < 0.) {
+                                DEBUG("'%s' cpu steal check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, systeminfo.total_cpu_steal_percent, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "cpu steal of %.1f%% matches resource limit [cpu steal%s%.1f%%]", systeminfo.total_cpu_steal_percent, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "cpu steal check succeeded [current cpu steal=%.1f%%]", systeminfo.total_cpu_steal_percent);
+                        }
+                        break;
+
+                case Resource_CpuAny:
+                        {
+                                // The busiest matching CPU is reported, the total usage is used if the per-CPU statistics are not available
+                                int cpu = -1, busiest = -1;
+                                for (int i = 0; i < systeminfo.cpu.count; i++) {
+                                        float usage = systeminfo.cpu.usage[i];
+                                        if (usage < 0.)
+                                                continue;
+                                        if (busiest < 0 || usage > systeminfo.cpu.usage[busiest])
+                                                busiest = i;
+                                        if (Util_evalDoubleQExpression(r->operator, usage, r->limit) && (cpu < 0 || usage > systeminfo.cpu.usage[cpu]))
+                                                cpu = i;
+                                }
+                                if (busiest < 0) {
+                                        if (systeminfo.cpu.count > 0 || systeminfo.total_cpu_user_percent < 0.) {
+                                                DEBUG("'%s' any cpu usage check skipped (initializing)\n", s->name);
+                                                return State_Init;
+                                        }
+                                        float usage = systeminfo.total_cpu_user_percent + (systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.);
+                                        if (Util_evalDoubleQExpression(r->operator, usage, r->limit)) {
+                                                rv = State_Failed;
+                                                snprintf(report, STRLEN, "cpu usage of %.1f%% matches resource limit [any cpu usage%s%.1f%%]", usage, operatorshortnames[r->operator], r->limit);
+                                        } else {
+                                                snprintf(report, STRLEN, "any cpu usage check succeeded [current cpu usage=%.1f%%]", usage);
+                                        }
+                                } else if (cpu >= 0) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "cpu %d usage of %.1f%% matches resource limit [any cpu usage%s%.1f%%]", cpu, systeminfo.cpu.usage[cpu], operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "any cpu usage check succeeded [current highest usage=%.1f%% on cpu %d]", systeminfo.cpu.usage[busiest], busiest);
+                                }
+                        }
+                        break;
+
                 case Resource_MemoryPercent:
                         if (s->type == Service_System) {
                                 if (Util_evalDoubleQExpression(r->operator, systeminfo.total_mem_percent, r->limit)) {
@@ -442,72 +851,923 @@ static State_Type _checkProcessResources(Service_T s, Resource_T r) {
                         }
                         break;
 
-                default:
-                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
-                        return State_Failed;
-        }
-        Event_post(s, Event_Resource, rv, r->action, "%s", report);
-        return rv;
-}
+                case Resource_ReadBytes:
+                case Resource_WriteBytes:
+                        {
+                                const char *direction = r->resource_id == Resource_ReadBytes ? "read" : "write";
+                                double rate = r->resource_id == Resource_ReadBytes ? s->inf->priv.process.read_rate : s->inf->priv.process.write_rate;
+                                if (rate < 0.) {
+                                        DEBUG("'%s' process disk %s rate check skipped (initializing)\n", s->name, direction);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, rate, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "disk %s rate of %s/s matches resource limit [disk %s%s%s/s]", direction, Str_bytesToSize(rate, buf1), direction, operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                                } else {
+                                        snprintf(report, STRLEN, "disk %s rate check succeeded [current disk %s rate=%s/s]", direction, direction, Str_bytesToSize(rate, buf1));
+                                }
+                        }
+                        break;
 
+                case Resource_VoluntaryContextSwitches:
+                case Resource_NonvoluntaryContextSwitches:
+                        {
+                                const char *kind = r->resource_id == Resource_VoluntaryContextSwitches ? "voluntary" : "nonvoluntary";
+                                double rate = r->resource_id == Resource_VoluntaryContextSwitches ? s->inf->priv.process.voluntary_rate : s->inf->priv.process.nonvoluntary_rate;
+                                if (rate < 0.) {
+                                        DEBUG("'%s' process %s context switches check skipped (initializing)\n", s->name, kind);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, rate, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "%s context switches rate of %.1f/s matches resource limit [%s context switches%s%.0f/s]", kind, rate, kind, operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "%s context switches check succeeded [current %s context switches=%.1f/s]", kind, kind, rate);
+                                }
+                        }
+                        break;
 
-/**
- * Test for associated path checksum change
- */
-static State_Type _checkChecksum(Service_T s) {
-        ASSERT(s);
-        ASSERT(s->path);
-        State_Type rv = State_Succeeded;
-        if (s->checksum) {
-                Checksum_T cs = s->checksum;
-                if (Util_getChecksum(s->path, cs->type, s->inf->priv.file.cs_sum, sizeof(s->inf->priv.file.cs_sum))) {
-                        Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "checksum %s", s->inf->priv.file.cs_sum);
-                        if (! cs->initialized) {
-                                cs->initialized = true;
-                                strncpy(cs->hash, s->inf->priv.file.cs_sum, sizeof(cs->hash));
+                case Resource_FileDescriptors:
+                        if (s->inf->priv.process.filedescriptors < 0) {
+                                DEBUG("'%s' process file descriptors count check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.process.filedescriptors, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "file descriptors count %i matches resource limit [file descriptors%s%.0f]", s->inf->priv.process.filedescriptors, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "file descriptors check succeeded [current file descriptors=%i]", s->inf->priv.process.filedescriptors);
                         }
-                        int changed;
-                        switch (cs->type) {
-                                case Hash_Md5:
-                                        changed = strncmp(cs->hash, s->inf->priv.file.cs_sum, 32);
-                                        break;
-                                case Hash_Sha1:
-                                        changed = strncmp(cs->hash, s->inf->priv.file.cs_sum, 40);
-                                        break;
-                                default:
-                                        LogError("'%s' unknown hash type (%d)\n", s->name, cs->type);
-                                        *s->inf->priv.file.cs_sum = 0;
-                                        return State_Failed;
+                        break;
+
+                case Resource_CgroupMemory:
+                        if (s->inf->priv.process.cgroup.memory < 0) {
+                                DEBUG("'%s' cgroup memory usage check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.process.cgroup.memory, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "cgroup mem amount of %s matches resource limit [cgroup mem amount%s%s]", Str_bytesToSize(s->inf->priv.process.cgroup.memory, buf1), operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                        } else {
+                                snprintf(report, STRLEN, "cgroup mem amount check succeeded [current cgroup mem amount=%s]", Str_bytesToSize(s->inf->priv.process.cgroup.memory, buf1));
                         }
-                        if (changed) {
-                                if (cs->test_changes) {
-                                        rv = State_Changed;
-                                        /* reset expected value for next cycle */
-                                        strncpy(cs->hash, s->inf->priv.file.cs_sum, sizeof(cs->hash));
-                                        /* if we are testing for changes only, the value is variable */
-                                        Event_post(s, Event_Checksum, State_Changed, cs->action, "checksum changed to %s", s->inf->priv.file.cs_sum);
+                        break;
+
+                case Resource_Pressure:
+                case Resource_CgroupPressure:
+                        {
+                                float pressure = Util_getPressure(r->resource_id == Resource_Pressure ? systeminfo.pressure : s->inf->priv.process.cgroup.pressure, r);
+                                char name[64]; // The longest name is "cgroup memory pressure some avg300"
+                                Util_getPressureName(r, name, sizeof(name));
+                                if (pressure < 0.) {
+                                        DEBUG("'%s' %s check skipped (initializing or not available)\n", s->name, name);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, pressure, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "%s of %.1f%% matches resource limit [%s%s%.1f%%]", name, pressure, name, operatorshortnames[r->operator], r->limit);
                                 } else {
-                                        /* we are testing constant value for failed or succeeded state */
+                                        snprintf(report, STRLEN, "%s check succeeded [current %s=%.1f%%]", name, name, pressure);
+                                }
+                        }
+                        break;
+
+                case Resource_Meminfo:
+                        {
+                                int i = Util_getMeminfo(&systeminfo, r->meminfo);
+                                if (i < 0) {
+                                        DEBUG("'%s' meminfo %s check skipped (initializing or not available)\n", s->name, r->meminfo);
+                                        return State_Init;
+                                }
+                                uint64_t value = systeminfo.meminfo.field[i].value;
+                                // The values are short, so the report with the field name always fits in STRLEN
+                                char current[32], limit[32];
+                                if (systeminfo.meminfo.field[i].bytes) {
+                                        Str_bytesToSize(value, current);
+                                        Str_bytesToSize(r->limit, limit);
+                                } else {
+                                        snprintf(current, sizeof(current), "%llu", (unsigned long long)value);
+                                        snprintf(limit, sizeof(limit), "%.0f", r->limit);
+                                }
+                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
                                         rv = State_Failed;
-                                        Event_post(s, Event_Checksum, State_Failed, cs->action, "checksum failed, expected %s got %s", cs->hash, s->inf->priv.file.cs_sum);
+                                        snprintf(report, STRLEN, "meminfo %s of %s matches resource limit [%s%s%s]", systeminfo.meminfo.field[i].name, current, systeminfo.meminfo.field[i].name, operatorshortnames[r->operator], limit);
+                                } else {
+                                        snprintf(report, STRLEN, "meminfo %s check succeeded [current %s=%s]", systeminfo.meminfo.field[i].name, systeminfo.meminfo.field[i].name, current);
                                 }
-                        } else if (cs->test_changes) {
-                                rv = State_ChangedNot;
-                                Event_post(s, Event_Checksum, State_ChangedNot, cs->action, "checksum has not changed");
+                        }
+                        break;
+
+                case Resource_CgroupCpuPercent:
+                        if (s->inf->priv.process.cgroup.cpu_percent < 0.) {
+                                DEBUG("'%s' cgroup cpu usage check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.process.cgroup.cpu_percent, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "cgroup cpu usage of %.1f%% matches resource limit [cgroup cpu usage%s%.1f%%]", s->inf->priv.process.cgroup.cpu_percent, operatorshortnames[r->operator], r->limit);
                         } else {
-                                Event_post(s, Event_Checksum, State_Succeeded, cs->action, "checksum is valid");
+                                snprintf(report, STRLEN, "cgroup cpu usage check succeeded [current cgroup cpu usage=%.1f%%]", s->inf->priv.process.cgroup.cpu_percent);
                         }
-                        return rv;
-                }
-                Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot compute checksum for %s", s->path);
-                return State_Failed;
-        }
-        return rv;
-}
+                        break;
 
+                case Resource_CgroupReadBytes:
+                case Resource_CgroupWriteBytes:
+                        {
+                                const char *direction = r->resource_id == Resource_CgroupReadBytes ? "read" : "write";
+                                double rate = r->resource_id == Resource_CgroupReadBytes ? s->inf->priv.process.cgroup.read_rate : s->inf->priv.process.cgroup.write_rate;
+                                if (rate < 0.) {
+                                        DEBUG("'%s' cgroup disk %s rate check skipped (initializing)\n", s->name, direction);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, rate, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "cgroup disk %s rate of %s/s matches resource limit [cgroup disk %s%s%s/s]", direction, Str_bytesToSize(rate, buf1), direction, operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                                } else {
+                                        snprintf(report, STRLEN, "cgroup disk %s rate check succeeded [current cgroup disk %s rate=%s/s]", direction, direction, Str_bytesToSize(rate, buf1));
+                                }
+                        }
+                        break;
 
-/**
- * Test for associated path permission change
+                case Resource_ThreadCpu:
+                        if (s->inf->priv.process.thread.cpu_percent < 0.) {
+                                DEBUG("'%s' thread cpu usage check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.process.thread.cpu_percent, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "thread %d (%s) cpu usage of %.1f%% matches resource limit [thread cpu usage%s%.1f%%]", s->inf->priv.process.thread.tid, s->inf->priv.process.thread.name, s->inf->priv.process.thread.cpu_percent, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "thread cpu usage check succeeded [current busiest thread %d (%s) cpu usage=%.1f%%]", s->inf->priv.process.thread.tid, s->inf->priv.process.thread.name, s->inf->priv.process.thread.cpu_percent);
+                        }
+                        break;
+
+                case Resource_MonitCycle:
+                        // The cycle is still running, the duration of the previous cycle is tested
+                        if (Run.self.cycle < 0) {
+                                DEBUG("'%s' monit cycle check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, Run.self.cycle, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "monit cycle of %s matches resource limit [monit cycle%s%s]", Str_milliToTime(Run.self.cycle, (char[23]){}), operatorshortnames[r->operator], Str_milliToTime(r->limit, (char[23]){}));
+                        } else {
+                                snprintf(report, STRLEN, "monit cycle check succeeded [last monit cycle=%s]", Str_milliToTime(Run.self.cycle, (char[23]){}));
+                        }
+                        break;
+
+                case Resource_MonitMemory:
+                        if (Run.self.memory == 0) {
+                                DEBUG("'%s' monit memory check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, Run.self.memory, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "monit memory of %s matches resource limit [monit memory%s%s]", Str_bytesToSize(Run.self.memory, buf1), operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                        } else {
+                                snprintf(report, STRLEN, "monit memory check succeeded [current monit memory=%s]", Str_bytesToSize(Run.self.memory, buf1));
+                        }
+                        break;
+
+                case Resource_MonitQueue:
+                        if (Util_evalDoubleQExpression(r->operator, Run.self.queue, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "monit queue of %d events matches resource limit [monit queue%s%.0f]", Run.self.queue, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "monit queue check succeeded [current monit queue=%d events]", Run.self.queue);
+                        }
+                        break;
+
+                case Resource_GpuMemory:
+                        if (s->type == Service_Process) {
+                                if (s->inf->priv.process.gpu_memory < 0) {
+                                        DEBUG("'%s' gpu memory check skipped (not available)\n", s->name);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.process.gpu_memory, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "gpu mem amount of %s matches resource limit [gpu mem amount%s%s]", Str_bytesToSize(s->inf->priv.process.gpu_memory, buf1), operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                                } else {
+                                        snprintf(report, STRLEN, "gpu mem amount check succeeded [current gpu mem amount=%s]", Str_bytesToSize(s->inf->priv.process.gpu_memory, buf1));
+                                }
+                                break;
+                        }
+                        // Fall through to the system test
+                case Resource_GpuUsage:
+                case Resource_GpuMemoryPercent:
+                case Resource_GpuTemperature:
+                case Resource_GpuEcc:
+                        {
+                                const char *name = r->resource_id == Resource_GpuUsage ? "gpu usage" : r->resource_id == Resource_GpuMemoryPercent ? "gpu mem usage" : r->resource_id == Resource_GpuMemory ? "gpu mem amount" : r->resource_id == Resource_GpuTemperature ? "gpu temperature" : "gpu ecc errors";
+                                double value = 0.;
+                                int i = _gpuHighest(r->resource_id, &value);
+                                if (i < 0) {
+                                        DEBUG("'%s' %s check skipped (not available)\n", s->name, name);
+                                        return State_Init;
+                                }
+                                // The values are short, so the report with the device name always fits in STRLEN
+                                char current[32], limit[32];
+                                switch (r->resource_id) {
+                                        case Resource_GpuMemory:
+                                                Str_bytesToSize(value, current);
+                                                Str_bytesToSize(r->limit, limit);
+                                                break;
+                                        case Resource_GpuTemperature:
+                                                snprintf(current, sizeof(current), "%.0f C", value);
+                                                snprintf(limit, sizeof(limit), "%.0f C", r->limit);
+                                                break;
+                                        case Resource_GpuEcc:
+                                                snprintf(current, sizeof(current), "%.0f", value);
+                                                snprintf(limit, sizeof(limit), "%.0f", r->limit);
+                                                break;
+                                        default:
+                                                snprintf(current, sizeof(current), "%.1f%%", value);
+                                                snprintf(limit, sizeof(limit), "%.1f%%", r->limit);
+                                                break;
+                                }
+                                if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "gpu %d (%s) %s of %s matches resource limit [%s%s%s]", i, systeminfo.gpu.device[i].name, name + 4, current, name, operatorshortnames[r->operator], limit);
+                                } else {
+                                        snprintf(report, STRLEN, "%s check succeeded [current highest %s=%s on gpu %d]", name, name, current, i);
+                                }
+                        }
+                        break;
+
+                default:
+                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
+                        return State_Failed;
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/*
+ * The metric accessors of the compiled resource tests. An accessor returns
+ * false where the full test skips the value as initializing.
+ */
+
+
+static boolean_t _systemCpu(Service_T s, double *value) {
+        *value =
+#ifdef HAVE_CPU_WAIT
+                (systeminfo.total_cpu_wait_percent > 0. ? systeminfo.total_cpu_wait_percent : 0.) +
+#endif
+                (systeminfo.total_cpu_syst_percent > 0. ? systeminfo.total_cpu_syst_percent : 0.) +
+                (systeminfo.total_cpu_user_percent > 0. ? systeminfo.total_cpu_user_percent : 0.);
+        // The full test checks the float sum
+        return (float)*value >= 0.;
+}
+
+
+static boolean_t _systemCpuUser(Service_T s, double *value) {
+        return (*value = systeminfo.total_cpu_user_percent) >= 0.;
+}
+
+
+static boolean_t _systemCpuSystem(Service_T s, double *value) {
+        return (*value = systeminfo.total_cpu_syst_percent) >= 0.;
+}
+
+
+static boolean_t _systemCpuWait(Service_T s, double *value) {
+        return (*value = systeminfo.total_cpu_wait_percent) >= 0.;
+}
+
+
+static boolean_t _systemCpuSteal(Service_T s, double *value) {
+        return (*value = systeminfo.total_cpu_steal_percent) >= 0.;
+}
+
+
+static boolean_t _systemMemoryPercent(Service_T s, double *value) {
+        *value = systeminfo.total_mem_percent;
+        return true;
+}
+
+
+static boolean_t _systemMemory(Service_T s, double *value) {
+        *value = systeminfo.total_mem;
+        return true;
+}
+
+
+static boolean_t _systemSwapPercent(Service_T s, double *value) {
+        *value = systeminfo.total_swap_percent;
+        return true;
+}
+
+
+static boolean_t _systemSwap(Service_T s, double *value) {
+        *value = systeminfo.total_swap;
+        return true;
+}
+
+
+static boolean_t _systemLoad1m(Service_T s, double *value) {
+        *value = systeminfo.loadavg[0];
+        return true;
+}
+
+
+static boolean_t _systemLoad5m(Service_T s, double *value) {
+        *value = systeminfo.loadavg[1];
+        return true;
+}
+
+
+static boolean_t _systemLoad15m(Service_T s, double *value) {
+        *value = systeminfo.loadavg[2];
+        return true;
+}
+
+
+static boolean_t _processCpu(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.cpu_percent) >= 0.;
+}
+
+
+static boolean_t _processCpuTotal(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.total_cpu_percent) >= 0.;
+}
+
+
+static boolean_t _processMemoryPercent(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.mem_percent) >= 0.;
+}
+
+
+static boolean_t _processMemory(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.mem) != 0.;
+}
+
+
+static boolean_t _processMemoryTotal(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.total_mem) != 0.;
+}
+
+
+static boolean_t _processMemoryPercentTotal(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.total_mem_percent) >= 0.;
+}
+
+
+static boolean_t _processThreads(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.threads) >= 0.;
+}
+
+
+static boolean_t _processChildren(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.children) >= 0.;
+}
+
+
+static boolean_t _processReadBytes(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.read_rate) >= 0.;
+}
+
+
+static boolean_t _processWriteBytes(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.write_rate) >= 0.;
+}
+
+
+static boolean_t _processVoluntarySwitches(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.voluntary_rate) >= 0.;
+}
+
+
+static boolean_t _processNonvoluntarySwitches(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.nonvoluntary_rate) >= 0.;
+}
+
+
+static boolean_t _processFileDescriptors(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.filedescriptors) >= 0.;
+}
+
+
+static boolean_t _processThreadCpu(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.thread.cpu_percent) >= 0.;
+}
+
+
+static boolean_t _cgroupMemory(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.cgroup.memory) >= 0.;
+}
+
+
+static boolean_t _cgroupCpu(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.cgroup.cpu_percent) >= 0.;
+}
+
+
+static boolean_t _cgroupReadBytes(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.cgroup.read_rate) >= 0.;
+}
+
+
+static boolean_t _cgroupWriteBytes(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.cgroup.write_rate) >= 0.;
+}
+
+
+static boolean_t _monitCycle(Service_T s, double *value) {
+        return (*value = Run.self.cycle) >= 0.;
+}
+
+
+static boolean_t _monitMemory(Service_T s, double *value) {
+        return (*value = Run.self.memory) != 0.;
+}
+
+
+static boolean_t _monitQueue(Service_T s, double *value) {
+        *value = Run.self.queue;
+        return true;
+}
+
+
+static boolean_t _processGpuMemory(Service_T s, double *value) {
+        return (*value = s->inf->priv.process.gpu_memory) >= 0.;
+}
+
+
+static boolean_t _gpuUsage(Service_T s, double *value) {
+        return _gpuHighest(Resource_GpuUsage, value) >= 0;
+}
+
+
+static boolean_t _gpuMemoryPercent(Service_T s, double *value) {
+        return _gpuHighest(Resource_GpuMemoryPercent, value) >= 0;
+}
+
+
+static boolean_t _gpuMemory(Service_T s, double *value) {
+        return _gpuHighest(Resource_GpuMemory, value) >= 0;
+}
+
+
+static boolean_t _gpuTemperature(Service_T s, double *value) {
+        return _gpuHighest(Resource_GpuTemperature, value) >= 0;
+}
+
+
+static boolean_t _gpuEcc(Service_T s, double *value) {
+        return _gpuHighest(Resource_GpuEcc, value) >= 0;
+}
+
+
+/**
+ * Get the metric accessor of the resource test or NULL if the test has to
+ * be evaluated in full, such as the average, the per-CPU, the pressure and
+ * the meminfo tests
+ */
+static boolean_t (*_resourceAccessor(Service_T s, Resource_T r))(Service_T, double *) {
+        if (r->average)
+                return NULL;
+        boolean_t system = s->type == Service_System;
+        switch (r->resource_id) {
+                case Resource_CpuPercent:                  return system ? _systemCpu : _processCpu;
+                case Resource_CpuPercentTotal:             return _processCpuTotal;
+                case Resource_CpuUser:                     return _systemCpuUser;
+                case Resource_CpuSystem:                   return _systemCpuSystem;
+                case Resource_CpuWait:                     return _systemCpuWait;
+                case Resource_CpuSteal:                    return _systemCpuSteal;
+                case Resource_MemoryPercent:               return system ? _systemMemoryPercent : _processMemoryPercent;
+                case Resource_MemoryKbyte:                 return system ? _systemMemory : _processMemory;
+                case Resource_SwapPercent:                 return system ? _systemSwapPercent : NULL;
+                case Resource_SwapKbyte:                   return system ? _systemSwap : NULL;
+                case Resource_LoadAverage1m:               return _systemLoad1m;
+                case Resource_LoadAverage5m:               return _systemLoad5m;
+                case Resource_LoadAverage15m:              return _systemLoad15m;
+                case Resource_Threads:                     return _processThreads;
+                case Resource_Children:                    return _processChildren;
+                case Resource_MemoryKbyteTotal:            return _processMemoryTotal;
+                case Resource_MemoryPercentTotal:          return _processMemoryPercentTotal;
+                case Resource_ReadBytes:                   return _processReadBytes;
+                case Resource_WriteBytes:                  return _processWriteBytes;
+                case Resource_VoluntaryContextSwitches:    return _processVoluntarySwitches;
+                case Resource_NonvoluntaryContextSwitches: return _processNonvoluntarySwitches;
+                case Resource_FileDescriptors:             return _processFileDescriptors;
+                case Resource_CgroupMemory:                return _cgroupMemory;
+                case Resource_CgroupCpuPercent:            return _cgroupCpu;
+                case Resource_CgroupReadBytes:             return _cgroupReadBytes;
+                case Resource_CgroupWriteBytes:            return _cgroupWriteBytes;
+                case Resource_ThreadCpu:                   return _processThreadCpu;
+                case Resource_MonitCycle:                  return _monitCycle;
+                case Resource_MonitMemory:                 return _monitMemory;
+                case Resource_MonitQueue:                  return _monitQueue;
+                case Resource_GpuUsage:                    return _gpuUsage;
+                case Resource_GpuMemoryPercent:            return _gpuMemoryPercent;
+                case Resource_GpuMemory:                   return system ? _gpuMemory : _processGpuMemory;
+                case Resource_GpuTemperature:              return _gpuTemperature;
+                case Resource_GpuEcc:                      return _gpuEcc;
+                default:                                   return NULL;
+        }
+}
+
+
+/**
+ * Evaluate the compiled resource tests of a process or system service.
+ * A test whose value is within the limit and which has no event to update
+ * is done without formatting the report, the other tests are evaluated in
+ * full by _checkProcessResources()
+ */
+static State_Type _checkResourcePlan(Service_T s) {
+        State_Type rv = State_Succeeded;
+        ResourceRule_T rules = s->resourceplan.rules;
+        for (int i = 0; i < s->resourceplan.count; i++) {
+                double value;
+                if (rules[i].value && ! Run.debug && rules[i].value(s, &value) && ! Util_evalDoubleQExpression(rules[i].operator, value, rules[i].limit) && ! Event_isPosted(s, Event_Resource, rules[i].resource->action))
+                        continue;
+                if (_checkProcessResources(s, rules[i].resource) == State_Failed)
+                        rv = State_Failed;
+        }
+        return rv;
+}
+
+
+/**
+ * Check the totals of the recursive directory scan
+ */
+static State_Type _checkDirectoryResources(Service_T s, Resource_T r) {
+        ASSERT(s);
+        ASSERT(r);
+        State_Type rv = State_Succeeded;
+        char report[STRLEN] = {}, buf1[STRLEN], buf2[STRLEN];
+        if (s->inf->priv.directory.tree.files < 0) {
+                DEBUG("'%s' directory scan check skipped (initializing)\n", s->name);
+                return State_Init;
+        }
+        switch (r->resource_id) {
+                case Resource_DirectorySize:
+                        if (Util_evalDoubleQExpression(r->operator, s->inf->priv.directory.tree.size, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "total size of %s matches resource limit [total size%s%s]", Str_bytesToSize(s->inf->priv.directory.tree.size, buf1), operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                        } else {
+                                snprintf(report, STRLEN, "total size check succeeded [current total size=%s]", Str_bytesToSize(s->inf->priv.directory.tree.size, buf1));
+                        }
+                        break;
+
+                case Resource_DirectoryFiles:
+                        if (Util_evalDoubleQExpression(r->operator, s->inf->priv.directory.tree.files, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "files count %lld matches resource limit [files%s%.0f]", s->inf->priv.directory.tree.files, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "files count check succeeded [current files=%lld]", s->inf->priv.directory.tree.files);
+                        }
+                        break;
+
+                case Resource_DirectoryOldest:
+                case Resource_DirectoryNewest:
+                        {
+                                const char *kind = r->resource_id == Resource_DirectoryOldest ? "oldest" : "newest";
+                                if (s->inf->priv.directory.tree.files == 0) {
+                                        snprintf(report, STRLEN, "%s file check succeeded [no files]", kind);
+                                        break;
+                                }
+                                time_t age = MAX(0, Time_now() - (r->resource_id == Resource_DirectoryOldest ? s->inf->priv.directory.tree.oldest : s->inf->priv.directory.tree.newest));
+                                if (Util_evalDoubleQExpression(r->operator, age, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "%s file age of %lld seconds matches resource limit [%s file%s%.0f seconds]", kind, (long long)age, kind, operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "%s file check succeeded [current %s file age=%lld seconds]", kind, kind, (long long)age);
+                                }
+                        }
+                        break;
+
+                default:
+                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
+                        return State_Failed;
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/**
+ * Check the resources used by the last run of the program
+ */
+static State_Type _checkProgramResources(Service_T s, Resource_T r) {
+        ASSERT(s);
+        ASSERT(r);
+        State_Type rv = State_Succeeded;
+        char report[STRLEN] = {}, buf1[STRLEN], buf2[STRLEN];
+        switch (r->resource_id) {
+                case Resource_ProgramCpuTime:
+                        if (s->program->usage.cpuTime < 0) {
+                                DEBUG("'%s' program cpu time check skipped (not available)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->program->usage.cpuTime / 1000., r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "program cpu time of %s matches resource limit [program cpu time%s%s]", Str_milliToTime(s->program->usage.cpuTime / 1000., (char[23]){}), operatorshortnames[r->operator], Str_milliToTime(r->limit, (char[23]){}));
+                        } else {
+                                snprintf(report, STRLEN, "program cpu time check succeeded [last program cpu time=%s]", Str_milliToTime(s->program->usage.cpuTime / 1000., (char[23]){}));
+                        }
+                        break;
+
+                case Resource_ProgramMemory:
+                        if (s->program->usage.memory < 0) {
+                                DEBUG("'%s' program memory check skipped (not available)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->program->usage.memory, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "program memory of %s matches resource limit [program memory%s%s]", Str_bytesToSize(s->program->usage.memory, buf1), operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                        } else {
+                                snprintf(report, STRLEN, "program memory check succeeded [last program memory=%s]", Str_bytesToSize(s->program->usage.memory, buf1));
+                        }
+                        break;
+
+                case Resource_ProgramRunTime:
+                        if (s->program->usage.runTime < 0) {
+                                DEBUG("'%s' program run time check skipped (not available)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->program->usage.runTime, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "program run time of %s matches resource limit [program run time%s%s]", Str_milliToTime(s->program->usage.runTime, (char[23]){}), operatorshortnames[r->operator], Str_milliToTime(r->limit, (char[23]){}));
+                        } else {
+                                snprintf(report, STRLEN, "program run time check succeeded [last program run time=%s]", Str_milliToTime(s->program->usage.runTime, (char[23]){}));
+                        }
+                        break;
+
+                default:
+                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
+                        return State_Failed;
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/**
+ * Check the TCP connection table counters of the socket service
+ */
+static State_Type _checkSocketResources(Service_T s, Resource_T r) {
+        ASSERT(s);
+        ASSERT(r);
+        State_Type rv = State_Succeeded;
+        char report[STRLEN] = {};
+        const char *name;
+        long long value;
+        switch (r->resource_id) {
+                case Resource_SocketConnections:
+                        name = "connections";
+                        value = s->inf->priv.socket.connections;
+                        break;
+                case Resource_SocketEstablished:
+                        name = "established connections";
+                        value = s->inf->priv.socket.established;
+                        break;
+                case Resource_SocketTimeWait:
+                        name = "time wait connections";
+                        value = s->inf->priv.socket.timewait;
+                        break;
+                case Resource_SocketCloseWait:
+                        name = "close wait connections";
+                        value = s->inf->priv.socket.closewait;
+                        break;
+                case Resource_SocketListen:
+                        name = "listen sockets";
+                        value = s->inf->priv.socket.listen;
+                        break;
+                case Resource_SocketListenQueue:
+                        name = "listen queue";
+                        value = s->inf->priv.socket.queue;
+                        if (value < 0) {
+                                DEBUG("'%s' listen queue check skipped (no listening socket)\n", s->name);
+                                return State_Init;
+                        }
+                        break;
+                case Resource_SocketListenDrops:
+                        name = "listen drops";
+                        value = s->inf->priv.socket.drops;
+                        if (value < 0) {
+                                DEBUG("'%s' listen drops check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        }
+                        break;
+                default:
+                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
+                        return State_Failed;
+        }
+        if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                rv = State_Failed;
+                snprintf(report, STRLEN, "%s %lld matches resource limit [%s%s%.0f]", name, value, name, operatorshortnames[r->operator], r->limit);
+        } else {
+                snprintf(report, STRLEN, "%s check succeeded [current %s=%lld]", name, name, value);
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/**
+ * Check the value of the push metric in the last cycle
+ */
+static State_Type _checkMetricResources(Service_T s, Resource_T r) {
+        ASSERT(s);
+        ASSERT(r);
+        State_Type rv = State_Succeeded;
+        char report[STRLEN] = {};
+        const char *name;
+        double value;
+        switch (r->resource_id) {
+                case Resource_MetricValue:
+                        name = "value";
+                        value = s->inf->priv.metric.value;
+                        break;
+                case Resource_MetricRate:
+                        name = "rate";
+                        value = s->inf->priv.metric.rate;
+                        if (value < 0) {
+                                DEBUG("'%s' rate check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        }
+                        break;
+                case Resource_MetricMax:
+                        name = "max";
+                        value = s->inf->priv.metric.max;
+                        break;
+                default:
+                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
+                        return State_Failed;
+        }
+        if (Util_evalDoubleQExpression(r->operator, value, r->limit)) {
+                rv = State_Failed;
+                snprintf(report, STRLEN, "%s %s %g matches resource limit [%s%s%g]", metrictypenames[s->inf->priv.metric.type], name, value, name, operatorshortnames[r->operator], r->limit);
+        } else {
+                snprintf(report, STRLEN, "%s check succeeded [current %s=%g]", name, name, value);
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/**
+ * Check the I/O statistics of the block device holding the filesystem
+ */
+static State_Type _checkFilesystemIO(Service_T s, Resource_T r) {
+        ASSERT(s);
+        ASSERT(r);
+        State_Type rv = State_Succeeded;
+        char report[STRLEN] = {}, buf1[STRLEN], buf2[STRLEN];
+        switch (r->resource_id) {
+                case Resource_ReadBytes:
+                case Resource_WriteBytes:
+                        {
+                                const char *direction = r->resource_id == Resource_ReadBytes ? "read" : "write";
+                                double rate = r->resource_id == Resource_ReadBytes ? s->inf->priv.filesystem.io.read_bytes : s->inf->priv.filesystem.io.write_bytes;
+                                if (rate < 0.) {
+                                        DEBUG("'%s' disk %s rate check skipped (initializing)\n", s->name, direction);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, rate, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "disk %s rate of %s/s matches resource limit [disk %s%s%s/s]", direction, Str_bytesToSize(rate, buf1), direction, operatorshortnames[r->operator], Str_bytesToSize(r->limit, buf2));
+                                } else {
+                                        snprintf(report, STRLEN, "disk %s rate check succeeded [current disk %s rate=%s/s]", direction, direction, Str_bytesToSize(rate, buf1));
+                                }
+                        }
+                        break;
+
+                case Resource_ReadOperations:
+                case Resource_WriteOperations:
+                        {
+                                const char *direction = r->resource_id == Resource_ReadOperations ? "read" : "write";
+                                double rate = r->resource_id == Resource_ReadOperations ? s->inf->priv.filesystem.io.read_operations : s->inf->priv.filesystem.io.write_operations;
+                                if (rate < 0.) {
+                                        DEBUG("'%s' disk %s operations check skipped (initializing)\n", s->name, direction);
+                                        return State_Init;
+                                } else if (Util_evalDoubleQExpression(r->operator, rate, r->limit)) {
+                                        rv = State_Failed;
+                                        snprintf(report, STRLEN, "disk %s operations rate of %.1f/s matches resource limit [disk %s operations%s%.0f/s]", direction, rate, direction, operatorshortnames[r->operator], r->limit);
+                                } else {
+                                        snprintf(report, STRLEN, "disk %s operations check succeeded [current disk %s operations=%.1f/s]", direction, direction, rate);
+                                }
+                        }
+                        break;
+
+                case Resource_ServiceTime:
+                        if (s->inf->priv.filesystem.io.service_time < 0.) {
+                                DEBUG("'%s' disk service time check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.filesystem.io.service_time, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "disk service time of %.3f ms matches resource limit [disk service time%s%.3f ms]", s->inf->priv.filesystem.io.service_time, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "disk service time check succeeded [current disk service time=%.3f ms]", s->inf->priv.filesystem.io.service_time);
+                        }
+                        break;
+
+                case Resource_Utilization:
+                        if (s->inf->priv.filesystem.io.utilization < 0.) {
+                                DEBUG("'%s' disk utilization check skipped (initializing)\n", s->name);
+                                return State_Init;
+                        } else if (Util_evalDoubleQExpression(r->operator, s->inf->priv.filesystem.io.utilization, r->limit)) {
+                                rv = State_Failed;
+                                snprintf(report, STRLEN, "disk utilization of %.1f%% matches resource limit [disk utilization%s%.1f%%]", s->inf->priv.filesystem.io.utilization, operatorshortnames[r->operator], r->limit);
+                        } else {
+                                snprintf(report, STRLEN, "disk utilization check succeeded [current disk utilization=%.1f%%]", s->inf->priv.filesystem.io.utilization);
+                        }
+                        break;
+
+                default:
+                        LogError("'%s' error -- unknown resource ID: [%d]\n", s->name, r->resource_id);
+                        return State_Failed;
+        }
+        Event_post(s, Event_Resource, rv, r->action, "%s", report);
+        return rv;
+}
+
+
+/**
+ * If the checksum cache is enabled and the file's inode, size, modification
+ * and change time didn't change since the checksum was computed, keep the
+ * previous checksum. The change time cannot be set from userspace, so any
+ * write to the file invalidates the cache. Returns true if the cached
+ * checksum is valid
+ */
+static boolean_t _checksumCached(Service_T s, struct stat *st) {
+        if (! (Run.flags & Run_ChecksumCache) || ! *s->inf->priv.file.cs_sum || ! s->inf->priv.file.cs_cache.inode)
+                return false;
+        unsigned long long mtime, ctime;
+        file_getStatTimes(st, &mtime, &ctime);
+        if (s->inf->priv.file.cs_cache.inode != (unsigned long long)st->st_ino || s->inf->priv.file.cs_cache.size != (unsigned long long)st->st_size || s->inf->priv.file.cs_cache.mtime != mtime || s->inf->priv.file.cs_cache.ctime != ctime)
+                return false;
+        if (Run.checksumCache.verifyCycles > 0 && ++s->inf->priv.file.cs_cache.cycles >= Run.checksumCache.verifyCycles) {
+                DEBUG("'%s' checksum cache expired, verifying the file\n", s->name);
+                return false;
+        }
+        DEBUG("'%s' file unchanged, using the cached checksum\n", s->name);
+        return true;
+}
+
+
+/**
+ * Compute the file checksum and remember the file's stat data for the checksum cache
+ */
+static boolean_t _checksumCompute(Service_T s, struct stat *st) {
+        memset(&s->inf->priv.file.cs_cache, 0, sizeof(s->inf->priv.file.cs_cache));
+        if (! Util_getChecksum(s->path, s->checksum->type, s->inf->priv.file.cs_sum, sizeof(s->inf->priv.file.cs_sum)))
+                return false;
+        s->inf->priv.file.cs_cache.inode = st->st_ino;
+        s->inf->priv.file.cs_cache.size = st->st_size;
+        file_getStatTimes(st, &s->inf->priv.file.cs_cache.mtime, &s->inf->priv.file.cs_cache.ctime);
+        return true;
+}
+
+
+/**
+ * Test for associated path checksum change
+ */
+static State_Type _checkChecksum(Service_T s, struct stat *st) {
+        ASSERT(s);
+        ASSERT(s->path);
+        State_Type rv = State_Succeeded;
+        if (s->checksum) {
+                Checksum_T cs = s->checksum;
+                State_Type computed = State_Succeeded;
+                if (! _checksumCached(s, st)) {
+                        if (ChecksumPool_isRunning())
+                                computed = ChecksumPool_get(s, st);
+                        else if (! _checksumCompute(s, st))
+                                computed = State_Failed;
+                }
+                if (computed == State_Init) {
+                        DEBUG("'%s' checksum is being computed, the test is deferred\n", s->name);
+                        return State_Init;
+                }
+                if (computed == State_Succeeded) {
+                        Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "checksum %s", s->inf->priv.file.cs_sum);
+                        if (! cs->initialized) {
+                                cs->initialized = true;
+                                strncpy(cs->hash, s->inf->priv.file.cs_sum, sizeof(cs->hash));
+                        }
+                        int length = Util_getHashLength(cs->type);
+                        if (! length) {
+                                LogError("'%s' unknown hash type (%d)\n", s->name, cs->type);
+                                *s->inf->priv.file.cs_sum = 0;
+                                return State_Failed;
+                        }
+                        if (strncmp(cs->hash, s->inf->priv.file.cs_sum, length)) {
+                                if (cs->test_changes) {
+                                        rv = State_Changed;
+                                        /* reset expected value for next cycle */
+                                        strncpy(cs->hash, s->inf->priv.file.cs_sum, sizeof(cs->hash));
+                                        /* if we are testing for changes only, the value is variable */
+                                        Event_post(s, Event_Checksum, State_Changed, cs->action, "checksum changed to %s", s->inf->priv.file.cs_sum);
+                                } else {
+                                        /* we are testing constant value for failed or succeeded state */
+                                        rv = State_Failed;
+                                        Event_post(s, Event_Checksum, State_Failed, cs->action, "checksum failed, expected %s got %s", cs->hash, s->inf->priv.file.cs_sum);
+                                }
+                        } else if (cs->test_changes) {
+                                rv = State_ChangedNot;
+                                Event_post(s, Event_Checksum, State_ChangedNot, cs->action, "checksum has not changed");
+                        } else {
+                                Event_post(s, Event_Checksum, State_Succeeded, cs->action, "checksum is valid");
+                        }
+                        return rv;
+                }
+                Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot compute checksum for %s", s->path);
+                return State_Failed;
+        }
+        return rv;
+}
+
+
+/**
+ * Test for associated path permission change
  */
 static State_Type _checkPerm(Service_T s, int mode) {
         ASSERT(s);
@@ -708,8 +1968,179 @@ static State_Type _checkUptime(Service_T s, long long uptime) {
 }
 
 
-static int _checkPattern(Match_T pattern, const char *line) {
-        return regexec(pattern->regex_comp, line, 0, NULL, 0);
+/**
+ * Get the set of the ignore patterns followed by the match patterns, so each
+ * line is scanned for the literals of all patterns in one pass and only the
+ * regular expressions whose literal is present in the line are executed
+ */
+static PatternSet_T _patternSet(Service_T s) {
+        if (! s->patternset) {
+                s->patternset = PatternSet_new();
+                for (Match_T ml = s->matchignorelist; ml; ml = ml->next)
+                        PatternSet_add(s->patternset, ml->match_string, ml->regex_comp);
+                for (Match_T ml = s->matchlist; ml; ml = ml->next)
+                        PatternSet_add(s->patternset, ml->match_string, ml->regex_comp);
+        }
+        return s->patternset;
+}
+
+
+/**
+ * Read a block from the given file offset into the buffer at the given buffer offset
+ * @return The number of bytes read, 0 at the end of file or -1 on error
+ */
+static ssize_t _tailerRead(Tailer_T *t, size_t offset, off_t position) {
+        ssize_t n;
+        do {
+                n = pread(t->fd, t->buffer + offset, t->size - offset, position);
+        } while (n < 0 && errno == EINTR);
+        if (n < 0)
+                t->error = true;
+        return n;
+}
+
+
+/**
+ * The line doesn't fit in the buffer: keep the first Run.limits.fileContentBuffer - 1
+ * bytes for the matchers and skip the rest of the line (till '\n')
+ */
+static char *_tailerSkip(Tailer_T *t) {
+        size_t keep = Run.limits.fileContentBuffer - 1;
+        off_t length = t->end; // The line bytes read so far
+        while (true) {
+                ssize_t n = _tailerRead(t, keep, t->position + length);
+                if (n <= 0)
+                        return NULL;
+                char *eol = memchr(t->buffer + keep, '\n', n);
+                if (eol) {
+                        length += eol - (t->buffer + keep);
+                        t->buffer[keep] = 0; // Either the '\n' or a byte of the skipped part of the line
+                        t->start = eol + 1 - t->buffer;
+                        t->end = keep + n;
+                        t->position += length + 1;
+                        return t->buffer;
+                }
+                length += n;
+        }
+}
+
+
+/**
+ * Get the next complete line. The line is terminated in place and it is valid
+ * till the next call, it is truncated to Run.limits.fileContentBuffer - 1 bytes.
+ * @return The line or NULL if no complete line is available (the end of file
+ * or an incomplete line, which will be read again in the next cycle) or on error
+ */
+static char *_tailerNext(Tailer_T *t) {
+        while (true) {
+                char *line = t->buffer + t->start;
+                char *eol = memchr(line, '\n', t->end - t->start);
+                if (eol) {
+                        size_t length = eol - line;
+                        *eol = 0;
+                        if (length >= Run.limits.fileContentBuffer)
+                                line[Run.limits.fileContentBuffer - 1] = 0;
+                        t->start += length + 1;
+                        t->position += length + 1;
+                        return line;
+                }
+                // Move the partial line to the beginning of the buffer and read more
+                if (t->start) {
+                        memmove(t->buffer, t->buffer + t->start, t->end - t->start);
+                        t->end -= t->start;
+                        t->start = 0;
+                }
+                if (t->end == t->size)
+                        return _tailerSkip(t);
+                ssize_t n = _tailerRead(t, t->end, t->position + t->end);
+                if (n <= 0)
+                        return NULL;
+                t->end += n;
+        }
+}
+
+
+/**
+ * Match the complete lines of the file from the read position to the end of file,
+ * the read position is moved past the last matched line. The matched lines are
+ * collected in Match_T.log.
+ * @return false on read error
+ */
+static boolean_t _scanContent(Service_T s, int fd) {
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        Tailer_T tailer = {.fd = fd};
+        tailer.position = s->inf->priv.file.readpos;
+        tailer.size = MAX(TAILER_BLOCK, 2 * Run.limits.fileContentBuffer);
+        tailer.buffer = ALLOC(tailer.size);
+        PatternSet_T patterns = _patternSet(s);
+        unsigned long long executions = PatternSet_executions(patterns);
+        int ignores = 0;
+        for (Match_T ml = s->matchignorelist; ml; ml = ml->next)
+                ignores++;
+        for (char *line = _tailerNext(&tailer); line; line = _tailerNext(&tailer)) {
+                /* Set read position to the end of last read */
+                s->inf->priv.file.readpos = tailer.position;
+                PatternSet_scan(patterns, line);
+                int index = 0;
+                /* Check ignores */
+                boolean_t ignored = false;
+                for (Match_T ml = s->matchignorelist; ml; ml = ml->next, index++) {
+                        if (PatternSet_match(patterns, index, line) ^ (ml->not)) {
+                                /* We match! -> line is ignored! */
+                                DEBUG("'%s' Ignore pattern %s'%s' match on content line\n", s->name, ml->not ? "not " : "", ml->match_string);
+                                ignored = true;
+                                break;
+                        }
+                }
+                if (ignored)
+                        continue;
+                /* Check non ignores */
+                index = ignores;
+                for (Match_T ml = s->matchlist; ml; ml = ml->next, index++) {
+                        if (PatternSet_match(patterns, index, line) ^ (ml->not)) {
+                                DEBUG("'%s' Pattern %s'%s' match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                                /* Save the line for Event_post */
+                                if (! ml->log)
+                                        ml->log = StringBuffer_create(Run.limits.fileContentBuffer);
+                                if (StringBuffer_length(ml->log) < Run.limits.fileContentBuffer) {
+                                        StringBuffer_append(ml->log, "%s\n", line);
+                                        if (StringBuffer_length(ml->log) >= Run.limits.fileContentBuffer)
+                                                StringBuffer_append(ml->log, "...\n");
+                                }
+                        } else {
+                                DEBUG("'%s' Pattern %s'%s' doesn't match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
+                        }
+                }
+        }
+        if (! tailer.error && tailer.start < tailer.end) {
+                /* Incomplete line: we gonna read it next time again, allowing the writer to complete the write */
+                DEBUG("'%s' content match: incomplete line read - no new line at end. (retrying next cycle)\n", s->name);
+        }
+        Counter_add(Counter_RegexExecutions, PatternSet_executions(patterns) - executions);
+        FREE(tailer.buffer);
+        return ! tailer.error;
+}
+
+
+/**
+ * The file was rotated (renamed or removed and replaced with a new file): match the
+ * lines which were appended to the old file since the last test through the descriptor
+ * kept open, then close it. The read position is reset to the beginning of the new file.
+ */
+static boolean_t _drainContent(Service_T s) {
+        boolean_t rv = true;
+        struct stat st;
+        if (fstat(s->inf->priv.file.fd, &st) == 0 && st.st_size >= s->inf->priv.file.readpos) {
+                DEBUG("'%s' file was rotated -- matching the rest of the previous file\n", s->name);
+                if (! (rv = _scanContent(s, s->inf->priv.file.fd)))
+                        LogError("'%s' cannot read the rotated file %s: %s\n", s->name, s->path, STRERROR);
+        }
+        close(s->inf->priv.file.fd);
+        s->inf->priv.file.fd = -1;
+        s->inf->priv.file.readpos = 0;
+        return rv;
 }
 
 
@@ -722,103 +2153,60 @@ static int _checkPattern(Match_T pattern, const char *line) {
  * The test will resume at the beginning of the incomplete line during the next cycle, allowing the writer to finish the write.
  *
  * We test only Run.limits.fileContentBuffer at maximum - in the case that the line is bigger, we read the rest of the line (till '\n') but ignore the characters past the maximum
+ *
+ * The file is read in large blocks from the saved read position, see _tailerNext(). The
+ * descriptor is kept open between the cycles, so when the file is rotated, the lines
+ * written to the old file before the rotation are matched too, see _drainContent(). If
+ * the file was truncated in place (copytruncate), it is read from the beginning.
  */
-static State_Type _checkMatch(Service_T s) {
+static State_Type _checkMatch(Service_T s, struct stat *st) {
         ASSERT(s);
         State_Type rv = State_Succeeded;
         if (s->matchlist) {
-                FILE *file = fopen(s->path, "r");
-                if (! file) {
-                        LogError("'%s' cannot open file %s: %s\n", s->name, s->path, STRERROR);
-                        return State_Failed;
+                // Files on procfs and similar filesystems report no real size, read them from the beginning each cycle
+                boolean_t isVirtual = filesystem_isVirtual(s->path, st->st_dev);
+                if (s->inf->priv.file.fd >= 0) {
+                        struct stat kept;
+                        if (fstat(s->inf->priv.file.fd, &kept) != 0 || kept.st_ino != st->st_ino || kept.st_dev != st->st_dev) {
+                                if (! _drainContent(s))
+                                        rv = State_Failed;
+                        }
                 }
-                /* FIXME: Refactor: Initialize the filesystems table ahead of file and filesystems test and index it by device id + replace the Str_startsWith() with lookup to the table by device id (obtained via file's stat()).
-                 The central filesystems initialization will allow to reduce the statfs() calls in the case that there will be multiple file and/or filesystems tests for the same fs. Temporarily we go with
-                 dummy Str_startsWith() as quick fix which will cover 99.9% of use cases without rising the statfs overhead if statfs call would be inlined here.
-                 */
-                if (Str_startsWith(s->path, "/proc")) {
+                if (s->inf->priv.file.fd < 0) {
+                        if ((s->inf->priv.file.fd = open(s->path, O_RDONLY | O_CLOEXEC)) < 0) {
+                                LogError("'%s' cannot open file %s: %s\n", s->name, s->path, STRERROR);
+                                return State_Failed;
+                        }
+                        /* If inode changed since the last test without a kept descriptor (such as after restart) -> set read position = 0 */
+                        if (s->inf->priv.file.inode != s->inf->priv.file.inode_prev)
+                                s->inf->priv.file.readpos = 0;
+                }
+                if (isVirtual) {
                         s->inf->priv.file.readpos = 0;
                 } else {
-                        /* If inode changed or size shrinked -> set read position = 0 */
-                        if (s->inf->priv.file.inode != s->inf->priv.file.inode_prev || s->inf->priv.file.readpos > s->inf->priv.file.size)
+                        /* Size shrinked -> the file was truncated in place (copytruncate), set read position = 0 */
+                        if (s->inf->priv.file.readpos > s->inf->priv.file.size) {
+                                DEBUG("'%s' file was truncated -- matching from the beginning\n", s->name);
                                 s->inf->priv.file.readpos = 0;
-                        /* Do we need to match? Even if not, go to final, so we can reset the content match error flags in this cycle */
-                        if (s->inf->priv.file.readpos == s->inf->priv.file.size) {
-                                DEBUG("'%s' content match skipped - file size nor inode has not changed since last test\n", s->name);
-                                goto final1;
-                        }
-                }
-                char *line = CALLOC(sizeof(unsigned char), Run.limits.fileContentBuffer);
-                while (true) {
-next:
-                        /* Seek to the read position */
-                        if (fseek(file, (long)s->inf->priv.file.readpos, SEEK_SET)) {
-                                rv = State_Failed;
-                                LogError("'%s' cannot seek file %s: %s\n", s->name, s->path, STRERROR);
-                                goto final2;
                         }
-                        if (! fgets(line, Run.limits.fileContentBuffer, file)) {
-                                if (! feof(file)) {
-                                        rv = State_Failed;
-                                        LogError("'%s' cannot read file %s: %s\n", s->name, s->path, STRERROR);
-                                }
-                                goto final2;
-                        }
-                        size_t length = strlen(line);
-                        if (length == 0) {
-                                /* No content: shouldn't happen - empty line will contain at least '\n' */
-                                goto final2;
-                        } else if (line[length - 1] != '\n') {
-                                if (length < Run.limits.fileContentBuffer - 1) {
-                                        /* Incomplete line: we gonna read it next time again, allowing the writer to complete the write */
-                                        DEBUG("'%s' content match: incomplete line read - no new line at end. (retrying next cycle)\n", s->name);
-                                        goto final2;
-                                } else if (length >= Run.limits.fileContentBuffer - 1) {
-                                        /* Our read buffer is full: ignore the content past the Run.limits.fileContentBuffer */
-                                        int rv;
-                                        do {
-                                                if ((rv = fgetc(file)) == EOF)
-                                                        goto final2;
-                                                length++;
-                                        } while (rv != '\n');
-                                }
-                        } else {
-                                /* Remove trailing newline */
-                                line[length - 1] = 0;
-                        }
-                        /* Set read position to the end of last read */
-                        s->inf->priv.file.readpos += length;
-                        /* Check ignores */
-                        for (Match_T ml = s->matchignorelist; ml; ml = ml->next) {
-                                if ((_checkPattern(ml, line) == 0) ^ (ml->not)) {
-                                        /* We match! -> line is ignored! */
-                                        DEBUG("'%s' Ignore pattern %s'%s' match on content line\n", s->name, ml->not ? "not " : "", ml->match_string);
-                                        goto next;
-                                }
-                        }
-                        /* Check non ignores */
-                        for (Match_T ml = s->matchlist; ml; ml = ml->next) {
-                                if ((_checkPattern(ml, line) == 0) ^ (ml->not)) {
-                                        DEBUG("'%s' Pattern %s'%s' match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
-                                        /* Save the line for Event_post */
-                                        if (! ml->log)
-                                                ml->log = StringBuffer_create(Run.limits.fileContentBuffer);
-                                        if (StringBuffer_length(ml->log) < Run.limits.fileContentBuffer) {
-                                                StringBuffer_append(ml->log, "%s\n", line);
-                                                if (StringBuffer_length(ml->log) >= Run.limits.fileContentBuffer)
-                                                        StringBuffer_append(ml->log, "...\n");
-                                        }
-                                } else {
-                                        DEBUG("'%s' Pattern %s'%s' doesn't match on content line [%s]\n", s->name, ml->not ? "not " : "", ml->match_string, line);
-                                }
+                        /* Do we need to match? Even if not, go to final, so we can reset the content match error flags in this cycle */
+                        if (s->inf->priv.file.readpos == s->inf->priv.file.size) {
+                                DEBUG("'%s' content match skipped - file size nor inode has not changed since last test\n", s->name);
+                                goto final;
                         }
                 }
-final2:
-                FREE(line);
-final1:
-                if (fclose(file)) {
+                if (! _scanContent(s, s->inf->priv.file.fd)) {
                         rv = State_Failed;
-                        LogError("'%s' cannot close file %s: %s\n", s->name, s->path, STRERROR);
+                        LogError("'%s' cannot read file %s: %s\n", s->name, s->path, STRERROR);
+                }
+final:
+                // The descriptor of a virtual file is not kept, it is read from the beginning each cycle anyway
+                if (isVirtual || rv == State_Failed) {
+                        if (close(s->inf->priv.file.fd)) {
+                                rv = State_Failed;
+                                LogError("'%s' cannot close file %s: %s\n", s->name, s->path, STRERROR);
+                        }
+                        s->inf->priv.file.fd = -1;
                 }
                 /* Post process the matches: generate events for particular patterns */
                 for (Match_T ml = s->matchlist; ml; ml = ml->next) {
@@ -835,6 +2223,187 @@ final1:
 }
 
 
+/**
+ * Add the member to the file set test report
+ */
+static void _fileSetReport(FileSetReport_T *r, const char *path, const char *format, ...) {
+        if (r->count++ < FILESET_REPORT) {
+                if (! r->members)
+                        r->members = StringBuffer_create(STRLEN);
+                StringBuffer_append(r->members, "\n  %s", path);
+                va_list ap;
+                va_start(ap, format);
+                StringBuffer_vappend(r->members, format, ap);
+                va_end(ap);
+        }
+}
+
+
+/**
+ * Post the file set test event: the state is failed or changed if some member was reported, then the report is reset
+ */
+static State_Type _fileSetPost(Service_T s, FileSetReport_T *r, long id, State_Type state, EventAction_T action, int count, const char *failed, const char *succeeded) {
+        State_Type rv = state;
+        if (r->count) {
+                if (r->count > FILESET_REPORT)
+                        StringBuffer_append(r->members, "\n  ... and %d more", r->count - FILESET_REPORT);
+                Event_post(s, id, state, action, "%s for %d of %d files:%s", failed, r->count, count, StringBuffer_toString(r->members));
+                StringBuffer_free(&r->members);
+                r->count = 0;
+        } else {
+                rv = state == State_Changed ? State_ChangedNot : State_Succeeded;
+                Event_post(s, id, rv, action, "%s for %d files", succeeded, count);
+        }
+        return rv;
+}
+
+
+/**
+ * Test the members of the file set: the test rules of the service are applied to each
+ * member and one event per rule lists the members which failed or changed. The service's
+ * file info holds the total size and the newest timestamp of the members.
+ */
+static State_Type _checkFileSet(Service_T s) {
+        FileSet_T set = s->fileset;
+        int count = FileSet_scan(set);
+        if (count < 0) {
+                Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot list the files matching %s", s->path);
+                return State_Failed;
+        }
+        if (! count) {
+                for (Nonexist_T l = s->nonexistlist; l; l = l->next)
+                        Event_post(s, Event_Nonexist, State_Failed, l->action, "no file matches %s", s->path);
+                Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "files matching %s listed", s->path);
+                Util_resetInfo(s);
+                return State_Failed;
+        }
+        for (Nonexist_T l = s->nonexistlist; l; l = l->next)
+                Event_post(s, Event_Nonexist, State_Succeeded, l->action, "%d files match", count);
+        State_Type rv = State_Succeeded;
+        FileSetReport_T invalid = {}, data = {}, checksum = {}, perm = {}, uid = {}, gid = {};
+        // Members which vanished since the scan have st_mode 0 and are skipped
+        struct stat *st = CALLOC(count, sizeof(struct stat));
+        MD_T *sums = s->checksum ? CALLOC(count, sizeof(MD_T)) : NULL;
+        int length = s->checksum ? Util_getHashLength(s->checksum->type) : 0;
+        long long total = 0;
+        time_t newest = 0;
+        for (int i = 0; i < count; i++) {
+                FileRecord_T r = &set->records[i];
+                if (IoProbe_stat(r->path, &st[i]) != 0) {
+                        st[i].st_mode = 0;
+                        continue;
+                }
+                if (! S_ISREG(st[i].st_mode)) {
+                        _fileSetReport(&invalid, r->path, " is not a regular file");
+                        st[i].st_mode = 0;
+                        continue;
+                }
+                total += st[i].st_size;
+                newest = MAX(newest, MAX(st[i].st_mtime, st[i].st_ctime));
+                if (s->checksum) {
+                        if (! FileSet_checksum(r, &st[i], s->checksum->type, sums[i])) {
+                                _fileSetReport(&data, r->path, "");
+                                *sums[i] = 0;
+                        } else if (s->checksum->test_changes ? (r->known && *r->sum && strncmp(r->sum, sums[i], length)) : strncmp(s->checksum->hash, sums[i], length)) {
+                                _fileSetReport(&checksum, r->path, " checksum %s", sums[i]);
+                        }
+                }
+                if (s->perm) {
+                        mode_t m = st[i].st_mode & 07777;
+                        if (s->perm->test_changes ? (r->known && (mode_t)(r->mode & 07777) != m) : m != s->perm->perm)
+                                _fileSetReport(&perm, r->path, " permission %04o", m);
+                }
+                if (s->uid && (int)st[i].st_uid != s->uid->uid)
+                        _fileSetReport(&uid, r->path, " uid %d", (int)st[i].st_uid);
+                if (s->gid && (int)st[i].st_gid != s->gid->gid)
+                        _fileSetReport(&gid, r->path, " gid %d", (int)st[i].st_gid);
+        }
+        if (_fileSetPost(s, &invalid, Event_Invalid, State_Failed, s->action_INVALID, count, "not a regular file", "regular files") == State_Failed)
+                rv = State_Failed;
+        if (_fileSetPost(s, &data, Event_Data, State_Failed, s->action_DATA, count, "cannot compute checksum", "data collected") == State_Failed)
+                rv = State_Failed;
+        if (s->checksum && _fileSetPost(s, &checksum, Event_Checksum, s->checksum->test_changes ? State_Changed : State_Failed, s->checksum->action, count, s->checksum->test_changes ? "checksum changed" : "checksum failed", s->checksum->test_changes ? "checksum has not changed" : "checksum is valid") == State_Failed)
+                rv = State_Failed;
+        if (s->perm && _fileSetPost(s, &perm, Event_Permission, s->perm->test_changes ? State_Changed : State_Failed, s->perm->action, count, s->perm->test_changes ? "permission changed" : "permission test failed", s->perm->test_changes ? "permission not changed" : "permission test succeeded") == State_Failed)
+                rv = State_Failed;
+        if (s->uid && _fileSetPost(s, &uid, Event_Uid, State_Failed, s->uid->action, count, "uid test failed", "uid test succeeded") == State_Failed)
+                rv = State_Failed;
+        if (s->gid && _fileSetPost(s, &gid, Event_Gid, State_Failed, s->gid->action, count, "gid test failed", "gid test succeeded") == State_Failed)
+                rv = State_Failed;
+        char buf[10];
+        for (Size_T sl = s->sizelist; sl; sl = sl->next) {
+                FileSetReport_T size = {};
+                for (int i = 0; i < count; i++) {
+                        if (st[i].st_mode && (sl->test_changes ? (set->records[i].known && set->records[i].size != st[i].st_size) : Util_evalQExpression(sl->operator, st[i].st_size, sl->size)))
+                                _fileSetReport(&size, set->records[i].path, " size %s", Str_bytesToSize(st[i].st_size, buf));
+                }
+                if (_fileSetPost(s, &size, Event_Size, sl->test_changes ? State_Changed : State_Failed, sl->action, count, sl->test_changes ? "size changed" : "size test failed", sl->test_changes ? "size has not changed" : "size check succeeded") == State_Failed)
+                        rv = State_Failed;
+        }
+        time_t now = Time_now();
+        for (Timestamp_T t = s->timestamplist; t; t = t->next) {
+                FileSetReport_T timestamp = {};
+                for (int i = 0; i < count; i++) {
+                        time_t current = MAX(st[i].st_mtime, st[i].st_ctime);
+                        if (st[i].st_mode && (t->test_changes ? (set->records[i].known && set->records[i].timestamp != current) : Util_evalQExpression(t->operator, now - current, t->time)))
+                                _fileSetReport(&timestamp, set->records[i].path, " timestamp %s", Time_string(current, (char[26]){}));
+                }
+                if (_fileSetPost(s, &timestamp, Event_Timestamp, t->test_changes ? State_Changed : State_Failed, t->action, count, t->test_changes ? "timestamp changed" : "timestamp test failed", t->test_changes ? "timestamp was not changed" : "timestamp test succeeded") == State_Failed)
+                        rv = State_Failed;
+        }
+        // Remember the values for the change tests and the checksum cache
+        for (int i = 0; i < count; i++) {
+                if (st[i].st_mode) {
+                        FileRecord_T r = &set->records[i];
+                        r->inode = st[i].st_ino;
+                        r->size = st[i].st_size;
+                        r->timestamp = MAX(st[i].st_mtime, st[i].st_ctime);
+                        file_getStatTimes(&st[i], &r->mtime, &r->ctime);
+                        r->mode = st[i].st_mode;
+                        r->uid = st[i].st_uid;
+                        r->gid = st[i].st_gid;
+                        if (sums)
+                                memcpy(r->sum, sums[i], sizeof(MD_T));
+                        r->known = true;
+                }
+        }
+        FREE(sums);
+        FREE(st);
+        s->inf->priv.file.size = total;
+        s->inf->priv.file.timestamp = newest;
+        Series_record(s);
+        if (_checkGrowth(s) == State_Failed)
+                rv = State_Failed;
+        return rv;
+}
+
+
+/**
+ * Test the directory tree checksum for changes, the event lists the changed paths
+ */
+static State_Type _checkTreeSum(Service_T s) {
+        State_Type rv;
+        StringBuffer_T changes = StringBuffer_create(256);
+        int count = TreeSum_update(s, changes);
+        if (count < 0) {
+                Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot read the directory tree");
+                rv = State_Failed;
+        } else {
+                if (! s->dirscan)
+                        Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "directory tree read");
+                if (count) {
+                        Event_post(s, Event_Checksum, State_Changed, s->treesum->action, "tree checksum changed to %s, %d paths changed:\n%s", s->treesum->hash, count, StringBuffer_toString(changes));
+                        rv = State_Changed;
+                } else {
+                        Event_post(s, Event_Checksum, State_ChangedNot, s->treesum->action, "tree checksum has not changed");
+                        rv = State_ChangedNot;
+                }
+        }
+        StringBuffer_free(&changes);
+        return rv;
+}
+
+
 /**
  * Test filesystem flags for possible change since last cycle
  */
@@ -952,92 +2521,616 @@ static State_Type _checkFilesystemResources(Service_T s, Filesystem_T td) {
 }
 
 
-static void _checkTimeout(Service_T s) {
-        if (s->actionratelist) {
-                /* Start counting cycles */
-                if (s->nstart > 0)
-                        s->ncycle++;
-                int max = 0;
-                for (ActionRate_T ar = s->actionratelist; ar; ar = ar->next) {
-                        if (max < ar->cycle)
-                                max = ar->cycle;
-                        if (s->nstart >= ar->count && s->ncycle <= ar->cycle)
-                                Event_post(s, Event_Timeout, State_Failed, ar->action, "service restarted %d times within %d cycles(s) - %s", s->nstart, s->ncycle, actionnames[ar->action->failed->id]);
-                }
-                /* Stop counting and reset if the cycle interval is succeeded */
-                if (s->ncycle > max) {
-                        s->ncycle = 0;
-                        s->nstart = 0;
-                }
+/**
+ * Filesystem quota test
+ */
+static State_Type _checkQuota(Service_T s, Quota_T q) {
+        ASSERT(s);
+        ASSERT(q);
+        const char *resource = q->inode ? "quota inode usage" : "quota usage";
+        if (! q->usage.found) {
+                DEBUG("'%s' no %s quota found for id %d\n", s->name, quotatypenames[q->type], q->id);
+                return State_Succeeded;
+        }
+        if (q->limit_percent >= 0.) {
+                if (q->usage.limit <= 0) {
+                        DEBUG("'%s' %s quota of id %d has no limit set\n", s->name, quotatypenames[q->type], q->id);
+                        return State_Succeeded;
+                }
+                double percent = 100. * (double)q->usage.used / (double)q->usage.limit;
+                if (Util_evalDoubleQExpression(q->operator, percent, q->limit_percent)) {
+                        Event_post(s, Event_Resource, State_Failed, q->action, "%s of %s %d %.1f%% matches resource limit [%s%s%.1f%%]", resource, quotatypenames[q->type], q->id, percent, resource, operatorshortnames[q->operator], q->limit_percent);
+                        return State_Failed;
+                }
+                Event_post(s, Event_Resource, State_Succeeded, q->action, "%s of %s %d test succeeded [current %s=%.1f%%]", resource, quotatypenames[q->type], q->id, resource, percent);
+        } else {
+                if (Util_evalQExpression(q->operator, q->usage.used, q->limit_absolute)) {
+                        if (q->inode) {
+                                Event_post(s, Event_Resource, State_Failed, q->action, "%s of %s %d %lld matches resource limit [%s%s%lld]", resource, quotatypenames[q->type], q->id, q->usage.used, resource, operatorshortnames[q->operator], q->limit_absolute);
+                        } else {
+                                char buf1[STRLEN];
+                                char buf2[STRLEN];
+                                Event_post(s, Event_Resource, State_Failed, q->action, "%s of %s %d %s matches resource limit [%s%s%s]", resource, quotatypenames[q->type], q->id, Str_bytesToSize(q->usage.used, buf1), resource, operatorshortnames[q->operator], Str_bytesToSize(q->limit_absolute, buf2));
+                        }
+                        return State_Failed;
+                }
+                Event_post(s, Event_Resource, State_Succeeded, q->action, "%s of %s %d test succeeded", resource, quotatypenames[q->type], q->id);
+        }
+        return State_Succeeded;
+}
+
+
+static void _checkTimeout(Service_T s) {
+        if (s->actionratelist) {
+                /* Start counting cycles */
+                if (s->nstart > 0)
+                        s->ncycle++;
+                int max = 0;
+                for (ActionRate_T ar = s->actionratelist; ar; ar = ar->next) {
+                        if (max < ar->cycle)
+                                max = ar->cycle;
+                        if (s->nstart >= ar->count && s->ncycle <= ar->cycle)
+                                Event_post(s, Event_Timeout, State_Failed, ar->action, "service restarted %d times within %d cycles(s) - %s", s->nstart, s->ncycle, actionnames[ar->action->failed->id]);
+                }
+                /* Stop counting and reset if the cycle interval is succeeded */
+                if (s->ncycle > max) {
+                        s->ncycle = 0;
+                        s->nstart = 0;
+                }
+        }
+}
+
+
+static boolean_t _incron(Service_T s, time_t now) {
+        if (now / 60 != s->every.last_run / 60) { // Minute is the lowest resolution, so only run once per minute
+                if (Cron_match(s->every.spec.cron.compiled, now)) {
+                        s->every.last_run = now;
+                        return true;
+                }
+        }
+        return false;
+}
+
+
+/**
+ * Adapt the check interval of the service to its health: a failed or changed
+ * service is re-checked sooner, between the cycles, and a service which has
+ * been stable for the set time is checked less often, the interval doubles
+ * with each check up to the set limit. The cron scheduled services are not
+ * affected.
+ */
+static void _adaptiveSchedule(Service_T s) {
+        if ((! Run.adaptive.failed && ! Run.adaptive.stable) || s->every.type == Every_Cron || s->every.type == Every_NotInCron)
+                return;
+        long long now = Time_milli();
+        s->adaptive.resume = 0;
+        if (s->error) {
+                s->adaptive.stable = 0;
+                s->adaptive.interval = 0;
+                s->adaptive.retry = Run.adaptive.failed ? now + Run.adaptive.failed * 1000LL : 0;
+                if (s->adaptive.retry && s->every.type == Every_Interval && s->adaptive.retry < s->every.spec.interval.next)
+                        s->every.spec.interval.next = s->adaptive.retry;
+                return;
+        }
+        s->adaptive.retry = 0;
+        if (! s->adaptive.stable)
+                s->adaptive.stable = now;
+        if (Run.adaptive.stable && now - s->adaptive.stable >= Run.adaptive.after * 1000LL) {
+                int base = s->every.type == Every_Interval ? s->every.spec.interval.seconds : Run.polltime;
+                s->adaptive.interval = MIN(MAX(s->adaptive.interval, base) * 2, Run.adaptive.stable);
+                if (s->adaptive.interval > base) {
+                        if (s->every.type == Every_Interval)
+                                s->every.spec.interval.next = now + s->adaptive.interval * 1000LL;
+                        else // Half a cycle of tolerance, so the cycle which ends just before the time doesn't skip the check
+                                s->adaptive.resume = now + s->adaptive.interval * 1000LL - Run.polltime * 500LL;
+                }
+        }
+}
+
+
+/**
+ * Returns true if the first check of the service is deferred by the startup ramp
+ */
+static boolean_t _checkRamp(Service_T s) {
+        if (s->ramp) {
+                long long remaining = s->ramp - Time_milli();
+                if (remaining > 0) {
+                        s->monitor |= Monitor_Waiting;
+                        DEBUG("'%s' test skipped as the first check is deferred by the startup ramp for %lld ms\n", s->name, remaining);
+                        return true;
+                }
+                s->ramp = 0;
+                s->monitor &= ~Monitor_Waiting;
+        }
+        return false;
+}
+
+
+/**
+ * Returns true if the host is checked by another cluster member
+ */
+static boolean_t _checkShard(Service_T s) {
+        if (s->type != Service_Host || Federation_isOwner(s->name))
+                return false;
+        s->monitor |= Monitor_Waiting;
+        DEBUG("'%s' test skipped as the host is checked by another cluster member\n", s->name);
+        return true;
+}
+
+
+/**
+ * Returns true if the check is deferred to the next cycle as the cycle budget is exhausted
+ */
+static boolean_t _checkBudget(Service_T s) {
+        if (! budget.deadline)
+                return false;
+        if (s->priority || s->deferred || s->type == Service_Program || s->type == Service_System || Time_milli() < budget.deadline) {
+                s->deferred = false;
+                return false;
+        }
+        s->deferred = true;
+        __atomic_add_fetch(&budget.count, 1, __ATOMIC_RELAXED);
+        DEBUG("'%s' test deferred to the next cycle as the cycle budget is exhausted\n", s->name);
+        return true;
+}
+
+
+/**
+ * Returns true if validation should be skiped for this service in this cycle, otherwise false. Handle every statement
+ */
+static boolean_t _checkSkip(Service_T s) {
+        ASSERT(s);
+        time_t now = Time_now();
+        if (s->adaptive.resume && Time_milli() < s->adaptive.resume) {
+                s->monitor |= Monitor_Waiting;
+                DEBUG("'%s' test skipped as the service is stable, the next check is in %lld ms\n", s->name, s->adaptive.resume - Time_milli());
+                return true;
+        }
+        // The fast re-check of a failed service doesn't wait for the cycles
+        if (s->every.type == Every_SkipCycles && ! (s->adaptive.retry && Time_milli() >= s->adaptive.retry)) {
+                s->every.spec.cycle.counter++;
+                if (s->every.spec.cycle.counter < s->every.spec.cycle.number) {
+                        s->monitor |= Monitor_Waiting;
+                        DEBUG("'%s' test skipped as current cycle (%d) < every cycle (%d) \n", s->name, s->every.spec.cycle.counter, s->every.spec.cycle.number);
+                        return true;
+                }
+                s->every.spec.cycle.counter = 0;
+        } else if (s->every.type == Every_Cron && ! _incron(s, now)) {
+                s->monitor |= Monitor_Waiting;
+                DEBUG("'%s' test skipped as current time (%lld) does not match every's cron spec \"%s\"\n", s->name, (long long)now, s->every.spec.cron.string);
+                return true;
+        } else if (s->every.type == Every_NotInCron && Cron_match(s->every.spec.cron.compiled, now)) {
+                s->monitor |= Monitor_Waiting;
+                DEBUG("'%s' test skipped as current time (%lld) matches every's cron spec \"not %s\"\n", s->name, (long long)now, s->every.spec.cron.string);
+                return true;
+        } else if (s->every.type == Every_Interval) {
+                long long milli = Time_milli();
+                if (milli < s->every.spec.interval.next) {
+                        s->monitor |= Monitor_Waiting;
+                        DEBUG("'%s' test skipped as the next check is scheduled in %lld ms\n", s->name, s->every.spec.interval.next - milli);
+                        return true;
+                }
+                s->every.spec.interval.next = milli + s->every.spec.interval.seconds * 1000LL;
+        }
+        s->monitor &= ~Monitor_Waiting;
+        // Skip the watched path if it didn't change
+        if ((s->type == Service_File || s->type == Service_Directory || s->type == Service_Fifo) && ! FileEvents_isPending(s)) {
+                DEBUG("'%s' test skipped as the watched path didn't change\n", s->name);
+                return true;
+        }
+        // Skip if parent is not initialized
+        for (Dependant_T d = s->dependantlist; d; d = d->next ) {
+                Service_T parent = d->service;
+                if (parent->monitor != Monitor_Yes) {
+                        DEBUG("'%s' test skipped as required service '%s' is %s\n", s->name, parent->name, parent->monitor == Monitor_Init ? "initializing" : "not monitored");
+                        return true;
+                } else if (parent->error) {
+                        DEBUG("'%s' test skipped as required service '%s' has errors\n", s->name, parent->name);
+                        return true;
+                }
+        }
+        return false;
+}
+
+
+/**
+ * Returns true if scheduled action was performed
+ */
+static boolean_t _doScheduledAction(Service_T s) {
+        int rv = false;
+        Action_Type action = s->doaction;
+        if (action != Action_Ignored) {
+                rv = control_service(s->name, action);
+                Event_post(s, Event_Action, State_Changed, s->action_ACTION, "%s action %s", actionnames[action], rv ? "done" : "failed");
+                FREE(s->token);
+        }
+        return rv;
+}
+
+
+/**
+ * Perform the pending actions of all services. The start, stop and restart
+ * actions are batched per action, so the services are processed concurrently
+ * in the dependency order (see control_services())
+ */
+static void _doScheduledActions() {
+        static const Action_Type batched[] = {Action_Stop, Action_Restart, Action_Start};
+        int count = Util_getNumberOfServices();
+        boolean_t *result = Arena_calloc(cycleArena, count ? count : 1, sizeof(boolean_t));
+        // Collect the batches first: a failed start schedules the retry for the next cycle, which must not be picked up in this pass
+        int sizes[3] = {};
+        Service_T *batches[3];
+        for (int i = 0; i < 3; i++)
+                batches[i] = Arena_calloc(cycleArena, count ? count : 1, sizeof(Service_T));
+        for (Service_T s = servicelist; s; s = s->next) {
+                int i;
+                for (i = 0; i < 3 && s->doaction != batched[i]; i++)
+                        ;
+                if (i < 3 && sizes[i] < count)
+                        batches[i][sizes[i]++] = s;
+                else
+                        _doScheduledAction(s);
+        }
+        for (int i = 0; i < 3; i++) {
+                if (sizes[i]) {
+                        control_services(batches[i], sizes[i], batched[i], result);
+                        for (int j = 0; j < sizes[i]; j++) {
+                                Service_T s = batches[i][j];
+                                Event_post(s, Event_Action, State_Changed, s->action_ACTION, "%s action %s", actionnames[batched[i]], result[j] ? "done" : "failed");
+                                FREE(s->token);
+                        }
+                }
+        }
+}
+
+
+/**
+ * Register PIDs of the monitored processes with the process events listener, so it can wake us up when some exits
+ */
+static void _watchProcesses() {
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Process && s->monitor != Monitor_Not && s->inf->priv.process.pid > 0)
+                        count++;
+        pid_t pids[count > 0 ? count : 1];
+        count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->type == Service_Process && s->monitor != Monitor_Not && s->inf->priv.process.pid > 0)
+                        pids[count++] = s->inf->priv.process.pid;
+        ProcessEvents_watch(pids, count);
+}
+
+
+/**
+ * Check the service if it is scheduled in this cycle
+ * @return true if the check failed
+ */
+static boolean_t _checkService(Service_T s) {
+        boolean_t failed = false;
+        // FIXME: The Service_Program must collect the exit value from last run, even if the program start should be skipped in this cycle => let check program always run the test (to be refactored with new scheduler)
+        if (! _doScheduledAction(s) && s->monitor && ! _checkRamp(s) && ! _checkShard(s) && (s->type == Service_Program || ! _checkSkip(s)) && ! _checkBudget(s)) {
+                _checkTimeout(s); // Can disable monitoring => need to check s->monitor again
+                if (s->monitor) {
+                        PROBE2(check_start, s->name, s->type);
+                        long long started = Profiler_now();
+                        State_Type state = s->check(s);
+                        Profiler_check(s, Profiler_now() - started);
+                        PROBE3(check_done, s->name, s->type, state);
+                        if (state != State_Init && s->monitor != Monitor_Not) // The monitoring can be disabled by some matching rule in s->check so we have to check again before setting to Monitor_Yes
+                                s->monitor = Monitor_Yes;
+                        if (state == State_Failed)
+                                failed = true;
+                        _adaptiveSchedule(s);
+                }
+                gettimeofday(&s->collected, NULL);
+        }
+        Snapshot_publish(s);
+        s->generation++;
+        return failed;
+}
+
+
+static int _compareJob(const void *a, const void *b) {
+        uintptr_t x = (uintptr_t)((const CheckJob_T *)a)->service;
+        uintptr_t y = (uintptr_t)((const CheckJob_T *)b)->service;
+        return x < y ? -1 : x > y ? 1 : 0;
+}
+
+
+/**
+ * Build the jobs for this cycle together with the dependency graph
+ * @return The number of jobs
+ */
+static int _executorPrepare() {
+        executor.count = Util_getNumberOfServices();
+        executor.done = executor.head = executor.tail = executor.errors = 0;
+        executor.jobs = Arena_calloc(cycleArena, MAX(1, executor.count), sizeof(CheckJob_T));
+        executor.queue = Arena_calloc(cycleArena, MAX(1, executor.count), sizeof(int));
+        // Lookup table from the service to its job, sorted by the service address
+        CheckJob_T *lookup = Arena_calloc(cycleArena, MAX(1, executor.count), sizeof(CheckJob_T));
+        int i = 0;
+        for (Service_T s = servicelist; s && i < executor.count; s = s->next, i++) {
+                executor.jobs[i].service = lookup[i].service = s;
+                lookup[i].offset = i;
+        }
+        executor.count = i;
+        qsort(lookup, executor.count, sizeof(CheckJob_T), _compareJob);
+        // Count the dependants of each service, then connect them (the list is sorted topologically, so the dependencies precede their dependants)
+        int edges = 0;
+        for (int pass = 0; pass < 2; pass++) {
+                if (pass) {
+                        for (i = 0, edges = 0; i < executor.count; i++) {
+                                executor.jobs[i].offset = edges;
+                                edges += executor.jobs[i].count;
+                                executor.jobs[i].count = 0;
+                        }
+                        executor.dependants = Arena_calloc(cycleArena, edges ? edges : 1, sizeof(int));
+                }
+                for (i = 0; i < executor.count; i++) {
+                        for (Dependant_T d = executor.jobs[i].service->dependantlist; d; d = d->next) {
+                                CheckJob_T key = {.service = d->service};
+                                CheckJob_T *found = key.service ? bsearch(&key, lookup, executor.count, sizeof(CheckJob_T), _compareJob) : NULL;
+                                if (found) {
+                                        CheckJob_T *parent = &executor.jobs[found->offset];
+                                        if (pass)
+                                                executor.dependants[parent->offset + parent->count] = i;
+                                        else
+                                                executor.jobs[i].pending++;
+                                        parent->count++;
+                                }
+                        }
+                }
+        }
+        for (i = 0; i < executor.count; i++)
+                if (executor.jobs[i].pending == 0)
+                        executor.queue[executor.tail++] = i;
+        return executor.count;
+}
+
+
+static void *_executorWorker(void *args) {
+        set_signal_block();
+        LOCK(executor.mutex)
+        {
+                while (executor.done < executor.count) {
+                        if (executor.head == executor.tail) {
+                                Sem_wait(executor.ready, executor.mutex);
+                                continue;
+                        }
+                        CheckJob_T *job = &executor.jobs[executor.queue[executor.head++]];
+                        if (! (Run.flags & Run_Stopped) && _checkService(job->service))
+                                executor.errors++;
+                        for (int i = job->offset; i < job->offset + job->count; i++)
+                                if (--executor.jobs[executor.dependants[i]].pending == 0)
+                                        executor.queue[executor.tail++] = executor.dependants[i];
+                        executor.done++;
+                        Sem_broadcast(executor.ready);
+                }
+        }
+        END_LOCK;
+        return NULL;
+}
+
+
+/**
+ * Check the services using the pool of worker threads
+ * @return The number of failed services
+ */
+static int _executorRun() {
+        int workers = MAX(1, MIN(Run.checkEngine.workers, _executorPrepare()));
+        Thread_T threads[workers];
+        Mutex_init(executor.mutex);
+        Sem_init(executor.ready);
+        executor.active = true;
+        for (int i = 0; i < workers; i++)
+                Thread_create(threads[i], _executorWorker, NULL);
+        for (int i = 0; i < workers; i++)
+                Thread_join(threads[i]);
+        executor.active = false;
+        Sem_destroy(executor.ready);
+        Mutex_destroy(executor.mutex);
+        executor.jobs = NULL;
+        executor.queue = executor.dependants = NULL;
+        return executor.errors;
+}
+
+
+/**
+ * @return The time of the next check of the scheduled service [ms] or 0 if the service won't be checked
+ */
+static long long _schedulerDeadline(Service_T s, time_t now) {
+        if (s->ramp)
+                return s->ramp;
+        if (s->every.type == Every_Interval)
+                return s->every.spec.interval.next;
+        // The cycle checked service is scheduled only for the fast re-check after a failure
+        if (s->every.type != Every_Cron)
+                return s->adaptive.retry;
+        // The cron service is due in the first matching minute after the last run (if it didn't run in the last minute, the current minute can match too)
+        time_t next = Cron_nextFire(s->every.spec.cron.compiled, MAX(s->every.last_run, now - 60));
+        return next * 1000LL;
+}
+
+
+/**
+ * The service was due, but the check was skipped (for example due to a dependency) => wait for the next deadline
+ */
+static void _schedulerPostpone(Service_T s, long long now) {
+        s->ramp = 0;
+        if (s->every.type == Every_Interval)
+                s->every.spec.interval.next = now + s->every.spec.interval.seconds * 1000LL;
+        else if (s->every.type == Every_Cron)
+                s->every.last_run = now / 1000;
+        else if (Run.adaptive.failed) // Without the fast re-check the service waits for the next cycle
+                s->adaptive.retry = now + Run.adaptive.failed * 1000LL;
+}
+
+
+static void _schedulerPush(Service_T s, long long deadline) {
+        if (! deadline)
+                return;
+        if (scheduler.count == scheduler.size) {
+                scheduler.size = scheduler.size ? scheduler.size * 2 : 16;
+                RESIZE(scheduler.heap, scheduler.size * sizeof(ScheduledCheck_T));
         }
+        int i = scheduler.count++;
+        for (int parent = (i - 1) / 2; i > 0 && scheduler.heap[parent].deadline > deadline; i = parent, parent = (i - 1) / 2)
+                scheduler.heap[i] = scheduler.heap[parent];
+        scheduler.heap[i] = (ScheduledCheck_T){.deadline = deadline, .service = s};
 }
 
 
-static boolean_t _incron(Service_T s, time_t now) {
-        if ((now - s->every.last_run) > 59) { // Minute is the lowest resolution, so only run once per minute
-                if (Time_incron(s->every.spec.cron, now)) {
-                        s->every.last_run = now;
-                        return true;
-                }
+static Service_T _schedulerPop() {
+        Service_T s = scheduler.heap[0].service;
+        ScheduledCheck_T last = scheduler.heap[--scheduler.count];
+        int i = 0;
+        for (int child = 1; child < scheduler.count; i = child, child = 2 * i + 1) {
+                if (child + 1 < scheduler.count && scheduler.heap[child + 1].deadline < scheduler.heap[child].deadline)
+                        child++;
+                if (last.deadline <= scheduler.heap[child].deadline)
+                        break;
+                scheduler.heap[i] = scheduler.heap[child];
         }
-        return false;
+        if (scheduler.count)
+                scheduler.heap[i] = last;
+        return s;
 }
 
 
 /**
- * Returns true if validation should be skiped for this service in this cycle, otherwise false. Handle every statement
+ * Rebuild the scheduler heap from the service list (the list changes on reload)
  */
-static boolean_t _checkSkip(Service_T s) {
-        ASSERT(s);
+static void _schedulerBuild() {
         time_t now = Time_now();
-        if (s->every.type == Every_SkipCycles) {
-                s->every.spec.cycle.counter++;
-                if (s->every.spec.cycle.counter < s->every.spec.cycle.number) {
-                        s->monitor |= Monitor_Waiting;
-                        DEBUG("'%s' test skipped as current cycle (%d) < every cycle (%d) \n", s->name, s->every.spec.cycle.counter, s->every.spec.cycle.number);
-                        return true;
-                }
-                s->every.spec.cycle.counter = 0;
-        } else if (s->every.type == Every_Cron && ! _incron(s, now)) {
-                s->monitor |= Monitor_Waiting;
-                DEBUG("'%s' test skipped as current time (%lld) does not match every's cron spec \"%s\"\n", s->name, (long long)now, s->every.spec.cron);
-                return true;
-        } else if (s->every.type == Every_NotInCron && Time_incron(s->every.spec.cron, now)) {
-                s->monitor |= Monitor_Waiting;
-                DEBUG("'%s' test skipped as current time (%lld) matches every's cron spec \"not %s\"\n", s->name, (long long)now, s->every.spec.cron);
-                return true;
+        scheduler.count = 0;
+        for (Service_T s = servicelist; s; s = s->next)
+                if (s->every.type == Every_Interval || s->every.type == Every_Cron || s->adaptive.retry || s->ramp)
+                        _schedulerPush(s, _schedulerDeadline(s, now));
+}
+
+
+/**
+ * Spread the checks across the poll cycle: wait until the slot of the index-th
+ * of count services, relative to the cycle start. The wait is interrupted as
+ * soon as Monit is stopped, reloaded, woken up or an action is pending.
+ */
+static void _spreadCheck(int index, int count, long long start) {
+        long long slot = start + Run.polltime * 1000LL * index / count;
+        for (long long now = Time_milli(); now < slot; now = Time_milli()) {
+                if (Run.flags & (Run_Stopped | Run_DoReload | Run_DoWakeup | Run_ActionPending))
+                        break;
+                Time_usleep((slot - now > 1000 ? 1000 : slot - now) * 1000);
         }
-        s->monitor &= ~Monitor_Waiting;
-        // Skip if parent is not initialized
-        for (Dependant_T d = s->dependantlist; d; d = d->next ) {
-                Service_T parent = Util_getService(d->dependant);
-                if (parent->monitor != Monitor_Yes) {
-                        DEBUG("'%s' test skipped as required service '%s' is %s\n", s->name, parent->name, parent->monitor == Monitor_Init ? "initializing" : "not monitored");
-                        return true;
-                } else if (parent->error) {
-                        DEBUG("'%s' test skipped as required service '%s' has errors\n", s->name, parent->name);
-                        return true;
+}
+
+
+/**
+ * Evaluate the program or plugin exit status and resource usage against the status and resource tests
+ */
+static State_Type _programEvaluate(Service_T s) {
+        State_Type rv = State_Succeeded;
+        // Evaluate program's exit status against our status checks.
+        for (Status_T status = s->statuslist; status; status = status->next) {
+                if (status->operator == Operator_Changed) {
+                        if (status->initialized) {
+                                if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
+                                        Event_post(s, Event_Status, State_Changed, status->action, "program status changed (%d -> %d) -- %s", status->return_value, s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
+                                        status->return_value = s->program->exitStatus;
+                                } else {
+                                        Event_post(s, Event_Status, State_ChangedNot, status->action, "program status didn't change [status=%d] -- %s", s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
+                                }
+                        } else {
+                                status->initialized = true;
+                                status->return_value = s->program->exitStatus;
+                        }
+                } else {
+                        if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
+                                rv = State_Failed;
+                                Event_post(s, Event_Status, State_Failed, status->action, "'%s' failed with exit status (%d) -- %s", s->path, s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
+                        } else {
+                                Event_post(s, Event_Status, State_Succeeded, status->action, "status succeeded [status=%d] -- %s", s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
+                        }
                 }
         }
-        return false;
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (_checkProgramResources(s, r) == State_Failed)
+                        rv = State_Failed;
+        return rv;
 }
 
 
 /**
- * Returns true if scheduled action was performed
+ * Evaluate the exit status and the output of the program which exited and
+ * release the program process
  */
-static boolean_t _doScheduledAction(Service_T s) {
-        int rv = false;
-        Action_Type action = s->doaction;
-        if (action != Action_Ignored) {
-                rv = control_service(s->name, action);
-                Event_post(s, Event_Action, State_Changed, s->action_ACTION, "%s action %s", actionnames[action], rv ? "done" : "failed");
-                FREE(s->token);
+static State_Type _programStatus(Service_T s) {
+        State_Type rv = State_Succeeded;
+        Process_T P = s->program->P;
+        s->program->exitStatus = Process_exitStatus(P); // Save exit status for web-view display
+        s->program->usage.cpuTime = Process_getCpuTime(P);
+        s->program->usage.memory = Process_getMaxMemory(P);
+        s->program->usage.runTime = Process_getRunTime(P);
+        // Save program output, the capture keeps the last part if the output was longer than the limit
+        StringBuffer_clear(s->program->output);
+        if (s->program->capture) {
+                if (Capture_collect(s->program->capture, s->program->output))
+                        DEBUG("'%s' program output truncated to the last %d bytes\n", s->name, StringBuffer_length(s->program->output));
+                Capture_free(&s->program->capture);
+        }
+        StringBuffer_trim(s->program->output);
+        rv = _programEvaluate(s);
+        Process_free(&s->program->P);
+        return rv;
+}
+
+
+/**
+ * Run the in-process plugin check and evaluate its status. Unlike the program, the result is available immediately.
+ */
+static State_Type _checkPlugin(Service_T s) {
+        // The program services are not skipped by _checkService(), see check_program()
+        if (_checkSkip(s))
+                return State_Init;
+        State_Type rv = State_Succeeded;
+        s->program->started = Time_now();
+        StringBuffer_clear(s->program->output);
+        s->program->exitStatus = Plugin_check(s->program->plugin, s->program->output, &s->program->usage);
+        StringBuffer_trim(s->program->output);
+        if (s->program->usage.runTime > Plugin_getTimeout(s->program->plugin)) {
+                rv = State_Failed;
+                LogError("'%s' plugin check exceeded its time budget of %s [run time %s]\n", s->name, Str_milliToTime(Plugin_getTimeout(s->program->plugin), (char[23]){}), Str_milliToTime(s->program->usage.runTime, (char[23]){}));
         }
+        if (_programEvaluate(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
 
+/**
+ * Collect the exit status of the check programs which exited since the last
+ * check, so the result doesn't wait for the next cycle. The program is
+ * started again by its regular check.
+ * @return The number of failed services
+ */
+static int _collectPrograms() {
+        int errors = 0;
+        for (Service_T s = servicelist; s && ! (Run.flags & Run_Stopped); s = s->next) {
+                if (s->type == Service_Program && s->monitor != Monitor_Not && s->program->P && Process_exitStatus(s->program->P) >= 0) {
+                        DEBUG("'%s' program exited, collecting the status\n", s->name);
+                        State_Type state = _programStatus(s);
+                        if (s->monitor != Monitor_Not)
+                                s->monitor = Monitor_Yes;
+                        if (state == State_Failed)
+                                errors++;
+                        gettimeofday(&s->collected, NULL);
+                        Snapshot_publish(s);
+                        s->generation++;
+                }
+        }
+        return errors;
+}
+
+
 /* ---------------------------------------------------------------- Public */
 
 
@@ -1047,42 +3140,268 @@ static boolean_t _doScheduledAction(Service_T s) {
  *  they will pass all defined tests.
  */
 int validate() {
+        long long cycle = Profiler_now(), phase = cycle;
+        if (cycleArena)
+                Arena_reset(cycleArena);
+        else
+                cycleArena = Arena_new(CYCLE_ARENA);
         Run.handler_flag = Handler_Succeeded;
         Event_queue_process();
+        Alert_flush(false);
+        Profiler_phase(Phase_EventQueue, Profiler_now() - phase);
+        FileEvents_poll(0); // Collect the path changes which were not picked up yet
 
+        phase = Profiler_now();
         update_system_info();
+        Profiler_phase(Phase_SystemInfo, Profiler_now() - phase);
+        phase = Profiler_now();
         ProcessTree_init(ProcessEngine_None);
+        Profiler_phase(Phase_ProcessTree, Profiler_now() - phase);
+        Run.self.memory = ProcessTree_getProcessMemory(getpid());
+        Run.self.queue = Event_queue_count() + Delivery_count();
         gettimeofday(&systeminfo.collected, NULL);
+        filesystem_invalidate(); // The filesystem usage statistics are shared by the services in this cycle
+        SockTable_invalidate(); // The TCP connection table is shared by the socket services in this cycle
+        PortShare_invalidate(); // The connection test results are shared by the services in this cycle
+        phase = Profiler_now();
+        StatBatch_run();
+        Profiler_phase(Phase_StatBatch, Profiler_now() - phase);
+        phase = Profiler_now();
+        Ping_run();
+        Profiler_phase(Phase_PingBatch, Profiler_now() - phase);
+        phase = Profiler_now();
+        UdpBatch_run();
+        Profiler_phase(Phase_UdpBatch, Profiler_now() - phase);
 
         /* In the case that at least one action is pending, perform quick loop to handle the actions ASAP */
         if (Run.flags & Run_ActionPending) {
                 Run.flags &= ~Run_ActionPending;
-                for (Service_T s = servicelist; s; s = s->next)
-                        _doScheduledAction(s);
+                _doScheduledActions();
         }
 
         int errors = 0;
         /* Check the services */
-        for (Service_T s = servicelist; s; s = s->next) {
-                if (Run.flags & Run_Stopped)
-                        break;
-                // FIXME: The Service_Program must collect the exit value from last run, even if the program start should be skipped in this cycle => let check program always run the test (to be refactored with new scheduler)
-                if (! _doScheduledAction(s) && s->monitor && (s->type == Service_Program || ! _checkSkip(s))) {
-                        _checkTimeout(s); // Can disable monitoring => need to check s->monitor again
-                        if (s->monitor) {
-                                State_Type state = s->check(s);
-                                if (state != State_Init && s->monitor != Monitor_Not) // The monitoring can be disabled by some matching rule in s->check so we have to check again before setting to Monitor_Yes
-                                        s->monitor = Monitor_Yes;
-                                if (state == State_Failed)
-                                        errors++;
+        phase = Profiler_now();
+        budget.deadline = Run.cycle.budget && ! (Run.flags & Run_Once) ? Time_milli() + Run.cycle.budget : 0;
+        budget.count = 0;
+        if (Run.checkEngine.workers > 1) {
+                errors = _executorRun();
+        } else {
+                int index = 0, count = 0;
+                long long start = Time_milli();
+                boolean_t spread = (Run.flags & Run_PacingSpread) && ! (Run.flags & Run_Once);
+                if (spread)
+                        for (Service_T s = servicelist; s; s = s->next)
+                                count++;
+                for (Service_T s = servicelist; s; s = s->next, index++) {
+                        if (spread) {
+                                // The wait for the slot doesn't consume the budget
+                                long long waiting = Time_milli();
+                                _spreadCheck(index, count, start);
+                                if (budget.deadline)
+                                        budget.deadline += Time_milli() - waiting;
+                        }
+                        if (Run.flags & Run_Stopped)
+                                break;
+                        if (_checkService(s))
+                                errors++;
+                }
+        }
+        Profiler_phase(Phase_Checks, Profiler_now() - phase);
+        if (budget.count && ! Run.cycle.last)
+                LogWarning("The cycle budget of %d ms is exhausted, %d checks are deferred to the next cycle\n", Run.cycle.budget, budget.count);
+        else if (! budget.count && Run.cycle.last && Run.cycle.budget)
+                LogInfo("The checks fit in the cycle budget of %d ms again\n", Run.cycle.budget);
+        Run.cycle.deferrals += budget.count;
+        Run.cycle.last = budget.count;
+        budget.deadline = 0;
+        if (ProcessEvents_isRunning())
+                _watchProcesses();
+        _schedulerBuild();
+        long long elapsed = Profiler_now() - cycle;
+        Profiler_phase(Phase_Cycle, elapsed);
+        Counter_cycle();
+        Run.self.cycle = elapsed / 1000;
+        StatusSegment_update();
+        return errors;
+}
+
+
+/**
+ * Check the services with own check interval which are due, the services
+ * whose watched path changed and the network services whose link changed,
+ * and collect the status of the check programs
+ * which exited. It is called by the daemon between the poll cycles.
+ * @return The number of failed services
+ */
+int validate_scheduled() {
+        long long now = Time_milli();
+        int due = 0;
+        Service_T *services = NULL;
+        // Pop all due services first, so the system and process data are collected once for all of them
+        while (scheduler.count && scheduler.heap[0].deadline <= now) {
+                Service_T s = _schedulerPop();
+                long long deadline = _schedulerDeadline(s, now / 1000);
+                if (deadline > now || ! deadline) {
+                        _schedulerPush(s, deadline);
+                } else {
+                        RESIZE(services, (due + 1) * sizeof(Service_T));
+                        services[due++] = s;
+                }
+        }
+        int scheduled = due;
+        if (FileEvents_hasChanged()) {
+                for (Service_T s = servicelist; s; s = s->next) {
+                        if (s->every.type != Every_Interval && s->every.type != Every_Cron && ! s->adaptive.retry && FileEvents_isChanged(s)) {
+                                RESIZE(services, (due + 1) * sizeof(Service_T));
+                                services[due++] = s;
+                        }
+                }
+        }
+        if (LinkEvents_hasChanged()) {
+                for (Service_T s = servicelist; s; s = s->next) {
+                        if (! LinkEvents_isChanged(s))
+                                continue;
+                        if (s->every.type != Every_Interval && s->every.type != Every_Cron && ! s->adaptive.retry) {
+                                // The link change ends the stable period of the adaptive interval
+                                s->adaptive.resume = 0;
+                                RESIZE(services, (due + 1) * sizeof(Service_T));
+                                services[due++] = s;
+                        } else {
+                                // The service is checked at its own time
+                                LinkEvents_checked(s);
+                        }
+                }
+        }
+        int errors = 0;
+        if (childExited) {
+                childExited = 0;
+                Run.handler_flag = Handler_Succeeded;
+                errors += _collectPrograms();
+        }
+        if (due) {
+                Run.handler_flag = Handler_Succeeded;
+                update_system_info();
+                ProcessTree_init(ProcessEngine_None);
+                gettimeofday(&systeminfo.collected, NULL);
+                SockTable_invalidate();
+                PortShare_invalidate();
+                for (int i = 0; i < due; i++) {
+                        if (! (Run.flags & Run_Stopped) && _checkService(services[i]))
+                                errors++;
+                        if (i < scheduled) {
+                                // The service deadline was advanced by the check (or it is still due if the check was postponed by a dependency or action), a recovered service is not rescheduled
+                                long long deadline = _schedulerDeadline(services[i], now / 1000);
+                                if (deadline && deadline <= now)
+                                        _schedulerPostpone(services[i], now);
+                                _schedulerPush(services[i], _schedulerDeadline(services[i], now / 1000));
+                        } else if (FileEvents_isChanged(services[i])) {
+                                // The check was skipped (for example the service is not monitored) => consider the change handled
+                                FileEvents_isPending(services[i]);
+                        } else {
+                                LinkEvents_checked(services[i]);
                         }
-                        gettimeofday(&s->collected, NULL);
                 }
+                FREE(services);
         }
+        StatusSegment_update();
         return errors;
 }
 
 
+/**
+ * Start the startup ramp after the service list was built or reloaded: the
+ * first check of each service which was not checked yet is deferred by an
+ * offset within the ramp window, derived from the service name hash. The
+ * deferred service is checked by validate_scheduled() when its time comes,
+ * so the /proc scans, connections and program executions of the first cycle
+ * are spread over the window instead of running all at once. The offset is
+ * stable, the service gets the same slot after each restart.
+ */
+void validate_ramp() {
+        Run.startupRamp.end = 0;
+        if (! Run.startupRamp.window || (Run.flags & Run_Once))
+                return;
+        long long now = Time_milli();
+        long long window = Run.startupRamp.window * 1000LL;
+        int count = 0;
+        for (Service_T s = servicelist; s; s = s->next) {
+                // The system service data is collected each cycle anyway and the reused services were checked already
+                if (s->type != Service_System && ! s->collected.tv_sec) {
+                        s->ramp = now + Str_hash(s->name) % window;
+                        count++;
+                }
+        }
+        if (count) {
+                Run.startupRamp.end = now + window;
+                LogInfo("Startup ramp: the first check of %d services is spread over %s\n", count, Str_milliToTime(window, (char[23]){}));
+                _schedulerBuild();
+        }
+}
+
+
+/**
+ * Note that some child process exited. Called from the SIGCHLD handler, so
+ * it only sets a flag, the exit status is collected by validate_scheduled()
+ */
+void validate_childexit() {
+        childExited = 1;
+}
+
+
+/**
+ * @return The time of the next scheduled check of a service with own check
+ * interval or of a service with changed path or link or exited program [ms], 0 if
+ * there is no such service
+ */
+long long validate_next() {
+        if (FileEvents_hasChanged() || LinkEvents_hasChanged() || childExited)
+                return Time_milli();
+        return scheduler.count ? scheduler.heap[0].deadline : 0;
+}
+
+
+/**
+ * Walk the service list of the control file as the daemon does in each cycle
+ * and print the cost per service of each walk as one JSON object: the
+ * validation loop and the scheduler rebuild, the state file update and the
+ * delta status poll. The services are not monitored during the benchmark, so
+ * the walks measure the service list iteration and the per service work of
+ * the loops, not the tests. The first cycle is not measured.
+ * @param cycles Number of measured cycles
+ */
+void validate_benchmark(int cycles) {
+        int count = Util_getNumberOfServices();
+        for (Service_T s = servicelist; s; s = s->next)
+                s->monitor = Monitor_Not;
+        if (! State_open())
+                exit(1);
+        StringBuffer_T B = StringBuffer_create(1024);
+        long long check = 0LL, state = 0LL, status = 0LL;
+        for (int i = 0; i <= cycles; i++) {
+                long long start = Time_monotonicMicro();
+                for (Service_T s = servicelist; s; s = s->next)
+                        _checkService(s);
+                _schedulerBuild();
+                long long checked = Time_monotonicMicro();
+                State_save();
+                long long saved = Time_monotonicMicro();
+                StringBuffer_clear(B);
+                status_json(B, NULL, __atomic_load_n(&Run.generation, __ATOMIC_ACQUIRE));
+                if (i) {
+                        check += checked - start;
+                        state += saved - checked;
+                        status += Time_monotonicMicro() - saved;
+                }
+        }
+        double scale = 1000. / ((double)cycles * count);
+        printf("{\"services\": %d, \"cycles\": %d, \"service_size\": %zu, \"validate_ns_per_service\": %.1f, \"state_save_ns_per_service\": %.1f, \"status_ns_per_service\": %.1f}\n",
+               count, cycles, sizeof(struct myservice), check * scale, state * scale, status * scale);
+        StringBuffer_free(&B);
+        State_close();
+}
+
+
 /**
  * Validate a given process service s. Events are posted according to
  * its configuration. In case of a fatal event false is returned.
@@ -1122,34 +3441,34 @@ State_Type check_process(Service_T s) {
                                 rv = State_Failed;
                         if (_checkUptime(s, s->inf->priv.process.uptime) == State_Failed)
                                 rv = State_Failed;
-                        for (Resource_T pr = s->resourcelist; pr; pr = pr->next)
-                                if (_checkProcessResources(s, pr) == State_Failed)
-                                        rv = State_Failed;
+                        Series_record(s);
+                        if (_checkResourcePlan(s) == State_Failed)
+                                rv = State_Failed;
                 } else {
                         LogError("'%s' failed to get service data\n", s->name);
                         rv = State_Failed;
                 }
         }
-        for (Port_T pp = s->portlist; pp; pp = pp->next) {
-                /* pause port tests in the start timeout timeframe while the process is starting (it may take some time to the process before it starts accepting connections) */
-                if (! s->start || s->inf->priv.process.uptime > s->start->timeout) {
-                        if (_checkConnection(s, pp) == State_Failed)
-                                rv = State_Failed;
-                } else {
+        /* pause port and socket tests in the start timeout timeframe while the process is starting (it may take some time to the process before it starts accepting connections) */
+        if (! s->start || s->inf->priv.process.uptime > s->start->timeout) {
+                if (_checkConnections(s, s->portlist) == State_Failed)
+                        rv = State_Failed;
+                if (_checkConnections(s, s->socketlist) == State_Failed)
+                        rv = State_Failed;
+                if (_checkResponseTimes(s) == State_Failed)
+                        rv = State_Failed;
+        } else {
+                for (Port_T pp = s->portlist; pp; pp = pp->next) {
                         pp->is_available = Connection_Init;
                         DEBUG("'%s' connection test paused for %lld seconds while the process is starting\n", s->name, (long long)(s->start->timeout - (s->inf->priv.process.uptime < 0 ? 0 : s->inf->priv.process.uptime)));
                 }
-        }
-        for (Port_T pp = s->socketlist; pp; pp = pp->next) {
-                /* pause socket tests in the start timeout timeframe while the process is starting (it may take some time to the process before it starts accepting connections) */
-                if (! s->start || s->inf->priv.process.uptime > s->start->timeout) {
-                        if (_checkConnection(s, pp) == State_Failed)
-                                rv = State_Failed;
-                } else {
+                for (Port_T pp = s->socketlist; pp; pp = pp->next) {
                         pp->is_available = Connection_Init;
                         DEBUG("'%s' connection test paused for %lld seconds while the process is starting\n", s->name, (long long)(s->start->timeout - (s->inf->priv.process.uptime < 0 ? 0 : s->inf->priv.process.uptime)));
                 }
         }
+        if (_checkGrowth(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
@@ -1175,9 +3494,18 @@ State_Type check_filesystem(Service_T s) {
                 rv = State_Failed;
         if (_checkFilesystemFlags(s) == State_Failed)
                 rv = State_Failed;
+        Series_record(s);
         for (Filesystem_T fs = s->filesystemlist; fs; fs = fs->next)
                 if (_checkFilesystemResources(s, fs) == State_Failed)
                         rv = State_Failed;
+        for (Quota_T q = s->quotalist; q; q = q->next)
+                if (_checkQuota(s, q) == State_Failed)
+                        rv = State_Failed;
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (_checkFilesystemIO(s, r) == State_Failed)
+                        rv = State_Failed;
+        if (_checkGrowth(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
@@ -1189,9 +3517,11 @@ State_Type check_filesystem(Service_T s) {
 State_Type check_file(Service_T s) {
         ASSERT(s);
         ASSERT(s->inf);
+        if (s->fileset)
+                return _checkFileSet(s);
         struct stat stat_buf;
         State_Type rv = State_Succeeded;
-        if (stat(s->path, &stat_buf) != 0) {
+        if (StatBatch_stat(s, &stat_buf) != 0) {
                 for (Nonexist_T l = s->nonexistlist; l; l = l->next)
                         Event_post(s, Event_Nonexist, State_Failed, l->action, "file doesn't exist");
                 return State_Failed;
@@ -1219,7 +3549,7 @@ State_Type check_file(Service_T s) {
         } else {
                 Event_post(s, Event_Invalid, State_Succeeded, s->action_INVALID, "is a regular file or socket");
         }
-        if (_checkChecksum(s) == State_Failed)
+        if (_checkChecksum(s, &stat_buf) == State_Failed)
                 rv = State_Failed;
         if (_checkPerm(s, s->inf->priv.file.mode) == State_Failed)
                 rv = State_Failed;
@@ -1231,7 +3561,10 @@ State_Type check_file(Service_T s) {
                 rv = State_Failed;
         if (_checkTimestamp(s, s->inf->priv.file.timestamp) == State_Failed)
                 rv = State_Failed;
-        if (_checkMatch(s) == State_Failed)
+        if (_checkMatch(s, &stat_buf) == State_Failed)
+                rv = State_Failed;
+        Series_record(s);
+        if (_checkGrowth(s) == State_Failed)
                 rv = State_Failed;
         return rv;
 }
@@ -1246,7 +3579,7 @@ State_Type check_directory(Service_T s) {
         ASSERT(s->inf);
         struct stat stat_buf;
         State_Type rv = State_Succeeded;
-        if (stat(s->path, &stat_buf) != 0) {
+        if (StatBatch_stat(s, &stat_buf) != 0) {
                 for (Nonexist_T l = s->nonexistlist; l; l = l->next)
                         Event_post(s, Event_Nonexist, State_Failed, l->action, "directory doesn't exist");
                 return State_Failed;
@@ -1272,6 +3605,22 @@ State_Type check_directory(Service_T s) {
                 rv = State_Failed;
         if (_checkTimestamp(s, s->inf->priv.directory.timestamp) == State_Failed)
                 rv = State_Failed;
+        if (s->dirscan) {
+                if (DirScan_scan(s)) {
+                        Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "directory scanned");
+                        Series_record(s);
+                        for (Resource_T r = s->resourcelist; r; r = r->next)
+                                if (_checkDirectoryResources(s, r) == State_Failed)
+                                        rv = State_Failed;
+                } else {
+                        Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot scan directory");
+                        rv = State_Failed;
+                }
+        }
+        if (s->treesum && _checkTreeSum(s) == State_Failed)
+                rv = State_Failed;
+        if (_checkGrowth(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
@@ -1285,7 +3634,7 @@ State_Type check_fifo(Service_T s) {
         ASSERT(s->inf);
         struct stat stat_buf;
         State_Type rv = State_Succeeded;
-        if (stat(s->path, &stat_buf) != 0) {
+        if (StatBatch_stat(s, &stat_buf) != 0) {
                 for (Nonexist_T l = s->nonexistlist; l; l = l->next)
                         Event_post(s, Event_Nonexist, State_Failed, l->action, "fifo doesn't exist");
                 return State_Failed;
@@ -1322,6 +3671,8 @@ State_Type check_fifo(Service_T s) {
 State_Type check_program(Service_T s) {
         ASSERT(s);
         ASSERT(s->program);
+        if (s->program->plugin)
+                return _checkPlugin(s);
         State_Type rv = State_Succeeded;
         time_t now = Time_now();
         Process_T P = s->program->P;
@@ -1340,36 +3691,8 @@ State_Type check_program(Service_T s) {
                                 return State_Init;
                         }
                 }
-                s->program->exitStatus = Process_exitStatus(P); // Save exit status for web-view display
-                // Save program output
-                StringBuffer_clear(s->program->output);
-                _programOutput(Process_getErrorStream(P), s->program->output);
-                _programOutput(Process_getInputStream(P), s->program->output);
-                StringBuffer_trim(s->program->output);
-                // Evaluate program's exit status against our status checks.
-                for (Status_T status = s->statuslist; status; status = status->next) {
-                        if (status->operator == Operator_Changed) {
-                                if (status->initialized) {
-                                        if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
-                                                Event_post(s, Event_Status, State_Changed, status->action, "program status changed (%d -> %d) -- %s", status->return_value, s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
-                                                status->return_value = s->program->exitStatus;
-                                        } else {
-                                                Event_post(s, Event_Status, State_ChangedNot, status->action, "program status didn't change [status=%d] -- %s", s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
-                                        }
-                                } else {
-                                        status->initialized = true;
-                                        status->return_value = s->program->exitStatus;
-                                }
-                        } else {
-                                if (Util_evalQExpression(status->operator, s->program->exitStatus, status->return_value)) {
-                                        rv = State_Failed;
-                                        Event_post(s, Event_Status, State_Failed, status->action, "'%s' failed with exit status (%d) -- %s", s->path, s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
-                                } else {
-                                        Event_post(s, Event_Status, State_Succeeded, status->action, "status succeeded [status=%d] -- %s", s->program->exitStatus, StringBuffer_length(s->program->output) ? StringBuffer_toString(s->program->output) : "no output");
-                                }
-                        }
-                }
-                Process_free(&s->program->P);
+                if (_programStatus(s) == State_Failed)
+                        rv = State_Failed;
         } else {
                 rv = State_Init;
         }
@@ -1381,6 +3704,7 @@ State_Type check_program(Service_T s) {
                         rv = State_Failed;
                         Event_post(s, Event_Status, State_Failed, s->action_EXEC, "failed to execute '%s' -- %s", s->path, STRERROR);
                 } else {
+                        s->program->capture = Capture_new(s->program->P, s->program->outputLimit >= 0 ? s->program->outputLimit : (int)Run.limits.programOutput);
                         Event_post(s, Event_Status, State_Succeeded, s->action_EXEC, "program started");
                         s->program->started = now;
                 }
@@ -1402,7 +3726,9 @@ State_Type check_remote_host(Service_T s) {
         for (Icmp_T icmp = s->icmplist; icmp; icmp = icmp->next) {
                 switch (icmp->type) {
                         case ICMP_ECHO:
-                                icmp->response = icmp_echo(s->path, icmp->family, &(icmp->outgoing), icmp->size, icmp->timeout, icmp->count);
+                                _executorRelease();
+                                icmp->response = Ping_echo(s, icmp);
+                                _executorAcquire();
                                 if (icmp->response == -2) {
                                         icmp->is_available = Connection_Init;
 #ifdef SOLARIS
@@ -1416,7 +3742,10 @@ State_Type check_remote_host(Service_T s) {
                                         Event_post(s, Event_Icmp, State_Failed, icmp->action, "ping test failed");
                                 } else {
                                         icmp->is_available = Connection_Ok;
-                                        Event_post(s, Event_Icmp, State_Succeeded, icmp->action, "ping test succeeded [response time %s]", Str_milliToTime(icmp->response, (char[23]){}));
+                                        if (icmp->loss >= 0)
+                                                Event_post(s, Event_Icmp, State_Succeeded, icmp->action, "ping test succeeded [response time %s, jitter %s, loss %d%%]", Str_milliToTime(icmp->response, (char[23]){}), Str_milliToTime(icmp->jitter, (char[23]){}), icmp->loss);
+                                        else
+                                                Event_post(s, Event_Icmp, State_Succeeded, icmp->action, "ping test succeeded [response time %s]", Str_milliToTime(icmp->response, (char[23]){}));
                                 }
                                 last_ping = icmp;
                                 break;
@@ -1431,13 +3760,38 @@ State_Type check_remote_host(Service_T s) {
                 return State_Failed;
         }
         /* Test each host:port and protocol in the service's portlist */
-        for (Port_T p = s->portlist; p; p = p->next)
-                if (_checkConnection(s, p) == State_Failed)
-                        rv = State_Failed;
+        if (_checkConnections(s, s->portlist) == State_Failed)
+                rv = State_Failed;
+        if (_checkResponseTimes(s) == State_Failed)
+                rv = State_Failed;
+        if (_checkGrowth(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
 
+/**
+ * Compile the resource tests of a process or system service to a dense
+ * array of metric accessors, operators and limits in the resourcelist
+ * order. Called by the parser once the service list was built.
+ */
+void compile_resources(Service_T s) {
+        ASSERT(s);
+        int count = 0;
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                count++;
+        s->resourceplan.count = count;
+        s->resourceplan.rules = count ? Arena_calloc(s->region, count, sizeof(struct myresourcerule)) : NULL;
+        count = 0;
+        for (Resource_T r = s->resourcelist; r; r = r->next, count++) {
+                s->resourceplan.rules[count].value = _resourceAccessor(s, r);
+                s->resourceplan.rules[count].operator = r->operator;
+                s->resourceplan.rules[count].limit = r->limit;
+                s->resourceplan.rules[count].resource = r;
+        }
+}
+
+
 /**
  * Validate the general system indicators. In case of a fatal event
  * false is returned.
@@ -1445,31 +3799,26 @@ State_Type check_remote_host(Service_T s) {
 State_Type check_system(Service_T s) {
         ASSERT(s);
         State_Type rv = State_Succeeded;
-        for (Resource_T r = s->resourcelist; r; r = r->next)
-                if (_checkProcessResources(s, r) == State_Failed)
-                        rv = State_Failed;
+        Series_record(s);
+        if (_checkResourcePlan(s) == State_Failed)
+                rv = State_Failed;
         if (_checkUptime(s, Time_now() - systeminfo.booted) == State_Failed)
                 rv = State_Failed;
+        if (_checkGrowth(s) == State_Failed)
+                rv = State_Failed;
         return rv;
 }
 
 
 State_Type check_net(Service_T s) {
-        boolean_t havedata = true;
+        LinkEvents_checked(s);
         State_Type rv = State_Succeeded;
-        TRY
-        {
-                Link_update(s->inf->priv.net.stats);
-        }
-        ELSE
-        {
-                havedata = false;
+        char error[STRLEN];
+        if (! Link_tryUpdate(s->inf->priv.net.stats, error, sizeof(error))) {
                 for (LinkStatus_T link = s->linkstatuslist; link; link = link->next)
-                        Event_post(s, Event_Link, State_Failed, link->action, "link data gathering failed -- %s", Exception_frame.message);
-        }
-        END_TRY;
-        if (! havedata)
+                        Event_post(s, Event_Link, State_Failed, link->action, "link data gathering failed -- %s", error);
                 return State_Failed; // Terminate test if no data are available
+        }
         for (LinkStatus_T link = s->linkstatuslist; link; link = link->next) {
                 Event_post(s, Event_Size, State_Succeeded, link->action, "link data gathering succeeded");
         }
@@ -1556,7 +3905,10 @@ State_Type check_net(Service_T s) {
                                         obytes = Link_getBytesOutPerHour(s->inf->priv.net.stats, upload->rangecount);
                                 break;
                         default:
-                                obytes = Link_getBytesOutPerSecond(s->inf->priv.net.stats);
+                                if (upload->rangecount > 1) // Average rate over the last seconds
+                                        obytes = Link_getBytesOutPerSecondAverage(s->inf->priv.net.stats, upload->rangecount);
+                                else
+                                        obytes = Link_getBytesOutPerSecond(s->inf->priv.net.stats);
                                 break;
                 }
                 if (Util_evalQExpression(upload->operator, obytes, upload->limit))
@@ -1577,7 +3929,10 @@ State_Type check_net(Service_T s) {
                                         opackets = Link_getPacketsOutPerHour(s->inf->priv.net.stats, upload->rangecount);
                                 break;
                         default:
-                                opackets = Link_getPacketsOutPerSecond(s->inf->priv.net.stats);
+                                if (upload->rangecount > 1) // Average rate over the last seconds
+                                        opackets = Link_getPacketsOutPerSecondAverage(s->inf->priv.net.stats, upload->rangecount);
+                                else
+                                        opackets = Link_getPacketsOutPerSecond(s->inf->priv.net.stats);
                                 break;
                 }
                 if (Util_evalQExpression(upload->operator, opackets, upload->limit))
@@ -1599,7 +3954,10 @@ State_Type check_net(Service_T s) {
                                         ibytes = Link_getBytesInPerHour(s->inf->priv.net.stats, download->rangecount);
                                 break;
                         default:
-                                ibytes = Link_getBytesInPerSecond(s->inf->priv.net.stats);
+                                if (download->rangecount > 1) // Average rate over the last seconds
+                                        ibytes = Link_getBytesInPerSecondAverage(s->inf->priv.net.stats, download->rangecount);
+                                else
+                                        ibytes = Link_getBytesInPerSecond(s->inf->priv.net.stats);
                                 break;
                 }
                 if (Util_evalQExpression(download->operator, ibytes, download->limit))
@@ -1620,7 +3978,10 @@ State_Type check_net(Service_T s) {
                                         ipackets = Link_getPacketsInPerHour(s->inf->priv.net.stats, download->rangecount);
                                 break;
                         default:
-                                ipackets = Link_getPacketsInPerSecond(s->inf->priv.net.stats);
+                                if (download->rangecount > 1) // Average rate over the last seconds
+                                        ipackets = Link_getPacketsInPerSecondAverage(s->inf->priv.net.stats, download->rangecount);
+                                else
+                                        ipackets = Link_getPacketsInPerSecond(s->inf->priv.net.stats);
                                 break;
                 }
                 if (Util_evalQExpression(download->operator, ipackets, download->limit))
@@ -1631,3 +3992,63 @@ State_Type check_net(Service_T s) {
         return rv;
 }
 
+
+State_Type check_socket(Service_T s) {
+        ASSERT(s);
+        if (! SockTable_update(s)) {
+                Util_resetInfo(s);
+                if (s->path)
+                        Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot read the sockets of the process in '%s'", s->path);
+                else
+                        Event_post(s, Event_Data, State_Failed, s->action_DATA, "cannot read the socket table");
+                return State_Failed;
+        }
+        Event_post(s, Event_Data, State_Succeeded, s->action_DATA, "socket table read");
+        State_Type rv = State_Succeeded;
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (_checkSocketResources(s, r) == State_Failed)
+                        rv = State_Failed;
+        return rv;
+}
+
+
+State_Type check_heartbeat(Service_T s) {
+        ASSERT(s);
+        ASSERT(s->heartbeat);
+        Heartbeat_T h = s->heartbeat;
+        long long now = Time_monotonic();
+        long long received = __atomic_load_n(&h->received, __ATOMIC_ACQUIRE);
+        if (! h->started)
+                h->started = now; // The deadline runs from the monitoring start until the first heartbeat
+        long long since = received > h->started ? received : h->started;
+        s->inf->priv.heartbeat.timestamp = __atomic_load_n(&h->timestamp, __ATOMIC_RELAXED);
+        s->inf->priv.heartbeat.count = __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        s->inf->priv.heartbeat.age = (now - since) / 1000;
+        if (now - since > h->timeout * 1000LL) {
+                if (received > h->started)
+                        Event_post(s, Event_Heartbeat, State_Failed, h->action, "no heartbeat for %llds [deadline %ds]", s->inf->priv.heartbeat.age, h->timeout);
+                else
+                        Event_post(s, Event_Heartbeat, State_Failed, h->action, "no heartbeat received since %llds [deadline %ds]", s->inf->priv.heartbeat.age, h->timeout);
+                return State_Failed;
+        }
+        if (received > h->started)
+                Event_post(s, Event_Heartbeat, State_Succeeded, h->action, "heartbeat received %llds ago", s->inf->priv.heartbeat.age);
+        else
+                Event_post(s, Event_Heartbeat, State_Succeeded, h->action, "waiting for the first heartbeat since %llds", s->inf->priv.heartbeat.age);
+        return State_Succeeded;
+}
+
+
+State_Type check_metric(Service_T s) {
+        ASSERT(s);
+        if (! Statsd_collect(s)) {
+                DEBUG("'%s' no metric sample received yet\n", s->name);
+                return State_Succeeded;
+        }
+        State_Type rv = State_Succeeded;
+        for (Resource_T r = s->resourcelist; r; r = r->next)
+                if (_checkMetricResources(s, r) == State_Failed)
+                        rv = State_Failed;
+        return rv;
+}
+
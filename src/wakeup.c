@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#include "config.h"
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#endif
+
+#ifdef HAVE_LIMITS_H
+#include <limits.h>
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#endif
+
+#include "monit.h"
+#include "fileevents.h"
+#include "linkevents.h"
+#include "wakeup.h"
+
+
+/**
+ *  Self-pipe wakeup of the daemon main loop. Wakeup_signal() writes a byte
+ *  to a non-blocking pipe (a full pipe means a wakeup is already pending),
+ *  Wakeup_wait() polls the pipe together with the file and link events
+ *  descriptors and drains it.
+ *
+ *  @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+static int _pipe[2] = {-1, -1};
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static boolean_t _setFlags(int fd) {
+        int flags = fcntl(fd, F_GETFL);
+        return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1 && fcntl(fd, F_SETFD, FD_CLOEXEC) != -1;
+}
+
+
+static void _drain(void) {
+        char buf[64];
+        while (read(_pipe[0], buf, sizeof(buf)) > 0)
+                ;
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+boolean_t Wakeup_init(void) {
+        if (_pipe[0] >= 0)
+                return true;
+        if (pipe(_pipe) == -1) {
+                LogError("Cannot create the wakeup pipe -- %s\n", STRERROR);
+                return false;
+        }
+        if (! _setFlags(_pipe[0]) || ! _setFlags(_pipe[1])) {
+                LogError("Cannot set the wakeup pipe flags -- %s\n", STRERROR);
+                close(_pipe[0]);
+                close(_pipe[1]);
+                _pipe[0] = _pipe[1] = -1;
+                return false;
+        }
+        return true;
+}
+
+
+void Wakeup_signal(void) {
+        if (_pipe[1] >= 0) {
+                int saved = errno;
+                // If the pipe is full (EAGAIN), a wakeup is pending already
+                ssize_t __attribute__((unused)) written = write(_pipe[1], "", 1);
+                errno = saved;
+        }
+}
+
+
+boolean_t Wakeup_wait(long long timeout) {
+        if (timeout < 0)
+                timeout = 0;
+        if (_pipe[0] < 0) {
+                if (FileEvents_isRunning()) {
+                        FileEvents_poll(timeout);
+                } else {
+                        struct timespec t = {.tv_sec = timeout / 1000, .tv_nsec = (timeout % 1000) * 1000000};
+                        nanosleep(&t, NULL);
+                }
+                return false;
+        }
+        struct pollfd p[3] = {
+                {.fd = _pipe[0], .events = POLLIN},
+                {.fd = FileEvents_descriptor(), .events = POLLIN}, // Negative descriptor is ignored by poll
+                {.fd = LinkEvents_descriptor(), .events = POLLIN}
+        };
+        int rv = poll(p, 3, timeout > INT_MAX ? INT_MAX : (int)timeout);
+        if (rv > 0) {
+                if (p[1].revents & POLLIN)
+                        FileEvents_poll(0);
+                if (p[2].revents & POLLIN)
+                        LinkEvents_poll();
+                if (p[0].revents & POLLIN) {
+                        _drain();
+                        return true;
+                }
+        } else if (rv == -1 && errno == EINTR) {
+                // The signal handler has written to the pipe already
+                _drain();
+                return true;
+        }
+        return false;
+}
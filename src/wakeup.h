@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+
+#ifndef MONIT_WAKEUP_H
+#define MONIT_WAKEUP_H
+
+
+/**
+ * Wakeup of the daemon main loop. The main loop waits for the next check in
+ * Wakeup_wait(), which returns as soon as Wakeup_signal() is called (from a
+ * signal handler or from another thread, such as the HTTP interface after a
+ * user action), a watched path or a network link changed. The wakeup is kept until the wait,
+ * so a request which arrives while the daemon is validating or just before
+ * it goes to sleep is not lost.
+ *
+ * @file
+ */
+
+
+/**
+ * Create the wakeup pipe
+ * @return true if succeeded, otherwise false (Wakeup_wait() then falls back
+ * to sleep and is interrupted by the signals only)
+ */
+boolean_t Wakeup_init(void);
+
+
+/**
+ * Wake up the main loop. The function is async-signal-safe and can be called
+ * from any thread
+ */
+void Wakeup_signal(void);
+
+
+/**
+ * Wait until Wakeup_signal() is called, a watched path changed or the
+ * timeout expired. The path changes are collected with FileEvents_poll().
+ * @param timeout Maximum wait time in milliseconds
+ * @return true if the main loop was awakened, otherwise false
+ */
+boolean_t Wakeup_wait(long long timeout);
+
+
+#endif
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) Tildeslash Ltd. All rights reserved.
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License version 3.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * In addition, as a special exception, the copyright holders give
+ * permission to link the code of portions of this program with the
+ * OpenSSL library under certain conditions as described in each
+ * individual source file, and distribute linked combinations
+ * including the two.
+ *
+ * You must obey the GNU Affero General Public License in all respects
+ * for all of the code used other than OpenSSL.
+ */
+
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#ifdef HAVE_STDINT_H
+#include <stdint.h>
+#endif
+
+#include "xxhash.h"
+
+
+/**
+ * The XXH64 non-cryptographic hash (xxHash by Yann Collet, seed 0). It is
+ * several times faster than MD5 and suitable for change detection, but
+ * must not be used where the file may be modified by an attacker. The
+ * digest is stored in big endian order, matching the xxh64sum output.
+ *
+ * @file
+ */
+
+
+/* ------------------------------------------------------------- Definitions */
+
+
+#define P1 0x9E3779B185EBCA87ULL
+#define P2 0xC2B2AE3D27D4EB4FULL
+#define P3 0x165667B19E3779F9ULL
+#define P4 0x85EBCA77C2B2AE63ULL
+#define P5 0x27D4EB2F165667C5ULL
+
+#define rol(value, bits) (((value) << (bits)) | ((value) >> (64 - (bits))))
+
+
+/* ----------------------------------------------------------------- Private */
+
+
+static inline uint64_t _read64(const unsigned char *p) {
+        return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16 | (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40 | (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+
+static inline uint32_t _read32(const unsigned char *p) {
+        return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static inline uint64_t _round(uint64_t acc, uint64_t input) {
+        acc += input * P2;
+        acc = rol(acc, 31);
+        return acc * P1;
+}
+
+
+static inline uint64_t _merge(uint64_t acc, uint64_t value) {
+        acc ^= _round(0, value);
+        return acc * P1 + P4;
+}
+
+
+static inline void _stripe(uint64_t v[4], const unsigned char *p) {
+        v[0] = _round(v[0], _read64(p));
+        v[1] = _round(v[1], _read64(p + 8));
+        v[2] = _round(v[2], _read64(p + 16));
+        v[3] = _round(v[3], _read64(p + 24));
+}
+
+
+/* ------------------------------------------------------------------ Public */
+
+
+void xxh64_init(xxh64_context_t *context) {
+        memset(context, 0, sizeof(*context));
+        context->v[0] = P1 + P2;
+        context->v[1] = P2;
+        context->v[2] = 0;
+        context->v[3] = -P1;
+}
+
+
+void xxh64_append(xxh64_context_t *context, const unsigned char *data, size_t len) {
+        context->total += len;
+        if (context->used + len < 32) {
+                memcpy(context->buffer + context->used, data, len);
+                context->used += len;
+                return;
+        }
+        if (context->used) {
+                size_t fill = 32 - context->used;
+                memcpy(context->buffer + context->used, data, fill);
+                _stripe(context->v, context->buffer);
+                data += fill;
+                len -= fill;
+                context->used = 0;
+        }
+        for (; len >= 32; data += 32, len -= 32)
+                _stripe(context->v, data);
+        if (len) {
+                memcpy(context->buffer, data, len);
+                context->used = len;
+        }
+}
+
+
+void xxh64_finish(xxh64_context_t *context, unsigned char digest[XXH64_DIGEST_SIZE]) {
+        uint64_t h;
+        if (context->total >= 32) {
+                h = rol(context->v[0], 1) + rol(context->v[1], 7) + rol(context->v[2], 12) + rol(context->v[3], 18);
+                for (int i = 0; i < 4; i++)
+                        h = _merge(h, context->v[i]);
+        } else {
+                h = P5;
+        }
+        h += context->total;
+        const unsigned char *p = context->buffer, *end = context->buffer + context->used;
+        for (; p + 8 <= end; p += 8) {
+                h ^= _round(0, _read64(p));
+                h = rol(h, 27) * P1 + P4;
+        }
+        if (p + 4 <= end) {
+                h ^= (uint64_t)_read32(p) * P1;
+                h = rol(h, 23) * P2 + P3;
+                p += 4;
+        }
+        for (; p < end; p++) {
+                h ^= *p * P5;
+                h = rol(h, 11) * P1;
+        }
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        for (int i = 0; i < 8; i++)
+                digest[i] = (unsigned char)(h >> (56 - i * 8));
+        memset(context, 0, sizeof(*context));
+}
+